@@ -26,7 +26,6 @@
 #include "./SockHop.h"
 #include <ccn/fetch.h>
 
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -44,14 +43,21 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <strings.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define HAVE_EPOLL 1
+#endif
 
-#define FetchBuffers 8
+#define FetchBuffers 32
 #define RobustMillis 40
+#define MaxBusyLimit 4096
+#define MaxWorkers 64
 
 #define CCN_CHUNK_SIZE 4096
 
@@ -61,14 +67,30 @@ typedef struct RequestBaseStruct *RequestBase;
 
 typedef struct MainBaseStruct *MainBase;
 
-typedef struct SelectDataStruct *SelectData;
+typedef struct EventSetStruct *EventSet;
 
-struct SelectDataStruct {
-	int fdLen;
-	fd_set readFDS;
-	fd_set writeFDS;
-	fd_set errorFDS;
-	struct timeval selectTimeout;
+typedef enum {
+	Event_Read = 1,
+	Event_Write = 2,
+	Event_Error = 4
+} EventBits;
+
+// The descriptors to wait on are gathered before each wait into want, and
+// the EventBits seen for each are left in ready, indexed by fd.  There is
+// no limit on fd values, unlike fd_set.  With epoll the kernel keeps the
+// interest set between waits, so enrolled tracks what it has, and only the
+// changes from the previous wait (in prev) cost a system call.
+struct EventSetStruct {
+	int nWant;
+	int nPrev;
+	int maxWant;
+	struct pollfd *want;
+	struct pollfd *prev;
+	int fdLimit;
+	unsigned char *ready;
+	unsigned char *enrolled;
+	int *slot;
+	int epfd;
 };
 
 typedef struct ParseItemStruct *ParseItem;
@@ -132,7 +154,7 @@ struct MainBaseStruct {
 	int hostFromGet;
 	uint64_t nChanges;
 	uint64_t startTime;
-	struct SelectDataStruct sds;
+	struct EventSetStruct events;
 	struct StatsStruct stats;
 };
 
@@ -157,6 +179,9 @@ typedef struct HttpInfoStruct {
 	int forceClose;
 	int cookie;
 	int hasRange;
+	int rangeOK;		// a single byte range that CCN can serve
+	int64_t rangeFirst;	// < 0 means the last rangeLast bytes
+	int64_t rangeLast;	// < 0 means to the end
 	int hasReferer;
 	int keepAlive;
 	int proxyConn;
@@ -184,6 +209,12 @@ typedef struct ChunkInfoStruct {
 	ChunkState prev;
 } *ChunkInfo;
 
+typedef enum {
+	Range_None,			// pass the stored reply through as is
+	Range_Header,		// reading the stored reply header
+	Range_Body			// sending the requested bytes of the body
+} RangeState;
+
 typedef enum {
 	RB_None,
 	RB_Start,
@@ -203,8 +234,11 @@ struct RequestBaseStruct {
 	string request;
 	string shortName;
 	struct ccn_fetch_stream * fetchStream;
+	RangeState rangeState;
+	int64_t rangeRem;
 	int recvOff;
 	int sendOff;
+	int sendPending;
 	int origin;
 	int index;
 	int maxConn;
@@ -607,9 +641,11 @@ RobustSendmsg(RequestBase rb, SockEntry se) {
 					   nb, len);
 				flushLog(f);
 				rb->sendOff = rb->sendOff + nb;
+				rb->sendPending = 1;
 			} else {
 				// we finally sent everything
 				rb->sendOff = 0;
+				rb->sendPending = 0;
 			}
 			return nb;
 		}
@@ -633,6 +669,41 @@ RobustSendmsg(RequestBase rb, SockEntry se) {
 	}
 }
 
+static ssize_t
+TrySendmsg(RequestBase rb, SockEntry se) {
+	// like RobustSendmsg, but never waits for the socket
+	// whatever is not sent stays in the buffer, with rb->sendPending set,
+	// until the socket is ready for more
+	struct msghdr *mp = &rb->msg;
+	rb->iov.iov_base = ((char *) rb->buffer) + rb->sendOff;
+	ssize_t len = rb->bufferLen - rb->sendOff;
+	rb->iov.iov_len = len;
+	if (len <= 0) {
+		rb->sendOff = 0;
+		rb->sendPending = 0;
+		return 0;
+	}
+	ssize_t nb = sendmsg(se->fd, mp, MSG_DONTWAIT);
+	if (nb >= 0) {
+		if (nb < len) {
+			rb->sendOff = rb->sendOff + nb;
+			rb->sendPending = 1;
+		} else {
+			rb->sendOff = 0;
+			rb->sendPending = 0;
+		}
+		return nb;
+	}
+	int e = errno;
+	if (e == EAGAIN || e == EWOULDBLOCK || e == EINTR) {
+		rb->sendPending = 1;
+		return 0;
+	}
+	se->errCount++;
+	SetRequestErr(rb, "TrySendmsg failed", 1);
+	return -1;
+}
+
 static int
 copySockAddr(MainBase mb, struct sockaddr *dst, struct sockaddr *src) {
 	sa_family_t fam = src->sa_family;
@@ -658,14 +729,208 @@ diagSockAddr(FILE *f, string prefix, string host, SockEntry se) {
 	flushLog(f);
 }
 
+////////////////////////////////
+// EventSet support
+////////////////////////////////
+
+static void
+InitEventSet(EventSet es) {
+	memset(es, 0, sizeof(*es));
+	es->epfd = -1;
+#ifdef HAVE_EPOLL
+	es->epfd = epoll_create(64);
+	if (es->epfd >= 0) fcntl(es->epfd, F_SETFD, FD_CLOEXEC);
+#endif
+}
+
+static void
+FreeEventSet(EventSet es) {
+	if (es->epfd >= 0) close(es->epfd);
+	free(es->want);
+	free(es->prev);
+	free(es->ready);
+	free(es->enrolled);
+	free(es->slot);
+	memset(es, 0, sizeof(*es));
+	es->epfd = -1;
+}
+
+static int
+GrowEventSet(EventSet es, int fd) {
+	if (fd >= es->fdLimit) {
+		int n = es->fdLimit * 2 + 64;
+		while (n <= fd) n = n * 2;
+		unsigned char *ready = ProxyUtil_Alloc(n, unsigned char);
+		unsigned char *enrolled = ProxyUtil_Alloc(n, unsigned char);
+		int *slot = ProxyUtil_Alloc(n, int);
+		if (ready == NULL || enrolled == NULL || slot == NULL) {
+			free(ready);
+			free(enrolled);
+			free(slot);
+			return -1;
+		}
+		if (es->fdLimit > 0) {
+			memcpy(ready, es->ready, es->fdLimit);
+			memcpy(enrolled, es->enrolled, es->fdLimit);
+			memcpy(slot, es->slot, es->fdLimit * sizeof(int));
+		}
+		free(es->ready);
+		free(es->enrolled);
+		free(es->slot);
+		es->ready = ready;
+		es->enrolled = enrolled;
+		es->slot = slot;
+		es->fdLimit = n;
+	}
+	if (es->nWant >= es->maxWant) {
+		int n = es->maxWant * 2 + 16;
+		struct pollfd *want = ProxyUtil_Alloc(n, struct pollfd);
+		struct pollfd *prev = ProxyUtil_Alloc(n, struct pollfd);
+		if (want == NULL || prev == NULL) {
+			free(want);
+			free(prev);
+			return -1;
+		}
+		if (es->maxWant > 0) {
+			memcpy(want, es->want, es->nWant * sizeof(struct pollfd));
+			memcpy(prev, es->prev, es->nPrev * sizeof(struct pollfd));
+		}
+		free(es->want);
+		free(es->prev);
+		es->want = want;
+		es->prev = prev;
+		es->maxWant = n;
+	}
+	return 0;
+}
+
 static void
-InitSelectData(SelectData sd, uint64_t timeoutUsecs) {
-	FD_ZERO(&sd->readFDS);
-	FD_ZERO(&sd->writeFDS);
-	FD_ZERO(&sd->errorFDS);
-	sd->selectTimeout.tv_sec = (timeoutUsecs / 1000000);
-	sd->selectTimeout.tv_usec = (timeoutUsecs % 1000000);
-	sd->fdLen = 0;
+WantEvents(EventSet es, int fd, EventBits bits) {
+	// adds to the events wanted for fd in the next wait
+	// a descriptor may be wanted by more than one request
+	if (fd < 0 || GrowEventSet(es, fd) < 0) return;
+	short events = 0;
+	if (bits & Event_Read) events |= POLLIN;
+	if (bits & Event_Write) events |= POLLOUT;
+	int k = es->slot[fd];
+	if (k == 0) {
+		struct pollfd *pfd = &es->want[es->nWant];
+		pfd->fd = fd;
+		pfd->events = 0;
+		pfd->revents = 0;
+		es->nWant++;
+		k = es->nWant;
+		es->slot[fd] = k;
+	}
+	es->want[k-1].events |= events;
+}
+
+static void
+ForgetEvents(EventSet es, int fd) {
+	// the fd is being closed, so the kernel forgets it as well
+	if (fd >= 0 && fd < es->fdLimit) {
+		es->enrolled[fd] = 0;
+		es->ready[fd] = 0;
+	}
+}
+
+static EventBits
+ReventsToBits(short want, short revents) {
+	EventBits bits = 0;
+	if (revents & POLLIN) bits |= Event_Read;
+	if (revents & POLLOUT) bits |= Event_Write;
+	if (revents & (POLLERR | POLLHUP)) {
+		// let the reader or writer see the error
+		bits |= Event_Error;
+		if (want & POLLIN) bits |= Event_Read;
+		if (want & POLLOUT) bits |= Event_Write;
+	}
+	return bits;
+}
+
+static int
+WaitForEvents(EventSet es, int timeoutMillis) {
+	// waits for any of the wanted events, then resets the wanted set
+	// returns the number of descriptors with events, or -1 for error
+	int res = 0;
+	int i;
+	for (i = 0; i < es->nPrev; i++)
+		es->ready[es->prev[i].fd] = 0;
+	for (i = 0; i < es->nWant; i++)
+		es->ready[es->want[i].fd] = 0;
+	if (es->epfd >= 0) {
+#ifdef HAVE_EPOLL
+		// bring the kernel up to date, first dropping the fds not wanted
+		for (i = 0; i < es->nPrev; i++) {
+			int fd = es->prev[i].fd;
+			if (es->slot[fd] == 0 && es->enrolled[fd] != 0) {
+				struct epoll_event ev;
+				memset(&ev, 0, sizeof(ev));
+				epoll_ctl(es->epfd, EPOLL_CTL_DEL, fd, &ev);
+				es->enrolled[fd] = 0;
+			}
+		}
+		for (i = 0; i < es->nWant; i++) {
+			struct pollfd *pfd = &es->want[i];
+			int fd = pfd->fd;
+			unsigned char have = es->enrolled[fd];
+			unsigned char need = Event_Error;
+			if (pfd->events & POLLIN) need |= Event_Read;
+			if (pfd->events & POLLOUT) need |= Event_Write;
+			if (have != need) {
+				struct epoll_event ev;
+				memset(&ev, 0, sizeof(ev));
+				if (need & Event_Read) ev.events |= EPOLLIN;
+				if (need & Event_Write) ev.events |= EPOLLOUT;
+				ev.data.fd = fd;
+				int op = ((have == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+				int cres = epoll_ctl(es->epfd, op, fd, &ev);
+				if (cres < 0 && errno == ENOENT)
+					cres = epoll_ctl(es->epfd, EPOLL_CTL_ADD, fd, &ev);
+				else if (cres < 0 && errno == EEXIST)
+					cres = epoll_ctl(es->epfd, EPOLL_CTL_MOD, fd, &ev);
+				es->enrolled[fd] = ((cres < 0) ? 0 : need);
+			}
+		}
+		struct epoll_event evs[64];
+		res = epoll_wait(es->epfd, evs, 64, timeoutMillis);
+		for (i = 0; i < res; i++) {
+			int fd = evs[i].data.fd;
+			short revents = 0;
+			if (evs[i].events & EPOLLIN) revents |= POLLIN;
+			if (evs[i].events & EPOLLOUT) revents |= POLLOUT;
+			if (evs[i].events & EPOLLERR) revents |= POLLERR;
+			if (evs[i].events & EPOLLHUP) revents |= POLLHUP;
+			int k = es->slot[fd];
+			if (k > 0)
+				es->ready[fd] = ReventsToBits(es->want[k-1].events, revents);
+		}
+#endif
+	} else {
+		res = poll(es->want, es->nWant, timeoutMillis);
+		for (i = 0; i < es->nWant && res > 0; i++) {
+			struct pollfd *pfd = &es->want[i];
+			es->ready[pfd->fd] = ReventsToBits(pfd->events, pfd->revents);
+		}
+	}
+	// this wait's set becomes the previous set
+	for (i = 0; i < es->nWant; i++)
+		es->slot[es->want[i].fd] = 0;
+	struct pollfd *prev = es->prev;
+	es->prev = es->want;
+	es->nPrev = es->nWant;
+	es->want = prev;
+	es->nWant = 0;
+	return res;
+}
+
+static int
+TakeEvent(EventSet es, int fd, EventBits bit) {
+	// tests and clears the given event for fd from the last wait
+	if (fd < 0 || fd >= es->fdLimit) return 0;
+	int res = es->ready[fd] & bit;
+	es->ready[fd] &= ~bit;
+	return res;
 }
 
 static void
@@ -916,22 +1181,24 @@ DestroyRequestBase(RequestBase rb) {
 }
 
 static void
-TrySelect(MainBase mb) {
+TrySelect(MainBase mb, int timeout) {
+	EventSet es = &mb->events;
 	int sockFD = mb->sockFD;
-	int timeout = 20;
-	InitSelectData(&mb->sds, timeout);
 	
-	// first, make sure that CCN wakes up
-	int max = mb->ccnFD;
-	FD_SET(max, &mb->sds.readFDS);
-	FD_SET(max, &mb->sds.errorFDS);
-
-	// gather up all of the potential bits we need
+	// first, make sure that CCN wakes up, and that its work is done in time
+	struct ccn *h = ccn_fetch_get_ccn(mb->fetchBase);
+	short ccnEvents = POLLIN;
+	int usecs = ccn_prepare_poll(h, &ccnEvents);
+	if (usecs >= 0 && usecs < timeout * 1000)
+		timeout = (usecs + 999) / 1000;
+	EventBits ccnBits = Event_Read;
+	if (ccnEvents & POLLOUT) ccnBits |= Event_Write;
+	WantEvents(es, mb->ccnFD, ccnBits);
+	
+	// gather up all of the potential events we need
 	if ((mb->requestCount - mb->requestDone) < mb->maxBusy) {
 		// we could start a new request
-		if (sockFD > max) max = sockFD;
-		FD_SET(sockFD, &mb->sds.readFDS);
-		FD_SET(sockFD, &mb->sds.errorFDS);
+		WantEvents(es, sockFD, Event_Read);
 	}
 	RequestBase rb = mb->requestList;
 	while (rb != NULL) {
@@ -939,44 +1206,36 @@ TrySelect(MainBase mb) {
 		if (rb->seSrc != NULL && rb->fetchStream == NULL) {
 			int fd = rb->seSrc->fd;
 			if (fd >= 0) {
+				EventBits bits = Event_Error;
 				if (state == RB_NeedRead || state == RB_Start)
-					FD_SET(fd, &mb->sds.readFDS);
-				FD_SET(fd, &mb->sds.errorFDS);
+					bits |= Event_Read;
+				WantEvents(es, fd, bits);
 			}
-			if (fd > max) max = fd;
 		}
 		if (rb->seDst != NULL) {
 			int fd = rb->seDst->fd;
 			if (fd >= 0) {
+				EventBits bits = Event_Error;
 				if (state == RB_NeedWrite)
-					FD_SET(fd, &mb->sds.writeFDS);
-				FD_SET(fd, &mb->sds.errorFDS);
+					bits |= Event_Write;
+				WantEvents(es, fd, bits);
 			}
-			if (fd > max) max = fd;
 		}
 		rb = rb->next;
 	}
-	mb->sds.fdLen = max+1;
-	
-	if (max < 0) return; // no need to select if no interest
+	int nWant = es->nWant;
 	
-	// now do the selection over all the current fd's
-	int res = select(mb->sds.fdLen,
-					 &mb->sds.readFDS,
-					 &mb->sds.writeFDS,
-					 &mb->sds.errorFDS,
-					 &mb->sds.selectTimeout
-					 );
+	// now wait for any of them
+	int res = WaitForEvents(es, timeout);
 	mb->nReady = res;
 	FILE *f = mb->debug;
-	if (f != NULL) {
+	if (f != NULL && res > 0) {
 		int seen = 0;
 		int i = 0;
-		for (; i < mb->sds.fdLen; i++) {
-			int bitR = FD_ISSET(i, &mb->sds.readFDS);
-			int bitW = FD_ISSET(i, &mb->sds.writeFDS);
-			int bitE = FD_ISSET(i, &mb->sds.errorFDS);
-			if (bitR | bitW | bitE) {
+		for (; i < nWant; i++) {
+			int fd = es->prev[i].fd;
+			EventBits bits = es->ready[fd];
+			if (bits != 0) {
 				if (seen == 0) {
 					int busy = mb->requestCount - mb->requestDone;
 					fprintf(f, "\n");
@@ -984,10 +1243,10 @@ TrySelect(MainBase mb) {
 					fprintf(f, "select, sockFD %d, ccnFD %d, busy %d, ready %d:",
 						   mb->sockFD, mb->ccnFD, busy, res);
 				}
-				fprintf(f, " %d ", i);
-				if (bitR) fprintf(f, "r");
-				if (bitW) fprintf(f, "w");
-				if (bitE) fprintf(f, "e");
+				fprintf(f, " %d ", fd);
+				if (bits & Event_Read) fprintf(f, "r");
+				if (bits & Event_Write) fprintf(f, "w");
+				if (bits & Event_Error) fprintf(f, "e");
 				seen++;
 			}
 		}
@@ -1026,12 +1285,22 @@ SetNameCCN(MainBase mb,
 static int
 MaybeNewRequestBase(MainBase mb) {
 	// when rb->sockFD can receive something we run this step
+	// the listening socket does not block, so there may be nothing there
+	// (another worker may have taken it)
 	int sockFD = mb->sockFD;
-	FD_CLR(sockFD, &mb->sds.readFDS);
-	int connFD = SH_RobustAccept(mb->client);
-	if (connFD < 0) return connFD;
+	int connFD = accept(sockFD, NULL, NULL);
+	if (connFD < 0) {
+		int e = errno;
+		if (e == EAGAIN || e == EWOULDBLOCK || e == EINTR
+			|| e == ECONNABORTED)
+			return -1;
+		mb->client->errCount++;
+		return retFail(mb, "accept failed");
+	}
+	mb->client->lastUsed = GetCurrentTime();
 	int res = fcntl(connFD, F_SETFL, O_NONBLOCK);
 	if (res < 0) {
+		close(connFD);
 		return retFail(mb, "connFD fcntl failed");
 	}
 	struct sockaddr_storage sa;
@@ -1376,6 +1645,44 @@ CheckHttpHeader(RequestBase rb) {
 	return 0;
 }
 
+static int64_t
+EvalInt64(string buf, int *pos, int len) {
+	// returns the decimal value at *pos, advancing *pos past it
+	// returns -1 if there are no digits
+	int64_t n = -1;
+	while (*pos < len) {
+		char c = buf[*pos];
+		if (c < '0' || c > '9' || n > INT64_MAX / 16) break;
+		if (n < 0) n = 0;
+		n = n * 10 + (c - '0');
+		(*pos)++;
+	}
+	return n;
+}
+
+static int
+ParseRange(HttpInfo h, string s, int len) {
+	// accepts a single byte range, as in "bytes=100-199", "bytes=100-",
+	// or "bytes=-100" (the last 100 bytes)
+	// returns 1 if the range is usable, 0 otherwise
+	int pos = 0;
+	while (pos < len && s[pos] == ' ') pos++;
+	if (SwitchPresent(s+pos, len-pos, "bytes=") == 0 || len-pos < 6)
+		return 0;
+	pos = pos + 6;
+	h->rangeFirst = EvalInt64(s, &pos, len);
+	if (pos >= len || s[pos] != '-') return 0;
+	pos++;
+	h->rangeLast = EvalInt64(s, &pos, len);
+	while (pos < len && (s[pos] == ' ' || s[pos] == '\r')) pos++;
+	if (pos < len)
+		// multiple ranges, or junk
+		return 0;
+	if (h->rangeFirst < 0 && h->rangeLast <= 0) return 0;
+	if (h->rangeLast >= 0 && h->rangeLast < h->rangeFirst) return 0;
+	return 1;
+}
+
 static int
 ExtractHTTPInfo(RequestBase rb, HttpVerb httpVerb) {
 	MainBase mb = rb->mb;
@@ -1487,6 +1794,7 @@ ExtractHTTPInfo(RequestBase rb, HttpVerb httpVerb) {
 				h->cookie = 1;
 			} else if (TokenPresent(key, keyLen, "Range: ")) {
 				h->hasRange = 1;
+				h->rangeOK = ParseRange(h, postKey, postLen);
 			} else if (TokenPresent(key, keyLen, "Referer: ")) {
 				h->hasReferer = 1;
 			} else if (TokenPresent(key, keyLen, "Keep-Alive: ")) {
@@ -2027,8 +2335,8 @@ RequestBaseStart(RequestBase rb) {
 				hostLine = NULL;
 				failQuick = 1;
 			}
-			if (rb->httpInfo.hasRange)
-				// CCN can't do ranges yet
+			if (rb->httpInfo.hasRange && rb->httpInfo.rangeOK == 0)
+				// CCN can only do a single byte range
 				hostLine = NULL;
 			if (info.count < 0 || firstLineLen >= NameMax)
 				// CCN can't handle excessively long names
@@ -2066,6 +2374,11 @@ RequestBaseStart(RequestBase rb) {
 				   rb->host, rb->shortName);
 			flushLog(f);
 			rb->fetchStream = fs;
+			if (rb->httpInfo.rangeOK) {
+				// the stored reply header comes first
+				rb->rangeState = Range_Header;
+				rb->bufferLen = 0;
+			}
 			
 			// dest socket is the src connection socket
 			int connFD = rb->seSrc->fd;
@@ -2099,6 +2412,121 @@ RequestBaseStart(RequestBase rb) {
 	
 }
 
+static int
+FindHeaderEnd(string buf, int len) {
+	// returns the length of the header (through the blank line)
+	// or 0 if the header is not complete
+	int pos = 0;
+	while (pos < len) {
+		int next = NextLine(buf, pos, len);
+		if (next <= pos || buf[next-1] != '\n') break;
+		if (next - pos == 1 || (next - pos == 2 && buf[pos] == '\r'))
+			return next;
+		pos = next;
+	}
+	return 0;
+}
+
+static int
+ReadRangeHeader(RequestBase rb) {
+	// Accumulates the stored reply header in rb->buffer, then replaces it
+	// with a 206 header for the requested range, and positions the stream
+	// at the first byte of the range.  Anything that we can't handle
+	// (not a 200 reply, no Content-Length, range not satisfiable, variable
+	// segment size) falls back to passing the stored reply through whole,
+	// which is a legal answer to a range request.
+	// returns -1 if there is nothing to send yet,
+	// otherwise the number of bytes in rb->buffer to send
+	MainBase mb = rb->mb;
+	FILE *f = mb->debug;
+	HttpInfo h = &rb->httpInfo;
+	string buf = rb->buffer;
+	int room = rb->bufferMax - rb->bufferLen - 1;
+	intmax_t nb = 0;
+	if (room > CCN_CHUNK_SIZE) room = CCN_CHUNK_SIZE;
+	if (room > 0)
+		nb = ccn_fetch_read(rb->fetchStream, buf + rb->bufferLen, room);
+	if (nb < 0) return -1;
+	rb->bufferLen = rb->bufferLen + nb;
+	int len = rb->bufferLen;
+	int hLen = FindHeaderEnd(buf, len);
+	if (hLen == 0 && nb > 0 && len + CCN_CHUNK_SIZE < rb->bufferMax)
+		// not there yet, keep reading
+		return -1;
+	rb->rangeState = Range_None;
+	if (hLen == 0) return len;
+	
+	// find the status code and the length of the body
+	int code = 0;
+	int64_t contentLen = -1;
+	int pos = SkipToBlank(buf, 0, hLen);
+	pos = SkipOverBlank(buf, pos, hLen);
+	code = EvalUint(buf, pos);
+	pos = NextLine(buf, 0, hLen);
+	while (pos < hLen) {
+		int next = NextLine(buf, pos, hLen);
+		if (next <= pos) break;
+		if (SwitchPresent(buf+pos, next-pos, "Content-Length:")) {
+			int vPos = SkipOverBlank(buf, pos+15, next);
+			contentLen = EvalInt64(buf, &vPos, next);
+		} else if (SwitchPresent(buf+pos, next-pos, "Transfer-Encoding:")) {
+			contentLen = -1;
+			break;
+		}
+		pos = next;
+	}
+	if (code != 200 || contentLen <= 0) return len;
+	int64_t first = h->rangeFirst;
+	int64_t last = h->rangeLast;
+	if (first < 0) {
+		// suffix range, the last N bytes
+		first = contentLen - last;
+		if (first < 0) first = 0;
+		last = contentLen - 1;
+	} else if (last < 0 || last >= contentLen) last = contentLen - 1;
+	if (first >= contentLen) return len;
+	if (ccn_fetch_seek(rb->fetchStream, hLen + first) < 0) {
+		// must stay where we are, so keep going with the whole reply
+		return len;
+	}
+	
+	// build the new header, copying all but the status and length lines
+	struct ccn_charbuf *cb = ccn_charbuf_create();
+	ccn_charbuf_putf(cb, "HTTP/1.1 206 Partial Content\r\n");
+	pos = NextLine(buf, 0, hLen);
+	while (pos < hLen) {
+		int next = NextLine(buf, pos, hLen);
+		if (next <= pos || next - pos <= 2) break;
+		if (SwitchPresent(buf+pos, next-pos, "Content-Length:") == 0
+			&& SwitchPresent(buf+pos, next-pos, "Content-Range:") == 0)
+			ccn_charbuf_append(cb, buf+pos, next-pos);
+		pos = next;
+	}
+	ccn_charbuf_putf(cb, "Content-Length: %jd\r\n",
+					 (intmax_t) (last - first + 1));
+	ccn_charbuf_putf(cb, "Content-Range: bytes %jd-%jd/%jd\r\n\r\n",
+					 (intmax_t) first, (intmax_t) last,
+					 (intmax_t) contentLen);
+	if (cb->length > (size_t) rb->bufferMax) {
+		ccn_charbuf_destroy(&cb);
+		SetRequestErr(rb, "range header too long", 0);
+		return -1;
+	}
+	memcpy(buf, cb->buf, cb->length);
+	rb->bufferLen = cb->length;
+	ccn_charbuf_destroy(&cb);
+	rb->rangeState = Range_Body;
+	rb->rangeRem = last - first + 1;
+	SetMsgLen(rb, rb->bufferLen + rb->rangeRem);
+	if (f != NULL) {
+		PutRequestMark(rb, "range");
+		fprintf(f, " bytes %jd-%jd/%jd\n",
+				(intmax_t) first, (intmax_t) last, (intmax_t) contentLen);
+		flushLog(f);
+	}
+	return rb->bufferLen;
+}
+
 static void
 NoteDone(RequestBase rb) {
 	MainBase mb = rb->mb;
@@ -2129,6 +2557,10 @@ RequestBaseStep(RequestBase rb) {
 	switch (rb->state) {
 		case RB_Start: {
 			// this only happens once for the outbound path
+			// but not until the client has sent something
+			if (rb->seSrc != NULL
+				&& TakeEvent(&mb->events, rb->seSrc->fd, Event_Read) == 0)
+				return 0;
 			return RequestBaseStart(rb);
 		}
 		case RB_Wait: {
@@ -2154,13 +2586,26 @@ RequestBaseStep(RequestBase rb) {
 		case RB_NeedRead: {
 			SockEntry se = rb->seSrc;
 			intmax_t nb = -1;
-			if (rb->fetchStream != NULL) {
+			if (rb->fetchStream != NULL && rb->rangeState == Range_Header) {
+				// we need the whole stored header to answer a range
+				nb = ReadRangeHeader(rb);
+				if (nb < 0)
+					// nothing to do, no characters available
+					return 0;
+			} else if (rb->fetchStream != NULL) {
 				// we get this buffer through CCN
-				nb = ccn_fetch_read(rb->fetchStream, rb->buffer, CCN_CHUNK_SIZE);
+				intmax_t want = CCN_CHUNK_SIZE;
+				if (rb->rangeState == Range_Body && rb->rangeRem < want)
+					want = rb->rangeRem;
+				nb = 0;
+				if (want > 0)
+					nb = ccn_fetch_read(rb->fetchStream, rb->buffer, want);
 				if (nb < 0)
 					// nothing to do, no characters available
 					return 0;
 				rb->bufferLen = nb;
+				if (rb->rangeState == Range_Body)
+					rb->rangeRem = rb->rangeRem - nb;
 				if (nb > 0) {
 					mb->stats.replyReadsCCN++;
 					mb->stats.replyBytesCCN = mb->stats.replyBytesCCN + nb;
@@ -2168,10 +2613,9 @@ RequestBaseStep(RequestBase rb) {
 			} else {
 				// we get this buffer through HTTP
 				int fd = se->fd;
-				int bit = FD_ISSET(fd, &mb->sds.readFDS);
+				int bit = TakeEvent(&mb->events, fd, Event_Read);
 				if (bit) {
 					// this fd has something to read
-					FD_CLR(fd, &mb->sds.readFDS);
 					nb = RobustRecvmsg(rb, se);
 				} else {
 					// nothing to do here, the fd is not ready to read
@@ -2280,7 +2724,7 @@ RequestBaseStep(RequestBase rb) {
 			rb->recentTime = now;
 			
 			// now pass along the reply
-			RobustSendmsg(rb, rb->seDst);
+			TrySendmsg(rb, rb->seDst);
 			SetRequestState(rb, RB_NeedWrite);
 			break;
 		}
@@ -2290,13 +2734,12 @@ RequestBaseStep(RequestBase rb) {
 				return SetRequestErr(rb, "RequestBaseStep rb->seDst == NULL", 0);
 			}
 			int fd = rb->seDst->fd;
-			int bit = FD_ISSET(fd, &mb->sds.writeFDS);
-			FD_CLR(fd, &mb->sds.writeFDS);
+			int bit = TakeEvent(&mb->events, fd, Event_Write);
 			if (bit == 0) {
 				// we should not have reached here, but it's not fatal
-			} else if (rb->sendOff > 0) {
+			} else if (rb->sendPending) {
 				// the write was incomplete, so try to finish it
-				RobustSendmsg(rb, rb->seDst);
+				TrySendmsg(rb, rb->seDst);
 				SetRequestState(rb, RB_NeedWrite);
 			} else {
 				// the write has completed, so we can turn around and read
@@ -2338,6 +2781,20 @@ RequestBaseStep(RequestBase rb) {
 	return 0;
 }
 
+static void
+NoteSockClose(SockBase sb, int fd) {
+	MainBase mb = (MainBase) sb->clientData;
+	ForgetEvents(&mb->events, fd);
+}
+
+static void
+SetFetchBase(MainBase mb, struct ccn_fetch * fetchBase) {
+	mb->fetchBase = fetchBase;
+	mb->ccnFD = -1;
+	if (fetchBase != NULL)
+		mb->ccnFD = ccn_get_connection_fd(ccn_fetch_get_ccn(fetchBase));
+}
+
 static MainBase
 NewMainBase(FILE *f, int maxBusy, struct ccn_fetch * fetchBase) {
 	MainBase mb = ProxyUtil_StructAlloc(1, MainBaseStruct);
@@ -2349,10 +2806,11 @@ NewMainBase(FILE *f, int maxBusy, struct ccn_fetch * fetchBase) {
 	sb->clientData = mb;
 	sb->startTime = now; // keep them sync'd
 	if (maxBusy < 2) maxBusy = 2;
-	if (maxBusy > 20) maxBusy = 20;
+	if (maxBusy > MaxBusyLimit) maxBusy = MaxBusyLimit;
 	mb->maxBusy = maxBusy;
-	mb->fetchBase = fetchBase;
-	mb->ccnFD = ccn_get_connection_fd(ccn_fetch_get_ccn(fetchBase));
+	SetFetchBase(mb, fetchBase);
+	InitEventSet(&mb->events);
+	sb->closeHook = NoteSockClose;
 	
 	mb->debug = f;
 	FILE *pf = fopen("./HttpProxy.list", "r");
@@ -2430,6 +2888,7 @@ DestroyMainBase(MainBase mb) {
 		}
 		if (mb->fetchBase != NULL)
 			ccn_fetch_destroy(mb->fetchBase);
+		FreeEventSet(&mb->events);
 		
 		
 		HostLine h = mb->hostLines;
@@ -2517,10 +2976,12 @@ static void
 ScanRequestsHttp(MainBase mb) {
 	// first, check for initial requests
 	int sockFD = mb->sockFD;
-	if (FD_ISSET(sockFD, &mb->sds.readFDS)) {
-		// initial connection request from the client
-		FD_CLR(sockFD, &mb->sds.readFDS);
-		MaybeNewRequestBase(mb);
+	if (TakeEvent(&mb->events, sockFD, Event_Read)) {
+		// initial connection requests from clients
+		// take as many as are waiting, up to our limit
+		while ((mb->requestCount - mb->requestDone) < mb->maxBusy) {
+			if (MaybeNewRequestBase(mb) < 0) break;
+		}
 	}
 	
 	// now, check for HTTP requests being done
@@ -2582,7 +3043,9 @@ DispatchLoop(MainBase mb) {
 	for (;;) {
 		uint64_t nChanges = mb->nChanges;
 		
-		TrySelect(mb);
+		// wait for something to do, or for the CCN work to come due
+		// the wait grows while nothing much is changing
+		TrySelect(mb, waitMillis);
 		
 		ScanRequestsCCN(mb);
 		if (mb->nReady > 0) {
@@ -2597,8 +3060,7 @@ DispatchLoop(MainBase mb) {
 		
 		// wait for a change
 		if (nChanges == mb->nChanges) {
-			// nothing much is changing so sleep and increase the wait
-			MilliSleep(waitMillis);
+			// nothing much is changing so increase the wait
 			if (waitMillis < 64) waitMillis++;
 			SH_CheckTimeouts(mb->sockBase);
 			SH_PruneAddrCache(mb->sockBase, 600, 300);
@@ -2612,20 +3074,75 @@ DispatchLoop(MainBase mb) {
 	return res;
 }
 
+static int
+OpenListener(FILE *f, struct sockaddr_in *sa, int reusePort) {
+	// returns a non-blocking listening socket, or -1 on failure
+	struct sockaddr *sap = (struct sockaddr *) sa;
+    int sockFD = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	
+    if (-1 == sockFD)
+		return retFail(NULL, "can not create socket");
+	
+#ifdef SO_REUSEPORT
+	if (reusePort) {
+		// each worker has its own socket, and the kernel spreads
+		// the connections over them
+		int xopt = 1;
+		setsockopt(sockFD, SOL_SOCKET, SO_REUSEPORT, &xopt, sizeof(xopt));
+	}
+#endif
+	
+	int it = 0;
+	for (;;) {
+		int bindRes = bind(sockFD, sap, sizeof(struct sockaddr_in));
+		if (bindRes < 0) {
+			int e = errno;
+			if (e == EADDRINUSE && it <= 120) {
+				// may be useful to wait for timeout of the old bind
+				// we probably did not close it properly due to an error
+				if (it == 0) fprintf(f, "Waiting for proxy socket...\n");
+				flushLog(f);
+				MilliSleep(1000);
+			} else {
+				close(sockFD);
+				return retFail(NULL, "error bind failed");
+			}
+		} else break;
+		it++;
+	}
+	
+    if (-1 == listen(sockFD, SOMAXCONN)) {
+		close(sockFD);
+		return retFail(NULL, "error listen failed");
+    }
+	if (fcntl(sockFD, F_SETFL, O_NONBLOCK) < 0) {
+		close(sockFD);
+		return retFail(NULL, "error fcntl failed");
+	}
+	double bt = DeltaTime(0, GetCurrentTime());
+	fprintf(f, "Socket listening, fd %d, pid %d, baseTime %7.6f\n",
+			sockFD, (int) getpid(), bt);
+	flushLog(f);
+	return sockFD;
+}
+
 int
 main(int argc, string *argv) {
 	
 	ccn_fetch_flags ccn_flags = (ccn_fetch_flags_NoteAll);
 	FILE *f = stdout;
 	
-	struct ccn_fetch * fetchBase = ccn_fetch_new(NULL);
-	if (fetchBase == NULL) {
-		fprintf(stdout, "** Can't connect to ccnd\n");
-		return -1;
-	}
-
-	MainBase mb = NewMainBase(f, 16, fetchBase);
+	MainBase mb = NewMainBase(f, 64, NULL);
 	int usePort = 8080;
+	int workers = 1;
+	int maxBusy = mb->maxBusy;
+	mb->ccnRoot = "TestCCN";
+	mb->removeProxy = 0;
+	mb->removeHost = 1;
+	mb->defaultKeepAlive = 13;
+	mb->timeoutSecs = 30;
+	mb->maxConn = 2; // RFC 2616 (pg. 2)
+	mb->resolveFlags = CCN_V_HIGHEST;
 	
 	int i = 1;
 	for (; i <= argc; i++) {
@@ -2692,6 +3209,24 @@ main(int argc, string *argv) {
 					return -1;
 				}
 				mb->maxConn = n;
+			} else if (strcasecmp(arg, "-maxBusy") == 0) {
+				i++;
+				int n = 0;
+				if (i <= argc) n = atoi(argv[i]);
+				if (n < 2 || n > MaxBusyLimit) {
+					fprintf(stdout, "** bad maxBusy: %d\n", n);
+					return -1;
+				}
+				maxBusy = n;
+			} else if (strcasecmp(arg, "-workers") == 0) {
+				i++;
+				int n = 0;
+				if (i <= argc) n = atoi(argv[i]);
+				if (n < 1 || n > MaxWorkers) {
+					fprintf(stdout, "** bad workers: %d\n", n);
+					return -1;
+				}
+				workers = n;
 			} else {
 				fprintf(stdout, "** bad arg: %s\n", arg);
 				return -1;
@@ -2699,60 +3234,48 @@ main(int argc, string *argv) {
 		}
     }
 
+	mb->maxBusy = maxBusy;
 	signal(SIGPIPE, SIG_IGN);
 	
 	struct sockaddr_in sa;
 	struct sockaddr *sap = (struct sockaddr *) &sa;
-    int sockFD = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-	
-    if (-1 == sockFD)
-		return retFail(NULL, "can not create socket");
-	
+	memset(&sa, 0, sizeof(sa));
     sa.sin_family = PF_INET;
     sa.sin_port = htons(usePort);
     sa.sin_addr.s_addr = INADDR_ANY;
 	
-	int it = 0;
-	for (;;) {
-		int bindRes = bind(sockFD, sap, sizeof(struct sockaddr_in));
-		if (bindRes < 0) {
-			int e = errno;
-			if (e == EADDRINUSE && it <= 120) {
-				// may be useful to wait for timeout of the old bind
-				// we probably did not close it properly due to an error
-				if (it == 0) fprintf(f, "Waiting for proxy socket...\n");
-				flushLog(f);
-				MilliSleep(1000);
-			} else {
-				close(sockFD);
-				return retFail(NULL, "error bind failed");
-			}
-		} else break;
-		it++;
+	// each worker is a separate process with its own CCN connection and
+	// event loop; the parent is one of them
+	int sockFD = -1;
+	int reusePort = 0;
+#ifdef SO_REUSEPORT
+	reusePort = (workers > 1);
+#endif
+	if (reusePort == 0) {
+		// without SO_REUSEPORT the workers share the one socket
+		sockFD = OpenListener(f, &sa, 0);
+		if (sockFD < 0) return -1;
+	}
+	for (i = 1; i < workers; i++) {
+		pid_t pid = fork();
+		if (pid < 0)
+			return retFail(NULL, "fork failed");
+		if (pid == 0) break;
+	}
+	if (sockFD < 0) {
+		sockFD = OpenListener(f, &sa, reusePort);
+		if (sockFD < 0) return -1;
 	}
 	
-    if (-1 == listen(sockFD, 10)) {
-		close(sockFD);
-		return retFail(NULL, "error listen failed");
-    }
-	double bt = DeltaTime(0, GetCurrentTime());
-	fprintf(f, "Socket listening, fd %d, baseTime %7.6f\n", sockFD, bt);
-	flushLog(f);
-	
-	
-	if (mb->fetchBase == NULL) {
+	struct ccn_fetch * fetchBase = ccn_fetch_new(NULL);
+	if (fetchBase == NULL) {
 		// should not happen unless ccnd is not answering
-		return retErr(mb, "Init failed!  No ccnd?");
+		fprintf(stdout, "** Can't connect to ccnd\n");
+		return -1;
 	}
+	SetFetchBase(mb, fetchBase);
 	SetSockFD(mb, sockFD);
 	SetSockEntryAddr(mb->client, sap);
-	mb->ccnRoot = "TestCCN";
-	mb->removeProxy = 0;
-	mb->removeHost = 1;
-	mb->defaultKeepAlive = 13;
-	mb->timeoutSecs = 30;
-	mb->maxConn = 2; // RFC 2616 (pg. 2)
-	mb->resolveFlags = CCN_V_HIGHEST;
 	
 	if (mb->debug != NULL && ccn_flags != ccn_fetch_flags_None)
 		ccn_fetch_set_debug(mb->fetchBase, mb->debug, ccn_flags);
@@ -36,6 +36,7 @@
 #include <strings.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
 #include <ccn/uri.h>
 #include <ccn/keystore.h>
 #include <ccn/signing.h>
@@ -54,6 +55,15 @@
 // default is not to go stale
 #define TempSegments 4
 
+// segments published beyond the highest one asked for, while fetching
+#define PushAheadSegs 32
+
+// the index of complete files, kept in fsRoot
+#define IndexFileName ".NetFetch.index"
+
+// default limit on origin fetches in progress at once (all hosts)
+#define MaxFetchesDefault 16
+
 #define UsePread 1
 
 typedef struct ccn_charbuf *MyCharbuf;
@@ -165,7 +175,11 @@ struct MainDataStruct {
 	int verbose;
 	int recentPort;
 	int maxBusySameHost;
+	int maxFetches;
 	int keepAliveDefault;
+	struct hashtb *fileIndex;
+	FILE *indexFile;
+	int indexLines;
 	uint64_t startTime;
 	uint64_t changes;
 	char *recentHost;
@@ -299,6 +313,7 @@ AddSegRequest(NetRequest nr, seg_t seg) {
 	// duplicates are suppressed, search is linear
 	SegList lag = NULL;
 	SegList each = nr->segRequests;
+	if (seg > nr->maxSegRequest) nr->maxSegRequest = seg;
 	while (each != NULL) {
 		if (each->seg == seg) return 0;
 		if (each->seg > seg) break;
@@ -605,6 +620,147 @@ MakePath(char *dir, int pos) {
 	return count;
 }
 
+////////////////////////////////
+// Index of complete files
+////////////////////////////////
+
+// Each file that has been completely fetched gets a line in the index,
+// "<fileSize> <modTime> <relName>", where relName is the file name relative
+// to fsRoot, and later lines override earlier ones.  The index is read into
+// a hash table at startup, so that after a restart we know which stored
+// files are whole without looking at them.  A stored file that is not in
+// the index, or whose size or time has changed, is left over from an
+// interrupted fetch, and is fetched again.
+
+typedef struct FileIndexEntryStruct *FileIndexEntry;
+struct FileIndexEntryStruct {
+	intmax_t fileSize;
+	intmax_t modTime;
+};
+
+static void
+SetIndexEntry(MainData md, char *relName, intmax_t fileSize, intmax_t modTime) {
+	struct hashtb_enumerator ee;
+	struct hashtb_enumerator *e = &ee;
+	hashtb_start(md->fileIndex, e);
+	if (hashtb_seek(e, relName, strlen(relName), 0) >= 0) {
+		FileIndexEntry ie = e->data;
+		ie->fileSize = fileSize;
+		ie->modTime = modTime;
+	}
+	hashtb_end(e);
+}
+
+static int
+WriteIndexLine(FILE *f, const char *relName, int len,
+			   intmax_t fileSize, intmax_t modTime) {
+	return fprintf(f, "%jd %jd %.*s\n", fileSize, modTime, len, relName);
+}
+
+static void
+CompactFileIndex(MainData md, char *path) {
+	// rewrite the index with one line per file
+	char temp[MaxFileName];
+	snprintf(temp, sizeof(temp), "%s.new", path);
+	FILE *f = fopen(temp, "w");
+	if (f == NULL) return;
+	struct hashtb_enumerator ee;
+	struct hashtb_enumerator *e = &ee;
+	int n = 0;
+	int bad = 0;
+	for (hashtb_start(md->fileIndex, e); e->data != NULL; hashtb_next(e)) {
+		FileIndexEntry ie = e->data;
+		if (WriteIndexLine(f, e->key, e->keysize,
+						   ie->fileSize, ie->modTime) < 0) bad++;
+		n++;
+	}
+	hashtb_end(e);
+	if (fclose(f) != 0 || bad || rename(temp, path) < 0) {
+		unlink(temp);
+		retErr("CompactFileIndex failed");
+		return;
+	}
+	md->indexLines = n;
+}
+
+static void
+OpenFileIndex(MainData md) {
+	// loads the index (if any), then opens it for appending
+	char path[MaxFileName];
+	snprintf(path, sizeof(path), "%s%s", md->fsRoot, IndexFileName);
+	md->fileIndex = hashtb_create(sizeof(struct FileIndexEntryStruct), NULL);
+	FILE *f = fopen(path, "r");
+	int lines = 0;
+	if (f != NULL) {
+		char line[MaxFileName+64];
+		while (fgets(line, sizeof(line), f) != NULL) {
+			intmax_t fileSize = 0;
+			intmax_t modTime = 0;
+			int pos = 0;
+			if (sscanf(line, "%jd %jd %n", &fileSize, &modTime, &pos) < 2
+				|| pos == 0)
+				continue;
+			char *relName = line+pos;
+			int len = strlen(relName);
+			if (len > 0 && relName[len-1] == '\n') relName[--len] = 0;
+			if (len == 0) continue;
+			SetIndexEntry(md, relName, fileSize, modTime);
+			lines++;
+		}
+		fclose(f);
+	}
+	md->indexLines = lines;
+	int n = hashtb_n(md->fileIndex);
+	if (lines > 2*n + 64)
+		// mostly overridden lines
+		CompactFileIndex(md, path);
+	md->indexFile = fopen(path, "a");
+	if (md->indexFile == NULL)
+		retErr("can't open the file index, restarts will refetch");
+	if (md->debug) {
+		fprintf(stdout, "-- OpenFileIndex, %s, %d files\n", path, n);
+		flushLog();
+	}
+}
+
+static void
+CloseFileIndex(MainData md) {
+	if (md->indexFile != NULL) fclose(md->indexFile);
+	md->indexFile = NULL;
+	hashtb_destroy(&md->fileIndex);
+}
+
+static char *
+RelFileName(FileNode fn) {
+	// the file name used in the index
+	return fn->fileName + strlen(fn->root);
+}
+
+static int
+IndexSaysComplete(MainData md, char *relName, struct stat *ss) {
+	if (md->fileIndex == NULL) return 1;
+	FileIndexEntry ie = hashtb_lookup(md->fileIndex, relName, strlen(relName));
+	if (ie == NULL) return 0;
+	if (ie->fileSize != ss->st_size || ie->modTime != ss->st_mtime) return 0;
+	return 1;
+}
+
+static void
+NoteFileComplete(FileNode fn) {
+	// records a fully fetched file in the index
+	MainData md = fn->md;
+	if (md->fileIndex == NULL) return;
+	char *relName = RelFileName(fn);
+	intmax_t modTime = fn->modTime.tv_sec;
+	SetIndexEntry(md, relName, fn->fileSize, modTime);
+	FILE *f = md->indexFile;
+	if (f != NULL) {
+		WriteIndexLine(f, relName, strlen(relName), fn->fileSize, modTime);
+		fflush(f);
+		md->indexLines++;
+	}
+}
+
 static int
 UnMapBig(FileNode fn) {
 	MainData md = fn->md;
@@ -728,15 +884,18 @@ OpenFileNode(MainData md, char *root, char *dir, char *shortName,
 		// file exists
 		fstat(fd, &ss);
 		fileSize = ss.st_size;
-		if (fileSize == 0) {
-			// pretend that zero-length files don't exist
+		if (fileSize == 0
+			|| !IndexSaysComplete(md, fileName + strlen(root), &ss)) {
+			// pretend that zero-length or partial files don't exist
 			close(fd);
 			fd = -1;
+			fileSize = 0;
 		}
 	}
 	if (fd < 0 && create) {
-		// no such file, so make one
-		fd = open(fileName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+		// no such file (or an incomplete one), so make one
+		int flags = O_RDWR | O_CREAT | O_TRUNC;
+		fd = open(fileName, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 		if (fd < 0) {
 			// could not create, maybe because we need a mkdir?
 			int nd = MakePath(dirName, strlen(root));
@@ -746,7 +905,7 @@ OpenFileNode(MainData md, char *root, char *dir, char *shortName,
 				flushLog();
 				return NULL;
 			}
-			fd = open(fileName, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+			fd = open(fileName, flags, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
 			if (fd < 0) {
 				string sysErr = strerror(errno);
 				fprintf(stdout, "** %s - Could not create %s\n", sysErr, fileName);
@@ -963,6 +1122,7 @@ CloseMainData(MainData md) {
 		CloseFileNode(md->files);
 	}
 	ccn_charbuf_destroy(&md->keylocator);
+	CloseFileIndex(md);
 	// finally, get rid of self
 	free(md);
 	return NULL;
@@ -1232,6 +1392,21 @@ PutSegment(FileNode fn, char *ccnRoot, seg_t seg) {
 	return ret;
 }
 
+static void
+PushSegments(NetRequest nr) {
+	// PushSegments publishes stable segments that have not been asked for
+	// yet, up to PushAheadSegs beyond the highest segment requested, so
+	// that the consumer's next interests are answered from the ccnd
+	// content store while the origin download is still running
+	FileNode fn = nr->fn;
+	if (fn == NULL || nr->maxSegRequest < 0) return;
+	seg_t lim = nr->maxSegRequest + PushAheadSegs;
+	seg_t seg = fn->maxSegPut + 1;
+	for (; seg <= lim && HaveSegment(fn, seg); seg++) {
+		if (PutSegment(fn, nr->ccnRoot, seg) < 0) break;
+	}
+}
+
 static seg_t
 GetSegmentNumber(struct ccn_upcall_info *info) {
 	// gets the current segment number for the info
@@ -1540,9 +1715,29 @@ StartHttpStream(NetRequest nr) {
 	return 0;
 }
 
+static int
+CountActiveRequests(MainData md) {
+	// returns the number of requests with an origin connection
+	int count = 0;
+	NetRequest nr = md->requests;
+	for (; nr != NULL; nr = nr->next)
+		if (nr->se != NULL) count++;
+	return count;
+}
+
 static int
 StartNetRequest(NetRequest nr) { 
 	MainData md = nr->md;
+	int active = CountActiveRequests(md);
+	if (active >= md->maxFetches) {
+		// too many fetches already, this one waits its turn
+		if (md->debug) {
+			fprintf(stdout, "-- StartNetRequest, %s, deferred, active %d\n",
+					nr->id, active);
+			flushLog();
+		}
+		return 0;
+	}
 	// see if we have any open
 	int openCount = SH_CountSockEntryOwned(md->sockBase,
 										   nr->host,
@@ -1688,6 +1883,17 @@ UnlinkNetRequest(NetRequest nr) {
 	}
 }
 
+static int
+FetchComplete(NetRequest nr) {
+	// returns 1 if the whole reply was seen, as far as we can tell
+	HttpInfo h = nr->httpInfo;
+	if (h == NULL || h->error) return 0;
+	if (nr->endSeen)
+		return (h->chunked == 0 || h->chunkInfo.state == Chunk_Done);
+	// without a length or chunking, the end of the connection is the end
+	return (h->chunked == 0 && h->totalLen < 0);
+}
+
 static int
 EndNetRequest(NetRequest nr) {
 	// terminates the NetRequest, removing it from the requests list
@@ -1703,6 +1909,7 @@ EndNetRequest(NetRequest nr) {
 	if (fn != NULL && nr->error == 0) {
 		// we have completion
 		AssertFinalSize(nr->fn, fn->fileSize);
+		if (FetchComplete(nr)) NoteFileComplete(fn);
 		// process any pending segments
 		for (;;) {
 			SegList pending = nr->segRequests;
@@ -1711,6 +1918,7 @@ EndNetRequest(NetRequest nr) {
 				PutSegment(fn, nr->ccnRoot, pending->seg);
 			RemSegRequest(nr, pending->seg);
 		}
+		PushSegments(nr);
 		nr->fn = NULL;
 	}
 	
@@ -1752,6 +1960,24 @@ EndNetRequest(NetRequest nr) {
 	return 0;
 }
 
+static void
+StartPendingRequests(MainData md) {
+	// starts waiting requests, oldest first, as the limits allow
+	// a request that can't get a connection at all is abandoned
+	int active = CountActiveRequests(md);
+	NetRequest nr = md->requests;
+	while (nr != NULL && active < md->maxFetches) {
+		NetRequest next = nr->next;
+		if (nr->se == NULL) {
+			if (StartNetRequest(nr) < 0) {
+				nr->error = 1;
+				EndNetRequest(nr);
+			} else if (nr->se != NULL) active++;
+		}
+		nr = next;
+	}
+}
+
 static int
 ReadFromHttp(NetRequest nr) {
 	// ReadFromHttp reads the next buffer from the HTTP stream associated
@@ -1881,6 +2107,9 @@ ReadFromHttp(NetRequest nr) {
 		} else break;
 	}
 	
+	// and publish ahead of the consumer
+	PushSegments(nr);
+	
 	if (nr->endSeen) {
 		// we are done now
 		EndNetRequest(nr);
@@ -1946,6 +2175,8 @@ NoteInterest(struct ccn_closure *selfp,
 			if (seg < 0) seg = 0;
 			
 			NetRequest nr = FindNetRequestByName(md, host, shortName);
+			if (nr != NULL && seg > nr->maxSegRequest)
+				nr->maxSegRequest = seg;
 			FileNode fn = OpenFileNode(md, iData->fsRoot, host, shortName,
 									   0, DefaultFreshness);
 			if (fn == NULL) {
@@ -2117,6 +2348,9 @@ MainLoop(MainData md) {
 			// now all of the CCN callbacks should have finished
 		}
 		
+		// fetches that had to wait may be able to start now
+		StartPendingRequests(md);
+		
 		uint64_t now = GetCurrentTime();
 		FileNode fn = md->files;
 		while (fn != NULL) {
@@ -2160,6 +2394,7 @@ main(int argc, char **argv) {
 	md->sockBase = base;
 	md->debug = 1;
 	md->maxBusySameHost = 4;
+	md->maxFetches = MaxFetchesDefault;
 	md->keepAliveDefault = KeepAliveDefault;
 	md->progname = progname;
 	md->ccnRoot = "TestCCN";
@@ -2191,6 +2426,15 @@ main(int argc, char **argv) {
 					return -1;
 				}
 				md->maxBusySameHost = n;
+			} else if (strcasecmp(arg, "-maxFetches") == 0) {
+				i++;
+				int n = 0;
+				if (i <= argc) n = atoi(argv[i]);
+				if (n < 1 || n > 1024) {
+					fprintf(stdout, "** bad maxFetches: %d\n", n);
+					return -1;
+				}
+				md->maxFetches = n;
 			} else {
 				fprintf(stdout, "** bad arg: %s\n", arg);
 				return -1;
@@ -2200,6 +2444,8 @@ main(int argc, char **argv) {
 	
 	signal(SIGPIPE, SIG_IGN);
 	
+	if (md->fsRoot != NULL) OpenFileIndex(md);
+	
 	status = init_internal_keystore(md);
 	if (status >= 0 && md->keystore != NULL)
 		status = MainLoop(md);
@@ -519,7 +519,11 @@ extern void
 SH_CloseConnection(SockEntry se) {
 	int fd = se->fd;
 	se->fd = -1;
-	if (fd >= 0) close(fd);
+	if (fd >= 0) {
+		SockBase base = se->base;
+		if (base->closeHook != NULL) base->closeHook(base, fd);
+		close(fd);
+	}
 	se->forceClose = 0;
 	se->owned = 0;
 }
@@ -79,6 +79,8 @@ struct SockBaseStruct {
 	int robustTimeout;
 	struct timeval selectTimeout;
 	void *clientData;
+	void (*closeHook)(SockBase base, int fd);
+	// if not NULL, called just before a socket is closed
 };
 
 // External routines for SockEntry objects
@@ -54,6 +54,14 @@
 #define CCN_VERSION_TIMEOUT 1000
 #define CCN_HEADER_TIMEOUT 1000
 #define CCN_DEFAULT_PREFETCH 5
+#define CCN_DEFAULT_PREFETCH_MAX 128
+/* the FIFO grows to hold this much playing time at the measured rate */
+#define CCN_FIFO_SECONDS 8
+#define CCN_FIFO_LIMIT_BLOCKS 2048
+/* slots for remembering when interests were expressed, for RTT samples */
+#define CCN_RTT_SLOTS 256
+#define CCN_RATE_INTERVAL 250000
+#define CCN_STATS_INTERVAL 5000000
 
 #define MAX_FIFO_TEXT N_("FIFO max blocks")
 #define MAX_FIFO_LONGTEXT N_(						\
@@ -67,7 +75,12 @@
 #define PREFETCH_TEXT N_("Prefetch offset")
 #define PREFETCH_LONGTEXT N_(                                          \
 "Number of content objects prefetched, "                       \
-"and offset from content object received for next interest.")
+"and offset from content object received for next interest. "  \
+"This is the least the prefetch window will shrink to.")
+#define PREFETCH_MAX_TEXT N_("Maximum prefetch")
+#define PREFETCH_MAX_LONGTEXT N_(                                      \
+"Most content objects prefetched when the prefetch window grows "  \
+"to cover the measured round trip time and throughput.")
 #define SEEKABLE_TEXT N_("CCN streams can seek")
 #define SEEKABLE_LONGTEXT N_(               \
 "Enable or disable seeking within a CCN stream.")
@@ -96,6 +109,8 @@ add_integer("ccn-fifo-blocksize", CCN_FIFO_BLOCK_SIZE, NULL,
             BLOCK_FIFO_TEXT, BLOCK_FIFO_LONGTEXT, true);
 add_integer("ccn-prefetch", CCN_DEFAULT_PREFETCH, NULL,
             PREFETCH_TEXT, PREFETCH_LONGTEXT, true);
+add_integer("ccn-prefetch-max", CCN_DEFAULT_PREFETCH_MAX, NULL,
+            PREFETCH_MAX_TEXT, PREFETCH_MAX_LONGTEXT, true);
 add_bool( "ccn-streams-seekable", true, NULL,
          SEEKABLE_TEXT, SEEKABLE_LONGTEXT, true )
 #else
@@ -105,6 +120,8 @@ add_integer("ccn-fifo-blocksize", CCN_FIFO_BLOCK_SIZE,
             BLOCK_FIFO_TEXT, BLOCK_FIFO_LONGTEXT, true);
 add_integer("ccn-prefetch", CCN_DEFAULT_PREFETCH,
             PREFETCH_TEXT, PREFETCH_LONGTEXT, true);
+add_integer("ccn-prefetch-max", CCN_DEFAULT_PREFETCH_MAX,
+            PREFETCH_MAX_TEXT, PREFETCH_MAX_LONGTEXT, true);
 add_bool( "ccn-streams-seekable", true,
          SEEKABLE_TEXT, SEEKABLE_LONGTEXT, true )
 #endif
@@ -130,8 +147,19 @@ struct access_sys_t
     int i_bufoffset;        /**< offset in intermediate buffer for next bytes to arrive over net */
     int i_chunksize;        /**< size of CCN ContentObject data blocks */
     int timeouts;           /**< number of timeouts without good data received */
-    int i_fifo_max;         /**< maximum number of blocks in FIFO */
-    int i_prefetch;         /**< offset for prefetching */
+    int i_fifo_max;         /**< least maximum number of blocks in FIFO */
+    int i_fifo_cur;         /**< current maximum, from the measured rate */
+    int i_prefetch;         /**< least offset for prefetching */
+    int i_prefetch_max;     /**< greatest offset for prefetching */
+    int i_window;           /**< current offset, from the measured rate and RTT */
+    uintmax_t i_seg_hi;     /**< highest segment we have asked for */
+    mtime_t sent[CCN_RTT_SLOTS];    /**< when each recent segment was asked for */
+    uintmax_t sent_seg[CCN_RTT_SLOTS]; /**< which segment each slot is for */
+    mtime_t i_srtt;         /**< smoothed round trip time (us), or 0 */
+    double f_rate;          /**< smoothed delivery rate (bytes/s), or 0 */
+    int64_t i_rate_bytes;   /**< bytes delivered since i_rate_start */
+    mtime_t i_rate_start;   /**< start of the current rate sample */
+    mtime_t i_stats_time;   /**< when stats were last reported */
     block_fifo_t *p_fifo;   /**< FIFO for blocks delivered to VLC */
     unsigned char *buf;     /**< intermediate buffer */
     struct ccn *ccn;        /**< CCN handle */
@@ -151,6 +179,12 @@ discard_content(struct ccn_closure *selfp,
                  struct ccn_upcall_info *info);
 static struct ccn_charbuf *
 sequenced_name(struct ccn_charbuf *basename, uintmax_t seq);
+static void
+prefetch_to(access_t *p_access, struct ccn *h, uintmax_t seg_hi);
+static void
+note_delivery(access_t *p_access, size_t data_size);
+static void
+report_stats(access_t *p_access);
 
 struct ccn_charbuf *make_data_template();
 
@@ -184,8 +218,14 @@ static int CCNOpen(vlc_object_t *p_this)
     p_sys->i_fifo_max = var_CreateGetInteger(p_access, "ccn-fifo-maxblocks");
     p_sys->i_bufsize = var_CreateGetInteger(p_access, "ccn-fifo-blocksize");
     p_sys->i_prefetch = var_CreateGetInteger(p_access, "ccn-prefetch");
-    msg_Info(p_access, "CCN.Open: ccn-fifo-maxblocks %d, ccn-fifo-blocksize %d",
-             p_sys->i_fifo_max, p_sys->i_bufsize);
+    p_sys->i_prefetch_max = var_CreateGetInteger(p_access, "ccn-prefetch-max");
+    if (p_sys->i_prefetch_max < p_sys->i_prefetch)
+        p_sys->i_prefetch_max = p_sys->i_prefetch;
+    p_sys->i_window = p_sys->i_prefetch;
+    p_sys->i_fifo_cur = p_sys->i_fifo_max;
+    msg_Info(p_access, "CCN.Open: ccn-fifo-maxblocks %d, ccn-fifo-blocksize %d, ccn-prefetch %d..%d",
+             p_sys->i_fifo_max, p_sys->i_bufsize,
+             p_sys->i_prefetch, p_sys->i_prefetch_max);
     p_access->info.i_size = LLONG_MAX;	/* don't know yet, but bigger is better */
     vlc_mutex_init(&p_sys->lock);
     vlc_cond_init(&p_sys->cond);
@@ -314,7 +354,7 @@ static int CCNSeek(access_t *p_access, uint64_t i_pos)
 {
     access_sys_t *p_sys = p_access->p_sys;
     struct ccn_charbuf *p_name;
-    int i;
+    uintmax_t i_seg;
 
     /* flush the FIFO in case the incoming content handler is blocked */
     block_FifoEmpty(p_sys->p_fifo);
@@ -343,16 +383,15 @@ static int CCNSeek(access_t *p_access, uint64_t i_pos)
     p_sys->incoming->data = p_access; /* so CCN callbacks can find p_sys */
     p_sys->incoming->p = &incoming_content; /* the CCN callback */
     p_sys->i_pos = i_pos;
-    p_name = sequenced_name(p_sys->p_name, p_sys->i_pos / p_sys->i_chunksize);
+    i_seg = p_sys->i_pos / p_sys->i_chunksize;
+    p_name = sequenced_name(p_sys->p_name, i_seg);
     ccn_express_interest(p_sys->ccn, p_name, p_sys->incoming, p_sys->p_template);
     ccn_charbuf_destroy(&p_name);
 
-    for (i = 1; i <= p_sys->i_prefetch; i++) {
-        p_name = sequenced_name(p_sys->p_name, i + p_sys->i_pos / p_sys->i_chunksize);
-        ccn_express_interest(p_sys->ccn, p_name, p_sys->prefetch,
-                                     p_sys->p_template);
-        ccn_charbuf_destroy(&p_name);        
-    }
+    /* refill the whole window at the new position, keeping what we have
+     * learned about the path so the pipeline starts out at full depth */
+    p_sys->i_seg_hi = i_seg;
+    prefetch_to(p_access, p_sys->ccn, i_seg + p_sys->i_window);
     
     p_access->info.i_pos = i_pos;
     p_access->info.b_eof = false;
@@ -419,7 +458,6 @@ static void *ccn_event_thread(void *p_this)
     struct ccn_charbuf *p_name = NULL;
     struct ccn_charbuf *p_co = NULL;
     struct ccn_header *p_header = NULL;
-    int i;
     int i_err = VLC_EGENERIC;
     struct pollfd fds[1];
     int i_ret = 0;
@@ -494,12 +532,8 @@ static void *ccn_event_thread(void *p_this)
         msg_Err(p_access, "CCN.Input failed: unable to express interest");
         goto exit;
     }
-    for (i=1; i <= p_sys->i_prefetch; i++) {
-        p_name = sequenced_name(p_sys->p_name, i);
-        i_ret = ccn_express_interest(p_sys->ccn, p_name, p_sys->prefetch,
-                                     p_sys->p_template);
-        ccn_charbuf_destroy(&p_name);        
-    }
+    p_sys->i_seg_hi = 0;
+    prefetch_to(p_access, p_sys->ccn, p_sys->i_window);
 
     vlc_mutex_lock(&p_sys->lock);
     p_sys->i_state = VLC_SUCCESS;
@@ -519,6 +553,7 @@ static void *ccn_event_thread(void *p_this)
         }
         vlc_mutex_lock(&p_sys->lock);
         i_ret = ccn_run(p_sys->ccn, 0);
+        report_stats(p_access);
         vlc_mutex_unlock(&p_sys->lock);
     }
     msg_Info(p_access, "CCN.Input: exited input event loop");
@@ -589,9 +624,9 @@ incoming_content(struct ccn_closure *selfp,
 
 #if (VLCPLUGINVER < 10100)
     /* block_FifoPace was not exported until 1.1.0, use a copy of it... */
-    s_block_FifoPace(p_sys->p_fifo, p_sys->i_fifo_max, SIZE_MAX);
+    s_block_FifoPace(p_sys->p_fifo, p_sys->i_fifo_cur, SIZE_MAX);
 #else
-    block_FifoPace(p_sys->p_fifo, p_sys->i_fifo_max, SIZE_MAX);
+    block_FifoPace(p_sys->p_fifo, p_sys->i_fifo_cur, SIZE_MAX);
 #endif
 
     switch (kind) {
@@ -647,6 +682,7 @@ incoming_content(struct ccn_closure *selfp,
     /* if we did not previously know the chunk size, record it */
     if (p_sys->i_chunksize == -1)
         p_sys->i_chunksize = data_size;
+    note_delivery(p_access, data_size);
     /* was this the last block? */
     if (ccn_is_final_block(info) || data_size < p_sys->i_chunksize)
         b_last = true;
@@ -692,22 +728,147 @@ incoming_content(struct ccn_closure *selfp,
     ccn_charbuf_destroy(&name);
     if (res < 0) abort();
     
-    name = sequenced_name(p_sys->p_name, p_sys->i_prefetch + p_sys->i_pos / p_sys->i_chunksize);
-    res = ccn_express_interest(info->h, name, p_sys->prefetch, NULL);
-    ccn_charbuf_destroy(&name);
+    prefetch_to(p_access, info->h,
+                p_sys->i_window + p_sys->i_pos / p_sys->i_chunksize);
 
 exit:
     return(result);
 }
 
+/*
+ * The prefetched content is only wanted in the ccnd content store, but its
+ * arrival tells us the round trip time for the segment.
+ */
 enum ccn_upcall_res
 discard_content(struct ccn_closure *selfp,
                 enum ccn_upcall_kind kind,
                 struct ccn_upcall_info *info)
 {
+    access_t *p_access = (access_t *)(selfp->data);
+    access_sys_t *p_sys = p_access->p_sys;
+    const unsigned char *comp = NULL;
+    size_t size = 0;
+    uintmax_t seg = 0;
+    mtime_t rtt;
+    int n, slot;
+    size_t i;
+
+    if (kind != CCN_UPCALL_CONTENT && kind != CCN_UPCALL_CONTENT_UNVERIFIED)
+        return(CCN_UPCALL_RESULT_OK);
+    n = info->content_comps->n;
+    if (n < 2 || ccn_name_comp_get(info->content_ccnb, info->content_comps,
+                                   n - 2, &comp, &size) < 0)
+        return(CCN_UPCALL_RESULT_OK);
+    if (size < 1 || size > 1 + sizeof(seg) || comp[0] != CCN_MARKER_SEQNUM)
+        return(CCN_UPCALL_RESULT_OK);
+    for (i = 1; i < size; i++)
+        seg = (seg << 8) | comp[i];
+    slot = seg % CCN_RTT_SLOTS;
+    if (p_sys->sent_seg[slot] != seg || p_sys->sent[slot] == 0)
+        return(CCN_UPCALL_RESULT_OK);
+    rtt = mdate() - p_sys->sent[slot];
+    p_sys->sent[slot] = 0;
+    if (rtt <= 0)
+        return(CCN_UPCALL_RESULT_OK);
+    if (p_sys->i_srtt == 0)
+        p_sys->i_srtt = rtt;
+    else
+        p_sys->i_srtt += (rtt - p_sys->i_srtt) / 8;
     return(CCN_UPCALL_RESULT_OK);
 }
 
+/*
+ * Express prefetch interests for the segments after the highest one asked
+ * for so far, up to and including seg_hi.
+ */
+static void
+prefetch_to(access_t *p_access, struct ccn *h, uintmax_t seg_hi)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    struct ccn_charbuf *name = NULL;
+    uintmax_t seg;
+    mtime_t now = mdate();
+    int slot;
+
+    for (seg = p_sys->i_seg_hi + 1; seg <= seg_hi; seg++) {
+        name = sequenced_name(p_sys->p_name, seg);
+        if (ccn_express_interest(h, name, p_sys->prefetch,
+                                 p_sys->p_template) >= 0) {
+            slot = seg % CCN_RTT_SLOTS;
+            p_sys->sent[slot] = now;
+            p_sys->sent_seg[slot] = seg;
+        }
+        ccn_charbuf_destroy(&name);
+        p_sys->i_seg_hi = seg;
+    }
+}
+
+/*
+ * Account for delivered content, and every so often resize the prefetch
+ * window and the FIFO.  The window is twice the bandwidth-delay product
+ * at the delivery rate, so that it can grow when the path allows; the
+ * FIFO holds CCN_FIFO_SECONDS of data at that rate.
+ */
+static void
+note_delivery(access_t *p_access, size_t data_size)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    mtime_t now = mdate();
+    mtime_t dt;
+    double rate, bdp;
+    int64_t blocks;
+    int w;
+
+    if (p_sys->i_rate_start == 0)
+        p_sys->i_rate_start = now;
+    p_sys->i_rate_bytes += data_size;
+    dt = now - p_sys->i_rate_start;
+    if (dt < CCN_RATE_INTERVAL)
+        return;
+    rate = p_sys->i_rate_bytes * 1e6 / dt;
+    if (p_sys->f_rate == 0)
+        p_sys->f_rate = rate;
+    else
+        p_sys->f_rate += (rate - p_sys->f_rate) / 4;
+    p_sys->i_rate_bytes = 0;
+    p_sys->i_rate_start = now;
+    if (p_sys->i_srtt > 0 && p_sys->i_chunksize > 0) {
+        bdp = p_sys->f_rate * p_sys->i_srtt / 1e6 / p_sys->i_chunksize;
+        w = (int)(2 * bdp) + 1;
+        if (w < p_sys->i_prefetch)
+            w = p_sys->i_prefetch;
+        if (w > p_sys->i_prefetch_max)
+            w = p_sys->i_prefetch_max;
+        p_sys->i_window = w;
+    }
+    blocks = p_sys->f_rate * CCN_FIFO_SECONDS / p_sys->i_bufsize;
+    if (blocks < p_sys->i_fifo_max)
+        blocks = p_sys->i_fifo_max;
+    if (blocks > CCN_FIFO_LIMIT_BLOCKS)
+        blocks = CCN_FIFO_LIMIT_BLOCKS;
+    p_sys->i_fifo_cur = blocks;
+}
+
+/*
+ * Buffer health: how much is waiting for VLC, and what the fetcher
+ * has measured.
+ */
+static void
+report_stats(access_t *p_access)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    mtime_t now = mdate();
+
+    if (now - p_sys->i_stats_time < CCN_STATS_INTERVAL)
+        return;
+    p_sys->i_stats_time = now;
+    msg_Dbg(p_access, "CCN.stats fifo %zu/%d blocks, %zu bytes, "
+            "rate %.0f bytes/s, rtt %"PRId64" us, window %d",
+            block_FifoCount(p_sys->p_fifo), p_sys->i_fifo_cur,
+            block_FifoSize(p_sys->p_fifo), p_sys->f_rate,
+            (int64_t)p_sys->i_srtt, p_sys->i_window);
+}
+
 static struct ccn_charbuf *
 sequenced_name(struct ccn_charbuf *basename, uintmax_t seq)
 {
@@ -22,8 +22,9 @@ LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/../include
 # LOCAL_PATH = project_root/csrc/ccnd
 LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/../../android/external/openssl-armv5/include
 
-CCNDOBJ := ccnd.o ccnd_msg.o ccnd_internal_client.o ccnd_stats.o \
-			android_main.o
+CCNDOBJ := ccnd.o ccnd_cache.o ccnd_msg.o ccnd_nameindex.o \
+			ccnd_internal_client.o ccnd_stats.o ccnd_trace.o ccnd_mrc.o ccnd_dnl.o \
+			ccnd_disk.o ccnd_prefetch.o ccnd_quota.o ccnd_hh.o android_main.o
 
 CCNDSRC := $(CCNDOBJ:.o=.c)
 
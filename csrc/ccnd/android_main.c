@@ -19,6 +19,7 @@
  */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <android/log.h>
 #include <ccnd_private.h>
 
@@ -33,6 +34,10 @@ start_ccnd(void)
 {
     struct ccnd_handle *h = NULL;
     
+    /* Spare the battery while idle, unless told otherwise */
+    setenv("CCND_IDLE_SLACK", "1000", 0);
+    /* and memory */
+    setenv("CCND_PROFILE", "compact", 0);
     h = ccnd_create("ccnd", &logger, NULL);
     ccnd_msg(h, "ccnd_create h=%p", h);
     ccnd_run(h);
@@ -21,6 +21,10 @@
  * Main program of ccnd - the CCNx Daemon
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for recvmmsg and sendmmsg */
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -39,6 +43,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 
@@ -47,7 +52,31 @@
     #include "dummyin6.h"
 #endif
 
+#if defined(__linux__)
+    #include <sched.h>
+    #define CCND_HAVE_AFFINITY 1
+    #include <sys/epoll.h>
+    #define CCND_HAVE_EPOLL 1
+    #include <sys/ioctl.h>
+    #include <net/if.h>
+    #include <netpacket/packet.h>
+    #define CCND_HAVE_ETHER 1
+    #include <netinet/udp.h>
+    #if defined(MSG_WAITFORONE)
+        #define CCND_HAVE_MMSG 1
+        #if defined(UDP_SEGMENT)
+            #define CCND_HAVE_GSO 1
+        #endif
+    #endif
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+      defined(__OpenBSD__) || defined(__DragonFly__)
+    #include <sys/event.h>
+    #define CCND_HAVE_KQUEUE 1
+#endif
+
+#include <ccn/arena.h>
 #include <ccn/bloom.h>
+#include <ccn/btree_content.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/ccnd.h>
@@ -55,11 +84,16 @@
 #include <ccn/face_mgmt.h>
 #include <ccn/hashtb.h>
 #include <ccn/indexbuf.h>
+#include <ccn/memacct.h>
 #include <ccn/schedule.h>
 #include <ccn/reg_mgmt.h>
+#include <ccn/shmring.h>
+#include <ccn/signer.h>
 #include <ccn/uri.h>
+#include <ccn/uring.h>
 
 #include "ccnd_private.h"
+#include "ccnd_trace.h"
 
 static void cleanup_at_exit(void);
 static void unlink_at_exit(const char *path);
@@ -75,33 +109,70 @@ static void process_input(struct ccnd_handle *h, int fd);
 static int ccn_stuff_interest(struct ccnd_handle *h,
                               struct face *face, struct ccn_charbuf *c);
 static void do_deferred_write(struct ccnd_handle *h, int fd);
+static void face_outq_write(struct ccnd_handle *h, struct face *face);
+static int dgram_batch_add(struct ccnd_handle *h, struct face *face,
+                           const struct iovec *iov, int iovcnt, size_t size);
+static void ccnd_sendv(struct ccnd_handle *h, struct face *face,
+                       const struct iovec *iov, int iovcnt,
+                       struct content_entry *content);
+static struct ccnd_outq *outq_create(void);
+static void outq_destroy(struct ccnd_outq **pq);
+static void dgram_batch_flush(struct ccnd_handle *h);
+static void stream_batch_flush(struct ccnd_handle *h);
+static void face_io_enroll(struct ccnd_handle *h, struct face *face);
+static void face_io_update(struct ccnd_handle *h, struct face *face);
+static void face_io_withdraw(struct ccnd_handle *h, struct face *face);
 static void clean_needed(struct ccnd_handle *h);
 static struct face *get_dgram_source(struct ccnd_handle *h, struct face *face,
                                      struct sockaddr *addr, socklen_t addrlen,
                                      int why);
-static void content_skiplist_insert(struct ccnd_handle *h,
-                                    struct content_entry *content);
-static void content_skiplist_remove(struct ccnd_handle *h,
-                                    struct content_entry *content);
 static void mark_stale(struct ccnd_handle *h,
                        struct content_entry *content);
-static ccn_accession_t content_skiplist_next(struct ccnd_handle *h,
-                                             struct content_entry *content);
 static void reap_needed(struct ccnd_handle *h, int init_delay_usec);
 static void check_comm_file(struct ccnd_handle *h);
 static struct nameprefix_entry *nameprefix_for_pe(struct ccnd_handle *h,
                                                   struct propagating_entry *pe);
+static void note_interest_outcome(struct ccnd_handle *h,
+                                  struct propagating_entry *pe,
+                                  unsigned from_faceid);
+static void release_outstanding(struct ccnd_handle *h,
+                                struct propagating_entry *pe);
+static unsigned ccnd_usec_now(struct ccnd_handle *h);
+static void ccnd_refresh_time(struct ccnd_handle *h);
+static void trace_pe(struct ccnd_handle *h, int event,
+                     struct propagating_entry *pe, unsigned faceid,
+                     unsigned aux);
+static void trace_content(struct ccnd_handle *h, int event, unsigned faceid,
+                          struct content_entry *content, int with_prefix,
+                          unsigned aux);
+static void pacer_insert(struct ccnd_handle *h, struct content_queue *q,
+                         unsigned delay);
+static void pacer_remove(struct ccnd_handle *h, struct content_queue *q);
+static void content_queue_destroy(struct ccnd_handle *h,
+                                  struct content_queue **pq);
+static int pacer_run(struct ccn_schedule *sched, void *clienth,
+                     struct ccn_scheduled_event *ev, int flags);
+static void negcache_note(struct ccnd_handle *h,
+                          const unsigned char *msg, size_t size);
 static int nameprefix_seek(struct ccnd_handle *h,
                            struct hashtb_enumerator *e,
                            const unsigned char *msg,
                            struct ccn_indexbuf *comps,
                            int ncomps);
+static struct nameprefix_entry *
+    nameprefix_longest_match(struct ccnd_handle *h,
+                             const unsigned char *key,
+                             const unsigned short *comps,
+                             int ncomps, int *matchp);
 static void register_new_face(struct ccnd_handle *h, struct face *face);
 static void update_forward_to(struct ccnd_handle *h,
                               struct nameprefix_entry *npe);
+static void update_forward_to_subtree(struct ccnd_handle *h,
+                                      struct nameprefix_entry *top);
 static void stuff_and_send(struct ccnd_handle *h, struct face *face,
                            const unsigned char *data1, size_t size1,
-                           const unsigned char *data2, size_t size2);
+                           const unsigned char *data2, size_t size2,
+                           struct content_entry *content);
 static void ccn_link_state_init(struct ccnd_handle *h, struct face *face);
 static void ccn_append_link_stuff(struct ccnd_handle *h,
                                   struct face *face,
@@ -109,6 +180,50 @@ static void ccn_append_link_stuff(struct ccnd_handle *h,
 static int process_incoming_link_message(struct ccnd_handle *h,
                                          struct face *face, enum ccn_dtag dtag,
                                          unsigned char *msg, size_t size);
+static void fraglink_destroy(struct ccnd_handle *h, struct face *face);
+static void arq_destroy(struct ccnd_handle *h, struct face *face);
+static void disk_fetch(struct ccnd_handle *h, const unsigned char *msg,
+                       const struct ccn_indexbuf *comps);
+static void prefetch_note(struct ccnd_handle *h, struct face *face,
+                          const unsigned char *msg,
+                          const struct ccn_indexbuf *comps);
+
+#define CCND_DGRAM_BATCH 32 /**< max datagrams per batched recv or send */
+#define CCND_DGRAM_MAX 8800 /**< largest datagram we expect to receive */
+#define CCND_GSO_SEGMENTS 64 /**< most datagrams in one segmented send */
+#define CCND_GSO_BYTES 60000 /**< most bytes in one segmented send */
+#define CCND_ETHERTYPE 0x88B5 /**< IEEE local experimental ethertype */
+#define CCND_ETHER_GROUP { 0x03, 0x00, 0x63, 0x63, 0x6E, 0x78 }
+
+/**
+ * Estimated memory per stored ContentObject beyond the entry, its name
+ * component offsets, and the object itself: the hash table node header
+ * and bucket, a slot in the name index, and allocator bookkeeping.
+ */
+#define CCND_CONTENT_OVERHEAD (8 * sizeof(void *))
+
+/**
+ * Batched datagram i/o
+ *
+ * Receive buffers for draining a datagram socket, and the outbound
+ * datagrams collected during a trip through the main loop so that
+ * they may go out with one sendmmsg(2) per socket.
+ */
+struct ccnd_dgram_io {
+    unsigned char rbuf[CCND_DGRAM_BATCH][CCND_DGRAM_MAX];
+    struct sockaddr_storage raddr[CCND_DGRAM_BATCH];
+    int fd;                     /**< socket for pending sends, or -1 */
+    int n;                      /**< number of pending sends */
+    size_t gso_maxseg;          /**< largest size to segment, 0 for no GSO */
+    struct ccn_charbuf *obuf;   /**< concatenated pending datagrams */
+    struct {
+        size_t start;           /**< offset in obuf */
+        size_t size;            /**< datagram length */
+        unsigned faceid;        /**< for metering and error reporting */
+        socklen_t addrlen;
+        struct sockaddr_storage addr;
+    } out[CCND_DGRAM_BATCH];
+};
 
 /**
  * Name of our unix-domain listener
@@ -173,16 +288,14 @@ comm_file_ok(void)
 
 /**
  * Obtain a charbuf for short-term use
+ *
+ * These come from the scratch arena, so in the steady state there is
+ * no allocation.  Anything not released is reclaimed in ccnd_run.
  */
 static struct ccn_charbuf *
 charbuf_obtain(struct ccnd_handle *h)
 {
-    struct ccn_charbuf *c = h->scratch_charbuf;
-    if (c == NULL)
-        return(ccn_charbuf_create());
-    h->scratch_charbuf = NULL;
-    c->length = 0;
-    return(c);
+    return(ccn_charbuf_create_in(h->scratch));
 }
 
 /**
@@ -191,11 +304,7 @@ charbuf_obtain(struct ccnd_handle *h)
 static void
 charbuf_release(struct ccnd_handle *h, struct ccn_charbuf *c)
 {
-    c->length = 0;
-    if (h->scratch_charbuf == NULL)
-        h->scratch_charbuf = c;
-    else
-        ccn_charbuf_destroy(&c);
+    ccn_charbuf_release_in(h->scratch, &c);
 }
 
 /**
@@ -204,12 +313,7 @@ charbuf_release(struct ccnd_handle *h, struct ccn_charbuf *c)
 static struct ccn_indexbuf *
 indexbuf_obtain(struct ccnd_handle *h)
 {
-    struct ccn_indexbuf *c = h->scratch_indexbuf;
-    if (c == NULL)
-        return(ccn_indexbuf_create());
-    h->scratch_indexbuf = NULL;
-    c->n = 0;
-    return(c);
+    return(ccn_indexbuf_create_in(h->scratch));
 }
 
 /**
@@ -218,11 +322,7 @@ indexbuf_obtain(struct ccnd_handle *h)
 static void
 indexbuf_release(struct ccnd_handle *h, struct ccn_indexbuf *c)
 {
-    c->n = 0;
-    if (h->scratch_indexbuf == NULL)
-        h->scratch_indexbuf = c;
-    else
-        ccn_indexbuf_destroy(&c);
+    ccn_indexbuf_release_in(h->scratch, &c);
 }
 
 /**
@@ -251,38 +351,160 @@ ccnd_face_from_faceid(struct ccnd_handle *h, unsigned faceid)
 }
 
 /**
- * Assigns the faceid for a nacent face,
- * calls register_new_face() if successful.
+ * Take a face out of the idle wheel, if it is there.
+ */
+static void
+idle_wheel_unlink(struct face *face)
+{
+    if (face->idle_link == NULL)
+        return;
+    *face->idle_link = face->idle_next;
+    if (face->idle_next != NULL)
+        face->idle_next->idle_link = face->idle_link;
+    face->idle_next = NULL;
+    face->idle_link = NULL;
+}
+
+/**
+ * Put a datagram face in the idle wheel slot for the given reap tick.
+ */
+static void
+idle_wheel_insert(struct ccnd_handle *h, struct face *face, unsigned tick)
+{
+    struct face **slot;
+    
+    idle_wheel_unlink(face);
+    slot = &h->idle_wheel[tick % CCND_IDLE_WHEEL];
+    face->idle_next = *slot;
+    if (face->idle_next != NULL)
+        face->idle_next->idle_link = &face->idle_next;
+    *slot = face;
+    face->idle_link = slot;
+}
+
+/**
+ * Note that something has arrived on a face.
+ *
+ * The first arrival in a reap tick moves the face ahead in the idle
+ * wheel, and allows another link check once it goes quiet again.
+ */
+static void
+note_face_recv(struct ccnd_handle *h, struct face *face)
+{
+    face->recvcount++;
+    if (face->rtick != h->reap_tick) {
+        face->rtick = h->reap_tick;
+        face->flags &= ~CCN_FACE_LC;
+        if (face->idle_link != NULL)
+            idle_wheel_insert(h, face, h->reap_tick + CCND_IDLE_TICKS);
+    }
+}
+
+/**
+ * Tell whether a face has had nothing arrive for a full reap tick.
  */
 static int
-enroll_face(struct ccnd_handle *h, struct face *face)
+face_is_quiet(struct ccnd_handle *h, struct face *face)
 {
-    unsigned i;
+    return(h->reap_tick - face->rtick >= CCND_IDLE_TICKS - 1);
+}
+
+/**
+ * Count an incoming Interest (fm is FM_INTI) or ContentObject (FM_DATI).
+ *
+ * For a framed face the counts are held until the end of the batch,
+ * and go into the meters all at once from flush_batch_counts.
+ */
+static void
+count_message_in(struct ccnd_handle *h, struct face *face, int fm)
+{
+    if ((face->flags & CCN_FACE_FRAMED) != 0)
+        face->batch_in[fm == FM_DATI]++;
+    else
+        ccnd_meter_bump(h, face->meter[fm], 1);
+}
+
+static void
+flush_batch_counts(struct ccnd_handle *h, struct face *face)
+{
+    if (face->batch_in[0] != 0)
+        ccnd_meter_bump(h, face->meter[FM_INTI], face->batch_in[0]);
+    if (face->batch_in[1] != 0)
+        ccnd_meter_bump(h, face->meter[FM_DATI], face->batch_in[1]);
+    face->batch_in[0] = face->batch_in[1] = 0;
+}
+
+/**
+ * Put a face slot on the free list.
+ *
+ * Normally it goes at the end, so that it is reused as late as possible.
+ */
+static void
+face_slot_release(struct ccnd_handle *h, unsigned i, int first)
+{
+    h->face_slots[i].next = MAXFACES;
+    if (h->face_free == MAXFACES)
+        h->face_free = h->face_free_tail = i;
+    else if (first) {
+        h->face_slots[i].next = h->face_free;
+        h->face_free = i;
+    }
+    else {
+        h->face_slots[h->face_free_tail].next = i;
+        h->face_free_tail = i;
+    }
+}
+
+/**
+ * Make room for more faces, up to limit slots (at most MAXFACES).
+ * @returns 0 for success, -1 for failure.
+ */
+static int
+face_slots_grow(struct ccnd_handle *h, unsigned limit)
+{
+    struct face **a = NULL;
+    struct ccnd_faceslot *s = NULL;
     unsigned n = h->face_limit;
-    struct face **a = h->faces_by_faceid;
-    for (i = h->face_rover; i < n; i++)
-        if (a[i] == NULL) goto use_i;
-    for (i = 0; i < n; i++)
-        if (a[i] == NULL) {
-            /* bump gen only if second pass succeeds */
-            h->face_gen += MAXFACES + 1;
-            goto use_i;
-        }
-    i = (n + 1) * 3 / 2;
-    if (i > MAXFACES) i = MAXFACES;
-    if (i <= n)
+    unsigned i;
+    
+    if (limit > MAXFACES)
+        limit = MAXFACES;
+    if (limit <= n)
         return(-1); /* overflow */
-    a = realloc(a, i * sizeof(struct face *));
+    a = realloc(h->faces_by_faceid, limit * sizeof(a[0]));
     if (a == NULL)
         return(-1); /* ENOMEM */
-    h->face_limit = i;
-    while (--i > n)
-        a[i] = NULL;
     h->faces_by_faceid = a;
-use_i:
-    a[i] = face;
-    h->face_rover = i + 1;
-    face->faceid = i | h->face_gen;
+    s = realloc(h->face_slots, limit * sizeof(s[0]));
+    if (s == NULL)
+        return(-1);
+    h->face_slots = s;
+    for (i = n; i < limit; i++) {
+        a[i] = NULL;
+        s[i].gen = 0;
+        face_slot_release(h, i, 0);
+    }
+    h->face_limit = limit;
+    return(0);
+}
+
+/**
+ * Assigns the faceid for a nacent face,
+ * calls register_new_face() if successful.
+ */
+static int
+enroll_face(struct ccnd_handle *h, struct face *face)
+{
+    unsigned i;
+    
+    if (h->face_free == MAXFACES &&
+        face_slots_grow(h, (h->face_limit + 1) * 3 / 2) < 0)
+        return(-1);
+    i = h->face_free;
+    h->face_free = h->face_slots[i].next;
+    h->faces_by_faceid[i] = face;
+    face->faceid = i | h->face_slots[i].gen;
+    face->rtick = h->reap_tick - CCND_IDLE_TICKS;
     face->meter[FM_BYTI] = ccnd_meter_create(h, "bytein");
     face->meter[FM_BYTO] = ccnd_meter_create(h, "byteout");
     face->meter[FM_INTI] = ccnd_meter_create(h, "intrin");
@@ -293,6 +515,20 @@ use_i:
     return (face->faceid);
 }
 
+/**
+ * The current answer suppression delay of a multicast face (usec).
+ *
+ * This starts out at data_pause_microsec, and is adapted from there
+ * by suppress_adjust().
+ */
+static unsigned
+suppress_usec(struct ccnd_handle *h, struct face *face)
+{
+    if (face->sup.usec == 0)
+        face->sup.usec = h->data_pause_microsec;
+    return(face->sup.usec);
+}
+
 /**
  * Decide how much to delay the content sent out on a face.
  *
@@ -309,7 +545,7 @@ choose_face_delay(struct ccnd_handle *h, struct face *face, enum cq_delay_class
     if ((face->flags & CCN_FACE_LOCAL) != 0)
         return(5); /* local stream, answer quickly */
     if ((face->flags & CCN_FACE_MCAST) != 0)
-        return((h->data_pause_microsec) << shift); /* multicast, delay more */
+        return(suppress_usec(h, face) << shift); /* multicast, delay more */
     if ((face->flags & CCN_FACE_GG) != 0)
         return(100 << shift); /* localhost, delay just a little */
     if ((face->flags & CCN_FACE_DGRAM) != 0)
@@ -325,19 +561,30 @@ content_queue_create(struct ccnd_handle *h, struct face *face, enum cq_delay_cla
 {
     struct content_queue *q;
     unsigned usec;
+    unsigned burst_usec;
+    int k;
     q = calloc(1, sizeof(*q));
     if (q != NULL) {
         usec = choose_face_delay(h, face, c);
-        q->burst_nsec = (usec <= 500 ? 500 : 150000); // XXX - needs a knob
+        /* The burst rate should not follow the adapted multicast delay */
+        burst_usec = usec;
+        if ((face->flags & CCN_FACE_MCAST) != 0)
+            burst_usec = h->data_pause_microsec << (c == CCN_CQ_SLOW ? 2 : 0);
+        q->burst_nsec = (burst_usec <= 500 ? 500 : 150000); // XXX - needs a knob
         q->min_usec = usec;
         q->rand_usec = 2 * usec;
         q->nrun = 0;
-        q->send_queue = ccn_indexbuf_create();
-        if (q->send_queue == NULL) {
-            free(q);
-            return(NULL);
+        for (k = 0; k < CCND_TC_N; k++) {
+            q->send_queue[k] = ccn_indexbuf_create();
+            q->stamp[k] = ccn_indexbuf_create();
+            if (q->send_queue[k] == NULL || q->stamp[k] == NULL) {
+                content_queue_destroy(h, &q);
+                return(NULL);
+            }
         }
-        q->sender = NULL;
+        q->turn = 1;
+        q->faceid = face->faceid;
+        q->paced = CCND_PACED_IDLE;
     }
     return(q);
 }
@@ -349,13 +596,15 @@ static void
 content_queue_destroy(struct ccnd_handle *h, struct content_queue **pq)
 {
     struct content_queue *q;
+    int k;
     if (*pq != NULL) {
         q = *pq;
-        ccn_indexbuf_destroy(&q->send_queue);
-        if (q->sender != NULL) {
-            ccn_schedule_cancel(h->sched, q->sender);
-            q->sender = NULL;
+        for (k = 0; k < CCND_TC_N; k++) {
+            ccn_indexbuf_destroy(&q->send_queue[k]);
+            ccn_indexbuf_destroy(&q->stamp[k]);
         }
+        if (q->paced == CCND_PACED_QUEUED)
+            pacer_remove(h, q);
         free(q);
         *pq = NULL;
     }
@@ -414,17 +663,30 @@ finalize_face(struct hashtb_enumerator *e)
     if (i < h->face_limit && h->faces_by_faceid[i] == face) {
         if ((face->flags & CCN_FACE_UNDECIDED) == 0)
             ccnd_face_status_change(h, face->faceid);
-        if (e->ht == h->faces_by_fd)
+        if (h->trace_on)
+            ccnd_trace_event(h, CCND_TR_FACE_DOWN, face->faceid,
+                             NULL, 0, 0, 0, 0, face->flags);
+        if (e->ht == h->faces_by_fd) {
+            face_io_withdraw(h, face);
             ccnd_close_fd(h, face->faceid, &face->recv_fd);
+        }
         h->faces_by_faceid[i] = NULL;
-        if ((face->flags & CCN_FACE_UNDECIDED) != 0 &&
-              face->faceid == ((h->face_rover - 1) | h->face_gen)) {
+        if (face->pending_interests > 0)
+            h->pit_faces -= 1;
+        if ((face->flags & CCN_FACE_UNDECIDED) != 0) {
             /* stream connection with no ccn traffic - safe to reuse */
             recycle = 1;
-            h->face_rover--;
         }
+        else
+            h->face_slots[i].gen += MAXFACES + 1;
+        face_slot_release(h, i, recycle);
         for (c = 0; c < CCN_CQ_N; c++)
             content_queue_destroy(h, &(face->q[c]));
+        if (face->packer.ev != NULL)
+            ccn_schedule_cancel(h->sched, face->packer.ev);
+        ccn_charbuf_destroy(&face->packer.buf);
+        fraglink_destroy(h, face);
+        arq_destroy(h, face);
         ccnd_msg(h, "%s face id %u (slot %u)",
             recycle ? "recycling" : "releasing",
             face->faceid, face->faceid & MAXFACES);
@@ -432,353 +694,525 @@ finalize_face(struct hashtb_enumerator *e)
     }
     else if (face->faceid != CCN_NOFACEID)
         ccnd_msg(h, "orphaned face %u", face->faceid);
+    idle_wheel_unlink(face);
     for (m = 0; m < CCND_FACE_METER_N; m++)
         ccnd_meter_destroy(&face->meter[m]);
+    ccn_shmring_destroy(&face->shm);
+    free(face->lat);
+    face->lat = NULL;
 }
 
 /**
  * Convert an accession to its associated content handle.
  *
+ * The accession may be one taken from a queue (see CCND_ACCESSION_MATCH).
  * @returns content handle, or NULL if it is no longer available.
  */
 static struct content_entry *
 content_from_accession(struct ccnd_handle *h, ccn_accession_t accession)
 {
+    unsigned slot = accession & CCND_CONTENT_SLOTMASK;
     struct content_entry *ans = NULL;
-    if (accession < h->accession_base) {
-        struct sparse_straggler_entry *entry;
-        entry = hashtb_lookup(h->sparse_straggler_tab,
-                              &accession, sizeof(accession));
-        if (entry != NULL)
-            ans = entry->content;
-    }
-    else if (accession < h->accession_base + h->content_by_accession_window) {
-        ans = h->content_by_accession[accession - h->accession_base];
-        if (ans != NULL && ans->accession != accession)
+    if (slot < h->content_slot_limit) {
+        ans = h->content_by_slot[slot];
+        if (ans != NULL && !CCND_ACCESSION_MATCH(accession, ans->accession))
             ans = NULL;
     }
     return(ans);
 }
 
 /**
- *  Sweep old entries out of the direct accession-to-content table
+ * Put a content slot on the free list.
+ *
+ * The free list is a min-heap, so that the lowest slots are used first
+ * and the top of the table can drain, letting content_slots_trim
+ * give the memory back.
  */
 static void
-cleanout_stragglers(struct ccnd_handle *h)
-{
-    ccn_accession_t accession;
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
-    struct sparse_straggler_entry *entry = NULL;
-    struct content_entry **a = h->content_by_accession;
-    unsigned n_direct;
-    unsigned n_occupied;
-    unsigned window;
-    unsigned i;
-    if (h->accession <= h->accession_base || a[0] == NULL)
-        return;
-    n_direct = h->accession - h->accession_base;
-    if (n_direct < 1000)
-        return;
-    n_occupied = hashtb_n(h->content_tab) - hashtb_n(h->sparse_straggler_tab);
-    if (n_occupied >= (n_direct / 8))
-        return;
-    /* The direct lookup table is too sparse, so sweep stragglers */
-    hashtb_start(h->sparse_straggler_tab, e);
-    window = h->content_by_accession_window;
-    for (i = 0; i < window; i++) {
-        if (a[i] != NULL) {
-            if (n_occupied >= ((window - i) / 8))
-                break;
-            accession = h->accession_base + i;
-            hashtb_seek(e, &accession, sizeof(accession), 0);
-            entry = e->data;
-            if (entry != NULL && entry->content == NULL) {
-                entry->content = a[i];
-                a[i] = NULL;
-                n_occupied -= 1;
-            }
-        }
+content_slot_release(struct ccnd_handle *h, unsigned slot)
+{
+    unsigned *heap = h->content_slot_free;
+    unsigned i = h->content_slot_nfree++;
+    unsigned parent;
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (heap[parent] <= slot)
+            break;
+        heap[i] = heap[parent];
+        i = parent;
     }
-    hashtb_end(e);
+    heap[i] = slot;
+}
+
+/**
+ * Restore the heap order below position i of the free list.
+ */
+static void
+content_slot_sift(struct ccnd_handle *h, unsigned i)
+{
+    unsigned *heap = h->content_slot_free;
+    unsigned n = h->content_slot_nfree;
+    unsigned slot = heap[i];
+    unsigned c;
+    for (c = 2 * i + 1; c < n; i = c, c = 2 * i + 1) {
+        if (c + 1 < n && heap[c + 1] < heap[c])
+            c++;
+        if (slot <= heap[c])
+            break;
+        heap[i] = heap[c];
+    }
+    heap[i] = slot;
 }
 
 /**
- *  Prevent the direct accession-to-content table from becoming too sparse
+ * Make room for more content, up to limit slots.
+ * @returns 0 for success, -1 for failure.
  */
 static int
-cleanout_empties(struct ccnd_handle *h)
+content_slots_grow(struct ccnd_handle *h, unsigned limit)
 {
-    unsigned i = 0;
-    unsigned j = 0;
-    struct content_entry **a = h->content_by_accession;
-    unsigned window = h->content_by_accession_window;
+    struct content_entry **a = NULL;
+    unsigned *f = NULL;
+    unsigned n = h->content_slot_limit;
+    unsigned i;
+    
+    if (limit > CCND_CONTENT_SLOTMASK + 1)
+        limit = CCND_CONTENT_SLOTMASK + 1;
+    if (limit <= n)
+        return(-1); /* overflow */
+    a = realloc(h->content_by_slot, limit * sizeof(a[0]));
     if (a == NULL)
+        return(-1); /* ENOMEM */
+    h->content_by_slot = a;
+    f = realloc(h->content_slot_free, limit * sizeof(f[0]));
+    if (f == NULL)
         return(-1);
-    cleanout_stragglers(h);
-    while (i < window && a[i] == NULL)
-        i++;
-    if (i == 0)
-        return(-1);
-    h->accession_base += i;
-    while (i < window)
-        a[j++] = a[i++];
-    while (j < window)
-        a[j++] = NULL;
+    h->content_slot_free = f;
+    for (i = n; i < limit; i++) {
+        a[i] = NULL;
+        content_slot_release(h, i);
+    }
+    h->content_slot_limit = limit;
     return(0);
 }
 
 /**
- * Assign an accession number to a content object
+ * Give back the top of the content slot table, if it has drained.
+ *
+ * The slots that remain keep their places, so outstanding accessions
+ * stay good.
  */
 static void
-enroll_content(struct ccnd_handle *h, struct content_entry *content)
+content_slots_trim(struct ccnd_handle *h)
 {
-    unsigned new_window;
-    struct content_entry **new_array;
-    struct content_entry **old_array;
-    unsigned i = 0;
-    unsigned j = 0;
-    unsigned window = h->content_by_accession_window;
-    if ((content->accession - h->accession_base) >= window &&
-          cleanout_empties(h) < 0) {
-        if (content->accession < h->accession_base)
-            return;
-        window = h->content_by_accession_window;
-        old_array = h->content_by_accession;
-        new_window = ((window + 20) * 3 / 2);
-        if (new_window < window)
-            return;
-        new_array = calloc(new_window, sizeof(new_array[0]));
-        if (new_array == NULL)
-            return;
-        while (i < h->content_by_accession_window && old_array[i] == NULL)
-            i++;
-        h->accession_base += i;
-        h->content_by_accession = new_array;
-        while (i < h->content_by_accession_window)
-            new_array[j++] = old_array[i++];
-        h->content_by_accession_window = new_window;
-    free(old_array);
-    }
-    h->content_by_accession[content->accession - h->accession_base] = content;
+    struct content_entry **a = h->content_by_slot;
+    unsigned *f = h->content_slot_free;
+    unsigned limit = h->content_slot_limit;
+    unsigned top = limit;
+    unsigned i, j;
+    
+    if (limit <= 1024 || ccnd_content_count(h) >= limit / 4)
+        return;
+    while (top > 0 && a[top - 1] == NULL)
+        top--;
+    if (top > limit / 2)
+        return;
+    limit = (top + 1) * 3 / 2;
+    if (limit < 1024)
+        limit = 1024;
+    for (i = 0, j = 0; i < h->content_slot_nfree; i++)
+        if (f[i] < limit)
+            f[j++] = f[i];
+    h->content_slot_nfree = j;
+    for (i = j / 2; i > 0; i--)
+        content_slot_sift(h, i - 1);
+    h->content_slot_limit = limit;
+    a = realloc(a, limit * sizeof(a[0]));
+    if (a != NULL)
+        h->content_by_slot = a;
+    f = realloc(f, limit * sizeof(f[0]));
+    if (f != NULL)
+        h->content_slot_free = f;
 }
 
-// the hash table this is for is going away
-static void
-finalize_content(struct hashtb_enumerator *content_enumerator)
+/**
+ * Assign an accession number to a content object
+ * @returns 0 for success, -1 for failure.
+ */
+static int
+enroll_content(struct ccnd_handle *h, struct content_entry *content)
 {
-    struct ccnd_handle *h = hashtb_get_param(content_enumerator->ht, NULL);
-    struct content_entry *entry = content_enumerator->data;
-    unsigned i = entry->accession - h->accession_base;
-    if (i < h->content_by_accession_window &&
-          h->content_by_accession[i] == entry) {
-        content_skiplist_remove(h, entry);
-        h->content_by_accession[i] = NULL;
-    }
-    else {
-        struct hashtb_enumerator ee;
-        struct hashtb_enumerator *e = &ee;
-        hashtb_start(h->sparse_straggler_tab, e);
-        if (hashtb_seek(e, &entry->accession, sizeof(entry->accession), 0) ==
-              HT_NEW_ENTRY) {
-            ccnd_msg(h, "orphaned content %llu",
-                     (unsigned long long)(entry->accession));
-            hashtb_delete(e);
-            hashtb_end(e);
-            return;
-        }
-        content_skiplist_remove(h, entry);
-        hashtb_delete(e);
-        hashtb_end(e);
-    }
-    if (entry->comps != NULL) {
-        free(entry->comps);
-        entry->comps = NULL;
-    }
+    unsigned slot;
+    
+    if (h->content_slot_nfree == 0 &&
+        content_slots_grow(h, (h->content_slot_limit + 1) * 3 / 2) < 0)
+        return(-1);
+    slot = h->content_slot_free[0];
+    h->content_slot_free[0] = h->content_slot_free[--h->content_slot_nfree];
+    if (h->content_slot_nfree > 0)
+        content_slot_sift(h, 0);
+    h->accession++;
+    content->accession = (h->accession << CCND_CONTENT_SLOTBITS) | slot;
+    h->content_by_slot[slot] = content;
+    return(0);
 }
 
 /**
- * Find the skiplist entries associated with the key.
+ * How many arrivals ago the content was accessioned.
  *
- * @returns the number of entries of ans that were filled in.
+ * This is modulo the arrival bits kept in the accession.
  */
-static int
-content_skiplist_findbefore(struct ccnd_handle *h,
-                            const unsigned char *key,
-                            size_t keysize,
-                            struct content_entry *wanted_old,
-                            struct ccn_indexbuf **ans)
+static ccn_accession_t
+content_age(struct ccnd_handle *h, struct content_entry *content)
 {
-    int i;
-    int n = h->skiplinks->n;
-    struct ccn_indexbuf *c;
-    struct content_entry *content;
-    int order;
-    size_t start;
-    size_t end;
-    
-    c = h->skiplinks;
-    for (i = n - 1; i >= 0; i--) {
-        for (;;) {
-            if (c->buf[i] == 0)
-                break;
-            content = content_from_accession(h, c->buf[i]);
-            if (content == NULL)
-                abort();
-            start = content->comps[0];
-            end = content->comps[content->ncomps - 1];
-            order = ccn_compare_names(content->key + start - 1, end - start + 2,
-                                      key, keysize);
-            if (order > 0)
-                break;
-            if (order == 0 && (wanted_old == content || wanted_old == NULL))
-                break;
-            if (content->skiplinks == NULL || i >= content->skiplinks->n)
-                abort();
-            c = content->skiplinks;
-        }
-        ans[i] = c;
-    }
-    return(n);
+    ccn_accession_t arrival = content->accession >> CCND_CONTENT_SLOTBITS;
+    return((h->accession - arrival) &
+           (~(ccn_accession_t)0 >> CCND_CONTENT_SLOTBITS));
 }
 
 /**
- * Limit for how deep our skiplists can be
+ * Estimate the memory used to hold content, apart from the object itself
  */
-#define CCN_SKIPLIST_MAX_DEPTH 30
+static size_t
+content_overhead(struct content_entry *content)
+{
+    return(sizeof(*content) + CCND_CONTENT_OVERHEAD +
+           content->ncomps * sizeof(content->comps[0]) +
+           content->suffix_size);
+}
 
 /**
- * Insert a new entry into the skiplist.
+ * Bytes taken by the stored form of a ContentObject, which is less
+ * than its size once it has been compressed
  */
-static void
-content_skiplist_insert(struct ccnd_handle *h, struct content_entry *content)
+static size_t
+content_stored_size(struct content_entry *content)
 {
-    int d;
-    int i;
-    size_t start;
-    size_t end;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
-    if (content->skiplinks != NULL) abort();
-    for (d = 1; d < CCN_SKIPLIST_MAX_DEPTH - 1; d++)
-        if ((nrand48(h->seed) & 3) != 0) break;
-    while (h->skiplinks->n < d)
-        ccn_indexbuf_append_element(h->skiplinks, 0);
-    start = content->comps[0];
-    end = content->comps[content->ncomps - 1];
-    i = content_skiplist_findbefore(h,
-                                    content->key + start - 1,
-                                    end - start + 2, NULL, pred);
-    if (i < d)
-        d = i; /* just in case */
-    content->skiplinks = ccn_indexbuf_create();
-    for (i = 0; i < d; i++) {
-        ccn_indexbuf_append_element(content->skiplinks, pred[i]->buf[i]);
-        pred[i]->buf[i] = content->accession;
-    }
+    if ((content->flags & CCN_CONTENT_ENTRY_COMPRESSED) != 0)
+        return(content->key_size + content->zsize);
+    return(content->size);
 }
 
 /**
- * Remove an entry from the skiplist.
+ * The content_tab key, which is the implicit digest in the name
  */
-static void
-content_skiplist_remove(struct ccnd_handle *h, struct content_entry *content)
+static const unsigned char *
+content_digest(struct content_entry *content)
 {
-    int i;
-    int d;
-    size_t start;
-    size_t end;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
-    if (content->skiplinks == NULL) abort();
-    start = content->comps[0];
-    end = content->comps[content->ncomps - 1];
-    d = content_skiplist_findbefore(h,
-                                    content->key + start - 1,
-                                    end - start + 2, content, pred);
-    if (d > content->skiplinks->n)
-        d = content->skiplinks->n;
-    for (i = 0; i < d; i++) {
-        pred[i]->buf[i] = content->skiplinks->buf[i];
-    }
-    ccn_indexbuf_destroy(&content->skiplinks);
+    return(content->key + content->comps[content->ncomps - 1] - 1 - 32);
 }
 
 /**
- * Find the first candidate that might match the given interest.
+ * Microseconds of cpu time used since t0
  */
-static struct content_entry *
-find_first_match_candidate(struct ccnd_handle *h,
-                           const unsigned char *interest_msg,
-                           const struct ccn_parsed_interest *pi)
+static uintmax_t
+cpu_usec_since(clock_t t0)
 {
-    int res;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
-    size_t start = pi->offset[CCN_PI_B_Name];
-    size_t end = pi->offset[CCN_PI_E_Name];
-    struct ccn_charbuf *namebuf = NULL;
-    if (pi->offset[CCN_PI_B_Exclude] < pi->offset[CCN_PI_E_Exclude]) {
-        /* Check for <Exclude><Any/><Component>... fast case */
-        struct ccn_buf_decoder decoder;
-        struct ccn_buf_decoder *d;
-        size_t ex1start;
-        size_t ex1end;
-        d = ccn_buf_decoder_start(&decoder,
-                                  interest_msg + pi->offset[CCN_PI_B_Exclude],
-                                  pi->offset[CCN_PI_E_Exclude] -
-                                  pi->offset[CCN_PI_B_Exclude]);
-        ccn_buf_advance(d);
-        if (ccn_buf_match_dtag(d, CCN_DTAG_Any)) {
-            ccn_buf_advance(d);
-            ccn_buf_check_close(d);
-            if (ccn_buf_match_dtag(d, CCN_DTAG_Component)) {
-                ex1start = pi->offset[CCN_PI_B_Exclude] + d->decoder.token_index;
-                ccn_buf_advance_past_element(d);
-                ex1end = pi->offset[CCN_PI_B_Exclude] + d->decoder.token_index;
-                if (d->decoder.state >= 0) {
-                    namebuf = ccn_charbuf_create();
-                    ccn_charbuf_append(namebuf,
-                                       interest_msg + start,
-                                       end - start);
-                    namebuf->length--;
-                    ccn_charbuf_append(namebuf,
-                                       interest_msg + ex1start,
-                                       ex1end - ex1start);
-                    ccn_charbuf_append_closer(namebuf);
-                    if (h->debug & 8)
-                        ccnd_debug_ccnb(h, __LINE__, "fastex", NULL,
-                                        namebuf->buf, namebuf->length);
-                }
-            }
-        }
-    }
-    if (namebuf == NULL) {
-        res = content_skiplist_findbefore(h, interest_msg + start, end - start,
-                                          NULL, pred);
-    }
-    else {
-        res = content_skiplist_findbefore(h, namebuf->buf, namebuf->length,
-                                          NULL, pred);
-        ccn_charbuf_destroy(&namebuf);
-    }
-    if (res == 0)
-        return(NULL);
-    return(content_from_accession(h, pred[0]->buf[0]));
+    return((uintmax_t)(clock() - t0) * 1000000 / CLOCKS_PER_SEC);
 }
 
 /**
- * Check for a prefix match.
+ * Get the whole of a ContentObject held in the store.
+ *
+ * Compressed content is expanded into a buffer that the next expansion
+ * reuses, so the result is good only until then.  The part before the
+ * Content element (and so the name) may always be had from content->key.
+ * @returns the ContentObject, or NULL if it could not be expanded.
  */
-static int
-content_matches_interest_prefix(struct ccnd_handle *h,
-                                struct content_entry *content,
-                                const unsigned char *interest_msg,
-                                struct ccn_indexbuf *comps,
-                                int prefix_comps)
+static const unsigned char *
+content_object(struct ccnd_handle *h, struct content_entry *content)
 {
-    size_t prefixlen;
-    if (prefix_comps < 0 || prefix_comps >= comps->n)
-        abort();
-    /* First verify the prefix match. */
+    struct ccn_charbuf *c = h->expanded;
+    clock_t t0;
+    ssize_t n;
+    
+    if ((content->flags & CCN_CONTENT_ENTRY_COMPRESSED) == 0)
+        return(content->key);
+    if (h->expanded_accession == content->accession)
+        return(c->buf);
+    h->expanded_accession = 0;
+    if (ccn_charbuf_reserve(c, content->size) == NULL)
+        return(NULL);
+    t0 = clock();
+    memcpy(c->buf, content->key, content->key_size);
+    n = ccnd_lz_expand(content->key + content->key_size, content->zsize,
+                       c->buf + content->key_size,
+                       content->size - content->key_size);
+    h->expand_usec += cpu_usec_since(t0);
+    h->expansions++;
+    if (n != content->size - content->key_size) {
+        ccnd_msg(h, "could not expand content (accession %llu)",
+                 (unsigned long long)content->accession);
+        return(NULL);
+    }
+    c->length = content->size;
+    h->expanded_accession = content->accession;
+    return(c->buf);
+}
+
+/**
+ * Debug output for a content entry.
+ *
+ * This does not expand compressed content, so only the part before
+ * the Content element is shown for that.
+ */
+static void
+debug_content(struct ccnd_handle *h, int lineno, const char *msg,
+              struct face *face, struct content_entry *content)
+{
+    size_t size = content->size;
+    
+    if ((content->flags & CCN_CONTENT_ENTRY_COMPRESSED) != 0)
+        size = content->key_size;
+    ccnd_debug_ccnb(h, lineno, msg, face, content->key, size);
+}
+
+/**
+ * Check whether a content store shard is over either of its capacity limits
+ * @param n is the number of objects to be considered held
+ * @param bytes is the number of bytes (including overhead) to be considered
+ */
+static int
+shard_over_capacity(struct ccnd_cs_shard *s, unsigned long n, size_t bytes)
+{
+    return(n > s->capacity || bytes > s->capacity_bytes);
+}
+
+static int
+shard_full(struct ccnd_cs_shard *s)
+{
+    return(shard_over_capacity(s, hashtb_n(s->content_tab), s->bytes));
+}
+
+/**
+ * Count the content store shards that are over capacity
+ */
+static int
+content_shards_full(struct ccnd_handle *h)
+{
+    int i;
+    int n = 0;
+    
+    for (i = 0; i < h->cs_n; i++)
+        if (shard_full(&h->cs[i]))
+            n++;
+    return(n);
+}
+
+/**
+ * Count the content objects held, over all of the shards
+ */
+unsigned long
+ccnd_content_count(struct ccnd_handle *h)
+{
+    unsigned long n = 0;
+    int i;
+    
+    for (i = 0; i < h->cs_n; i++)
+        n += hashtb_n(h->cs[i].content_tab);
+    return(n);
+}
+
+/** Names of the memory accounting tags, for reports */
+static const char *const ccnd_mem_names[CCND_MEM_N] = {
+    "content_tab",
+    "content",
+    "nameindex",
+    "nameprefix",
+    "fib",
+    "pit",
+    "faces",
+    "face_buffers",
+    "sched",
+};
+
+/**
+ * Bring the census-based memory tags up to date
+ *
+ * Face buffers come and go on the busiest paths, and the scheduler is
+ * in the library, so these are counted by looking rather than at each
+ * allocation.  This is called when the tags are about to be reported.
+ */
+void
+ccnd_mem_census(struct ccnd_handle *h)
+{
+    struct face *face;
+    struct ccnd_outq *q;
+    uintmax_t bytes = 0;
+    uintmax_t objects = 0;
+    unsigned i;
+    int k;
+    int n;
+    
+    for (i = 0; i < h->face_limit; i++) {
+        face = h->faces_by_faceid[i];
+        if (face == NULL)
+            continue;
+        if (face->inbuf != NULL) {
+            bytes += face->inbuf->limit;
+            objects++;
+        }
+        q = face->outq;
+        if (q != NULL) {
+            bytes += sizeof(*q) + q->limit * sizeof(q->seg[0]);
+            objects++;
+            for (k = q->head; k < q->n; k++) {
+                if (q->seg[k].copy != NULL) {
+                    bytes += q->seg[k].copy->limit;
+                    objects++;
+                }
+            }
+        }
+    }
+    if (h->spare_inbuf != NULL) {
+        bytes += h->spare_inbuf->limit;
+        objects++;
+    }
+    if (h->dgram_io != NULL && h->dgram_io->obuf != NULL) {
+        bytes += sizeof(*h->dgram_io) + h->dgram_io->obuf->limit;
+        objects += 2;
+    }
+    ccn_memacct_set(&h->mem[CCND_MEM_FACEBUF], bytes, objects);
+    bytes = ccn_schedule_memory(h->sched, &n);
+    ccn_memacct_set(&h->mem[CCND_MEM_SCHED], bytes, n);
+}
+
+/**
+ * Choose the content store shard for a name
+ *
+ * The name includes the implicit digest, so the shards fill evenly
+ * even when much of the content shares a prefix.
+ */
+static unsigned
+content_shard_index(struct ccnd_handle *h,
+                    const unsigned char *name, size_t size)
+{
+    uint32_t x = 2166136261U;
+    size_t i;
+    
+    if (h->cs_n <= 1)
+        return(0);
+    for (i = 0; i < size; i++)
+        x = (x ^ name[i]) * 16777619U;
+    return(x % h->cs_n);
+}
+
+// the hash table this is for is going away
+static void
+finalize_content(struct hashtb_enumerator *content_enumerator)
+{
+    struct ccnd_handle *h = hashtb_get_param(content_enumerator->ht, NULL);
+    struct content_entry *entry = content_enumerator->data;
+    struct ccnd_cs_shard *s = &h->cs[entry->shard];
+    unsigned slot = entry->accession & CCND_CONTENT_SLOTMASK;
+    if (s->cache != NULL)
+        ccnd_cache_withdraw(s->cache, entry);
+    if (entry->key != NULL) {
+        h->content_bytes -= content_stored_size(entry);
+        h->content_overhead -= content_overhead(entry);
+        s->bytes -= content_stored_size(entry) + content_overhead(entry);
+        if (entry->quota != 0)
+            ccnd_quota_uncharge(h->quota, entry->quota, entry->size);
+        if (entry->fresh_rule != 0) {
+            h->fresh_rule[entry->fresh_rule].objects--;
+            h->fresh_rule[entry->fresh_rule].bytes -= entry->size;
+        }
+        if ((entry->flags & CCN_CONTENT_ENTRY_COMPRESSED) != 0) {
+            h->compressed--;
+            h->compressed_in -= entry->size - entry->key_size;
+            h->compressed_out -= entry->zsize;
+        }
+        ccn_memacct_free(&h->mem[CCND_MEM_CONTENT], (void *)entry->key);
+        entry->key = NULL;
+    }
+    if (slot < h->content_slot_limit && h->content_by_slot[slot] == entry) {
+        ccnd_nameindex_remove(h->nameindex, entry);
+        h->content_by_slot[slot] = NULL;
+        content_slot_release(h, slot);
+    }
+    else if (entry->accession != 0)
+        ccnd_msg(h, "orphaned content %llu",
+                 (unsigned long long)(entry->accession));
+    if (entry->comps != NULL) {
+        ccn_memacct_free(&h->mem[CCND_MEM_CONTENT], entry->comps);
+        entry->comps = NULL;
+    }
+    ccnd_intern_release(h->intern, entry->prefix);
+    entry->prefix = NULL;
+}
+
+/**
+ * Find the first candidate that might match the given interest.
+ */
+static struct content_entry *
+find_first_match_candidate(struct ccnd_handle *h,
+                           const unsigned char *interest_msg,
+                           const struct ccn_parsed_interest *pi)
+{
+    struct content_entry *content;
+    size_t start = pi->offset[CCN_PI_B_Name];
+    size_t end = pi->offset[CCN_PI_E_Name];
+    struct ccn_charbuf *namebuf = NULL;
+    if (pi->offset[CCN_PI_B_Exclude] < pi->offset[CCN_PI_E_Exclude]) {
+        /* Check for <Exclude><Any/><Component>... fast case */
+        struct ccn_buf_decoder decoder;
+        struct ccn_buf_decoder *d;
+        size_t ex1start;
+        size_t ex1end;
+        d = ccn_buf_decoder_start(&decoder,
+                                  interest_msg + pi->offset[CCN_PI_B_Exclude],
+                                  pi->offset[CCN_PI_E_Exclude] -
+                                  pi->offset[CCN_PI_B_Exclude]);
+        ccn_buf_advance(d);
+        if (ccn_buf_match_dtag(d, CCN_DTAG_Any)) {
+            ccn_buf_advance(d);
+            ccn_buf_check_close(d);
+            if (ccn_buf_match_dtag(d, CCN_DTAG_Component)) {
+                ex1start = pi->offset[CCN_PI_B_Exclude] + d->decoder.token_index;
+                ccn_buf_advance_past_element(d);
+                ex1end = pi->offset[CCN_PI_B_Exclude] + d->decoder.token_index;
+                if (d->decoder.state >= 0) {
+                    namebuf = charbuf_obtain(h);
+                    ccn_charbuf_append(namebuf,
+                                       interest_msg + start,
+                                       end - start);
+                    namebuf->length--;
+                    ccn_charbuf_append(namebuf,
+                                       interest_msg + ex1start,
+                                       ex1end - ex1start);
+                    ccn_charbuf_append_closer(namebuf);
+                    if (h->debug & 8)
+                        ccnd_debug_ccnb(h, __LINE__, "fastex", NULL,
+                                        namebuf->buf, namebuf->length);
+                }
+            }
+        }
+    }
+    if (namebuf == NULL)
+        content = ccnd_nameindex_lookup(h->nameindex, interest_msg + start,
+                                        end - start);
+    else {
+        content = ccnd_nameindex_lookup(h->nameindex, namebuf->buf,
+                                        namebuf->length);
+        charbuf_release(h, namebuf);
+    }
+    return(content);
+}
+
+/**
+ * Check for a prefix match.
+ */
+static int
+content_matches_interest_prefix(struct ccnd_handle *h,
+                                struct content_entry *content,
+                                const unsigned char *interest_msg,
+                                struct ccn_indexbuf *comps,
+                                int prefix_comps)
+{
+    size_t prefixlen;
+    if (prefix_comps < 0 || prefix_comps >= comps->n)
+        abort();
+    /* First verify the prefix match. */
     if (content->ncomps < prefix_comps + 1)
             return(0);
     prefixlen = comps->buf[prefix_comps] - comps->buf[0];
@@ -792,16 +1226,104 @@ content_matches_interest_prefix(struct ccnd_handle *h,
 }
 
 /**
- * Advance to the next entry in the skiplist.
+ * Size class for a pending interest message, or -1 if too large.
  */
-static ccn_accession_t
-content_skiplist_next(struct ccnd_handle *h, struct content_entry *content)
+static int
+pit_size_class(size_t size)
 {
-    if (content == NULL)
-        return(0);
-    if (content->skiplinks == NULL || content->skiplinks->n < 1)
-        return(0);
-    return(content->skiplinks->buf[0]);
+    int c;
+    for (c = 0; c < CCND_PIT_CLASSES; c++)
+        if (size <= ((size_t)1 << (CCND_PIT_MIN_SHIFT + c)))
+            return(c);
+    return(-1);
+}
+
+/**
+ * @returns the bytes of PIT storage taken by a message of the given size
+ */
+static size_t
+pit_msg_cost(size_t size)
+{
+    int c = pit_size_class(size);
+    
+    return(c < 0 ? size : (size_t)1 << (CCND_PIT_MIN_SHIFT + c));
+}
+
+/**
+ * Allocate storage for a pending interest message.
+ *
+ * This is done for every interest that enters the PIT, so small
+ * messages come from per-class free lists rather than malloc.
+ */
+static unsigned char *
+pit_msg_alloc(struct ccnd_handle *h, size_t size)
+{
+    int c = pit_size_class(size);
+    size_t bsize;
+    size_t off;
+    unsigned char *slab;
+    void *b;
+    
+    if (c < 0) {
+        b = ccn_memacct_malloc(&h->mem[CCND_MEM_PIT], size);
+        if (b != NULL)
+            h->pit_msg_bytes += size;
+        return(b);
+    }
+    bsize = (size_t)1 << (CCND_PIT_MIN_SHIFT + c);
+    if (h->pit_free[c] == NULL) {
+        slab = ccn_memacct_malloc(&h->mem[CCND_MEM_PIT], CCND_PIT_SLAB_BYTES);
+        if (slab == NULL)
+            return(NULL);
+        *(void **)slab = h->pit_slabs;
+        h->pit_slabs = slab;
+        h->pit_slab_bytes += CCND_PIT_SLAB_BYTES;
+        /* first block is given up to the slab link, for alignment */
+        for (off = bsize; off + bsize <= CCND_PIT_SLAB_BYTES; off += bsize) {
+            *(void **)(slab + off) = h->pit_free[c];
+            h->pit_free[c] = slab + off;
+        }
+    }
+    b = h->pit_free[c];
+    h->pit_free[c] = *(void **)b;
+    h->pit_msg_bytes += bsize;
+    return(b);
+}
+
+/**
+ * Return storage for a pending interest message of the given size.
+ */
+static void
+pit_msg_free(struct ccnd_handle *h, unsigned char *msg, size_t size)
+{
+    int c = pit_size_class(size);
+    
+    if (c < 0) {
+        h->pit_msg_bytes -= size;
+        ccn_memacct_free(&h->mem[CCND_MEM_PIT], msg);
+        return;
+    }
+    *(void **)msg = h->pit_free[c];
+    h->pit_free[c] = msg;
+    h->pit_msg_bytes -= (size_t)1 << (CCND_PIT_MIN_SHIFT + c);
+}
+
+/**
+ * Release the slabs, once the PIT is gone.
+ */
+static void
+pit_slabs_destroy(struct ccnd_handle *h)
+{
+    void *slab;
+    int c;
+    
+    while ((slab = h->pit_slabs) != NULL) {
+        h->pit_slabs = *(void **)slab;
+        ccn_memacct_free(&h->mem[CCND_MEM_PIT], slab);
+    }
+    for (c = 0; c < CCND_PIT_CLASSES; c++)
+        h->pit_free[c] = NULL;
+    h->pit_slab_bytes = 0;
 }
 
 /**
@@ -811,13 +1333,19 @@ static void
 consume(struct ccnd_handle *h, struct propagating_entry *pe)
 {
     struct face *face = NULL;
+    release_outstanding(h, pe);
     ccn_indexbuf_destroy(&pe->outbound);
+    ccn_compiled_exclude_destroy(&pe->excl);
     if (pe->interest_msg != NULL) {
-        free(pe->interest_msg);
+        pit_msg_free(h, pe->interest_msg, pe->size);
         pe->interest_msg = NULL;
+        h->pit_pending -= 1;
         face = face_from_faceid(h, pe->faceid);
-        if (face != NULL)
-            face->pending_interests -= 1;
+        if (face != NULL) {
+            face->pending_bytes -= pit_msg_cost(pe->size);
+            if (--face->pending_interests == 0)
+                h->pit_faces -= 1;
+        }
     }
     if (pe->next != NULL) {
         pe->next->prev = pe->prev;
@@ -827,6 +1355,83 @@ consume(struct ccnd_handle *h, struct propagating_entry *pe)
     pe->usec = 0;
 }
 
+/**
+ * Give up the latency histogram slot held by a name prefix entry.
+ */
+static void
+prefix_lat_release(struct ccnd_handle *h, struct nameprefix_entry *npe)
+{
+    int i;
+    
+    for (i = 0; i < CCND_LAT_PREFIXES; i++) {
+        if (h->lat_prefix[i] == npe->lat) {
+            free(h->lat_prefix[i]);
+            h->lat_prefix[i] = NULL;
+        }
+    }
+    npe->lat = NULL;
+    npe->lat_hits = 0;
+}
+
+/**
+ * Take a forwarding entry out of the expiry wheel.
+ */
+static void
+fib_wheel_unlink(struct ccn_forwarding *f)
+{
+    if (f->wlink == NULL)
+        return;
+    *f->wlink = f->wnext;
+    if (f->wnext != NULL)
+        f->wnext->wlink = f->wlink;
+    f->wnext = NULL;
+    f->wlink = NULL;
+}
+
+/**
+ * Put a forwarding entry in the expiry wheel slot for its etick.
+ */
+static void
+fib_wheel_insert(struct ccnd_handle *h, struct ccn_forwarding *f)
+{
+    struct ccn_forwarding **slot;
+    
+    fib_wheel_unlink(f);
+    slot = &h->fib_wheel[f->etick % CCND_FIB_WHEEL];
+    f->wnext = *slot;
+    if (f->wnext != NULL)
+        f->wnext->wlink = &f->wnext;
+    *slot = f;
+    f->wlink = slot;
+}
+
+/**
+ * Free a forwarding entry that is no longer on its prefix's list.
+ */
+static void
+forwarding_free(struct ccnd_handle *h, struct ccn_forwarding *f)
+{
+    fib_wheel_unlink(f);
+    ccn_memacct_free(&h->mem[CCND_MEM_FIB], f);
+}
+
+/**
+ * Lift the freshness rule set on a name prefix entry.
+ *
+ * The rule's slot is kept until the content charged to it is gone.
+ */
+static void
+fresh_rule_lift(struct ccnd_handle *h, struct nameprefix_entry *npe)
+{
+    struct ccnd_fresh_rule *r = &h->fresh_rule[npe->fresh_rule];
+    
+    r->npe = NULL;
+    r->freshness = 0;
+    r->residency = 0;
+    npe->fresh_rule = 0;
+    h->fresh_rules_active--;
+}
+
 /**
  * Clean up a name prefix entry when it is removed from the hash table.
  */
@@ -841,11 +1446,15 @@ finalize_nameprefix(struct hashtb_enumerator *e)
             consume(h, head->next);
     }
     ccn_indexbuf_destroy(&npe->forward_to);
-    ccn_indexbuf_destroy(&npe->tap);
+    ccnd_faceset_destroy(&npe->tap);
+    if (npe->lat != NULL)
+        prefix_lat_release(h, npe);
+    if (npe->fresh_rule != 0)
+        fresh_rule_lift(h, npe);
     while (npe->forwarding != NULL) {
         struct ccn_forwarding *f = npe->forwarding;
         npe->forwarding = f->next;
-        free(f);
+        forwarding_free(h, f);
     }
 }
 
@@ -870,6 +1479,8 @@ finalize_propagating(struct hashtb_enumerator *e)
 {
     struct ccnd_handle *h = hashtb_get_param(e->ht, NULL);
     consume(h, e->data);
+    if (h->dnl != NULL)
+        ccnd_dnl_insert(h->dnl, h->sec, e->key, e->keysize);
 }
 
 /**
@@ -1008,6 +1619,8 @@ record_connection(struct ccnd_handle *h, int fd,
             hashtb_delete(e);
             face = NULL;
         }
+        else
+            face_io_enroll(h, face);
     }
     hashtb_end(e);
     return(face);
@@ -1099,8 +1712,8 @@ make_connection(struct ccnd_handle *h,
     }
     if ((face->flags & CCN_FACE_CONNECTING) != 0) {
         ccnd_msg(h, "connecting to client fd=%d id=%u", fd, face->faceid);
-        face->outbufindex = 0;
-        face->outbuf = ccn_charbuf_create();
+        face->outq = outq_create();
+        face_io_update(h, face);
     }
     else
         ccnd_msg(h, "connected client fd=%d id=%u", fd, face->faceid);
@@ -1216,33 +1829,137 @@ setup_multicast(struct ccnd_handle *h, struct ccn_face_instance *face_instance,
     return(face);
 }
 
+#if defined(CCND_HAVE_ETHER)
 /**
- * Close a socket, destroying the associated face.
+ * Set up an Ethernet face on the named interface.
+ *
+ * Messages go directly in frames of CCND_ETHERTYPE, addressed to
+ * CCND_ETHER_GROUP, so this is much like a multicast face: every ccnd
+ * on the segment hears what is sent on it.  It is a link face, so that
+ * messages too big for a frame can be sent in fragments.
  */
-static void
-shutdown_client_fd(struct ccnd_handle *h, int fd)
+static struct face *
+setup_ether(struct ccnd_handle *h, const char *ifname)
 {
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
+    static const unsigned char group[6] = CCND_ETHER_GROUP;
+    struct sockaddr_ll sll = {0};
+    struct packet_mreq mr = {0};
+    struct ifreq ifr = {0};
     struct face *face = NULL;
-    unsigned faceid = CCN_NOFACEID;
-    hashtb_start(h->faces_by_fd, e);
-    if (hashtb_seek(e, &fd, sizeof(fd), 0) == HT_OLD_ENTRY) {
-        face = e->data;
-        if (face->recv_fd != fd) abort();
-        faceid = face->faceid;
-        if (faceid == CCN_NOFACEID) {
-            ccnd_msg(h, "error indication on fd %d ignored", fd);
-            hashtb_end(e);
-            return;
-        }
-        close(fd);
-        face->recv_fd = -1;
-        ccnd_msg(h, "shutdown client fd=%d id=%u", fd, faceid);
-        ccn_charbuf_destroy(&face->inbuf);
-        ccn_charbuf_destroy(&face->outbuf);
-        face = NULL;
-    }
+    unsigned ifindex;
+    int mtu = 1500;
+    int fd;
+    
+    ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        ccnd_msg(h, "CCND_ETHER: %s: %s", ifname, strerror(errno));
+        return(NULL);
+    }
+    fd = socket(AF_PACKET, SOCK_DGRAM, htons(CCND_ETHERTYPE));
+    if (fd == -1) {
+        ccnd_msg(h, "CCND_ETHER: %s: %s", ifname, strerror(errno));
+        return(NULL);
+    }
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(CCND_ETHERTYPE);
+    sll.sll_ifindex = ifindex;
+    mr.mr_ifindex = ifindex;
+    mr.mr_type = PACKET_MR_MULTICAST;
+    mr.mr_alen = sizeof(group);
+    memcpy(mr.mr_address, group, sizeof(group));
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1 ||
+        setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                   &mr, sizeof(mr)) == -1) {
+        ccnd_msg(h, "CCND_ETHER: %s: %s", ifname, strerror(errno));
+        close(fd);
+        return(NULL);
+    }
+#if defined(PACKET_QDISC_BYPASS)
+    {
+        /* The face has its own shaping; go straight to the driver */
+        int yes = 1;
+        setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &yes, sizeof(yes));
+    }
+#endif
+    establish_min_recv_bufsize(h, fd, 128*1024);
+    strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+    if (ioctl(fd, SIOCGIFMTU, &ifr) == 0 && ifr.ifr_mtu > 0)
+        mtu = ifr.ifr_mtu;
+    sll.sll_halen = sizeof(group);
+    memcpy(sll.sll_addr, group, sizeof(group));
+    face = record_connection(h, fd, (struct sockaddr *)&sll, sizeof(sll),
+                             CCN_FACE_MCAST | CCN_FACE_DGRAM | CCN_FACE_LINK);
+    if (face == NULL) {
+        close(fd);
+        return(NULL);
+    }
+    face->sendface = face->faceid;
+    face->frame_mtu = mtu;
+    ccnd_msg(h, "ethernet on %s fd=%d id=%u mtu %d",
+             ifname, fd, face->faceid, mtu);
+    return(face);
+}
+#endif
+
+/**
+ * Set up Ethernet faces on the interfaces named in CCND_ETHER.
+ *
+ * The names may be separated by whitespace, commas, or semicolons.
+ */
+static void
+ccnd_ether_init(struct ccnd_handle *h, const char *ifnames)
+{
+    char name[64];
+    size_t i, n;
+    
+    if (ifnames == NULL || ifnames[0] == 0)
+        return;
+#if defined(CCND_HAVE_ETHER)
+    for (i = 0; ifnames[i] != 0;) {
+        n = strcspn(ifnames + i, " \t\n,;");
+        if (n > 0 && n < sizeof(name)) {
+            memcpy(name, ifnames + i, n);
+            name[n] = 0;
+            setup_ether(h, name);
+        }
+        i += n;
+        if (ifnames[i] != 0)
+            i++;
+    }
+#else
+    (void)name; (void)i; (void)n;
+    ccnd_msg(h, "CCND_ETHER=%s: not supported here", ifnames);
+#endif
+}
+
+/**
+ * Close a socket, destroying the associated face.
+ */
+static void
+shutdown_client_fd(struct ccnd_handle *h, int fd)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct face *face = NULL;
+    unsigned faceid = CCN_NOFACEID;
+    hashtb_start(h->faces_by_fd, e);
+    if (hashtb_seek(e, &fd, sizeof(fd), 0) == HT_OLD_ENTRY) {
+        face = e->data;
+        if (face->recv_fd != fd) abort();
+        faceid = face->faceid;
+        if (faceid == CCN_NOFACEID) {
+            ccnd_msg(h, "error indication on fd %d ignored", fd);
+            hashtb_end(e);
+            return;
+        }
+        face_io_withdraw(h, face);
+        close(fd);
+        face->recv_fd = -1;
+        ccnd_msg(h, "shutdown client fd=%d id=%u", fd, faceid);
+        ccn_charbuf_destroy(&face->inbuf);
+        outq_destroy(&face->outq);
+        face = NULL;
+    }
     hashtb_delete(e);
     hashtb_end(e);
     check_comm_file(h);
@@ -1258,15 +1975,19 @@ shutdown_client_fd(struct ccnd_handle *h, int fd)
 static void
 send_content(struct ccnd_handle *h, struct face *face, struct content_entry *content)
 {
+    const unsigned char *msg;
     int n, a, b, size;
     if ((face->flags & CCN_FACE_NOSEND) != 0) {
         // XXX - should count this.
         return;
     }
+    content->used = h->sec;
+    msg = content_object(h, content);
+    if (msg == NULL)
+        return;
     size = content->size;
     if (h->debug & 4)
-        ccnd_debug_ccnb(h, __LINE__, "content_to", face,
-                        content->key, size);
+        ccnd_debug_ccnb(h, __LINE__, "content_to", face, msg, size);
     /* Excise the message-digest name component */
     n = content->ncomps;
     if (n < 2) abort();
@@ -1274,9 +1995,17 @@ send_content(struct ccnd_handle *h, struct face *face, struct content_entry *con
     b = content->comps[n - 1];
     if (b - a != 36)
         abort(); /* strange digest length */
-    stuff_and_send(h, face, content->key, a, content->key + b, size - b);
+    if (h->trace_on)
+        trace_content(h, CCND_TR_CONTENT_OUT, face->faceid, content, 0,
+                      content->accession);
+    /* An expanded copy will not last, so it may not be queued by reference */
+    stuff_and_send(h, face, msg, a, msg + b, size - b,
+                   msg == content->key ? content : NULL);
     ccnd_meter_bump(h, face->meter[FM_DATO], 1);
     h->content_items_sent += 1;
+    if (h->hh_bytes != NULL)
+        ccnd_hh_count(h->hh_bytes, h->sec / CCND_HH_HALFLIFE, face->faceid,
+                      size - (b - a), 1, NULL, 0);
 }
 
 /**
@@ -1322,65 +2051,367 @@ randomize_content_delay(struct ccnd_handle *h, struct content_queue *q)
 }
 
 /**
- * Scheduled event for sending from a queue.
+ * Events that adapt the answer suppression delay of a multicast face.
+ */
+enum suppress_event {
+    SUPPRESS_SENT,          /**< we answered, and nobody had beaten us */
+    SUPPRESS_SUPPRESSED,    /**< a peer answered while ours was queued */
+    SUPPRESS_COLLISION      /**< a peer answered with content we had */
+};
+
+/**
+ * Adapt the answer suppression delay of a multicast face.
+ *
+ * Each answer sent shrinks the delay by a sixteenth, so it falls
+ * toward CCND_SUPPRESS_MIN_USEC when we are the only responder.
+ * A suppressed answer grows it by a quarter and a collision doubles it;
+ * in either case it is kept to at least half the link round trip, where
+ * that is known, so that a peer's answer has time to reach us.
+ * The content queues of the face pick up the new value at once.
+ */
+static void
+suppress_adjust(struct ccnd_handle *h, struct face *face,
+                enum suppress_event ev)
+{
+    struct ccnd_suppress *sup = &face->sup;
+    struct content_queue *q;
+    unsigned usec;
+    unsigned hi;
+    enum cq_delay_class c;
+    
+    if ((face->flags & CCN_FACE_MCAST) == 0)
+        return;
+    usec = suppress_usec(h, face);
+    switch (ev) {
+        case SUPPRESS_SENT:
+            sup->sent++;
+            usec -= usec / 16;
+            break;
+        case SUPPRESS_SUPPRESSED:
+            sup->suppressed++;
+            usec += usec / 4 + CCND_SUPPRESS_MIN_USEC;
+            break;
+        case SUPPRESS_COLLISION:
+            sup->collisions++;
+            usec *= 2;
+            break;
+    }
+    if (ev != SUPPRESS_SENT && face->arq != NULL && usec < face->arq->srtt / 2)
+        usec = face->arq->srtt / 2;
+    hi = h->data_pause_microsec << 2;
+    if (usec < CCND_SUPPRESS_MIN_USEC)
+        usec = CCND_SUPPRESS_MIN_USEC;
+    if (usec > hi)
+        usec = hi;
+    if (usec == sup->usec)
+        return;
+    sup->usec = usec;
+    for (c = 0; c < CCN_CQ_N; c++) {
+        q = face->q[c];
+        if (q != NULL) {
+            q->min_usec = choose_face_delay(h, face, c);
+            q->rand_usec = 2 * q->min_usec;
+        }
+    }
+}
+
+/**
+ * Note the delay imposed on an answer queued for a multicast face.
+ */
+static void
+suppress_note_delay(struct face *face, unsigned delay)
+{
+    if ((face->flags & CCN_FACE_MCAST) == 0)
+        return;
+    face->sup.delayed++;
+    face->sup.delay_total += delay;
+}
+
+#define CCND_SHAPE_MIN_BURST 9000 /**< must hold the largest datagram */
+#define CCND_SHAPE_MIN_QUEUE 64
+
+/**
+ * Set or clear the egress shaping of a face.
+ *
+ * @param rate is in bytes per second; 0 turns shaping off.
+ * @param burst is the bucket depth in bytes, or -1 to pick one
+ *        (an eighth of a second's worth).
+ * Each content queue of a shaped face may hold about two seconds'
+ * worth of 1 KB objects; content beyond that is dropped.
+ */
+static void
+ccnd_face_set_shaping(struct ccnd_handle *h, struct face *face,
+                      int rate, int burst)
+{
+    struct ccnd_shaper *s = &face->shaper;
+    
+    if (rate <= 0) {
+        s->rate = 0;
+        return;
+    }
+    if (burst < 0)
+        burst = rate / 8;
+    if (burst < CCND_SHAPE_MIN_BURST)
+        burst = CCND_SHAPE_MIN_BURST;
+    s->rate = rate;
+    s->burst = burst;
+    s->tokens = burst;
+    s->stamp = ccnd_usec_now(h);
+    s->qmax = rate / 512;
+    if (s->qmax < CCND_SHAPE_MIN_QUEUE)
+        s->qmax = CCND_SHAPE_MIN_QUEUE;
+    if ((h->debug & 2) != 0)
+        ccnd_msg(h, "face %u shaped to %u bytes/sec, burst %u",
+                 face->faceid, s->rate, s->burst);
+}
+
+/**
+ * Add the tokens earned since the last refill of a shaper.
+ *
+ * The stamp advances only by the time that was paid for, so
+ * frequent refills do not lose fractional bytes.
+ */
+static void
+shaper_refill(struct ccnd_handle *h, struct ccnd_shaper *s)
+{
+    unsigned now = ccnd_usec_now(h);
+    unsigned elapsed = now - s->stamp;
+    uint_least64_t add;
+    
+    add = (uint_least64_t)s->rate * elapsed / 1000000;
+    if (add == 0)
+        return;
+    if ((int)elapsed < 0 || add >= (uint_least64_t)((long long)s->burst - s->tokens)) {
+        s->tokens = s->burst;
+        s->stamp = now;
+        return;
+    }
+    s->tokens += (int)add;
+    s->stamp += (unsigned)(add * 1000000 / s->rate);
+}
+
+/**
+ * Account for bytes sent on a face.
+ */
+static void
+shaper_charge(struct ccnd_handle *h, struct face *face, size_t size)
+{
+    struct ccnd_shaper *s = &face->shaper;
+    
+    if (s->rate == 0)
+        return;
+    shaper_refill(h, s);
+    if (s->tokens > -(int)s->burst - (int)size)
+        s->tokens -= (int)size;
+}
+
+/**
+ * @returns the delay (usec) before a shaped face may send again,
+ *          or 0 if it may send now.
  */
 static int
-content_sender(struct ccn_schedule *sched,
-    void *clienth,
-    struct ccn_scheduled_event *ev,
-    int flags)
+shaper_delay(struct ccnd_handle *h, struct ccnd_shaper *s)
+{
+    shaper_refill(h, s);
+    if (s->tokens > 0)
+        return(0);
+    return((int)((uint_least64_t)(1 - s->tokens) * 1000000 / s->rate) + 1);
+}
+
+/**
+ * Find the traffic class of the names under a name prefix entry.
+ */
+static int
+npe_traffic_class(struct nameprefix_entry *npe)
+{
+    for (; npe != NULL; npe = npe->parent)
+        if (npe->tclass != 0)
+            return(npe->tclass - 1);
+    return(CCND_TC_DEFAULT);
+}
+
+/**
+ * @returns the freshness rule that governs content under npe, or 0
+ */
+static int
+npe_fresh_rule(struct nameprefix_entry *npe)
+{
+    for (; npe != NULL; npe = npe->parent)
+        if (npe->fresh_rule != 0)
+            return(npe->fresh_rule);
+    return(0);
+}
+
+/**
+ * @returns the number of ContentObjects waiting in a content queue
+ */
+static unsigned
+content_queue_count(struct content_queue *q)
+{
+    unsigned n = 0;
+    int k;
+    
+    for (k = 0; k < CCND_TC_N; k++)
+        n += q->send_queue[k]->n;
+    return(n);
+}
+
+/**
+ * Look for content in any class of a content queue.
+ * @returns its index in the class's FIFO, or -1 if it is not there.
+ */
+static int
+content_queue_member(struct content_queue *q, ccn_accession_t accession,
+                     int *pk)
+{
+    int i;
+    int k;
+    
+    for (k = 0; k < CCND_TC_N; k++) {
+        i = ccn_indexbuf_member(q->send_queue[k], accession);
+        if (i >= 0) {
+            if (pk != NULL)
+                *pk = k;
+            return(i);
+        }
+    }
+    return(-1);
+}
+
+/**
+ * Choose the class of a content queue to send from next.
+ *
+ * Class 0 goes whenever it has anything.  Otherwise the classes take
+ * turns, each sending while it has deficit left; its deficit grows by
+ * its weight in CCND_TC_QUANTUM bytes each time its turn comes around,
+ * and a class with nothing queued forfeits what it had saved.
+ * The queue must not be empty.
+ */
+static int
+content_queue_pick(struct ccnd_handle *h, struct content_queue *q)
+{
+    int k = q->turn;
+    
+    if (q->send_queue[0]->n > 0)
+        return(0);
+    for (;;) {
+        if (q->send_queue[k]->n == 0)
+            q->deficit[k] = 0;
+        else if (q->deficit[k] > 0)
+            break;
+        k = (k < CCND_TC_N - 1) ? k + 1 : 1;
+        if (q->send_queue[k]->n > 0)
+            q->deficit[k] += h->tc_weight[k] * CCND_TC_QUANTUM;
+    }
+    q->turn = k;
+    return(k);
+}
+
+/**
+ * Take the oldest entry from one class of a content queue.
+ * @returns its accession; *stamp gets the time it was queued.
+ */
+static ccn_accession_t
+content_queue_shift(struct content_queue *q, int k, unsigned *stamp)
+{
+    struct ccn_indexbuf *x = q->send_queue[k];
+    struct ccn_indexbuf *t = q->stamp[k];
+    ccn_accession_t a = x->buf[0];
+    
+    *stamp = t->buf[0];
+    x->n--;
+    t->n--;
+    memmove(x->buf, x->buf + 1, x->n * sizeof(x->buf[0]));
+    memmove(t->buf, t->buf + 1, t->n * sizeof(t->buf[0]));
+    return(a);
+}
+
+/**
+ * Send some content from a queue, on behalf of the pacer.
+ *
+ * The classes of the queue are served as described for
+ * content_queue_pick.  When the face's outq is over its cap, only
+ * class 0 is sent, and it goes ahead of what the outq holds.
+ *
+ * @returns the delay (usec) until the queue should be run again, 0 if
+ *          it has nothing more to send, or -1 if its face went away
+ *          (in which case the queue is gone too).
+ */
+static int
+content_queue_send(struct ccnd_handle *h, struct content_queue *q)
 {
-    int i, j;
+    int i, j, k;
     int delay;
     int nsec;
     int burst_nsec;
     int burst_max;
-    struct ccnd_handle *h = clienth;
+    int congested = 0;
+    unsigned now;
+    unsigned stamp;
     struct content_entry *content = NULL;
-    unsigned faceid = ev->evint;
+    unsigned faceid = q->faceid;
     struct face *face = NULL;
-    struct content_queue *q = ev->evdata;
-    (void)sched;
     
-    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
-        goto Bail;
     face = face_from_faceid(h, faceid);
     if (face == NULL)
         goto Bail;
-    if (q->send_queue == NULL)
-        goto Bail;
     if ((face->flags & CCN_FACE_NOSEND) != 0)
         goto Bail;
+    if (face->outq != NULL && face->outq->bytes >= h->face_outq_cap) {
+        /* Slow consumer - leave the content queued until it catches up */
+        congested = 1;
+        if (q->send_queue[0]->n == 0) {
+            q->nrun = 0;
+            return(randomize_content_delay(h, q) + 1000);
+        }
+    }
+    if (face->shaper.rate != 0) {
+        /* The shaper does the pacing, in place of burst_nsec */
+        delay = shaper_delay(h, &face->shaper);
+        if (delay > 0)
+            return(delay);
+    }
     /* Send the content at the head of the queue */
-    if (q->ready > q->send_queue->n ||
+    j = content_queue_count(q);
+    if (q->ready > j ||
         (q->ready == 0 && q->nrun >= 12 && q->nrun < 120))
-        q->ready = q->send_queue->n;
+        q->ready = j;
     nsec = 0;
-    burst_nsec = q->burst_nsec;
+    burst_nsec = (face->shaper.rate != 0) ? 0 : q->burst_nsec;
     burst_max = 2;
     if (q->ready < burst_max)
         burst_max = q->ready;
     if (burst_max == 0)
         q->nrun = 0;
+    now = ccnd_usec_now(h);
     for (i = 0; i < burst_max && nsec < 1000000; i++) {
-        content = content_from_accession(h, q->send_queue->buf[i]);
+        if (face->shaper.rate != 0 && face->shaper.tokens <= 0)
+            break;
+        if (congested && q->send_queue[0]->n == 0)
+            break;
+        k = content_queue_pick(h, q);
+        content = content_from_accession(h, content_queue_shift(q, k, &stamp));
         if (content == NULL)
             q->nrun = 0;
         else {
+            q->deficit[k] -= content->size;
+            h->tc_sent[k]++;
+            h->tc_bytes[k] += content->size;
+            ccnd_hist_record(&h->tc_wait[k], now - stamp);
+            h->send_urgent = (k == 0);
             send_content(h, face, content);
+            h->send_urgent = 0;
             /* face may have vanished, bail out if it did */
             if (face_from_faceid(h, faceid) == NULL)
-                goto Bail;
+                return(-1);
+            suppress_adjust(h, face, SUPPRESS_SENT);
             nsec += burst_nsec * (unsigned)((content->size + 1023) / 1024);
             q->nrun++;
         }
     }
     if (q->ready < i) abort();
     q->ready -= i;
-    /* Update queue */
-    for (j = 0; i < q->send_queue->n; i++, j++)
-        q->send_queue->buf[j] = q->send_queue->buf[i];
-    q->send_queue->n = j;
+    j = content_queue_count(q);
     /* Do a poll before going on to allow others to preempt send. */
     delay = (nsec + 499) / 1000 + 1;
     if (q->ready > 0) {
@@ -1396,33 +2427,189 @@ content_sender(struct ccn_schedule *sched,
             delay += burst_nsec / 50;
         if (h->debug & 8)
             ccnd_msg(h, "face %u ready %u delay %i nrun %u surplus %u",
-                    (unsigned)ev->evint, q->ready, delay, q->nrun, face->surplus);
+                    faceid, q->ready, delay, q->nrun, face->surplus);
         return(delay);
     }
     /* Determine when to run again */
-    for (i = 0; i < q->send_queue->n; i++) {
-        content = content_from_accession(h, q->send_queue->buf[i]);
-        if (content != NULL) {
-            q->nrun = 0;
-            delay = randomize_content_delay(h, q);
-            if (h->debug & 8)
-                ccnd_msg(h, "face %u queued %u delay %i",
-                         (unsigned)ev->evint, q->ready, delay);
-            return(delay);
+    for (k = 0; k < CCND_TC_N; k++) {
+        for (i = 0; i < q->send_queue[k]->n; i++) {
+            content = content_from_accession(h, q->send_queue[k]->buf[i]);
+            if (content != NULL) {
+                q->nrun = 0;
+                delay = randomize_content_delay(h, q);
+                suppress_note_delay(face, delay);
+                if (h->debug & 8)
+                    ccnd_msg(h, "face %u queued %u delay %i",
+                             faceid, q->ready, delay);
+                return(delay);
+            }
         }
     }
-    q->send_queue->n = q->ready = 0;
+    for (k = 0; k < CCND_TC_N; k++)
+        q->send_queue[k]->n = q->stamp[k]->n = 0;
+    q->ready = 0;
 Bail:
-    q->sender = NULL;
     return(0);
 }
 
+/**
+ * Add a content queue to the pacer, to be run after delay usec.
+ */
+static void
+pacer_insert(struct ccnd_handle *h, struct content_queue *q, unsigned delay)
+{
+    unsigned now = ccnd_usec_now(h);
+    unsigned s;
+    
+    q->due = now + delay;
+    q->pass = h->pacer_pass;
+    s = (q->due >> CCND_PACE_SHIFT) & (CCND_PACE_SLOTS - 1);
+    q->pnext = h->pacer_slot[s];
+    h->pacer_slot[s] = q;
+    q->paced = CCND_PACED_QUEUED;
+    h->pacer_n++;
+    if (h->pacer_running)
+        return;
+    /* Move the wakeup earlier only if it gains more than half a slot */
+    if (h->pacer != NULL &&
+        (int)(h->pacer_wake - q->due) <= (1 << (CCND_PACE_SHIFT - 1)))
+        return;
+    if (h->pacer != NULL)
+        ccn_schedule_cancel(h->sched, h->pacer);
+    h->pacer_wake = q->due;
+    h->pacer = ccn_schedule_event(h->sched, delay, pacer_run, NULL, 0);
+}
+
+/**
+ * Take a content queue out of the pacer.
+ */
+static void
+pacer_remove(struct ccnd_handle *h, struct content_queue *q)
+{
+    struct content_queue **pp;
+    unsigned s;
+    
+    s = (q->due >> CCND_PACE_SHIFT) & (CCND_PACE_SLOTS - 1);
+    for (pp = &h->pacer_slot[s]; *pp != NULL; pp = &(*pp)->pnext) {
+        if (*pp == q) {
+            *pp = q->pnext;
+            q->pnext = NULL;
+            q->paced = CCND_PACED_IDLE;
+            h->pacer_n--;
+            return;
+        }
+    }
+}
+
+/**
+ * Find how long until the next content queue in the pacer is due.
+ *
+ * Slots are examined in time order, starting with the current one.
+ * A slot may also hold queues that are due a lap or more later,
+ * so the scan stops only when the best so far is no later than the
+ * end of the slot being examined.
+ * @returns the delay in usec, or 0 if the pacer is empty.
+ */
+static int
+pacer_next_delay(struct ccnd_handle *h, unsigned now)
+{
+    struct content_queue *q;
+    unsigned base = now >> CCND_PACE_SHIFT;
+    int best = INT_MAX;
+    int d;
+    int k;
+    
+    if (h->pacer_n == 0)
+        return(0);
+    for (k = 0; k < CCND_PACE_SLOTS; k++) {
+        q = h->pacer_slot[(base + k) & (CCND_PACE_SLOTS - 1)];
+        for (; q != NULL; q = q->pnext) {
+            d = (int)(q->due - now);
+            if (d < best)
+                best = d;
+        }
+        if (best <= (int)(((base + k + 1) << CCND_PACE_SHIFT) - now))
+            break;
+    }
+    return(best < 1 ? 1 : best);
+}
+
+/**
+ * Scheduled event that sends from all the content queues that are due.
+ *
+ * Queues due within half a slot are run now as well, so that faces
+ * with nearby deadlines share a wakeup.
+ */
+static int
+pacer_run(struct ccn_schedule *sched,
+          void *clienth,
+          struct ccn_scheduled_event *ev,
+          int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct content_queue **pp;
+    struct content_queue *q;
+    unsigned now;
+    unsigned limit;
+    unsigned nslots;
+    unsigned k;
+    unsigned s;
+    int delay;
+    (void)sched;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        if (ev == h->pacer)
+            h->pacer = NULL;
+        return(0);
+    }
+    now = ccnd_usec_now(h);
+    limit = now + (1 << (CCND_PACE_SHIFT - 1));
+    nslots = (limit >> CCND_PACE_SHIFT) - (h->pacer_clock >> CCND_PACE_SHIFT) + 1;
+    if ((int)(limit - h->pacer_clock) < 0 || nslots > CCND_PACE_SLOTS)
+        nslots = CCND_PACE_SLOTS;
+    h->pacer_running = 1;
+    h->pacer_pass++;
+    for (k = 0; k < nslots; k++) {
+        s = ((h->pacer_clock >> CCND_PACE_SHIFT) + k) & (CCND_PACE_SLOTS - 1);
+        pp = &h->pacer_slot[s];
+        while ((q = *pp) != NULL) {
+            if (q->pass == h->pacer_pass || (int)(q->due - limit) > 0) {
+                pp = &q->pnext;
+                continue;
+            }
+            *pp = q->pnext;
+            q->pnext = NULL;
+            q->paced = CCND_PACED_RUNNING;
+            h->pacer_n--;
+            delay = content_queue_send(h, q);
+            if (delay > 0)
+                pacer_insert(h, q, delay);
+            else if (delay == 0)
+                q->paced = CCND_PACED_IDLE;
+            /* Sending may have removed others from this slot */
+            pp = &h->pacer_slot[s];
+        }
+    }
+    h->pacer_running = 0;
+    /* Anything queued from now on is due no earlier than now */
+    h->pacer_clock = now;
+    delay = pacer_next_delay(h, now);
+    if (delay == 0)
+        h->pacer = NULL;
+    else
+        h->pacer_wake = now + delay;
+    return(delay);
+}
+
 /**
  * Queue a ContentObject to be sent on a face.
+ *
+ * @param tclass is the traffic class of the content's name.
  */
 static int
 face_send_queue_insert(struct ccnd_handle *h,
-                       struct face *face, struct content_entry *content)
+                       struct face *face, struct content_entry *content,
+                       int tclass)
 {
     int ans;
     int delay;
@@ -1431,30 +2618,46 @@ face_send_queue_insert(struct ccnd_handle *h,
     struct content_queue *q;
     if (face == NULL || content == NULL || (face->flags & CCN_FACE_NOSEND) != 0)
         return(-1);
+    content->used = h->sec;
     c = choose_content_delay_class(h, face->faceid, content->flags);
     if (face->q[c] == NULL)
         face->q[c] = content_queue_create(h, face, c);
     q = face->q[c];
     if (q == NULL)
         return(-1);
-    /* Check the other queues first, it might be in one of them */
+    /* Check the queues first, it might be in one of them already */
     for (k = 0; k < CCN_CQ_N; k++) {
-        if (k != c && face->q[k] != NULL) {
-            ans = ccn_indexbuf_member(face->q[k]->send_queue, content->accession);
+        if (face->q[k] != NULL) {
+            ans = content_queue_member(face->q[k], content->accession, NULL);
             if (ans >= 0) {
-                if (h->debug & 8)
-                    ccnd_debug_ccnb(h, __LINE__, "content_otherq", face,
-                                    content->key, content->size);
+                if (k != c && (h->debug & 8))
+                    debug_content(h, __LINE__, "content_otherq", face, content);
                 return(ans);
             }
         }
     }
-    ans = ccn_indexbuf_set_insert(q->send_queue, content->accession);
-    if (q->sender == NULL) {
+    if (face->shaper.rate != 0 &&
+        q->send_queue[tclass]->n >= face->shaper.qmax) {
+        /* Shaped face is backed up, drop rather than queue without bound */
+        face->shaper.drops++;
+        return(-1);
+    }
+    ans = q->send_queue[tclass]->n;
+    if (ccn_indexbuf_append_element(q->send_queue[tclass], content->accession) < 0 ||
+        ccn_indexbuf_append_element(q->stamp[tclass], ccnd_usec_now(h)) < 0) {
+        q->send_queue[tclass]->n = q->stamp[tclass]->n = ans;
+        return(-1);
+    }
+    if ((content->flags & CCN_CONTENT_ENTRY_PREFETCHED) != 0 &&
+          face != h->face0) {
+        content->flags &= ~CCN_CONTENT_ENTRY_PREFETCHED;
+        ccnd_prefetch_outcome(h->prefetch, 1);
+    }
+    if (q->paced == CCND_PACED_IDLE) {
         delay = randomize_content_delay(h, q);
-        q->ready = q->send_queue->n;
-        q->sender = ccn_schedule_event(h->sched, delay,
-                                       content_sender, q, face->faceid);
+        suppress_note_delay(face, delay);
+        q->ready = content_queue_count(q);
+        pacer_insert(h, q, delay);
         if (h->debug & 8)
             ccnd_msg(h, "face %u q %d delay %d usec", face->faceid, c, delay);
     }
@@ -1486,6 +2689,168 @@ promote_outbound(struct propagating_entry *pe, unsigned faceid)
     return(lb);
 }
 
+/**
+ * Move the unsent outbound faces of pe that are in a set to the front
+ * of the unsent ones, keeping the order within each group.
+ *
+ * This takes one pass, however many faces are moved.
+ * @returns the number of faces moved.
+ */
+static int
+promote_outbound_set(struct ccnd_handle *h, struct propagating_entry *pe,
+                     const struct ccnd_faceset *s)
+{
+    struct ccn_indexbuf *ob = pe->outbound;
+    struct ccn_indexbuf *rest;
+    int i;
+    int k;
+    
+    if (ob == NULL || ob->n <= pe->sent || pe->sent < 0 || s->n == 0)
+        return(0);
+    rest = indexbuf_obtain(h);
+    if (ccn_indexbuf_reserve(rest, ob->n - pe->sent) == NULL) {
+        indexbuf_release(h, rest);
+        return(0);
+    }
+    for (i = k = pe->sent; i < ob->n; i++) {
+        if (ccnd_faceset_member(s, ob->buf[i]))
+            ob->buf[k++] = ob->buf[i];
+        else
+            rest->buf[rest->n++] = ob->buf[i];
+    }
+    memcpy(ob->buf + k, rest->buf, rest->n * sizeof(ob->buf[0]));
+    indexbuf_release(h, rest);
+    return(k - pe->sent);
+}
+
+/**
+ * Count a latency sample against a name prefix, if it is one of the
+ * busiest.
+ *
+ * Samples go to the nearest registered prefix at or above npe (or the
+ * root, if nothing is registered), so that there are only as many
+ * candidates as there are registrations.
+ */
+static void
+note_prefix_latency(struct ccnd_handle *h, struct nameprefix_entry *npe,
+                    unsigned usec)
+{
+    struct ccnd_prefix_lat *slot;
+    int i;
+    int v;
+    
+    while (npe->forwarding == NULL && npe->parent != NULL)
+        npe = npe->parent;
+    slot = npe->lat;
+    if (slot == NULL) {
+        npe->lat_hits++;
+        for (i = 0, v = 0; i < CCND_LAT_PREFIXES; i++) {
+            if (h->lat_prefix[i] == NULL) {
+                v = i;
+                break;
+            }
+            if (h->lat_prefix[i]->recent < h->lat_prefix[v]->recent)
+                v = i;
+        }
+        if (h->lat_prefix[v] != NULL) {
+            if (npe->lat_hits <= h->lat_prefix[v]->recent)
+                return;
+            /* Take over the quietest slot; others age a little */
+            h->lat_prefix[v]->npe->lat = NULL;
+            h->lat_prefix[v]->npe->lat_hits = 0;
+            for (i = 0; i < CCND_LAT_PREFIXES; i++)
+                h->lat_prefix[i]->recent >>= 1;
+            memset(h->lat_prefix[v], 0, sizeof(*h->lat_prefix[v]));
+        }
+        else
+            h->lat_prefix[v] = calloc(1, sizeof(*h->lat_prefix[v]));
+        slot = h->lat_prefix[v];
+        if (slot == NULL)
+            return;
+        slot->npe = npe;
+        slot->recent = npe->lat_hits;
+        npe->lat = slot;
+    }
+    else
+        slot->recent++;
+    ccnd_hist_record(&slot->hist, usec);
+}
+
+/**
+ * Note how long it took to satisfy an interest.
+ *
+ * The interest arrived on face (if it is still around) at atime, and was
+ * answered from the content store if from_store is nonzero.
+ */
+static void
+note_interest_latency(struct ccnd_handle *h, struct face *face,
+                      struct nameprefix_entry *npe, unsigned atime,
+                      int from_store)
+{
+    unsigned usec = ccnd_usec_now(h) - atime;
+    
+    if (usec > 0x7FFFFFFF)
+        usec = 0; /* the clock went backward */
+    ccnd_hist_record(from_store ? &h->lat_store : &h->lat_upstream, usec);
+    if (face != NULL) {
+        if (face->lat == NULL)
+            face->lat = calloc(1, sizeof(*face->lat));
+        if (face->lat != NULL)
+            ccnd_hist_record(face->lat, usec);
+    }
+    if (npe != NULL) {
+        note_prefix_latency(h, npe, usec);
+        ccnd_hist_record(&h->tc_lat[npe_traffic_class(npe)], usec);
+    }
+}
+
+/**
+ * Count a content store lookup.
+ *
+ * The hit or miss is counted against the nearest registered prefix at
+ * or above npe, as for latencies, and the name is offered to the
+ * reuse distance sampler.
+ */
+static void
+note_store_lookup(struct ccnd_handle *h, struct nameprefix_entry *npe,
+                  const unsigned char *name, size_t size, int hit)
+{
+    while (npe->forwarding == NULL && npe->parent != NULL)
+        npe = npe->parent;
+    if (hit)
+        npe->cs_hits++;
+    else
+        npe->cs_misses++;
+    if (h->mrc != NULL)
+        ccnd_mrc_reference(h->mrc, name, size);
+}
+
+/**
+ * Count an accepted interest in the heavy-hitter sketches, against
+ * each of its leading prefixes and against the face it came in on.
+ * @param miss is nonzero if the content store did not answer it.
+ */
+static void
+hh_note_interest(struct ccnd_handle *h, struct face *face,
+                 const unsigned char *msg, const struct ccn_indexbuf *comps,
+                 int miss)
+{
+    const unsigned char *name = msg + comps->buf[0];
+    long tick = h->sec / CCND_HH_HALFLIFE;
+    size_t size;
+    int d;
+
+    for (d = 1; d <= CCND_HH_DEPTHS && d < (int)comps->n; d++) {
+        if (h->hh_prefix[d - 1] == NULL)
+            continue;
+        size = comps->buf[d] - comps->buf[0];
+        ccnd_hh_count(h->hh_prefix[d - 1], tick, hashtb_hash(name, size),
+                      1, miss, name, size);
+    }
+    if (h->hh_face != NULL)
+        ccnd_hh_count(h->hh_face, tick, face->faceid, 1, miss, NULL, 0);
+}
+
 /**
  * Consume matching interests
  * given a nameprefix_entry and a piece of content.
@@ -1493,6 +2858,10 @@ promote_outbound(struct propagating_entry *pe, unsigned faceid)
  * If face is not NULL, pay attention only to interests from that face.
  * It is allowed to pass NULL for pc, but if you have a (valid) one it
  * will avoid a re-parse.
+ * For new content, from_face is the source; for old content, from_face is NULL.
+ * Interests marked CCN_PR_EXACT match without a check, so the full
+ * comparison is only paid for interests that carry selectors.
+ An Exclude is checked in the compiled form kept with the PIT entry.
  * @returns number of matches found.
  */
 static int
@@ -1500,7 +2869,8 @@ consume_matching_interests(struct ccnd_handle *h,
                            struct nameprefix_entry *npe,
                            struct content_entry *content,
                            struct ccn_parsed_ContentObject *pc,
-                           struct face *face)
+                           struct face *face,
+                           struct face *from_face)
 {
     int matches = 0;
     struct propagating_entry *head;
@@ -1511,21 +2881,43 @@ consume_matching_interests(struct ccnd_handle *h,
     struct face *f;
     
     head = &npe->pe_head;
-    content_msg = content->key;
+    content_msg = content_object(h, content);
     content_size = content->size;
+    if (content_msg == NULL)
+        return(0);
     f = face;
     for (p = head->next; p != head; p = next) {
         next = p->next;
         if (p->interest_msg != NULL &&
             ((face == NULL && (f = face_from_faceid(h, p->faceid)) != NULL) ||
              (face != NULL && p->faceid == face->faceid))) {
-            if (ccn_content_matches_interest(content_msg, content_size, 0, pc,
-                                             p->interest_msg, p->size, NULL)) {
-                face_send_queue_insert(h, f, content);
+            if ((p->flags & CCN_PR_EXACT) != 0 ||
+                ccn_content_matches_interest_excl(content_msg, content_size,
+                                                  0, pc, p->interest_msg,
+                                                  p->size, NULL, p->excl)) {
+                if ((p->flags & CCN_PR_MGMT) != 0) {
+                    face_send_queue_insert(h, f, content, 0);
+                    ccnd_hist_record(&h->mgmt_lat,
+                                     ccnd_usec_now(h) - p->atime);
+                }
+                else
+                    face_send_queue_insert(h, f, content,
+                                           npe_traffic_class(npe));
                 if (h->debug & (32 | 8))
                     ccnd_debug_ccnb(h, __LINE__, "consume", f,
                                     p->interest_msg, p->size);
                 matches += 1;
+                note_interest_latency(h, f, npe, p->atime, from_face == NULL);
+                if (h->trace_on)
+                    trace_pe(h, CCND_TR_PIT_SATISFY, p, p->faceid,
+                             ccnd_usec_now(h) - p->atime);
+                if (from_face != NULL)
+                    note_interest_outcome(h, p, from_face->faceid);
+                if (from_face != NULL && pc != NULL &&
+                    ccn_parse_ContentObject_finish(content_msg, content_size,
+                                                   pc) == 0 &&
+                    pc->type == CCN_CONTENT_NACK)
+                    negcache_note(h, p->interest_msg, p->size);
                 consume(h, p);
             }
         }
@@ -1600,29 +2992,368 @@ note_content_from(struct ccnd_handle *h,
 }
 
 /**
- * Use the history to reorder the interest forwarding.
+ * Current time, in microseconds, for measuring response times.
  *
- * @returns number of tap faces that are present.
+ * This wraps, so only differences are meaningful.
  */
-static int
-reorder_outbound_using_history(struct ccnd_handle *h,
-                               struct nameprefix_entry *npe,
-                               struct propagating_entry *pe)
+static unsigned
+ccnd_usec_now(struct ccnd_handle *h)
 {
-    int ntap = 0;
+    return((unsigned)h->sec * 1000000U + h->usec);
+}
+
+/**
+ * Trace an event concerning an interest.
+ *
+ * If comps is NULL, the prefix hash and label are left out.
+ */
+static void
+trace_interest(struct ccnd_handle *h, int event, unsigned faceid,
+               const unsigned char *msg, size_t size,
+               const struct ccn_parsed_interest *pi,
+               const struct ccn_indexbuf *comps, unsigned aux)
+{
+    size_t b = pi->offset[CCN_PI_B_Component0];
+    size_t plen = 0;
+    int k;
+    
+    if (comps != NULL && comps->n > 1) {
+        k = comps->n - 1;
+        if (k > CCND_TRACE_PREFIX_COMPS)
+            k = CCND_TRACE_PREFIX_COMPS;
+        plen = comps->buf[k] - comps->buf[0];
+    }
+    ccnd_trace_event(h, event, faceid, msg + b,
+                     pi->offset[CCN_PI_E_ComponentLast] - b, plen,
+                     pi->prefix_comps, size, aux);
+}
+
+/**
+ * Trace an event concerning a pending interest.
+ *
+ * The interest is parsed again, but only while tracing.
+ */
+static void
+trace_pe(struct ccnd_handle *h, int event, struct propagating_entry *pe,
+         unsigned faceid, unsigned aux)
+{
+    struct ccn_parsed_interest parsed_interest = {0};
+    
+    if (pe->interest_msg == NULL ||
+        ccn_parse_interest(pe->interest_msg, pe->size,
+                           &parsed_interest, NULL) < 0)
+        return;
+    trace_interest(h, event, faceid, pe->interest_msg, pe->size,
+                   &parsed_interest, NULL, aux);
+}
+
+/**
+ * Trace an event concerning content.
+ *
+ * The name is taken without the digest component.
+ */
+static void
+trace_content(struct ccnd_handle *h, int event, unsigned faceid,
+              struct content_entry *content, int with_prefix, unsigned aux)
+{
+    int n = content->ncomps - 2;
+    size_t plen = 0;
+    
+    if (n < 0)
+        return;
+    if (with_prefix)
+        plen = content->comps[n < CCND_TRACE_PREFIX_COMPS ?
+                              n : CCND_TRACE_PREFIX_COMPS] - content->comps[0];
+    ccnd_trace_event(h, event, faceid, content->key + content->comps[0],
+                     content->comps[n] - content->comps[0], plen, n,
+                     content->size, aux);
+}
+
+/**
+ * Find the forwarding entry that supplied faceid for an interest
+ * under npe, looking at npe and its ancestors.
+ */
+static struct ccn_forwarding *
+forwarding_for_face(struct nameprefix_entry *npe, unsigned faceid)
+{
+    struct ccn_forwarding *f;
+    
+    for (; npe != NULL; npe = npe->parent)
+        for (f = npe->forwarding; f != NULL; f = f->next)
+            if (f->faceid == faceid)
+                return(f);
+    return(NULL);
+}
+
+/**
+ * Note that an interest is being sent to a face.
+ */
+static void
+note_interest_sent(struct ccnd_handle *h, struct propagating_entry *pe,
+                   unsigned faceid)
+{
+    struct ccn_forwarding *f;
+    
+    f = forwarding_for_face(nameprefix_for_pe(h, pe), faceid);
+    if (f != NULL)
+        f->outstanding += 1;
+    pe->sface = faceid;
+    pe->stime = ccnd_usec_now(h);
+}
+
+/**
+ * Update the per-face estimates for an interest that is finishing.
+ *
+ * If from_faceid is CCN_NOFACEID the interest timed out, and each face
+ * it was sent to is charged with a loss.  Otherwise the answering face
+ * is credited, and a response time is sampled if it was the face most
+ * recently sent to (other samples would be ambiguous).
+ */
+static void
+note_interest_outcome(struct ccnd_handle *h, struct propagating_entry *pe,
+                      unsigned from_faceid)
+{
+    struct nameprefix_entry *npe;
+    struct ccn_forwarding *f;
+    unsigned faceid;
+    int rtt;
+    int i;
+    
+    if (pe->outbound == NULL || pe->next == NULL)
+        return;
+    npe = nameprefix_for_pe(h, pe);
+    for (i = 0; i < pe->sent && i < pe->outbound->n; i++) {
+        faceid = pe->outbound->buf[i];
+        f = forwarding_for_face(npe, faceid);
+        if (f == NULL)
+            continue;
+        if (from_faceid == CCN_NOFACEID)
+            f->loss += (65536 - f->loss) >> 3;
+        else if (faceid == from_faceid) {
+            f->loss -= f->loss >> 3;
+            if (faceid == pe->sface) {
+                rtt = ccnd_usec_now(h) - pe->stime;
+                if (rtt < 0 || rtt > CCN_INTEREST_LIFETIME_MICROSEC)
+                    continue;
+                if (f->srtt == 0)
+                    f->srtt = rtt;
+                else
+                    f->srtt += (rtt - (int)f->srtt) / 8;
+            }
+        }
+    }
+}
+
+/**
+ * Release the outstanding counts held by an interest.
+ */
+static void
+release_outstanding(struct ccnd_handle *h, struct propagating_entry *pe)
+{
+    struct nameprefix_entry *npe;
+    struct ccn_forwarding *f;
+    int i;
+    
+    if (pe->outbound == NULL || pe->next == NULL || pe->sent == 0)
+        return;
+    npe = nameprefix_for_pe(h, pe);
+    for (i = 0; i < pe->sent && i < pe->outbound->n; i++) {
+        f = forwarding_for_face(npe, pe->outbound->buf[i]);
+        if (f != NULL && f->outstanding > 0)
+            f->outstanding -= 1;
+    }
+}
+
+/**
+ * Estimate the cost of forwarding an interest under npe to a face.
+ *
+ * This is the smoothed response time (or the prediction for the prefix,
+ * if the face has not answered yet), inflated by the loss rate and by
+ * the number of interests already waiting on the face.
+ */
+static uint64_t
+face_forwarding_cost(struct nameprefix_entry *npe, unsigned faceid)
+{
+    struct ccn_forwarding *f;
+    uint64_t cost;
+    
+    f = forwarding_for_face(npe, faceid);
+    cost = (f != NULL && f->srtt != 0) ? f->srtt : npe->usec;
+    if (cost < 127)
+        cost = 127;
+    if (f != NULL) {
+        cost += (cost * f->loss) >> 14;
+        cost *= 1 + f->outstanding;
+    }
+    return(cost);
+}
+
+/**
+ * Order the unsent outbound faces of pe by cost, cheapest first.
+ * @returns the cheapest faceid, or CCN_NOFACEID if there are none.
+ */
+static unsigned
+promote_outbound_by_cost(struct nameprefix_entry *npe,
+                         struct propagating_entry *pe)
+{
+    struct ccn_indexbuf *ob = pe->outbound;
+    uint64_t least;
+    uint64_t cost;
+    unsigned faceid;
     int i;
+    int j;
+    int k;
     
+    if (ob == NULL || ob->n <= pe->sent)
+        return(CCN_NOFACEID);
+    /* A selection sort, keeping equal-cost faces in their original order */
+    for (i = pe->sent; i < ob->n - 1; i++) {
+        k = i;
+        least = face_forwarding_cost(npe, ob->buf[i]);
+        for (j = i + 1; j < ob->n; j++) {
+            cost = face_forwarding_cost(npe, ob->buf[j]);
+            if (cost < least)
+                (k = j, least = cost);
+        }
+        faceid = ob->buf[k];
+        for (; k > i; k--)
+            ob->buf[k] = ob->buf[k - 1];
+        ob->buf[i] = faceid;
+    }
+    return(ob->buf[pe->sent]);
+}
+
+/**
+ * The default strategy uses the history of where content came from.
+ */
+static unsigned
+strategy_default(struct ccnd_handle *h,
+                 struct nameprefix_entry *npe,
+                 struct propagating_entry *pe)
+{
     if (npe->osrc != CCN_NOFACEID)
         promote_outbound(pe, npe->osrc);
     /* Process npe->src last so it will be tried first */
     if (npe->src != CCN_NOFACEID)
         promote_outbound(pe, npe->src);
+    return(npe->src);
+}
+
+/**
+ * Weighted load balancing spreads interests over the faces, choosing
+ * each face with a probability inversely proportional to its cost.
+ * The remaining faces are held in reserve, cheapest first.
+ */
+static unsigned
+strategy_balance(struct ccnd_handle *h,
+                 struct nameprefix_entry *npe,
+                 struct propagating_entry *pe)
+{
+    struct ccn_indexbuf *ob = pe->outbound;
+    uint64_t w[32];
+    uint64_t sum = 0;
+    uint64_t r;
+    unsigned first;
+    int n;
+    int i;
+    
+    first = promote_outbound_by_cost(npe, pe);
+    if (first == CCN_NOFACEID)
+        return(first);
+    n = ob->n - pe->sent;
+    if (n > 32)
+        n = 32;
+    for (i = 0; i < n; i++) {
+        w[i] = ((uint64_t)1 << 40) /
+               face_forwarding_cost(npe, ob->buf[pe->sent + i]);
+        sum += w[i];
+    }
+    r = (((uint64_t)nrand48(h->seed) << 31) ^ nrand48(h->seed)) % sum;
+    for (i = 0; i < n - 1 && r >= w[i]; i++)
+        r -= w[i];
+    first = ob->buf[pe->sent + i];
+    promote_outbound(pe, first);
+    return(first);
+}
+
+/**
+ * Best-route sends to the cheapest face, and waits for the predicted
+ * response time before trying others.  Occasionally it probes by also
+ * sending right away to another face, so that the estimates for the
+ * alternatives stay current and a better route is switched to.
+ */
+static unsigned
+strategy_best(struct ccnd_handle *h,
+              struct nameprefix_entry *npe,
+              struct propagating_entry *pe)
+{
+    struct ccn_indexbuf *ob = pe->outbound;
+    unsigned best;
+    unsigned probe;
+    int n;
+    
+    best = promote_outbound_by_cost(npe, pe);
+    if (best == CCN_NOFACEID)
+        return(best);
+    n = ob->n - pe->sent;
+    if (n < 2 || (nrand48(h->seed) & 15) != 0)
+        return(best);
+    probe = ob->buf[pe->sent + 1 + nrand48(h->seed) % (n - 1)];
+    promote_outbound(pe, probe);
+    promote_outbound(pe, best);
+    return(CCN_NOFACEID);
+}
+
+/**
+ * A forwarding strategy puts the outbound faces of a new interest in
+ * order of use.
+ * @returns the face to try first, holding the others back until the
+ * predicted response time has passed, or CCN_NOFACEID to send to them
+ * in quick succession.
+ */
+typedef unsigned (*ccnd_strategy_proc)(struct ccnd_handle *h,
+                                       struct nameprefix_entry *npe,
+                                       struct propagating_entry *pe);
+
+/**
+ * The strategies, selected by forwarding flags on the prefix.
+ * The last entry is the default.
+ */
+static const struct {
+    const char *name;
+    unsigned flag;
+    ccnd_strategy_proc plan;
+} ccnd_strategies[] = {
+    {"balance", CCN_FORW_BALANCE, &strategy_balance},
+    {"best",    CCN_FORW_BEST,    &strategy_best},
+    {"default", 0,                &strategy_default}
+};
+
+/**
+ * Use the forwarding strategy to order the interest forwarding.
+ *
+ * @param firstp is set to the face the strategy wants tried first.
+ * @returns number of tap faces that are present.
+ */
+static int
+reorder_outbound_using_strategy(struct ccnd_handle *h,
+                                struct nameprefix_entry *npe,
+                                struct propagating_entry *pe,
+                                unsigned *firstp)
+{
+    struct nameprefix_entry *fnpe = npe->fib;
+    int ntap = 0;
+    int i;
+    
+    for (i = 0; (ccnd_strategies[i].flag & fnpe->flags) !=
+                ccnd_strategies[i].flag; i++)
+        continue;
+    if ((h->debug & 32) != 0 && ccnd_strategies[i].flag != 0)
+        ccnd_msg(h, "strategy.%d %s", __LINE__, ccnd_strategies[i].name);
+    *firstp = (ccnd_strategies[i].plan)(h, npe, pe);
     /* Tap are really first. */
-    if (npe->tap != NULL) {
-        ntap = npe->tap->n;
-        for (i = 0; i < ntap; i++)
-            promote_outbound(pe, npe->tap->buf[i]);
-    }
+    if (npe->tap != NULL)
+        ntap = promote_outbound_set(h, pe, npe->tap);
     return(ntap);
 }
 
@@ -1645,22 +3376,15 @@ match_interests(struct ccnd_handle *h, struct content_entry *content,
     int new_matches;
     int ci;
     int cm = 0;
-    unsigned c0 = content->comps[0];
-    const unsigned char *key = content->key + c0;
     struct nameprefix_entry *npe = NULL;
-    for (ci = content->ncomps - 1; ci >= 0; ci--) {
-        int size = content->comps[ci] - c0;
-        npe = hashtb_lookup(h->nameprefix_tab, key, size);
-        if (npe != NULL)
-            break;
-    }
+    npe = nameprefix_longest_match(h, content->key, content->comps,
+                                   content->ncomps - 1, &ci);
     for (; npe != NULL; npe = npe->parent, ci--) {
-        if (npe->fgen != h->forward_to_gen)
-            update_forward_to(h, npe);
         if (from_face != NULL && (npe->flags & CCN_FORW_LOCAL) != 0 &&
             (from_face->flags & CCN_FACE_GG) == 0)
             return(-1);
-        new_matches = consume_matching_interests(h, npe, content, pc, face);
+        new_matches = consume_matching_interests(h, npe, content, pc, face,
+                                                 from_face);
         if (from_face != NULL && (new_matches != 0 || ci + 1 == cm))
             note_content_from(h, npe, from_face->faceid, ci);
         if (new_matches != 0) {
@@ -1671,40 +3395,516 @@ match_interests(struct ccnd_handle *h, struct content_entry *content,
     return(n_matched);
 }
 
+#define CCND_PACK_MTU 1400     /**< packing budget if CCND_MTU is not set */
+#define CCND_PACK_RESERVE 16   /**< room kept for PDU framing and link stuff */
+
 /**
- * Send a message in a PDU, possibly stuffing other interest messages into it.
- * The message may be in two pieces.
+ * @returns the number of message bytes that may be packed into a datagram
+ */
+static int
+pack_budget(struct ccnd_handle *h)
+{
+    return((h->mtu > 0 ? h->mtu : CCND_PACK_MTU) - CCND_PACK_RESERVE);
+}
+
+/**
+ * Send the messages that are being held for packing on a face, if any.
  */
 static void
-stuff_and_send(struct ccnd_handle *h, struct face *face,
-               const unsigned char *data1, size_t size1,
-               const unsigned char *data2, size_t size2) {
-    struct ccn_charbuf *c = NULL;
+pack_flush(struct ccnd_handle *h, struct face *face)
+{
+    struct ccnd_packer *pk = &face->packer;
+    struct ccn_charbuf *c = pk->buf;
+    unsigned now;
     
-    if ((face->flags & CCN_FACE_LINK) != 0) {
-        c = charbuf_obtain(h);
-        ccn_charbuf_reserve(c, size1 + size2 + 5 + 8);
-        ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
-        ccn_charbuf_append(c, data1, size1);
-		if (size2 != 0)
-            ccn_charbuf_append(c, data2, size2);
-        ccn_stuff_interest(h, face, c);
-        ccn_append_link_stuff(h, face, c);
+    if (c == NULL)
+        return;
+    pk->buf = NULL;
+    if (pk->ev != NULL)
+        ccn_schedule_cancel(h->sched, pk->ev);
+    now = ccnd_usec_now(h);
+    pk->msgs += pk->n;
+    pk->pdus += 1;
+    pk->wait += (uintmax_t)pk->n * (now - pk->start) - pk->offsets;
+    ccn_stuff_interest(h, face, c);
+    ccn_append_link_stuff(h, face, c);
+    if ((face->flags & CCN_FACE_LINK) != 0)
         ccn_charbuf_append_closer(c);
-    }
-    else if (size2 != 0 || h->mtu > size1 + size2 ||
-             (face->flags & (CCN_FACE_SEQOK | CCN_FACE_SEQPROBE)) != 0 ||
-             face->recvcount == 0) {
-        c = charbuf_obtain(h);
-        ccn_charbuf_append(c, data1, size1);
-		if (size2 != 0)
-            ccn_charbuf_append(c, data2, size2);
+    ccnd_send(h, face, c->buf, c->length);
+    ccn_charbuf_destroy(&c);
+}
+
+/**
+ * Scheduled event that sends a partly filled packet when its window closes.
+ */
+static int
+pack_timeout(struct ccn_schedule *sched,
+             void *clienth,
+             struct ccn_scheduled_event *ev,
+             int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct face *face = face_from_faceid(h, ev->evint);
+    (void)sched;
+    
+    if (face == NULL || face->packer.ev != ev)
+        return(0);
+    face->packer.ev = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) == 0)
+        pack_flush(h, face);
+    return(0);
+}
+
+/**
+ * Hold a small message so that it may share a packet with others.
+ *
+ * The packet goes when it is full, or when CCND_PACK_MICROSEC has
+ * passed since its first message arrived.
+ * @returns 0, or -1 if the message should be sent at once instead.
+ */
+static int
+pack_append(struct ccnd_handle *h, struct face *face,
+            const unsigned char *data1, size_t size1,
+            const unsigned char *data2, size_t size2)
+{
+    struct ccnd_packer *pk = &face->packer;
+    int budget = pack_budget(h);
+    unsigned now;
+    
+    if (h->pack_microsec <= 0 || size1 + size2 > budget / 2)
+        return(-1);
+    if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_LOCAL | CCN_FACE_NOSEND)) !=
+        CCN_FACE_DGRAM)
+        return(-1);
+    if (pk->buf != NULL && pk->buf->length + size1 + size2 > budget)
+        pack_flush(h, face);
+    now = ccnd_usec_now(h);
+    if (pk->buf == NULL) {
+        pk->buf = ccn_charbuf_create();
+        if (pk->buf == NULL)
+            return(-1);
+        if ((face->flags & CCN_FACE_LINK) != 0)
+            ccn_charbuf_append_tt(pk->buf, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
+        pk->start = now;
+        pk->n = 0;
+        pk->offsets = 0;
+        pk->ev = ccn_schedule_event(h->sched, h->pack_microsec,
+                                    pack_timeout, NULL, face->faceid);
+    }
+    ccn_charbuf_append(pk->buf, data1, size1);
+    if (size2 != 0)
+        ccn_charbuf_append(pk->buf, data2, size2);
+    pk->n++;
+    pk->offsets += now - pk->start;
+    /* No point waiting if nothing more will fit */
+    if (pk->buf->length + 20 > budget)
+        pack_flush(h, face);
+    return(0);
+}
+
+#define CCND_FRAG_OVERHEAD 48        /**< PDU and LinkFragment framing */
+#define CCND_FRAG_REPAIR_USEC 20000  /**< wait before asking for fragments */
+#define CCND_FRAG_TRIES 3            /**< repair requests before giving up */
+
+/**
+ * Get the fragmentation state of a face, creating it if need be.
+ */
+static struct ccnd_fraglink *
+fraglink_get(struct ccnd_handle *h, struct face *face)
+{
+    struct ccnd_fraglink *fl = face->frag;
+    int i;
+    
+    if (fl == NULL) {
+        fl = calloc(1, sizeof(*fl));
+        if (fl == NULL)
+            return(NULL);
+        for (i = 0; i < CCND_REASM_SLOTS; i++)
+            fl->slot[i].id = -1;
+        fl->nextid = nrand48(h->seed);
+        face->frag = fl;
+    }
+    return(fl);
+}
+
+/**
+ * Free the fragmentation state of a face.
+ */
+static void
+fraglink_destroy(struct ccnd_handle *h, struct face *face)
+{
+    struct ccnd_fraglink *fl = face->frag;
+    int i;
+    
+    if (fl == NULL)
+        return;
+    if (fl->repair != NULL)
+        ccn_schedule_cancel(h->sched, fl->repair);
+    for (i = 0; i < CCND_REASM_SLOTS; i++)
+        ccn_charbuf_destroy(&fl->slot[i].parts);
+    for (i = 0; i < CCND_FRAG_KEEP; i++)
+        ccn_charbuf_destroy(&fl->kept[i]);
+    free(fl);
+    face->frag = NULL;
+}
+
+/**
+ * Send one LinkFragment of a message, in a PDU of its own.
+ */
+static void
+frag_send_piece(struct ccnd_handle *h, struct face *face, unsigned id,
+                int i, int n, const unsigned char *data, size_t size)
+{
+    struct ccn_charbuf *c = charbuf_obtain(h);
+    
+    ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
+    ccnb_element_begin(c, CCN_DTAG_LinkFragment);
+    ccnb_element_begin(c, CCN_DTAG_SequenceNumber);
+    ccn_charbuf_append_tt(c, 2, CCN_BLOB);
+    ccn_charbuf_append_value(c, id, 2);
+    ccnb_element_end(c);
+    ccnb_tagged_putf(c, CCN_DTAG_FragmentIndex, "%d", i);
+    ccnb_tagged_putf(c, CCN_DTAG_FragmentCount, "%d", n);
+    ccnb_append_tagged_blob(c, CCN_DTAG_Content, data, size);
+    ccnb_element_end(c);
+    ccn_append_link_stuff(h, face, c);
+    ccn_charbuf_append_closer(c);
+    ccnd_send(h, face, c->buf, c->length);
+    charbuf_release(h, c);
+}
+
+/**
+ * Send a message in fragments, if it is too large for one packet on a
+ * link face.  A copy is kept for a while, for repairs.
+ * @returns 0 if sent, or -1 if the message should be sent whole.
+ */
+static int
+link_fragment_send(struct ccnd_handle *h, struct face *face,
+                   const unsigned char *data1, size_t size1,
+                   const unsigned char *data2, size_t size2)
+{
+    struct ccnd_fraglink *fl;
+    struct ccn_charbuf *msg;
+    size_t size = size1 + size2;
+    size_t len;
+    int mtu = h->link_mtu;
+    int fragsize;
+    int n, i, k;
+    unsigned id;
+    
+    /* Leave room for the framing of a whole message, too */
+    if (face->frame_mtu > 0 &&
+        (mtu <= 0 || mtu > face->frame_mtu - CCND_PACK_RESERVE))
+        mtu = face->frame_mtu - CCND_PACK_RESERVE;
+    if (mtu <= 0 || size <= mtu)
+        return(-1);
+    fragsize = mtu - CCND_FRAG_OVERHEAD;
+    n = (size + fragsize - 1) / fragsize;
+    if (n > CCND_FRAG_MAX)
+        return(-1);
+    fl = fraglink_get(h, face);
+    msg = ccn_charbuf_create();
+    if (fl == NULL || msg == NULL) {
+        ccn_charbuf_destroy(&msg);
+        return(-1);
+    }
+    ccn_charbuf_append(msg, data1, size1);
+    if (size2 != 0)
+        ccn_charbuf_append(msg, data2, size2);
+    id = fl->nextid++;
+    k = id % CCND_FRAG_KEEP;
+    ccn_charbuf_destroy(&fl->kept[k]);
+    fl->kept[k] = msg;
+    fl->kept_id[k] = id;
+    fl->kept_fragsize[k] = fragsize;
+    for (i = 0; i < n; i++) {
+        len = size - i * fragsize;
+        if (len > fragsize)
+            len = fragsize;
+        frag_send_piece(h, face, id, i, n, msg->buf + i * fragsize, len);
+        fl->sent++;
+    }
+    return(0);
+}
+
+/**
+ * Ask the sender for the fragments of a message that have not arrived.
+ */
+static void
+frag_request_missing(struct ccnd_handle *h, struct face *face,
+                     struct ccnd_reasm *r)
+{
+    struct ccn_charbuf *c = charbuf_obtain(h);
+    int i;
+    
+    ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
+    ccnb_element_begin(c, CCN_DTAG_FragmentRequest);
+    ccnb_element_begin(c, CCN_DTAG_SequenceNumber);
+    ccn_charbuf_append_tt(c, 2, CCN_BLOB);
+    ccn_charbuf_append_value(c, r->id, 2);
+    ccnb_element_end(c);
+    for (i = 0; i < r->count; i++)
+        if ((r->have & ((uint_least64_t)1 << i)) == 0)
+            ccnb_tagged_putf(c, CCN_DTAG_FragmentIndex, "%d", i);
+    ccnb_element_end(c);
+    ccn_append_link_stuff(h, face, c);
+    ccn_charbuf_append_closer(c);
+    ccnd_send(h, face, c->buf, c->length);
+    charbuf_release(h, c);
+}
+
+/**
+ * Scheduled event that asks again for missing fragments, and
+ * eventually gives up on messages that cannot be completed.
+ */
+static int
+frag_repair(struct ccn_schedule *sched,
+            void *clienth,
+            struct ccn_scheduled_event *ev,
+            int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct face *face = face_from_faceid(h, ev->evint);
+    struct ccnd_fraglink *fl;
+    struct ccnd_reasm *r;
+    unsigned now;
+    int pending = 0;
+    int i;
+    (void)sched;
+    
+    if (face == NULL || (fl = face->frag) == NULL || fl->repair != ev)
+        return(0);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        fl->repair = NULL;
+        return(0);
+    }
+    now = ccnd_usec_now(h);
+    for (i = 0; i < CCND_REASM_SLOTS; i++) {
+        r = &fl->slot[i];
+        if (r->id < 0)
+            continue;
+        if ((int)(now - r->stamp) < CCND_FRAG_REPAIR_USEC) {
+            pending = 1;
+            continue;
+        }
+        if (r->tries >= CCND_FRAG_TRIES) {
+            r->id = -1;
+            fl->dropped++;
+            continue;
+        }
+        frag_request_missing(h, face, r);
+        r->tries++;
+        r->stamp = now;
+        fl->requested++;
+        pending = 1;
+    }
+    if (!pending) {
+        fl->repair = NULL;
+        return(0);
+    }
+    return(CCND_FRAG_REPAIR_USEC);
+}
+
+/**
+ * Handle a LinkFragment, delivering the message once it is complete.
+ */
+static int
+process_link_fragment(struct ccnd_handle *h, struct face *face,
+                      unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+    struct ccn_skeleton_decoder sd = {0};
+    struct ccnd_fraglink *fl;
+    struct ccnd_reasm *r = NULL;
+    struct ccnd_reasm *victim = NULL;
+    struct ccn_charbuf *c = NULL;
+    const unsigned char *data = NULL;
+    size_t dsize = 0;
+    uint_least64_t all;
+    unsigned now;
+    size_t start;
+    ssize_t dres;
+    int id, i, n, j;
+    
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_LinkFragment))
+        return(-1);
+    ccn_buf_advance(d);
+    id = ccn_parse_required_tagged_binary_number(d, CCN_DTAG_SequenceNumber, 1, 2);
+    i = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FragmentIndex);
+    n = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FragmentCount);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Content)) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_blob(d, &data, &dsize))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+    }
+    ccn_buf_check_close(d);
+    if (d->decoder.state < 0 || n < 1 || n > CCND_FRAG_MAX || i < 0 ||
+        i >= n || data == NULL || dsize == 0 || dsize > CCND_DGRAM_MAX)
+        return(-1);
+    fl = fraglink_get(h, face);
+    if (fl == NULL)
+        return(-1);
+    now = ccnd_usec_now(h);
+    for (j = 0; j < CCND_REASM_SLOTS; j++) {
+        if (fl->slot[j].id == id) {
+            r = &fl->slot[j];
+            break;
+        }
+        /* Otherwise use a free slot, or else the stalest one */
+        if (victim == NULL || fl->slot[j].id < 0 ||
+            (victim->id >= 0 &&
+             (int)(fl->slot[j].stamp - victim->stamp) < 0))
+            victim = &fl->slot[j];
+    }
+    if (r != NULL && r->count != n)
+        victim = r, r = NULL;
+    if (r == NULL) {
+        r = victim;
+        if (r->id >= 0)
+            fl->dropped++;
+        if (r->parts == NULL)
+            r->parts = ccn_charbuf_create();
+        if (r->parts == NULL)
+            return(-1);
+        r->parts->length = 0;
+        r->id = id;
+        r->count = n;
+        r->have = 0;
+        r->tries = 0;
+    }
+    if ((r->have & ((uint_least64_t)1 << i)) != 0)
+        return(0); /* duplicate */
+    r->off[i] = r->parts->length;
+    r->len[i] = dsize;
+    ccn_charbuf_append(r->parts, data, dsize);
+    r->have |= ((uint_least64_t)1 << i);
+    r->stamp = now;
+    all = (n == 64) ? ~(uint_least64_t)0 : (((uint_least64_t)1 << n) - 1);
+    if (r->have != all) {
+        if (fl->repair == NULL)
+            fl->repair = ccn_schedule_event(h->sched, CCND_FRAG_REPAIR_USEC,
+                                            frag_repair, NULL, face->faceid);
+        return(0);
+    }
+    /* Complete - put the pieces in order and pass the result along */
+    r->id = -1;
+    c = ccn_charbuf_create();
+    if (c == NULL)
+        return(-1);
+    for (j = 0; j < n; j++)
+        ccn_charbuf_append(c, r->parts->buf + r->off[j], r->len[j]);
+    r->parts->length = 0;
+    dres = ccn_skeleton_decode(&sd, c->buf, c->length);
+    if (sd.state != 0 || dres != c->length) {
+        ccnd_msg(h, "discarding malformed reassembly from face %u",
+                 face->faceid);
+        fl->dropped++;
+        ccn_charbuf_destroy(&c);
+        return(-1);
+    }
+    fl->reassembled++;
+    memset(&sd, 0, sizeof(sd));
+    while (sd.index < c->length) {
+        start = sd.index;
+        ccn_skeleton_decode(&sd, c->buf + start, c->length - start);
+        process_input_message(h, face, c->buf + start, sd.index - start, 0);
+    }
+    ccn_charbuf_destroy(&c);
+    return(0);
+}
+
+/**
+ * Handle a FragmentRequest by sending the listed fragments again,
+ * if the message is still at hand.
+ */
+static int
+process_fragment_request(struct ccnd_handle *h, struct face *face,
+                         unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+    struct ccnd_fraglink *fl = face->frag;
+    struct ccn_charbuf *m;
+    size_t len;
+    int fragsize;
+    int id, i, n, k;
+    
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_FragmentRequest))
+        return(-1);
+    ccn_buf_advance(d);
+    id = ccn_parse_required_tagged_binary_number(d, CCN_DTAG_SequenceNumber, 1, 2);
+    if (d->decoder.state < 0)
+        return(-1);
+    k = id % CCND_FRAG_KEEP;
+    if (fl == NULL || fl->kept[k] == NULL || fl->kept_id[k] != id)
+        return(0); /* too late */
+    m = fl->kept[k];
+    fragsize = fl->kept_fragsize[k];
+    n = (m->length + fragsize - 1) / fragsize;
+    while (ccn_buf_match_dtag(d, CCN_DTAG_FragmentIndex)) {
+        i = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FragmentIndex);
+        if (i < 0 || i >= n)
+            break;
+        len = m->length - i * fragsize;
+        if (len > fragsize)
+            len = fragsize;
+        frag_send_piece(h, face, id, i, n, m->buf + i * fragsize, len);
+        fl->resent++;
+    }
+    return(0);
+}
+
+/**
+ * Send a message in a PDU, possibly stuffing other interest messages into it.
+ * The message may be in two pieces.
+ * If the pieces are part of a content store entry, pass that as content
+ * so that a stream face may queue them without copying.
+ * Small messages to a datagram face may be held for packing.
+ */
+static void
+stuff_and_send(struct ccnd_handle *h, struct face *face,
+               const unsigned char *data1, size_t size1,
+               const unsigned char *data2, size_t size2,
+               struct content_entry *content) {
+    struct ccn_charbuf *c = NULL;
+    struct iovec iov[2];
+    
+    if (pack_append(h, face, data1, size1, data2, size2) == 0)
+        return;
+    /* Anything already held must go first, to keep the order */
+    pack_flush(h, face);
+    if ((face->flags & CCN_FACE_LINK) != 0) {
+        if (link_fragment_send(h, face, data1, size1, data2, size2) == 0)
+            return;
+        c = charbuf_obtain(h);
+        ccn_charbuf_reserve(c, size1 + size2 + 5 + 8);
+        ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
+        ccn_charbuf_append(c, data1, size1);
+		if (size2 != 0)
+            ccn_charbuf_append(c, data2, size2);
+        ccn_stuff_interest(h, face, c);
+        ccn_append_link_stuff(h, face, c);
+        ccn_charbuf_append_closer(c);
+    }
+    else if (h->mtu > size1 + size2 ||
+             (face->flags & (CCN_FACE_SEQOK | CCN_FACE_SEQPROBE)) != 0 ||
+             face_is_quiet(h, face)) {
+        c = charbuf_obtain(h);
+        ccn_charbuf_append(c, data1, size1);
+		if (size2 != 0)
+            ccn_charbuf_append(c, data2, size2);
         ccn_stuff_interest(h, face, c);
         ccn_append_link_stuff(h, face, c);
     }
     else {
-        /* avoid a copy in this case */
-        ccnd_send(h, face, data1, size1);
+        /* nothing to add, so avoid a copy by gathering the pieces */
+        iov[0].iov_base = (void *)data1;
+        iov[0].iov_len = size1;
+        iov[1].iov_base = (void *)data2;
+        iov[1].iov_len = size2;
+        ccnd_sendv(h, face, iov, (size2 != 0) ? 2 : 1, content);
         return;
     }
     ccnd_send(h, face, c->buf, c->length);
@@ -1727,7 +3927,7 @@ stuff_link_check(struct ccnd_handle *h,
     struct ccn_charbuf *ibuf = NULL;
     int res;
     int ans = 0;
-    if (face->recvcount > 0)
+    if (!face_is_quiet(h, face))
         return(0);
     if ((face->flags & checkflags) != wantflags)
         return(0);
@@ -1815,84 +4015,392 @@ ccn_stuff_interest(struct ccnd_handle *h,
     return(n_stuffed);
 }
 
+#define CCND_ARQ_ACK_USEC 1000  /**< longest an ack waits for a ride */
+#define CCND_ARQ_MIN_RTO 2000   /**< usec */
+#define CCND_ARQ_TRIES 2        /**< retransmissions before giving up */
+
 /**
- * Set up to send one sequence number to see it the other side wants to play.
- *
- * If we don't hear a number from the other side, we won't keep sending them.
+ * Get the link reliability state of a face, creating it if need be.
+ */
+static struct ccnd_arq *
+arq_get(struct face *face)
+{
+    struct ccnd_arq *a = face->arq;
+    
+    if (a == NULL) {
+        a = calloc(1, sizeof(*a));
+        if (a == NULL)
+            return(NULL);
+        a->srtt = 20000;
+        face->arq = a;
+    }
+    return(a);
+}
+
+/**
+ * Free the link reliability state of a face.
  */
 static void
-ccn_link_state_init(struct ccnd_handle *h, struct face *face)
+arq_destroy(struct ccnd_handle *h, struct face *face)
 {
-    int checkflags;
-    int matchflags;
+    struct ccnd_arq *a = face->arq;
+    int k;
     
-    matchflags = CCN_FACE_DGRAM;
-    checkflags = matchflags | CCN_FACE_MCAST | CCN_FACE_GG | CCN_FACE_SEQOK | \
-                 CCN_FACE_PASSIVE;
-    if ((face->flags & checkflags) != matchflags)
+    if (a == NULL)
         return;
-    /* Send one sequence number to see if the other side wants to play. */
-    face->pktseq = nrand48(h->seed);
-    face->flags |= CCN_FACE_SEQPROBE;
+    if (a->ack_ev != NULL)
+        ccn_schedule_cancel(h->sched, a->ack_ev);
+    if (a->rto_ev != NULL)
+        ccn_schedule_cancel(h->sched, a->rto_ev);
+    for (k = 0; k < CCND_ARQ_WINDOW; k++)
+        ccn_charbuf_destroy(&a->buf[k]);
+    free(a);
+    face->arq = NULL;
 }
 
 /**
- * Append a sequence number if appropriate.
+ * Append a LinkAck covering the SequenceNumbers received lately.
  */
 static void
-ccn_append_link_stuff(struct ccnd_handle *h,
-                      struct face *face,
-                      struct ccn_charbuf *c)
+arq_append_ack(struct ccnd_arq *a, struct ccn_charbuf *c)
 {
-    if ((face->flags & (CCN_FACE_SEQOK | CCN_FACE_SEQPROBE)) == 0)
-        return;
-    ccn_charbuf_append_tt(c, CCN_DTAG_SequenceNumber, CCN_DTAG);
+    ccnb_element_begin(c, CCN_DTAG_LinkAck);
+    ccnb_element_begin(c, CCN_DTAG_SequenceNumber);
     ccn_charbuf_append_tt(c, 2, CCN_BLOB);
-    ccn_charbuf_append_value(c, face->pktseq, 2);
+    ccn_charbuf_append_value(c, a->rtop, 2);
     ccnb_element_end(c);
-    if (0)
-        ccnd_msg(h, "debug.%d pkt_to %u seq %u",
-                 __LINE__, face->faceid, (unsigned)face->pktseq);
-    face->pktseq++;
-    face->flags &= ~CCN_FACE_SEQPROBE;
+    ccnb_element_begin(c, CCN_DTAG_AckMask);
+    ccn_charbuf_append_tt(c, 4, CCN_BLOB);
+    ccn_charbuf_append_value(c, a->rmask & 0xFFFFFFFF, 4);
+    ccnb_element_end(c);
+    ccnb_element_end(c);
+    a->ack_pending = 0;
+    a->acks_sent++;
 }
 
 /**
- * Process an incoming link message.
+ * Scheduled event that sends an ack on its own, if no outgoing
+ * datagram has carried it in the meantime.
  */
 static int
-process_incoming_link_message(struct ccnd_handle *h,
-                              struct face *face, enum ccn_dtag dtag,
-                              unsigned char *msg, size_t size)
+arq_ack_timeout(struct ccn_schedule *sched,
+                void *clienth,
+                struct ccn_scheduled_event *ev,
+                int flags)
 {
-    uintmax_t s;
-    int checkflags;
-    int matchflags;
-    struct ccn_buf_decoder decoder;
-    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+    struct ccnd_handle *h = clienth;
+    struct face *face = face_from_faceid(h, ev->evint);
+    struct ccn_charbuf *c;
+    struct ccnd_arq *a;
+    (void)sched;
+    
+    if (face == NULL || (a = face->arq) == NULL || a->ack_ev != ev)
+        return(0);
+    a->ack_ev = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || !a->ack_pending)
+        return(0);
+    c = charbuf_obtain(h);
+    if ((face->flags & CCN_FACE_LINK) != 0)
+        ccn_charbuf_append_tt(c, CCN_DTAG_CCNProtocolDataUnit, CCN_DTAG);
+    arq_append_ack(a, c);
+    if ((face->flags & CCN_FACE_LINK) != 0)
+        ccn_charbuf_append_closer(c);
+    a->seq_pending = 0; /* acks are not themselves acked */
+    ccnd_send(h, face, c->buf, c->length);
+    charbuf_release(h, c);
+    return(0);
+}
 
-    switch (dtag) {
-        case CCN_DTAG_SequenceNumber:
-            s = ccn_parse_required_tagged_binary_number(d, dtag, 1, 6);
-            if (d->decoder.state < 0)
-                return(d->decoder.state);
-            /*
-             * If the other side is unicast and sends sequence numbers,
-             * then it is OK for us to send numbers as well.
-             */
-            matchflags = CCN_FACE_DGRAM;
-            checkflags = matchflags | CCN_FACE_MCAST | CCN_FACE_SEQOK;
-            if ((face->flags & checkflags) == matchflags)
-                face->flags |= CCN_FACE_SEQOK;
-            if (face->rrun == 0) {
-                face->rseq = s;
-                face->rrun = 1;
-                return(0);
-            }
-            if (s == face->rseq + 1) {
-                face->rseq = s;
-                if (face->rrun < 255)
-                    face->rrun++;
+/**
+ * Note a SequenceNumber from the peer, to be acknowledged shortly.
+ */
+static void
+arq_note_received(struct ccnd_handle *h, struct face *face, unsigned short s)
+{
+    struct ccnd_arq *a = arq_get(face);
+    unsigned short d;
+    
+    if (a == NULL)
+        return;
+    d = s - a->rtop;
+    if (a->rmask == 0 || (d != 0 && d < 0x8000)) {
+        /* newest so far */
+        a->rmask = (a->rmask == 0 || d >= 32) ? 1 : (a->rmask << d) | 1;
+        a->rtop = s;
+    }
+    else if ((unsigned short)(a->rtop - s) < 32)
+        a->rmask |= (uint_least32_t)1 << (unsigned short)(a->rtop - s);
+    a->ack_pending = 1;
+    if (a->ack_ev == NULL)
+        a->ack_ev = ccn_schedule_event(h->sched, CCND_ARQ_ACK_USEC,
+                                       arq_ack_timeout, NULL, face->faceid);
+}
+
+/**
+ * @returns the retransmission timeout for a face, in usec.
+ */
+static int
+arq_rto(struct ccnd_arq *a)
+{
+    int rto = 2 * a->srtt;
+    
+    if (rto < CCND_ARQ_MIN_RTO)
+        rto = CCND_ARQ_MIN_RTO;
+    return(rto);
+}
+
+/**
+ * Send a kept datagram again.
+ */
+static void
+arq_retransmit(struct ccnd_handle *h, struct face *face, int k, unsigned now)
+{
+    struct ccnd_arq *a = face->arq;
+    
+    a->tries[k]++;
+    a->sent_at[k] = now;
+    a->retransmitted++;
+    ccnd_send(h, face, a->buf[k]->buf, a->buf[k]->length);
+}
+
+/**
+ * Scheduled event that retransmits datagrams that have not been acked
+ * in time, and eventually gives up on them.
+ */
+static int
+arq_rto_timeout(struct ccn_schedule *sched,
+                void *clienth,
+                struct ccn_scheduled_event *ev,
+                int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct face *face = face_from_faceid(h, ev->evint);
+    struct ccnd_arq *a;
+    unsigned now;
+    int pending = 0;
+    int rto;
+    int k;
+    (void)sched;
+    
+    if (face == NULL || (a = face->arq) == NULL || a->rto_ev != ev)
+        return(0);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        a->rto_ev = NULL;
+        return(0);
+    }
+    now = ccnd_usec_now(h);
+    rto = arq_rto(a);
+    for (k = 0; k < CCND_ARQ_WINDOW; k++) {
+        if (a->buf[k] == NULL)
+            continue;
+        if ((int)(now - a->sent_at[k]) >= rto) {
+            if (a->tries[k] >= CCND_ARQ_TRIES) {
+                ccn_charbuf_destroy(&a->buf[k]);
+                a->lost++;
+                continue;
+            }
+            arq_retransmit(h, face, k, now);
+        }
+        pending = 1;
+    }
+    if (!pending) {
+        a->rto_ev = NULL;
+        return(0);
+    }
+    return(rto);
+}
+
+/**
+ * Keep a copy of a datagram that carries a SequenceNumber, if the
+ * peer is acking them.  Called as the datagram is sent.
+ */
+static void
+arq_note_sent(struct ccnd_handle *h, struct face *face,
+              const struct iovec *iov, int iovcnt)
+{
+    struct ccnd_arq *a = face->arq;
+    int i, k;
+    
+    a->seq_pending = 0;
+    if ((face->flags & CCN_FACE_ARQ) == 0)
+        return;
+    k = a->seq_next % CCND_ARQ_WINDOW;
+    if (a->buf[k] != NULL) {
+        a->lost++; /* the window wrapped before an ack came */
+        a->buf[k]->length = 0;
+    }
+    else
+        a->buf[k] = ccn_charbuf_create();
+    if (a->buf[k] == NULL)
+        return;
+    for (i = 0; i < iovcnt; i++)
+        ccn_charbuf_append(a->buf[k], iov[i].iov_base, iov[i].iov_len);
+    a->seq[k] = a->seq_next;
+    a->sent_at[k] = ccnd_usec_now(h);
+    a->tries[k] = 0;
+    if (a->rto_ev == NULL)
+        a->rto_ev = ccn_schedule_event(h->sched, arq_rto(a),
+                                       arq_rto_timeout, NULL, face->faceid);
+}
+
+/**
+ * Handle a LinkAck from the peer.
+ *
+ * The first one tells us that the peer is willing to ack, so from then
+ * on we keep what we send for retransmission.  A datagram that is
+ * missing from an ack that covers three later ones is sent again at once.
+ */
+static int
+process_link_ack(struct ccnd_handle *h, struct face *face,
+                 unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+    struct ccnd_arq *a;
+    unsigned short top;
+    unsigned short s;
+    unsigned short back;
+    uintmax_t mask;
+    unsigned now;
+    unsigned sample;
+    int i, k;
+    
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_LinkAck))
+        return(-1);
+    ccn_buf_advance(d);
+    top = ccn_parse_required_tagged_binary_number(d, CCN_DTAG_SequenceNumber, 1, 2);
+    mask = ccn_parse_required_tagged_binary_number(d, CCN_DTAG_AckMask, 1, 4);
+    ccn_buf_check_close(d);
+    if (d->decoder.state < 0)
+        return(-1);
+    if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_MCAST)) != CCN_FACE_DGRAM)
+        return(0);
+    a = arq_get(face);
+    if (a == NULL)
+        return(-1);
+    if ((face->flags & CCN_FACE_ARQ) == 0) {
+        face->flags |= CCN_FACE_ARQ;
+        if (h->debug & 2)
+            ccnd_msg(h, "face %u acks link sequence numbers", face->faceid);
+    }
+    now = ccnd_usec_now(h);
+    for (i = 0; i < 32; i++) {
+        if ((mask & ((uintmax_t)1 << i)) == 0)
+            continue;
+        s = top - i;
+        k = s % CCND_ARQ_WINDOW;
+        if (a->buf[k] != NULL && a->seq[k] == s) {
+            if (a->tries[k] == 0) {
+                sample = now - a->sent_at[k];
+                a->srtt = (7 * a->srtt + sample) / 8;
+            }
+            ccn_charbuf_destroy(&a->buf[k]);
+            a->acked++;
+        }
+    }
+    for (k = 0; k < CCND_ARQ_WINDOW; k++) {
+        if (a->buf[k] == NULL || a->tries[k] != 0)
+            continue;
+        back = top - a->seq[k];
+        if (back >= 3 && back < 32)
+            arq_retransmit(h, face, k, now);
+    }
+    return(0);
+}
+
+/**
+ * Set up to send one sequence number to see it the other side wants to play.
+ *
+ * If we don't hear a number from the other side, we won't keep sending them.
+ * With CCND_LINK_MTU set, unicast datagram faces also become link faces
+ * so that large messages may be fragmented; the peer follows suit when it
+ * sees the first CCNProtocolDataUnit.
+ */
+static void
+ccn_link_state_init(struct ccnd_handle *h, struct face *face)
+{
+    int checkflags;
+    int matchflags;
+
+    matchflags = CCN_FACE_DGRAM;
+    checkflags = matchflags | CCN_FACE_MCAST | CCN_FACE_GG | CCN_FACE_PASSIVE;
+    if ((face->flags & checkflags) != matchflags)
+        return;
+    if (h->link_mtu > 0)
+        face->flags |= CCN_FACE_LINK;
+    if ((face->flags & CCN_FACE_SEQOK) != 0)
+        return;
+    /* Send one sequence number to see if the other side wants to play. */
+    face->pktseq = nrand48(h->seed);
+    face->flags |= CCN_FACE_SEQPROBE;
+}
+
+/**
+ * Append a sequence number if appropriate.
+ */
+static void
+ccn_append_link_stuff(struct ccnd_handle *h,
+                      struct face *face,
+                      struct ccn_charbuf *c)
+{
+    if ((face->flags & (CCN_FACE_SEQOK | CCN_FACE_SEQPROBE)) == 0)
+        return;
+    ccn_charbuf_append_tt(c, CCN_DTAG_SequenceNumber, CCN_DTAG);
+    ccn_charbuf_append_tt(c, 2, CCN_BLOB);
+    ccn_charbuf_append_value(c, face->pktseq, 2);
+    ccnb_element_end(c);
+    if (face->arq != NULL) {
+        /* Note the number for arq_note_sent, and give any ack a ride */
+        face->arq->seq_pending = 1;
+        face->arq->seq_next = face->pktseq;
+        if (face->arq->ack_pending)
+            arq_append_ack(face->arq, c);
+    }
+    if (0)
+        ccnd_msg(h, "debug.%d pkt_to %u seq %u",
+                 __LINE__, face->faceid, (unsigned)face->pktseq);
+    face->pktseq++;
+    face->flags &= ~CCN_FACE_SEQPROBE;
+}
+
+/**
+ * Process an incoming link message.
+ */
+static int
+process_incoming_link_message(struct ccnd_handle *h,
+                              struct face *face, enum ccn_dtag dtag,
+                              unsigned char *msg, size_t size)
+{
+    uintmax_t s;
+    int checkflags;
+    int matchflags;
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+
+    switch (dtag) {
+        case CCN_DTAG_SequenceNumber:
+            s = ccn_parse_required_tagged_binary_number(d, dtag, 1, 6);
+            if (d->decoder.state < 0)
+                return(d->decoder.state);
+            /*
+             * If the other side is unicast and sends sequence numbers,
+             * then it is OK for us to send numbers as well.
+             */
+            matchflags = CCN_FACE_DGRAM;
+            checkflags = matchflags | CCN_FACE_MCAST | CCN_FACE_SEQOK;
+            if ((face->flags & checkflags) == matchflags)
+                face->flags |= CCN_FACE_SEQOK;
+            if (h->link_arq && (face->flags & CCN_FACE_SEQOK) != 0)
+                arq_note_received(h, face, s);
+            if (face->rrun == 0) {
+                face->rseq = s;
+                face->rrun = 1;
+                return(0);
+            }
+            if (s == face->rseq + 1) {
+                face->rseq = s;
+                if (face->rrun < 255)
+                    face->rrun++;
                 return(0);
             }
             if (s > face->rseq && s - face->rseq < 255) {
@@ -1919,6 +4427,12 @@ process_incoming_link_message(struct ccnd_handle *h,
             face->rseq = s;
             face->rrun = 1;
             break;
+        case CCN_DTAG_LinkFragment:
+            return(process_link_fragment(h, face, msg, size));
+        case CCN_DTAG_FragmentRequest:
+            return(process_fragment_request(h, face, msg, size));
+        case CCN_DTAG_LinkAck:
+            return(process_link_ack(h, face, msg, size));
         default:
             return(-1);
     }
@@ -1927,6 +4441,10 @@ process_incoming_link_message(struct ccnd_handle *h,
 
 /**
  * Checks for inactivity on datagram faces.
+ *
+ * Advances the reap tick, and looks at the faces in its idle wheel slot.
+ * Any face that has heard something since it was put there would have
+ * moved on, so these have gone quiet, unless they are permanent.
  * @returns number of faces that have gone away.
  */
 static int
@@ -1934,32 +4452,26 @@ check_dgram_faces(struct ccnd_handle *h)
 {
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
+    struct face *face;
+    struct face *next;
     int count = 0;
-    int checkflags = CCN_FACE_DGRAM;
-    int wantflags = CCN_FACE_DGRAM;
     
-    hashtb_start(h->dgram_faces, e);
-    while (e->data != NULL) {
-        struct face *face = e->data;
-        if (face->addr != NULL && (face->flags & checkflags) == wantflags) {
+    h->reap_tick += 1;
+    face = h->idle_wheel[h->reap_tick % CCND_IDLE_WHEEL];
+    for (; face != NULL; face = next) {
+        next = face->idle_next;
+        if ((face->flags & CCN_FACE_PERMANENT) != 0 ||
+            h->reap_tick - face->rtick < CCND_IDLE_TICKS) {
             face->flags &= ~CCN_FACE_LC; /* Rate limit link check interests */
-            if (face->recvcount == 0) {
-                if ((face->flags & CCN_FACE_PERMANENT) == 0) {
-                    count += 1;
-                    hashtb_delete(e);
-                    continue;
-                }
-            }
-            else if (face->recvcount == 1) {
-                face->recvcount = 0;
-            }
-            else {
-                face->recvcount = 1; /* go around twice */
-            }
+            idle_wheel_insert(h, face, h->reap_tick + CCND_IDLE_TICKS);
+            continue;
         }
-        hashtb_next(e);
+        count += 1;
+        hashtb_start(h->dgram_faces, e);
+        hashtb_seek(e, face->addr, face->addrlen, 0);
+        hashtb_delete(e);
+        hashtb_end(e);
     }
-    hashtb_end(e);
     return(count);
 }
 
@@ -2046,6 +4558,35 @@ check_propagating(struct ccnd_handle *h)
     return(count);
 }
 
+/**
+ * Remove expired negative cache entries.
+ * @returns number that have gone away.
+ */
+static int
+check_negcache(struct ccnd_handle *h)
+{
+    int count = 0;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct negcache_entry *ne;
+    unsigned now;
+    
+    if (h->negcache_tab == NULL)
+        return(0);
+    now = ccnd_usec_now(h);
+    hashtb_start(h->negcache_tab, e);
+    for (ne = e->data; ne != NULL; ne = e->data) {
+        if ((int)(ne->expiry - now) <= 0) {
+            count += 1;
+            hashtb_delete(e);
+            continue;
+        }
+        hashtb_next(e);
+    }
+    hashtb_end(e);
+    return(count);
+}
+
 /**
  * Ages src info and retires unused nameprefix entries.
  * @returns number that have gone away.
@@ -2071,6 +4612,12 @@ check_nameprefix_entries(struct ccnd_handle *h)
                 count += 1;
                 if (npe->parent != NULL) {
                     npe->parent->children--;
+                    if (npe->psibling != NULL)
+                        npe->psibling->sibling = npe->sibling;
+                    else
+                        npe->parent->child = npe->sibling;
+                    if (npe->sibling != NULL)
+                        npe->sibling->psibling = npe->psibling;
                     npe->parent = NULL;
                 }
                 hashtb_delete(e);
@@ -2095,6 +4642,40 @@ check_comm_file(struct ccnd_handle *h)
     }
 }
 
+/**
+ * Stretch the period of a housekeeping event while ccnd is quiet.
+ */
+int
+ccnd_idle_period(struct ccnd_handle *h, int usec)
+{
+    if (h->quiet && usec <= INT_MAX / CCND_IDLE_STRETCH)
+        return(usec * CCND_IDLE_STRETCH);
+    return(usec);
+}
+
+/**
+ * Go into or out of idle mode, as the traffic warrants.
+ *
+ * Idle mode lets the scheduler hold timers for up to h->idle_slack,
+ * so that nearby ones share a wakeup.  It is left as soon as anything
+ * comes in, since that may leave interests pending.
+ */
+static void
+check_quiet(struct ccnd_handle *h)
+{
+    int quiet;
+    
+    if (h->idle_slack <= 0)
+        return;
+    quiet = (h->pit_pending == 0 && h->sec - h->busy_sec >= CCND_QUIET_SECS);
+    if (quiet == h->quiet)
+        return;
+    h->quiet = quiet;
+    ccn_schedule_set_slack(h->sched, quiet ? h->idle_slack : 0);
+    if (h->debug & 2)
+        ccnd_msg(h, "%s idle mode", quiet ? "entering" : "leaving");
+}
+
 /**
  * Scheduled reap event for retiring expired structures.
  */
@@ -2114,9 +4695,11 @@ reap(
     }
     check_dgram_faces(h);
     check_propagating(h);
+    check_negcache(h);
     check_nameprefix_entries(h);
     check_comm_file(h);
-    return(2 * CCN_INTEREST_LIFETIME_MICROSEC);
+    ccnd_msg_flush(h);
+    return(ccnd_idle_period(h, 2 * CCN_INTEREST_LIFETIME_MICROSEC));
 }
 
 static void
@@ -2137,23 +4720,66 @@ remove_content(struct ccnd_handle *h, struct content_entry *content)
     int res;
     if (content == NULL)
         return(-1);
-    hashtb_start(h->content_tab, e);
-    res = hashtb_seek(e, content->key,
-                      content->key_size, content->size - content->key_size);
+    hashtb_start(h->cs[content->shard].content_tab, e);
+    res = hashtb_seek(e, content_digest(content), 32, 0);
     if (res != HT_OLD_ENTRY)
         abort();
     if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0)
         h->n_stale--;
+    if ((content->flags & CCN_CONTENT_ENTRY_PREFETCHED) != 0)
+        ccnd_prefetch_outcome(h->prefetch, 0);
     if (h->debug & 4)
-        ccnd_debug_ccnb(h, __LINE__, "remove", NULL,
-                        content->key, content->size);
+        debug_content(h, __LINE__, "remove", NULL, content);
     hashtb_delete(e);
     hashtb_end(e);
     return(0);
 }
 
+/**
+ * Remove content from the store to make room, and count it
+ */
+static int
+evict_content(struct ccnd_handle *h, struct content_entry *content)
+{
+    struct ccnd_cs_shard *s = &h->cs[content->shard];
+    
+    if (remove_content(h, content) < 0)
+        return(-1);
+    s->evicted++;
+    ccnd_meter_bump(h, h->evictions, 1);
+    return(0);
+}
+
+/**
+ * Write content that is being evicted to the disk cache.
+ *
+ * Only content that does not go stale with time is kept, since its
+ * freshness would start over when it came back.  The implicit digest
+ * is left out, as it was on the wire.
+ */
+static void
+demote_content(struct ccnd_handle *h, struct content_entry *content)
+{
+    const unsigned char *key;
+    int n = content->ncomps;
+    
+    if (h->disk == NULL || n < 2 ||
+        (content->flags & CCN_CONTENT_ENTRY_EXPIRES) != 0)
+        return;
+    key = content_object(h, content);
+    if (key == NULL)
+        return;
+    ccnd_disk_put(h->disk, key + content->comps[0],
+                  content->comps[n - 2] - content->comps[0],
+                  key, content->comps[n - 2],
+                  key + content->comps[n - 1], content->size - content->comps[n - 1]);
+}
+
 /**
  * Periodic content cleaning
+ *
+ * Only the shards that are over their share of the capacity give up
+ * content, apart from unsolicited content, which goes first anywhere.
  */
 static int
 clean_deamon(struct ccn_schedule *sched,
@@ -2164,15 +4790,18 @@ clean_deamon(struct ccn_schedule *sched,
     struct ccnd_handle *h = clienth;
     (void)(sched);
     (void)(ev);
-    unsigned long n;
-    ccn_accession_t limit;
-    ccn_accession_t a;
-    ccn_accession_t min_stale;
+    unsigned long n[CCND_CS_SHARDS_MAX];
+    size_t bytes[CCND_CS_SHARDS_MAX];
+    struct ccnd_cs_shard *s = NULL;
+    unsigned limit;
+    unsigned a;
+    unsigned min_stale;
     int check_limit = 500;  /* Do not run for too long at once */
     struct content_entry *content = NULL;
-    int res = 0;
+    int full;
     int ignore;
     int i;
+    int k;
     
     /*
      * If we ran into our processing limit (check_limit) last time,
@@ -2183,8 +4812,8 @@ clean_deamon(struct ccn_schedule *sched,
         h->clean = NULL;
         return(0);
     }
-    n = hashtb_n(h->content_tab);
-    if (n <= h->capacity)
+    content_slots_trim(h);
+    if (content_shards_full(h) == 0)
         return(15000000);
     /* Toss unsolicited content first */
     for (i = 0; i < h->unsol->n; i++) {
@@ -2198,37 +4827,45 @@ clean_deamon(struct ccn_schedule *sched,
         content = content_from_accession(h, a);
         if (content != NULL &&
             (content->flags & CCN_CONTENT_ENTRY_PRECIOUS) == 0)
-            remove_content(h, content);
+            evict_content(h, content);
     }
-    n = hashtb_n(h->content_tab);
     h->unsol->n = 0;
+    full = content_shards_full(h);
     if (h->min_stale <= h->max_stale) {
         /* clean out stale content next */
         limit = h->max_stale;
-        if (limit > h->accession)
-            limit = h->accession;
+        if (limit >= h->content_slot_limit)
+            limit = h->content_slot_limit - 1;
         min_stale = ~0;
         a = ev->evint;
         if (a <= h->min_stale || a > h->max_stale)
             a = h->min_stale;
         else
             min_stale = h->min_stale;
-        for (; a <= limit && n > h->capacity; a++) {
+        for (; a <= limit && full > 0; a++) {
             if (check_limit-- <= 0) {
                 ev->evint = a;
                 break;
             }
-            content = content_from_accession(h, a);
+            content = h->content_by_slot[a];
             if (content != NULL &&
                   (content->flags & CCN_CONTENT_ENTRY_STALE) != 0) {
-                res = remove_content(h, content);
-                if (res < 0) {
+                s = &h->cs[content->shard];
+                if (!shard_full(s)) {
+                    /* Its shard has room; leave it for a later round */
+                    if (a < min_stale)
+                        min_stale = a;
+                    continue;
+                }
+                demote_content(h, content);
+                if (evict_content(h, content) < 0) {
                     if (a < min_stale)
                         min_stale = a;
                 }
                 else {
                     content = NULL;
-                    n -= 1;
+                    if (!shard_full(s))
+                        full--;
                 }
             }
         }
@@ -2243,22 +4880,57 @@ clean_deamon(struct ccn_schedule *sched,
         if (check_limit <= 0)
             return(5000);
     }
-    else {
-        /* Make oldish content stale, for cleanup on next round */
-        limit = h->accession;
+    else if (h->cs->cache == NULL) {
+        /*
+         * Make oldish content stale, for cleanup on next round.
+         * The first pass spares the newest arrivals.
+         */
+        for (k = 0; k < h->cs_n; k++) {
+            n[k] = hashtb_n(h->cs[k].content_tab);
+            bytes[k] = h->cs[k].bytes;
+        }
+        limit = h->content_slot_limit;
         ignore = CCN_CONTENT_ENTRY_STALE | CCN_CONTENT_ENTRY_PRECIOUS;
-        for (a = h->accession_base; a <= limit && n > h->capacity; a++) {
-            content = content_from_accession(h, a);
-            if (content != NULL && (content->flags & ignore) == 0) {
-                mark_stale(h, content);
-                n--;
+        for (i = 1; i >= 0; i--) {
+            for (a = 0; a < limit && full > 0; a++) {
+                content = h->content_by_slot[a];
+                if (content == NULL || (content->flags & ignore) != 0)
+                    continue;
+                k = content->shard;
+                s = &h->cs[k];
+                if (!shard_over_capacity(s, n[k], bytes[k]))
+                    continue;
+                if (i == 0 || content_age(h, content) >= h->capacity) {
+                    mark_stale(h, content);
+                    n[k]--;
+                    bytes[k] -= content_stored_size(content) +
+                                content_overhead(content);
+                    if (!shard_over_capacity(s, n[k], bytes[k]))
+                        full--;
+                }
             }
         }
         ev->evint = 0;
         return(1000000);
     }
+    if (h->cs->cache != NULL) {
+        /* Let the replacement policy of each shard choose what goes */
+        for (k = 0; k < h->cs_n; k++) {
+            s = &h->cs[k];
+            while (shard_full(s)) {
+                if (check_limit-- <= 0)
+                    return(5000);
+                content = ccnd_cache_victim(s->cache);
+                if (content == NULL)
+                    break;
+                demote_content(h, content);
+                if (evict_content(h, content) < 0)
+                    break;
+            }
+        }
+    }
     ev->evint = 0;
-    return(15000000);
+    return(ccnd_idle_period(h, 15000000));
 }
 
 /**
@@ -2272,60 +4944,173 @@ clean_needed(struct ccnd_handle *h)
 }
 
 /**
- * Age out the old forwarding table entries
+ * Compress the part of a ContentObject from the Content element onward.
+ *
+ * The object's buffer shrinks to fit, and the store is charged for
+ * the smaller size.  Content that does not compress well is marked so
+ * that it is not tried again.
  */
-static int
+static void
+content_compress(struct ccnd_handle *h, struct content_entry *content,
+                 struct ccn_charbuf *scratch)
+{
+    struct ccnd_cs_shard *s = &h->cs[content->shard];
+    unsigned char *object = (unsigned char *)content->key;
+    unsigned char *p;
+    size_t tail = content->size - content->key_size;
+    size_t n;
+    
+    if ((content->flags & (CCN_CONTENT_ENTRY_COMPRESSED |
+                           CCN_CONTENT_ENTRY_INCOMPRESSIBLE)) != 0)
+        return;
+    h->compress_tries++;
+    n = 0;
+    if (tail >= CCND_COMPRESS_MIN &&
+        ccn_charbuf_reserve(scratch, tail) != NULL)
+        n = ccnd_lz_compress(object + content->key_size, tail,
+                             scratch->buf, tail - tail / 8);
+    if (n == 0) {
+        content->flags |= CCN_CONTENT_ENTRY_INCOMPRESSIBLE;
+        return;
+    }
+    memcpy(object + content->key_size, scratch->buf, n);
+    p = ccn_memacct_realloc(&h->mem[CCND_MEM_CONTENT], object,
+                            content->key_size + n);
+    if (p != NULL)
+        content->key = p;
+    content->zsize = n;
+    content->flags |= CCN_CONTENT_ENTRY_COMPRESSED;
+    h->content_bytes -= tail - n;
+    s->bytes -= tail - n;
+    h->compressed++;
+    h->compressed_in += tail;
+    h->compressed_out += n;
+}
+
+/**
+ * Compress content that has not been sent for a while
+ *
+ * Each run looks at a few of the content slots, picking up where the
+ * last left off.  It looks at more of them when no interests have come
+ * in since the last run, so that most of the work is done while ccnd
+ * is otherwise idle.
+ */
+static int
+compress_deamon(struct ccn_schedule *sched,
+                void *clienth,
+                struct ccn_scheduled_event *ev,
+                int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct content_entry *content;
+    struct ccn_charbuf *scratch;
+    unsigned a;
+    int budget;
+    clock_t t0;
+    (void)(sched);
+    (void)(ev);
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        h->compressor = NULL;
+        return(0);
+    }
+    budget = CCND_COMPRESS_SLOTS;
+    if (h->interests_accepted == h->compress_mark)
+        budget = CCND_COMPRESS_IDLE_SLOTS;
+    h->compress_mark = h->interests_accepted;
+    scratch = charbuf_obtain(h);
+    t0 = clock();
+    a = h->compress_cursor;
+    for (; budget > 0 && h->content_slot_limit > 0; budget--, a++) {
+        if (a >= h->content_slot_limit)
+            a = 0;
+        content = h->content_by_slot[a];
+        if (content != NULL &&
+            (unsigned)h->sec - content->used >= h->compress_age)
+            content_compress(h, content, scratch);
+    }
+    h->compress_cursor = a;
+    h->compress_usec += cpu_usec_since(t0);
+    charbuf_release(h, scratch);
+    return(CCND_COMPRESS_PERIOD);
+}
+
+/**
+ * Age out the old forwarding table entries
+ *
+ * Only the entries in the expiry wheel slots for this run's ticks are
+ * examined; that is one tick, or CCND_IDLE_STRETCH of them after a
+ * run that was put off for idle mode.
+ * Those that are due, or whose face has gone away, are removed.
+ */
+static int
 age_forwarding(struct ccn_schedule *sched,
              void *clienth,
              struct ccn_scheduled_event *ev,
              int flags)
 {
     struct ccnd_handle *h = clienth;
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
     struct ccn_forwarding *f;
     struct ccn_forwarding *next;
     struct ccn_forwarding **p;
     struct nameprefix_entry *npe;
+    struct face *face;
+    int ticks;
     
     if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
         h->age_forwarding = NULL;
         return(0);
     }
-    hashtb_start(h->nameprefix_tab, e);
-    for (npe = e->data; npe != NULL; npe = e->data) {
-        p = &npe->forwarding;
-        for (f = npe->forwarding; f != NULL; f = next) {
-            next = f->next;
-            if ((f->flags & CCN_FORW_REFRESHED) == 0 ||
-                  face_from_faceid(h, f->faceid) == NULL) {
-                if (h->debug & 2) {
-                    struct face *face = face_from_faceid(h, f->faceid);
-                    if (face != NULL) {
-                        struct ccn_charbuf *prefix = ccn_charbuf_create();
-                        ccn_name_init(prefix);
-                        ccn_name_append_components(prefix, e->key, 0, e->keysize);
-                        ccnd_debug_ccnb(h, __LINE__, "prefix_expiry", face,
-                                prefix->buf,
-                                prefix->length);
-                        ccn_charbuf_destroy(&prefix);
-                    }
-                }
-                *p = next;
-                free(f);
-                f = NULL;
+    for (ticks = ev->evint > 0 ? ev->evint : 1; ticks > 0; ticks--) {
+        h->fib_tick += 1;
+        for (f = h->fib_wheel[h->fib_tick % CCND_FIB_WHEEL]; f != NULL; f = next) {
+            next = f->wnext;
+            face = face_from_faceid(h, f->faceid);
+            if (face != NULL && (int)(f->etick - h->fib_tick) > 0)
                 continue;
-            }
-            f->expires -= CCN_FWU_SECS;
-            if (f->expires <= 0)
-                f->flags &= ~CCN_FORW_REFRESHED;
-            p = &(f->next);
+            if (face != NULL && (h->debug & 2) != 0)
+                ccnd_msg(h, "prefix_expiry face %u flags 0x%x",
+                         f->faceid, f->flags & CCN_FORW_PUBMASK);
+            npe = f->npe;
+            for (p = &npe->forwarding; *p != f; p = &(*p)->next)
+                continue;
+            *p = f->next;
+            forwarding_free(h, f);
+            update_forward_to_subtree(h, npe);
         }
-        hashtb_next(e);
     }
-    hashtb_end(e);
-    h->forward_to_gen += 1;
-    return(CCN_FWU_SECS*1000000);
+    ev->evint = h->quiet ? CCND_IDLE_STRETCH : 1;
+    return(ccnd_idle_period(h, CCN_FWU_SECS*1000000));
+}
+
+/**
+ * Set the remaining lifetime of a forwarding entry, in seconds.
+ *
+ * The entry goes away at the first age_forwarding run after that.
+ */
+static void
+forwarding_set_expires(struct ccnd_handle *h, struct ccn_forwarding *f,
+                       int expires)
+{
+    unsigned ticks = 1;
+    
+    if (expires > 0)
+        ticks += (expires - 1) / CCN_FWU_SECS + 1;
+    f->etick = h->fib_tick + ticks;
+    fib_wheel_insert(h, f);
+}
+
+/**
+ * Report the remaining lifetime of a forwarding entry, in seconds.
+ */
+int
+ccnd_forwarding_expires(struct ccnd_handle *h, struct ccn_forwarding *f)
+{
+    int ticks = f->etick - h->fib_tick;
+    
+    if (ticks > 0x7FFFFFFF / CCN_FWU_SECS)
+        return(0x7FFFFFFF);
+    return(ticks * CCN_FWU_SECS);
 }
 
 /**
@@ -2353,11 +5138,12 @@ seek_forwarding(struct ccnd_handle *h,
     for (f = npe->forwarding; f != NULL; f = f->next)
         if (f->faceid == faceid)
             return(f);
-    f = calloc(1, sizeof(*f));
+    f = ccn_memacct_calloc(&h->mem[CCND_MEM_FIB], 1, sizeof(*f));
     if (f != NULL) {
         f->faceid = faceid;
         f->flags = (CCN_FORW_CHILD_INHERIT | CCN_FORW_ACTIVE);
-        f->expires = 0x7FFFFFFF;
+        f->npe = npe;
+        forwarding_set_expires(h, f, 0x7FFFFFFF);
         f->next = npe->forwarding;
         npe->forwarding = f;
     }
@@ -2391,6 +5177,7 @@ ccnd_reg_prefix(struct ccnd_handle *h,
     struct ccn_forwarding *f = NULL;
     struct nameprefix_entry *npe = NULL;
     int res;
+    unsigned oldflags;
     struct face *face = NULL;
     
     if (flags >= 0 &&
@@ -2407,20 +5194,26 @@ ccnd_reg_prefix(struct ccnd_handle *h,
     if (res >= 0) {
         res = (res == HT_OLD_ENTRY) ? CCN_FORW_REFRESHED : 0;
         npe = e->data;
+        for (f = npe->forwarding; f != NULL; f = f->next)
+            if (f->faceid == faceid)
+                break;
+        oldflags = (f == NULL) ? ~0U : (f->flags & CCN_FORW_PUBMASK);
         f = seek_forwarding(h, npe, faceid);
         if (f != NULL) {
-            h->forward_to_gen += 1; // XXX - too conservative, should check changes
-            f->expires = expires;
+            forwarding_set_expires(h, f, expires);
             if (flags < 0)
                 flags = f->flags & CCN_FORW_PUBMASK;
             f->flags = (CCN_FORW_REFRESHED | flags);
             res |= flags;
+            /* A refresh with the same flags changes nothing downstream */
+            if (oldflags != flags)
+                update_forward_to_subtree(h, npe);
             if (h->debug & (2 | 4)) {
                 struct ccn_charbuf *prefix = ccn_charbuf_create();
                 struct ccn_charbuf *debugtag = ccn_charbuf_create();
                 ccn_charbuf_putf(debugtag, "prefix,ff=%s%x",
                                  flags > 9 ? "0x" : "", flags);
-                if (f->expires < (1 << 30))
+                if (expires < (1 << 30))
                     ccn_charbuf_putf(debugtag, ",sec=%d", expires);
                 ccn_name_init(prefix);
                 ccn_name_append_components(prefix, msg,
@@ -2503,6 +5296,9 @@ register_new_face(struct ccnd_handle *h, struct face *face)
 {
     if (face->faceid != 0 && (face->flags & (CCN_FACE_UNDECIDED | CCN_FACE_PASSIVE)) == 0) {
         ccnd_face_status_change(h, face->faceid);
+        if (h->trace_on)
+            ccnd_trace_event(h, CCND_TR_FACE_UP, face->faceid,
+                             NULL, 0, 0, 0, 0, face->flags);
         if (h->flood && h->autoreg != NULL && (face->flags & CCN_FACE_GG) == 0)
             ccnd_reg_uri_list(h, h->autoreg, face->faceid,
                               CCN_FORW_CAPTURE_OK | CCN_FORW_CHILD_INHERIT | CCN_FORW_ACTIVE,
@@ -2564,6 +5360,87 @@ check_forwarding_entry_ccndid(struct ccnd_handle *h,
     return(check_ccndid(h, f->ccnd_id, f->ccnd_id_size, reply_body));
 }
 
+/**
+ * Make the face described by a FaceInstance with an address and port,
+ * or find it if it already exists.  The face is made permanent, and
+ * given any shaping the FaceInstance asks for.
+ *
+ * @param nack is set to the status code when no face results.
+ * @returns the face, or NULL.
+ */
+static struct face *
+face_from_instance(struct ccnd_handle *h,
+                   struct ccn_face_instance *face_instance,
+                   int *nack)
+{
+    struct addrinfo hints = {0};
+    struct addrinfo *addrinfo = NULL;
+    int mcast;
+    int res;
+    struct face *face = NULL;
+    struct face *newface = NULL;
+    
+    hints.ai_flags |= AI_NUMERICHOST;
+    hints.ai_protocol = face_instance->descr.ipproto;
+    hints.ai_socktype = (hints.ai_protocol == IPPROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+    res = getaddrinfo(face_instance->descr.address,
+                      face_instance->descr.port,
+                      &hints,
+                      &addrinfo);
+    if (res != 0 || (h->debug & 128) != 0)
+        ccnd_msg(h, "face_from_instance: getaddrinfo(%s, %s, ...) returned %d",
+                 face_instance->descr.address,
+                 face_instance->descr.port,
+                 res);
+    if (res != 0 || addrinfo == NULL) {
+        *nack = 501;
+        goto Finish;
+    }
+    if (addrinfo->ai_next != NULL)
+        ccnd_msg(h, "face_from_instance: (addrinfo->ai_next != NULL) ? ?");
+    if (face_instance->descr.ipproto == IPPROTO_UDP) {
+        mcast = 0;
+        if (addrinfo->ai_family == AF_INET) {
+            face = face_from_faceid(h, h->ipv4_faceid);
+            mcast = IN_MULTICAST(ntohl(((struct sockaddr_in *)(addrinfo->ai_addr))->sin_addr.s_addr));
+        }
+        else if (addrinfo->ai_family == AF_INET6) {
+            face = face_from_faceid(h, h->ipv6_faceid);
+            mcast = IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)addrinfo->ai_addr)->sin6_addr);
+        }
+        if (mcast)
+            face = setup_multicast(h, face_instance,
+                                   addrinfo->ai_addr,
+                                   addrinfo->ai_addrlen);
+        if (face == NULL) {
+            *nack = 453;
+            goto Finish;
+        }
+        newface = get_dgram_source(h, face,
+                                   addrinfo->ai_addr,
+                                   addrinfo->ai_addrlen,
+                                   0);
+    }
+    else if (addrinfo->ai_socktype == SOCK_STREAM) {
+        newface = make_connection(h,
+                                  addrinfo->ai_addr,
+                                  addrinfo->ai_addrlen,
+                                  0);
+    }
+    if (newface != NULL) {
+        newface->flags |= CCN_FACE_PERMANENT;
+        if (face_instance->rate >= 0)
+            ccnd_face_set_shaping(h, newface, face_instance->rate,
+                                  face_instance->burst);
+    }
+    else
+        *nack = 450;
+Finish:
+    if (addrinfo != NULL)
+        freeaddrinfo(addrinfo);
+    return(newface);
+}
+
 /**
  * Process a newface request for the ccnd internal client.
  *
@@ -2590,14 +5467,11 @@ ccnd_req_newface(struct ccnd_handle *h,
     const unsigned char *req;
     size_t req_size;
     struct ccn_face_instance *face_instance = NULL;
-    struct addrinfo hints = {0};
-    struct addrinfo *addrinfo = NULL;
-    int mcast;
-    struct face *face = NULL;
     struct face *reqface = NULL;
     struct face *newface = NULL;
     int save;
     int nackallowed = 0;
+    int nack = 0;
 
     save = h->flood;
     h->flood = 0; /* never auto-register for these */
@@ -2639,56 +5513,13 @@ ccnd_req_newface(struct ccnd_handle *h,
         res = ccnd_nack(h, reply_body, 430, "not authorized");
         goto Finish;
     }
-    hints.ai_flags |= AI_NUMERICHOST;
-    hints.ai_protocol = face_instance->descr.ipproto;
-    hints.ai_socktype = (hints.ai_protocol == IPPROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
-    res = getaddrinfo(face_instance->descr.address,
-                      face_instance->descr.port,
-                      &hints,
-                      &addrinfo);
-    if (res != 0 || (h->debug & 128) != 0)
-        ccnd_msg(h, "ccnd_req_newface from %u: getaddrinfo(%s, %s, ...) returned %d",
-                 h->interest_faceid,
-                 face_instance->descr.address,
-                 face_instance->descr.port,
-                 res);
-    if (res != 0 || addrinfo == NULL) {
-        res = ccnd_nack(h, reply_body, 501, "syntax error in address");
-        goto Finish;
-    }
-    if (addrinfo->ai_next != NULL)
-        ccnd_msg(h, "ccnd_req_newface: (addrinfo->ai_next != NULL) ? ?");
-    if (face_instance->descr.ipproto == IPPROTO_UDP) {
-        mcast = 0;
-        if (addrinfo->ai_family == AF_INET) {
-            face = face_from_faceid(h, h->ipv4_faceid);
-            mcast = IN_MULTICAST(ntohl(((struct sockaddr_in *)(addrinfo->ai_addr))->sin_addr.s_addr));
-        }
-        else if (addrinfo->ai_family == AF_INET6) {
-            face = face_from_faceid(h, h->ipv6_faceid);
-            mcast = IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)addrinfo->ai_addr)->sin6_addr);
-        }
-        if (mcast)
-            face = setup_multicast(h, face_instance,
-                                   addrinfo->ai_addr,
-                                   addrinfo->ai_addrlen);
-        if (face == NULL) {
-            res = ccnd_nack(h, reply_body, 453, "could not setup multicast");
-            goto Finish;
-        }
-        newface = get_dgram_source(h, face,
-                                   addrinfo->ai_addr,
-                                   addrinfo->ai_addrlen,
-                                   0);
-    }
-    else if (addrinfo->ai_socktype == SOCK_STREAM) {
-        newface = make_connection(h,
-                                  addrinfo->ai_addr,
-                                  addrinfo->ai_addrlen,
-                                  0);
-    }
+    newface = face_from_instance(h, face_instance, &nack);
     if (newface != NULL) {
-        newface->flags |= CCN_FACE_PERMANENT;
+        face_instance->rate = face_instance->burst = -1;
+        if (newface->shaper.rate != 0) {
+            face_instance->rate = newface->shaper.rate;
+            face_instance->burst = newface->shaper.burst;
+        }
         face_instance->action = NULL;
         face_instance->ccnd_id = h->ccnd_id;
         face_instance->ccnd_id_size = sizeof(h->ccnd_id);
@@ -2704,13 +5535,15 @@ ccnd_req_newface(struct ccnd_handle *h,
         if (res > 0)
             res = 0;
     }
+    else if (nack == 501)
+        res = ccnd_nack(h, reply_body, 501, "syntax error in address");
+    else if (nack == 453)
+        res = ccnd_nack(h, reply_body, 453, "could not setup multicast");
     else
         res = ccnd_nack(h, reply_body, 450, "could not create face");
 Finish:
     h->flood = save; /* restore saved flood flag */
     ccn_face_instance_destroy(&face_instance);
-    if (addrinfo != NULL)
-        freeaddrinfo(addrinfo);
     return((nackallowed || res <= 0) ? res : -1);
 }
 
@@ -2782,6 +5615,142 @@ Finish:
     return((nackallowed || res <= 0) ? res : -1);
 }
 
+/**
+ * Apply the StoreQuota of a registration, if it has one.
+ *
+ * The quota stays in force after the registration goes; a StoreQuota
+ * of 0 lifts it.
+ */
+static void
+store_quota_set(struct ccnd_handle *h, struct ccn_forwarding_entry *fe)
+{
+    int res;
+    
+    if (fe->store_quota < 0)
+        return;
+    res = ccnd_quota_set(h->quota, fe->name_prefix->buf,
+                         fe->name_prefix->length, fe->store_quota);
+    if (res < 0)
+        ccnd_msg(h, "could not set store quota of %jd", fe->store_quota);
+    else if (h->debug & 2)
+        ccnd_debug_ccnb(h, __LINE__, "store_quota", NULL,
+                        fe->name_prefix->buf, fe->name_prefix->length);
+}
+
+/**
+ * Apply the TrafficClass of a registration, if it has one.
+ *
+ * The class is kept with the name prefix entry, which the registration
+ * holds in place; comps are the components of fe->name_prefix.
+ */
+static void
+traffic_class_set(struct ccnd_handle *h, struct ccn_forwarding_entry *fe,
+                  struct ccn_indexbuf *comps)
+{
+    struct nameprefix_entry *npe;
+    
+    if (fe->traffic_class < 0 || comps->n < 1)
+        return;
+    npe = hashtb_lookup(h->nameprefix_tab,
+                        fe->name_prefix->buf + comps->buf[0],
+                        comps->buf[comps->n - 1] - comps->buf[0]);
+    if (npe == NULL)
+        return;
+    npe->tclass = fe->traffic_class + 1;
+    if (h->debug & 2)
+        ccnd_debug_ccnb(h, __LINE__, "traffic_class", NULL,
+                        fe->name_prefix->buf, fe->name_prefix->length);
+}
+
+/**
+ * Find a free freshness rule slot, making the table if need be.
+ * @returns the rule number, or 0 if there is none to be had.
+ */
+static int
+fresh_rule_alloc(struct ccnd_handle *h)
+{
+    struct ccnd_fresh_rule *r;
+    int i;
+    
+    if (h->fresh_rule == NULL) {
+        h->fresh_rule = calloc(CCND_FRESH_RULES_MAX, sizeof(h->fresh_rule[0]));
+        if (h->fresh_rule == NULL)
+            return(0);
+        h->fresh_rules = 1;
+    }
+    for (i = 1; i < h->fresh_rules; i++)
+        if (h->fresh_rule[i].npe == NULL && h->fresh_rule[i].objects == 0)
+            break;
+    if (i == CCND_FRESH_RULES_MAX)
+        return(0);
+    r = &h->fresh_rule[i];
+    if (r->name == NULL)
+        r->name = ccn_charbuf_create();
+    if (r->name == NULL)
+        return(0);
+    if (i == h->fresh_rules)
+        h->fresh_rules++;
+    r->name->length = 0;
+    r->freshness = 0;
+    r->residency = 0;
+    r->staled = 0;
+    r->removed = 0;
+    return(i);
+}
+
+/**
+ * Apply the DefaultFreshness and MaxResidency of a registration, if it
+ * has either.
+ *
+ * Like the traffic class, the rule is kept with the name prefix entry;
+ * comps are the components of fe->name_prefix.  A value of 0 lifts
+ * that part of the rule, and the rule goes once both are lifted.
+ */
+static void
+fresh_rule_set(struct ccnd_handle *h, struct ccn_forwarding_entry *fe,
+               struct ccn_indexbuf *comps)
+{
+    struct nameprefix_entry *npe;
+    struct ccnd_fresh_rule *r;
+    int i;
+    
+    if ((fe->default_freshness < 0 && fe->max_residency < 0) || comps->n < 1)
+        return;
+    npe = hashtb_lookup(h->nameprefix_tab,
+                        fe->name_prefix->buf + comps->buf[0],
+                        comps->buf[comps->n - 1] - comps->buf[0]);
+    if (npe == NULL)
+        return;
+    if (npe->fresh_rule == 0) {
+        if (fe->default_freshness <= 0 && fe->max_residency <= 0)
+            return;
+        i = fresh_rule_alloc(h);
+        if (i == 0) {
+            ccnd_msg(h, "could not set freshness rule");
+            return;
+        }
+        r = &h->fresh_rule[i];
+        ccn_charbuf_append(r->name, fe->name_prefix->buf,
+                           fe->name_prefix->length);
+        r->npe = npe;
+        npe->fresh_rule = i;
+        h->fresh_rules_active++;
+    }
+    r = &h->fresh_rule[npe->fresh_rule];
+    if (fe->default_freshness >= 0)
+        r->freshness = fe->default_freshness;
+    if (fe->max_residency >= 0)
+        r->residency = fe->max_residency;
+    /* Residency is timed by a wheel like freshness, with the same limit */
+    if (r->residency > (int)((1U<<31) / 1000000))
+        r->residency = (1U<<31) / 1000000;
+    if (r->freshness == 0 && r->residency == 0)
+        fresh_rule_lift(h, npe);
+    if (h->debug & 2)
+        ccnd_debug_ccnb(h, __LINE__, "fresh_rule", NULL,
+                        fe->name_prefix->buf, fe->name_prefix->length);
+}
+
 /**
  * Worker bee for two very similar public functions.
  */
@@ -2858,6 +5827,9 @@ ccnd_req_prefix_or_self_reg(struct ccnd_handle *h,
     if (res < 0)
         goto Finish;
     forwarding_entry->flags = res;
+    store_quota_set(h, forwarding_entry);
+    traffic_class_set(h, forwarding_entry, comps);
+    fresh_rule_set(h, forwarding_entry, comps);
     forwarding_entry->action = NULL;
     forwarding_entry->ccnd_id = h->ccnd_id;
     forwarding_entry->ccnd_id_size = sizeof(h->ccnd_id);
@@ -2912,6 +5884,38 @@ ccnd_req_selfreg(struct ccnd_handle *h,
     return(ccnd_req_prefix_or_self_reg(h, msg, size, 1, reply_body));
 }
 
+/**
+ * Find the forwarding entry for faceid under a name prefix.
+ * @param npep, if not NULL, is set to the name prefix entry.
+ * @returns the link that points to it, or NULL if there is none.
+ */
+static struct ccn_forwarding **
+seek_forwarding_link(struct ccnd_handle *h,
+                     struct ccn_charbuf *name_prefix, unsigned faceid,
+                     struct nameprefix_entry **npep)
+{
+    struct ccn_indexbuf *comps = NULL;
+    struct nameprefix_entry *npe = NULL;
+    struct ccn_forwarding **p = NULL;
+    int n;
+    
+    comps = indexbuf_obtain(h);
+    n = ccn_name_split(name_prefix, comps);
+    if (n >= 0 && n + 1 <= comps->n)
+        npe = hashtb_lookup(h->nameprefix_tab,
+                            name_prefix->buf + comps->buf[0],
+                            comps->buf[n] - comps->buf[0]);
+    indexbuf_release(h, comps);
+    if (npe == NULL)
+        return(NULL);
+    if (npep != NULL)
+        *npep = npe;
+    for (p = &npe->forwarding; *p != NULL; p = &(*p)->next)
+        if ((*p)->faceid == faceid)
+            return(p);
+    return(NULL);
+}
+
 /**
  * @brief Process an unreg request for the ccnd internal client.
  * @param h is the ccnd handle
@@ -2930,17 +5934,12 @@ ccnd_req_unreg(struct ccnd_handle *h,
                struct ccn_charbuf *reply_body)
 {
     struct ccn_parsed_ContentObject pco = {0};
-    int n_name_comp = 0;
     int res;
     const unsigned char *req;
     size_t req_size;
-    size_t start;
-    size_t stop;
-    int found;
     struct ccn_forwarding_entry *forwarding_entry = NULL;
     struct face *face = NULL;
     struct face *reqface = NULL;
-    struct ccn_indexbuf *comps = NULL;
     struct ccn_forwarding **p = NULL;
     struct ccn_forwarding *f = NULL;
     struct nameprefix_entry *npe = NULL;
@@ -2974,38 +5973,18 @@ ccnd_req_unreg(struct ccnd_handle *h,
     face = face_from_faceid(h, forwarding_entry->faceid);
     if (face == NULL)
         goto Finish;
-    comps = ccn_indexbuf_create();
-    n_name_comp = ccn_name_split(forwarding_entry->name_prefix, comps);
-    if (n_name_comp < 0)
-        goto Finish;
-    if (n_name_comp + 1 > comps->n)
-        goto Finish;
-    start = comps->buf[0];
-    stop = comps->buf[n_name_comp];
-    npe = hashtb_lookup(h->nameprefix_tab,
-                        forwarding_entry->name_prefix->buf + start,
-                        stop - start);
-    if (npe == NULL)
+    p = seek_forwarding_link(h, forwarding_entry->name_prefix, face->faceid,
+                             &npe);
+    if (p == NULL)
         goto Finish;
-    found = 0;
-    p = &npe->forwarding;
-    for (f = npe->forwarding; f != NULL; f = f->next) {
-        if (f->faceid == forwarding_entry->faceid) {
-            found = 1;
-            if (h->debug & (2 | 4))
-                ccnd_debug_ccnb(h, __LINE__, "prefix_unreg", face,
-                                forwarding_entry->name_prefix->buf,
-                                forwarding_entry->name_prefix->length);
-            *p = f->next;
-            free(f);
-            f = NULL;
-            h->forward_to_gen += 1;
-            break;
-        }
-        p = &(f->next);
-    }
-    if (!found)
-        goto Finish;    
+    if (h->debug & (2 | 4))
+        ccnd_debug_ccnb(h, __LINE__, "prefix_unreg", face,
+                        forwarding_entry->name_prefix->buf,
+                        forwarding_entry->name_prefix->length);
+    f = *p;
+    *p = f->next;
+    forwarding_free(h, f);
+    update_forward_to_subtree(h, npe);
     forwarding_entry->action = NULL;
     forwarding_entry->ccnd_id = h->ccnd_id;
     forwarding_entry->ccnd_id_size = sizeof(h->ccnd_id);
@@ -3014,23 +5993,194 @@ ccnd_req_unreg(struct ccnd_handle *h,
         res = 0;
 Finish:
     ccn_forwarding_entry_destroy(&forwarding_entry);
-    ccn_indexbuf_destroy(&comps);
     if (nackallowed && res < 0)
         res = ccnd_nack(h, reply_body, 450, "could not unregister prefix");
     return((nackallowed || res <= 0) ? res : -1);
 }
 
+/**
+ * Check one entry of a prefixregs request.
+ * @returns 0 if it may be applied, -1 if not.
+ */
+static int
+check_batch_entry(struct ccnd_handle *h, struct face *reqface,
+                  struct ccn_forwarding_entry *fe)
+{
+    if (fe == NULL || fe->action == NULL || fe->name_prefix == NULL)
+        return(-1);
+    if (fe->ccnd_id_size != 0 &&
+        (fe->ccnd_id_size != sizeof(h->ccnd_id) ||
+         memcmp(fe->ccnd_id, h->ccnd_id, sizeof(h->ccnd_id)) != 0))
+        return(-1);
+    if (face_from_faceid(h, fe->faceid) == NULL)
+        return(-1);
+    if (strcmp(fe->action, "prefixreg") == 0) {
+        if (fe->flags >= 0 && (fe->flags & CCN_FORW_PUBMASK) != fe->flags)
+            return(-1);
+        return(0);
+    }
+    if (strcmp(fe->action, "unreg") == 0) {
+        if ((reqface->flags & CCN_FACE_GG) == 0)
+            return(-1);
+        if (seek_forwarding_link(h, fe->name_prefix, fe->faceid, NULL) == NULL)
+            return(-1);
+        return(0);
+    }
+    return(-1);
+}
+
+/**
+ * @brief Process a prefixregs request for the ccnd internal client.
+ *
+ * This is a batch of prefixreg and unreg requests under one signature.
+ * The Content is a sequence of ForwardingEntry elements.  Every entry
+ * is checked before any is applied, so that a batch with a bad entry
+ * changes nothing.  Applying the batch invalidates the cached forwarding
+ * lists once, rather than once per entry as separate requests would.
+ *
+ * @param h is the ccnd handle
+ * @param msg points to a ccnd-encoded ContentObject containing a
+ *          sequence of ForwardingEntry elements in its Content.
+ * @param size is its size in bytes
+ * @param reply_body is a buffer to hold the Content of the reply, as a
+ *         ccnb-encoded ForwardingEntry for each entry of the request
+ * @returns 0 for success, negative for no response, or CCN_CONTENT_NACK to
+ *         set the response type to NACK.
+ */
+int
+ccnd_req_prefixregs(struct ccnd_handle *h,
+                    const unsigned char *msg, size_t size,
+                    struct ccn_charbuf *reply_body)
+{
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = NULL;
+    struct ccn_indexbuf *bounds = NULL;
+    struct ccn_indexbuf *comps = NULL;
+    struct ccn_forwarding_entry **fe = NULL;
+    struct ccn_forwarding **p = NULL;
+    struct ccn_forwarding *f = NULL;
+    struct nameprefix_entry *npe = NULL;
+    struct face *reqface = NULL;
+    const unsigned char *req;
+    size_t req_size;
+    int nackallowed = 0;
+    int n = 0;
+    int i;
+    int res;
+    
+    res = ccn_parse_ContentObject(msg, size, &pco, NULL);
+    if (res < 0)
+        goto Finish;
+    res = ccn_content_get_value(msg, size, &pco, &req, &req_size);
+    if (res < 0)
+        goto Finish;
+    res = -1;
+    /* consider the source ... */
+    reqface = face_from_faceid(h, h->interest_faceid);
+    if (reqface == NULL)
+        goto Finish;
+    if ((reqface->flags & (CCN_FACE_GG | CCN_FACE_REGOK)) == 0)
+        goto Finish;
+    nackallowed = 1;
+    bounds = ccn_indexbuf_create();
+    if (bounds == NULL)
+        goto Finish;
+    d = ccn_buf_decoder_start(&decoder, req, req_size);
+    while (ccn_buf_match_dtag(d, CCN_DTAG_ForwardingEntry)) {
+        ccn_indexbuf_append_element(bounds, d->decoder.token_index);
+        if (ccn_buf_advance_past_element(d) < 0)
+            goto Finish;
+    }
+    if (d->decoder.index != req_size || bounds->n == 0)
+        goto Finish;
+    n = bounds->n;
+    ccn_indexbuf_append_element(bounds, req_size);
+    fe = calloc(n, sizeof(*fe));
+    if (fe == NULL)
+        goto Finish;
+    for (i = 0; i < n; i++) {
+        fe[i] = ccn_forwarding_entry_parse(req + bounds->buf[i],
+                                           bounds->buf[i + 1] - bounds->buf[i]);
+        if (check_batch_entry(h, reqface, fe[i]) < 0) {
+            if (h->debug & (2 | 4))
+                ccnd_msg(h, "prefixregs entry %d of %d refused", i, n);
+            goto Finish;
+        }
+    }
+    comps = ccn_indexbuf_create();
+    for (i = 0; i < n; i++) {
+        if (fe[i]->action[0] == 'u') {
+            p = seek_forwarding_link(h, fe[i]->name_prefix, fe[i]->faceid,
+                                     &npe);
+            if (p != NULL) {
+                /* not there if the batch removed it already */
+                f = *p;
+                *p = f->next;
+                forwarding_free(h, f);
+                update_forward_to_subtree(h, npe);
+            }
+            continue;
+        }
+        if (fe[i]->lifetime < 0)
+            fe[i]->lifetime = 2000000000;
+        else if (fe[i]->lifetime > 3600 && fe[i]->lifetime < (1 << 30))
+            fe[i]->lifetime = 300;
+        res = ccn_name_split(fe[i]->name_prefix, comps);
+        if (res >= 0)
+            res = ccnd_reg_prefix(h, fe[i]->name_prefix->buf, comps, res,
+                                  fe[i]->faceid, fe[i]->flags,
+                                  fe[i]->lifetime);
+        if (res < 0) {
+            /* Out of memory; what was done so far stays done */
+            ccnd_msg(h, "prefixregs applied %d of %d entries", i, n);
+            goto Finish;
+        }
+        fe[i]->flags = res;
+        store_quota_set(h, fe[i]);
+        traffic_class_set(h, fe[i], comps);
+        fresh_rule_set(h, fe[i], comps);
+    }
+    if (h->debug & 2)
+        ccnd_msg(h, "prefixregs applied %d entries", n);
+    for (i = 0; i < n; i++) {
+        fe[i]->action = NULL;
+        fe[i]->ccnd_id = h->ccnd_id;
+        fe[i]->ccnd_id_size = sizeof(h->ccnd_id);
+        res = ccnb_append_forwarding_entry(reply_body, fe[i]);
+        if (res < 0)
+            goto Finish;
+    }
+    res = 0;
+Finish:
+    for (i = 0; fe != NULL && i < n; i++)
+        ccn_forwarding_entry_destroy(&fe[i]);
+    free(fe);
+    ccn_indexbuf_destroy(&bounds);
+    ccn_indexbuf_destroy(&comps);
+    if (nackallowed && res < 0) {
+        reply_body->length = 0;
+        res = ccnd_nack(h, reply_body, 450, "could not register prefixes");
+    }
+    return((nackallowed || res <= 0) ? res : -1);
+}
+
 /**
  * Set up forward_to list for a name prefix entry.
  *
- * Recomputes the contents of npe->forward_to and npe->flags
- * from forwarding lists of npe and all of its ancestors.
+ * Recomputes the contents of npe->forward_to, npe->tap, and npe->flags
+ * from forwarding lists of npe and all of its ancestors, which must
+ * themselves be up to date.
+ *
+ * Only an entry with forwarding of its own keeps a forward_to list;
+ * the others are served by the nearest such ancestor.
  */
 static void
 update_forward_to(struct ccnd_handle *h, struct nameprefix_entry *npe)
 {
     struct ccn_indexbuf *x = NULL;
-    struct ccn_indexbuf *tap = NULL;
+    struct ccnd_faceset *seen = &h->fs_scratch;
+    struct ccnd_faceset *tap = NULL;
     struct ccn_forwarding *f = NULL;
     struct nameprefix_entry *p = NULL;
     unsigned tflags;
@@ -3038,12 +6188,29 @@ update_forward_to(struct ccnd_handle *h, struct nameprefix_entry *npe)
     unsigned moreflags;
     unsigned lastfaceid;
     unsigned namespace_flags;
+    int res;
 
+    p = npe->parent;
+    npe->fib = (npe->forwarding != NULL || p == NULL) ? npe : p->fib;
+    if (npe->forwarding == NULL && p != NULL && p->forwarding == NULL) {
+        /* Nothing is registered here or at the parent, so it all carries over */
+        ccn_indexbuf_destroy(&npe->forward_to);
+        npe->flags = p->flags;
+        if (p->tap != NULL) {
+            tap = ccnd_faceset_create();
+            if (tap != NULL && ccnd_faceset_copy(tap, p->tap) < 0)
+                ccnd_faceset_destroy(&tap);
+        }
+        ccnd_faceset_destroy(&npe->tap);
+        npe->tap = tap;
+        return;
+    }
     x = npe->forward_to;
     if (x == NULL)
         npe->forward_to = x = ccn_indexbuf_create();
     else
         x->n = 0;
+    ccnd_faceset_clear(seen);
     wantflags = CCN_FORW_ACTIVE;
     lastfaceid = CCN_NOFACEID;
     namespace_flags = 0;
@@ -3057,11 +6224,16 @@ update_forward_to(struct ccnd_handle *h, struct nameprefix_entry *npe)
             if ((tflags & wantflags) == wantflags) {
                 if (h->debug & 32)
                     ccnd_msg(h, "fwd.%d adding %u", __LINE__, f->faceid);
-                ccn_indexbuf_set_insert(x, f->faceid);
+                res = ccnd_faceset_add(seen, f->faceid);
+                if (res > 0)
+                    ccn_indexbuf_append_element(x, f->faceid);
+                else if (res < 0)
+                    ccn_indexbuf_set_insert(x, f->faceid);
                 if ((f->flags & CCN_FORW_TAP) != 0) {
                     if (tap == NULL)
-                        tap = ccn_indexbuf_create();
-                    ccn_indexbuf_set_insert(tap, f->faceid);
+                        tap = ccnd_faceset_create();
+                    if (tap != NULL)
+                        ccnd_faceset_add(tap, f->faceid);
                 }
                 if ((f->flags & CCN_FORW_LAST) != 0)
                     lastfaceid = f->faceid;
@@ -3075,13 +6247,40 @@ update_forward_to(struct ccnd_handle *h, struct nameprefix_entry *npe)
     if (lastfaceid != CCN_NOFACEID)
         ccn_indexbuf_move_to_end(x, lastfaceid);
     npe->flags = namespace_flags;
-    npe->fgen = h->forward_to_gen;
-    if (x->n == 0)
+    if (x->n == 0 || npe->forwarding == NULL)
         ccn_indexbuf_destroy(&npe->forward_to);
-    ccn_indexbuf_destroy(&npe->tap);
+    ccnd_faceset_destroy(&npe->tap);
     npe->tap = tap;
 }
 
+/**
+ * Bring forwarding state up to date after a change in the FIB.
+ *
+ * A change to the forwarding list of top can only affect top and the
+ * longer prefixes under it, so just those are recomputed, parents
+ * before children.  This keeps the cost of a registration proportional
+ * to the part of the name tree it covers, and means that interest
+ * processing never has to recompute anything.
+ */
+static void
+update_forward_to_subtree(struct ccnd_handle *h, struct nameprefix_entry *top)
+{
+    struct nameprefix_entry *npe = top;
+    
+    h->forward_to_gen += 1;
+    ccnd_status_invalidate(h);
+    while (npe != NULL) {
+        update_forward_to(h, npe);
+        if (npe->child != NULL) {
+            npe = npe->child;
+            continue;
+        }
+        while (npe != top && npe->sibling == NULL)
+            npe = npe->parent;
+        npe = (npe == top) ? NULL : npe->sibling;
+    }
+}
+
 /**
  * This is where we consult the interest forwarding table.
  * @param h is the ccnd handle
@@ -3106,13 +6305,12 @@ get_outbound_faces(struct ccnd_handle *h,
     int n;
     unsigned faceid;
     
-    while (npe->parent != NULL && npe->forwarding == NULL)
-        npe = npe->parent;
-    if (npe->fgen != h->forward_to_gen)
-        update_forward_to(h, npe);
+    npe = npe->fib;
     x = ccn_indexbuf_create();
     if (pi->scope == 0 || npe->forward_to == NULL || npe->forward_to->n == 0)
         return(x);
+    /* Size it once, rather than growing it a face at a time */
+    ccn_indexbuf_reserve(x, npe->forward_to->n);
     if ((npe->flags & CCN_FORW_LOCAL) != 0)
         checkmask = (from != NULL && (from->flags & CCN_FACE_GG) != 0) ? CCN_FACE_GG : (~0);
     else if (pi->scope == 1)
@@ -3146,7 +6344,7 @@ pe_next_usec(struct ccnd_handle *h,
         next_delay = pe->usec;
     pe->usec -= next_delay;
     if (h->debug & 32) {
-        struct ccn_charbuf *c = ccn_charbuf_create();
+        struct ccn_charbuf *c = charbuf_obtain(h);
         ccn_charbuf_putf(c, "%p.%dof%d,usec=%d+%d",
                          (void *)pe,
                          pe->sent,
@@ -3157,11 +6355,33 @@ pe_next_usec(struct ccnd_handle *h,
                             face_from_faceid(h, pe->faceid),
                             pe->interest_msg, pe->size);
         }
-        ccn_charbuf_destroy(&c);
+        charbuf_release(h, c);
     }
     return(next_delay);
 }
 
+/**
+ * How long a retried interest gives a face to answer before it goes on
+ * to the next: half again the face's smoothed response time, or the
+ * prediction for the prefix if the face has not answered yet.
+ */
+static int
+retry_usec(struct ccnd_handle *h, struct propagating_entry *pe,
+           unsigned faceid)
+{
+    struct nameprefix_entry *npe = nameprefix_for_pe(h, pe);
+    struct ccn_forwarding *f = forwarding_for_face(npe, faceid);
+    int usec;
+    
+    if (f != NULL && f->srtt != 0)
+        usec = f->srtt + f->srtt / 2;
+    else
+        usec = npe->usec;
+    if (usec < CCND_RETRY_MIN_USEC)
+        usec = CCND_RETRY_MIN_USEC;
+    return(usec);
+}
+
 static void replan_propagation(struct ccnd_handle *, struct propagating_entry *);
 
 /**
@@ -3193,6 +6413,13 @@ do_propagate(struct ccn_schedule *sched,
             ccnd_debug_ccnb(h, __LINE__, "interest_expiry",
                             face_from_faceid(h, pe->faceid),
                             pe->interest_msg, pe->size);
+        note_interest_outcome(h, pe, CCN_NOFACEID);
+        if (h->trace_on)
+            trace_pe(h, CCND_TR_PIT_EXPIRE, pe, pe->faceid,
+                     ccnd_usec_now(h) - pe->atime);
+        if (pe->outbound != NULL && pe->sent > 0 &&
+            pe->sent >= pe->outbound->n)
+            negcache_note(h, pe->interest_msg, pe->size);
         consume(h, pe);
         reap_needed(h, 0);
         return(0);        
@@ -3209,12 +6436,15 @@ do_propagate(struct ccn_schedule *sched,
             if (h->debug & 2)
                 ccnd_debug_ccnb(h, __LINE__, "interest_to", face,
                                 pe->interest_msg, pe->size);
+            note_interest_sent(h, pe, faceid);
+            if (h->trace_on)
+                trace_pe(h, CCND_TR_INTEREST_OUT, pe, faceid, pe->faceid);
             pe->sent++;
             h->interests_sent += 1;
             h->interest_faceid = pe->faceid;
             next_delay = nrand48(h->seed) % 8192 + 500;
             if (((pe->flags & CCN_PR_TAP) != 0) &&
-                  ccn_indexbuf_member(nameprefix_for_pe(h, pe)->tap, pe->faceid)) {
+                  ccnd_faceset_member(nameprefix_for_pe(h, pe)->tap, faceid)) {
                 next_delay = special_delay = 1;
             }
             else if ((pe->flags & CCN_PR_UNSENT) != 0) {
@@ -3222,7 +6452,11 @@ do_propagate(struct ccn_schedule *sched,
                 pe->flags |= CCN_PR_WAIT1;
                 next_delay = special_delay = ev->evint;
             }
-            stuff_and_send(h, face, pe->interest_msg, pe->size, NULL, 0);
+            else if ((pe->flags & CCN_PR_RETRY) != 0)
+                next_delay = retry_usec(h, pe, faceid);
+            h->send_urgent = ((pe->flags & CCN_PR_URGENT) != 0);
+            stuff_and_send(h, face, pe->interest_msg, pe->size, NULL, 0, NULL);
+            h->send_urgent = 0;
             ccnd_meter_bump(h, face->meter[FM_INTO], 1);
         }
         else
@@ -3250,6 +6484,102 @@ do_propagate(struct ccn_schedule *sched,
     return(next_delay);
 }
 
+/**
+ * Test whether a pending interest matches a new one in everything
+ * but the Nonce.
+ */
+static int
+similar_interest(struct propagating_entry *p, const unsigned char *msg,
+                 struct ccn_parsed_interest *pi)
+{
+    size_t presize = pi->offset[CCN_PI_B_Nonce];
+    size_t postsize = pi->offset[CCN_PI_E] - pi->offset[CCN_PI_E_Nonce];
+    const unsigned char *post = msg + pi->offset[CCN_PI_E_Nonce];
+    
+    return(p->size > presize + postsize &&
+           p->interest_msg != NULL &&
+           p->usec > 0 &&
+           0 == memcmp(msg, p->interest_msg, presize) &&
+           0 == memcmp(post, p->interest_msg + p->size - postsize, postsize));
+}
+
+/**
+ * Take a consumer's retransmission of a pending interest as a sign
+ * that the interest or its answer was lost upstream.
+ *
+ * The newest similar interest from the same face stops propagating,
+ * and the retransmission takes over as a retry: outbound is reordered
+ * to put the faces that have not been tried first, then those that
+ * have, with the one tried last at the end, each group cheapest first.
+ * The retry goes to the first at once, and on down the list a little
+ * over one response time at a time (see retry_usec).
+ *
+ * @returns 1 if outbound is now planned as a retry, 0 if this is not
+ *          a retransmission, or -1 if there have been too many.
+ */
+static int
+plan_retry(struct ccnd_handle *h, struct face *face, unsigned char *msg,
+           struct ccn_parsed_interest *pi, struct nameprefix_entry *npe,
+           struct ccn_indexbuf *outbound, int max_redundant)
+{
+    struct propagating_entry *head = &npe->pe_head;
+    struct propagating_entry *p;
+    struct propagating_entry *rp = NULL;
+    uint64_t best_cost = 0;
+    uint64_t cost;
+    unsigned faceid;
+    int best_rank = 0;
+    int rank;
+    int k = 0;
+    int i;
+    int j;
+    int x;
+    
+    for (p = head->prev; p != head; p = p->prev) {
+        if (p->faceid != face->faceid || !similar_interest(p, msg, pi))
+            continue;
+        if (rp == NULL)
+            rp = p;
+        if ((++k) >= max_redundant)
+            return(-1);
+    }
+    if (rp == NULL)
+        return(0);
+    /* A selection sort by rank, then cost; there are only a few faces */
+    for (i = 0; i + 1 < outbound->n; i++) {
+        k = i;
+        for (j = i; j < outbound->n; j++) {
+            faceid = outbound->buf[j];
+            rank = 0;
+            if (faceid == rp->sface)
+                rank = 2;
+            else if (rp->outbound != NULL) {
+                x = ccn_indexbuf_member(rp->outbound, faceid);
+                if (x >= 0 && x < rp->sent)
+                    rank = 1;
+            }
+            cost = face_forwarding_cost(npe, faceid);
+            if (j == i || rank < best_rank ||
+                  (rank == best_rank && cost < best_cost)) {
+                k = j;
+                best_rank = rank;
+                best_cost = cost;
+            }
+        }
+        faceid = outbound->buf[k];
+        outbound->buf[k] = outbound->buf[i];
+        outbound->buf[i] = faceid;
+    }
+    if (rp->outbound != NULL && rp->outbound->n > rp->sent)
+        rp->outbound->n = rp->sent;
+    rp->flags |= CCN_PR_EQV; /* Don't add new faces */
+    h->interests_retried += 1;
+    if (h->debug & 32)
+        ccnd_debug_ccnb(h, __LINE__, "retry_of", face,
+                        rp->interest_msg, rp->size);
+    return(1);
+}
+
 /**
  * Adjust the outbound face list for a new Interest, based upon
  * existing similar interests.
@@ -3264,14 +6594,11 @@ adjust_outbound_for_existing_interests(struct ccnd_handle *h, struct face *face,
                                        unsigned char *msg,
                                        struct ccn_parsed_interest *pi,
                                        struct nameprefix_entry *npe,
-                                       struct ccn_indexbuf *outbound)
+                                       struct ccn_indexbuf *outbound,
+                                       int *retry)
 {
     struct propagating_entry *head = &npe->pe_head;
     struct propagating_entry *p;
-    size_t presize = pi->offset[CCN_PI_B_Nonce];
-    size_t postsize = pi->offset[CCN_PI_E] - pi->offset[CCN_PI_E_Nonce];
-    size_t minsize = presize + postsize;
-    unsigned char *post = msg + pi->offset[CCN_PI_E_Nonce];
     int k = 0;
     int max_redundant = 3; /* Allow this many dups from same face */
     int i;
@@ -3279,15 +6606,22 @@ adjust_outbound_for_existing_interests(struct ccnd_handle *h, struct face *face,
     struct face *otherface;
     int extra_delay = 0;
 
+    *retry = 0;
     if ((face->flags & (CCN_FACE_MCAST | CCN_FACE_LINK)) != 0)
         max_redundant = 0;
+    if (outbound != NULL && max_redundant > 0) {
+        *retry = plan_retry(h, face, msg, pi, npe, outbound, max_redundant);
+        if (*retry < 0) {
+            *retry = 0;
+            outbound->n = 0;
+            return(-1);
+        }
+        if (*retry > 0)
+            return(0);
+    }
     if (outbound != NULL) {
         for (p = head->prev; p != head && outbound->n > 0; p = p->prev) {
-            if (p->size > minsize &&
-                p->interest_msg != NULL &&
-                p->usec > 0 &&
-                0 == memcmp(msg, p->interest_msg, presize) &&
-                0 == memcmp(post, p->interest_msg + p->size - postsize, postsize)) {
+            if (similar_interest(p, msg, pi)) {
                 /* Matches everything but the Nonce */
                 otherface = face_from_faceid(h, p->faceid);
                 if (otherface == NULL)
@@ -3412,89 +6746,410 @@ ccnd_append_plain_nonce(struct ccnd_handle *h, struct face *face, struct ccn_cha
         ccn_charbuf_append_closer(cb);
 }
 
+#define CCND_NACK_RATE 100 /**< drops signaled per second, at most */
+
 /**
- * Schedules the propagation of an Interest message.
+ * Take a token from a bucket that refills at rate per second.
+ *
+ * A bucket that has never been used starts out full.
+ * @returns 1 if a token was available (always, if rate is 0), else 0.
  */
 static int
-propagate_interest(struct ccnd_handle *h,
-                   struct face *face,
-                   unsigned char *msg,
-                   struct ccn_parsed_interest *pi,
-                   struct nameprefix_entry *npe)
+bucket_take(struct ccnd_handle *h, struct ccnd_bucket *b, unsigned rate)
 {
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
-    unsigned char *nonce;
-    size_t noncesize;
-    struct ccn_charbuf *cb = NULL;
-    int res;
-    struct propagating_entry *pe = NULL;
-    unsigned char *msg_out = msg;
-    size_t msg_out_size = pi->offset[CCN_PI_E];
-    int usec;
-    int ntap;
-    int delaymask;
-    int extra_delay = 0;
-    struct ccn_indexbuf *outbound = NULL;
-    intmax_t lifetime;
+    unsigned now;
+    long long level;
+    long long cap;
     
-    lifetime = ccn_interest_lifetime(msg, pi);
-    outbound = get_outbound_faces(h, face, msg, pi, npe);
-    if (outbound->n != 0) {
-        extra_delay = adjust_outbound_for_existing_interests(h, face, msg, pi, npe, outbound);
-        if (extra_delay < 0) {
-            /*
-             * Completely subsumed by other interests.
-             * We do not have to worry about generating a nonce if it
-             * does not have one yet.
-             */
-            if (h->debug & 16)
-                ccnd_debug_ccnb(h, __LINE__, "interest_subsumed", face,
-                                msg_out, msg_out_size);
-            h->interests_dropped += 1;
-            ccn_indexbuf_destroy(&outbound);
-            return(0);
-        }
+    if (rate == 0)
+        return(1);
+    now = ccnd_usec_now(h);
+    cap = (long long)rate * 1000;
+    level = b->level + (long long)(unsigned)(now - b->stamp) * rate / 1000;
+    if (b->stamp == 0 || level > cap)
+        level = cap;
+    b->stamp = now;
+    if (level < 1000) {
+        b->level = level;
+        return(0);
     }
-    if (pi->offset[CCN_PI_B_Nonce] == pi->offset[CCN_PI_E_Nonce]) {
-        /* This interest has no nonce; add one before going on */
-        size_t nonce_start = 0;
-        cb = charbuf_obtain(h);
-        ccn_charbuf_append(cb, msg, pi->offset[CCN_PI_B_Nonce]);
-        nonce_start = cb->length;
-        (h->appnonce)(h, face, cb);
-        noncesize = cb->length - nonce_start;
-        ccn_charbuf_append(cb, msg + pi->offset[CCN_PI_B_OTHER],
-                               pi->offset[CCN_PI_E] - pi->offset[CCN_PI_B_OTHER]);
-        nonce = cb->buf + nonce_start;
-        msg_out = cb->buf;
-        msg_out_size = cb->length;
+    b->level = level - 1000;
+    return(1);
+}
+
+/**
+ * @returns how full the PIT is, in thousandths of its budget
+ *
+ * This is the larger of the two fractions, pending interests of
+ * CCND_PIT_LIMIT and their message bytes of CCND_PIT_BYTES; it is 0
+ * when there is no budget.
+ */
+unsigned
+ccnd_pit_usage(struct ccnd_handle *h)
+{
+    uintmax_t ans = 0;
+    uintmax_t u;
+    
+    if (h->pit_limit != 0)
+        ans = (uintmax_t)h->pit_pending * 1000 / h->pit_limit;
+    if (h->pit_byte_limit != 0) {
+        u = (uintmax_t)h->pit_msg_bytes * 1000 / h->pit_byte_limit;
+        if (u > ans)
+            ans = u;
     }
-    else {
-        nonce = msg + pi->offset[CCN_PI_B_Nonce];
-        noncesize = pi->offset[CCN_PI_E_Nonce] - pi->offset[CCN_PI_B_Nonce];
+    return(ans > UINT_MAX ? UINT_MAX : ans);
+}
+
+/**
+ * Decide whether a face may add another interest of the given size
+ * to the PIT.
+ *
+ * Below CCND_PIT_SOFT anything goes.  From there on, the face that the
+ * heavy-hitter sketch shows sending the most interests lately may not
+ * hold more than the average number pending, so the likeliest flooder
+ * is reined in before the budget runs out.  Once it is used up, each
+ * face that has interests pending gets an equal share of it, in
+ * entries and in bytes, so the faces that are flooding the PIT are
+ * the ones turned away and the rest still get through.  A face with
+ * nothing pending may always have one.  h->pit_faces is kept current
+ * as faces gain and lose pending interests, so this takes constant time.
+ */
+static int
+pit_share_ok(struct ccnd_handle *h, struct face *face, size_t size)
+{
+    unsigned usage;
+    unsigned n;
+    uint64_t heavy;
+    
+    if (face->pending_interests == 0)
+        return(1);
+    usage = ccnd_pit_usage(h);
+    if (usage < CCND_PIT_SOFT)
+        return(1);
+    n = h->pit_faces;
+    if (usage < 1000) {
+        if (h->hh_face == NULL || n < 2 ||
+            ccnd_hh_heaviest(h->hh_face, &heavy) == 0 ||
+            heavy != face->faceid)
+            return(1);
+        return(face->pending_interests <= h->pit_pending / n);
+    }
+    if (h->pit_limit != 0 && face->pending_interests >= h->pit_limit / n)
+        return(0);
+    if (h->pit_byte_limit != 0 &&
+        face->pending_bytes + pit_msg_cost(size) > h->pit_byte_limit / n)
+        return(0);
+    return(1);
+}
+
+/**
+ * Shorten the lifetime of a new PIT entry while the PIT is past its
+ * soft limit, so that it drains faster than it fills.
+ *
+ * The lifetime is halved at CCND_PIT_SOFT, and cut to an eighth as the
+ * PIT nears its budget, but not below CCND_PIT_MIN_USEC.
+ */
+static void
+pit_shorten(struct ccnd_handle *h, struct propagating_entry *pe,
+            unsigned usage)
+{
+    unsigned shift;
+    int usec;
+    
+    if (usage < CCND_PIT_SOFT)
+        return;
+    shift = 1 + 2 * (usage - CCND_PIT_SOFT) / (1000 - CCND_PIT_SOFT);
+    if (shift > 3)
+        shift = 3;
+    usec = pe->usec >> shift;
+    if (usec < CCND_PIT_MIN_USEC)
+        usec = CCND_PIT_MIN_USEC;
+    if (usec < pe->usec) {
+        pe->usec = usec;
+        h->interests_shortened += 1;
     }
-    hashtb_start(h->propagating_tab, e);
-    hashtb_seek(e, nonce, noncesize, 0);
-    pe = e->data;
-    if (pe != NULL && pe->interest_msg == NULL) {
-        unsigned char *m;
-        m = calloc(1, msg_out_size);
-        if (m == NULL) {
-            res = -1;
-            pe = NULL;
-            hashtb_delete(e);
-        }
+}
+
+/**
+ * Send a NACK once it has been signed, if the face is still there.
+ */
+static void
+ccnd_nack_done(struct ccn_signer *s, struct ccn_charbuf *reply,
+               void *data, intptr_t faceid)
+{
+    struct ccnd_handle *h = data;
+    struct face *face;
+    
+    if (reply == NULL)
+        return;
+    face = face_from_faceid(h, faceid);
+    if (face == NULL)
+        return;
+    ccnd_send(h, face, reply->buf, reply->length);
+    h->interests_nacked += 1;
+}
+
+/**
+ * Tell the sender promptly that its interest will not be answered,
+ * rather than leaving it to time out.
+ *
+ * The answer is a NACK ContentObject with the name of the interest.
+ * It goes straight to the face without entering the content store,
+ * so it cannot satisfy anyone else's interest.  Signing is not cheap,
+ * so this is done at a bounded rate, and by h->signer rather than here.
+ */
+static void
+ccnd_nack_interest(struct ccnd_handle *h, struct face *face,
+                   unsigned char *msg, struct ccn_parsed_interest *pi)
+{
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_charbuf *name = NULL;
+    
+    if (h->internal_client == NULL || h->signer == NULL)
+        return;
+    if (!bucket_take(h, &h->nack_bucket, CCND_NACK_RATE))
+        return;
+    sp.type = CCN_CONTENT_NACK;
+    sp.freshness = 0;
+    if (h->local_signing &&
+        (face->flags & (CCN_FACE_LOCAL | CCN_FACE_LOOPBACK)) != 0)
+        sp.sp_flags |= CCN_SP_HMAC;
+    name = charbuf_obtain(h);
+    ccn_charbuf_append(name, msg + pi->offset[CCN_PI_B_Name],
+                       pi->offset[CCN_PI_E_Name] - pi->offset[CCN_PI_B_Name]);
+    ccn_signer_submit(h->signer, name, &sp, NULL, 0,
+                      &ccnd_nack_done, h, face->faceid);
+    charbuf_release(h, name);
+}
+
+/**
+ * Apply the per-face and per-prefix limits to an interest that is
+ * about to enter the PIT.
+ *
+ * The prefix limit applies to the longest registered prefix that
+ * covers the interest.  The internal client is exempt, and so are
+ * management interests from local faces.
+ * @returns 1 if the interest may proceed, 0 if it has been dropped.
+ */
+static int
+interest_admit(struct ccnd_handle *h, struct face *face,
+               unsigned char *msg, struct ccn_parsed_interest *pi,
+               struct nameprefix_entry *npe)
+{
+    struct nameprefix_entry *p;
+    const char *why = NULL;
+    
+    if (face == h->face0)
+        return(1);
+    if (h->mgmt_active && (face->flags & CCN_FACE_GG) != 0)
+        return(1);
+    if (!pit_share_ok(h, face, pi->offset[CCN_PI_E]))
+        why = "interest_over_pit_share";
+    else if (!bucket_take(h, &face->ibucket, h->face_irate))
+        why = "interest_over_face_rate";
+    else if (h->prefix_irate != 0) {
+        for (p = npe; p != NULL && p->forwarding == NULL; p = p->parent)
+            continue;
+        if (p != NULL && !bucket_take(h, &p->ibucket, h->prefix_irate))
+            why = "interest_over_prefix_rate";
+    }
+    if (why == NULL)
+        return(1);
+    if (h->debug & 16)
+        ccnd_debug_ccnb(h, __LINE__, why, face, msg, pi->offset[CCN_PI_E]);
+    h->interests_dropped += 1;
+    h->interests_limited += 1;
+    if ((face->flags & CCN_FACE_GG) != 0)
+        ccnd_nack_interest(h, face, msg, pi);
+    return(0);
+}
+
+/**
+ * Find the negative cache ttl for an interest name, in msec.
+ *
+ * The longest prefix listed in CCND_NEGATIVE_TTL_PREFIXES wins;
+ * otherwise it is CCND_NEGATIVE_TTL.  Zero means do not cache.
+ */
+static unsigned
+negcache_ttl(struct ccnd_handle *h, const unsigned char *msg,
+             const struct ccn_parsed_interest *pi)
+{
+    const unsigned char *comps = msg + pi->offset[CCN_PI_B_Component0];
+    size_t size = pi->offset[CCN_PI_E_LastPrefixComponent] -
+                  pi->offset[CCN_PI_B_Component0];
+    unsigned ans = h->negttl;
+    size_t best = 0;
+    size_t start;
+    size_t len;
+    size_t i;
+    
+    if (h->negttl_ms == NULL)
+        return(ans);
+    for (i = 0; i < h->negttl_ms->n; i++) {
+        start = h->negttl_off->buf[i];
+        len = h->negttl_off->buf[i + 1] - start;
+        if (len <= size && len >= best &&
+            0 == memcmp(comps, h->negttl_comps->buf + start, len)) {
+            best = len;
+            ans = h->negttl_ms->buf[i];
+        }
+    }
+    return(ans);
+}
+
+/**
+ * Remember that an interest could not be answered.
+ *
+ * This is called when an interest that was forwarded expires, and
+ * when a NACK comes back for it.
+ */
+static void
+negcache_note(struct ccnd_handle *h, const unsigned char *msg, size_t size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_parsed_interest parsed_interest = {0};
+    struct ccn_parsed_interest *pi = &parsed_interest;
+    struct negcache_entry *ne;
+    unsigned ttl;
+    
+    if (h->negcache_tab == NULL ||
+        hashtb_n(h->negcache_tab) >= CCND_NEGCACHE_MAX)
+        return;
+    if (ccn_parse_interest(msg, size, pi, NULL) < 0)
+        return;
+    ttl = negcache_ttl(h, msg, pi);
+    if (ttl == 0)
+        return;
+    hashtb_start(h->negcache_tab, e);
+    if (hashtb_seek(e, msg + pi->offset[CCN_PI_B_Name],
+                    pi->offset[CCN_PI_E_Exclude] - pi->offset[CCN_PI_B_Name],
+                    0) >= 0) {
+        ne = e->data;
+        ne->expiry = ccnd_usec_now(h) + ttl * 1000;
+        if (h->debug & 16)
+            ccnd_debug_ccnb(h, __LINE__, "negcache_note", NULL, msg, size);
+    }
+    hashtb_end(e);
+    reap_needed(h, 0);
+}
+
+/**
+ * Check the negative cache for an interest.
+ * @returns 1 if the same interest recently went unanswered, else 0.
+ */
+static int
+negcache_lookup(struct ccnd_handle *h, const unsigned char *msg,
+                const struct ccn_parsed_interest *pi)
+{
+    struct negcache_entry *ne;
+    
+    if (h->negcache_tab == NULL || hashtb_n(h->negcache_tab) == 0)
+        return(0);
+    ne = hashtb_lookup(h->negcache_tab, msg + pi->offset[CCN_PI_B_Name],
+                       pi->offset[CCN_PI_E_Exclude] - pi->offset[CCN_PI_B_Name]);
+    if (ne == NULL)
+        return(0);
+    return((int)(ne->expiry - ccnd_usec_now(h)) > 0);
+}
+
+/**
+ * Schedules the propagation of an Interest message.
+ */
+static int
+propagate_interest(struct ccnd_handle *h,
+                   struct face *face,
+                   unsigned char *msg,
+                   struct ccn_parsed_interest *pi,
+                   struct nameprefix_entry *npe)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    unsigned char *nonce;
+    size_t noncesize;
+    struct ccn_charbuf *cb = NULL;
+    int res;
+    struct propagating_entry *pe = NULL;
+    unsigned char *msg_out = msg;
+    size_t msg_out_size = pi->offset[CCN_PI_E];
+    int usec;
+    int ntap;
+    unsigned first = CCN_NOFACEID;
+    int delaymask;
+    int extra_delay = 0;
+    int retry = 0;
+    int tclass;
+    struct ccn_indexbuf *outbound = NULL;
+    intmax_t lifetime;
+    
+    lifetime = ccn_interest_lifetime(msg, pi);
+    outbound = get_outbound_faces(h, face, msg, pi, npe);
+    if (outbound->n != 0) {
+        extra_delay = adjust_outbound_for_existing_interests(h, face, msg, pi,
+                                                             npe, outbound,
+                                                             &retry);
+        if (extra_delay < 0) {
+            /*
+             * Completely subsumed by other interests.
+             * We do not have to worry about generating a nonce if it
+             * does not have one yet.
+             */
+            if (h->debug & 16)
+                ccnd_debug_ccnb(h, __LINE__, "interest_subsumed", face,
+                                msg_out, msg_out_size);
+            h->interests_dropped += 1;
+            ccn_indexbuf_destroy(&outbound);
+            return(0);
+        }
+    }
+    if (!interest_admit(h, face, msg, pi, npe)) {
+        ccn_indexbuf_destroy(&outbound);
+        return(0);
+    }
+    if (pi->offset[CCN_PI_B_Nonce] == pi->offset[CCN_PI_E_Nonce]) {
+        /* This interest has no nonce; add one before going on */
+        size_t nonce_start = 0;
+        cb = charbuf_obtain(h);
+        ccn_charbuf_append(cb, msg, pi->offset[CCN_PI_B_Nonce]);
+        nonce_start = cb->length;
+        (h->appnonce)(h, face, cb);
+        noncesize = cb->length - nonce_start;
+        ccn_charbuf_append(cb, msg + pi->offset[CCN_PI_B_OTHER],
+                               pi->offset[CCN_PI_E] - pi->offset[CCN_PI_B_OTHER]);
+        nonce = cb->buf + nonce_start;
+        msg_out = cb->buf;
+        msg_out_size = cb->length;
+    }
+    else {
+        nonce = msg + pi->offset[CCN_PI_B_Nonce];
+        noncesize = pi->offset[CCN_PI_E_Nonce] - pi->offset[CCN_PI_B_Nonce];
+    }
+    hashtb_start(h->propagating_tab, e);
+    hashtb_seek(e, nonce, noncesize, 0);
+    pe = e->data;
+    if (pe != NULL && pe->interest_msg == NULL) {
+        unsigned char *m;
+        m = pit_msg_alloc(h, msg_out_size);
+        if (m == NULL) {
+            res = -1;
+            pe = NULL;
+            hashtb_delete(e);
+        }
         else {
             memcpy(m, msg_out, msg_out_size);
             pe->interest_msg = m;
             pe->size = msg_out_size;
             pe->faceid = face->faceid;
-            face->pending_interests += 1;
+            pe->atime = ccnd_usec_now(h);
+            if (face->pending_interests++ == 0)
+                h->pit_faces += 1;
+            face->pending_bytes += pit_msg_cost(msg_out_size);
+            h->pit_pending += 1;
             if (lifetime < INT_MAX / (1000000 >> 6) * (4096 >> 6))
                 pe->usec = lifetime * (1000000 >> 6) / (4096 >> 6);
             else
                 pe->usec = INT_MAX;
+            pit_shorten(h, pe, ccnd_pit_usage(h));
             delaymask = 0xFFF;
             pe->sent = 0;            
             pe->outbound = outbound;
@@ -3505,15 +7160,47 @@ propagate_interest(struct ccnd_handle *h,
                 pe->flags |= CCN_PR_SCOPE1;
             else if (pi->scope == 2)
                 pe->flags |= CCN_PR_SCOPE2;
+            /*
+             * The npe holds exactly the interest name, so if nothing
+             * after the name affects matching, any content that reaches
+             * this npe in match_interests will match.
+             */
+            if (pi->offset[CCN_PI_E_Exclude] == pi->offset[CCN_PI_E_Name])
+                pe->flags |= CCN_PR_EXACT;
+            else if (pi->offset[CCN_PI_E_Exclude] > pi->offset[CCN_PI_B_Exclude])
+                pe->excl = ccn_compile_exclude(msg + pi->offset[CCN_PI_B_Exclude],
+                                               pi->offset[CCN_PI_E_Exclude] -
+                                               pi->offset[CCN_PI_B_Exclude]);
             pe->fgen = h->forward_to_gen;
+            tclass = npe_traffic_class(npe);
+            h->tc_interests[tclass]++;
+            if (tclass == 0)
+                pe->flags |= CCN_PR_URGENT;
+            if (h->mgmt_active) {
+                pe->flags |= CCN_PR_URGENT | CCN_PR_MGMT;
+                pe->atime = h->mgmt_arrival;
+            }
             link_propagating_interest_to_nameprefix(h, pe, npe);
-            ntap = reorder_outbound_using_history(h, npe, pe);
+            if (h->trace_on)
+                trace_interest(h, CCND_TR_PIT_INSERT, face->faceid, msg_out,
+                               msg_out_size, pi, NULL, pe->usec);
+            if (retry) {
+                /* Already in order, and the taps have had it */
+                pe->flags |= CCN_PR_RETRY;
+                ntap = 0;
+            }
+            else
+                ntap = reorder_outbound_using_strategy(h, npe, pe, &first);
             if (outbound->n > ntap &&
-                  outbound->buf[ntap] == npe->src &&
+                  first != CCN_NOFACEID &&
+                  outbound->buf[ntap] == first &&
                   extra_delay == 0) {
                 pe->flags |= CCN_PR_UNSENT;
                 delaymask = 0xFF;
             }
+            /* Latency-sensitive traffic goes out without the random wait */
+            if ((pe->flags & (CCN_PR_URGENT | CCN_PR_RETRY)) != 0)
+                delaymask = 0;
             outbound = NULL;
             res = 0;
             if (ntap > 0)
@@ -3563,11 +7250,13 @@ replan_propagation(struct ccnd_handle *h, struct propagating_entry *pe)
 {
     struct nameprefix_entry *npe = NULL;
     struct ccn_indexbuf *x = pe->outbound;
+    struct ccnd_faceset *seen = &h->fs_scratch;
     struct face *face = NULL;
     struct face *from = NULL;
     int i;
     int k;
     int n;
+    int res;
     unsigned faceid;
     unsigned checkmask = 0;
     unsigned wantmask = 0;
@@ -3578,11 +7267,7 @@ replan_propagation(struct ccnd_handle *h, struct propagating_entry *pe)
     from = face_from_faceid(h, pe->faceid);
     if (from == NULL)
         return;
-    npe = nameprefix_for_pe(h, pe);
-    while (npe->parent != NULL && npe->forwarding == NULL)
-        npe = npe->parent;
-    if (npe->fgen != h->forward_to_gen)
-        update_forward_to(h, npe);
+    npe = nameprefix_for_pe(h, pe)->fib;
     if (npe->forward_to == NULL || npe->forward_to->n == 0)
         return;
     if ((pe->flags & CCN_PR_SCOPE1) != 0)
@@ -3594,13 +7279,22 @@ replan_propagation(struct ccnd_handle *h, struct propagating_entry *pe)
     wantmask = checkmask;
     if (wantmask == CCN_FACE_GG)
         checkmask |= CCN_FACE_DC;
+    /* Faces that have gone away do not count, so their slots may be reused */
+    ccnd_faceset_clear(seen);
+    for (i = 0; i < x->n; i++)
+        if (face_from_faceid(h, x->buf[i]) != NULL)
+            ccnd_faceset_add(seen, x->buf[i]);
     for (n = npe->forward_to->n, i = 0; i < n; i++) {
         faceid = npe->forward_to->buf[i];
         face = face_from_faceid(h, faceid);
         if (face != NULL && faceid != pe->faceid &&
             ((face->flags & checkmask) == wantmask)) {
             k = x->n;
-            ccn_indexbuf_set_insert(x, faceid);
+            res = ccnd_faceset_add(seen, faceid);
+            if (res > 0)
+                ccn_indexbuf_append_element(x, faceid);
+            else if (res < 0)
+                ccn_indexbuf_set_insert(x, faceid);
             if (x->n > k && (h->debug & 32) != 0)
                 ccnd_msg(h, "at %d adding %u", __LINE__, faceid);
         }
@@ -3613,6 +7307,8 @@ replan_propagation(struct ccnd_handle *h, struct propagating_entry *pe)
  * its Nonce, recording it in the process.  Also, if it has been
  * seen and the original is still propagating, remove the face that
  * the duplicate arrived on from the outbound set of the original.
+ * Nonces whose PIT entries have already gone are found in the dead
+ * nonce list.
  */
 static int
 is_duplicate_flooded(struct ccnd_handle *h, unsigned char *msg,
@@ -3633,40 +7329,100 @@ is_duplicate_flooded(struct ccnd_handle *h, unsigned char *msg,
         if (promote_outbound(pe, faceid) != -1)
             pe->sent++;
     }
+    else if (h->dnl != NULL &&
+             ccnd_dnl_match(h->dnl, h->sec, msg + nonce_start, nonce_size)) {
+        hashtb_delete(e);
+        h->interests_looped += 1;
+        res = HT_OLD_ENTRY;
+    }
     hashtb_end(e);
     return(res == HT_OLD_ENTRY);
 }
 
 /**
- * Finds the longest matching nameprefix, returns the component count or -1 for error.
+ * Below this many candidate prefix lengths, probe them longest first
+ */
+#define LPM_LINEAR_MAX 4
+
+/**
+ * Finds the longest prefix of a name that has a nameprefix entry.
+ *
+ * Since nameprefix_seek always creates all the shorter prefixes,
+ * and only leaves are removed, the prefixes present form an unbroken
+ * run from the root.  So the longest one may be found by binary search
+ * over the prefix lengths, bounded by the longest prefix ever entered.
+ * All the hashes needed come from a single pass over the name.
+ *
+ * @param key is the ccnb-encoded name (or an object starting with one).
+ * @param comps holds the ncomps + 1 component boundary offsets.
+ * @param matchp gets the component count of the match, or -1.
+ * @returns the entry, or NULL if none matched.
  */
-/* UNUSED */ int
-nameprefix_longest_match(struct ccnd_handle *h, const unsigned char *msg,
-                         struct ccn_indexbuf *comps, int ncomps)
+static struct nameprefix_entry *
+nameprefix_longest_match(struct ccnd_handle *h, const unsigned char *key,
+                         const unsigned short *comps, int ncomps, int *matchp)
 {
-    int i;
-    int base;
-    int answer = 0;
+    size_t space[2 * 32];
+    size_t *offsets = space;
+    size_t *hashes;
     struct nameprefix_entry *npe = NULL;
+    struct nameprefix_entry *ans = NULL;
+    int lo = -1;
+    int hi;
+    int mid;
+    int i;
 
-    if (ncomps + 1 > comps->n)
-        return(-1);
-    base = comps->buf[0];
-    for (i = 0; i <= ncomps; i++) {
-        npe = hashtb_lookup(h->nameprefix_tab, msg + base, comps->buf[i] - base);
-        if (npe == NULL)
-            break;
-        answer = i;
-        if (npe->children == 0)
-            break;
+    *matchp = -1;
+    if (ncomps < 0)
+        return(NULL);
+    if (ncomps > h->nameprefix_maxcomps)
+        ncomps = h->nameprefix_maxcomps;
+    if (ncomps + 1 > sizeof(space) / sizeof(space[0]) / 2) {
+        offsets = calloc(2 * (ncomps + 1), sizeof(offsets[0]));
+        if (offsets == NULL)
+            return(NULL);
+    }
+    hashes = offsets + ncomps + 1;
+    for (i = 0; i <= ncomps; i++)
+        offsets[i] = comps[i];
+    hashtb_hash_prefixes(h->nameprefix_tab, key, offsets, ncomps + 1,
+                         hashes);
+    key += comps[0];
+    if (ncomps < LPM_LINEAR_MAX) {
+        for (i = ncomps; i >= 0 && ans == NULL; i--) {
+            ans = hashtb_lookup_hashed(h->nameprefix_tab, key,
+                                       comps[i] - comps[0], hashes[i]);
+            lo = i;
+        }
+        if (ans == NULL)
+            lo = -1;
+    }
+    else {
+        /* Invariant: prefix lo is present (or lo < 0), prefix hi is not */
+        for (hi = ncomps + 1; hi - lo > 1;) {
+            mid = (lo + hi) / 2;
+            npe = hashtb_lookup_hashed(h->nameprefix_tab, key,
+                                       comps[mid] - comps[0], hashes[mid]);
+            if (npe != NULL) {
+                ans = npe;
+                lo = mid;
+            }
+            else
+                hi = mid;
+        }
     }
-    ccnd_msg(h, "nameprefix_longest_match returning %d", answer);
-    return(answer);
+    if (offsets != space)
+        free(offsets);
+    *matchp = lo;
+    return(ans);
 }
 
 /**
  * Creates a nameprefix entry if it does not already exist, together
  * with all of its parents.
+ *
+ * The hashes of all the prefixes are computed in a single pass
+ * over the name.
  */
 static int
 nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
@@ -3678,27 +7434,41 @@ nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
     struct nameprefix_entry *parent = NULL;
     struct nameprefix_entry *npe = NULL;
     struct propagating_entry *head = NULL;
+    size_t space[32];
+    size_t *hashes = space;
 
     if (ncomps + 1 > comps->n)
         return(-1);
+    if (ncomps + 1 > sizeof(space) / sizeof(space[0])) {
+        hashes = calloc(ncomps + 1, sizeof(hashes[0]));
+        if (hashes == NULL)
+            return(-1);
+    }
+    hashtb_hash_prefixes(h->nameprefix_tab, msg, comps->buf, ncomps + 1,
+                         hashes);
     base = comps->buf[0];
     for (i = 0; i <= ncomps; i++) {
-        res = hashtb_seek(e, msg + base, comps->buf[i] - base, 0);
+        res = hashtb_seek_hashed(e, msg + base, comps->buf[i] - base, 0,
+                                 hashes[i]);
         if (res < 0)
             break;
         npe = e->data;
         if (res == HT_NEW_ENTRY) {
+            if (i > h->nameprefix_maxcomps)
+                h->nameprefix_maxcomps = i;
             head = &npe->pe_head;
             head->next = head;
             head->prev = head;
             head->faceid = CCN_NOFACEID;
             npe->parent = parent;
             npe->forwarding = NULL;
-            npe->fgen = h->forward_to_gen - 1;
             npe->forward_to = NULL;
             if (parent != NULL) {
                 parent->children++;
-                npe->flags = parent->flags;
+                npe->sibling = parent->child;
+                if (npe->sibling != NULL)
+                    npe->sibling->psibling = npe;
+                parent->child = npe;
                 npe->src = parent->src;
                 npe->osrc = parent->osrc;
                 npe->usec = parent->usec;
@@ -3707,9 +7477,12 @@ nameprefix_seek(struct ccnd_handle *h, struct hashtb_enumerator *e,
                 npe->src = npe->osrc = CCN_NOFACEID;
                 npe->usec = (nrand48(h->seed) % 4096U) + 8192;
             }
+            update_forward_to(h, npe);
         }
         parent = npe;
     }
+    if (hashes != space)
+        free(hashes);
     return(res);
 }
 
@@ -3719,15 +7492,13 @@ next_child_at_level(struct ccnd_handle *h,
 {
     struct content_entry *next = NULL;
     struct ccn_charbuf *name;
-    struct ccn_indexbuf *pred[CCN_SKIPLIST_MAX_DEPTH] = {NULL};
-    int d;
     int res;
     
     if (content == NULL)
         return(NULL);
     if (content->ncomps <= level + 1)
         return(NULL);
-    name = ccn_charbuf_create();
+    name = charbuf_obtain(h);
     ccn_name_init(name);
     res = ccn_name_append_components(name, content->key,
                                      content->comps[0],
@@ -3738,15 +7509,13 @@ next_child_at_level(struct ccnd_handle *h,
     if (h->debug & 8)
         ccnd_debug_ccnb(h, __LINE__, "child_successor", NULL,
                         name->buf, name->length);
-    d = content_skiplist_findbefore(h, name->buf, name->length,
-                                    NULL, pred);
-    next = content_from_accession(h, pred[0]->buf[0]);
+    next = ccnd_nameindex_lookup(h->nameindex, name->buf, name->length);
     if (next == content) {
         // XXX - I think this case should not occur, but just in case, avoid a loop.
-        next = content_from_accession(h, content_skiplist_next(h, content));
-        ccnd_debug_ccnb(h, __LINE__, "bump", NULL, next->key, next->size);
+        next = ccnd_nameindex_next(h->nameindex, content);
+        debug_content(h, __LINE__, "bump", NULL, next);
     }
-    ccn_charbuf_destroy(&name);
+    charbuf_release(h, name);
     return(next);
 }
 
@@ -3781,6 +7550,8 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
     struct nameprefix_entry *npe = NULL;
     struct content_entry *content = NULL;
     struct content_entry *last_match = NULL;
+    const unsigned char *cob = NULL;
+    struct ccn_compiled_exclude *ce = NULL;
     struct ccn_indexbuf *comps = indexbuf_obtain(h);
     if (size > 65535)
         res = -__LINE__;
@@ -3791,7 +7562,10 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
         ccn_indexbuf_destroy(&comps);
         return;
     }
-    ccnd_meter_bump(h, face->meter[FM_INTI], 1);
+    count_message_in(h, face, FM_INTI);
+    if (h->trace_on)
+        trace_interest(h, CCND_TR_INTEREST_IN, face->faceid, msg, size,
+                       pi, comps, 0);
     if (pi->scope >= 0 && pi->scope < 2 &&
              (face->flags & CCN_FACE_GG) == 0) {
         ccnd_debug_ccnb(h, __LINE__, "interest_outofscope", face, msg, size);
@@ -3853,9 +7627,7 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
             last_match = NULL;
             content = find_first_match_candidate(h, msg, pi);
             if (content != NULL && (h->debug & 8))
-                ccnd_debug_ccnb(h, __LINE__, "first_candidate", NULL,
-                                content->key,
-                                content->size);
+                debug_content(h, __LINE__, "first_candidate", NULL, content);
             if (content != NULL &&
                 !content_matches_interest_prefix(h, content, msg, comps,
                                                  pi->prefix_comps)) {
@@ -3865,25 +7637,29 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                 content = NULL;
             }
             for (try = 0; content != NULL; try++) {
+                /* Past the first candidate, compile the Exclude once */
+                if (try == 1 &&
+                    pi->offset[CCN_PI_E_Exclude] > pi->offset[CCN_PI_B_Exclude])
+                    ce = ccn_compile_exclude(msg + pi->offset[CCN_PI_B_Exclude],
+                                             pi->offset[CCN_PI_E_Exclude] -
+                                             pi->offset[CCN_PI_B_Exclude]);
                 if ((s_ok || (content->flags & CCN_CONTENT_ENTRY_STALE) == 0) &&
-                    ccn_content_matches_interest(content->key,
+                    (cob = content_object(h, content)) != NULL &&
+                    ccn_content_matches_interest_excl(cob,
                                        content->size,
-                                       0, NULL, msg, size, pi)) {
+                                       0, NULL, msg, size, pi, ce)) {
                     if ((pi->orderpref & 1) == 0 && // XXX - should be symbolic
                         pi->prefix_comps != comps->n - 1 &&
                         comps->n == content->ncomps &&
                         content_matches_interest_prefix(h, content, msg,
                                                         comps, comps->n - 1)) {
                         if (h->debug & 8)
-                            ccnd_debug_ccnb(h, __LINE__, "skip_match", NULL,
-                                            content->key,
-                                            content->size);
+                            debug_content(h, __LINE__, "skip_match", NULL,
+                                          content);
                         goto move_along;
                     }
                     if (h->debug & 8)
-                        ccnd_debug_ccnb(h, __LINE__, "matches", NULL,
-                                        content->key,
-                                        content->size);
+                        debug_content(h, __LINE__, "matches", NULL, content);
                     if ((pi->orderpref & 1) == 0) // XXX - should be symbolic
                         break;
                     last_match = content;
@@ -3891,15 +7667,14 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                     goto check_next_prefix;
                 }
             move_along:
-                content = content_from_accession(h, content_skiplist_next(h, content));
+                content = ccnd_nameindex_next(h->nameindex, content);
             check_next_prefix:
                 if (content != NULL &&
                     !content_matches_interest_prefix(h, content, msg,
                                                      comps, pi->prefix_comps)) {
                     if (h->debug & 8)
-                        ccnd_debug_ccnb(h, __LINE__, "prefix_mismatch", NULL,
-                                        content->key,
-                                        content->size);
+                        debug_content(h, __LINE__, "prefix_mismatch", NULL,
+                                      content);
                     content = NULL;
                 }
             }
@@ -3910,9 +7685,10 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                 enum cq_delay_class c;
                 for (c = 0, k = -1; c < CCN_CQ_N && k == -1; c++)
                     if (face->q[c] != NULL)
-                        k = ccn_indexbuf_member(face->q[c]->send_queue, content->accession);
+                        k = content_queue_member(face->q[c], content->accession, NULL);
                 if (k == -1) {
-                    k = face_send_queue_insert(h, face, content);
+                    k = face_send_queue_insert(h, face, content,
+                                               npe_traffic_class(npe));
                     if (k >= 0) {
                         if (h->debug & (32 | 8))
                             ccnd_debug_ccnb(h, __LINE__, "consume", face, msg, size);
@@ -3922,94 +7698,363 @@ process_incoming_interest(struct ccnd_handle *h, struct face *face,
                 }
                 if ((pi->answerfrom & CCN_AOK_EXPIRE) != 0)
                     mark_stale(h, content);
+                if (h->cs[content->shard].cache != NULL)
+                    ccnd_cache_touch(h->cs[content->shard].cache, content);
+                else if (content->cache_freq < UINT_MAX)
+                    content->cache_freq++;
+                h->cache_hits++;
+                note_interest_latency(h, face, npe, ccnd_usec_now(h), 1);
+                if (h->trace_on)
+                    trace_interest(h, CCND_TR_CS_HIT, face->faceid, msg, size,
+                                   pi, comps, content->accession);
                 matched = 1;
             }
+            else
+                h->cache_misses++;
+            note_store_lookup(h, npe, msg + comps->buf[0], namesize, matched);
+        }
+        if (!matched && pi->scope != 0 && npe != NULL) {
+            if (negcache_lookup(h, msg, pi)) {
+                if (h->debug & 16)
+                    ccnd_debug_ccnb(h, __LINE__, "interest_negcached",
+                                    face, msg, size);
+                h->interests_negcached += 1;
+                ccnd_nack_interest(h, face, msg, pi);
+            }
+            else {
+                propagate_interest(h, face, msg, pi, npe);
+                if (h->disk != NULL)
+                    disk_fetch(h, msg, comps);
+            }
         }
-        if (!matched && pi->scope != 0 && npe != NULL)
-            propagate_interest(h, face, msg, pi, npe);
+        if (h->topk > 0)
+            hh_note_interest(h, face, msg, comps, !matched);
+        if (h->prefetch != NULL && face != h->face0)
+            prefetch_note(h, face, msg, comps);
     Bail:
         hashtb_end(e);
     }
+    ccn_compiled_exclude_destroy(&ce);
     indexbuf_release(h, comps);
 }
 
+#define CCND_MGMT_LOCALHOST "\xC1.M.S.localhost"
+
 /**
- * Mark content as stale
+ * Test whether an interest is for the management namespaces of the
+ * internal client: ccnx:/ccnx/CCNDID/... or ccnx:/%C1.M.S.localhost/...
+ *
+ * Only the first two components are looked at, so this is cheap enough
+ * to do for every interest as it arrives.
+ */
+static int
+is_mgmt_interest(struct ccnd_handle *h, const unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    const unsigned char *v[2] = {NULL, NULL};
+    size_t vs[2] = {0, 0};
+    int i;
+    
+    d = ccn_buf_decoder_start(&decoder, msg, size);
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_Interest))
+        return(0);
+    ccn_buf_advance(d);
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_Name))
+        return(0);
+    ccn_buf_advance(d);
+    for (i = 0; i < 2 && ccn_buf_match_dtag(d, CCN_DTAG_Component); i++) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_blob(d, &v[i], &vs[i]))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+    }
+    if (d->decoder.state < 0 || i < 2)
+        return(0);
+    if (vs[0] == 4 && memcmp(v[0], "ccnx", 4) == 0)
+        return(vs[1] == sizeof(h->ccnd_id) &&
+               memcmp(v[1], h->ccnd_id, sizeof(h->ccnd_id)) == 0);
+    return(vs[0] == sizeof(CCND_MGMT_LOCALHOST) - 1 &&
+           memcmp(v[0], CCND_MGMT_LOCALHOST, vs[0]) == 0);
+}
+
+/**
+ * Set a management interest aside, to be handled by mgmt_run.
  */
 static void
-mark_stale(struct ccnd_handle *h, struct content_entry *content)
+mgmt_set_aside(struct ccnd_handle *h, struct face *face,
+               unsigned char *msg, size_t size)
 {
-    ccn_accession_t accession = content->accession;
-    if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0)
+    struct ccnd_mgmtq *q = &h->mgmtq;
+    struct ccn_charbuf *c = NULL;
+    unsigned i;
+    
+    if (q->n < CCND_MGMT_QMAX)
+        c = ccn_charbuf_create();
+    if (c == NULL || ccn_charbuf_append(c, msg, size) < 0) {
+        ccn_charbuf_destroy(&c);
+        h->mgmt_dropped++;
+        if (h->debug & 16)
+            ccnd_debug_ccnb(h, __LINE__, "mgmt_dropped", face, msg, size);
         return;
-    if (h->debug & 4)
-            ccnd_debug_ccnb(h, __LINE__, "stale", NULL,
-                            content->key, content->size);
-    content->flags |= CCN_CONTENT_ENTRY_STALE;
-    h->n_stale++;
-    if (accession < h->min_stale)
-        h->min_stale = accession;
-    if (accession > h->max_stale)
-        h->max_stale = accession;
+    }
+    i = (q->head + q->n++) % CCND_MGMT_QMAX;
+    q->faceid[i] = face->faceid;
+    q->stamp[i] = ccnd_usec_now(h);
+    q->msg[i] = c;
 }
 
 /**
- * Scheduled event that makes content stale when its FreshnessSeconds
- * has exported.
- *
- * May actually remove the content if we are over quota.
+ * Handle the management interests that have been set aside, oldest
+ * first, as far as what is left of this turn's budget allows.
  */
-static int
-expire_content(struct ccn_schedule *sched,
-               void *clienth,
-               struct ccn_scheduled_event *ev,
-               int flags)
+static void
+mgmt_run(struct ccnd_handle *h)
 {
-    struct ccnd_handle *h = clienth;
-    ccn_accession_t accession = ev->evint;
-    struct content_entry *content = NULL;
-    int res;
-    unsigned n;
-    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
-        return(0);
-    content = content_from_accession(h, accession);
-    if (content != NULL) {
-        n = hashtb_n(h->content_tab);
-        /* The fancy test here lets existing stale content go away, too. */
-        if ((n - (n >> 3)) > h->capacity ||
-            (n > h->capacity && h->min_stale > h->max_stale)) {
-            res = remove_content(h, content);
-            if (res == 0)
-                return(0);
+    struct ccnd_mgmtq *q = &h->mgmtq;
+    struct ccn_charbuf *c = NULL;
+    struct face *face = NULL;
+    unsigned now;
+    unsigned i;
+    
+    while (q->n > 0 && h->mgmt_left > 0) {
+        i = q->head;
+        q->head = (q->head + 1) % CCND_MGMT_QMAX;
+        q->n--;
+        c = q->msg[i];
+        q->msg[i] = NULL;
+        face = face_from_faceid(h, q->faceid[i]);
+        if (face != NULL) {
+            now = ccnd_usec_now(h);
+            ccnd_hist_record(&h->mgmt_wait, now - q->stamp[i]);
+            h->mgmt_left--;
+            h->mgmt_interests++;
+            h->mgmt_active = 1;
+            h->mgmt_arrival = q->stamp[i];
+            process_incoming_interest(h, face, c->buf, c->length);
+            h->mgmt_active = 0;
         }
-        mark_stale(h, content);
+        ccn_charbuf_destroy(&c);
     }
-    return(0);
 }
 
 /**
- * Schedules content expiration based on its FreshnessSeconds, and the
- * configured default and limit.
+ * Discard whatever management interests are still set aside.
  */
 static void
-set_content_timer(struct ccnd_handle *h, struct content_entry *content,
+mgmt_discard(struct ccnd_handle *h)
+{
+    struct ccnd_mgmtq *q = &h->mgmtq;
+    
+    for (; q->n > 0; q->n--) {
+        ccn_charbuf_destroy(&q->msg[q->head]);
+        q->head = (q->head + 1) % CCND_MGMT_QMAX;
+    }
+}
+
+/**
+ * Mark content as stale
+ */
+static void
+mark_stale(struct ccnd_handle *h, struct content_entry *content)
+{
+    unsigned slot = content->accession & CCND_CONTENT_SLOTMASK;
+    if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0)
+        return;
+    if (h->debug & 4)
+            debug_content(h, __LINE__, "stale", NULL, content);
+    content->flags |= CCN_CONTENT_ENTRY_STALE;
+    h->n_stale++;
+    if (content->fresh_rule != 0)
+        h->fresh_rule[content->fresh_rule].staled++;
+    if (slot < h->min_stale)
+        h->min_stale = slot;
+    if (slot > h->max_stale)
+        h->max_stale = slot;
+}
+
+/**
+ * Make content stale when its FreshnessSeconds has expired.
+ *
+ * May actually remove the content if we are over quota.
+ */
+static void
+expire_accession(struct ccnd_handle *h, ccn_accession_t accession)
+{
+    struct content_entry *content = NULL;
+    struct ccnd_cs_shard *s = NULL;
+    unsigned n;
+    size_t bytes;
+    
+    content = content_from_accession(h, accession);
+    if (content != NULL) {
+        s = &h->cs[content->shard];
+        n = hashtb_n(s->content_tab);
+        bytes = s->bytes;
+        /* The fancy test here lets existing stale content go away, too. */
+        if (shard_over_capacity(s, n - (n >> 3), bytes - (bytes >> 3)) ||
+            (shard_over_capacity(s, n, bytes) &&
+             h->min_stale > h->max_stale)) {
+            if (evict_content(h, content) == 0)
+                return;
+        }
+        mark_stale(h, content);
+    }
+}
+
+/**
+ * Remove content that has stayed as long as its freshness rule allows,
+ * unless the rule has since been lifted.
+ */
+static void
+expire_residency(struct ccnd_handle *h, ccn_accession_t accession)
+{
+    struct content_entry *content = NULL;
+    struct ccnd_fresh_rule *r = NULL;
+    
+    content = content_from_accession(h, accession);
+    if (content == NULL || content->fresh_rule == 0 ||
+        (content->flags & CCN_CONTENT_ENTRY_PRECIOUS) != 0)
+        return;
+    r = &h->fresh_rule[content->fresh_rule];
+    if (r->residency == 0)
+        return;
+    if (h->debug & 4)
+        debug_content(h, __LINE__, "residency", NULL, content);
+    if (remove_content(h, content) == 0)
+        r->removed++;
+}
+
+/**
+ * Scheduled event for the expiry of one piece of content, for
+ * lifetimes finer than the fresh_wheel can give.
+ */
+static int
+expire_content(struct ccn_schedule *sched,
+               void *clienth,
+               struct ccn_scheduled_event *ev,
+               int flags)
+{
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        return(0);
+    expire_accession(clienth, ev->evint);
+    return(0);
+}
+
+/**
+ * Scheduled event that expires each second's slot of the fresh_wheel,
+ * and of the residency_wheel.
+ *
+ * Runs just after each second boundary while there is anything in
+ * either wheel.  Content that went away in the meantime is simply not
+ * found by its accession.
+ */
+static int
+expire_fresh(struct ccn_schedule *sched,
+             void *clienth,
+             struct ccn_scheduled_event *ev,
+             int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct ccn_indexbuf *slot;
+    unsigned w;
+    int i;
+    int k;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        h->expire_fresh = NULL;
+        return(0);
+    }
+    for (k = 0; h->fresh_tick < h->sec && k < CCND_FRESH_WHEEL; k++) {
+        h->fresh_tick++;
+        w = h->fresh_tick & (CCND_FRESH_WHEEL - 1);
+        slot = h->fresh_wheel[w];
+        if (slot != NULL && slot->n != 0) {
+            for (i = 0; i < slot->n; i++)
+                expire_accession(h, slot->buf[i]);
+            h->fresh_n -= slot->n;
+            slot->n = 0;
+        }
+        slot = h->residency_wheel[w];
+        if (slot != NULL && slot->n != 0) {
+            for (i = 0; i < slot->n; i++)
+                expire_residency(h, slot->buf[i]);
+            h->fresh_n -= slot->n;
+            slot->n = 0;
+        }
+    }
+    if (h->fresh_n == 0) {
+        h->expire_fresh = NULL;
+        return(0);
+    }
+    return(1000000 - h->usec);
+}
+
+/**
+ * Put content into a wheel (the fresh_wheel or the residency_wheel),
+ * to come up after the given number of seconds, rounded up to a
+ * second boundary.
+ */
+static void
+fresh_wheel_insert(struct ccnd_handle *h, struct ccn_indexbuf **wheel,
+                   struct content_entry *content, int seconds)
+{
+    struct ccn_indexbuf **slot;
+    long when = h->sec + seconds + 1;
+    
+    if (h->expire_fresh == NULL) {
+        h->fresh_tick = h->sec;
+        h->expire_fresh = ccn_schedule_event(h->sched, 1000000 - h->usec,
+                                             &expire_fresh, NULL, 0);
+    }
+    if (when <= h->fresh_tick) /* the clock went backward */
+        when = h->fresh_tick + 1;
+    slot = &wheel[when & (CCND_FRESH_WHEEL - 1)];
+    if (*slot == NULL)
+        *slot = ccn_indexbuf_create();
+    ccn_indexbuf_append_element(*slot, content->accession);
+    h->fresh_n++;
+}
+
+/**
+ * Schedules content expiration based on its FreshnessSeconds, and the
+ * configured default and limit.  The default may come from the
+ * content's freshness rule instead.
+ *
+ * Finishes the parse in *pco if it was only started.
+ *
+ * Whole seconds go to the fresh_wheel; only the short lifetimes used
+ * with force_zero_freshness get events of their own.
+ */
+static void
+set_content_timer(struct ccnd_handle *h, struct content_entry *content,
                   struct ccn_parsed_ContentObject *pco)
 {
+    const unsigned char *msg = content_object(h, content);
     int seconds = 0;
     int microseconds = 0;
-    size_t start = pco->offset[CCN_PCO_B_FreshnessSeconds];
-    size_t stop  = pco->offset[CCN_PCO_E_FreshnessSeconds];
+    size_t start;
+    size_t stop;
+    if (msg == NULL ||
+        ccn_parse_ContentObject_finish(msg, content->size, pco) < 0)
+        return;
+    start = pco->offset[CCN_PCO_B_FreshnessSeconds];
+    stop  = pco->offset[CCN_PCO_E_FreshnessSeconds];
     if (h->force_zero_freshness) {
         /* Keep around for long enough to make it through the queues */
         microseconds = 8 * h->data_pause_microsec + 10000;
         goto Finish;
     }
-    if (start == stop)
+    if (start == stop) {
         seconds = h->tts_default;
+        if (content->fresh_rule != 0 &&
+            h->fresh_rule[content->fresh_rule].freshness > 0)
+            seconds = h->fresh_rule[content->fresh_rule].freshness;
+    }
     else
         seconds = ccn_fetch_tagged_nonNegativeInteger(
                 CCN_DTAG_FreshnessSeconds,
-                content->key,
+                msg,
                 start, stop);
     if (seconds <= 0 || (h->tts_limit > 0 && seconds > h->tts_limit))
         seconds = h->tts_limit;
@@ -4017,19 +8062,205 @@ set_content_timer(struct ccnd_handle *h, struct content_entry *content,
         return;
     if (seconds > ((1U<<31) / 1000000)) {
         ccnd_debug_ccnb(h, __LINE__, "FreshnessSeconds_too_large", NULL,
-            content->key, pco->offset[CCN_PCO_E]);
+            msg, pco->offset[CCN_PCO_E]);
         return;
     }
-    microseconds = seconds * 1000000;
+    content->flags |= CCN_CONTENT_ENTRY_EXPIRES;
+    fresh_wheel_insert(h, h->fresh_wheel, content, seconds);
+    return;
 Finish:
+    content->flags |= CCN_CONTENT_ENTRY_EXPIRES;
     ccn_schedule_event(h->sched, microseconds,
                        &expire_content, NULL, content->accession);
 }
 
+/**
+ * Charge new content to a freshness rule, and if the rule limits
+ * its residency, put it on the residency_wheel.
+ *
+ * Such content is marked as expiring, so it is neither demoted to
+ * the disk cache nor kept in a snapshot, where it would outlive
+ * its residency.
+ */
+static void
+fresh_rule_charge(struct ccnd_handle *h, struct content_entry *content,
+                  int i)
+{
+    struct ccnd_fresh_rule *r = NULL;
+    
+    if (i == 0)
+        return;
+    r = &h->fresh_rule[i];
+    content->fresh_rule = i;
+    r->objects++;
+    r->bytes += content->size;
+    if (r->residency > 0) {
+        content->flags |= CCN_CONTENT_ENTRY_EXPIRES;
+        fresh_wheel_insert(h, h->residency_wheel, content, r->residency);
+    }
+}
+
+/**
+ * Find the longest name prefix entry for a ContentObject, given the
+ * component boundaries of its name (with the digest made explicit).
+ */
+static struct nameprefix_entry *
+content_nameprefix(struct ccnd_handle *h, const unsigned char *msg,
+                   const struct ccn_indexbuf *comps)
+{
+    unsigned short space[32] = {0};
+    unsigned short *c = space;
+    struct nameprefix_entry *npe;
+    int ci;
+    int i;
+    
+    if (comps->n > sizeof(space) / sizeof(space[0])) {
+        c = calloc(comps->n, sizeof(c[0]));
+        if (c == NULL)
+            return(NULL);
+    }
+    for (i = 0; i < comps->n; i++)
+        c[i] = comps->buf[i];
+    npe = nameprefix_longest_match(h, msg, c, comps->n - 1, &ci);
+    if (c != space)
+        free(c);
+    return(npe);
+}
+
+/**
+ * Tell whether any interest is pending that a ContentObject might
+ * answer, given its longest name prefix entry.
+ *
+ * This errs on the side of yes; the selectors are not checked.
+ */
+static int
+content_solicited(struct nameprefix_entry *npe)
+{
+    for (; npe != NULL; npe = npe->parent)
+        if (npe->pe_head.next != &npe->pe_head)
+            return(1);
+    return(0);
+}
+
+/**
+ * Decide whether to keep newly arrived content in the store once it
+ * has been sent on, according to CCND_ADMIT.
+ */
+static int
+content_admitted(struct ccnd_handle *h, struct content_entry *content,
+                 int nocache)
+{
+    const unsigned char *name = content->key + content->comps[0];
+    size_t size = content->comps[content->ncomps - 1] - content->comps[0];
+    
+    if (nocache)
+        return(0);
+    if ((content->flags & CCN_CONTENT_ENTRY_PREFETCHED) != 0)
+        return(1);
+    if (h->admit_percent < 100 &&
+          nrand48(h->seed) % 100 >= (unsigned)h->admit_percent)
+        return(0);
+    if (h->admit_seen != NULL &&
+          !ccnd_dnl_match(h->admit_seen, h->sec, name, size)) {
+        ccnd_dnl_insert(h->admit_seen, h->sec, name, size);
+        return(0);
+    }
+    return(1);
+}
+
+/**
+ * Set up the store admission policy from CCND_ADMIT.
+ *
+ * This is a list of words: all, solicited, second, or a percentage
+ * such as 25% for the chance that new content is kept.
+ */
+static void
+ccnd_admit_init(struct ccnd_handle *h, const char *spec)
+{
+    char word[16];
+    size_t i, n;
+    
+    h->admit = CCND_ADMIT_SOLICITED;
+    h->admit_percent = 100;
+    if (spec == NULL || spec[0] == 0)
+        return;
+    for (i = 0; spec[i] != 0;) {
+        n = strcspn(spec + i, " \t\n,;");
+        if (n > 0 && n < sizeof(word)) {
+            memcpy(word, spec + i, n);
+            word[n] = 0;
+            if (strcmp(word, "all") == 0) {
+                h->admit = 0;
+                h->admit_percent = 100;
+            }
+            else if (strcmp(word, "solicited") == 0)
+                h->admit |= CCND_ADMIT_SOLICITED;
+            else if (strcmp(word, "second") == 0)
+                h->admit |= CCND_ADMIT_SECOND;
+            else if (word[n - 1] == '%' && atoi(word) >= 0 && atoi(word) <= 100)
+                h->admit_percent = atoi(word);
+            else
+                ccnd_msg(h, "CCND_ADMIT: %s not understood", word);
+        }
+        i += n;
+        if (spec[i] != 0)
+            i++;
+    }
+    ccnd_msg(h, "CCND_ADMIT=%s", spec);
+}
+
+/**
+ * Charge new content to the store quota for its namespace, if there is
+ * one, and toss the oldest content under that quota while it is over.
+ */
+static void
+content_quota_charge(struct ccnd_handle *h, struct content_entry *content)
+{
+    struct content_entry *old = NULL;
+    ccn_accession_t a;
+    size_t n;
+    int q;
+    
+    q = ccnd_quota_match(h->quota, content->key, content->comps,
+                         content->ncomps);
+    if (q == 0)
+        return;
+    content->quota = q;
+    if (ccnd_quota_charge(h->quota, q, content->accession, content->size)) {
+        /* Pass over the queue once, keeping what is still charged */
+        for (n = ccnd_quota_queued(h->quota, q); n > 0; n--) {
+            a = ccnd_quota_oldest(h->quota, q);
+            old = content_from_accession(h, a);
+            if (old != NULL && old->quota == q)
+                ccnd_quota_requeue(h->quota, q, a);
+        }
+    }
+    while (ccnd_quota_over(h->quota, q)) {
+        a = ccnd_quota_oldest(h->quota, q);
+        if (a == 0)
+            break;
+        if (CCND_ACCESSION_MATCH(a, content->accession)) {
+            /* Over by itself; keep it anyway */
+            ccnd_quota_requeue(h->quota, q, a);
+            break;
+        }
+        old = content_from_accession(h, a);
+        if (old == NULL || old->quota != q ||
+            (old->flags & CCN_CONTENT_ENTRY_PRECIOUS) != 0)
+            continue;
+        demote_content(h, old);
+        if (evict_content(h, old) == 0)
+            ccnd_quota_evicted(h->quota, q);
+    }
+}
+
 /**
  * Process an arriving ContentObject.
  *
- * Parse the ContentObject and discard if it is not well-formed.
+ * Parse the framing and Name of the ContentObject and discard if it is
+ * not well-formed.  The Signature and SignedInfo are parsed later, and
+ * only if needed: always for new content, but for a duplicate only if
+ * matching or freshening it calls for them.
  *
  * Compute the digest.
  *
@@ -4041,6 +8272,10 @@ Finish:
  * If no matches were found and the content object was new, discard remove it
  * from the store.
  *
+ * Content from other nodes that nothing asked for is dropped before it
+ * gets that far, and content that is not admitted (by CCND_ADMIT or a
+ * CCN_FORW_NOCACHE prefix) is sent on but marked to go first.
+ *
  * XXX - the change to staleness should also not happen if there was no
  * matching PIT entry.
  */
@@ -4055,22 +8290,28 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
     struct ccn_parsed_ContentObject obj = {0};
     int res;
     size_t keysize = 0;
-    size_t tailsize = 0;
-    unsigned char *tail = NULL;
+    unsigned char *object = NULL;
+    size_t plen = 0;
     struct content_entry *content = NULL;
+    struct nameprefix_entry *npe = NULL;
+    struct ccnd_cs_shard *s = NULL;
+    unsigned k;
+    int nocache = 0;
     int i;
+    int tc;
     struct ccn_indexbuf *comps = indexbuf_obtain(h);
     struct ccn_charbuf *cb = charbuf_obtain(h);
+    struct ccn_charbuf *flat = charbuf_obtain(h);
     
     msg = wire_msg;
     size = wire_size;
     
-    res = ccn_parse_ContentObject(msg, size, &obj, comps);
+    res = ccn_parse_ContentObject_name(msg, size, &obj, comps);
     if (res < 0) {
         ccnd_msg(h, "error parsing ContentObject - code %d", res);
         goto Bail;
     }
-    ccnd_meter_bump(h, face->meter[FM_DATI], 1);
+    count_message_in(h, face, FM_DATI);
     if (comps->n < 1 ||
         (keysize = comps->buf[comps->n - 1]) > 65535 - 36) {
         ccnd_msg(h, "ContentObject with keysize %lu discarded",
@@ -4094,7 +8335,7 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
     ccn_charbuf_append(cb, msg + i, size - i);
     msg = cb->buf;
     size = cb->length;
-    res = ccn_parse_ContentObject(msg, size, &obj, comps);
+    res = ccn_parse_ContentObject_name(msg, size, &obj, comps);
     if (res < 0) abort(); /* must have just messed up */
     
     if (obj.magic != 20090415) {
@@ -4107,22 +8348,47 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
     }
     if (h->debug & 4)
         ccnd_debug_ccnb(h, __LINE__, "content_from", face, msg, size);
+    if ((face->flags & CCN_FACE_GG) == 0) {
+        npe = content_nameprefix(h, msg, comps);
+        if (npe != NULL && (npe->flags & CCN_FORW_NOCACHE) != 0)
+            nocache = 1;
+        if ((h->admit & CCND_ADMIT_SOLICITED) != 0 && !content_solicited(npe)) {
+            h->content_unsolicited++;
+            if (h->debug & 4)
+                ccnd_debug_ccnb(h, __LINE__, "unsolicited", face, msg, size);
+            res = -__LINE__;
+            goto Bail;
+        }
+    }
+    else if (h->fresh_rules_active > 0)
+        npe = content_nameprefix(h, msg, comps);
     keysize = obj.offset[CCN_PCO_B_Content];
-    tail = msg + keysize;
-    tailsize = size - keysize;
-    hashtb_start(h->content_tab, e);
-    res = hashtb_seek(e, msg, keysize, tailsize);
+    k = content_shard_index(h, msg + comps->buf[0],
+                            comps->buf[comps->n - 1] - comps->buf[0]);
+    s = &h->cs[k];
+    hashtb_start(s->content_tab, e);
+    /*
+     * The table is keyed by the implicit digest, which stands for the
+     * whole object; the object itself is held apart from the table so
+     * that it may be compressed later.
+     */
+    res = hashtb_seek(e, msg + comps->buf[comps->n - 1] - 1 - 32, 32, 0);
     content = e->data;
     if (res == HT_OLD_ENTRY) {
-        if (tailsize != e->extsize ||
-              0 != memcmp(tail, ((unsigned char *)e->key) + keysize, tailsize)) {
+        if (size != (size_t)content->size) {
             ccnd_msg(h, "ContentObject name collision!!!!!");
             ccnd_debug_ccnb(h, __LINE__, "new", face, msg, size);
-            ccnd_debug_ccnb(h, __LINE__, "old", NULL, e->key, e->keysize + e->extsize);
+            debug_content(h, __LINE__, "old", NULL, content);
             content = NULL;
             hashtb_delete(e); /* XXX - Mercilessly throw away both of them. */
             res = -__LINE__;
         }
+        else if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0 &&
+                 (face->flags & CCN_FACE_GG) == 0 &&
+                 !content_admitted(h, content, nocache)) {
+            /* Still not to be kept, so it stays stale */
+            h->content_passed++;
+        }
         else if ((content->flags & CCN_CONTENT_ENTRY_STALE) != 0) {
             /* When old content arrives after it has gone stale, freshen it */
             // XXX - ought to do mischief checks before this
@@ -4133,48 +8399,101 @@ process_incoming_content(struct ccnd_handle *h, struct face *face,
         }
         else {
             h->content_dups_recvd++;
+            suppress_adjust(h, face, SUPPRESS_COLLISION);
             ccnd_msg(h, "received duplicate ContentObject from %u (accession %llu)",
                      face->faceid, (unsigned long long)content->accession);
             ccnd_debug_ccnb(h, __LINE__, "dup", face, msg, size);
         }
     }
     else if (res == HT_NEW_ENTRY) {
-        content->accession = ++(h->accession);
-        enroll_content(h, content);
-        if (content == content_from_accession(h, content->accession)) {
-            content->ncomps = comps->n;
-            content->comps = calloc(comps->n, sizeof(comps[0]));
-            if (content->comps == NULL) {
-                ccnd_msg(h, "could not enroll ContentObject (accession %llu)",
-                         (unsigned long long)content->accession);
-                content = NULL;
-                hashtb_delete(e);
-                res = -__LINE__;
-                hashtb_end(e);
-                goto Bail;
-                
+        content->shard = k;
+        res = ccn_parse_ContentObject_finish(msg, size, &obj);
+        if (res < 0) {
+            ccnd_msg(h, "error parsing ContentObject - code %d", res);
+            content = NULL;
+            hashtb_delete(e);
+            res = -__LINE__;
+            hashtb_end(e);
+            goto Bail;
+        }
+        res = HT_NEW_ENTRY;
+        if (enroll_content(h, content) == 0 &&
+            ccn_flatname_from_ccnb(flat, msg + obj.offset[CCN_PCO_B_Name],
+                                   obj.offset[CCN_PCO_E_Name] -
+                                   obj.offset[CCN_PCO_B_Name]) >= 0) {
+            plen = ccnd_intern_split(flat->buf, flat->length,
+                                     CCND_NAME_SUFFIX_COMPS);
+            content->prefix = ccnd_intern_prefix(h->intern, flat->buf, plen);
+            if (content->prefix != NULL || plen == 0) {
+                content->ncomps = comps->n;
+                content->comps = ccn_memacct_calloc(&h->mem[CCND_MEM_CONTENT], 1,
+                                       comps->n * sizeof(content->comps[0]) +
+                                       flat->length - plen);
+                object = ccn_memacct_malloc(&h->mem[CCND_MEM_CONTENT], size);
             }
         }
-        content->key_size = e->keysize;
-        content->size = e->keysize + e->extsize;
-        content->key = e->key;
+        if (content->comps == NULL || object == NULL) {
+            ccn_memacct_free(&h->mem[CCND_MEM_CONTENT], object);
+            ccnd_msg(h, "could not enroll ContentObject (accession %llu)",
+                     (unsigned long long)content->accession);
+            content = NULL;
+            hashtb_delete(e);
+            res = -__LINE__;
+            hashtb_end(e);
+            goto Bail;
+        }
+        memcpy(object, msg, size);
+        content->key_size = keysize;
+        content->size = size;
+        content->key = object;
+        content->used = h->sec;
         for (i = 0; i < comps->n; i++)
             content->comps[i] = comps->buf[i];
-        content_skiplist_insert(h, content);
+        content->suffix = (unsigned char *)(content->comps + comps->n);
+        memcpy((unsigned char *)content->suffix, flat->buf + plen,
+               flat->length - plen);
+        content->suffix_size = flat->length - plen;
+        h->content_bytes += content->size;
+        h->content_overhead += content_overhead(content);
+        s->bytes += content->size + content_overhead(content);
+        s->inserted++;
+        if (ccnd_nameindex_insert(h->nameindex, content) < 0) {
+            ccnd_msg(h, "could not index ContentObject (accession %llu)",
+                     (unsigned long long)content->accession);
+            content = NULL;
+            hashtb_delete(e);
+            res = -__LINE__;
+            hashtb_end(e);
+            goto Bail;
+        }
+        if (h->fresh_rules_active > 0)
+            fresh_rule_charge(h, content, npe_fresh_rule(npe));
         set_content_timer(h, content, &obj);
+        if (h->prefetch != NULL && comps->n >= 2 &&
+              ccnd_prefetch_landed(h->prefetch, msg + comps->buf[0],
+                                   comps->buf[comps->n - 2] - comps->buf[0]))
+            content->flags |= CCN_CONTENT_ENTRY_PREFETCHED;
         /* Mark public keys supplied at startup as precious. */
-        if (obj.type == CCN_CONTENT_KEY && content->accession <= (h->capacity + 7)/8)
+        if (obj.type == CCN_CONTENT_KEY && h->accession <= (h->capacity + 7)/8)
             content->flags |= CCN_CONTENT_ENTRY_PRECIOUS;
+        else if (s->cache != NULL)
+            ccnd_cache_enroll(s->cache, content);
     }
     hashtb_end(e);
+    if (res == HT_NEW_ENTRY)
+        content_quota_charge(h, content);
 Bail:
     indexbuf_release(h, comps);
     charbuf_release(h, cb);
+    charbuf_release(h, flat);
     cb = NULL;
     if (res >= 0 && content != NULL) {
         int n_matches;
         enum cq_delay_class c;
         struct content_queue *q;
+        if (h->trace_on)
+            trace_content(h, CCND_TR_CONTENT_IN, face->faceid, content, 1,
+                          content->accession);
         n_matches = match_interests(h, content, &obj, NULL, face);
         if (res == HT_NEW_ENTRY) {
             if (n_matches < 0) {
@@ -4185,11 +8504,18 @@ Bail:
                 content->flags |= CCN_CONTENT_ENTRY_SLOWSEND;
                 ccn_indexbuf_append_element(h->unsol, content->accession);
             }
+            else if ((face->flags & CCN_FACE_GG) == 0 &&
+                     !content_admitted(h, content, nocache)) {
+                /* Pass it on, but do not answer from it again */
+                h->content_passed++;
+                mark_stale(h, content);
+                ccn_indexbuf_append_element(h->unsol, content->accession);
+            }
         }
         for (c = 0; c < CCN_CQ_N; c++) {
             q = face->q[c];
             if (q != NULL) {
-                i = ccn_indexbuf_member(q->send_queue, content->accession);
+                i = content_queue_member(q, content->accession, &tc);
                 if (i >= 0) {
                     /*
                      * In the case this consumed any interests from this source,
@@ -4197,7 +8523,8 @@ Bail:
                      */
                     if (h->debug & 8)
                         ccnd_debug_ccnb(h, __LINE__, "content_nosend", face, msg, size);
-                    q->send_queue->buf[i] = 0;
+                    q->send_queue[tc]->buf[i] = 0;
+                    suppress_adjust(h, face, SUPPRESS_SUPPRESSED);
                 }
             }
         }
@@ -4205,37 +8532,292 @@ Bail:
 }
 
 /**
- * Process an incoming message.
+ * Bring content back from the disk cache.
  *
- * This is where we decide whether we have an Interest message,
- * a ContentObject, or something else.
+ * The objects come in as if they had arrived on face 0, so they answer
+ * the interests that asked for them before those are sent upstream.
+ */
+static int
+disk_reader(struct ccn_schedule *sched,
+            void *clienth,
+            struct ccn_scheduled_event *ev,
+            int flags)
+{
+    struct ccnd_handle *h = clienth;
+    unsigned char *obj = NULL;
+    size_t size = 0;
+    int res;
+    
+    (void)(sched);
+    (void)(ev);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        h->disk_reader = NULL;
+        return(0);
+    }
+    while ((res = ccnd_disk_next(h->disk, &obj, &size)) != 0) {
+        if (res > 0)
+            process_incoming_content(h, h->face0, obj, size);
+    }
+    h->disk_reader = NULL;
+    return(0);
+}
+
+/**
+ * Ask the disk cache for content with exactly the name of an interest
+ * that missed in memory.
  */
 static void
-process_input_message(struct ccnd_handle *h, struct face *face,
-                      unsigned char *msg, size_t size, int pdu_ok)
+disk_fetch(struct ccnd_handle *h, const unsigned char *msg,
+           const struct ccn_indexbuf *comps)
+{
+    if (comps->n < 1)
+        return;
+    if (ccnd_disk_want(h->disk, msg + comps->buf[0],
+                       comps->buf[comps->n - 1] - comps->buf[0]) &&
+          h->disk_reader == NULL)
+        h->disk_reader = ccn_schedule_event(h->sched, 0, disk_reader, NULL, 0);
+}
+
+/**
+ * Send the prefetching interests that have built up.
+ *
+ * They come in as if from face 0, after the interest that prompted
+ * them has been dealt with.
+ */
+static int
+prefetch_sender(struct ccn_schedule *sched,
+                void *clienth,
+                struct ccn_scheduled_event *ev,
+                int flags)
 {
+    struct ccnd_handle *h = clienth;
+    struct ccn_charbuf *out = h->prefetch_out;
     struct ccn_skeleton_decoder decoder = {0};
     struct ccn_skeleton_decoder *d = &decoder;
+    size_t start = 0;
     ssize_t dres;
-    enum ccn_dtag dtag;
     
-    if ((face->flags & CCN_FACE_UNDECIDED) != 0) {
-        face->flags &= ~CCN_FACE_UNDECIDED;
-        if ((face->flags & CCN_FACE_LOOPBACK) != 0)
-            face->flags |= CCN_FACE_GG;
-        /* YYY This is the first place that we know that an inbound stream face is speaking CCNx protocol. */
-        register_new_face(h, face);
+    (void)(sched);
+    (void)(ev);
+    h->prefetch_sender = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || out == NULL)
+        return(0);
+    h->prefetch_out = NULL;
+    while (start < out->length) {
+        d->state = 0;
+        dres = ccn_skeleton_decode(d, out->buf + start, out->length - start);
+        if (d->state != 0 || dres <= 0)
+            break;
+        process_input_message(h, h->face0, out->buf + start, dres, 0);
+        start += dres;
     }
-    d->state |= CCN_DSTATE_PAUSE;
-    dres = ccn_skeleton_decode(d, msg, size);
-    if (d->state < 0)
-        abort(); /* cannot happen because of checks in caller */
+    if (h->prefetch_out == NULL) {
+        out->length = 0;
+        h->prefetch_out = out;
+    }
+    else
+        ccn_charbuf_destroy(&out);
+    return(0);
+}
+
+/**
+ * Follow an interest for a segment, and ask ahead for the segments
+ * after it if the face is reading in sequence.
+ *
+ * The segment is the last component of the interest name, with the
+ * CCN_MARKER_SEQNUM marker.
+ */
+static void
+prefetch_note(struct ccnd_handle *h, struct face *face,
+              const unsigned char *msg, const struct ccn_indexbuf *comps)
+{
+    struct ccn_charbuf *c = NULL;
+    const unsigned char *seg = NULL;
+    const unsigned char *prefix = NULL;
+    size_t segsize = 0;
+    size_t prefixsize;
+    size_t start;
+    uintmax_t seq = 0;
+    uintmax_t first = 0;
+    uintmax_t v;
+    unsigned char b[1 + sizeof(uintmax_t)];
+    int n;
+    int i;
+    int k;
+    
+    if (comps->n < 2)
+        return;
+    if (ccn_ref_tagged_BLOB(CCN_DTAG_Component, msg,
+                            comps->buf[comps->n - 2], comps->buf[comps->n - 1],
+                            &seg, &segsize) < 0)
+        return;
+    if (segsize < 1 || seg[0] != CCN_MARKER_SEQNUM ||
+          segsize > sizeof(b))
+        return;
+    for (i = 1; i < (int)segsize; i++)
+        seq = (seq << 8) + seg[i];
+    prefix = msg + comps->buf[0];
+    prefixsize = comps->buf[comps->n - 2] - comps->buf[0];
+    n = ccnd_prefetch_note(h->prefetch, face->faceid, h->sec,
+                           prefix, prefixsize, seq, &first);
+    if (n <= 0)
+        return;
+    if (h->prefetch_out == NULL)
+        h->prefetch_out = ccn_charbuf_create();
+    c = h->prefetch_out;
+    if (c == NULL)
+        return;
+    for (; n > 0; n--, first++) {
+        for (k = sizeof(b), v = first; v != 0; v >>= 8)
+            b[--k] = v & 0xff;
+        b[--k] = CCN_MARKER_SEQNUM;
+        ccn_charbuf_append_tt(c, CCN_DTAG_Interest, CCN_DTAG);
+        ccn_charbuf_append_tt(c, CCN_DTAG_Name, CCN_DTAG);
+        start = c->length;
+        ccn_charbuf_append(c, prefix, prefixsize);
+        ccnb_append_tagged_blob(c, CCN_DTAG_Component, b + k, sizeof(b) - k);
+        ccnd_prefetch_expect(h->prefetch, h->sec,
+                             c->buf + start, c->length - start);
+        ccn_charbuf_append_closer(c); /* </Name> */
+        ccn_charbuf_append_closer(c); /* </Interest> */
+    }
+    if (h->prefetch_sender == NULL)
+        h->prefetch_sender = ccn_schedule_event(h->sched, 0, prefetch_sender,
+                                                NULL, 0);
+}
+
+/**
+ * Handle a local client's request to use shared-memory rings.
+ *
+ * This must be the first message on a unix-domain stream, so nothing
+ * has been sent to the client yet; the client sends nothing more until
+ * it has our answer.  The rings are made here, sealed at their size,
+ * and the descriptor goes to the client with an "ok" answer; everything
+ * after that goes through the rings.  See CCN_SHM_URI.
+ * A request that ends with CCN_SHM_FRAMED makes the face a framed one.
+ * @returns 1 if msg was such a request, 0 if it should be processed
+ *          as an ordinary Interest.
+ */
+static int
+ccnd_shm_request(struct ccnd_handle *h, struct face *face,
+                 unsigned char *msg, size_t size)
+{
+    static const char *prefix[2] = {"\xC1.M.S.localhost", "\xC1.M.SHM"};
+    struct ccn_parsed_interest pi = {0};
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_indexbuf *comps = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_charbuf *reply = NULL;
+    struct ccn_shmring *r = NULL;
+    const unsigned char *comp = NULL;
+    size_t compsize = 0;
+    ssize_t sres;
+    int ans = 0;
+    int framed = 0;
+    int fd = -1;
+    int i, res;
+    
+    if ((face->flags & (CCN_FACE_LOCAL | CCN_FACE_DGRAM)) != CCN_FACE_LOCAL ||
+        face->shm != NULL || face->outq != NULL)
+        return(0);
+    comps = indexbuf_obtain(h);
+    res = ccn_parse_interest(msg, size, &pi, comps);
+    if (res != 2 && res != 3)
+        goto Finish;
+    for (i = 0; i < 2; i++) {
+        ccn_name_comp_get(msg, comps, i, &comp, &compsize);
+        if (compsize != strlen(prefix[i]) || memcmp(comp, prefix[i], compsize) != 0)
+            goto Finish;
+    }
+    if (res == 3) {
+        ccn_name_comp_get(msg, comps, 2, &comp, &compsize);
+        if (compsize != strlen(CCN_SHM_FRAMED) ||
+            memcmp(comp, CCN_SHM_FRAMED, compsize) != 0)
+            goto Finish;
+        framed = 1;
+    }
+    ans = 1;
+    r = ccn_shmring_create(CCN_SHMRING_SIZE, face->recv_fd, &fd);
+    name = ccn_charbuf_create();
+    reply = ccn_charbuf_create();
+    ccn_charbuf_append(name, msg + pi.offset[CCN_PI_B_Name],
+                       pi.offset[CCN_PI_E_Name] - pi.offset[CCN_PI_B_Name]);
+    res = ccn_sign_content(h->internal_client, reply, name, &sp,
+                           r != NULL ? "ok" : "no", 2);
+    if (res < 0) {
+        ccn_shmring_destroy(&r);
+        goto Finish;
+    }
+    if (r == NULL) {
+        ccnd_send(h, face, reply->buf, reply->length);
+        goto Finish;
+    }
+    /* Nothing else has been sent to the face, so this goes out first */
+    sres = ccn_shmring_sendfd(face->recv_fd, reply->buf, reply->length, fd);
+    if (sres > 0)
+        ccnd_meter_bump(h, face->meter[FM_BYTO], sres);
+    if (sres != reply->length) {
+        /* The answer did not go in one piece, so give up on the client */
+        ccnd_msg(h, "shm: short answer on face %u", face->faceid);
+        ccn_shmring_destroy(&r);
+        face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+        face_io_update(h, face);
+        goto Finish;
+    }
+    face->shm = r;
+    if (framed)
+        face->flags |= CCN_FACE_FRAMED;
+    if (h->debug & 2)
+        ccnd_msg(h, "shm: face %u uses shared rings%s", face->faceid,
+                 framed ? " (framed)" : "");
+Finish:
+    if (fd != -1)
+        close(fd);
+    indexbuf_release(h, comps);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&reply);
+    return(ans);
+}
+
+/**
+ * Process an incoming message.
+ *
+ * This is where we decide whether we have an Interest message,
+ * a ContentObject, or something else.
+ */
+static void
+process_input_message(struct ccnd_handle *h, struct face *face,
+                      unsigned char *msg, size_t size, int pdu_ok)
+{
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    ssize_t dres;
+    enum ccn_dtag dtag;
+    int first = 0;
+    
+    h->busy_sec = h->sec;
+    if ((face->flags & CCN_FACE_UNDECIDED) != 0) {
+        first = 1;
+        face->flags &= ~CCN_FACE_UNDECIDED;
+        if ((face->flags & CCN_FACE_LOOPBACK) != 0)
+            face->flags |= CCN_FACE_GG;
+        /* YYY This is the first place that we know that an inbound stream face is speaking CCNx protocol. */
+        register_new_face(h, face);
+    }
+    d->state |= CCN_DSTATE_PAUSE;
+    dres = ccn_skeleton_decode(d, msg, size);
+    if (d->state < 0)
+        abort(); /* cannot happen because of checks in caller */
     if (CCN_GET_TT_FROM_DSTATE(d->state) != CCN_DTAG) {
         ccnd_msg(h, "discarding unknown message; size = %lu", (unsigned long)size);
         // XXX - keep a count?
         return;
     }
     dtag = d->numval;
+#ifdef CCN_BUF_PROFILE
+    if (dtag != CCN_DTAG_CCNProtocolDataUnit)
+        h->bufprof_msgs++;
+#endif
     switch (dtag) {
         case CCN_DTAG_CCNProtocolDataUnit:
             if (!pdu_ok)
@@ -4259,12 +8841,21 @@ process_input_message(struct ccnd_handle *h, struct face *face,
             }
             return;
         case CCN_DTAG_Interest:
+            if (first && ccnd_shm_request(h, face, msg, size))
+                return;
+            if (face != h->face0 && is_mgmt_interest(h, msg, size)) {
+                mgmt_set_aside(h, face, msg, size);
+                return;
+            }
             process_incoming_interest(h, face, msg, size);
             return;
         case CCN_DTAG_ContentObject:
             process_incoming_content(h, face, msg, size);
             return;
         case CCN_DTAG_SequenceNumber:
+        case CCN_DTAG_LinkFragment:
+        case CCN_DTAG_FragmentRequest:
+        case CCN_DTAG_LinkAck:
             process_incoming_link_message(h, face, dtag, msg, size);
             return;
         default:
@@ -4353,11 +8944,21 @@ get_dgram_source(struct ccnd_handle *h, struct face *face,
         return(face);
     if ((face->flags & CCN_FACE_MCAST) != 0)
         return(face);
+    addr = scrub_sockaddr(addr, addrlen, &space);
+    /* Datagrams tend to come in runs from the same peer */
+    source = face_from_faceid(h, face->last_source);
+    if (source != NULL && source->addr != NULL &&
+          source->addrlen == addrlen &&
+          memcmp(source->addr, addr, addrlen) == 0) {
+        note_face_recv(h, source);
+        return(source);
+    }
+    source = NULL;
     hashtb_start(h->dgram_faces, e);
-    res = hashtb_seek(e, scrub_sockaddr(addr, addrlen, &space), addrlen, 0);
+    res = hashtb_seek(e, addr, addrlen, 0);
     if (res >= 0) {
         source = e->data;
-        source->recvcount++;
+        note_face_recv(h, source);
         if (source->addr == NULL) {
             source->addr = e->key;
             source->addrlen = e->keysize;
@@ -4372,10 +8973,14 @@ get_dgram_source(struct ccnd_handle *h, struct face *face,
                 source = NULL;
             }
             else {
+                note_face_recv(h, source);
+                idle_wheel_insert(h, source, h->reap_tick + CCND_IDLE_TICKS);
                 ccnd_new_face_msg(h, source);
                 reap_needed(h, CCN_INTEREST_LIFETIME_MICROSEC);
             }
         }
+        if (source != NULL)
+            face->last_source = source->faceid;
     }
     hashtb_end(e);
     return(source);
@@ -4416,237 +9021,1508 @@ process_input_buffer(struct ccnd_handle *h, struct face *face)
     memset(d, 0, sizeof(*d));
 }
 
+/*
+ * Shards.
+ *
+ * Several ccnd processes may share a host and its port, binding their
+ * sockets with SO_REUSEPORT, so that the kernel spreads the incoming
+ * datagrams among them by sender.  Each name belongs to just one of
+ * them (see ccn_name_shard), which keeps the PIT and content store for
+ * it.  A datagram that lands on another one is handed over to its
+ * owner on a unix-domain datagram socket, prefixed by the sender's
+ * address, and the owner takes it as if it had come to its own
+ * listener.  Since that listener shares the address, replies go back
+ * to the sender from the expected place.
+ *
+ * Stream connections, and local clients, stay with the ccnd that
+ * accepted them.
+ */
+
 /**
- * Process the input from a socket.
+ * Get the address of the handoff socket of a shard.
+ * @returns 0, or -1 if the name does not fit.
+ */
+static int
+shard_sockaddr(int shard, struct sockaddr_un *sa)
+{
+    size_t n;
+    
+    ccn_setup_sockaddr_un_shard(NULL, shard, sa);
+    n = strlen(sa->sun_path);
+    if (n + sizeof(".dgram") > sizeof(sa->sun_path))
+        return(-1);
+    memcpy(sa->sun_path + n, ".dgram", sizeof(".dgram"));
+    return(0);
+}
+
+/*
+ * Placement.
  *
- * The socket has been found ready for input by the poll call.
- * Decide what face it corresponds to, and after checking for exceptional
- * cases, receive data, parse it into ccnb-encoded messages, and call
- * process_input_message for each one.
+ * On a machine with several NUMA nodes, a shard does best on the node
+ * of the network card queues that feed it, with its tables in that
+ * node's memory.  CCND_CPUS says where the shards go, and each one pins
+ * itself to its CPU before it allocates much.  The kernel's usual
+ * first-touch policy then keeps the memory local.  With a shared port,
+ * SO_INCOMING_CPU asks the kernel to prefer the shard on the CPU that
+ * services the receive queue.
  */
-static void
-process_input(struct ccnd_handle *h, int fd)
+
+#define CCND_MAX_CPUS 1024  /**< CPU numbers must be below this */
+#define CCND_MAX_NODES 64   /**< NUMA node numbers looked for */
+
+/**
+ * Parse a list of CPUs, such as 0-3,8,10-11.
+ * @returns the number stored in cpus (at most max), or -1 if malformed.
+ */
+static int
+parse_cpu_list(const char *s, int *cpus, int max)
 {
-    struct face *face = NULL;
-    struct face *source = NULL;
-    ssize_t res;
-    ssize_t dres;
-    ssize_t msgstart;
-    unsigned char *buf;
-    struct ccn_skeleton_decoder *d;
-    struct sockaddr_storage sstor;
-    socklen_t addrlen = sizeof(sstor);
-    struct sockaddr *addr = (struct sockaddr *)&sstor;
-    int err = 0;
-    socklen_t err_sz;
+    char *end;
+    long lo;
+    long hi;
+    int n = 0;
     
-    face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
-    if (face == NULL)
-        return;
-    if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_PASSIVE)) == CCN_FACE_PASSIVE) {
-        accept_connection(h, fd);
-        check_comm_file(h);
-        return;
-    }
-    err_sz = sizeof(err);
-    res = getsockopt(face->recv_fd, SOL_SOCKET, SO_ERROR, &err, &err_sz);
-    if (res >= 0 && err != 0) {
-        ccnd_msg(h, "error on face %u: %s (%d)", face->faceid, strerror(err), err);
-        if (err == ETIMEDOUT && (face->flags & CCN_FACE_CONNECTING) != 0) {
-            shutdown_client_fd(h, fd);
-            return;
-        }
-    }
-    d = &face->decoder;
-    if (face->inbuf == NULL)
-        face->inbuf = ccn_charbuf_create();
-    if (face->inbuf->length == 0)
-        memset(d, 0, sizeof(*d));
-    buf = ccn_charbuf_reserve(face->inbuf, 8800);
-    memset(&sstor, 0, sizeof(sstor));
-    res = recvfrom(face->recv_fd, buf, face->inbuf->limit - face->inbuf->length,
-            /* flags */ 0, addr, &addrlen);
-    if (res == -1)
-        ccnd_msg(h, "recvfrom face %u :%s (errno = %d)",
-                    face->faceid, strerror(errno), errno);
-    else if (res == 0 && (face->flags & CCN_FACE_DGRAM) == 0)
-        shutdown_client_fd(h, fd);
-    else {
-        source = get_dgram_source(h, face, addr, addrlen, (res == 1) ? 1 : 2);
-        ccnd_meter_bump(h, source->meter[FM_BYTI], res);
-        source->recvcount++;
-        source->surplus = 0; // XXX - we don't actually use this, except for some obscure messages.
-        if (res <= 1 && (source->flags & CCN_FACE_DGRAM) != 0) {
-            // XXX - If the initial heartbeat gets missed, we don't realize the locality of the face.
-            if (h->debug & 128)
-                ccnd_msg(h, "%d-byte heartbeat on %d", (int)res, source->faceid);
-            return;
-        }
-        face->inbuf->length += res;
-        msgstart = 0;
-        if (((face->flags & CCN_FACE_UNDECIDED) != 0 &&
-             face->inbuf->length >= 6 &&
-             0 == memcmp(face->inbuf->buf, "GET ", 4))) {
-            ccnd_stats_handle_http_connection(h, face);
-            return;
-        }
-        dres = ccn_skeleton_decode(d, buf, res);
-        while (d->state == 0) {
-            process_input_message(h, source,
-                                  face->inbuf->buf + msgstart,
-                                  d->index - msgstart,
-                                  (face->flags & CCN_FACE_LOCAL) != 0);
-            msgstart = d->index;
-            if (msgstart == face->inbuf->length) {
-                face->inbuf->length = 0;
-                return;
-            }
-            dres = ccn_skeleton_decode(d,
-                    face->inbuf->buf + d->index, // XXX - msgstart and d->index are the same here - use msgstart
-                    res = face->inbuf->length - d->index);  // XXX - why is res set here?
-        }
-        if ((face->flags & CCN_FACE_DGRAM) != 0) {
-            ccnd_msg(h, "protocol error on face %u, discarding %u bytes",
-                source->faceid,
-                (unsigned)(face->inbuf->length));  // XXX - Should be face->inbuf->length - d->index (or msgstart)
-            face->inbuf->length = 0;
-            /* XXX - should probably ignore this source for a while */
-            return;
-        }
-        else if (d->state < 0) {
-            ccnd_msg(h, "protocol error on face %u", source->faceid);
-            shutdown_client_fd(h, fd);
-            return;
-        }
-        if (msgstart < face->inbuf->length && msgstart > 0) {
-            /* move partial message to start of buffer */
-            memmove(face->inbuf->buf, face->inbuf->buf + msgstart,
-                face->inbuf->length - msgstart);
-            face->inbuf->length -= msgstart;
-            d->index -= msgstart;
+    while (*s != 0 && *s != '\n') {
+        lo = strtol(s, &end, 10);
+        if (end == s || lo < 0 || lo >= CCND_MAX_CPUS)
+            return(-1);
+        hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi >= CCND_MAX_CPUS)
+                return(-1);
+            s = end;
         }
+        for (; lo <= hi && n < max; lo++)
+            cpus[n++] = lo;
+        if (*s == ',')
+            s++;
+        else if (*s != 0 && *s != '\n')
+            return(-1);
     }
+    return(n);
 }
 
 /**
- * Process messages from our internal client.
+ * Learn the NUMA node of each CPU, from sysfs.
  *
- * The internal client's output is input to us.
+ * CPUs that are not found stay at -1, as does everything on a machine
+ * that does not say.
  */
 static void
-process_internal_client_buffer(struct ccnd_handle *h)
+ccnd_cpu_nodes_init(struct ccnd_handle *h)
 {
-    struct face *face = h->face0;
-    if (face == NULL)
-        return;
-    face->inbuf = ccn_grab_buffered_output(h->internal_client);
-    if (face->inbuf == NULL)
+    char path[64];
+    char line[1024];
+    int cpus[CCND_MAX_CPUS];
+    FILE *f;
+    int node;
+    int i;
+    int n;
+    
+    h->cpu_node = malloc(CCND_MAX_CPUS);
+    if (h->cpu_node == NULL)
         return;
-    ccnd_meter_bump(h, face->meter[FM_BYTI], face->inbuf->length);
-    process_input_buffer(h, face);
-    ccn_charbuf_destroy(&(face->inbuf));
+    h->ncpu_node = CCND_MAX_CPUS;
+    memset(h->cpu_node, -1, CCND_MAX_CPUS);
+    for (node = 0; node < CCND_MAX_NODES; node++) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/cpulist", node);
+        f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        if (fgets(line, sizeof(line), f) != NULL) {
+            n = parse_cpu_list(line, cpus, CCND_MAX_CPUS);
+            for (i = 0; i < n; i++)
+                h->cpu_node[cpus[i]] = node;
+        }
+        fclose(f);
+    }
 }
 
 /**
- * Handle errors after send() or sendto().
- * @returns -1 if error has been dealt with, or 0 to defer sending.
+ * @returns the NUMA node of a CPU, or -1 if not known.
  */
 static int
-handle_send_error(struct ccnd_handle *h, int errnum, struct face *face,
-                  const void *data, size_t size)
+ccnd_cpu_node(struct ccnd_handle *h, int cpu)
 {
-    int res = -1;
-    if (errnum == EAGAIN) {
-        res = 0;
-    }
-    else if (errnum == EPIPE) {
-        face->flags |= CCN_FACE_NOSEND;
-        face->outbufindex = 0;
-        ccn_charbuf_destroy(&face->outbuf);
-    }
-    else {
-        ccnd_msg(h, "send to face %u failed: %s (errno = %d)",
-                 face->faceid, strerror(errnum), errnum);
-        if (errnum == EISCONN)
-            res = 0;
-    }
-    return(res);
+    if (h->cpu_node == NULL || cpu < 0 || cpu >= h->ncpu_node)
+        return(-1);
+    return(h->cpu_node[cpu]);
 }
 
 /**
- * Determine what socket to use to send on a face.
+ * Pin ourselves to a CPU, as directed by CCND_CPUS.
  *
- * For streams, this just returns the associated fd.
- *
- * For datagrams, one fd may be in use for many faces, so we need to find the
- * right one to use.
- *
- * This is not as smart as it should be for situations where
- * CCND_LISTEN_ON has been specified.
+ * Shard k runs on the k-th CPU listed, wrapping around.
  */
-static int
-sending_fd(struct ccnd_handle *h, struct face *face)
+static void
+ccnd_cpu_init(struct ccnd_handle *h)
 {
-    struct face *out = NULL;
-    if (face->sendface == face->faceid)
-        return(face->recv_fd);
-    out = face_from_faceid(h, face->sendface);
-    if (out != NULL)
-        return(out->recv_fd);
-    face->sendface = CCN_NOFACEID;
-    if (face->addr != NULL) {
-        switch (face->addr->sa_family) {
-            case AF_INET:
-                face->sendface = h->ipv4_faceid;
-                break;
-            case AF_INET6:
-                face->sendface = h->ipv6_faceid;
-                break;
-            default:
-                break;
+    const char *s;
+    int cpus[CCND_MAX_CPUS];
+    int n;
+    int k;
+    
+    h->cpu = -1;
+    h->numa_node = -1;
+    memset(h->shard_node, -1, sizeof(h->shard_node));
+    s = getenv("CCND_CPUS");
+    if (s == NULL || s[0] == 0)
+        return;
+    n = parse_cpu_list(s, cpus, CCND_MAX_CPUS);
+    if (n <= 0) {
+        ccnd_msg(h, "CCND_CPUS=%s is not a list of CPUs, ignored", s);
+        return;
+    }
+#if defined(CCND_HAVE_AFFINITY)
+    {
+        cpu_set_t set;
+        
+        CPU_ZERO(&set);
+        CPU_SET(cpus[h->shard % n], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            ccnd_msg(h, "CCND_CPUS=%s: cpu %d: %s", s, cpus[h->shard % n],
+                     strerror(errno));
+            return;
         }
     }
-    out = face_from_faceid(h, face->sendface);
-    if (out != NULL)
-        return(out->recv_fd);
-    return(-1);
+    h->cpu = cpus[h->shard % n];
+    ccnd_cpu_nodes_init(h);
+    h->numa_node = ccnd_cpu_node(h, h->cpu);
+    for (k = 0; k < h->nshards; k++)
+        h->shard_node[k] = ccnd_cpu_node(h, cpus[k % n]);
+    ccnd_msg(h, "CCND_CPUS=%s running on cpu %d, node %d",
+             s, h->cpu, h->numa_node);
+#else
+    ccnd_msg(h, "CCND_CPUS is not supported on this platform, ignored");
+#endif
 }
 
 /**
- * Send data to the face.
+ * Count datagrams that were received through a CPU on another node.
  *
- * No direct error result is provided; the face state is updated as needed.
+ * The socket remembers which CPU handled its latest packet, so this
+ * samples once per batch of n.
  */
-void
-ccnd_send(struct ccnd_handle *h,
-          struct face *face,
-          const void *data, size_t size)
+static void
+note_incoming_cpu(struct ccnd_handle *h, int fd, int n)
 {
-    ssize_t res;
-    if ((face->flags & CCN_FACE_NOSEND) != 0)
-        return;
-    face->surplus++;
-    if (face->outbuf != NULL) {
-        ccn_charbuf_append(face->outbuf, data, size);
+#if defined(SO_INCOMING_CPU)
+    socklen_t len;
+    int cpu = -1;
+    int node;
+    
+    len = sizeof(cpu);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == -1)
         return;
-    }
-    if (face == h->face0) {
-        ccnd_meter_bump(h, face->meter[FM_BYTO], size);
-        ccn_dispatch_message(h->internal_client, (void *)data, size);
+    node = ccnd_cpu_node(h, cpu);
+    if (node >= 0 && node != h->numa_node)
+        h->xnode_in += n;
+#endif
+}
+
+/**
+ * Work out which shard we are, as directed by CCN_SHARDS and CCN_SHARD,
+ * and take our place.
+ *
+ * Shards are how ccnd uses more than one core, since a single ccnd
+ * has no worker threads (see ccnd_run).
+ *
+ * This comes early, so that our memory is allocated where we run.
+ */
+static void
+ccnd_shard_setup(struct ccnd_handle *h)
+{
+    const char *s;
+    
+    h->nshards = ccn_local_shards();
+    h->shard_components = ccn_shard_components();
+    h->shard = 0;
+    h->shard_faceid = CCN_NOFACEID;
+    s = getenv("CCN_SHARD");
+    if (h->nshards > 1 && s != NULL && s[0] != 0)
+        h->shard = atoi(s);
+    if (h->shard < 0 || h->shard >= h->nshards) {
+        ccnd_msg(h, "CCN_SHARD=%s is out of range, using 0", s);
+        h->shard = 0;
+    }
+    ccnd_cpu_init(h);
+}
+
+/**
+ * Set up for sharing the port.
+ */
+static void
+ccnd_shards_init(struct ccnd_handle *h)
+{
+    struct sockaddr_un sa;
+    struct face *face;
+    int savedmask;
+    int fd;
+    
+    if (h->nshards <= 1)
+        return;
+    ccnd_msg(h, "CCN_SHARDS=%d CCN_SHARD=%d CCN_SHARD_COMPONENTS=%d",
+             h->nshards, h->shard, h->shard_components);
+    if (shard_sockaddr(h->shard, &sa) < 0) {
+        ccnd_msg(h, "shard socket name too long, not taking handoffs");
+        return;
+    }
+    unlink(sa.sun_path);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        ccnd_msg(h, "shard socket: %s", strerror(errno));
+        return;
+    }
+    /* Only our own user gets to speak for remote senders */
+    savedmask = umask(0177);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+        umask(savedmask);
+        ccnd_msg(h, "%s: %s", sa.sun_path, strerror(errno));
+        close(fd);
+        return;
+    }
+    umask(savedmask);
+    face = record_connection(h, fd, (struct sockaddr *)&sa, sizeof(sa),
+                             CCN_FACE_DGRAM | CCN_FACE_PASSIVE);
+    if (face == NULL) {
+        close(fd);
+        unlink(sa.sun_path);
+        return;
+    }
+    h->shard_faceid = face->faceid;
+    ccnd_msg(h, "taking handoffs on %s", sa.sun_path);
+}
+
+/**
+ * Find which shard owns the name in the first message of a datagram.
+ * @returns the shard, or -1 if it is not an Interest or ContentObject.
+ */
+static int
+shard_of_dgram(struct ccnd_handle *h, const unsigned char *buf, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    
+    d = ccn_buf_decoder_start(&decoder, buf, size);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Interest))
+        ccn_buf_advance(d);
+    else if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject)) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_dtag(d, CCN_DTAG_Signature))
+            ccn_buf_advance_past_element(d);
+    }
+    else
+        return(-1);
+    if (d->decoder.state < 0 || d->decoder.token_index >= size)
+        return(-1);
+    return(ccn_name_shard(buf + d->decoder.token_index,
+                          size - d->decoder.token_index,
+                          h->shard_components, h->nshards));
+}
+
+/**
+ * Hand a datagram to the shard that owns it, if that is not us.
+ *
+ * If the owner cannot be reached, we keep the datagram ourselves.
+ * @returns 1 if it was handed off, else 0.
+ */
+static int
+shard_handoff(struct ccnd_handle *h, unsigned char *buf, size_t size,
+              struct sockaddr *addr, socklen_t addrlen)
+{
+    struct sockaddr_un sa;
+    struct msghdr mh = {0};
+    struct iovec iov[3];
+    struct face *link;
+    uint32_t len = addrlen;
+    int shard;
+    
+    shard = shard_of_dgram(h, buf, size);
+    if (shard < 0 || shard == h->shard)
+        return(0);
+    link = face_from_faceid(h, h->shard_faceid);
+    if (link == NULL || shard_sockaddr(shard, &sa) < 0)
+        return(0);
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof(len);
+    iov[1].iov_base = addr;
+    iov[1].iov_len = addrlen;
+    iov[2].iov_base = buf;
+    iov[2].iov_len = size;
+    mh.msg_name = &sa;
+    mh.msg_namelen = sizeof(sa);
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 3;
+    if (sendmsg(link->recv_fd, &mh, MSG_DONTWAIT) == -1) {
+        if (h->debug & 2)
+            ccnd_msg(h, "handoff to shard %d: %s", shard, strerror(errno));
+        return(0);
+    }
+    h->shard_out++;
+    if (h->numa_node >= 0 && h->shard_node[shard] >= 0 &&
+          h->shard_node[shard] != h->numa_node)
+        h->xnode_out++;
+    return(1);
+}
+
+static void deliver_dgram(struct ccnd_handle *h, struct face *face,
+                          unsigned char *buf, size_t size,
+                          struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * Take a datagram handed over by another shard.
+ */
+static void
+shard_takeover(struct ccnd_handle *h, unsigned char *buf, size_t size)
+{
+    struct sockaddr_storage sstor;
+    struct face *face;
+    uint32_t len;
+    
+    if (size < sizeof(len))
+        return;
+    memcpy(&len, buf, sizeof(len));
+    if (len > sizeof(sstor) || len < sizeof(struct sockaddr) ||
+          size - sizeof(len) < len)
+        return;
+    memcpy(&sstor, buf + sizeof(len), len);
+    if (sstor.ss_family == AF_INET)
+        face = face_from_faceid(h, h->ipv4_faceid);
+    else if (sstor.ss_family == AF_INET6)
+        face = face_from_faceid(h, h->ipv6_faceid);
+    else
+        return;
+    if (face == NULL)
+        return;
+    h->shard_in++;
+    deliver_dgram(h, face, buf + sizeof(len) + len, size - sizeof(len) - len,
+                  (struct sockaddr *)&sstor, len);
+}
+
+/**
+ * Process one received datagram.
+ *
+ * When the port is shared, the datagram may belong to another shard.
+ */
+static void
+process_dgram(struct ccnd_handle *h, struct face *face,
+              unsigned char *buf, size_t size,
+              struct sockaddr *addr, socklen_t addrlen)
+{
+    if (h->nshards > 1) {
+        if (face->faceid == h->shard_faceid) {
+            shard_takeover(h, buf, size);
+            return;
+        }
+        if ((face->flags & CCN_FACE_MCAST) == 0 && size > 1 &&
+              shard_handoff(h, buf, size, addr, addrlen))
+            return;
+    }
+    deliver_dgram(h, face, buf, size, addr, addrlen);
+}
+
+/**
+ * Deliver a datagram to the face of its sender.
+ *
+ * A datagram must hold a whole number of ccnb messages; anything
+ * left over is discarded.
+ */
+static void
+deliver_dgram(struct ccnd_handle *h, struct face *face,
+              unsigned char *buf, size_t size,
+              struct sockaddr *addr, socklen_t addrlen)
+{
+    struct ccn_skeleton_decoder ds = {0};
+    struct ccn_skeleton_decoder *d = &ds;
+    struct face *source = NULL;
+    size_t msgstart = 0;
+    
+    source = get_dgram_source(h, face, addr, addrlen, (size == 1) ? 1 : 2);
+    if (source == NULL)
+        return;
+    ccnd_meter_bump(h, source->meter[FM_BYTI], size);
+    note_face_recv(h, source);
+    source->surplus = 0;
+    if (size <= 1 && (source->flags & CCN_FACE_DGRAM) != 0) {
+        if (h->debug & 128)
+            ccnd_msg(h, "%d-byte heartbeat on %d", (int)size, source->faceid);
+        return;
+    }
+    ccn_skeleton_decode(d, buf, size);
+    while (d->state == 0) {
+        /*
+         * Link faces of our own making, such as ethernet, speak PDUs,
+         * as does a unicast peer that has CCND_LINK_MTU set.
+         */
+        process_input_message(h, source, buf + msgstart, d->index - msgstart,
+                              (face->flags & (CCN_FACE_LOCAL |
+                                              CCN_FACE_LINK)) != 0 ||
+                              (source->flags & (CCN_FACE_DGRAM |
+                                                CCN_FACE_MCAST)) ==
+                              CCN_FACE_DGRAM);
+        msgstart = d->index;
+        if (msgstart == size)
+            return;
+        ccn_skeleton_decode(d, buf + msgstart, size - msgstart);
+    }
+    /* Short frames on an ethernet face come padded with zeros */
+    while (msgstart < size && buf[msgstart] == 0)
+        msgstart++;
+    if (msgstart == size)
+        return;
+    ccnd_msg(h, "protocol error on face %u, discarding %u bytes",
+             source->faceid, (unsigned)(size - msgstart));
+}
+
+/**
+ * Drain datagrams from a bound or multicast socket.
+ *
+ * Up to CCND_DGRAM_BATCH datagrams are consumed per readiness
+ * indication, using a single recvmmsg(2) where available.
+ */
+static void
+process_dgram_input(struct ccnd_handle *h, struct face *face)
+{
+    struct ccnd_dgram_io *io = h->dgram_io;
+    unsigned faceid = face->faceid;
+    int fd = face->recv_fd;
+    int i;
+#if defined(CCND_HAVE_MMSG)
+    int n;
+    struct mmsghdr mm[CCND_DGRAM_BATCH];
+    struct iovec iov[CCND_DGRAM_BATCH];
+    
+    memset(mm, 0, sizeof(mm));
+    for (i = 0; i < CCND_DGRAM_BATCH; i++) {
+        iov[i].iov_base = io->rbuf[i];
+        iov[i].iov_len = sizeof(io->rbuf[i]);
+        mm[i].msg_hdr.msg_iov = &iov[i];
+        mm[i].msg_hdr.msg_iovlen = 1;
+        mm[i].msg_hdr.msg_name = &io->raddr[i];
+        mm[i].msg_hdr.msg_namelen = sizeof(io->raddr[i]);
+    }
+    n = recvmmsg(fd, mm, CCND_DGRAM_BATCH, MSG_DONTWAIT, NULL);
+    if (n == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            ccnd_msg(h, "recvmmsg face %u :%s (errno = %d)",
+                     faceid, strerror(errno), errno);
+        return;
+    }
+    if (h->numa_node >= 0 && faceid != h->shard_faceid)
+        note_incoming_cpu(h, fd, n);
+    for (i = 0; i < n; i++) {
+        process_dgram(h, face, io->rbuf[i], mm[i].msg_len,
+                      (struct sockaddr *)&io->raddr[i],
+                      mm[i].msg_hdr.msg_namelen);
+        /* face may have vanished, bail out if it did */
+        if (face_from_faceid(h, faceid) != face)
+            return;
+    }
+#else
+    ssize_t res;
+    socklen_t addrlen;
+    
+    for (i = 0; i < CCND_DGRAM_BATCH; i++) {
+        addrlen = sizeof(io->raddr[0]);
+        memset(&io->raddr[0], 0, addrlen);
+        res = recvfrom(fd, io->rbuf[0], sizeof(io->rbuf[0]), 0,
+                       (struct sockaddr *)&io->raddr[0], &addrlen);
+        if (res == -1) {
+            if (i == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                ccnd_msg(h, "recvfrom face %u :%s (errno = %d)",
+                         faceid, strerror(errno), errno);
+            return;
+        }
+        process_dgram(h, face, io->rbuf[0], res,
+                      (struct sockaddr *)&io->raddr[0], addrlen);
+        if (face_from_faceid(h, faceid) != face)
+            return;
+    }
+#endif
+}
+
+/**
+ * Handle newly received data on a face.
+ *
+ * The res bytes at buf have just been placed at the end of face->inbuf
+ * (though not yet counted in its length).  Parse them, along with any
+ * partial message left from before, into ccnb-encoded messages, and call
+ * process_input_message for each one.
+ */
+static void
+process_received(struct ccnd_handle *h, struct face *face,
+                 unsigned char *buf, ssize_t res,
+                 struct sockaddr *addr, socklen_t addrlen)
+{
+    struct face *source = NULL;
+    struct ccn_skeleton_decoder *d = &face->decoder;
+    ssize_t dres;
+    ssize_t msgstart;
+    int fd = face->recv_fd;
+    
+    if (res == 0 && (face->flags & CCN_FACE_DGRAM) == 0) {
+        shutdown_client_fd(h, fd);
+        return;
+    }
+    source = get_dgram_source(h, face, addr, addrlen, (res == 1) ? 1 : 2);
+    ccnd_meter_bump(h, source->meter[FM_BYTI], res);
+    note_face_recv(h, source);
+    source->surplus = 0; // XXX - we don't actually use this, except for some obscure messages.
+    if (res <= 1 && (source->flags & CCN_FACE_DGRAM) != 0) {
+        // XXX - If the initial heartbeat gets missed, we don't realize the locality of the face.
+        if (h->debug & 128)
+            ccnd_msg(h, "%d-byte heartbeat on %d", (int)res, source->faceid);
+        return;
+    }
+    face->inbuf->length += res;
+    msgstart = 0;
+    if (((face->flags & CCN_FACE_UNDECIDED) != 0 &&
+         face->inbuf->length >= 6 &&
+         0 == memcmp(face->inbuf->buf, "GET ", 4))) {
+        if (ccnd_stats_handle_http_connection(h, face) == 0)
+            face_io_update(h, face);
+        return;
+    }
+    dres = ccn_skeleton_decode(d, buf, res);
+    while (d->state == 0) {
+        process_input_message(h, source,
+                              face->inbuf->buf + msgstart,
+                              d->index - msgstart,
+                              (face->flags & CCN_FACE_LOCAL) != 0);
+        msgstart = d->index;
+        if (msgstart == face->inbuf->length) {
+            face->inbuf->length = 0;
+            return;
+        }
+        dres = ccn_skeleton_decode(d,
+                face->inbuf->buf + d->index, // XXX - msgstart and d->index are the same here - use msgstart
+                res = face->inbuf->length - d->index);  // XXX - why is res set here?
+    }
+    if ((face->flags & CCN_FACE_DGRAM) != 0) {
+        ccnd_msg(h, "protocol error on face %u, discarding %u bytes",
+            source->faceid,
+            (unsigned)(face->inbuf->length));  // XXX - Should be face->inbuf->length - d->index (or msgstart)
+        face->inbuf->length = 0;
+        /* XXX - should probably ignore this source for a while */
+        return;
+    }
+    else if (d->state < 0) {
+        ccnd_msg(h, "protocol error on face %u", source->faceid);
+        shutdown_client_fd(h, fd);
+        return;
+    }
+    if (msgstart < face->inbuf->length && msgstart > 0) {
+        /* move partial message to start of buffer */
+        memmove(face->inbuf->buf, face->inbuf->buf + msgstart,
+            face->inbuf->length - msgstart);
+        face->inbuf->length -= msgstart;
+        d->index -= msgstart;
+    }
+}
+
+/**
+ * Find the dtag of a message from a framed face without a full decode.
+ * @returns the dtag, or -1 if the message does not start with one.
+ */
+static int
+framed_dtag(const unsigned char *msg, size_t size)
+{
+    unsigned val = 0;
+    size_t i;
+    
+    for (i = 0; i < size && i < 4; i++) {
+        if ((msg[i] & CCN_TT_HBIT) != 0) {
+            if ((msg[i] & CCN_TT_MASK) != CCN_DTAG)
+                return(-1);
+            return((val << (7 - CCN_TT_BITS)) +
+                   ((msg[i] >> CCN_TT_BITS) & CCN_MAX_TINY));
+        }
+        val = (val << 7) + msg[i];
+    }
+    return(-1);
+}
+
+/**
+ * Handle the size bytes of length-framed input at buf from a framed face.
+ *
+ * The messages are found by their length prefixes, and Interests and
+ * ContentObjects go straight to their handlers, which do the full parse;
+ * the client has promised not to send link messages or PDU wrappers.
+ * Anything else gets the usual skeleton check.  The face meters are
+ * bumped once for the batch.
+ */
+static void
+process_framed(struct ccnd_handle *h, struct face *face,
+               unsigned char *buf, size_t size)
+{
+    struct ccn_skeleton_decoder decoder;
+    struct ccn_charbuf *inbuf = face->inbuf;
+    unsigned char *msg = NULL;
+    size_t msgstart = 0;
+    uint32_t len = 0;
+    
+    ccnd_meter_bump(h, face->meter[FM_BYTI], size);
+    note_face_recv(h, face);
+    inbuf->length += size;
+    while (inbuf->length - msgstart >= CCN_SHM_FRAME_BYTES) {
+        memcpy(&len, inbuf->buf + msgstart, CCN_SHM_FRAME_BYTES);
+        if (len == 0 || len > CCND_FRAMED_MAX) {
+            flush_batch_counts(h, face);
+            ccnd_msg(h, "framing error on face %u", face->faceid);
+            shutdown_client_fd(h, face->recv_fd);
+            return;
+        }
+        if (inbuf->length - msgstart - CCN_SHM_FRAME_BYTES < len)
+            break;
+        msg = inbuf->buf + msgstart + CCN_SHM_FRAME_BYTES;
+        msgstart += CCN_SHM_FRAME_BYTES + len;
+        switch (framed_dtag(msg, len)) {
+            case CCN_DTAG_Interest:
+                process_incoming_interest(h, face, msg, len);
+                break;
+            case CCN_DTAG_ContentObject:
+                process_incoming_content(h, face, msg, len);
+                break;
+            default:
+                memset(&decoder, 0, sizeof(decoder));
+                if (ccn_skeleton_decode(&decoder, msg, len) == len &&
+                    decoder.state == 0)
+                    process_input_message(h, face, msg, len, 0);
+                else
+                    ccnd_msg(h, "discarding bad message on face %u; size = %lu",
+                             face->faceid, (unsigned long)len);
+        }
+    }
+    flush_batch_counts(h, face);
+    if (msgstart == inbuf->length)
+        inbuf->length = 0;
+    else if (msgstart > 0) {
+        memmove(inbuf->buf, inbuf->buf + msgstart, inbuf->length - msgstart);
+        inbuf->length -= msgstart;
+    }
+}
+
+/**
+ * Make room for size more bytes of input on a face.
+ *
+ * In the compact profile a face with nothing buffered has no inbuf,
+ * and takes the spare one if there is one.
+ * @returns where the bytes should go.
+ */
+static unsigned char *
+face_inbuf_reserve(struct ccnd_handle *h, struct face *face, size_t size)
+{
+    if (face->inbuf == NULL) {
+        face->inbuf = h->spare_inbuf;
+        h->spare_inbuf = NULL;
+        if (face->inbuf == NULL)
+            face->inbuf = ccn_charbuf_create();
+        if (face->inbuf == NULL)
+            return(NULL);
+    }
+    if (face->inbuf->length == 0)
+        memset(&face->decoder, 0, sizeof(face->decoder));
+    return(ccn_charbuf_reserve(face->inbuf, size));
+}
+
+/**
+ * After input on fd has been processed, give back the face's inbuf
+ * if the compact profile is in use and no partial message is left in it.
+ */
+static void
+face_inbuf_release(struct ccnd_handle *h, int fd)
+{
+    struct face *face;
+    
+    if (!h->compact)
+        return;
+    face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+    if (face == NULL || face->inbuf == NULL || face->inbuf->length != 0)
+        return;
+    if (h->spare_inbuf == NULL &&
+          face->inbuf->limit <= CCND_COMPACT_INBUF_MAX)
+        h->spare_inbuf = face->inbuf;
+    else
+        ccn_charbuf_destroy(&face->inbuf);
+    face->inbuf = NULL;
+}
+
+/**
+ * Take the input that a face's client has put in the rings.
+ *
+ * The doorbell bytes have been received already if drained is nonzero.
+ * We keep going until the ring is empty and we have asked to be rung
+ * for more, and then send whatever output was waiting for room.
+ * If the client has gone, what it left in the ring is still processed
+ * before the face is shut down.
+ */
+static void
+ccnd_shm_input(struct ccnd_handle *h, struct face *face, int drained)
+{
+    int fd = face->recv_fd;
+    unsigned char *buf;
+    ssize_t res;
+    int alive;
+    
+    alive = drained ? 1 : ccn_shmring_drain(face->shm);
+    for (;;) {
+        buf = face_inbuf_reserve(h, face, 8800);
+        if (buf == NULL)
+            break;
+        res = ccn_shmring_read(face->shm, buf,
+                               face->inbuf->limit - face->inbuf->length);
+        if (res > 0) {
+            if ((face->flags & CCN_FACE_FRAMED) != 0)
+                process_framed(h, face, buf, res);
+            else
+                process_received(h, face, buf, res, NULL, 0);
+            /* The face might have gone away */
+            face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+            if (face == NULL || face->shm == NULL)
+                return;
+        }
+        else if (!ccn_shmring_idle(face->shm))
+            break;
+    }
+    face_inbuf_release(h, fd);
+    if (alive <= 0)
+        shutdown_client_fd(h, fd);
+    else if (face->outq != NULL)
+        do_deferred_write(h, fd);
+}
+
+/**
+ * Process the input from a socket.
+ *
+ * The socket has been found ready for input by the poll call.
+ * Decide what face it corresponds to, and after checking for exceptional
+ * cases, receive data and hand it to process_received.
+ */
+static void
+process_input(struct ccnd_handle *h, int fd)
+{
+    struct face *face = NULL;
+    ssize_t res;
+    unsigned char *buf;
+    struct sockaddr_storage sstor;
+    socklen_t addrlen = sizeof(sstor);
+    struct sockaddr *addr = (struct sockaddr *)&sstor;
+    int err = 0;
+    socklen_t err_sz;
+    
+    face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+    if (face == NULL)
+        return;
+    if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_PASSIVE)) == CCN_FACE_PASSIVE) {
+        accept_connection(h, fd);
+        check_comm_file(h);
+        return;
+    }
+    err_sz = sizeof(err);
+    res = getsockopt(face->recv_fd, SOL_SOCKET, SO_ERROR, &err, &err_sz);
+    if (res >= 0 && err != 0) {
+        ccnd_msg(h, "error on face %u: %s (%d)", face->faceid, strerror(err), err);
+        if (err == ETIMEDOUT && (face->flags & CCN_FACE_CONNECTING) != 0) {
+            shutdown_client_fd(h, fd);
+            return;
+        }
+    }
+    if ((face->flags & CCN_FACE_DGRAM) != 0 && h->dgram_io != NULL) {
+        process_dgram_input(h, face);
+        return;
+    }
+    if (face->shm != NULL) {
+        ccnd_shm_input(h, face, 0);
+        return;
+    }
+    buf = face_inbuf_reserve(h, face, 8800);
+    if (buf == NULL)
+        return;
+    memset(&sstor, 0, sizeof(sstor));
+    res = recvfrom(face->recv_fd, buf, face->inbuf->limit - face->inbuf->length,
+            /* flags */ 0, addr, &addrlen);
+    if (res == -1)
+        ccnd_msg(h, "recvfrom face %u :%s (errno = %d)",
+                    face->faceid, strerror(errno), errno);
+    else
+        process_received(h, face, buf, res, addr, addrlen);
+    face_inbuf_release(h, fd);
+}
+
+/**
+ * Process messages from our internal client.
+ *
+ * The internal client's output is input to us.
+ */
+static void
+process_internal_client_buffer(struct ccnd_handle *h)
+{
+    struct face *face = h->face0;
+    if (face == NULL)
+        return;
+    face->inbuf = ccn_grab_buffered_output(h->internal_client);
+    if (face->inbuf == NULL)
+        return;
+    ccnd_meter_bump(h, face->meter[FM_BYTI], face->inbuf->length);
+    process_input_buffer(h, face);
+    ccn_charbuf_destroy(&(face->inbuf));
+}
+
+/**
+ * Make a face for a connected stream socket supplied by the caller.
+ *
+ * This lets an in-process driver such as ccnd_bench attach faces
+ * without going through a listener.
+ */
+struct face *
+ccnd_face_from_fd(struct ccnd_handle *h, int fd)
+{
+    struct sockaddr_storage who = {0};
+    socklen_t wholen = sizeof(who);
+    
+    if (getpeername(fd, (struct sockaddr *)&who, &wholen) == -1)
+        return(NULL);
+    return(record_connection(h, fd, (struct sockaddr *)&who, wholen, 0));
+}
+
+/**
+ * Process one complete ccnb message as though it had arrived on face.
+ */
+void
+ccnd_input_message(struct ccnd_handle *h, struct face *face,
+                   unsigned char *msg, size_t size)
+{
+    ccnd_meter_bump(h, face->meter[FM_BYTI], size);
+    process_input_message(h, face, msg, size, 0);
+}
+
+/**
+ * Handle errors after send() or sendto().
+ * @returns -1 if error has been dealt with, or 0 to defer sending.
+ */
+static int
+handle_send_error(struct ccnd_handle *h, int errnum, struct face *face,
+                  const void *data, size_t size)
+{
+    int res = -1;
+    if (errnum == EAGAIN) {
+        res = 0;
+    }
+    else if (errnum == EPIPE) {
+        face->flags |= CCN_FACE_NOSEND;
+        outq_destroy(&face->outq);
+        face_io_update(h, face);
+    }
+    else {
+        ccnd_msg(h, "send to face %u failed: %s (errno = %d)",
+                 face->faceid, strerror(errnum), errnum);
+        if (errnum == EISCONN)
+            res = 0;
+    }
+    return(res);
+}
+
+/**
+ * Determine what socket to use to send on a face.
+ *
+ * For streams, this just returns the associated fd.
+ *
+ * For datagrams, one fd may be in use for many faces, so we need to find the
+ * right one to use.
+ *
+ * This is not as smart as it should be for situations where
+ * CCND_LISTEN_ON has been specified.
+ */
+static int
+sending_fd(struct ccnd_handle *h, struct face *face)
+{
+    struct face *out = NULL;
+    if (face->sendface == face->faceid)
+        return(face->recv_fd);
+    out = face_from_faceid(h, face->sendface);
+    if (out != NULL)
+        return(out->recv_fd);
+    face->sendface = CCN_NOFACEID;
+    if (face->addr != NULL) {
+        switch (face->addr->sa_family) {
+            case AF_INET:
+                face->sendface = h->ipv4_faceid;
+                break;
+            case AF_INET6:
+                face->sendface = h->ipv6_faceid;
+                break;
+            default:
+                break;
+        }
+    }
+    out = face_from_faceid(h, face->sendface);
+    if (out != NULL)
+        return(out->recv_fd);
+    return(-1);
+}
+
+/**
+ * Append a datagram to the pending sendmmsg batch.
+ *
+ * The datagram is gathered from iovcnt pieces totalling size bytes.
+ * The batch is flushed first if it is full or for a different socket.
+ * @returns 0 if the datagram was taken, -1 if the caller should send it.
+ */
+static int
+dgram_batch_add(struct ccnd_handle *h, struct face *face,
+                const struct iovec *iov, int iovcnt, size_t size)
+{
+#if defined(CCND_HAVE_MMSG)
+    struct ccnd_dgram_io *io = h->dgram_io;
+    int fd;
+    int i;
+    int k;
+    
+    if (io == NULL || io->obuf == NULL || face->addr == NULL ||
+        face->addrlen > sizeof(io->out[0].addr))
+        return(-1);
+    fd = sending_fd(h, face);
+    if (fd == -1)
+        return(-1);
+    if (io->n > 0 && (io->fd != fd || io->n == CCND_DGRAM_BATCH))
+        dgram_batch_flush(h);
+    i = io->n;
+    io->out[i].start = io->obuf->length;
+    if (ccn_charbuf_reserve(io->obuf, size) == NULL)
+        return(-1);
+    for (k = 0; k < iovcnt; k++)
+        ccn_charbuf_append(io->obuf, iov[k].iov_base, iov[k].iov_len);
+    io->out[i].size = size;
+    io->out[i].faceid = face->faceid;
+    io->out[i].addrlen = face->addrlen;
+    memcpy(&io->out[i].addr, face->addr, face->addrlen);
+    io->fd = fd;
+    io->n = i + 1;
+    return(0);
+#else
+    return(-1);
+#endif
+}
+
+#if defined(CCND_HAVE_GSO)
+/**
+ * Count the pending datagrams, starting at i, that may be sent as one
+ * UDP_SEGMENT message.
+ *
+ * These go to the same address, and all but the last are the same size,
+ * which is what the kernel will split the message at.  They are already
+ * contiguous in obuf.
+ */
+static int
+dgram_gso_run(struct ccnd_dgram_io *io, int i)
+{
+    size_t seg = io->out[i].size;
+    size_t total = seg;
+    int k;
+    
+    if (seg > io->gso_maxseg)
+        return(1);
+    if (io->out[i].addr.ss_family != AF_INET &&
+        io->out[i].addr.ss_family != AF_INET6)
+        return(1);
+    for (k = i + 1; k < io->n && k - i < CCND_GSO_SEGMENTS; k++) {
+        if (io->out[k].size > seg || total + io->out[k].size > CCND_GSO_BYTES)
+            break;
+        if (io->out[k].addrlen != io->out[i].addrlen ||
+            0 != memcmp(&io->out[k].addr, &io->out[i].addr, io->out[i].addrlen))
+            break;
+        total += io->out[k].size;
+        if (io->out[k].size < seg)
+            return(k + 1 - i);
+    }
+    return(k - i);
+}
+
+/**
+ * Send pending datagrams first through last-1 one at a time.
+ *
+ * This is the fallback when the kernel refuses a segmented send.
+ */
+static void
+dgram_send_each(struct ccnd_handle *h, int first, int last)
+{
+    struct ccnd_dgram_io *io = h->dgram_io;
+    struct face *face;
+    ssize_t res;
+    int k;
+    
+    for (k = first; k < last; k++) {
+        res = sendto(io->fd, io->obuf->buf + io->out[k].start,
+                     io->out[k].size, 0,
+                     (struct sockaddr *)&io->out[k].addr, io->out[k].addrlen);
+        face = face_from_faceid(h, io->out[k].faceid);
+        if (face == NULL)
+            continue;
+        if (res == -1)
+            handle_send_error(h, errno, face,
+                              io->obuf->buf + io->out[k].start,
+                              io->out[k].size);
+        else
+            ccnd_meter_bump(h, face->meter[FM_BYTO], res);
+    }
+}
+#endif
+
+/**
+ * Send the pending batch of datagrams.
+ *
+ * With UDP generic segmentation offload, each run of same-sized
+ * datagrams to one peer goes down as a single message, so the stack is
+ * traversed once per run rather than once per datagram.
+ */
+static void
+dgram_batch_flush(struct ccnd_handle *h)
+{
+#if defined(CCND_HAVE_MMSG)
+    struct ccnd_dgram_io *io = h->dgram_io;
+    struct mmsghdr mm[CCND_DGRAM_BATCH];
+    struct iovec iov[CCND_DGRAM_BATCH];
+    int first[CCND_DGRAM_BATCH + 1]; /* first datagram of each message */
+#if defined(CCND_HAVE_GSO)
+    union {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } ctl[CCND_DGRAM_BATCH];
+    struct cmsghdr *cm;
+#endif
+    struct face *face;
+    int i, k, m, nm;
+    int res;
+    
+    if (io == NULL || io->n == 0)
+        return;
+    memset(mm, 0, sizeof(mm));
+    for (i = 0, nm = 0; i < io->n; i += k, nm++) {
+        k = 1;
+        first[nm] = i;
+        iov[nm].iov_base = io->obuf->buf + io->out[i].start;
+        iov[nm].iov_len = io->out[i].size;
+        mm[nm].msg_hdr.msg_iov = &iov[nm];
+        mm[nm].msg_hdr.msg_iovlen = 1;
+        mm[nm].msg_hdr.msg_name = &io->out[i].addr;
+        mm[nm].msg_hdr.msg_namelen = io->out[i].addrlen;
+#if defined(CCND_HAVE_GSO)
+        k = dgram_gso_run(io, i);
+        if (k > 1) {
+            iov[nm].iov_len = io->out[i + k - 1].start +
+                              io->out[i + k - 1].size - io->out[i].start;
+            mm[nm].msg_hdr.msg_control = ctl[nm].buf;
+            mm[nm].msg_hdr.msg_controllen = sizeof(ctl[nm].buf);
+            cm = CMSG_FIRSTHDR(&mm[nm].msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            *(uint16_t *)(void *)CMSG_DATA(cm) = io->out[i].size;
+        }
+#endif
+    }
+    first[nm] = io->n;
+    for (m = 0; m < nm;) {
+        res = sendmmsg(io->fd, mm + m, nm - m, 0);
+        if (res > 0) {
+            for (k = first[m]; k < first[m + res]; k++) {
+                face = face_from_faceid(h, io->out[k].faceid);
+                if (face != NULL)
+                    ccnd_meter_bump(h, face->meter[FM_BYTO], io->out[k].size);
+            }
+            m += res;
+            continue;
+        }
+#if defined(CCND_HAVE_GSO)
+        if (res == -1 && first[m + 1] - first[m] > 1) {
+            /*
+             * Segmentation refused.  EINVAL means this size is too big
+             * for the path; anything else means no GSO here at all.
+             */
+            if (errno == EINVAL)
+                io->gso_maxseg = io->out[first[m]].size - 1;
+            else if (errno != EAGAIN && errno != ENOBUFS) {
+                ccnd_msg(h, "UDP GSO off: %s (errno = %d)",
+                         strerror(errno), errno);
+                io->gso_maxseg = 0;
+            }
+            dgram_send_each(h, first[m], first[m + 1]);
+            m++;
+            continue;
+        }
+#endif
+        /* The datagram at m failed; report it and go on with the rest */
+        face = face_from_faceid(h, io->out[first[m]].faceid);
+        if (face != NULL && res == -1)
+            handle_send_error(h, errno, face, iov[m].iov_base, iov[m].iov_len);
+        m++;
+    }
+    io->n = 0;
+    io->fd = -1;
+    io->obuf->length = 0;
+#endif
+}
+
+/**
+ * Output queues for stream faces
+ *
+ * When a stream face cannot take a whole message, the rest of it and
+ * everything sent after it wait in the face's outq until the socket is
+ * writable again.  ContentObjects are queued by reference to the content
+ * store, so a slow peer does not cost a copy of everything sent to it.
+ * Only a message that has been partly written, or one that did not come
+ * from the content store, is copied.  content_queue_send holds back while
+ * the unsent bytes exceed h->face_outq_cap.
+ */
+#define CCND_OUTQ_IOV 64 /**< max iovecs per write */
+#define CCND_DEFAULT_OUTQ_BYTES (1 << 20) /**< default face_outq_cap */
+
+static struct ccnd_outq *
+outq_create(void)
+{
+    return(calloc(1, sizeof(struct ccnd_outq)));
+}
+
+static void
+outq_destroy(struct ccnd_outq **pq)
+{
+    struct ccnd_outq *q = *pq;
+    int i;
+    if (q == NULL)
+        return;
+    for (i = q->head; i < q->n; i++)
+        ccn_charbuf_destroy(&q->seg[i].copy);
+    free(q->seg);
+    free(q);
+    *pq = NULL;
+}
+
+/**
+ * Make room for a new message at the end of the queue.
+ * @returns the new (zeroed) segment, or NULL for ENOMEM.
+ */
+static struct ccnd_outseg *
+outq_append(struct ccnd_outq *q)
+{
+    struct ccnd_outseg *seg;
+    int limit;
+    if (q->n == q->limit && q->head > 0) {
+        memmove(q->seg, q->seg + q->head, (q->n - q->head) * sizeof(q->seg[0]));
+        q->n -= q->head;
+        q->jump = (q->jump > q->head) ? q->jump - q->head : 0;
+        q->head = 0;
+    }
+    if (q->n == q->limit) {
+        limit = q->limit * 2 + 8;
+        seg = realloc(q->seg, limit * sizeof(q->seg[0]));
+        if (seg == NULL)
+            return(NULL);
+        q->seg = seg;
+        q->limit = limit;
+    }
+    seg = &q->seg[q->n++];
+    memset(seg, 0, sizeof(*seg));
+    return(seg);
+}
+
+/**
+ * Queue a copy of a message, less the first skip bytes.
+ */
+static int
+outq_append_copy(struct ccnd_outq *q,
+                 const struct iovec *iov, int iovcnt, size_t skip)
+{
+    struct ccnd_outseg *seg;
+    struct ccn_charbuf *c;
+    int i;
+    c = ccn_charbuf_create();
+    if (c == NULL)
+        return(-1);
+    for (i = 0; i < iovcnt; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        ccn_charbuf_append(c, ((const unsigned char *)iov[i].iov_base) + skip,
+                           iov[i].iov_len - skip);
+        skip = 0;
+    }
+    seg = outq_append(q);
+    if (seg == NULL) {
+        ccn_charbuf_destroy(&c);
+        return(-1);
+    }
+    seg->copy = c;
+    seg->size = c->length;
+    q->bytes += seg->size;
+    return(0);
+}
+
+/**
+ * Queue a message made of pieces of a content store entry's key.
+ */
+static int
+outq_append_content(struct ccnd_outq *q, struct content_entry *content,
+                    const struct iovec *iov, int iovcnt)
+{
+    struct ccnd_outseg *seg;
+    int i;
+    if (iovcnt > 2)
+        return(outq_append_copy(q, iov, iovcnt, 0));
+    seg = outq_append(q);
+    if (seg == NULL)
+        return(-1);
+    seg->accession = content->accession;
+    for (i = 0; i < iovcnt; i++) {
+        seg->piece[i][0] = (const unsigned char *)iov[i].iov_base - content->key;
+        seg->piece[i][1] = iov[i].iov_len;
+        seg->size += iov[i].iov_len;
+    }
+    q->bytes += seg->size;
+    return(0);
+}
+
+/**
+ * Move the newest message ahead of the others that are waiting, but
+ * behind one that is partly written and any that jumped before it.
+ *
+ * This is how traffic class 0 gets past a backlog on a stream face.
+ */
+static void
+outq_jump(struct ccnd_handle *h, struct ccnd_outq *q)
+{
+    struct ccnd_outseg seg;
+    int pos;
+    
+    pos = q->head;
+    if (q->seg[pos].sent > 0)
+        pos++;
+    if (pos < q->jump)
+        pos = q->jump;
+    if (pos < q->n - 1) {
+        seg = q->seg[q->n - 1];
+        memmove(q->seg + pos + 1, q->seg + pos,
+                (q->n - 1 - pos) * sizeof(q->seg[0]));
+        q->seg[pos] = seg;
+        h->tc_jumps++;
+    }
+    q->jump = pos + 1;
+}
+
+/**
+ * Fill in iovecs for the unsent part of a queued message.
+ * @returns the number used, or 0 if the content has gone away
+ *          or no longer holds the referenced pieces.
+ */
+static int
+outseg_iov(struct ccnd_handle *h, struct ccnd_outseg *seg, struct iovec *iov)
+{
+    struct content_entry *content;
+    int i;
+    if (seg->copy != NULL) {
+        iov[0].iov_base = seg->copy->buf + seg->sent;
+        iov[0].iov_len = seg->size - seg->sent;
+        return(1);
+    }
+    content = content_from_accession(h, seg->accession);
+    if (content == NULL)
+        return(0);
+    /* It has been compressed since, so it has not been sent for a while */
+    if ((content->flags & CCN_CONTENT_ENTRY_COMPRESSED) != 0)
+        return(0);
+    for (i = 0; i < 2 && seg->piece[i][1] != 0; i++) {
+        /* Do not trust a reference that would reach past the object */
+        if (seg->piece[i][0] > content->size ||
+            seg->piece[i][1] > content->size - seg->piece[i][0])
+            return(0);
+        iov[i].iov_base = (void *)(content->key + seg->piece[i][0]);
+        iov[i].iov_len = seg->piece[i][1];
+    }
+    return(i);
+}
+
+/**
+ * Replace a message held by reference with a copy.
+ */
+static int
+outseg_copy(struct ccnd_handle *h, struct ccnd_outseg *seg)
+{
+    struct iovec iov[2];
+    struct ccn_charbuf *c;
+    int i, k;
+    k = outseg_iov(h, seg, iov);
+    c = ccn_charbuf_create();
+    if (c == NULL)
+        return(-1);
+    for (i = 0; i < k; i++)
+        ccn_charbuf_append(c, iov[i].iov_base, iov[i].iov_len);
+    if (c->length != seg->size) {
+        ccn_charbuf_destroy(&c);
+        return(-1);
+    }
+    seg->copy = c;
+    seg->accession = 0;
+    return(0);
+}
+
+/**
+ * Start holding the output for a remote stream face until the end of
+ * this trip through the main loop.
+ *
+ * Everything sent to the face in the meantime goes into its outq, as if
+ * the socket were backed up, and stream_batch_flush then writes it all
+ * with one sendmsg.  So a burst of answers or forwarded interests to a
+ * TCP peer costs one system call and goes out in full-sized segments,
+ * without waiting on anything but the rest of the pass.
+ * Local streams are left alone, since their clients expect each
+ * answer as soon as it is ready, and the shm setup relies on that.
+ * @returns 0 if the caller should create the outq, -1 to send now.
+ */
+static int
+stream_batch_start(struct ccnd_handle *h, struct face *face)
+{
+    if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_LOCAL |
+                        CCN_FACE_NOSEND | CCN_FACE_CORKED)) != 0 ||
+        face->shm != NULL || face == h->face0 || h->corked == NULL)
+        return(-1);
+    if (ccn_indexbuf_append_element(h->corked, face->faceid) < 0)
+        return(-1);
+    face->flags |= CCN_FACE_CORKED;
+    return(0);
+}
+
+/**
+ * Write out the output held by stream_batch_start.
+ *
+ * Whatever does not fit in the socket stays in the outq, and is sent
+ * as the socket becomes writable, just as after a short write.
+ */
+static void
+stream_batch_flush(struct ccnd_handle *h)
+{
+    struct face *face;
+    unsigned faceid;
+    int i;
+    
+    if (h->corked == NULL)
+        return;
+    for (i = 0; i < h->corked->n; i++) {
+        faceid = h->corked->buf[i];
+        face = face_from_faceid(h, faceid);
+        if (face == NULL || (face->flags & CCN_FACE_CORKED) == 0)
+            continue;
+        face->flags &= ~CCN_FACE_CORKED;
+        if (face->outq == NULL)
+            continue;
+        if (face->outq->bytes == 0) {
+            outq_destroy(&face->outq);
+            continue;
+        }
+        face_outq_write(h, face);
+        /* The face may be gone, and otherwise may now want POLLOUT */
+        face = face_from_faceid(h, faceid);
+        if (face != NULL)
+            face_io_update(h, face);
+    }
+    h->corked->n = 0;
+}
+
+/**
+ * Send data to the face.
+ *
+ * No direct error result is provided; the face state is updated as needed.
+ *
+ * Datagrams may be held briefly to be sent in a batch; see dgram_batch_add.
+ * Likewise stream output to remote peers; see stream_batch_start.
+ */
+void
+ccnd_send(struct ccnd_handle *h,
+          struct face *face,
+          const void *data, size_t size)
+{
+    struct iovec iov;
+    
+    iov.iov_base = (void *)data;
+    iov.iov_len = size;
+    ccnd_sendv(h, face, &iov, 1, NULL);
+}
+
+/**
+ * Send a message, gathered from iovcnt pieces, to the face.
+ *
+ * This lets callers such as send_content hand over a ContentObject
+ * straight from the content store without first copying it.
+ * If the pieces come from a content store entry, pass that as content;
+ * then on a backed-up stream face they are queued by reference.
+ */
+static void
+ccnd_sendv(struct ccnd_handle *h, struct face *face,
+           const struct iovec *iov, int iovcnt,
+           struct content_entry *content)
+{
+    struct msghdr msg;
+    struct ccn_charbuf *c = NULL;
+    size_t size = 0;
+    ssize_t res;
+    int i;
+    
+    if ((face->flags & CCN_FACE_NOSEND) != 0)
+        return;
+    h->busy_sec = h->sec;
+    face->surplus++;
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+    shaper_charge(h, face, size);
+    if (face->arq != NULL && face->arq->seq_pending)
+        arq_note_sent(h, face, iov, iovcnt);
+    if (face->outq == NULL && stream_batch_start(h, face) == 0)
+        face->outq = outq_create();
+    if (face->outq != NULL) {
+        if (content != NULL)
+            res = outq_append_content(face->outq, content, iov, iovcnt);
+        else
+            res = outq_append_copy(face->outq, iov, iovcnt, 0);
+        if (res == 0 && h->send_urgent)
+            outq_jump(h, face->outq);
+        return;
+    }
+    if (face == h->face0) {
+        ccnd_meter_bump(h, face->meter[FM_BYTO], size);
+        if (iovcnt == 1)
+            ccn_dispatch_message(h->internal_client, iov[0].iov_base, size);
+        else {
+            c = charbuf_obtain(h);
+            for (i = 0; i < iovcnt; i++)
+                ccn_charbuf_append(c, iov[i].iov_base, iov[i].iov_len);
+            ccn_dispatch_message(h->internal_client, c->buf, c->length);
+            charbuf_release(h, c);
+        }
         process_internal_client_buffer(h);
         return;
     }
-    if ((face->flags & CCN_FACE_DGRAM) == 0)
-        res = send(face->recv_fd, data, size, 0);
-    else
-        res = sendto(sending_fd(h, face), data, size, 0,
-                     face->addr, face->addrlen);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+    if (face->shm != NULL)
+        res = ccn_shmring_writev(face->shm, iov, iovcnt);
+    else if ((face->flags & CCN_FACE_DGRAM) == 0)
+        res = sendmsg(face->recv_fd, &msg, 0);
+    else if (dgram_batch_add(h, face, iov, iovcnt, size) == 0)
+        return;
+    else {
+        msg.msg_name = (void *)face->addr;
+        msg.msg_namelen = face->addrlen;
+        res = sendmsg(sending_fd(h, face), &msg, 0);
+    }
     if (res > 0)
         ccnd_meter_bump(h, face->meter[FM_BYTO], res);
     if (res == size)
         return;
     if (res == -1) {
-        res = handle_send_error(h, errno, face, data, size);
+        res = handle_send_error(h, errno, face, iov[0].iov_base, size);
         if (res == -1)
             return;
     }
@@ -4654,65 +10530,654 @@ ccnd_send(struct ccnd_handle *h,
         ccnd_msg(h, "sendto short");
         return;
     }
-    face->outbufindex = 0;
-    face->outbuf = ccn_charbuf_create();
-    if (face->outbuf == NULL) {
+    face->outq = outq_create();
+    if (face->outq == NULL ||
+        (res == 0 && content != NULL ?
+          outq_append_content(face->outq, content, iov, iovcnt) :
+          outq_append_copy(face->outq, iov, iovcnt, res)) < 0) {
         ccnd_msg(h, "do_write: %s", strerror(errno));
         return;
     }
-    ccn_charbuf_append(face->outbuf,
-                       ((const unsigned char *)data) + res, size - res);
+    face_io_update(h, face);
+}
+
+/**
+ * Do deferred sends.
+ *
+ * These can only happen on streams, after there has been a partial write,
+ * or when output has been held for a batch.
+ */
+static void
+do_deferred_write(struct ccnd_handle *h, int fd)
+{
+    /* This only happens on connected sockets */
+    struct face *face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+    if (face == NULL)
+        return;
+    face_outq_write(h, face);
+}
+
+/**
+ * Write as much of a stream face's outq as will fit, in one sendmsg.
+ */
+static void
+face_outq_write(struct ccnd_handle *h, struct face *face)
+{
+    int fd = face->recv_fd;
+    struct iovec iov[CCND_OUTQ_IOV];
+    struct msghdr msg;
+    struct ccnd_outq *q;
+    struct ccnd_outseg *seg;
+    ssize_t res;
+    size_t left;
+    size_t unsent;
+    int iovcnt;
+    int i, k;
+    
+    q = face->outq;
+    if (q != NULL && q->bytes > 0) {
+        /* Gather; messages whose content has gone are dropped, since
+           only messages not yet started are held by reference. */
+        for (i = q->head, iovcnt = 0; i < q->n; i++) {
+            seg = &q->seg[i];
+            if (iovcnt + 2 > CCND_OUTQ_IOV)
+                break;
+            k = outseg_iov(h, seg, iov + iovcnt);
+            if (k == 0) {
+                q->bytes -= seg->size - seg->sent;
+                seg->sent = seg->size;
+            }
+            iovcnt += k;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        if (iovcnt == 0)
+            res = 0;
+        else if (face->shm != NULL)
+            res = ccn_shmring_writev(face->shm, iov, iovcnt);
+        else
+            res = sendmsg(fd, &msg, 0);
+        if (res == -1) {
+            if (errno == EAGAIN)
+                return;
+            if (errno == EPIPE) {
+                face->flags |= CCN_FACE_NOSEND;
+                outq_destroy(&face->outq);
+                face_io_update(h, face);
+                return;
+            }
+            ccnd_msg(h, "send: %s (errno = %d)", strerror(errno), errno);
+            shutdown_client_fd(h, fd);
+            return;
+        }
+        ccnd_meter_bump(h, face->meter[FM_BYTO], res);
+        /* Retire what was sent */
+        for (left = res; q->head < q->n; q->head++) {
+            seg = &q->seg[q->head];
+            unsent = seg->size - seg->sent;
+            if (unsent > left) {
+                if (left > 0 && seg->copy == NULL && outseg_copy(h, seg) < 0) {
+                    /* the stream can no longer be completed */
+                    ccnd_msg(h, "do_deferred_write: %s", strerror(errno));
+                    shutdown_client_fd(h, fd);
+                    return;
+                }
+                seg->sent += left;
+                q->bytes -= left;
+                break;
+            }
+            left -= unsent;
+            q->bytes -= unsent;
+            ccn_charbuf_destroy(&seg->copy);
+        }
+        if (q->head < q->n)
+            return;
+        outq_destroy(&face->outq);
+        if ((face->flags & CCN_FACE_CLOSING) != 0)
+            shutdown_client_fd(h, fd);
+        else
+            face_io_update(h, face);
+        return;
+    }
+    outq_destroy(&face->outq);
+    if ((face->flags & CCN_FACE_CLOSING) != 0) {
+        shutdown_client_fd(h, fd);
+        return;
+    }
+    if ((face->flags & CCN_FACE_CONNECTING) != 0) {
+        face->flags &= ~CCN_FACE_CONNECTING;
+        ccnd_face_status_change(h, face->faceid);
+    }
+    else
+        ccnd_msg(h, "ccnd:do_deferred_write: something fishy on %d", fd);
+    face_io_update(h, face);
+}
+
+/**
+ * Event notification
+ *
+ * Where the platform provides epoll(7) or kqueue(2), the stream and
+ * listener descriptors in faces_by_fd are registered with h->evfd as
+ * they come and go, and only re-registered when the set of events
+ * wanted changes.  The main loop then costs according to the number
+ * of ready descriptors rather than the number of faces.
+ * If no such facility is available, h->evfd is -1 and we use poll(2).
+ *
+ * On Linux, CCND_IO=uring selects io_uring instead; see below.
+ */
+#define CCND_IO_ENROLLED 0x10000 /**< io_events bit: fd is registered */
+#define CCND_IO_MAX_EVENTS 128   /**< max ready fds per trip through loop */
+
+static int ccnd_uring_create(struct ccnd_handle *h);
+static void ccnd_uring_update(struct ccnd_handle *h, struct face *face,
+                              unsigned want);
+
+/**
+ * Compute the events (POLLIN, POLLOUT) to wait for on a face's fd.
+ *
+ * A face using shared-memory rings is rung (POLLIN) when there is room
+ * for its queued output, so it waits for POLLOUT only to finish closing.
+ */
+static unsigned
+face_wanted_events(struct face *face)
+{
+    unsigned events = 0;
+    if ((face->flags & CCN_FACE_NORECV) == 0)
+        events |= POLLIN;
+    if (face->outq != NULL ? face->shm == NULL :
+                             (face->flags & CCN_FACE_CLOSING) != 0)
+        events |= POLLOUT;
+    return(events);
+}
+
+/**
+ * Create the epoll or kqueue descriptor, or set up io_uring if the
+ * backend asked for is "uring".
+ * @returns the new fd, or -1 if we should use poll.
+ */
+static int
+ccnd_io_create(struct ccnd_handle *h, const char *backend)
+{
+    int fd = -1;
+    
+    if (backend != NULL && strcmp(backend, "uring") == 0) {
+        fd = ccnd_uring_create(h);
+        if (fd != -1)
+            return(fd);
+    }
+#if defined(CCND_HAVE_EPOLL)
+    fd = epoll_create(CCND_IO_MAX_EVENTS);
+#elif defined(CCND_HAVE_KQUEUE)
+    fd = kqueue();
+#endif
+    if (fd == -1)
+        return(-1);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    h->fds = calloc(CCND_IO_MAX_EVENTS, sizeof(h->fds[0]));
+    if (h->fds == NULL) {
+        close(fd);
+        return(-1);
+    }
+    return(fd);
+}
+
+/**
+ * Tell the kernel about a change in the events we want on fd.
+ *
+ * Either may have CCND_IO_ENROLLED clear, meaning we are adding
+ * or removing the fd.
+ */
+static int
+ccnd_io_ctl(struct ccnd_handle *h, int fd, unsigned have, unsigned want)
+{
+#if defined(CCND_HAVE_EPOLL)
+    struct epoll_event ev;
+    int op;
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((want & POLLIN) ? EPOLLIN : 0) |
+                ((want & POLLOUT) ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if ((have & CCND_IO_ENROLLED) == 0)
+        op = EPOLL_CTL_ADD;
+    else if ((want & CCND_IO_ENROLLED) == 0)
+        op = EPOLL_CTL_DEL;
+    else
+        op = EPOLL_CTL_MOD;
+    return(epoll_ctl(h->evfd, op, fd, &ev));
+#elif defined(CCND_HAVE_KQUEUE)
+    struct kevent kev[2];
+    int n = 0;
+    
+    if (((have ^ want) & POLLIN) != 0)
+        EV_SET(&kev[n++], fd, EVFILT_READ,
+               (want & POLLIN) ? EV_ADD : EV_DELETE, 0, 0, 0);
+    if (((have ^ want) & POLLOUT) != 0)
+        EV_SET(&kev[n++], fd, EVFILT_WRITE,
+               (want & POLLOUT) ? EV_ADD : EV_DELETE, 0, 0, 0);
+    if (n == 0)
+        return(0);
+    return(kevent(h->evfd, kev, n, NULL, 0, NULL));
+#else
+    return(-1);
+#endif
+}
+
+/**
+ * Register a newly recorded face's fd with the event backend.
+ */
+static void
+face_io_enroll(struct ccnd_handle *h, struct face *face)
+{
+    unsigned want;
+    
+    face->io_events = 0;
+    if (h->evfd == -1 || face->recv_fd == -1)
+        return;
+    want = CCND_IO_ENROLLED | face_wanted_events(face);
+    if (h->uring != NULL) {
+        ccnd_uring_update(h, face, want);
+        return;
+    }
+    if (ccnd_io_ctl(h, face->recv_fd, 0, want) == -1) {
+        ccnd_msg(h, "face_io_enroll: fd %d: %s (errno = %d)",
+                 face->recv_fd, strerror(errno), errno);
+        return;
+    }
+    face->io_events = want;
+}
+
+/**
+ * Bring the registered events for a face up to date.
+ *
+ * Must be called whenever the face's outq comes or goes, or the
+ * NORECV or CLOSING flags change.  Faces that are not in faces_by_fd
+ * are never enrolled, so this is a no-op for them.
+ */
+static void
+face_io_update(struct ccnd_handle *h, struct face *face)
+{
+    unsigned want;
+    
+    if ((face->io_events & CCND_IO_ENROLLED) == 0)
+        return;
+    want = CCND_IO_ENROLLED | face_wanted_events(face);
+    if (want == face->io_events)
+        return;
+    if (h->uring != NULL) {
+        ccnd_uring_update(h, face, want);
+        return;
+    }
+    if (ccnd_io_ctl(h, face->recv_fd, face->io_events, want) == -1) {
+        ccnd_msg(h, "face_io_update: fd %d: %s (errno = %d)",
+                 face->recv_fd, strerror(errno), errno);
+        return;
+    }
+    face->io_events = want;
+}
+
+/**
+ * Update the i/o events of a face after changing its flags or output
+ * from outside the usual input path.
+ */
+void
+ccnd_face_io_update(struct ccnd_handle *h, struct face *face)
+{
+    face_io_update(h, face);
+}
+
+/**
+ * Remove a face's fd from the event backend; call before closing it.
+ */
+static void
+face_io_withdraw(struct ccnd_handle *h, struct face *face)
+{
+    if ((face->io_events & CCND_IO_ENROLLED) == 0)
+        return;
+    if (h->uring != NULL)
+        ccnd_uring_update(h, face, 0);
+    else if (face->recv_fd != -1)
+        ccnd_io_ctl(h, face->recv_fd, face->io_events, 0);
+    face->io_events = 0;
+}
+
+/**
+ * io_uring backend
+ *
+ * Stream and datagram sockets are read by multishot receives that
+ * fill buffers from a pool shared with the kernel, so a busy face
+ * costs no system calls for reading.  Listeners, and stream faces
+ * with output waiting, use one-shot poll operations.  Completions are
+ * dispatched as they are reaped, and sends are as for the other
+ * backends.
+ *
+ * Each operation is tagged with the fd, the face's io_gen, and what
+ * kind it is, so completions for a face that has gone away (or had its
+ * operations replaced) are recognized and ignored.  In this mode
+ * io_events tells which operations are armed.
+ */
+#define CCND_URING_ENTRIES 256      /**< submission ring size */
+#define CCND_URING_NBUFS 256        /**< receive buffers, power of 2 */
+#define CCND_URING_BUFSIZE (CCND_DGRAM_MAX + 256) /**< room for address */
+
+#define CCND_URING_READ 1           /**< recv, recvmsg, or listener poll */
+#define CCND_URING_POLLOUT 2
+#define CCND_URING_CANCEL 3
+
+#define CCND_URING_TAG(face, op) \
+    (((uint64_t)(face)->io_gen << 32) | ((op) << 24) | \
+     ((face)->recv_fd & 0xffffff))
+
+struct ccnd_uring_io {
+    struct ccn_uring *ring;
+    unsigned gen;               /**< last io_gen handed out */
+    struct msghdr msg;          /**< shape of datagram receives */
+};
+
+/**
+ * Set up io_uring as the event backend.
+ * @returns the ring's fd, or -1 if it is not available.
+ */
+static int
+ccnd_uring_create(struct ccnd_handle *h)
+{
+    struct ccnd_uring_io *u;
+    
+    u = calloc(1, sizeof(*u));
+    if (u == NULL)
+        return(-1);
+    u->ring = ccn_uring_create(CCND_URING_ENTRIES,
+                               CCND_URING_NBUFS, CCND_URING_BUFSIZE);
+    if (u->ring == NULL) {
+        ccnd_msg(h, "io_uring unavailable: %s (errno = %d)",
+                 strerror(errno), errno);
+        free(u);
+        return(-1);
+    }
+    u->msg.msg_namelen = sizeof(struct sockaddr_storage);
+    h->uring = u;
+    return(ccn_uring_fd(u->ring));
+}
+
+static void
+ccnd_uring_destroy(struct ccnd_handle *h)
+{
+    if (h->uring == NULL)
+        return;
+    ccn_uring_destroy(&h->uring->ring);
+    free(h->uring);
+    h->uring = NULL;
+}
+
+/**
+ * Arm or cancel operations on a face's fd to match the wanted events.
+ *
+ * A change on the read side (or withdrawal) cancels everything armed
+ * and starts over with a new io_gen, so that late completions for the
+ * old operations are ignored.  A POLLOUT that is armed but no longer
+ * wanted is left to fire.
+ */
+static void
+ccnd_uring_update(struct ccnd_handle *h, struct face *face, unsigned want)
+{
+    struct ccn_uring *r = h->uring->ring;
+    unsigned have = face->io_events;
+    int res = 0;
+    
+    if ((have & CCND_IO_ENROLLED) != 0 &&
+        ((have ^ want) & (CCND_IO_ENROLLED | POLLIN)) != 0) {
+        if ((have & POLLIN) != 0)
+            ccn_uring_cancel(r, CCND_URING_TAG(face, CCND_URING_READ),
+                             CCND_URING_TAG(face, CCND_URING_CANCEL));
+        if ((have & POLLOUT) != 0)
+            ccn_uring_cancel(r, CCND_URING_TAG(face, CCND_URING_POLLOUT),
+                             CCND_URING_TAG(face, CCND_URING_CANCEL));
+        have = 0;
+    }
+    if ((want & CCND_IO_ENROLLED) == 0) {
+        face->io_events = 0;
+        return;
+    }
+    if (have == 0) {
+        face->io_gen = ++(h->uring->gen);
+        have = CCND_IO_ENROLLED;
+    }
+    if ((want & POLLIN) != 0 && (have & POLLIN) == 0) {
+        if ((face->flags & CCN_FACE_DGRAM) != 0)
+            res = ccn_uring_recvmsg_multishot(r, face->recv_fd, &h->uring->msg,
+                                    CCND_URING_TAG(face, CCND_URING_READ));
+        else if ((face->flags & CCN_FACE_PASSIVE) != 0)
+            res = ccn_uring_poll(r, face->recv_fd, POLLIN, 0,
+                                 CCND_URING_TAG(face, CCND_URING_READ));
+        else
+            res = ccn_uring_recv_multishot(r, face->recv_fd,
+                                    CCND_URING_TAG(face, CCND_URING_READ));
+        if (res == 0)
+            have |= POLLIN;
+    }
+    if ((want & POLLOUT) != 0 && (have & POLLOUT) == 0) {
+        res |= ccn_uring_poll(r, face->recv_fd, POLLOUT, 0,
+                              CCND_URING_TAG(face, CCND_URING_POLLOUT));
+        if (res == 0)
+            have |= POLLOUT;
+    }
+    if (res != 0)
+        ccnd_msg(h, "ccnd_uring_update: fd %d: %s (errno = %d)",
+                 face->recv_fd, strerror(errno), errno);
+    face->io_events = have;
+}
+
+/**
+ * Look up the face that a completion is for.
+ * @returns NULL if that face is gone.
+ */
+static struct face *
+ccnd_uring_face(struct ccnd_handle *h, uint64_t tag)
+{
+    int fd = tag & 0xffffff;
+    struct face *face;
+    
+    face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+    if (face == NULL || face->io_gen != (unsigned)(tag >> 32) ||
+        (face->io_events & CCND_IO_ENROLLED) == 0)
+        return(NULL);
+    return(face);
+}
+
+/**
+ * Take the data from a completed receive.
+ */
+static void
+ccnd_uring_input(struct ccnd_handle *h, struct face *face,
+                 struct ccn_uring_cqe *c)
+{
+    struct ccnd_uring_io *u = h->uring;
+    unsigned char *data;
+    unsigned char *buf;
+    struct sockaddr *addr = NULL;
+    socklen_t addrlen = 0;
+    ssize_t size;
+    int trunc = 0;
+    int fd;
+    
+    if ((face->flags & CCN_FACE_DGRAM) != 0) {
+        size = ccn_uring_recvmsg_parse(u->ring, c->bid, c->res, &u->msg,
+                                       &data, &addr, &addrlen, &trunc);
+        if (size < 0 || trunc)
+            ccnd_msg(h, "discarding %s datagram on face %u",
+                     trunc ? "oversize" : "malformed", face->faceid);
+        else
+            process_dgram(h, face, data, size, addr, addrlen);
+        return;
+    }
+    if (face->shm != NULL) {
+        /* the data were just doorbells */
+        ccnd_shm_input(h, face, 1);
+        return;
+    }
+    data = ccn_uring_buf(u->ring, c->bid);
+    fd = face->recv_fd;
+    buf = face_inbuf_reserve(h, face, c->res);
+    if (data == NULL || buf == NULL)
+        return;
+    memcpy(buf, data, c->res);
+    process_received(h, face, buf, c->res, NULL, 0);
+    face_inbuf_release(h, fd);
+}
+
+/**
+ * Dispatch one completion.
+ */
+static void
+ccnd_uring_complete(struct ccnd_handle *h, struct ccn_uring_cqe *c)
+{
+    unsigned op = (c->user_data >> 24) & 0xff;
+    int fd = c->user_data & 0xffffff;
+    struct face *face;
+    
+    face = ccnd_uring_face(h, c->user_data);
+    if (face == NULL || op == CCND_URING_CANCEL)
+        ;
+    else if (op == CCND_URING_POLLOUT) {
+        face->io_events &= ~POLLOUT;
+        if (c->res < 0)
+            ;
+        else if ((c->res & (POLLERR | POLLNVAL | POLLHUP)) != 0)
+            shutdown_client_fd(h, fd);
+        else if ((face_wanted_events(face) & POLLOUT) != 0)
+            do_deferred_write(h, fd);
+    }
+    else {
+        if ((c->flags & CCN_URING_F_MORE) == 0)
+            face->io_events &= ~POLLIN;
+        if ((face->flags & (CCN_FACE_DGRAM | CCN_FACE_PASSIVE)) == CCN_FACE_PASSIVE) {
+            if (c->res > 0)
+                process_input(h, fd);
+        }
+        else if (c->bid >= 0)
+            ccnd_uring_input(h, face, c);
+        else if (c->res == 0 && face->shm != NULL)
+            ccnd_shm_input(h, face, 0);
+        else if (c->res == 0 && (face->flags & CCN_FACE_DGRAM) == 0)
+            shutdown_client_fd(h, fd);
+        else if (c->res < 0 && c->res != -ENOBUFS && c->res != -ECANCELED) {
+            ccnd_msg(h, "recv face %u :%s (errno = %d)",
+                     face->faceid, strerror(-c->res), -c->res);
+            if ((face->flags & CCN_FACE_DGRAM) == 0)
+                shutdown_client_fd(h, fd);
+        }
+    }
+    ccn_uring_buf_recycle(h->uring->ring, c->bid);
+    /* Re-arm whatever has finished, if the face is still with us */
+    face = ccnd_uring_face(h, c->user_data);
+    if (face != NULL)
+        face_io_update(h, face);
 }
 
 /**
- * Do deferred sends.
+ * Wait for and dispatch completions using the io_uring backend.
  *
- * These can only happen on streams, after there has been a partial write.
+ * As for prepare_poll_fds, input on multicast receivers is handled
+ * first.  Nothing is left in h->fds for the main loop.
+ * @returns the number of completions, 0 on timeout, or -1 with errno set.
  */
-static void
-do_deferred_write(struct ccnd_handle *h, int fd)
+static int
+ccnd_uring_wait(struct ccnd_handle *h, int timeout_ms)
 {
-    /* This only happens on connected sockets */
-    ssize_t res;
-    struct face *face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
-    if (face == NULL)
-        return;
-    if (face->outbuf != NULL) {
-        ssize_t sendlen = face->outbuf->length - face->outbufindex;
-        if (sendlen > 0) {
-            res = send(fd, face->outbuf->buf + face->outbufindex, sendlen, 0);
-            if (res == -1) {
-                if (errno == EPIPE) {
-                    face->flags |= CCN_FACE_NOSEND;
-                    face->outbufindex = 0;
-                    ccn_charbuf_destroy(&face->outbuf);
-                    return;
-                }
-                ccnd_msg(h, "send: %s (errno = %d)", strerror(errno), errno);
-                shutdown_client_fd(h, fd);
-                return;
-            }
-            if (res == sendlen) {
-                face->outbufindex = 0;
-                ccn_charbuf_destroy(&face->outbuf);
-                if ((face->flags & CCN_FACE_CLOSING) != 0)
-                    shutdown_client_fd(h, fd);
-                return;
-            }
-            face->outbufindex += res;
-            return;
+    struct ccn_uring_cqe cqe[CCND_IO_MAX_EVENTS];
+    struct face *face;
+    int i, n;
+    
+    h->nfds = 0;
+    n = ccn_uring_wait(h->uring->ring, timeout_ms);
+    /* Completions are processed here, so the wait ends now */
+    ccnd_refresh_time(h);
+    ccn_schedule_note_idle(h->sched, 0);
+    if (n <= 0)
+        return(n);
+    n = ccn_uring_reap(h->uring->ring, cqe, CCND_IO_MAX_EVENTS);
+    for (i = 0; i < n; i++) {
+        face = ccnd_uring_face(h, cqe[i].user_data);
+        if (face != NULL && (face->flags & CCN_FACE_MCAST) != 0) {
+            ccnd_uring_complete(h, &cqe[i]);
+            cqe[i].user_data = 0;
         }
-        face->outbufindex = 0;
-        ccn_charbuf_destroy(&face->outbuf);
     }
-    if ((face->flags & CCN_FACE_CLOSING) != 0)
-        shutdown_client_fd(h, fd);
-    else if ((face->flags & CCN_FACE_CONNECTING) != 0) {
-        face->flags &= ~CCN_FACE_CONNECTING;
-        ccnd_face_status_change(h, face->faceid);
+    for (i = 0; i < n; i++) {
+        if (cqe[i].user_data != 0)
+            ccnd_uring_complete(h, &cqe[i]);
+        if (h->mgmtq.n > 0)
+            mgmt_run(h);
     }
-    else
-        ccnd_msg(h, "ccnd:do_deferred_write: something fishy on %d", fd);
+    return(n);
+}
+
+/**
+ * Wait for events using the epoll or kqueue backend.
+ *
+ * The ready descriptors are translated into h->fds and h->nfds, in the
+ * same form that poll(2) would have left them, so the main loop's
+ * dispatch is unchanged.  As for prepare_poll_fds, multicast receivers
+ * are placed first.
+ * @returns number of ready entries, 0 on timeout, or -1 with errno set.
+ */
+static int
+ccnd_io_wait(struct ccnd_handle *h, int timeout_ms)
+{
+    int n = -1;
+    int i, j, k, m;
+    int fd;
+    short revents;
+    struct face *face;
+#if defined(CCND_HAVE_EPOLL)
+    struct epoll_event ev[CCND_IO_MAX_EVENTS];
+    
+    n = epoll_wait(h->evfd, ev, CCND_IO_MAX_EVENTS, timeout_ms);
+#elif defined(CCND_HAVE_KQUEUE)
+    struct kevent ev[CCND_IO_MAX_EVENTS];
+    struct timespec ts;
+    
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    n = kevent(h->evfd, NULL, 0, ev, CCND_IO_MAX_EVENTS,
+               (timeout_ms < 0) ? NULL : &ts);
+#else
+    errno = ENOSYS;
+#endif
+    h->nfds = 0;
+    if (n <= 0)
+        return(n);
+    for (i = 0, j = 0, k = n; i < n; i++) {
+        revents = 0;
+#if defined(CCND_HAVE_EPOLL)
+        fd = ev[i].data.fd;
+        if ((ev[i].events & EPOLLIN) != 0)  revents |= POLLIN;
+        if ((ev[i].events & EPOLLOUT) != 0) revents |= POLLOUT;
+        if ((ev[i].events & EPOLLERR) != 0) revents |= POLLERR;
+        if ((ev[i].events & EPOLLHUP) != 0) revents |= POLLHUP;
+#elif defined(CCND_HAVE_KQUEUE)
+        fd = ev[i].ident;
+        if ((ev[i].flags & EV_ERROR) != 0)
+            revents |= POLLERR;
+        else if (ev[i].filter == EVFILT_READ)
+            revents |= POLLIN; /* EOF shows up as a 0-length read */
+        else if ((ev[i].flags & EV_EOF) != 0)
+            revents |= POLLHUP;
+        else
+            revents |= POLLOUT;
+#endif
+        face = hashtb_lookup(h->faces_by_fd, &fd, sizeof(fd));
+        if (face != NULL && (face->flags & CCN_FACE_MCAST) != 0)
+            m = j++;
+        else
+            m = --k;
+        h->fds[m].fd = fd;
+        h->fds[m].events = 0;
+        h->fds[m].revents = revents;
+    }
+    h->nfds = n;
+    return(n);
 }
 
 /**
@@ -4741,17 +11206,349 @@ prepare_poll_fds(struct ccnd_handle *h)
         else
             j = --k;
         h->fds[j].fd = face->recv_fd;
-        h->fds[j].events = ((face->flags & CCN_FACE_NORECV) == 0) ? POLLIN : 0;
-        if ((face->outbuf != NULL || (face->flags & CCN_FACE_CLOSING) != 0))
-            h->fds[j].events |= POLLOUT;
+        h->fds[j].events = face_wanted_events(face);
     }
     hashtb_end(e);
     if (i < k)
         abort();
 }
 
+/*
+ * Snapshots, for a warm restart.
+ *
+ * A snapshot is a series of ccnb elements: a FaceInstance for each
+ * permanent face, a ForwardingEntry (with its remaining lifetime) for
+ * each registration on one of those faces, and then the most used
+ * ContentObjects.  The faceids are those of the ccnd that wrote it;
+ * the one that reads it maps them to the faces it makes.
+ */
+
+static volatile sig_atomic_t snapshot_signal = 0;
+
+static void
+handle_snapshot_signal(int sig)
+{
+    snapshot_signal = sig;
+}
+
+/**
+ * Tell whether a face belongs in a snapshot.
+ */
+static int
+snapshot_face_ok(struct face *face)
+{
+    if (face == NULL || face->addr == NULL)
+        return(0);
+    if ((face->flags & CCN_FACE_PERMANENT) == 0)
+        return(0);
+    return((face->flags & (CCN_FACE_LOCAL | CCN_FACE_PASSIVE)) == 0);
+}
+
+/**
+ * Order content for a snapshot: more used first, then newer.
+ */
+static int
+content_hotter(const struct content_entry *a, const struct content_entry *b)
+{
+    if (a->cache_freq != b->cache_freq)
+        return(a->cache_freq > b->cache_freq);
+    return(a->accession > b->accession);
+}
+
+/**
+ * Sift down in a heap that keeps the least used content on top.
+ */
+static void
+snapshot_sift(struct content_entry **heap, int n, int i)
+{
+    struct content_entry *x = heap[i];
+    int c;
+    
+    for (; (c = 2 * i + 1) < n; i = c) {
+        if (c + 1 < n && content_hotter(heap[c], heap[c + 1]))
+            c++;
+        if (!content_hotter(x, heap[c]))
+            break;
+        heap[i] = heap[c];
+    }
+    heap[i] = x;
+}
+
+/**
+ * Choose up to h->snapshot_objects of the most used content.
+ *
+ * Content that goes stale with time is left out, since its freshness
+ * would start over when it came back.
+ * @returns the number chosen.
+ */
+static int
+snapshot_choose_content(struct ccnd_handle *h, struct content_entry **heap)
+{
+    struct content_entry *content;
+    unsigned a;
+    int n = 0;
+    int i;
+    int skip = CCN_CONTENT_ENTRY_STALE | CCN_CONTENT_ENTRY_EXPIRES;
+    
+    for (a = 0; a < h->content_slot_limit; a++) {
+        content = h->content_by_slot[a];
+        if (content == NULL || (content->flags & skip) != 0 ||
+            content->ncomps < 2)
+            continue;
+        if (n < h->snapshot_objects) {
+            heap[n++] = content;
+            if (n == h->snapshot_objects)
+                for (i = n / 2; i > 0; i--)
+                    snapshot_sift(heap, n, i - 1);
+        }
+        else if (content_hotter(content, heap[0])) {
+            heap[0] = content;
+            snapshot_sift(heap, n, 0);
+        }
+    }
+    return(n);
+}
+
+/**
+ * Write a snapshot of the faces, forwarding entries, and hot content
+ * to the file named by CCND_SNAPSHOT.
+ *
+ * The file is replaced only once the new one is complete.
+ */
+static void
+ccnd_snapshot_write(struct ccnd_handle *h)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *c = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_charbuf *temp = NULL;
+    struct content_entry **heap = NULL;
+    struct ccn_forwarding *f;
+    struct face *face;
+    char host[NI_MAXHOST];
+    char port[NI_MAXSERV];
+    int nfaces = 0;
+    int nfwd = 0;
+    int n = 0;
+    int fd;
+    int i;
+    
+    c = ccn_charbuf_create();
+    name = ccn_charbuf_create();
+    temp = ccn_charbuf_create();
+    if (h->snapshot_objects > 0)
+        heap = calloc(h->snapshot_objects, sizeof(heap[0]));
+    if (c == NULL || name == NULL || temp == NULL ||
+        (heap == NULL && h->snapshot_objects > 0))
+        goto Bail;
+    for (i = 0; i < h->face_limit; i++) {
+        struct ccn_face_instance fi = {0};
+        face = h->faces_by_faceid[i];
+        if (!snapshot_face_ok(face))
+            continue;
+        if (getnameinfo(face->addr, face->addrlen, host, sizeof(host),
+                        port, sizeof(port),
+                        NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+            continue;
+        fi.faceid = face->faceid;
+        fi.descr.ipproto = ((face->flags & CCN_FACE_DGRAM) != 0) ?
+                           IPPROTO_UDP : IPPROTO_TCP;
+        fi.descr.address = host;
+        fi.descr.port = port;
+        fi.descr.mcast_ttl = -1;
+        fi.lifetime = -1;
+        fi.rate = fi.burst = -1;
+        if (face->shaper.rate != 0) {
+            fi.rate = face->shaper.rate;
+            fi.burst = face->shaper.burst;
+        }
+        if (ccnb_append_face_instance(c, &fi) == 0)
+            nfaces++;
+    }
+    for (hashtb_start(h->nameprefix_tab, e); e->data != NULL; hashtb_next(e)) {
+        struct nameprefix_entry *npe = e->data;
+        for (f = npe->forwarding; f != NULL; f = f->next) {
+            struct ccn_forwarding_entry fe = {0};
+            if (!snapshot_face_ok(face_from_faceid(h, f->faceid)))
+                continue;
+            name->length = 0;
+            ccn_charbuf_append_tt(name, CCN_DTAG_Name, CCN_DTAG);
+            ccn_charbuf_append(name, e->key, e->keysize);
+            ccn_charbuf_append_closer(name);
+            fe.name_prefix = name;
+            fe.faceid = f->faceid;
+            fe.flags = f->flags & CCN_FORW_PUBMASK;
+            fe.lifetime = ccnd_forwarding_expires(h, f);
+            fe.store_quota = -1;
+            fe.traffic_class = (int)npe->tclass - 1;
+            fe.default_freshness = fe.max_residency = -1;
+            if (npe->fresh_rule != 0) {
+                fe.default_freshness = h->fresh_rule[npe->fresh_rule].freshness;
+                fe.max_residency = h->fresh_rule[npe->fresh_rule].residency;
+            }
+            if (ccnb_append_forwarding_entry(c, &fe) == 0)
+                nfwd++;
+        }
+    }
+    hashtb_end(e);
+    n = snapshot_choose_content(h, heap);
+    for (i = 0; i < n; i++) {
+        struct content_entry *content = heap[i];
+        const unsigned char *msg = content_object(h, content);
+        int k = content->ncomps;
+        if (msg == NULL)
+            continue;
+        /* Leave out the implicit digest, as it was on the wire */
+        ccn_charbuf_append(c, msg, content->comps[k - 2]);
+        ccn_charbuf_append(c, msg + content->comps[k - 1],
+                           content->size - content->comps[k - 1]);
+    }
+    ccn_charbuf_putf(temp, "%s.new", h->snapshot_path);
+    fd = open(ccn_charbuf_as_string(temp), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+        goto Bail;
+    if (write(fd, c->buf, c->length) != (ssize_t)c->length) {
+        close(fd);
+        unlink(ccn_charbuf_as_string(temp));
+        goto Bail;
+    }
+    close(fd);
+    if (rename(ccn_charbuf_as_string(temp), h->snapshot_path) != 0)
+        goto Bail;
+    ccnd_msg(h, "snapshot to %s: %d faces, %d prefixes, %d objects",
+             h->snapshot_path, nfaces, nfwd, n);
+    goto Done;
+Bail:
+    ccnd_msg(h, "snapshot to %s failed: %s", h->snapshot_path, strerror(errno));
+Done:
+    free(heap);
+    ccn_charbuf_destroy(&c);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&temp);
+}
+
+/**
+ * Restore what the last snapshot saved.
+ *
+ * Faces that cannot be made again are skipped, along with their
+ * forwarding entries.  The content comes in as if it had arrived on
+ * face 0.
+ */
+static void
+ccnd_snapshot_load(struct ccnd_handle *h)
+{
+    struct ccn_skeleton_decoder sd;
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    struct ccn_indexbuf *oldid = NULL;
+    struct ccn_indexbuf *newid = NULL;
+    struct ccn_indexbuf *comps = NULL;
+    struct ccn_face_instance *fi = NULL;
+    struct ccn_forwarding_entry *fe = NULL;
+    struct face *face;
+    struct stat st;
+    unsigned char *buf = NULL;
+    size_t off;
+    size_t n;
+    ssize_t res;
+    int nfaces = 0;
+    int nfwd = 0;
+    int nobj = 0;
+    int nack;
+    int fd;
+    int i;
+    
+    fd = open(h->snapshot_path, O_RDONLY);
+    if (fd == -1)
+        return;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        buf = malloc(st.st_size);
+    res = (buf == NULL) ? -1 : read(fd, buf, st.st_size);
+    close(fd);
+    if (res != st.st_size) {
+        ccnd_msg(h, "snapshot %s: could not read", h->snapshot_path);
+        free(buf);
+        return;
+    }
+    oldid = ccn_indexbuf_create();
+    newid = ccn_indexbuf_create();
+    comps = ccn_indexbuf_create();
+    for (off = 0; off < (size_t)st.st_size; off += n) {
+        memset(&sd, 0, sizeof(sd));
+        n = ccn_skeleton_decode(&sd, buf + off, st.st_size - off);
+        if (sd.state != 0 || n == 0)
+            break;
+        d = ccn_buf_decoder_start(&decoder, buf + off, n);
+        if (ccn_buf_match_dtag(d, CCN_DTAG_FaceInstance)) {
+            fi = ccn_face_instance_parse(buf + off, n);
+            if (fi == NULL)
+                continue;
+            nack = 0;
+            face = face_from_instance(h, fi, &nack);
+            if (face != NULL) {
+                ccn_indexbuf_append_element(oldid, fi->faceid);
+                ccn_indexbuf_append_element(newid, face->faceid);
+                nfaces++;
+            }
+            ccn_face_instance_destroy(&fi);
+        }
+        else if (ccn_buf_match_dtag(d, CCN_DTAG_ForwardingEntry)) {
+            fe = ccn_forwarding_entry_parse(buf + off, n);
+            if (fe == NULL || fe->name_prefix == NULL)
+                goto NextEntry;
+            i = ccn_indexbuf_member(oldid, fe->faceid);
+            if (i < 0)
+                goto NextEntry;
+            d = ccn_buf_decoder_start(&decoder, fe->name_prefix->buf,
+                                      fe->name_prefix->length);
+            if (ccn_parse_Name(d, comps) < 0)
+                goto NextEntry;
+            if (ccnd_reg_prefix(h, fe->name_prefix->buf, comps, comps->n - 1,
+                                newid->buf[i], fe->flags, fe->lifetime) >= 0) {
+                traffic_class_set(h, fe, comps);
+                fresh_rule_set(h, fe, comps);
+                nfwd++;
+            }
+        NextEntry:
+            ccn_forwarding_entry_destroy(&fe);
+        }
+        else if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject)) {
+            process_incoming_content(h, h->face0, buf + off, n);
+            nobj++;
+        }
+    }
+    ccnd_msg(h, "snapshot %s: %d faces, %d prefixes, %d objects restored",
+             h->snapshot_path, nfaces, nfwd, nobj);
+    ccn_indexbuf_destroy(&oldid);
+    ccn_indexbuf_destroy(&newid);
+    ccn_indexbuf_destroy(&comps);
+    free(buf);
+}
+
+/**
+ * Act on a signal noted by handle_snapshot_signal.
+ *
+ * SIGTERM stops ccnd, and ccnd_destroy writes the snapshot.
+ */
+static void
+snapshot_signalled(struct ccnd_handle *h)
+{
+    int sig = snapshot_signal;
+    
+    snapshot_signal = 0;
+    if (sig == SIGTERM)
+        h->running = 0;
+    else
+        ccnd_snapshot_write(h);
+}
+
 /**
  * Run the main loop of the ccnd
+ *
+ * Everything in the handle belongs to the thread that runs this.  The
+ * tables, their hashtbs and the schedule are not locked, and scheduled
+ * events change the tables between polls, so ccnd has no worker threads.
  */
 void
 ccnd_run(struct ccnd_handle *h)
@@ -4762,16 +11559,42 @@ ccnd_run(struct ccnd_handle *h)
     int prev_timeout_ms = -1;
     int usec;
     for (h->running = 1; h->running;) {
+        /* Nothing from the scratch arena is in use out here */
+        ccn_arena_reset(h->scratch);
         process_internal_client_buffer(h);
+        ccnd_refresh_time(h);
+        h->mgmt_left = h->mgmt_budget;
+        mgmt_run(h);
+        check_quiet(h);
         usec = ccn_schedule_run(h->sched);
         timeout_ms = (usec < 0) ? -1 : ((usec + 960) / 1000);
         if (timeout_ms == 0 && prev_timeout_ms == 0)
             timeout_ms = 1;
+        if (h->mgmtq.n > 0)
+            timeout_ms = 0;
         process_internal_client_buffer(h);
-        prepare_poll_fds(h);
-        if (0) ccnd_msg(h, "at ccnd.c:%d poll(h->fds, %d, %d)", __LINE__, h->nfds, timeout_ms);
-        res = poll(h->fds, h->nfds, timeout_ms);
+        stream_batch_flush(h);
+        dgram_batch_flush(h);
+        ccnd_refresh_time(h);
+        ccn_schedule_note_idle(h->sched, 1);
+        if (h->uring != NULL)
+            res = ccnd_uring_wait(h, timeout_ms);
+        else if (h->evfd != -1)
+            res = ccnd_io_wait(h, timeout_ms);
+        else {
+            prepare_poll_fds(h);
+            if (0) ccnd_msg(h, "at ccnd.c:%d poll(h->fds, %d, %d)", __LINE__, h->nfds, timeout_ms);
+            res = poll(h->fds, h->nfds, timeout_ms);
+        }
+        if (h->uring == NULL)
+            ccnd_refresh_time(h);
+        ccn_schedule_note_idle(h->sched, 0);
         prev_timeout_ms = ((res == 0) ? timeout_ms : 1);
+        if (snapshot_signal != 0) {
+            snapshot_signalled(h);
+            if (-1 == res && errno == EINTR)
+                continue;
+        }
         if (-1 == res) {
             ccnd_msg(h, "poll: %s (errno = %d)", strerror(errno), errno);
             sleep(1);
@@ -4791,9 +11614,13 @@ ccnd_run(struct ccnd_handle *h)
                     do_deferred_write(h, h->fds[i].fd);
                 else if (h->fds[i].revents & (POLLIN))
                     process_input(h, h->fds[i].fd);
+                if (h->mgmtq.n > 0)
+                    mgmt_run(h);
             }
         }
     }
+    stream_batch_flush(h);
+    dgram_batch_flush(h);
 }
 
 /**
@@ -4837,20 +11664,18 @@ ccnd_get_local_sockname(void)
 }
 
 /**
- * Get the time.
+ * Read the clock, and keep the time in h->sec and h->usec.
  *
- * This is used to supply the clock for our scheduled events.
+ * The event loop does this when it wakes up, before it runs the
+ * scheduled events, and before it waits again.  The scheduler, the
+ * meters, and everything else in between use the cached reading.
  */
 static void
-ccnd_gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
+ccnd_refresh_time(struct ccnd_handle *h)
 {
-    struct ccnd_handle *h = self->data;
-    struct timeval now = {0};
-    gettimeofday(&now, 0);
-    result->s = now.tv_sec;
-    result->micros = now.tv_usec;
-    h->sec = now.tv_sec;
-    h->usec = now.tv_usec;
+    const struct ccn_timeval *now = ccn_clock_refresh(&h->clock);
+    h->sec = now->s;
+    h->usec = now->micros;
 }
 
 /**
@@ -4871,6 +11696,32 @@ ccnd_setsockopt_v6only(struct ccnd_handle *h, int fd)
                  fd, strerror(errno));
 }
 
+/**
+ * Set SO_REUSEPORT on a listener, if the port is shared with other shards.
+ *
+ * If we are pinned to a CPU, also ask for the traffic that arrives there.
+ */
+static void
+ccnd_setsockopt_reuseport(struct ccnd_handle *h, int fd)
+{
+    int res = 0;
+#ifdef SO_REUSEPORT
+    int yes = 1;
+    if (h->nshards > 1)
+        res = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#endif
+    if (res == -1)
+        ccnd_msg(h, "warning - could not set SO_REUSEPORT on fd %d: %s",
+                 fd, strerror(errno));
+#ifdef SO_INCOMING_CPU
+    if (h->nshards > 1 && h->cpu >= 0 &&
+          setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU,
+                     &h->cpu, sizeof(h->cpu)) == -1)
+        ccnd_msg(h, "warning - could not set SO_INCOMING_CPU on fd %d: %s",
+                 fd, strerror(errno));
+#endif
+}
+
 /**
  * Translate an address family constant to a string.
  */
@@ -4914,6 +11765,7 @@ ccnd_listen_on_wildcards(struct ccnd_handle *h)
                     int rcvbuf = 0;
                     socklen_t rcvbuf_sz;
                     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                    ccnd_setsockopt_reuseport(h, fd);
                     rcvbuf_sz = sizeof(rcvbuf);
                     getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &rcvbuf_sz);
                     if (a->ai_family == AF_INET6)
@@ -4943,6 +11795,7 @@ ccnd_listen_on_wildcards(struct ccnd_handle *h)
                 if (fd != -1) {
                     int yes = 1;
                     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                    ccnd_setsockopt_reuseport(h, fd);
                     if (a->ai_family == AF_INET6)
                         ccnd_setsockopt_v6only(h, fd);
                     res = bind(fd, a->ai_addr, a->ai_addrlen);
@@ -4994,6 +11847,7 @@ ccnd_listen_on_address(struct ccnd_handle *h, const char *addr)
                 int rcvbuf = 0;
                 socklen_t rcvbuf_sz;
                 setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                ccnd_setsockopt_reuseport(h, fd);
                 rcvbuf_sz = sizeof(rcvbuf);
                 getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &rcvbuf_sz);
                 if (a->ai_family == AF_INET6)
@@ -5024,6 +11878,7 @@ ccnd_listen_on_address(struct ccnd_handle *h, const char *addr)
             if (fd != -1) {
                 int yes = 1;
                 setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+                ccnd_setsockopt_reuseport(h, fd);
                 if (a->ai_family == AF_INET6)
                     ccnd_setsockopt_v6only(h, fd);
                 res = bind(fd, a->ai_addr, a->ai_addrlen);
@@ -5137,6 +11992,128 @@ ccnd_parse_uri_list(struct ccnd_handle *h, const char *what, const char *uris)
     return(ans);
 }
 
+/**
+ * Parse a list of negative cache ttls for name prefixes.
+ *
+ * Each element is a ccnx URI and a ttl in msec, separated by an
+ * equals sign (e.g. ccnx:/example/live=0).  Elements are separated
+ * by whitespace, commas, or semicolons.
+ */
+static void
+ccnd_parse_negttl_list(struct ccnd_handle *h, const char *what,
+                       const char *list)
+{
+    struct ccn_charbuf *tok;
+    struct ccn_charbuf *name;
+    struct ccn_indexbuf *comps;
+    char *uri;
+    char *eq;
+    char *end;
+    long ms;
+    int n;
+    int i;
+    unsigned char ch;
+    
+    tok = ccn_charbuf_create();
+    name = ccn_charbuf_create();
+    comps = ccn_indexbuf_create();
+    for (i = 0, ch = list[0]; ch != 0;) {
+        while ((0 < ch && ch <= ' ') || ch == ',' || ch == ';')
+            ch = list[++i];
+        tok->length = 0;
+        while (ch > ' ' && ch != ',' && ch != ';') {
+            ccn_charbuf_append_value(tok, ch, 1);
+            ch = list[++i];
+        }
+        if (tok->length == 0)
+            continue;
+        uri = (char *)ccn_charbuf_as_string(tok);
+        eq = strrchr(uri, '=');
+        n = -1;
+        if (eq != NULL) {
+            *eq = 0;
+            ms = strtol(eq + 1, &end, 10);
+            name->length = 0;
+            if (eq[1] != 0 && *end == 0 && ms >= 0 &&
+                ccn_name_from_uri(name, uri) >= 0)
+                n = ccn_name_split(name, comps);
+        }
+        if (n < 0) {
+            ccnd_msg(h, "%s: invalid element: %s", what, uri);
+            continue;
+        }
+        if (ms > CCND_NEGATIVE_TTL_MAX)
+            ms = CCND_NEGATIVE_TTL_MAX;
+        if (h->negttl_ms == NULL) {
+            h->negttl_comps = ccn_charbuf_create();
+            h->negttl_off = ccn_indexbuf_create();
+            h->negttl_ms = ccn_indexbuf_create();
+            ccn_indexbuf_append_element(h->negttl_off, 0);
+        }
+        ccn_charbuf_append(h->negttl_comps, name->buf + comps->buf[0],
+                           comps->buf[n] - comps->buf[0]);
+        ccn_indexbuf_append_element(h->negttl_off, h->negttl_comps->length);
+        ccn_indexbuf_append_element(h->negttl_ms, ms);
+    }
+    ccn_charbuf_destroy(&tok);
+    ccn_charbuf_destroy(&name);
+    ccn_indexbuf_destroy(&comps);
+}
+
+/**
+ * Parse a byte count, which may have a k, m, or g suffix (powers of 1024)
+ */
+static size_t
+parse_byte_count(const char *s)
+{
+    char *end = NULL;
+    unsigned long long v;
+    unsigned shift = 0;
+
+    v = strtoull(s, &end, 10);
+    switch (end[0]) {
+        case 'g': case 'G': shift += 10; /* FALLTHROUGH */
+        case 'm': case 'M': shift += 10; /* FALLTHROUGH */
+        case 'k': case 'K': shift += 10;
+    }
+    if (shift != 0 && v > (~(size_t)0 >> shift))
+        return(~(size_t)0);
+    v <<= shift;
+    if (v > ~(size_t)0)
+        return(~(size_t)0);
+    return(v);
+}
+
+/**
+ * Set up the content store shards, dividing the capacity among them.
+ * @param policy - replacement policy name, or NULL for the default
+ */
+static void
+content_store_create(struct ccnd_handle *h, const char *policy)
+{
+    struct hashtb_param param = {0};
+    struct ccnd_cs_shard *s;
+    int i;
+    
+    h->cs = calloc(h->cs_n, sizeof(h->cs[0]));
+    param.finalize_data = h;
+    param.finalize = &finalize_content;
+    param.memacct = &h->mem[CCND_MEM_CONTENT_TAB];
+    param.shrink = h->compact;
+    for (i = 0; i < h->cs_n; i++) {
+        s = &h->cs[i];
+        s->content_tab = hashtb_create(sizeof(struct content_entry), &param);
+        s->capacity = h->capacity;
+        if (h->capacity != ~0UL)
+            s->capacity = (h->capacity + h->cs_n - 1) / h->cs_n;
+        s->capacity_bytes = h->capacity_bytes;
+        if (h->capacity_bytes != ~(size_t)0)
+            s->capacity_bytes = (h->capacity_bytes + h->cs_n - 1) / h->cs_n;
+        if (policy != NULL)
+            s->cache = ccnd_cache_create(policy, s->capacity);
+    }
+}
+
 /**
  * Start a new ccnd instance
  * @param progname - name of program binary, used for locating helpers
@@ -5149,14 +12126,53 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     char *sockname;
     const char *portstr;
     const char *debugstr;
+    const char *lograte;
     const char *entrylimit;
+    const char *bytelimit;
+    const char *outq_cap;
+    const char *face_irate;
+    const char *prefix_irate;
+    const char *pit_limit;
+    const char *pit_bytes;
+    const char *negttl;
+    const char *negttl_prefixes;
+    const char *dead_nonce;
+    const char *disk_path;
+    const char *snapshot_objects;
+    const char *compress_age;
+    const char *idle_slack;
+    const char *class_weights;
+    const char *prefetch;
+    int prefetch_depth;
+    const char *disk_bytes;
+    uintmax_t disk_capacity;
+    long dnl_period;
+    const char *cache_policy;
+    const char *cs_shards;
+    const char *mrc_rate;
+    long mrc_sample;
+    const char *topk;
+    const char *mgmt_budget;
+    const char *notice_interval;
+    int notice_ms;
+    unsigned hh_width;
+    struct timeval now;
     const char *mtu;
+    const char *pack;
+    const char *link_mtu;
+    const char *link_arq;
+    const char *udp_gso;
+    const char *trace;
+    const char *trace_records;
     const char *data_pause;
     const char *tts_default;
     const char *tts_limit;
     const char *autoreg;
     const char *listen_on;
+    const char *io_backend;
+    const char *profile;
     int fd;
+    int i;
     struct ccnd_handle *h;
     struct hashtb_param param = {0};
     
@@ -5170,31 +12186,45 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     h->logpid = (int)getpid();
     h->progname = progname;
     h->debug = -1;
-    h->skiplinks = ccn_indexbuf_create();
+    h->evfd = -1;
+    ccnd_shard_setup(h);
+    for (i = 0; i < CCND_MEM_N; i++)
+        h->mem[i].name = ccnd_mem_names[i];
+    h->nameindex = ccnd_nameindex_create(&h->mem[CCND_MEM_NAMEINDEX]);
+    h->intern = ccnd_intern_create();
+    profile = getenv("CCND_PROFILE");
+    if (profile != NULL && strcmp(profile, "compact") == 0)
+        h->compact = 1;
     param.finalize_data = h;
-    h->face_limit = 1024; /* soft limit */
-    h->faces_by_faceid = calloc(h->face_limit, sizeof(h->faces_by_faceid[0]));
+    param.shrink = h->compact;
+    h->face_free = h->face_free_tail = MAXFACES;
+    /* soft limit */
+    face_slots_grow(h, h->compact ? CCND_COMPACT_FACE_SLOTS : 1024);
     param.finalize = &finalize_face;
+    param.memacct = &h->mem[CCND_MEM_FACES];
     h->faces_by_fd = hashtb_create(sizeof(struct face), &param);
     h->dgram_faces = hashtb_create(sizeof(struct face), &param);
-    param.finalize = &finalize_content;
-    h->content_tab = hashtb_create(sizeof(struct content_entry), &param);
     param.finalize = &finalize_nameprefix;
+    param.memacct = &h->mem[CCND_MEM_NAMEPREFIX];
     h->nameprefix_tab = hashtb_create(sizeof(struct nameprefix_entry), &param);
     param.finalize = &finalize_propagating;
+    param.memacct = &h->mem[CCND_MEM_PIT];
     h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
     param.finalize = 0;
-    h->sparse_straggler_tab = hashtb_create(sizeof(struct sparse_straggler_entry), NULL);
+    param.memacct = NULL;
+    content_slots_grow(h, h->compact ? CCND_COMPACT_CONTENT_SLOTS : 1024);
     h->min_stale = ~0;
     h->max_stale = 0;
     h->unsol = ccn_indexbuf_create();
-    h->ticktock.descr[0] = 'C';
-    h->ticktock.micros_per_base = 1000000;
-    h->ticktock.gettime = &ccnd_gettime;
-    h->ticktock.data = h;
-    h->sched = ccn_schedule_create(h, &h->ticktock);
-    h->starttime = h->sec;
-    h->starttime_usec = h->usec;
+    h->corked = ccn_indexbuf_create();
+    ccn_clock_init(&h->clock);
+    ccnd_refresh_time(h);
+    h->sched = ccn_schedule_create(h, &h->clock.gettime);
+    h->busy_sec = h->sec;
+    h->scratch = ccn_arena_create();
+    gettimeofday(&now, NULL);
+    h->starttime = now.tv_sec;
+    h->starttime_usec = now.tv_usec;
     h->oldformatcontentgrumble = 1;
     h->oldformatinterestgrumble = 1;
     debugstr = getenv("CCND_DEBUG");
@@ -5205,12 +12235,18 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     }
     else
         h->debug = 1;
+    lograte = getenv("CCND_LOG_RATE");
+    h->lograte = CCND_LOG_RATE;
+    if (lograte != NULL && lograte[0] != 0)
+        h->lograte = atol(lograte);
     portstr = getenv(CCN_LOCAL_PORT_ENVNAME);
     if (portstr == NULL || portstr[0] == 0 || strlen(portstr) > 10)
         portstr = CCN_DEFAULT_UNICAST_PORT;
     h->portstr = portstr;
+    if (h->compact)
+        ccnd_msg(h, "CCND_PROFILE=compact");
     entrylimit = getenv("CCND_CAP");
-    h->capacity = ~0;
+    h->capacity = h->compact ? CCND_COMPACT_CAP : ~0;
     if (entrylimit != NULL && entrylimit[0] != 0) {
         h->capacity = atol(entrylimit);
         if (h->capacity == 0)
@@ -5219,6 +12255,215 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
             h->capacity = 10;
     }
     ccnd_msg(h, "CCND_DEBUG=%d CCND_CAP=%lu", h->debug, h->capacity);
+    outq_cap = getenv("CCND_OUTQ_BYTES");
+    h->face_outq_cap = CCND_DEFAULT_OUTQ_BYTES;
+    if (h->compact)
+        h->face_outq_cap = CCND_COMPACT_OUTQ_BYTES;
+    if (outq_cap != NULL && outq_cap[0] != 0) {
+        h->face_outq_cap = parse_byte_count(outq_cap);
+        if (h->face_outq_cap == 0)
+            h->face_outq_cap = ~(size_t)0;
+        ccnd_msg(h, "CCND_OUTQ_BYTES=%llu",
+                 (unsigned long long)h->face_outq_cap);
+    }
+    class_weights = getenv("CCND_CLASS_WEIGHTS");
+    for (i = 1; i < CCND_TC_N; i++)
+        h->tc_weight[i] = 1 << (CCND_TC_N - 1 - i);
+    if (class_weights != NULL && class_weights[0] != 0) {
+        const char *p = class_weights;
+        for (i = 1; i < CCND_TC_N && *p != 0; i++) {
+            h->tc_weight[i] = atoi(p);
+            if (h->tc_weight[i] < 1)
+                h->tc_weight[i] = 1;
+            p += strcspn(p, ",");
+            if (*p == ',')
+                p++;
+        }
+        ccnd_msg(h, "CCND_CLASS_WEIGHTS=%d,%d,%d",
+                 h->tc_weight[1], h->tc_weight[2], h->tc_weight[3]);
+    }
+    face_irate = getenv("CCND_FACE_INTEREST_RATE");
+    if (face_irate != NULL && face_irate[0] != 0) {
+        h->face_irate = atol(face_irate);
+        if (h->face_irate > 1000000)
+            h->face_irate = 1000000;
+        ccnd_msg(h, "CCND_FACE_INTEREST_RATE=%u", h->face_irate);
+    }
+    prefix_irate = getenv("CCND_PREFIX_INTEREST_RATE");
+    if (prefix_irate != NULL && prefix_irate[0] != 0) {
+        h->prefix_irate = atol(prefix_irate);
+        if (h->prefix_irate > 1000000)
+            h->prefix_irate = 1000000;
+        ccnd_msg(h, "CCND_PREFIX_INTEREST_RATE=%u", h->prefix_irate);
+    }
+    pit_limit = getenv("CCND_PIT_LIMIT");
+    if (pit_limit != NULL && pit_limit[0] != 0) {
+        h->pit_limit = atol(pit_limit);
+        ccnd_msg(h, "CCND_PIT_LIMIT=%u", h->pit_limit);
+    }
+    pit_bytes = getenv("CCND_PIT_BYTES");
+    if (h->compact)
+        h->pit_byte_limit = CCND_COMPACT_PIT_BYTES;
+    if (pit_bytes != NULL && pit_bytes[0] != 0) {
+        h->pit_byte_limit = parse_byte_count(pit_bytes);
+        ccnd_msg(h, "CCND_PIT_BYTES=%llu",
+                 (unsigned long long)h->pit_byte_limit);
+    }
+    negttl = getenv("CCND_NEGATIVE_TTL");
+    if (negttl != NULL && negttl[0] != 0) {
+        h->negttl = atol(negttl);
+        if (h->negttl > CCND_NEGATIVE_TTL_MAX)
+            h->negttl = CCND_NEGATIVE_TTL_MAX;
+        ccnd_msg(h, "CCND_NEGATIVE_TTL=%u", h->negttl);
+    }
+    negttl_prefixes = getenv("CCND_NEGATIVE_TTL_PREFIXES");
+    if (negttl_prefixes != NULL && negttl_prefixes[0] != 0) {
+        ccnd_parse_negttl_list(h, "CCND_NEGATIVE_TTL_PREFIXES",
+                               negttl_prefixes);
+        ccnd_msg(h, "CCND_NEGATIVE_TTL_PREFIXES=%s", negttl_prefixes);
+    }
+    if (h->negttl != 0 || h->negttl_ms != NULL)
+        h->negcache_tab = hashtb_create(sizeof(struct negcache_entry), NULL);
+    dead_nonce = getenv("CCND_DEAD_NONCE_SECONDS");
+    dnl_period = CCND_DEAD_NONCE_SECONDS;
+    if (dead_nonce != NULL && dead_nonce[0] != 0) {
+        dnl_period = atol(dead_nonce);
+        if (dnl_period > CCND_DEAD_NONCE_MAX)
+            dnl_period = CCND_DEAD_NONCE_MAX;
+        ccnd_msg(h, "CCND_DEAD_NONCE_SECONDS=%ld", dnl_period);
+    }
+    bytelimit = getenv("CCND_CAP_BYTES");
+    h->capacity_bytes = ~(size_t)0;
+    if (h->compact)
+        h->capacity_bytes = CCND_COMPACT_CAP_BYTES;
+    if (bytelimit != NULL && bytelimit[0] != 0) {
+        h->capacity_bytes = parse_byte_count(bytelimit);
+        ccnd_msg(h, "CCND_CAP_BYTES=%llu",
+                 (unsigned long long)h->capacity_bytes);
+    }
+    mrc_rate = getenv("CCND_MRC_RATE");
+    mrc_sample = 100;
+    if (mrc_rate != NULL && mrc_rate[0] != 0) {
+        mrc_sample = atol(mrc_rate);
+        ccnd_msg(h, "CCND_MRC_RATE=%ld", mrc_sample);
+    }
+    if (mrc_sample > 0)
+        h->mrc = ccnd_mrc_create(mrc_sample);
+    h->notice_usec = CCND_NOTICE_INTERVAL * 1000;
+    notice_interval = getenv("CCND_NOTICE_INTERVAL");
+    if (notice_interval != NULL && notice_interval[0] != 0) {
+        notice_ms = atoi(notice_interval);
+        if (notice_ms < 1)
+            notice_ms = 1;
+        if (notice_ms > 60000)
+            notice_ms = 60000;
+        h->notice_usec = notice_ms * 1000;
+        ccnd_msg(h, "CCND_NOTICE_INTERVAL=%d", notice_ms);
+    }
+    h->mgmt_budget = CCND_MGMT_BUDGET;
+    mgmt_budget = getenv("CCND_MGMT_BUDGET");
+    if (mgmt_budget != NULL && mgmt_budget[0] != 0) {
+        h->mgmt_budget = atoi(mgmt_budget);
+        if (h->mgmt_budget < 1)
+            h->mgmt_budget = 1;
+        if (h->mgmt_budget > CCND_MGMT_QMAX)
+            h->mgmt_budget = CCND_MGMT_QMAX;
+        ccnd_msg(h, "CCND_MGMT_BUDGET=%d", h->mgmt_budget);
+    }
+    h->topk = CCND_HH_TOPK;
+    topk = getenv("CCND_TOPK");
+    if (topk != NULL && topk[0] != 0) {
+        h->topk = atoi(topk);
+        if (h->topk < 0)
+            h->topk = 0;
+        if (h->topk > CCND_HH_MAXK)
+            h->topk = CCND_HH_MAXK;
+        ccnd_msg(h, "CCND_TOPK=%d", h->topk);
+    }
+    if (h->topk > 0) {
+        hh_width = h->compact ? CCND_COMPACT_HH_WIDTH : CCND_HH_WIDTH;
+        for (i = 0; i < CCND_HH_DEPTHS; i++)
+            h->hh_prefix[i] = ccnd_hh_create(h->topk, hh_width);
+        h->hh_face = ccnd_hh_create(h->topk, hh_width);
+        h->hh_bytes = ccnd_hh_create(h->topk, hh_width);
+    }
+    disk_path = getenv("CCND_DISK_CACHE");
+    if (disk_path != NULL && disk_path[0] != 0) {
+        disk_capacity = CCND_DISK_CACHE_BYTES;
+        disk_bytes = getenv("CCND_DISK_CACHE_BYTES");
+        if (disk_bytes != NULL && disk_bytes[0] != 0)
+            disk_capacity = parse_byte_count(disk_bytes);
+        h->disk = ccnd_disk_create(disk_path, disk_capacity);
+        if (h->disk == NULL)
+            ccnd_msg(h, "CCND_DISK_CACHE=%s: %s", disk_path, strerror(errno));
+        else
+            ccnd_msg(h, "CCND_DISK_CACHE=%s (%ju bytes, %lu objects recovered)",
+                     disk_path, disk_capacity, ccnd_disk_recovered(h->disk));
+    }
+    h->snapshot_path = getenv("CCND_SNAPSHOT");
+    if (h->snapshot_path != NULL && h->snapshot_path[0] == 0)
+        h->snapshot_path = NULL;
+    h->snapshot_objects = CCND_SNAPSHOT_OBJECTS;
+    snapshot_objects = getenv("CCND_SNAPSHOT_OBJECTS");
+    if (snapshot_objects != NULL && snapshot_objects[0] != 0)
+        h->snapshot_objects = atoi(snapshot_objects);
+    if (h->snapshot_objects < 0)
+        h->snapshot_objects = 0;
+    if (h->snapshot_path != NULL)
+        ccnd_msg(h, "CCND_SNAPSHOT=%s (up to %d objects)",
+                 h->snapshot_path, h->snapshot_objects);
+    idle_slack = getenv("CCND_IDLE_SLACK");
+    if (idle_slack != NULL && atoi(idle_slack) > 0) {
+        h->idle_slack = atoi(idle_slack);
+        if (h->idle_slack > 60000)
+            h->idle_slack = 60000;
+        ccnd_msg(h, "CCND_IDLE_SLACK=%d", h->idle_slack);
+        h->idle_slack *= 1000;
+    }
+    compress_age = getenv("CCND_COMPRESS_AGE");
+    if (compress_age != NULL && atoi(compress_age) > 0) {
+        h->compress_age = atoi(compress_age);
+        h->expanded = ccn_charbuf_create();
+        h->compressor = ccn_schedule_event(h->sched, CCND_COMPRESS_PERIOD,
+                                           compress_deamon, NULL, 0);
+        ccnd_msg(h, "CCND_COMPRESS_AGE=%u", h->compress_age);
+    }
+    prefetch = getenv("CCND_PREFETCH");
+    ccnd_admit_init(h, getenv("CCND_ADMIT"));
+    prefetch_depth = prefetch == NULL ? 0 : atoi(prefetch);
+    if (prefetch_depth > CCND_PREFETCH_MAX)
+        prefetch_depth = CCND_PREFETCH_MAX;
+    if (prefetch_depth > 0) {
+        h->prefetch = ccnd_prefetch_create(prefetch_depth,
+                                           CCND_PREFETCH_STREAMS);
+        if (h->prefetch != NULL)
+            ccnd_msg(h, "CCND_PREFETCH=%d", prefetch_depth);
+    }
+    h->evictions = ccnd_meter_create(h, "evicted");
+    h->cs_n = 1;
+    cs_shards = getenv("CCND_CS_SHARDS");
+    if (cs_shards != NULL && cs_shards[0] != 0) {
+        h->cs_n = atoi(cs_shards);
+        if (h->cs_n < 1)
+            h->cs_n = 1;
+        if (h->cs_n > CCND_CS_SHARDS_MAX)
+            h->cs_n = CCND_CS_SHARDS_MAX;
+        ccnd_msg(h, "CCND_CS_SHARDS=%d", h->cs_n);
+    }
+    cache_policy = getenv("CCND_CACHE_POLICY");
+    if (cache_policy != NULL && (cache_policy[0] == 0 ||
+                                 strcmp(cache_policy, "default") == 0))
+        cache_policy = NULL;
+    content_store_create(h, cache_policy);
+    if (cache_policy != NULL) {
+        if (h->cs->cache == NULL)
+            ccnd_msg(h, "CCND_CACHE_POLICY=%s not recognized, using default",
+                     cache_policy);
+        else
+            ccnd_msg(h, "CCND_CACHE_POLICY=%s",
+                     ccnd_cache_policy_name(h->cs->cache));
+    }
+    h->quota = ccnd_quota_create();
     h->mtu = 0;
     mtu = getenv("CCND_MTU");
     if (mtu != NULL && mtu[0] != 0) {
@@ -5228,6 +12473,51 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
         if (h->mtu > 8800)
             h->mtu = 8800;
     }
+    h->pack_microsec = 0;
+    pack = getenv("CCND_PACK_MICROSEC");
+    if (pack != NULL && pack[0] != 0) {
+        h->pack_microsec = atol(pack);
+        if (h->pack_microsec < 0)
+            h->pack_microsec = 0;
+        if (h->pack_microsec > 100000)
+            h->pack_microsec = 100000;
+        if (h->pack_microsec != 0)
+            ccnd_msg(h, "CCND_PACK_MICROSEC=%d", h->pack_microsec);
+    }
+    h->link_mtu = 0;
+    link_mtu = getenv("CCND_LINK_MTU");
+    if (link_mtu != NULL && link_mtu[0] != 0) {
+        h->link_mtu = atol(link_mtu);
+        if (h->link_mtu < 0)
+            h->link_mtu = 0;
+        if (h->link_mtu != 0 && h->link_mtu < 256)
+            h->link_mtu = 256;
+        if (h->link_mtu > CCND_DGRAM_MAX)
+            h->link_mtu = CCND_DGRAM_MAX;
+        if (h->link_mtu != 0)
+            ccnd_msg(h, "CCND_LINK_MTU=%d", h->link_mtu);
+    }
+    link_arq = getenv("CCND_LINK_ARQ");
+    udp_gso = getenv("CCND_UDP_GSO");
+    h->link_arq = (link_arq != NULL && atoi(link_arq) != 0);
+    if (h->link_arq)
+        ccnd_msg(h, "CCND_LINK_ARQ=%d", h->link_arq);
+    h->trace_nrec = 65536;
+    trace_records = getenv("CCND_TRACE_RECORDS");
+    if (trace_records != NULL && trace_records[0] != 0) {
+        h->trace_nrec = atol(trace_records);
+        if (h->trace_nrec < 1024)
+            h->trace_nrec = 1024;
+        if (h->trace_nrec > (1U << 24))
+            h->trace_nrec = 1U << 24;
+    }
+    trace = getenv("CCND_TRACE");
+    if (trace != NULL && trace[0] != 0) {
+        if (ccnd_trace_open(h, trace, h->trace_nrec) == -1)
+            ccnd_msg(h, "CCND_TRACE=%s: %s", trace, strerror(errno));
+        else
+            ccnd_trace_enable(h, 1);
+    }
     h->data_pause_microsec = 10000;
     data_pause = getenv("CCND_DATA_PAUSE_MICROSEC");
     if (data_pause != NULL && data_pause[0] != 0) {
@@ -5257,6 +12547,7 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     }
     listen_on = getenv("CCND_LISTEN_ON");
     autoreg = getenv("CCND_AUTOREG");
+    io_backend = getenv("CCND_IO");
     
     if (autoreg != NULL && autoreg[0] != 0) {
         h->autoreg = ccnd_parse_uri_list(h, "CCND_AUTOREG", autoreg);
@@ -5270,6 +12561,15 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
     /* Do keystore setup early, it takes a while the first time */
     ccnd_init_internal_keystore(h);
     ccnd_reseed(h);
+    if (dnl_period > 0)
+        h->dnl = ccnd_dnl_create(dnl_period, h->sec,
+                                 ((uint64_t)nrand48(h->seed) << 31) ^
+                                 nrand48(h->seed));
+    /* The names seen once are kept the same way as dead nonces */
+    if ((h->admit & CCND_ADMIT_SECOND) != 0)
+        h->admit_seen = ccnd_dnl_create(CCND_ADMIT_WINDOW, h->sec,
+                                        ((uint64_t)nrand48(h->seed) << 31) ^
+                                        nrand48(h->seed));
     if (h->face0 == NULL) {
         struct face *face;
         face = calloc(1, sizeof(*face));
@@ -5279,6 +12579,22 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
         h->face0 = face;
     }
     enroll_face(h, h->face0);
+    h->evfd = ccnd_io_create(h, io_backend);
+    if (h->uring != NULL)
+        ccnd_msg(h, "CCND_IO=uring");
+    /* The batch buffers are big, so the compact profile does without */
+    if (!h->compact)
+        h->dgram_io = calloc(1, sizeof(*h->dgram_io));
+    if (h->dgram_io != NULL) {
+        h->dgram_io->fd = -1;
+        h->dgram_io->obuf = ccn_charbuf_create();
+#if defined(CCND_HAVE_GSO)
+        if (udp_gso == NULL || atoi(udp_gso) != 0)
+            h->dgram_io->gso_maxseg = CCND_DGRAM_MAX;
+        else
+            ccnd_msg(h, "CCND_UDP_GSO=0");
+#endif
+    }
     fd = create_local_listener(h, sockname, 42);
     if (fd == -1)
         ccnd_msg(h, "%s: %s", sockname, strerror(errno));
@@ -5286,12 +12602,19 @@ ccnd_create(const char *progname, ccnd_logger logger, void *loggerdata)
         ccnd_msg(h, "listening on %s", sockname);
     h->flood = (h->autoreg != NULL);
     h->ipv4_faceid = h->ipv6_faceid = CCN_NOFACEID;
+    ccnd_shards_init(h);
     ccnd_listen_on(h, listen_on);
+    ccnd_ether_init(h, getenv("CCND_ETHER"));
     clean_needed(h);
     age_forwarding_needed(h);
     ccnd_internal_client_start(h);
     free(sockname);
     sockname = NULL;
+    if (h->snapshot_path != NULL) {
+        ccnd_snapshot_load(h);
+        signal(SIGUSR1, &handle_snapshot_signal);
+        signal(SIGTERM, &handle_snapshot_signal);
+    }
     return(h);
 }
 
@@ -5320,17 +12643,75 @@ void
 ccnd_destroy(struct ccnd_handle **pccnd)
 {
     struct ccnd_handle *h = *pccnd;
+    struct sockaddr_un sa;
+    int i;
     if (h == NULL)
         return;
+    if (h->snapshot_path != NULL)
+        ccnd_snapshot_write(h);
+    stream_batch_flush(h);
+    dgram_batch_flush(h);
     ccnd_shutdown_listeners(h);
+    if (h->shard_faceid != CCN_NOFACEID && shard_sockaddr(h->shard, &sa) == 0)
+        unlink(sa.sun_path);
     ccnd_internal_client_stop(h);
+    mgmt_discard(h);
     ccn_schedule_destroy(&h->sched);
+    ccnd_status_destroy(h);
+    free(h->cpu_node);
+    h->cpu_node = NULL;
     hashtb_destroy(&h->dgram_faces);
+    ccnd_trace_close(h);
     hashtb_destroy(&h->faces_by_fd);
-    hashtb_destroy(&h->content_tab);
+    for (i = 0; i < h->cs_n; i++) {
+        hashtb_destroy(&h->cs[i].content_tab);
+        ccnd_cache_destroy(&h->cs[i].cache);
+    }
+    free(h->cs);
+    h->cs = NULL;
+    ccnd_quota_destroy(&h->quota);
+    ccnd_nameindex_destroy(&h->nameindex);
+    ccnd_intern_destroy(&h->intern);
+    ccn_charbuf_destroy(&h->expanded);
+    ccnd_mrc_destroy(&h->mrc);
+    for (i = 0; i < CCND_HH_DEPTHS; i++)
+        ccnd_hh_destroy(&h->hh_prefix[i]);
+    ccnd_hh_destroy(&h->hh_face);
+    ccnd_hh_destroy(&h->hh_bytes);
+    ccnd_disk_destroy(&h->disk);
+    ccnd_prefetch_destroy(&h->prefetch);
+    ccn_charbuf_destroy(&h->prefetch_out);
+    ccnd_meter_destroy(&h->evictions);
+    for (i = 0; i < CCND_FRESH_WHEEL; i++) {
+        ccn_indexbuf_destroy(&h->fresh_wheel[i]);
+        ccn_indexbuf_destroy(&h->residency_wheel[i]);
+    }
     hashtb_destroy(&h->propagating_tab);
+    ccnd_dnl_destroy(&h->dnl);
+    ccnd_dnl_destroy(&h->admit_seen);
     hashtb_destroy(&h->nameprefix_tab);
-    hashtb_destroy(&h->sparse_straggler_tab);
+    if (h->fresh_rule != NULL) {
+        for (i = 0; i < h->fresh_rules; i++)
+            ccn_charbuf_destroy(&h->fresh_rule[i].name);
+        free(h->fresh_rule);
+        h->fresh_rule = NULL;
+    }
+    pit_slabs_destroy(h);
+    ccnd_faceset_reset(&h->fs_scratch);
+    hashtb_destroy(&h->negcache_tab);
+    ccn_charbuf_destroy(&h->negttl_comps);
+    ccn_indexbuf_destroy(&h->negttl_off);
+    ccn_indexbuf_destroy(&h->negttl_ms);
+    if (h->uring != NULL)
+        ccnd_uring_destroy(h);
+    else if (h->evfd != -1)
+        close(h->evfd);
+    h->evfd = -1;
+    if (h->dgram_io != NULL) {
+        ccn_charbuf_destroy(&h->dgram_io->obuf);
+        free(h->dgram_io);
+        h->dgram_io = NULL;
+    }
     if (h->fds != NULL) {
         free(h->fds);
         h->fds = NULL;
@@ -5339,21 +12720,26 @@ ccnd_destroy(struct ccnd_handle **pccnd)
     if (h->faces_by_faceid != NULL) {
         free(h->faces_by_faceid);
         h->faces_by_faceid = NULL;
-        h->face_limit = h->face_gen = 0;
-    }
-    if (h->content_by_accession != NULL) {
-        free(h->content_by_accession);
-        h->content_by_accession = NULL;
-        h->content_by_accession_window = 0;
+        free(h->face_slots);
+        h->face_slots = NULL;
+        h->face_limit = 0;
+    }
+    if (h->content_by_slot != NULL) {
+        free(h->content_by_slot);
+        h->content_by_slot = NULL;
+        free(h->content_slot_free);
+        h->content_slot_free = NULL;
+        h->content_slot_limit = 0;
+        h->content_slot_nfree = 0;
     }
-    ccn_charbuf_destroy(&h->scratch_charbuf);
     ccn_charbuf_destroy(&h->autoreg);
-    ccn_indexbuf_destroy(&h->skiplinks);
-    ccn_indexbuf_destroy(&h->scratch_indexbuf);
+    ccn_arena_destroy(&h->scratch);
     ccn_indexbuf_destroy(&h->unsol);
+    ccn_indexbuf_destroy(&h->corked);
+    ccn_charbuf_destroy(&h->spare_inbuf);
     if (h->face0 != NULL) {
         ccn_charbuf_destroy(&h->face0->inbuf);
-        ccn_charbuf_destroy(&h->face0->outbuf);
+        outq_destroy(&h->face0->outq);
         free(h->face0);
         h->face0 = NULL;
     }
@@ -0,0 +1,503 @@
+/**
+ * @file ccnd_bench.c
+ *
+ * Forwarding microbenchmark for ccnd internals.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * A ccnd is created in-process, and its faces are attached to socketpairs
+ * whose other ends are only drained.  A workload of interests and content
+ * objects is generated in memory ahead of time and then handed straight to
+ * the message processing code, so the figures reflect ccnd itself rather
+ * than the cost of clients and the network.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/schedule.h>
+
+#include "ccnd_private.h"
+
+#define BENCH_BATCH 64          /**< messages between scheduler runs */
+#define BENCH_LAG (4 * BENCH_BATCH) /**< messages before a miss is answered */
+#define BENCH_MAXFANIN 64
+
+/**
+ * Count heap allocations, where the C library lets us interpose.
+ */
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+static uintmax_t bench_allocs;
+static const int bench_counting = 1;
+
+void *
+malloc(size_t size)
+{
+    bench_allocs++;
+    return(__libc_malloc(size));
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+    bench_allocs++;
+    return(__libc_calloc(n, size));
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    bench_allocs++;
+    return(__libc_realloc(ptr, size));
+}
+#else
+static uintmax_t bench_allocs;
+static const int bench_counting = 0;
+#endif
+
+/** One pregenerated message */
+struct bench_msg {
+    unsigned face;              /**< index into the bench faces */
+    size_t start;               /**< offset in the workload buffer */
+    size_t size;
+};
+
+struct bench_workload {
+    struct ccn_charbuf *buf;    /**< all the messages, back to back */
+    struct bench_msg *msgs;
+    size_t n;
+    size_t limit;
+    unsigned interests;
+    unsigned contents;
+};
+
+struct bench_params {
+    unsigned ops;               /**< requests to generate, before fan-in */
+    unsigned names;             /**< size of the cached name population */
+    double zipf;                /**< Zipf exponent for cached names */
+    unsigned fib;               /**< registered prefixes */
+    unsigned fanin;             /**< consumer faces asking for each miss */
+    double hit_ratio;           /**< fraction of interests for cached names */
+    unsigned short seed[3];
+    int verbose;
+};
+
+static int
+bench_logger(void *loggerdata, const char *format, va_list ap)
+{
+    int *verbose = loggerdata;
+    if (*verbose)
+        return(vfprintf(stderr, format, ap));
+    return(0);
+}
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-n ops] [-N names] [-z zipf] [-F fib] [-f fanin] "
+            "[-c hitratio] [-s seed] [-v]\n"
+            "   Run ccnd forwarding code on a generated workload.\n"
+            "   -n  requests to generate, before fan-in (default 100000)\n"
+            "   -N  distinct names in the content store (default 10000)\n"
+            "   -z  Zipf exponent for choosing cached names (default 1.0)\n"
+            "   -F  registered FIB prefixes (default 100)\n"
+            "   -f  consumer faces asking for each uncached name (default 1)\n"
+            "   -c  fraction of interests answered from the store (default 0.5)\n"
+            "   -s  random seed\n"
+            "   -v  show ccnd log messages\n",
+            progname);
+    exit(1);
+}
+
+static double
+now_secs(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return(tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+/**
+ * Build the cumulative distribution for Zipf-distributed ranks 0..n-1.
+ */
+static double *
+zipf_create(unsigned n, double s)
+{
+    double *cdf;
+    double sum = 0;
+    unsigned i;
+
+    cdf = calloc(n, sizeof(*cdf));
+    for (i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, s);
+        cdf[i] = sum;
+    }
+    for (i = 0; i < n; i++)
+        cdf[i] /= sum;
+    return(cdf);
+}
+
+static unsigned
+zipf_draw(const double *cdf, unsigned n, unsigned short *seed)
+{
+    double u = erand48(seed);
+    unsigned lo = 0;
+    unsigned hi = n - 1;
+    unsigned mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return(lo);
+}
+
+static void
+bench_name(struct ccn_charbuf *name, unsigned fib, const char *kind,
+           unsigned k)
+{
+    char tmp[24];
+
+    name->length = 0;
+    ccn_name_init(name);
+    ccn_name_append_str(name, "bench");
+    snprintf(tmp, sizeof(tmp), "%u", k % fib);
+    ccn_name_append_str(name, tmp);
+    ccn_name_append_str(name, kind);
+    snprintf(tmp, sizeof(tmp), "%u", k);
+    ccn_name_append_str(name, tmp);
+}
+
+static void
+workload_add(struct bench_workload *w, unsigned face, size_t start)
+{
+    if (w->n == w->limit) {
+        w->limit = 2 * w->limit + 1024;
+        w->msgs = realloc(w->msgs, w->limit * sizeof(w->msgs[0]));
+        if (w->msgs == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    w->msgs[w->n].face = face;
+    w->msgs[w->n].start = start;
+    w->msgs[w->n].size = w->buf->length - start;
+    w->n++;
+}
+
+/**
+ * Append an Interest for name, to arrive on face.
+ *
+ * The nonce is left out, so ccnd supplies a fresh one.
+ */
+static void
+add_interest(struct bench_workload *w, unsigned face,
+             const struct ccn_charbuf *name)
+{
+    size_t start = w->buf->length;
+
+    ccn_charbuf_append_tt(w->buf, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append(w->buf, name->buf, name->length);
+    ccn_charbuf_append_closer(w->buf);
+    workload_add(w, face, start);
+    w->interests++;
+}
+
+/**
+ * Append a ContentObject for name, to arrive on face.
+ *
+ * ccnd does not check signatures, so the signature bits are filler.
+ */
+static void
+add_content(struct bench_workload *w, unsigned face,
+            const struct ccn_charbuf *name,
+            const struct ccn_charbuf *signed_info)
+{
+    static const unsigned char sigbits[128] = {0};
+    static const char payload[] = "ccnd_bench payload";
+    size_t start = w->buf->length;
+
+    ccn_charbuf_append_tt(w->buf, CCN_DTAG_ContentObject, CCN_DTAG);
+    ccn_charbuf_append_tt(w->buf, CCN_DTAG_Signature, CCN_DTAG);
+    ccnb_append_tagged_blob(w->buf, CCN_DTAG_SignatureBits,
+                            sigbits, sizeof(sigbits));
+    ccn_charbuf_append_closer(w->buf);
+    ccn_charbuf_append(w->buf, name->buf, name->length);
+    ccn_charbuf_append(w->buf, signed_info->buf, signed_info->length);
+    ccnb_append_tagged_blob(w->buf, CCN_DTAG_Content,
+                            payload, sizeof(payload) - 1);
+    ccn_charbuf_append_closer(w->buf);
+    workload_add(w, face, start);
+    w->contents++;
+}
+
+/**
+ * Generate the workloads.
+ *
+ * warm holds content for the cached names, sent by the producer.
+ * run mixes interests for cached names (chosen by Zipf rank) with
+ * interests for new names; each new name is asked for by fanin
+ * consumer faces and then answered by the producer.  The answer is held
+ * back for a few batches, so that the scheduler has had the chance to
+ * forward the interest to the producer by then.
+ */
+static void
+generate(const struct bench_params *p, struct bench_workload *warm,
+         struct bench_workload *run)
+{
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *signed_info = ccn_charbuf_create();
+    unsigned char keyid[32];
+    unsigned short seed[3];
+    unsigned producer = p->fanin;
+    unsigned *pending;
+    size_t *due;
+    unsigned npending = 0;
+    unsigned k = 0;
+    double *cdf;
+    unsigned i, j;
+
+    memcpy(seed, p->seed, sizeof(seed));
+    for (i = 0; i < sizeof(keyid); i++)
+        keyid[i] = nrand48(seed);
+    ccn_signed_info_create(signed_info, keyid, sizeof(keyid), NULL,
+                           CCN_CONTENT_DATA, -1, NULL, NULL);
+    cdf = zipf_create(p->names, p->zipf);
+    pending = calloc(p->ops, sizeof(*pending));
+    due = calloc(p->ops, sizeof(*due));
+    for (i = 0; i < p->names; i++) {
+        bench_name(name, p->fib, "h", i);
+        add_content(warm, producer, name, signed_info);
+    }
+    for (i = 0; i <= p->ops; i++) {
+        for (; k < npending && (i == p->ops || run->n >= due[k]); k++) {
+            bench_name(name, p->fib, "m", pending[k]);
+            add_content(run, producer, name, signed_info);
+        }
+        if (i == p->ops)
+            break;
+        if (erand48(seed) < p->hit_ratio) {
+            bench_name(name, p->fib, "h", zipf_draw(cdf, p->names, seed));
+            add_interest(run, i % p->fanin, name);
+        }
+        else {
+            bench_name(name, p->fib, "m", i);
+            for (j = 0; j < p->fanin; j++)
+                add_interest(run, j, name);
+            pending[npending] = i;
+            due[npending++] = run->n + BENCH_LAG;
+        }
+    }
+    free(due);
+    free(pending);
+    free(cdf);
+    ccn_charbuf_destroy(&signed_info);
+    ccn_charbuf_destroy(&name);
+}
+
+/**
+ * Discard whatever ccnd has sent to the bench ends of the socketpairs.
+ */
+static void
+drain(int *fds, unsigned n)
+{
+    static char scratch[65536];
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        while (read(fds[i], scratch, sizeof(scratch)) > 0)
+            continue;
+}
+
+/**
+ * Feed a workload to ccnd.
+ * @returns the elapsed time, not counting the draining of output.
+ */
+static double
+feed(struct ccnd_handle *h, struct face **faces, int *fds, unsigned nfaces,
+     struct bench_workload *w)
+{
+    double elapsed = 0;
+    double t0;
+    size_t i;
+
+    t0 = now_secs();
+    for (i = 0; i < w->n; i++) {
+        ccnd_input_message(h, faces[w->msgs[i].face],
+                           w->buf->buf + w->msgs[i].start, w->msgs[i].size);
+        if ((i + 1) % BENCH_BATCH == 0 || i + 1 == w->n) {
+            ccn_schedule_run(h->sched);
+            elapsed += now_secs() - t0;
+            drain(fds, nfaces);
+            t0 = now_secs();
+        }
+    }
+    /* Let the content queues empty */
+    for (i = 0; i < 100; i++) {
+        ccn_schedule_run(h->sched);
+        elapsed += now_secs() - t0;
+        drain(fds, nfaces);
+        usleep(1000);
+        t0 = now_secs();
+    }
+    return(elapsed);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct bench_params p = {0};
+    struct bench_workload warm = {0};
+    struct bench_workload run = {0};
+    struct ccnd_handle *h = NULL;
+    struct face *faces[BENCH_MAXFANIN + 1];
+    int fds[BENCH_MAXFANIN + 1];
+    int sv[2];
+    char tmp[64];
+    uintmax_t hits0, sent0, allocs0;
+    double elapsed;
+    unsigned nfaces;
+    unsigned i;
+    int opt;
+
+    p.ops = 100000;
+    p.names = 10000;
+    p.zipf = 1.0;
+    p.fib = 100;
+    p.fanin = 1;
+    p.hit_ratio = 0.5;
+    p.seed[0] = 1;
+    while ((opt = getopt(argc, argv, "hn:N:z:F:f:c:s:v")) != -1) {
+        switch (opt) {
+            case 'n':
+                p.ops = atoi(optarg);
+                break;
+            case 'N':
+                p.names = atoi(optarg);
+                break;
+            case 'z':
+                p.zipf = atof(optarg);
+                break;
+            case 'F':
+                p.fib = atoi(optarg);
+                break;
+            case 'f':
+                p.fanin = atoi(optarg);
+                break;
+            case 'c':
+                p.hit_ratio = atof(optarg);
+                break;
+            case 's':
+                p.seed[0] = atoi(optarg);
+                p.seed[1] = atoi(optarg) >> 16;
+                break;
+            case 'v':
+                p.verbose = 1;
+                break;
+            default:
+                usage(progname);
+        }
+    }
+    if (optind != argc || p.ops == 0 || p.names == 0 || p.fib == 0 ||
+        p.fanin == 0 || p.fanin > BENCH_MAXFANIN ||
+        p.hit_ratio < 0 || p.hit_ratio > 1)
+        usage(progname);
+    signal(SIGPIPE, SIG_IGN);
+    /* Keep clear of any real ccnd, and send content without pausing */
+    snprintf(tmp, sizeof(tmp), "/tmp/.ccnd_bench.%d.sock", (int)getpid());
+    setenv("CCN_LOCAL_SOCKNAME", tmp, 1);
+    setenv("CCN_LOCAL_PORT", "49695", 0);
+    setenv("CCND_LISTEN_ON", "127.0.0.1", 0);
+    setenv("CCND_DATA_PAUSE_MICROSEC", "1", 0);
+    setenv("CCND_DEBUG", p.verbose ? "1" : "0", 0);
+    snprintf(tmp, sizeof(tmp), "%u", 2 * p.names + 2 * p.ops);
+    setenv("CCND_CAP", tmp, 0);
+
+    warm.buf = ccn_charbuf_create();
+    run.buf = ccn_charbuf_create();
+    generate(&p, &warm, &run);
+    h = ccnd_create(progname, bench_logger, &p.verbose);
+    if (h == NULL) {
+        fprintf(stderr, "%s: unable to create ccnd\n", progname);
+        exit(1);
+    }
+    nfaces = p.fanin + 1;
+    for (i = 0; i < nfaces; i++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            perror("socketpair");
+            exit(1);
+        }
+        faces[i] = ccnd_face_from_fd(h, sv[0]);
+        if (faces[i] == NULL) {
+            fprintf(stderr, "%s: unable to make face\n", progname);
+            exit(1);
+        }
+        fds[i] = sv[1];
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+    }
+    for (i = 0; i < p.fib; i++) {
+        snprintf(tmp, sizeof(tmp), "ccnx:/bench/%u", i);
+        ccnd_reg_uri(h, tmp, faces[p.fanin]->faceid,
+                     CCN_FORW_ACTIVE, 0x7FFFFFFF);
+    }
+    feed(h, faces, fds, nfaces, &warm);
+    hits0 = h->cache_hits;
+    sent0 = h->interests_sent;
+    allocs0 = bench_allocs;
+    elapsed = feed(h, faces, fds, nfaces, &run);
+    printf("ccnd_bench: %u interests, %u content objects, "
+           "%u names, zipf %g, fib %u, fanin %u, hit ratio %g\n",
+           run.interests, run.contents, p.names, p.zipf, p.fib, p.fanin,
+           p.hit_ratio);
+    printf("  %.3f s, %.0f packets/s, %.0f ns/packet\n",
+           elapsed, run.n / elapsed, elapsed * 1e9 / run.n);
+    if (bench_counting)
+        printf("  %.2f allocations/packet\n",
+               (double)(bench_allocs - allocs0) / run.n);
+    printf("  %ju store hits, %ju interests sent upstream\n",
+           (uintmax_t)(h->cache_hits - hits0),
+           (uintmax_t)(h->interests_sent - sent0));
+    ccnd_destroy(&h);
+    for (i = 0; i < nfaces; i++)
+        close(fds[i]);
+    ccn_charbuf_destroy(&warm.buf);
+    ccn_charbuf_destroy(&run.buf);
+    free(warm.msgs);
+    free(run.msgs);
+    exit(0);
+}
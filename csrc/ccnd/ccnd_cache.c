@@ -0,0 +1,445 @@
+/**
+ * @file ccnd_cache.c
+ *
+ * Replacement policies for the ccnd content store.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * A replacement policy keeps the evictable content entries on one or more
+ * queues threaded through the entries themselves, so that noting a hit,
+ * withdrawing an entry, and choosing a victim are all constant-time
+ * (amortized, in the case of S3-FIFO).
+ *
+ * Entries marked precious are never enrolled, and so are never chosen.
+ *
+ * Policies:
+ *  - lru: least recently used.
+ *  - lfu: least frequently used, with ties going to the oldest; uses
+ *         a chain of frequency buckets.
+ *  - s3fifo: a small probationary FIFO, a main FIFO with reinsertion,
+ *         and a ghost FIFO that remembers recently evicted names.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/hashtb.h>
+
+#include "ccnd_private.h"
+
+/** A doubly-linked queue of content entries, oldest first */
+struct ccnd_cache_list {
+    struct content_entry *head;     /**< oldest */
+    struct content_entry *tail;     /**< newest */
+    unsigned long n;                /**< number of entries on this list */
+    unsigned freq;                  /**< lfu: use count of these entries */
+    struct ccnd_cache_list *prev;   /**< lfu: bucket with smaller freq */
+    struct ccnd_cache_list *next;   /**< lfu: bucket with larger freq */
+};
+
+struct ccnd_cache_policy {
+    const char *name;
+    void (*enroll)(struct ccnd_cache *, struct content_entry *);
+    void (*touch)(struct ccnd_cache *, struct content_entry *);
+    void (*withdraw)(struct ccnd_cache *, struct content_entry *);
+    struct content_entry *(*victim)(struct ccnd_cache *);
+};
+
+#define S3FIFO_SMALL 0
+#define S3FIFO_MAIN 1
+#define S3FIFO_MAXFREQ 3
+#define GHOST_MIN 64
+#define GHOST_MAX 65536
+
+struct ccnd_cache {
+    const struct ccnd_cache_policy *policy;
+    unsigned long n;                /**< number of entries enrolled */
+    struct ccnd_cache_list q[2];    /**< lru uses q[0]; s3fifo small, main */
+    struct ccnd_cache_list *lowest; /**< lfu: bucket with the smallest freq */
+    struct hashtb *ghost_tab;       /**< s3fifo: name hash -> count */
+    uint32_t *ghost;                /**< s3fifo: ring of name hashes */
+    unsigned ghost_size;            /**< s3fifo: ring capacity */
+    unsigned ghost_next;            /**< s3fifo: next ring slot to use */
+    unsigned ghost_n;               /**< s3fifo: ring slots in use */
+};
+
+/* Queue primitives */
+
+static void
+list_append(struct ccnd_cache_list *l, struct content_entry *content)
+{
+    content->cache_list = l;
+    content->cache_next = NULL;
+    content->cache_prev = l->tail;
+    if (l->tail != NULL)
+        l->tail->cache_next = content;
+    else
+        l->head = content;
+    l->tail = content;
+    l->n++;
+}
+
+static void
+list_unlink(struct content_entry *content)
+{
+    struct ccnd_cache_list *l = content->cache_list;
+    if (content->cache_prev != NULL)
+        content->cache_prev->cache_next = content->cache_next;
+    else
+        l->head = content->cache_next;
+    if (content->cache_next != NULL)
+        content->cache_next->cache_prev = content->cache_prev;
+    else
+        l->tail = content->cache_prev;
+    l->n--;
+    content->cache_list = NULL;
+    content->cache_prev = content->cache_next = NULL;
+}
+
+/* LRU */
+
+static void
+lru_enroll(struct ccnd_cache *c, struct content_entry *content)
+{
+    list_append(&c->q[0], content);
+}
+
+static void
+lru_touch(struct ccnd_cache *c, struct content_entry *content)
+{
+    list_unlink(content);
+    list_append(&c->q[0], content);
+}
+
+static void
+lru_withdraw(struct ccnd_cache *c, struct content_entry *content)
+{
+    (void)c;
+    list_unlink(content);
+}
+
+static struct content_entry *
+lru_victim(struct ccnd_cache *c)
+{
+    return(c->q[0].head);
+}
+
+/* LFU */
+
+/**
+ * Find or make the bucket for freq, which must follow b (or be the
+ * lowest bucket, if b is NULL).
+ */
+static struct ccnd_cache_list *
+lfu_bucket_after(struct ccnd_cache *c, struct ccnd_cache_list *b, unsigned freq)
+{
+    struct ccnd_cache_list *next = (b == NULL) ? c->lowest : b->next;
+    struct ccnd_cache_list *nb;
+
+    if (next != NULL && next->freq == freq)
+        return(next);
+    nb = calloc(1, sizeof(*nb));
+    if (nb == NULL)
+        return(NULL);
+    nb->freq = freq;
+    nb->prev = b;
+    nb->next = next;
+    if (next != NULL)
+        next->prev = nb;
+    if (b != NULL)
+        b->next = nb;
+    else
+        c->lowest = nb;
+    return(nb);
+}
+
+static void
+lfu_bucket_maybe_free(struct ccnd_cache *c, struct ccnd_cache_list *b)
+{
+    if (b->n != 0)
+        return;
+    if (b->prev != NULL)
+        b->prev->next = b->next;
+    else
+        c->lowest = b->next;
+    if (b->next != NULL)
+        b->next->prev = b->prev;
+    free(b);
+}
+
+static void
+lfu_enroll(struct ccnd_cache *c, struct content_entry *content)
+{
+    struct ccnd_cache_list *b = lfu_bucket_after(c, NULL, 1);
+    if (b != NULL)
+        list_append(b, content);
+}
+
+static void
+lfu_touch(struct ccnd_cache *c, struct content_entry *content)
+{
+    struct ccnd_cache_list *b = content->cache_list;
+    struct ccnd_cache_list *nb;
+
+    if (b->freq == ~0U)
+        return;
+    nb = lfu_bucket_after(c, b, b->freq + 1);
+    if (nb == NULL)
+        return;
+    list_unlink(content);
+    list_append(nb, content);
+    lfu_bucket_maybe_free(c, b);
+}
+
+static void
+lfu_withdraw(struct ccnd_cache *c, struct content_entry *content)
+{
+    struct ccnd_cache_list *b = content->cache_list;
+    list_unlink(content);
+    lfu_bucket_maybe_free(c, b);
+}
+
+static struct content_entry *
+lfu_victim(struct ccnd_cache *c)
+{
+    if (c->lowest == NULL)
+        return(NULL);
+    return(c->lowest->head);
+}
+
+/* S3-FIFO */
+
+static uint32_t
+name_hash(struct content_entry *content)
+{
+    const unsigned char *p = content->key + content->comps[0];
+    const unsigned char *e = content->key + content->comps[content->ncomps - 1];
+    uint32_t hash = 2166136261U;
+    for (; p < e; p++)
+        hash = (hash ^ *p) * 16777619U;
+    return(hash);
+}
+
+static void
+ghost_remember(struct ccnd_cache *c, uint32_t hash)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    unsigned *count;
+    int res;
+
+    hashtb_start(c->ghost_tab, e);
+    if (c->ghost_n == c->ghost_size) {
+        /* forget the oldest */
+        res = hashtb_seek(e, &c->ghost[c->ghost_next], sizeof(c->ghost[0]), 0);
+        if (res >= 0) {
+            count = e->data;
+            if (res == HT_NEW_ENTRY || --(*count) == 0)
+                hashtb_delete(e);
+        }
+        c->ghost_n--;
+    }
+    c->ghost[c->ghost_next] = hash;
+    c->ghost_next = (c->ghost_next + 1) % c->ghost_size;
+    c->ghost_n++;
+    if (hashtb_seek(e, &hash, sizeof(hash), 0) >= 0) {
+        count = e->data;
+        (*count)++;
+    }
+    hashtb_end(e);
+}
+
+static void
+s3fifo_enroll(struct ccnd_cache *c, struct content_entry *content)
+{
+    uint32_t hash = name_hash(content);
+    content->cache_freq = 0;
+    if (hashtb_lookup(c->ghost_tab, &hash, sizeof(hash)) != NULL)
+        list_append(&c->q[S3FIFO_MAIN], content);
+    else
+        list_append(&c->q[S3FIFO_SMALL], content);
+}
+
+static void
+s3fifo_touch(struct ccnd_cache *c, struct content_entry *content)
+{
+    (void)c;
+    if (content->cache_freq < S3FIFO_MAXFREQ)
+        content->cache_freq++;
+}
+
+static struct content_entry *
+s3fifo_victim(struct ccnd_cache *c)
+{
+    struct ccnd_cache_list *smallq = &c->q[S3FIFO_SMALL];
+    struct ccnd_cache_list *mainq = &c->q[S3FIFO_MAIN];
+    struct content_entry *content;
+
+    for (;;) {
+        content = smallq->head;
+        if (content != NULL && (smallq->n > c->n / 10 || mainq->head == NULL)) {
+            if (content->cache_freq > 1) {
+                /* Used while on probation, so promote it */
+                content->cache_freq = 0;
+                list_unlink(content);
+                list_append(mainq, content);
+                continue;
+            }
+            ghost_remember(c, name_hash(content));
+            return(content);
+        }
+        content = mainq->head;
+        if (content == NULL)
+            return(NULL);
+        if (content->cache_freq == 0)
+            return(content);
+        content->cache_freq--;
+        list_unlink(content);
+        list_append(mainq, content);
+    }
+}
+
+static const struct ccnd_cache_policy policies[] = {
+    {"lru", &lru_enroll, &lru_touch, &lru_withdraw, &lru_victim},
+    {"lfu", &lfu_enroll, &lfu_touch, &lfu_withdraw, &lfu_victim},
+    {"s3fifo", &s3fifo_enroll, &s3fifo_touch, &lru_withdraw, &s3fifo_victim},
+    {NULL}
+};
+
+/**
+ * Create a content store replacement policy.
+ * @param name is the policy name, as given by CCND_CACHE_POLICY.
+ * @param capacity is the configured content store capacity, in objects.
+ * @returns the new policy, or NULL if the name is unknown or for ENOMEM.
+ */
+struct ccnd_cache *
+ccnd_cache_create(const char *name, unsigned long capacity)
+{
+    struct ccnd_cache *c;
+    int i;
+
+    for (i = 0; policies[i].name != NULL; i++)
+        if (strcmp(name, policies[i].name) == 0)
+            break;
+    if (policies[i].name == NULL)
+        return(NULL);
+    c = calloc(1, sizeof(*c));
+    if (c == NULL)
+        return(NULL);
+    c->policy = &policies[i];
+    if (c->policy->victim == &s3fifo_victim) {
+        c->ghost_size = GHOST_MAX;
+        if (capacity < GHOST_MAX)
+            c->ghost_size = capacity < GHOST_MIN ? GHOST_MIN : capacity;
+        c->ghost = calloc(c->ghost_size, sizeof(c->ghost[0]));
+        c->ghost_tab = hashtb_create(sizeof(unsigned), NULL);
+        if (c->ghost == NULL || c->ghost_tab == NULL) {
+            ccnd_cache_destroy(&c);
+            return(NULL);
+        }
+    }
+    return(c);
+}
+
+/**
+ * Destroy a replacement policy.
+ *
+ * Any entries still enrolled must not be referred to afterwards.
+ */
+void
+ccnd_cache_destroy(struct ccnd_cache **pc)
+{
+    struct ccnd_cache *c = *pc;
+    struct ccnd_cache_list *b;
+
+    if (c == NULL)
+        return;
+    while (c->lowest != NULL) {
+        b = c->lowest;
+        c->lowest = b->next;
+        free(b);
+    }
+    hashtb_destroy(&c->ghost_tab);
+    free(c->ghost);
+    free(c);
+    *pc = NULL;
+}
+
+/**
+ * @returns the name of the policy.
+ */
+const char *
+ccnd_cache_policy_name(struct ccnd_cache *c)
+{
+    return(c->policy->name);
+}
+
+/**
+ * Make content eligible for eviction.
+ */
+void
+ccnd_cache_enroll(struct ccnd_cache *c, struct content_entry *content)
+{
+    if (content->cache_list != NULL)
+        return;
+    c->policy->enroll(c, content);
+    if (content->cache_list != NULL)
+        c->n++;
+}
+
+/**
+ * Note a cache hit on content.
+ */
+void
+ccnd_cache_touch(struct ccnd_cache *c, struct content_entry *content)
+{
+    if (content->cache_list != NULL)
+        c->policy->touch(c, content);
+}
+
+/**
+ * Forget about content, which is about to be removed from the store.
+ *
+ * It is not an error if the content is not enrolled.
+ */
+void
+ccnd_cache_withdraw(struct ccnd_cache *c, struct content_entry *content)
+{
+    if (content->cache_list == NULL)
+        return;
+    c->policy->withdraw(c, content);
+    c->n--;
+}
+
+/**
+ * Choose the next content to evict.
+ *
+ * The victim stays enrolled; the caller is expected to remove it from
+ * the store, which withdraws it.
+ * @returns the victim, or NULL if nothing is enrolled.
+ */
+struct content_entry *
+ccnd_cache_victim(struct ccnd_cache *c)
+{
+    if (c->n == 0)
+        return(NULL);
+    return(c->policy->victim(c));
+}
@@ -0,0 +1,525 @@
+/**
+ * @file ccnd_disk.c
+ *
+ * Second tier of the content store, kept in a file.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Content evicted from memory is appended to a log that wraps around
+ * within a file of fixed capacity, so the oldest records are the ones
+ * overwritten.  Positions in the log are counted from its beginning
+ * and never wrap; a record at pos is intact as long as the log has not
+ * advanced past pos + capacity.
+ *
+ * The index is an open-addressed table keyed by a hash of the name
+ * components, holding only the position and size of each record.
+ * Entries for overwritten records are left behind, and are recognized
+ * by their position.  A hash collision can only cause the wrong
+ * object to be read, and the caller matches what it gets anyway.
+ *
+ * The records carry their own position and a checksum, so the index
+ * can be rebuilt by scanning the file when ccnd starts again.  The file
+ * is written in host byte order, and is not meant to be moved between
+ * machines.
+ *
+ * Lookups only note what to read, and advise the kernel that it will
+ * be wanted; the reads are done later from ccnd_disk_next.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+
+#include "ccnd_private.h"
+
+#define DISK_MAGIC 0xCC0D15C1U
+#define DISK_ALIGN 16                   /**< records start on these */
+#define DISK_MAX_OBJECT (1 << 17)       /**< largest object kept */
+#define DISK_MIN_CAPACITY (1 << 22)
+#define DISK_INDEX_LG 10                /**< initial index size, lg slots */
+#define DISK_WANT_MAX 64                /**< most reads outstanding */
+#define DISK_SCAN_CHUNK (1 << 20)
+
+struct disk_rec {
+    uint32_t magic;
+    uint32_t size;              /**< of the object that follows */
+    uint64_t pos;               /**< log position of this record */
+    uint64_t hash;              /**< of the name components */
+    uint32_t sum;               /**< of the above and the object */
+    uint32_t pad;
+};
+
+struct disk_slot {
+    uint64_t pos;
+    uint32_t check;             /**< high half of the hash */
+    uint32_t size;              /**< 0 if empty */
+};
+
+struct ccnd_disk {
+    int fd;
+    uint64_t capacity;          /**< file size limit, a multiple of DISK_ALIGN */
+    uint64_t head;              /**< log position of the next record */
+    struct disk_slot *index;
+    unsigned lg_slots;
+    unsigned long used;         /**< nonempty index slots */
+    struct disk_slot want[DISK_WANT_MAX];
+    uint64_t want_hash[DISK_WANT_MAX];
+    int n_want;
+    struct ccn_charbuf *rbuf;
+    uintmax_t written;
+    uintmax_t read;
+    uintmax_t bad;
+    unsigned long recovered;
+};
+
+static uint64_t
+disk_hash(const unsigned char *key, size_t size)
+{
+    uint64_t x = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        x = (x ^ key[i]) * 1099511628211ULL;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return(x);
+}
+
+static uint32_t
+disk_sum(const struct disk_rec *r, const unsigned char *data)
+{
+    uint32_t x = 2166136261U;
+    const unsigned char *p = (const void *)r;
+    size_t i;
+
+    for (i = 0; i < offsetof(struct disk_rec, sum); i++)
+        x = (x ^ p[i]) * 16777619U;
+    for (i = 0; i < r->size; i++)
+        x = (x ^ data[i]) * 16777619U;
+    return(x);
+}
+
+static uint64_t
+disk_reclen(uint32_t size)
+{
+    return((sizeof(struct disk_rec) + size + DISK_ALIGN - 1) &
+           ~(uint64_t)(DISK_ALIGN - 1));
+}
+
+static int
+disk_live(const struct ccnd_disk *d, const struct disk_slot *s)
+{
+    return(s->size != 0 && d->head <= s->pos + d->capacity);
+}
+
+static size_t
+disk_bucket(const struct ccnd_disk *d, uint64_t hash)
+{
+    uint32_t check = hash >> 32;
+
+    return(disk_hash((const void *)&check, sizeof(check)) &
+           (((size_t)1 << d->lg_slots) - 1));
+}
+
+/**
+ * Make a new index with 1 << lg slots, leaving out the dead entries.
+ */
+static int
+disk_index_alloc(struct ccnd_disk *d, unsigned lg)
+{
+    struct disk_slot *old = d->index;
+    size_t n = (size_t)1 << d->lg_slots;
+    struct disk_slot *s;
+    size_t mask;
+    size_t i;
+    size_t j;
+
+    d->index = calloc((size_t)1 << lg, sizeof(d->index[0]));
+    if (d->index == NULL) {
+        d->index = old;
+        return(-1);
+    }
+    d->lg_slots = lg;
+    d->used = 0;
+    mask = ((size_t)1 << lg) - 1;
+    for (i = 0; old != NULL && i < n; i++) {
+        s = &old[i];
+        if (!disk_live(d, s))
+            continue;
+        for (j = disk_bucket(d, (uint64_t)s->check << 32);
+             d->index[j].size != 0; j = (j + 1) & mask)
+            continue;
+        d->index[j] = *s;
+        d->used++;
+    }
+    free(old);
+    return(0);
+}
+
+static struct disk_slot *
+disk_index_find(struct ccnd_disk *d, uint64_t hash)
+{
+    size_t mask = ((size_t)1 << d->lg_slots) - 1;
+    uint32_t check = hash >> 32;
+    struct disk_slot *s;
+    size_t j;
+
+    for (j = disk_bucket(d, hash); d->index[j].size != 0; j = (j + 1) & mask) {
+        s = &d->index[j];
+        if (s->check == check && disk_live(d, s))
+            return(s);
+    }
+    return(NULL);
+}
+
+/**
+ * Index a record, replacing any older one under the same hash.
+ */
+static void
+disk_index_insert(struct ccnd_disk *d, uint64_t hash, uint64_t pos,
+                  uint32_t size)
+{
+    size_t mask;
+    uint32_t check = hash >> 32;
+    struct disk_slot *s;
+    struct disk_slot *reuse = NULL;
+    size_t j;
+
+    if (d->used * 2 >= ((size_t)1 << d->lg_slots)) {
+        disk_index_alloc(d, d->lg_slots);
+        if (d->used * 2 >= ((size_t)1 << d->lg_slots))
+            disk_index_alloc(d, d->lg_slots + 1);
+    }
+    mask = ((size_t)1 << d->lg_slots) - 1;
+    for (j = disk_bucket(d, hash); d->index[j].size != 0; j = (j + 1) & mask) {
+        s = &d->index[j];
+        if (!disk_live(d, s)) {
+            if (reuse == NULL)
+                reuse = s;
+        }
+        else if (s->check == check) {
+            if (pos > s->pos) {
+                s->pos = pos;
+                s->size = size;
+            }
+            return;
+        }
+    }
+    if (reuse == NULL) {
+        reuse = &d->index[j];
+        d->used++;
+    }
+    reuse->pos = pos;
+    reuse->check = check;
+    reuse->size = size;
+}
+
+/**
+ * Read the file to recover the index.
+ */
+static void
+disk_scan(struct ccnd_disk *d)
+{
+    unsigned char *buf;
+    struct disk_rec r;
+    uint64_t off = 0;
+    uint64_t start = 0;
+    uint64_t head = 0;
+    size_t have = 0;
+    ssize_t res;
+    struct disk_slot *found = NULL;
+    size_t nfound = 0;
+    size_t limit = 0;
+    size_t i;
+
+    buf = malloc(DISK_SCAN_CHUNK);
+    if (buf == NULL)
+        return;
+    while (off + sizeof(r) <= d->capacity) {
+        if (off + sizeof(r) > start + have) {
+            start = off;
+            res = pread(d->fd, buf, DISK_SCAN_CHUNK, start);
+            if (res < (ssize_t)sizeof(r))
+                break;
+            have = res;
+        }
+        memcpy(&r, buf + (off - start), sizeof(r));
+        if (r.magic != DISK_MAGIC || r.size > DISK_MAX_OBJECT ||
+              r.pos % d->capacity != off || off + disk_reclen(r.size) > d->capacity) {
+            off += DISK_ALIGN;
+            continue;
+        }
+        if (off + sizeof(r) + r.size > start + have) {
+            start = off;
+            res = pread(d->fd, buf, DISK_SCAN_CHUNK, start);
+            if (res < 0 || (size_t)res < sizeof(r) + r.size)
+                break;
+            have = res;
+        }
+        if (disk_sum(&r, buf + (off - start) + sizeof(r)) != r.sum) {
+            off += DISK_ALIGN;
+            continue;
+        }
+        if (nfound == limit) {
+            struct disk_slot *x;
+            limit = limit * 2 + 1024;
+            x = realloc(found, limit * sizeof(*found));
+            if (x == NULL)
+                break;
+            found = x;
+        }
+        /* Index these once the head is known */
+        found[nfound].pos = r.pos;
+        found[nfound].check = r.hash >> 32;
+        found[nfound].size = r.size;
+        nfound++;
+        if (r.pos + disk_reclen(r.size) > head)
+            head = r.pos + disk_reclen(r.size);
+        off += disk_reclen(r.size);
+    }
+    free(buf);
+    d->head = head;
+    for (i = 0; i < nfound; i++) {
+        if (!disk_live(d, &found[i]))
+            continue;
+        disk_index_insert(d, (uint64_t)found[i].check << 32,
+                          found[i].pos, found[i].size);
+        d->recovered++;
+    }
+    free(found);
+}
+
+/**
+ * Open the cache file, and recover what it holds.
+ * @param capacity - bytes of file to use
+ * @returns NULL, with errno set, for an error.
+ */
+struct ccnd_disk *
+ccnd_disk_create(const char *path, uintmax_t capacity)
+{
+    struct ccnd_disk *d;
+    int save;
+
+    if (capacity < DISK_MIN_CAPACITY)
+        capacity = DISK_MIN_CAPACITY;
+    if (sizeof(off_t) < 8 && capacity > 0x7FF00000)
+        capacity = 0x7FF00000;
+    d = calloc(1, sizeof(*d));
+    if (d == NULL)
+        return(NULL);
+    d->capacity = capacity & ~(uintmax_t)(DISK_ALIGN - 1);
+    d->rbuf = ccn_charbuf_create();
+    d->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (d->fd == -1 || d->rbuf == NULL ||
+          disk_index_alloc(d, DISK_INDEX_LG) < 0) {
+        save = errno;
+        ccnd_disk_destroy(&d);
+        errno = save;
+        return(NULL);
+    }
+    disk_scan(d);
+    return(d);
+}
+
+void
+ccnd_disk_destroy(struct ccnd_disk **pd)
+{
+    struct ccnd_disk *d = *pd;
+
+    if (d == NULL)
+        return;
+    if (d->fd != -1)
+        close(d->fd);
+    ccn_charbuf_destroy(&d->rbuf);
+    free(d->index);
+    free(d);
+    *pd = NULL;
+}
+
+/**
+ * Append an object to the log.
+ *
+ * The object is given in two pieces, so the caller need not copy it
+ * to leave something out.  If an object of the same size is already
+ * held under the name, it is taken to be the same one.
+ * @param name - the name components, as the key for ccnd_disk_want
+ * @returns 1 if written, 0 if not needed, -1 for an error.
+ */
+int
+ccnd_disk_put(struct ccnd_disk *d,
+              const unsigned char *name, size_t namesize,
+              const unsigned char *a, size_t asize,
+              const unsigned char *b, size_t bsize)
+{
+    struct ccn_charbuf *c = d->rbuf;
+    struct disk_rec r = {0};
+    struct disk_slot *s;
+    uint64_t len;
+    ssize_t res;
+
+    if (asize + bsize > DISK_MAX_OBJECT)
+        return(-1);
+    r.hash = disk_hash(name, namesize);
+    r.size = asize + bsize;
+    s = disk_index_find(d, r.hash);
+    if (s != NULL && s->size == r.size)
+        return(0);
+    len = disk_reclen(r.size);
+    if (d->head % d->capacity + len > d->capacity)
+        d->head += d->capacity - d->head % d->capacity;
+    r.magic = DISK_MAGIC;
+    r.pos = d->head;
+    c->length = 0;
+    ccn_charbuf_reserve(c, len);
+    if (c->limit < len)
+        return(-1);
+    memset(c->buf, 0, len);
+    memcpy(c->buf + sizeof(r), a, asize);
+    memcpy(c->buf + sizeof(r) + asize, b, bsize);
+    r.sum = disk_sum(&r, c->buf + sizeof(r));
+    memcpy(c->buf, &r, sizeof(r));
+    res = pwrite(d->fd, c->buf, len, r.pos % d->capacity);
+    if (res != (ssize_t)len)
+        return(-1);
+    d->head = r.pos + len;
+    disk_index_insert(d, r.hash, r.pos, r.size);
+    d->written++;
+    return(1);
+}
+
+/**
+ * Look for an object held under the name, and if there is one,
+ * arrange for it to be read.
+ * @returns 1 if a read is (or already was) pending, else 0.
+ */
+int
+ccnd_disk_want(struct ccnd_disk *d, const unsigned char *name, size_t namesize)
+{
+    uint64_t hash = disk_hash(name, namesize);
+    struct disk_slot *s;
+    int i;
+
+    s = disk_index_find(d, hash);
+    if (s == NULL)
+        return(0);
+    for (i = 0; i < d->n_want; i++)
+        if (d->want[i].pos == s->pos)
+            return(1);
+    if (d->n_want == DISK_WANT_MAX)
+        return(0);
+    d->want[d->n_want] = *s;
+    d->want_hash[d->n_want] = hash;
+    d->n_want++;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(d->fd, s->pos % d->capacity, disk_reclen(s->size),
+                  POSIX_FADV_WILLNEED);
+#endif
+    return(1);
+}
+
+/**
+ * Read the next object asked for by ccnd_disk_want.
+ *
+ * On success, *obj and *size tell where the object is; it stays valid
+ * until the next call.
+ * @returns 1 for an object, 0 if none are pending, -1 if one could not
+ *          be read (try again for the next).
+ */
+int
+ccnd_disk_next(struct ccnd_disk *d, unsigned char **obj, size_t *size)
+{
+    struct ccn_charbuf *c = d->rbuf;
+    struct disk_slot s;
+    struct disk_rec r;
+    uint64_t hash;
+    uint64_t len;
+    ssize_t res;
+
+    if (d->n_want == 0)
+        return(0);
+    s = d->want[0];
+    hash = d->want_hash[0];
+    d->n_want--;
+    memmove(&d->want[0], &d->want[1], d->n_want * sizeof(d->want[0]));
+    memmove(&d->want_hash[0], &d->want_hash[1],
+            d->n_want * sizeof(d->want_hash[0]));
+    if (!disk_live(d, &s))
+        return(-1);
+    len = disk_reclen(s.size);
+    c->length = 0;
+    ccn_charbuf_reserve(c, len);
+    if (c->limit < len)
+        return(-1);
+    res = pread(d->fd, c->buf, len, s.pos % d->capacity);
+    if (res < (ssize_t)(sizeof(r) + s.size)) {
+        d->bad++;
+        return(-1);
+    }
+    memcpy(&r, c->buf, sizeof(r));
+    if (r.magic != DISK_MAGIC || r.pos != s.pos || r.size != s.size ||
+          r.hash != hash || disk_sum(&r, c->buf + sizeof(r)) != r.sum) {
+        d->bad++;
+        return(-1);
+    }
+    d->read++;
+    *obj = c->buf + sizeof(r);
+    *size = r.size;
+    return(1);
+}
+
+/**
+ * Get the counts for the status page.
+ * @returns the number of objects held.
+ */
+unsigned long
+ccnd_disk_counts(struct ccnd_disk *d, uintmax_t *bytes, uintmax_t *written,
+                 uintmax_t *read, uintmax_t *bad)
+{
+    unsigned long n = 0;
+    size_t i;
+
+    for (i = 0; i < ((size_t)1 << d->lg_slots); i++)
+        if (disk_live(d, &d->index[i]))
+            n++;
+    if (bytes != NULL)
+        *bytes = d->head < d->capacity ? d->head : d->capacity;
+    if (written != NULL)
+        *written = d->written;
+    if (read != NULL)
+        *read = d->read;
+    if (bad != NULL)
+        *bad = d->bad;
+    return(n);
+}
+
+/**
+ * @returns the number of objects found in the file when it was opened.
+ */
+unsigned long
+ccnd_disk_recovered(struct ccnd_disk *d)
+{
+    return(d->recovered);
+}
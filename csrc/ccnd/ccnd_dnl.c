@@ -0,0 +1,254 @@
+/**
+ * @file ccnd_dnl.c
+ *
+ * Dead nonce list, for catching looped interests after their PIT
+ * entries are gone.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The nonces are kept in a pair of Bloom filters.  New nonces go into
+ * the current one, and both are consulted.  Once a period, the older
+ * filter is dropped and a new current one is started, so a nonce is
+ * remembered for at least one period and at most two, at about two
+ * bytes apiece.
+ *
+ * Each new filter is sized from the rate at which nonces went into the
+ * one before it, so the memory follows the traffic.  If a filter fills
+ * up ahead of time, it is rotated early rather than let the false
+ * positive rate climb.
+ *
+ * Every lookup is accompanied by a decoy lookup, of a key that was
+ * never inserted, so the count of decoy hits estimates the number of
+ * interests dropped by mistake.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+
+#include "ccnd_private.h"
+
+#define DNL_HASHES 8            /**< bits set per nonce */
+#define DNL_BITS_PER 16         /**< bits of filter per expected nonce */
+#define DNL_FULL 12             /**< rotate early below this many */
+#define DNL_LG_MIN 15           /**< smallest filter, lg bits */
+#define DNL_LG_MAX 28           /**< largest filter, lg bits */
+#define DNL_DECOY 0x9e3779b97f4a7c15ULL
+
+struct dnl_filter {
+    unsigned lg_bits;
+    uint64_t *bits;
+    unsigned long n;            /**< nonces inserted */
+};
+
+struct ccnd_dnl {
+    unsigned period;            /**< seconds between rotations */
+    long rotated;               /**< time of the last rotation */
+    uint64_t seed;
+    struct dnl_filter f[2];     /**< current, previous */
+    uintmax_t lookups;
+    uintmax_t decoy_hits;
+};
+
+static int
+dnl_filter_init(struct dnl_filter *f, unsigned long expected)
+{
+    unsigned lg = DNL_LG_MIN;
+
+    while (lg < DNL_LG_MAX && ((uint64_t)1 << lg) < expected * DNL_BITS_PER)
+        lg++;
+    f->bits = calloc((size_t)1 << (lg - 6), sizeof(f->bits[0]));
+    if (f->bits == NULL)
+        return(-1);
+    f->lg_bits = lg;
+    f->n = 0;
+    return(0);
+}
+
+/**
+ * Create the dead nonce list.
+ * @param period - seconds between rotations
+ * @param seed - varies the hashing from one ccnd to another
+ */
+struct ccnd_dnl *
+ccnd_dnl_create(unsigned period, long now, uint64_t seed)
+{
+    struct ccnd_dnl *d;
+
+    d = calloc(1, sizeof(*d));
+    if (d == NULL)
+        return(NULL);
+    d->period = period < 1 ? 1 : period;
+    d->rotated = now;
+    d->seed = seed;
+    if (dnl_filter_init(&d->f[0], 0) < 0 || dnl_filter_init(&d->f[1], 0) < 0)
+        ccnd_dnl_destroy(&d);
+    return(d);
+}
+
+void
+ccnd_dnl_destroy(struct ccnd_dnl **pd)
+{
+    struct ccnd_dnl *d = *pd;
+
+    if (d == NULL)
+        return;
+    free(d->f[0].bits);
+    free(d->f[1].bits);
+    free(d);
+    *pd = NULL;
+}
+
+/**
+ * Start a new current filter, sized for a period at the rate that the
+ * one it replaces was filled, with some headroom.
+ */
+static void
+dnl_rotate(struct ccnd_dnl *d, long now)
+{
+    struct dnl_filter f;
+    long elapsed = now - d->rotated;
+    unsigned long expected = d->f[0].n + d->f[0].n / 2;
+
+    if (elapsed < 1)
+        elapsed = 1;
+    if (elapsed < (long)d->period)
+        expected = expected / elapsed * d->period;
+    if (dnl_filter_init(&f, expected) < 0) {
+        /* Keep going with the old storage */
+        f = d->f[1];
+        memset(f.bits, 0, ((size_t)1 << (f.lg_bits - 6)) * sizeof(f.bits[0]));
+        f.n = 0;
+    }
+    else
+        free(d->f[1].bits);
+    d->f[1] = d->f[0];
+    d->f[0] = f;
+    d->rotated = now;
+}
+
+static void
+dnl_age(struct ccnd_dnl *d, long now)
+{
+    if (now - d->rotated < (long)d->period)
+        return;
+    if (now - d->rotated >= 2 * (long)d->period)
+        dnl_rotate(d, now);
+    dnl_rotate(d, now);
+}
+
+static uint64_t
+dnl_hash(uint64_t seed, const unsigned char *key, size_t size)
+{
+    uint64_t x = seed ^ 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        x = (x ^ key[i]) * 1099511628211ULL;
+    /* Spread the bits, so that both halves are good */
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return(x);
+}
+
+static int
+dnl_filter_match(const struct dnl_filter *f, uint64_t x)
+{
+    uint32_t h1 = (uint32_t)x;
+    uint32_t h2 = (uint32_t)(x >> 32) | 1;
+    uint32_t mask = ((uint32_t)1 << f->lg_bits) - 1;
+    uint32_t b;
+    int i;
+
+    for (i = 0; i < DNL_HASHES; i++, h1 += h2) {
+        b = h1 & mask;
+        if ((f->bits[b >> 6] & ((uint64_t)1 << (b & 63))) == 0)
+            return(0);
+    }
+    return(1);
+}
+
+static void
+dnl_filter_insert(struct dnl_filter *f, uint64_t x)
+{
+    uint32_t h1 = (uint32_t)x;
+    uint32_t h2 = (uint32_t)(x >> 32) | 1;
+    uint32_t mask = ((uint32_t)1 << f->lg_bits) - 1;
+    uint32_t b;
+    int i;
+
+    for (i = 0; i < DNL_HASHES; i++, h1 += h2) {
+        b = h1 & mask;
+        f->bits[b >> 6] |= ((uint64_t)1 << (b & 63));
+    }
+    f->n++;
+}
+
+/**
+ * Remember a nonce.
+ */
+void
+ccnd_dnl_insert(struct ccnd_dnl *d, long now,
+                const unsigned char *nonce, size_t size)
+{
+    struct dnl_filter *f = &d->f[0];
+
+    dnl_age(d, now);
+    if (f->n >= ((unsigned long)1 << f->lg_bits) / DNL_FULL)
+        dnl_rotate(d, now);
+    dnl_filter_insert(f, dnl_hash(d->seed, nonce, size));
+}
+
+/**
+ * Check for a nonce that has been seen lately.
+ * @returns 1 if it was (or seems to have been) seen, else 0.
+ */
+int
+ccnd_dnl_match(struct ccnd_dnl *d, long now,
+               const unsigned char *nonce, size_t size)
+{
+    uint64_t x = dnl_hash(d->seed, nonce, size);
+    uint64_t decoy = dnl_hash(d->seed ^ DNL_DECOY, nonce, size);
+
+    dnl_age(d, now);
+    d->lookups++;
+    if (dnl_filter_match(&d->f[0], decoy) || dnl_filter_match(&d->f[1], decoy))
+        d->decoy_hits++;
+    return(dnl_filter_match(&d->f[0], x) || dnl_filter_match(&d->f[1], x));
+}
+
+/**
+ * Get the number of nonces held, and the estimated number of
+ * lookups that have matched falsely.
+ * @returns the number of lookups.
+ */
+uintmax_t
+ccnd_dnl_counts(struct ccnd_dnl *d, unsigned long *held, uintmax_t *false_hits)
+{
+    if (held != NULL)
+        *held = d->f[0].n + d->f[1].n;
+    if (false_hits != NULL)
+        *false_hits = d->decoy_hits;
+    return(d->lookups);
+}
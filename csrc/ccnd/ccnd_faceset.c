@@ -0,0 +1,280 @@
+/**
+ * @file ccnd_faceset.c
+ *
+ * Sets of faces, for quick membership tests on forwarding paths.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Most forwarding decisions involve only a handful of faces, so a set
+ * starts out as a short sorted array of face slots kept inside the
+ * struct, and costs no allocation at all.  Once it outgrows that it
+ * becomes a bitmap indexed by face slot, sized to the largest slot it
+ * has held; membership is then a single bit test no matter how many
+ * faces there are, and copying or clearing goes a word at a time.
+ *
+ * The sets hold face slots, not whole faceids.  Callers that need
+ * the face itself look the slot up, which also skips faces that
+ * have gone away.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccnd_private.h"
+
+#define FS_WORDBITS 64
+
+static int
+fs_grow(struct ccnd_faceset *s, unsigned slot)
+{
+    unsigned nwords = s->nwords;
+    uint64_t *bits;
+
+    if (nwords == 0)
+        nwords = 4;
+    while (slot / FS_WORDBITS >= nwords)
+        nwords *= 2;
+    bits = realloc(s->u.bits, nwords * sizeof(bits[0]));
+    if (bits == NULL)
+        return(-1);
+    memset(bits + s->nwords, 0, (nwords - s->nwords) * sizeof(bits[0]));
+    s->u.bits = bits;
+    s->nwords = nwords;
+    return(0);
+}
+
+/**
+ * Switch a full inline set over to a bitmap big enough for slot.
+ */
+static int
+fs_to_bits(struct ccnd_faceset *s, unsigned slot)
+{
+    unsigned held[CCND_FACESET_INLINE];
+    unsigned i;
+
+    memcpy(held, s->u.slot, sizeof(held));
+    s->u.bits = NULL;
+    if (slot < held[s->n - 1])
+        slot = held[s->n - 1];
+    if (fs_grow(s, slot) < 0) {
+        memcpy(s->u.slot, held, sizeof(held));
+        return(-1);
+    }
+    for (i = 0; i < s->n; i++)
+        s->u.bits[held[i] / FS_WORDBITS] |=
+            (uint64_t)1 << (held[i] % FS_WORDBITS);
+    return(0);
+}
+
+/**
+ * @returns index of the first inline slot that is >= slot
+ */
+static unsigned
+fs_lower_bound(const struct ccnd_faceset *s, unsigned slot)
+{
+    unsigned i;
+
+    for (i = 0; i < s->n && s->u.slot[i] < slot; i++)
+        continue;
+    return(i);
+}
+
+/**
+ * Add a face to a set.
+ * @returns 1 if it was added, 0 if it was already there, -1 if out of memory.
+ */
+int
+ccnd_faceset_add(struct ccnd_faceset *s, unsigned faceid)
+{
+    unsigned slot = faceid & MAXFACES;
+    uint64_t bit;
+    unsigned i;
+
+    if (s->nwords == 0) {
+        i = fs_lower_bound(s, slot);
+        if (i < s->n && s->u.slot[i] == slot)
+            return(0);
+        if (s->n < CCND_FACESET_INLINE) {
+            memmove(s->u.slot + i + 1, s->u.slot + i,
+                    (s->n - i) * sizeof(s->u.slot[0]));
+            s->u.slot[i] = slot;
+            s->n++;
+            return(1);
+        }
+        if (fs_to_bits(s, slot) < 0)
+            return(-1);
+    }
+    else if (slot / FS_WORDBITS >= s->nwords && fs_grow(s, slot) < 0)
+        return(-1);
+    bit = (uint64_t)1 << (slot % FS_WORDBITS);
+    if ((s->u.bits[slot / FS_WORDBITS] & bit) != 0)
+        return(0);
+    s->u.bits[slot / FS_WORDBITS] |= bit;
+    s->n++;
+    return(1);
+}
+
+/**
+ * Take a face out of a set.
+ * @returns 1 if it was there, otherwise 0.
+ */
+int
+ccnd_faceset_remove(struct ccnd_faceset *s, unsigned faceid)
+{
+    unsigned slot = faceid & MAXFACES;
+    uint64_t bit;
+    unsigned i;
+
+    if (s->nwords == 0) {
+        i = fs_lower_bound(s, slot);
+        if (i == s->n || s->u.slot[i] != slot)
+            return(0);
+        s->n--;
+        memmove(s->u.slot + i, s->u.slot + i + 1,
+                (s->n - i) * sizeof(s->u.slot[0]));
+        return(1);
+    }
+    if (slot / FS_WORDBITS >= s->nwords)
+        return(0);
+    bit = (uint64_t)1 << (slot % FS_WORDBITS);
+    if ((s->u.bits[slot / FS_WORDBITS] & bit) == 0)
+        return(0);
+    s->u.bits[slot / FS_WORDBITS] &= ~bit;
+    s->n--;
+    return(1);
+}
+
+/**
+ * Test whether a face is in a set.  A NULL set is empty.
+ */
+int
+ccnd_faceset_member(const struct ccnd_faceset *s, unsigned faceid)
+{
+    unsigned slot = faceid & MAXFACES;
+    unsigned i;
+
+    if (s == NULL || s->n == 0)
+        return(0);
+    if (s->nwords == 0) {
+        i = fs_lower_bound(s, slot);
+        return(i < s->n && s->u.slot[i] == slot);
+    }
+    if (slot / FS_WORDBITS >= s->nwords)
+        return(0);
+    return((s->u.bits[slot / FS_WORDBITS] >> (slot % FS_WORDBITS)) & 1);
+}
+
+/**
+ * Find the next member of a set.
+ * @returns the least member slot that is >= slot, or -1 if there is none.
+ */
+int
+ccnd_faceset_next(const struct ccnd_faceset *s, unsigned slot)
+{
+    uint64_t w;
+    unsigned i;
+
+    if (s == NULL || s->n == 0)
+        return(-1);
+    if (s->nwords == 0) {
+        i = fs_lower_bound(s, slot);
+        return(i < s->n ? (int)s->u.slot[i] : -1);
+    }
+    for (i = slot / FS_WORDBITS; i < s->nwords; i++) {
+        w = s->u.bits[i];
+        if (i == slot / FS_WORDBITS)
+            w &= ~(uint64_t)0 << (slot % FS_WORDBITS);
+        if (w == 0)
+            continue;
+#if defined(__GNUC__)
+        return(i * FS_WORDBITS + __builtin_ctzll(w));
+#else
+        for (slot = 0; (w & 1) == 0; slot++)
+            w >>= 1;
+        return(i * FS_WORDBITS + slot);
+#endif
+    }
+    return(-1);
+}
+
+/**
+ * Empty a set, keeping any bitmap it has for reuse.
+ */
+void
+ccnd_faceset_clear(struct ccnd_faceset *s)
+{
+    if (s->nwords != 0)
+        memset(s->u.bits, 0, s->nwords * sizeof(s->u.bits[0]));
+    s->n = 0;
+}
+
+/**
+ * Make dst hold the same faces as src.
+ * @returns 0, or -1 if out of memory (leaving dst empty).
+ */
+int
+ccnd_faceset_copy(struct ccnd_faceset *dst, const struct ccnd_faceset *src)
+{
+    if (src->nwords == 0) {
+        ccnd_faceset_reset(dst);
+        *dst = *src;
+        return(0);
+    }
+    ccnd_faceset_clear(dst);
+    if (dst->nwords < src->nwords) {
+        if (dst->nwords == 0)
+            dst->u.bits = NULL;
+        if (fs_grow(dst, src->nwords * FS_WORDBITS - 1) < 0)
+            return(-1);
+    }
+    memcpy(dst->u.bits, src->u.bits, src->nwords * sizeof(src->u.bits[0]));
+    dst->n = src->n;
+    return(0);
+}
+
+/**
+ * Release the storage held by a set, leaving it empty.
+ */
+void
+ccnd_faceset_reset(struct ccnd_faceset *s)
+{
+    if (s->nwords != 0)
+        free(s->u.bits);
+    s->nwords = 0;
+    s->n = 0;
+}
+
+/**
+ * Allocate an empty set.
+ */
+struct ccnd_faceset *
+ccnd_faceset_create(void)
+{
+    return(calloc(1, sizeof(struct ccnd_faceset)));
+}
+
+void
+ccnd_faceset_destroy(struct ccnd_faceset **ps)
+{
+    if (*ps == NULL)
+        return;
+    ccnd_faceset_reset(*ps);
+    free(*ps);
+    *ps = NULL;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file ccnd_hh.c
+ *
+ * Heavy-hitter sketches, for finding the busiest prefixes and faces.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Each sketch is a count-min sketch, which estimates the weight of any
+ * key seen so far from above, paired with a small table of the k keys
+ * with the largest estimates, in the manner of Space-Saving.  A key
+ * that is already in the table has its count bumped directly.  Any
+ * other key replaces the smallest entry in the table once its estimate
+ * passes that entry's count, and starts from its estimate; the part
+ * of that which may belong to other keys is kept as its error.  The
+ * count-min sketch uses conservative update, raising only the cells
+ * that are below the new estimate, which keeps the overcounts down.
+ *
+ * Everything costs the same no matter how many keys go by: the rows
+ * of the sketch are indexed by slices of a single 64-bit hash, and the
+ * table is small enough to scan.
+ *
+ * Counts are halved each time the caller's tick advances, so what the
+ * table shows is recent traffic, and no timer is needed to age it.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ccnd_private.h"
+
+struct ccnd_hh {
+    unsigned k;                     /**< most keys tracked */
+    unsigned n;                     /**< keys tracked now */
+    unsigned width;                 /**< cells per row, a power of 2 */
+    unsigned min;                   /**< index of the smallest item */
+    long tick;                      /**< tick of the last decay */
+    uint64_t *keys;                 /**< k keys, for the scan */
+    struct ccnd_hh_item *item;      /**< k items, parallel to keys */
+    uint64_t *cell;                 /**< CCND_HH_ROWS * width counters */
+};
+
+/**
+ * Create a sketch.
+ * @param k is the number of keys to track.
+ * @param width is the number of cells in each row, rounded up to a power of 2.
+ */
+struct ccnd_hh *
+ccnd_hh_create(unsigned k, unsigned width)
+{
+    struct ccnd_hh *hh;
+    unsigned w;
+
+    if (k < 1)
+        k = 1;
+    for (w = 16; w < width && w < (1U << 16); w <<= 1)
+        continue;
+    hh = calloc(1, sizeof(*hh));
+    if (hh == NULL)
+        return(NULL);
+    hh->k = k;
+    hh->width = w;
+    hh->keys = calloc(k, sizeof(hh->keys[0]));
+    hh->item = calloc(k, sizeof(hh->item[0]));
+    hh->cell = calloc((size_t)CCND_HH_ROWS * w, sizeof(hh->cell[0]));
+    if (hh->keys == NULL || hh->item == NULL || hh->cell == NULL)
+        ccnd_hh_destroy(&hh);
+    return(hh);
+}
+
+void
+ccnd_hh_destroy(struct ccnd_hh **phh)
+{
+    struct ccnd_hh *hh = *phh;
+
+    if (hh == NULL)
+        return;
+    free(hh->keys);
+    free(hh->item);
+    free(hh->cell);
+    free(hh);
+    *phh = NULL;
+}
+
+static void
+hh_find_min(struct ccnd_hh *hh)
+{
+    unsigned i;
+
+    hh->min = 0;
+    for (i = 1; i < hh->n; i++)
+        if (hh->item[i].count < hh->item[hh->min].count)
+            hh->min = i;
+}
+
+/**
+ * Halve everything once for each tick since the last decay.
+ */
+static void
+hh_decay(struct ccnd_hh *hh, long tick)
+{
+    long d = tick - hh->tick;
+    unsigned shift;
+    size_t i;
+
+    hh->tick = tick;
+    if (d <= 0)
+        return;
+    shift = (d > 63) ? 63 : d;
+    for (i = 0; i < (size_t)CCND_HH_ROWS * hh->width; i++)
+        hh->cell[i] >>= shift;
+    for (i = 0; i < hh->n; i++) {
+        hh->item[i].count >>= shift;
+        hh->item[i].err >>= shift;
+        hh->item[i].aux >>= shift;
+    }
+    hh_find_min(hh);
+}
+
+/**
+ * Spread the key so that its 16-bit slices make independent row indices,
+ * even for keys such as faceids that differ only in their low bits.
+ */
+static uint64_t
+hh_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return(x);
+}
+
+/**
+ * Count some weight against a key.
+ *
+ * @param tick is the caller's clock, in half-lives.
+ * @param key identifies what is being counted.
+ * @param w is the weight to add.
+ * @param aux is a second weight, kept only for tracked keys.
+ * @param label is remembered along with a tracked key, for display;
+ *        only the first CCND_HH_LABEL bytes are kept.
+ */
+void
+ccnd_hh_count(struct ccnd_hh *hh, long tick, uint64_t key,
+              unsigned w, unsigned aux,
+              const unsigned char *label, size_t labelsize)
+{
+    struct ccnd_hh_item *it;
+    uint64_t *c[CCND_HH_ROWS];
+    uint64_t x = hh_mix(key);
+    uint64_t est;
+    uint64_t v;
+    unsigned mask = hh->width - 1;
+    unsigned i;
+    int r;
+
+    if (tick != hh->tick)
+        hh_decay(hh, tick);
+    est = UINT64_MAX;
+    for (r = 0; r < CCND_HH_ROWS; r++) {
+        c[r] = &hh->cell[r * hh->width + ((x >> (16 * r)) & mask)];
+        if (*c[r] < est)
+            est = *c[r];
+    }
+    v = est + w;
+    for (r = 0; r < CCND_HH_ROWS; r++)
+        if (*c[r] < v)
+            *c[r] = v;
+    for (i = 0; i < hh->n; i++) {
+        if (hh->keys[i] == key) {
+            it = &hh->item[i];
+            it->count += w;
+            it->aux += aux;
+            if (i == hh->min)
+                hh_find_min(hh);
+            return;
+        }
+    }
+    if (hh->n < hh->k)
+        i = hh->n++;
+    else if (v > hh->item[hh->min].count)
+        i = hh->min;
+    else
+        return;
+    hh->keys[i] = key;
+    it = &hh->item[i];
+    it->key = key;
+    it->count = v;
+    it->err = est;
+    it->aux = aux;
+    it->labelsize = labelsize;
+    if (labelsize > CCND_HH_LABEL)
+        labelsize = CCND_HH_LABEL;
+    if (labelsize > 0)
+        memcpy(it->label, label, labelsize);
+    hh_find_min(hh);
+}
+
+static int
+hh_item_cmp(const void *a, const void *b)
+{
+    const struct ccnd_hh_item *x = a;
+    const struct ccnd_hh_item *y = b;
+
+    if (x->count != y->count)
+        return(x->count < y->count ? 1 : -1);
+    return(x->key < y->key ? -1 : x->key > y->key);
+}
+
+/**
+ * Get the tracked keys, heaviest first.
+ * @returns the number of items stored in out, at most max.
+ */
+int
+ccnd_hh_top(struct ccnd_hh *hh, long tick, struct ccnd_hh_item *out, int max)
+{
+    struct ccnd_hh_item *tmp;
+    int n;
+
+    if (tick != hh->tick)
+        hh_decay(hh, tick);
+    if (max <= 0 || hh->n == 0)
+        return(0);
+    tmp = malloc(hh->n * sizeof(*tmp));
+    if (tmp == NULL)
+        return(0);
+    memcpy(tmp, hh->item, hh->n * sizeof(*tmp));
+    qsort(tmp, hh->n, sizeof(*tmp), &hh_item_cmp);
+    n = ((unsigned)max < hh->n) ? max : (int)hh->n;
+    memcpy(out, tmp, n * sizeof(*tmp));
+    free(tmp);
+    return(n);
+}
+
+/**
+ * Find the heaviest tracked key.
+ * @returns its count, which is 0 if there is none.
+ */
+uint64_t
+ccnd_hh_heaviest(struct ccnd_hh *hh, uint64_t *key)
+{
+    unsigned best = 0;
+    unsigned i;
+
+    if (hh->n == 0)
+        return(0);
+    for (i = 1; i < hh->n; i++)
+        if (hh->item[i].count > hh->item[best].count)
+            best = i;
+    *key = hh->item[best].key;
+    return(hh->item[best].count);
+}
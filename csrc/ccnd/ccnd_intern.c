@@ -0,0 +1,180 @@
+/**
+ * @file ccnd_intern.c
+ *
+ * Interned name prefixes, shared by the entries of the content store.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Content names tend to come in runs that differ only near the end -
+ * the segments of one version, each with its own digest - so the
+ * leading part of every name is kept here once, as a flatname, and the
+ * content entries that share it hold a counted reference plus their
+ * own last few components.
+ *
+ * A prefix is hashed once, when it is interned.  After that it is known
+ * by its address (or its id, which stays the same for as long as it is
+ * referenced), so entries with equal prefixes can be told apart by
+ * comparing just their suffixes.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/btree_content.h>
+#include <ccn/hashtb.h>
+
+#include "ccnd_private.h"
+
+struct ccnd_intern {
+    struct hashtb *prefix_tab;  /**< keyed by prefix flatname */
+    unsigned next_id;           /**< id for the next new prefix */
+    size_t bytes;               /**< bytes of prefix flatnames held */
+    size_t shared;              /**< bytes not copied, thanks to sharing */
+};
+
+/**
+ * Create an empty table of interned prefixes.
+ */
+struct ccnd_intern *
+ccnd_intern_create(void)
+{
+    struct ccnd_intern *t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return(NULL);
+    t->prefix_tab = hashtb_create(sizeof(struct ccnd_name_prefix), NULL);
+    if (t->prefix_tab == NULL) {
+        free(t);
+        return(NULL);
+    }
+    t->next_id = 1;
+    return(t);
+}
+
+void
+ccnd_intern_destroy(struct ccnd_intern **pt)
+{
+    struct ccnd_intern *t = *pt;
+    if (t == NULL)
+        return;
+    hashtb_destroy(&t->prefix_tab);
+    free(t);
+    *pt = NULL;
+}
+
+/**
+ * Find where to split a flatname into an interned prefix and a suffix.
+ *
+ * @param keep is the number of trailing components for the suffix.
+ * @returns the size of the prefix, which is 0 if the name has no more
+ *          than keep components or is malformed.
+ */
+size_t
+ccnd_intern_split(const unsigned char *flatname, size_t size, int keep)
+{
+    size_t i = 0;
+    int n;
+    int rnc;
+
+    n = ccn_flatname_ncomps(flatname, size) - keep;
+    for (; n > 0; n--) {
+        rnc = ccn_flatname_next_comp(flatname + i, size - i);
+        if (rnc <= 0)
+            return(0);
+        i += CCNFLATSKIP(rnc);
+    }
+    return(i);
+}
+
+/**
+ * Find or make the interned copy of a prefix, and take a reference to it.
+ *
+ * @param flatname is the prefix, which should end on a component boundary.
+ * @returns the prefix, or NULL if size is 0 or out of memory.
+ */
+struct ccnd_name_prefix *
+ccnd_intern_prefix(struct ccnd_intern *t,
+                   const unsigned char *flatname, size_t size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccnd_name_prefix *p = NULL;
+    int res;
+
+    if (size == 0)
+        return(NULL);
+    hashtb_start(t->prefix_tab, e);
+    res = hashtb_seek(e, flatname, size, 0);
+    p = e->data;
+    if (res == HT_NEW_ENTRY) {
+        p->flatname = e->key;
+        p->size = size;
+        p->id = t->next_id++;
+        if (t->next_id == 0)
+            t->next_id = 1;
+        t->bytes += size;
+    }
+    else if (res == HT_OLD_ENTRY)
+        t->shared += size;
+    if (p != NULL)
+        p->refs++;
+    hashtb_end(e);
+    return(p);
+}
+
+/**
+ * Drop a reference to an interned prefix, which goes away with the last one.
+ */
+void
+ccnd_intern_release(struct ccnd_intern *t, struct ccnd_name_prefix *p)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+
+    if (p == NULL)
+        return;
+    if (p->refs == 0)
+        abort();
+    if (--p->refs > 0) {
+        t->shared -= p->size;
+        return;
+    }
+    hashtb_start(t->prefix_tab, e);
+    if (hashtb_seek(e, p->flatname, p->size, 0) != HT_OLD_ENTRY)
+        abort();
+    t->bytes -= p->size;
+    hashtb_delete(e);
+    hashtb_end(e);
+}
+
+/**
+ * Report on the interned prefixes.
+ * @param bytes gets the bytes of prefix flatnames held
+ * @param shared gets the bytes that sharing has saved copying
+ * @returns the number of prefixes.
+ */
+unsigned long
+ccnd_intern_counts(struct ccnd_intern *t, size_t *bytes, size_t *shared)
+{
+    if (bytes != NULL)
+        *bytes = t->bytes;
+    if (shared != NULL)
+        *shared = t->shared;
+    return(hashtb_n(t->prefix_tab));
+}
@@ -35,6 +35,7 @@
 #include <ccn/ccn_private.h>
 #include <ccn/keystore.h>
 #include <ccn/schedule.h>
+#include <ccn/signer.h>
 #include <ccn/sockaddrutil.h>
 #include <ccn/uri.h>
 #include "ccnd_private.h"
@@ -45,6 +46,7 @@
 #define GOT_HERE
 #endif
 #define CCND_NOTICE_NAME "notice.txt"
+#define CCND_NOTICES_NAME "notices"
 
 #ifndef CCND_TEST_100137
 #define CCND_TEST_100137 0
@@ -56,6 +58,9 @@
 #endif
 
 static void ccnd_start_notice(struct ccnd_handle *ccnd);
+static int ccnd_req_notices(struct ccnd_handle *ccnd,
+                            const unsigned char *comp, size_t size,
+                            struct ccn_charbuf *reply_body);
 
 static struct ccn_charbuf *
 ccnd_init_service_ccnb(struct ccnd_handle *ccnd, const char *baseuri, int freshness)
@@ -120,15 +125,35 @@ ccnd_init_service_ccnb(struct ccnd_handle *ccnd, const char *baseuri, int freshn
 #define OP_UNREG       0x0600
 #define OP_NOTICE      0x0700
 #define OP_SERVICE     0x0800
+#define OP_PREFIXREGS  0x0900
+#define OP_NOTICES     0x0A00
 /**
  * Common interest handler for ccnd_internal_client
  */
+/**
+ * Completion action for ccnd_answer_req replies
+ */
+static void
+ccnd_answer_req_done(struct ccn_signer *s, struct ccn_charbuf *msg,
+                     void *data, intptr_t intdata)
+{
+    struct ccnd_handle *ccnd = data;
+    
+    if (msg == NULL || ccnd->internal_client == NULL)
+        return;
+    if ((ccnd->debug & 128) != 0)
+        ccnd_debug_ccnb(ccnd, __LINE__, "ccnd_answer_req_response", NULL,
+                        msg->buf, msg->length);
+    ccn_put(ccnd->internal_client, msg->buf, msg->length);
+    if (CCND_TEST_100137)
+        ccn_put(ccnd->internal_client, msg->buf, msg->length);
+}
+
 static enum ccn_upcall_res
 ccnd_answer_req(struct ccn_closure *selfp,
                  enum ccn_upcall_kind kind,
                  struct ccn_upcall_info *info)
 {
-    struct ccn_charbuf *msg = NULL;
     struct ccn_charbuf *name = NULL;
     struct ccn_charbuf *keylocator = NULL;
     struct ccn_charbuf *signed_info = NULL;
@@ -219,10 +244,19 @@ ccnd_answer_req(struct ccn_closure *selfp,
             reply_body = ccn_charbuf_create();
             res = ccnd_req_unreg(ccnd, final_comp, final_size, reply_body);
             break;
+        case OP_PREFIXREGS:
+            reply_body = ccn_charbuf_create();
+            res = ccnd_req_prefixregs(ccnd, final_comp, final_size, reply_body);
+            break;
         case OP_NOTICE:
             ccnd_start_notice(ccnd);
             goto Bail;
             break;
+        case OP_NOTICES:
+            reply_body = ccn_charbuf_create();
+            res = ccnd_req_notices(ccnd, final_comp, final_size, reply_body);
+            sp.freshness = 1;
+            break;
         case OP_SERVICE:
             if (ccnd->service_ccnb == NULL)
                 ccnd->service_ccnb = ccnd_init_service_ccnb(ccnd, CCNDID_LOCAL_URI, 600);
@@ -266,30 +300,22 @@ ccnd_answer_req(struct ccn_closure *selfp,
         goto Bail;
     if (res == CCN_CONTENT_NACK)
         sp.type = res;
-    msg = ccn_charbuf_create();
     name = ccn_charbuf_create();
     start = info->pi->offset[CCN_PI_B_Name];
     end = info->interest_comps->buf[info->pi->prefix_comps];
     ccn_charbuf_append(name, info->interest_ccnb + start, end - start);
     ccn_charbuf_append_closer(name);
-    res = ccn_sign_content(info->h, msg, name, &sp,
-                           reply_body->buf, reply_body->length);
-    if (res < 0)
-        goto Bail;
-    if ((ccnd->debug & 128) != 0)
-        ccnd_debug_ccnb(ccnd, __LINE__, "ccnd_answer_req_response", NULL,
-                        msg->buf, msg->length);
-    res = ccn_put(info->h, msg->buf, msg->length);
+    /* The reply goes out once signed, after this round of input */
+    res = ccn_signer_submit(ccnd->signer, name, &sp,
+                            reply_body->buf, reply_body->length,
+                            &ccnd_answer_req_done, ccnd, 0);
     if (res < 0)
         goto Bail;
-    if (CCND_TEST_100137)
-        ccn_put(info->h, msg->buf, msg->length);
     res = CCN_UPCALL_RESULT_INTEREST_CONSUMED;
     goto Finish;
 Bail:
     res = CCN_UPCALL_RESULT_ERR;
 Finish:
-    ccn_charbuf_destroy(&msg);
     ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&keylocator);
     ccn_charbuf_destroy(&reply_body);
@@ -309,8 +335,8 @@ ccnd_internal_client_refresh(struct ccn_schedule *sched,
           ccnd->internal_client != NULL &&
           ccnd->internal_client_refresh == ev) {
         microsec = ccn_process_scheduled_operations(ccnd->internal_client);
-        if (microsec > ev->evint)
-            microsec = ev->evint;
+        if (microsec > ccnd_idle_period(ccnd, ev->evint))
+            microsec = ccnd_idle_period(ccnd, ev->evint);
     }
     if (microsec <= 0 && ccnd->internal_client_refresh == ev)
         ccnd->internal_client_refresh = NULL;
@@ -467,33 +493,107 @@ Finish:
     return(res);
 }
 
-static int
-post_face_notice(struct ccnd_handle *ccnd, unsigned faceid)
+/**
+ * Append the notice record for a face.
+ *
+ * A face that is there is told of as "+FACEID FLAGS[ ADDRESS:PORT]",
+ * with the flags in hex, and one that has gone away as "-FACEID".
+ */
+static void
+append_face_record(struct ccnd_handle *ccnd, unsigned faceid,
+                   struct ccn_charbuf *msg)
 {
     struct face *face = ccnd_face_from_faceid(ccnd, faceid);
-    struct ccn_charbuf *msg = ccn_charbuf_create();
-    int res = -1;
     int port;
     
-    // XXX - text version for trying out stream stuff - replace with ccnb
-    if (face == NULL)
-        ccn_charbuf_putf(msg, "destroyface(%u);\n", faceid);
-    else {
-        ccn_charbuf_putf(msg, "newface(%u, 0x%x", faceid, face->flags);
-        if (face->addr != NULL &&
-            (face->flags & (CCN_FACE_INET | CCN_FACE_INET6)) != 0) {
-            ccn_charbuf_putf(msg, ", ");
-            port = ccn_charbuf_append_sockaddr(msg, face->addr);
-            if (port < 0)
-                msg->length--;
-            else if (port > 0)
-                ccn_charbuf_putf(msg, ":%d", port);
+    if (face == NULL) {
+        ccn_charbuf_putf(msg, "-%u\n", faceid);
+        return;
+    }
+    ccn_charbuf_putf(msg, "+%u %x", faceid, face->flags);
+    if (face->addr != NULL &&
+        (face->flags & (CCN_FACE_INET | CCN_FACE_INET6)) != 0) {
+        ccn_charbuf_putf(msg, " ");
+        port = ccn_charbuf_append_sockaddr(msg, face->addr);
+        if (port < 0)
+            msg->length--;
+        else if (port > 0)
+            ccn_charbuf_putf(msg, ":%d", port);
+    }
+    ccn_charbuf_putf(msg, "\n");
+}
+
+/**
+ * Remember that a destroyed face was told of in batch seq.
+ */
+static void
+notice_gone_add(struct ccnd_handle *ccnd, unsigned faceid, unsigned seq)
+{
+    struct ccnd_notice_gone *g;
+    
+    if (ccnd->notice_gone == NULL) {
+        ccnd->notice_floor = seq;
+        return;
+    }
+    if (ccnd->notice_ngone == CCND_NOTICE_GONE) {
+        g = &ccnd->notice_gone[ccnd->notice_gone_head];
+        ccnd->notice_floor = g->seq;
+        ccnd->notice_gone_head = (ccnd->notice_gone_head + 1) % CCND_NOTICE_GONE;
+        ccnd->notice_ngone--;
+    }
+    g = &ccnd->notice_gone[(ccnd->notice_gone_head + ccnd->notice_ngone++) %
+                           CCND_NOTICE_GONE];
+    g->faceid = faceid;
+    g->seq = seq;
+}
+
+/**
+ * Write the next batch of face notices.
+ *
+ * As many of the changed faces as fit in CCND_NOTICE_BLOCK go into one
+ * write, so the batch makes at most one segment.  It starts with
+ * "@SEQ" so that a reader can see a gap and ask for the delta.  The
+ * batch counts as told even if the stream has no room for it (nobody
+ * has read the last one), so that readers of deltas are not held up
+ * by a stalled stream.
+ */
+static void
+post_face_notices(struct ccnd_handle *ccnd)
+{
+    struct ccn_indexbuf *chface = ccnd->chface;
+    struct ccn_charbuf *msg = ccn_charbuf_create();
+    struct face *face = NULL;
+    unsigned seq = ccnd->notice_seq + 1;
+    size_t len;
+    int i;
+    int j;
+    
+    ccn_charbuf_putf(msg, "@%u\n", seq);
+    for (i = 0; i < chface->n; i++) {
+        len = msg->length;
+        append_face_record(ccnd, chface->buf[i], msg);
+        if (msg->length > CCND_NOTICE_BLOCK && i > 0) {
+            msg->length = len;
+            break;
         }
-        ccn_charbuf_putf(msg, ");\n", faceid);
     }
-    res = ccn_seqw_write(ccnd->notice, msg->buf, msg->length);
+    if (ccnd->notice != NULL &&
+          ccn_seqw_write(ccnd->notice, msg->buf, msg->length) < 0)
+        ccnd->notice_unsent++;
+    ccnd->notice_seq = seq;
+    ccnd->notice_batches++;
+    ccnd->notice_records += i;
+    for (j = 0; j < i; j++) {
+        face = ccnd_face_from_faceid(ccnd, chface->buf[j]);
+        if (face != NULL)
+            face->notice_seq = seq;
+        else
+            notice_gone_add(ccnd, chface->buf[j], seq);
+    }
+    for (j = 0; i < chface->n; i++, j++)
+        chface->buf[j] = chface->buf[i];
+    chface->n = j;
     ccn_charbuf_destroy(&msg);
-    return(res);
 }
 
 static int
@@ -503,26 +603,17 @@ ccnd_notice_push(struct ccn_schedule *sched,
                int flags)
 {
     struct ccnd_handle *ccnd = clienth;
-    struct ccn_indexbuf *chface = NULL;
-    int i = 0;
-    int j = 0;
     int microsec = 0;
-    int res = 0;
     
     if ((flags & CCN_SCHEDULE_CANCEL) == 0 &&
-            ccnd->notice != NULL &&
             ccnd->notice_push == ev &&
             ccnd->chface != NULL) {
-        chface = ccnd->chface;
-        ccn_seqw_batch_start(ccnd->notice);
-        for (i = 0; i < chface->n && res != -1; i++)
-            res = post_face_notice(ccnd, chface->buf[i]);
-        ccn_seqw_batch_end(ccnd->notice);
-        for (j = 0; i < chface->n; i++, j++)
-            chface->buf[j] = chface->buf[i];
-        chface->n = j;
-        if (res == -1)
-            microsec = 3000;
+        if (ccnd->chface->n > 0) {
+            post_face_notices(ccnd);
+            ccnd->notice_last = (unsigned)ccnd->sec * 1000000U + ccnd->usec;
+        }
+        if (ccnd->chface->n > 0)
+            microsec = ccnd->notice_usec;
     }
     if (microsec <= 0)
         ccnd->notice_push = NULL;
@@ -535,51 +626,182 @@ ccnd_notice_push(struct ccn_schedule *sched,
  *
  * In the destroy case, this is called from the hash table finalizer,
  * so it shouldn't do much directly.  Inspecting the face is OK, though.
+ *
+ * A burst of changes shortly after a quiet spell goes out in 2 ms, but
+ * batches are never closer together than the notice interval.
  */
 void
 ccnd_face_status_change(struct ccnd_handle *ccnd, unsigned faceid)
 {
     struct ccn_indexbuf *chface = ccnd->chface;
+    unsigned since;
+    unsigned delay = 2000;
+    
+    ccnd_status_invalidate(ccnd);
     if (chface != NULL) {
         ccn_indexbuf_set_insert(chface, faceid);
-        if (ccnd->notice_push == NULL)
-            ccnd->notice_push = ccn_schedule_event(ccnd->sched, 2000,
+        if (ccnd->notice_push == NULL) {
+            since = (unsigned)ccnd->sec * 1000000U + ccnd->usec -
+                    ccnd->notice_last;
+            if (since < ccnd->notice_usec &&
+                  ccnd->notice_usec - since > delay)
+                delay = ccnd->notice_usec - since;
+            ccnd->notice_push = ccn_schedule_event(ccnd->sched, delay,
                                                    ccnd_notice_push,
                                                    NULL, 0);
+        }
     }
 }
 
+/**
+ * Start keeping track of face changes, if that is not already going.
+ *
+ * Every face is taken to have changed, so the first batches tell of
+ * them all.
+ */
 static void
-ccnd_start_notice(struct ccnd_handle *ccnd)
+ccnd_start_notice_tracking(struct ccnd_handle *ccnd)
 {
-    struct ccn *h = ccnd->internal_client;
     struct ccn_charbuf *name = NULL;
     struct face *face = NULL;
     int i;
     
+    if (ccnd->chface == NULL) {
+        ccnd->chface = ccn_indexbuf_create();
+        ccnd->notice_gone = calloc(CCND_NOTICE_GONE,
+                                   sizeof(ccnd->notice_gone[0]));
+        ccnd->notice_ngone = 0;
+        ccnd->notice_gone_head = 0;
+        if (ccnd->local_signing) {
+            name = ccn_charbuf_create();
+            ccn_name_from_uri(name, "ccnx:/ccnx");
+            ccn_name_append(name, ccnd->ccnd_id, 32);
+            ccn_name_append_str(name, CCND_NOTICES_NAME);
+            ccn_set_signing_policy(ccnd->internal_client, name, CCN_SP_HMAC);
+            ccn_charbuf_destroy(&name);
+        }
+    }
+    for (i = 0; i < ccnd->face_limit; i++) {
+        face = ccnd->faces_by_faceid[i];
+        if (face != NULL)
+            ccn_indexbuf_set_insert(ccnd->chface, face->faceid);
+    }
+    if (ccnd->chface->n > 0)
+        ccnd_face_status_change(ccnd, ccnd->chface->buf[0]);
+}
+
+static void
+ccnd_start_notice(struct ccnd_handle *ccnd)
+{
+    struct ccn *h = ccnd->internal_client;
+    struct ccn_charbuf *name = NULL;
+    
     if (h == NULL)
         return;
     if (ccnd->notice != NULL)
         return;
-    if (ccnd->chface != NULL) {
-        /* Probably should not happen. */
-        ccnd_msg(ccnd, "ccnd_internal_client.c:%d Huh?", __LINE__);
-        ccn_indexbuf_destroy(&ccnd->chface);
-    }
     name = ccn_charbuf_create();
     ccn_name_from_uri(name, "ccnx:/ccnx");
     ccn_name_append(name, ccnd->ccnd_id, 32);
     ccn_name_append_str(name, CCND_NOTICE_NAME);
+    /* Only local clients read the notices, so spare the private key */
+    if (ccnd->local_signing)
+        ccn_set_signing_policy(h, name, CCN_SP_HMAC);
     ccnd->notice = ccn_seqw_create(h, name);
-    ccnd->chface = ccn_indexbuf_create();
+    /* Room for a whole batch, and then some, in each segment */
+    ccn_seqw_set_block_limits(ccnd->notice, 0, CCND_NOTICE_BLOCK + 96);
+    ccnd_start_notice_tracking(ccnd);
+    ccn_charbuf_destroy(&name);
+}
+
+/**
+ * Answer a request for the face changes since a given notice batch.
+ *
+ * The final name component is the batch number, in decimal.  The reply
+ * starts with "@SEQ", the batch it is complete through, followed by
+ * "*" if it is the whole state rather than a delta (when the number
+ * asked for is too old, or from before a restart), and then the
+ * records as in the notice stream, in the order they were told.  A
+ * reply holds about as much as one batch; if there was more, SEQ is
+ * short of the latest and the reader should ask again from there.
+ */
+static int
+notice_gone_cmp(const void *a, const void *b)
+{
+    const struct ccnd_notice_gone *x = a;
+    const struct ccnd_notice_gone *y = b;
+    
+    if (x->seq != y->seq)
+        return(x->seq < y->seq ? -1 : 1);
+    return(x->faceid < y->faceid ? -1 : x->faceid > y->faceid);
+}
+
+static int
+ccnd_req_notices(struct ccnd_handle *ccnd,
+                 const unsigned char *comp, size_t size,
+                 struct ccn_charbuf *reply_body)
+{
+    struct ccnd_notice_gone *told = NULL;
+    struct ccnd_notice_gone *g = NULL;
+    struct ccn_charbuf *records = NULL;
+    struct face *face = NULL;
+    char buf[16];
+    char *ep = NULL;
+    unsigned long since;
+    unsigned through;
+    int full = 0;
+    int n = 0;
+    int i;
+    int j;
+    
+    if (size == 0 || size >= sizeof(buf) || comp[0] < '0' || comp[0] > '9')
+        return(-1);
+    memcpy(buf, comp, size);
+    buf[size] = 0;
+    since = strtoul(buf, &ep, 10);
+    if (*ep != 0)
+        return(-1);
+    ccnd_start_notice_tracking(ccnd);
+    if (since == 0 || since < ccnd->notice_floor || since > ccnd->notice_seq) {
+        since = 0;
+        full = 1;
+    }
+    told = calloc(ccnd->face_limit + CCND_NOTICE_GONE, sizeof(told[0]));
+    records = ccn_charbuf_create();
+    if (told == NULL || records == NULL) {
+        free(told);
+        ccn_charbuf_destroy(&records);
+        return(-1);
+    }
+    /* Gather what was told since then, and put it in the order told */
     for (i = 0; i < ccnd->face_limit; i++) {
         face = ccnd->faces_by_faceid[i];
-        if (face != NULL)
-            ccn_indexbuf_set_insert(ccnd->chface, face->faceid);
+        if (face != NULL && face->notice_seq > since) {
+            told[n].faceid = face->faceid;
+            told[n++].seq = face->notice_seq;
+        }
     }
-    if (ccnd->chface->n > 0)
-        ccnd_face_status_change(ccnd, ccnd->chface->buf[0]);
-    ccn_charbuf_destroy(&name);
+    for (i = 0; i < ccnd->notice_ngone; i++) {
+        g = &ccnd->notice_gone[(ccnd->notice_gone_head + i) % CCND_NOTICE_GONE];
+        if (g->seq > since)
+            told[n++] = *g;
+    }
+    qsort(told, n, sizeof(told[0]), &notice_gone_cmp);
+    /* Stop at the end of a batch once a batch's worth is in */
+    through = ccnd->notice_seq;
+    for (i = 0; i < n; i = j) {
+        if (records->length > CCND_NOTICE_BLOCK) {
+            through = told[i - 1].seq;
+            break;
+        }
+        for (j = i; j < n && told[j].seq == told[i].seq; j++)
+            append_face_record(ccnd, told[j].faceid, records);
+    }
+    ccn_charbuf_putf(reply_body, "@%u\n%s", through, full ? "*\n" : "");
+    ccn_charbuf_append_charbuf(reply_body, records);
+    free(told);
+    ccn_charbuf_destroy(&records);
+    return(0);
 }
 
 int
@@ -595,6 +817,8 @@ ccnd_internal_client_start(struct ccnd_handle *ccnd)
         ccn_destroy(&ccnd->internal_client);
         return(-1);
     }
+    ccnd->local_signing = (ccn_load_local_key(h, NULL) == 0);
+    ccnd->signer = ccn_signer_create(h, ccnd->sched);
 #if (CCND_PING+0)
     ccnd_uri_listen(ccnd, "ccnx:/ccnx/ping",
                     &ccnd_answer_req, OP_PING);
@@ -611,8 +835,12 @@ ccnd_internal_client_start(struct ccnd_handle *ccnd)
                     &ccnd_answer_req, OP_SELFREG + MUST_VERIFY1);
     ccnd_uri_listen(ccnd, "ccnx:/ccnx/" CCND_ID_TEMPL "/unreg",
                     &ccnd_answer_req, OP_UNREG + MUST_VERIFY1);
+    ccnd_uri_listen(ccnd, "ccnx:/ccnx/" CCND_ID_TEMPL "/prefixregs",
+                    &ccnd_answer_req, OP_PREFIXREGS + MUST_VERIFY1);
     ccnd_uri_listen(ccnd, "ccnx:/ccnx/" CCND_ID_TEMPL "/" CCND_NOTICE_NAME,
                     &ccnd_answer_req, OP_NOTICE);
+    ccnd_uri_listen(ccnd, "ccnx:/ccnx/" CCND_ID_TEMPL "/" CCND_NOTICES_NAME,
+                    &ccnd_answer_req, OP_NOTICES + 1);
     ccnd_uri_listen(ccnd, "ccnx:/%C1.M.S.localhost/%C1.M.SRV/ccnd",
                     &ccnd_answer_req, OP_SERVICE);
     ccnd_uri_listen(ccnd, "ccnx:/%C1.M.S.neighborhood",
@@ -638,6 +866,10 @@ ccnd_internal_client_stop(struct ccnd_handle *ccnd)
     if (ccnd->notice_push != NULL)
         ccn_schedule_cancel(ccnd->sched, ccnd->notice_push);
     ccn_indexbuf_destroy(&ccnd->chface);
+    free(ccnd->notice_gone);
+    ccnd->notice_gone = NULL;
+    ccnd->notice_ngone = 0;
+    ccn_signer_destroy(&ccnd->signer);
     ccn_destroy(&ccnd->internal_client);
     ccn_charbuf_destroy(&ccnd->service_ccnb);
     ccn_charbuf_destroy(&ccnd->neighbor_ccnb);
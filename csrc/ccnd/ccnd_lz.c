@@ -0,0 +1,207 @@
+/**
+ * @file ccnd_lz.c
+ *
+ * A small LZ77 codec for compressing content held in the store.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The compressed form is the LZ4 block format: a sequence of tokens,
+ * each a run of literals followed by a copy of at least 4 bytes from
+ * up to 64k back, with the last token all literals.  The compressor is
+ * the simple greedy one, with a single hash probe per position, so it
+ * is fast rather than thorough; that suits text and XML well enough,
+ * and what it cannot shrink is left alone.
+ *
+ * Nothing is kept between calls, and the compressed blocks never leave
+ * the process, so the format is not tied to anything outside this file.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ccnd_private.h"
+
+#define LZ_MINMATCH 4
+#define LZ_HASHBITS 12
+#define LZ_MAXOFFSET 65535
+#define LZ_LASTLITERALS 5       /**< the block ends with at least these */
+#define LZ_MFLIMIT 12           /**< no match starts this close to the end */
+
+static uint32_t
+lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return(v);
+}
+
+static unsigned
+lz_hash(uint32_t v)
+{
+    return((v * 2654435761U) >> (32 - LZ_HASHBITS));
+}
+
+/**
+ * Append a literal run (and the token for it) to the output.
+ * @returns the new output position, or NULL if it does not fit.
+ */
+static unsigned char *
+lz_put_literals(unsigned char *op, unsigned char *oend,
+                const unsigned char *lit, size_t n, unsigned char **token)
+{
+    size_t len = n;
+
+    if (op + 1 + n / 255 + 1 + n > oend)
+        return(NULL);
+    *token = op++;
+    if (len >= 15) {
+        **token = 15 << 4;
+        for (len -= 15; len >= 255; len -= 255)
+            *op++ = 255;
+        *op++ = len;
+    }
+    else
+        **token = len << 4;
+    memcpy(op, lit, n);
+    return(op + n);
+}
+
+/**
+ * Compress a block.
+ *
+ * @param cap is the most the compressed form may take.
+ * @returns the compressed size, or 0 if it would not fit in cap.
+ */
+size_t
+ccnd_lz_compress(const unsigned char *src, size_t n,
+                 unsigned char *dst, size_t cap)
+{
+    uint32_t tab[1 << LZ_HASHBITS];
+    const unsigned char *ip = src;
+    const unsigned char *anchor = src;
+    const unsigned char *iend = src + n;
+    const unsigned char *ref;
+    const unsigned char *mp;
+    unsigned char *op = dst;
+    unsigned char *oend = dst + cap;
+    unsigned char *token;
+    size_t mlen;
+    size_t off;
+    uint32_t v;
+    unsigned x;
+
+    memset(tab, 0, sizeof(tab));
+    while (n > LZ_MFLIMIT && ip < iend - LZ_MFLIMIT) {
+        v = lz_read32(ip);
+        x = lz_hash(v);
+        ref = src + tab[x];
+        tab[x] = ip - src;
+        if (ref >= ip || ip - ref > LZ_MAXOFFSET || lz_read32(ref) != v) {
+            ip++;
+            continue;
+        }
+        for (mp = ip + LZ_MINMATCH, ref += LZ_MINMATCH;
+             mp < iend - LZ_LASTLITERALS && *mp == *ref; mp++, ref++)
+            continue;
+        off = mp - ref;
+        mlen = mp - ip - LZ_MINMATCH;
+        op = lz_put_literals(op, oend, anchor, ip - anchor, &token);
+        if (op == NULL || op + 2 + mlen / 255 + 1 > oend)
+            return(0);
+        *op++ = off;
+        *op++ = off >> 8;
+        if (mlen >= 15) {
+            *token |= 15;
+            for (mlen -= 15; mlen >= 255; mlen -= 255)
+                *op++ = 255;
+            *op++ = mlen;
+        }
+        else
+            *token |= mlen;
+        ip = anchor = mp;
+    }
+    op = lz_put_literals(op, oend, anchor, iend - anchor, &token);
+    if (op == NULL)
+        return(0);
+    return(op - dst);
+}
+
+/**
+ * Expand a block made by ccnd_lz_compress.
+ *
+ * @param cap is the size of dst, which should be the original size.
+ * @returns the expanded size, or -1 if the block is malformed or
+ *          would overflow dst.
+ */
+ssize_t
+ccnd_lz_expand(const unsigned char *src, size_t n,
+               unsigned char *dst, size_t cap)
+{
+    const unsigned char *ip = src;
+    const unsigned char *iend = src + n;
+    const unsigned char *ref;
+    unsigned char *op = dst;
+    size_t len;
+    size_t off;
+    unsigned token;
+    unsigned b;
+
+    while (ip < iend) {
+        token = *ip++;
+        len = token >> 4;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return(-1);
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (size_t)(iend - ip) || len > cap - (op - dst))
+            return(-1);
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend)
+            break;
+        if (iend - ip < 2)
+            return(-1);
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (off == 0 || off > (size_t)(op - dst))
+            return(-1);
+        len = token & 15;
+        if (len == 15) {
+            do {
+                if (ip >= iend)
+                    return(-1);
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ_MINMATCH;
+        if (len > cap - (op - dst))
+            return(-1);
+        /* The copy may overlap what it is making, so go a byte at a time */
+        for (ref = op - off; len > 0; len--)
+            *op++ = *ref++;
+    }
+    return(op - dst);
+}
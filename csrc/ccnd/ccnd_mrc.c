@@ -0,0 +1,277 @@
+/**
+ * @file ccnd_mrc.c
+ *
+ * Online miss ratio curve for the ccnd content store.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The names looked up in the content store are sampled by hash, in the
+ * manner of SHARDS (Waldspurger et al., FAST '15): a name is tracked if
+ * its hash falls below a fixed threshold, so that either every reference
+ * to a name is seen or none are.  For a tracked name, the reuse distance
+ * is the number of distinct tracked names looked up since its previous
+ * lookup; scaled up by the sampling rate, this estimates the number of
+ * distinct names in between.  An LRU store of S objects would have
+ * answered the lookup if and only if that distance is less than S, so
+ * the histogram of scaled distances gives the hit ratio for any size.
+ *
+ * The distances are counted with a Fenwick tree indexed by the time
+ * (in sampled lookups) of the latest lookup of each tracked name.  When
+ * the times run out, the tree is rebuilt with the names renumbered in
+ * order, and the oldest names are forgotten if there are too many.
+ * So the estimates are good for stores of up to about MRC_KEEP * rate
+ * objects; beyond that, reuse looks like first lookups.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/hashtb.h>
+
+#include "ccnd_private.h"
+
+#define MRC_STAMPS (1 << 16)        /**< times before a rebuild */
+#define MRC_KEEP (MRC_STAMPS / 2)   /**< most names kept over a rebuild */
+
+struct ccnd_mrc {
+    unsigned rate;                  /**< one name in rate is tracked */
+    uint32_t threshold;             /**< track names whose hash is below */
+    struct hashtb *names;           /**< name hash -> struct mrc_name */
+    unsigned *tree;                 /**< Fenwick tree over times, 1-based */
+    unsigned now;                   /**< time of the next tracked lookup */
+    uintmax_t lookups;              /**< all lookups */
+    struct ccnd_hist dist;          /**< scaled reuse distances */
+};
+
+struct mrc_name {
+    unsigned stamp;                 /**< time of the latest lookup */
+};
+
+/**
+ * Create the miss ratio curve estimator.
+ * @param rate - track about one name in this many (at least 1)
+ */
+struct ccnd_mrc *
+ccnd_mrc_create(unsigned rate)
+{
+    struct ccnd_mrc *m;
+
+    if (rate < 1)
+        rate = 1;
+    m = calloc(1, sizeof(*m));
+    if (m == NULL)
+        return(NULL);
+    m->rate = rate;
+    m->threshold = (rate == 1) ? UINT32_MAX : (uint32_t)(0x100000000ULL / rate);
+    m->names = hashtb_create(sizeof(struct mrc_name), NULL);
+    m->tree = calloc(MRC_STAMPS + 1, sizeof(m->tree[0]));
+    if (m->names == NULL || m->tree == NULL)
+        ccnd_mrc_destroy(&m);
+    return(m);
+}
+
+void
+ccnd_mrc_destroy(struct ccnd_mrc **pm)
+{
+    struct ccnd_mrc *m = *pm;
+
+    if (m == NULL)
+        return;
+    hashtb_destroy(&m->names);
+    free(m->tree);
+    free(m);
+    *pm = NULL;
+}
+
+/**
+ * 64-bit FNV-1a, with a final mix so that the high bits are usable
+ */
+static uint64_t
+mrc_hash(const unsigned char *p, size_t size)
+{
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return(h);
+}
+
+static void
+tree_add(unsigned *tree, unsigned stamp, int delta)
+{
+    unsigned i;
+
+    for (i = stamp + 1; i <= MRC_STAMPS; i += i & -i)
+        tree[i] += delta;
+}
+
+/**
+ * @returns the number of tracked names last looked up before time t
+ */
+static unsigned
+tree_count(const unsigned *tree, unsigned t)
+{
+    unsigned n = 0;
+    unsigned i;
+
+    for (i = t; i > 0; i -= i & -i)
+        n += tree[i];
+    return(n);
+}
+
+static int
+mrc_stamp_compare(const void *a, const void *b)
+{
+    const struct mrc_name *x = *(struct mrc_name * const *)a;
+    const struct mrc_name *y = *(struct mrc_name * const *)b;
+
+    return((x->stamp > y->stamp) - (x->stamp < y->stamp));
+}
+
+/**
+ * Renumber the tracked names, forgetting the oldest if need be.
+ */
+static void
+mrc_rebuild(struct ccnd_mrc *m)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct mrc_name **v;
+    int n, i, drop;
+
+    n = hashtb_n(m->names);
+    v = calloc(n > 0 ? n : 1, sizeof(v[0]));
+    if (v == NULL) {
+        /* Start over */
+        hashtb_destroy(&m->names);
+        m->names = hashtb_create(sizeof(struct mrc_name), NULL);
+        memset(m->tree, 0, (MRC_STAMPS + 1) * sizeof(m->tree[0]));
+        m->now = 0;
+        return;
+    }
+    hashtb_start(m->names, e);
+    for (i = 0; i < n && e->data != NULL; i++, hashtb_next(e))
+        v[i] = e->data;
+    hashtb_end(e);
+    n = i;
+    qsort(v, n, sizeof(v[0]), &mrc_stamp_compare);
+    drop = (n > MRC_KEEP) ? n - MRC_KEEP : 0;
+    /* Mark the ones to go, then delete them in one pass */
+    for (i = 0; i < drop; i++)
+        v[i]->stamp = UINT_MAX;
+    for (i = drop; i < n; i++)
+        v[i]->stamp = i - drop;
+    if (drop > 0) {
+        hashtb_start(m->names, e);
+        while (e->data != NULL) {
+            struct mrc_name *name = e->data;
+            if (name->stamp == UINT_MAX)
+                hashtb_delete(e);
+            else
+                hashtb_next(e);
+        }
+        hashtb_end(e);
+    }
+    memset(m->tree, 0, (MRC_STAMPS + 1) * sizeof(m->tree[0]));
+    for (i = 0; i < n - drop; i++)
+        tree_add(m->tree, i, 1);
+    m->now = n - drop;
+    free(v);
+}
+
+/**
+ * Note a content store lookup of the given name.
+ *
+ * Most names cost only a hash; the few that are tracked also cost a
+ * hash table lookup and a walk of the Fenwick tree.
+ */
+void
+ccnd_mrc_reference(struct ccnd_mrc *m, const unsigned char *name, size_t size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct mrc_name *entry;
+    uint64_t hash;
+    uintmax_t d;
+    int res;
+
+    m->lookups++;
+    hash = mrc_hash(name, size);
+    if ((uint32_t)(hash >> 32) >= m->threshold && m->rate != 1)
+        return;
+    if (m->now >= MRC_STAMPS)
+        mrc_rebuild(m);
+    hashtb_start(m->names, e);
+    res = hashtb_seek(e, &hash, sizeof(hash), 0);
+    entry = e->data;
+    if (entry == NULL) {
+        hashtb_end(e);
+        return;
+    }
+    if (res == HT_OLD_ENTRY) {
+        d = tree_count(m->tree, m->now) - tree_count(m->tree, entry->stamp + 1);
+        d *= m->rate;
+        ccnd_hist_record(&m->dist, d < UINT_MAX ? d : UINT_MAX - 1);
+        tree_add(m->tree, entry->stamp, -1);
+    }
+    else
+        ccnd_hist_record(&m->dist, UINT_MAX); /* first lookup */
+    entry->stamp = m->now++;
+    tree_add(m->tree, entry->stamp, 1);
+    hashtb_end(e);
+}
+
+/**
+ * Estimate the hit ratio that an LRU store of the given size would have.
+ * @returns the estimate, in parts per million.
+ */
+unsigned
+ccnd_mrc_hit_ppm(struct ccnd_mrc *m, uintmax_t objects)
+{
+    if (m == NULL || m->dist.n == 0)
+        return(0);
+    if (objects > UINT_MAX - 1)
+        objects = UINT_MAX - 1;
+    return((uintmax_t)ccnd_hist_count_below(&m->dist, objects) * 1000000 /
+           m->dist.n);
+}
+
+/**
+ * @returns the number of lookups seen, and (in *sampled) the number of
+ * those that were tracked, reduced as old ones fade away.
+ */
+uintmax_t
+ccnd_mrc_lookups(struct ccnd_mrc *m, unsigned *sampled, unsigned *rate)
+{
+    if (m == NULL) {
+        *sampled = 0;
+        *rate = 0;
+        return(0);
+    }
+    *sampled = m->dist.n;
+    *rate = m->rate;
+    return(m->lookups);
+}
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -32,11 +33,96 @@
 
 #include "ccnd_private.h"
 
+/**
+ * Write one message through h->logger, without rate limiting.
+ */
+static void
+ccnd_vmsg(struct ccnd_handle *h, struct timeval *t, const char *fmt, va_list ap)
+{
+    struct ccn_charbuf *b;
+    int res;
+    b = ccn_charbuf_create();
+    if (((h->debug & 64) != 0) &&
+        ((h->logbreak-- < 0 && t->tv_sec != h->logtime) ||
+          t->tv_sec >= h->logtime + 30)) {
+        ccn_charbuf_putf(b, "%ld.000000 ccnd[%d]: %s ____________________ %s",
+                         (long)t->tv_sec, h->logpid, h->portstr ? h->portstr : "", ctime(&t->tv_sec));
+        h->logtime = t->tv_sec;
+        h->logbreak = 30;
+    }
+    ccn_charbuf_putf(b, "%ld.%06u ccnd[%d]: %s\n",
+        (long)t->tv_sec, (unsigned)t->tv_usec, h->logpid, fmt);
+    res = (*h->logger)(h->loggerdata, (const char *)b->buf, ap);
+    ccn_charbuf_destroy(&b);
+    /* if there's no one to hear, don't make a sound */
+    if (res < 0)
+        h->debug = 0;
+}
+
+static void
+ccnd_msg_now(struct ccnd_handle *h, struct timeval *t, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    ccnd_vmsg(h, t, fmt, ap);
+    va_end(ap);
+}
+
+/**
+ * Report how many messages were dropped at a call site.
+ */
+static void
+ccnd_logsite_report(struct ccnd_handle *h, struct ccnd_logsite *s,
+                    struct timeval *t)
+{
+    if (s->suppressed == 0)
+        return;
+    ccnd_msg_now(h, t, "suppressed %u more like \"%s\"", s->suppressed, s->fmt);
+    s->suppressed = 0;
+    h->logsuppressed--;
+}
+
+/**
+ * Decide whether a message from a call site is within h->lograte.
+ *
+ * Call sites are told apart by their format strings, in a small
+ * direct-mapped table; a site that collides with another simply takes
+ * over its slot, after reporting what it had dropped.
+ * This runs before any formatting, so a storm of messages costs little
+ * more than the calls.
+ * @returns 1 if the message should go out, 0 to drop it.
+ */
+static int
+ccnd_msg_allowed(struct ccnd_handle *h, const char *fmt, struct timeval *t)
+{
+    struct ccnd_logsite *s;
+    uintptr_t x = (uintptr_t)fmt;
+    
+    s = &h->logsites[(x ^ (x >> 6)) % CCND_LOGSITES];
+    if (s->fmt != fmt || s->sec != (unsigned long)t->tv_sec) {
+        ccnd_logsite_report(h, s, t);
+        s->fmt = fmt;
+        s->sec = t->tv_sec;
+        s->count = 0;
+    }
+    if (s->count >= h->lograte) {
+        if (s->suppressed++ == 0)
+            h->logsuppressed++;
+        return(0);
+    }
+    s->count++;
+    return(1);
+}
+
 /**
  *  Produce ccnd debug output.
  *  Output is produced via h->logger under the control of h->debug;
  *  prepends decimal timestamp and process identification.
  *  Caller should not supply newlines.
+ *  No more than h->lograte messages a second are produced from one
+ *  call site, if that is nonzero; the rest are counted, and the count
+ *  is reported later by ccnd_msg_flush or by the next message that
+ *  the site is allowed.
  *  @param      h  the ccnd handle
  *  @param      fmt  printf-like format string
  */
@@ -45,29 +131,31 @@ ccnd_msg(struct ccnd_handle *h, const char *fmt, ...)
 {
     struct timeval t;
     va_list ap;
-    struct ccn_charbuf *b;
-    int res;
     if (h == NULL || h->debug == 0 || h->logger == 0)
         return;
-    b = ccn_charbuf_create();
     gettimeofday(&t, NULL);
-    if (((h->debug & 64) != 0) &&
-        ((h->logbreak-- < 0 && t.tv_sec != h->logtime) ||
-          t.tv_sec >= h->logtime + 30)) {
-        ccn_charbuf_putf(b, "%ld.000000 ccnd[%d]: %s ____________________ %s",
-                         (long)t.tv_sec, h->logpid, h->portstr ? h->portstr : "", ctime(&t.tv_sec));
-        h->logtime = t.tv_sec;
-        h->logbreak = 30;
-    }
-    ccn_charbuf_putf(b, "%ld.%06u ccnd[%d]: %s\n",
-        (long)t.tv_sec, (unsigned)t.tv_usec, h->logpid, fmt);
+    if (h->lograte != 0 && !ccnd_msg_allowed(h, fmt, &t))
+        return;
     va_start(ap, fmt);
-    res = (*h->logger)(h->loggerdata, (const char *)b->buf, ap);
+    ccnd_vmsg(h, &t, fmt, ap);
     va_end(ap);
-    ccn_charbuf_destroy(&b);
-    /* if there's no one to hear, don't make a sound */
-    if (res < 0)
-        h->debug = 0;
+}
+
+/**
+ *  Report the messages dropped by rate limiting in earlier seconds.
+ *  @param      h  the ccnd handle
+ */
+void
+ccnd_msg_flush(struct ccnd_handle *h)
+{
+    struct timeval t;
+    int i;
+    if (h->logsuppressed == 0 || h->debug == 0 || h->logger == 0)
+        return;
+    gettimeofday(&t, NULL);
+    for (i = 0; i < CCND_LOGSITES && h->logsuppressed > 0; i++)
+        if (h->logsites[i].sec != (unsigned long)t.tv_sec)
+            ccnd_logsite_report(h, &h->logsites[i], &t);
 }
 
 /**
@@ -90,6 +178,7 @@ ccnd_debug_ccnb(struct ccnd_handle *h,
 {
     struct ccn_charbuf *c;
     struct ccn_parsed_interest pi;
+    struct timeval t;
     const unsigned char *nonce = NULL;
     size_t nonce_size = 0;
     size_t i;
@@ -122,7 +211,11 @@ ccnd_debug_ccnb(struct ccnd_handle *h,
         for (i = 0; i < nonce_size; i++)
             ccn_charbuf_putf(c, "%s%02X", (*p) && (*p++)=='-' ? "-" : "", nonce[i]);
     }
-    ccnd_msg(h, "%s", ccn_charbuf_as_string(c));
+    /* Traces are asked for by h->debug, so they are not rate limited */
+    if (h != NULL && h->logger != 0) {
+        gettimeofday(&t, NULL);
+        ccnd_msg_now(h, &t, "%s", ccn_charbuf_as_string(c));
+    }
     ccn_charbuf_destroy(&c);
 }
 
@@ -145,21 +238,220 @@ const char *ccnd_usage_message =
     "      64 - log occasional human-readable timestamps\n"
     "      128 - face registration debugging\n"
     "      bitwise OR these together for combinations; -1 gets max logging\n"
+    "    CCND_LOG_RATE=\n"
+    "          Most messages a second that one place in the code may log (default 50),\n"
+    "          so that error storms cost little.  The number dropped is logged later.\n"
+    "          0 means no limit.  Debug traces of messages are not limited.\n"
     "    CCN_LOCAL_PORT=\n"
     "      UDP port for unicast clients (default "CCN_DEFAULT_UNICAST_PORT").\n"
     "      Also listens on this TCP port for stream connections.\n"
     "      Also affects name of unix-domain socket.\n"
     "    CCN_LOCAL_SOCKNAME=\n"
     "      Name stem of unix-domain socket (default "CCN_DEFAULT_LOCAL_SOCKNAME").\n"
+    "    CCN_SHARDS=\n"
+    "      Number of ccnd processes sharing the port (default 1).  Each owns\n"
+    "      the names whose leading components hash to it, and has its own\n"
+    "      unix-domain socket, named with the shard number appended.\n"
+    "      Datagrams that arrive at the wrong one are handed to the owner.\n"
+    "    CCN_SHARD=\n"
+    "      Which of the CCN_SHARDS this ccnd is, counting from 0.  Clients\n"
+    "      may set it to pick the ccnd to contact.\n"
+    "    CCN_SHARD_COMPONENTS=\n"
+    "      How many leading name components pick the shard (default 1, up\n"
+    "      to 8).  More spread a busy prefix over the shards, but then an\n"
+    "      Interest with fewer components only finds content in its own\n"
+    "      shard.  Every ccnd and client on the host must use the same value.\n"
+    "    CCN_SHARD_PREFIX=\n"
+    "      Read by local clients, not by ccnd.  Without CCN_SHARD, a client\n"
+    "      contacts the ccnd that owns this name prefix.\n"
+    "    CCN_SHM=\n"
+    "      Read by local clients, not by ccnd.  If set (and not 0), a client\n"
+    "      asks to carry its connection over shared-memory rings that ccnd\n"
+    "      makes and passes to it, keeping the unix-domain socket only as a\n"
+    "      doorbell.  Linux only.\n"
+    "      With framed, a trusted client also sends length-framed messages,\n"
+    "      which ccnd takes without decoding the stream.\n"
+    "    CCN_SCHEDULE=\n"
+    "      Set to wheel to schedule events with a timer wheel instead of a heap.\n"
     "    CCND_CAP=\n"
     "      Capacity limit, in count of ContentObjects.\n"
     "      Not an absolute limit.\n"
+    "    CCND_CAP_BYTES=\n"
+    "      Capacity limit, in bytes held including estimated overhead.\n"
+    "      May have a k, m, or g suffix.  Not an absolute limit.\n"
+    "    CCND_CACHE_POLICY=\n"
+    "      Content store replacement policy, used when over CCND_CAP.\n"
+    "      One of lru, lfu, s3fifo; the default tosses the oldest content first.\n"
+    "    CCND_CS_SHARDS=\n"
+    "      Split the content store by name hash into this many shards, up to 64.\n"
+    "      Each holds its share of the capacity and is cleaned on its own.\n"
+    "    CCND_MRC_RATE=\n"
+    "      Sample 1 name in this many content store lookups to estimate\n"
+    "      the hit ratio at other store sizes, up to 32768 times this\n"
+    "      many objects.  The default is 100; 0 turns this off.\n"
     "    CCND_MTU=\n"
     "      Packet size in bytes.\n"
     "      If set, interest stuffing is allowed within this budget.\n"
     "      Single items larger than this are not precluded.\n"
+    "    CCND_PACK_MICROSEC=\n"
+    "      Time in microseconds to hold a small message for a datagram face,\n"
+    "      so that several may share one packet of up to CCND_MTU bytes\n"
+    "      (1400 if that is not set).  0 (the default) turns packing off.\n"
+    "    CCND_LINK_MTU=\n"
+    "      On link faces (those using CCNProtocolDataUnit), send messages\n"
+    "      larger than this many bytes as fragments, to be reassembled by the\n"
+    "      next hop.  Lost fragments are requested again from this hop.  Any ccnd\n"
+    "      will reassemble; this controls sending.  0 (the default) turns it off.\n"
+    "      When set, unicast datagram faces to other ccnds become link faces.\n"
+    "    CCND_LINK_ARQ=\n"
+    "      If nonzero, acknowledge the link SequenceNumbers received on unicast\n"
+    "      datagram faces.  A peer that sees these acks keeps what it sends for a\n"
+    "      short while, and sends again whatever seems to have been lost, so that\n"
+    "      losses are repaired within about one link round trip.\n"
+    "    CCND_UDP_GSO=\n"
+    "      Where the kernel supports it, runs of same-sized datagrams to one\n"
+    "      peer are handed down as a single segmented send.  0 turns this off.\n"
+    "    CCND_TRACE=\n"
+    "      If set, write a binary trace of packet events (interests and content\n"
+    "      in and out, content store hits, PIT inserts, satisfactions and expiries,\n"
+    "      faces up and down) to this file, for decoding with ccndtrace(1).\n"
+    "      Tracing can also be turned on and off with /?t=on and /?t=off on the\n"
+    "      status port; without CCND_TRACE, the file is $TMPDIR/ccnd-PID.trace.\n"
+    "    CCND_TRACE_RECORDS=\n"
+    "      Number of records kept in the trace ring (default 65536); the oldest\n"
+    "      are overwritten.  Each record is 64 bytes.\n"
+    "    CCND_OUTQ_BYTES=\n"
+    "      Per-face limit on unsent output to a stream face, in bytes (default 1m).\n"
+    "      Content is held back from a face that is over the limit.\n"
+    "      May have a k, m, or g suffix; 0 means no limit.\n"
+    "    CCND_FACE_INTEREST_RATE=\n"
+    "      Limit on interests per second that one face may add to the pending\n"
+    "      interest table, with bursts of up to a second's worth.  0 (the\n"
+    "      default) means no limit.  Local clients are told of drops at once\n"
+    "      by a NACK ContentObject, instead of having their interests time out.\n"
+    "    CCND_PREFIX_INTEREST_RATE=\n"
+    "      Like CCND_FACE_INTEREST_RATE, but applied to each registered prefix,\n"
+    "      counting interests from all faces.\n"
+    "    CCND_PIT_LIMIT=\n"
+    "      Budget for the number of pending interests.  Past three quarters of\n"
+    "      it, new interests are kept for less than their lifetimes, so that the\n"
+    "      PIT drains faster; once it is used up, each face may only have its\n"
+    "      equal share pending.  0 (the default) means no limit.\n"
+    "    CCND_PIT_BYTES=\n"
+    "      Budget for the bytes of pending interest messages, applied in the\n"
+    "      same way as CCND_PIT_LIMIT.  May have a k, m, or g suffix; 0 (the\n"
+    "      default) means no limit.\n"
+    "    CCND_NEGATIVE_TTL=\n"
+    "      Time, in milliseconds, to remember an interest that was forwarded\n"
+    "      but went unanswered (or was answered by a NACK).  Until then, the\n"
+    "      same interest (same name and selectors) is not forwarded again,\n"
+    "      but is answered by a NACK ContentObject.  0 (the default) means\n"
+    "      no negative caching.  Do not use this for namespaces where\n"
+    "      interests are meant to wait for content that does not yet exist.\n"
+    "    CCND_NEGATIVE_TTL_PREFIXES=\n"
+    "      List of per-prefix overrides for CCND_NEGATIVE_TTL, each a ccnx URI\n"
+    "      and a time in milliseconds joined by '=', separated by whitespace,\n"
+    "      commas, or semicolons.  The longest matching prefix applies.\n"
+    "      example: CCND_NEGATIVE_TTL_PREFIXES=ccnx:/video=2000,ccnx:/video/live=0\n"
+    "    CCND_DEAD_NONCE_SECONDS=\n"
+    "      Seconds to remember the nonces of interests whose pending entries\n"
+    "      have gone, so that interests that loop back late are dropped.\n"
+    "      Each nonce is kept for one to two of these periods.  The default\n"
+    "      is 8; 0 turns this off.\n"
+    "    CCND_DISK_CACHE=\n"
+    "      File in which to keep content evicted from memory, as a second\n"
+    "      tier of the content store.  Interests that miss in memory look\n"
+    "      for content of exactly their name there.  What the file holds is\n"
+    "      found again when ccnd restarts.  Only content that does not go\n"
+    "      stale with time is kept.  Unset (the default) means no disk cache.\n"
+    "    CCND_DISK_CACHE_BYTES=\n"
+    "      Size of the CCND_DISK_CACHE file, with an optional k, m, or g\n"
+    "      suffix.  The oldest content is overwritten when it fills.\n"
+    "      The default is 1g.\n"
+    "    CCND_SNAPSHOT=\n"
+    "      File for a snapshot of the permanent faces, their forwarding\n"
+    "      entries, and the most used content, so that a restarted ccnd\n"
+    "      starts warm.  The snapshot is written when ccnd exits (including\n"
+    "      on SIGTERM) and on SIGUSR1, and read back at startup.  Only content\n"
+    "      that does not go stale with time is kept.  Unset (the default)\n"
+    "      means no snapshot.\n"
+    "    CCND_SNAPSHOT_OBJECTS=\n"
+    "      Most content objects to keep in the CCND_SNAPSHOT.  The default\n"
+    "      is 1000.\n"
+    "    CCND_COMPRESS_AGE=\n"
+    "      Seconds that a content object in the store may go unsent before it\n"
+    "      is compressed, to make room for more.  Compression is done a little\n"
+    "      at a time in the background, faster when no interests are arriving,\n"
+    "      and the object is expanded again whenever it is sent.  Unset or 0\n"
+    "      (the default) means no compression.\n"
+    "    CCND_CLASS_WEIGHTS=\n"
+    "      Weights of traffic classes 1, 2 and 3, separated by commas.  Each\n"
+    "      face sends the content queued for class 0 first, and shares what is\n"
+    "      left among the others in proportion to these.  Registrations put\n"
+    "      prefixes in classes (see ccndc); other names are in class 2.  The\n"
+    "      default is 4,2,1.\n"
+    "    CCND_IDLE_SLACK=\n"
+    "      Milliseconds by which timers may be put off while ccnd is idle,\n"
+    "      so that housekeeping shares wakeups.  ccnd is idle once no interests\n"
+    "      are pending and nothing has come or gone for 2 seconds; then the\n"
+    "      periodic housekeeping also runs 4 times less often.  Anything\n"
+    "      arriving ends it.  Meant for battery-powered hosts.  Unset or 0\n"
+    "      (the default) means timers are kept exactly.\n"
+    "    CCND_PROFILE=\n"
+    "      Set to compact for small devices.  The tables start small and shrink\n"
+    "      again as they empty, faces share one input buffer, and there are no\n"
+    "      batched datagram buffers.  Unless they are set, CCND_CAP defaults to\n"
+    "      2000, CCND_CAP_BYTES to 4M, CCND_OUTQ_BYTES to 64k and CCND_PIT_BYTES\n"
+    "      to 1M.  Unset (the default) sizes things for a server.\n"
+    "    CCND_TOPK=\n"
+    "      Number of heaviest name prefixes (at depths 1 to 3) and faces\n"
+    "      to track for the status page, by interests received, and of faces\n"
+    "      by content bytes sent.  Counts halve every 10 seconds.  Past 3/4 of\n"
+    "      the PIT budget, the face sending the most interests may not hold more\n"
+    "      than its average share.  0 turns tracking off.  The default is 10;\n"
+    "      at most 64.\n"
+    "    CCND_MGMT_BUDGET=\n"
+    "      Management interests (for /ccnx/<ccnd id> and /%C1.M.S.localhost)\n"
+    "      are set aside as they arrive and handled ahead of other traffic, at\n"
+    "      most this many per turn of the event loop, and their replies jump\n"
+    "      the output queues.  The default is 16; at most 64.\n"
+    "    CCND_NOTICE_INTERVAL=\n"
+    "      Least time between batches of face status notices, in milliseconds.\n"
+    "      Face changes go to ccnx:/ccnx/<ccnd id>/notice.txt at most this often,\n"
+    "      many faces to a segment, and ccnx:/ccnx/<ccnd id>/notices/N gives the\n"
+    "      changes since batch N.  The default is 100.\n"
+    "    CCND_ETHER=\n"
+    "      Network interfaces on which to carry CCNx directly in Ethernet\n"
+    "      frames, of ethertype 0x88B5, sent to group 03:00:63:63:6e:78.  Each\n"
+    "      becomes a face shared by every ccnd on that segment; messages too\n"
+    "      large for a frame are sent in fragments.  Linux only; needs\n"
+    "      CAP_NET_RAW.  Separate names by commas or spaces.\n"
+    "    CCND_ADMIT=\n"
+    "      Which content from other nodes to keep in the store.  A list of:\n"
+    "      solicited, to drop content that no pending interest asked for\n"
+    "      without storing it; second, to keep content only the second time it\n"
+    "      comes within a minute; a percentage such as 25%, the chance that new\n"
+    "      content is kept; all, to keep everything.  Content not kept is still\n"
+    "      sent to the faces that asked for it.  Content that local applications\n"
+    "      put is always kept.  The default is solicited.\n"
+    "    CCND_PREFETCH=\n"
+    "      Segments to fetch ahead for a face that asks for the segments of\n"
+    "      a name in sequence (by the CCN_MARKER_SEQNUM convention).  Up to 4\n"
+    "      such readers are followed on each face.  The most is 64; 0 or unset\n"
+    "      (the default) means no prefetching.\n"
+    "    CCND_IO=\n"
+    "      Event backend.  If uring, use io_uring where the kernel supports it;\n"
+    "      otherwise epoll, kqueue, or poll is used.\n"
+    "    CCND_CPUS=\n"
+    "      List of CPUs, such as 0-7,16-23.  If set, this ccnd runs only on the\n"
+    "      one listed at the position of its CCN_SHARD (wrapping around), and\n"
+    "      with shared ports, asks the kernel for the traffic that arrives on\n"
+    "      that CPU.  Listing the CPUs of the network card's NUMA node keeps the\n"
+    "      shards and their memory there.  Linux only.\n"
     "    CCND_DATA_PAUSE_MICROSEC=\n"
-    "      Adjusts content-send delay time for multicast and udplink faces\n"
+    "      Adjusts content-send delay time for multicast and udplink faces.\n"
+    "      On multicast faces this is the starting point; the delay then\n"
+    "      adapts to how often other nodes answer first.\n"
     "    CCND_DEFAULT_TIME_TO_STALE=\n"
     "      Default for content objects without explicit FreshnessSeconds\n"
     "    CCND_MAX_TIME_TO_STALE=\n"
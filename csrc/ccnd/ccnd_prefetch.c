@@ -0,0 +1,312 @@
+/**
+ * @file ccnd_prefetch.c
+ *
+ * Prefetching of segments for consumers that fetch in sequence.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * A stream is a face asking for segments under one prefix.  Once a
+ * stream has asked for two segments in a row, each further request
+ * reaches out to keep the next few segments on their way, so that
+ * they are in the store when the consumer gets to them.  A face has a
+ * bounded number of streams, and streams that go quiet are dropped.
+ *
+ * The names that were asked for are remembered for a while, so that
+ * the content store can tell which arrivals came from prefetching.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
+
+#include "ccnd_private.h"
+
+#define PREFETCH_IDLE 10        /**< seconds before a quiet stream goes */
+#define PREFETCH_EXPECT 8       /**< seconds to wait for a prefetched name */
+
+struct prefetch_stream {
+    unsigned faceid;
+    uintmax_t next;             /**< the segment that continues the run */
+    uintmax_t issued;           /**< highest segment prefetched */
+    unsigned run;               /**< segments in a row so far */
+    long used;                  /**< when last asked for */
+};
+
+struct prefetch_face {
+    unsigned streams;
+};
+
+struct prefetch_expect {
+    long asked;
+};
+
+struct ccnd_prefetch {
+    unsigned depth;             /**< segments to keep ahead */
+    unsigned streams;           /**< most streams per face */
+    struct hashtb *stream_tab;  /**< keyed by faceid and prefix */
+    struct hashtb *face_tab;    /**< keyed by faceid */
+    struct hashtb *expect_tab;  /**< keyed by name components */
+    struct ccn_charbuf *key;
+    long swept;                 /**< time of the last sweep */
+    uintmax_t issued;
+    uintmax_t landed;
+    uintmax_t used;
+    uintmax_t wasted;
+};
+
+/**
+ * Create the prefetcher.
+ * @param depth - how many segments to keep ahead of a stream
+ * @param streams - most streams to follow for any one face
+ */
+struct ccnd_prefetch *
+ccnd_prefetch_create(unsigned depth, unsigned streams)
+{
+    struct ccnd_prefetch *p;
+
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        return(NULL);
+    p->depth = depth;
+    p->streams = streams < 1 ? 1 : streams;
+    p->stream_tab = hashtb_create(sizeof(struct prefetch_stream), NULL);
+    p->face_tab = hashtb_create(sizeof(struct prefetch_face), NULL);
+    p->expect_tab = hashtb_create(sizeof(struct prefetch_expect), NULL);
+    p->key = ccn_charbuf_create();
+    if (p->stream_tab == NULL || p->face_tab == NULL ||
+        p->expect_tab == NULL || p->key == NULL)
+        ccnd_prefetch_destroy(&p);
+    return(p);
+}
+
+void
+ccnd_prefetch_destroy(struct ccnd_prefetch **pp)
+{
+    struct ccnd_prefetch *p = *pp;
+
+    if (p == NULL)
+        return;
+    hashtb_destroy(&p->stream_tab);
+    hashtb_destroy(&p->face_tab);
+    hashtb_destroy(&p->expect_tab);
+    ccn_charbuf_destroy(&p->key);
+    free(p);
+    *pp = NULL;
+}
+
+/**
+ * Drop the streams that have gone quiet, and stop waiting for names
+ * that have not turned up.
+ */
+static void
+prefetch_sweep(struct ccnd_prefetch *p, long now)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct prefetch_stream *s;
+    struct prefetch_expect *x;
+    struct prefetch_face *f;
+
+    p->swept = now;
+    hashtb_start(p->stream_tab, e);
+    while (e->data != NULL) {
+        s = e->data;
+        if (now - s->used < PREFETCH_IDLE) {
+            hashtb_next(e);
+            continue;
+        }
+        f = hashtb_lookup(p->face_tab, &s->faceid, sizeof(s->faceid));
+        if (f != NULL && f->streams > 0)
+            f->streams--;
+        hashtb_delete(e);
+    }
+    hashtb_end(e);
+    hashtb_start(p->face_tab, e);
+    while (e->data != NULL) {
+        f = e->data;
+        if (f->streams == 0)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+    hashtb_start(p->expect_tab, e);
+    while (e->data != NULL) {
+        x = e->data;
+        if (now - x->asked >= PREFETCH_EXPECT)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+}
+
+/**
+ * Note a request for a segment.
+ *
+ * The stream is named by the face and the name components that come
+ * before the segment component.
+ * @param first - set to the first segment to prefetch
+ * @returns the number of segments to prefetch, starting at *first.
+ */
+int
+ccnd_prefetch_note(struct ccnd_prefetch *p, unsigned faceid, long now,
+                   const unsigned char *prefix, size_t size,
+                   uintmax_t seq, uintmax_t *first)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct hashtb_enumerator fee;
+    struct hashtb_enumerator *fe = &fee;
+    struct prefetch_stream *s;
+    struct prefetch_face *f;
+    uintmax_t last;
+    int res;
+
+    if (now - p->swept >= PREFETCH_IDLE)
+        prefetch_sweep(p, now);
+    p->key->length = 0;
+    ccn_charbuf_append(p->key, &faceid, sizeof(faceid));
+    ccn_charbuf_append(p->key, prefix, size);
+    hashtb_start(p->stream_tab, e);
+    res = hashtb_seek(e, p->key->buf, p->key->length, 0);
+    s = e->data;
+    if (res == HT_NEW_ENTRY) {
+        hashtb_start(p->face_tab, fe);
+        hashtb_seek(fe, &faceid, sizeof(faceid), 0);
+        f = fe->data;
+        hashtb_end(fe);
+        if (f == NULL || f->streams >= p->streams) {
+            hashtb_delete(e);
+            hashtb_end(e);
+            return(0);
+        }
+        f->streams++;
+        s->faceid = faceid;
+        s->next = seq + 1;
+        s->issued = seq;
+        s->run = 1;
+        s->used = now;
+        hashtb_end(e);
+        return(0);
+    }
+    hashtb_end(e);
+    if (s == NULL)
+        return(0);
+    s->used = now;
+    if (seq < s->next - 1)
+        return(0); /* a retransmission, or a look back */
+    if (seq == s->next)
+        s->run++;
+    else if (seq != s->next - 1) {
+        s->run = 1;
+        if (s->issued < seq)
+            s->issued = seq;
+    }
+    s->next = seq + 1;
+    if (s->run < 2)
+        return(0);
+    *first = s->issued + 1;
+    if (*first < seq + 1)
+        *first = seq + 1;
+    last = seq + p->depth;
+    if (*first > last)
+        return(0);
+    s->issued = last;
+    return(last - *first + 1);
+}
+
+/**
+ * Remember that a name (as its components) was asked for.
+ */
+void
+ccnd_prefetch_expect(struct ccnd_prefetch *p, long now,
+                     const unsigned char *comps, size_t size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct prefetch_expect *x;
+
+    hashtb_start(p->expect_tab, e);
+    if (hashtb_seek(e, comps, size, 0) >= 0) {
+        x = e->data;
+        x->asked = now;
+        p->issued++;
+    }
+    hashtb_end(e);
+}
+
+/**
+ * Check arriving content against the names that were asked for.
+ * @returns 1 if the name was prefetched, else 0.
+ */
+int
+ccnd_prefetch_landed(struct ccnd_prefetch *p,
+                     const unsigned char *comps, size_t size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    int res = 0;
+
+    if (hashtb_n(p->expect_tab) == 0)
+        return(0);
+    hashtb_start(p->expect_tab, e);
+    if (hashtb_seek(e, comps, size, 0) == HT_OLD_ENTRY) {
+        p->landed++;
+        res = 1;
+    }
+    hashtb_delete(e);
+    hashtb_end(e);
+    return(res);
+}
+
+/**
+ * Count the fate of a prefetched object: sent to a consumer, or
+ * dropped from the store unused.
+ */
+void
+ccnd_prefetch_outcome(struct ccnd_prefetch *p, int used)
+{
+    if (used)
+        p->used++;
+    else
+        p->wasted++;
+}
+
+/**
+ * Get the counts of prefetched objects that arrived, that were used,
+ * and that were dropped unused.
+ * @returns the number of prefetching interests.
+ */
+uintmax_t
+ccnd_prefetch_counts(struct ccnd_prefetch *p, uintmax_t *landed,
+                     uintmax_t *used, uintmax_t *wasted)
+{
+    if (landed != NULL)
+        *landed = p->landed;
+    if (used != NULL)
+        *used = p->used;
+    if (wasted != NULL)
+        *wasted = p->wasted;
+    return(p->issued);
+}
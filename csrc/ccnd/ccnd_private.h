@@ -33,6 +33,7 @@
 
 #include <ccn/ccn_private.h>
 #include <ccn/coding.h>
+#include <ccn/memacct.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/schedule.h>
 #include <ccn/seqwriter.h>
@@ -45,6 +46,10 @@ struct ccn_charbuf;
 struct ccn_indexbuf;
 struct hashtb;
 struct ccnd_meter;
+struct ccnd_scrape;
+struct ccnd_status;
+struct ccnd_trace;
+struct ccn_shmring;
 
 /*
  * These are defined in this header.
@@ -54,14 +59,406 @@ struct face;
 struct content_entry;
 struct nameprefix_entry;
 struct propagating_entry;
+struct ccn_arena;
 struct content_tree_node;
 struct ccn_forwarding;
+struct ccn_signer;
+struct ccnd_dgram_io;
+struct ccnd_uring_io;
+struct ccnd_nameindex;
+struct ccnd_nameindex_node;
+struct ccnd_intern;
+struct ccnd_cache;
+struct ccnd_cache_list;
+struct ccnd_mrc;
+struct ccnd_dnl;
+struct ccnd_disk;
+struct ccnd_prefetch;
+struct ccnd_quota;
+struct ccnd_fresh_rule;
+struct ccnd_hh;
+struct ccnd_cs_shard;
+struct content_queue;
 
-//typedef uint_least64_t ccn_accession_t;
-typedef unsigned ccn_accession_t;
+/**
+ * Content is referenced by its accession number.  The low-order
+ * CCND_CONTENT_SLOTBITS bits are the content's slot in content_by_slot;
+ * the rest are taken from the arrival count, so that an accession stays
+ * unique over time, even after its slot has been reused.
+ * Accessions are 64 bits on every host, so they do not come around again.
+ * The references queued in indexbufs and in scheduled events only hold
+ * a size_t, though, so on 32-bit hosts they keep just the low bits;
+ * use CCND_ACCESSION_MATCH to compare one with an accession.
+ */
+typedef uint64_t ccn_accession_t;
+#define CCND_CONTENT_SLOTBITS (sizeof(size_t) > 4 ? 28 : 20)
+#define CCND_CONTENT_SLOTMASK \
+    ((((ccn_accession_t)1) << CCND_CONTENT_SLOTBITS) - 1)
+#define CCND_ACCESSION_MATCH(ref, accession) \
+    ((size_t)(ref) == (size_t)(accession))
 
 typedef int (*ccnd_logger)(void *loggerdata, const char *format, va_list ap);
 
+/**
+ * Rate limiting state for the ccnd_msg calls from one call site,
+ * which is known by its format string.
+ */
+struct ccnd_logsite {
+    const char *fmt;                /**< format string, or NULL */
+    unsigned long sec;              /**< second being counted */
+    unsigned count;                 /**< messages produced in that second */
+    unsigned suppressed;            /**< dropped and not yet reported */
+};
+#define CCND_LOGSITES 64
+/** Default for CCND_LOG_RATE */
+#define CCND_LOG_RATE 50
+
+/**
+ * Token bucket used for limiting interest rates.
+ * The bucket holds at most one second's worth of tokens.
+ */
+struct ccnd_bucket {
+    int level;                      /**< tokens, in thousandths */
+    unsigned stamp;                 /**< time of last refill (usec) */
+};
+
+/**
+ * Byte token bucket for shaping the output of a face.
+ * A message is never split, so the tokens may go negative; the
+ * content queues of the face then wait until the deficit is repaid.
+ */
+struct ccnd_shaper {
+    unsigned rate;                  /**< bytes per second, 0 if not shaped */
+    unsigned burst;                 /**< bucket depth in bytes */
+    int tokens;                     /**< bytes that may be sent now */
+    unsigned stamp;                 /**< time of last refill (usec) */
+    unsigned qmax;                  /**< limit on each content queue (items) */
+    unsigned drops;                 /**< content not queued for lack of room */
+};
+
+/**
+ * Answer suppression on a party-line (multicast) face.
+ * Content is held back for a randomized delay so that, if a peer answers
+ * first, our copy need not be sent.  The delay is adapted per face: it
+ * shrinks while nobody else answers, and grows when a peer's answer
+ * arrives while ours is queued (suppressed) or after ours was already
+ * available (a collision).  It stays between CCND_SUPPRESS_MIN_USEC and
+ * four times the data_pause_microsec tunable.
+ */
+#define CCND_SUPPRESS_MIN_USEC 20
+
+struct ccnd_suppress {
+    unsigned usec;                  /**< current base delay, 0 until used */
+    unsigned sent;                  /**< answers sent */
+    unsigned suppressed;            /**< answers withheld, a peer's came first */
+    unsigned collisions;            /**< duplicate answers heard */
+    unsigned delayed;               /**< answers delayed */
+    uintmax_t delay_total;          /**< sum of those delays (usec) */
+};
+
+/**
+ * Log-bucketed histogram of latencies, in microseconds.
+ * Below CCND_HIST_SUB each value has its own bucket; above that each
+ * power of two is split into CCND_HIST_SUB buckets, so a bucket is never
+ * wider than 1/CCND_HIST_SUB of the values in it.
+ * When n reaches CCND_HIST_HALF all the counts are halved, so that
+ * old samples fade away.
+ */
+#define CCND_HIST_SUB_BITS 3
+#define CCND_HIST_SUB (1 << CCND_HIST_SUB_BITS)
+#define CCND_HIST_N ((33 - CCND_HIST_SUB_BITS) * CCND_HIST_SUB)
+#define CCND_HIST_HALF (1U << 20)
+
+struct ccnd_hist {
+    unsigned count[CCND_HIST_N];    /**< samples, by bucket */
+    unsigned n;                     /**< sum of count[] */
+    uintmax_t sum;                  /**< sum of the samples counted (usec) */
+    unsigned max;                   /**< largest since the last halving */
+};
+
+/**
+ * Latency histogram for one of the busiest name prefixes.
+ * A prefix without a slot takes over the least busy one once it has
+ * seen more samples than that slot has recently.
+ */
+#define CCND_LAT_PREFIXES 16
+
+struct ccnd_prefix_lat {
+    struct nameprefix_entry *npe;   /**< the prefix this slot is for */
+    unsigned recent;                /**< samples, halved as slots turn over */
+    struct ccnd_hist hist;
+};
+
+/**
+ * Small messages bound for a datagram face may be held briefly, so that
+ * several can share one packet (a CCNProtocolDataUnit on a link face).
+ */
+struct ccnd_packer {
+    struct ccn_charbuf *buf;        /**< messages waiting to go, or NULL */
+    struct ccn_scheduled_event *ev; /**< sends buf when the window closes */
+    unsigned start;                 /**< when buf was started (usec) */
+    unsigned n;                     /**< messages in buf */
+    unsigned offsets;               /**< sum of their arrival times - start */
+    unsigned msgs;                  /**< total messages sent packed */
+    unsigned pdus;                  /**< total packets they went in */
+    uintmax_t wait;                 /**< total usec they were held */
+};
+
+/**
+ * Messages too large for one packet on a link face are sent as
+ * LinkFragments, and reassembled by the next hop.
+ * Recently fragmented messages are kept, so that the receiver may
+ * ask (with a FragmentRequest) for pieces that went missing.
+ */
+#define CCND_FRAG_MAX 64            /**< most fragments in one message */
+#define CCND_REASM_SLOTS 4          /**< messages in reassembly per face */
+#define CCND_FRAG_KEEP 8            /**< messages kept for repair per face */
+
+struct ccnd_reasm {
+    int id;                         /**< message SequenceNumber, -1 if free */
+    int count;                      /**< FragmentCount */
+    uint_least64_t have;            /**< bitmap of fragments received */
+    unsigned stamp;                 /**< last arrival or request (usec) */
+    int tries;                      /**< repair requests sent */
+    struct ccn_charbuf *parts;      /**< fragment data, in arrival order */
+    unsigned off[CCND_FRAG_MAX];    /**< where each fragment is in parts */
+    unsigned short len[CCND_FRAG_MAX]; /**< and how long it is */
+};
+
+struct ccnd_fraglink {
+    unsigned short nextid;          /**< SequenceNumber for the next message */
+    struct ccnd_reasm slot[CCND_REASM_SLOTS];
+    struct ccn_charbuf *kept[CCND_FRAG_KEEP]; /**< sent, by id modulo KEEP */
+    unsigned short kept_id[CCND_FRAG_KEEP];
+    unsigned short kept_fragsize[CCND_FRAG_KEEP];
+    struct ccn_scheduled_event *repair; /**< asks for missing fragments */
+    unsigned sent;                  /**< fragments sent */
+    unsigned resent;                /**< fragments sent again on request */
+    unsigned reassembled;           /**< messages reassembled */
+    unsigned requested;             /**< repair requests sent */
+    unsigned dropped;               /**< messages given up on */
+};
+
+/**
+ * Hop-by-hop reliability for a datagram face whose peer sends LinkAcks.
+ * Each datagram sent with a SequenceNumber is kept until it is
+ * acknowledged, and sent again if it seems to have been lost.
+ */
+#define CCND_ARQ_WINDOW 32          /**< datagrams kept for retransmission */
+
+struct ccnd_arq {
+    /* receiving side - what to acknowledge */
+    unsigned short rtop;            /**< highest SequenceNumber received */
+    uint_least32_t rmask;           /**< bit i set if rtop - i was received */
+    int ack_pending;                /**< an ack is owed to the peer */
+    struct ccn_scheduled_event *ack_ev; /**< sends an ack on its own */
+    /* sending side - what may need to go again */
+    int seq_pending;                /**< next datagram carries seq_next */
+    unsigned short seq_next;
+    struct ccn_charbuf *buf[CCND_ARQ_WINDOW]; /**< unacked, by seq modulo */
+    unsigned short seq[CCND_ARQ_WINDOW];
+    unsigned sent_at[CCND_ARQ_WINDOW];
+    unsigned char tries[CCND_ARQ_WINDOW];
+    struct ccn_scheduled_event *rto_ev; /**< retransmission timer */
+    unsigned srtt;                  /**< smoothed link round trip (usec) */
+    unsigned acks_sent;
+    unsigned acked;
+    unsigned retransmitted;
+    unsigned lost;                  /**< given up after CCND_ARQ_TRIES */
+};
+
+/**
+ * Pending interest messages are held in blocks carved from slabs,
+ * in power-of-two size classes from 64 bytes up to 2048.
+ * Larger messages are simply malloced.
+ */
+#define CCND_PIT_SLAB_BYTES 65536
+#define CCND_PIT_MIN_SHIFT 6
+#define CCND_PIT_CLASSES 6
+
+/**
+ * A set of faces, by slot
+ *
+ * Up to CCND_FACESET_INLINE slots are kept sorted within the struct;
+ * a larger set is a bitmap over face slots.  See ccnd_faceset.c.
+ */
+#define CCND_FACESET_INLINE 6
+struct ccnd_faceset {
+    unsigned n;                 /**< number of members */
+    unsigned nwords;            /**< words in u.bits, or 0 while inline */
+    union {
+        unsigned slot[CCND_FACESET_INLINE]; /**< sorted, while inline */
+        uint64_t *bits;         /**< bitmap indexed by slot */
+    } u;
+};
+
+/**
+ * Memory accounting tags
+ *
+ * Most of these are charged as the memory is allocated and freed.
+ * CCND_MEM_FACEBUF and CCND_MEM_SCHED are set by ccnd_mem_census
+ * instead, just before they are reported.
+ */
+enum ccnd_mem_tag {
+    CCND_MEM_CONTENT_TAB,   /**< content store entries (content_tab) */
+    CCND_MEM_CONTENT,       /**< stored ContentObjects and their names */
+    CCND_MEM_NAMEINDEX,     /**< name-ordered content index */
+    CCND_MEM_NAMEPREFIX,    /**< nameprefix_tab */
+    CCND_MEM_FIB,           /**< forwarding entries (ccn_forwarding) */
+    CCND_MEM_PIT,           /**< propagating_tab and interest messages */
+    CCND_MEM_FACES,         /**< face tables */
+    CCND_MEM_FACEBUF,       /**< face input buffers and output queues */
+    CCND_MEM_SCHED,         /**< scheduled events */
+    CCND_MEM_N
+};
+
+/**
+ * PIT budget
+ *
+ * PIT usage is the larger of the pending interests as a fraction of
+ * CCND_PIT_LIMIT and the bytes of their messages as a fraction of
+ * CCND_PIT_BYTES, in thousandths.  From CCND_PIT_SOFT on, new entries
+ * are given shortened lifetimes so that the PIT drains faster, and the
+ * face with the heaviest interest traffic (per hh_face) may not go
+ * past its average share; from 1000 on, every face is held to an equal
+ * share of the budget.
+ */
+#define CCND_PIT_SOFT 750
+#define CCND_PIT_MIN_USEC 250000 /**< shortening stops here */
+
+/**
+ * Heavy hitters
+ *
+ * Interests are counted by name prefix, at depths 1 through
+ * CCND_HH_DEPTHS, and by face, in sketches that keep the CCND_TOPK
+ * heaviest of each.  Counts halve every CCND_HH_HALFLIFE seconds.
+ * See ccnd_hh.c.
+ */
+#define CCND_HH_DEPTHS 3
+#define CCND_HH_TOPK 10         /**< default for CCND_TOPK */
+#define CCND_HH_MAXK 64         /**< most CCND_TOPK may ask for */
+#define CCND_HH_WIDTH 1024      /**< sketch cells per row */
+#define CCND_HH_ROWS 4
+#define CCND_HH_HALFLIFE 10     /**< seconds */
+#define CCND_HH_LABEL 96        /**< bytes of name kept with a prefix */
+struct ccnd_hh_item {
+    uint64_t key;
+    uint64_t count;             /**< estimated weight, from above */
+    uint64_t err;               /**< most of count that may be others' */
+    uint64_t aux;               /**< second weight, since tracking began */
+    size_t labelsize;           /**< size of the whole label */
+    unsigned char label[CCND_HH_LABEL]; /**< start of the label */
+};
+
+/**
+ * Content queues with something to send are kept by a single pacer,
+ * in a calendar queue of slots by due time, rather than each having
+ * its own timer.  One wakeup sends from every queue that is due.
+ */
+#define CCND_PACE_SHIFT 7       /**< slot width is 128 usec */
+#define CCND_PACE_SLOTS 256     /**< power of 2, so slots survive clock wrap */
+#define CCND_PACED_IDLE 0       /**< nothing to send */
+#define CCND_PACED_QUEUED 1     /**< waiting in a pacer slot */
+#define CCND_PACED_RUNNING 2    /**< being sent from right now */
+
+/**
+ * Traffic classes
+ *
+ * A registration may put the names under its prefix in a class.  Each
+ * content queue keeps a FIFO per class.  Class 0 is served with strict
+ * priority, and its messages may also go ahead of what is waiting in a
+ * stream face's outq; the other classes share what is left, by weight,
+ * in deficit round robin.  Names under no classed prefix are in
+ * CCND_TC_DEFAULT.
+ */
+#define CCND_TC_N CCN_TRAFFIC_CLASSES
+#define CCND_TC_DEFAULT 2
+#define CCND_TC_QUANTUM 1500    /**< bytes per round, per unit of weight */
+
+/**
+ * Management traffic
+ *
+ * Interests for the namespaces of the internal client (face and prefix
+ * management under ccnx:/ccnx/CCNDID, and the ccnd service under
+ * ccnx:/%C1.M.S.localhost) are picked out as they arrive and set aside
+ * in a queue of their own.  The event loop handles them ahead of the
+ * data: at the top of each turn, and again after each face it takes
+ * input from, up to CCND_MGMT_BUDGET of them a turn.  They go to the
+ * internal client without the random wait, those from local faces are
+ * not held to the interest limits, and the replies are sent as class 0.
+ */
+#define CCND_MGMT_QMAX 64       /**< most management interests set aside */
+#define CCND_MGMT_BUDGET 16     /**< default for CCND_MGMT_BUDGET */
+struct ccnd_mgmtq {
+    unsigned head;              /**< oldest entry */
+    unsigned n;                 /**< entries held */
+    unsigned faceid[CCND_MGMT_QMAX]; /**< where each came from */
+    unsigned stamp[CCND_MGMT_QMAX]; /**< when each was set aside (usec) */
+    struct ccn_charbuf *msg[CCND_MGMT_QMAX];
+};
+
+/**
+ * Face status notices
+ *
+ * Changed faces are collected in chface and written out as one batch
+ * at most every CCND_NOTICE_INTERVAL, in a single segment of the notice
+ * stream.  Each batch has a sequence number, and each face remembers
+ * the batch that last told of it, so that a reader that missed some of
+ * the stream may ask for just what changed since a given batch.  Faces
+ * that have gone away are remembered for that in a ring of
+ * CCND_NOTICE_GONE; asking from before what the ring still holds gets
+ * the whole state instead.
+ */
+#define CCND_NOTICE_INTERVAL 100 /**< default for CCND_NOTICE_INTERVAL (ms) */
+#define CCND_NOTICE_BLOCK 4000  /**< most bytes of records in a batch */
+#define CCND_NOTICE_GONE 1024   /**< destroyed faces remembered */
+struct ccnd_notice_gone {
+    unsigned faceid;
+    unsigned seq;               /**< batch that told of it */
+};
+
+/**
+ * Forwarding entries are kept in a wheel of slots by expiry time, one
+ * slot per CCN_FWU_SECS, so that each run of age_forwarding looks at
+ * just the entries in one slot.  Those that live longer than a turn of
+ * the wheel are looked at once per turn.
+ */
+#define CCND_FIB_WHEEL 256      /**< power of 2, so slots survive tick wrap */
+
+/**
+ * Unicast datagram faces are kept in a wheel of slots by the reap tick
+ * at which they will count as idle.  A face moves ahead at most once
+ * per tick, on its first datagram, so reap looks only at the faces
+ * that have actually gone quiet.
+ */
+#define CCND_IDLE_TICKS 2       /**< reap ticks without traffic, then it goes */
+#define CCND_IDLE_WHEEL 4       /**< power of 2, more than CCND_IDLE_TICKS */
+
+/**
+ * Content freshness expiry is kept in a wheel of one-second slots of
+ * accession numbers, with a single scheduled event that makes a whole
+ * slot stale at once.  The wheel is bigger than the longest lifetime
+ * allowed for FreshnessSeconds, so each slot holds just one second.
+ */
+#define CCND_FRESH_WHEEL 4096   /**< power of 2, more than 2^31 usec */
+
+/**
+ * Largest message accepted from a length-framed local face.
+ * See CCN_SHM_FRAMED.
+ */
+#define CCND_FRAMED_MAX (1 << 20)
+
+/**
+ * Per-slot bookkeeping for faceid allocation.
+ *
+ * Free slots are reused oldest first, and each reuse gets a new
+ * generation, so a stale faceid stays stale for as long as possible.
+ */
+struct ccnd_faceslot {
+    unsigned gen;               /**< generation bits for the slot's next face */
+    unsigned next;              /**< next free slot, if this one is free */
+};
+
 /**
  * We pass this handle almost everywhere within ccnd
  */
@@ -69,45 +466,117 @@ struct ccnd_handle {
     unsigned char ccnd_id[32];      /**< sha256 digest of our public key */
     struct hashtb *faces_by_fd;     /**< keyed by fd */
     struct hashtb *dgram_faces;     /**< keyed by sockaddr */
-    struct hashtb *content_tab;     /**< keyed by portion of ContentObject */
+    struct ccnd_cs_shard *cs;       /**< content store, split by name hash */
+    int cs_n;                       /**< number of content store shards */
     struct hashtb *nameprefix_tab;  /**< keyed by name prefix components */
+    int nameprefix_maxcomps;        /**< bound on components in nameprefix_tab */
     struct hashtb *propagating_tab; /**< keyed by nonce */
-    struct ccn_indexbuf *skiplinks; /**< skiplist for content-ordered ops */
-    unsigned forward_to_gen;        /**< for forward_to updates */
-    unsigned face_gen;              /**< faceid generation number */
-    unsigned face_rover;            /**< for faceid allocation */
+    struct ccnd_nameindex *nameindex; /**< name-ordered content index */
+    struct ccnd_intern *intern;     /**< name prefixes shared by content */
+    struct ccn_memacct mem[CCND_MEM_N]; /**< memory, by subsystem */
+    struct ccnd_faceset fs_scratch; /**< for set operations on face lists */
+    unsigned forward_to_gen;        /**< counts FIB changes, for replanning */
+    unsigned face_free;             /**< oldest free face slot, or MAXFACES */
+    unsigned face_free_tail;        /**< newest free face slot */
     unsigned face_limit;            /**< current number of face slots */
     struct face **faces_by_faceid;  /**< array with face_limit elements */
+    struct ccnd_faceslot *face_slots; /**< array with face_limit elements */
+    unsigned reap_tick;             /**< counts reap runs */
+    struct face *idle_wheel[CCND_IDLE_WHEEL]; /**< dgram faces by idle tick */
     struct ccn_scheduled_event *reaper;
     struct ccn_scheduled_event *age;
     struct ccn_scheduled_event *clean;
+    struct ccn_scheduled_event *compressor;
     struct ccn_scheduled_event *age_forwarding;
+    unsigned fib_tick;              /**< counts age_forwarding runs */
+    struct ccn_forwarding *fib_wheel[CCND_FIB_WHEEL]; /**< by expiry tick */
+    struct ccn_scheduled_event *expire_fresh;
+    long fresh_tick;                /**< last second expired by expire_fresh */
+    unsigned long fresh_n;          /**< accessions waiting in both wheels */
+    struct ccn_indexbuf *fresh_wheel[CCND_FRESH_WHEEL]; /**< by expiry sec */
+    struct ccn_indexbuf *residency_wheel[CCND_FRESH_WHEEL]; /**< by removal sec */
     const char *portstr;            /**< "main" port number */
     unsigned ipv4_faceid;           /**< wildcard IPv4, bound to port */
     unsigned ipv6_faceid;           /**< wildcard IPv6, bound to port */
+    int nshards;                    /**< ccnd processes sharing the port */
+    int shard;                      /**< which of them we are */
+    int shard_components;           /**< leading name components hashed */
+    unsigned shard_faceid;          /**< datagrams handed to us by the others */
+    uintmax_t shard_out;            /**< datagrams handed off to others */
+    uintmax_t shard_in;             /**< datagrams handed to us */
+    int cpu;                        /**< CPU we are pinned to, or -1 */
+    int numa_node;                  /**< NUMA node of that CPU, or -1 */
+    signed char *cpu_node;          /**< NUMA node of each CPU, if pinned */
+    int ncpu_node;                  /**< number of entries in cpu_node */
+    signed char shard_node[CCN_MAX_SHARDS]; /**< NUMA node of each shard */
+    uintmax_t xnode_in;             /**< datagrams received via another node */
+    uintmax_t xnode_out;            /**< handoffs to a shard on another node */
     nfds_t nfds;                    /**< number of entries in fds array */
     struct pollfd *fds;             /**< used for poll system call */
-    struct ccn_gettime ticktock;    /**< our time generator */
-    long sec;                       /**< cached gettime seconds */
-    unsigned usec;                  /**< cached gettime microseconds */
-    long starttime;                 /**< ccnd start time, in seconds */
+    int evfd;                       /**< epoll, kqueue, or io_uring fd, or -1 */
+    struct ccnd_uring_io *uring;    /**< io_uring state, if that is in use */
+    struct ccnd_dgram_io *dgram_io; /**< batched datagram i/o buffers */
+    int compact;                    /**< CCND_PROFILE=compact */
+    struct ccn_charbuf *spare_inbuf; /**< compact: recv buffer not in use */
+    int topk;                       /**< CCND_TOPK, 0 for no sketches */
+    struct ccnd_hh *hh_prefix[CCND_HH_DEPTHS]; /**< interests by prefix */
+    struct ccnd_hh *hh_face;        /**< interests (and misses) by face */
+    struct ccnd_hh *hh_bytes;       /**< content bytes sent, by face */
+    struct ccn_indexbuf *corked;    /**< faces with stream output held */
+    int send_urgent;                /**< what is being sent is class 0 */
+    struct ccn_clock clock;         /**< our monotonic time source */
+    long sec;                       /**< cached clock seconds */
+    unsigned usec;                  /**< cached clock microseconds */
+    long starttime;                 /**< ccnd start (wall clock) seconds */
     unsigned starttime_usec;        /**< ccnd start time fractional part */
     struct ccn_schedule *sched;     /**< our schedule */
-    struct ccn_charbuf *scratch_charbuf; /**< one-slot scratch cache */
-    struct ccn_indexbuf *scratch_indexbuf; /**< one-slot scratch cache */
-    /** Next three fields are used for direct accession-to-content table */
-    ccn_accession_t accession_base;
-    unsigned content_by_accession_window;
-    struct content_entry **content_by_accession;
-    /** The following holds stragglers that would otherwise bloat the above */
-    struct hashtb *sparse_straggler_tab; /* keyed by accession */
-    ccn_accession_t accession;      /**< newest used accession number */
-    ccn_accession_t min_stale;      /**< smallest accession of stale content */
-    ccn_accession_t max_stale;      /**< largest accession of stale content */
+    int idle_slack;                 /**< CCND_IDLE_SLACK (usec), 0 for none */
+    int quiet;                      /**< nonzero while in idle mode */
+    long busy_sec;                  /**< when a message last came or went */
+    struct ccn_arena *scratch;      /**< buffers for per-message temporaries */
+    unsigned content_slot_limit;    /**< current number of content slots */
+    struct content_entry **content_by_slot; /**< content_slot_limit elements */
+    unsigned *content_slot_free;    /**< free slots, as a min-heap */
+    unsigned content_slot_nfree;    /**< number of free slots */
+    ccn_accession_t accession;      /**< counts content accessioned */
+    unsigned min_stale;             /**< smallest slot of stale content */
+    unsigned max_stale;             /**< largest slot of stale content */
     unsigned long capacity;         /**< may toss content if there more than
                                      this many content objects in the store */
+    size_t capacity_bytes;          /**< may toss content if it holds more
+                                     than this many bytes, with overhead */
+    size_t face_outq_cap;           /**< hold back content for a face with
+                                     this many unsent bytes */
+    size_t content_bytes;           /**< bytes of ContentObjects held */
+    size_t content_overhead;        /**< estimated bytes used to hold them */
+    struct ccnd_meter *evictions;   /**< content tossed for capacity */
     unsigned long n_stale;          /**< Number of stale content objects */
+    unsigned long cache_hits;       /**< interests answered from the store */
+    unsigned long cache_misses;     /**< interests the store could not answer */
+    struct ccnd_mrc *mrc;           /**< store reuse distances, or NULL */
     struct ccn_indexbuf *unsol;     /**< unsolicited content */
+    int admit;                      /**< CCND_ADMIT_* policy bits */
+    int admit_percent;              /**< chance that new content is kept */
+    struct ccnd_dnl *admit_seen;    /**< names that have come once */
+    unsigned long content_unsolicited; /**< dropped before the store */
+    unsigned long content_passed;   /**< sent on, but not kept */
+    struct ccnd_quota *quota;       /**< store quotas, by name prefix */
+    struct ccnd_fresh_rule *fresh_rule; /**< CCND_FRESH_RULES_MAX, or NULL */
+    int fresh_rules;                /**< rule slots in use, counting slot 0 */
+    int fresh_rules_active;         /**< rules still set on a name prefix */
+    unsigned compress_age;          /**< seconds unsent before compressing,
+                                     or 0 not to compress content */
+    unsigned compress_cursor;       /**< next slot for compress_deamon */
+    unsigned long compress_mark;    /**< interests_accepted at its last run */
+    struct ccn_charbuf *expanded;   /**< last compressed content expanded */
+    ccn_accession_t expanded_accession; /**< and which it was */
+    unsigned long compressed;       /**< content held compressed */
+    uintmax_t compressed_in;        /**< bytes of it before compression */
+    uintmax_t compressed_out;       /**< bytes of it after compression */
+    uintmax_t compress_tries;       /**< content offered for compression */
+    uintmax_t compress_usec;        /**< cpu time spent compressing */
+    uintmax_t expansions;           /**< compressed content expanded */
+    uintmax_t expand_usec;          /**< cpu time spent expanding */
     unsigned long oldformatcontent;
     unsigned long oldformatcontentgrumble;
     unsigned long oldformatinterests;
@@ -118,6 +587,45 @@ struct ccnd_handle {
     unsigned long interests_dropped;
     unsigned long interests_sent;
     unsigned long interests_stuffed;
+    unsigned long interests_retried; /**< consumer retransmissions retried */
+    unsigned long interests_limited; /**< dropped by rate or PIT share */
+    unsigned long interests_nacked; /**< drops signaled to local clients */
+    unsigned face_irate;            /**< CCND_FACE_INTEREST_RATE (per sec) */
+    unsigned prefix_irate;          /**< CCND_PREFIX_INTEREST_RATE (per sec) */
+    unsigned pit_limit;             /**< CCND_PIT_LIMIT, 0 for none */
+    unsigned pit_pending;           /**< interests pending, all faces */
+    size_t pit_byte_limit;          /**< CCND_PIT_BYTES, 0 for none */
+    unsigned pit_faces;             /**< faces with interests pending */
+    unsigned long interests_shortened; /**< lifetimes cut by PIT pressure */
+    struct ccnd_bucket nack_bucket; /**< limits drop signaling */
+    int local_signing;              /**< local key loaded, for CCN_SP_HMAC */
+    void *pit_free[CCND_PIT_CLASSES]; /**< free blocks, by size class */
+    void *pit_slabs;                /**< slabs for interest messages */
+    size_t pit_slab_bytes;          /**< bytes in pit_slabs */
+    size_t pit_msg_bytes;           /**< bytes of blocks holding messages */
+    struct content_queue *pacer_slot[CCND_PACE_SLOTS]; /**< by due time */
+    struct ccn_scheduled_event *pacer; /**< the one content send timer */
+    unsigned pacer_clock;           /**< time of the last pacer run */
+    unsigned pacer_wake;            /**< when pacer is scheduled to run */
+    unsigned pacer_pass;            /**< counts pacer runs */
+    int pacer_running;              /**< true while pacer is sending */
+    int pacer_n;                    /**< content queues in the pacer */
+    struct hashtb *negcache_tab;    /**< unanswerable interests, keyed by
+                                     name and selectors */
+    unsigned negttl;                /**< CCND_NEGATIVE_TTL (msec) */
+    struct ccn_charbuf *negttl_comps; /**< prefixes with their own ttl */
+    struct ccn_indexbuf *negttl_off; /**< bounds within negttl_comps */
+    struct ccn_indexbuf *negttl_ms; /**< ttl for each prefix (msec) */
+    unsigned long interests_negcached; /**< answered from negcache_tab */
+    struct ccnd_dnl *dnl;           /**< nonces of departed PIT entries */
+    unsigned long interests_looped; /**< dropped by dnl */
+    struct ccnd_disk *disk;         /**< second tier of the store, or NULL */
+    struct ccn_scheduled_event *disk_reader; /**< reads for disk */
+    struct ccnd_prefetch *prefetch; /**< follows sequential readers */
+    struct ccn_charbuf *prefetch_out; /**< interests waiting to go out */
+    struct ccn_scheduled_event *prefetch_sender; /**< sends prefetch_out */
+    const char *snapshot_path;      /**< CCND_SNAPSHOT, or NULL */
+    int snapshot_objects;           /**< most content to snapshot */
     unsigned short seed[3];         /**< for PRNG */
     int running;                    /**< true while should be running */
     int debug;                      /**< For controlling debug output */
@@ -126,13 +634,47 @@ struct ccnd_handle {
     int logbreak;                   /**< see ccn_msg() */
     unsigned long logtime;          /**< see ccn_msg() */
     int logpid;                     /**< see ccn_msg() */
+    unsigned lograte;               /**< per call site per second, or 0 */
+    int logsuppressed;              /**< logsites with suppressed counts */
+    struct ccnd_logsite logsites[CCND_LOGSITES]; /**< see ccnd_msg() */
     int mtu;                        /**< Target size for stuffing interests */
+    int pack_microsec;              /**< Window for packing datagrams */
+    int link_mtu;                   /**< Fragment beyond this on link faces */
+    int link_arq;                   /**< Acknowledge link SequenceNumbers */
+    struct ccnd_hist lat_store;     /**< interests answered from the store */
+    struct ccnd_hist lat_upstream;  /**< interests answered from upstream */
+    struct ccnd_prefix_lat *lat_prefix[CCND_LAT_PREFIXES]; /**< by prefix */
+    int tc_weight[CCND_TC_N];       /**< CCND_CLASS_WEIGHTS, by class */
+    struct ccnd_hist tc_lat[CCND_TC_N]; /**< interest latency, by class */
+    struct ccnd_hist tc_wait[CCND_TC_N]; /**< content queue wait, by class */
+    uintmax_t tc_interests[CCND_TC_N]; /**< interests forwarded, by class */
+    uintmax_t tc_sent[CCND_TC_N];   /**< content sent from queues, by class */
+    uintmax_t tc_bytes[CCND_TC_N];  /**< bytes of that content */
+    uintmax_t tc_jumps;             /**< messages put ahead in an outq */
+    struct ccnd_mgmtq mgmtq;        /**< management interests set aside */
+    int mgmt_budget;                /**< CCND_MGMT_BUDGET, per loop turn */
+    int mgmt_left;                  /**< what is left of it this turn */
+    int mgmt_active;                /**< one is being handled right now */
+    unsigned mgmt_arrival;          /**< when that one arrived (usec) */
+    uintmax_t mgmt_interests;       /**< management interests handled */
+    uintmax_t mgmt_dropped;         /**< turned away, queue full */
+    struct ccnd_hist mgmt_wait;     /**< time spent set aside */
+    struct ccnd_hist mgmt_lat;      /**< arrival to reply */
+    struct ccnd_scrape *scrapes;    /**< metrics responses being built */
+    struct ccnd_status *status[2];  /**< cached HTML and XML status */
+    int trace_on;                   /**< record events in trace */
+    struct ccnd_trace *trace;       /**< binary event trace, or NULL */
+    unsigned trace_nrec;            /**< CCND_TRACE_RECORDS */
+#ifdef CCN_BUF_PROFILE
+    unsigned long long bufprof_msgs; /**< messages since profile reset */
+#endif
     int flood;                      /**< Internal control for auto-reg */
     struct ccn_charbuf *autoreg;    /**< URIs to auto-register */
     int force_zero_freshness;       /**< Simulate freshness=0 on all content */
     unsigned interest_faceid;       /**< for self_reg internal client */
     const char *progname;           /**< our name, for locating helpers */
     struct ccn *internal_client;    /**< internal client */
+    struct ccn_signer *signer;      /**< signs replies and NACKs */
     struct face *face0;             /**< special face for internal client */
     struct ccn_charbuf *service_ccnb; /**< for local service discovery */
     struct ccn_charbuf *neighbor_ccnb; /**< for neighbor service discovery */
@@ -140,6 +682,16 @@ struct ccnd_handle {
     struct ccn_indexbuf *chface;    /**< faceids w/ recent status changes */
     struct ccn_scheduled_event *internal_client_refresh;
     struct ccn_scheduled_event *notice_push;
+    unsigned notice_usec;           /**< CCND_NOTICE_INTERVAL, in usec */
+    unsigned notice_last;           /**< when the last batch went (usec) */
+    unsigned notice_seq;            /**< sequence number of the last batch */
+    unsigned notice_floor;          /**< deltas from before this are lost */
+    struct ccnd_notice_gone *notice_gone; /**< ring of destroyed faces */
+    unsigned notice_ngone;          /**< entries in notice_gone */
+    unsigned notice_gone_head;      /**< oldest entry in notice_gone */
+    uintmax_t notice_batches;       /**< batches of notices */
+    uintmax_t notice_records;       /**< face records in them */
+    uintmax_t notice_unsent;        /**< batches the stream had no room for */
     unsigned data_pause_microsec;   /**< tunable, see choose_face_delay() */
     void (*appnonce)(struct ccnd_handle *, struct face *, struct ccn_charbuf *);
                                     /**< pluggable nonce generation */
@@ -163,8 +715,16 @@ struct content_queue {
     unsigned rand_usec;              /**< randomization range */
     unsigned ready;                  /**< # that have waited enough */
     unsigned nrun;                   /**< # sent since last randomized delay */
-    struct ccn_indexbuf *send_queue; /**< accession numbers of pending content */
-    struct ccn_scheduled_event *sender;
+    struct ccn_indexbuf *send_queue[CCND_TC_N]; /**< accession numbers of
+                                          pending content, by class */
+    struct ccn_indexbuf *stamp[CCND_TC_N]; /**< when each was queued (usec) */
+    int deficit[CCND_TC_N];          /**< bytes each class may send */
+    int turn;                        /**< class (not 0) whose round it is */
+    unsigned faceid;                 /**< face that owns this queue */
+    unsigned due;                    /**< when the pacer should send (usec) */
+    unsigned pass;                   /**< pacer pass that last queued us */
+    int paced;                       /**< CCND_PACED_* */
+    struct content_queue *pnext;     /**< next in the same pacer slot */
 };
 
 enum cq_delay_class {
@@ -187,6 +747,32 @@ enum ccnd_face_meter_index {
     CCND_FACE_METER_N
 };
 
+/**
+ * A message waiting in a stream face's output queue
+ *
+ * ContentObjects are held by reference to their content store entry,
+ * as up to two pieces of its key; anything else is copied.
+ */
+struct ccnd_outseg {
+    ccn_accession_t accession;  /**< content referenced, or 0 */
+    struct ccn_charbuf *copy;   /**< the message, if not by reference */
+    unsigned piece[2][2];       /**< offset and size of referenced pieces */
+    size_t size;                /**< message size in bytes */
+    size_t sent;                /**< bytes of copy already written */
+};
+
+/**
+ * Unsent output for a stream face
+ */
+struct ccnd_outq {
+    struct ccnd_outseg *seg;    /**< the queued messages */
+    int head;                   /**< index of the oldest */
+    int n;                      /**< index past the newest */
+    int jump;                   /**< index past the last class 0 message */
+    int limit;                  /**< allocated size of seg */
+    size_t bytes;               /**< unsent bytes in the queue */
+};
+
 /**
  * One of our active faces
  */
@@ -197,18 +783,35 @@ struct face {
     int surplus;                /**< sends since last successful recv */
     unsigned faceid;            /**< internal face id */
     unsigned recvcount;         /**< for activity level monitoring */
+    unsigned rtick;             /**< reap_tick of the latest receive */
+    struct face *idle_next;     /**< next in the same idle_wheel slot */
+    struct face **idle_link;    /**< the link that points here, if in wheel */
+    unsigned last_source;       /**< faceid of latest peer, for listeners */
     struct content_queue *q[CCN_CQ_N]; /**< outgoing content, per delay class */
     struct ccn_charbuf *inbuf;
     struct ccn_skeleton_decoder decoder;
-    size_t outbufindex;
-    struct ccn_charbuf *outbuf;
+    struct ccnd_outq *outq;     /**< unsent stream output, or NULL */
     const struct sockaddr *addr;
     socklen_t addrlen;
     int pending_interests;
+    size_t pending_bytes;       /**< PIT bytes taken by their messages */
     unsigned rrun;
     uintmax_t rseq;
     struct ccnd_meter *meter[CCND_FACE_METER_N];
     unsigned short pktseq;     /**< sequence number for sent packets */
+    unsigned io_events;        /**< events registered with h->evfd */
+    unsigned io_gen;           /**< tags our io_uring operations */
+    struct ccn_shmring *shm;   /**< rings shared with a local client */
+    unsigned batch_in[2];      /**< uncounted interests, content (framed) */
+    struct ccnd_bucket ibucket; /**< limits incoming interest rate */
+    struct ccnd_shaper shaper; /**< limits outgoing byte rate */
+    struct ccnd_suppress sup;  /**< answer suppression, multicast only */
+    struct ccnd_packer packer; /**< coalesces small outgoing datagrams */
+    struct ccnd_fraglink *frag; /**< fragmentation state, or NULL */
+    int frame_mtu;             /**< payload limit of the link's frames, or 0 */
+    struct ccnd_arq *arq;      /**< link reliability state, or NULL */
+    struct ccnd_hist *lat;     /**< latency of interests from here, or NULL */
+    unsigned notice_seq;       /**< notice batch that last told of this face */
 };
 
 /** face flags */
@@ -232,6 +835,9 @@ struct face {
 #define CCN_FACE_SEQOK (1 << 17) /** OK to send SequenceNumber link messages */
 #define CCN_FACE_SEQPROBE (1 << 18) /** SequenceNumber probe */
 #define CCN_FACE_LC    (1 << 19) /** A link check has been issued recently */
+#define CCN_FACE_ARQ   (1 << 20) /** Peer acks our SequenceNumbers */
+#define CCN_FACE_FRAMED (1 << 21) /** Trusted local, length-framed input */
+#define CCN_FACE_CORKED (1 << 22) /** outq holds this pass's output */
 #define CCN_NOFACEID    (~0U)    /** denotes no face */
 
 /**
@@ -243,33 +849,65 @@ struct face {
  *  which simplifies the matching logic.
  *  The original ContentObject may be reconstructed simply by excising this
  *  last name component, which is easily located via the comps array.
+ *  The complete name is also kept as a flatname, so that the name index
+ *  can order entries by memcmp.  All but the last CCND_NAME_SUFFIX_COMPS
+ *  components of it are interned, and shared with other entries; the rest
+ *  is in the same allocation as the comps array.
  */
 struct content_entry {
-    ccn_accession_t accession;  /**< assigned in arrival order */
+    ccn_accession_t accession;  /**< slot and arrival count */
     unsigned short *comps;      /**< Name Component byte boundary offsets */
     int ncomps;                 /**< Number of name components plus one */
+    unsigned short fresh_rule;  /**< freshness rule charged, or 0 */
+    struct ccnd_name_prefix *prefix; /**< leading part of flatname, or NULL */
+    const unsigned char *suffix; /**< rest of flatname (after comps) */
+    int suffix_size;            /**< Size of suffix */
     int flags;                  /**< see below */
     const unsigned char *key;   /**< ccnb-encoded ContentObject */
     int key_size;               /**< Size of fragment prior to Content */
     int size;                   /**< Size of ContentObject */
-    struct ccn_indexbuf *skiplinks; /**< skiplist for name-ordered ops */
+    int zsize;                  /**< Size of the rest, once compressed */
+    unsigned used;              /**< h->sec when last queued to send */
+    struct ccnd_nameindex_node *nameindex_leaf; /**< for name-ordered ops */
+    struct ccnd_cache_list *cache_list; /**< replacement policy queue */
+    struct content_entry *cache_prev; /**< older neighbor on cache_list */
+    struct content_entry *cache_next; /**< newer neighbor on cache_list */
+    unsigned cache_freq;        /**< use count, for the replacement policy
+                                     (or the snapshot, without one) */
+    unsigned short shard;       /**< content store shard */
+    unsigned short quota;       /**< store quota charged, or 0 */
 };
 
 /**
- * content_entry flags
+ * Number of trailing flatname components that a content entry keeps
+ * for itself, rather than in its interned prefix (the segment and the
+ * digest, for segmented content).
  */
-#define CCN_CONTENT_ENTRY_SLOWSEND  1
-#define CCN_CONTENT_ENTRY_STALE     2
-#define CCN_CONTENT_ENTRY_PRECIOUS  4
+#define CCND_NAME_SUFFIX_COMPS 2
 
 /**
- * The sparse_straggler hash table, keyed by accession, holds scattered
- * entries that would otherwise bloat the direct content_by_accession table.
+ * An interned name prefix, as a flatname.
+ *
+ * These live in a hash table, so the flatname does not move.
  */
-struct sparse_straggler_entry {
-    struct content_entry *content;
+struct ccnd_name_prefix {
+    const unsigned char *flatname; /**< the prefix (the hash table key) */
+    size_t size;                /**< size of flatname */
+    unsigned id;                /**< nonzero, stable while referenced */
+    unsigned refs;              /**< number of references */
 };
 
+/**
+ * content_entry flags
+ */
+#define CCN_CONTENT_ENTRY_SLOWSEND  1
+#define CCN_CONTENT_ENTRY_STALE     2
+#define CCN_CONTENT_ENTRY_PRECIOUS  4
+#define CCN_CONTENT_ENTRY_EXPIRES   8
+#define CCN_CONTENT_ENTRY_PREFETCHED 16 /**< not yet sent to a consumer */
+#define CCN_CONTENT_ENTRY_COMPRESSED 32 /**< Content onward is compressed */
+#define CCN_CONTENT_ENTRY_INCOMPRESSIBLE 64 /**< not worth compressing */
+
 /**
  * The propagating interest hash table is keyed by Nonce.
  *
@@ -292,6 +930,10 @@ struct propagating_entry {
     unsigned char *interest_msg; /**< pending interest message */
     unsigned size;              /**< size in bytes of interest_msg */
     int fgen;                   /**< decide if outbound is stale */
+    unsigned sface;             /**< faceid of most recent send */
+    unsigned stime;             /**< time of most recent send (usec, wraps) */
+    unsigned atime;             /**< time of arrival (usec, wraps) */
+    struct ccn_compiled_exclude *excl; /**< compiled Exclude, if any */
 };
 // XXX - with new outbound/sent repr, some of these flags may not be needed.
 #define CCN_PR_UNSENT   0x01 /**< interest has not been sent anywhere yet */
@@ -302,6 +944,148 @@ struct propagating_entry {
 #define CCN_PR_SCOPE0   0x20 /**< interest scope is 0 */
 #define CCN_PR_SCOPE1   0x40 /**< interest scope is 1 (this host) */
 #define CCN_PR_SCOPE2   0x80 /**< interest scope is 2 (immediate neighborhood) */
+#define CCN_PR_EXACT    0x100 /**< no selectors, so any content under the name matches */
+#define CCN_PR_URGENT   0x200 /**< name is in traffic class 0 */
+#define CCN_PR_MGMT     0x400 /**< management interest, see CCND_MGMT_QMAX */
+#define CCN_PR_RETRY    0x800 /**< consumer retransmission, faces by cost */
+
+/**
+ * Least time a retried interest gives each face to answer (usec)
+ */
+#define CCND_RETRY_MIN_USEC 1000
+
+/**
+ * The negative cache remembers, for a short time, interests that
+ * could not be answered, so that retransmissions are not forwarded
+ * again.  It is keyed by the Name and the selectors that affect
+ * matching, so the Nonce and lifetime do not matter.
+ */
+struct negcache_entry {
+    unsigned expiry;            /**< ccnd_usec_now() when this goes away */
+};
+#define CCND_NEGCACHE_MAX 65536 /**< entries, at most */
+#define CCND_NEGATIVE_TTL_MAX 600000 /**< msec, well short of clock wrap */
+
+/**
+ * Nonces of interests whose PIT entries have gone are kept in the dead
+ * nonce list for one to two of these periods, so that interests that
+ * loop back late are still recognized.
+ */
+#define CCND_DEAD_NONCE_SECONDS 8   /**< default, a couple of lifetimes */
+#define CCND_DEAD_NONCE_MAX 3600
+
+/**
+ * Default size of the file named by CCND_DISK_CACHE, which holds
+ * content evicted from memory.
+ */
+#define CCND_DISK_CACHE_BYTES ((uintmax_t)1 << 30)
+
+/**
+ * Default for the most content objects kept in a CCND_SNAPSHOT.
+ */
+#define CCND_SNAPSHOT_OBJECTS 1000
+
+/**
+ * Idle mode, with CCND_IDLE_SLACK set.  Once no interests are pending
+ * and no message has come or gone for CCND_QUIET_SECS, timers are
+ * allowed the slack, and the periodic housekeeping runs
+ * CCND_IDLE_STRETCH times less often.
+ */
+#define CCND_QUIET_SECS 2
+#define CCND_IDLE_STRETCH 4
+
+/**
+ * The compact profile (CCND_PROFILE=compact), for small devices.
+ * These are the defaults for the limits that are not set explicitly.
+ * The tables start small and shrink again when they empty, and a face
+ * holds an input buffer only while it has part of a message in it;
+ * otherwise the one spare buffer is passed around, unless it has
+ * grown past CCND_COMPACT_INBUF_MAX.
+ */
+#define CCND_COMPACT_CAP 2000
+#define CCND_COMPACT_CAP_BYTES ((size_t)4 << 20)
+#define CCND_COMPACT_OUTQ_BYTES ((size_t)64 << 10)
+#define CCND_COMPACT_PIT_BYTES ((size_t)1 << 20)
+#define CCND_COMPACT_FACE_SLOTS 64
+#define CCND_COMPACT_CONTENT_SLOTS 256
+#define CCND_COMPACT_INBUF_MAX 16384
+#define CCND_COMPACT_HH_WIDTH 256
+
+/**
+ * Compression of content that has not been sent for CCND_COMPRESS_AGE
+ * seconds.  Each run of the compressor looks at this many slots, or
+ * the larger number if no interests have come since the last run.
+ * Only the part from the Content element onward is compressed, and
+ * only if it is at least CCND_COMPRESS_MIN bytes and shrinks by at
+ * least an eighth.
+ */
+#define CCND_COMPRESS_PERIOD 100000
+#define CCND_COMPRESS_SLOTS 32
+#define CCND_COMPRESS_IDLE_SLOTS 1024
+#define CCND_COMPRESS_MIN 128
+
+/**
+ * Store admission policies, from CCND_ADMIT.
+ *
+ * These apply to content that arrives from other nodes; what local
+ * applications put is always kept.
+ */
+#define CCND_ADMIT_SOLICITED 1  /**< drop content nothing asked for */
+#define CCND_ADMIT_SECOND    2  /**< keep content the second time it comes */
+#define CCND_ADMIT_WINDOW   60  /**< seconds to remember the first time */
+
+/**
+ * Limits for CCND_PREFETCH, the segments fetched ahead of a
+ * sequential reader, and for the readers followed on each face.
+ */
+#define CCND_PREFETCH_MAX 64
+#define CCND_PREFETCH_STREAMS 4
+
+/**
+ * A shard of the content store.
+ *
+ * Content goes to a shard by a hash of its name.  Each shard holds its
+ * share of the capacity, and has its own replacement policy queues and
+ * accounting, so eviction deals with one shard at a time.
+ */
+struct ccnd_cs_shard {
+    struct hashtb *content_tab;     /**< keyed by portion of ContentObject */
+    struct ccnd_cache *cache;       /**< replacement policy, NULL for default */
+    unsigned long capacity;         /**< share of the object limit */
+    size_t capacity_bytes;          /**< share of the byte limit */
+    size_t bytes;                   /**< bytes held, with overhead */
+    uintmax_t inserted;             /**< content added */
+    uintmax_t evicted;              /**< content tossed for capacity */
+};
+#define CCND_CS_SHARDS_MAX 64
+
+/**
+ * Most store quotas (set by prefix registrations) in force at once.
+ */
+#define CCND_QUOTA_MAX 256
+
+/**
+ * Most freshness rules (set by prefix registrations) in force at once.
+ */
+#define CCND_FRESH_RULES_MAX 256
+
+/**
+ * A freshness rule gives the content under a name prefix its own
+ * default freshness and longest stay in the store, in place of the
+ * global ones.  Rules are numbered from 1, so that a content entry
+ * can note the rule it was charged to; a slot is reused only once the
+ * rule has been lifted and the last of its content has gone.
+ */
+struct ccnd_fresh_rule {
+    struct ccn_charbuf *name;   /**< ccnb Name of the prefix */
+    struct nameprefix_entry *npe; /**< where it is set, or NULL if lifted */
+    int freshness;              /**< seconds if no FreshnessSeconds, or 0 */
+    int residency;              /**< most seconds in the store, or 0 */
+    unsigned long objects;      /**< content held under the rule */
+    uintmax_t bytes;            /**< and its size */
+    uintmax_t staled;           /**< content that went stale */
+    uintmax_t removed;          /**< content removed for its residency */
+};
 
 /**
  * The nameprefix hash table is keyed by the Component elements of
@@ -309,16 +1093,26 @@ struct propagating_entry {
  */
 struct nameprefix_entry {
     struct propagating_entry pe_head; /**< list head for propagating entries */
-    struct ccn_indexbuf *forward_to; /**< faceids to forward to */
-    struct ccn_indexbuf *tap;    /**< faceids to forward to as tap*/
+    struct ccn_indexbuf *forward_to; /**< faceids to forward to, if registered */
+    struct ccnd_faceset *tap;    /**< faces to forward to as tap, or NULL */
     struct ccn_forwarding *forwarding; /**< detailed forwarding info */
     struct nameprefix_entry *parent; /**< link to next-shorter prefix */
+    struct nameprefix_entry *fib;   /**< longest registered prefix, or root */
+    struct nameprefix_entry *child; /**< first of the next-longer prefixes */
+    struct nameprefix_entry *sibling; /**< next child of the same parent */
+    struct nameprefix_entry *psibling; /**< previous one, or NULL if first */
     int children;                /**< number of children */
     unsigned flags;              /**< CCN_FORW_* flags about namespace */
-    int fgen;                    /**< used to decide when forward_to is stale */
     unsigned src;                /**< faceid of recent content source */
     unsigned osrc;               /**< and of older matching content */
     unsigned usec;               /**< response-time prediction */
+    struct ccnd_bucket ibucket;  /**< limits interest rate, if registered */
+    struct ccnd_prefix_lat *lat; /**< latency histogram slot, or NULL */
+    unsigned lat_hits;           /**< samples seen while without a slot */
+    unsigned long cs_hits;       /**< store lookups answered, if registered */
+    unsigned long cs_misses;     /**< store lookups not answered */
+    unsigned char tclass;        /**< traffic class plus 1, or 0 to inherit */
+    unsigned short fresh_rule;   /**< freshness rule, or 0 to inherit */
 };
 
 /**
@@ -328,8 +1122,14 @@ struct nameprefix_entry {
 struct ccn_forwarding {
     unsigned faceid;             /**< locally unique number identifying face */
     unsigned flags;              /**< CCN_FORW_* - c.f. <ccn/reg_mgnt.h> */
-    int expires;                 /**< time remaining, in seconds */
+    unsigned etick;              /**< fib_tick at which this expires */
+    unsigned srtt;               /**< smoothed response time (usec), 0 if none */
+    unsigned loss;               /**< smoothed unanswered fraction, of 65536 */
+    int outstanding;             /**< interests sent, not yet finished */
     struct ccn_forwarding *next;
+    struct nameprefix_entry *npe; /**< the prefix this is registered for */
+    struct ccn_forwarding *wnext; /**< next in the same fib_wheel slot */
+    struct ccn_forwarding **wlink; /**< the link that points here */
 };
 
 /* create and destroy procs for separately allocated meters */
@@ -345,6 +1145,21 @@ void ccnd_meter_bump(struct ccnd_handle *h, struct ccnd_meter *m, unsigned amt);
 unsigned ccnd_meter_rate(struct ccnd_handle *h, struct ccnd_meter *m);
 uintmax_t ccnd_meter_total(struct ccnd_meter *m);
 
+/* latency histograms */
+void ccnd_hist_record(struct ccnd_hist *hist, unsigned usec);
+unsigned ccnd_hist_bucket_low(int i);
+unsigned ccnd_hist_percentile(const struct ccnd_hist *hist, unsigned pct);
+unsigned ccnd_hist_count_below(const struct ccnd_hist *hist, unsigned value);
+
+/* binary event trace - see ccnd_trace.h */
+int ccnd_trace_open(struct ccnd_handle *h, const char *path, unsigned nrec);
+void ccnd_trace_close(struct ccnd_handle *h);
+const char *ccnd_trace_enable(struct ccnd_handle *h, int on);
+void ccnd_trace_event(struct ccnd_handle *h, int event, unsigned faceid,
+                      const unsigned char *name, size_t namelen,
+                      size_t prefixlen, int ncomps, unsigned size,
+                      unsigned aux);
+
 
 /**
  * Refer to doc/technical/Registration.txt for the meaning of these flags.
@@ -357,6 +1172,9 @@ uintmax_t ccnd_meter_total(struct ccnd_meter *m);
  * @def CCN_FORW_LOCAL         32
  * @def CCN_FORW_TAP           64
  * @def CCN_FORW_CAPTURE_OK   128
+ * @def CCN_FORW_BALANCE      256
+ * @def CCN_FORW_BEST         512
+ * @def CCN_FORW_NOCACHE     1024
  */
 #define CCN_FORW_PFXO (CCN_FORW_ADVERTISE | CCN_FORW_CAPTURE | CCN_FORW_LOCAL)
 #define CCN_FORW_REFRESHED      (1 << 16) /**< private to ccnd */
@@ -408,6 +1226,14 @@ int ccnd_req_selfreg(struct ccnd_handle *h,
                      const unsigned char *msg, size_t size,
                      struct ccn_charbuf *reply_body);
 
+/*
+ * The internal client calls this with the argument portion ARG of
+ * a batch prefix-registration request (/ccnx/CCNDID/prefixregs/ARG)
+ */
+int ccnd_req_prefixregs(struct ccnd_handle *h,
+                        const unsigned char *msg, size_t size,
+                        struct ccn_charbuf *reply_body);
+
 /**
  * URIs for prefixes served by the internal client
  */
@@ -422,6 +1248,8 @@ int ccnd_req_unreg(struct ccnd_handle *h,
                    const unsigned char *msg, size_t size,
                    struct ccn_charbuf *reply_body);
 
+int ccnd_forwarding_expires(struct ccnd_handle *h, struct ccn_forwarding *f);
+
 int ccnd_reg_uri(struct ccnd_handle *h,
                  const char *uri,
                  unsigned faceid,
@@ -429,14 +1257,126 @@ int ccnd_reg_uri(struct ccnd_handle *h,
                  int expires);
 
 struct face *ccnd_face_from_faceid(struct ccnd_handle *, unsigned);
+unsigned long ccnd_content_count(struct ccnd_handle *);
+unsigned ccnd_pit_usage(struct ccnd_handle *);
+int ccnd_idle_period(struct ccnd_handle *, int);
+void ccnd_mem_census(struct ccnd_handle *);
+void ccnd_face_io_update(struct ccnd_handle *, struct face *);
+struct face *ccnd_face_from_fd(struct ccnd_handle *, int fd);
+void ccnd_input_message(struct ccnd_handle *h, struct face *face,
+                        unsigned char *msg, size_t size);
 void ccnd_face_status_change(struct ccnd_handle *, unsigned);
 int ccnd_destroy_face(struct ccnd_handle *h, unsigned faceid);
 void ccnd_send(struct ccnd_handle *h, struct face *face,
                const void *data, size_t size);
 
 /* Consider a separate header for these */
+struct ccnd_nameindex *ccnd_nameindex_create(struct ccn_memacct *);
+void ccnd_nameindex_destroy(struct ccnd_nameindex **);
+size_t ccnd_nameindex_count(struct ccnd_nameindex *);
+int ccnd_nameindex_insert(struct ccnd_nameindex *, struct content_entry *);
+void ccnd_nameindex_remove(struct ccnd_nameindex *, struct content_entry *);
+struct content_entry *ccnd_nameindex_lookup(struct ccnd_nameindex *,
+                                            const unsigned char *, size_t);
+struct content_entry *ccnd_nameindex_lookup_flatname(struct ccnd_nameindex *,
+                                                     const unsigned char *,
+                                                     size_t);
+struct content_entry *ccnd_nameindex_next(struct ccnd_nameindex *,
+                                          struct content_entry *);
+int ccnd_nameindex_check(struct ccnd_nameindex *);
+
+struct ccnd_intern *ccnd_intern_create(void);
+void ccnd_intern_destroy(struct ccnd_intern **);
+size_t ccnd_intern_split(const unsigned char *, size_t, int);
+struct ccnd_name_prefix *ccnd_intern_prefix(struct ccnd_intern *,
+                                            const unsigned char *, size_t);
+void ccnd_intern_release(struct ccnd_intern *, struct ccnd_name_prefix *);
+unsigned long ccnd_intern_counts(struct ccnd_intern *, size_t *, size_t *);
+
+struct ccnd_faceset *ccnd_faceset_create(void);
+void ccnd_faceset_destroy(struct ccnd_faceset **);
+void ccnd_faceset_reset(struct ccnd_faceset *);
+int ccnd_faceset_add(struct ccnd_faceset *, unsigned faceid);
+int ccnd_faceset_remove(struct ccnd_faceset *, unsigned faceid);
+int ccnd_faceset_member(const struct ccnd_faceset *, unsigned faceid);
+int ccnd_faceset_next(const struct ccnd_faceset *, unsigned slot);
+void ccnd_faceset_clear(struct ccnd_faceset *);
+int ccnd_faceset_copy(struct ccnd_faceset *, const struct ccnd_faceset *);
+
+struct ccnd_hh *ccnd_hh_create(unsigned, unsigned);
+void ccnd_hh_destroy(struct ccnd_hh **);
+void ccnd_hh_count(struct ccnd_hh *, long, uint64_t, unsigned, unsigned,
+                   const unsigned char *, size_t);
+int ccnd_hh_top(struct ccnd_hh *, long, struct ccnd_hh_item *, int);
+uint64_t ccnd_hh_heaviest(struct ccnd_hh *, uint64_t *);
+
+size_t ccnd_lz_compress(const unsigned char *, size_t, unsigned char *, size_t);
+ssize_t ccnd_lz_expand(const unsigned char *, size_t, unsigned char *, size_t);
+
+struct ccnd_cache *ccnd_cache_create(const char *, unsigned long);
+void ccnd_cache_destroy(struct ccnd_cache **);
+const char *ccnd_cache_policy_name(struct ccnd_cache *);
+void ccnd_cache_enroll(struct ccnd_cache *, struct content_entry *);
+void ccnd_cache_touch(struct ccnd_cache *, struct content_entry *);
+void ccnd_cache_withdraw(struct ccnd_cache *, struct content_entry *);
+struct content_entry *ccnd_cache_victim(struct ccnd_cache *);
+
+struct ccnd_mrc *ccnd_mrc_create(unsigned);
+void ccnd_mrc_destroy(struct ccnd_mrc **);
+void ccnd_mrc_reference(struct ccnd_mrc *, const unsigned char *, size_t);
+unsigned ccnd_mrc_hit_ppm(struct ccnd_mrc *, uintmax_t);
+uintmax_t ccnd_mrc_lookups(struct ccnd_mrc *, unsigned *, unsigned *);
+
+struct ccnd_dnl *ccnd_dnl_create(unsigned, long, uint64_t);
+void ccnd_dnl_destroy(struct ccnd_dnl **);
+void ccnd_dnl_insert(struct ccnd_dnl *, long, const unsigned char *, size_t);
+int ccnd_dnl_match(struct ccnd_dnl *, long, const unsigned char *, size_t);
+uintmax_t ccnd_dnl_counts(struct ccnd_dnl *, unsigned long *, uintmax_t *);
+
+struct ccnd_disk *ccnd_disk_create(const char *, uintmax_t);
+void ccnd_disk_destroy(struct ccnd_disk **);
+int ccnd_disk_put(struct ccnd_disk *, const unsigned char *, size_t,
+                  const unsigned char *, size_t,
+                  const unsigned char *, size_t);
+int ccnd_disk_want(struct ccnd_disk *, const unsigned char *, size_t);
+int ccnd_disk_next(struct ccnd_disk *, unsigned char **, size_t *);
+unsigned long ccnd_disk_counts(struct ccnd_disk *, uintmax_t *, uintmax_t *,
+                               uintmax_t *, uintmax_t *);
+unsigned long ccnd_disk_recovered(struct ccnd_disk *);
+
+struct ccnd_prefetch *ccnd_prefetch_create(unsigned, unsigned);
+void ccnd_prefetch_destroy(struct ccnd_prefetch **);
+int ccnd_prefetch_note(struct ccnd_prefetch *, unsigned, long,
+                       const unsigned char *, size_t, uintmax_t, uintmax_t *);
+void ccnd_prefetch_expect(struct ccnd_prefetch *, long,
+                          const unsigned char *, size_t);
+int ccnd_prefetch_landed(struct ccnd_prefetch *, const unsigned char *, size_t);
+void ccnd_prefetch_outcome(struct ccnd_prefetch *, int);
+uintmax_t ccnd_prefetch_counts(struct ccnd_prefetch *, uintmax_t *,
+                               uintmax_t *, uintmax_t *);
+
+struct ccnd_quota *ccnd_quota_create(void);
+void ccnd_quota_destroy(struct ccnd_quota **);
+int ccnd_quota_set(struct ccnd_quota *, const unsigned char *, size_t,
+                   uintmax_t);
+int ccnd_quota_match(struct ccnd_quota *, const unsigned char *,
+                     const unsigned short *, int);
+int ccnd_quota_charge(struct ccnd_quota *, int, ccn_accession_t, size_t);
+void ccnd_quota_uncharge(struct ccnd_quota *, int, size_t);
+int ccnd_quota_over(struct ccnd_quota *, int);
+size_t ccnd_quota_queued(struct ccnd_quota *, int);
+ccn_accession_t ccnd_quota_oldest(struct ccnd_quota *, int);
+void ccnd_quota_requeue(struct ccnd_quota *, int, ccn_accession_t);
+void ccnd_quota_evicted(struct ccnd_quota *, int);
+int ccnd_quota_slots(struct ccnd_quota *);
+int ccnd_quota_get(struct ccnd_quota *, int, const unsigned char **, size_t *,
+                   uintmax_t *, uintmax_t *, unsigned long *, uintmax_t *);
+
 int ccnd_stats_handle_http_connection(struct ccnd_handle *, struct face *);
+void ccnd_status_invalidate(struct ccnd_handle *);
+void ccnd_status_destroy(struct ccnd_handle *);
 void ccnd_msg(struct ccnd_handle *, const char *, ...);
+void ccnd_msg_flush(struct ccnd_handle *);
 void ccnd_debug_ccnb(struct ccnd_handle *h,
                      int lineno,
                      const char *msg,
@@ -0,0 +1,355 @@
+/**
+ * @file ccnd_quota.c
+ *
+ * Bounds on how much of the content store a namespace may occupy.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * A quota names a prefix and a number of bytes.  New content is
+ * charged to the quota with the longest matching prefix, if any, and
+ * when the content charged to a quota comes to more than its bytes,
+ * the oldest of it goes first.
+ *
+ * Each quota keeps the accessions it was charged in arrival order.
+ * Content that leaves the store by other means stays in this queue
+ * until the caller, told that the queue has grown slack, passes over
+ * it once and puts back only what is still there.
+ *
+ * Quotas are numbered from 1, so a content entry can hold the number
+ * of the quota it was charged to, with 0 for none.  A quota that is
+ * lifted keeps its number until the last of its content is gone.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+
+#include "ccnd_private.h"
+
+struct quota_entry {
+    struct ccn_charbuf *name;   /**< ccnb Name of the prefix, NULL if free */
+    size_t start;               /**< first Component, within name */
+    size_t end;                 /**< end of the last Component */
+    int ncomps;                 /**< number of Components */
+    uintmax_t limit;            /**< bytes allowed, or 0 if lifted */
+    uintmax_t bytes;            /**< bytes charged */
+    unsigned long objects;      /**< objects charged */
+    uintmax_t evicted;          /**< objects tossed to stay within limit */
+    struct ccn_indexbuf *fifo;  /**< accessions charged, oldest at head */
+    size_t head;
+};
+
+struct ccnd_quota {
+    int n;                      /**< slots used, counting the unused slot 0 */
+    int active;                 /**< number with a limit */
+    struct quota_entry q[CCND_QUOTA_MAX];
+};
+
+struct ccnd_quota *
+ccnd_quota_create(void)
+{
+    struct ccnd_quota *q;
+
+    q = calloc(1, sizeof(*q));
+    if (q == NULL)
+        return(NULL);
+    q->n = 1;
+    return(q);
+}
+
+static void
+quota_entry_clear(struct quota_entry *e)
+{
+    ccn_charbuf_destroy(&e->name);
+    ccn_indexbuf_destroy(&e->fifo);
+    memset(e, 0, sizeof(*e));
+}
+
+void
+ccnd_quota_destroy(struct ccnd_quota **pq)
+{
+    struct ccnd_quota *q = *pq;
+    int i;
+
+    if (q == NULL)
+        return;
+    for (i = 1; i < q->n; i++)
+        quota_entry_clear(&q->q[i]);
+    free(q);
+    *pq = NULL;
+}
+
+static struct quota_entry *
+quota_entry(struct ccnd_quota *q, int slot)
+{
+    if (slot < 1 || slot >= q->n || q->q[slot].name == NULL)
+        return(NULL);
+    return(&q->q[slot]);
+}
+
+/**
+ * Set the quota for a prefix.
+ * @param name - the prefix, as a ccnb-encoded Name
+ * @param limit - bytes allowed, or 0 to lift the quota
+ * @returns the quota number, 0 if a lifted quota was not there,
+ *          or -1 for a bad name or a full table.
+ */
+int
+ccnd_quota_set(struct ccnd_quota *q, const unsigned char *name, size_t size,
+               uintmax_t limit)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    struct ccn_indexbuf *comps;
+    struct quota_entry *e;
+    size_t start;
+    size_t end;
+    int ncomps;
+    int free_slot = 0;
+    int i;
+
+    comps = ccn_indexbuf_create();
+    if (comps == NULL)
+        return(-1);
+    d = ccn_buf_decoder_start(&decoder, name, size);
+    ncomps = ccn_parse_Name(d, comps);
+    if (ncomps < 0) {
+        ccn_indexbuf_destroy(&comps);
+        return(-1);
+    }
+    start = comps->buf[0];
+    end = comps->buf[ncomps];
+    ccn_indexbuf_destroy(&comps);
+    for (i = 1; i < q->n; i++) {
+        e = &q->q[i];
+        if (e->name == NULL || (e->limit == 0 && e->objects == 0)) {
+            if (free_slot == 0)
+                free_slot = i;
+            continue;
+        }
+        if (e->ncomps == ncomps && e->end - e->start == end - start &&
+            memcmp(e->name->buf + e->start, name + start, end - start) == 0) {
+            if (e->limit == 0 && limit != 0)
+                q->active++;
+            else if (e->limit != 0 && limit == 0)
+                q->active--;
+            e->limit = limit;
+            return(i);
+        }
+    }
+    if (limit == 0)
+        return(0);
+    if (free_slot == 0) {
+        if (q->n == CCND_QUOTA_MAX)
+            return(-1);
+        free_slot = q->n++;
+    }
+    e = &q->q[free_slot];
+    quota_entry_clear(e);
+    e->name = ccn_charbuf_create();
+    e->fifo = ccn_indexbuf_create();
+    if (e->name == NULL || e->fifo == NULL ||
+        ccn_charbuf_append(e->name, name, size) < 0) {
+        quota_entry_clear(e);
+        return(-1);
+    }
+    e->start = start;
+    e->end = end;
+    e->ncomps = ncomps;
+    e->limit = limit;
+    q->active++;
+    return(free_slot);
+}
+
+/**
+ * Find the quota that new content falls under.
+ * @param key - the content's ccnb
+ * @param comps - offsets of its name components, as in a content_entry
+ * @param ncomps - the number of offsets
+ * @returns the quota number, or 0 for none.
+ */
+int
+ccnd_quota_match(struct ccnd_quota *q, const unsigned char *key,
+                 const unsigned short *comps, int ncomps)
+{
+    struct quota_entry *e;
+    size_t len;
+    int best = 0;
+    int bestk = -1;
+    int i;
+
+    if (q == NULL || q->active == 0)
+        return(0);
+    for (i = 1; i < q->n; i++) {
+        e = &q->q[i];
+        if (e->limit == 0 || e->ncomps >= ncomps || e->ncomps <= bestk)
+            continue;
+        len = comps[e->ncomps] - comps[0];
+        if (len == e->end - e->start &&
+            memcmp(key + comps[0], e->name->buf + e->start, len) == 0) {
+            best = i;
+            bestk = e->ncomps;
+        }
+    }
+    return(best);
+}
+
+/**
+ * Charge new content to a quota.
+ * @returns 1 if the queue of accessions has grown slack enough to be
+ *          worth passing over, else 0.
+ */
+int
+ccnd_quota_charge(struct ccnd_quota *q, int slot, ccn_accession_t a,
+                  size_t bytes)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    if (e == NULL)
+        return(0);
+    e->bytes += bytes;
+    e->objects++;
+    ccn_indexbuf_append_element(e->fifo, a);
+    return(e->fifo->n - e->head > 2 * e->objects + 64);
+}
+
+/**
+ * Give back the charge for content leaving the store.
+ */
+void
+ccnd_quota_uncharge(struct ccnd_quota *q, int slot, size_t bytes)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    if (e == NULL)
+        return;
+    e->bytes -= bytes;
+    e->objects--;
+    if (e->limit == 0 && e->objects == 0)
+        quota_entry_clear(e);
+}
+
+/**
+ * @returns 1 if the content charged to a quota is over its limit.
+ */
+int
+ccnd_quota_over(struct ccnd_quota *q, int slot)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    return(e != NULL && e->limit != 0 && e->bytes > e->limit);
+}
+
+size_t
+ccnd_quota_queued(struct ccnd_quota *q, int slot)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    return(e == NULL ? 0 : e->fifo->n - e->head);
+}
+
+/**
+ * Take the oldest accession off the queue of a quota.
+ *
+ * It may belong to content that has already left the store.
+ * @returns the accession, or 0 if the queue is empty.
+ */
+ccn_accession_t
+ccnd_quota_oldest(struct ccnd_quota *q, int slot)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+    struct ccn_indexbuf *f;
+    ccn_accession_t a;
+
+    if (e == NULL || e->head >= e->fifo->n)
+        return(0);
+    f = e->fifo;
+    a = f->buf[e->head++];
+    if (e->head == f->n)
+        e->head = f->n = 0;
+    else if (e->head >= 1024 && e->head >= f->n / 2) {
+        memmove(f->buf, f->buf + e->head, (f->n - e->head) * sizeof(f->buf[0]));
+        f->n -= e->head;
+        e->head = 0;
+    }
+    return(a);
+}
+
+/**
+ * Put an accession taken by ccnd_quota_oldest() back, as the newest.
+ */
+void
+ccnd_quota_requeue(struct ccnd_quota *q, int slot, ccn_accession_t a)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    if (e != NULL)
+        ccn_indexbuf_append_element(e->fifo, a);
+}
+
+void
+ccnd_quota_evicted(struct ccnd_quota *q, int slot)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    if (e != NULL)
+        e->evicted++;
+}
+
+/**
+ * @returns a bound on the quota numbers in use, for iterating.
+ */
+int
+ccnd_quota_slots(struct ccnd_quota *q)
+{
+    return(q == NULL ? 0 : q->n);
+}
+
+/**
+ * Get the state of a quota.
+ * @returns 0, or -1 if there is no such quota.
+ */
+int
+ccnd_quota_get(struct ccnd_quota *q, int slot,
+               const unsigned char **name, size_t *size,
+               uintmax_t *limit, uintmax_t *bytes,
+               unsigned long *objects, uintmax_t *evicted)
+{
+    struct quota_entry *e = quota_entry(q, slot);
+
+    if (e == NULL)
+        return(-1);
+    if (name != NULL)
+        *name = e->name->buf;
+    if (size != NULL)
+        *size = e->name->length;
+    if (limit != NULL)
+        *limit = e->limit;
+    if (bytes != NULL)
+        *bytes = e->bytes;
+    if (objects != NULL)
+        *objects = e->objects;
+    if (evicted != NULL)
+        *evicted = e->evicted;
+    return(0);
+}
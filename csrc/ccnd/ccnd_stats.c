@@ -46,6 +46,9 @@
 #define CRLF "\r\n"
 #define NL   "\n"
 
+/** Estimated hash table overhead per PIT entry, beyond data and key */
+#define CCND_PIT_OVERHEAD (6 * sizeof(void *))
+
 /**
  * Provide a way to monitor rates.
  */
@@ -59,15 +62,96 @@ struct ccnd_meter {
 struct ccnd_stats {
     long total_interest_counts;
     long total_flood_control;      /* done propagating, still recorded */
+    long pit_entries;              /* entries in propagating_tab */
+    size_t pit_bytes;              /* estimated PIT memory use */
 };
 
+struct ccnd_status;
+
 static int ccnd_collect_stats(struct ccnd_handle *h, struct ccnd_stats *ans);
-static struct ccn_charbuf *collect_stats_html(struct ccnd_handle *h);
 static void send_http_response(struct ccnd_handle *h, struct face *face,
                                const char *mime_type,
                                struct ccn_charbuf *response);
-static struct ccn_charbuf *collect_stats_html(struct ccnd_handle *h);
-static struct ccn_charbuf *collect_stats_xml(struct ccnd_handle *h);
+static struct ccn_charbuf *collect_stats_html(struct ccnd_handle *h,
+                                              struct ccnd_status *s);
+static struct ccn_charbuf *collect_stats_xml(struct ccnd_handle *h,
+                                             struct ccnd_status *s);
+static void start_scrape(struct ccnd_handle *h, struct face *face, int want);
+static void status_request(struct ccnd_handle *h, struct face *face, int fmt);
+static int status_waiting(struct ccnd_handle *h, unsigned faceid);
+
+/**
+ * State for building an OpenMetrics response a piece at a time,
+ * so that a big FIB or many faces do not hold up forwarding.
+ *
+ * The samples of a metric family have to be together, so each family
+ * that is collected per face or per prefix gets its own buffer, and
+ * they are all concatenated at the end.
+ */
+#define SCRAPE_FACES 1
+#define SCRAPE_FIB   2
+#define SCRAPE_MAX   4      /**< scrapes in progress at once */
+#define SCRAPE_CHUNK 64     /**< faces or registered prefixes per step */
+#define SCRAPE_WALK 4096    /**< most nameprefix entries visited per step */
+#define SCRAPE_NF    9      /**< per-face families */
+#define SCRAPE_NP    3      /**< per-prefix families */
+
+struct ccnd_scrape {
+    struct ccnd_scrape *next;
+    unsigned faceid;            /**< where the response goes */
+    int want;                   /**< SCRAPE_FACES | SCRAPE_FIB */
+    unsigned slot;              /**< next face slot to look at */
+    struct ccn_charbuf *key;    /**< last nameprefix_tab key visited */
+    int fib_started;            /**< key is meaningful */
+    int truncated;              /**< FIB walk lost its place */
+    struct ccn_charbuf *head;   /**< global metrics */
+    struct ccn_charbuf *fam[SCRAPE_NF + SCRAPE_NP];
+};
+
+/**
+ * A status document, HTML or XML, kept for reuse.
+ *
+ * A request gets the document on hand if it is less than
+ * CCND_STATUS_MICROSEC old and no face or forwarding table change
+ * has happened since it was started.  Otherwise a new one is built, with the
+ * faces and the forwarding table done a chunk at a time as for the
+ * metrics scrapes, and the requests that come in meanwhile all wait
+ * for it.  The parts are put together, after the global figures,
+ * at the end.
+ */
+#define STATUS_HTML 0
+#define STATUS_XML  1
+#define STATUS_N    2
+#define STATUS_WAIT_MAX 16  /**< requests waiting for one document */
+#define CCND_STATUS_MICROSEC 1000000
+
+#define STATUS_FACES 0      /**< building stages */
+#define STATUS_FIB   1
+#define STATUS_DONE  2
+
+#define STATUS_PART_FACES  0
+#define STATUS_PART_METERS 1
+#define STATUS_PART_FIB    2
+#define STATUS_NPART       3
+
+struct ccnd_status {
+    struct ccn_charbuf *doc;        /**< latest complete document, or NULL */
+    long sec;                       /**< when doc was finished */
+    unsigned usec;
+    struct ccn_scheduled_event *builder; /**< non-NULL while building */
+    struct ccn_indexbuf *waiting;   /**< faceids waiting for the next doc */
+    int stage;                      /**< STATUS_FACES, etc. */
+    unsigned slot;                  /**< next face slot to look at */
+    struct ccn_charbuf *key;        /**< last nameprefix_tab key visited */
+    int fib_started;                /**< key is meaningful */
+    int truncated;                  /**< FIB walk lost its place */
+    int stale;                      /**< changes since the build started */
+    struct ccn_charbuf *part[STATUS_NPART];
+};
+
+static const char *const status_mime_type[STATUS_N] = {
+    "text/html", "text/xml"
+};
 
 /* HTTP */
 
@@ -92,11 +176,43 @@ ccnd_stats_http_set_debug(struct ccnd_handle *h, struct face *face, int level)
     ccn_charbuf_destroy(&response);
 }
 
+static void
+ccnd_stats_http_set_trace(struct ccnd_handle *h, struct face *face, int on)
+{
+    struct ccn_charbuf *response = ccn_charbuf_create();
+    const char *path;
+    
+    path = ccnd_trace_enable(h, on);
+    if (path == NULL)
+        path = "(none)";
+    ccn_charbuf_putf(response, "<title>trace %s</title><tt>trace %s %s</tt>" CRLF,
+                     h->trace_on ? "on" : "off",
+                     h->trace_on ? "on" : "off", path);
+    send_http_response(h, face, "text/html", response);
+    ccn_charbuf_destroy(&response);
+}
+
+#ifdef CCN_BUF_PROFILE
+static void
+ccnd_stats_http_bufprof_reset(struct ccnd_handle *h, struct face *face)
+{
+    struct ccn_charbuf *response = ccn_charbuf_create();
+    
+    ccn_bufprof_reset();
+    h->bufprof_msgs = 0;
+    ccn_charbuf_putf(response, "<title>buffer profile reset</title>"
+                     "<tt>buffer profile reset</tt>" CRLF);
+    send_http_response(h, face, "text/html", response);
+    ccn_charbuf_destroy(&response);
+}
+#endif
+
 int
 ccnd_stats_handle_http_connection(struct ccnd_handle *h, struct face *face)
 {
     struct ccn_charbuf *response = NULL;
-    char rbuf[16];
+    struct ccnd_scrape *scrape = NULL;
+    char rbuf[32];
     int i;
     int nspace;
     int n;
@@ -107,6 +223,11 @@ ccnd_stats_handle_http_connection(struct ccnd_handle *h, struct face *face)
         ccnd_destroy_face(h, face->faceid);
         return(-1);
     }
+    for (scrape = h->scrapes; scrape != NULL; scrape = scrape->next)
+        if (scrape->faceid == face->faceid)
+            return(-1); /* already answering */
+    if (status_waiting(h, face->faceid))
+        return(-1);
     n = sizeof(rbuf) - 1;
     if (face->inbuf->length < n)
         n = face->inbuf->length;
@@ -120,8 +241,8 @@ ccnd_stats_handle_http_connection(struct ccnd_handle *h, struct face *face)
         return(-1);
     if (0 == strcmp(rbuf, "GET / ") ||
         0 == strcmp(rbuf, "GET /? ")) {
-        response = collect_stats_html(h);
-        send_http_response(h, face, "text/html", response);
+        status_request(h, face, STATUS_HTML);
+        return(0);
     }
     else if (0 == strcmp(rbuf, "GET /?l=none ")) {
         ccnd_stats_http_set_debug(h, face, 0);
@@ -138,9 +259,26 @@ ccnd_stats_handle_http_connection(struct ccnd_handle *h, struct face *face)
     else if (0 == strcmp(rbuf, "GET /?l=high ")) {
         ccnd_stats_http_set_debug(h, face, -1);
     }
+    else if (0 == strcmp(rbuf, "GET /?t=on ")) {
+        ccnd_stats_http_set_trace(h, face, 1);
+    }
+    else if (0 == strcmp(rbuf, "GET /?t=off ")) {
+        ccnd_stats_http_set_trace(h, face, 0);
+    }
+#ifdef CCN_BUF_PROFILE
+    else if (0 == strcmp(rbuf, "GET /?b=reset ")) {
+        ccnd_stats_http_bufprof_reset(h, face);
+    }
+#endif
     else if (0 == strcmp(rbuf, "GET /?f=xml ")) {
-        response = collect_stats_xml(h);
-        send_http_response(h, face, "text/xml", response);
+        status_request(h, face, STATUS_XML);
+        return(0);
+    }
+    else if (0 == strncmp(rbuf, "GET /metrics", 12) &&
+             (rbuf[12] == ' ' || rbuf[12] == '?')) {
+        start_scrape(h, face, (strstr(rbuf + 12, "faces") ? SCRAPE_FACES : 0) |
+                              (strstr(rbuf + 12, "fib") ? SCRAPE_FIB : 0));
+        return(0);
     }
     else if (0 == strcmp(rbuf, "GET "))
         ccnd_send(h, face, resp404, strlen(resp404));
@@ -156,7 +294,7 @@ send_http_response(struct ccnd_handle *h, struct face *face,
                    const char *mime_type, struct ccn_charbuf *response)
 {
     struct linger linger = { .l_onoff = 1, .l_linger = 1 };
-    char buf[128];
+    char buf[256];
     int hdrlen;
 
     /* Set linger to prevent quickly resetting the connection on close.*/
@@ -181,96 +319,178 @@ ccnd_collect_stats(struct ccnd_handle *h, struct ccnd_stats *ans)
     struct hashtb_enumerator *e = &ee;
     long sum;
     unsigned i;
-    for (sum = 0, hashtb_start(h->nameprefix_tab, e);
-         e->data != NULL; hashtb_next(e)) {
-        struct nameprefix_entry *npe = e->data;
-        struct propagating_entry *head = &npe->pe_head;
-        struct propagating_entry *p;
-        for (p = head->next; p != head; p = p->next) {
-            if (ccnd_face_from_faceid(h, p->faceid) != NULL)
-                sum += 1;
-        }
-    }
-    ans->total_interest_counts = sum;
-    hashtb_end(e);
+    ans->pit_bytes = h->pit_msg_bytes;
     for (sum = 0, hashtb_start(h->propagating_tab, e);
          e->data != NULL; hashtb_next(e)) {
         struct propagating_entry *pe = e->data;
         if (pe->interest_msg == NULL)
             sum += 1;
+        ans->pit_bytes += CCND_PIT_OVERHEAD + e->datasize + e->keysize;
+        if (pe->outbound != NULL)
+            ans->pit_bytes += sizeof(*pe->outbound) +
+                              pe->outbound->limit * sizeof(pe->outbound->buf[0]);
     }
+    ans->pit_entries = hashtb_n(h->propagating_tab);
     ans->total_flood_control = sum;
     hashtb_end(e);
-    /* Do a consistency check on pending interest counts */
+    /* The faces keep count of their pending interests */
     for (sum = 0, i = 0; i < h->face_limit; i++) {
         struct face *face = h->faces_by_faceid[i];
         if (face != NULL)
             sum += face->pending_interests;
     }
-    if (sum != ans->total_interest_counts)
-        ccnd_msg(h, "ccnd_collect_stats found inconsistency %ld != %ld\n",
-                 (long)sum, (long)ans->total_interest_counts);
     ans->total_interest_counts = sum;
     return(0);
 }
 
 /* HTML formatting */
 
+/**
+ * @returns the number of ContentObjects waiting in the send queues of a face
+ */
+static unsigned
+face_queued_content(struct face *face)
+{
+    unsigned n = 0;
+    int c;
+    int k;
+    
+    for (c = 0; c < CCN_CQ_N; c++)
+        if (face->q[c] != NULL)
+            for (k = 0; k < CCND_TC_N; k++)
+                n += face->q[c]->send_queue[k]->n;
+    return(n);
+}
+
 static void
-collect_faces_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+hist_html(struct ccn_charbuf *b, const struct ccnd_hist *hist)
+{
+    ccn_charbuf_putf(b, "%u, p50 %u, p90 %u, p99 %u, max %u usec",
+                     hist->n,
+                     ccnd_hist_percentile(hist, 50),
+                     ccnd_hist_percentile(hist, 90),
+                     ccnd_hist_percentile(hist, 99),
+                     hist->max);
+}
+
+/**
+ * Describe one face for the HTML status
+ */
+static void
+collect_face_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                  struct face *face, struct ccn_charbuf *nodebuf)
 {
-    int i;
-    struct ccn_charbuf *nodebuf;
     int port;
     
-    nodebuf = ccn_charbuf_create();
+    ccn_charbuf_putf(b, " <li>");
+    ccn_charbuf_putf(b, "<b>face:</b> %u <b>flags:</b> 0x%x",
+                     face->faceid, face->flags);
+    ccn_charbuf_putf(b, " <b>pending:</b> %d",
+                     face->pending_interests);
+    ccn_charbuf_putf(b, " <b>queued:</b> %u",
+                     face_queued_content(face));
+    if (face->shaper.rate != 0)
+        ccn_charbuf_putf(b, " <b>shaped:</b> %u/%u",
+                         face->shaper.rate, face->shaper.burst);
+    if (face->shaper.drops != 0)
+        ccn_charbuf_putf(b, " <b>dropped:</b> %u",
+                         face->shaper.drops);
+    if (face->packer.pdus != 0)
+        ccn_charbuf_putf(b, " <b>packed:</b> %u in %u"
+                         " (%.2f per packet, %ju usec avg wait)",
+                         face->packer.msgs, face->packer.pdus,
+                         (double)face->packer.msgs / face->packer.pdus,
+                         face->packer.wait / face->packer.msgs);
+    if (face->frag != NULL)
+        ccn_charbuf_putf(b, " <b>fragments:</b> %u sent, %u resent,"
+                         " %u reassembled, %u requested, %u dropped",
+                         face->frag->sent, face->frag->resent,
+                         face->frag->reassembled,
+                         face->frag->requested, face->frag->dropped);
+    if (face->arq != NULL && (face->flags & CCN_FACE_ARQ) != 0)
+        ccn_charbuf_putf(b, " <b>arq:</b> rtt %u usec, %u acked,"
+                         " %u retransmitted, %u lost",
+                         face->arq->srtt, face->arq->acked,
+                         face->arq->retransmitted, face->arq->lost);
+    if (face->arq != NULL && face->arq->acks_sent != 0)
+        ccn_charbuf_putf(b, " <b>acks:</b> %u", face->arq->acks_sent);
+    if (face->sup.usec != 0)
+        ccn_charbuf_putf(b, " <b>suppression:</b> %u usec,"
+                         " %u sent, %u suppressed, %u collisions,"
+                         " %ju usec avg delay",
+                         face->sup.usec, face->sup.sent,
+                         face->sup.suppressed, face->sup.collisions,
+                         face->sup.delayed == 0 ? (uintmax_t)0 :
+                         face->sup.delay_total / face->sup.delayed);
+    if (face->lat != NULL && face->lat->n != 0) {
+        ccn_charbuf_putf(b, " <b>latency:</b> ");
+        hist_html(b, face->lat);
+    }
+    if (face->recvcount != 0)
+        ccn_charbuf_putf(b, " <b>activity:</b> %d",
+                         face->recvcount);
+    nodebuf->length = 0;
+    port = ccn_charbuf_append_sockaddr(nodebuf, face->addr);
+    if (port > 0) {
+        const char *node = ccn_charbuf_as_string(nodebuf);
+        int chk = CCN_FACE_MCAST | CCN_FACE_UNDECIDED |
+        CCN_FACE_NOSEND | CCN_FACE_GG | CCN_FACE_PASSIVE;
+        if ((face->flags & chk) == 0)
+            ccn_charbuf_putf(b,
+                             " <b>remote:</b> "
+                             "<a href='http://%s:%s/'>"
+                             "%s:%d</a>",
+                             node, CCN_DEFAULT_UNICAST_PORT,
+                             node, port);
+        else if ((face->flags & CCN_FACE_PASSIVE) == 0)
+            ccn_charbuf_putf(b, " <b>remote:</b> %s:%d",
+                             node, port);
+        else
+            ccn_charbuf_putf(b, " <b>local:</b> %s:%d",
+                             node, port);
+        if (face->sendface != face->faceid &&
+            face->sendface != CCN_NOFACEID)
+            ccn_charbuf_putf(b, " <b>via:</b> %u", face->sendface);
+    }
+    ccn_charbuf_putf(b, "</li>" NL);
+}
+
+static void
+collect_faces_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                   struct ccnd_status *s)
+{
     ccn_charbuf_putf(b, "<h4>Faces</h4>" NL);
     ccn_charbuf_putf(b, "<ul>");
-    for (i = 0; i < h->face_limit; i++) {
-        struct face *face = h->faces_by_faceid[i];
-        if (face != NULL && (face->flags & CCN_FACE_UNDECIDED) == 0) {
-            ccn_charbuf_putf(b, " <li>");
-            ccn_charbuf_putf(b, "<b>face:</b> %u <b>flags:</b> 0x%x",
-                             face->faceid, face->flags);
-            ccn_charbuf_putf(b, " <b>pending:</b> %d",
-                             face->pending_interests);
-            if (face->recvcount != 0)
-                ccn_charbuf_putf(b, " <b>activity:</b> %d",
-                                 face->recvcount);
-            nodebuf->length = 0;
-            port = ccn_charbuf_append_sockaddr(nodebuf, face->addr);
-            if (port > 0) {
-                const char *node = ccn_charbuf_as_string(nodebuf);
-                int chk = CCN_FACE_MCAST | CCN_FACE_UNDECIDED |
-                CCN_FACE_NOSEND | CCN_FACE_GG | CCN_FACE_PASSIVE;
-                if ((face->flags & chk) == 0)
-                    ccn_charbuf_putf(b,
-                                     " <b>remote:</b> "
-                                     "<a href='http://%s:%s/'>"
-                                     "%s:%d</a>",
-                                     node, CCN_DEFAULT_UNICAST_PORT,
-                                     node, port);
-                else if ((face->flags & CCN_FACE_PASSIVE) == 0)
-                    ccn_charbuf_putf(b, " <b>remote:</b> %s:%d",
-                                     node, port);
-                else
-                    ccn_charbuf_putf(b, " <b>local:</b> %s:%d",
-                                     node, port);
-                if (face->sendface != face->faceid &&
-                    face->sendface != CCN_NOFACEID)
-                    ccn_charbuf_putf(b, " <b>via:</b> %u", face->sendface);
-            }
-            ccn_charbuf_putf(b, "</li>" NL);
-        }
-    }
+    ccn_charbuf_append_charbuf(b, s->part[STATUS_PART_FACES]);
     ccn_charbuf_putf(b, "</ul>");
-    ccn_charbuf_destroy(&nodebuf);
 }
 
+/**
+ * Add the row for one face to the HTML activity rates table
+ */
 static void
-collect_face_meter_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+collect_face_meter_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                        struct face *face)
+{
+    ccn_charbuf_putf(b, " <tr>");
+    ccn_charbuf_putf(b, "<td><b>face:</b> %u</td>\t",
+                     face->faceid);
+    ccn_charbuf_putf(b, "<td>%6u / %u</td>\t\t",
+                         ccnd_meter_rate(h, face->meter[FM_BYTI]),
+                         ccnd_meter_rate(h, face->meter[FM_BYTO]));
+    ccn_charbuf_putf(b, "<td>%9u / %u</td>\t\t",
+                         ccnd_meter_rate(h, face->meter[FM_DATI]),
+                         ccnd_meter_rate(h, face->meter[FM_INTO]));
+    ccn_charbuf_putf(b, "<td>%9u / %u</td>",
+                         ccnd_meter_rate(h, face->meter[FM_DATO]),
+                         ccnd_meter_rate(h, face->meter[FM_INTI]));
+    ccn_charbuf_putf(b, "</tr>" NL);
+}
+
+static void
+collect_face_meters_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                         struct ccnd_status *s)
 {
-    int i;
     ccn_charbuf_putf(b, "<h4>Face Activity Rates</h4>");
     ccn_charbuf_putf(b, "<table cellspacing='0' cellpadding='0' class='tbl' summary='face activity rates'>");
     ccn_charbuf_putf(b, "<tbody>" NL);
@@ -278,276 +498,1288 @@ collect_face_meter_html(struct ccnd_handle *h, struct ccn_charbuf *b)
                         " <td>Bytes/sec In/Out</td>\t"
                         " <td>recv data/intr sent</td>\t"
                         " <td>sent data/intr recv</td></tr>" NL);
-    for (i = 0; i < h->face_limit; i++) {
-        struct face *face = h->faces_by_faceid[i];
-        if (face != NULL && (face->flags & (CCN_FACE_UNDECIDED|CCN_FACE_PASSIVE)) == 0) {
-            ccn_charbuf_putf(b, " <tr>");
-            ccn_charbuf_putf(b, "<td><b>face:</b> %u</td>\t",
-                             face->faceid);
-            ccn_charbuf_putf(b, "<td>%6u / %u</td>\t\t",
-                                 ccnd_meter_rate(h, face->meter[FM_BYTI]),
-                                 ccnd_meter_rate(h, face->meter[FM_BYTO]));
-            ccn_charbuf_putf(b, "<td>%9u / %u</td>\t\t",
-                                 ccnd_meter_rate(h, face->meter[FM_DATI]),
-                                 ccnd_meter_rate(h, face->meter[FM_INTO]));
-            ccn_charbuf_putf(b, "<td>%9u / %u</td>",
-                                 ccnd_meter_rate(h, face->meter[FM_DATO]),
-                                 ccnd_meter_rate(h, face->meter[FM_INTI]));
-            ccn_charbuf_putf(b, "</tr>" NL);
-        }
-    }
+    ccn_charbuf_append_charbuf(b, s->part[STATUS_PART_METERS]);
     ccn_charbuf_putf(b, "</tbody>");
     ccn_charbuf_putf(b, "</table>");
 }
 
+/**
+ * Describe the forwarding of one prefix for the HTML status
+ * @param name is the ccnb-encoded prefix.
+ */
 static void
-collect_forwarding_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+collect_fentry_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                    struct ccn_charbuf *name, struct nameprefix_entry *ipe)
 {
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
     struct ccn_forwarding *f;
-    int res;
-    struct ccn_charbuf *name = ccn_charbuf_create();
     
-    ccn_charbuf_putf(b, "<h4>Forwarding</h4>" NL);
-    ccn_charbuf_putf(b, "<ul>");
-    hashtb_start(h->nameprefix_tab, e);
-    for (; e->data != NULL; hashtb_next(e)) {
-        struct nameprefix_entry *ipe = e->data;
-        ccn_name_init(name);
-        res = ccn_name_append_components(name, e->key, 0, e->keysize);
-        if (res < 0)
-            abort();
-        if (0) {
+    for (f = ipe->forwarding; f != NULL; f = f->next) {
+        if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0) {
             ccn_charbuf_putf(b, " <li>");
             ccn_uri_append(b, name->buf, name->length, 1);
-            ccn_charbuf_putf(b, "</li>" NL);
-        }
-        for (f = ipe->forwarding; f != NULL; f = f->next) {
-            if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0) {
-                ccn_name_init(name);
-                ccn_name_append_components(name, e->key, 0, e->keysize);
-                ccn_charbuf_putf(b, " <li>");
-                ccn_uri_append(b, name->buf, name->length, 1);
+            ccn_charbuf_putf(b,
+                             " <b>face:</b> %u"
+                             " <b>flags:</b> 0x%x"
+                             " <b>expires:</b> %d",
+                             f->faceid,
+                             f->flags & CCN_FORW_PUBMASK,
+                             ccnd_forwarding_expires(h, f));
+            if (f->srtt != 0 || f->outstanding != 0)
                 ccn_charbuf_putf(b,
-                                 " <b>face:</b> %u"
-                                 " <b>flags:</b> 0x%x"
-                                 " <b>expires:</b> %d",
-                                 f->faceid,
-                                 f->flags & CCN_FORW_PUBMASK,
-                                 f->expires);
-                ccn_charbuf_putf(b, "</li>" NL);
-            }
+                                 " <b>rtt:</b> %u"
+                                 " <b>loss:</b> %u%%"
+                                 " <b>outstanding:</b> %d",
+                                 f->srtt,
+                                 f->loss * 100 / 65536,
+                                 f->outstanding);
+            ccn_charbuf_putf(b, "</li>" NL);
         }
     }
-    hashtb_end(e);
-    ccn_charbuf_destroy(&name);
+}
+
+static void
+collect_forwarding_html(struct ccnd_handle *h, struct ccn_charbuf *b,
+                        struct ccnd_status *s)
+{
+    ccn_charbuf_putf(b, "<h4>Forwarding</h4>" NL);
+    ccn_charbuf_putf(b, "<ul>");
+    ccn_charbuf_append_charbuf(b, s->part[STATUS_PART_FIB]);
+    if (s->truncated)
+        ccn_charbuf_putf(b, " <li><i>The rest was left out, because the"
+                            " table changed while it was being listed</i>"
+                            "</li>" NL);
     ccn_charbuf_putf(b, "</ul>");
 }
 
-static unsigned
-ccnd_colorhash(struct ccnd_handle *h)
+/**
+ * @returns a description of how the PIT is coping with its budget
+ */
+static const char *
+pit_state(unsigned usage)
 {
-    unsigned const char *a = h->ccnd_id;
-    unsigned v;
-    
-    v = (a[0] << 16) + (a[1] << 8) + a[2];
-    return (v | 0xC0C0C0);
+    if (usage >= 1000)
+        return("full, faces held to equal shares");
+    if (usage >= CCND_PIT_SOFT)
+        return("filling, lifetimes shortened");
+    return("normal");
 }
 
-static struct ccn_charbuf *
-collect_stats_html(struct ccnd_handle *h)
+static void
+collect_pit_html(struct ccnd_handle *h, struct ccn_charbuf *b)
 {
-    struct ccnd_stats stats = {0};
-    struct ccn_charbuf *b = ccn_charbuf_create();
-    int pid;
-    struct utsname un;
-    const char *portstr;
+    unsigned usage;
     
-    portstr = getenv(CCN_LOCAL_PORT_ENVNAME);
-    if (portstr == NULL || portstr[0] == 0 || strlen(portstr) > 10)
-        portstr = CCN_DEFAULT_UNICAST_PORT;
-    uname(&un);
-    pid = getpid();
+    if (h->pit_limit == 0 && h->pit_byte_limit == 0)
+        return;
+    usage = ccnd_pit_usage(h);
+    ccn_charbuf_putf(b, "<div><b>PIT budget:</b> %s, %u.%u%% used of",
+                     pit_state(usage), usage / 10, usage % 10);
+    if (h->pit_limit != 0)
+        ccn_charbuf_putf(b, " %u entries", h->pit_limit);
+    if (h->pit_byte_limit != 0)
+        ccn_charbuf_putf(b, "%s %llu bytes", h->pit_limit != 0 ? "," : "",
+                         (unsigned long long)h->pit_byte_limit);
+    ccn_charbuf_putf(b, ", %u faces pending, %lu lifetimes shortened</div>" NL,
+                     h->pit_faces, h->interests_shortened);
+}
+
+static void
+collect_dnl_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    unsigned long held;
+    uintmax_t false_hits;
     
-    ccnd_collect_stats(h, &stats);
+    if (h->dnl == NULL)
+        return;
+    ccnd_dnl_counts(h->dnl, &held, &false_hits);
     ccn_charbuf_putf(b,
-        "<html xmlns='http://www.w3.org/1999/xhtml'>"
-        "<head>"
-        "<title>%s ccnd[%d]</title>"
-        //"<meta http-equiv='refresh' content='3'>"
-        "<style type='text/css'>"
-        "/*<![CDATA[*/"
-        "p.header {color: white; background-color: blue; width: 100%%} "
-        "table.tbl {border-style: solid; border-width: 1.0px 1.0px 1.0px 1.0px; border-color: black} "
-        "td {border-style: solid; "
-            "border-width: 1.0px 1.0px 1.0px 1.0px; "
-            "border-color: #808080 #808080 #808080 #808080; "
-            "padding: 6px 6px 6px 6px; "
-            "margin-left: auto; margin-right: auto; "
-            "text-align: center"
-            "} "
-        "td.left {text-align: left} "
-        "/*]]>*/"
-        "</style>"
-        "</head>" NL
-        "<body bgcolor='#%06X'>"
-        "<p class='header'>%s ccnd[%d] local port %s api %d start %ld.%06u now %ld.%06u</p>" NL
-        "<div><b>Content items:</b> %llu accessioned,"
-        " %d stored, %lu stale, %d sparse, %lu duplicate, %lu sent</div>" NL
-        "<div><b>Interests:</b> %d names,"
-        " %ld pending, %ld propagating, %ld noted</div>" NL
-        "<div><b>Interest totals:</b> %lu accepted,"
-        " %lu dropped, %lu sent, %lu stuffed</div>" NL,
-        un.nodename,
-        pid,
-        ccnd_colorhash(h),
-        un.nodename,
-        pid,
-        portstr,
-        (int)CCN_API_VERSION,
-        h->starttime, h->starttime_usec,
-        h->sec,
-        h->usec,
-        (unsigned long long)h->accession,
-        hashtb_n(h->content_tab),
-        h->n_stale,
-        hashtb_n(h->sparse_straggler_tab),
-        h->content_dups_recvd,
-        h->content_items_sent,
-        hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
-        hashtb_n(h->propagating_tab) - stats.total_flood_control,
-        stats.total_flood_control,
-        h->interests_accepted, h->interests_dropped,
-        h->interests_sent, h->interests_stuffed);
-    if (0)
-        ccn_charbuf_putf(b,
-                         "<div><b>Active faces and listeners:</b> %d</div>" NL,
-                         hashtb_n(h->faces_by_fd) + hashtb_n(h->dgram_faces));
-    collect_faces_html(h, b);
-    collect_face_meter_html(h, b);
-    collect_forwarding_html(h, b);
+        "<div><b>Dead nonces:</b> %lu held,"
+        " %lu looped, about %llu matched falsely</div>" NL,
+        held, h->interests_looped, (unsigned long long)false_hits);
+}
+
+static void
+collect_admit_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
     ccn_charbuf_putf(b,
-        "</body>"
-        "</html>" NL);
-    return(b);
+        "<div><b>Admission:</b> %s%s%d%%,"
+        " %lu unsolicited dropped, %lu passed on without keeping</div>" NL,
+        (h->admit & CCND_ADMIT_SOLICITED) ? "solicited, " : "",
+        (h->admit & CCND_ADMIT_SECOND) ? "second, " : "",
+        h->admit_percent, h->content_unsolicited, h->content_passed);
 }
 
-/* XML formatting */
+static void
+collect_disk_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    unsigned long objects;
+    uintmax_t bytes, written, read, bad;
+    
+    if (h->disk == NULL)
+        return;
+    objects = ccnd_disk_counts(h->disk, &bytes, &written, &read, &bad);
+    ccn_charbuf_putf(b,
+        "<div><b>Disk cache:</b> %lu objects in %ju bytes,"
+        " %ju written, %ju read back, %ju unreadable</div>" NL,
+        objects, bytes, written, read, bad);
+}
 
 static void
-collect_meter_xml(struct ccnd_handle *h, struct ccn_charbuf *b, struct ccnd_meter *m)
+collect_prefetch_html(struct ccnd_handle *h, struct ccn_charbuf *b)
 {
-    uintmax_t total;
-    unsigned rate;
+    uintmax_t issued, landed, used, wasted;
     
-    if (m == NULL)
+    if (h->prefetch == NULL)
         return;
-    total = ccnd_meter_total(m);
-    rate = ccnd_meter_rate(h, m);
-    ccn_charbuf_putf(b, "<%s><total>%ju</total><persec>%u</persec></%s>",
-        m->what, total, rate, m->what);
+    issued = ccnd_prefetch_counts(h->prefetch, &landed, &used, &wasted);
+    ccn_charbuf_putf(b,
+        "<div><b>Prefetch:</b> %ju asked, %ju arrived,"
+        " %ju used (%ju%%), %ju dropped unused</div>" NL,
+        issued, landed, used, landed == 0 ? 0 : used * 100 / landed, wasted);
+}
+
+static void
+collect_shard_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    if (h->cpu >= 0)
+        ccn_charbuf_putf(b,
+            "<div><b>Placement:</b> cpu %d, node %d,"
+            " %ju datagrams via another node,"
+            " %ju handed off to another node</div>" NL,
+            h->cpu, h->numa_node, h->xnode_in, h->xnode_out);
+    if (h->nshards <= 1)
+        return;
+    ccn_charbuf_putf(b,
+        "<div><b>Shard:</b> %d of %d,"
+        " %ju datagrams handed off, %ju taken over</div>" NL,
+        h->shard, h->nshards, h->shard_out, h->shard_in);
 }
 
 static void
-collect_faces_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+collect_cs_html(struct ccnd_handle *h, struct ccn_charbuf *b)
 {
+    struct ccnd_cs_shard *s;
+    struct ccnd_fresh_rule *r;
+    const unsigned char *name;
+    size_t size;
+    size_t shared;
+    uintmax_t limit, bytes, evicted;
+    unsigned long objects;
     int i;
-    int m;
-    int port;
-    struct ccn_charbuf *nodebuf;
     
-    nodebuf = ccn_charbuf_create();
-    ccn_charbuf_putf(b, "<faces>");
-    for (i = 0; i < h->face_limit; i++) {
-        struct face *face = h->faces_by_faceid[i];
-        if (face != NULL && (face->flags & CCN_FACE_UNDECIDED) == 0) {
-            ccn_charbuf_putf(b, "<face>");
+    objects = ccnd_intern_counts(h->intern, &size, &shared);
+    ccn_charbuf_putf(b,
+        "<div><b>Name prefixes:</b> %lu interned, %ju bytes,"
+        " %ju bytes shared</div>" NL,
+        objects, (uintmax_t)size, (uintmax_t)shared);
+    if (h->compress_age > 0)
+        ccn_charbuf_putf(b,
+            "<div><b>Compressed content:</b> %lu objects,"
+            " %ju bytes in %ju (%.2f to 1), %ju tried,"
+            " %ju ms compressing, %ju expanded in %ju ms</div>" NL,
+            h->compressed, h->compressed_in, h->compressed_out,
+            h->compressed_out == 0 ? 1.0 :
+                (double)h->compressed_in / h->compressed_out,
+            h->compress_tries, h->compress_usec / 1000,
+            h->expansions, h->expand_usec / 1000);
+    if (h->cs_n > 1) {
+        ccn_charbuf_putf(b, "<div><b>Content store shards:</b></div><ul>");
+        for (i = 0; i < h->cs_n; i++) {
+            s = &h->cs[i];
             ccn_charbuf_putf(b,
-                             "<faceid>%u</faceid>"
-                             "<faceflags>%04x</faceflags>",
-                             face->faceid, face->flags);
-            ccn_charbuf_putf(b, "<pending>%d</pending>",
-                             face->pending_interests);
-            ccn_charbuf_putf(b, "<recvcount>%d</recvcount>",
-                             face->recvcount);
-            nodebuf->length = 0;
-            port = ccn_charbuf_append_sockaddr(nodebuf, face->addr);
-            if (port > 0) {
-                const char *node = ccn_charbuf_as_string(nodebuf);
-                ccn_charbuf_putf(b, "<ip>%s:%d</ip>", node, port);
-            }
-            if (face->sendface != face->faceid &&
-                face->sendface != CCN_NOFACEID)
-                ccn_charbuf_putf(b, "<via>%u</via>", face->sendface);
-            if (face != NULL && (face->flags & CCN_FACE_PASSIVE) == 0) {
-                ccn_charbuf_putf(b, "<meters>");
-                for (m = 0; m < CCND_FACE_METER_N; m++)
-                    collect_meter_xml(h, b, face->meter[m]);
-                ccn_charbuf_putf(b, "</meters>");
-            }
-            ccn_charbuf_putf(b, "</face>" NL);
+                "<li>%d: %d objects, %ju bytes,"
+                " %ju added, %ju evicted</li>" NL,
+                i, hashtb_n(s->content_tab), (uintmax_t)s->bytes,
+                s->inserted, s->evicted);
         }
+        ccn_charbuf_putf(b, "</ul>");
+    }
+    for (i = 0; i < ccnd_quota_slots(h->quota); i++) {
+        if (ccnd_quota_get(h->quota, i, &name, &size, &limit,
+                           &bytes, &objects, &evicted) < 0)
+            continue;
+        ccn_charbuf_putf(b, "<div><b>Store quota:</b> ");
+        ccn_uri_append(b, name, size, 1);
+        ccn_charbuf_putf(b, " %ju bytes of %ju, %lu objects,"
+                         " %ju evicted</div>" NL,
+                         bytes, limit, objects, evicted);
+    }
+    for (i = 1; i < h->fresh_rules; i++) {
+        r = &h->fresh_rule[i];
+        if (r->npe == NULL && r->objects == 0)
+            continue;
+        ccn_charbuf_putf(b, "<div><b>Freshness rule:</b> ");
+        ccn_uri_append(b, r->name->buf, r->name->length, 1);
+        if (r->npe == NULL)
+            ccn_charbuf_putf(b, " lifted,");
+        else
+            ccn_charbuf_putf(b, " freshness %d, residency %d,",
+                             r->freshness, r->residency);
+        ccn_charbuf_putf(b, " %lu objects, %ju bytes,"
+                         " %ju staled, %ju removed</div>" NL,
+                         r->objects, r->bytes, r->staled, r->removed);
     }
-    ccn_charbuf_putf(b, "</faces>");
-    ccn_charbuf_destroy(&nodebuf);
 }
 
 static void
-collect_forwarding_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+collect_latency_html(struct ccnd_handle *h, struct ccn_charbuf *b)
 {
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
-    struct ccn_forwarding *f;
-    int res;
     struct ccn_charbuf *name = ccn_charbuf_create();
     
-    ccn_charbuf_putf(b, "<forwarding>");
+    ccn_charbuf_putf(b, "<h4>Interest Latency</h4>" NL);
+    ccn_charbuf_putf(b, "<ul>");
+    ccn_charbuf_putf(b, " <li><b>store:</b> ");
+    hist_html(b, &h->lat_store);
+    ccn_charbuf_putf(b, "</li>" NL);
+    ccn_charbuf_putf(b, " <li><b>upstream:</b> ");
+    hist_html(b, &h->lat_upstream);
+    ccn_charbuf_putf(b, "</li>" NL);
     hashtb_start(h->nameprefix_tab, e);
     for (; e->data != NULL; hashtb_next(e)) {
         struct nameprefix_entry *ipe = e->data;
-        for (f = ipe->forwarding, res = 0; f != NULL && !res; f = f->next) {
-            if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0)
-                res = 1;
-        }
-        if (res) {
-            ccn_name_init(name);
-            ccn_name_append_components(name, e->key, 0, e->keysize);
-            ccn_charbuf_putf(b, "<fentry>");
-            ccn_charbuf_putf(b, "<prefix>");
-            ccn_uri_append(b, name->buf, name->length, 1);
-            ccn_charbuf_putf(b, "</prefix>");
-            for (f = ipe->forwarding; f != NULL; f = f->next) {
-                if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0) {
-                    ccn_charbuf_putf(b,
-                                     "<dest>"
-                                     "<faceid>%u</faceid>"
-                                     "<flags>%x</flags>"
-                                     "<expires>%d</expires>"
-                                     "</dest>",
-                                     f->faceid,
-                                     f->flags & CCN_FORW_PUBMASK,
-                                     f->expires);
-                }
-            }
-            ccn_charbuf_putf(b, "</fentry>");
-        }
+        if (ipe->lat == NULL || ipe->lat->hist.n == 0)
+            continue;
+        ccn_name_init(name);
+        ccn_name_append_components(name, e->key, 0, e->keysize);
+        ccn_charbuf_putf(b, " <li>");
+        ccn_uri_append(b, name->buf, name->length, 1);
+        ccn_charbuf_putf(b, " ");
+        hist_html(b, &ipe->lat->hist);
+        ccn_charbuf_putf(b, "</li>" NL);
     }
     hashtb_end(e);
     ccn_charbuf_destroy(&name);
-    ccn_charbuf_putf(b, "</forwarding>");
+    ccn_charbuf_putf(b, "</ul>");
 }
 
-static struct ccn_charbuf *
-collect_stats_xml(struct ccnd_handle *h)
+/**
+ * Rebuild the name of a heavy-hitter prefix from what is kept of it.
+ * @returns 1 if components were left off the end, otherwise 0.
+ */
+static int
+hh_prefix_name(struct ccn_charbuf *name, const struct ccnd_hh_item *it)
 {
-    struct ccnd_stats stats = {0};
-    struct ccn_charbuf *b = ccn_charbuf_create();
-    int i;
-        
-    ccnd_collect_stats(h, &stats);
-    ccn_charbuf_putf(b,
-        "<ccnd>"
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    size_t kept = it->labelsize;
+    size_t end = 0;
+
+    if (kept > CCND_HH_LABEL)
+        kept = CCND_HH_LABEL;
+    d = ccn_buf_decoder_start(&decoder, it->label, kept);
+    while (ccn_buf_match_dtag(d, CCN_DTAG_Component)) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_blob(d, NULL, NULL))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+        if (d->decoder.state < 0)
+            break;
+        end = d->decoder.index;
+    }
+    ccn_name_init(name);
+    ccn_name_append_components(name, it->label, 0, end);
+    return(end < it->labelsize);
+}
+
+static void
+collect_heavy_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccnd_hh_item top[CCND_HH_MAXK];
+    struct ccn_charbuf *name;
+    long tick = h->sec / CCND_HH_HALFLIFE;
+    int truncated;
+    int d, i, n;
+    
+    if (h->topk <= 0)
+        return;
+    name = ccn_charbuf_create();
+    ccn_charbuf_putf(b, "<h4>Heavy Hitters</h4>" NL);
+    ccn_charbuf_putf(b, "<ul>");
+    for (d = 0; d < CCND_HH_DEPTHS; d++) {
+        if (h->hh_prefix[d] == NULL)
+            continue;
+        n = ccnd_hh_top(h->hh_prefix[d], tick, top, h->topk);
+        ccn_charbuf_putf(b, " <li><b>prefixes, depth %d:</b>", d + 1);
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b, " ");
+            truncated = hh_prefix_name(name, &top[i]);
+            ccn_uri_append(b, name->buf, name->length, 1);
+            if (truncated)
+                ccn_charbuf_putf(b, "/...");
+            ccn_charbuf_putf(b, " %ju (%ju missed);",
+                             (uintmax_t)top[i].count, (uintmax_t)top[i].aux);
+        }
+        ccn_charbuf_putf(b, "</li>" NL);
+    }
+    if (h->hh_face != NULL) {
+        n = ccnd_hh_top(h->hh_face, tick, top, h->topk);
+        ccn_charbuf_putf(b, " <li><b>faces, by interests:</b>");
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b, " %u%s %ju (%ju missed);",
+                             (unsigned)top[i].key,
+                             ccnd_face_from_faceid(h, top[i].key) == NULL ?
+                             " (gone)" : "",
+                             (uintmax_t)top[i].count, (uintmax_t)top[i].aux);
+        }
+        ccn_charbuf_putf(b, "</li>" NL);
+    }
+    if (h->hh_bytes != NULL) {
+        n = ccnd_hh_top(h->hh_bytes, tick, top, h->topk);
+        ccn_charbuf_putf(b, " <li><b>faces, by content bytes sent:</b>");
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b, " %u%s %ju (%ju objects);",
+                             (unsigned)top[i].key,
+                             ccnd_face_from_faceid(h, top[i].key) == NULL ?
+                             " (gone)" : "",
+                             (uintmax_t)top[i].count, (uintmax_t)top[i].aux);
+        }
+        ccn_charbuf_putf(b, "</li>" NL);
+    }
+    ccn_charbuf_putf(b, "</ul>");
+    ccn_charbuf_destroy(&name);
+}
+
+static void
+collect_class_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    int k;
+    
+    ccn_charbuf_putf(b, "<h4>Traffic Classes</h4>" NL);
+    ccn_charbuf_putf(b, "<ul>");
+    for (k = 0; k < CCND_TC_N; k++) {
+        ccn_charbuf_putf(b, " <li><b>%d:</b> sent %ju (%ju bytes),"
+                         " interests %ju<br/>latency ",
+                         k, h->tc_sent[k], h->tc_bytes[k],
+                         h->tc_interests[k]);
+        hist_html(b, &h->tc_lat[k]);
+        ccn_charbuf_putf(b, "<br/>queued ");
+        hist_html(b, &h->tc_wait[k]);
+        ccn_charbuf_putf(b, "</li>" NL);
+    }
+    ccn_charbuf_putf(b, "</ul>");
+    ccn_charbuf_putf(b, "<div><b>Outq jumps:</b> %ju</div>" NL, h->tc_jumps);
+    ccn_charbuf_putf(b, "<div><b>Management:</b> handled %ju,"
+                     " dropped %ju, waiting %u<br/>set aside ",
+                     h->mgmt_interests, h->mgmt_dropped, h->mgmtq.n);
+    hist_html(b, &h->mgmt_wait);
+    ccn_charbuf_putf(b, "<br/>answered ");
+    hist_html(b, &h->mgmt_lat);
+    ccn_charbuf_putf(b, "</div>" NL);
+    ccn_charbuf_putf(b, "<div><b>Face notices:</b> batch %u,"
+                     " batches %ju, records %ju, unsent %ju</div>" NL,
+                     h->notice_seq, h->notice_batches, h->notice_records,
+                     h->notice_unsent);
+}
+
+/* Store sizes, relative to the current one, at which to estimate hit ratios */
+static const struct {
+    const char *label;
+    unsigned num, den;
+} mrc_scale[] = {
+    {"0.5", 1, 2}, {"1", 1, 1}, {"2", 2, 1}, {"4", 4, 1}
+};
+#define MRC_NSCALE (sizeof(mrc_scale) / sizeof(mrc_scale[0]))
+
+/**
+ * @returns the size of the content store in objects, and how it was found
+ *
+ * This is the smaller of the CCND_CAP limit and the CCND_CAP_BYTES limit
+ * divided by the mean object size; with no limit, the objects now stored.
+ */
+static uintmax_t
+store_size_objects(struct ccnd_handle *h, const char **how)
+{
+    uintmax_t ans = ~(uintmax_t)0;
+    uintmax_t n = ccnd_content_count(h);
+    
+    *how = "objects stored";
+    if (h->capacity != ~0UL) {
+        ans = h->capacity;
+        *how = "CCND_CAP";
+    }
+    if (h->capacity_bytes != ~(size_t)0 && n > 0 &&
+          h->content_bytes + h->content_overhead > 0) {
+        uintmax_t b = (uintmax_t)h->capacity_bytes * n /
+                      (h->content_bytes + h->content_overhead);
+        if (b < ans) {
+            ans = b;
+            *how = "CCND_CAP_BYTES";
+        }
+    }
+    if (ans == ~(uintmax_t)0)
+        ans = n;
+    return(ans);
+}
+
+static double
+store_ratio(uintmax_t part, uintmax_t total)
+{
+    return(total > 0 ? (double)part / total : 0.0);
+}
+
+static void
+collect_store_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    const char *how;
+    uintmax_t size = store_size_objects(h, &how);
+    uintmax_t lookups;
+    unsigned sampled, rate;
+    unsigned i;
+    
+    ccn_charbuf_putf(b, "<h4>Content Store</h4>" NL);
+    ccn_charbuf_putf(b, "<div><b>Hit ratio:</b> %.3f "
+                     "(%lu hits, %lu misses)</div>" NL,
+                     store_ratio(h->cache_hits, h->cache_hits + h->cache_misses),
+                     h->cache_hits, h->cache_misses);
+    lookups = ccnd_mrc_lookups(h->mrc, &sampled, &rate);
+    if (h->mrc != NULL) {
+        ccn_charbuf_putf(b, "<div><b>Estimated hit ratio (LRU):</b>");
+        for (i = 0; i < MRC_NSCALE; i++)
+            ccn_charbuf_putf(b, "%s %.3f at %sx", i == 0 ? "" : ",",
+                             ccnd_mrc_hit_ppm(h->mrc, size * mrc_scale[i].num /
+                                              mrc_scale[i].den) / 1e6,
+                             mrc_scale[i].label);
+        ccn_charbuf_putf(b, " of %ju objects (%s);"
+                         " %u samples of %ju lookups, 1 name in %u</div>" NL,
+                         size, how, sampled, lookups, rate);
+    }
+    ccn_charbuf_putf(b, "<ul>");
+    hashtb_start(h->nameprefix_tab, e);
+    for (; e->data != NULL; hashtb_next(e)) {
+        struct nameprefix_entry *ipe = e->data;
+        if (ipe->cs_hits == 0 && ipe->cs_misses == 0)
+            continue;
+        ccn_name_init(name);
+        ccn_name_append_components(name, e->key, 0, e->keysize);
+        ccn_charbuf_putf(b, " <li>");
+        ccn_uri_append(b, name->buf, name->length, 1);
+        ccn_charbuf_putf(b, " hits: %lu misses: %lu ratio: %.3f</li>" NL,
+                         ipe->cs_hits, ipe->cs_misses,
+                         store_ratio(ipe->cs_hits,
+                                     ipe->cs_hits + ipe->cs_misses));
+    }
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_putf(b, "</ul>");
+}
+
+#define SCHED_LAG_TOP 32
+
+/**
+ * @returns the name of a scheduled action, for display
+ */
+static const char *
+sched_lag_name(const struct ccn_schedule_lag *lag)
+{
+    return(lag->name != NULL ? lag->name : "(unnamed)");
+}
+
+static double
+sched_pct(uintmax_t part, uintmax_t total)
+{
+    return(total > 0 ? 100.0 * part / total : 0.0);
+}
+
+static double
+sched_per_minute(uintmax_t count, uintmax_t usec)
+{
+    return(usec > 0 ? 60e6 * count / usec : 0.0);
+}
+
+static void
+collect_scheduler_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    uintmax_t busy;
+    int i, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    busy = load.total - (load.idle < load.total ? load.idle : load.total);
+    ccn_charbuf_putf(b, "<h4>Event Loop</h4>" NL);
+    ccn_charbuf_putf(b, "<div><b>Busy:</b> %.1f%% "
+                     "(scheduled events %.1f%%, i/o and other %.1f%%)</div>" NL,
+                     sched_pct(busy, load.total),
+                     sched_pct(load.events, load.total),
+                     sched_pct(busy - (load.events < busy ? load.events : busy),
+                               load.total));
+    ccn_charbuf_putf(b, "<div><b>Wakeups:</b> %ju", load.wakeups);
+    if (h->idle_slack > 0)
+        ccn_charbuf_putf(b, "; idle mode (%s) %ju s, %.1f wakeups per "
+                         "idle minute",
+                         h->quiet ? "on" : "off", load.slack_time / 1000000,
+                         sched_per_minute(load.slack_wakeups,
+                                          load.slack_time));
+    ccn_charbuf_putf(b, "</div>" NL);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    ccn_charbuf_putf(b, "<ul>");
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b, " <li><b>%s:</b> %ju runs, late by mean %ju, "
+                         "p50 %u, p90 %u, p99 %u, max %u usec</li>" NL,
+                         sched_lag_name(&lag[i]), lag[i].runs,
+                         lag[i].late_sum / lag[i].runs,
+                         ccn_schedule_lag_percentile(&lag[i], 50),
+                         ccn_schedule_lag_percentile(&lag[i], 90),
+                         ccn_schedule_lag_percentile(&lag[i], 99),
+                         lag[i].late_max);
+    ccn_charbuf_putf(b, "</ul>");
+}
+
+/**
+ * Memory held, by subsystem
+ */
+static void
+collect_memory_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    int i;
+    
+    ccnd_mem_census(h);
+    ccn_charbuf_putf(b, "<h4>Memory%s</h4>" NL,
+                     h->compact ? " (compact profile)" : "");
+    ccn_charbuf_putf(b, "<ul>");
+    for (i = 0; i < CCND_MEM_N; i++)
+        ccn_charbuf_putf(b, " <li><b>%s:</b> %ju bytes, %ju objects, "
+                         "peak %ju bytes</li>" NL, h->mem[i].name,
+                         h->mem[i].bytes, h->mem[i].objects, h->mem[i].peak);
+    ccn_charbuf_putf(b, "</ul>");
+}
+
+#ifdef CCN_BUF_PROFILE
+#define BUFPROF_TOP 25
+
+static void
+collect_bufprof_html(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_bufprof_site top[BUFPROF_TOP];
+    double msgs = h->bufprof_msgs > 0 ? (double)h->bufprof_msgs : 1.0;
+    int i, n;
+    
+    n = ccn_bufprof_snapshot(top, BUFPROF_TOP);
+    ccn_charbuf_putf(b, "<h4>Buffer Allocations</h4>" NL);
+    ccn_charbuf_putf(b, "<div><b>Messages:</b> %llu "
+                     "(<a href=\"/?b=reset\">reset</a>)</div>" NL,
+                     h->bufprof_msgs);
+    ccn_charbuf_putf(b, "<ul>");
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b,
+            " <li><b>%s:%d</b> %s"
+            " creates: %llu grows: %llu bytes: %llu"
+            " per message: %.2f creates, %.1f bytes</li>" NL,
+            top[i].file, top[i].line,
+            top[i].kind == CCN_BUFPROF_CHARBUF ? "charbuf" : "indexbuf",
+            top[i].creates, top[i].grows, top[i].bytes,
+            top[i].creates / msgs, top[i].bytes / msgs);
+    ccn_charbuf_putf(b, "</ul>");
+}
+#endif
+
+static unsigned
+ccnd_colorhash(struct ccnd_handle *h)
+{
+    unsigned const char *a = h->ccnd_id;
+    unsigned v;
+    
+    v = (a[0] << 16) + (a[1] << 8) + a[2];
+    return (v | 0xC0C0C0);
+}
+
+static struct ccn_charbuf *
+collect_stats_html(struct ccnd_handle *h, struct ccnd_status *s)
+{
+    struct ccnd_stats stats = {0};
+    struct ccn_charbuf *b = ccn_charbuf_create();
+    int pid;
+    struct utsname un;
+    struct timeval now;
+    const char *portstr;
+    
+    portstr = getenv(CCN_LOCAL_PORT_ENVNAME);
+    if (portstr == NULL || portstr[0] == 0 || strlen(portstr) > 10)
+        portstr = CCN_DEFAULT_UNICAST_PORT;
+    uname(&un);
+    pid = getpid();
+    gettimeofday(&now, NULL);
+    
+    ccnd_collect_stats(h, &stats);
+    ccn_charbuf_putf(b,
+        "<html xmlns='http://www.w3.org/1999/xhtml'>"
+        "<head>"
+        "<title>%s ccnd[%d]</title>"
+        //"<meta http-equiv='refresh' content='3'>"
+        "<style type='text/css'>"
+        "/*<![CDATA[*/"
+        "p.header {color: white; background-color: blue; width: 100%%} "
+        "table.tbl {border-style: solid; border-width: 1.0px 1.0px 1.0px 1.0px; border-color: black} "
+        "td {border-style: solid; "
+            "border-width: 1.0px 1.0px 1.0px 1.0px; "
+            "border-color: #808080 #808080 #808080 #808080; "
+            "padding: 6px 6px 6px 6px; "
+            "margin-left: auto; margin-right: auto; "
+            "text-align: center"
+            "} "
+        "td.left {text-align: left} "
+        "/*]]>*/"
+        "</style>"
+        "</head>" NL
+        "<body bgcolor='#%06X'>"
+        "<p class='header'>%s ccnd[%d] local port %s api %d start %ld.%06u now %ld.%06u</p>" NL
+        "<div><b>Content items:</b> %llu accessioned,"
+        " %d stored, %lu stale, %d sparse, %lu duplicate, %lu sent</div>" NL
+        "<div><b>Content store:</b> %s policy,"
+        " %lu hits, %lu misses,"
+        " %llu bytes, %llu overhead, %u evicted/sec</div>" NL
+        "<div><b>Interests:</b> %d names,"
+        " %ld pending, %ld propagating, %ld noted</div>" NL
+        "<div><b>Interest totals:</b> %lu accepted,"
+        " %lu dropped, %lu sent, %lu stuffed, %lu retried,"
+        " %lu limited, %lu nacked, %lu negcached</div>" NL
+        "<div><b>PIT memory:</b> %ld entries,"
+        " %llu bytes, %llu per entry, %llu in slabs</div>" NL,
+        un.nodename,
+        pid,
+        ccnd_colorhash(h),
+        un.nodename,
+        pid,
+        portstr,
+        (int)CCN_API_VERSION,
+        h->starttime, h->starttime_usec,
+        (long)now.tv_sec,
+        (unsigned)now.tv_usec,
+        (unsigned long long)h->accession,
+        (int)ccnd_content_count(h),
+        h->n_stale,
+        (int)h->content_slot_nfree,
+        h->content_dups_recvd,
+        h->content_items_sent,
+        h->cs->cache == NULL ? "default" : ccnd_cache_policy_name(h->cs->cache),
+        h->cache_hits, h->cache_misses,
+        (unsigned long long)h->content_bytes,
+        (unsigned long long)h->content_overhead,
+        ccnd_meter_rate(h, h->evictions),
+        hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
+        hashtb_n(h->propagating_tab) - stats.total_flood_control,
+        stats.total_flood_control,
+        h->interests_accepted, h->interests_dropped,
+        h->interests_sent, h->interests_stuffed, h->interests_retried,
+        h->interests_limited, h->interests_nacked, h->interests_negcached,
+        stats.pit_entries, (unsigned long long)stats.pit_bytes,
+        (unsigned long long)(stats.pit_entries > 0 ?
+                             stats.pit_bytes / stats.pit_entries : 0),
+        (unsigned long long)h->pit_slab_bytes);
+    collect_pit_html(h, b);
+    collect_dnl_html(h, b);
+    collect_admit_html(h, b);
+    collect_disk_html(h, b);
+    collect_prefetch_html(h, b);
+    collect_cs_html(h, b);
+    collect_shard_html(h, b);
+    if (0)
+        ccn_charbuf_putf(b,
+                         "<div><b>Active faces and listeners:</b> %d</div>" NL,
+                         hashtb_n(h->faces_by_fd) + hashtb_n(h->dgram_faces));
+    collect_faces_html(h, b, s);
+    collect_face_meters_html(h, b, s);
+    collect_forwarding_html(h, b, s);
+    collect_store_html(h, b);
+    collect_latency_html(h, b);
+    collect_heavy_html(h, b);
+    collect_class_html(h, b);
+    collect_scheduler_html(h, b);
+    collect_memory_html(h, b);
+#ifdef CCN_BUF_PROFILE
+    collect_bufprof_html(h, b);
+#endif
+    ccn_charbuf_putf(b,
+        "</body>"
+        "</html>" NL);
+    return(b);
+}
+
+/* XML formatting */
+
+static void
+collect_meter_xml(struct ccnd_handle *h, struct ccn_charbuf *b, struct ccnd_meter *m)
+{
+    uintmax_t total;
+    unsigned rate;
+    
+    if (m == NULL)
+        return;
+    total = ccnd_meter_total(m);
+    rate = ccnd_meter_rate(h, m);
+    ccn_charbuf_putf(b, "<%s><total>%ju</total><persec>%u</persec></%s>",
+        m->what, total, rate, m->what);
+}
+
+static void
+hist_xml(struct ccn_charbuf *b, const struct ccnd_hist *hist)
+{
+    const char *sep = "";
+    int i;
+    
+    ccn_charbuf_putf(b, "<samples>%u</samples>"
+                     "<mean>%ju</mean>"
+                     "<p50>%u</p50><p90>%u</p90><p99>%u</p99>"
+                     "<max>%u</max>",
+                     hist->n,
+                     hist->n == 0 ? (uintmax_t)0 : hist->sum / hist->n,
+                     ccnd_hist_percentile(hist, 50),
+                     ccnd_hist_percentile(hist, 90),
+                     ccnd_hist_percentile(hist, 99),
+                     hist->max);
+    /* Nonzero buckets, as lower bound:count, so histograms can be merged */
+    ccn_charbuf_putf(b, "<buckets>");
+    for (i = 0; i < CCND_HIST_N; i++) {
+        if (hist->count[i] != 0) {
+            ccn_charbuf_putf(b, "%s%u:%u", sep,
+                             ccnd_hist_bucket_low(i), hist->count[i]);
+            sep = " ";
+        }
+    }
+    ccn_charbuf_putf(b, "</buckets>");
+}
+
+/**
+ * Describe one face for the XML status
+ */
+static void
+collect_face_xml(struct ccnd_handle *h, struct ccn_charbuf *b,
+                 struct face *face, struct ccn_charbuf *nodebuf)
+{
+    int m;
+    int port;
+    
+    ccn_charbuf_putf(b, "<face>");
+    ccn_charbuf_putf(b,
+                     "<faceid>%u</faceid>"
+                     "<faceflags>%04x</faceflags>",
+                     face->faceid, face->flags);
+    ccn_charbuf_putf(b, "<pending>%d</pending>",
+                     face->pending_interests);
+    ccn_charbuf_putf(b, "<queued>%u</queued>",
+                     face_queued_content(face));
+    if (face->shaper.rate != 0)
+        ccn_charbuf_putf(b, "<rate>%u</rate><burst>%u</burst>",
+                         face->shaper.rate, face->shaper.burst);
+    ccn_charbuf_putf(b, "<dropped>%u</dropped>",
+                     face->shaper.drops);
+    if (face->packer.pdus != 0)
+        ccn_charbuf_putf(b, "<packed><msgs>%u</msgs><pdus>%u</pdus>"
+                         "<waitusec>%ju</waitusec></packed>",
+                         face->packer.msgs, face->packer.pdus,
+                         face->packer.wait / face->packer.msgs);
+    if (face->frag != NULL)
+        ccn_charbuf_putf(b, "<fragments><sent>%u</sent>"
+                         "<resent>%u</resent>"
+                         "<reassembled>%u</reassembled>"
+                         "<requested>%u</requested>"
+                         "<dropped>%u</dropped></fragments>",
+                         face->frag->sent, face->frag->resent,
+                         face->frag->reassembled,
+                         face->frag->requested, face->frag->dropped);
+    if (face->arq != NULL)
+        ccn_charbuf_putf(b, "<arq><rttusec>%u</rttusec>"
+                         "<acked>%u</acked>"
+                         "<retransmitted>%u</retransmitted>"
+                         "<lost>%u</lost>"
+                         "<ackssent>%u</ackssent></arq>",
+                         face->arq->srtt, face->arq->acked,
+                         face->arq->retransmitted, face->arq->lost,
+                         face->arq->acks_sent);
+    if (face->sup.usec != 0)
+        ccn_charbuf_putf(b, "<suppress><usec>%u</usec>"
+                         "<sent>%u</sent>"
+                         "<suppressed>%u</suppressed>"
+                         "<collisions>%u</collisions>"
+                         "<delayusec>%ju</delayusec></suppress>",
+                         face->sup.usec, face->sup.sent,
+                         face->sup.suppressed, face->sup.collisions,
+                         face->sup.delayed == 0 ? (uintmax_t)0 :
+                         face->sup.delay_total / face->sup.delayed);
+    if (face->lat != NULL && face->lat->n != 0) {
+        ccn_charbuf_putf(b, "<latency>");
+        hist_xml(b, face->lat);
+        ccn_charbuf_putf(b, "</latency>");
+    }
+    ccn_charbuf_putf(b, "<recvcount>%d</recvcount>",
+                     face->recvcount);
+    nodebuf->length = 0;
+    port = ccn_charbuf_append_sockaddr(nodebuf, face->addr);
+    if (port > 0) {
+        const char *node = ccn_charbuf_as_string(nodebuf);
+        ccn_charbuf_putf(b, "<ip>%s:%d</ip>", node, port);
+    }
+    if (face->sendface != face->faceid &&
+        face->sendface != CCN_NOFACEID)
+        ccn_charbuf_putf(b, "<via>%u</via>", face->sendface);
+    if (face != NULL && (face->flags & CCN_FACE_PASSIVE) == 0) {
+        ccn_charbuf_putf(b, "<meters>");
+        for (m = 0; m < CCND_FACE_METER_N; m++)
+            collect_meter_xml(h, b, face->meter[m]);
+        ccn_charbuf_putf(b, "</meters>");
+    }
+    ccn_charbuf_putf(b, "</face>" NL);
+}
+
+static void
+collect_faces_xml(struct ccnd_handle *h, struct ccn_charbuf *b,
+                  struct ccnd_status *s)
+{
+    ccn_charbuf_putf(b, "<faces>");
+    ccn_charbuf_append_charbuf(b, s->part[STATUS_PART_FACES]);
+    ccn_charbuf_putf(b, "</faces>");
+}
+
+/**
+ * Describe the forwarding of one prefix for the XML status
+ * @param name is the ccnb-encoded prefix.
+ */
+static void
+collect_fentry_xml(struct ccnd_handle *h, struct ccn_charbuf *b,
+                   struct ccn_charbuf *name, struct nameprefix_entry *ipe)
+{
+    struct ccn_forwarding *f;
+    int res;
+    
+    for (f = ipe->forwarding, res = 0; f != NULL && !res; f = f->next) {
+        if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0)
+            res = 1;
+    }
+    if (!res)
+        return;
+    ccn_charbuf_putf(b, "<fentry>");
+    ccn_charbuf_putf(b, "<prefix>");
+    ccn_uri_append(b, name->buf, name->length, 1);
+    ccn_charbuf_putf(b, "</prefix>");
+    for (f = ipe->forwarding; f != NULL; f = f->next) {
+        if ((f->flags & (CCN_FORW_ACTIVE | CCN_FORW_PFXO)) != 0) {
+            ccn_charbuf_putf(b,
+                             "<dest>"
+                             "<faceid>%u</faceid>"
+                             "<flags>%x</flags>"
+                             "<expires>%d</expires>"
+                             "<rtt>%u</rtt>"
+                             "<loss>%u</loss>"
+                             "<outstanding>%d</outstanding>"
+                             "</dest>",
+                             f->faceid,
+                             f->flags & CCN_FORW_PUBMASK,
+                             ccnd_forwarding_expires(h, f),
+                             f->srtt,
+                             f->loss,
+                             f->outstanding);
+        }
+    }
+    ccn_charbuf_putf(b, "</fentry>");
+}
+
+static void
+collect_forwarding_xml(struct ccnd_handle *h, struct ccn_charbuf *b,
+                       struct ccnd_status *s)
+{
+    ccn_charbuf_putf(b, "<forwarding>");
+    ccn_charbuf_append_charbuf(b, s->part[STATUS_PART_FIB]);
+    if (s->truncated)
+        ccn_charbuf_putf(b, "<truncated>1</truncated>");
+    ccn_charbuf_putf(b, "</forwarding>");
+}
+
+static void
+collect_dnl_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    unsigned long held;
+    uintmax_t false_hits;
+    
+    if (h->dnl == NULL)
+        return;
+    ccnd_dnl_counts(h->dnl, &held, &false_hits);
+    ccn_charbuf_putf(b,
+        "<deadnonces>"
+        "<held>%lu</held>"
+        "<looped>%lu</looped>"
+        "<falsematches>%llu</falsematches>"
+        "</deadnonces>",
+        held, h->interests_looped, (unsigned long long)false_hits);
+}
+
+static void
+collect_admit_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    ccn_charbuf_putf(b,
+        "<admission>"
+        "<policy>%s%s%d%%</policy>"
+        "<unsolicited>%lu</unsolicited>"
+        "<passed>%lu</passed>"
+        "</admission>",
+        (h->admit & CCND_ADMIT_SOLICITED) ? "solicited," : "",
+        (h->admit & CCND_ADMIT_SECOND) ? "second," : "",
+        h->admit_percent, h->content_unsolicited, h->content_passed);
+}
+
+static void
+collect_disk_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    unsigned long objects;
+    uintmax_t bytes, written, read, bad;
+    
+    if (h->disk == NULL)
+        return;
+    objects = ccnd_disk_counts(h->disk, &bytes, &written, &read, &bad);
+    ccn_charbuf_putf(b,
+        "<diskcache>"
+        "<objects>%lu</objects>"
+        "<bytes>%ju</bytes>"
+        "<written>%ju</written>"
+        "<read>%ju</read>"
+        "<unreadable>%ju</unreadable>"
+        "</diskcache>",
+        objects, bytes, written, read, bad);
+}
+
+static void
+collect_prefetch_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    uintmax_t issued, landed, used, wasted;
+    
+    if (h->prefetch == NULL)
+        return;
+    issued = ccnd_prefetch_counts(h->prefetch, &landed, &used, &wasted);
+    ccn_charbuf_putf(b,
+        "<prefetch>"
+        "<asked>%ju</asked>"
+        "<arrived>%ju</arrived>"
+        "<used>%ju</used>"
+        "<unused>%ju</unused>"
+        "</prefetch>",
+        issued, landed, used, wasted);
+}
+
+static void
+collect_shard_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    if (h->cpu >= 0)
+        ccn_charbuf_putf(b,
+            "<placement>"
+            "<cpu>%d</cpu>"
+            "<node>%d</node>"
+            "<crossnodein>%ju</crossnodein>"
+            "<crossnodeout>%ju</crossnodeout>"
+            "</placement>",
+            h->cpu, h->numa_node, h->xnode_in, h->xnode_out);
+    if (h->nshards <= 1)
+        return;
+    ccn_charbuf_putf(b,
+        "<shard>"
+        "<index>%d</index>"
+        "<count>%d</count>"
+        "<handedoff>%ju</handedoff>"
+        "<takenover>%ju</takenover>"
+        "</shard>",
+        h->shard, h->nshards, h->shard_out, h->shard_in);
+}
+
+static void
+collect_cs_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccnd_cs_shard *s;
+    struct ccnd_fresh_rule *r;
+    const unsigned char *name;
+    size_t size;
+    uintmax_t limit, bytes, evicted;
+    unsigned long objects;
+    int i;
+    
+    if (h->cs_n > 1) {
+        ccn_charbuf_putf(b, "<csshards>");
+        for (i = 0; i < h->cs_n; i++) {
+            s = &h->cs[i];
+            ccn_charbuf_putf(b,
+                "<csshard>"
+                "<index>%d</index>"
+                "<stored>%d</stored>"
+                "<bytes>%ju</bytes>"
+                "<added>%ju</added>"
+                "<evicted>%ju</evicted>"
+                "</csshard>",
+                i, hashtb_n(s->content_tab), (uintmax_t)s->bytes,
+                s->inserted, s->evicted);
+        }
+        ccn_charbuf_putf(b, "</csshards>");
+    }
+    for (i = 0; i < ccnd_quota_slots(h->quota); i++) {
+        if (ccnd_quota_get(h->quota, i, &name, &size, &limit,
+                           &bytes, &objects, &evicted) < 0)
+            continue;
+        ccn_charbuf_putf(b, "<storequota><prefix>");
+        ccn_uri_append(b, name, size, 1);
+        ccn_charbuf_putf(b,
+            "</prefix>"
+            "<limit>%ju</limit>"
+            "<bytes>%ju</bytes>"
+            "<objects>%lu</objects>"
+            "<evicted>%ju</evicted>"
+            "</storequota>",
+            limit, bytes, objects, evicted);
+    }
+    for (i = 1; i < h->fresh_rules; i++) {
+        r = &h->fresh_rule[i];
+        if (r->npe == NULL && r->objects == 0)
+            continue;
+        ccn_charbuf_putf(b, "<freshrule><prefix>");
+        ccn_uri_append(b, r->name->buf, r->name->length, 1);
+        ccn_charbuf_putf(b,
+            "</prefix>"
+            "<freshness>%d</freshness>"
+            "<residency>%d</residency>"
+            "<objects>%lu</objects>"
+            "<bytes>%ju</bytes>"
+            "<staled>%ju</staled>"
+            "<removed>%ju</removed>"
+            "</freshrule>",
+            r->freshness, r->residency, r->objects, r->bytes,
+            r->staled, r->removed);
+    }
+}
+
+static void
+collect_latency_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    
+    ccn_charbuf_putf(b, "<latency><store>");
+    hist_xml(b, &h->lat_store);
+    ccn_charbuf_putf(b, "</store><upstream>");
+    hist_xml(b, &h->lat_upstream);
+    ccn_charbuf_putf(b, "</upstream>");
+    hashtb_start(h->nameprefix_tab, e);
+    for (; e->data != NULL; hashtb_next(e)) {
+        struct nameprefix_entry *ipe = e->data;
+        if (ipe->lat == NULL || ipe->lat->hist.n == 0)
+            continue;
+        ccn_name_init(name);
+        ccn_name_append_components(name, e->key, 0, e->keysize);
+        ccn_charbuf_putf(b, "<lentry><prefix>");
+        ccn_uri_append(b, name->buf, name->length, 1);
+        ccn_charbuf_putf(b, "</prefix>");
+        hist_xml(b, &ipe->lat->hist);
+        ccn_charbuf_putf(b, "</lentry>");
+    }
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_putf(b, "</latency>");
+}
+
+static void
+collect_heavy_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccnd_hh_item top[CCND_HH_MAXK];
+    struct ccn_charbuf *name;
+    long tick = h->sec / CCND_HH_HALFLIFE;
+    int truncated;
+    int d, i, n;
+    
+    if (h->topk <= 0)
+        return;
+    name = ccn_charbuf_create();
+    ccn_charbuf_putf(b, "<heavyhitters>");
+    for (d = 0; d < CCND_HH_DEPTHS; d++) {
+        if (h->hh_prefix[d] == NULL)
+            continue;
+        n = ccnd_hh_top(h->hh_prefix[d], tick, top, h->topk);
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b, "<hhprefix><depth>%d</depth><prefix>", d + 1);
+            truncated = hh_prefix_name(name, &top[i]);
+            ccn_uri_append(b, name->buf, name->length, 1);
+            if (truncated)
+                ccn_charbuf_putf(b, "/...");
+            ccn_charbuf_putf(b,
+                "</prefix>"
+                "<interests>%ju</interests>"
+                "<error>%ju</error>"
+                "<missed>%ju</missed>"
+                "</hhprefix>",
+                (uintmax_t)top[i].count, (uintmax_t)top[i].err,
+                (uintmax_t)top[i].aux);
+        }
+    }
+    if (h->hh_face != NULL) {
+        n = ccnd_hh_top(h->hh_face, tick, top, h->topk);
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b,
+                "<hhface>"
+                "<faceid>%u</faceid>"
+                "%s"
+                "<interests>%ju</interests>"
+                "<error>%ju</error>"
+                "<missed>%ju</missed>"
+                "</hhface>",
+                (unsigned)top[i].key,
+                ccnd_face_from_faceid(h, top[i].key) == NULL ?
+                "<gone/>" : "",
+                (uintmax_t)top[i].count, (uintmax_t)top[i].err,
+                (uintmax_t)top[i].aux);
+        }
+    }
+    if (h->hh_bytes != NULL) {
+        n = ccnd_hh_top(h->hh_bytes, tick, top, h->topk);
+        for (i = 0; i < n; i++) {
+            if (top[i].count == 0)
+                continue;
+            ccn_charbuf_putf(b,
+                "<hhsender>"
+                "<faceid>%u</faceid>"
+                "%s"
+                "<bytes>%ju</bytes>"
+                "<error>%ju</error>"
+                "<objects>%ju</objects>"
+                "</hhsender>",
+                (unsigned)top[i].key,
+                ccnd_face_from_faceid(h, top[i].key) == NULL ?
+                "<gone/>" : "",
+                (uintmax_t)top[i].count, (uintmax_t)top[i].err,
+                (uintmax_t)top[i].aux);
+        }
+    }
+    ccn_charbuf_putf(b, "</heavyhitters>");
+    ccn_charbuf_destroy(&name);
+}
+
+static void
+collect_store_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    const char *how;
+    uintmax_t size = store_size_objects(h, &how);
+    uintmax_t lookups;
+    unsigned sampled, rate;
+    unsigned i;
+    
+    ccn_charbuf_putf(b, "<store>");
+    lookups = ccnd_mrc_lookups(h->mrc, &sampled, &rate);
+    if (h->mrc != NULL) {
+        ccn_charbuf_putf(b, "<mrc><objects>%ju</objects><lookups>%ju</lookups>"
+                         "<samples>%u</samples><rate>%u</rate>",
+                         size, lookups, sampled, rate);
+        for (i = 0; i < MRC_NSCALE; i++)
+            ccn_charbuf_putf(b, "<estimate><scale>%s</scale>"
+                             "<ppm>%u</ppm></estimate>", mrc_scale[i].label,
+                             ccnd_mrc_hit_ppm(h->mrc, size * mrc_scale[i].num /
+                                              mrc_scale[i].den));
+        ccn_charbuf_putf(b, "</mrc>");
+    }
+    hashtb_start(h->nameprefix_tab, e);
+    for (; e->data != NULL; hashtb_next(e)) {
+        struct nameprefix_entry *ipe = e->data;
+        if (ipe->cs_hits == 0 && ipe->cs_misses == 0)
+            continue;
+        ccn_name_init(name);
+        ccn_name_append_components(name, e->key, 0, e->keysize);
+        ccn_charbuf_putf(b, "<csprefix><prefix>");
+        ccn_uri_append(b, name->buf, name->length, 1);
+        ccn_charbuf_putf(b, "</prefix><hits>%lu</hits><misses>%lu</misses>"
+                         "</csprefix>", ipe->cs_hits, ipe->cs_misses);
+    }
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_putf(b, "</store>");
+}
+
+static void
+collect_scheduler_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    int i, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    ccn_charbuf_putf(b, "<scheduler><load>"
+                     "<total>%ju</total><idle>%ju</idle><events>%ju</events>"
+                     "<wakeups>%ju</wakeups><idlemode>%ju</idlemode>"
+                     "<idlewakeups>%ju</idlewakeups>"
+                     "</load>", load.total, load.idle, load.events,
+                     load.wakeups, load.slack_time, load.slack_wakeups);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b, "<action><name>%s</name><runs>%ju</runs>"
+                         "<mean>%ju</mean>"
+                         "<p50>%u</p50><p90>%u</p90><p99>%u</p99>"
+                         "<max>%u</max></action>",
+                         sched_lag_name(&lag[i]), lag[i].runs,
+                         lag[i].late_sum / lag[i].runs,
+                         ccn_schedule_lag_percentile(&lag[i], 50),
+                         ccn_schedule_lag_percentile(&lag[i], 90),
+                         ccn_schedule_lag_percentile(&lag[i], 99),
+                         lag[i].late_max);
+    ccn_charbuf_putf(b, "</scheduler>");
+}
+
+static void
+collect_memory_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    int i;
+    
+    ccnd_mem_census(h);
+    ccn_charbuf_putf(b, "<memory>");
+    for (i = 0; i < CCND_MEM_N; i++)
+        ccn_charbuf_putf(b, "<tag><name>%s</name><bytes>%ju</bytes>"
+                         "<objects>%ju</objects><peak>%ju</peak></tag>",
+                         h->mem[i].name, h->mem[i].bytes,
+                         h->mem[i].objects, h->mem[i].peak);
+    ccn_charbuf_putf(b, "</memory>");
+}
+
+#ifdef CCN_BUF_PROFILE
+static void
+collect_bufprof_xml(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_bufprof_site top[BUFPROF_TOP];
+    int i, n;
+    
+    n = ccn_bufprof_snapshot(top, BUFPROF_TOP);
+    ccn_charbuf_putf(b, "<bufprof><messages>%llu</messages>", h->bufprof_msgs);
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b,
+            "<site><file>%s</file><line>%d</line><kind>%s</kind>"
+            "<creates>%llu</creates><grows>%llu</grows><bytes>%llu</bytes>"
+            "</site>",
+            top[i].file, top[i].line,
+            top[i].kind == CCN_BUFPROF_CHARBUF ? "charbuf" : "indexbuf",
+            top[i].creates, top[i].grows, top[i].bytes);
+    ccn_charbuf_putf(b, "</bufprof>");
+}
+#endif
+
+static struct ccn_charbuf *
+collect_stats_xml(struct ccnd_handle *h, struct ccnd_status *s)
+{
+    struct ccnd_stats stats = {0};
+    struct ccn_charbuf *b = ccn_charbuf_create();
+    struct timeval now;
+    int i;
+        
+    ccnd_collect_stats(h, &stats);
+    gettimeofday(&now, NULL);
+    ccn_charbuf_putf(b,
+        "<ccnd>"
         "<identity>"
         "<ccndid>");
     for (i = 0; i < sizeof(h->ccnd_id); i++)
@@ -559,8 +1791,8 @@ collect_stats_xml(struct ccnd_handle *h)
         "</identity>",
         (int)CCN_API_VERSION,
         h->starttime, h->starttime_usec,
-        h->sec,
-        h->usec);
+        (long)now.tv_sec,
+        (unsigned)now.tv_usec);
     ccn_charbuf_putf(b,
         "<cobs>"
         "<accessioned>%llu</accessioned>"
@@ -569,6 +1801,12 @@ collect_stats_xml(struct ccnd_handle *h)
         "<sparse>%d</sparse>"
         "<duplicate>%lu</duplicate>"
         "<sent>%lu</sent>"
+        "<policy>%s</policy>"
+        "<hits>%lu</hits>"
+        "<misses>%lu</misses>"
+        "<bytes>%llu</bytes>"
+        "<overhead>%llu</overhead>"
+        "<evicted>%u</evicted>"
         "</cobs>"
         "<interests>"
         "<names>%d</names>"
@@ -579,24 +1817,956 @@ collect_stats_xml(struct ccnd_handle *h)
         "<dropped>%lu</dropped>"
         "<sent>%lu</sent>"
         "<stuffed>%lu</stuffed>"
-        "</interests>",
+        "<retried>%lu</retried>"
+        "<limited>%lu</limited>"
+        "<nacked>%lu</nacked>"
+        "<negcached>%lu</negcached>"
+        "</interests>"
+        "<pit>"
+        "<entries>%ld</entries>"
+        "<bytes>%llu</bytes>"
+        "<slabbytes>%llu</slabbytes>"
+        "</pit>",
         (unsigned long long)h->accession,
-        hashtb_n(h->content_tab),
+        (int)ccnd_content_count(h),
         h->n_stale,
-        hashtb_n(h->sparse_straggler_tab),
+        (int)h->content_slot_nfree,
         h->content_dups_recvd,
         h->content_items_sent,
+        h->cs->cache == NULL ? "default" : ccnd_cache_policy_name(h->cs->cache),
+        h->cache_hits, h->cache_misses,
+        (unsigned long long)h->content_bytes,
+        (unsigned long long)h->content_overhead,
+        ccnd_meter_rate(h, h->evictions),
         hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
         hashtb_n(h->propagating_tab) - stats.total_flood_control,
         stats.total_flood_control,
         h->interests_accepted, h->interests_dropped,
-        h->interests_sent, h->interests_stuffed);
-    collect_faces_xml(h, b);
-    collect_forwarding_xml(h, b);
+        h->interests_sent, h->interests_stuffed, h->interests_retried,
+        h->interests_limited, h->interests_nacked, h->interests_negcached,
+        stats.pit_entries, (unsigned long long)stats.pit_bytes,
+        (unsigned long long)h->pit_slab_bytes);
+    collect_dnl_xml(h, b);
+    collect_admit_xml(h, b);
+    collect_disk_xml(h, b);
+    collect_prefetch_xml(h, b);
+    collect_cs_xml(h, b);
+    collect_shard_xml(h, b);
+    collect_faces_xml(h, b, s);
+    collect_forwarding_xml(h, b, s);
+    collect_store_xml(h, b);
+    collect_latency_xml(h, b);
+    collect_heavy_xml(h, b);
+    collect_scheduler_xml(h, b);
+    collect_memory_xml(h, b);
+#ifdef CCN_BUF_PROFILE
+    collect_bufprof_xml(h, b);
+#endif
     ccn_charbuf_putf(b, "</ccnd>" NL);
     return(b);
 }
 
+/* OpenMetrics formatting */
+
+static const char *resp503 =
+    "HTTP/1.1 503 Service Unavailable" CRLF
+    "Retry-After: 1" CRLF
+    "Connection: close" CRLF CRLF;
+
+/** per-face families, in output order */
+static const char *const scrape_face_family[SCRAPE_NF][2] = {
+    {"ccnd_face_received_bytes", "counter"},
+    {"ccnd_face_sent_bytes", "counter"},
+    {"ccnd_face_received_data", "counter"},
+    {"ccnd_face_sent_data", "counter"},
+    {"ccnd_face_received_interests", "counter"},
+    {"ccnd_face_sent_interests", "counter"},
+    {"ccnd_face_pending_interests", "gauge"},
+    {"ccnd_face_queued_content", "gauge"},
+    {"ccnd_face_shaper_drops", "counter"},
+};
+
+/** per-prefix families, in output order */
+static const char *const scrape_fib_family[SCRAPE_NP][2] = {
+    {"ccnd_fib_rtt_seconds", "gauge"},
+    {"ccnd_fib_loss_ratio", "gauge"},
+    {"ccnd_fib_outstanding_interests", "gauge"},
+};
+
+static void
+metric_head(struct ccn_charbuf *b, const char *name, const char *type)
+{
+    ccn_charbuf_putf(b, "# TYPE %s %s" NL, name, type);
+}
+
+/**
+ * Append a counter or gauge that has no labels
+ */
+static void
+metric_value(struct ccn_charbuf *b, const char *name, const char *type,
+             uintmax_t value)
+{
+    metric_head(b, name, type);
+    ccn_charbuf_putf(b, "%s%s %ju" NL, name,
+                     strcmp(type, "counter") == 0 ? "_total" : "", value);
+}
+
+/**
+ * Append the series of a summary made from a latency histogram
+ */
+static void
+metric_summary(struct ccn_charbuf *b, const char *name, const char *labels,
+               const struct ccnd_hist *hist)
+{
+    static const unsigned pct[3] = {50, 90, 99};
+    int i;
+    
+    for (i = 0; i < 3; i++)
+        ccn_charbuf_putf(b, "%s{%s,quantile=\"0.%02u\"} %u.%06u" NL,
+                         name, labels, pct[i],
+                         ccnd_hist_percentile(hist, pct[i]) / 1000000,
+                         ccnd_hist_percentile(hist, pct[i]) % 1000000);
+    ccn_charbuf_putf(b, "%s_sum{%s} %ju.%06ju" NL, name, labels,
+                     hist->sum / 1000000, hist->sum % 1000000);
+    ccn_charbuf_putf(b, "%s_count{%s} %u" NL, name, labels, hist->n);
+}
+
+static void
+metric_seconds(struct ccn_charbuf *b, const char *name, const char *labels,
+               uintmax_t usec)
+{
+    ccn_charbuf_putf(b, "%s{%s} %ju.%06ju" NL, name, labels,
+                     usec / 1000000, usec % 1000000);
+}
+
+/**
+ * Time spent by the event loop, and lateness of scheduled events
+ */
+static void
+collect_scheduler_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    static const unsigned pct[3] = {50, 90, 99};
+    const char *name = "ccnd_event_lateness_seconds";
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    uintmax_t busy;
+    int i, j, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    busy = load.total - (load.idle < load.total ? load.idle : load.total);
+    metric_head(b, "ccnd_loop_seconds", "counter");
+    metric_seconds(b, "ccnd_loop_seconds_total", "state=\"idle\"", load.idle);
+    metric_seconds(b, "ccnd_loop_seconds_total", "state=\"events\"",
+                   load.events);
+    metric_seconds(b, "ccnd_loop_seconds_total", "state=\"other\"",
+                   busy - (load.events < busy ? load.events : busy));
+    metric_head(b, "ccnd_loop_wakeups", "counter");
+    ccn_charbuf_putf(b, "ccnd_loop_wakeups_total{mode=\"any\"} %ju" NL
+                     "ccnd_loop_wakeups_total{mode=\"idle\"} %ju" NL,
+                     load.wakeups, load.slack_wakeups);
+    metric_head(b, "ccnd_idle_mode_seconds", "counter");
+    ccn_charbuf_putf(b, "ccnd_idle_mode_seconds_total %ju.%06ju" NL,
+                     load.slack_time / 1000000, load.slack_time % 1000000);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    metric_head(b, name, "summary");
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 3; j++) {
+            unsigned v = ccn_schedule_lag_percentile(&lag[i], pct[j]);
+            ccn_charbuf_putf(b, "%s{action=\"%s\",quantile=\"0.%02u\"} "
+                             "%u.%06u" NL, name, sched_lag_name(&lag[i]),
+                             pct[j], v / 1000000, v % 1000000);
+        }
+        ccn_charbuf_putf(b, "%s_sum{action=\"%s\"} %ju.%06ju" NL,
+                         name, sched_lag_name(&lag[i]),
+                         lag[i].late_sum / 1000000, lag[i].late_sum % 1000000);
+        ccn_charbuf_putf(b, "%s_count{action=\"%s\"} %ju" NL,
+                         name, sched_lag_name(&lag[i]), lag[i].runs);
+    }
+}
+
+/**
+ * Memory held, by subsystem
+ */
+static void
+collect_memory_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    static const char *fam[3] = {
+        "ccnd_memory_bytes",
+        "ccnd_memory_objects",
+        "ccnd_memory_peak_bytes",
+    };
+    uintmax_t v[3];
+    int i, k;
+    
+    ccnd_mem_census(h);
+    for (i = 0; i < 3; i++) {
+        metric_head(b, fam[i], "gauge");
+        for (k = 0; k < CCND_MEM_N; k++) {
+            v[0] = h->mem[k].bytes;
+            v[1] = h->mem[k].objects;
+            v[2] = h->mem[k].peak;
+            ccn_charbuf_putf(b, "%s{tag=\"%s\"} %ju" NL,
+                             fam[i], h->mem[k].name, v[i]);
+        }
+    }
+}
+
+/**
+ * Hit ratios that the content store would have at other sizes
+ */
+static void
+collect_store_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    const char *name = "ccnd_content_store_estimated_hit_ratio";
+    const char *how;
+    uintmax_t size;
+    unsigned ppm;
+    unsigned i;
+    
+    if (h->mrc == NULL)
+        return;
+    size = store_size_objects(h, &how);
+    metric_head(b, name, "gauge");
+    for (i = 0; i < MRC_NSCALE; i++) {
+        ppm = ccnd_mrc_hit_ppm(h->mrc, size * mrc_scale[i].num /
+                                        mrc_scale[i].den);
+        ccn_charbuf_putf(b, "%s{scale=\"%s\"} %u.%06u" NL, name,
+                         mrc_scale[i].label, ppm / 1000000, ppm % 1000000);
+    }
+}
+
+/**
+ * The content store shards, the store quotas, and the freshness rules
+ */
+static void
+collect_cs_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    static const char *fam[4][2] = {
+        {"ccnd_cs_shard_objects", "gauge"},
+        {"ccnd_cs_shard_bytes", "gauge"},
+        {"ccnd_cs_shard_added", "counter"},
+        {"ccnd_cs_shard_evicted", "counter"},
+    };
+    static const char *quota_fam[4][2] = {
+        {"ccnd_store_quota_limit_bytes", "gauge"},
+        {"ccnd_store_quota_bytes", "gauge"},
+        {"ccnd_store_quota_objects", "gauge"},
+        {"ccnd_store_quota_evicted", "counter"},
+    };
+    static const char *rule_fam[4][2] = {
+        {"ccnd_fresh_rule_objects", "gauge"},
+        {"ccnd_fresh_rule_bytes", "gauge"},
+        {"ccnd_fresh_rule_staled", "counter"},
+        {"ccnd_fresh_rule_removed", "counter"},
+    };
+    struct ccnd_fresh_rule *r;
+    struct ccnd_cs_shard *s;
+    struct ccn_charbuf *label;
+    const unsigned char *name;
+    size_t size;
+    uintmax_t v[4];
+    unsigned long objects;
+    int i, j;
+    
+    if (h->cs_n > 1) {
+        for (j = 0; j < 4; j++) {
+            metric_head(b, fam[j][0], fam[j][1]);
+            for (i = 0; i < h->cs_n; i++) {
+                s = &h->cs[i];
+                v[0] = hashtb_n(s->content_tab);
+                v[1] = s->bytes;
+                v[2] = s->inserted;
+                v[3] = s->evicted;
+                ccn_charbuf_putf(b, "%s%s{shard=\"%d\"} %ju" NL, fam[j][0],
+                                 j >= 2 ? "_total" : "", i, v[j]);
+            }
+        }
+    }
+    if (ccnd_quota_slots(h->quota) <= 1 && h->fresh_rules <= 1)
+        return;
+    label = ccn_charbuf_create();
+    for (j = 0; j < 4 && ccnd_quota_slots(h->quota) > 1; j++) {
+        metric_head(b, quota_fam[j][0], quota_fam[j][1]);
+        for (i = 0; i < ccnd_quota_slots(h->quota); i++) {
+            if (ccnd_quota_get(h->quota, i, &name, &size, &v[0], &v[1],
+                               &objects, &v[3]) < 0)
+                continue;
+            v[2] = objects;
+            label->length = 0;
+            ccn_uri_append(label, name, size, 1);
+            ccn_charbuf_putf(b, "%s%s{prefix=\"%s\"} %ju" NL,
+                             quota_fam[j][0], j == 3 ? "_total" : "",
+                             ccn_charbuf_as_string(label), v[j]);
+        }
+    }
+    for (j = 0; j < 4 && h->fresh_rules > 1; j++) {
+        metric_head(b, rule_fam[j][0], rule_fam[j][1]);
+        for (i = 1; i < h->fresh_rules; i++) {
+            r = &h->fresh_rule[i];
+            if (r->npe == NULL && r->objects == 0)
+                continue;
+            v[0] = r->objects;
+            v[1] = r->bytes;
+            v[2] = r->staled;
+            v[3] = r->removed;
+            label->length = 0;
+            ccn_uri_append(label, r->name->buf, r->name->length, 1);
+            ccn_charbuf_putf(b, "%s%s{prefix=\"%s\"} %ju" NL,
+                             rule_fam[j][0], j >= 2 ? "_total" : "",
+                             ccn_charbuf_as_string(label), v[j]);
+        }
+    }
+    ccn_charbuf_destroy(&label);
+}
+
+/**
+ * What each traffic class has sent, and how long it waited
+ */
+static void
+collect_class_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    static const char *fam[3] = {
+        "ccnd_class_content_sent",
+        "ccnd_class_content_bytes",
+        "ccnd_class_interests",
+    };
+    char labels[16];
+    uintmax_t v[3];
+    int i, k;
+    
+    for (i = 0; i < 3; i++) {
+        metric_head(b, fam[i], "counter");
+        for (k = 0; k < CCND_TC_N; k++) {
+            v[0] = h->tc_sent[k];
+            v[1] = h->tc_bytes[k];
+            v[2] = h->tc_interests[k];
+            ccn_charbuf_putf(b, "%s_total{class=\"%d\"} %ju" NL,
+                             fam[i], k, v[i]);
+        }
+    }
+    metric_head(b, "ccnd_class_interest_latency_seconds", "summary");
+    for (k = 0; k < CCND_TC_N; k++) {
+        snprintf(labels, sizeof(labels), "class=\"%d\"", k);
+        metric_summary(b, "ccnd_class_interest_latency_seconds", labels,
+                       &h->tc_lat[k]);
+    }
+    metric_head(b, "ccnd_class_queue_wait_seconds", "summary");
+    for (k = 0; k < CCND_TC_N; k++) {
+        snprintf(labels, sizeof(labels), "class=\"%d\"", k);
+        metric_summary(b, "ccnd_class_queue_wait_seconds", labels,
+                       &h->tc_wait[k]);
+    }
+    metric_value(b, "ccnd_outq_jumps", "counter", h->tc_jumps);
+    metric_value(b, "ccnd_mgmt_interests", "counter", h->mgmt_interests);
+    metric_value(b, "ccnd_mgmt_dropped", "counter", h->mgmt_dropped);
+    metric_value(b, "ccnd_mgmt_waiting", "gauge", h->mgmtq.n);
+    metric_head(b, "ccnd_mgmt_seconds", "summary");
+    metric_summary(b, "ccnd_mgmt_seconds", "stage=\"queued\"",
+                   &h->mgmt_wait);
+    metric_summary(b, "ccnd_mgmt_seconds", "stage=\"answered\"",
+                   &h->mgmt_lat);
+    metric_value(b, "ccnd_notice_batches", "counter", h->notice_batches);
+    metric_value(b, "ccnd_notice_records", "counter", h->notice_records);
+    metric_value(b, "ccnd_notice_unsent", "counter", h->notice_unsent);
+}
+
+/**
+ * The metrics that cost the same no matter how big things get
+ */
+static void
+collect_global_metrics(struct ccnd_handle *h, struct ccn_charbuf *b)
+{
+    unsigned long held;
+    uintmax_t false_hits;
+    uintmax_t bytes, written, read, bad;
+    uintmax_t issued, landed, used, wasted;
+    size_t isize, ishared;
+    
+    metric_head(b, "ccnd_start_time_seconds", "gauge");
+    ccn_charbuf_putf(b, "ccnd_start_time_seconds %ld.%06u" NL,
+                     h->starttime, h->starttime_usec);
+    metric_value(b, "ccnd_faces", "gauge",
+                 hashtb_n(h->faces_by_fd) + hashtb_n(h->dgram_faces));
+    metric_value(b, "ccnd_content_accessioned", "counter", h->accession);
+    metric_value(b, "ccnd_content_stored", "gauge", ccnd_content_count(h));
+    metric_value(b, "ccnd_content_stale", "gauge", h->n_stale);
+    metric_value(b, "ccnd_content_duplicates", "counter",
+                 h->content_dups_recvd);
+    metric_value(b, "ccnd_content_sent", "counter", h->content_items_sent);
+    metric_value(b, "ccnd_content_unsolicited", "counter",
+                 h->content_unsolicited);
+    metric_value(b, "ccnd_content_passed", "counter", h->content_passed);
+    metric_value(b, "ccnd_content_store_bytes", "gauge", h->content_bytes);
+    metric_value(b, "ccnd_content_store_overhead_bytes", "gauge",
+                 h->content_overhead);
+    metric_value(b, "ccnd_name_prefixes", "gauge",
+                 ccnd_intern_counts(h->intern, &isize, &ishared));
+    metric_value(b, "ccnd_name_prefix_bytes", "gauge", isize);
+    metric_value(b, "ccnd_name_prefix_shared_bytes", "gauge", ishared);
+    metric_value(b, "ccnd_content_compressed", "gauge", h->compressed);
+    metric_value(b, "ccnd_content_compressed_in_bytes", "gauge",
+                 h->compressed_in);
+    metric_value(b, "ccnd_content_compressed_out_bytes", "gauge",
+                 h->compressed_out);
+    metric_value(b, "ccnd_content_compress_tries", "counter",
+                 h->compress_tries);
+    metric_value(b, "ccnd_content_compress_cpu_usec", "counter",
+                 h->compress_usec);
+    metric_value(b, "ccnd_content_expansions", "counter", h->expansions);
+    metric_value(b, "ccnd_content_expand_cpu_usec", "counter",
+                 h->expand_usec);
+    metric_value(b, "ccnd_content_store_hits", "counter", h->cache_hits);
+    metric_value(b, "ccnd_content_store_misses", "counter", h->cache_misses);
+    metric_value(b, "ccnd_content_evicted", "counter",
+                 ccnd_meter_total(h->evictions));
+    metric_value(b, "ccnd_names", "gauge", hashtb_n(h->nameprefix_tab));
+    metric_value(b, "ccnd_interests_pending", "gauge", h->pit_pending);
+    metric_value(b, "ccnd_interests_accepted", "counter",
+                 h->interests_accepted);
+    metric_value(b, "ccnd_interests_dropped", "counter", h->interests_dropped);
+    metric_value(b, "ccnd_interests_sent", "counter", h->interests_sent);
+    metric_value(b, "ccnd_interests_stuffed", "counter", h->interests_stuffed);
+    metric_value(b, "ccnd_interests_retried", "counter", h->interests_retried);
+    metric_value(b, "ccnd_interests_limited", "counter", h->interests_limited);
+    metric_value(b, "ccnd_interests_nacked", "counter", h->interests_nacked);
+    metric_value(b, "ccnd_interests_negcached", "counter",
+                 h->interests_negcached);
+    metric_value(b, "ccnd_pit_entries", "gauge", hashtb_n(h->propagating_tab));
+    metric_value(b, "ccnd_pit_message_bytes", "gauge", h->pit_msg_bytes);
+    metric_value(b, "ccnd_pit_slab_bytes", "gauge", h->pit_slab_bytes);
+    if (h->pit_limit != 0 || h->pit_byte_limit != 0) {
+        metric_value(b, "ccnd_pit_usage_permille", "gauge",
+                     ccnd_pit_usage(h));
+        metric_value(b, "ccnd_pit_faces", "gauge", h->pit_faces);
+        metric_value(b, "ccnd_interests_shortened", "counter",
+                     h->interests_shortened);
+    }
+    if (h->dnl != NULL) {
+        ccnd_dnl_counts(h->dnl, &held, &false_hits);
+        metric_value(b, "ccnd_dead_nonces", "gauge", held);
+        metric_value(b, "ccnd_interests_looped", "counter",
+                     h->interests_looped);
+        metric_value(b, "ccnd_dead_nonce_false_matches", "counter",
+                     false_hits);
+    }
+    if (h->disk != NULL) {
+        /* The object count takes a pass over the index, so leave it out */
+        ccnd_disk_counts(h->disk, &bytes, &written, &read, &bad);
+        metric_value(b, "ccnd_disk_bytes", "gauge", bytes);
+        metric_value(b, "ccnd_disk_writes", "counter", written);
+        metric_value(b, "ccnd_disk_reads", "counter", read);
+        metric_value(b, "ccnd_disk_unreadable", "counter", bad);
+    }
+    if (h->prefetch != NULL) {
+        issued = ccnd_prefetch_counts(h->prefetch, &landed, &used, &wasted);
+        metric_value(b, "ccnd_prefetch_interests", "counter", issued);
+        metric_value(b, "ccnd_prefetch_arrived", "counter", landed);
+        metric_value(b, "ccnd_prefetch_used", "counter", used);
+        metric_value(b, "ccnd_prefetch_unused", "counter", wasted);
+    }
+    if (h->nshards > 1) {
+        metric_value(b, "ccnd_shard", "gauge", h->shard);
+        metric_value(b, "ccnd_shard_handoffs", "counter", h->shard_out);
+        metric_value(b, "ccnd_shard_takeovers", "counter", h->shard_in);
+    }
+    if (h->cpu >= 0) {
+        metric_value(b, "ccnd_cpu", "gauge", h->cpu);
+        if (h->numa_node >= 0)
+            metric_value(b, "ccnd_numa_node", "gauge", h->numa_node);
+        metric_value(b, "ccnd_cross_node_datagrams", "counter", h->xnode_in);
+        metric_value(b, "ccnd_cross_node_handoffs", "counter", h->xnode_out);
+    }
+    metric_head(b, "ccnd_interest_latency_seconds", "summary");
+    metric_summary(b, "ccnd_interest_latency_seconds", "source=\"store\"",
+                   &h->lat_store);
+    metric_summary(b, "ccnd_interest_latency_seconds", "source=\"upstream\"",
+                   &h->lat_upstream);
+    collect_class_metrics(h, b);
+    collect_store_metrics(h, b);
+    collect_cs_metrics(h, b);
+    collect_scheduler_metrics(h, b);
+    collect_memory_metrics(h, b);
+}
+
+/**
+ * Collect the per-face metrics for some face slots.
+ * @returns nonzero when all the faces have been done
+ */
+static int
+scrape_faces(struct ccnd_handle *h, struct ccnd_scrape *s)
+{
+    struct face *face;
+    uintmax_t v[SCRAPE_NF];
+    int n;
+    int k;
+    
+    for (n = 0; n < SCRAPE_CHUNK && s->slot < h->face_limit; s->slot++) {
+        face = h->faces_by_faceid[s->slot];
+        if (face == NULL ||
+            (face->flags & (CCN_FACE_UNDECIDED | CCN_FACE_PASSIVE)) != 0)
+            continue;
+        v[0] = ccnd_meter_total(face->meter[FM_BYTI]);
+        v[1] = ccnd_meter_total(face->meter[FM_BYTO]);
+        v[2] = ccnd_meter_total(face->meter[FM_DATI]);
+        v[3] = ccnd_meter_total(face->meter[FM_DATO]);
+        v[4] = ccnd_meter_total(face->meter[FM_INTI]);
+        v[5] = ccnd_meter_total(face->meter[FM_INTO]);
+        v[6] = face->pending_interests;
+        v[7] = face_queued_content(face);
+        v[8] = face->shaper.drops;
+        for (k = 0; k < SCRAPE_NF; k++)
+            ccn_charbuf_putf(s->fam[k], "%s%s{face=\"%u\"} %ju" NL,
+                             scrape_face_family[k][0],
+                             strcmp(scrape_face_family[k][1], "counter") == 0 ?
+                                 "_total" : "",
+                             face->faceid, v[k]);
+        n++;
+    }
+    return(s->slot >= h->face_limit);
+}
+
+/**
+ * Collect the FIB metrics for some prefixes.
+ *
+ * nameprefix_tab enumerates in order of insertion, so we can pick up
+ * after the last key we saw.  If that entry has gone away in the
+ * meantime, the rest of the FIB is left out and the response says so.
+ * @returns nonzero when the walk is over
+ */
+static int
+scrape_fib(struct ccnd_handle *h, struct ccnd_scrape *s)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_forwarding *f;
+    int n;
+    int walked;
+    int done = 0;
+    
+    hashtb_start(h->nameprefix_tab, e);
+    if (s->fib_started) {
+        if (hashtb_lookup(h->nameprefix_tab, s->key->buf, s->key->length) == NULL) {
+            s->truncated = 1;
+            hashtb_end(e);
+            return(1);
+        }
+        hashtb_seek(e, s->key->buf, s->key->length, 0);
+        hashtb_next(e);
+    }
+    s->fib_started = 1;
+    name = ccn_charbuf_create();
+    for (n = 0, walked = 0;
+         n < SCRAPE_CHUNK && walked < SCRAPE_WALK && e->data != NULL;
+         hashtb_next(e), walked++) {
+        struct nameprefix_entry *ipe = e->data;
+        s->key->length = 0;
+        ccn_charbuf_append(s->key, e->key, e->keysize);
+        for (f = ipe->forwarding; f != NULL; f = f->next) {
+            if ((f->flags & CCN_FORW_ACTIVE) == 0)
+                continue;
+            ccn_name_init(name);
+            ccn_name_append_components(name, e->key, 0, e->keysize);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 0], "%s{prefix=\"",
+                             scrape_fib_family[0][0]);
+            ccn_uri_append(s->fam[SCRAPE_NF + 0], name->buf, name->length, 1);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 0], "\",face=\"%u\"} %u.%06u" NL,
+                             f->faceid, f->srtt / 1000000, f->srtt % 1000000);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 1], "%s{prefix=\"",
+                             scrape_fib_family[1][0]);
+            ccn_uri_append(s->fam[SCRAPE_NF + 1], name->buf, name->length, 1);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 1], "\",face=\"%u\"} %.4f" NL,
+                             f->faceid, f->loss / 65536.0);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 2], "%s{prefix=\"",
+                             scrape_fib_family[2][0]);
+            ccn_uri_append(s->fam[SCRAPE_NF + 2], name->buf, name->length, 1);
+            ccn_charbuf_putf(s->fam[SCRAPE_NF + 2], "\",face=\"%u\"} %d" NL,
+                             f->faceid, f->outstanding);
+        }
+        if (ipe->forwarding != NULL)
+            n++;
+    }
+    done = (e->data == NULL);
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
+    return(done);
+}
+
+static void
+scrape_free(struct ccnd_handle *h, struct ccnd_scrape *s)
+{
+    struct ccnd_scrape **pp;
+    int k;
+    
+    for (pp = &h->scrapes; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == s) {
+            *pp = s->next;
+            break;
+        }
+    }
+    ccn_charbuf_destroy(&s->key);
+    ccn_charbuf_destroy(&s->head);
+    for (k = 0; k < SCRAPE_NF + SCRAPE_NP; k++)
+        ccn_charbuf_destroy(&s->fam[k]);
+    free(s);
+}
+
+/**
+ * Scheduled event that builds a metrics response, one chunk per run,
+ * and sends it when it is complete.
+ */
+static int
+scrape_step(struct ccn_schedule *sched,
+            void *clienth,
+            struct ccn_scheduled_event *ev,
+            int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct ccnd_scrape *s = ev->evdata;
+    struct face *face = NULL;
+    struct ccn_charbuf *b = NULL;
+    int k;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        scrape_free(h, s);
+        return(0);
+    }
+    face = ccnd_face_from_faceid(h, s->faceid);
+    if (face == NULL) {
+        scrape_free(h, s);
+        return(0);
+    }
+    if ((s->want & SCRAPE_FACES) != 0) {
+        if (scrape_faces(h, s))
+            s->want &= ~SCRAPE_FACES;
+        return(1);
+    }
+    if ((s->want & SCRAPE_FIB) != 0) {
+        if (scrape_fib(h, s))
+            s->want &= ~SCRAPE_FIB;
+        return(1);
+    }
+    /* All there, so assemble the response */
+    b = s->head;
+    for (k = 0; k < SCRAPE_NF + SCRAPE_NP; k++) {
+        if (s->fam[k] == NULL || s->fam[k]->length == 0)
+            continue;
+        if (k < SCRAPE_NF)
+            metric_head(b, scrape_face_family[k][0], scrape_face_family[k][1]);
+        else
+            metric_head(b, scrape_fib_family[k - SCRAPE_NF][0],
+                        scrape_fib_family[k - SCRAPE_NF][1]);
+        ccn_charbuf_append_charbuf(b, s->fam[k]);
+    }
+    if (s->fib_started)
+        metric_value(b, "ccnd_metrics_fib_truncated", "gauge", s->truncated);
+    ccn_charbuf_putf(b, "# EOF" NL);
+    send_http_response(h, face, "application/openmetrics-text; version=1.0.0", b);
+    face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+    ccnd_face_io_update(h, face);
+    scrape_free(h, s);
+    return(0);
+}
+
+/**
+ * Answer a request for metrics.
+ *
+ * The global metrics are collected right away.  Faces and the FIB are
+ * only included if asked for, and are gathered in chunks, with other
+ * work going on in between.
+ */
+static void
+start_scrape(struct ccnd_handle *h, struct face *face, int want)
+{
+    struct ccnd_scrape *s;
+    int n;
+    int k;
+    
+    for (n = 0, s = h->scrapes; s != NULL; s = s->next)
+        n++;
+    if (n >= SCRAPE_MAX || (s = calloc(1, sizeof(*s))) == NULL) {
+        ccnd_send(h, face, resp503, strlen(resp503));
+        face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+        return;
+    }
+    s->faceid = face->faceid;
+    s->want = want;
+    s->key = ccn_charbuf_create();
+    s->head = ccn_charbuf_create();
+    for (k = 0; k < SCRAPE_NF + SCRAPE_NP; k++)
+        s->fam[k] = ccn_charbuf_create();
+    collect_global_metrics(h, s->head);
+    s->next = h->scrapes;
+    h->scrapes = s;
+    ccn_schedule_event(h->sched, 0, scrape_step, s, 0);
+}
+
+/* Cached status documents */
+
+static void
+status_reset(struct ccnd_status *s)
+{
+    int k;
+    
+    s->stage = STATUS_FACES;
+    s->slot = 0;
+    s->fib_started = 0;
+    s->truncated = 0;
+    s->key->length = 0;
+    for (k = 0; k < STATUS_NPART; k++)
+        s->part[k]->length = 0;
+}
+
+/**
+ * Add some face slots to the document being built.
+ * @returns nonzero when all the faces have been done
+ */
+static int
+status_faces(struct ccnd_handle *h, struct ccnd_status *s, int fmt)
+{
+    struct ccn_charbuf *nodebuf;
+    struct face *face;
+    int n;
+    
+    nodebuf = ccn_charbuf_create();
+    for (n = 0; n < SCRAPE_CHUNK && s->slot < h->face_limit; s->slot++) {
+        face = h->faces_by_faceid[s->slot];
+        if (face == NULL || (face->flags & CCN_FACE_UNDECIDED) != 0)
+            continue;
+        if (fmt == STATUS_XML)
+            collect_face_xml(h, s->part[STATUS_PART_FACES], face, nodebuf);
+        else {
+            collect_face_html(h, s->part[STATUS_PART_FACES], face, nodebuf);
+            if ((face->flags & CCN_FACE_PASSIVE) == 0)
+                collect_face_meter_html(h, s->part[STATUS_PART_METERS], face);
+        }
+        n++;
+    }
+    ccn_charbuf_destroy(&nodebuf);
+    return(s->slot >= h->face_limit);
+}
+
+/**
+ * Add some of the forwarding table to the document being built.
+ *
+ * This picks up where it left off in the same way as scrape_fib.
+ * @returns nonzero when the walk is over
+ */
+static int
+status_fib(struct ccnd_handle *h, struct ccnd_status *s, int fmt)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = NULL;
+    int n;
+    int walked;
+    int done = 0;
+    
+    hashtb_start(h->nameprefix_tab, e);
+    if (s->fib_started) {
+        if (hashtb_lookup(h->nameprefix_tab, s->key->buf, s->key->length) == NULL) {
+            s->truncated = 1;
+            hashtb_end(e);
+            return(1);
+        }
+        hashtb_seek(e, s->key->buf, s->key->length, 0);
+        hashtb_next(e);
+    }
+    s->fib_started = 1;
+    name = ccn_charbuf_create();
+    for (n = 0, walked = 0;
+         n < SCRAPE_CHUNK && walked < SCRAPE_WALK && e->data != NULL;
+         hashtb_next(e), walked++) {
+        struct nameprefix_entry *ipe = e->data;
+        s->key->length = 0;
+        ccn_charbuf_append(s->key, e->key, e->keysize);
+        if (ipe->forwarding == NULL)
+            continue;
+        ccn_name_init(name);
+        ccn_name_append_components(name, e->key, 0, e->keysize);
+        if (fmt == STATUS_XML)
+            collect_fentry_xml(h, s->part[STATUS_PART_FIB], name, ipe);
+        else
+            collect_fentry_html(h, s->part[STATUS_PART_FIB], name, ipe);
+        n++;
+    }
+    done = (e->data == NULL);
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
+    return(done);
+}
+
+static void
+status_send(struct ccnd_handle *h, struct face *face,
+            struct ccnd_status *s, int fmt)
+{
+    send_http_response(h, face, status_mime_type[fmt], s->doc);
+    face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+    ccnd_face_io_update(h, face);
+}
+
+/**
+ * Scheduled event that builds a status document, one chunk per run,
+ * and answers the waiting requests when it is complete.
+ */
+static int
+status_step(struct ccn_schedule *sched,
+            void *clienth,
+            struct ccn_scheduled_event *ev,
+            int flags)
+{
+    struct ccnd_handle *h = clienth;
+    struct ccnd_status *s = ev->evdata;
+    struct face *face = NULL;
+    int fmt = ev->evint;
+    int i;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        s->builder = NULL;
+        s->waiting->n = 0;
+        status_reset(s);
+        return(0);
+    }
+    if (s->stage == STATUS_FACES) {
+        if (status_faces(h, s, fmt))
+            s->stage = STATUS_FIB;
+        return(1);
+    }
+    if (s->stage == STATUS_FIB) {
+        if (status_fib(h, s, fmt))
+            s->stage = STATUS_DONE;
+        return(1);
+    }
+    /* All there, so put it together */
+    ccn_charbuf_destroy(&s->doc);
+    if (fmt == STATUS_XML)
+        s->doc = collect_stats_xml(h, s);
+    else
+        s->doc = collect_stats_html(h, s);
+    s->sec = h->sec;
+    s->usec = h->usec;
+    s->builder = NULL;
+    status_reset(s);
+    for (i = 0; i < s->waiting->n; i++) {
+        face = ccnd_face_from_faceid(h, s->waiting->buf[i]);
+        if (face != NULL)
+            status_send(h, face, s, fmt);
+    }
+    s->waiting->n = 0;
+    if (s->stale)
+        ccn_charbuf_destroy(&s->doc);
+    s->stale = 0;
+    return(0);
+}
+
+/**
+ * @returns nonzero if the face is waiting for a status document
+ */
+static int
+status_waiting(struct ccnd_handle *h, unsigned faceid)
+{
+    int fmt;
+    
+    for (fmt = 0; fmt < STATUS_N; fmt++)
+        if (h->status[fmt] != NULL &&
+            ccn_indexbuf_member(h->status[fmt]->waiting, faceid) >= 0)
+            return(1);
+    return(0);
+}
+
+/**
+ * Answer a request for a status document.
+ *
+ * A recent enough document is sent right away; otherwise the face
+ * waits for the next one, which is started if need be.
+ */
+static void
+status_request(struct ccnd_handle *h, struct face *face, int fmt)
+{
+    struct ccnd_status *s = h->status[fmt];
+    long long age;
+    int k;
+    
+    if (s == NULL) {
+        s = calloc(1, sizeof(*s));
+        if (s == NULL)
+            goto Busy;
+        s->waiting = ccn_indexbuf_create();
+        s->key = ccn_charbuf_create();
+        for (k = 0; k < STATUS_NPART; k++)
+            s->part[k] = ccn_charbuf_create();
+        h->status[fmt] = s;
+    }
+    if (s->doc != NULL && s->builder == NULL) {
+        age = (long long)(h->sec - s->sec) * 1000000 +
+              ((long long)h->usec - (long long)s->usec);
+        if (age < CCND_STATUS_MICROSEC) {
+            status_send(h, face, s, fmt);
+            return;
+        }
+    }
+    if (s->waiting->n >= STATUS_WAIT_MAX)
+        goto Busy;
+    ccn_indexbuf_append_element(s->waiting, face->faceid);
+    if (s->builder == NULL)
+        s->builder = ccn_schedule_event(h->sched, 0, status_step, s, fmt);
+    return;
+Busy:
+    ccnd_send(h, face, resp503, strlen(resp503));
+    face->flags |= (CCN_FACE_NOSEND | CCN_FACE_CLOSING);
+}
+
+/**
+ * Note that the cached status documents no longer reflect the faces
+ * or the forwarding table.
+ *
+ * One that is being built is still sent to the requests waiting for it,
+ * but is not kept for reuse.
+ */
+void
+ccnd_status_invalidate(struct ccnd_handle *h)
+{
+    struct ccnd_status *s;
+    int fmt;
+    
+    for (fmt = 0; fmt < STATUS_N; fmt++) {
+        s = h->status[fmt];
+        if (s == NULL)
+            continue;
+        if (s->builder != NULL)
+            s->stale = 1;
+        else
+            ccn_charbuf_destroy(&s->doc);
+    }
+}
+
+/**
+ * Free the cached status documents.
+ *
+ * Any that are being built should have been cancelled already,
+ * by destroying the schedule.
+ */
+void
+ccnd_status_destroy(struct ccnd_handle *h)
+{
+    struct ccnd_status *s;
+    int fmt;
+    int k;
+    
+    for (fmt = 0; fmt < STATUS_N; fmt++) {
+        s = h->status[fmt];
+        if (s == NULL)
+            continue;
+        ccn_charbuf_destroy(&s->doc);
+        ccn_indexbuf_destroy(&s->waiting);
+        ccn_charbuf_destroy(&s->key);
+        for (k = 0; k < STATUS_NPART; k++)
+            ccn_charbuf_destroy(&s->part[k]);
+        free(s);
+        h->status[fmt] = NULL;
+    }
+}
+
 /**
  * create and initialize separately allocated meter.
  */
@@ -694,3 +2864,117 @@ ccnd_meter_total(struct ccnd_meter *m)
         return(0);
     return (m->total);
 }
+
+/**
+ * @returns the smallest value counted in bucket i of a ccnd_hist
+ */
+unsigned
+ccnd_hist_bucket_low(int i)
+{
+    int b;
+    
+    if (i < CCND_HIST_SUB)
+        return(i);
+    b = i / CCND_HIST_SUB + CCND_HIST_SUB_BITS - 1;
+    return((unsigned)(CCND_HIST_SUB + i % CCND_HIST_SUB) <<
+           (b - CCND_HIST_SUB_BITS));
+}
+
+/**
+ * Count a latency sample.
+ *
+ * This is cheap enough to do for every interest that is satisfied.
+ */
+void
+ccnd_hist_record(struct ccnd_hist *hist, unsigned usec)
+{
+    unsigned n;
+    int b;
+    int i;
+    
+    if (hist->n >= CCND_HIST_HALF) {
+        for (i = 0, n = 0; i < CCND_HIST_N; i++) {
+            hist->count[i] >>= 1;
+            n += hist->count[i];
+            if (hist->count[i] != 0)
+                hist->max = ccnd_hist_bucket_low(i);
+        }
+        hist->n = n;
+        hist->sum >>= 1;
+    }
+    if (usec < CCND_HIST_SUB)
+        i = usec;
+    else {
+        /* find the most significant bit */
+        for (b = CCND_HIST_SUB_BITS; (usec >> b) > 1; b++)
+            continue;
+        i = (b - CCND_HIST_SUB_BITS + 1) * CCND_HIST_SUB +
+            ((usec >> (b - CCND_HIST_SUB_BITS)) & (CCND_HIST_SUB - 1));
+    }
+    hist->count[i]++;
+    hist->n++;
+    hist->sum += usec;
+    if (usec > hist->max)
+        hist->max = usec;
+}
+
+/**
+ * Estimate a percentile of the samples in a histogram.
+ *
+ * The answer is the top of the bucket holding the percentile, but
+ * never more than the largest sample.
+ * @returns the latency in microseconds, or 0 if there are no samples.
+ */
+unsigned
+ccnd_hist_percentile(const struct ccnd_hist *hist, unsigned pct)
+{
+    uintmax_t want;
+    uintmax_t seen;
+    unsigned ans;
+    int i;
+    
+    if (hist == NULL || hist->n == 0)
+        return(0);
+    want = ((uintmax_t)hist->n * pct + 99) / 100;
+    if (want == 0)
+        want = 1;
+    for (i = 0, seen = 0; i < CCND_HIST_N - 1; i++) {
+        seen += hist->count[i];
+        if (seen >= want)
+            break;
+    }
+    if (i == CCND_HIST_N - 1)
+        return(hist->max);
+    ans = ccnd_hist_bucket_low(i + 1) - 1;
+    if (ans > hist->max)
+        ans = hist->max;
+    return(ans);
+}
+
+/**
+ * Estimate how many of the samples in a histogram are below a value.
+ *
+ * The samples within the bucket holding the value are taken to be
+ * spread evenly across it.
+ */
+unsigned
+ccnd_hist_count_below(const struct ccnd_hist *hist, unsigned value)
+{
+    uintmax_t seen;
+    unsigned lo, hi;
+    int i;
+    
+    if (hist == NULL || hist->n == 0)
+        return(0);
+    for (i = 0, seen = 0; i < CCND_HIST_N - 1; i++) {
+        hi = ccnd_hist_bucket_low(i + 1);
+        if (value < hi)
+            break;
+        seen += hist->count[i];
+    }
+    if (i == CCND_HIST_N - 1)
+        return(seen); /* the top bucket has no useful upper bound */
+    lo = ccnd_hist_bucket_low(i);
+    seen += (uintmax_t)hist->count[i] * (value - lo) / (hi - lo);
+    return(seen);
+}
@@ -0,0 +1,238 @@
+/**
+ * @file ccnd_trace.c
+ *
+ * Binary event tracing for ccnd.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Events are written as fixed-size records into a ring that is mapped
+ * from a file, so that tracing costs a few stores per event, and the
+ * trace survives a crash of ccnd.  The ccndtrace program decodes it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+
+#include "ccnd_private.h"
+#include "ccnd_trace.h"
+
+struct ccnd_trace {
+    struct ccnd_trace_header *hdr;  /**< start of the mapping */
+    struct ccnd_trace_rec *rec;     /**< the ring */
+    size_t maplen;                  /**< bytes mapped */
+    char *path;                     /**< trace file name */
+};
+
+/**
+ * Create (or truncate) a trace file and map it.
+ *
+ * Tracing is left off.
+ * @returns 0 for success, -1 for failure (errno is set).
+ */
+int
+ccnd_trace_open(struct ccnd_handle *h, const char *path, unsigned nrec)
+{
+    struct ccnd_trace *t = NULL;
+    size_t len;
+    void *p;
+    int fd;
+
+    ccnd_trace_close(h);
+    len = sizeof(struct ccnd_trace_header) +
+          (size_t)nrec * sizeof(struct ccnd_trace_rec);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return(-1);
+    if (ftruncate(fd, len) == -1) {
+        close(fd);
+        return(-1);
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return(-1);
+    t = calloc(1, sizeof(*t));
+    if (t == NULL || (t->path = strdup(path)) == NULL) {
+        free(t);
+        munmap(p, len);
+        errno = ENOMEM;
+        return(-1);
+    }
+    t->hdr = p;
+    t->rec = (void *)(t->hdr + 1);
+    t->maplen = len;
+    memcpy(t->hdr->magic, CCND_TRACE_MAGIC, sizeof(t->hdr->magic));
+    t->hdr->recsize = sizeof(struct ccnd_trace_rec);
+    t->hdr->nrec = nrec;
+    t->hdr->head = 0;
+    t->hdr->pid = getpid();
+    t->hdr->on = 0;
+    h->trace = t;
+    h->trace_on = 0;
+    return(0);
+}
+
+/**
+ * Stop tracing and unmap the trace file (which is kept).
+ */
+void
+ccnd_trace_close(struct ccnd_handle *h)
+{
+    struct ccnd_trace *t = h->trace;
+
+    h->trace_on = 0;
+    if (t == NULL)
+        return;
+    t->hdr->on = 0;
+    munmap(t->hdr, t->maplen);
+    free(t->path);
+    free(t);
+    h->trace = NULL;
+}
+
+/**
+ * Turn tracing on or off.
+ *
+ * If there is no trace file yet, one is made in the temporary directory.
+ * @returns the name of the trace file, or NULL if there is none.
+ */
+const char *
+ccnd_trace_enable(struct ccnd_handle *h, int on)
+{
+    struct ccn_charbuf *path = NULL;
+    const char *tmpdir;
+
+    if (h->trace == NULL && on) {
+        tmpdir = getenv("TMPDIR");
+        if (tmpdir == NULL || tmpdir[0] == 0)
+            tmpdir = "/tmp";
+        path = ccn_charbuf_create();
+        ccn_charbuf_putf(path, "%s/ccnd-%d.trace", tmpdir, (int)getpid());
+        if (ccnd_trace_open(h, ccn_charbuf_as_string(path), h->trace_nrec) == -1)
+            ccnd_msg(h, "unable to create trace file %s: %s",
+                     ccn_charbuf_as_string(path), strerror(errno));
+        ccn_charbuf_destroy(&path);
+    }
+    if (h->trace == NULL)
+        return(NULL);
+    h->trace->hdr->on = h->trace_on = (on != 0);
+    ccnd_msg(h, "tracing %s to %s", on ? "on" : "off", h->trace->path);
+    return(h->trace->path);
+}
+
+/**
+ * Copy the values of the components in name[0..len) into label,
+ * as a slash-separated path, with unprintable bytes shown as dots.
+ */
+static void
+trace_label(char *label, const unsigned char *name, size_t len)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    const unsigned char *v = NULL;
+    size_t vs = 0;
+    size_t i;
+    int n = 0;
+
+    d = ccn_buf_decoder_start(&decoder, name, len);
+    while (ccn_buf_match_dtag(d, CCN_DTAG_Component) &&
+           n < CCND_TRACE_LABEL - 1) {
+        ccn_buf_advance(d);
+        vs = 0;
+        if (ccn_buf_match_blob(d, &v, &vs))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+        if (d->decoder.state < 0)
+            break;
+        label[n++] = '/';
+        for (i = 0; i < vs && n < CCND_TRACE_LABEL - 1; i++)
+            label[n++] = (v[i] >= ' ' && v[i] < 0x7f) ? v[i] : '.';
+    }
+    label[n] = 0;
+}
+
+/**
+ * Hash a name for a trace record (32-bit FNV-1a).
+ *
+ * This is unkeyed, unlike hashtb_hash, so the same name hashes the same
+ * in every run and every ccnd, and traces can be compared.
+ */
+static uint32_t
+trace_hash(const unsigned char *p, size_t size)
+{
+    uint32_t x = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        x = (x ^ p[i]) * 16777619U;
+    return(x);
+}
+
+/**
+ * Record an event.
+ *
+ * The caller should check h->trace_on first, to keep the cost down when
+ * tracing is off.
+ *
+ * @param name       start of the name components (or NULL)
+ * @param namelen    bytes of name components
+ * @param prefixlen  bytes in the first CCND_TRACE_PREFIX_COMPS components,
+ *                   or 0 to leave out the prefix hash and label
+ */
+void
+ccnd_trace_event(struct ccnd_handle *h, int event, unsigned faceid,
+                 const unsigned char *name, size_t namelen, size_t prefixlen,
+                 int ncomps, unsigned size, unsigned aux)
+{
+    struct ccnd_trace *t = h->trace;
+    struct ccnd_trace_rec *r;
+    struct timeval now;
+    uint64_t seq;
+
+    if (t == NULL || !h->trace_on)
+        return;
+    seq = t->hdr->head;
+    r = &t->rec[seq % t->hdr->nrec];
+    gettimeofday(&now, NULL);
+    r->usec = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+    r->event = event;
+    r->ncomps = ncomps > 255 ? 255 : ncomps;
+    r->size = size > 65535 ? 65535 : size;
+    r->faceid = faceid;
+    r->namehash = (name == NULL) ? 0 : trace_hash(name, namelen);
+    r->prefixhash = 0;
+    r->label[0] = 0;
+    if (name != NULL && prefixlen != 0) {
+        r->prefixhash = trace_hash(name, prefixlen);
+        trace_label(r->label, name, prefixlen);
+    }
+    r->aux = aux;
+    r->seq = (uint32_t)seq;
+    t->hdr->head = seq + 1;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file ccnd_trace.h
+ *
+ * Layout of the ccnd binary event trace, shared by ccnd and ccndtrace.
+ *
+ * Part of ccnd - the CCNx Daemon.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CCND_TRACE_DEFINED
+#define CCND_TRACE_DEFINED
+
+#include <stdint.h>
+
+/**
+ * The trace file is a header followed by a ring of fixed-size records.
+ * ccnd is the only writer.  It fills in a record and then advances head,
+ * so a reader (even of a live file) takes the records from
+ * head - nrec (or 0) up to head, and skips any whose seq does not match
+ * its position, since those were overwritten while it was looking.
+ * Values are in host byte order.
+ */
+#define CCND_TRACE_MAGIC "CCNDTRC1"
+#define CCND_TRACE_LABEL 32         /**< bytes of name text in a record */
+#define CCND_TRACE_PREFIX_COMPS 2   /**< components hashed as the prefix */
+
+struct ccnd_trace_header {
+    char magic[8];                  /**< CCND_TRACE_MAGIC, no terminator */
+    uint32_t recsize;               /**< sizeof(struct ccnd_trace_rec) */
+    uint32_t nrec;                  /**< ring capacity, in records */
+    volatile uint64_t head;         /**< records written so far */
+    uint32_t pid;                   /**< of the ccnd writing the trace */
+    volatile uint32_t on;           /**< nonzero while tracing */
+    unsigned char pad[32];
+};
+
+/**
+ * Trace event types
+ */
+enum ccnd_trace_event {
+    CCND_TR_NONE = 0,
+    CCND_TR_INTEREST_IN,            /**< aux: 0 */
+    CCND_TR_INTEREST_OUT,           /**< aux: faceid of the requester */
+    CCND_TR_CONTENT_IN,             /**< aux: accession */
+    CCND_TR_CONTENT_OUT,            /**< aux: accession */
+    CCND_TR_CS_HIT,                 /**< aux: accession */
+    CCND_TR_PIT_INSERT,             /**< aux: lifetime (usec) */
+    CCND_TR_PIT_SATISFY,            /**< aux: latency (usec) */
+    CCND_TR_PIT_EXPIRE,             /**< aux: time pending (usec) */
+    CCND_TR_FACE_UP,                /**< aux: face flags */
+    CCND_TR_FACE_DOWN,              /**< aux: face flags */
+    CCND_TR_N
+};
+
+/**
+ * One traced event
+ *
+ * namehash covers the name components of the interest (for content,
+ * all but the digest).  prefixhash covers the first
+ * CCND_TRACE_PREFIX_COMPS of them, and label holds their text; these
+ * two are filled in only for CCND_TR_INTEREST_IN, CCND_TR_CONTENT_IN
+ * and CCND_TR_CS_HIT, so other events are tied to a prefix by namehash.
+ * Both are 32-bit FNV-1a of the ccnb-encoded components, the same in
+ * every ccnd.
+ */
+struct ccnd_trace_rec {
+    uint64_t usec;                  /**< time of day, in microseconds */
+    uint8_t event;                  /**< enum ccnd_trace_event */
+    uint8_t ncomps;                 /**< name components (at most 255) */
+    uint16_t size;                  /**< message size (at most 65535) */
+    uint32_t faceid;
+    uint32_t namehash;
+    uint32_t prefixhash;
+    uint32_t aux;                   /**< see enum ccnd_trace_event */
+    uint32_t seq;                   /**< low bits of the record number */
+    char label[CCND_TRACE_LABEL];   /**< prefix as text, or empty */
+};
+
+#endif
@@ -0,0 +1,349 @@
+/**
+ * @file ccndtrace.c
+ * Decode the binary event trace written by ccnd.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <ccn/hashtb.h>
+
+#include "ccnd_trace.h"
+
+static const char *event_names[CCND_TR_N] = {
+    "none", "int-in", "int-out", "con-in", "con-out", "cs-hit",
+    "pit-ins", "pit-sat", "pit-exp", "face-up", "face-down"
+};
+
+/** Per-prefix summary */
+struct prefix_sum {
+    char label[CCND_TRACE_LABEL];
+    unsigned interests;
+    unsigned hits;
+    unsigned expired;
+    unsigned n;                 /**< satisfied, with latency samples */
+    unsigned limit;             /**< allocated samples */
+    uint32_t *lat;              /**< latency samples (usec) */
+};
+
+/** The live part of the ring, oldest first */
+struct trace_view {
+    const struct ccnd_trace_header *hdr;
+    const struct ccnd_trace_rec *rec;
+    uint64_t first;
+    uint64_t last;
+};
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-p] [-f] file\n"
+            "   Decode a ccnd event trace (see CCND_TRACE).\n"
+            "   With no options, list the events.\n"
+            "   -p  per-prefix latency summary\n"
+            "   -f  events grouped into per-name flows\n",
+            progname);
+    exit(1);
+}
+
+/**
+ * @returns the record at position i, or NULL if it was overwritten
+ */
+static const struct ccnd_trace_rec *
+view_rec(const struct trace_view *v, uint64_t i)
+{
+    const struct ccnd_trace_rec *r = &v->rec[i % v->hdr->nrec];
+
+    if (r->seq != (uint32_t)i)
+        return(NULL);
+    return(r);
+}
+
+static void
+print_rec(const struct ccnd_trace_rec *r, uint64_t t0)
+{
+    const char *ev = "?";
+
+    if (r->event < CCND_TR_N)
+        ev = event_names[r->event];
+    printf("%12.6f %-9s face=%-4u name=%08x ncomps=%-3u size=%-5u aux=%-10u %s\n",
+           (double)(r->usec - t0) / 1e6, ev, (unsigned)r->faceid,
+           (unsigned)r->namehash, (unsigned)r->ncomps, (unsigned)r->size,
+           (unsigned)r->aux, r->label);
+}
+
+static void
+dump_events(const struct trace_view *v, uint64_t t0)
+{
+    const struct ccnd_trace_rec *r;
+    uint64_t i;
+
+    for (i = v->first; i < v->last; i++) {
+        r = view_rec(v, i);
+        if (r != NULL)
+            print_rec(r, t0);
+    }
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return((x > y) - (x < y));
+}
+
+static uint32_t
+percentile(const struct prefix_sum *p, int pct)
+{
+    unsigned k;
+
+    if (p->n == 0)
+        return(0);
+    k = ((uint64_t)p->n * pct + 99) / 100;
+    if (k > 0)
+        k--;
+    return(p->lat[k]);
+}
+
+/**
+ * Summarize latency by prefix.
+ *
+ * Only INTEREST_IN, CONTENT_IN and CS_HIT records carry the prefix,
+ * so the PIT events are tied to it through the name hash.
+ */
+static void
+prefix_summary(const struct trace_view *v)
+{
+    struct hashtb *names = hashtb_create(sizeof(uint32_t), NULL);
+    struct hashtb *prefixes = hashtb_create(sizeof(struct prefix_sum), NULL);
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    const struct ccnd_trace_rec *r;
+    struct prefix_sum *p;
+    uint32_t *ph;
+    uint32_t unknown = 0;
+    uint64_t i;
+    int res;
+
+    for (i = v->first; i < v->last; i++) {
+        r = view_rec(v, i);
+        if (r == NULL || r->namehash == 0)
+            continue;
+        hashtb_start(names, e);
+        if (r->prefixhash != 0) {
+            res = hashtb_seek(e, &r->namehash, sizeof(r->namehash), 0);
+            ph = e->data;
+            if (res >= 0)
+                *ph = r->prefixhash;
+            hashtb_end(e);
+            hashtb_start(prefixes, e);
+            res = hashtb_seek(e, &r->prefixhash, sizeof(r->prefixhash), 0);
+            p = e->data;
+            if (res == HT_NEW_ENTRY)
+                memcpy(p->label, r->label, sizeof(p->label));
+        }
+        else {
+            ph = hashtb_lookup(names, &r->namehash, sizeof(r->namehash));
+            hashtb_end(e);
+            hashtb_start(prefixes, e);
+            res = hashtb_seek(e, ph != NULL ? ph : &unknown,
+                              sizeof(unknown), 0);
+            p = e->data;
+            if (res == HT_NEW_ENTRY)
+                strcpy(p->label, "(unknown)");
+        }
+        hashtb_end(e);
+        if (p == NULL)
+            continue;
+        switch (r->event) {
+            case CCND_TR_INTEREST_IN:
+                p->interests++;
+                break;
+            case CCND_TR_CS_HIT:
+                p->hits++;
+                break;
+            case CCND_TR_PIT_EXPIRE:
+                p->expired++;
+                break;
+            case CCND_TR_PIT_SATISFY:
+                if (p->n == p->limit) {
+                    uint32_t *lat;
+                    lat = realloc(p->lat, 2 * (p->limit + 16) * sizeof(*lat));
+                    if (lat == NULL)
+                        break;
+                    p->lat = lat;
+                    p->limit = 2 * (p->limit + 16);
+                }
+                p->lat[p->n++] = r->aux;
+                break;
+            default:
+                break;
+        }
+    }
+    printf("%-32s %9s %7s %7s %9s %10s %10s %10s %10s\n",
+           "prefix", "interests", "cshits", "expired", "satisfied",
+           "p50usec", "p90usec", "p99usec", "maxusec");
+    for (hashtb_start(prefixes, e); e->data != NULL; hashtb_next(e)) {
+        p = e->data;
+        if (p->interests + p->hits + p->expired + p->n == 0)
+            continue;
+        if (p->n > 0)
+            qsort(p->lat, p->n, sizeof(p->lat[0]), cmp_u32);
+        printf("%-32s %9u %7u %7u %9u %10u %10u %10u %10u\n",
+               p->label, p->interests, p->hits, p->expired, p->n,
+               (unsigned)percentile(p, 50), (unsigned)percentile(p, 90),
+               (unsigned)percentile(p, 99),
+               (unsigned)(p->n > 0 ? p->lat[p->n - 1] : 0));
+        free(p->lat);
+    }
+    hashtb_end(e);
+    hashtb_destroy(&prefixes);
+    hashtb_destroy(&names);
+}
+
+static const struct trace_view *sort_view;
+
+static int
+cmp_flow(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    uint32_t hx = sort_view->rec[x % sort_view->hdr->nrec].namehash;
+    uint32_t hy = sort_view->rec[y % sort_view->hdr->nrec].namehash;
+
+    if (hx != hy)
+        return((hx > hy) - (hx < hy));
+    return((x > y) - (x < y));
+}
+
+/**
+ * List the events for each name together, in time order.
+ */
+static void
+flow_timelines(const struct trace_view *v, uint64_t t0)
+{
+    const struct ccnd_trace_rec *r;
+    uint64_t *order;
+    uint32_t prev = 0;
+    size_t n = 0;
+    size_t k;
+    uint64_t i;
+
+    order = calloc(v->last - v->first + 1, sizeof(*order));
+    if (order == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = v->first; i < v->last; i++) {
+        r = view_rec(v, i);
+        if (r != NULL && r->namehash != 0)
+            order[n++] = i;
+    }
+    sort_view = v;
+    qsort(order, n, sizeof(order[0]), cmp_flow);
+    for (k = 0; k < n; k++) {
+        r = view_rec(v, order[k]);
+        if (r == NULL)
+            continue;
+        if (k == 0 || r->namehash != prev)
+            printf("\nflow %08x\n", (unsigned)r->namehash);
+        prev = r->namehash;
+        print_rec(r, t0);
+    }
+    free(order);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct trace_view view = {0};
+    const struct ccnd_trace_rec *r;
+    struct stat st;
+    void *map;
+    uint64_t t0 = 0;
+    uint64_t i;
+    int pflag = 0;
+    int fflag = 0;
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "hpf")) != -1) {
+        switch (opt) {
+            case 'p':
+                pflag = 1;
+                break;
+            case 'f':
+                fflag = 1;
+                break;
+            default:
+                usage(progname);
+        }
+    }
+    if (optind != argc - 1)
+        usage(progname);
+    fd = open(argv[optind], O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if (st.st_size < sizeof(struct ccnd_trace_header)) {
+        fprintf(stderr, "%s: too short for a trace\n", argv[optind]);
+        exit(1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+    view.hdr = map;
+    view.rec = (const void *)(view.hdr + 1);
+    if (memcmp(view.hdr->magic, CCND_TRACE_MAGIC, sizeof(view.hdr->magic)) != 0 ||
+        view.hdr->recsize != sizeof(struct ccnd_trace_rec) ||
+        view.hdr->nrec == 0 ||
+        st.st_size < sizeof(struct ccnd_trace_header) +
+                     (uint64_t)view.hdr->nrec * sizeof(struct ccnd_trace_rec)) {
+        fprintf(stderr, "%s: not a ccnd trace of this version\n", argv[optind]);
+        exit(1);
+    }
+    view.last = view.hdr->head;
+    view.first = view.last > view.hdr->nrec ? view.last - view.hdr->nrec : 0;
+    for (i = view.first; i < view.last && t0 == 0; i++) {
+        r = view_rec(&view, i);
+        if (r != NULL)
+            t0 = r->usec;
+    }
+    fprintf(stderr, "ccnd pid %u, %llu records (%llu in ring), tracing %s\n",
+            (unsigned)view.hdr->pid, (unsigned long long)view.last,
+            (unsigned long long)(view.last - view.first),
+            view.hdr->on ? "on" : "off");
+    if (pflag)
+        prefix_summary(&view);
+    if (fflag)
+        flow_timelines(&view, t0);
+    if (!pflag && !fflag)
+        dump_events(&view, t0);
+    munmap(map, st.st_size);
+    exit(0);
+}
@@ -0,0 +1,643 @@
+/**
+ * @file ccnloadgen.c
+ * Generate a steady interest load against ccnd.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The consumers ask for names of the form prefix/k, with k from 0 to N-1
+ * chosen with a Zipf (or uniform) popularity.  Each consumer has its own
+ * connection to ccnd.  In closed-loop mode each consumer keeps a fixed
+ * number of interests outstanding; in open-loop mode the interests are
+ * expressed at a target rate, whether or not they are answered.
+ *
+ * The consumers are spread over several worker processes, since a ccn
+ * handle belongs to a single event loop.  Each worker sends the parent
+ * its counts and a latency histogram once a second, over a pipe, and
+ * the parent prints the totals for each second as they complete.
+ *
+ * The producer (-P) answers every interest under the prefix with made-up
+ * content, signing each name only once.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/hashtb.h>
+#include <ccn/uri.h>
+
+#define LOADGEN_MAXWORKERS 64
+#define LOADGEN_MAXCONSUMERS 256    /**< per worker */
+#define LOADGEN_MAXPAYLOAD 8192
+
+/*
+ * Latency histogram, with the same buckets as ccnd uses: below
+ * LG_HIST_SUB each value has its own bucket, and above that each power
+ * of two is split into LG_HIST_SUB buckets.
+ */
+#define LG_HIST_SUB_BITS 3
+#define LG_HIST_SUB (1 << LG_HIST_SUB_BITS)
+#define LG_HIST_N ((33 - LG_HIST_SUB_BITS) * LG_HIST_SUB)
+
+/** What a worker sends to the parent for each second */
+struct loadgen_report {
+    unsigned second;
+    unsigned sent;
+    unsigned satisfied;
+    unsigned lost;              /**< timed out */
+    unsigned lat[LG_HIST_N];    /**< latency of those satisfied */
+};
+
+struct loadgen_params {
+    struct ccn_charbuf *prefix;
+    unsigned workers;
+    unsigned consumers;         /**< per worker */
+    unsigned names;
+    double zipf;                /**< 0 for uniform */
+    double rate;                /**< interests/s in all, 0 for closed loop */
+    unsigned window;            /**< per consumer, closed loop */
+    unsigned seconds;
+    unsigned seed;
+    unsigned payload;           /**< producer content size */
+    double *cdf;                /**< popularity, cumulative, by name */
+};
+
+struct loadgen_request {
+    struct ccn_closure closure;
+    struct loadgen_consumer *consumer;
+    uint64_t sent;
+};
+
+struct loadgen_consumer {
+    struct ccn *h;
+    unsigned outstanding;
+    struct loadgen_report *report; /**< the current second */
+};
+
+struct loadgen_producer {
+    struct ccn_closure closure;
+    struct hashtb *content;     /**< Name -> signed ContentObject */
+    unsigned payload;
+    unsigned answered;
+};
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-t workers] [-c consumers] [-N names] [-z zipf] "
+            "[-r rate | -w window] [-d seconds] [-s seed] ccnx:/prefix\n"
+            "%s -P [-p payload] [-d seconds] ccnx:/prefix\n"
+            "   Express interests for prefix/0 to prefix/N-1 with Zipf\n"
+            "   popularity, and print sent, satisfied, lost and latency\n"
+            "   percentiles (usec) for each second.\n"
+            "   -t  worker processes (default 1)\n"
+            "   -c  consumers per worker, each with a connection (default 1)\n"
+            "   -N  distinct names (default 10000)\n"
+            "   -z  Zipf exponent; 0 for uniform (default 1.0)\n"
+            "   -r  open loop: interests per second, over all consumers\n"
+            "   -w  closed loop: interests outstanding per consumer (default 1)\n"
+            "   -d  seconds to run (default 10; for -P, until killed)\n"
+            "   -s  random seed\n"
+            "   -P  be the producer for the prefix instead\n"
+            "   -p  bytes of content for each name, with -P (default 1024)\n",
+            progname, progname);
+    exit(1);
+}
+
+static uint64_t
+now_usec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+static void
+hist_record(unsigned *hist, unsigned usec)
+{
+    int b;
+    int i;
+
+    if (usec < LG_HIST_SUB)
+        i = usec;
+    else {
+        for (b = LG_HIST_SUB_BITS; (usec >> b) > 1; b++)
+            continue;
+        i = (b - LG_HIST_SUB_BITS + 1) * LG_HIST_SUB +
+            ((usec >> (b - LG_HIST_SUB_BITS)) & (LG_HIST_SUB - 1));
+    }
+    hist[i]++;
+}
+
+/**
+ * @returns the top of the bucket holding the given percentile
+ */
+static unsigned
+hist_percentile(const unsigned *hist, unsigned pct)
+{
+    uintmax_t n, want, seen;
+    int b, i;
+
+    for (i = 0, n = 0; i < LG_HIST_N; i++)
+        n += hist[i];
+    if (n == 0)
+        return(0);
+    want = (n * pct + 99) / 100;
+    for (i = 0, seen = 0; i < LG_HIST_N - 1; i++) {
+        seen += hist[i];
+        if (seen >= want)
+            break;
+    }
+    if (i == LG_HIST_N - 1)
+        return(UINT_MAX);
+    i++;
+    if (i < LG_HIST_SUB)
+        return(i - 1);
+    b = i / LG_HIST_SUB + LG_HIST_SUB_BITS - 1;
+    return(((unsigned)(LG_HIST_SUB + i % LG_HIST_SUB) <<
+            (b - LG_HIST_SUB_BITS)) - 1);
+}
+
+/**
+ * Make the cumulative popularity of the names.
+ */
+static double *
+make_cdf(unsigned n, double s)
+{
+    double *cdf = calloc(n, sizeof(*cdf));
+    double sum = 0;
+    unsigned i;
+
+    if (cdf == NULL)
+        return(NULL);
+    for (i = 0; i < n; i++) {
+        sum += (s == 0) ? 1.0 : pow(i + 1, -s);
+        cdf[i] = sum;
+    }
+    for (i = 0; i < n; i++)
+        cdf[i] /= sum;
+    return(cdf);
+}
+
+static unsigned
+choose_name(const struct loadgen_params *p)
+{
+    double u = random() / (RAND_MAX + 1.0);
+    unsigned lo = 0;
+    unsigned hi = p->names - 1;
+    unsigned mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (p->cdf[mid] > u)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return(lo);
+}
+
+static struct ccn *
+connect_ccnd(const char *progname)
+{
+    struct ccn *h = ccn_create();
+
+    if (ccn_connect(h, NULL) == -1) {
+        fprintf(stderr, "%s: ", progname);
+        perror("could not connect to ccnd");
+        exit(1);
+    }
+    return(h);
+}
+
+static enum ccn_upcall_res
+incoming_content(struct ccn_closure *selfp,
+                 enum ccn_upcall_kind kind,
+                 struct ccn_upcall_info *info)
+{
+    struct loadgen_request *req = selfp->data;
+    struct loadgen_consumer *c = req->consumer;
+
+    switch (kind) {
+        case CCN_UPCALL_FINAL:
+            free(req);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_INTEREST_TIMED_OUT:
+            c->report->lost++;
+            c->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+        case CCN_UPCALL_CONTENT_BAD:
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+        case CCN_UPCALL_CONTENT_RAW:
+            hist_record(c->report->lat, now_usec() - req->sent);
+            c->report->satisfied++;
+            c->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        default:
+            return(CCN_UPCALL_RESULT_OK);
+    }
+}
+
+static int
+express(const struct loadgen_params *p, struct loadgen_consumer *c,
+        struct ccn_charbuf *name, struct ccn_charbuf *templ)
+{
+    struct loadgen_request *req;
+    char num[16];
+    int res;
+
+    ccn_charbuf_reset(name);
+    ccn_charbuf_append_charbuf(name, p->prefix);
+    snprintf(num, sizeof(num), "%u", choose_name(p));
+    ccn_name_append_str(name, num);
+    req = calloc(1, sizeof(*req));
+    if (req == NULL)
+        return(-1);
+    req->closure.p = &incoming_content;
+    req->closure.data = req;
+    req->consumer = c;
+    req->sent = now_usec();
+    res = ccn_express_interest(c->h, name, &req->closure, templ);
+    if (res < 0)
+        return(-1);
+    c->outstanding++;
+    c->report->sent++;
+    return(0);
+}
+
+/**
+ * Run the consumers of one worker, sending a report to fd each second.
+ */
+static void
+run_worker(const char *progname, const struct loadgen_params *p,
+           unsigned worker, int fd)
+{
+    struct loadgen_consumer c[LOADGEN_MAXCONSUMERS];
+    struct pollfd fds[LOADGEN_MAXCONSUMERS];
+    struct loadgen_report report;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    uint64_t t0, now, next;
+    double rate = p->rate / p->workers;
+    uintmax_t issued = 0;
+    uintmax_t due;
+    unsigned k;
+
+    srandom(p->seed + worker);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
+    ccn_charbuf_append_closer(templ); /* </Name> */
+    /* The name component, plus the implicit digest */
+    ccnb_tagged_putf(templ, CCN_DTAG_MaxSuffixComponents, "%d", 1);
+    ccn_charbuf_append_closer(templ); /* </Interest> */
+    memset(&report, 0, sizeof(report));
+    for (k = 0; k < p->consumers; k++) {
+        c[k].h = connect_ccnd(progname);
+        c[k].outstanding = 0;
+        c[k].report = &report;
+    }
+    t0 = now_usec();
+    next = t0 + 1000000;
+    for (;;) {
+        now = now_usec();
+        if (now >= next) {
+            if (write(fd, &report, sizeof(report)) != sizeof(report))
+                break;
+            if (report.second + 1 >= p->seconds)
+                break;
+            k = report.second + 1;
+            memset(&report, 0, sizeof(report));
+            report.second = k;
+            next += 1000000;
+        }
+        if (rate > 0) {
+            due = (now - t0) * rate / 1e6;
+            for (; issued < due; issued++)
+                if (express(p, &c[issued % p->consumers], name, templ) < 0)
+                    report.lost++;
+        }
+        else {
+            for (k = 0; k < p->consumers; k++)
+                while (c[k].outstanding < p->window)
+                    if (express(p, &c[k], name, templ) < 0) {
+                        report.lost++;
+                        break;
+                    }
+        }
+        for (k = 0; k < p->consumers; k++) {
+            fds[k].fd = ccn_get_connection_fd(c[k].h);
+            fds[k].events = POLLIN;
+            fds[k].revents = 0;
+        }
+        poll(fds, p->consumers, rate > 0 ? 1 : 10);
+        for (k = 0; k < p->consumers; k++)
+            ccn_run(c[k].h, 0);
+    }
+    for (k = 0; k < p->consumers; k++)
+        ccn_destroy(&c[k].h);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&templ);
+}
+
+/**
+ * Collect the workers' reports, and print each second once all are in.
+ * @returns the number of interests lost.
+ */
+static uintmax_t
+collect_reports(const struct loadgen_params *p, int fd)
+{
+    struct loadgen_report r;
+    struct loadgen_report *sec;
+    struct loadgen_report total;
+    unsigned *seen;
+    unsigned nsec = p->seconds;
+    unsigned s, i;
+    ssize_t res;
+
+    sec = calloc(nsec, sizeof(*sec));
+    seen = calloc(nsec, sizeof(*seen));
+    memset(&total, 0, sizeof(total));
+    printf("second,sent,satisfied,lost,p50,p90,p99\n");
+    for (;;) {
+        res = read(fd, &r, sizeof(r));
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res != sizeof(r))
+            break;
+        s = r.second < nsec ? r.second : nsec - 1;
+        sec[s].sent += r.sent;
+        sec[s].satisfied += r.satisfied;
+        sec[s].lost += r.lost;
+        for (i = 0; i < LG_HIST_N; i++)
+            sec[s].lat[i] += r.lat[i];
+        if (++seen[s] < p->workers)
+            continue;
+        printf("%u,%u,%u,%u,%u,%u,%u\n", s + 1,
+               sec[s].sent, sec[s].satisfied, sec[s].lost,
+               hist_percentile(sec[s].lat, 50),
+               hist_percentile(sec[s].lat, 90),
+               hist_percentile(sec[s].lat, 99));
+        fflush(stdout);
+        total.sent += sec[s].sent;
+        total.satisfied += sec[s].satisfied;
+        total.lost += sec[s].lost;
+        for (i = 0; i < LG_HIST_N; i++)
+            total.lat[i] += sec[s].lat[i];
+    }
+    printf("total,%u,%u,%u,%u,%u,%u\n",
+           total.sent, total.satisfied, total.lost,
+           hist_percentile(total.lat, 50),
+           hist_percentile(total.lat, 90),
+           hist_percentile(total.lat, 99));
+    fprintf(stderr, "%u workers x %u consumers, %s %g: "
+            "%.1f interests/s satisfied over %u s\n",
+            p->workers, p->consumers,
+            p->rate > 0 ? "rate" : "window",
+            p->rate > 0 ? p->rate : p->window,
+            (double)total.satisfied / p->seconds, p->seconds);
+    free(sec);
+    free(seen);
+    return(total.lost);
+}
+
+static enum ccn_upcall_res
+incoming_interest(struct ccn_closure *selfp,
+                  enum ccn_upcall_kind kind,
+                  struct ccn_upcall_info *info)
+{
+    static const unsigned char zeros[LOADGEN_MAXPAYLOAD];
+    struct loadgen_producer *prod = selfp->data;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf **co;
+    struct ccn_charbuf *name;
+    const unsigned char *p;
+    size_t b, size;
+    int res;
+
+    if (kind != CCN_UPCALL_INTEREST)
+        return(CCN_UPCALL_RESULT_OK);
+    b = info->pi->offset[CCN_PI_B_Name];
+    size = info->pi->offset[CCN_PI_E_Name] - b;
+    p = info->interest_ccnb + b;
+    hashtb_start(prod->content, e);
+    res = hashtb_seek(e, p, size, 0);
+    co = e->data;
+    if (co != NULL && res == HT_NEW_ENTRY) {
+        name = ccn_charbuf_create();
+        ccn_charbuf_append(name, p, size);
+        *co = ccn_charbuf_create();
+        if (ccn_sign_content(info->h, *co, name, NULL,
+                             zeros, prod->payload) < 0)
+            ccn_charbuf_destroy(co);
+        ccn_charbuf_destroy(&name);
+    }
+    if (co == NULL || *co == NULL) {
+        if (co != NULL)
+            hashtb_delete(e);
+        hashtb_end(e);
+        return(CCN_UPCALL_RESULT_ERR);
+    }
+    ccn_put(info->h, (*co)->buf, (*co)->length);
+    hashtb_end(e);
+    prod->answered++;
+    return(CCN_UPCALL_RESULT_INTEREST_CONSUMED);
+}
+
+static void
+finalize_content(struct hashtb_enumerator *e)
+{
+    struct ccn_charbuf **co = e->data;
+    ccn_charbuf_destroy(co);
+}
+
+/**
+ * Answer interests under the prefix, printing the count each second.
+ */
+static void
+run_producer(const char *progname, const struct loadgen_params *p)
+{
+    struct loadgen_producer prod = {{0}};
+    struct hashtb_param param = {&finalize_content};
+    struct ccn *h = connect_ccnd(progname);
+    uint64_t t0, now, next;
+    unsigned second = 0;
+    unsigned last = 0;
+
+    prod.closure.p = &incoming_interest;
+    prod.closure.data = &prod;
+    prod.payload = p->payload;
+    prod.content = hashtb_create(sizeof(struct ccn_charbuf *), &param);
+    if (ccn_set_interest_filter(h, p->prefix, &prod.closure) < 0) {
+        fprintf(stderr, "%s: could not register prefix\n", progname);
+        exit(1);
+    }
+    printf("second,answered\n");
+    t0 = now_usec();
+    next = t0 + 1000000;
+    while (p->seconds == 0 || second < p->seconds) {
+        now = now_usec();
+        if (now >= next) {
+            second++;
+            printf("%u,%u\n", second, prod.answered - last);
+            fflush(stdout);
+            last = prod.answered;
+            next += 1000000;
+            continue;
+        }
+        if (ccn_run(h, (next - now + 999) / 1000) < 0) {
+            fprintf(stderr, "%s: lost the connection to ccnd\n", progname);
+            break;
+        }
+    }
+    fprintf(stderr, "answered %u interests for %d names\n",
+            prod.answered, hashtb_n(prod.content));
+    ccn_destroy(&h);
+    hashtb_destroy(&prod.content);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct loadgen_params p = {0};
+    pid_t pid[LOADGEN_MAXWORKERS];
+    int produce = 0;
+    int seconds = -1;
+    int fds[2];
+    int status;
+    int fail = 0;
+    int opt;
+    unsigned k;
+
+    p.workers = 1;
+    p.consumers = 1;
+    p.names = 10000;
+    p.zipf = 1.0;
+    p.window = 1;
+    p.payload = 1024;
+    while ((opt = getopt(argc, argv, "ht:c:N:z:r:w:d:s:Pp:")) != -1) {
+        switch (opt) {
+            case 't':
+                p.workers = atoi(optarg);
+                if (p.workers < 1 || p.workers > LOADGEN_MAXWORKERS)
+                    usage(progname);
+                break;
+            case 'c':
+                p.consumers = atoi(optarg);
+                if (p.consumers < 1 || p.consumers > LOADGEN_MAXCONSUMERS)
+                    usage(progname);
+                break;
+            case 'N':
+                p.names = atoi(optarg);
+                if (p.names < 1)
+                    usage(progname);
+                break;
+            case 'z':
+                p.zipf = atof(optarg);
+                if (p.zipf < 0)
+                    usage(progname);
+                break;
+            case 'r':
+                p.rate = atof(optarg);
+                if (p.rate <= 0)
+                    usage(progname);
+                break;
+            case 'w':
+                p.window = atoi(optarg);
+                if (p.window < 1)
+                    usage(progname);
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                if (seconds < 1)
+                    usage(progname);
+                break;
+            case 's':
+                p.seed = atoi(optarg);
+                break;
+            case 'P':
+                produce = 1;
+                break;
+            case 'p':
+                p.payload = atoi(optarg);
+                if (p.payload > LOADGEN_MAXPAYLOAD)
+                    usage(progname);
+                break;
+            case 'h':
+            default:
+                usage(progname);
+        }
+    }
+    if (optind != argc - 1)
+        usage(progname);
+    p.prefix = ccn_charbuf_create();
+    if (ccn_name_from_uri(p.prefix, argv[optind]) < 0) {
+        fprintf(stderr, "%s: bad ccn URI: %s\n", progname, argv[optind]);
+        exit(1);
+    }
+    if (produce) {
+        p.seconds = seconds > 0 ? seconds : 0;
+        run_producer(progname, &p);
+        ccn_charbuf_destroy(&p.prefix);
+        exit(0);
+    }
+    p.seconds = seconds > 0 ? seconds : 10;
+    if (p.seed == 0)
+        p.seed = getpid();
+    p.cdf = make_cdf(p.names, p.zipf);
+    if (p.cdf == NULL || pipe(fds) < 0) {
+        perror(progname);
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    for (k = 0; k < p.workers; k++) {
+        pid[k] = fork();
+        if (pid[k] < 0) {
+            perror(progname);
+            exit(1);
+        }
+        if (pid[k] == 0) {
+            close(fds[0]);
+            run_worker(progname, &p, k, fds[1]);
+            _exit(0);
+        }
+    }
+    close(fds[1]);
+    if (collect_reports(&p, fds[0]) > 0)
+        fail = 1;
+    for (k = 0; k < p.workers; k++)
+        if (waitpid(pid[k], &status, 0) < 0 || status != 0)
+            fail = 1;
+    free(p.cdf);
+    ccn_charbuf_destroy(&p.prefix);
+    exit(fail);
+}
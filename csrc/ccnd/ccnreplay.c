@@ -0,0 +1,850 @@
+/**
+ * @file ccnreplay.c
+ * Replay a captured workload against ccnd.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * The workload comes either from a pcap capture of ccnx traffic, or from
+ * a ccnd event trace (see ccndtrace).  Each distinct source in the
+ * capture (address and port, or face) becomes a consumer, and the
+ * consumers are spread over a number of connections to the local ccnd.
+ * A producer connection answers the interests; from a capture it sends
+ * the recorded ContentObjects, while a trace only has names as hashes,
+ * so names and content are made up to match.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <ccn/ccn.h>
+#include <ccn/ccnd.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
+
+#include "ccnd_trace.h"
+
+#define REPLAY_MAXCONN 256
+#define REPLAY_PREFIX_COMPS 1   /**< components registered by the producer */
+#define REPLAY_MAXPACKET 262144
+#define REPLAY_MAXPAYLOAD 8192
+#define REPLAY_DRAIN_USEC 5000000 /**< wait this long for stragglers */
+
+/** One Interest to be expressed */
+struct replay_event {
+    uint64_t usec;              /**< capture time */
+    unsigned flow;              /**< source in the capture */
+    size_t start;               /**< offset of the Interest in msgs */
+    size_t size;
+};
+
+/** What the producer sends for a name */
+struct replay_content {
+    struct ccn_charbuf *co;     /**< ContentObject, or NULL to make one */
+    unsigned size;              /**< payload size, if made up */
+};
+
+struct replay_input {
+    struct ccn_charbuf *msgs;   /**< Interests, back to back */
+    struct replay_event *ev;
+    size_t n;
+    size_t limit;
+    struct hashtb *flows;       /**< source key -> flow number + 1 */
+    struct hashtb *content;     /**< Name -> struct replay_content */
+    struct hashtb *prefixes;    /**< Names for the producer to register */
+    unsigned skipped;           /**< messages not understood */
+};
+
+struct replay_stats {
+    unsigned issued;
+    unsigned satisfied;
+    unsigned lost;
+    unsigned outstanding;
+    unsigned *lat;              /**< latency samples (usec) */
+    unsigned nlat;
+    unsigned limit;
+    unsigned answered;          /**< by our producer */
+    unsigned unknown;           /**< interests our producer could not answer */
+};
+
+struct replay_request {
+    struct ccn_closure closure;
+    struct replay_stats *stats;
+    uint64_t sent;
+};
+
+struct replay_producer {
+    struct ccn_closure closure;
+    struct replay_input *in;
+    struct replay_stats *stats;
+};
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-t] [-x speedup | -a] [-c connections] [-w window] "
+            "[-p port] [-P] file\n"
+            "   Replay the interests in a pcap capture (or, with -t, a ccnd\n"
+            "   event trace) against the local ccnd, and report the rate,\n"
+            "   loss and latency achieved.\n"
+            "   -t  the file is a ccnd trace (see CCND_TRACE)\n"
+            "   -x  replay this many times faster than recorded (default 1)\n"
+            "   -a  replay as fast as the window allows\n"
+            "   -c  most connections to use for consumers (default 32)\n"
+            "   -w  most interests outstanding with -a (default 100)\n"
+            "   -p  ccnx port in the capture (default 9695)\n"
+            "   -P  do not answer interests; rely on other producers\n",
+            progname);
+    exit(1);
+}
+
+static uint64_t
+now_usec(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+/**
+ * @returns the flow number for a source key, allocating a new one if needed
+ */
+static unsigned
+flow_for_key(struct replay_input *in, const void *key, size_t keysize)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    unsigned *flow;
+    unsigned ans = 0;
+
+    hashtb_start(in->flows, e);
+    if (hashtb_seek(e, key, keysize, 0) >= 0) {
+        flow = e->data;
+        if (*flow == 0)
+            *flow = hashtb_n(in->flows);
+        ans = *flow - 1;
+    }
+    hashtb_end(e);
+    return(ans);
+}
+
+/**
+ * Note the leading components of a Name as a prefix for the producer.
+ */
+static void
+add_prefix(struct replay_input *in, const unsigned char *name, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+
+    d = ccn_buf_decoder_start(&decoder, name, size);
+    if (ccn_parse_Name(d, comps) >= REPLAY_PREFIX_COMPS) {
+        ccn_name_init(c);
+        ccn_name_append_components(c, name, comps->buf[0],
+                                   comps->buf[REPLAY_PREFIX_COMPS]);
+        hashtb_start(in->prefixes, e);
+        hashtb_seek(e, c->buf, c->length, 0);
+        hashtb_end(e);
+    }
+    ccn_charbuf_destroy(&c);
+    ccn_indexbuf_destroy(&comps);
+}
+
+static void
+add_interest(struct replay_input *in, uint64_t usec, unsigned flow,
+             const unsigned char *msg, size_t size)
+{
+    if (in->n == in->limit) {
+        in->limit = 2 * in->limit + 1024;
+        in->ev = realloc(in->ev, in->limit * sizeof(in->ev[0]));
+        if (in->ev == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    in->ev[in->n].usec = usec;
+    in->ev[in->n].flow = flow;
+    in->ev[in->n].start = in->msgs->length;
+    in->ev[in->n].size = size;
+    ccn_charbuf_append(in->msgs, msg, size);
+    in->n++;
+}
+
+/**
+ * Record what the producer should send for name.
+ *
+ * If co is NULL, the content is made up when it is needed, with a
+ * payload of the given size.
+ */
+static void
+add_content(struct replay_input *in, const unsigned char *name, size_t namesize,
+            const unsigned char *co, size_t cosize, unsigned size)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct replay_content *rc;
+
+    hashtb_start(in->content, e);
+    if (hashtb_seek(e, name, namesize, 0) == HT_NEW_ENTRY) {
+        rc = e->data;
+        if (co != NULL) {
+            rc->co = ccn_charbuf_create();
+            ccn_charbuf_append(rc->co, co, cosize);
+        }
+        rc->size = size > REPLAY_MAXPAYLOAD ? REPLAY_MAXPAYLOAD : size;
+        add_prefix(in, name, namesize);
+    }
+    hashtb_end(e);
+}
+
+static void take_messages(struct replay_input *in, uint64_t usec,
+                          unsigned flow, int want_interests,
+                          const unsigned char *p, size_t n);
+
+static void
+take_message(struct replay_input *in, uint64_t usec, unsigned flow,
+             int want_interests, const unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    struct ccn_parsed_interest pi = {0};
+    struct ccn_parsed_ContentObject pco = {0};
+    size_t b;
+
+    d = ccn_buf_decoder_start(&decoder, msg, size);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Interest)) {
+        if (ccn_parse_interest(msg, size, &pi, NULL) < 0)
+            in->skipped++;
+        else if (want_interests)
+            add_interest(in, usec, flow, msg, size);
+    }
+    else if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject)) {
+        if (ccn_parse_ContentObject(msg, size, &pco, NULL) < 0)
+            in->skipped++;
+        else {
+            b = pco.offset[CCN_PCO_B_Name];
+            add_content(in, msg + b, pco.offset[CCN_PCO_E_Name] - b,
+                        msg, size, 0);
+        }
+    }
+    else if (ccn_buf_match_dtag(d, CCN_DTAG_CCNProtocolDataUnit)) {
+        ccn_buf_advance(d);
+        b = d->decoder.index;
+        if (size > b)
+            take_messages(in, usec, flow, want_interests, msg + b, size - b - 1);
+    }
+    else
+        in->skipped++;
+}
+
+/**
+ * Take the complete ccnb messages from a packet payload.
+ *
+ * A message split across TCP segments is not put back together.
+ */
+static void
+take_messages(struct replay_input *in, uint64_t usec, unsigned flow,
+              int want_interests, const unsigned char *p, size_t n)
+{
+    struct ccn_skeleton_decoder sd;
+    size_t i = 0;
+
+    while (i < n) {
+        memset(&sd, 0, sizeof(sd));
+        ccn_skeleton_decode(&sd, p + i, n - i);
+        if (!CCN_FINAL_DSTATE(sd.state) || sd.index == 0) {
+            in->skipped++;
+            return;
+        }
+        take_message(in, usec, flow, want_interests, p + i, sd.index);
+        i += sd.index;
+    }
+}
+
+static uint32_t
+get32(const unsigned char *p, int swap)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    if (swap)
+        v = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+    return(v);
+}
+
+/**
+ * Take the ccnx messages from one captured frame.
+ */
+static void
+take_packet(struct replay_input *in, uint64_t usec, unsigned linktype,
+            unsigned port, const unsigned char *p, size_t n)
+{
+    const unsigned char *ip;
+    const unsigned char *l4;
+    const unsigned char *data;
+    const unsigned char *end;
+    unsigned char key[18];
+    size_t off;
+    size_t addrlen;
+    unsigned ethertype;
+    unsigned proto;
+    unsigned sport, dport;
+
+    switch (linktype) {
+        case 0:     /* DLT_NULL */
+        case 108:   /* DLT_LOOP */
+            off = 4;
+            break;
+        case 1:     /* DLT_EN10MB */
+            if (n < 14)
+                return;
+            off = 14;
+            ethertype = (p[12] << 8) | p[13];
+            if (ethertype == 0x8100 && n >= 18) {
+                off = 18;
+                ethertype = (p[16] << 8) | p[17];
+            }
+            if (ethertype != 0x0800 && ethertype != 0x86DD)
+                return;
+            break;
+        case 113:   /* DLT_LINUX_SLL */
+            off = 16;
+            break;
+        default:    /* DLT_RAW */
+            off = 0;
+            break;
+    }
+    if (n < off + 40)
+        return;
+    ip = p + off;
+    end = p + n;
+    if ((ip[0] >> 4) == 4) {
+        proto = ip[9];
+        addrlen = 4;
+        l4 = ip + (ip[0] & 15) * 4;
+        if (ip + ((ip[2] << 8) | ip[3]) < end)
+            end = ip + ((ip[2] << 8) | ip[3]);
+        memcpy(key, ip + 12, addrlen);
+    }
+    else if ((ip[0] >> 4) == 6) {
+        proto = ip[6];
+        addrlen = 16;
+        l4 = ip + 40;
+        if (l4 + ((ip[4] << 8) | ip[5]) < end)
+            end = l4 + ((ip[4] << 8) | ip[5]);
+        memcpy(key, ip + 8, addrlen);
+    }
+    else
+        return;
+    if (l4 + 20 > end)
+        return;
+    sport = (l4[0] << 8) | l4[1];
+    dport = (l4[2] << 8) | l4[3];
+    if (proto == 17)
+        data = l4 + 8;
+    else if (proto == 6)
+        data = l4 + (l4[12] >> 4) * 4;
+    else
+        return;
+    if ((sport != port && dport != port) || data >= end)
+        return;
+    memcpy(key + addrlen, l4, 2);
+    take_messages(in, usec, flow_for_key(in, key, addrlen + 2),
+                  dport == port, data, end - data);
+}
+
+/**
+ * Read a capture in the classic pcap format.
+ * @returns -1 if the file is not a capture that we understand.
+ */
+static int
+read_pcap(struct replay_input *in, const char *path, unsigned port)
+{
+    unsigned char *buf;
+    unsigned char hdr[24];
+    uint32_t magic;
+    uint32_t caplen;
+    unsigned linktype;
+    uint64_t usec;
+    int swap = 0;
+    int nsec = 0;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        perror(path);
+        return(-1);
+    }
+    if (fread(hdr, sizeof(hdr), 1, fp) != 1)
+        goto Bail;
+    magic = get32(hdr, 0);
+    if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1)
+        swap = 1;
+    magic = get32(hdr, swap);
+    if (magic == 0xa1b23c4d)
+        nsec = 1;
+    else if (magic != 0xa1b2c3d4)
+        goto Bail;
+    linktype = get32(hdr + 20, swap);
+    if (linktype != 0 && linktype != 1 && linktype != 12 && linktype != 14 &&
+        linktype != 101 && linktype != 108 && linktype != 113) {
+        fprintf(stderr, "%s: unsupported link type %u\n", path, linktype);
+        fclose(fp);
+        return(-1);
+    }
+    buf = malloc(REPLAY_MAXPACKET);
+    while (fread(hdr, 16, 1, fp) == 1) {
+        caplen = get32(hdr + 8, swap);
+        if (caplen > REPLAY_MAXPACKET || fread(buf, caplen, 1, fp) != 1)
+            break;
+        usec = (uint64_t)get32(hdr, swap) * 1000000;
+        usec += nsec ? get32(hdr + 4, swap) / 1000 : get32(hdr + 4, swap);
+        take_packet(in, usec, linktype, port, buf, caplen);
+    }
+    free(buf);
+    fclose(fp);
+    return(0);
+Bail:
+    fprintf(stderr, "%s: not a pcap file\n", path);
+    fclose(fp);
+    return(-1);
+}
+
+/**
+ * Make up a name for a trace record.
+ *
+ * The trace keeps the text of the leading components and a hash of the
+ * whole name, so the hash stands in for the rest of the name.
+ */
+static void
+trace_name(struct ccn_charbuf *c, const struct ccnd_trace_rec *r)
+{
+    char label[CCND_TRACE_LABEL + 1];
+    char hash[16];
+    char *s;
+    char *t;
+
+    memcpy(label, r->label, CCND_TRACE_LABEL);
+    label[CCND_TRACE_LABEL] = 0;
+    c->length = 0;
+    ccn_name_init(c);
+    for (s = label; *s == '/'; s = t) {
+        t = strchr(s + 1, '/');
+        if (t != NULL)
+            *t = 0;
+        ccn_name_append_str(c, s + 1);
+        if (t == NULL)
+            break;
+        *t = '/';
+    }
+    if (r->ncomps > CCND_TRACE_PREFIX_COMPS) {
+        snprintf(hash, sizeof(hash), "%08x", (unsigned)r->namehash);
+        ccn_name_append_str(c, hash);
+    }
+}
+
+/**
+ * Read a ccnd event trace.
+ * @returns -1 if the file is not a trace.
+ */
+static int
+read_trace(struct replay_input *in, const char *path)
+{
+    const struct ccnd_trace_header *hdr;
+    const struct ccnd_trace_rec *rec;
+    const struct ccnd_trace_rec *r;
+    struct hashtb *sizes = hashtb_create(sizeof(unsigned), NULL);
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *msg = ccn_charbuf_create();
+    struct stat st;
+    uint64_t first, last, i;
+    unsigned *size;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return(-1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return(-1);
+    }
+    hdr = map;
+    rec = (const void *)(hdr + 1);
+    if (st.st_size < sizeof(*hdr) ||
+        memcmp(hdr->magic, CCND_TRACE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->recsize != sizeof(*rec) || hdr->nrec == 0 ||
+        st.st_size < sizeof(*hdr) + (uint64_t)hdr->nrec * sizeof(*rec)) {
+        fprintf(stderr, "%s: not a ccnd trace of this version\n", path);
+        munmap(map, st.st_size);
+        return(-1);
+    }
+    last = hdr->head;
+    first = last > hdr->nrec ? last - hdr->nrec : 0;
+    /* Content sizes first, so the made-up content is about the right size */
+    for (i = first; i < last; i++) {
+        r = &rec[i % hdr->nrec];
+        if (r->seq != (uint32_t)i || r->event != CCND_TR_CONTENT_IN)
+            continue;
+        hashtb_start(sizes, e);
+        if (hashtb_seek(e, &r->namehash, sizeof(r->namehash), 0) >= 0) {
+            size = e->data;
+            *size = r->size;
+        }
+        hashtb_end(e);
+    }
+    for (i = first; i < last; i++) {
+        r = &rec[i % hdr->nrec];
+        if (r->seq != (uint32_t)i || r->event != CCND_TR_INTEREST_IN ||
+            r->label[0] != '/')
+            continue;
+        trace_name(name, r);
+        msg->length = 0;
+        ccn_charbuf_append_tt(msg, CCN_DTAG_Interest, CCN_DTAG);
+        ccn_charbuf_append(msg, name->buf, name->length);
+        ccn_charbuf_append_closer(msg);
+        add_interest(in, r->usec, flow_for_key(in, &r->faceid, sizeof(r->faceid)),
+                     msg->buf, msg->length);
+        size = hashtb_lookup(sizes, &r->namehash, sizeof(r->namehash));
+        add_content(in, name->buf, name->length, NULL, 0,
+                    size != NULL ? *size : 1024);
+    }
+    munmap(map, st.st_size);
+    hashtb_destroy(&sizes);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&msg);
+    return(0);
+}
+
+static enum ccn_upcall_res
+incoming_content(struct ccn_closure *selfp,
+                 enum ccn_upcall_kind kind,
+                 struct ccn_upcall_info *info)
+{
+    struct replay_request *req = selfp->data;
+    struct replay_stats *st = req->stats;
+    unsigned *lat;
+
+    switch (kind) {
+        case CCN_UPCALL_FINAL:
+            free(req);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_INTEREST_TIMED_OUT:
+            st->lost++;
+            st->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+        case CCN_UPCALL_CONTENT_BAD:
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+        case CCN_UPCALL_CONTENT_RAW:
+            if (st->nlat == st->limit) {
+                lat = realloc(st->lat, (2 * st->limit + 1024) * sizeof(*lat));
+                if (lat == NULL)
+                    return(CCN_UPCALL_RESULT_ERR);
+                st->lat = lat;
+                st->limit = 2 * st->limit + 1024;
+            }
+            st->lat[st->nlat++] = now_usec() - req->sent;
+            st->satisfied++;
+            st->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        default:
+            return(CCN_UPCALL_RESULT_OK);
+    }
+}
+
+static enum ccn_upcall_res
+incoming_interest(struct ccn_closure *selfp,
+                  enum ccn_upcall_kind kind,
+                  struct ccn_upcall_info *info)
+{
+    static const unsigned char zeros[REPLAY_MAXPAYLOAD];
+    struct replay_producer *prod = selfp->data;
+    struct replay_content *rc;
+    struct ccn_charbuf *name;
+    const unsigned char *p;
+    size_t b;
+
+    if (kind != CCN_UPCALL_INTEREST)
+        return(CCN_UPCALL_RESULT_OK);
+    b = info->pi->offset[CCN_PI_B_Name];
+    p = info->interest_ccnb + b;
+    rc = hashtb_lookup(prod->in->content, p, info->pi->offset[CCN_PI_E_Name] - b);
+    if (rc == NULL) {
+        prod->stats->unknown++;
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    if (rc->co == NULL) {
+        name = ccn_charbuf_create();
+        ccn_charbuf_append(name, p, info->pi->offset[CCN_PI_E_Name] - b);
+        rc->co = ccn_charbuf_create();
+        if (ccn_sign_content(info->h, rc->co, name, NULL, zeros, rc->size) < 0)
+            ccn_charbuf_destroy(&rc->co);
+        ccn_charbuf_destroy(&name);
+        if (rc->co == NULL)
+            return(CCN_UPCALL_RESULT_ERR);
+    }
+    ccn_put(info->h, rc->co->buf, rc->co->length);
+    prod->stats->answered++;
+    return(CCN_UPCALL_RESULT_INTEREST_CONSUMED);
+}
+
+static int
+cmp_unsigned(const void *a, const void *b)
+{
+    unsigned x = *(const unsigned *)a;
+    unsigned y = *(const unsigned *)b;
+    return((x > y) - (x < y));
+}
+
+static unsigned
+percentile(const struct replay_stats *st, int pct)
+{
+    unsigned k;
+
+    if (st->nlat == 0)
+        return(0);
+    k = ((uint64_t)st->nlat * pct + 99) / 100;
+    return(st->lat[k > 0 ? k - 1 : 0]);
+}
+
+static struct ccn *
+connect_ccnd(const char *progname)
+{
+    struct ccn *h = ccn_create();
+
+    if (ccn_connect(h, NULL) == -1) {
+        fprintf(stderr, "%s: ", progname);
+        perror("could not connect to ccnd");
+        exit(1);
+    }
+    return(h);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct replay_input in = {0};
+    struct replay_stats st = {0};
+    struct replay_producer prod = {{0}};
+    struct ccn *conn[REPLAY_MAXCONN + 1];
+    struct pollfd fds[REPLAY_MAXCONN + 1];
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    struct ccn_parsed_interest pi = {0};
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct replay_request *req;
+    struct replay_event *ev;
+    const unsigned char *msg;
+    uint64_t t0, t1 = 0, now, due, deadline = 0;
+    double speedup = 1;
+    unsigned maxconn = 32;
+    unsigned window = 100;
+    unsigned port = CCN_DEFAULT_UNICAST_PORT_NUMBER;
+    unsigned nconn;
+    unsigned nflows;
+    size_t i;
+    int asap = 0;
+    int trace = 0;
+    int produce = 1;
+    int timeout;
+    int opt;
+    int k;
+    int res;
+
+    while ((opt = getopt(argc, argv, "hax:c:w:p:tP")) != -1) {
+        switch (opt) {
+            case 'a':
+                asap = 1;
+                break;
+            case 'x':
+                speedup = atof(optarg);
+                if (speedup <= 0)
+                    usage(progname);
+                break;
+            case 'c':
+                maxconn = atoi(optarg);
+                if (maxconn < 1 || maxconn > REPLAY_MAXCONN)
+                    usage(progname);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                if (window < 1)
+                    usage(progname);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 't':
+                trace = 1;
+                break;
+            case 'P':
+                produce = 0;
+                break;
+            default:
+                usage(progname);
+        }
+    }
+    if (optind != argc - 1)
+        usage(progname);
+    in.msgs = ccn_charbuf_create();
+    in.flows = hashtb_create(sizeof(unsigned), NULL);
+    in.content = hashtb_create(sizeof(struct replay_content), NULL);
+    in.prefixes = hashtb_create(0, NULL);
+    res = trace ? read_trace(&in, argv[optind]) :
+                  read_pcap(&in, argv[optind], port);
+    if (res < 0)
+        exit(1);
+    if (in.n == 0) {
+        fprintf(stderr, "%s: no interests found in %s\n", progname, argv[optind]);
+        exit(1);
+    }
+    nflows = hashtb_n(in.flows);
+    nconn = nflows < maxconn ? nflows : maxconn;
+    if (nconn == 0)
+        nconn = 1;
+    for (k = 0; k < nconn; k++)
+        conn[k] = connect_ccnd(progname);
+    conn[nconn] = NULL;
+    if (produce) {
+        conn[nconn] = connect_ccnd(progname);
+        prod.closure.p = &incoming_interest;
+        prod.closure.data = &prod;
+        prod.in = &in;
+        prod.stats = &st;
+        for (hashtb_start(in.prefixes, e); e->data != NULL; hashtb_next(e)) {
+            name->length = 0;
+            ccn_charbuf_append(name, e->key, e->keysize);
+            ccn_set_interest_filter(conn[nconn], name, &prod.closure);
+        }
+        hashtb_end(e);
+        /* Give the registrations a moment to take effect */
+        ccn_run(conn[nconn], 100);
+    }
+
+    t0 = now_usec();
+    for (i = 0; i < in.n || (st.outstanding > 0 && now_usec() < deadline);) {
+        now = now_usec();
+        for (; i < in.n; i++) {
+            ev = &in.ev[i];
+            if (asap) {
+                if (st.outstanding >= window)
+                    break;
+            }
+            else if (t0 + (ev->usec - in.ev[0].usec) / speedup > now)
+                break;
+            msg = in.msgs->buf + ev->start;
+            if (ccn_parse_interest(msg, ev->size, &pi, NULL) < 0)
+                continue;
+            name->length = 0;
+            ccn_charbuf_append(name, msg + pi.offset[CCN_PI_B_Name],
+                               pi.offset[CCN_PI_E_Name] - pi.offset[CCN_PI_B_Name]);
+            templ->length = 0;
+            ccn_charbuf_append(templ, msg, ev->size);
+            req = calloc(1, sizeof(*req));
+            req->closure.p = &incoming_content;
+            req->closure.data = req;
+            req->stats = &st;
+            req->sent = now_usec();
+            res = ccn_express_interest(conn[ev->flow % nconn], name,
+                                       &req->closure, templ);
+            if (res < 0) {
+                st.lost++;
+                continue;
+            }
+            st.issued++;
+            st.outstanding++;
+        }
+        timeout = 10;
+        if (i == in.n) {
+            if (deadline == 0) {
+                t1 = now_usec();
+                deadline = t1 + REPLAY_DRAIN_USEC;
+            }
+        }
+        else if (!asap) {
+            due = t0 + (in.ev[i].usec - in.ev[0].usec) / speedup;
+            if (due < now + 10000)
+                timeout = due > now ? (due - now) / 1000 : 0;
+        }
+        for (k = 0; conn[k] != NULL; k++) {
+            fds[k].fd = ccn_get_connection_fd(conn[k]);
+            fds[k].events = POLLIN;
+            fds[k].revents = 0;
+        }
+        poll(fds, k, timeout);
+        for (k = 0; conn[k] != NULL; k++)
+            ccn_run(conn[k], 0);
+    }
+    now = now_usec();
+    qsort(st.lat, st.nlat, sizeof(st.lat[0]), cmp_unsigned);
+    printf("%lu interests from %u sources, over %u connections; "
+           "recorded in %.3f s\n",
+           (unsigned long)in.n, nflows, nconn,
+           (in.ev[in.n - 1].usec - in.ev[0].usec) / 1e6);
+    if (in.skipped > 0)
+        printf("%u captured messages skipped\n", in.skipped);
+    printf("replayed in %.3f s (%.3f s with stragglers): %.0f interests/s\n",
+           (t1 - t0) / 1e6, (now - t0) / 1e6,
+           st.issued / ((t1 > t0 ? t1 - t0 : 1) / 1e6));
+    printf("satisfied %u, lost %u (%.2f%%), outstanding %u\n",
+           st.satisfied, st.lost,
+           st.issued ? 100.0 * st.lost / st.issued : 0.0, st.outstanding);
+    printf("latency usec: p50 %u p90 %u p99 %u max %u\n",
+           percentile(&st, 50), percentile(&st, 90), percentile(&st, 99),
+           st.nlat ? st.lat[st.nlat - 1] : 0);
+    if (produce)
+        printf("producer answered %u, had no content for %u\n",
+               st.answered, st.unknown);
+    for (k = 0; conn[k] != NULL; k++)
+        ccn_destroy(&conn[k]);
+    for (hashtb_start(in.content, e); e->data != NULL; hashtb_next(e)) {
+        struct replay_content *rc = e->data;
+        ccn_charbuf_destroy(&rc->co);
+    }
+    hashtb_end(e);
+    hashtb_destroy(&in.content);
+    hashtb_destroy(&in.prefixes);
+    hashtb_destroy(&in.flows);
+    ccn_charbuf_destroy(&in.msgs);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&templ);
+    free(in.ev);
+    free(st.lat);
+    exit(st.lost > 0);
+}
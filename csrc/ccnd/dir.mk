@@ -12,17 +12,21 @@
 # FOR A PARTICULAR PURPOSE.
 #
 
-LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn
+LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn -lpthread
 CCNLIBDIR = ../lib
 
-INSTALLED_PROGRAMS = ccnd ccndsmoketest ccnd-init-keystore-helper
-PROGRAMS = $(INSTALLED_PROGRAMS)
+INSTALLED_PROGRAMS = ccnd ccndsmoketest ccndtrace ccnreplay ccnloadgen \
+                     ccnd-init-keystore-helper
+PROGRAMS = $(INSTALLED_PROGRAMS) nameindextest ccnd_bench
 DEBRIS = anything.ccnb contentobjecthash.ccnb contentmishash.ccnb \
          contenthash.ccnb
 
 BROKEN_PROGRAMS = 
-CSRC = ccnd_main.c ccnd.c ccnd_msg.c ccnd_stats.c ccnd_internal_client.c ccndsmoketest.c
-HSRC = ccnd_private.h
+CSRC = ccnd_main.c ccnd.c ccnd_cache.c ccnd_msg.c ccnd_nameindex.c ccnd_stats.c \
+       ccnd_intern.c ccnd_lz.c ccnd_internal_client.c ccnd_trace.c ccnd_mrc.c ccnd_dnl.c ccnd_disk.c \
+       ccnd_prefetch.c ccnd_quota.c ccnd_faceset.c ccnd_hh.c ccndsmoketest.c ccndtrace.c ccnreplay.c ccnloadgen.c nameindextest.c \
+       ccnd_bench.c
+HSRC = ccnd_private.h ccnd_trace.h
 SCRIPTSRC = testbasics fortunes.ccnb contentobjecthash.ref anything.ref \
             ccnd-init-keystore-helper.sh minsuffix.ref
  
@@ -32,11 +36,17 @@ all: default $(BROKEN_PROGRAMS)
 
 $(PROGRAMS): $(CCNLIBDIR)/libccn.a
 
-CCND_OBJ = ccnd_main.o ccnd.o ccnd_msg.o ccnd_stats.o ccnd_internal_client.o
+CCND_OBJ = ccnd_main.o ccnd.o ccnd_cache.o ccnd_msg.o ccnd_nameindex.o ccnd_stats.o \
+           ccnd_intern.o ccnd_lz.o ccnd_internal_client.o ccnd_trace.o ccnd_mrc.o ccnd_dnl.o ccnd_disk.o \
+           ccnd_prefetch.o ccnd_quota.o ccnd_faceset.o ccnd_hh.o
 ccnd: $(CCND_OBJ) ccnd_built.sh
 	$(CC) $(CFLAGS) -o $@ $(CCND_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 	sh ./ccnd_built.sh
 
+CCND_BENCH_OBJ = ccnd_bench.o $(CCND_OBJ:ccnd_main.o=)
+ccnd_bench: $(CCND_BENCH_OBJ)
+	$(CC) $(CFLAGS) -o $@ $(CCND_BENCH_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lm
+
 ccnd_built.sh:
 	touch ccnd_built.sh
 
@@ -47,12 +57,25 @@ ccnd-init-keystore-helper: ccnd-init-keystore-helper.sh
 ccndsmoketest: ccndsmoketest.o
 	$(CC) $(CFLAGS) -o $@ ccndsmoketest.o $(LDLIBS)
 
+ccndtrace: ccndtrace.o
+	$(CC) $(CFLAGS) -o $@ ccndtrace.o $(LDLIBS)
+
+ccnreplay: ccnreplay.o
+	$(CC) $(CFLAGS) -o $@ ccnreplay.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
+ccnloadgen: ccnloadgen.o
+	$(CC) $(CFLAGS) -o $@ ccnloadgen.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lm
+
+nameindextest: nameindextest.o ccnd_nameindex.o ccnd_intern.o
+	$(CC) $(CFLAGS) -o $@ nameindextest.o ccnd_nameindex.o ccnd_intern.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 clean:
 	rm -f *.o *.a $(PROGRAMS) $(BROKEN_PROGRAMS) depend
 	rm -rf *.dSYM $(DEBRIS)
 
-check test: ccnd ccndsmoketest $(SCRIPTSRC)
+check test: ccnd ccndsmoketest nameindextest $(SCRIPTSRC)
 	./testbasics
+	./nameindextest 10000
 	: ---------------------- :
 	:  ccnd unit tests pass  :
 	: ---------------------- :
@@ -65,29 +88,105 @@ ccnd_main.o: ccnd_main.c ccnd_private.h ../include/ccn/ccn_private.h \
   ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/charbuf.h ../include/ccn/schedule.h \
   ../include/ccn/seqwriter.h
-ccnd.o: ccnd.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
+ccnd.o: ccnd.c ../include/ccn/arena.h ../include/ccn/bloom.h ../include/ccn/ccn.h \
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
   ../include/ccn/ccnd.h ../include/ccn/face_mgmt.h \
   ../include/ccn/sockcreate.h ../include/ccn/hashtb.h \
   ../include/ccn/schedule.h ../include/ccn/reg_mgmt.h \
-  ../include/ccn/uri.h ccnd_private.h ../include/ccn/seqwriter.h
+  ../include/ccn/shmring.h ../include/ccn/signer.h ../include/ccn/uri.h \
+  ../include/ccn/uring.h \
+  ccnd_private.h ccnd_trace.h \
+  ../include/ccn/seqwriter.h
+ccnd_cache.o: ccnd_cache.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/hashtb.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
+ccnd_mrc.o: ccnd_mrc.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/hashtb.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
+ccnd_dnl.o: ccnd_dnl.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_disk.o: ccnd_disk.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_prefetch.o: ccnd_prefetch.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/hashtb.h ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_quota.o: ccnd_quota.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ccnd_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
 ccnd_msg.o: ccnd_msg.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccnd.h ../include/ccn/uri.h ccnd_private.h \
   ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_nameindex.o: ccnd_nameindex.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/indexbuf.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
+ccnd_intern.o: ccnd_intern.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/hashtb.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
+ccnd_lz.o: ccnd_lz.c ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h
+ccnd_faceset.o: ccnd_faceset.c ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h ../include/ccn/memacct.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
+ccnd_hh.o: ccnd_hh.c ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h ../include/ccn/memacct.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
 ccnd_stats.o: ccnd_stats.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccnd.h ../include/ccn/schedule.h \
   ../include/ccn/sockaddrutil.h ../include/ccn/hashtb.h \
   ../include/ccn/uri.h ccnd_private.h ../include/ccn/ccn_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h
+ccnd_trace.o: ccnd_trace.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/hashtb.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h ccnd_trace.h
 ccnd_internal_client.o: ccnd_internal_client.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
-  ../include/ccn/keystore.h ../include/ccn/schedule.h \
+  ../include/ccn/keystore.h ../include/ccn/schedule.h ../include/ccn/signer.h \
   ../include/ccn/sockaddrutil.h ../include/ccn/uri.h ccnd_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h
 ccndsmoketest.o: ccndsmoketest.c ../include/ccn/ccnd.h \
   ../include/ccn/ccn_private.h
+ccndtrace.o: ccndtrace.c ../include/ccn/hashtb.h ccnd_trace.h
+ccnreplay.o: ccnreplay.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/ccnd.h ../include/ccn/hashtb.h ccnd_trace.h
+ccnloadgen.o: ccnloadgen.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/hashtb.h ../include/ccn/uri.h
+ccnd_bench.o: ccnd_bench.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/schedule.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h
+nameindextest.o: nameindextest.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/indexbuf.h ccnd_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h
@@ -0,0 +1,214 @@
+/**
+ * @file nameindextest.c
+ * Exercise and time the ccnd name index.
+ *
+ * A CCNx program.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <ccn/ccn.h>
+#include <ccn/btree_content.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+
+#include "ccnd_private.h"
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr, "%s [-s seed] [count ...]\n"
+            " Insert, look up, walk, and remove count synthetic names"
+            " in a ccnd name index, reporting per-operation times.\n"
+            " The default counts are 100000 1000000.\n", progname);
+    exit(1);
+}
+
+static double
+elapsed(struct timeval *t0)
+{
+    struct timeval t1;
+    gettimeofday(&t1, NULL);
+    return((t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_usec - t0->tv_usec) * 1e3);
+}
+
+static struct ccnd_intern *intern;
+
+/**
+ * Make a content entry for a name like /bench/NNN/%00XXX/<digest>.
+ * Only the fields used by the name index are filled in.
+ */
+static struct content_entry *
+make_entry(unsigned s1, unsigned s2)
+{
+    struct content_entry *content;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_charbuf *flat = ccn_charbuf_create();
+    unsigned char seg[4];
+    unsigned char digest[32];
+    unsigned char *key;
+    size_t plen;
+    int i;
+
+    ccn_name_init(name);
+    ccn_name_append_str(name, "bench");
+    ccn_name_append_numeric(name, CCN_MARKER_NONE, s1 % 1000);
+    seg[0] = 0;
+    seg[1] = s1 >> 16;
+    seg[2] = s1 >> 8;
+    seg[3] = s1;
+    ccn_name_append(name, seg, sizeof(seg));
+    for (i = 0; i < (int)sizeof(digest); i++)
+        digest[i] = (s2 >> (i % 4 * 8)) + i;
+    ccn_name_append(name, digest, sizeof(digest));
+    ccn_name_split(name, comps);
+    ccn_flatname_from_ccnb(flat, name->buf, name->length);
+    plen = ccnd_intern_split(flat->buf, flat->length, CCND_NAME_SUFFIX_COMPS);
+    content = calloc(1, sizeof(*content));
+    content->prefix = ccnd_intern_prefix(intern, flat->buf, plen);
+    content->ncomps = comps->n;
+    content->comps = calloc(1, comps->n * sizeof(content->comps[0]) +
+                               flat->length - plen);
+    for (i = 0; i < (int)comps->n; i++)
+        content->comps[i] = comps->buf[i];
+    content->suffix = (unsigned char *)(content->comps + comps->n);
+    memcpy((unsigned char *)content->suffix, flat->buf + plen,
+           flat->length - plen);
+    content->suffix_size = flat->length - plen;
+    content->key_size = content->size = name->length;
+    key = malloc(name->length);
+    memcpy(key, name->buf, name->length);
+    content->key = key;
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&flat);
+    ccn_indexbuf_destroy(&comps);
+    return(content);
+}
+
+static void
+free_entry(struct content_entry *content)
+{
+    ccnd_intern_release(intern, content->prefix);
+    free(content->comps);
+    free((void *)content->key);
+    free(content);
+}
+
+static int
+run(unsigned n, unsigned seed)
+{
+    struct ccnd_nameindex *ni = ccnd_nameindex_create(NULL);
+    struct content_entry **v;
+    struct content_entry *c;
+    struct ccn_charbuf *root = ccn_charbuf_create();
+    struct timeval t0;
+    unsigned i;
+    unsigned walked;
+    int res = 0;
+
+    srandom(seed);
+    v = calloc(n, sizeof(*v));
+    intern = ccnd_intern_create();
+    if (ni == NULL || v == NULL || intern == NULL)
+        return(-1);
+    for (i = 0; i < n; i++)
+        v[i] = make_entry(random(), random());
+    printf("%9u names, %lu interned prefixes\n", n,
+           ccnd_intern_counts(intern, NULL, NULL));
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i++) {
+        if (ccnd_nameindex_insert(ni, v[i]) < 0)
+            return(-1);
+    }
+    printf("%9u insert %8.1f ns/op\n", n, elapsed(&t0) / n);
+    if (ccnd_nameindex_count(ni) != n || ccnd_nameindex_check(ni) != 0) {
+        fprintf(stderr, "index check failed after insert\n");
+        res = 1;
+    }
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i++) {
+        c = v[(i * 7919U) % n];
+        if (ccnd_nameindex_lookup(ni, c->key, c->size) != c)
+            res = 1;
+    }
+    printf("%9u lookup %8.1f ns/op\n", n, elapsed(&t0) / n);
+    gettimeofday(&t0, NULL);
+    walked = 0;
+    ccn_name_init(root);
+    for (c = ccnd_nameindex_lookup(ni, root->buf, root->length); c != NULL;
+         c = ccnd_nameindex_next(ni, c))
+        walked++;
+    printf("%9u next   %8.1f ns/op\n", n, elapsed(&t0) / n);
+    if (walked != n)
+        res = 1;
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i += 2)
+        ccnd_nameindex_remove(ni, v[i]);
+    for (i = 1; i < n; i += 2)
+        ccnd_nameindex_remove(ni, v[i]);
+    printf("%9u remove %8.1f ns/op\n", n, elapsed(&t0) / n);
+    if (ccnd_nameindex_count(ni) != 0 || ccnd_nameindex_check(ni) != 0) {
+        fprintf(stderr, "index check failed after remove\n");
+        res = 1;
+    }
+    ccnd_nameindex_destroy(&ni);
+    ccn_charbuf_destroy(&root);
+    for (i = 0; i < n; i++)
+        free_entry(v[i]);
+    free(v);
+    if (ccnd_intern_counts(intern, NULL, NULL) != 0) {
+        fprintf(stderr, "interned prefixes left over\n");
+        res = 1;
+    }
+    ccnd_intern_destroy(&intern);
+    return(res);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    int opt;
+    int i;
+    int res = 0;
+
+    while ((opt = getopt(argc, argv, "hs:")) != -1) {
+        switch (opt) {
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind == argc) {
+        res |= run(100000, seed);
+        res |= run(1000000, seed);
+    }
+    for (i = optind; i < argc; i++) {
+        if (atoi(argv[i]) <= 0)
+            usage(argv[0]);
+        res |= run(atoi(argv[i]), seed);
+    }
+    if (res != 0)
+        fprintf(stderr, "%s: FAILED\n", argv[0]);
+    return(res != 0);
+}
@@ -19,6 +19,7 @@
  */
 
 #include <stdarg.h>
+#include <stdlib.h>
 #include <android/log.h>
 #include <ccnr_private.h>
 
@@ -33,6 +34,10 @@ start_ccnr(void)
 {
     struct ccnr_handle *h = NULL;
    
+    /* Spare the battery while idle, unless told otherwise */
+    setenv("CCNR_IDLE_SLACK", "1000", 0);
+    /* and memory */
+    setenv("CCNR_PROFILE", "compact", 0);
 	h = r_init_create(&logger, NULL);
 	if (h == NULL) {
 		exit(1);
@@ -0,0 +1,610 @@
+/**
+ * @file ccnr_bulk.c
+ *
+ * Part of ccnr -  CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * Bulk loading of the index.
+ *
+ * When many objects go into an empty index at once - a reindex of
+ * repoFile1 from scratch, or a bulk import into a new repository -
+ * inserting them one at a time is slow, since each insert lands on a
+ * random leaf and the leaves keep splitting.  Instead, the flatnames
+ * and leaf payloads are gathered and sorted, and the index is built
+ * bottom-up by ccn_btree_builder_append(), which fills and writes each
+ * node just once, in order.
+ *
+ * The sort uses at most CCNR_BULK_LOAD_BYTES of memory.  When that
+ * fills, the records are sorted and spilled to a run file in the index
+ * directory, and at the end the runs are merged.  Where a name appears
+ * more than once, the copy earliest in repoFile1 is indexed, as it
+ * would have been by one-at-a-time insertion.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <ccn/btree.h>
+#include <ccn/btree_content.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/indexbuf.h>
+
+#include "ccnr_private.h"
+
+#include "ccnr_bulk.h"
+
+#include "ccnr_init.h"
+#include "ccnr_io.h"
+#include "ccnr_msg.h"
+#include "ccnr_store.h"
+
+/**
+ * A sort record, as kept in memory and in the run files
+ *
+ * The flatname follows, padded in memory to keep the records aligned.
+ */
+struct bulk_rec {
+    uint64_t offset;            /**< position of the object in the data */
+    unsigned keysize;           /**< bytes of flatname */
+    struct ccn_btree_content_payload payload;
+};
+#define BULK_ALIGN (sizeof(uint64_t))
+
+/**
+ * Where a merge stands in one run
+ */
+struct bulk_run {
+    FILE *f;
+    struct ccn_charbuf *rec;    /**< current record, empty at end */
+};
+
+struct r_bulk {
+    struct ccnr_handle *h;
+    struct ccn_btree_builder *builder;
+    size_t limit;               /**< memory for sorting */
+    struct ccn_charbuf *arena;  /**< records not yet sorted */
+    struct ccn_indexbuf *recs;  /**< offsets of the records in arena */
+    struct ccn_charbuf *flat;   /**< scratch */
+    struct bulk_run *runs;      /**< spilled runs */
+    int nruns;
+    const struct bulk_rec *prev; /**< last record sent to the builder */
+    uintmax_t objects;          /**< objects added */
+    uintmax_t dups;             /**< objects not indexed, name seen before */
+    uintmax_t bad;              /**< objects that did not parse */
+};
+
+static const unsigned char *
+bulk_key(const struct bulk_rec *r)
+{
+    return((const unsigned char *)(r + 1));
+}
+
+static int
+bulk_rec_compare(const void *a, const void *b)
+{
+    const struct bulk_rec *x = *(const struct bulk_rec * const *)a;
+    const struct bulk_rec *y = *(const struct bulk_rec * const *)b;
+    unsigned n = x->keysize < y->keysize ? x->keysize : y->keysize;
+    int res;
+
+    res = memcmp(bulk_key(x), bulk_key(y), n);
+    if (res != 0)
+        return(res);
+    if (x->keysize != y->keysize)
+        return(x->keysize < y->keysize ? -1 : 1);
+    if (x->offset != y->offset)
+        return(x->offset < y->offset ? -1 : 1);
+    return(0);
+}
+
+/**
+ * Set up for a bulk load of the index.
+ *
+ * @returns NULL if bulk loading is turned off (CCNR_BULK_LOAD_BYTES=0)
+ *          or the index is not empty, in which case the caller should
+ *          index the objects one at a time.
+ */
+struct r_bulk *
+r_bulk_create(struct ccnr_handle *h)
+{
+    struct r_bulk *b = NULL;
+    size_t limit;
+    int fill;
+
+    limit = r_init_confval(h, "CCNR_BULK_LOAD_BYTES", 0, 1073741824, 67108864);
+    fill = r_init_confval(h, "CCNR_BULK_LOAD_FILL", 50, 100, 90);
+    if (limit == 0 || h->btree == NULL)
+        return(NULL);
+    if (limit < 65536)
+        limit = 65536;
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+        return(NULL);
+    b->h = h;
+    b->limit = limit;
+    b->builder = ccn_btree_builder_create(h->btree, fill);
+    b->arena = ccn_charbuf_create();
+    b->recs = ccn_indexbuf_create();
+    b->flat = ccn_charbuf_create();
+    if (b->builder == NULL || b->arena == NULL || b->recs == NULL ||
+        b->flat == NULL || ccn_charbuf_reserve(b->arena, limit) == NULL)
+        r_bulk_destroy(&b);
+    return(b);
+}
+
+/**
+ * Give up on a bulk load, discarding what has been gathered.
+ *
+ * The index is left as it was.  Nodes already written for it are
+ * left behind, but nothing refers to them.
+ */
+void
+r_bulk_destroy(struct r_bulk **pb)
+{
+    struct r_bulk *b = *pb;
+    int i;
+
+    if (b == NULL)
+        return;
+    ccn_btree_builder_destroy(&b->builder);
+    for (i = 0; i < b->nruns; i++) {
+        fclose(b->runs[i].f);
+        ccn_charbuf_destroy(&b->runs[i].rec);
+    }
+    free(b->runs);
+    ccn_charbuf_destroy(&b->arena);
+    ccn_indexbuf_destroy(&b->recs);
+    ccn_charbuf_destroy(&b->flat);
+    free(b);
+    *pb = NULL;
+}
+
+/**
+ * Sort the records in memory.
+ * @returns an array of pointers into the arena, to be freed by the caller.
+ */
+static const struct bulk_rec **
+bulk_sort(struct r_bulk *b)
+{
+    const struct bulk_rec **v = NULL;
+    size_t i;
+
+    v = calloc(b->recs->n + 1, sizeof(v[0]));
+    if (v == NULL)
+        return(NULL);
+    for (i = 0; i < b->recs->n; i++)
+        v[i] = (const void *)(b->arena->buf + b->recs->buf[i]);
+    qsort(v, b->recs->n, sizeof(v[0]), &bulk_rec_compare);
+    return(v);
+}
+
+/**
+ * Open an anonymous file in the index directory for a run.
+ */
+static FILE *
+bulk_open_run(struct r_bulk *b)
+{
+    struct ccn_charbuf *path = NULL;
+    FILE *f = NULL;
+    int fd;
+
+    path = ccn_charbuf_create();
+    if (path == NULL)
+        return(NULL);
+    ccn_charbuf_putf(path, "%s/index/bulkrun.%d", b->h->directory, b->nruns);
+    fd = open(ccn_charbuf_as_string(path), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd != -1) {
+        unlink(ccn_charbuf_as_string(path));
+        f = fdopen(fd, "w+");
+        if (f == NULL)
+            close(fd);
+    }
+    if (f == NULL)
+        ccnr_msg(b->h, "bulk load: %s: %s",
+                 ccn_charbuf_as_string(path), strerror(errno));
+    ccn_charbuf_destroy(&path);
+    return(f);
+}
+
+/**
+ * Sort what is in memory and write it out as a run.
+ */
+static int
+bulk_spill(struct r_bulk *b)
+{
+    const struct bulk_rec **v = NULL;
+    struct bulk_run *runs = NULL;
+    FILE *f = NULL;
+    size_t i;
+    int res = 0;
+
+    if (b->recs->n == 0)
+        return(0);
+    runs = realloc(b->runs, (b->nruns + 1) * sizeof(runs[0]));
+    if (runs == NULL)
+        return(-1);
+    b->runs = runs;
+    f = bulk_open_run(b);
+    v = bulk_sort(b);
+    if (f == NULL || v == NULL) {
+        if (f != NULL)
+            fclose(f);
+        free(v);
+        return(-1);
+    }
+    for (i = 0; i < b->recs->n && res == 0; i++) {
+        if (fwrite(v[i], sizeof(*v[i]) + v[i]->keysize, 1, f) != 1)
+            res = -1;
+    }
+    if (res == 0 && (fflush(f) != 0 || fseeko(f, 0, SEEK_SET) != 0))
+        res = -1;
+    free(v);
+    if (res < 0) {
+        ccnr_msg(b->h, "bulk load: writing run %d: %s",
+                 b->nruns, strerror(errno));
+        fclose(f);
+        return(-1);
+    }
+    b->runs[b->nruns].f = f;
+    b->runs[b->nruns].rec = ccn_charbuf_create();
+    b->nruns++;
+    b->arena->length = 0;
+    b->recs->n = 0;
+    return(0);
+}
+
+/**
+ * Add a ContentObject at the given position in the repository data.
+ *
+ * Objects that do not parse are skipped, as they would be by
+ * one-at-a-time indexing.
+ *
+ * @returns 0 for success, -1 for error.
+ */
+int
+r_bulk_add(struct r_bulk *b, const unsigned char *msg, size_t size,
+           off_t offset)
+{
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_charbuf *flat = b->flat;
+    struct bulk_rec *r = NULL;
+    uint_least64_t cobid;
+    size_t recsize;
+    int res;
+
+    res = ccn_parse_ContentObject(msg, size, &pco, NULL);
+    if (res < 0) {
+        b->bad++;
+        return(0);
+    }
+    ccn_digest_ContentObject(msg, &pco);
+    flat->length = 0;
+    res = ccn_flatname_from_ccnb(flat, msg, size);
+    if (res >= 0 && pco.digest_bytes == 32)
+        res = ccn_flatname_append_component(flat, pco.digest, pco.digest_bytes);
+    else
+        res = -1;
+    if (res < 0 || flat->length > CCN_BT_MAX_KEY_SIZE) {
+        b->bad++;
+        return(0);
+    }
+    recsize = sizeof(*r) + flat->length;
+    recsize = (recsize + BULK_ALIGN - 1) / BULK_ALIGN * BULK_ALIGN;
+    if (b->arena->length + recsize > b->arena->limit ||
+        (b->arena->length + recsize +
+         (b->recs->n + 1) * sizeof(b->recs->buf[0])) > b->limit) {
+        if (bulk_spill(b) < 0)
+            return(-1);
+    }
+    r = (struct bulk_rec *)(b->arena->buf + b->arena->length);
+    memset(r, 0, recsize);
+    r->offset = offset;
+    r->keysize = flat->length;
+    cobid = ccnr_accession_encode(b->h, ((ccnr_accession)offset) +
+                                        r_store_mark_repoFile1);
+    res = ccn_btree_init_content_payload(&r->payload, cobid, msg, &pco,
+                                         flat->buf, flat->length);
+    if (res < 0) {
+        b->bad++;
+        return(0);
+    }
+    memcpy(r + 1, flat->buf, flat->length);
+    if (ccn_indexbuf_append_element(b->recs, b->arena->length) < 0)
+        return(-1);
+    b->arena->length += recsize;
+    b->objects++;
+    return(0);
+}
+
+/**
+ * Pass a record to the builder, unless its name was just seen.
+ */
+static int
+bulk_emit(struct r_bulk *b, const struct bulk_rec *r)
+{
+    const struct bulk_rec *p = b->prev;
+
+    if (p != NULL && p->keysize == r->keysize &&
+        memcmp(bulk_key(p), bulk_key(r), r->keysize) == 0) {
+        b->dups++;
+        return(0);
+    }
+    b->prev = r;
+    return(ccn_btree_builder_append(b->builder, bulk_key(r), r->keysize,
+                                    (void *)&r->payload, sizeof(r->payload)));
+}
+
+/**
+ * Read the next record of a run.
+ * @returns 1 if there is one, 0 at the end, -1 for error.
+ */
+static int
+bulk_run_next(struct bulk_run *run)
+{
+    struct bulk_rec *r = NULL;
+    unsigned char *p = NULL;
+
+    run->rec->length = 0;
+    r = (void *)ccn_charbuf_reserve(run->rec, sizeof(*r));
+    if (r == NULL)
+        return(-1);
+    if (fread(r, sizeof(*r), 1, run->f) != 1)
+        return(ferror(run->f) ? -1 : 0);
+    run->rec->length = sizeof(*r);
+    p = ccn_charbuf_reserve(run->rec, r->keysize);
+    if (p == NULL)
+        return(-1);
+    r = (void *)run->rec->buf;
+    if (r->keysize > 0 && fread(p, r->keysize, 1, run->f) != 1)
+        return(-1);
+    run->rec->length += r->keysize;
+    return(1);
+}
+
+static const struct bulk_rec *
+bulk_run_rec(struct bulk_run *run)
+{
+    return((const void *)run->rec->buf);
+}
+
+/**
+ * Restore the heap property below slot i of a heap of runs.
+ */
+static void
+bulk_sift_down(struct bulk_run **heap, int n, int i)
+{
+    struct bulk_run *t = NULL;
+    const struct bulk_rec *a = NULL;
+    const struct bulk_rec *c = NULL;
+    int j;
+
+    for (; (j = 2 * i + 1) < n; i = j) {
+        if (j + 1 < n) {
+            a = bulk_run_rec(heap[j]);
+            c = bulk_run_rec(heap[j + 1]);
+            if (bulk_rec_compare(&c, &a) < 0)
+                j++;
+        }
+        a = bulk_run_rec(heap[i]);
+        c = bulk_run_rec(heap[j]);
+        if (bulk_rec_compare(&a, &c) <= 0)
+            break;
+        t = heap[i];
+        heap[i] = heap[j];
+        heap[j] = t;
+    }
+}
+
+/**
+ * Merge the runs into the builder.
+ *
+ * The previous record must stay put while the next is compared with it,
+ * so it is copied aside before its run moves on.
+ */
+static int
+bulk_merge(struct r_bulk *b)
+{
+    struct bulk_run **heap = NULL;
+    struct ccn_charbuf *last = NULL;
+    struct bulk_run *run = NULL;
+    int n = 0;
+    int i;
+    int res = 0;
+
+    heap = calloc(b->nruns, sizeof(heap[0]));
+    last = ccn_charbuf_create();
+    if (heap == NULL || last == NULL) {
+        free(heap);
+        ccn_charbuf_destroy(&last);
+        return(-1);
+    }
+    for (i = 0; i < b->nruns && res >= 0; i++) {
+        if (b->runs[i].rec == NULL)
+            res = -1;
+        else
+            res = bulk_run_next(&b->runs[i]);
+        if (res > 0)
+            heap[n++] = &b->runs[i];
+    }
+    for (i = n / 2 - 1; i >= 0; i--)
+        bulk_sift_down(heap, n, i);
+    while (n > 0 && res >= 0) {
+        run = heap[0];
+        res = bulk_emit(b, bulk_run_rec(run));
+        if (res < 0)
+            break;
+        if (b->prev == bulk_run_rec(run)) {
+            last->length = 0;
+            ccn_charbuf_append_charbuf(last, run->rec);
+            b->prev = (const void *)last->buf;
+        }
+        res = bulk_run_next(run);
+        if (res == 0)
+            heap[0] = heap[--n];
+        bulk_sift_down(heap, n, 0);
+    }
+    if (res < 0)
+        ccnr_msg(b->h, "bulk load: merge failed: %s", strerror(errno));
+    b->prev = NULL;
+    free(heap);
+    ccn_charbuf_destroy(&last);
+    return(res < 0 ? -1 : 0);
+}
+
+/**
+ * Sort what has been added, and build the index from it.
+ *
+ * The bulk state is freed in any case.
+ * @returns 0 for success, -1 for error.
+ */
+int
+r_bulk_finish(struct r_bulk **pb)
+{
+    struct r_bulk *b = *pb;
+    const struct bulk_rec **v = NULL;
+    size_t i;
+    int res = 0;
+
+    if (b == NULL)
+        return(-1);
+    if (b->nruns == 0) {
+        v = bulk_sort(b);
+        if (v == NULL)
+            res = -1;
+        for (i = 0; res >= 0 && i < b->recs->n; i++)
+            res = bulk_emit(b, v[i]);
+        free(v);
+        b->prev = NULL;
+    }
+    else {
+        res = bulk_spill(b);
+        if (res >= 0)
+            res = bulk_merge(b);
+    }
+    if (res >= 0)
+        res = ccn_btree_builder_finish(&b->builder);
+    if (CCNSHOULDLOG(b->h, bulk, CCNL_INFO))
+        ccnr_msg(b->h, "bulk load: %ju objects, %ju duplicate, %ju bad, "
+                 "%d runs%s",
+                 b->objects, b->dups, b->bad, b->nruns,
+                 res < 0 ? " - FAILED" : "");
+    r_bulk_destroy(pb);
+    return(res < 0 ? -1 : 0);
+}
+
+/**
+ * Add all the ContentObjects in one segment of the repository data.
+ * @returns the number of bytes in the segment, or -1 for error.
+ */
+static off_t
+bulk_add_segment(struct r_bulk *b, unsigned segment)
+{
+    struct ccnr_handle *h = b->h;
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    struct stat statbuf;
+    unsigned char *base = MAP_FAILED;
+    off_t start;
+    size_t size;
+    ssize_t dres;
+    int res = 0;
+    int fd;
+
+    fd = r_io_repo_data_file_fd(h, segment, 0);
+    if (fd == -1 || fstat(fd, &statbuf) != 0)
+        return(-1);
+    size = statbuf.st_size;
+    if ((off_t)size != statbuf.st_size)
+        return(-1);
+    if (size == 0)
+        return(0);
+    base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ccnr_msg(h, "bulk load: mmap segment %u: %s", segment, strerror(errno));
+        return(-1);
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    start = r_store_position(h, segment, 0);
+    while (d->index < size && res >= 0) {
+        dres = ccn_skeleton_decode(d, base + d->index, size - d->index);
+        if (!CCN_FINAL_DSTATE(d->state))
+            break;
+        res = r_bulk_add(b, base + d->index - dres, dres,
+                         start + d->index - dres);
+    }
+    if (res >= 0 && d->index != size)
+        ccnr_msg(h, "bulk load: %ju bytes at the end of segment %u not indexed",
+                 (uintmax_t)(size - d->index), segment);
+    munmap(base, size);
+    if (res < 0)
+        return(-1);
+    return(size);
+}
+
+/**
+ * Index the repository data from scratch, by bulk loading.
+ *
+ * The index must be empty.  Every segment is loaded in turn, so where
+ * an object is in more than one, the first copy is the one indexed.
+ *
+ * @returns the position of the end of the data, or -1 if the caller
+ *          should index it the usual way instead.
+ */
+off_t
+r_bulk_reindex(struct ccnr_handle *h)
+{
+    struct r_bulk *b = NULL;
+    off_t end = 0;
+    off_t size = 0;
+    off_t total = 0;
+    unsigned i;
+    int res = 0;
+
+    b = r_bulk_create(h);
+    if (b == NULL)
+        return(-1);
+    for (i = 1; i < h->n_segment && size >= 0; i++) {
+        if (h->segment[i].state == CCNR_SEG_ABSENT)
+            continue;
+        size = bulk_add_segment(b, i);
+        if (size >= 0) {
+            end = r_store_position(h, i, size);
+            total += size;
+        }
+    }
+    if (size < 0 || total == 0) {
+        r_bulk_destroy(&b);
+        return(-1);
+    }
+    res = r_bulk_finish(&b);
+    if (res < 0)
+        return(-1);
+    return(end);
+}
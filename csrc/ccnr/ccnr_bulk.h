@@ -0,0 +1,38 @@
+/**
+ * @file ccnr_bulk.h
+ * 
+ * Part of ccnr - CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+ 
+#ifndef CCNR_BULK_DEFINED
+#define CCNR_BULK_DEFINED
+
+#include <sys/types.h>
+
+#include "ccnr_private.h"
+
+struct r_bulk;
+
+struct r_bulk *r_bulk_create(struct ccnr_handle *h);
+int r_bulk_add(struct r_bulk *b, const unsigned char *msg, size_t size, off_t offset);
+int r_bulk_finish(struct r_bulk **pb);
+void r_bulk_destroy(struct r_bulk **pb);
+off_t r_bulk_reindex(struct ccnr_handle *h);
+
+#endif
@@ -41,6 +41,7 @@
 #include <sys/un.h>
 #include <netinet/in.h>
 
+#include <ccn/arena.h>
 #include <ccn/bloom.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
@@ -69,6 +70,8 @@
 #include "ccnr_store.h"
 #include "ccnr_sync.h"
 #include "ccnr_util.h"
+#include "ccnr_verify.h"
+#include "ccnr_watch.h"
 
 static void
 process_input_message(struct ccnr_handle *h, struct fdholder *fdholder,
@@ -81,6 +84,7 @@ process_input_message(struct ccnr_handle *h, struct fdholder *fdholder,
     enum ccn_dtag dtag;
     struct content_entry *content = NULL;
     
+    h->busy_sec = h->sec;
     if ((fdholder->flags & CCNR_FACE_UNDECIDED) != 0) {
         fdholder->flags &= ~CCNR_FACE_UNDECIDED;
         if ((fdholder->flags & CCNR_FACE_LOOPBACK) != 0)
@@ -209,11 +213,10 @@ r_dispatch_process_input(struct ccnr_handle *h, int fd)
         ccnr_msg(h, "read %u :%s (errno = %d)",
                     fdholder->filedesc, strerror(errno), errno);
     else if (res == 0 && (fdholder->flags & CCNR_FACE_DGRAM) == 0) {
-        if (fd == h->active_in_fd && h->stable == 0) {
-            h->stable = lseek(fd, 0, SEEK_END);
-            ccnr_msg(h, "read %ju bytes", (uintmax_t)h->stable);
-        }
-        r_io_shutdown_client_fd(h, fd);
+        if (fd == h->active_in_fd && h->stable == 0)
+            r_store_input_done(h, fd);
+        else
+            r_io_shutdown_client_fd(h, fd);
     }
     else {
         off_t offset = (off_t)-1;
@@ -303,7 +306,11 @@ r_dispatch_run(struct ccnr_handle *h)
         return;
     }
     for (h->running = 1; h->running;) {
+        /* Nothing from the scratch arena is in use out here */
+        ccn_arena_reset(h->scratch);
         r_dispatch_process_internal_client_buffer(h);
+        r_util_refresh_time(h);
+        r_util_check_quiet(h);
         usec = ccn_schedule_run(h->sched);
         usec_direct = ccn_process_scheduled_operations(h->direct_client);
         if (usec_direct < usec)
@@ -322,8 +329,13 @@ r_dispatch_run(struct ccnr_handle *h)
             timeout_ms = 1;
         r_dispatch_process_internal_client_buffer(h);
         r_store_trim(h, h->cob_limit);
+        r_store_fetch_submit(h);
         r_io_prepare_poll_fds(h);
+        r_util_refresh_time(h);
+        ccn_schedule_note_idle(h->sched, 1);
         res = poll(h->fds, h->nfds, timeout_ms);
+        r_util_refresh_time(h);
+        ccn_schedule_note_idle(h->sched, 0);
         prev_timeout_ms = ((res == 0) ? timeout_ms : 1);
         if (-1 == res) {
             if (errno == EINTR)
@@ -335,6 +347,18 @@ r_dispatch_run(struct ccnr_handle *h)
         for (i = 0; res > 0 && i < h->nfds; i++) {
             if (h->fds[i].revents != 0) {
                 res--;
+                if (h->fds[i].fd == r_store_fetch_fd(h)) {
+                    r_store_fetch_complete(h);
+                    continue;
+                }
+                if (h->fds[i].fd == r_verify_fd(h)) {
+                    r_verify_complete(h);
+                    continue;
+                }
+                if (h->fds[i].fd == r_watch_fd(h)) {
+                    r_watch_process(h);
+                    continue;
+                }
                 if (h->fds[i].revents & (POLLERR | POLLNVAL | POLLHUP)) {
                     if (h->fds[i].revents & (POLLIN))
                         r_dispatch_process_input(h, h->fds[i].fd);
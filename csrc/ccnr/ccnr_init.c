@@ -45,13 +45,16 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
+#include <ccn/arena.h>
 #include <ccn/bloom.h>
+#include <ccn/btree.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/charbuf.h>
 #include <ccn/face_mgmt.h>
 #include <ccn/hashtb.h>
 #include <ccn/indexbuf.h>
+#include <ccn/memacct.h>
 #include <ccn/schedule.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/uri.h>
@@ -62,6 +65,7 @@
 
 #include "ccnr_init.h"
 
+#include "ccnr_bulk.h"
 #include "ccnr_dispatch.h"
 #include "ccnr_forwarding.h"
 #include "ccnr_internal_client.h"
@@ -73,6 +77,8 @@
 #include "ccnr_store.h"
 #include "ccnr_sync.h"
 #include "ccnr_util.h"
+#include "ccnr_verify.h"
+#include "ccnr_watch.h"
 
 static int load_policy(struct ccnr_handle *h);
 static int merge_files(struct ccnr_handle *h);
@@ -448,6 +454,17 @@ ccnr_parsed_policy_destroy(struct ccnr_parsed_policy **ppp)
     *ppp = NULL;
 }
 
+/** Names of the memory accounting tags, for reports */
+static const char *const r_init_mem_names[CCNR_MEM_N] = {
+    "nameprefix",
+    "pit",
+    "enum_state",
+    "accession",
+    "btree",
+    "cobs",
+    "sched",
+};
+
 /**
  * Create a new ccnr instance
  * @param progname - name of program binary, used for locating helpers
@@ -461,14 +478,22 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     const char *portstr = NULL;
     const char *listen_on = NULL;
     const char *d = NULL;
+    const char *profile = NULL;
     struct ccnr_handle *h = NULL;
     struct hashtb_param param = {0};
     struct ccn_charbuf *config = NULL;
+    struct timeval now;
+    long start_sec;
+    unsigned start_usec;
     int res;
+    int i;
     
     h = calloc(1, sizeof(*h));
     if (h == NULL)
         return(h);
+    for (i = 0; i < CCNR_MEM_N; i++)
+        h->mem[i].name = r_init_mem_names[i];
+    h->scratch = ccn_arena_create();
     h->notify_after = CCNR_MAX_ACCESSION;
     h->logger = logger;
     h->loggerdata = loggerdata;
@@ -491,27 +516,43 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     h->skiplinks = ccn_indexbuf_create();
     h->face_limit = 10; /* soft limit */
     h->fdholder_by_fd = calloc(h->face_limit, sizeof(h->fdholder_by_fd[0]));
+    profile = getenv("CCNR_PROFILE");
+    if (profile != NULL && strcmp(profile, "compact") == 0) {
+        h->compact = 1;
+        ccnr_msg(h, "CCNR_PROFILE=compact");
+    }
     param.finalize_data = h;
+    param.shrink = h->compact;
     param.finalize = &r_fwd_finalize_nameprefix;
+    param.memacct = &h->mem[CCNR_MEM_NAMEPREFIX];
     h->nameprefix_tab = hashtb_create(sizeof(struct nameprefix_entry), &param);
     param.finalize = 0; // PRUNED &r_fwd_finalize_propagating;
+    param.memacct = &h->mem[CCNR_MEM_PIT];
     h->propagating_tab = hashtb_create(sizeof(struct propagating_entry), &param);
     param.finalize = 0;
-    h->enum_state_tab = hashtb_create(sizeof(struct enum_state), NULL); // XXX - do we need finalization? Perhaps
+    param.memacct = &h->mem[CCNR_MEM_ENUM];
+    h->enum_state_tab = hashtb_create(sizeof(struct enum_state), &param); // XXX - do we need finalization? Perhaps
+    param.memacct = NULL;
     h->min_stale = ~0;
     h->max_stale = 0;
     h->unsol = ccn_indexbuf_create();
-    h->ticktock.descr[0] = 'C';
-    h->ticktock.micros_per_base = 1000000;
-    h->ticktock.gettime = &r_util_gettime;
-    h->ticktock.data = h;
-    h->sched = ccn_schedule_create(h, &h->ticktock);
-    h->starttime = h->sec;
-    h->starttime_usec = h->usec;
+    ccn_clock_init(&h->clock);
+    r_util_refresh_time(h);
+    h->sched = ccn_schedule_create(h, &h->clock.gettime);
+    start_sec = h->sec;
+    start_usec = h->usec;
+    h->busy_sec = h->sec;
+    gettimeofday(&now, NULL);
+    h->starttime = now.tv_sec;
+    h->starttime_usec = now.tv_usec;
     h->oldformatcontentgrumble = 1;
     h->oldformatinterestgrumble = 1;
     h->cob_limit = 4201;
     h->start_write_scope_limit = r_init_confval(h, "CCNR_START_WRITE_SCOPE_LIMIT", 0, 3, 3);
+    h->send_from_file = r_init_confval(h, "CCNR_SENDFILE", 0, 1, 1);
+    h->lograte = r_init_confval(h, "CCNR_LOG_RATE", 0, 1000000, 50);
+    h->idle_slack = r_init_confval(h, "CCNR_IDLE_SLACK", 0, 60000, 0) * 1000;
+    h->replica = r_init_confval(h, "CCNR_REPLICA", 0, 1, 0);
     h->debug = 1; /* so that we see any complaints */
     h->debug = r_init_debug_getenv(h, "CCNR_DEBUG");
     h->syncdebug = r_init_debug_getenv(h, "CCNS_DEBUG");
@@ -523,6 +564,8 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     listen_on = getenv("CCNR_LISTEN_ON");
     if (listen_on != NULL && listen_on[0] != 0)
         ccnr_msg(h, "CCNR_LISTEN_ON=%s", listen_on);
+    if (h->replica)
+        ccnr_msg(h, "CCNR_REPLICA=1 - following the index committed by the writer");
     
     if (ccnr_init_repo_keystore(h, NULL) < 0) {
         h->running = -1;
@@ -534,9 +577,21 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     while (h->active_in_fd >= 0) {
         r_dispatch_process_input(h, h->active_in_fd);
         r_store_trim(h, h->cob_limit);
+        r_util_refresh_time(h);
         ccn_schedule_run(h->sched);
     }
+    r_util_refresh_time(h);
+    h->startup_msec = (h->sec - start_sec) * 1000 +
+                      ((long)h->usec - (long)start_usec) / 1000;
     ccnr_msg(h, "Repository file is indexed");
+    if (h->replaybytes != 0) {
+        ccnr_msg(h, "indexed %ju bytes of repository data, ready after %lu.%03lu seconds",
+                 (uintmax_t)h->replaybytes,
+                 h->startup_msec / 1000, h->startup_msec % 1000);
+        /* Write out what was indexed, so a new checkpoint is taken */
+        h->btree->cleanreq++;
+        r_store_index_needs_cleaning(h);
+    }
     if (h->face0 == NULL) {
         struct fdholder *fdholder;
         fdholder = calloc(1, sizeof(*fdholder));
@@ -553,6 +608,8 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
         ccnr_msg(h, "CCNR_SKIP_VERIFY=%s", d);
         ccn_defer_verification(h->direct_client, 1);
     }
+    else if (r_verify_init(h) > 0)
+        ccn_defer_verification(h->direct_client, 1);
 #endif
     if (ccn_connect(h->direct_client, NULL) != -1) {
         int af = 0;
@@ -589,9 +646,12 @@ r_init_create(const char *progname, ccnr_logger logger, void *loggerdata)
     ccnr_internal_client_start(h);
     r_proto_init(h);
     r_proto_activate_policy(h, h->parsed_policy);
+    if (h->replica)
+        goto Bail; /* the writer does the importing and the syncing */
     if (merge_files(h) == -1)
         r_init_fail(h, __LINE__, "Unable to merge additional repository data files.", errno);
     if (h->running == -1) goto Bail;
+    r_watch_init(h);
     SyncInit(h->sync_handle);
 Bail:
     if (sockname)
@@ -622,12 +682,14 @@ r_init_destroy(struct ccnr_handle **pccnr)
     if (h == NULL)
         return;
     stable = h->active_in_fd == -1 ? 1 : 0;
+    r_watch_final(h);
+    r_verify_final(h);
+    r_store_log_flush(h);
     r_io_shutdown_all(h);
     ccnr_direct_client_stop(h);
     ccn_schedule_destroy(&h->sched);
     hashtb_destroy(&h->propagating_tab);
     hashtb_destroy(&h->nameprefix_tab);
-    hashtb_destroy(&h->content_by_accession_tab);
     hashtb_destroy(&h->enum_state_tab);
     
     SyncFreeBase(&h->sync_handle);
@@ -649,10 +711,15 @@ r_init_destroy(struct ccnr_handle **pccnr)
         h->content_by_cookie = NULL;
         h->cookie_limit = 1;
     }
-    ccn_charbuf_destroy(&h->scratch_charbuf);
+    if (h->content_by_accession != NULL) {
+        ccn_memacct_free(&h->mem[CCNR_MEM_ACCESSION], h->content_by_accession);
+        h->content_by_accession = NULL;
+        h->acc_limit = h->acc_count = 0;
+    }
     ccn_indexbuf_destroy(&h->skiplinks);
-    ccn_indexbuf_destroy(&h->scratch_indexbuf);
+    ccn_arena_destroy(&h->scratch);
     ccn_indexbuf_destroy(&h->unsol);
+    hashtb_destroy(&h->policy_prefix_tab);
     if (h->parsed_policy != NULL) {
         ccn_indexbuf_destroy(&h->parsed_policy->namespaces);
         ccn_charbuf_destroy(&h->parsed_policy->store);
@@ -677,6 +744,8 @@ r_init_map_and_process_file(struct ccnr_handle *h, struct ccn_charbuf *filename,
     struct content_entry *content;
     struct ccn_skeleton_decoder *d;
     struct fdholder *fdholder;
+    struct r_bulk *bulk = NULL;
+    off_t offset;
     
     fd = r_io_open_repo_data_file(h, ccn_charbuf_as_string(filename), 0);
     if (fd == -1)   // Normal exit
@@ -703,16 +772,34 @@ r_init_map_and_process_file(struct ccnr_handle *h, struct ccn_charbuf *filename,
     d = &fdholder->decoder;
     msg = mapped_file;
     size = statbuf.st_size;
+    /* Into an empty index, with no one to tell, it is faster in bulk */
+    if (add_content && h->notify_after == CCNR_MAX_ACCESSION)
+        bulk = r_bulk_create(h);
     while (d->index < size) {
         dres = ccn_skeleton_decode(d, msg + d->index, size - d->index);
         if (!CCN_FINAL_DSTATE(d->state))
             break;
+        if (bulk != NULL) {
+            offset = r_store_append_unindexed(h, msg + d->index - dres, dres);
+            if (offset != (off_t)-1 &&
+                r_bulk_add(bulk, msg + d->index - dres, dres, offset) >= 0)
+                continue;
+            /* Index what we have, and carry on one at a time */
+            if (r_bulk_finish(&bulk) < 0)
+                ccnr_msg(h, "bulk load of %s failed",
+                         ccn_charbuf_as_string(filename));
+        }
         if (add_content) {
             content = process_incoming_content(h, fdholder, msg + d->index - dres, dres);
             if (content != NULL)
                 r_store_commit_content(h, content);
         }
     }
+    if (bulk != NULL && r_bulk_finish(&bulk) < 0) {
+        ccnr_msg(h, "bulk load of %s failed", ccn_charbuf_as_string(filename));
+        res = -1;
+        goto Bail;
+    }
     
     if (d->index != size || !CCN_FINAL_DSTATE(d->state)) {
         ccnr_msg(h, "protocol error on fdholder %u (state %d), discarding %d bytes",
@@ -722,6 +809,7 @@ r_init_map_and_process_file(struct ccnr_handle *h, struct ccn_charbuf *filename,
     }
     
 Bail:
+    r_bulk_destroy(&bulk);
     if (mapped_file != MAP_FAILED)
         munmap(mapped_file, statbuf.st_size);
     r_io_shutdown_client_fd(h, fd);
@@ -974,6 +1062,10 @@ load_policy(struct ccnr_handle *ccnr)
     }
     
 CreateNewPolicy:
+    if (ccnr->replica) {
+        r_init_fail(ccnr, __LINE__, "Replica has no usable repository policy", 0);
+        return(-1);
+    }
     ccnr_msg(ccnr, "Creating new policy file.");
     // construct the policy content object
     global_prefix = getenv ("CCNR_GLOBAL_PREFIX");
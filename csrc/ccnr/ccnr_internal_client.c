@@ -33,6 +33,7 @@
 #include <ccn/charbuf.h>
 #include <ccn/ccn_private.h>
 #include <ccn/schedule.h>
+#include <ccn/signer.h>
 #include <ccn/sockaddrutil.h>
 #include <ccn/uri.h>
 #include <ccn/keystore.h>
@@ -265,8 +266,8 @@ ccnr_internal_client_refresh(struct ccn_schedule *sched,
           ccnr->internal_client != NULL &&
           ccnr->internal_client_refresh == ev) {
         microsec = ccn_process_scheduled_operations(ccnr->internal_client);
-        if (microsec > ev->evint)
-            microsec = ev->evint;
+        if (microsec > r_util_idle_period(ccnr, ev->evint))
+            microsec = r_util_idle_period(ccnr, ev->evint);
     }
     if (microsec <= 0 && ccnr->internal_client_refresh == ev)
         ccnr->internal_client_refresh = NULL;
@@ -362,6 +363,11 @@ ccnr_init_repo_keystore(struct ccnr_handle *ccnr, struct ccn *h)
         culprit = NULL;
         goto Finish;
     }
+    if (ccnr->replica) {
+        /* A replica uses the writer's key, and must not make its own */
+        res = -1;
+        goto Finish;
+    }
     /* No stored keystore that we can access. Create one if we can.*/
     res = ccn_keystore_file_init(keystore_path, CCNR_KEYSTORE_PASS, "Repository", 0, 0);
     if (res != 0) {
@@ -398,35 +404,45 @@ Finish:
     return(res);
 }
 
-static int
-post_face_notice(struct ccnr_handle *ccnr, unsigned filedesc)
+/** Most bytes of records in one batch of face notices */
+#define CCNR_NOTICE_BLOCK 4000
+
+/**
+ * Append the notice record for a fdholder, in the format ccnd uses.
+ *
+ * One that is there is told of as "+FILEDESC FLAGS[ ADDRESS:PORT]",
+ * with the flags in hex, and one that has gone away as "-FILEDESC".
+ */
+static void
+append_face_record(struct ccnr_handle *ccnr, unsigned filedesc,
+                   struct ccn_charbuf *msg)
 {
     struct fdholder *fdholder = ccnr_r_io_fdholder_from_fd(ccnr, filedesc);
-    struct ccn_charbuf *msg = ccn_charbuf_create();
-    int res = -1;
     int port;
     
-    // XXX - text version for trying out stream stuff - replace with ccnb
-    if (fdholder == NULL)
-        ccn_charbuf_putf(msg, "destroyface(%u);\n", filedesc);
-    else {
-        ccn_charbuf_putf(msg, "newface(%u, 0x%x", filedesc, fdholder->flags);
-        if (fdholder->name->length != 0 &&
-            (fdholder->flags & (CCNR_FACE_INET | CCNR_FACE_INET6)) != 0) {
-            ccn_charbuf_putf(msg, ", ");
-            port = ccn_charbuf_append_sockaddr(msg, (struct sockaddr *)fdholder->name->buf);
-            if (port < 0)
-                msg->length--;
-            else if (port > 0)
-                ccn_charbuf_putf(msg, ":%d", port);
-        }
-        ccn_charbuf_putf(msg, ");\n", filedesc);
+    if (fdholder == NULL) {
+        ccn_charbuf_putf(msg, "-%u\n", filedesc);
+        return;
     }
-    res = ccn_seqw_write(ccnr->notice, msg->buf, msg->length);
-    ccn_charbuf_destroy(&msg);
-    return(res);
+    ccn_charbuf_putf(msg, "+%u %x", filedesc, fdholder->flags);
+    if (fdholder->name->length != 0 &&
+        (fdholder->flags & (CCNR_FACE_INET | CCNR_FACE_INET6)) != 0) {
+        ccn_charbuf_putf(msg, " ");
+        port = ccn_charbuf_append_sockaddr(msg, (struct sockaddr *)fdholder->name->buf);
+        if (port < 0)
+            msg->length--;
+        else if (port > 0)
+            ccn_charbuf_putf(msg, ":%d", port);
+    }
+    ccn_charbuf_putf(msg, "\n");
 }
 
+/**
+ * Write the changed fdholders as one batch, numbered by an "@SEQ" line.
+ *
+ * What does not fit in CCNR_NOTICE_BLOCK, or all of it if the stream
+ * has no room, is left for the next try.
+ */
 static int
 ccnr_notice_push(struct ccn_schedule *sched,
                void *clienth,
@@ -435,24 +451,36 @@ ccnr_notice_push(struct ccn_schedule *sched,
 {
     struct ccnr_handle *ccnr = clienth;
     struct ccn_indexbuf *chface = NULL;
+    struct ccn_charbuf *msg = NULL;
+    size_t len;
     int i = 0;
     int j = 0;
     int microsec = 0;
-    int res = 0;
     
     if ((flags & CCN_SCHEDULE_CANCEL) == 0 &&
             ccnr->notice != NULL &&
             ccnr->notice_push == ev &&
             ccnr->chface != NULL) {
         chface = ccnr->chface;
-        ccn_seqw_batch_start(ccnr->notice);
-        for (i = 0; i < chface->n && res != -1; i++)
-            res = post_face_notice(ccnr, chface->buf[i]);
-        ccn_seqw_batch_end(ccnr->notice);
+        msg = ccn_charbuf_create();
+        ccn_charbuf_putf(msg, "@%u\n", ccnr->notice_seq + 1);
+        for (i = 0; i < chface->n; i++) {
+            len = msg->length;
+            append_face_record(ccnr, chface->buf[i], msg);
+            if (msg->length > CCNR_NOTICE_BLOCK && i > 0) {
+                msg->length = len;
+                break;
+            }
+        }
+        if (ccn_seqw_write(ccnr->notice, msg->buf, msg->length) < 0)
+            i = 0;
+        else
+            ccnr->notice_seq++;
+        ccn_charbuf_destroy(&msg);
         for (j = 0; i < chface->n; i++, j++)
             chface->buf[j] = chface->buf[i];
         chface->n = j;
-        if (res == -1)
+        if (chface->n > 0)
             microsec = 3000;
     }
     if (microsec <= 0)
@@ -550,6 +578,7 @@ ccnr_direct_client_start(struct ccnr_handle *ccnr)
         ccn_destroy(&ccnr->direct_client);
         return(-1);
     }
+    ccnr->direct_signer = ccn_signer_create(ccnr->direct_client, ccnr->sched);
     ccnr->direct_client_refresh = ccn_schedule_event(ccnr->sched, 50000,
                          ccnr_direct_client_refresh,
                          NULL, CCN_INTEREST_LIFETIME_MICROSEC);
@@ -562,6 +591,7 @@ ccnr_direct_client_stop(struct ccnr_handle *ccnr)
     if (ccnr->notice_push != NULL)
         ccn_schedule_cancel(ccnr->sched, ccnr->notice_push);
     ccn_indexbuf_destroy(&ccnr->chface);
+    ccn_signer_destroy(&ccnr->direct_signer);
     ccn_destroy(&ccnr->direct_client);
     ccn_charbuf_destroy(&ccnr->service_ccnb);
     ccn_charbuf_destroy(&ccnr->neighbor_ccnb);
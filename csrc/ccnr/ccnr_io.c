@@ -40,6 +40,10 @@
 #include <sys/types.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#define CCNR_HAVE_SENDFILE 1
+#endif
 
 #include <ccn/bloom.h>
 #include <ccn/ccn.h>
@@ -62,6 +66,9 @@
 #include "ccnr_msg.h"
 #include "ccnr_sendq.h"
 #include "ccnr_stats.h"
+#include "ccnr_store.h"
+#include "ccnr_verify.h"
+#include "ccnr_watch.h"
 
 /**
  * Looks up a fdholder based on its filedesc (private).
@@ -269,20 +276,19 @@ r_io_accept_connection(struct ccnr_handle *h, int listener_fd)
     return(fd);
 }
 
-PUBLIC int
-r_io_open_repo_data_file(struct ccnr_handle *h, const char *name, int output)
+/**
+ * Open a repository data file, given its path.
+ */
+static int
+r_io_open_repo_path(struct ccnr_handle *h, struct ccn_charbuf *temp, int output)
 {
-    struct ccn_charbuf *temp = NULL;
     int fd = -1;
     struct fdholder *fdholder = NULL;
 
-    temp = ccn_charbuf_create();
-    ccn_charbuf_putf(temp, "%s/%s", h->directory, name);
     fd = open(ccn_charbuf_as_string(temp), output ? (O_CREAT | O_WRONLY | O_APPEND) : O_RDONLY, 0666);
     if (fd == -1) {
         if (CCNSHOULDLOG(h, sdf, CCNL_FINE))
             ccnr_msg(h, "open(%s): %s", ccn_charbuf_as_string(temp), strerror(errno));
-        ccn_charbuf_destroy(&temp);
         return(-1);
     }
     fdholder = r_io_record_fd(h, fd,
@@ -298,27 +304,96 @@ r_io_open_repo_data_file(struct ccnr_handle *h, const char *name, int output)
                 fdholder->bufoffset = 0;
             }
             if (fdholder->inbuf != NULL)
-                ccn_charbuf_reserve(fdholder->inbuf, 256 * 1024);
+                ccn_charbuf_reserve(fdholder->inbuf, h->compact ?
+                                    CCNR_COMPACT_INDEX_BUFSIZE : 256 * 1024);
         }
         if (CCNSHOULDLOG(h, sdf, CCNL_INFO))
             ccnr_msg(h, "opened fd=%d file=%s", fd, ccn_charbuf_as_string(temp));
     }
+    return(fd);
+}
+
+PUBLIC int
+r_io_open_repo_data_file(struct ccnr_handle *h, const char *name, int output)
+{
+    struct ccn_charbuf *temp = NULL;
+    int fd;
+
+    temp = ccn_charbuf_create();
+    if (temp == NULL)
+        return(-1);
+    ccn_charbuf_putf(temp, "%s/%s", h->directory, name);
+    fd = r_io_open_repo_path(h, temp, output);
     ccn_charbuf_destroy(&temp);
     return(fd);
 }
 
 
+/**
+ * Append the file name of a segment of the repository data.
+ *
+ * Segment 1 is repoFile1, for compatibility.  Later segments are not
+ * named repoFile<n>, since those names are taken by files to be merged
+ * in at startup.
+ */
+PUBLIC int
+r_io_repo_segment_name(struct ccn_charbuf *c, unsigned segment)
+{
+    if (segment == 1)
+        return(ccn_charbuf_putf(c, "repoFile1"));
+    return(ccn_charbuf_putf(c, "repoSegment%u", segment));
+}
+
+/**
+ * Append the path of a segment of the repository data, within the
+ * data directory that holds it.
+ */
+PUBLIC int
+r_io_repo_segment_path(struct ccnr_handle *h, struct ccn_charbuf *c,
+                       unsigned segment)
+{
+    const char *dir = h->directory;
+    
+    if (segment < h->n_segment && h->segment[segment].dir < h->n_data_dir)
+        dir = h->data_dir[h->segment[segment].dir];
+    ccn_charbuf_putf(c, "%s/", dir);
+    return(r_io_repo_segment_name(c, segment));
+}
+
+/**
+ * Open a segment of the repository data.
+ */
+PUBLIC int
+r_io_open_repo_segment(struct ccnr_handle *h, unsigned segment, int output)
+{
+    struct ccn_charbuf *path = NULL;
+    int fd;
+    
+    path = ccn_charbuf_create();
+    if (path == NULL)
+        return(-1);
+    r_io_repo_segment_path(h, path, segment);
+    fd = r_io_open_repo_path(h, path, output);
+    ccn_charbuf_destroy(&path);
+    return(fd);
+}
+
 PUBLIC int
 r_io_repo_data_file_fd(struct ccnr_handle *h, unsigned repofile, int output)
 {
-    if (repofile != 1)
+    struct ccnr_segment *seg = NULL;
+    
+    if (repofile == 0 || repofile >= h->n_segment)
         return(-1);
     if (output)
         return(-1);
-    if (h->repofile1_fd > 0)
-        return(h->repofile1_fd);
-    h->repofile1_fd = r_io_open_repo_data_file(h, "repoFile1", 0);
-    return(h->repofile1_fd);
+    seg = &h->segment[repofile];
+    if (seg->state == CCNR_SEG_ABSENT)
+        return(-1);
+    if (seg->fd > 0)
+        return(seg->fd);
+    seg->fd = r_io_open_repo_segment(h, repofile, 0);
+    return(seg->fd);
 }
 
 PUBLIC void
@@ -356,8 +431,9 @@ r_io_shutdown_client_fd(struct ccnr_handle *h, int fd)
         h->active_in_fd = -1;
     if (h->active_out_fd == fd)
         h->active_out_fd = -1;
-    if (h->repofile1_fd == fd)
-        h->repofile1_fd = -1;
+    for (m = 1; m < h->n_segment; m++)
+        if (h->segment[m].fd == fd)
+            h->segment[m].fd = -1;
     // r_fwd_reap_needed(h, 250000);
 }
 
@@ -434,6 +510,7 @@ r_io_send(struct ccnr_handle *h,
         *offsetp = (off_t)-1;
     if ((fdholder->flags & CCNR_FACE_NOSEND) != 0)
         return;
+    h->busy_sec = h->sec;
     if (fdholder->outbuf != NULL) {
         ccn_charbuf_append(fdholder->outbuf, data, size);
         return;
@@ -462,13 +539,6 @@ r_io_send(struct ccnr_handle *h,
         }
         if (offsetp != NULL)
             *offsetp = offset;
-        if (fdholder->filedesc == h->active_out_fd) {
-            if (offset != h->stable && h->stable != 0)
-                ccnr_msg(h, "expected file size %ju, found %ju",
-                    (uintmax_t)h->stable,
-                    (uintmax_t)offset);
-            h->stable = offset + size;
-        }
     }
     if ((fdholder->flags & CCNR_FACE_DGRAM) == 0)
         res = write(fdholder->filedesc, data, size);
@@ -498,6 +568,59 @@ r_io_send(struct ccnr_handle *h,
     ccn_charbuf_append(fdholder->outbuf,
                        ((const unsigned char *)data) + res, size - res);
 }
+
+/**
+ * Send data that is also held in a repository file.
+ *
+ * On a stream, this lets the kernel take the bytes straight from the
+ * file, and only what does not fit is copied, into the output buffer.
+ * Anywhere else the data is sent as by r_io_send.
+ * @param data - the bytes, as found at offset in fd
+ * @returns 1 if the bytes were sent from the file, else 0.
+ */
+PUBLIC int
+r_io_send_file(struct ccnr_handle *h,
+               struct fdholder *fdholder,
+               const void *data, size_t size,
+               int fd, off_t offset)
+{
+    ssize_t res;
+    
+    if ((fdholder->flags & CCNR_FACE_NOSEND) != 0)
+        return(0);
+    if ((fdholder->flags & CCNR_FACE_CCND) != 0) {
+        ccnr_meter_bump(h, fdholder->meter[FM_BYTO], size);
+        res = ccn_put_from_file(h->direct_client, data, size, fd, offset);
+        if (res < 0 && CCNSHOULDLOG(h, r_io_send, CCNL_WARNING))
+            ccnr_msg(h, "ccn_put failed");
+        return(res >= 0);
+    }
+#if defined(CCNR_HAVE_SENDFILE)
+    if (fdholder->outbuf == NULL && fdholder != h->face0 &&
+        (fdholder->flags & (CCNR_FACE_DGRAM | CCNR_FACE_REPODATA)) == 0) {
+        res = sendfile(fdholder->filedesc, fd, &offset, size);
+        if (res == -1 && errno == EAGAIN)
+            res = 0;
+        if (res >= 0) {
+            ccnr_meter_bump(h, fdholder->meter[FM_BYTO], res);
+            if (res == size)
+                return(1);
+            fdholder->outbufindex = 0;
+            fdholder->outbuf = ccn_charbuf_create();
+            if (fdholder->outbuf == NULL) {
+                ccnr_msg(h, "do_write: %s", strerror(errno));
+                return(1);
+            }
+            ccn_charbuf_append(fdholder->outbuf,
+                               ((const unsigned char *)data) + res, size - res);
+            return(1);
+        }
+    }
+#endif
+    r_io_send(h, fdholder, data, size, NULL);
+    return(0);
+}
+
 /**
  * Set up the array of fd descriptors for the poll(2) call.
  *
@@ -506,10 +629,22 @@ PUBLIC void
 r_io_prepare_poll_fds(struct ccnr_handle *h)
 {
     int i, j, nfds;
+    int fetchfd;
+    int verifyfd;
+    int watchfd;
     
     for (i = 1, nfds = 0; i < h->face_limit; i++)
         if (r_io_fdholder_from_fd(h, i) != NULL)
             nfds++;
+    fetchfd = r_store_fetch_fd(h);
+    if (fetchfd != -1)
+        nfds++;
+    verifyfd = r_verify_fd(h);
+    if (verifyfd != -1)
+        nfds++;
+    watchfd = r_watch_fd(h);
+    if (watchfd != -1)
+        nfds++;
     
     if (nfds != h->nfds) {
         h->nfds = nfds;
@@ -537,6 +672,21 @@ r_io_prepare_poll_fds(struct ccnr_handle *h)
             j++;
         }
     }
+    if (fetchfd != -1) {
+        h->fds[j].fd = fetchfd;
+        h->fds[j].events = POLLIN;
+        j++;
+    }
+    if (verifyfd != -1) {
+        h->fds[j].fd = verifyfd;
+        h->fds[j].events = POLLIN;
+        j++;
+    }
+    if (watchfd != -1) {
+        h->fds[j].fd = watchfd;
+        h->fds[j].events = POLLIN;
+        j++;
+    }
 }
 
 /**
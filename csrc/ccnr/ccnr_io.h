@@ -29,9 +29,14 @@ void r_io_shutdown_all(struct ccnr_handle *h);
 void r_io_prepare_poll_fds(struct ccnr_handle *h);
 void r_dispatch_process_internal_client_buffer(struct ccnr_handle *h);
 void r_io_send(struct ccnr_handle *h,struct fdholder *fdholder,const void *data,size_t size,off_t *offsetp);
+int r_io_send_file(struct ccnr_handle *h,struct fdholder *fdholder,const void *data,size_t size,int fd,off_t offset);
 int r_io_destroy_face(struct ccnr_handle *h,unsigned filedesc);
 int r_io_open_repo_data_file(struct ccnr_handle *h, const char *name, int output);
 int r_io_repo_data_file_fd(struct ccnr_handle *h, unsigned repofile, int output);
+int r_io_repo_segment_name(struct ccn_charbuf *c, unsigned segment);
+int r_io_repo_segment_path(struct ccnr_handle *h, struct ccn_charbuf *c,
+                           unsigned segment);
+int r_io_open_repo_segment(struct ccnr_handle *h, unsigned segment, int output);
 void r_io_shutdown_client_fd(struct ccnr_handle *h,int fd);
 int r_io_accept_connection(struct ccnr_handle *h,int listener_fd);
 struct fdholder *r_io_record_fd(struct ccnr_handle *h,int fd,void *who,socklen_t wholen,int setflags);
@@ -65,8 +65,25 @@ static const char *ccnr_usage_message =
 "      WARNING - warnings\n"
 "      INFO - informational messages\n"
 "      FINE, FINER, FINEST - debugging/tracing\n"
+"    CCNR_LOG_RATE=50\n"
+"      0..1000000 (default 50) Most messages a second logged from one place\n"
+"      in the code; the number dropped is logged later.  0 means no limit.\n"
+"    CCNR_IDLE_SLACK=0\n"
+"      0..60000 (default 0) Milliseconds by which timers may be put off\n"
+"      while ccnr is idle, so that housekeeping shares wakeups.\n"
+"    CCNR_PROFILE=\n"
+"      compact for small devices: the hash tables shrink as they empty, and\n"
+"      the defaults become CCNR_CONTENT_CACHE=256,\n"
+"      CCNR_CONTENT_CACHE_BYTES=1048576, CCNR_BTREE_NODE_POOL=64 and\n"
+"      CCNR_BTREE_CACHE_BYTES=2097152.\n"
 "    CCNR_DIRECTORY=.\n"
 "      Directory where ccnr data is kept\n"
+"    CCNR_REPLICA=0\n"
+"      1 to serve read-only from a repository that another ccnr is\n"
+"      writing, following the index it commits.  Needs the pages store.\n"
+"    CCNR_REPLICA_FOLLOW=1000\n"
+"      10..60000 (default 1000) Milliseconds between looks for a new\n"
+"      commit, in replica mode.\n"
 "      Defaults to current directory\n"
 "      Ignored in config file\n"
 "    CCNR_GLOBAL_PREFIX=ccnx:/parc.com/csl/ccn/Repos\n"
@@ -83,8 +100,49 @@ static const char *ccnr_usage_message =
 "      1024..8388608 (default 2097152) Maximum node size (bytes).\n"
 "    CCNR_BTREE_NODE_POOL=512\n"
 "      16..2000000 (default 512) Maximum number of btree nodes in memory.\n"
+"    CCNR_BTREE_CACHE_BYTES=0\n"
+"      0..68719476736 (default 0) Maximum bytes of btree nodes in memory; 0 for no limit.\n"
+"    CCNR_BTREE_COMPACT_IDLE=10\n"
+"      0..3600 (default 10) Quiet seconds before merging sparse btree nodes; 0 for never.\n"
+"    CCNR_BTREE_STORE=pages\n"
+"      How the index is kept: 'pages' (default) for one file of pages,\n"
+"      or 'files' for a file per btree node.\n"
+"    CCNR_BULK_LOAD_BYTES=67108864\n"
+"      0..1073741824 (default 67108864) Sort memory for building the index in bulk; 0 disables.\n"
+"    CCNR_BULK_LOAD_FILL=90\n"
+"      50..100 (default 90) Percent fill of index nodes built in bulk.\n"
+"    CCNR_COMMIT_BYTES=1048576\n"
+"      4096..16777216 (default 1048576) Commit appends early once this many bytes wait.\n"
+"    CCNR_COMMIT_SYNC=0\n"
+"      0..1 (default 0) Sync repoFile1 to disk after each commit (1), or not (0).\n"
+"    CCNR_COMMIT_USEC=5000\n"
+"      0..1000000 (default 5000) Microseconds that appends to repoFile1 may wait\n"
+"      to be written together.  0 means each ContentObject is written as it arrives.\n"
 "    CCNR_CONTENT_CACHE=4201\n"
 "      16..2000000 (default 4201) Maximum number of ContentObjects cached in memory.\n"
+"    CCNR_CONTENT_CACHE_BYTES=33554432\n"
+"      65536..1099511627776 (default 33554432) Maximum bytes of ContentObjects\n"
+"      cached in memory.\n"
+"    CCNR_FETCH_LIMIT=16\n"
+"      0..256 (default 16 per data directory) Maximum number of asynchronous\n"
+"      content reads in flight.  0 means content is read synchronously.\n"
+"    CCNR_FETCH_READAHEAD=2\n"
+"      0..16 (default 2) Following ContentObjects to read along with a cache miss.\n"
+"    CCNR_SEGMENT_BYTES=1073741824\n"
+"      65536..1099511627776 (default 1073741824) Size at which a new repository\n"
+"      data segment is started.\n"
+"    CCNR_SEGMENT_LIVE=50\n"
+"      0..99 (default 50) Copy out the live content of a segment once less than\n"
+"      this percent of it is live, then remove it.  0 disables cleaning.\n"
+"    CCNR_DATA_DIRECTORIES=\n"
+"      Colon-separated directories, besides CCNR_DIRECTORY, to hold new\n"
+"      repository data segments, e.g. on other disks.\n"
+"    CCNR_DATA_PLACEMENT=0\n"
+"      0..1 (default 0) Put each new segment in the next data directory in\n"
+"      turn (0), or in the one with the most space free (1).\n"
+"    CCNR_SENDFILE=1\n"
+"      0..1 (default 1) Send content not cached in memory straight from\n"
+"      the repository file to stream connections.\n"
 "    CCNR_MIN_SEND_BUFSIZE=16384\n"
 "      Minimum in bytes for output socket buffering.\n"
 "    CCNR_PROTO=unix\n"
@@ -93,6 +151,19 @@ static const char *ccnr_usage_message =
 "      List of ip addresses to listen on for status; defaults to wildcard.\n"
 "    CCNR_STATUS_PORT=\n"
 "      Port to use for status server; default is to not serve status.\n"
+"    CCNR_VERIFY_THREADS=2\n"
+"      0..64 (default 2) Threads to check the signatures of incoming content.\n"
+"      0 checks them as they arrive.  Ignored with CCNR_SKIP_VERIFY=1.\n"
+"    CCNR_WATCH_DIRECTORY=\n"
+"      Directory whose new files are published into the repository as they\n"
+"      are written.  Needs CCNR_WATCH_PREFIX.\n"
+"    CCNR_WATCH_PREFIX=\n"
+"      ccnx URI under which watched files are named.\n"
+"    CCNR_WATCH_BLOCKSIZE=4096\n"
+"      1..8192 (default 4096) Bytes in each segment of a watched file.\n"
+"    CCNR_WATCH_IDLE=5\n"
+"      1..3600 (default 5) Seconds without growth after which a watched file\n"
+"      is given its final segment.\n"
 "    CCNS_DEBUG=WARNING\n"
 "      Same values as for CCNR_DEBUG.\n"
 "    CCNS_ENABLE=1\n"
@@ -112,9 +183,16 @@ static const char *ccnr_usage_message =
 "    CCNS_NODE_FETCH_LIFETIME=4\n"
 "      1..30 (default 4) lifetime (seconds) for Sync node fetch response.\n"
 "    CCNS_MAX_FETCH_BUSY=6\n"
-"      1..100 (default 6) maximum simultaneous node or content fetches per Sync root.\n"
+"      1..100 (default 6) maximum simultaneous node fetches per Sync root,\n"
+"      and the starting window for content fetches.\n"
+"    CCNS_MAX_FETCH_WINDOW=64\n"
+"      1..1000 (default 64) maximum simultaneous content fetches per Sync root.\n"
 "    CCNS_MAX_COMPARES_BUSY=4\n"
 "      1..100 (default 4) maximum simultaneous Sync roots in compare state.\n"
+"    CCNS_IBLT_CELLS=0\n"
+"      Disable (0, default) or enable (3..99) cells in IBLT RootAdvise responses.\n"
+"    CCNS_NODE_BATCH_BYTES=0\n"
+"      Disable (0, default) or enable (1..8000) bytes of nodes in NodeFetch batches.\n"
 "    CCNS_NOTE_ERR=0\n"
 "      Disable (0, default) or enable (1) exceptional Sync error reporting.\n"
 ;
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <sys/time.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -75,46 +76,127 @@ ccnr_msg_level_from_string(const char *s)
 }
 
 /**
- *  Produce ccnr debug output.
- *  Output is produced via h->logger under the control of h->debug;
- *  prepends decimal timestamp and process identification.
- *  Caller should not supply newlines.
- *  @param      h  the ccnr handle
- *  @param      fmt  printf-like format string
+ * Write one message through h->logger, without rate limiting.
  */
-void
-ccnr_msg(struct ccnr_handle *h, const char *fmt, ...)
+static void
+ccnr_vmsg(struct ccnr_handle *h, struct timeval *t, const char *fmt, va_list ap)
 {
-    struct timeval t;
-    va_list ap;
     struct ccn_charbuf *b;
     int res;
-    if (h == NULL || h->debug == 0 || h->logger == 0)
-        return;
     b = ccn_charbuf_create();
     if (b == NULL)
         return;
-    gettimeofday(&t, NULL);
     if ((h->debug >= CCNL_FINE) &&
-        ((h->logbreak-- < 0 && t.tv_sec != h->logtime) ||
-          t.tv_sec >= h->logtime + 30)) {
+        ((h->logbreak-- < 0 && t->tv_sec != h->logtime) ||
+          t->tv_sec >= h->logtime + 30)) {
         ccn_charbuf_putf(b, "%ld.000000 ccnr[%d]: %s ____________________ %s",
-                         (long)t.tv_sec, h->logpid, h->portstr ? h->portstr : "", ctime(&t.tv_sec));
-        h->logtime = t.tv_sec;
+                         (long)t->tv_sec, h->logpid, h->portstr ? h->portstr : "", ctime(&t->tv_sec));
+        h->logtime = t->tv_sec;
         h->logbreak = 30;
     }
     ccn_charbuf_putf(b, "%ld.%06u ccnr[%d]: %s\n",
-        (long)t.tv_sec, (unsigned)t.tv_usec, h->logpid, fmt);
-    va_start(ap, fmt);
+        (long)t->tv_sec, (unsigned)t->tv_usec, h->logpid, fmt);
     /* b should already have null termination, but use call for cleanliness */
     res = (*h->logger)(h->loggerdata, ccn_charbuf_as_string(b), ap);
-    va_end(ap);
     ccn_charbuf_destroy(&b);
     /* if there's no one to hear, don't make a sound */
     if (res < 0)
         h->debug = 0;
 }
 
+static void
+ccnr_msg_now(struct ccnr_handle *h, struct timeval *t, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    ccnr_vmsg(h, t, fmt, ap);
+    va_end(ap);
+}
+
+/**
+ * Report how many messages were dropped at a call site.
+ */
+static void
+ccnr_logsite_report(struct ccnr_handle *h, struct ccnr_logsite *s,
+                    struct timeval *t)
+{
+    if (s->suppressed == 0)
+        return;
+    ccnr_msg_now(h, t, "suppressed %u more like \"%s\"", s->suppressed, s->fmt);
+    s->suppressed = 0;
+    h->logsuppressed--;
+}
+
+/**
+ * Report the messages dropped at any call site in earlier seconds.
+ */
+static void
+ccnr_msg_flush(struct ccnr_handle *h, struct timeval *t)
+{
+    int i;
+    for (i = 0; i < CCNR_LOGSITES && h->logsuppressed > 0; i++)
+        if (h->logsites[i].sec != (unsigned long)t->tv_sec)
+            ccnr_logsite_report(h, &h->logsites[i], t);
+}
+
+/**
+ * Decide whether a message from a call site is within h->lograte.
+ *
+ * Call sites are told apart by their format strings, in a small
+ * direct-mapped table; a site that collides with another takes over
+ * its slot, after reporting what it had dropped.
+ * @returns 1 if the message should go out, 0 to drop it.
+ */
+static int
+ccnr_msg_allowed(struct ccnr_handle *h, const char *fmt, struct timeval *t)
+{
+    struct ccnr_logsite *s;
+    uintptr_t x = (uintptr_t)fmt;
+    
+    s = &h->logsites[(x ^ (x >> 6)) % CCNR_LOGSITES];
+    if (s->fmt != fmt || s->sec != (unsigned long)t->tv_sec) {
+        ccnr_logsite_report(h, s, t);
+        s->fmt = fmt;
+        s->sec = t->tv_sec;
+        s->count = 0;
+    }
+    if (s->count >= h->lograte) {
+        if (s->suppressed++ == 0)
+            h->logsuppressed++;
+        return(0);
+    }
+    s->count++;
+    return(1);
+}
+
+/**
+ *  Produce ccnr debug output.
+ *  Output is produced via h->logger under the control of h->debug;
+ *  prepends decimal timestamp and process identification.
+ *  Caller should not supply newlines.
+ *  No more than h->lograte messages a second are produced from one
+ *  call site, if that is nonzero.  The rest are counted, and the
+ *  counts are reported along with a later message.
+ *  @param      h  the ccnr handle
+ *  @param      fmt  printf-like format string
+ */
+void
+ccnr_msg(struct ccnr_handle *h, const char *fmt, ...)
+{
+    struct timeval t;
+    va_list ap;
+    if (h == NULL || h->debug == 0 || h->logger == 0)
+        return;
+    gettimeofday(&t, NULL);
+    if (h->lograte != 0 && !ccnr_msg_allowed(h, fmt, &t))
+        return;
+    if (h->logsuppressed != 0)
+        ccnr_msg_flush(h, &t);
+    va_start(ap, fmt);
+    ccnr_vmsg(h, &t, fmt, ap);
+    va_end(ap);
+}
+
 /**
  *  Produce a ccnr debug trace entry.
  *  Output is produced by calling ccnr_msg.
@@ -135,6 +217,7 @@ ccnr_debug_ccnb(struct ccnr_handle *h,
 {
     struct ccn_charbuf *c;
     struct ccn_parsed_interest pi;
+    struct timeval t;
     const unsigned char *nonce = NULL;
     size_t nonce_size = 0;
     size_t i;
@@ -163,7 +246,11 @@ ccnr_debug_ccnb(struct ccnr_handle *h,
                 ccn_charbuf_putf(c, "%s%02X", (*p) && (*p++)=='-' ? "-" : "", nonce[i]);
         }
     }
-    ccnr_msg(h, "%s", ccn_charbuf_as_string(c));
+    /* Traces are asked for by h->debug, so they are not rate limited */
+    if (h != NULL && h->logger != 0) {
+        gettimeofday(&t, NULL);
+        ccnr_msg_now(h, &t, "%s", ccn_charbuf_as_string(c));
+    }
     ccn_charbuf_destroy(&c);
 }
 
@@ -31,8 +31,10 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/coding.h>
+#include <ccn/memacct.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/schedule.h>
 #include <ccn/seqwriter.h>
@@ -43,9 +45,13 @@
  */
 struct ccn_charbuf;
 struct ccn_indexbuf;
+struct ccn_arena;
 struct hashtb;
 struct ccnr_meter;
 struct ccn_btree;
+struct ccn_btree_cursor;
+struct ccn_uring;
+struct ccn_signer;
 
 struct SyncBaseStruct;
 /*
@@ -54,12 +60,16 @@ struct SyncBaseStruct;
 struct ccnr_handle;
 struct fdholder;
 struct content_entry;
+struct ccnr_fetch;
+struct ccnr_cob_cache;
+struct ccnr_watch;
 struct nameprefix_entry;
 struct propagating_entry;
 struct content_tree_node;
 struct ccn_forwarding;
 struct enum_state;
 struct ccnr_parsed_policy;
+struct ccnr_expect_content;
 
 /* Repository-specific content identifiers */
 
@@ -142,6 +152,18 @@ typedef unsigned ccnr_cookie;
 /** Logger type (ccnr_logger) */
 typedef int (*ccnr_logger)(void *loggerdata, const char *format, va_list ap);
 
+/**
+ * Rate limiting state for the ccnr_msg calls from one call site,
+ * which is known by its format string.
+ */
+struct ccnr_logsite {
+    const char *fmt;                /**< format string, or NULL */
+    unsigned long sec;              /**< second being counted */
+    unsigned count;                 /**< messages produced in that second */
+    unsigned suppressed;            /**< dropped and not yet reported */
+};
+#define CCNR_LOGSITES 64
+
 /**
  * This is true if we should log at the given level.
  * 
@@ -162,6 +184,104 @@ typedef int (*ccnr_logger)(void *loggerdata, const char *format, va_list ap);
  */
 #define CCNR_MAX_ENUM 64
 
+/**
+ * Idle mode, with CCNR_IDLE_SLACK set.  Once no interests are pending
+ * and no message has come or gone for CCNR_QUIET_SECS, timers are
+ * allowed the slack, and the periodic housekeeping runs
+ * CCNR_IDLE_STRETCH times less often.
+ */
+#define CCNR_QUIET_SECS 2
+#define CCNR_IDLE_STRETCH 4
+
+/**
+ * The compact profile (CCNR_PROFILE=compact), for small devices.
+ * These are the defaults for the cache limits that are not set
+ * explicitly; the hash tables also shrink again when they empty.
+ */
+#define CCNR_COMPACT_CONTENT_CACHE 256
+#define CCNR_COMPACT_CONTENT_CACHE_BYTES 1048576
+#define CCNR_COMPACT_BTREE_NODE_POOL 64
+#define CCNR_COMPACT_BTREE_CACHE_BYTES 2097152
+#define CCNR_COMPACT_INDEX_BUFSIZE (32 * 1024)
+
+/**
+ * A read-only mapping of a segment of the repository data
+ *
+ * The mapping is made larger than the file, so that it seldom needs to
+ * be replaced as the file grows.  A replaced mapping is kept until the
+ * next safe point, since its addresses may still be in use.
+ */
+struct ccnr_repomap {
+    unsigned char *addr;            /**< start of mapping, or NULL */
+    size_t size;                    /**< length of mapping */
+    off_t valid;                    /**< file bytes known to be there */
+    unsigned char *old;             /**< replaced mapping, or NULL */
+    size_t oldsize;                 /**< length of replaced mapping */
+    int disabled;                   /**< nonzero if mmap failed */
+};
+
+/**
+ * What is happening to a segment of the repository data
+ */
+enum ccnr_segment_state {
+    CCNR_SEG_ABSENT = 0,            /**< no such file */
+    CCNR_SEG_SEALED,                /**< full, and only read from */
+    CCNR_SEG_ACTIVE,                /**< being appended to */
+    CCNR_SEG_EVACUATING,            /**< live content is being copied out */
+    CCNR_SEG_EMPTY                  /**< goes once the index is committed */
+};
+
+/**
+ * One of the files holding the repository data
+ *
+ * Segment 1 is repoFile1, and segment n is repoSegment<n> after that.
+ * Segments may live in any of the data directories, but repoFile1
+ * is always in the repository directory.  Content is appended to the last segment until it reaches
+ * CCNR_SEGMENT_BYTES, and then a new one is begun.  The live bytes
+ * are those the index refers to, as counted by the segment cleaner.
+ */
+struct ccnr_segment {
+    enum ccnr_segment_state state;
+    int fd;                         /**< read-only access, or -1 */
+    unsigned dir;                   /**< index into data_dir */
+    off_t size;                     /**< bytes in the file */
+    uintmax_t live;                 /**< live bytes as of the last pass */
+    uintmax_t counting;             /**< live bytes seen in this pass */
+    off_t mark;                     /**< EMPTY: index must cover this */
+    struct ccnr_repomap map;        /**< read-only mapping */
+};
+
+/** Index levels covered by the fill statistics */
+#define CCNR_FILL_LEVELS 8
+
+/**
+ * Occupancy of the index nodes at one level of the btree
+ */
+struct ccnr_index_fill {
+    uintmax_t nodes;                /**< nodes seen at this level */
+    uintmax_t entries;              /**< entries in those nodes */
+    uintmax_t bytes;                /**< size of those nodes */
+    unsigned last;                  /**< nodeid last counted */
+};
+
+/**
+ * Memory accounting tags
+ *
+ * The hash tables are charged as they allocate.  The index cache, the
+ * content cache and the scheduler keep their own totals, which are
+ * copied in when the tags are reported.
+ */
+enum ccnr_mem_tag {
+    CCNR_MEM_NAMEPREFIX,    /**< nameprefix_tab */
+    CCNR_MEM_PIT,           /**< propagating_tab */
+    CCNR_MEM_ENUM,          /**< enum_state_tab */
+    CCNR_MEM_ACCESSION,     /**< content_by_accession */
+    CCNR_MEM_BTREE,         /**< resident btree index nodes */
+    CCNR_MEM_COBS,          /**< cached ContentObjects */
+    CCNR_MEM_SCHED,         /**< scheduled events */
+    CCNR_MEM_N
+};
+
 /**
  * We pass this handle almost everywhere within ccnr
  */
@@ -173,6 +293,7 @@ struct ccnr_handle {
     struct hashtb *enum_state_tab;  /**< keyed by enumeration interest */
     struct ccn_indexbuf *skiplinks; /**< skiplist for content-ordered ops */
     struct ccn_btree *btree;        /**< btree index of content */
+    struct ccn_memacct mem[CCNR_MEM_N]; /**< memory, by subsystem */
     unsigned forward_to_gen;        /**< for forward_to updates */
     unsigned face_gen;              /**< filedesc generation number */
     unsigned face_rover;            /**< for filedesc allocation */
@@ -180,9 +301,28 @@ struct ccnr_handle {
     struct fdholder **fdholder_by_fd;  /**< array with face_limit elements */
     int active_in_fd;               /**< data currently being indexed */
     int active_out_fd;              /**< repo file we will write to */
-    int repofile1_fd;               /**< read-only access to repoFile1 */
-    off_t startupbytes;             /**< repoFile1 size at startup */
-    off_t stable;                   /**< repoFile1 size at shutdown */
+    struct ccnr_segment *segment;   /**< repository data, by segment number */
+    unsigned n_segment;             /**< slots in the segment array */
+    unsigned out_segment;           /**< segment being appended to */
+    unsigned in_segment;            /**< segment being indexed */
+    char **data_dir;                /**< where segments go; 0 is directory */
+    unsigned n_data_dir;            /**< number of data directories */
+    unsigned data_placement;        /**< 0 round robin, 1 most free space */
+    off_t segment_bytes;            /**< begin a new segment at this size */
+    unsigned segment_live_pct;      /**< clean segments less live than this */
+    size_t pagesize;                /**< for residency checks */
+    off_t startupbytes;             /**< repository data size at startup */
+    off_t replaybytes;              /**< bytes indexed at startup */
+    unsigned long startup_msec;     /**< time taken to get ready to serve */
+    off_t stable;                   /**< end of repository data at shutdown */
+    struct ccn_charbuf *log_buf;    /**< appends awaiting commit */
+    off_t log_written;              /**< out_segment has been written this far */
+    off_t checkpoint;               /**< index files cover the data this far */
+    struct ccn_scheduled_event *log_committer; /**< group commit timer */
+    struct ccn_scheduled_event *checkpointer; /**< gets the index written */
+    unsigned log_commit_usec;       /**< how long appends may wait */
+    size_t log_commit_bytes;        /**< commit early at this many bytes */
+    int log_sync;                   /**< fdatasync after each commit */
     struct ccn_scheduled_event *reaper;
     struct ccn_scheduled_event *age;
     struct ccn_scheduled_event *clean;
@@ -190,29 +330,58 @@ struct ccnr_handle {
     struct ccn_scheduled_event *reap_enumerations; /**< cleans out old enumeration state */
     struct ccn_scheduled_event *index_cleaner; /**< writes out btree nodes */
     struct ccn_indexbuf *toclean;   /**< for index_cleaner use */
+    struct ccn_scheduled_event *index_compactor; /**< merges sparse nodes */
+    struct ccn_charbuf *compact_key; /**< where the compactor pass is */
+    unsigned compact_idle_usec;     /**< quiet time before compacting */
+    unsigned long compact_activity; /**< traffic as of the last look */
+    unsigned long compact_merges;   /**< index nodes merged away */
+    struct ccnr_index_fill fill[CCNR_FILL_LEVELS]; /**< last full pass */
+    struct ccnr_index_fill filling[CCNR_FILL_LEVELS]; /**< pass under way */
+    struct ccn_scheduled_event *segment_cleaner; /**< reclaims dead space */
+    struct ccn_charbuf *segclean_key; /**< where the cleaner pass is */
+    uintmax_t segment_copied;       /**< bytes moved out of sparse segments */
+    unsigned long segments_removed; /**< segment files unlinked */
+    int replica;                    /**< CCNR_REPLICA - follow, never write */
+    unsigned replica_follow_usec;   /**< how often to look for a new commit */
+    struct ccn_scheduled_event *replica_follower; /**< picks up commits */
+    unsigned long replica_refreshes; /**< commits picked up */
+    unsigned long replica_failures; /**< refreshes that did not work */
     const char *portstr;            /**< port number for status display */
     nfds_t nfds;                    /**< number of entries in fds array */
     struct pollfd *fds;             /**< used for poll system call */
-    struct ccn_gettime ticktock;    /**< our time generator */
-    long sec;                       /**< cached gettime seconds */
-    unsigned usec;                  /**< cached gettime microseconds */
-    long starttime;                 /**< ccnr start time, in seconds */
+    struct ccn_clock clock;         /**< our monotonic time source */
+    long sec;                       /**< cached clock seconds */
+    unsigned usec;                  /**< cached clock microseconds */
+    long starttime;                 /**< ccnr start (wall clock) seconds */
     unsigned starttime_usec;        /**< ccnr start time fractional part */
     struct ccn_schedule *sched;     /**< our schedule */
-    struct ccn_charbuf *scratch_charbuf; /**< one-slot scratch cache */
-    struct ccn_indexbuf *scratch_indexbuf; /**< one-slot scratch cache */
+    int compact;                    /**< CCNR_PROFILE=compact */
+    int idle_slack;                 /**< CCNR_IDLE_SLACK (usec), 0 for none */
+    int quiet;                      /**< nonzero while in idle mode */
+    long busy_sec;                  /**< when a message last came or went */
+    struct ccn_arena *scratch;      /**< buffers for per-message temporaries */
     /** Next two fields are used for direct cookie-to-content table */
     unsigned cookie_limit;          /**< content_by_cookie size(power of 2)*/
     struct content_entry **content_by_cookie; /**< cookie-to-content table */
-    struct hashtb *content_by_accession_tab; /**< keyed by accession */
+    unsigned acc_limit;             /**< content_by_accession size(power of 2)*/
+    unsigned long acc_count;        /**< handles in content_by_accession */
+    struct content_entry **content_by_accession; /**< accession-to-content map */
     ccnr_cookie cookie;      /**< newest used cookie number */
     ccnr_cookie min_stale;      /**< smallest cookie of stale content */
     ccnr_cookie max_stale;      /**< largest cookie of stale content */
-    ccnr_cookie trim_rover;     /**< where we left off trimming */
     unsigned long n_stale;          /**< Number of stale content objects */
     struct ccn_indexbuf *unsol;     /**< unsolicited content */
     unsigned long cob_count;  /**< count of accessioned content objects in memory */
     unsigned long cob_limit;  /**< trim when we get beyond this */
+    uintmax_t cob_bytes;      /**< total size of those objects */
+    uintmax_t cob_byte_limit; /**< trim when we get beyond this */
+    struct ccnr_cob_cache *cob_cache; /**< recency lists and admission filter */
+    struct ccn_uring *fetch_ring;   /**< for asynchronous reads, or NULL */
+    struct ccnr_fetch *fetch;       /**< fetch_limit slots for reads */
+    int fetch_limit;                /**< maximum reads in flight */
+    int fetch_outstanding;          /**< reads in flight */
+    int fetch_readahead;            /**< how far to read ahead on a miss */
+    int send_from_file;             /**< send stored content with sendfile */
     unsigned long oldformatcontent;
     unsigned long oldformatcontentgrumble;
     unsigned long oldformatinterests;
@@ -225,7 +394,22 @@ struct ccnr_handle {
     unsigned long interests_stuffed;
     unsigned long content_from_accession_hits;
     unsigned long content_from_accession_misses;
+    unsigned long cob_hits;         /**< content found in the cob cache */
+    unsigned long cob_misses;       /**< content mapped or read instead */
+    unsigned long cob_evictions;    /**< cobs trimmed to stay in the limits */
+    unsigned long cob_rejections;   /**< cobs the admission filter refused */
+    unsigned long content_sent_from_file; /**< sent straight from repoFile1 */
+    struct ccn_verifier *verifier;  /**< signature checking threads, or NULL */
+    unsigned long content_verified; /**< incoming content that passed */
+    unsigned long content_verify_failed; /**< and that was refused */
+    struct ccnr_watch *watch;       /**< directory watched for ingest, or NULL */
+    unsigned long watch_files;      /**< versions begun by directory ingest */
+    unsigned long watch_segments;   /**< segments stored by directory ingest */
     unsigned start_write_scope_limit;    /**< Scope on start-write must be <= this value.  3 indicates unlimited */
+    struct ccnr_expect_content *writes; /**< start-writes in progress */
+    int n_writes;                   /**< how many are listed in writes */
+    uintmax_t write_segments;       /**< segments fetched for start-writes */
+    unsigned long write_timeouts;   /**< their Interests that timed out */
     unsigned short seed[3];         /**< for PRNG */
     int running;                    /**< true while should be running */
     int debug;                      /**< For controlling debug output */
@@ -235,18 +419,25 @@ struct ccnr_handle {
     int logbreak;                   /**< see ccnr_msg() */
     unsigned long logtime;          /**< see ccnr_msg() */
     int logpid;                     /**< see ccnr_msg() */
+    unsigned lograte;               /**< per call site per second, or 0 */
+    int logsuppressed;              /**< logsites with suppressed counts */
+    struct ccnr_logsite logsites[CCNR_LOGSITES]; /**< see ccnr_msg() */
     int flood;                      /**< Internal control for auto-reg */
     unsigned interest_faceid;       /**< for self_reg internal client */
     const char *progname;           /**< our name, for locating helpers */
     struct ccn *direct_client;      /**< this talks directly with ccnd */
+    struct ccn_signer *direct_signer; /**< signs replies for direct_client */
     struct ccn *internal_client;    /**< internal client */
     struct fdholder *face0;         /**< special fdholder for internal client */
     struct ccn_charbuf *service_ccnb; /**< for local service discovery */
     struct ccn_charbuf *neighbor_ccnb; /**< for neighbor service discovery */
     struct ccnr_parsed_policy *parsed_policy;  /**< offsets for parsed fields of policy */
+    struct hashtb *policy_prefix_tab; /**< policy prefixes, keyed by name components */
+    unsigned policy_gen;            /**< bumped each time a policy is activated */
     struct ccn_charbuf *policy_name;
     struct ccn_charbuf *policy_link_cob;
     struct ccn_seqwriter *notice;   /**< for notices of status changes */
+    unsigned notice_seq;            /**< number of the last notice batch */
     struct ccn_indexbuf *chface;    /**< faceids w/ recent status changes */
     struct ccn_scheduled_event *internal_client_refresh;
     struct ccn_scheduled_event *direct_client_refresh;
@@ -267,6 +458,7 @@ struct content_queue {
     unsigned nrun;                   /**< # sent since last randomized delay */
     struct ccn_indexbuf *send_queue; /**< cookie numbers of pending content */
     struct ccn_scheduled_event *sender;
+    int parked;                      /**< waiting for content to be read */
 };
 
 enum cq_delay_class {
@@ -341,14 +533,8 @@ struct content_entry;
 #define CCN_CONTENT_ENTRY_STALE     2
 #define CCN_CONTENT_ENTRY_PRECIOUS  4
 #define CCN_CONTENT_ENTRY_STABLE    8 /**< Repository-backed */
-
-/**
- * The content_by_accession hash table, keyed by accession, holds
- * entries that have a known accession.
- */
-struct content_by_accession_entry {
-    struct content_entry *content;
-};
+#define CCN_CONTENT_ENTRY_FETCHING 16 /**< Being read in */
+#define CCN_CONTENT_ENTRY_READERR  32 /**< Asynchronous read failed */
 
 /**
  * The propagating interest hash table is keyed by Nonce.
@@ -415,6 +601,11 @@ struct ccn_forwarding {
 /**
  * Keeps track of the state of running and recently completed enumerations
  * The enum_state hash table is keyed by the interest up to the segment id
+ *
+ * Responses are generated a batch at a time into a ring of ENUM_N_COBS.
+ * When a completed enumeration fits in the ring, it is kept as a cached
+ * answer for the prefix, shared by all requesters, until content is
+ * added under the prefix (which sets stale) or it is reaped.
  */
 enum es_active_state {
     ES_PENDING = -1,
@@ -424,13 +615,14 @@ enum es_active_state {
 #define ENUM_N_COBS 9
 struct enum_state {
     struct ccn_charbuf *name;
-    struct content_entry *content;
+    struct ccn_charbuf *resume;     /**< flatname of the next entry to list */
     struct ccn_charbuf *reply_body;
     struct ccn_charbuf *interest;
     struct ccn_indexbuf *interest_comps;
     struct ccn_charbuf *cob[ENUM_N_COBS];
+    struct ccn_parsed_ContentObject cob_pco[ENUM_N_COBS]; /**< parsed lazily */
     intmax_t next_segment;
-    ccnr_cookie starting_cookie;
+    int stale;                      /**< content was added under the prefix */
     enum es_active_state active;
     long lifetime;
     long lastuse_sec;
@@ -30,13 +30,17 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <ccn/btree.h>
+#include <ccn/btree_content.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/ccn_private.h>
 #include <ccn/schedule.h>
+#include <ccn/signer.h>
 #include <ccn/sockaddrutil.h>
 #include <ccn/uri.h>
 #include <ccn/coding.h>
+#include <ccn/hashtb.h>
 #include <sync/SyncBase.h>
 #include "ccnr_private.h"
 
@@ -48,9 +52,11 @@
 #include "ccnr_io.h"
 #include "ccnr_msg.h"
 #include "ccnr_sendq.h"
+#include "ccnr_stats.h"
 #include "ccnr_store.h"
 #include "ccnr_sync.h"
 #include "ccnr_util.h"
+#include "ccnr_verify.h"
 
 #define CCNR_MAX_RETRY 5
 
@@ -159,6 +165,9 @@ r_proto_answer_req(struct ccn_closure *selfp,
                             NULL, info->interest_ccnb, info->pi->offset[CCN_PI_E]);
         res = r_proto_continue_enumeration(selfp, kind, info, marker_comp);
         goto Finish;
+    } else if (ccnr->replica) {
+        /* Writes and imports are for the writer to take */
+        goto Bail;
     } else if (((marker_comp = ncomps - 3) > 0) &&
                0 == r_util_name_comp_compare(info->interest_ccnb, info->interest_comps, marker_comp, REPO_SW, strlen(REPO_SW))) {
         if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
@@ -216,15 +225,12 @@ name_comp_equal_prefix(const unsigned char *data,
     return(1);
 }
 
-PUBLIC void
-r_proto_uri_listen(struct ccnr_handle *ccnr, struct ccn *ccn, const char *uri,
-                   ccn_handler p, intptr_t intdata)
+static void
+r_proto_name_listen(struct ccnr_handle *ccnr, struct ccn *ccn,
+                    struct ccn_charbuf *name, ccn_handler p, intptr_t intdata)
 {
-    struct ccn_charbuf *name;
     struct ccn_closure *closure = NULL;
     
-    name = ccn_charbuf_create();
-    ccn_name_from_uri(name, uri);
     if (p != NULL) {
         closure = calloc(1, sizeof(*closure));
         closure->p = p;
@@ -232,6 +238,17 @@ r_proto_uri_listen(struct ccnr_handle *ccnr, struct ccn *ccn, const char *uri,
         closure->intdata = intdata;
     }
     ccn_set_interest_filter(ccn, name, closure);
+}
+
+PUBLIC void
+r_proto_uri_listen(struct ccnr_handle *ccnr, struct ccn *ccn, const char *uri,
+                   ccn_handler p, intptr_t intdata)
+{
+    struct ccn_charbuf *name;
+    
+    name = ccn_charbuf_create();
+    ccn_name_from_uri(name, uri);
+    r_proto_name_listen(ccnr, ccn, name, p, intdata);
     ccn_charbuf_destroy(&name);
 }
 
@@ -241,51 +258,154 @@ r_proto_init(struct ccnr_handle *ccnr) {
     // nothing to do
 }
 /**
- * Install the listener for the namespaces that the parsed policy says to serve
+ * A prefix named by the policy - a namespace, or the global prefix
+ *
+ * The policy_prefix_tab is keyed by the Components of the prefix.
+ */
+struct policy_prefix_entry {
+    unsigned gen;               /**< policy_gen of the policy naming it */
+    int wanted;                 /**< not under a shorter policy prefix */
+    int listening;              /**< our interest filter is installed */
+};
+
+/**
+ * Install or remove the interest filter for a policy prefix.
+ */
+static void
+r_proto_policy_listen(struct ccnr_handle *ccnr, struct ccn_charbuf *name,
+                      int listen)
+{
+    struct ccn_charbuf *uri = NULL;
+    
+    if (CCNSHOULDLOG(ccnr, sdfdf, CCNL_INFO)) {
+        uri = ccn_charbuf_create();
+        ccn_uri_append(uri, name->buf, name->length, 1);
+        ccnr_msg(ccnr, "%s listener for policy namespace %s",
+                 listen ? "Adding" : "Removing", ccn_charbuf_as_string(uri));
+        ccn_charbuf_destroy(&uri);
+    }
+    r_proto_name_listen(ccnr, ccnr->direct_client, name,
+                        listen ? r_proto_answer_req : NULL, 0);
+}
+
+/**
+ * Bring the listeners for the namespaces into line with what the
+ * parsed policy says to serve
  * 
- * Normal usage is to deactivate the old policy and then activate the new one
+ * The namespaces and the global prefix go into a table keyed by name
+ * components.  Only those that are not under a shorter one need a
+ * listener of their own, and listeners that the previous policy had
+ * already installed are left alone, so replacing a policy costs only
+ * as much as it changes.
  */
 PUBLIC void
 r_proto_activate_policy(struct ccnr_handle *ccnr, struct ccnr_parsed_policy *pp) {
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct policy_prefix_entry *entry = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_indexbuf *comps = NULL;
+    const char *uri = NULL;
+    unsigned gen;
+    int ncomps;
+    int pass;
+    int n;
     int i;
+    int k;
     
-    for (i = 0; i < pp->namespaces->n; i++) {
-        if (CCNSHOULDLOG(ccnr, sdfdf, CCNL_INFO))
-            ccnr_msg(ccnr, "Adding listener for policy namespace %s",
-                     (char *)pp->store->buf + pp->namespaces->buf[i]);
-        r_proto_uri_listen(ccnr, ccnr->direct_client,
-                           (char *)pp->store->buf + pp->namespaces->buf[i],
-                           r_proto_answer_req, 0);
-    }
-    if (CCNSHOULDLOG(ccnr, sdfdf, CCNL_INFO))
-        ccnr_msg(ccnr, "Adding listener for policy global prefix %s",
-                 (char *)pp->store->buf + pp->global_prefix_offset);
-    r_proto_uri_listen(ccnr, ccnr->direct_client,
-                       (char *)pp->store->buf + pp->global_prefix_offset,
-                       r_proto_answer_req, 0);    
+    if (ccnr->policy_prefix_tab == NULL)
+        ccnr->policy_prefix_tab = hashtb_create(sizeof(*entry), NULL);
+    name = ccn_charbuf_create();
+    comps = ccn_indexbuf_create();
+    if (ccnr->policy_prefix_tab == NULL || name == NULL || comps == NULL)
+        goto Bail;
+    gen = ++ccnr->policy_gen;
+    n = pp->namespaces->n;
+    /* Enter the prefixes, then see which are under shorter ones */
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i <= n; i++) {
+            if (i < n)
+                uri = (char *)pp->store->buf + pp->namespaces->buf[i];
+            else
+                uri = (char *)pp->store->buf + pp->global_prefix_offset;
+            name->length = 0;
+            if (ccn_name_from_uri(name, uri) < 0)
+                continue;
+            ncomps = ccn_name_split(name, comps);
+            if (ncomps < 0)
+                continue;
+            if (pass == 0) {
+                hashtb_start(ccnr->policy_prefix_tab, e);
+                if (hashtb_seek(e, name->buf + comps->buf[0],
+                                comps->buf[ncomps] - comps->buf[0], 0) >= 0) {
+                    entry = e->data;
+                    entry->gen = gen;
+                    entry->wanted = 1;
+                }
+                hashtb_end(e);
+                continue;
+            }
+            for (k = 0; k < ncomps; k++) {
+                entry = hashtb_lookup(ccnr->policy_prefix_tab, name->buf + comps->buf[0],
+                                      comps->buf[k] - comps->buf[0]);
+                if (entry != NULL && entry->gen == gen)
+                    break;
+            }
+            if (k == ncomps)
+                continue;
+            entry = hashtb_lookup(ccnr->policy_prefix_tab, name->buf + comps->buf[0],
+                                  comps->buf[ncomps] - comps->buf[0]);
+            if (entry != NULL)
+                entry->wanted = 0;
+        }
+    }
+    /* Change only the listeners that need it, and forget old prefixes */
+    hashtb_start(ccnr->policy_prefix_tab, e);
+    while (e->data != NULL) {
+        entry = e->data;
+        if (entry->gen != gen)
+            entry->wanted = 0;
+        if (entry->wanted != entry->listening) {
+            ccn_name_init(name);
+            ccn_name_append_components(name, e->key, 0, e->keysize);
+            r_proto_policy_listen(ccnr, name, entry->wanted);
+            entry->listening = entry->wanted;
+        }
+        if (entry->gen != gen)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+Bail:
+    ccn_charbuf_destroy(&name);
+    ccn_indexbuf_destroy(&comps);
 }
 /**
- * Uninstall the listener for the namespaces that the parsed policy says to serve
+ * Uninstall the listeners for the namespaces of the active policy
  */
 PUBLIC void
 r_proto_deactivate_policy(struct ccnr_handle *ccnr, struct ccnr_parsed_policy *pp) {
-    int i;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct policy_prefix_entry *entry = NULL;
+    struct ccn_charbuf *name = NULL;
 
-    if (CCNSHOULDLOG(ccnr, sdfdf, CCNL_INFO))
-        ccnr_msg(ccnr, "Removing listener for policy global prefix %s",
-                 (char *)pp->store->buf + pp->global_prefix_offset);
-    r_proto_uri_listen(ccnr, ccnr->direct_client,
-                       (char *)pp->store->buf + pp->global_prefix_offset,
-                       NULL, 0);    
-    for (i = 0; i < pp->namespaces->n; i++) {
-        if (CCNSHOULDLOG(ccnr, sdfdf, CCNL_INFO))
-            ccnr_msg(ccnr, "Removing listener for policy namespace %s",
-                     (char *)pp->store->buf + pp->namespaces->buf[i]);
-        r_proto_uri_listen(ccnr, ccnr->direct_client,
-                           (char *)pp->store->buf + pp->namespaces->buf[i],
-                           NULL, 0);
+    if (ccnr->policy_prefix_tab == NULL)
+        return;
+    name = ccn_charbuf_create();
+    hashtb_start(ccnr->policy_prefix_tab, e);
+    while (e->data != NULL) {
+        entry = e->data;
+        if (entry->listening && name != NULL) {
+            ccn_name_init(name);
+            ccn_name_append_components(name, e->key, 0, e->keysize);
+            r_proto_policy_listen(ccnr, name, 0);
+        }
+        hashtb_delete(e);
     }
-    
+    hashtb_end(e);
+    ccn_charbuf_destroy(&name);
 }
 
 
@@ -320,10 +440,205 @@ r_proto_append_repo_info(struct ccnr_handle *ccnr,
     return (res);
 }
 
+static struct ccnr_expect_content *
+r_proto_expect_content_create(struct ccnr_handle *ccnr)
+{
+    struct ccnr_expect_content *md = NULL;
+    int i;
+    
+    md = calloc(1, sizeof(*md));
+    if (md == NULL)
+        return(NULL);
+    md->ccnr = ccnr;
+    md->final = -1;
+    for (i = 0; i < CCNR_WINDOW_MAX; i++)
+        md->slot[i].segment = -1;
+    md->window = CCNR_PIPELINE;
+    md->ssthresh = CCNR_WINDOW_MAX;
+    md->recover = -1;
+    md->rto_usec = CCNR_RTO_INIT_USEC;
+    return(md);
+}
+
+/**
+ * Put a start-write on the list of those in progress.
+ *
+ * name is the stream name, without the segment component.
+ */
+static void
+r_proto_write_list(struct ccnr_expect_content *md, struct ccn_charbuf *name)
+{
+    struct ccnr_handle *ccnr = md->ccnr;
+    
+    md->name = ccn_charbuf_create();
+    ccn_charbuf_append_charbuf(md->name, name);
+    md->meter = ccnr_meter_create(ccnr, "bytein");
+    md->start_sec = ccnr->sec;
+    md->next = ccnr->writes;
+    if (md->next != NULL)
+        md->next->prevp = &md->next;
+    md->prevp = &ccnr->writes;
+    ccnr->writes = md;
+    ccnr->n_writes++;
+}
+
+static void
+r_proto_write_unlist(struct ccnr_expect_content *md)
+{
+    if (md->prevp == NULL)
+        return;
+    *md->prevp = md->next;
+    if (md->next != NULL)
+        md->next->prevp = md->prevp;
+    md->next = NULL;
+    md->prevp = NULL;
+    md->ccnr->n_writes--;
+}
+
+static void
+r_proto_expect_content_destroy(struct ccnr_expect_content **mdp)
+{
+    struct ccnr_expect_content *md = *mdp;
+    
+    if (md == NULL)
+        return;
+    r_proto_write_unlist(md);
+    ccn_charbuf_destroy(&md->name);
+    ccnr_meter_destroy(&md->meter);
+    free(md);
+    *mdp = NULL;
+}
+
+/**
+ * Find the slot of an outstanding segment.
+ * @returns the slot, or NULL if the segment is not outstanding.
+ */
+static struct ccnr_fetch_slot *
+r_proto_fetch_slot(struct ccnr_expect_content *md, intmax_t segment)
+{
+    struct ccnr_fetch_slot *fs = NULL;
+    
+    if (segment < 0)
+        return(NULL);
+    fs = &md->slot[segment & (CCNR_WINDOW_MAX - 1)];
+    return(fs->segment == segment ? fs : NULL);
+}
+
+/**
+ * How many Interests this fetch may have outstanding right now.
+ *
+ * This is its own window, or its share of the budget if that is less.
+ */
+static int
+r_proto_fetch_window(struct ccnr_expect_content *md)
+{
+    int share = CCNR_FETCH_BUDGET;
+    
+    if (md->ccnr->n_writes > 1)
+        share /= md->ccnr->n_writes;
+    if (share < CCNR_PIPELINE)
+        share = CCNR_PIPELINE;
+    return(md->window < share ? md->window : share);
+}
+
+static void
+r_proto_fetch_sent(struct ccnr_expect_content *md, intmax_t segment)
+{
+    struct ccnr_fetch_slot *fs = &md->slot[segment & (CCNR_WINDOW_MAX - 1)];
+    
+    fs->segment = segment;
+    fs->sent_sec = md->ccnr->sec;
+    fs->sent_usec = md->ccnr->usec;
+    fs->tries = 0;
+    md->inflight++;
+}
+
+static void
+r_proto_fetch_release(struct ccnr_expect_content *md, struct ccnr_fetch_slot *fs)
+{
+    fs->segment = -1;
+    md->inflight--;
+}
+
+/**
+ * Note the arrival of an outstanding segment.
+ *
+ * Unless the Interest had to be sent again, this gives a round trip
+ * time sample, which goes into the Interest lifetime as for the TCP
+ * retransmission timer.  The window opens by one for each arrival in
+ * slow start, and by one per window's worth after that.
+ */
+static void
+r_proto_fetch_ack(struct ccnr_expect_content *md, struct ccnr_fetch_slot *fs)
+{
+    struct ccnr_handle *ccnr = md->ccnr;
+    unsigned rtt;
+    unsigned delta;
+    unsigned rto;
+    
+    if (fs->tries == 0) {
+        rtt = (ccnr->sec - fs->sent_sec) * 1000000 + ccnr->usec - fs->sent_usec;
+        if (md->srtt_usec == 0) {
+            md->srtt_usec = rtt;
+            md->rttvar_usec = rtt / 2;
+        }
+        else {
+            delta = rtt > md->srtt_usec ? rtt - md->srtt_usec : md->srtt_usec - rtt;
+            md->rttvar_usec = md->rttvar_usec - md->rttvar_usec / 4 + delta / 4;
+            md->srtt_usec = md->srtt_usec - md->srtt_usec / 8 + rtt / 8;
+        }
+        rto = md->srtt_usec + 4 * md->rttvar_usec;
+        if (rto < CCNR_RTO_MIN_USEC)
+            rto = CCNR_RTO_MIN_USEC;
+        if (rto > CCNR_RTO_MAX_USEC)
+            rto = CCNR_RTO_MAX_USEC;
+        md->rto_usec = rto;
+    }
+    r_proto_fetch_release(md, fs);
+    if (md->window >= CCNR_WINDOW_MAX)
+        return;
+    if (md->window < md->ssthresh)
+        md->window++;
+    else if (++(md->wgrow) >= md->window) {
+        md->window++;
+        md->wgrow = 0;
+    }
+}
+
+/**
+ * Note that the Interest for an outstanding segment has timed out.
+ *
+ * The window is halved, but only once for all the losses among the
+ * Interests that were already out at the first of them.
+ */
+static void
+r_proto_fetch_timeout(struct ccnr_expect_content *md, struct ccnr_fetch_slot *fs,
+                      intmax_t highest)
+{
+    fs->tries++;
+    md->timeouts++;
+    md->ccnr->write_timeouts++;
+    if (fs->segment <= md->recover)
+        return;
+    md->recover = highest;
+    md->ssthresh = md->window / 2;
+    if (md->ssthresh < 2)
+        md->ssthresh = 2;
+    md->window = md->ssthresh;
+    md->wgrow = 0;
+    md->rto_usec *= 2;
+    if (md->rto_usec > CCNR_RTO_MAX_USEC)
+        md->rto_usec = CCNR_RTO_MAX_USEC;
+}
+
 static struct ccn_charbuf *
 r_proto_mktemplate(struct ccnr_expect_content *md, struct ccn_upcall_info *info)
 {
     struct ccn_charbuf *templ = ccn_charbuf_create();
+    unsigned char buf[3];
+    unsigned lifetime;
+    int i;
+    
     ccnb_element_begin(templ, CCN_DTAG_Interest); // same structure as Name
     ccnb_element_begin(templ, CCN_DTAG_Name);
     ccnb_element_end(templ); /* </Name> */
@@ -331,6 +646,13 @@ r_proto_mktemplate(struct ccnr_expect_content *md, struct ccn_upcall_info *info)
     // XXX - if start-write was scoped, use scope here?
     ccnb_tagged_putf(templ, CCN_DTAG_MinSuffixComponents, "%d", 1);
     ccnb_tagged_putf(templ, CCN_DTAG_MaxSuffixComponents, "%d", 1);
+    if (md != NULL && md->rto_usec != 0) {
+        /* InterestLifetime is in units of 1/4096 second */
+        lifetime = (uintmax_t)md->rto_usec * 4096 / 1000000;
+        for (i = sizeof(buf) - 1; i >= 0; i--, lifetime >>= 8)
+            buf[i] = lifetime & 0xff;
+        ccnb_append_tagged_blob(templ, CCN_DTAG_InterestLifetime, buf, sizeof(buf));
+    }
     ccnb_element_end(templ); /* </Interest> */
     return(templ);
 }
@@ -349,16 +671,15 @@ r_proto_expect_content(struct ccn_closure *selfp,
     int res;
     struct ccnr_expect_content *md = selfp->data;
     struct ccnr_handle *ccnr = NULL;
-    struct content_entry *content = NULL;
+    struct ccnr_fetch_slot *fs = NULL;
     int i;
-    int empty_slots;
+    int tries;
     intmax_t segment;
 
     if (kind == CCN_UPCALL_FINAL) {
         if (md != NULL) {
             selfp->data = NULL;
-            free(md);
-            md = NULL;
+            r_proto_expect_content_destroy(&md);
         }
         free(selfp);
         return(CCN_UPCALL_RESULT_OK);
@@ -369,13 +690,27 @@ r_proto_expect_content(struct ccn_closure *selfp,
     if (md->done)
         return(CCN_UPCALL_RESULT_ERR);
     ccnr = (struct ccnr_handle *)md->ccnr;
+    /* Refresh our idea of the time, for the round trip measurements */
+    r_util_refresh_time(ccnr);
     if (kind == CCN_UPCALL_INTEREST_TIMED_OUT) {
-        if (md->tries > CCNR_MAX_RETRY) {
+        ib = info->interest_ccnb;
+        ic = info->interest_comps;
+        segment = -1;
+        if (ic->n >= 2)
+            segment = r_util_segment_from_component(ib, ic->buf[ic->n - 2], ic->buf[ic->n - 1]);
+        fs = r_proto_fetch_slot(md, segment);
+        if (fs == NULL && md->keyfetch == 0)
+            return(CCN_UPCALL_RESULT_OK); /* retired already */
+        tries = (fs != NULL) ? fs->tries : md->tries;
+        if (tries > CCNR_MAX_RETRY) {
             ccnr_debug_ccnb(ccnr, __LINE__, "fetch_failed", NULL,
                             info->interest_ccnb, info->pi->offset[CCN_PI_E]);
             return(CCN_UPCALL_RESULT_ERR);
         }
-        md->tries++;
+        if (fs != NULL)
+            r_proto_fetch_timeout(md, fs, selfp->intdata);
+        else
+            md->tries++;
         return(CCN_UPCALL_RESULT_REEXPRESS);
     }
     if (kind == CCN_UPCALL_CONTENT_UNVERIFIED) {
@@ -400,15 +735,16 @@ r_proto_expect_content(struct ccn_closure *selfp,
     ib = info->interest_ccnb;
     ic = info->interest_comps;
     
-    content = process_incoming_content(ccnr, r_io_fdholder_from_fd(ccnr, ccn_get_connection_fd(info->h)),
-                                       (void *)ccnb, ccnb_size);
-    if (content == NULL) {
-        ccnr_msg(ccnr, "r_proto_expect_content: failed to process incoming content");
+    res = r_verify_content(ccnr, info->h, ccnb, ccnb_size, info->pco,
+                           md->expect_complete == NULL);
+    if (res < 0) {
+        ccnr_debug_ccnb(ccnr, __LINE__, "co_verify_failed", NULL,
+                        ccnb, ccnb_size);
         return(CCN_UPCALL_RESULT_ERR);
     }
-    r_store_commit_content(ccnr, content);
-    r_proto_initiate_key_fetch(ccnr, ccnb, info->pco, 0,
-                               r_store_content_cookie(ccnr, content));
+    if (res == 0 &&
+        r_proto_content_verified(ccnr, info->h, ccnb, ccnb_size, info->pco) < 0)
+        return(CCN_UPCALL_RESULT_ERR);
     
     md->tries = 0;
     segment = r_util_segment_from_component(ib, ic->buf[ic->n - 2], ic->buf[ic->n - 1]);
@@ -441,15 +777,21 @@ r_proto_expect_content(struct ccn_closure *selfp,
     }
     
     /* retire the current segment and any segments beyond the final one */
-    empty_slots = 0;
-    for (i = 0; i < CCNR_PIPELINE; i++) {
-        if (md->outstanding[i] == segment || ((md->final > -1) && (md->outstanding[i] > md->final)))
-            md->outstanding[i] = -1;
-        if (md->outstanding[i] == -1)
-            empty_slots++;
-    
+    fs = r_proto_fetch_slot(md, segment);
+    if (fs != NULL) {
+        r_proto_fetch_ack(md, fs);
+        md->segments++;
+        ccnr->write_segments++;
+        ccnr_meter_bump(ccnr, md->meter, ccnb_size);
     }
-    md->done = (md->final > -1) && (empty_slots == CCNR_PIPELINE);
+    if (md->final > -1) {
+        for (i = 0; i < CCNR_WINDOW_MAX && md->inflight > 0; i++)
+            if (md->slot[i].segment > md->final)
+                r_proto_fetch_release(md, &md->slot[i]);
+    }
+    md->done = (md->final > -1) && (md->inflight == 0);
+    if (md->done)
+        r_proto_write_unlist(md);
     // if there is a completion handler set up, and we've got all the blocks
     // call it -- note that this may not be the last block if they arrive out of order.
     if (md->done && (md->expect_complete != NULL))
@@ -462,17 +804,16 @@ r_proto_expect_content(struct ccn_closure *selfp,
     name = ccn_charbuf_create();
     if (ic->n < 2) abort();    
     templ = r_proto_mktemplate(md, info);
-    /* fill the pipeline with new requests */
-    for (i = 0; i < CCNR_PIPELINE; i++) {
-        if (md->outstanding[i] == -1) {
-            ccn_name_init(name);
-            res = ccn_name_append_components(name, ib, ic->buf[0], ic->buf[ic->n - 2]);
-            if (res < 0) abort();
-            ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, ++(selfp->intdata));
-            res = ccn_express_interest(info->h, name, selfp, templ);
-            if (res < 0) abort();
-            md->outstanding[i] = selfp->intdata;
-        }
+    /* open the window with new requests, stopping at a busy slot */
+    while (md->inflight < r_proto_fetch_window(md) &&
+           md->slot[(selfp->intdata + 1) & (CCNR_WINDOW_MAX - 1)].segment == -1) {
+        ccn_name_init(name);
+        res = ccn_name_append_components(name, ib, ic->buf[0], ic->buf[ic->n - 2]);
+        if (res < 0) abort();
+        ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, ++(selfp->intdata));
+        res = ccn_express_interest(info->h, name, selfp, templ);
+        if (res < 0) abort();
+        r_proto_fetch_sent(md, selfp->intdata);
     }
     ccn_charbuf_destroy(&templ);
     ccn_charbuf_destroy(&name);
@@ -572,7 +913,6 @@ r_proto_policy_update(struct ccn_schedule *sched,
     }
     close(fd);
     fd = -1;
-    r_proto_deactivate_policy(ccnr, ccnr->parsed_policy);
     ccnr_parsed_policy_destroy(&ccnr->parsed_policy);
     ccnr->parsed_policy = pp;
     r_proto_activate_policy(ccnr, pp);
@@ -630,6 +970,25 @@ r_proto_policy_complete(struct ccn_closure *selfp,
     return (0);
 }
 
+/**
+ * Completion action for replies signed by ccnr->direct_signer
+ */
+static void
+r_proto_signed_reply(struct ccn_signer *s, struct ccn_charbuf *cob,
+                     void *data, intptr_t intdata)
+{
+    struct ccnr_handle *ccnr = data;
+    const char *what = (const char *)intdata;
+    
+    if (cob == NULL || ccnr->direct_client == NULL)
+        return;
+    if (CCNSHOULDLOG(ccnr, LM_128, CCNL_FINE))
+        ccnr_debug_ccnb(ccnr, __LINE__, what, NULL, cob->buf, cob->length);
+    if (ccn_put(ccnr->direct_client, cob->buf, cob->length) < 0)
+        ccnr_debug_ccnb(ccnr, __LINE__, "ccn_put FAILED", NULL,
+                        cob->buf, cob->length);
+}
+
 static enum ccn_upcall_res
 r_proto_start_write(struct ccn_closure *selfp,
                     enum ccn_upcall_kind kind,
@@ -644,12 +1003,10 @@ r_proto_start_write(struct ccn_closure *selfp,
     struct ccn_charbuf *name = NULL;
     struct ccn_indexbuf *ic = NULL;
     enum ccn_upcall_res ans = CCN_UPCALL_RESULT_ERR;
-    struct ccn_charbuf *msg = NULL;
     int res = 0;
     int start = 0;
     int end = 0;
     int is_policy = 0;
-    int i;
     struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
     
     // XXX - Check for valid nonce
@@ -683,32 +1040,21 @@ r_proto_start_write(struct ccn_closure *selfp,
     name->length = 0;
     ccn_charbuf_append(name, info->interest_ccnb + start, end - start);
     ccn_charbuf_append_closer(name);
-    msg = ccn_charbuf_create();
     reply_body = ccn_charbuf_create();
     r_proto_append_repo_info(ccnr, reply_body, NULL, NULL);
     sp.freshness = 12; /* seconds */
-    res = ccn_sign_content(info->h, msg, name, &sp,
-                           reply_body->buf, reply_body->length);
+    /* Signed later, so the private key stays off the input path */
+    res = ccn_signer_submit(ccnr->direct_signer, name, &sp,
+                            reply_body->buf, reply_body->length,
+                            &r_proto_signed_reply, ccnr,
+                            (intptr_t)"r_proto_start_write response");
     if (res < 0)
         goto Bail;
-    if (CCNSHOULDLOG(ccnr, LM_128, CCNL_FINE))
-        ccnr_debug_ccnb(ccnr, __LINE__, "r_proto_start_write response", NULL,
-                        msg->buf, msg->length);
-    res = ccn_put(info->h, msg->buf, msg->length);
-    if (res < 0) {
-        ccnr_debug_ccnb(ccnr, __LINE__, "r_proto_start_write ccn_put FAILED", NULL,
-                        msg->buf, msg->length);
-        goto Bail;
-    }
 
     /* Send an interest for segment 0 */
-    expect_content = calloc(1, sizeof(*expect_content));
+    expect_content = r_proto_expect_content_create(ccnr);
     if (expect_content == NULL)
         goto Bail;
-    expect_content->ccnr = ccnr;
-    expect_content->final = -1;
-    for (i = 0; i < CCNR_PIPELINE; i++)
-        expect_content->outstanding[i] = -1;
     if (is_policy) {
         expect_content->expect_complete = &r_proto_policy_complete;
         if (CCNSHOULDLOG(ccnr, LM_128, CCNL_FINE))
@@ -723,8 +1069,9 @@ r_proto_start_write(struct ccn_closure *selfp,
     ic = info->interest_comps;
     ccn_name_init(name);
     ccn_name_append_components(name, info->interest_ccnb, ic->buf[0], ic->buf[marker_comp]);
+    r_proto_write_list(expect_content, name);
     ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, 0);
-    expect_content->outstanding[0] = 0;
+    r_proto_fetch_sent(expect_content, 0);
     res = ccn_express_interest(info->h, name, incoming, templ);
     if (res >= 0) {
         /* upcall will free these when it is done. */
@@ -741,12 +1088,10 @@ r_proto_start_write(struct ccn_closure *selfp,
 Bail:
     if (incoming != NULL)
         free(incoming);
-    if (expect_content != NULL)
-        free(expect_content);
+    r_proto_expect_content_destroy(&expect_content);
     ccn_charbuf_destroy(&templ);
     ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&reply_body);
-    ccn_charbuf_destroy(&msg);
     return(ans);
 }
 
@@ -765,7 +1110,6 @@ r_proto_start_write_checked(struct ccn_closure *selfp,
     struct ccn_charbuf *name = NULL;
     struct ccn_charbuf *interest = NULL;
     struct ccn_indexbuf *comps = NULL;
-    struct ccn_charbuf *msg = NULL;
     struct ccn_charbuf *reply_body = NULL;
     int start = 0;
     int end = 0;
@@ -817,7 +1161,6 @@ r_proto_start_write_checked(struct ccn_closure *selfp,
     // which is what we have in the "name" of the interest we created to check the content.
     ///// begin copied code
     /* Generate our reply */
-    msg = ccn_charbuf_create();
     reply_body = ccn_charbuf_create();
     r_proto_append_repo_info(ccnr, reply_body, name, NULL);
     start = info->pi->offset[CCN_PI_B_Name];
@@ -826,23 +1169,18 @@ r_proto_start_write_checked(struct ccn_closure *selfp,
     ccn_charbuf_append(name, info->interest_ccnb + start, end - start);
     ccn_charbuf_append_closer(name);
     sp.freshness = 12; /* Seconds */
-    res = ccn_sign_content(info->h, msg, name, &sp,
-                           reply_body->buf, reply_body->length);
-    if (res < 0)
-        goto Bail;
     if (CCNSHOULDLOG(ccnr, LM_128, CCNL_FINE))
         ccnr_msg(ccnr, "r_proto_start_write_checked PRESENT");
-    res = ccn_put(info->h, msg->buf, msg->length);
-    if (res < 0) {
-        // note the error somehow.
-        ccnr_debug_ccnb(ccnr, __LINE__, "r_proto_start_write_checked ccn_put FAILED", NULL,
-                        msg->buf, msg->length);
-    }
+    res = ccn_signer_submit(ccnr->direct_signer, name, &sp,
+                            reply_body->buf, reply_body->length,
+                            &r_proto_signed_reply, ccnr,
+                            (intptr_t)"r_proto_start_write_checked response");
+    if (res < 0)
+        goto Bail;
     //// end of copied code
 Bail:
     ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&reply_body);
-    ccn_charbuf_destroy(&msg);
     return(ans);
 }
 
@@ -914,6 +1252,30 @@ Bail:
 }
 
 #define ENUMERATION_STATE_TICK_MICROSEC 1000000
+/**
+ * How long a completed enumeration answers new requests for its prefix.
+ * This is also the freshness of the responses.
+ */
+#define ENUMERATION_CACHE_SECONDS 60
+
+/**
+ * Release what an enumeration holds, except for its name.
+ */
+static void
+r_proto_enum_state_clear(struct enum_state *es)
+{
+    int i;
+    
+    ccn_charbuf_destroy(&es->resume);
+    ccn_charbuf_destroy(&es->interest);
+    ccn_charbuf_destroy(&es->reply_body);
+    for (i = 0; i < ENUM_N_COBS; i++)
+        ccn_charbuf_destroy(&es->cob[i]);
+    memset(es->cob_pco, 0, sizeof(es->cob_pco));
+    ccn_indexbuf_destroy(&es->interest_comps);
+    es->next_segment = 0;
+}
+
 /**
  * Remove expired enumeration table entries
  */
@@ -940,19 +1302,20 @@ reap_enumerations(struct ccn_schedule *sched,
             if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
                 ccnr_debug_ccnb(ccnr, __LINE__, "reap enumeration state", NULL,
                                 es->name->buf, es->name->length);            
-            // everything but the name has already been destroyed
+            r_proto_enum_state_clear(es);
             ccn_charbuf_destroy(&es->name);
-            // remove the entry from the hash table
+            // remove the entry from the hash table, moving on to the next
             hashtb_delete(e);
         }
-        hashtb_next(e);
+        else
+            hashtb_next(e);
     }
     hashtb_end(e);
     if (hashtb_n(ccnr->enum_state_tab) == 0) {
         ccnr->reap_enumerations = NULL;
         return(0);
     }
-    return(ENUMERATION_STATE_TICK_MICROSEC);
+    return(r_util_idle_period(ccnr, ENUMERATION_STATE_TICK_MICROSEC));
 }
 static void
 reap_enumerations_needed(struct ccnr_handle *ccnr)
@@ -964,6 +1327,184 @@ reap_enumerations_needed(struct ccnr_handle *ccnr)
                                                      NULL, 0);
 }
 
+/**
+ * Note that content has been added, so that enumerations of the
+ * prefixes of its name stop answering from what they have saved.
+ *
+ * The enumeration table is keyed by prefix, so this is one lookup
+ * per name component.
+ */
+PUBLIC void
+r_proto_note_content_added(struct ccnr_handle *ccnr,
+                           struct content_entry *content)
+{
+    struct ccn_charbuf *flatname = NULL;
+    struct ccn_charbuf *prefix = NULL;
+    struct enum_state *es = NULL;
+    int k;
+    
+    if (ccnr->enum_state_tab == NULL || hashtb_n(ccnr->enum_state_tab) == 0)
+        return;
+    flatname = r_store_content_flatname(ccnr, content);
+    if (flatname == NULL)
+        return;
+    prefix = ccn_charbuf_create();
+    ccn_name_init(prefix);
+    for (k = 0;; k++) {
+        es = hashtb_lookup(ccnr->enum_state_tab, prefix->buf, prefix->length);
+        if (es != NULL)
+            es->stale = 1;
+        if (ccn_name_append_flatname(prefix, flatname->buf, flatname->length,
+                                     k, 1) != 1)
+            break;
+    }
+    ccn_charbuf_destroy(&prefix);
+}
+
+/**
+ * Check whether one of the saved enumeration responses answers an interest.
+ *
+ * The response is parsed on first use, and the parsed form (which holds
+ * the implicit digest once it has been needed) is kept alongside it, so
+ * repeated interests with exclusions do not parse and hash it again.
+ */
+static int
+r_proto_enum_cob_matches(struct enum_state *es, int i,
+                         struct ccn_upcall_info *info)
+{
+    struct ccn_charbuf *cob = es->cob[i];
+    struct ccn_parsed_ContentObject *pco = &es->cob_pco[i];
+    int res;
+    
+    if (cob == NULL || cob->length == 0)
+        return(0);
+    if (pco->magic == 0) {
+        res = ccn_parse_ContentObject(cob->buf, cob->length, pco, NULL);
+        if (res < 0) {
+            memset(pco, 0, sizeof(*pco));
+            return(0);
+        }
+    }
+    return(ccn_content_matches_interest(cob->buf, cob->length, 1, pco,
+                                        info->interest_ccnb,
+                                        info->pi->offset[CCN_PI_E],
+                                        info->pi));
+}
+
+/**
+ * Sign the first size bytes of the reply body as the next segment of
+ * an enumeration, in its place in the ring.
+ */
+static void
+r_proto_enum_sign_segment(struct ccnr_handle *ccnr, struct ccn *h,
+                          struct enum_state *es, size_t size, int final)
+{
+    struct ccn_charbuf *result_name = NULL;
+    struct ccn_charbuf *cob = NULL;
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    int i = es->next_segment % ENUM_N_COBS;
+    
+    result_name = ccn_charbuf_create();
+    ccn_charbuf_append_charbuf(result_name, es->name);
+    ccn_name_append_numeric(result_name, CCN_MARKER_SEQNUM, es->next_segment);
+    sp.freshness = ENUMERATION_CACHE_SECONDS;
+    if (final)
+        sp.sp_flags |= CCN_SP_FINAL_BLOCK;
+    cob = es->cob[i];
+    if (cob == NULL) {
+        cob = ccn_charbuf_create();
+        es->cob[i] = cob;
+    }
+    cob->length = 0;
+    memset(&es->cob_pco[i], 0, sizeof(es->cob_pco[i]));
+    ccn_sign_content(h, cob, result_name, &sp, es->reply_body->buf, size);
+    ccn_charbuf_destroy(&result_name);
+    if (CCNSHOULDLOG(ccnr, blah, CCNL_FINER))
+        ccnr_msg(ccnr, "enumeration: signed %scob for segment %jd",
+                 final ? "final " : "", es->next_segment);
+    es->next_segment++;
+    memmove(es->reply_body->buf, es->reply_body->buf + size,
+            es->reply_body->length - size);
+    es->reply_body->length -= size;
+}
+
+/**
+ * Generate the responses of an enumeration from es->next_segment
+ * through segment last, or until the enumeration ends.
+ *
+ * The children are found in one pass over the index with a single
+ * cursor, rather than with a fresh descent of the btree for each
+ * segment that is asked for.  The place to pick up from next time is
+ * kept as a key, since content handles do not stay valid between events.
+ */
+static void
+r_proto_enum_fill(struct ccnr_handle *ccnr, struct ccn *h,
+                  struct enum_state *es, intmax_t last)
+{
+    struct ccn_btree_cursor cursor = {0};
+    struct content_entry *content = NULL;
+    int level = es->interest_comps->n - 1;
+    size_t save;
+    int res;
+    
+    if (es->resume->length > 0)
+        content = r_store_seek_content(ccnr, &cursor, es->resume->buf,
+                                       es->resume->length);
+    while (es->next_segment <= last) {
+        if (content != NULL &&
+            !r_store_content_matches_interest_prefix(ccnr, content,
+                                                     es->interest->buf,
+                                                     es->interest->length))
+            content = NULL;
+        if (content == NULL) {
+            ccnb_element_end(es->reply_body); /* </Collection> */
+            r_proto_enum_sign_segment(ccnr, h, es, es->reply_body->length, 1);
+            es->active = ES_INACTIVE;
+            break;
+        }
+        save = es->reply_body->length;
+        ccnb_element_begin(es->reply_body, CCN_DTAG_Link);
+        ccnb_element_begin(es->reply_body, CCN_DTAG_Name);
+        ccnb_element_end(es->reply_body); /* </Name> */
+        res = r_store_name_append_components(es->reply_body, ccnr, content, level, 1);
+        ccnb_element_end(es->reply_body); /* </Link> */
+        if (res == 0) {
+            /* The name matched exactly, need to skip. */
+            es->reply_body->length = save;
+        }
+        else if (res != 1) {
+            ccnr_debug_ccnb(ccnr, __LINE__, "oops", NULL, es->interest->buf, es->interest->length);
+            ccnr_debug_content(ccnr, __LINE__, "oops", NULL, content);
+            abort();
+        }
+        content = r_store_next_child_at_level(ccnr, &cursor, content, level);
+        if (es->reply_body->length >= 4096)
+            r_proto_enum_sign_segment(ccnr, h, es, 4096, 0);
+    }
+    es->resume->length = 0;
+    if (content != NULL)
+        ccn_charbuf_append_charbuf(es->resume,
+                                   r_store_content_flatname(ccnr, content));
+}
+
+/**
+ * Tidy up an enumeration that has generated its final segment.
+ *
+ * The responses stay in the ring for the requests still to come.
+ * If they are the whole answer, they also answer new enumerations
+ * of the prefix for as long as they are fresh.
+ */
+static void
+r_proto_enum_complete(struct enum_state *es)
+{
+    ccn_charbuf_destroy(&es->resume);
+    ccn_charbuf_destroy(&es->interest);
+    ccn_charbuf_destroy(&es->reply_body);
+    ccn_indexbuf_destroy(&es->interest_comps);
+    if (es->next_segment <= ENUM_N_COBS)
+        es->lifetime = ENUMERATION_CACHE_SECONDS;
+}
+
 static enum ccn_upcall_res
 r_proto_begin_enumeration(struct ccn_closure *selfp,
                           enum ccn_upcall_kind kind,
@@ -1009,12 +1550,27 @@ r_proto_begin_enumeration(struct ccn_closure *selfp,
     if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINE))
         ccnr_debug_ccnb(ccnr, __LINE__, "enumeration: begin hash key", NULL,
                         name->buf, name->length);
+    // A completed enumeration that is still current answers for everyone
+    if (res == HT_OLD_ENTRY && es->active == ES_INACTIVE && !es->stale &&
+        es->next_segment > 0 && es->next_segment <= ENUM_N_COBS) {
+        ans = CCN_UPCALL_RESULT_OK;
+        if (r_proto_enum_cob_matches(es, 0, info)) {
+            if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
+                ccnr_msg(ccnr, "enumeration: answered from saved responses");
+            ccn_put(info->h, es->cob[0]->buf, es->cob[0]->length);
+            es->lastuse_sec = ccnr->sec;
+            es->lastuse_usec = ccnr->usec;
+            ans = CCN_UPCALL_RESULT_INTEREST_CONSUMED;
+        }
+        hashtb_end(e);
+        goto Bail;
+    }
     // Do not restart an active enumeration, it is probably a duplicate interest
-    if (res == HT_OLD_ENTRY && es->active != ES_INACTIVE) {
+    if (res == HT_OLD_ENTRY && (es->active == ES_ACTIVE ||
+                                (es->active == ES_PENDING && !es->stale))) {
         if (es->next_segment > 0)
             cob = es->cob[(es->next_segment - 1) % ENUM_N_COBS];
-        if (cob && ccn_content_matches_interest(cob->buf, cob->length, 1, NULL,
-                                         info->interest_ccnb, info->pi->offset[CCN_PI_E], info->pi)) {
+        if (cob && r_proto_enum_cob_matches(es, (es->next_segment - 1) % ENUM_N_COBS, info)) {
             if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
                 ccnr_msg(ccnr, "enumeration: duplicate request for last cob");
             ccn_put(info->h, cob->buf, cob->length);
@@ -1031,6 +1587,8 @@ r_proto_begin_enumeration(struct ccn_closure *selfp,
         hashtb_end(e);
         goto Bail;
     }
+    if (res == HT_OLD_ENTRY)
+        r_proto_enum_state_clear(es);
     // Continue to construct the name under which we will respond: %C1.E.be
     ccn_name_append_components(name, info->interest_ccnb,
                                info->interest_comps->buf[marker_comp],
@@ -1038,14 +1596,14 @@ r_proto_begin_enumeration(struct ccn_closure *selfp,
     // Append the repository key id %C1.K.%00<repoid>
     ccn_name_append(name, ccnr->ccnr_keyid->buf, ccnr->ccnr_keyid->length);
     
-    if (res == HT_NEW_ENTRY || es->starting_cookie != ccnr->cookie) {
+    if (res == HT_NEW_ENTRY || es->stale) {
         // this is a new enumeration, the time is now.
         res = ccn_create_version(info->h, name, CCN_V_NOW, 0, 0);
         if (es->name != NULL)
             ccn_charbuf_destroy(&es->name);
         es->name = ccn_charbuf_create();
         ccn_charbuf_append_charbuf(es->name, name);
-        es->starting_cookie = ccnr->cookie; // XXX - a conservative indicator of change
+        es->stale = 0;
     }
     ccn_charbuf_destroy(&name);
     // check the exclude against the result name
@@ -1063,10 +1621,12 @@ r_proto_begin_enumeration(struct ccn_closure *selfp,
     if (content != NULL &&
         !r_store_content_matches_interest_prefix(ccnr, content, interest->buf, interest->length))
         content = NULL;
-    es->cob[0] = ccn_charbuf_create();
     es->reply_body = ccn_charbuf_create();
     ccnb_element_begin(es->reply_body, CCN_DTAG_Collection);
-    es->content = content;
+    es->resume = ccn_charbuf_create();
+    if (content != NULL)
+        ccn_charbuf_append_charbuf(es->resume,
+                                   r_store_content_flatname(ccnr, content));
     es->interest = interest;
     es->interest_comps = comps;
     es->next_segment = 0;
@@ -1104,15 +1664,14 @@ r_proto_continue_enumeration(struct ccn_closure *selfp,
     // Should chop 1 component off interest -- which will look like
     // ccnx:/.../%C1.E.be/%C1.M.K%00.../%FD.../%00%02
     struct ccn_charbuf *hashkey = NULL;
-    struct ccn_charbuf *result_name = NULL;
     struct ccn_charbuf *cob = NULL;
     struct ccn_indexbuf *ic = NULL;
     intmax_t segment;
+    intmax_t last;
     struct enum_state *es = NULL;
     struct ccnr_handle *ccnr = NULL;
     struct hashtb_enumerator enumerator = {0};
     struct hashtb_enumerator *e = &enumerator;
-    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
     int i;
     int res = 0;
     int ans = CCN_UPCALL_RESULT_ERR;
@@ -1128,10 +1687,14 @@ r_proto_continue_enumeration(struct ccn_closure *selfp,
     res = hashtb_seek(e, hashkey->buf, hashkey->length, 0);
     ccn_charbuf_destroy(&hashkey);
     if (res != HT_OLD_ENTRY) {
-        goto Bail;
+        if (res == HT_NEW_ENTRY)
+            hashtb_delete(e);
+        hashtb_end(e);
+        return(ans);
     }
     es = e->data;
-    if (es->active != ES_ACTIVE) {
+    if (es->active == ES_PENDING ||
+        (es->active == ES_INACTIVE && es->next_segment == 0)) {
         hashtb_end(e);
         return(ans);
     }
@@ -1139,9 +1702,11 @@ r_proto_continue_enumeration(struct ccn_closure *selfp,
     segment = r_util_segment_from_component(info->interest_ccnb,
                                             ic->buf[ic->n - 2],
                                             ic->buf[ic->n - 1]);
+    if (segment < 0)
+        segment = es->next_segment;
     if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINE))
         ccnr_msg(ccnr, "enumeration: requested %jd :: expected %jd", segment, es->next_segment);
-    if (segment >= 0 && segment != es->next_segment) {
+    if (es->active == ES_ACTIVE && segment >= es->next_segment) {
         // too far in the future for us to process
         if (segment > es->next_segment + (ENUM_N_COBS / 2)) {
             if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
@@ -1149,105 +1714,31 @@ r_proto_continue_enumeration(struct ccn_closure *selfp,
             hashtb_end(e);
             return (CCN_UPCALL_RESULT_OK);
         }
-        // if theres a possibility we could have it
-        if (segment >= es->next_segment - ENUM_N_COBS) {
-            cob = es->cob[segment % ENUM_N_COBS];
-            if (cob &&
-                ccn_content_matches_interest(cob->buf, cob->length, 1, NULL,
-                                             info->interest_ccnb, info->pi->offset[CCN_PI_E], info->pi)) {
-                    if (CCNSHOULDLOG(ccnr, LM_8, CCNL_FINER))
-                        ccnr_msg(ccnr, "enumeration: processing dup request for segment %jd", segment);
-                    ccn_put(info->h, cob->buf, cob->length);
-                    hashtb_end(e);
-                    return (CCN_UPCALL_RESULT_INTEREST_CONSUMED);
-                }
-        }
+        // Fill the ring, keeping the most recent segments for retransmissions
+        last = segment + (ENUM_N_COBS / 2);
+        if (es->next_segment == 0)
+            last = ENUM_N_COBS - 1;
+        if (CCNSHOULDLOG(ccnr, blah, CCNL_FINE))
+            ccnr_msg(ccnr, "enumeration: generating segments %jd to %jd", es->next_segment, last);
+        es->lastuse_sec = ccnr->sec;
+        es->lastuse_usec = ccnr->usec;
+        r_proto_enum_fill(ccnr, info->h, es, last);
+        if (es->active == ES_INACTIVE)
+            r_proto_enum_complete(es);
     }
-NextSegment:
-    if (CCNSHOULDLOG(ccnr, blah, CCNL_FINE))
-        ccnr_msg(ccnr, "enumeration: generating segment %jd", es->next_segment);
-    es->lastuse_sec = ccnr->sec;
-    es->lastuse_usec = ccnr->usec;
-    while (es->content != NULL &&
-           r_store_content_matches_interest_prefix(ccnr, es->content,
-                                                   es->interest->buf,
-                                                   es->interest->length)) {
-        int save = es->reply_body->length;
-        ccnb_element_begin(es->reply_body, CCN_DTAG_Link);
-        ccnb_element_begin(es->reply_body, CCN_DTAG_Name);
-        ccnb_element_end(es->reply_body); /* </Name> */
-        res = r_store_name_append_components(es->reply_body, ccnr, es->content, es->interest_comps->n - 1, 1);
-        ccnb_element_end(es->reply_body); /* </Link> */
-        if (res == 0) {
-            /* The name matched exactly, need to skip. */
-            es->reply_body->length = save;
-            es->content = r_store_next_child_at_level(ccnr, es->content, es->interest_comps->n - 1);
-            continue;
-        }
-        if (res != 1) {
-            ccnr_debug_ccnb(ccnr, __LINE__, "oops", NULL, es->interest->buf, es->interest->length);
-            ccnr_debug_content(ccnr, __LINE__, "oops", NULL, es->content);
-            abort();
-        }
-        es->content = r_store_next_child_at_level(ccnr, es->content, es->interest_comps->n - 1);
-        if (es->reply_body->length >= 4096) {
-            result_name = ccn_charbuf_create();
-            ccn_charbuf_append_charbuf(result_name, es->name);
-            ccn_name_append_numeric(result_name, CCN_MARKER_SEQNUM, es->next_segment);
-            sp.freshness = 60;
-            cob = es->cob[es->next_segment % ENUM_N_COBS];
-            if (cob == NULL) {
-                cob = ccn_charbuf_create();
-                es->cob[es->next_segment % ENUM_N_COBS] = cob;
-            }
-            cob->length = 0;
-            res = ccn_sign_content(info->h, cob, result_name, &sp,
-                                   es->reply_body->buf, 4096);
-            ccn_charbuf_destroy(&result_name);
+    ans = CCN_UPCALL_RESULT_OK;
+    if (segment < es->next_segment && segment >= es->next_segment - ENUM_N_COBS) {
+        i = segment % ENUM_N_COBS;
+        cob = es->cob[i];
+        if (r_proto_enum_cob_matches(es, i, info)) {
             if (CCNSHOULDLOG(ccnr, blah, CCNL_FINER))
-                ccnr_msg(ccnr, "enumeration: putting cob for segment %jd, req %jd", es->next_segment, segment);
-            if (segment == -1 || segment == es->next_segment)
-                ccn_put(info->h, cob->buf, cob->length);
-            es->next_segment++;
-            memmove(es->reply_body->buf, es->reply_body->buf + 4096, es->reply_body->length - 4096);
-            es->reply_body->length -= 4096;
-            if (segment >= es->next_segment)
-                 goto NextSegment;
-            hashtb_end(e);
-            return (CCN_UPCALL_RESULT_INTEREST_CONSUMED);
+                ccnr_msg(ccnr, "enumeration: putting cob for segment %jd", segment);
+            ccn_put(info->h, cob->buf, cob->length);
+            es->lastuse_sec = ccnr->sec;
+            es->lastuse_usec = ccnr->usec;
+            ans = CCN_UPCALL_RESULT_INTEREST_CONSUMED;
         }
     }
-    // we will only get here if we are finishing an in-progress enumeration
-    ccnb_element_end(es->reply_body); /* </Collection> */
-    result_name = ccn_charbuf_create();
-    ccn_charbuf_append_charbuf(result_name, es->name);
-    ccn_name_append_numeric(result_name, CCN_MARKER_SEQNUM, es->next_segment);
-    sp.freshness = 60;
-    sp.sp_flags |= CCN_SP_FINAL_BLOCK;
-    cob = es->cob[es->next_segment % ENUM_N_COBS];
-    if (cob == NULL) {
-        cob = ccn_charbuf_create();
-        es->cob[es->next_segment % ENUM_N_COBS] = cob;
-    }
-    cob->length = 0;
-    res = ccn_sign_content(info->h, cob, result_name, &sp, es->reply_body->buf,
-                           es->reply_body->length);
-    ccn_charbuf_destroy(&result_name);    
-    if (CCNSHOULDLOG(ccnr, blah, CCNL_FINER))
-        ccnr_msg(ccnr, "enumeration: putting final cob for segment %jd", es->next_segment);
-    ccn_put(info->h, cob->buf, cob->length);
-    es->active = ES_INACTIVE;
-    ans = CCN_UPCALL_RESULT_INTEREST_CONSUMED;
-    
-Bail:
-    if (es != NULL) {
-        // leave the name 
-        ccn_charbuf_destroy(&es->interest);
-        ccn_charbuf_destroy(&es->reply_body);
-        for (i = 0; i < ENUM_N_COBS; i++)
-            ccn_charbuf_destroy(&es->cob[i]);
-        ccn_indexbuf_destroy(&es->interest_comps);
-    }
     hashtb_end(e);
     return(ans);
 }
@@ -1261,8 +1752,8 @@ r_proto_dump_enums(struct ccnr_handle *ccnr)
     
     for (hashtb_start(ccnr->enum_state_tab, e); e->data != NULL; hashtb_next(e)) {
         es = e->data;
-        ccnr_msg(ccnr, "Enumeration active: %d, next segment %d, cookie %u",
-                 es->active, es->next_segment, es->starting_cookie);
+        ccnr_msg(ccnr, "Enumeration active: %d, next segment %jd, stale %d",
+                 es->active, es->next_segment, es->stale);
         ccnr_debug_ccnb(ccnr, __LINE__, "     enum name", NULL,
                         es->name->buf, es->name->length);
         
@@ -1446,6 +1937,30 @@ r_proto_parse_policy(struct ccnr_handle *ccnr, const unsigned char *buf, size_t
     return (res);
 }
 
+/**
+ * Store incoming content that has passed verification (or had none),
+ * and go after its key if need be.
+ * @returns 0, or -1 for an error.
+ */
+PUBLIC int
+r_proto_content_verified(struct ccnr_handle *ccnr, struct ccn *client,
+                         const unsigned char *ccnb, size_t size,
+                         struct ccn_parsed_ContentObject *pco)
+{
+    struct content_entry *content = NULL;
+    
+    content = process_incoming_content(ccnr, r_io_fdholder_from_fd(ccnr, ccn_get_connection_fd(client)),
+                                       (void *)ccnb, size);
+    if (content == NULL) {
+        ccnr_msg(ccnr, "r_proto_expect_content: failed to process incoming content");
+        return(-1);
+    }
+    r_store_commit_content(ccnr, content);
+    r_proto_initiate_key_fetch(ccnr, ccnb, pco, 0,
+                               r_store_content_cookie(ccnr, content));
+    return(0);
+}
+
 /**
  * Initiate a key fetch if necessary.
  * @returns -1 if error or no name, 0 if fetch was issued, 1 if already stored.
@@ -1469,7 +1984,6 @@ r_proto_initiate_key_fetch(struct ccnr_handle *ccnr,
     const unsigned char *namestart = NULL;
     int namelen = 0;
     int keynamelen;
-    int i;
     
     keynamelen = (pco->offset[CCN_PCO_E_KeyName_Name] -
                   pco->offset[CCN_PCO_B_KeyName_Name]);
@@ -1547,13 +2061,9 @@ r_proto_initiate_key_fetch(struct ccnr_handle *ccnr,
     else {
         /* We do not have it; need to ask */
         res = -1;
-        expect_content = calloc(1, sizeof(*expect_content));
+        expect_content = r_proto_expect_content_create(ccnr);
         if (expect_content == NULL)
             goto Bail;
-        expect_content->ccnr = ccnr;
-        expect_content->final = -1;
-        for (i = 0; i < CCNR_PIPELINE; i++)
-            expect_content->outstanding[i] = -1;
         /* inform r_proto_expect_content we are looking for a key. */
         expect_content->keyfetch = a;
         key_closure = calloc(1, sizeof(*key_closure));
@@ -1574,8 +2084,7 @@ r_proto_initiate_key_fetch(struct ccnr_handle *ccnr,
 Bail:
     if (key_closure != NULL)
         free(key_closure);
-    if (expect_content != NULL)
-        free(expect_content);
+    r_proto_expect_content_destroy(&expect_content);
     ccn_charbuf_destroy(&key_name);
     ccn_charbuf_destroy(&templ);
     return(res);
@@ -39,15 +39,55 @@ struct ccnr_parsed_policy {
     struct ccn_charbuf *store;
 };
 
-#define CCNR_PIPELINE 4
+/*
+ * The segments of a stream named in a start-write are fetched with a
+ * window of outstanding Interests.  The window grows as content comes
+ * in and is halved when Interests time out, much as TCP manages its
+ * congestion window, and Interest lifetimes follow the measured round
+ * trip time.  The writes in progress share CCNR_FETCH_BUDGET between
+ * them, so that one large write does not shut out the others.
+ */
+#define CCNR_PIPELINE 4             /**< initial window, in segments */
+#define CCNR_WINDOW_MAX 256         /**< largest window, a power of 2 */
+#define CCNR_FETCH_BUDGET 1024      /**< Interests out, over all writes */
+#define CCNR_RTO_INIT_USEC 1000000  /**< lifetime before any RTT sample */
+#define CCNR_RTO_MIN_USEC 50000
+#define CCNR_RTO_MAX_USEC 4000000
+
+/**
+ * An outstanding segment, kept at the index of its low-order bits
+ */
+struct ccnr_fetch_slot {
+    intmax_t segment;           /**< segment number, or -1 if free */
+    long sent_sec;              /**< when the Interest was expressed */
+    unsigned sent_usec;
+    int tries;                  /**< timeouts so far */
+};
+
 struct ccnr_expect_content {
     struct ccnr_handle *ccnr;
     int tries; /** counter so we can give up eventually */
     int done;
     ccnr_cookie keyfetch;
-    intmax_t outstanding[CCNR_PIPELINE];
+    struct ccnr_fetch_slot slot[CCNR_WINDOW_MAX];
+    int inflight;               /**< slots in use */
+    int window;                 /**< congestion window, in segments */
+    int ssthresh;               /**< slow start ends at this window */
+    int wgrow;                  /**< acks towards the next window increase */
+    intmax_t recover;           /**< no more decrease until beyond this */
+    unsigned srtt_usec;         /**< smoothed round trip time */
+    unsigned rttvar_usec;       /**< round trip time variation */
+    unsigned rto_usec;          /**< Interest lifetime to use */
     intmax_t final;
     ccn_handler expect_complete;
+    /* The rest is for start-writes, and shows in ccnr_stats */
+    struct ccn_charbuf *name;   /**< name of the stream, without segment */
+    struct ccnr_meter *meter;   /**< content bytes fetched */
+    uintmax_t segments;         /**< segments fetched */
+    unsigned long timeouts;     /**< Interests that timed out */
+    long start_sec;             /**< when the write began */
+    struct ccnr_expect_content *next; /**< in ccnr->writes */
+    struct ccnr_expect_content **prevp; /**< link to here, if listed */
 };
 
 
@@ -73,9 +113,14 @@ r_proto_parse_policy(struct ccnr_handle *ccnr, const unsigned char *buf, size_t
                      struct ccnr_parsed_policy *pp);
 void r_proto_activate_policy(struct ccnr_handle *ccnr, struct ccnr_parsed_policy *pp);
 void r_proto_deactivate_policy(struct ccnr_handle *ccnr, struct ccnr_parsed_policy *pp);
+void r_proto_note_content_added(struct ccnr_handle *ccnr,
+                                struct content_entry *content);
 int r_proto_initiate_key_fetch(struct ccnr_handle *ccnr,
                                const unsigned char *msg,
                                struct ccn_parsed_ContentObject *pco,
                                int use_link,
                                ccnr_cookie a);
+int r_proto_content_verified(struct ccnr_handle *ccnr, struct ccn *client,
+                             const unsigned char *ccnb, size_t size,
+                             struct ccn_parsed_ContentObject *pco);
 #endif
@@ -174,6 +174,10 @@ content_sender(struct ccn_schedule *sched,
         if (content == NULL)
             q->nrun = 0;
         else {
+            if (r_store_content_fetch(h, content) == 0) {
+                q->parked = 1;
+                break;
+            }
             r_link_send_content(h, fdholder, content);
             /* fdholder may have vanished, bail out if it did */
             if (r_io_fdholder_from_fd(h, filedesc) == NULL)
@@ -188,6 +192,16 @@ content_sender(struct ccn_schedule *sched,
     for (j = 0; i < q->send_queue->n; i++, j++)
         q->send_queue->buf[j] = q->send_queue->buf[i];
     q->send_queue->n = j;
+    if (q->parked) {
+        /* Get the reads for the rest of what is ready going, too */
+        for (i = 0; i < q->ready; i++) {
+            content = r_store_content_from_cookie(h, q->send_queue->buf[i]);
+            if (content != NULL)
+                r_store_content_fetch(h, content);
+        }
+        q->sender = NULL;
+        return(0);
+    }
     /* Do a poll before going on to allow others to preempt send. */
     delay = (nsec + 499) / 1000 + 1;
     if (q->ready > 0) {
@@ -218,6 +232,33 @@ Bail:
     return(0);
 }
 
+/**
+ * Restart the senders that were waiting for content to be read in.
+ */
+PUBLIC void
+r_sendq_wake_parked(struct ccnr_handle *h)
+{
+    struct fdholder *fdholder = NULL;
+    struct content_queue *q = NULL;
+    unsigned i;
+    int c;
+    
+    for (i = 0; i < h->face_limit; i++) {
+        fdholder = r_io_fdholder_from_fd(h, i);
+        if (fdholder == NULL)
+            continue;
+        for (c = 0; c < CCN_CQ_N; c++) {
+            q = fdholder->q[c];
+            if (q == NULL || !q->parked)
+                continue;
+            q->parked = 0;
+            if (q->sender == NULL)
+                q->sender = ccn_schedule_event(h->sched, 1, content_sender,
+                                               q, fdholder->filedesc);
+        }
+    }
+}
+
 PUBLIC int
 r_sendq_face_send_queue_insert(struct ccnr_handle *h,
                        struct fdholder *fdholder, struct content_entry *content)
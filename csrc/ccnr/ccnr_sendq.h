@@ -27,5 +27,6 @@
 
 int r_sendq_face_send_queue_insert(struct ccnr_handle *h, struct fdholder *fdholder, struct content_entry *content);
 void r_sendq_content_queue_destroy(struct ccnr_handle *h, struct content_queue **pq);
+void r_sendq_wake_parked(struct ccnr_handle *h);
 
 #endif
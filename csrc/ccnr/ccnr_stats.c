@@ -34,20 +34,25 @@
 #include <sys/utsname.h>
 #include <time.h>
 #include <unistd.h>
+#include <ccn/btree.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
 #include <ccn/indexbuf.h>
+#include <ccn/memacct.h>
 #include <ccn/schedule.h>
 #include <ccn/sockaddrutil.h>
 #include <ccn/hashtb.h>
 #include <ccn/uri.h>
 
+#include <sync/SyncBase.h>
+
 #include "ccnr_private.h"
 
 #include "ccnr_stats.h"
 #include "ccnr_io.h"
 #include "ccnr_msg.h"
+#include "ccnr_proto.h"
 
 
 #define CRLF "\r\n"
@@ -75,6 +80,7 @@ static void send_http_response(struct ccnr_handle *h, struct fdholder *fdholder,
                                struct ccn_charbuf *response);
 static struct ccn_charbuf *collect_stats_html(struct ccnr_handle *h);
 static struct ccn_charbuf *collect_stats_xml(struct ccnr_handle *h);
+static struct ccn_charbuf *collect_stats_metrics(struct ccnr_handle *h);
 
 /* HTTP */
 
@@ -149,6 +155,12 @@ ccnr_stats_handle_http_connection(struct ccnr_handle *h, struct fdholder *fdhold
         response = collect_stats_xml(h);
         send_http_response(h, fdholder, "text/xml", response);
     }
+    else if (0 == strcmp(rbuf, "GET /metrics ")) {
+        response = collect_stats_metrics(h);
+        send_http_response(h, fdholder,
+                           "application/openmetrics-text; version=1.0.0",
+                           response);
+    }
     else if (0 == strcmp(rbuf, "GET "))
         r_io_send(h, fdholder, resp404, strlen(resp404), NULL);
     else
@@ -163,7 +175,7 @@ send_http_response(struct ccnr_handle *h, struct fdholder *fdholder,
                    const char *mime_type, struct ccn_charbuf *response)
 {
     struct linger linger = { .l_onoff = 1, .l_linger = 1 };
-    char buf[128];
+    char buf[256];
     int hdrlen;
 
     /* Set linger to prevent quickly resetting the connection on close.*/
@@ -223,6 +235,113 @@ ccnr_collect_stats(struct ccnr_handle *h, struct ccnr_stats *ans)
 
 /* HTML formatting */
 
+/**
+ * How full the index nodes at a level were in the last compactor pass,
+ * as a percentage of the entries at which they would be split
+ */
+static unsigned
+index_fill_pct(struct ccnr_handle *h, int level)
+{
+    const struct ccnr_index_fill *f = &h->fill[level];
+    int limit;
+    
+    limit = (level == 0 && h->btree->full0 > 0) ? h->btree->full0 : h->btree->full;
+    if (f->nodes == 0 || limit <= 0)
+        return(0);
+    return(f->entries * 100 / (f->nodes * limit));
+}
+
+static void
+collect_index_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_btree *btree = h->btree;
+    const struct ccnr_index_fill *f = NULL;
+    int i;
+    
+    if (btree == NULL)
+        return;
+    ccn_charbuf_putf(b,
+        "<div><b>Index cache:</b> %d nodes, %ju bytes,"
+        " %ju hits, %ju misses</div>" NL,
+        hashtb_n(btree->resident), btree->cachebytes,
+        btree->hits, btree->misses);
+    for (i = 0; i < CCNR_FILL_LEVELS && h->fill[i].nodes != 0; i++) {
+        f = &h->fill[i];
+        ccn_charbuf_putf(b,
+            "<div><b>Index level %d:</b> %ju nodes, %ju entries,"
+            " %ju bytes, %u%% full</div>" NL,
+            i, f->nodes, f->entries, f->bytes, index_fill_pct(h, i));
+    }
+    if (h->compact_merges != 0)
+        ccn_charbuf_putf(b, "<div><b>Index merges:</b> %lu</div>" NL,
+                         h->compact_merges);
+    if (h->replica)
+        ccn_charbuf_putf(b,
+            "<div><b>Replica:</b> following commit at %ju,"
+            " %lu refreshes, %lu failures</div>" NL,
+            (uintmax_t)h->checkpoint,
+            h->replica_refreshes, h->replica_failures);
+}
+
+/**
+ * Add up the sizes of the segments of the repository data, and the
+ * bytes live in them as of the last segment cleaner pass
+ * @param dir - the data directory to count, or -1 for all of them
+ * @returns the number of segments.
+ */
+static unsigned
+segment_totals(struct ccnr_handle *h, int dir, uintmax_t *bytes, uintmax_t *live)
+{
+    unsigned n = 0;
+    unsigned i;
+    
+    *bytes = *live = 0;
+    for (i = 1; i < h->n_segment; i++) {
+        if (h->segment[i].state == CCNR_SEG_ABSENT)
+            continue;
+        if (dir >= 0 && h->segment[i].dir != (unsigned)dir)
+            continue;
+        n++;
+        *bytes += h->segment[i].size;
+        *live += h->segment[i].live;
+    }
+    return(n);
+}
+
+static void
+collect_segments_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    uintmax_t bytes;
+    uintmax_t live;
+    unsigned n;
+    unsigned i;
+    
+    n = segment_totals(h, -1, &bytes, &live);
+    ccn_charbuf_putf(b,
+        "<div><b>Repository data:</b> %u segments, %ju bytes, %ju live,"
+        " %ju copied, %lu segments removed</div>" NL,
+        n, bytes, live, h->segment_copied, h->segments_removed);
+    for (i = 0; h->n_data_dir > 1 && i < h->n_data_dir; i++) {
+        n = segment_totals(h, i, &bytes, &live);
+        ccn_charbuf_putf(b,
+            "<div>&nbsp;&nbsp;%s: %u segments, %ju bytes, %ju live</div>" NL,
+            h->data_dir[i], n, bytes, live);
+    }
+}
+
+static void
+collect_cob_cache_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    ccn_charbuf_putf(b,
+        "<div><b>Content cache:</b> %lu cobs, %ju bytes,"
+        " %lu hits, %lu misses, %lu evicted, %lu not admitted;"
+        " handles %lu hits, %lu misses; %lu sent from file</div>" NL,
+        h->cob_count, h->cob_bytes,
+        h->cob_hits, h->cob_misses, h->cob_evictions, h->cob_rejections,
+        h->content_from_accession_hits, h->content_from_accession_misses,
+        h->content_sent_from_file);
+}
+
 static void
 collect_faces_html(struct ccnr_handle *h, struct ccn_charbuf *b)
 {
@@ -347,6 +466,41 @@ collect_forwarding_html(struct ccnr_handle *h, struct ccn_charbuf *b)
     ccn_charbuf_putf(b, "</ul>");
 }
 
+/**
+ * Start-writes in progress, with their progress and fetch window
+ */
+static void
+collect_writes_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccnr_expect_content *md;
+    
+    if (h->writes == NULL)
+        return;
+    ccn_charbuf_putf(b, "<h4>Writes</h4>" NL);
+    ccn_charbuf_putf(b, "<ul>");
+    for (md = h->writes; md != NULL; md = md->next) {
+        ccn_charbuf_putf(b, " <li>");
+        ccn_uri_append(b, md->name->buf, md->name->length, 1);
+        ccn_charbuf_putf(b,
+                         " <b>segments:</b> %ju"
+                         " <b>bytes:</b> %ju"
+                         " <b>rate:</b> %u"
+                         " <b>window:</b> %d/%d"
+                         " <b>rtt:</b> %u.%03u"
+                         " <b>timeouts:</b> %lu"
+                         " <b>secs:</b> %ld",
+                         md->segments,
+                         ccnr_meter_total(md->meter),
+                         ccnr_meter_rate(h, md->meter),
+                         md->inflight, md->window,
+                         md->srtt_usec / 1000, md->srtt_usec % 1000,
+                         md->timeouts,
+                         h->sec - md->start_sec);
+        ccn_charbuf_putf(b, "</li>" NL);
+    }
+    ccn_charbuf_putf(b, "</ul>");
+}
+
 static unsigned
 ccnr_colorhash(struct ccnr_handle *h)
 {
@@ -357,6 +511,104 @@ ccnr_colorhash(struct ccnr_handle *h)
     return (v | 0xC0C0C0);
 }
 
+#define SCHED_LAG_TOP 32
+
+/**
+ * @returns the name of a scheduled action, for display
+ */
+static const char *
+sched_lag_name(const struct ccn_schedule_lag *lag)
+{
+    return(lag->name != NULL ? lag->name : "(unnamed)");
+}
+
+static double
+sched_pct(uintmax_t part, uintmax_t total)
+{
+    return(total > 0 ? 100.0 * part / total : 0.0);
+}
+
+static double
+sched_per_minute(uintmax_t count, uintmax_t usec)
+{
+    return(usec > 0 ? 60e6 * count / usec : 0.0);
+}
+
+static void
+collect_scheduler_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    uintmax_t busy;
+    int i, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    busy = load.total - (load.idle < load.total ? load.idle : load.total);
+    ccn_charbuf_putf(b, "<h4>Event Loop</h4>" NL);
+    ccn_charbuf_putf(b, "<div><b>Busy:</b> %.1f%% "
+                     "(scheduled events %.1f%%, i/o and other %.1f%%)</div>" NL,
+                     sched_pct(busy, load.total),
+                     sched_pct(load.events, load.total),
+                     sched_pct(busy - (load.events < busy ? load.events : busy),
+                               load.total));
+    ccn_charbuf_putf(b, "<div><b>Wakeups:</b> %ju", load.wakeups);
+    if (h->idle_slack > 0)
+        ccn_charbuf_putf(b, "; idle mode (%s) %ju s, %.1f wakeups per "
+                         "idle minute",
+                         h->quiet ? "on" : "off", load.slack_time / 1000000,
+                         sched_per_minute(load.slack_wakeups,
+                                          load.slack_time));
+    ccn_charbuf_putf(b, "</div>" NL);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    ccn_charbuf_putf(b, "<ul>");
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b, " <li><b>%s:</b> %ju runs, late by mean %ju, "
+                         "p50 %u, p90 %u, p99 %u, max %u usec</li>" NL,
+                         sched_lag_name(&lag[i]), lag[i].runs,
+                         lag[i].late_sum / lag[i].runs,
+                         ccn_schedule_lag_percentile(&lag[i], 50),
+                         ccn_schedule_lag_percentile(&lag[i], 90),
+                         ccn_schedule_lag_percentile(&lag[i], 99),
+                         lag[i].late_max);
+    ccn_charbuf_putf(b, "</ul>");
+}
+
+/**
+ * Copy in the memory totals that are kept elsewhere
+ */
+static void
+mem_census(struct ccnr_handle *h)
+{
+    size_t bytes;
+    int n;
+    
+    if (h->btree != NULL)
+        ccn_memacct_set(&h->mem[CCNR_MEM_BTREE], h->btree->cachebytes,
+                        hashtb_n(h->btree->resident));
+    ccn_memacct_set(&h->mem[CCNR_MEM_COBS], h->cob_bytes, h->cob_count);
+    bytes = ccn_schedule_memory(h->sched, &n);
+    ccn_memacct_set(&h->mem[CCNR_MEM_SCHED], bytes, n);
+}
+
+/**
+ * Memory held, by subsystem
+ */
+static void
+collect_memory_html(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    int i;
+    
+    mem_census(h);
+    ccn_charbuf_putf(b, "<h4>Memory%s</h4>" NL,
+                     h->compact ? " (compact profile)" : "");
+    ccn_charbuf_putf(b, "<ul>");
+    for (i = 0; i < CCNR_MEM_N; i++)
+        ccn_charbuf_putf(b, " <li><b>%s:</b> %ju bytes, %ju objects, "
+                         "peak %ju bytes</li>" NL, h->mem[i].name,
+                         h->mem[i].bytes, h->mem[i].objects, h->mem[i].peak);
+    ccn_charbuf_putf(b, "</ul>");
+}
+
 static struct ccn_charbuf *
 collect_stats_html(struct ccnr_handle *h)
 {
@@ -364,9 +616,11 @@ collect_stats_html(struct ccnr_handle *h)
     struct ccn_charbuf *b = ccn_charbuf_create();
     int pid;
     struct utsname un;
+    struct timeval now;
     
     uname(&un);
     pid = getpid();
+    gettimeofday(&now, NULL);
     
     ccnr_collect_stats(h, &stats);
     ccn_charbuf_putf(b,
@@ -396,7 +650,9 @@ collect_stats_html(struct ccnr_handle *h)
         "<div><b>Interests:</b> %d names,"
         " %ld pending, %ld propagating, %ld noted</div>" NL
         "<div><b>Interest totals:</b> %lu accepted,"
-        " %lu dropped, %lu sent, %lu stuffed</div>" NL,
+        " %lu dropped, %lu sent, %lu stuffed</div>" NL
+        "<div><b>Startup:</b> %ju bytes indexed,"
+        " ready after %lu.%03lu seconds</div>" NL,
         un.nodename,
         pid,
         ccnr_colorhash(h),
@@ -405,22 +661,31 @@ collect_stats_html(struct ccnr_handle *h)
         h->portstr,
         (int)CCN_API_VERSION,
         h->starttime, h->starttime_usec,
-        h->sec,
-        h->usec,
-        (unsigned long long)hashtb_n(h->content_by_accession_tab), // XXXXXX - 
+        (long)now.tv_sec,
+        (unsigned)now.tv_usec,
+        (unsigned long long)(h->acc_count), // XXXXXX - 
         (unsigned long long)(h->cob_count),
         h->n_stale,
-        hashtb_n(h->content_by_accession_tab),
+        (int)(h->acc_count),
         h->content_dups_recvd,
         h->content_items_sent,
         hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
         hashtb_n(h->propagating_tab) - stats.total_flood_control,
         stats.total_flood_control,
         h->interests_accepted, h->interests_dropped,
-        h->interests_sent, h->interests_stuffed);
+        h->interests_sent, h->interests_stuffed,
+        (uintmax_t)h->replaybytes,
+        h->startup_msec / 1000, h->startup_msec % 1000);
+    collect_cob_cache_html(h, b);
+    collect_index_html(h, b);
+    collect_segments_html(h, b);
     collect_faces_html(h, b);
     collect_face_meter_html(h, b);
     collect_forwarding_html(h, b);
+    collect_writes_html(h, b);
+    collect_scheduler_html(h, b);
+    collect_memory_html(h, b);
+    SyncAppendStats(h->sync_handle, b, 0);
     ccn_charbuf_putf(b,
         "</body>"
         "</html>" NL);
@@ -443,6 +708,80 @@ collect_meter_xml(struct ccnr_handle *h, struct ccn_charbuf *b, struct ccnr_mete
         m->what, total, rate, m->what);
 }
 
+static void
+collect_index_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_btree *btree = h->btree;
+    const struct ccnr_index_fill *f = NULL;
+    int i;
+    
+    if (btree == NULL)
+        return;
+    ccn_charbuf_putf(b,
+        "<index>"
+        "<nodes>%d</nodes>"
+        "<bytes>%ju</bytes>"
+        "<hits>%ju</hits>"
+        "<misses>%ju</misses>"
+        "<merges>%lu</merges>",
+        hashtb_n(btree->resident), btree->cachebytes,
+        btree->hits, btree->misses, h->compact_merges);
+    for (i = 0; i < CCNR_FILL_LEVELS && h->fill[i].nodes != 0; i++) {
+        f = &h->fill[i];
+        ccn_charbuf_putf(b,
+            "<level><n>%d</n><nodes>%ju</nodes><entries>%ju</entries>"
+            "<bytes>%ju</bytes><fill>%u</fill></level>",
+            i, f->nodes, f->entries, f->bytes, index_fill_pct(h, i));
+    }
+    if (h->replica)
+        ccn_charbuf_putf(b,
+            "<replica><commit>%ju</commit><refreshes>%lu</refreshes>"
+            "<failures>%lu</failures></replica>",
+            (uintmax_t)h->checkpoint,
+            h->replica_refreshes, h->replica_failures);
+    ccn_charbuf_putf(b, "</index>");
+}
+
+static void
+collect_segments_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    uintmax_t bytes;
+    uintmax_t live;
+    unsigned n;
+    
+    n = segment_totals(h, -1, &bytes, &live);
+    ccn_charbuf_putf(b,
+        "<segments>"
+        "<count>%u</count>"
+        "<bytes>%ju</bytes>"
+        "<live>%ju</live>"
+        "<copied>%ju</copied>"
+        "<removed>%lu</removed>"
+        "</segments>",
+        n, bytes, live, h->segment_copied, h->segments_removed);
+}
+
+static void
+collect_cob_cache_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    ccn_charbuf_putf(b,
+        "<cobcache>"
+        "<cobs>%lu</cobs>"
+        "<bytes>%ju</bytes>"
+        "<hits>%lu</hits>"
+        "<misses>%lu</misses>"
+        "<evicted>%lu</evicted>"
+        "<rejected>%lu</rejected>"
+        "<handlehits>%lu</handlehits>"
+        "<handlemisses>%lu</handlemisses>"
+        "<fromfile>%lu</fromfile>"
+        "</cobcache>",
+        h->cob_count, h->cob_bytes,
+        h->cob_hits, h->cob_misses, h->cob_evictions, h->cob_rejections,
+        h->content_from_accession_hits, h->content_from_accession_misses,
+        h->content_sent_from_file);
+}
+
 static void
 collect_faces_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
 {
@@ -536,14 +875,91 @@ collect_forwarding_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
     ccn_charbuf_putf(b, "</forwarding>");
 }
 
+static void
+collect_writes_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccnr_expect_content *md;
+    
+    ccn_charbuf_putf(b, "<writes>");
+    for (md = h->writes; md != NULL; md = md->next) {
+        ccn_charbuf_putf(b, "<write><name>");
+        ccn_uri_append(b, md->name->buf, md->name->length, 1);
+        ccn_charbuf_putf(b, "</name>"
+                         "<segments>%ju</segments>"
+                         "<bytes>%ju</bytes>"
+                         "<persec>%u</persec>"
+                         "<inflight>%d</inflight>"
+                         "<window>%d</window>"
+                         "<srtt>%u</srtt>"
+                         "<rto>%u</rto>"
+                         "<timeouts>%lu</timeouts>"
+                         "<secs>%ld</secs>"
+                         "</write>",
+                         md->segments,
+                         ccnr_meter_total(md->meter),
+                         ccnr_meter_rate(h, md->meter),
+                         md->inflight, md->window,
+                         md->srtt_usec, md->rto_usec,
+                         md->timeouts,
+                         h->sec - md->start_sec);
+    }
+    ccn_charbuf_putf(b, "</writes>");
+}
+
+static void
+collect_scheduler_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    int i, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    ccn_charbuf_putf(b, "<scheduler><load>"
+                     "<total>%ju</total><idle>%ju</idle><events>%ju</events>"
+                     "<wakeups>%ju</wakeups><idlemode>%ju</idlemode>"
+                     "<idlewakeups>%ju</idlewakeups>"
+                     "</load>", load.total, load.idle, load.events,
+                     load.wakeups, load.slack_time, load.slack_wakeups);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    for (i = 0; i < n; i++)
+        ccn_charbuf_putf(b, "<action><name>%s</name><runs>%ju</runs>"
+                         "<mean>%ju</mean>"
+                         "<p50>%u</p50><p90>%u</p90><p99>%u</p99>"
+                         "<max>%u</max></action>",
+                         sched_lag_name(&lag[i]), lag[i].runs,
+                         lag[i].late_sum / lag[i].runs,
+                         ccn_schedule_lag_percentile(&lag[i], 50),
+                         ccn_schedule_lag_percentile(&lag[i], 90),
+                         ccn_schedule_lag_percentile(&lag[i], 99),
+                         lag[i].late_max);
+    ccn_charbuf_putf(b, "</scheduler>");
+}
+
+static void
+collect_memory_xml(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    int i;
+    
+    mem_census(h);
+    ccn_charbuf_putf(b, "<memory>");
+    for (i = 0; i < CCNR_MEM_N; i++)
+        ccn_charbuf_putf(b, "<tag><name>%s</name><bytes>%ju</bytes>"
+                         "<objects>%ju</objects><peak>%ju</peak></tag>",
+                         h->mem[i].name, h->mem[i].bytes,
+                         h->mem[i].objects, h->mem[i].peak);
+    ccn_charbuf_putf(b, "</memory>");
+}
+
 static struct ccn_charbuf *
 collect_stats_xml(struct ccnr_handle *h)
 {
     struct ccnr_stats stats = {0};
     struct ccn_charbuf *b = ccn_charbuf_create();
+    struct timeval now;
     int i;
         
     ccnr_collect_stats(h, &stats);
+    gettimeofday(&now, NULL);
     ccn_charbuf_putf(b,
         "<ccnr>"
         "<identity>"
@@ -557,8 +973,8 @@ collect_stats_xml(struct ccnr_handle *h)
         "</identity>",
         (int)CCN_API_VERSION,
         h->starttime, h->starttime_usec,
-        h->sec,
-        h->usec);
+        (long)now.tv_sec,
+        (unsigned)now.tv_usec);
     ccn_charbuf_putf(b,
         "<cobs>"
         "<accessioned>%llu</accessioned>"
@@ -577,24 +993,210 @@ collect_stats_xml(struct ccnr_handle *h)
         "<dropped>%lu</dropped>"
         "<sent>%lu</sent>"
         "<stuffed>%lu</stuffed>"
-        "</interests>",
-        (unsigned long long)hashtb_n(h->content_by_accession_tab), // XXXXXX -
+        "</interests>"
+        "<startup>"
+        "<indexed>%ju</indexed>"
+        "<msec>%lu</msec>"
+        "</startup>",
+        (unsigned long long)(h->acc_count), // XXXXXX -
         (unsigned long long)(h->cob_count),
         h->n_stale,
-        hashtb_n(h->content_by_accession_tab),
+        (int)(h->acc_count),
         h->content_dups_recvd,
         h->content_items_sent,
         hashtb_n(h->nameprefix_tab), stats.total_interest_counts,
         hashtb_n(h->propagating_tab) - stats.total_flood_control,
         stats.total_flood_control,
         h->interests_accepted, h->interests_dropped,
-        h->interests_sent, h->interests_stuffed);
+        h->interests_sent, h->interests_stuffed,
+        (uintmax_t)h->replaybytes, h->startup_msec);
+    collect_cob_cache_xml(h, b);
+    collect_index_xml(h, b);
+    collect_segments_xml(h, b);
     collect_faces_xml(h, b);
     collect_forwarding_xml(h, b);
+    collect_writes_xml(h, b);
+    collect_scheduler_xml(h, b);
+    collect_memory_xml(h, b);
+    SyncAppendStats(h->sync_handle, b, 1);
     ccn_charbuf_putf(b, "</ccnr>" NL);
     return(b);
 }
 
+/* OpenMetrics formatting */
+
+static void
+metric_value(struct ccn_charbuf *b, const char *name, const char *type,
+             uintmax_t value)
+{
+    ccn_charbuf_putf(b, "# TYPE %s %s" NL, name, type);
+    ccn_charbuf_putf(b, "%s%s %ju" NL, name,
+                     strcmp(type, "counter") == 0 ? "_total" : "", value);
+}
+
+static void
+metric_seconds(struct ccn_charbuf *b, const char *name, const char *labels,
+               uintmax_t usec)
+{
+    ccn_charbuf_putf(b, "%s{%s} %ju.%06ju" NL, name, labels,
+                     usec / 1000000, usec % 1000000);
+}
+
+/**
+ * Time spent by the event loop, and lateness of scheduled events
+ */
+static void
+collect_scheduler_metrics(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    static const unsigned pct[3] = {50, 90, 99};
+    const char *name = "ccnr_event_lateness_seconds";
+    struct ccn_schedule_lag lag[SCHED_LAG_TOP];
+    struct ccn_schedule_load load;
+    uintmax_t busy;
+    int i, j, n;
+    
+    ccn_schedule_get_load(h->sched, &load);
+    busy = load.total - (load.idle < load.total ? load.idle : load.total);
+    ccn_charbuf_putf(b, "# TYPE ccnr_loop_seconds counter" NL);
+    metric_seconds(b, "ccnr_loop_seconds_total", "state=\"idle\"", load.idle);
+    metric_seconds(b, "ccnr_loop_seconds_total", "state=\"events\"",
+                   load.events);
+    metric_seconds(b, "ccnr_loop_seconds_total", "state=\"other\"",
+                   busy - (load.events < busy ? load.events : busy));
+    ccn_charbuf_putf(b, "# TYPE ccnr_loop_wakeups counter" NL);
+    ccn_charbuf_putf(b, "ccnr_loop_wakeups_total{mode=\"any\"} %ju" NL
+                     "ccnr_loop_wakeups_total{mode=\"idle\"} %ju" NL,
+                     load.wakeups, load.slack_wakeups);
+    ccn_charbuf_putf(b, "# TYPE ccnr_idle_mode_seconds counter" NL);
+    ccn_charbuf_putf(b, "ccnr_idle_mode_seconds_total %ju.%06ju" NL,
+                     load.slack_time / 1000000, load.slack_time % 1000000);
+    n = ccn_schedule_lag(h->sched, lag, SCHED_LAG_TOP);
+    ccn_charbuf_putf(b, "# TYPE %s summary" NL, name);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < 3; j++) {
+            unsigned v = ccn_schedule_lag_percentile(&lag[i], pct[j]);
+            ccn_charbuf_putf(b, "%s{action=\"%s\",quantile=\"0.%02u\"} "
+                             "%u.%06u" NL, name, sched_lag_name(&lag[i]),
+                             pct[j], v / 1000000, v % 1000000);
+        }
+        ccn_charbuf_putf(b, "%s_sum{action=\"%s\"} %ju.%06ju" NL,
+                         name, sched_lag_name(&lag[i]),
+                         lag[i].late_sum / 1000000, lag[i].late_sum % 1000000);
+        ccn_charbuf_putf(b, "%s_count{action=\"%s\"} %ju" NL,
+                         name, sched_lag_name(&lag[i]), lag[i].runs);
+    }
+}
+
+/**
+ * Memory held, by subsystem
+ */
+static void
+collect_memory_metrics(struct ccnr_handle *h, struct ccn_charbuf *b)
+{
+    static const char *fam[3] = {
+        "ccnr_memory_bytes",
+        "ccnr_memory_objects",
+        "ccnr_memory_peak_bytes",
+    };
+    uintmax_t v[3];
+    int i, k;
+    
+    mem_census(h);
+    for (i = 0; i < 3; i++) {
+        ccn_charbuf_putf(b, "# TYPE %s gauge" NL, fam[i]);
+        for (k = 0; k < CCNR_MEM_N; k++) {
+            v[0] = h->mem[k].bytes;
+            v[1] = h->mem[k].objects;
+            v[2] = h->mem[k].peak;
+            ccn_charbuf_putf(b, "%s{tag=\"%s\"} %ju" NL,
+                             fam[i], h->mem[k].name, v[i]);
+        }
+    }
+}
+
+/**
+ * Collect the metrics that do not require walking any tables.
+ */
+static struct ccn_charbuf *
+collect_stats_metrics(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *b = ccn_charbuf_create();
+    uintmax_t bytes;
+    uintmax_t live;
+    int i;
+    
+    ccn_charbuf_putf(b, "# TYPE ccnr_start_time_seconds gauge" NL
+                     "ccnr_start_time_seconds %ld.%06u" NL,
+                     h->starttime, h->starttime_usec);
+    metric_value(b, "ccnr_content_accessioned", "gauge",
+                 h->acc_count);
+    metric_value(b, "ccnr_content_stored", "gauge", h->cob_count);
+    metric_value(b, "ccnr_content_cache_bytes", "gauge", h->cob_bytes);
+    metric_value(b, "ccnr_content_cache_hits", "counter", h->cob_hits);
+    metric_value(b, "ccnr_content_cache_misses", "counter", h->cob_misses);
+    metric_value(b, "ccnr_content_cache_evictions", "counter",
+                 h->cob_evictions);
+    metric_value(b, "ccnr_content_cache_rejections", "counter",
+                 h->cob_rejections);
+    metric_value(b, "ccnr_content_handle_hits", "counter",
+                 h->content_from_accession_hits);
+    metric_value(b, "ccnr_content_handle_misses", "counter",
+                 h->content_from_accession_misses);
+    metric_value(b, "ccnr_content_sent_from_file", "counter",
+                 h->content_sent_from_file);
+    metric_value(b, "ccnr_content_verified", "counter", h->content_verified);
+    metric_value(b, "ccnr_content_verify_failures", "counter",
+                 h->content_verify_failed);
+    metric_value(b, "ccnr_watch_files", "counter", h->watch_files);
+    metric_value(b, "ccnr_watch_segments", "counter", h->watch_segments);
+    metric_value(b, "ccnr_content_stale", "gauge", h->n_stale);
+    metric_value(b, "ccnr_content_duplicates", "counter",
+                 h->content_dups_recvd);
+    metric_value(b, "ccnr_content_sent", "counter", h->content_items_sent);
+    metric_value(b, "ccnr_names", "gauge", hashtb_n(h->nameprefix_tab));
+    metric_value(b, "ccnr_pit_entries", "gauge", hashtb_n(h->propagating_tab));
+    metric_value(b, "ccnr_interests_accepted", "counter",
+                 h->interests_accepted);
+    metric_value(b, "ccnr_interests_dropped", "counter", h->interests_dropped);
+    metric_value(b, "ccnr_interests_sent", "counter", h->interests_sent);
+    metric_value(b, "ccnr_interests_stuffed", "counter", h->interests_stuffed);
+    metric_value(b, "ccnr_startup_indexed_bytes", "gauge", h->replaybytes);
+    metric_value(b, "ccnr_startup_milliseconds", "gauge", h->startup_msec);
+    metric_value(b, "ccnr_segments", "gauge", segment_totals(h, -1, &bytes, &live));
+    metric_value(b, "ccnr_segment_bytes", "gauge", bytes);
+    metric_value(b, "ccnr_segment_live_bytes", "gauge", live);
+    metric_value(b, "ccnr_segment_copied_bytes", "counter", h->segment_copied);
+    metric_value(b, "ccnr_segments_removed", "counter", h->segments_removed);
+    metric_value(b, "ccnr_writes", "gauge", h->n_writes);
+    metric_value(b, "ccnr_write_segments", "counter", h->write_segments);
+    metric_value(b, "ccnr_write_timeouts", "counter", h->write_timeouts);
+    if (h->btree != NULL) {
+        metric_value(b, "ccnr_index_cache_nodes", "gauge",
+                     hashtb_n(h->btree->resident));
+        metric_value(b, "ccnr_index_cache_bytes", "gauge",
+                     h->btree->cachebytes);
+        metric_value(b, "ccnr_index_cache_hits", "counter", h->btree->hits);
+        metric_value(b, "ccnr_index_cache_misses", "counter",
+                     h->btree->misses);
+        metric_value(b, "ccnr_index_merges", "counter", h->compact_merges);
+        if (h->replica) {
+            metric_value(b, "ccnr_replica_refreshes", "counter",
+                         h->replica_refreshes);
+            metric_value(b, "ccnr_replica_failures", "counter",
+                         h->replica_failures);
+        }
+        ccn_charbuf_putf(b, "# TYPE ccnr_index_fill_ratio gauge" NL);
+        for (i = 0; i < CCNR_FILL_LEVELS && h->fill[i].nodes != 0; i++)
+            ccn_charbuf_putf(b, "ccnr_index_fill_ratio{level=\"%d\"} %u.%02u" NL,
+                             i, index_fill_pct(h, i) / 100,
+                             index_fill_pct(h, i) % 100);
+    }
+    collect_scheduler_metrics(h, b);
+    collect_memory_metrics(h, b);
+    ccn_charbuf_putf(b, "# EOF" NL);
+    return(b);
+}
+
 /**
  * create and initialize separately allocated meter.
  */
@@ -20,8 +20,10 @@
  * Boston, MA 02110-1301, USA.
  */
  
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <netdb.h>
 #include <poll.h>
@@ -34,9 +36,11 @@
 #include <time.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <netinet/in.h>
@@ -49,9 +53,11 @@
 #include <ccn/face_mgmt.h>
 #include <ccn/hashtb.h>
 #include <ccn/indexbuf.h>
+#include <ccn/memacct.h>
 #include <ccn/schedule.h>
 #include <ccn/reg_mgmt.h>
 #include <ccn/uri.h>
+#include <ccn/uring.h>
 
 #include "ccnr_private.h"
 
@@ -66,6 +72,7 @@
 #include "ccnr_match.h"
 #include "ccnr_sendq.h"
 #include "ccnr_io.h"
+#include "ccnr_bulk.h"
 
 struct content_entry {
     ccnr_accession accession;   /**< permanent repository id */
@@ -74,6 +81,52 @@ struct content_entry {
     int size;                   /**< size of ContentObject */
     struct ccn_charbuf *flatname; /**< for skiplist, et. al. */
     struct ccn_charbuf *cob;    /**< may contain ContentObject, or be NULL */
+    struct content_entry *cob_prev; /**< cob cache list, if cob is cached */
+    struct content_entry *cob_next; /**< cob cache list, or NULL */
+    int cob_list;               /**< CCNR_COB_PROBATION or CCNR_COB_PROTECTED */
+    unsigned cob_epoch;         /**< cob cache epoch of the last use */
+};
+
+/**
+ * An asynchronous read of a ContentObject from repoFile1.
+ */
+struct ccnr_fetch {
+    ccnr_cookie cookie;         /**< content being read, or 0 if slot is free */
+    struct ccn_charbuf *cob;    /**< buffer the kernel is reading into */
+};
+
+/**
+ * The in-memory copies (cobs) of accessioned content objects.
+ *
+ * This is a segmented LRU.  Objects come in on probation, and move
+ * to the protected list when they are used again.  The protected list
+ * holds at most CCNR_COB_PROTECTED_PCT of the budget; what falls off
+ * its end goes back on probation, and eviction is from the end of
+ * probation.
+ *
+ * When the cache is full, a count-min sketch of recent accesses by
+ * accession (TinyLFU) decides admission: a newcomer that has been
+ * asked for less often than the object it would push out goes at the
+ * end of probation, to be the next to go, instead of at the front.
+ * So a scan of cold objects does not flush the hot ones.
+ *
+ * The epoch advances each time the cache is trimmed, which is once per
+ * pass of the main loop, so that the several looks at an object while
+ * handling one message count as one use.
+ */
+#define CCNR_COB_PROBATION 0
+#define CCNR_COB_PROTECTED 1
+#define CCNR_COB_PROTECTED_PCT 80
+#define CCNR_COB_SKETCH_DEPTH 4
+#define CCNR_COB_SKETCH_MAX 15
+struct ccnr_cob_cache {
+    struct content_entry lru[2];    /**< list heads, most recent first */
+    unsigned long count[2];         /**< objects on each list */
+    uintmax_t bytes[2];             /**< bytes on each list */
+    unsigned char *sketch;          /**< CCNR_COB_SKETCH_DEPTH rows of width */
+    unsigned width;                 /**< counters per row, a power of 2 */
+    unsigned long samples;          /**< accesses since the counters aged */
+    unsigned epoch;                 /**< advanced by each trim */
 };
 
 static const unsigned char *bogon = NULL;
@@ -81,11 +134,30 @@ static const unsigned char *bogon = NULL;
 static int
 r_store_set_flatname(struct ccnr_handle *h, struct content_entry *content,
                      struct ccn_parsed_ContentObject *pco);
+static struct content_entry *
+r_store_content_at(struct ccnr_handle *h, struct ccn_btree_node *leaf, int ndx);
 static int
 r_store_content_btree_insert(struct ccnr_handle *h,
                              struct content_entry *content,
                              struct ccn_parsed_ContentObject *pco,
                              ccnr_accession *accession);
+static void
+r_store_log_init(struct ccnr_handle *h, off_t size);
+static int
+r_store_index_compactor(struct ccn_schedule *sched, void *clienth,
+                        struct ccn_scheduled_event *ev, int flags);
+static int
+r_store_segment_cleaner(struct ccn_schedule *sched, void *clienth,
+                        struct ccn_scheduled_event *ev, int flags);
+
+/** Segment numbers must fit above the 48-bit offset in a position */
+#define CCNR_MAX_SEGMENT 32767
+/** Delay between the steps of a segment cleaner pass */
+#define CCNR_SEGCLEAN_STEP_MICROS 5000
+/** Delay between segment cleaner passes, when no segment is being cleaned */
+#define CCNR_SEGCLEAN_PASS_MICROS 600000000
+/** Most bytes of content the segment cleaner copies in one step */
+#define CCNR_SEGCLEAN_STEP_BYTES 262144
 
 #define FAILIF(cond) do {} while ((cond) && r_store_fatal(h, __func__, __LINE__))
 #define CHKSYS(res) FAILIF((res) == -1)
@@ -131,17 +203,479 @@ r_store_offset_from_accession(struct ccnr_handle *h, ccnr_accession a)
 static unsigned
 r_store_repofile_from_accession(struct ccnr_handle *h, ccnr_accession a)
 {
-    /* Initially this should always be 1 */
     return(a >> 48);
 }
 
+/**
+ * Make a position in the repository data from a segment and an offset.
+ *
+ * A position is laid out like an accession, but with the segment
+ * number less one, so that as long as there is only repoFile1 a
+ * position is just an offset into it.
+ */
+PUBLIC off_t
+r_store_position(struct ccnr_handle *h, unsigned segment, off_t offset)
+{
+    return(((off_t)(segment - 1) << 48) | offset);
+}
+
+static unsigned
+r_store_segment_from_position(struct ccnr_handle *h, off_t pos)
+{
+    return((unsigned)(pos >> 48) + 1);
+}
+
+/**
+ * Get the slot for a segment, growing the table if need be.
+ * @returns NULL if the segment number is out of range.
+ */
+static struct ccnr_segment *
+r_store_segment(struct ccnr_handle *h, unsigned segment)
+{
+    struct ccnr_segment *t = NULL;
+    unsigned n;
+    unsigned i;
+    
+    if (segment == 0 || segment > CCNR_MAX_SEGMENT)
+        return(NULL);
+    if (segment >= h->n_segment) {
+        for (n = h->n_segment + 8; n <= segment; n *= 2)
+            continue;
+        t = realloc(h->segment, n * sizeof(t[0]));
+        if (t == NULL)
+            return(NULL);
+        memset(t + h->n_segment, 0, (n - h->n_segment) * sizeof(t[0]));
+        for (i = h->n_segment; i < n; i++)
+            t[i].fd = -1;
+        h->segment = t;
+        h->n_segment = n;
+    }
+    return(&h->segment[segment]);
+}
+
+
+/**
+ * Make sure the mapping of a segment covers its first end bytes.
+ * @returns 0 if it does, -1 if not.
+ */
+static int
+r_store_map_repofile(struct ccnr_handle *h, unsigned segment, off_t end)
+{
+    struct ccnr_repomap *m = NULL;
+    struct stat statbuf;
+    unsigned char *addr = NULL;
+    off_t size;
+    int fd;
+    
+    if (segment == 0 || segment >= h->n_segment)
+        return(-1);
+    m = &h->segment[segment].map;
+    if (end <= m->valid)
+        return(0);
+    if (m->disabled)
+        return(-1);
+    fd = r_io_repo_data_file_fd(h, segment, 0);
+    if (fd == -1 || fstat(fd, &statbuf) == -1)
+        return(-1);
+    if (statbuf.st_size < end)
+        return(-1); /* not all there yet */
+    if (statbuf.st_size <= m->size) {
+        m->valid = statbuf.st_size;
+        return(0);
+    }
+    if (m->old != NULL)
+        return(-1); /* until r_store_trim gets rid of it */
+    size = 2 * statbuf.st_size;
+    if (size < ((off_t)1 << 26))
+        size = ((off_t)1 << 26);
+    if ((off_t)(size_t)size != size) {
+        m->disabled = 1;
+        return(-1);
+    }
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        ccnr_msg(h, "mmap of segment %u failed, %s (errno=%d)",
+                 segment, strerror(errno), errno);
+        m->disabled = 1;
+        return(-1);
+    }
+    /* Serving is mostly random access; readahead is done explicitly */
+    madvise(addr, size, MADV_RANDOM);
+    m->old = m->addr;
+    m->oldsize = m->size;
+    m->addr = addr;
+    m->size = size;
+    m->valid = statbuf.st_size;
+    return(0);
+}
+
+/**
+ * Release the resources of the mapping of a segment.
+ *
+ * If all is nonzero, the current mapping goes as well as any
+ * replaced one.
+ */
+static void
+r_store_unmap_segment(struct ccnr_handle *h, struct ccnr_repomap *m, int all)
+{
+    if (m->old != NULL) {
+        munmap(m->old, m->oldsize);
+        m->old = NULL;
+        m->oldsize = 0;
+    }
+    if (all && m->addr != NULL) {
+        munmap(m->addr, m->size);
+        m->addr = NULL;
+        m->size = 0;
+        m->valid = 0;
+    }
+}
+
+/**
+ * Release the resources of the mappings of all the segments.
+ */
+static void
+r_store_unmap_repofile(struct ccnr_handle *h, int all)
+{
+    unsigned i;
+    
+    for (i = 1; i < h->n_segment; i++)
+        r_store_unmap_segment(h, &h->segment[i].map, all);
+}
+
+/**
+ * Get the address of size bytes at an accession, within the mapping of
+ * its segment
+ * @returns NULL if it is not mapped.
+ */
+static const unsigned char *
+r_store_mapped_at(struct ccnr_handle *h, ccnr_accession a, size_t size)
+{
+    unsigned segment;
+    off_t offset;
+    
+    if (size <= 0 || a == CCNR_NULL_ACCESSION)
+        return(NULL);
+    segment = r_store_repofile_from_accession(h, a);
+    offset = r_store_offset_from_accession(h, a);
+    if (r_store_map_repofile(h, segment, offset + size) < 0)
+        return(NULL);
+    return(h->segment[segment].map.addr + offset);
+}
 
+/**
+ * Get the address of the content object within the mapping of its segment
+ * @returns NULL if it is not mapped.
+ */
 static const unsigned char *
 r_store_content_mapped(struct ccnr_handle *h, struct content_entry *content)
 {
+    if (content->size <= 0)
+        return(NULL);
+    return(r_store_mapped_at(h, content->accession, content->size));
+}
+
+/**
+ * Test whether touching the mapped bytes would wait for the disk.
+ * @returns 1 if they all appear to be in memory, 0 if not.
+ */
+static int
+r_store_mapped_resident(struct ccnr_handle *h,
+                        const unsigned char *p, size_t size)
+{
+    unsigned char vec[8];
+    size_t pagesize = h->pagesize;
+    uintptr_t start;
+    size_t len;
+    size_t i;
+    
+    if (pagesize == 0)
+        return(0);
+    start = (uintptr_t)p & ~(uintptr_t)(pagesize - 1);
+    len = (uintptr_t)p + size - start;
+    if (len > sizeof(vec) * pagesize)
+        return(0);
+    if (mincore((void *)start, len, (void *)vec) != 0)
+        return(0);
+    for (i = 0; i * pagesize < len; i++)
+        if ((vec[i] & 1) == 0)
+            return(0);
+    return(1);
+}
+
+/**
+ * Read from a segment, including any appends not yet committed.
+ * @returns the number of bytes read, or -1 for an error.
+ */
+static ssize_t
+r_store_pread(struct ccnr_handle *h, unsigned segment, int fd,
+              void *buf, size_t len, off_t offset)
+{
+    ssize_t res = 0;
+    size_t n = len;
+    off_t pos;
+    
+    if (segment != h->out_segment)
+        return(pread(fd, buf, len, offset));
+    if (offset < h->log_written) {
+        if (offset + (off_t)n > h->log_written)
+            n = h->log_written - offset;
+        res = pread(fd, buf, n, offset);
+        if (res != n)
+            return(res);
+    }
+    if (h->log_buf != NULL && res < len) {
+        pos = offset + res - h->log_written;
+        if (pos >= 0 && pos < h->log_buf->length) {
+            n = len - res;
+            if (n > h->log_buf->length - pos)
+                n = h->log_buf->length - pos;
+            memcpy((unsigned char *)buf + res, h->log_buf->buf + pos, n);
+            res += n;
+        }
+    }
+    return(res);
+}
+
+/**
+ * Test whether the content is still waiting in the commit buffer.
+ */
+static int
+r_store_content_unwritten(struct ccnr_handle *h, struct content_entry *content)
+{
+    if (h->log_buf == NULL || h->log_buf->length == 0)
+        return(0);
+    if (r_store_repofile_from_accession(h, content->accession) != h->out_segment)
+        return(0);
+    return(r_store_offset_from_accession(h, content->accession) +
+           content->size > h->log_written);
+}
+
+/**
+ * Set up the cob cache.
+ *
+ * CCNR_CONTENT_CACHE limits the number of cobs, and
+ * CCNR_CONTENT_CACHE_BYTES their total size.
+ */
+static void
+r_store_cob_cache_init(struct ccnr_handle *h)
+{
+    struct ccnr_cob_cache *c = NULL;
+    int i;
+    
+    h->cob_byte_limit = r_init_confval(h, "CCNR_CONTENT_CACHE_BYTES",
+                                       65536, ((intmax_t)1) << 40,
+                                       h->compact ?
+                                       CCNR_COMPACT_CONTENT_CACHE_BYTES :
+                                       33554432);
+    c = calloc(1, sizeof(*c));
+    CHKPTR(c);
+    for (i = 0; i < 2; i++)
+        c->lru[i].cob_next = c->lru[i].cob_prev = &c->lru[i];
+    for (c->width = 1024; c->width < h->cob_limit; c->width *= 2)
+        continue;
+    c->sketch = calloc(CCNR_COB_SKETCH_DEPTH, c->width);
+    CHKPTR(c->sketch);
+    h->cob_cache = c;
+}
+
+/**
+ * Take down the cob cache, leaving the cobs with their content.
+ */
+static void
+r_store_cob_cache_final(struct ccnr_handle *h)
+{
+    struct ccnr_cob_cache *c = h->cob_cache;
+    struct content_entry *content = NULL;
+    int i;
+    
+    if (c == NULL)
+        return;
+    for (i = 0; i < 2; i++) {
+        while ((content = c->lru[i].cob_next) != &c->lru[i]) {
+            c->lru[i].cob_next = content->cob_next;
+            content->cob_next = content->cob_prev = NULL;
+        }
+    }
+    h->cob_count = 0;
+    h->cob_bytes = 0;
+    free(c->sketch);
+    free(c);
+    h->cob_cache = NULL;
+}
+
+static unsigned
+r_store_cob_sketch_index(struct ccnr_cob_cache *c, ccnr_accession a, int row)
+{
+    static const uint_least64_t mult[CCNR_COB_SKETCH_DEPTH] = {
+        0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+        0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+    };
+    uint_least64_t x = (uint_least64_t)a * mult[row];
+    
+    return(row * c->width + ((unsigned)(x >> 32) & (c->width - 1)));
+}
+
+/**
+ * Estimate how often an object has been asked for lately.
+ */
+static int
+r_store_cob_frequency(struct ccnr_cob_cache *c, ccnr_accession a)
+{
+    int ans = CCNR_COB_SKETCH_MAX;
+    int v;
+    int i;
+    
+    for (i = 0; i < CCNR_COB_SKETCH_DEPTH; i++) {
+        v = c->sketch[r_store_cob_sketch_index(c, a, i)];
+        if (v < ans)
+            ans = v;
+    }
+    return(ans);
+}
+
+/**
+ * Count an access to an object in the admission filter.
+ *
+ * Only the smallest counters are bumped (a conservative update).
+ * All the counters are halved after 10 accesses per counter, so
+ * that the filter follows changes in popularity.
+ */
+static void
+r_store_cob_note_access(struct ccnr_handle *h, ccnr_accession a)
+{
+    struct ccnr_cob_cache *c = h->cob_cache;
+    unsigned char *p = NULL;
+    size_t j;
+    int f;
+    int i;
+    
+    if (c == NULL || a == CCNR_NULL_ACCESSION)
+        return;
+    f = r_store_cob_frequency(c, a);
+    if (f < CCNR_COB_SKETCH_MAX) {
+        for (i = 0; i < CCNR_COB_SKETCH_DEPTH; i++) {
+            p = &c->sketch[r_store_cob_sketch_index(c, a, i)];
+            if (*p == f)
+                (*p)++;
+        }
+    }
+    if (++(c->samples) >= 10UL * c->width) {
+        for (j = 0; j < (size_t)CCNR_COB_SKETCH_DEPTH * c->width; j++)
+            c->sketch[j] >>= 1;
+        c->samples = 0;
+    }
+}
+
+static void
+r_store_cob_unlink(struct ccnr_cob_cache *c, struct content_entry *content)
+{
+    content->cob_prev->cob_next = content->cob_next;
+    content->cob_next->cob_prev = content->cob_prev;
+    content->cob_next = content->cob_prev = NULL;
+    c->count[content->cob_list]--;
+    c->bytes[content->cob_list] -= content->size;
+}
+
+static void
+r_store_cob_link(struct ccnr_cob_cache *c, struct content_entry *content,
+                 int list, int recent)
+{
+    struct content_entry *head = &c->lru[list];
+    struct content_entry *prev = recent ? head : head->cob_prev;
+    
+    content->cob_prev = prev;
+    content->cob_next = prev->cob_next;
+    prev->cob_next->cob_prev = content;
+    prev->cob_next = content;
+    content->cob_list = list;
+    c->count[list]++;
+    c->bytes[list] += content->size;
+}
+
+/**
+ * The cob that is next in line to be evicted.
+ */
+static struct content_entry *
+r_store_cob_victim(struct ccnr_cob_cache *c)
+{
+    if (c->count[CCNR_COB_PROBATION] > 0)
+        return(c->lru[CCNR_COB_PROBATION].cob_prev);
+    if (c->count[CCNR_COB_PROTECTED] > 0)
+        return(c->lru[CCNR_COB_PROTECTED].cob_prev);
     return(NULL);
 }
 
+/**
+ * Enter accessioned content that has a cob into the cache, on probation.
+ */
+static void
+r_store_cob_admit(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct ccnr_cob_cache *c = h->cob_cache;
+    struct content_entry *victim = NULL;
+    int recent = 1;
+    
+    if (c == NULL || content->cob == NULL || content->cob_next != NULL ||
+        content->accession == CCNR_NULL_ACCESSION)
+        return;
+    if (h->cob_count >= h->cob_limit ||
+        h->cob_bytes + content->size > h->cob_byte_limit) {
+        victim = r_store_cob_victim(c);
+        if (victim != NULL &&
+            r_store_cob_frequency(c, content->accession) <=
+            r_store_cob_frequency(c, victim->accession)) {
+            recent = 0;
+            h->cob_rejections++;
+        }
+    }
+    r_store_cob_link(c, content, CCNR_COB_PROBATION, recent);
+    content->cob_epoch = c->epoch;
+    h->cob_count++;
+    h->cob_bytes += content->size;
+}
+
+/**
+ * Take content out of the cache, if it is there.  The cob stays.
+ */
+static void
+r_store_cob_detach(struct ccnr_handle *h, struct content_entry *content)
+{
+    if (h->cob_cache == NULL || content->cob_next == NULL)
+        return;
+    r_store_cob_unlink(h->cob_cache, content);
+    h->cob_count--;
+    h->cob_bytes -= content->size;
+}
+
+/**
+ * Note a use of a cached cob, protecting it.
+ */
+static void
+r_store_cob_hit(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct ccnr_cob_cache *c = h->cob_cache;
+    struct content_entry *demote = NULL;
+    
+    if (c == NULL || content->cob_next == NULL || content->cob_epoch == c->epoch)
+        return;
+    content->cob_epoch = c->epoch;
+    h->cob_hits++;
+    r_store_cob_note_access(h, content->accession);
+    r_store_cob_unlink(c, content);
+    r_store_cob_link(c, content, CCNR_COB_PROTECTED, 1);
+    while (c->bytes[CCNR_COB_PROTECTED] * 100 >
+           h->cob_byte_limit * CCNR_COB_PROTECTED_PCT ||
+           c->count[CCNR_COB_PROTECTED] * 100 >
+           h->cob_limit * CCNR_COB_PROTECTED_PCT) {
+        demote = c->lru[CCNR_COB_PROTECTED].cob_prev;
+        if (demote == content)
+            break;
+        r_store_cob_unlink(c, demote);
+        r_store_cob_link(c, demote, CCNR_COB_PROBATION, 1);
+    }
+}
+
 static const unsigned char *
 r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
 {
@@ -157,8 +691,6 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
     
     repofile = r_store_repofile_from_accession(h, content->accession);
     offset = r_store_offset_from_accession(h, content->accession);
-    if (repofile != 1)
-        goto Bail;
     if (content->cob != NULL)
         goto Bail;
     fd = r_io_repo_data_file_fd(h, repofile, 0);
@@ -170,11 +702,11 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
     if (content->size > 0) {
         if (ccn_charbuf_reserve(cob, content->size) == NULL)
             goto Bail;
-        rres = pread(fd, cob->buf, content->size, offset);
+        rres = r_store_pread(h, repofile, fd, cob->buf, content->size, offset);
         if (rres == content->size) {
             cob->length = content->size;
             content->cob = cob;
-            h->cob_count++;
+            r_store_cob_admit(h, content);
             return(cob->buf);
         }
         if (rres == -1)
@@ -184,7 +716,7 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
             ccnr_msg(h, "r_store_content_read %u expected %d bytes, but got %d",
                      fd, (int)content->size, (int)rres);
     } else {
-        rres = pread(fd, buf, 8800, offset); // XXX - should be symbolic
+        rres = r_store_pread(h, repofile, fd, buf, 8800, offset); // XXX - should be symbolic
         if (rres == -1) {
             ccnr_msg(h, "r_store_content_read %u :%s (errno = %d)",
                      fd, strerror(errno), errno);
@@ -199,7 +731,7 @@ r_store_content_read(struct ccnr_handle *h, struct content_entry *content)
         if (ccn_charbuf_append(cob, buf, dres) < 0)
             goto Bail;
         content->cob = cob;
-        h->cob_count++;
+        r_store_cob_admit(h, content);
         return(cob->buf);        
     }
 Bail:
@@ -216,41 +748,40 @@ PUBLIC int
 r_store_content_trim(struct ccnr_handle *h, struct content_entry *content)
 {
     if (content->accession != CCNR_NULL_ACCESSION && content->cob != NULL) {
+        r_store_cob_detach(h, content);
         ccn_charbuf_destroy(&content->cob);
-        h->cob_count--;
         return(0);
     }
     return(-1);
 }
 
 /**
- *  Evict recoverable content from in-memory buffers
+ *  Evict recoverable content from in-memory buffers, until there are
+ *  at most limit cobs and they fit in CCNR_CONTENT_CACHE_BYTES
  */
 PUBLIC void
 r_store_trim(struct ccnr_handle *h, unsigned long limit)
 {
     struct content_entry *content = NULL;
-    int checklimit;
-    unsigned before;
-    unsigned rover;
-    unsigned mask;
+    unsigned long before;
     
     r_store_index_needs_cleaning(h);
+    /* Nobody holds addresses into the mapping, or cobs, when we get called */
+    r_store_unmap_repofile(h, 0);
     before = h->cob_count;
-    if (before <= limit)
+    if (h->cob_cache == NULL)
         return;
-    checklimit = h->cookie_limit;
-    mask = h->cookie_limit - 1;
-    for (rover = (h->trim_rover & mask);
-         checklimit > 0 && h->cob_count > limit;
-         checklimit--, rover = (rover + 1) & mask) {
-        content = h->content_by_cookie[rover];
-        if (content != NULL)
-            r_store_content_trim(h, content);
+    h->cob_cache->epoch++;
+    while (h->cob_count > limit || h->cob_bytes > h->cob_byte_limit) {
+        content = r_store_cob_victim(h->cob_cache);
+        if (content == NULL || r_store_content_trim(h, content) < 0)
+            break;
+        h->cob_evictions++;
+        if (content->cookie == 0)
+            r_store_forget_content(h, &content); /* only the cache had it */
     }
-    h->trim_rover = rover;
-    if (CCNSHOULDLOG(h, sdf, CCNL_FINER))
-        ccnr_msg(h, "trimmed %u cobs", before - h->cob_count);
+    if (before != h->cob_count && CCNSHOULDLOG(h, sdf, CCNL_FINER))
+        ccnr_msg(h, "trimmed %lu cobs", before - h->cob_count);
 }
 
 /**
@@ -268,13 +799,18 @@ r_store_content_base(struct ccnr_handle *h, struct content_entry *content)
     
     if (content->cob != NULL && content->cob->length == content->size) {
         ans = content->cob->buf;
+        r_store_cob_hit(h, content);
         goto Finish;
     }
     if (content->accession == CCNR_NULL_ACCESSION)
         goto Finish;
-    ans = r_store_content_mapped(h, content);
-    if (ans != NULL)
-        goto Finish;
+    h->cob_misses++;
+    r_store_cob_note_access(h, content->accession);
+    if (!r_store_content_unwritten(h, content)) {
+        ans = r_store_content_mapped(h, content);
+        if (ans != NULL)
+            goto Finish;
+    }
     ans = r_store_content_read(h, content);
 Finish:
     if (ans != NULL) {
@@ -294,154 +830,1076 @@ Finish:
     return(ans);
 }
 
-PUBLIC int
-r_store_name_append_components(struct ccn_charbuf *dst,
-                               struct ccnr_handle *h,
-                               struct content_entry *content,
-                               int skip,
-                               int count)
+/**
+ * Set up for asynchronous reads of content objects.
+ *
+ * CCNR_FETCH_LIMIT bounds the number of reads in flight; 0 means
+ * content is always read synchronously when it is needed.
+ */
+static void
+r_store_fetch_init(struct ccnr_handle *h)
 {
-    int res;
+    int dflt;
     
-    res = ccn_name_append_flatname(dst,
-                                   content->flatname->buf,
-                                   content->flatname->length, skip, count);
-    return(res);
+    /* Keep each of the data directories busy */
+    dflt = 16 * (h->n_data_dir > 1 ? h->n_data_dir : 1);
+    h->fetch_limit = r_init_confval(h, "CCNR_FETCH_LIMIT", 0, 256,
+                                    dflt > 256 ? 256 : dflt);
+    h->fetch_readahead = r_init_confval(h, "CCNR_FETCH_READAHEAD", 0, 16, 2);
+    h->fetch_outstanding = 0;
+    if (h->fetch_limit == 0)
+        return;
+    h->fetch_ring = ccn_uring_create(h->fetch_limit, 0, 0);
+    if (h->fetch_ring == NULL) {
+        if (CCNSHOULDLOG(h, sdfsdf, CCNL_INFO))
+            ccnr_msg(h, "asynchronous reads not available - %s",
+                     strerror(errno));
+        h->fetch_limit = 0;
+        return;
+    }
+    h->fetch = calloc(h->fetch_limit, sizeof(h->fetch[0]));
+    CHKPTR(h->fetch);
 }
 
-PUBLIC int
-r_store_content_flags(struct content_entry *content)
+/**
+ * Start reading content in from its segment.
+ * @returns 0 if the read was started, -1 if not.
+ */
+static int
+r_store_fetch_start(struct ccnr_handle *h, struct content_entry *content)
 {
-    return(content->flags);
+    struct ccnr_fetch *f = NULL;
+    unsigned repofile;
+    off_t offset;
+    int fd;
+    int i;
+    int res;
+    
+    if (h->fetch_outstanding >= h->fetch_limit)
+        return(-1);
+    repofile = r_store_repofile_from_accession(h, content->accession);
+    offset = r_store_offset_from_accession(h, content->accession);
+    fd = r_io_repo_data_file_fd(h, repofile, 0);
+    if (fd == -1)
+        return(-1);
+    for (i = 0; i < h->fetch_limit; i++) {
+        if (h->fetch[i].cookie == 0) {
+            f = &h->fetch[i];
+            break;
+        }
+    }
+    if (f == NULL)
+        return(-1);
+    f->cob = ccn_charbuf_create();
+    if (f->cob == NULL || ccn_charbuf_reserve(f->cob, content->size) == NULL)
+        goto Bail;
+    res = ccn_uring_read(h->fetch_ring, fd, f->cob->buf, content->size,
+                         offset, i + 1);
+    if (res < 0)
+        goto Bail;
+    f->cookie = content->cookie;
+    content->flags |= CCN_CONTENT_ENTRY_FETCHING;
+    h->fetch_outstanding++;
+    return(0);
+Bail:
+    ccn_charbuf_destroy(&f->cob);
+    return(-1);
+}
+
+/**
+ * Find the length of the leading part of a flatname that remains
+ * after dropping its last drop components.
+ * @returns the length, or -1 if there are not that many components.
+ */
+static int
+r_store_flatname_stem(const unsigned char *flatname, size_t size, int drop)
+{
+    int n;
+    int rnc;
+    size_t stem;
+    
+    n = ccn_flatname_ncomps(flatname, size);
+    if (n < drop)
+        return(-1);
+    for (stem = 0, n -= drop; n > 0; n--) {
+        rnc = ccn_flatname_next_comp(flatname + stem, size - stem);
+        if (rnc <= 0)
+            return(-1);
+        stem += CCNFLATSKIP(rnc);
+    }
+    return(stem);
+}
+
+/**
+ * Start reading in the content that follows in name order, for as long
+ * as it looks like more of the same stream (same name but for the last
+ * explicit component).
+ */
+static void
+r_store_fetch_readahead(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct content_entry *next = NULL;
+    struct ccn_charbuf *flatname = content->flatname;
+    struct ccn_btree_cursor cursor = {0};
+    const unsigned char *mapped = NULL;
+    int ncomps;
+    int stem;
+    int res;
+    int i;
+    
+    if (flatname == NULL)
+        return;
+    /* The last component is the digest, and the one before may vary */
+    stem = r_store_flatname_stem(flatname->buf, flatname->length, 2);
+    if (stem <= 0)
+        return;
+    ncomps = ccn_flatname_ncomps(flatname->buf, flatname->length);
+    /* Start just past the current name, as r_store_content_next() does */
+    ccn_charbuf_as_string(flatname);
+    res = ccn_btree_cursor_seek(&cursor, h->btree,
+                                flatname->buf, flatname->length + 1);
+    for (i = 0; i < h->fetch_readahead && res >= 0 && cursor.leaf != NULL;
+         i++, res = ccn_btree_cursor_next(&cursor)) {
+        if (h->fetch_outstanding >= h->fetch_limit)
+            break;
+        /* A stem match is a prefix match, as the stem ends a component */
+        if (ccn_btree_compare(flatname->buf, stem,
+                              cursor.leaf, cursor.index) != -9999)
+            break;
+        next = r_store_content_at(h, cursor.leaf, cursor.index);
+        if (next == NULL || next->flatname == NULL)
+            break;
+        if (ccn_flatname_ncomps(next->flatname->buf,
+                                next->flatname->length) != ncomps)
+            break;
+        if (next->cob != NULL || next->accession == CCNR_NULL_ACCESSION ||
+            next->size <= 0 ||
+            (next->flags & CCN_CONTENT_ENTRY_FETCHING) != 0 ||
+            r_store_content_unwritten(h, next))
+            continue;
+        mapped = r_store_content_mapped(h, next);
+        if (mapped != NULL && r_store_mapped_resident(h, mapped, next->size))
+            continue;
+        if (r_store_fetch_start(h, next) < 0)
+            break;
+    }
+}
+
+/**
+ *  Arrange for the content object to be in memory when it is needed
+ *
+ * If it is not there already and asynchronous reads are available,
+ * start reading it in, along with some of what follows it.
+ *
+ * @returns 1 if r_store_content_base may be called now, or
+ *          0 if the caller should wait until the read completes.
+ *          Waiting send queues are awakened when that happens.
+ */
+PUBLIC int
+r_store_content_fetch(struct ccnr_handle *h, struct content_entry *content)
+{
+    const unsigned char *mapped = NULL;
+    
+    if (content->cob != NULL || h->fetch_ring == NULL)
+        return(1);
+    if ((content->flags & CCN_CONTENT_ENTRY_FETCHING) != 0)
+        return(0);
+    if ((content->flags & CCN_CONTENT_ENTRY_READERR) != 0) {
+        /* Let r_store_content_read try it, and complain if need be */
+        content->flags &= ~CCN_CONTENT_ENTRY_READERR;
+        return(1);
+    }
+    if (content->accession == CCNR_NULL_ACCESSION || content->size <= 0 ||
+        r_store_content_unwritten(h, content))
+        return(1);
+    mapped = r_store_content_mapped(h, content);
+    if (mapped != NULL && r_store_mapped_resident(h, mapped, content->size))
+        return(1);
+    if (r_store_fetch_start(h, content) < 0) {
+        /* If all the slots are busy, wait for one to free up */
+        return(h->fetch_outstanding == 0);
+    }
+    r_store_fetch_readahead(h, content);
+    return(0);
+}
+
+/**
+ * Pass any reads that have been started to the kernel.
+ */
+PUBLIC void
+r_store_fetch_submit(struct ccnr_handle *h)
+{
+    if (h->fetch_ring != NULL && h->fetch_outstanding > 0)
+        ccn_uring_submit(h->fetch_ring);
+}
+
+/**
+ * @returns the fd to poll for read completions, or -1 if none.
+ */
+PUBLIC int
+r_store_fetch_fd(struct ccnr_handle *h)
+{
+    if (h->fetch_ring == NULL)
+        return(-1);
+    return(ccn_uring_fd(h->fetch_ring));
+}
+
+/**
+ * Attach the content objects from completed reads.
+ * @returns the number of reads completed.
+ */
+static int
+r_store_fetch_reap(struct ccnr_handle *h)
+{
+    struct ccn_uring_cqe cqes[16];
+    struct content_entry *content = NULL;
+    struct ccnr_fetch *f = NULL;
+    int total = 0;
+    int n;
+    int i;
+    
+    while ((n = ccn_uring_reap(h->fetch_ring, cqes, 16)) > 0) {
+        for (i = 0; i < n; i++) {
+            if (cqes[i].user_data == 0 || cqes[i].user_data > h->fetch_limit)
+                continue;
+            f = &h->fetch[cqes[i].user_data - 1];
+            content = r_store_content_from_cookie(h, f->cookie);
+            if (content != NULL) {
+                content->flags &= ~CCN_CONTENT_ENTRY_FETCHING;
+                if (cqes[i].res == content->size &&
+                    r_store_content_mapped(h, content) != NULL)
+                    ; /* the page cache has it now */
+                else if (cqes[i].res == content->size && content->cob == NULL) {
+                    f->cob->length = content->size;
+                    content->cob = f->cob;
+                    f->cob = NULL;
+                    r_store_cob_admit(h, content);
+                }
+                else if (cqes[i].res != content->size)
+                    content->flags |= CCN_CONTENT_ENTRY_READERR;
+            }
+            ccn_charbuf_destroy(&f->cob);
+            f->cookie = 0;
+            h->fetch_outstanding--;
+            total++;
+        }
+    }
+    return(total);
+}
+
+/**
+ * Handle read completions, and get the waiting senders going again.
+ */
+PUBLIC void
+r_store_fetch_complete(struct ccnr_handle *h)
+{
+    if (h->fetch_ring == NULL)
+        return;
+    if (r_store_fetch_reap(h) > 0)
+        r_sendq_wake_parked(h);
+}
+
+/**
+ * Wait for any reads in flight, and then release the ring.
+ */
+static void
+r_store_fetch_final(struct ccnr_handle *h)
+{
+    if (h->fetch_ring == NULL)
+        return;
+    while (h->fetch_outstanding > 0 && ccn_uring_wait(h->fetch_ring, 1000) > 0)
+        r_store_fetch_reap(h);
+    ccn_uring_destroy(&h->fetch_ring);
+    free(h->fetch);
+    h->fetch = NULL;
+    h->fetch_limit = 0;
+}
+
+PUBLIC int
+r_store_name_append_components(struct ccn_charbuf *dst,
+                               struct ccnr_handle *h,
+                               struct content_entry *content,
+                               int skip,
+                               int count)
+{
+    int res;
+    
+    res = ccn_name_append_flatname(dst,
+                                   content->flatname->buf,
+                                   content->flatname->length, skip, count);
+    return(res);
+}
+
+PUBLIC int
+r_store_content_flags(struct content_entry *content)
+{
+    return(content->flags);
+}
+
+PUBLIC int
+r_store_content_change_flags(struct content_entry *content, int set, int clear)
+{
+    int old = content->flags;
+    content->flags |= set;
+    content->flags &= ~clear;
+    return(old);
+}
+
+/**
+ * Write a file named index/stable that contains the position of the
+ * end of the repository data when the repository is shut down.
+ */
+static int
+r_store_write_stable_point(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccn_charbuf *cb = NULL;
+    int fd;
+    
+    path = ccn_charbuf_create();
+    cb = ccn_charbuf_create();
+    ccn_charbuf_putf(path, "%s/index/stable", h->directory);
+    unlink(ccn_charbuf_as_string(path)); /* Should not exist, but just in case. */
+    fd = open(ccn_charbuf_as_string(path),
+              O_CREAT | O_EXCL | O_WRONLY | O_TRUNC, 0666);
+    if (fd == -1) {
+        ccnr_msg(h, "cannot write stable mark %s: %s",
+                 ccn_charbuf_as_string(path), strerror(errno));
+        unlink(ccn_charbuf_as_string(path));
+    }
+    else {
+        ccn_charbuf_putf(cb, "%ju", (uintmax_t)(h->stable));
+        write(fd, cb->buf, cb->length);
+        close(fd);
+        if (CCNSHOULDLOG(h, dfsdf, CCNL_INFO))
+            ccnr_msg(h, "Index marked stable - %s", ccn_charbuf_as_string(cb));
+    }
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&cb);
+    return(0);
+}
+
+/**
+ * Read the former end of the repository data from index/stable, and
+ * remove the latter.
+ */
+static void
+r_store_read_stable_point(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccn_charbuf *cb = NULL;
+    int fd;
+    int i;
+    ssize_t rres;
+    uintmax_t val;
+    unsigned char c;
+    
+    path = ccn_charbuf_create();
+    cb = ccn_charbuf_create();
+    ccn_charbuf_putf(path, "%s/index/stable", h->directory);
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY, 0666);
+    if (fd != -1) {
+        rres = read(fd, ccn_charbuf_reserve(cb, 80), 80);
+        if (rres > 0)
+            cb->length = rres;
+        close(fd);
+        if (CCNSHOULDLOG(h, dfsdf, CCNL_INFO))
+            ccnr_msg(h, "Last stable at %s", ccn_charbuf_as_string(cb));
+    }
+    for (val = 0, i = 0; i < cb->length; i++) {
+        c = cb->buf[i];
+        if ('0' <= c && c <= '9')
+            val = val * 10 + (c - '0');
+        else
+            break;
+    }
+    if (i == 0 || i < cb->length) {
+        ccnr_msg(h, "Bad stable mark - %s", ccn_charbuf_as_string(cb));
+        h->stable = 0;
+    }
+    else {
+        h->stable = val;
+        unlink(ccn_charbuf_as_string(path));
+    }
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&cb);
+}
+
+/**
+ * Record how much of the repository data is covered by the index files.
+ *
+ * This is called when the index cleaner has nothing left to write, so
+ * after a crash only what follows the checkpoint needs to be indexed.
+ * A store that commits snapshots keeps the checkpoint in the commit,
+ * so that it always matches what the index holds; otherwise it goes in
+ * a file of its own.
+ */
+static void
+r_store_write_checkpoint(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccn_charbuf *temp = NULL;
+    struct ccn_charbuf *cb = NULL;
+    int fd;
+    
+    if (h->active_in_fd != -1 || h->active_out_fd == -1)
+        return;
+    if (r_store_log_flush(h) < 0)
+        return;
+    if (h->stable == 0 || h->stable == h->checkpoint)
+        return;
+    if (h->btree->io->btcommit != NULL) {
+        if (ccn_btree_commit(h->btree, h->stable) < 0)
+            ccnr_msg(h, "cannot commit index at %ju", (uintmax_t)h->stable);
+        else {
+            h->checkpoint = h->stable;
+            if (CCNSHOULDLOG(h, dfsdf, CCNL_FINE))
+                ccnr_msg(h, "Index committed at %ju", (uintmax_t)h->stable);
+        }
+        return;
+    }
+    path = ccn_charbuf_create();
+    temp = ccn_charbuf_create();
+    cb = ccn_charbuf_create();
+    ccn_charbuf_putf(path, "%s/index/checkpoint", h->directory);
+    ccn_charbuf_putf(temp, "%s/index/checkpoint.new", h->directory);
+    ccn_charbuf_putf(cb, "%ju", (uintmax_t)(h->stable));
+    fd = open(ccn_charbuf_as_string(temp), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+    if (fd == -1 ||
+        write(fd, cb->buf, cb->length) != cb->length ||
+        (h->log_sync && fsync(fd) != 0) ||
+        close(fd) != 0 ||
+        rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(path)) != 0) {
+        ccnr_msg(h, "cannot write checkpoint %s: %s",
+                 ccn_charbuf_as_string(path), strerror(errno));
+        unlink(ccn_charbuf_as_string(temp));
+    }
+    else {
+        h->checkpoint = h->stable;
+        if (CCNSHOULDLOG(h, dfsdf, CCNL_FINE))
+            ccnr_msg(h, "Index checkpoint - %s", ccn_charbuf_as_string(cb));
+    }
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&temp);
+    ccn_charbuf_destroy(&cb);
+}
+
+/**
+ * Test whether a position falls within a segment that is there.
+ */
+static int
+r_store_position_in_data(struct ccnr_handle *h, off_t pos)
+{
+    unsigned segment = r_store_segment_from_position(h, pos);
+    
+    if (segment >= h->n_segment ||
+        h->segment[segment].state == CCNR_SEG_ABSENT)
+        return(0);
+    return(r_store_offset_from_accession(h, pos) <= h->segment[segment].size);
+}
+
+/**
+ * Find out how much of the repository data the surviving index files
+ * cover.
+ *
+ * A committed snapshot is consistent as it stands, so only an index
+ * kept in files needs to be checked over.
+ * @returns the checkpoint position, or 0 if the index cannot be trusted.
+ */
+static off_t
+r_store_read_checkpoint(struct ccnr_handle *h, off_t size)
+{
+    struct ccn_charbuf *path = NULL;
+    char buf[32];
+    char *endp = NULL;
+    uintmax_t val = 0;
+    ssize_t rres = 0;
+    int fd;
+    
+    /* An index from before commits may still have a checkpoint file */
+    if (h->btree->io->btcommit != NULL && h->btree->io->mark != 0) {
+        val = h->btree->io->mark;
+        if (val > (uintmax_t)size || !r_store_position_in_data(h, val)) {
+            ccnr_msg(h, "Bad index commit mark - %ju", val);
+            return(0);
+        }
+        return(val);
+    }
+    path = ccn_charbuf_create();
+    ccn_charbuf_putf(path, "%s/index/checkpoint", h->directory);
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY, 0666);
+    ccn_charbuf_destroy(&path);
+    if (fd == -1)
+        return(0);
+    rres = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (rres <= 0)
+        return(0);
+    buf[rres] = 0;
+    val = strtoumax(buf, &endp, 10);
+    if (endp != buf + rres || val == 0 || val > (uintmax_t)size ||
+        !r_store_position_in_data(h, val)) {
+        ccnr_msg(h, "Bad checkpoint - %s", buf);
+        return(0);
+    }
+    if (ccn_btree_check(h->btree, NULL) < 0) {
+        ccnr_msg(h, "Index fails checks");
+        return(0);
+    }
+    return(val);
+}
+
+/**
+ * Log a bit if we are taking a while to re-index.
+ */
+static int
+r_store_reindexing(struct ccn_schedule *sched,
+                   void *clienth,
+                   struct ccn_scheduled_event *ev,
+                   int flags)
+{
+    struct ccnr_handle *h = clienth;
+    struct fdholder *in = NULL;
+    unsigned pct;
+    
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        return(0);
+    in = r_io_fdholder_from_fd(h, h->active_in_fd);
+    if (in == NULL)
+        return(0);
+    pct = ccnr_meter_total(in->meter[FM_BYTI]) / ((h->replaybytes / 100) + 1);
+    if (pct >= 100)
+        return(0);
+    ccnr_msg(h, "indexing %u%% complete", pct);
+    return(2000000);
+}
+
+/**
+ * Select power of 2 between l and m + 1 (if possible).
+ */
+static unsigned
+choose_limit(unsigned l, unsigned m)
+{
+    unsigned k;
+    
+    for (k = 0; k < l; k = 2 * k + 1)
+        continue;
+    while (k > (m | 1) || k + 1 < k)
+        k >>= 1;
+    return(k + 1);
+}
+
+/*
+ * The accession map is an open-addressed table of content handles,
+ * probed linearly from a hash of the accession.  The key is the
+ * accession in the handle itself, so a slot is a single pointer and
+ * a lookup touches nothing but the table and the handles it passes.
+ * The table is kept at most half full, and deletion shifts the rest
+ * of the run back, so there are no tombstones.
+ */
+
+static unsigned
+r_store_acc_hash(struct ccnr_handle *h, ccnr_accession accession)
+{
+    uint_least64_t x = ccnr_accession_encode(h, accession);
+    
+    return((unsigned)((x * 0x9E3779B97F4A7C15ULL) >> 32) & (h->acc_limit - 1));
+}
+
+/**
+ * Find the slot that holds the handle for an accession, or the empty
+ * slot where it would go.
+ */
+static struct content_entry **
+r_store_acc_slot(struct ccnr_handle *h, ccnr_accession accession)
+{
+    unsigned mask = h->acc_limit - 1;
+    unsigned i;
+    
+    for (i = r_store_acc_hash(h, accession);
+         h->content_by_accession[i] != NULL;
+         i = (i + 1) & mask) {
+        if (h->content_by_accession[i]->accession == accession)
+            break;
+    }
+    return(&h->content_by_accession[i]);
+}
+
+static struct content_entry *
+r_store_acc_lookup(struct ccnr_handle *h, ccnr_accession accession)
+{
+    return(*r_store_acc_slot(h, accession));
+}
+
+/**
+ * Double the size of the accession map.
+ */
+static int
+r_store_acc_grow(struct ccnr_handle *h)
+{
+    struct content_entry **old = h->content_by_accession;
+    struct content_entry **tab = NULL;
+    unsigned n = h->acc_limit;
+    unsigned i;
+    
+    if (2 * n < n)
+        return(-1);
+    tab = ccn_memacct_calloc(&h->mem[CCNR_MEM_ACCESSION], 2 * n, sizeof(tab[0]));
+    if (tab == NULL)
+        return(-1);
+    h->content_by_accession = tab;
+    h->acc_limit = 2 * n;
+    for (i = 0; i < n; i++)
+        if (old[i] != NULL)
+            *r_store_acc_slot(h, old[i]->accession) = old[i];
+    ccn_memacct_free(&h->mem[CCNR_MEM_ACCESSION], old);
+    return(0);
+}
+
+/**
+ * Enter content into the accession map, under its accession,
+ * replacing any handle that was there.
+ */
+static void
+r_store_acc_insert(struct ccnr_handle *h, struct content_entry *content)
+{
+    struct content_entry **slot;
+    
+    if (2 * (h->acc_count + 1) > h->acc_limit)
+        r_store_acc_grow(h);
+    slot = r_store_acc_slot(h, content->accession);
+    if (*slot == NULL) {
+        if (h->acc_count + 1 >= h->acc_limit) {
+            ccnr_msg(h, "accession map is full");
+            return;
+        }
+        h->acc_count++;
+    }
+    *slot = content;
+}
+
+/**
+ * Take the handle for an accession out of the map.
+ * @returns the handle that was there, or NULL.
+ */
+static struct content_entry *
+r_store_acc_remove(struct ccnr_handle *h, ccnr_accession accession)
+{
+    struct content_entry **tab = h->content_by_accession;
+    struct content_entry *ans;
+    unsigned mask = h->acc_limit - 1;
+    unsigned i;
+    unsigned j;
+    unsigned k;
+    
+    i = r_store_acc_slot(h, accession) - tab;
+    ans = tab[i];
+    if (ans == NULL)
+        return(NULL);
+    for (j = (i + 1) & mask; tab[j] != NULL; j = (j + 1) & mask) {
+        k = r_store_acc_hash(h, tab[j]->accession);
+        /* Move it back unless its home is cyclically in (i, j] */
+        if (i < j ? (k <= i || k > j) : (k <= i && k > j)) {
+            tab[i] = tab[j];
+            i = j;
+        }
+    }
+    tab[i] = NULL;
+    h->acc_count--;
+    return(ans);
+}
+
+/**
+ * Open the storage for the index, of the kind named by CCNR_BTREE_STORE.
+ *
+ * A replica always opens the writer's page store, read-only.
+ */
+static struct ccn_btree_io *
+r_store_index_io(struct ccnr_handle *h, const char *path,
+                 struct ccn_charbuf *msgs)
+{
+    const char *kind = getenv("CCNR_BTREE_STORE");
+    
+    if (h->replica)
+        return(ccn_btree_io_from_pagefile_readonly(path, msgs));
+    if (kind != NULL && strcmp(kind, "files") == 0)
+        return(ccn_btree_io_from_directory(path, msgs));
+    return(ccn_btree_io_from_pagefile(path, msgs));
+}
+
+/**
+ * Index all of the repository data in one go, after the index has
+ * been reset.
+ *
+ * If this works, the input is finished just as if it had been read
+ * to the end; otherwise it is left to be read the usual way.
+ * Either way, no content timers are set and no interests are matched
+ * during the reindex, since at this point there are none to match.
+ */
+static void
+r_store_bulk_reindex(struct ccnr_handle *h)
+{
+    off_t end;
+    
+    end = r_bulk_reindex(h);
+    if (end < 0)
+        return;
+    h->stable = end;
+    ccnr_msg(h, "read %ju bytes", (uintmax_t)h->replaybytes);
+    r_io_shutdown_client_fd(h, h->active_in_fd);
+}
+
+/**
+ * Set up the list of data directories from CCNR_DATA_DIRECTORIES.
+ *
+ * The repository directory always comes first.
+ */
+static void
+r_store_data_dirs_init(struct ccnr_handle *h)
+{
+    const char *list = getenv("CCNR_DATA_DIRECTORIES");
+    const char *p = NULL;
+    const char *q = NULL;
+    unsigned n = 1;
+    unsigned i;
+    
+    for (p = list; p != NULL && *p != 0; p++)
+        if (*p == ':')
+            n++;
+    h->data_dir = calloc(n + 1, sizeof(h->data_dir[0]));
+    CHKPTR(h->data_dir);
+    h->data_dir[0] = strdup(h->directory);
+    CHKPTR(h->data_dir[0]);
+    h->n_data_dir = 1;
+    for (p = list; p != NULL && *p != 0; p = q + (*q != 0)) {
+        q = strchr(p, ':');
+        if (q == NULL)
+            q = p + strlen(p);
+        if (q == p)
+            continue;
+        for (i = 0; i < h->n_data_dir; i++)
+            if (strlen(h->data_dir[i]) == (size_t)(q - p) &&
+                memcmp(h->data_dir[i], p, q - p) == 0)
+                break;
+        if (i < h->n_data_dir)
+            continue;
+        h->data_dir[i] = strndup(p, q - p);
+        CHKPTR(h->data_dir[i]);
+        h->n_data_dir++;
+    }
+    h->data_placement = r_init_confval(h, "CCNR_DATA_PLACEMENT", 0, 1, 0);
+}
+
+/**
+ * Choose the data directory for a new segment.
+ *
+ * Either the directories are taken in turn, or the one with the most
+ * space free is chosen.
+ */
+static unsigned
+r_store_place_segment(struct ccnr_handle *h)
+{
+    struct statvfs st;
+    uintmax_t avail;
+    uintmax_t best_avail = 0;
+    unsigned best;
+    unsigned i;
+    
+    if (h->n_data_dir <= 1)
+        return(0);
+    best = (h->segment[h->out_segment].dir + 1) % h->n_data_dir;
+    if (h->data_placement == 0)
+        return(best);
+    for (i = 0; i < h->n_data_dir; i++) {
+        if (statvfs(h->data_dir[i], &st) != 0)
+            continue;
+        avail = (uintmax_t)st.f_bavail * st.f_frsize;
+        if (avail > best_avail) {
+            best_avail = avail;
+            best = i;
+        }
+    }
+    return(best);
+}
+
+/**
+ * Look through the data directories for segments not yet known, and
+ * note them as sealed.
+ * @returns the number found.
+ */
+static unsigned
+r_store_segments_scan(struct ccnr_handle *h)
+{
+    struct ccnr_segment *seg = NULL;
+    struct dirent *de = NULL;
+    DIR *dir = NULL;
+    unsigned long n;
+    char *endp = NULL;
+    unsigned found = 0;
+    unsigned d;
+    
+    for (d = 0; d < h->n_data_dir; d++) {
+        dir = opendir(h->data_dir[d]);
+        if (dir == NULL && d > 0)
+            ccnr_msg(h, "cannot open data directory %s: %s",
+                     h->data_dir[d], strerror(errno));
+        while (dir != NULL && (de = readdir(dir)) != NULL) {
+            if (strcmp(de->d_name, "repoFile1") == 0) {
+                if (d > 0)
+                    continue;
+                n = 1;
+            }
+            else if (strncmp(de->d_name, "repoSegment", 11) == 0 &&
+                     de->d_name[11] > '0' && de->d_name[11] <= '9') {
+                n = strtoul(de->d_name + 11, &endp, 10);
+                if (*endp != 0 || n < 2)
+                    continue;
+            }
+            else
+                continue;
+            seg = r_store_segment(h, n);
+            if (seg == NULL) {
+                ccnr_msg(h, "ignoring %s - too many segments", de->d_name);
+                continue;
+            }
+            if (seg->state != CCNR_SEG_ABSENT) {
+                if (seg->dir != d)
+                    ccnr_msg(h, "ignoring %s/%s - already found in %s",
+                             h->data_dir[d], de->d_name, h->data_dir[seg->dir]);
+                continue;
+            }
+            seg->state = CCNR_SEG_SEALED;
+            seg->dir = d;
+            found++;
+        }
+        if (dir != NULL)
+            closedir(dir);
+    }
+    return(found);
+}
+
+/**
+ * Find the segments of the repository data, and open the last one for
+ * appending.
+ *
+ * Each of the data directories is searched.  If there are no segments,
+ * repoFile1 is created.
+ * @returns the position of the end of the data.
+ */
+static off_t
+r_store_segments_init(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccnr_segment *seg = NULL;
+    struct stat statbuf;
+    off_t size;
+    unsigned i;
+    
+    h->segment_bytes = r_init_confval(h, "CCNR_SEGMENT_BYTES", 65536, 1099511627776, 1073741824);
+    h->segment_live_pct = r_init_confval(h, "CCNR_SEGMENT_LIVE", 0, 99, 50);
+    h->pagesize = sysconf(_SC_PAGESIZE);
+    h->out_segment = 0;
+    h->startupbytes = 0;
+    r_store_data_dirs_init(h);
+    r_store_segments_scan(h);
+    path = ccn_charbuf_create();
+    CHKPTR(path);
+    for (i = 1; i < h->n_segment; i++) {
+        seg = &h->segment[i];
+        if (seg->state == CCNR_SEG_ABSENT)
+            continue;
+        path->length = 0;
+        r_io_repo_segment_path(h, path, i);
+        if (stat(ccn_charbuf_as_string(path), &statbuf) == 0)
+            seg->size = statbuf.st_size;
+        h->startupbytes += seg->size;
+        h->out_segment = i;
+    }
+    ccn_charbuf_destroy(&path);
+    if (h->out_segment == 0) {
+        seg = r_store_segment(h, 1);
+        CHKPTR(seg);
+        h->out_segment = 1;
+    }
+    seg = &h->segment[h->out_segment];
+    seg->state = CCNR_SEG_ACTIVE;
+    h->active_out_fd = r_io_open_repo_segment(h, h->out_segment, 1); /* output */
+    size = lseek(h->active_out_fd, 0, SEEK_END);
+    if (size == (off_t)-1) {
+        r_init_fail(h, __LINE__, "repository data", errno);
+        return(0);
+    }
+    h->startupbytes += size - seg->size;
+    seg->size = size;
+    return(r_store_position(h, h->out_segment, size));
 }
 
-PUBLIC int
-r_store_content_change_flags(struct content_entry *content, int set, int clear)
+/**
+ * Start indexing a segment at the given offset.
+ * @returns 0 for success, -1 for failure.
+ */
+static int
+r_store_open_input(struct ccnr_handle *h, unsigned segment, off_t offset)
 {
-    int old = content->flags;
-    content->flags |= set;
-    content->flags &= ~clear;
-    return(old);
+    struct fdholder *in = NULL;
+    
+    h->in_segment = segment;
+    h->active_in_fd = r_io_open_repo_segment(h, segment, 0); /* input */
+    in = r_io_fdholder_from_fd(h, h->active_in_fd);
+    if (in == NULL || lseek(h->active_in_fd, offset, SEEK_SET) != offset)
+        return(-1);
+    in->bufoffset = offset;
+    return(0);
 }
 
 /**
- * Write a file named index/stable that contains the size of
- * repoFile1 when the repository is shut down.
+ * Count the bytes of repository data that follow a position.
  */
-static int
-r_store_write_stable_point(struct ccnr_handle *h)
+static off_t
+r_store_bytes_after(struct ccnr_handle *h, off_t pos)
 {
-    struct ccn_charbuf *path = NULL;
-    struct ccn_charbuf *cb = NULL;
-    int fd;
+    unsigned segment = r_store_segment_from_position(h, pos);
+    off_t offset = r_store_offset_from_accession(h, pos);
+    off_t total = 0;
+    unsigned i;
     
-    path = ccn_charbuf_create();
-    cb = ccn_charbuf_create();
-    ccn_charbuf_putf(path, "%s/index/stable", h->directory);
-    unlink(ccn_charbuf_as_string(path)); /* Should not exist, but just in case. */
-    fd = open(ccn_charbuf_as_string(path),
-              O_CREAT | O_EXCL | O_WRONLY | O_TRUNC, 0666);
-    if (fd == -1) {
-        ccnr_msg(h, "cannot write stable mark %s: %s",
-                 ccn_charbuf_as_string(path), strerror(errno));
-        unlink(ccn_charbuf_as_string(path));
+    for (i = segment; i < h->n_segment; i++) {
+        if (h->segment[i].state == CCNR_SEG_ABSENT)
+            continue;
+        total += h->segment[i].size;
+        if (i == segment)
+            total -= offset;
     }
-    else {
-        ccn_charbuf_putf(cb, "%ju", (uintmax_t)(h->stable));
-        write(fd, cb->buf, cb->length);
-        close(fd);
-        if (CCNSHOULDLOG(h, dfsdf, CCNL_INFO))
-            ccnr_msg(h, "Index marked stable - %s", ccn_charbuf_as_string(cb));
+    return(total);
+}
+
+/**
+ * The segment being indexed has been read to the end.
+ *
+ * Go on to the next segment, if there is one; otherwise note where
+ * the data ends, which also says that indexing is done.
+ */
+PUBLIC void
+r_store_input_done(struct ccnr_handle *h, int fd)
+{
+    off_t size;
+    unsigned i;
+    
+    size = lseek(fd, 0, SEEK_END);
+    r_io_shutdown_client_fd(h, fd);
+    for (i = h->in_segment + 1; i < h->n_segment; i++) {
+        if (h->segment[i].state == CCNR_SEG_ABSENT)
+            continue;
+        if (r_store_open_input(h, i, 0) == 0)
+            return;
+        ccnr_msg(h, "cannot index segment %u: %s", i, strerror(errno));
+        if (h->active_in_fd != -1)
+            r_io_shutdown_client_fd(h, h->active_in_fd);
+        break;
     }
-    ccn_charbuf_destroy(&path);
-    ccn_charbuf_destroy(&cb);
-    return(0);
+    h->stable = r_store_position(h, h->in_segment, size);
+    ccnr_msg(h, "read %ju bytes", (uintmax_t)h->replaybytes);
 }
 
 /**
- * Read the former size of repoFile1 from index/stable, and remove
- * the latter.
+ * Bring a replica's view of the segments up to date.
+ *
+ * New segments are picked up, the sizes are refreshed, and any segment
+ * that the writer has removed is let go.
  */
 static void
-r_store_read_stable_point(struct ccnr_handle *h)
+r_store_replica_segments(struct ccnr_handle *h)
 {
     struct ccn_charbuf *path = NULL;
-    struct ccn_charbuf *cb = NULL;
-    int fd;
-    int i;
-    ssize_t rres;
-    uintmax_t val;
-    unsigned char c;
+    struct ccnr_segment *seg = NULL;
+    struct stat statbuf;
+    unsigned i;
     
+    r_store_segments_scan(h);
     path = ccn_charbuf_create();
-    cb = ccn_charbuf_create();
-    ccn_charbuf_putf(path, "%s/index/stable", h->directory);
-    fd = open(ccn_charbuf_as_string(path), O_RDONLY, 0666);
-    if (fd != -1) {
-        rres = read(fd, ccn_charbuf_reserve(cb, 80), 80);
-        if (rres > 0)
-            cb->length = rres;
-        close(fd);
-        if (CCNSHOULDLOG(h, dfsdf, CCNL_INFO))
-            ccnr_msg(h, "Last stable at %s", ccn_charbuf_as_string(cb));
-    }
-    for (val = 0, i = 0; i < cb->length; i++) {
-        c = cb->buf[i];
-        if ('0' <= c && c <= '9')
-            val = val * 10 + (c - '0');
-        else
-            break;
-    }
-    if (i == 0 || i < cb->length) {
-        ccnr_msg(h, "Bad stable mark - %s", ccn_charbuf_as_string(cb));
-        h->stable = 0;
-    }
-    else {
-        h->stable = val;
-        unlink(ccn_charbuf_as_string(path));
+    CHKPTR(path);
+    for (i = 1; i < h->n_segment; i++) {
+        seg = &h->segment[i];
+        if (seg->state == CCNR_SEG_ABSENT)
+            continue;
+        path->length = 0;
+        r_io_repo_segment_path(h, path, i);
+        if (stat(ccn_charbuf_as_string(path), &statbuf) == 0) {
+            seg->size = statbuf.st_size;
+            continue;
+        }
+        /* A read in flight might still be using the file */
+        if (errno != ENOENT || h->fetch_outstanding > 0)
+            continue;
+        r_store_unmap_segment(h, &seg->map, 1);
+        if (seg->fd != -1)
+            r_io_shutdown_client_fd(h, seg->fd);
+        memset(seg, 0, sizeof(*seg));
+        seg->fd = -1;
     }
     ccn_charbuf_destroy(&path);
-    ccn_charbuf_destroy(&cb);
 }
 
 /**
- * Log a bit if we are taking a while to re-index.
+ * Pick up the writer's latest commit, if there is a new one.
+ *
+ * The nodes that changed are dropped from the cache, and are read
+ * again as they are needed.
  */
 static int
-r_store_reindexing(struct ccn_schedule *sched,
-                   void *clienth,
-                   struct ccn_scheduled_event *ev,
-                   int flags)
+r_store_replica_follow(struct ccn_schedule *sched,
+                       void *clienth,
+                       struct ccn_scheduled_event *ev,
+                       int flags)
 {
     struct ccnr_handle *h = clienth;
-    struct fdholder *in = NULL;
-    unsigned pct;
+    int res;
     
-    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
-        return(0);
-    in = r_io_fdholder_from_fd(h, h->active_in_fd);
-    if (in == NULL)
-        return(0);
-    pct = ccnr_meter_total(in->meter[FM_BYTI]) / ((h->startupbytes / 100) + 1);
-    if (pct >= 100)
+    (void)(sched);
+    (void)(ev);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || h->btree == NULL) {
+        h->replica_follower = NULL;
         return(0);
-    ccnr_msg(h, "indexing %u%% complete", pct);
-    return(2000000);
+    }
+    res = ccn_btree_refresh(h->btree);
+    if (res < 0) {
+        h->replica_failures++;
+        if (CCNSHOULDLOG(h, refresh, CCNL_WARNING))
+            ccnr_msg(h, "cannot follow the index - %s", strerror(errno));
+    }
+    else if (res > 0) {
+        h->replica_refreshes++;
+        h->stable = h->checkpoint = h->btree->io->mark;
+        r_store_replica_segments(h);
+        r_store_index_needs_cleaning(h);
+        if (CCNSHOULDLOG(h, refresh, CCNL_FINE))
+            ccnr_msg(h, "following the index committed at %ju",
+                     (uintmax_t)h->checkpoint);
+    }
+    return(h->replica_follow_usec);
 }
 
 /**
- * Select power of 2 between l and m + 1 (if possible).
+ * Get a replica ready to serve from the index the writer last committed.
+ *
+ * A replica never writes, so there is no segment open for output and
+ * nothing to index; it just looks for a new commit now and then.
  */
-static unsigned
-choose_limit(unsigned l, unsigned m)
+static void
+r_store_replica_init(struct ccnr_handle *h)
 {
-    unsigned k;
-    
-    for (k = 0; k < l; k = 2 * k + 1)
-        continue;
-    while (k > (m | 1) || k + 1 < k)
-        k >>= 1;
-    return(k + 1);
+    h->pagesize = sysconf(_SC_PAGESIZE);
+    h->out_segment = 0;
+    h->active_in_fd = -1;
+    h->active_out_fd = -1;
+    r_store_data_dirs_init(h);
+    r_store_replica_segments(h);
+    h->stable = h->checkpoint = h->btree->io->mark;
+    ccnr_msg(h, "Replica of the index committed at %ju",
+             (uintmax_t)h->checkpoint);
+    h->replica_follow_usec = r_init_confval(h, "CCNR_REPLICA_FOLLOW", 10, 60000, 1000) * 1000;
+    h->replica_follower = ccn_schedule_event(h->sched, h->replica_follow_usec,
+                                             r_store_replica_follow, NULL, 0);
 }
 
 PUBLIC void
@@ -449,34 +1907,42 @@ r_store_init(struct ccnr_handle *h)
 {
     struct ccn_btree *btree = NULL;
     struct ccn_btree_node *node = NULL;
-    struct hashtb_param param = {0};
     int i;
     int j;
     int res;
     struct ccn_charbuf *path = NULL;
     struct ccn_charbuf *msgs = NULL;
-    off_t offset;
+    off_t end;
+    off_t tail = 0;
+    int fresh = 0;
+    int reset = 0;
+    static const char *const indexfiles[4] = {
+        "maxnodeid", "pages", "nodemap", "checkpoint"
+    };
     
     path = ccn_charbuf_create();
-    param.finalize_data = h;
-    param.finalize = 0;
     
-    h->cob_limit = r_init_confval(h, "CCNR_CONTENT_CACHE", 16, 2000000, 4201);
+    h->cob_limit = r_init_confval(h, "CCNR_CONTENT_CACHE", 16, 2000000,
+                                  h->compact ? CCNR_COMPACT_CONTENT_CACHE : 4201);
     h->cookie_limit = choose_limit(h->cob_limit, (ccnr_cookie)(~0U));
+    r_store_cob_cache_init(h);
     h->content_by_cookie = calloc(h->cookie_limit, sizeof(h->content_by_cookie[0]));
     CHKPTR(h->content_by_cookie);
-    h->content_by_accession_tab = hashtb_create(sizeof(struct content_by_accession_entry), NULL);
-    CHKPTR(h->content_by_accession_tab);
+    h->acc_limit = 2 * h->cookie_limit;
+    h->acc_count = 0;
+    h->content_by_accession = ccn_memacct_calloc(&h->mem[CCNR_MEM_ACCESSION],
+        h->acc_limit, sizeof(h->content_by_accession[0]));
+    CHKPTR(h->content_by_accession);
     h->btree = btree = ccn_btree_create();
     CHKPTR(btree);
     FAILIF(btree->nextnodeid != 1);
     ccn_charbuf_putf(path, "%s/index", h->directory);
-    res = mkdir(ccn_charbuf_as_string(path), 0700);
+    res = h->replica ? 0 : mkdir(ccn_charbuf_as_string(path), 0700);
     if (res != 0 && errno != EEXIST)
         r_init_fail(h, __LINE__, ccn_charbuf_as_string(path), errno);
     else {
         msgs = ccn_charbuf_create();
-        btree->io = ccn_btree_io_from_directory(ccn_charbuf_as_string(path), msgs);
+        btree->io = r_store_index_io(h, ccn_charbuf_as_string(path), msgs);
         if (btree->io == NULL)
             res = errno;
         if (msgs->length != 0 && CCNSHOULDLOG(h, sffdsdf, CCNL_WARNING)) {
@@ -488,6 +1954,10 @@ r_store_init(struct ccnr_handle *h)
         if (btree->io == NULL)
             r_init_fail(h, __LINE__, ccn_charbuf_as_string(path), res);
     }
+    if (btree->io != NULL)
+        fresh = (btree->io->maxnodeid == 0);
+    if (btree->io != NULL && h->replica && (fresh || btree->io->mark == 0))
+        r_init_fail(h, __LINE__, "nothing committed yet - start the writer first", 0);
     node = ccn_btree_getnode(btree, 1, 0);
     if (btree->io != NULL)
         btree->nextnodeid = btree->io->maxnodeid + 1;
@@ -499,12 +1969,29 @@ r_store_init(struct ccnr_handle *h)
     ccn_charbuf_destroy(&path);
     if (h->running == -1)
         return;
+    if (h->replica) {
+        r_store_replica_init(h);
+        goto Limits;
+    }
     r_store_read_stable_point(h);
     h->active_in_fd = -1;
-    h->active_out_fd = r_io_open_repo_data_file(h, "repoFile1", 1); /* output */
-    offset = lseek(h->active_out_fd, 0, SEEK_END);
-    h->startupbytes = offset;
-    if (offset != h->stable || node->corrupt != 0) {
+    end = r_store_segments_init(h);
+    r_store_log_init(h, h->segment[h->out_segment].size);
+    if (end != h->stable && node->corrupt == 0 && !fresh)
+        tail = r_store_read_checkpoint(h, end);
+    if (tail > 0) {
+        h->replaybytes = r_store_bytes_after(h, tail);
+        ccnr_msg(h, "Index current to %ju - indexing the remaining %ju bytes",
+                 (uintmax_t)tail, (uintmax_t)h->replaybytes);
+        h->stable = 0;
+        h->checkpoint = tail;
+        if (r_store_open_input(h, r_store_segment_from_position(h, tail),
+                               r_store_offset_from_accession(h, tail)) < 0)
+            r_init_fail(h, __LINE__, "repository data", errno);
+        if (CCNSHOULDLOG(h, dfds, CCNL_INFO))
+            ccn_schedule_event(h->sched, 50000, r_store_reindexing, NULL, 0);
+    }
+    else if (end != h->stable || node->corrupt != 0 || (fresh && h->startupbytes != 0)) {
         ccnr_msg(h, "Index not current - resetting");
         ccn_btree_init_node(node, 0, 'R', 0);
         node = NULL;
@@ -519,10 +2006,15 @@ r_store_init(struct ccnr_handle *h)
             if (res < 0)
                 j++;
         }
+        for (i = 0; i < 4; i++) {
+            path->length = 0;
+            ccn_charbuf_putf(path, "%s/index/%s", h->directory, indexfiles[i]);
+            unlink(ccn_charbuf_as_string(path));
+        }
         h->btree = btree = ccn_btree_create();
         path->length = 0;
         ccn_charbuf_putf(path, "%s/index", h->directory);
-        btree->io = ccn_btree_io_from_directory(ccn_charbuf_as_string(path), msgs);
+        btree->io = r_store_index_io(h, ccn_charbuf_as_string(path), msgs);
         CHKPTR(btree->io);
         btree->io->maxnodeid = 0;
         btree->nextnodeid = 1;
@@ -530,7 +2022,12 @@ r_store_init(struct ccnr_handle *h)
         btree->nextnodeid = btree->io->maxnodeid + 1;
         ccn_btree_init_node(node, 0, 'R', 0);
         h->stable = 0;
-        h->active_in_fd = r_io_open_repo_data_file(h, "repoFile1", 0); /* input */
+        h->replaybytes = h->startupbytes;
+        for (i = 1; h->segment[i].state == CCNR_SEG_ABSENT; i++)
+            continue;
+        if (r_store_open_input(h, i, 0) < 0)
+            r_init_fail(h, __LINE__, "repository data", errno);
+        reset = 1;
         ccn_charbuf_destroy(&path);
         if (CCNSHOULDLOG(h, dfds, CCNL_INFO))
             ccn_schedule_event(h->sched, 50000, r_store_reindexing, NULL, 0);
@@ -554,22 +2051,59 @@ r_store_init(struct ccnr_handle *h)
         if (res < 0)
             r_init_fail(h, __LINE__, "index is corrupt", res);
     }
+Limits:
     btree->full = r_init_confval(h, "CCNR_BTREE_MAX_FANOUT", 4, 9999, 1999);
     btree->full0 = r_init_confval(h, "CCNR_BTREE_MAX_LEAF_ENTRIES", 4, 9999, 1999);
     btree->nodebytes = r_init_confval(h, "CCNR_BTREE_MAX_NODE_BYTES", 1024, 8388608, 2097152);
-    btree->nodepool = r_init_confval(h, "CCNR_BTREE_NODE_POOL", 16, 2000000, 512);
+    btree->nodepool = r_init_confval(h, "CCNR_BTREE_NODE_POOL", 16, 2000000,
+                                     h->compact ? CCNR_COMPACT_BTREE_NODE_POOL : 512);
+    btree->cachelimit = r_init_confval(h, "CCNR_BTREE_CACHE_BYTES", 0, 68719476736,
+                                       h->compact ? CCNR_COMPACT_BTREE_CACHE_BYTES : 0);
+    h->compact_idle_usec = r_init_confval(h, "CCNR_BTREE_COMPACT_IDLE", 0, 3600, 10) * 1000000;
+    if (reset && h->active_in_fd >= 0 && h->running != -1)
+        r_store_bulk_reindex(h);
+    r_store_fetch_init(h);
     if (h->running != -1)
         r_store_index_needs_cleaning(h);
+    if (h->replica)
+        return;
+    if (h->running != -1 && h->compact_idle_usec != 0)
+        h->index_compactor = ccn_schedule_event(h->sched, h->compact_idle_usec,
+                                                r_store_index_compactor, NULL, 0);
+    if (h->running != -1)
+        h->segment_cleaner = ccn_schedule_event(h->sched, CCNR_SEGCLEAN_STEP_MICROS,
+                                                r_store_segment_cleaner, NULL, 0);
 }
 
 PUBLIC int
 r_store_final(struct ccnr_handle *h, int stable) {
     int res;
+    unsigned i;
     
+    r_store_fetch_final(h);
+    r_store_cob_cache_final(h);
+    r_store_unmap_repofile(h, 1);
+    if (h->log_buf != NULL && h->log_buf->length != 0) {
+        ccnr_msg(h, "r_store_final.%d - %ju bytes not committed", __LINE__,
+                 (uintmax_t)h->log_buf->length);
+        stable = 0;
+    }
+    ccn_charbuf_destroy(&h->log_buf);
+    if (stable && h->btree != NULL && h->btree->io != NULL &&
+        h->btree->io->btcommit != NULL)
+        ccn_btree_commit(h->btree, h->stable);
     res = ccn_btree_destroy(&h->btree);
     if (res < 0)
         ccnr_msg(h, "r_store_final.%d-%d Errors while closing index", __LINE__, res);
-    if (res >= 0 && stable)
+    free(h->segment);
+    h->segment = NULL;
+    h->n_segment = 0;
+    for (i = 0; i < h->n_data_dir; i++)
+        free(h->data_dir[i]);
+    free(h->data_dir);
+    h->data_dir = NULL;
+    h->n_data_dir = 0;
+    if (res >= 0 && stable && !h->replica)
         res = r_store_write_stable_point(h);
     return(res);
 }
@@ -579,18 +2113,18 @@ r_store_content_from_accession(struct ccnr_handle *h, ccnr_accession accession)
 {
     struct ccn_parsed_ContentObject obj = {0};
     struct content_entry *content = NULL;
-    struct content_by_accession_entry *entry;
     const unsigned char *content_base = NULL;
     int res;
     ccnr_accession acc;
     
     if (accession == CCNR_NULL_ACCESSION)
         return(NULL);
-    entry = hashtb_lookup(h->content_by_accession_tab,
-                          &accession, sizeof(accession));
-    if (entry != NULL) {
+    content = r_store_acc_lookup(h, accession);
+    if (content != NULL) {
         h->content_from_accession_hits++;
-        return(entry->content);
+        if (content->cookie == 0)
+            r_store_enroll_content(h, content);
+        return(content);
     }
     h->content_from_accession_misses++;
     content = calloc(1, sizeof(*content));
@@ -628,9 +2162,30 @@ r_store_content_from_cookie(struct ccnr_handle *h, ccnr_cookie cookie)
     return(ans);
 }
 
+/**
+ * Make room in the cookie table.
+ *
+ * Content that has its cob in the cob cache keeps its handle, without
+ * a cookie, so that the cache rather than the order of arrival decides
+ * how long the cob stays.  It gets a new cookie when it is looked up
+ * by accession again.
+ */
+static void
+r_store_release_cookie_slot(struct ccnr_handle *h, unsigned i)
+{
+    struct content_entry *content = h->content_by_cookie[i];
+    
+    if (content != NULL && content->cob_next != NULL) {
+        h->content_by_cookie[i] = NULL;
+        content->cookie = 0;
+        return;
+    }
+    r_store_forget_content(h, &(h->content_by_cookie[i]));
+}
+
 /**
  * This makes a cookie for content, and, if it has an accession number already,
- * enters it into the content_by_accession_tab.  Does not index by name.
+ * enters it into the accession map.  Does not index by name.
  */
 PUBLIC ccnr_cookie
 r_store_enroll_content(struct ccnr_handle *h, struct content_entry *content)
@@ -643,20 +2198,11 @@ r_store_enroll_content(struct ccnr_handle *h, struct content_entry *content)
     if (cookie == 0)
         cookie = ++(h->cookie); /* Cookie numbers may wrap */
     // XXX - check for persistence here, if we add that
-    r_store_forget_content(h, &(h->content_by_cookie[cookie & mask]));
+    r_store_release_cookie_slot(h, cookie & mask);
     content->cookie = cookie;
     h->content_by_cookie[cookie & mask] = content;
     if (content->accession != CCNR_NULL_ACCESSION) {
-        struct hashtb_enumerator ee;
-        struct hashtb_enumerator *e = &ee;
-        ccnr_accession accession = content->accession;
-        struct content_by_accession_entry *entry = NULL;
-        hashtb_start(h->content_by_accession_tab, e);
-        hashtb_seek(e, &accession, sizeof(accession), 0);
-        entry = e->data;
-        if (entry != NULL)
-            entry->content = content;
-        hashtb_end(e);
+        r_store_acc_insert(h, content);
         content->flags |= CCN_CONTENT_ENTRY_STABLE;
     }
     return(cookie);
@@ -696,6 +2242,10 @@ r_store_content_btree_insert(struct ccnr_handle *h,
         content_base = r_store_content_base(h, content);
         if (content_base == NULL)
             return(-1);
+        /* New content, so the index entry needs the SignedInfo */
+        res = ccn_parse_ContentObject_finish(content_base, content->size, pco);
+        if (res < 0)
+            return(-1);
         res = ccn_btree_prepare_for_update(h->btree, leaf);
         if (res < 0)
             return(-1);
@@ -746,94 +2296,102 @@ r_store_forget_content(struct ccnr_handle *h, struct content_entry **pentry)
     entry->cookie = 0;
     /* Remove the accession reference */
     if (entry->accession != CCNR_NULL_ACCESSION) {
-        struct hashtb_enumerator ee;
-        struct hashtb_enumerator *e = &ee;
-        hashtb_start(h->content_by_accession_tab, e);
-        if (hashtb_seek(e, &entry->accession, sizeof(entry->accession), 0) ==
-            HT_NEW_ENTRY) {
+        if (r_store_acc_remove(h, entry->accession) == NULL) {
             ccnr_msg(h, "orphaned content %llu",
                      (unsigned long long)(entry->accession));
-            hashtb_delete(e);
-            hashtb_end(e);
             return;
         }
-        hashtb_delete(e);
-        hashtb_end(e);
         entry->accession = CCNR_NULL_ACCESSION;
     }
     /* Clean up allocated subfields */
     ccn_charbuf_destroy(&entry->flatname);
-    if (entry->cob != NULL) {
-        h->cob_count--;
-        ccn_charbuf_destroy(&entry->cob);
-    }
+    r_store_cob_detach(h, entry);
+    ccn_charbuf_destroy(&entry->cob);
     free(entry);
 }
 
 /**
- *  Get a handle on the content object that matches key, or if there is
- * no match, the one that would come just after it.
- *
- * The key is in flatname format.
+ *  Get a handle on the content object at the given entry of a leaf.
  */
-static struct content_entry *    
-r_store_look(struct ccnr_handle *h, const unsigned char *key, size_t size)
+static struct content_entry *
+r_store_content_at(struct ccnr_handle *h, struct ccn_btree_node *leaf, int ndx)
 {
     struct content_entry *content = NULL;
-    struct ccn_btree_node *leaf = NULL;
     ccnr_accession accession;
-    int ndx;
     int res;
 
-    res = ccn_btree_lookup(h->btree, key, size, &leaf);
-    if (res >= 0) {
-        ndx = CCN_BT_SRCH_INDEX(res);
-        if (ndx == ccn_btree_node_nent(leaf)) {
-            res = ccn_btree_next_leaf(h->btree, leaf, &leaf);
-            if (res <= 0)
-                return(NULL);
-            ndx = 0;
-        }
-        accession = ccnr_accession_decode(h, ccn_btree_content_cobid(leaf, ndx));
-        if (accession != CCNR_NULL_ACCESSION) {
-            struct content_by_accession_entry *entry;
-            entry = hashtb_lookup(h->content_by_accession_tab,
-                                    &accession, sizeof(accession));
-            if (entry != NULL)
-                content = entry->content;
-            if (content == NULL) {
-                /* Construct handle without actually reading the cob */
-                res = ccn_btree_content_cobsz(leaf, ndx);
-                content = calloc(1, sizeof(*content));
-                if (res > 0 && content != NULL) {
-                    content->accession = accession;
-                    content->cob = NULL;
-                    content->size = res;
-                    content->flatname = ccn_charbuf_create();
-                    CHKPTR(content->flatname);
-                    res = ccn_btree_key_fetch(content->flatname, leaf, ndx);
-                    CHKRES(res);
-                    r_store_enroll_content(h, content);
-                }
+    accession = ccnr_accession_decode(h, ccn_btree_content_cobid(leaf, ndx));
+    if (accession != CCNR_NULL_ACCESSION) {
+        content = r_store_acc_lookup(h, accession);
+        if (content != NULL && content->cookie == 0)
+            r_store_enroll_content(h, content);
+        if (content == NULL) {
+            /* Construct handle without actually reading the cob */
+            res = ccn_btree_content_cobsz(leaf, ndx);
+            content = calloc(1, sizeof(*content));
+            if (res > 0 && content != NULL) {
+                content->accession = accession;
+                content->cob = NULL;
+                content->size = res;
+                content->flatname = ccn_charbuf_create();
+                CHKPTR(content->flatname);
+                res = ccn_btree_key_fetch(content->flatname, leaf, ndx);
+                CHKRES(res);
+                r_store_enroll_content(h, content);
             }
         }
     }
     return(content);
 }
 
+/**
+ *  Get a handle on the content object that matches key, or if there is
+ * no match, the one that would come just after it.
+ *
+ * The key is in flatname format.
+ */
+static struct content_entry *    
+r_store_look(struct ccnr_handle *h, const unsigned char *key, size_t size)
+{
+    struct ccn_btree_cursor cursor = {0};
+
+    return(r_store_seek_content(h, &cursor, key, size));
+}
+
+/**
+ * Like r_store_look, but positions the caller's cursor, so that
+ * a following r_store_next_child_at_level can usually stay in the leaf.
+ */
 PUBLIC struct content_entry *
-r_store_find_first_match_candidate(struct ccnr_handle *h,
-                                   const unsigned char *interest_msg,
-                                   const struct ccn_parsed_interest *pi)
+r_store_seek_content(struct ccnr_handle *h, struct ccn_btree_cursor *cursor,
+                     const unsigned char *key, size_t size)
+{
+    int res;
+
+    res = ccn_btree_cursor_seek(cursor, h->btree, key, size);
+    if (res < 0 || cursor->leaf == NULL)
+        return(NULL);
+    return(r_store_content_at(h, cursor->leaf, cursor->index));
+}
+
+/**
+ * Compute the flatname key at which to start looking for matches
+ * to an interest.
+ *
+ * This is usually just the name, but an Exclude that starts with
+ * <Any/><Component>... lets us skip ahead.
+ */
+static void
+r_store_first_candidate_key(struct ccnr_handle *h,
+                            struct ccn_charbuf *flatname,
+                            const unsigned char *interest_msg,
+                            const struct ccn_parsed_interest *pi)
 {
     int res;
     size_t start = pi->offset[CCN_PI_B_Name];
     size_t end = pi->offset[CCN_PI_E_Name];
     struct ccn_charbuf *namebuf = NULL;
-    struct ccn_charbuf *flatname = NULL;
-    struct content_entry *content = NULL;
     
-    flatname = ccn_charbuf_create();
     ccn_flatname_from_ccnb(flatname, interest_msg, pi->offset[CCN_PI_E]);
     if (pi->offset[CCN_PI_B_Exclude] < pi->offset[CCN_PI_E_Exclude]) {
         /* Check for <Exclude><Any/><Component>... fast case */
@@ -877,8 +2435,20 @@ r_store_find_first_match_candidate(struct ccnr_handle *h,
             }
         }
     }
-    content = r_store_look(h, flatname->buf, flatname->length);
     ccn_charbuf_destroy(&namebuf);
+}
+
+PUBLIC struct content_entry *
+r_store_find_first_match_candidate(struct ccnr_handle *h,
+                                   const unsigned char *interest_msg,
+                                   const struct ccn_parsed_interest *pi)
+{
+    struct ccn_charbuf *flatname = NULL;
+    struct content_entry *content = NULL;
+    
+    flatname = ccn_charbuf_create();
+    r_store_first_candidate_key(h, flatname, interest_msg, pi);
+    content = r_store_look(h, flatname->buf, flatname->length);
     ccn_charbuf_destroy(&flatname);
     return(content);
 }
@@ -911,47 +2481,86 @@ r_store_content_next(struct ccnr_handle *h, struct content_entry *content)
     return(content);
 }
 
-PUBLIC struct content_entry *
-r_store_next_child_at_level(struct ccnr_handle *h,
-                    struct content_entry *content, int level)
+/**
+ * Make the flatname key that comes after all the names that share
+ * their first level + 1 components with the given flatname, or if
+ * it has only level components, the key for its first child.
+ *
+ * @returns 0 for success, -1 if there are too few components.
+ */
+static int
+r_store_child_successor(struct ccnr_handle *h, struct ccn_charbuf *dst,
+                        const unsigned char *flatname, size_t size, int level)
 {
-    struct content_entry *next = NULL;
     struct ccn_charbuf *name;
-    struct ccn_charbuf *flatname = NULL;
     int res;
     
-    if (content == NULL)
-        return(NULL);
     name = ccn_charbuf_create();
     ccn_name_init(name);
-    res = ccn_name_append_flatname(name,
-                                   content->flatname->buf,
-                                   content->flatname->length, 0, level + 1);
+    res = ccn_name_append_flatname(name, flatname, size, 0, level + 1);
     if (res < level)
-        goto Bail;
-    if (res == level)
+        res = -1;
+    else if (res == level)
         res = ccn_name_append(name, NULL, 0);
     else if (res == level + 1)
         res = ccn_name_next_sibling(name); // XXX - would be nice to have a flatname version of this
+    if (res >= 0) {
+        if (CCNSHOULDLOG(h, LM_8, CCNL_FINER))
+            ccnr_debug_ccnb(h, __LINE__, "child_successor", NULL,
+                            name->buf, name->length);
+        ccn_flatname_from_ccnb(dst, name->buf, name->length);
+        res = 0;
+    }
+    ccn_charbuf_destroy(&name);
+    return(res);
+}
+
+/**
+ * Find the first content that comes after all the content that has
+ * the same first level + 1 components as the given content.
+ *
+ * The cursor should be zeroed before the first call; when the
+ * calls are made without intervening changes to the store, it
+ * usually saves a descent of the btree.
+ */
+PUBLIC struct content_entry *
+r_store_next_child_at_level(struct ccnr_handle *h,
+                            struct ccn_btree_cursor *cursor,
+                            struct content_entry *content, int level)
+{
+    struct content_entry *next = NULL;
+    struct ccn_charbuf *flatname = NULL;
+    int res;
+    
+    if (content == NULL)
+        return(NULL);
+    flatname = ccn_charbuf_create();
+    res = r_store_child_successor(h, flatname, content->flatname->buf,
+                                  content->flatname->length, level);
     if (res < 0)
         goto Bail;
-    if (CCNSHOULDLOG(h, LM_8, CCNL_FINER))
-        ccnr_debug_ccnb(h, __LINE__, "child_successor", NULL,
-                        name->buf, name->length);
-    flatname = ccn_charbuf_create();
-    ccn_flatname_from_ccnb(flatname, name->buf, name->length);
-    next = r_store_look(h, flatname->buf, flatname->length);
+    res = ccn_btree_cursor_seek(cursor, h->btree,
+                                flatname->buf, flatname->length);
+    if (res < 0 || cursor->leaf == NULL)
+        goto Bail;
+    next = r_store_content_at(h, cursor->leaf, cursor->index);
     if (next == content) {
         // XXX - I think this case should not occur, but just in case, avoid a loop.
         ccnr_debug_content(h, __LINE__, "urp", NULL, next);
         next = NULL;
     }
 Bail:
-    ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&flatname);
     return(next);
 }
 
+/**
+ * Find the content that best matches an interest.
+ *
+ * The candidates are visited in name order with a btree cursor, so
+ * stepping past an entry that does not match stays within the leaf.
+ * Content handles are only made for entries that match.
+ */
 PUBLIC struct content_entry *
 r_store_lookup(struct ccnr_handle *h,
                const unsigned char *msg,
@@ -959,63 +2568,90 @@ r_store_lookup(struct ccnr_handle *h,
                struct ccn_indexbuf *comps)
 {
     struct content_entry *content = NULL;
+    struct ccn_btree_cursor cursor = {0};
+    struct ccn_btree_cursor *c = &cursor;
     struct ccn_btree_node *leaf = NULL;
     ccnr_cookie last_match = 0;
     ccnr_accession last_match_acc = CCNR_NULL_ACCESSION;
+    struct ccn_charbuf *prefix = NULL;
+    struct ccn_charbuf *flatname = NULL;
     struct ccn_charbuf *scratch = NULL;
+    struct ccn_compiled_exclude *ce = NULL;
     size_t size = pi->offset[CCN_PI_E];
     int ndx;
     int res;
-    int try;
-    
-    content = r_store_find_first_match_candidate(h, msg, pi);
-    if (content != NULL && CCNSHOULDLOG(h, LM_8, CCNL_FINER))
-        ccnr_debug_content(h, __LINE__, "first_candidate", NULL,
-                           content);
-    if (content != NULL &&
-        !r_store_content_matches_interest_prefix(h, content, msg, size)) {
-            if (CCNSHOULDLOG(h, LM_8, CCNL_FINER))
-                ccnr_debug_ccnb(h, __LINE__, "prefix_mismatch", NULL,
-                                msg, size);
+    int try;
+    
+    /* Every candidate is checked against the Exclude, so compile it once */
+    if (pi->offset[CCN_PI_E_Exclude] > pi->offset[CCN_PI_B_Exclude])
+        ce = ccn_compile_exclude(msg + pi->offset[CCN_PI_B_Exclude],
+                                 pi->offset[CCN_PI_E_Exclude] -
+                                 pi->offset[CCN_PI_B_Exclude]);
+    prefix = r_util_charbuf_obtain(h);
+    ccn_flatname_from_ccnb(prefix, msg, size);
+    flatname = r_util_charbuf_obtain(h);
+    r_store_first_candidate_key(h, flatname, msg, pi);
+    res = ccn_btree_cursor_seek(c, h->btree, flatname->buf, flatname->length);
+    scratch = r_util_charbuf_obtain(h);
+    for (try = 0; res >= 0 && c->leaf != NULL; try++) {
+        if (try == 0 && CCNSHOULDLOG(h, LM_8, CCNL_FINER)) {
+            content = r_store_content_at(h, c->leaf, c->index);
+            if (content != NULL)
+                ccnr_debug_content(h, __LINE__, "first_candidate", NULL,
+                                   content);
             content = NULL;
         }
-    scratch = ccn_charbuf_create();
-    for (try = 0; content != NULL; try++) {
-        res = ccn_btree_lookup(h->btree,
-                               content->flatname->buf,
-                               content->flatname->length,
-                               &leaf);
-        if (CCN_BT_SRCH_FOUND(res) == 0) {
-            ccnr_debug_content(h, __LINE__, "impossible", NULL, content);
-            content = NULL;
+        res = ccn_btree_compare(prefix->buf, prefix->length,
+                                c->leaf, c->index);
+        if (res != 0 && res != -9999) {
+            if (try == 0 && CCNSHOULDLOG(h, LM_8, CCNL_FINER))
+                ccnr_debug_ccnb(h, __LINE__, "prefix_mismatch", NULL,
+                                msg, size);
             break;
         }
-        ndx = CCN_BT_SRCH_INDEX(res);
-        res = ccn_btree_match_interest(leaf, ndx, msg, pi, scratch);
+        res = ccn_btree_match_interest_excl(c->leaf, c->index, msg, pi,
+                                            ce, scratch);
         if (res == -1) {
             ccnr_debug_ccnb(h, __LINE__, "match_error", NULL, msg, size);
-            content = NULL;
             break;
         }
-        if (res == 1) {
-            if ((pi->orderpref & 1) == 0) // XXX - should be symbolic
-                break;
-            last_match = content->cookie;
-            last_match_acc = content->accession;
-            content = r_store_next_child_at_level(h, content, comps->n - 1);
+        if (res == 0) {
+            res = ccn_btree_cursor_next(c);
+            continue;
+        }
+        content = r_store_content_at(h, c->leaf, c->index);
+        if (content == NULL || (pi->orderpref & 1) == 0) // XXX - should be symbolic
+            break;
+        last_match = content->cookie;
+        last_match_acc = content->accession;
+        content = NULL;
+        /* Skip the rest of this child, looking for a later match */
+        leaf = c->leaf;
+        ndx = c->index;
+        res = ccn_btree_key_fetch(scratch, leaf, ndx);
+        if (res < 0)
+            break;
+        res = r_store_child_successor(h, flatname, scratch->buf,
+                                      scratch->length, comps->n - 1);
+        if (res < 0)
+            break;
+        res = ccn_btree_cursor_seek(c, h->btree,
+                                    flatname->buf, flatname->length);
+        if (c->leaf == leaf && c->index == ndx) {
+            // XXX - should not occur, but just in case, avoid a loop.
+            ccnr_debug_ccnb(h, __LINE__, "urp", NULL, msg, size);
+            break;
         }
-        else
-            content = r_store_content_next(h, content);
-        if (content != NULL &&
-            !r_store_content_matches_interest_prefix(h, content, msg, size))
-                content = NULL;
     }
     if (last_match != 0) {
         content = r_store_content_from_cookie(h, last_match);
         if (content == NULL)
             content = r_store_content_from_accession(h, last_match_acc);
     }
-    ccn_charbuf_destroy(&scratch);
+    r_util_charbuf_release(h, prefix);
+    r_util_charbuf_release(h, flatname);
+    r_util_charbuf_release(h, scratch);
+    ccn_compiled_exclude_destroy(&ce);
     return(content);
 }
 
@@ -1127,7 +2763,10 @@ r_store_set_content_timer(struct ccnr_handle *h, struct content_entry *content,
 }
 
 /**
- * Parses content object and sets content->flatname
+ * Parses the framing and name of a content object and sets content->flatname
+ *
+ * The Signature and SignedInfo are left for ccn_parse_ContentObject_finish,
+ * so that a duplicate is recognized without parsing them.
  */
 static int
 r_store_set_flatname(struct ccnr_handle *h, struct content_entry *content,
@@ -1145,7 +2784,7 @@ r_store_set_flatname(struct ccnr_handle *h, struct content_entry *content,
     flatname = ccn_charbuf_create();
     if (flatname == NULL)
         goto Bail;    
-    res = ccn_parse_ContentObject(msg, size, pco, NULL);
+    res = ccn_parse_ContentObject_name(msg, size, pco, NULL);
     if (res < 0) {
         ccnr_msg(h, "error parsing ContentObject - code %d", res);
         goto Bail;
@@ -1185,6 +2824,8 @@ process_incoming_content(struct ccnr_handle *h, struct fdholder *fdholder,
     struct content_entry *content = NULL;
     ccnr_accession accession = CCNR_NULL_ACCESSION;
     
+    if (h->replica)
+        return(NULL); /* the index belongs to the writer */
     content = calloc(1, sizeof(*content));
     if (content == NULL)
         goto Bail;    
@@ -1214,6 +2855,11 @@ process_incoming_content(struct ccnr_handle *h, struct fdholder *fdholder,
         if (content == NULL)
             goto Bail;
     }
+    else
+        r_proto_note_content_added(h, content);
+    res = ccn_parse_ContentObject_finish(msg, size, &obj);
+    if (res < 0)
+        return(content);
     r_store_set_content_timer(h, content, &obj);
     r_match_match_interests(h, content, &obj, NULL, fdholder);
     return(content);
@@ -1235,7 +2881,7 @@ r_store_content_field_access(struct ccnr_handle *h,
     content_msg = r_store_content_base(h, content);
     if (content_msg == NULL)
         return(-1);
-    res = ccn_parse_ContentObject(content_msg, content->size, &pco, NULL);
+    res = ccn_parse_ContentObject_name(content_msg, content->size, &pco, NULL);
     if (res < 0)
         return(-1);
     if (dtag == CCN_DTAG_Content)
@@ -1248,6 +2894,12 @@ r_store_content_field_access(struct ccnr_handle *h,
 
 const ccnr_accession r_store_mark_repoFile1 = ((ccnr_accession)1) << 48;
 
+/**
+ * Give content the accession for where it is in the repository data.
+ *
+ * The offset is within the file of fdholder, which is either the
+ * segment being indexed or the one being appended to.
+ */
 PUBLIC int
 r_store_set_accession_from_offset(struct ccnr_handle *h,
                                   struct content_entry *content,
@@ -1255,25 +2907,19 @@ r_store_set_accession_from_offset(struct ccnr_handle *h,
 {
     struct ccn_btree_node *leaf = NULL;
     uint_least64_t cobid;
+    unsigned segment;
     int ndx;
     int res = -1;
     
     if (offset != (off_t)-1 && content->accession == CCNR_NULL_ACCESSION) {
-        struct hashtb_enumerator ee;
-        struct hashtb_enumerator *e = &ee;
-        struct content_by_accession_entry *entry = NULL;
-        
+        segment = h->out_segment;
+        if (fdholder != NULL && fdholder->filedesc == h->active_in_fd)
+            segment = h->in_segment;
         content->flags |= CCN_CONTENT_ENTRY_STABLE;
-        content->accession = ((ccnr_accession)offset) | r_store_mark_repoFile1;
-        hashtb_start(h->content_by_accession_tab, e);
-        hashtb_seek(e, &content->accession, sizeof(content->accession), 0);
-        entry = e->data;
-        if (entry != NULL) {
-            entry->content = content;
-            if (content->cob != NULL)
-                h->cob_count++;
-        }
-        hashtb_end(e);
+        content->accession = ((ccnr_accession)r_store_position(h, segment, offset)) +
+                             r_store_mark_repoFile1;
+        r_store_acc_insert(h, content);
+        r_store_cob_admit(h, content);
         if (content->flatname != NULL) {
             res = ccn_btree_lookup(h->btree,
                                    content->flatname->buf,
@@ -1293,6 +2939,228 @@ r_store_set_accession_from_offset(struct ccnr_handle *h,
     return(res);
 }
 
+/**
+ * Write out the appends to the repository data that are waiting in the
+ * commit buffer.
+ *
+ * If CCNR_COMMIT_SYNC is set, the file is also synced, so that
+ * everything accessioned so far survives a crash.
+ * @returns 0 for success, -1 for error (what was not written is kept
+ *          for the next try).
+ */
+PUBLIC int
+r_store_log_flush(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *b = h->log_buf;
+    size_t done = 0;
+    ssize_t res = 0;
+    int fd = h->active_out_fd;
+    
+    if (b == NULL || b->length == 0)
+        return(0);
+    if (fd == -1)
+        return(-1);
+    while (done < b->length) {
+        res = write(fd, b->buf + done, b->length - done);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        done += res;
+    }
+    if (done < b->length)
+        ccnr_msg(h, "write %d: %s - %ju bytes not committed", fd,
+                 (res < 0) ? strerror(errno) : "short write",
+                 (uintmax_t)(b->length - done));
+    h->log_written += done;
+    if (done > 0 && done < b->length)
+        memmove(b->buf, b->buf + done, b->length - done);
+    b->length -= done;
+    if (h->log_sync && done > 0 && fsync(fd) != 0) {
+        ccnr_msg(h, "fsync %d: %s", fd, strerror(errno));
+        return(-1);
+    }
+    if (CCNSHOULDLOG(h, sdfgsd, CCNL_FINEST))
+        ccnr_msg(h, "committed %ju bytes, segment %u now %ju",
+                 (uintmax_t)done, h->out_segment, (uintmax_t)h->log_written);
+    return(b->length == 0 ? 0 : -1);
+}
+
+/** Delay after new content is stored before the index is brought up to date */
+#define CCNR_CHECKPOINT_MICROS 2000000
+static int
+r_store_checkpointer(struct ccn_schedule *sched,
+                     void *clienth,
+                     struct ccn_scheduled_event *ev,
+                     int flags)
+{
+    struct ccnr_handle *h = clienth;
+    
+    (void)(sched);
+    (void)(ev);
+    h->checkpointer = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || h->btree == NULL)
+        return(0);
+    /* Nodes that stayed open will not have asked for cleaning */
+    h->btree->cleanreq++;
+    r_store_index_needs_cleaning(h);
+    return(0);
+}
+
+static int
+r_store_log_committer(struct ccn_schedule *sched,
+                      void *clienth,
+                      struct ccn_scheduled_event *ev,
+                      int flags)
+{
+    struct ccnr_handle *h = clienth;
+    
+    (void)(sched);
+    (void)(ev);
+    h->log_committer = NULL;
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        return(0);
+    r_store_log_flush(h);
+    return(0);
+}
+
+/**
+ * Keep track of what has been appended to the segment being written.
+ */
+static void
+r_store_note_append(struct ccnr_handle *h, off_t offset, size_t size)
+{
+    off_t pos;
+    
+    pos = r_store_position(h, h->out_segment, offset);
+    if (h->log_buf == NULL) {
+        if (pos != h->stable && h->stable != 0)
+            ccnr_msg(h, "expected file size %ju, found %ju",
+                     (uintmax_t)h->stable, (uintmax_t)pos);
+        h->log_written = offset + size;
+    }
+    h->segment[h->out_segment].size = offset + size;
+    h->stable = pos + size;
+}
+
+/**
+ * Begin a new segment if appending size bytes would take the one being
+ * written past CCNR_SEGMENT_BYTES.
+ *
+ * What is waiting in the commit buffer belongs to the old segment, so
+ * it is written out first; if that cannot be done, the old segment
+ * carries on for now.
+ */
+static void
+r_store_segment_reserve(struct ccnr_handle *h, size_t size)
+{
+    struct ccnr_segment *seg = NULL;
+    unsigned next = h->out_segment + 1;
+    off_t used;
+    int fd;
+    
+    if (h->active_out_fd == -1)
+        return;
+    used = h->log_written + (h->log_buf == NULL ? 0 : h->log_buf->length);
+    if (used == 0 || used + (off_t)size <= h->segment_bytes)
+        return;
+    if (next > CCNR_MAX_SEGMENT || r_store_log_flush(h) < 0)
+        return;
+    seg = r_store_segment(h, next);
+    if (seg == NULL)
+        return;
+    seg->state = CCNR_SEG_ACTIVE;
+    seg->dir = r_store_place_segment(h);
+    fd = r_io_open_repo_segment(h, next, 1);
+    if (fd == -1) {
+        ccnr_msg(h, "cannot begin segment %u: %s", next, strerror(errno));
+        seg->state = CCNR_SEG_ABSENT;
+        return;
+    }
+    h->segment[h->out_segment].state = CCNR_SEG_SEALED;
+    h->segment[h->out_segment].size = h->log_written;
+    r_io_shutdown_client_fd(h, h->active_out_fd);
+    h->active_out_fd = fd;
+    h->out_segment = next;
+    h->log_written = 0;
+    if (CCNSHOULDLOG(h, sdfsdf, CCNL_INFO))
+        ccnr_msg(h, "begun segment %u in %s", next, h->data_dir[seg->dir]);
+}
+
+/**
+ * Append a content object to the segment being written, by way of the
+ * commit buffer.
+ *
+ * The append is written along with whatever else arrives within
+ * CCNR_COMMIT_USEC, or sooner if CCNR_COMMIT_BYTES are waiting.
+ * @returns the offset of the object in the segment.
+ */
+static off_t
+r_store_log_append(struct ccnr_handle *h, const unsigned char *data, size_t size)
+{
+    off_t offset;
+    
+    offset = h->log_written + h->log_buf->length;
+    if (ccn_charbuf_append(h->log_buf, data, size) < 0)
+        return((off_t)-1);
+    r_store_note_append(h, offset, size);
+    if (h->log_buf->length >= h->log_commit_bytes)
+        r_store_log_flush(h);
+    else if (h->log_committer == NULL)
+        h->log_committer = ccn_schedule_event(h->sched, h->log_commit_usec,
+                                              r_store_log_committer, NULL, 0);
+    return(offset);
+}
+
+/**
+ * Set up group commit of the appends to the repository data.
+ *
+ * CCNR_COMMIT_USEC of 0 means each object is written as it arrives.
+ */
+static void
+r_store_log_init(struct ccnr_handle *h, off_t size)
+{
+    h->log_written = size;
+    h->log_commit_usec = r_init_confval(h, "CCNR_COMMIT_USEC", 0, 1000000, 5000);
+    h->log_commit_bytes = r_init_confval(h, "CCNR_COMMIT_BYTES", 4096, 16777216, 1048576);
+    h->log_sync = r_init_confval(h, "CCNR_COMMIT_SYNC", 0, 1, 0);
+    if (h->log_commit_usec == 0 || size == (off_t)-1)
+        return;
+    h->log_buf = ccn_charbuf_create();
+    CHKPTR(h->log_buf);
+}
+
+/**
+ * Send content that lives in a segment straight from the file, if it
+ * is not already in memory and the fdholder is not a datagram face.
+ *
+ * The mapped copy stands in for the bytes that will not fit in the
+ * socket, and for datagram faces is sent as it is.
+ * @returns 1 if sent, 0 if the caller should send it as usual.
+ */
+static int
+r_store_send_from_file(struct ccnr_handle *h, struct fdholder *fdholder,
+                       struct content_entry *content,
+                       const unsigned char *content_msg)
+{
+    int fd;
+    
+    if (!h->send_from_file || content_msg == NULL || content->cob != NULL ||
+        fdholder == NULL || content->accession == CCNR_NULL_ACCESSION)
+        return(0);
+    if ((fdholder->flags & (CCNR_FACE_DGRAM | CCNR_FACE_REPODATA)) != 0)
+        return(0);
+    if (r_store_content_unwritten(h, content))
+        return(0);
+    fd = r_io_repo_data_file_fd(h, r_store_repofile_from_accession(h, content->accession), 0);
+    if (fd == -1)
+        return(0);
+    if (r_io_send_file(h, fdholder, content_msg, content->size, fd,
+                       r_store_offset_from_accession(h, content->accession)))
+        h->content_sent_from_file++;
+    return(1);
+}
+
 PUBLIC void
 r_store_send_content(struct ccnr_handle *h, struct fdholder *fdholder, struct content_entry *content)
 {
@@ -1302,7 +3170,11 @@ r_store_send_content(struct ccnr_handle *h, struct fdholder *fdholder, struct co
     if (CCNSHOULDLOG(h, LM_4, CCNL_FINE))
         ccnr_debug_content(h, __LINE__, "content_to", fdholder, content);
     content_msg = r_store_content_base(h, content);
+    if (r_store_send_from_file(h, fdholder, content, content_msg))
+        return;
     r_link_stuff_and_send(h, fdholder, content_msg, content->size, NULL, 0, &offset);
+    if (offset != (off_t)-1 && fdholder->filedesc == h->active_out_fd)
+        r_store_note_append(h, offset, content->size);
     if (offset != (off_t)-1 && content->accession == CCNR_NULL_ACCESSION) {
         int res;
         res = r_store_set_accession_from_offset(h, content, fdholder, offset);
@@ -1318,13 +3190,68 @@ PUBLIC int
 r_store_commit_content(struct ccnr_handle *h, struct content_entry *content)
 {
     // XXX - here we need to check if this is something we *should* be storing, according to our policy
+    struct fdholder *fdholder = NULL;
+    const unsigned char *content_msg = NULL;
+    off_t offset;
+    
     if ((r_store_content_flags(content) & CCN_CONTENT_ENTRY_STABLE) == 0) {
-        r_store_send_content(h, r_io_fdholder_from_fd(h, h->active_out_fd), content);
+        if (content->accession == CCNR_NULL_ACCESSION)
+            r_store_segment_reserve(h, content->size);
+        fdholder = r_io_fdholder_from_fd(h, h->active_out_fd);
+        if (h->log_buf == NULL || fdholder == NULL)
+            r_store_send_content(h, fdholder, content);
+        else if (content->accession == CCNR_NULL_ACCESSION) {
+            content_msg = r_store_content_base(h, content);
+            if (content_msg == NULL)
+                return(-1);
+            offset = r_store_log_append(h, content_msg, content->size);
+            ccnr_meter_bump(h, fdholder->meter[FM_BYTO], content->size);
+            if (offset != (off_t)-1)
+                r_store_set_accession_from_offset(h, content, fdholder, offset);
+        }
         r_store_content_change_flags(content, CCN_CONTENT_ENTRY_STABLE, 0);
+        if (h->checkpointer == NULL)
+            h->checkpointer = ccn_schedule_event(h->sched, CCNR_CHECKPOINT_MICROS,
+                                                 r_store_checkpointer, NULL, 0);
     }
     return(0);
 }
 
+/**
+ * Append a content object to the repository data without indexing it
+ *
+ * This is for a caller that indexes what it appends some other way,
+ * as a bulk load does (see ccnr_bulk.c).
+ * @returns the position of the object, or -1 for error.
+ */
+PUBLIC off_t
+r_store_append_unindexed(struct ccnr_handle *h,
+                         const unsigned char *msg, size_t size)
+{
+    struct fdholder *fdholder = NULL;
+    off_t offset = (off_t)-1;
+    
+    r_store_segment_reserve(h, size);
+    fdholder = r_io_fdholder_from_fd(h, h->active_out_fd);
+    if (fdholder == NULL)
+        return((off_t)-1);
+    if (h->log_buf == NULL) {
+        r_io_send(h, fdholder, msg, size, &offset);
+        if (offset != (off_t)-1)
+            r_store_note_append(h, offset, size);
+    }
+    else {
+        offset = r_store_log_append(h, msg, size);
+        ccnr_meter_bump(h, fdholder->meter[FM_BYTO], size);
+    }
+    if (h->checkpointer == NULL)
+        h->checkpointer = ccn_schedule_event(h->sched, CCNR_CHECKPOINT_MICROS,
+                                             r_store_checkpointer, NULL, 0);
+    if (offset == (off_t)-1)
+        return(offset);
+    return(r_store_position(h, h->out_segment, offset));
+}
+
 PUBLIC void
 ccnr_debug_content(struct ccnr_handle *h,
                    int lineno,
@@ -1358,10 +3285,9 @@ r_store_index_cleaner(struct ccn_schedule *sched,
     int flags)
 {
     struct ccnr_handle *h = clienth;
-    struct hashtb_enumerator ee;
-    struct hashtb_enumerator *e = &ee;
     struct ccn_btree_node *node = NULL;
-    int k;
+    struct ccn_indexbuf *opened = NULL;
+    int i, k;
     int res;
     int overquota;
     
@@ -1373,8 +3299,15 @@ r_store_index_cleaner(struct ccn_schedule *sched,
         ccn_indexbuf_destroy(&h->toclean);
         return(0);
     }
-    /* First, work on cleaning the things we already know need cleaning */
+    /* Drop idle nodes to stay within the cache limits */
+    res = ccn_btree_evict(h->btree);
+    if (res > 0 && CCNSHOULDLOG(h, sdfsdffd, CCNL_FINEST))
+        ccnr_msg(h, "pruned %d index nodes", res);
+    /* Then work on cleaning the things we already know need cleaning */
     if (h->toclean != NULL) {
+        /* Index nodes must not reach disk ahead of the content they name */
+        if (h->toclean->n > 0 && r_store_log_flush(h) < 0)
+            return(nrand48(h->seed) % (2U * CCN_BT_CLEAN_TICK_MICROS) + 500);
         for (k = 0; k < CCN_BT_CLEAN_BATCH && h->toclean->n > 0; k++) {
             node = ccn_btree_rnode(h->btree, h->toclean->buf[--h->toclean->n]);
             if (node != NULL && node->iodata != NULL) {
@@ -1402,23 +3335,14 @@ r_store_index_cleaner(struct ccn_schedule *sched,
         if (h->toclean->n > 0)
             return(nrand48(h->seed) % (2U * CCN_BT_CLEAN_TICK_MICROS) + 500);
     }
-    /* Sweep though and find the nodes that still need cleaning */
-    overquota = 0;
-    if (h->btree->nodepool >= 16)
-        overquota = hashtb_n(h->btree->resident) - h->btree->nodepool;
-    hashtb_start(h->btree->resident, e);
-    for (node = e->data; node != NULL; node = e->data) {
-        if (overquota > 0 &&
-              node->activity == 0 &&
-              node->iodata == NULL &&
-              node->clean == node->buf->length) {
-            overquota -= 1;
-            if (CCNSHOULDLOG(h, sdfsdffd, CCNL_FINEST))
-                ccnr_msg(h, "prune index node %u",
-                         (unsigned)node->nodeid);
-            hashtb_delete(e);
+    /* Look over the nodes opened since last time, keeping those still open */
+    opened = h->btree->opened;
+    for (i = 0, k = 0; opened != NULL && i < opened->n; i++) {
+        node = ccn_btree_rnode(h->btree, opened->buf[i]);
+        if (node == NULL ||
+            (node->iodata == NULL && node->clean == node->buf->length))
             continue;
-        }
+        opened->buf[k++] = node->nodeid;
         node->activity /= 2; /* Age the node's activity */
         if (node->clean != node->buf->length ||
             (node->iodata != NULL && node->activity == 0)) {
@@ -1429,9 +3353,15 @@ r_store_index_cleaner(struct ccn_schedule *sched,
             }
             ccn_indexbuf_append_element(h->toclean, node->nodeid);
         }
-        hashtb_next(e);
     }
-    hashtb_end(e);
+    if (opened != NULL && i == opened->n)
+        opened->n = k;
+    overquota = 0;
+    if (h->btree->nodepool >= 16)
+        overquota = hashtb_n(h->btree->resident) - h->btree->nodepool;
+    if (h->btree->cachelimit != 0 &&
+        h->btree->cachebytes > h->btree->cachelimit && overquota <= 0)
+        overquota = 1;
     /* If nothing to do, shut down cleaner */
     if ((h->toclean == NULL || h->toclean->n == 0) && overquota <= 0 &&
         h->btree->io->openfds <= CCN_BT_OPEN_NODES_IDLE) {
@@ -1440,10 +3370,337 @@ r_store_index_cleaner(struct ccn_schedule *sched,
         ccn_indexbuf_destroy(&h->toclean);
         if (CCNSHOULDLOG(h, sdfsdffd, CCNL_FINE))
             ccnr_msg(h, "index btree nodes all clean");
-        
+        r_store_write_checkpoint(h);
+        return(0);
+    }
+    /* While idle, the next look can wait longer */
+    return(r_util_idle_period(h,
+           nrand48(h->seed) % (2U * CCN_BT_CLEAN_TICK_MICROS) + 500));
+}
+
+/** Delay between steps of an index compaction pass */
+#define CCNR_COMPACT_STEP_MICROS 2000
+/** Delay between index compaction passes */
+#define CCNR_COMPACT_PASS_MICROS 600000000
+/** Merge neighboring index nodes that together are at most this full */
+#define CCNR_COMPACT_FILL 75
+
+/**
+ * Count a leaf, and its ancestors not yet counted, in the fill statistics
+ */
+static void
+r_store_note_fill(struct ccnr_handle *h, struct ccn_btree_node *leaf)
+{
+    struct ccn_btree_node *node = NULL;
+    struct ccnr_index_fill *f = NULL;
+    int level;
+    
+    for (node = leaf; node != NULL; node = ccn_btree_rnode(h->btree, node->parent)) {
+        level = ccn_btree_node_level(node);
+        if (level < 0 || level >= CCNR_FILL_LEVELS)
+            break;
+        f = &h->filling[level];
+        if (f->last == node->nodeid)
+            break;
+        f->last = node->nodeid;
+        f->nodes++;
+        f->entries += ccn_btree_node_nent(node);
+        f->bytes += node->buf->length;
+        if (node->parent == 0)
+            break;
+    }
+}
+
+/**
+ * Merge sparse index nodes, a leaf at a time, while the repo is quiet
+ *
+ * Each step looks at one leaf, trying to merge it (or failing that, one
+ * of its ancestors) with its right-hand neighbor.  A step that merges
+ * stays on the same leaf.  Whenever content arrives or interests are
+ * accepted, the compactor waits until things have been quiet for
+ * compact_idle_usec.  A pass through all the leaves also gathers the
+ * fill statistics for each level.
+ */
+static int
+r_store_index_compactor(struct ccn_schedule *sched,
+                        void *clienth,
+                        struct ccn_scheduled_event *ev,
+                        int flags)
+{
+    struct ccnr_handle *h = clienth;
+    struct ccn_btree_node *leaf = NULL;
+    struct ccn_btree_node *node = NULL;
+    unsigned long activity;
+    int res;
+    
+    (void)(sched);
+    (void)(ev);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || h->btree == NULL) {
+        h->index_compactor = NULL;
+        ccn_charbuf_destroy(&h->compact_key);
+        return(0);
+    }
+    activity = h->cookie + h->interests_accepted;
+    if (activity != h->compact_activity || h->active_in_fd != -1) {
+        h->compact_activity = activity;
+        return(h->compact_idle_usec);
+    }
+    if (h->compact_key == NULL) {
+        h->compact_key = ccn_charbuf_create();
+        if (h->compact_key == NULL)
+            return(h->compact_idle_usec);
+        memset(h->filling, 0, sizeof(h->filling));
+    }
+    res = ccn_btree_lookup(h->btree, h->compact_key->buf,
+                           h->compact_key->length, &leaf);
+    for (node = leaf; res >= 0 && node != NULL && node->parent != 0;
+         node = ccn_btree_rnode(h->btree, node->parent)) {
+        res = ccn_btree_merge(h->btree, node, CCNR_COMPACT_FILL);
+        if (res != 0)
+            break;
+    }
+    if (res > 0) {
+        h->compact_merges++;
+        if (CCNSHOULDLOG(h, sdfsdffd, CCNL_FINER))
+            ccnr_msg(h, "merged index nodes under %u",
+                     (unsigned)node->parent);
+        r_store_index_needs_cleaning(h);
+        return(CCNR_COMPACT_STEP_MICROS);
+    }
+    if (res >= 0) {
+        r_store_note_fill(h, leaf);
+        res = ccn_btree_next_leaf(h->btree, leaf, &leaf);
+        if (res > 0)
+            res = ccn_btree_key_fetch(h->compact_key, leaf, 0);
+        if (res >= 0 && leaf != NULL)
+            return(CCNR_COMPACT_STEP_MICROS);
+    }
+    if (res < 0) {
+        ccnr_msg(h, "index compaction failed");
+        h->index_compactor = NULL;
+        ccn_charbuf_destroy(&h->compact_key);
+        return(0);
+    }
+    /* Finished a pass */
+    memcpy(h->fill, h->filling, sizeof(h->fill));
+    ccn_charbuf_destroy(&h->compact_key);
+    if (CCNSHOULDLOG(h, sdfsdffd, CCNL_FINE))
+        ccnr_msg(h, "index compaction pass done, %lu merges so far",
+                 h->compact_merges);
+    return(CCNR_COMPACT_PASS_MICROS);
+}
+
+/**
+ * Copy a content object out of a segment that is being emptied, and
+ * point the index entry and any in-memory handle at the copy.
+ * @returns 0 for success, -1 for failure.
+ */
+static int
+r_store_relocate(struct ccnr_handle *h, struct ccn_btree_node *leaf, int ndx,
+                 ccnr_accession old, size_t size, struct ccn_charbuf *scratch)
+{
+    struct content_entry *content = NULL;
+    const unsigned char *p = NULL;
+    ccnr_accession acc;
+    unsigned segment;
+    off_t pos;
+    int fd;
+    
+    p = r_store_mapped_at(h, old, size);
+    if (p == NULL) {
+        segment = r_store_repofile_from_accession(h, old);
+        fd = r_io_repo_data_file_fd(h, segment, 0);
+        scratch->length = 0;
+        if (fd == -1 || ccn_charbuf_reserve(scratch, size) == NULL ||
+            pread(fd, scratch->buf, size, r_store_offset_from_accession(h, old)) != size)
+            return(-1);
+        p = scratch->buf;
+    }
+    /* Same sanity check as r_store_content_base makes */
+    if (size < 5 || p[0] != 0x04 || p[1] != 0x82 ||
+        p[size - 1] != 0 || p[size - 2] != 0)
+        return(-1);
+    pos = r_store_append_unindexed(h, p, size);
+    if (pos == (off_t)-1)
+        return(-1);
+    acc = ((ccnr_accession)pos) + r_store_mark_repoFile1;
+    if (ccn_btree_prepare_for_update(h->btree, leaf) < 0 ||
+        ccn_btree_content_set_cobid(leaf, ndx, ccnr_accession_encode(h, acc)) < 0)
+        return(-1);
+    content = r_store_acc_remove(h, old);
+    if (content != NULL) {
+        content->accession = acc;
+        r_store_acc_insert(h, content);
+    }
+    h->segment_copied += size;
+    return(0);
+}
+
+/**
+ * Remove the segments that have been emptied, once the index committed
+ * to disk no longer refers to them.
+ */
+static void
+r_store_segments_remove(struct ccnr_handle *h)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccnr_segment *seg = NULL;
+    unsigned i;
+    
+    for (i = 1; i < h->n_segment; i++) {
+        seg = &h->segment[i];
+        if (seg->state != CCNR_SEG_EMPTY || h->checkpoint < seg->mark)
+            continue;
+        /* A read in flight might still be using the file */
+        if (h->fetch_outstanding > 0)
+            return;
+        r_store_unmap_segment(h, &seg->map, 1);
+        if (seg->fd != -1)
+            r_io_shutdown_client_fd(h, seg->fd);
+        path = ccn_charbuf_create();
+        CHKPTR(path);
+        r_io_repo_segment_path(h, path, i);
+        if (unlink(ccn_charbuf_as_string(path)) != 0)
+            ccnr_msg(h, "cannot remove %s: %s",
+                     ccn_charbuf_as_string(path), strerror(errno));
+        else if (CCNSHOULDLOG(h, sdfsdf, CCNL_INFO))
+            ccnr_msg(h, "removed segment %u", i);
+        ccn_charbuf_destroy(&path);
+        memset(seg, 0, sizeof(*seg));
+        seg->fd = -1;
+        h->segments_removed++;
+    }
+}
+
+/**
+ * Take stock at the end of a segment cleaner pass.
+ *
+ * A segment with nothing live left in it can go, as soon as an index
+ * that says so has been committed.  A sealed segment that is mostly
+ * dead is emptied by the next pass.
+ * @returns the delay until the next pass.
+ */
+static int
+r_store_segments_review(struct ccnr_handle *h)
+{
+    struct ccnr_segment *seg = NULL;
+    int busy = 0;
+    unsigned i;
+    
+    for (i = 1; i < h->n_segment; i++) {
+        seg = &h->segment[i];
+        seg->live = seg->counting;
+        seg->counting = 0;
+        if (h->segment_live_pct != 0 &&
+            (seg->state == CCNR_SEG_SEALED || seg->state == CCNR_SEG_EVACUATING)) {
+            if (seg->live == 0) {
+                seg->state = CCNR_SEG_EMPTY;
+                seg->mark = h->stable;
+            }
+            else if (seg->state == CCNR_SEG_SEALED &&
+                     seg->live * 100 < (uintmax_t)seg->size * h->segment_live_pct) {
+                seg->state = CCNR_SEG_EVACUATING;
+                if (CCNSHOULDLOG(h, sdfsdffd, CCNL_INFO))
+                    ccnr_msg(h, "cleaning segment %u - %ju of %ju bytes live",
+                             i, seg->live, (uintmax_t)seg->size);
+            }
+        }
+        if (seg->state == CCNR_SEG_EVACUATING || seg->state == CCNR_SEG_EMPTY)
+            busy = 1;
+    }
+    r_store_segments_remove(h);
+    return(busy ? CCNR_CHECKPOINT_MICROS : CCNR_SEGCLEAN_PASS_MICROS);
+}
+
+/**
+ * Account for the live bytes in each segment, and empty out the
+ * segments that are mostly dead, a leaf at a time
+ *
+ * A pass goes through all the index entries, adding the size of each
+ * object to the count for its segment.  Objects in a segment that is
+ * being emptied are copied to the end of the data as they are passed,
+ * up to CCNR_SEGCLEAN_STEP_BYTES in a step, and their index entries
+ * updated; the copies count toward the segment they land in.  Since
+ * new content only goes to the segment being written, the counts for
+ * the others are exact at the end of a pass.
+ */
+static int
+r_store_segment_cleaner(struct ccn_schedule *sched,
+                        void *clienth,
+                        struct ccn_scheduled_event *ev,
+                        int flags)
+{
+    struct ccnr_handle *h = clienth;
+    struct ccn_btree_node *leaf = NULL;
+    struct ccn_charbuf *scratch = NULL;
+    ccnr_accession acc;
+    unsigned segment;
+    size_t copied = 0;
+    int size;
+    int n;
+    int i;
+    int res;
+    
+    (void)(sched);
+    (void)(ev);
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || h->btree == NULL) {
+        h->segment_cleaner = NULL;
+        ccn_charbuf_destroy(&h->segclean_key);
         return(0);
     }
-    return(nrand48(h->seed) % (2U * CCN_BT_CLEAN_TICK_MICROS) + 500);
+    if (h->active_in_fd != -1)
+        return(CCNR_CHECKPOINT_MICROS);
+    if (h->segclean_key == NULL) {
+        h->segclean_key = ccn_charbuf_create();
+        if (h->segclean_key == NULL)
+            return(CCNR_SEGCLEAN_PASS_MICROS);
+    }
+    res = ccn_btree_lookup(h->btree, h->segclean_key->buf,
+                           h->segclean_key->length, &leaf);
+    if (res < 0)
+        goto Fail;
+    n = ccn_btree_node_nent(leaf);
+    scratch = r_util_charbuf_obtain(h);
+    for (i = CCN_BT_SRCH_INDEX(res); i < n; i++) {
+        if (copied >= CCNR_SEGCLEAN_STEP_BYTES)
+            break;
+        acc = ccnr_accession_decode(h, ccn_btree_content_cobid(leaf, i));
+        size = ccn_btree_content_cobsz(leaf, i);
+        segment = r_store_repofile_from_accession(h, acc);
+        if (acc == CCNR_NULL_ACCESSION || size <= 0 || segment >= h->n_segment)
+            continue;
+        if (h->segment[segment].state == CCNR_SEG_EVACUATING &&
+            r_store_relocate(h, leaf, i, acc, size, scratch) == 0) {
+            copied += size;
+            acc = ccnr_accession_decode(h, ccn_btree_content_cobid(leaf, i));
+            segment = r_store_repofile_from_accession(h, acc);
+        }
+        h->segment[segment].counting += size;
+    }
+    r_util_charbuf_release(h, scratch);
+    if (copied > 0)
+        r_store_index_needs_cleaning(h);
+    if (i < n)
+        res = ccn_btree_key_fetch(h->segclean_key, leaf, i);
+    else {
+        res = ccn_btree_next_leaf(h->btree, leaf, &leaf);
+        if (res > 0)
+            res = ccn_btree_key_fetch(h->segclean_key, leaf, 0);
+        else if (res == 0)
+            leaf = NULL;
+    }
+    if (res < 0)
+        goto Fail;
+    if (leaf != NULL)
+        return(CCNR_SEGCLEAN_STEP_MICROS);
+    /* Finished a pass */
+    ccn_charbuf_destroy(&h->segclean_key);
+    return(r_store_segments_review(h));
+Fail:
+    ccnr_msg(h, "segment cleaning failed");
+    h->segment_cleaner = NULL;
+    ccn_charbuf_destroy(&h->segclean_key);
+    return(0);
 }
 
 PUBLIC void
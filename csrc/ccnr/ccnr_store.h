@@ -32,7 +32,8 @@ void r_store_init(struct ccnr_handle *h);
 int r_store_final(struct ccnr_handle *h, int stable);
 void r_store_set_content_timer(struct ccnr_handle *h,struct content_entry *content,struct ccn_parsed_ContentObject *pco);
 void r_store_mark_stale(struct ccnr_handle *h,struct content_entry *content);
-struct content_entry *r_store_next_child_at_level(struct ccnr_handle *h,struct content_entry *content,int level);
+struct content_entry *r_store_next_child_at_level(struct ccnr_handle *h,struct ccn_btree_cursor *cursor,struct content_entry *content,int level);
+struct content_entry *r_store_seek_content(struct ccnr_handle *h,struct ccn_btree_cursor *cursor,const unsigned char *key,size_t size);
 struct content_entry *r_store_content_next(struct ccnr_handle *h,struct content_entry *content);
 int r_store_content_matches_interest_prefix(struct ccnr_handle *h,struct content_entry *content,const unsigned char *interest_msg, size_t interest_size);
 struct content_entry *r_store_find_first_match_candidate(struct ccnr_handle *h,const unsigned char *interest_msg,const struct ccn_parsed_interest *pi);
@@ -48,6 +49,10 @@ int r_store_name_append_components(struct ccn_charbuf *dst, struct ccnr_handle *
 int r_store_content_flags(struct content_entry *content);
 int r_store_content_change_flags(struct content_entry *content, int set, int clear);
 int r_store_commit_content(struct ccnr_handle *h, struct content_entry *content);
+int r_store_log_flush(struct ccnr_handle *h);
+off_t r_store_append_unindexed(struct ccnr_handle *h, const unsigned char *msg, size_t size);
+off_t r_store_position(struct ccnr_handle *h, unsigned segment, off_t offset);
+void r_store_input_done(struct ccnr_handle *h, int fd);
 void r_store_forget_content(struct ccnr_handle *h, struct content_entry **pentry);
 void ccnr_debug_content(struct ccnr_handle *h, int lineno, const char *msg,
                         struct fdholder *fdholder,
@@ -58,7 +63,12 @@ void r_store_trim(struct ccnr_handle *h, unsigned long limit);
 ccnr_cookie r_store_content_cookie(struct ccnr_handle *h, struct content_entry *content);
 ccnr_accession r_store_content_accession(struct ccnr_handle *h, struct content_entry *content);
 const unsigned char *r_store_content_base(struct ccnr_handle *h, struct content_entry *content);
+int r_store_content_fetch(struct ccnr_handle *h, struct content_entry *content);
+void r_store_fetch_submit(struct ccnr_handle *h);
+int r_store_fetch_fd(struct ccnr_handle *h);
+void r_store_fetch_complete(struct ccnr_handle *h);
 size_t r_store_content_size(struct ccnr_handle *h, struct content_entry *content);
 void r_store_index_needs_cleaning(struct ccnr_handle *h);
 struct ccn_charbuf *r_store_content_flatname(struct ccnr_handle *h, struct content_entry *content);
+extern const ccnr_accession r_store_mark_repoFile1;
 #endif
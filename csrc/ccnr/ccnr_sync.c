@@ -47,6 +47,7 @@
 #include "ccnr_store.h"
 #include "ccnr_sync.h"
 #include "ccnr_util.h"
+#include "ccnr_verify.h"
 
 #ifndef CCNLINT
 
@@ -122,6 +123,12 @@ r_sync_notify_after(struct ccnr_handle *ccnr, ccnr_hwm item)
     ccnr->notify_after = (ccnr_accession) item;
 }
 
+PUBLIC int
+r_sync_idle_period(struct ccnr_handle *ccnr, int micros)
+{
+    return(r_util_idle_period(ccnr, micros));
+}
+
 /**
  * A wrapper for SyncNotifyContent that takes a content entry.
  */
@@ -162,16 +169,26 @@ r_sync_notify_content(struct ccnr_handle *ccnr, int e, struct content_entry *con
     return(res);
 }
 
+/**
+ * Limits on the work done by one step of a sync enumeration.
+ */
+#define CCNR_SYNC_ENUM_NAMES 1000   /**< names handed to sync per step */
+#define CCNR_SYNC_ENUM_TRIES 8000   /**< btree entries examined per step */
+
 /**
  *  State for an ongoing sync enumeration.
  */
 struct sync_enumeration_state {
     int magic; /**< for sanity check - should be se_cookie */
     int index; /**< Index into ccnr->active_enum */
-    ccnr_cookie cookie; /**< Resumption point */
+    struct ccn_charbuf *resume; /**< Resumption point, as a btree key */
+    struct ccn_charbuf *prefix; /**< Flatname of the interest name */
     struct ccn_parsed_interest parsed_interest;
     struct ccn_charbuf *interest;
     struct ccn_indexbuf *comps;
+    struct ccn_charbuf *block;  /**< Flatnames of a step, back to back */
+    size_t off[CCNR_SYNC_ENUM_NAMES + 1]; /**< Where each flatname starts */
+    ccnr_accession acc[CCNR_SYNC_ENUM_NAMES]; /**< Accession of each */
 };
 static const int se_cookie = __LINE__;
 
@@ -186,11 +203,92 @@ cleanup_se(struct ccnr_handle *ccnr, struct sync_enumeration_state *md)
             ccnr->active_enum[i] = CCNR_NULL_ACCESSION;
         ccn_indexbuf_destroy(&md->comps);
         ccn_charbuf_destroy(&md->interest);
+        ccn_charbuf_destroy(&md->resume);
+        ccn_charbuf_destroy(&md->prefix);
+        ccn_charbuf_destroy(&md->block);
         free(md);
     }
     return(NULL);
 }
 
+/**
+ * Collect the next block of matching names for an enumeration.
+ *
+ * This walks the btree leaves directly, starting from md->resume, so
+ * the names come out in canonical order and no content entries need to
+ * be constructed.  The btree is not touched while sync digests the block.
+ *
+ * @returns the number of names collected (possibly 0), with md->resume
+ *  advanced past the last entry examined, or -1 if there are no more entries.
+ */
+static int
+r_sync_enumerate_block(struct ccnr_handle *ccnr,
+                       struct sync_enumeration_state *md,
+                       struct ccn_charbuf *scratch)
+{
+    struct ccn_btree_node *leaf = NULL;
+    struct ccn_charbuf *key = md->block;
+    ccnr_accession acc;
+    size_t mark;
+    int ndx;
+    int n;
+    int res;
+    int try;
+    int more = 0;
+    
+    key->length = 0;
+    res = ccn_btree_lookup(ccnr->btree, md->resume->buf, md->resume->length,
+                           &leaf);
+    if (res < 0)
+        return(-1);
+    ndx = CCN_BT_SRCH_INDEX(res);
+    for (try = 0, n = 0; ; try++, ndx++) {
+        if (n == CCNR_SYNC_ENUM_NAMES || try == CCNR_SYNC_ENUM_TRIES) {
+            more = 1;
+            break;
+        }
+        if (ndx >= ccn_btree_node_nent(leaf)) {
+            res = ccn_btree_next_leaf(ccnr->btree, leaf, &leaf);
+            if (res <= 0)
+                break;
+            ndx = 0;
+            if (ccn_btree_node_nent(leaf) == 0)
+                continue;
+        }
+        mark = key->length;
+        res = ccn_btree_key_append(key, leaf, ndx);
+        if (res < 0)
+            break;
+        /* Flatnames sort in name order, so the first mismatch ends it */
+        if (key->length - mark < md->prefix->length ||
+            memcmp(key->buf + mark, md->prefix->buf, md->prefix->length) != 0) {
+            key->length = mark;
+            break;
+        }
+        /* Remember where to pick up, just past this entry */
+        md->resume->length = 0;
+        ccn_charbuf_append(md->resume, key->buf + mark, key->length - mark);
+        ccn_charbuf_append_value(md->resume, 0, 1);
+        acc = ccnr_accession_decode(ccnr, ccn_btree_content_cobid(leaf, ndx));
+        res = ccn_btree_match_interest(leaf, ndx, md->interest->buf,
+                                       &md->parsed_interest, scratch);
+        if (res != 1 || acc == CCNR_NULL_ACCESSION) {
+            key->length = mark;
+            if (res == -1)
+                break;
+        }
+        else {
+            md->off[n] = mark;
+            md->acc[n] = acc;
+            n++;
+        }
+    }
+    md->off[n] = key->length;
+    if (n == 0 && !more)
+        return(-1);
+    return(n);
+}
+
 static int
 r_sync_enumerate_action(struct ccn_schedule *sched,
     void *clienth,
@@ -199,17 +297,9 @@ r_sync_enumerate_action(struct ccn_schedule *sched,
 {
     struct ccnr_handle *ccnr = clienth;
     struct sync_enumeration_state *md = NULL;
-    struct content_entry *content = NULL;
-    struct ccn_btree_node *leaf = NULL;
-    struct ccn_charbuf *interest = NULL;
-    struct ccn_indexbuf *comps = NULL;
-    struct ccn_parsed_interest *pi = NULL;
     struct ccn_charbuf *scratch = NULL;
-    struct ccn_charbuf *flat = NULL;
-    int ndx;
+    int n;
     int res;
-    int try;
-    int matches;
     
     md = ev->evdata;
     if (md->magic != se_cookie || md->index >= CCNR_MAX_ENUM) abort();
@@ -217,65 +307,27 @@ r_sync_enumerate_action(struct ccn_schedule *sched,
         ev->evdata = cleanup_se(ccnr, md);
         return(0);
     }
-    pi = &md->parsed_interest;
-    interest = md->interest;
-    comps = md->comps;
-    /*
-     * Recover starting point from either cookie or accession.
-     *
-     * The accession number might not be available yet (but we try to avoid
-     * suspending in such a case).
-     * The cookie might go away, but only if the content has been accessioned.
-     */
-    content = r_store_content_from_cookie(ccnr, md->cookie);
-    if (content == NULL && md->cookie != 0)
-        content = r_store_content_from_accession(ccnr, ccnr->active_enum[md->index]);
-    for (try = 0, matches = 0; content != NULL; try++) {
-        if (scratch == NULL)
-            scratch = ccn_charbuf_create();
-        flat = r_store_content_flatname(ccnr, content);
-        res = ccn_btree_lookup(ccnr->btree, flat->buf, flat->length, &leaf);
-        if (CCN_BT_SRCH_FOUND(res) == 0) {
-            ccnr_debug_content(ccnr, __LINE__, "impossible", NULL, content);
-            break;
-        }
-        ndx = CCN_BT_SRCH_INDEX(res);
-        res = ccn_btree_match_interest(leaf, ndx, interest->buf, pi, scratch);
+    scratch = r_util_charbuf_obtain(ccnr);
+    n = md->resume == NULL ? -1 : r_sync_enumerate_block(ccnr, md, scratch);
+    r_util_charbuf_release(ccnr, scratch);
+    if (n > 0) {
+        ccnr->active_enum[md->index] = md->acc[n - 1];
+        res = SyncNotifyContentBlock(ccnr->sync_handle, md->index,
+                                     md->block->buf, md->off, md->acc, n);
+        if (CCNSHOULDLOG(ccnr, r_sync_enumerate_action, CCNL_FINEST))
+            ccnr_msg(ccnr, "sync_enum id=%d block of %d, accession=0x%jx",
+                     md->index, n,
+                     ccnr_accession_encode(ccnr, ccnr->active_enum[md->index]));
         if (res == -1) {
-            ccnr_debug_content(ccnr, __LINE__, "impossible", NULL, content);
-            break;
-        }
-        if (res == 1) {
-            res = r_sync_notify_content(ccnr, md->index, content);
-            matches++;
-            if (res == -1) {
-                if (CCNSHOULDLOG(ccnr, r_sync_enumerate_action, CCNL_FINEST))
-                    ccnr_debug_content(ccnr, __LINE__, "r_sync_enumerate_action", NULL,
-                                       content);
-                ev->evdata = cleanup_se(ccnr, md);
-                ccn_charbuf_destroy(&scratch);
-                return(0);
-            }
-        }
-        content = r_store_content_next(ccnr, content);
-        if (content != NULL &&
-            !r_store_content_matches_interest_prefix(ccnr, content,
-                                                     interest->buf,
-                                                     interest->length))
-            content = NULL;
-        if (content != NULL) {
-            md->cookie = r_store_content_cookie(ccnr, content);
-            ccnr->active_enum[md->index] = r_store_content_accession(ccnr, content);
-            if (ccnr->active_enum[md->index] != CCNR_NULL_ACCESSION && 
-                (matches >= 8 || try >= 200)) { // XXX - these numbers need tuning
-                ccn_charbuf_destroy(&scratch);
-                return(300);
-            }
+            ev->evdata = cleanup_se(ccnr, md);
+            return(0);
         }
+        return(300);
     }
+    if (n == 0)
+        return(300);
     r_sync_notify_content(ccnr, md->index, NULL);
     ev->evdata = cleanup_se(ccnr, md);
-    ccn_charbuf_destroy(&scratch);
     return(0);
 }
 
@@ -283,7 +335,9 @@ r_sync_enumerate_action(struct ccn_schedule *sched,
  * Request that a SyncNotifyContent call be made for each content object
  *  in the repository that matches the interest.
  *
- * If SyncNotifyContent returns -1 the active enumeration will be cancelled.
+ * The names are passed in blocks, in canonical order, through
+ *  SyncNotifyContentBlock; if that returns -1 the active enumeration will
+ *  be cancelled.
  *
  * When there are no more matching objects, SyncNotifyContent will be called
  *  passing NULL for name.
@@ -356,8 +410,17 @@ r_sync_enumerate(struct ccnr_handle *ccnr,
     md = calloc(1, sizeof(*md));
     if (md == NULL) { ccnr->active_enum[ans] = CCNR_NULL_ACCESSION; ans = -1; goto Bail; }
     md->magic = se_cookie;
-    md->cookie = content == NULL ? 0 : r_store_content_cookie(ccnr, content);
     md->index = ans;
+    if (content != NULL) {
+        md->resume = ccn_charbuf_create();
+        md->prefix = ccn_charbuf_create();
+        md->block = ccn_charbuf_create();
+        if (md->resume == NULL || md->prefix == NULL || md->block == NULL)
+            goto Bail;
+        ccn_charbuf_append_charbuf(md->resume,
+                                   r_store_content_flatname(ccnr, content));
+        ccn_flatname_from_ccnb(md->prefix, interest->buf, interest->length);
+    }
     md->interest = ccn_charbuf_create();
     if (md->interest == NULL) goto Bail;
     ccn_charbuf_append(md->interest, interest->buf, interest->length);
@@ -408,6 +471,47 @@ r_sync_lookup(struct ccnr_handle *ccnr,
     return(ans);
 }
 
+/**
+ * Check a batch of full names against the index.
+ *
+ * The names are visited with one btree cursor, so a run of names that
+ * fall in the same leaf costs one descent from the root, rather than a
+ * parsed interest and a full r_store_lookup apiece.  Only an exact match
+ * of the name (with its digest) counts.
+ */
+PUBLIC int
+r_sync_lookup_names(struct ccnr_handle *ccnr,
+                    struct ccn_charbuf **names,
+                    int n,
+                    unsigned char *present)
+{
+    struct ccn_btree_cursor cursor = {0};
+    struct ccn_charbuf *flatname = r_util_charbuf_obtain(ccnr);
+    int ans = 0;
+    int res;
+    int i;
+    
+    for (i = 0; i < n; i++)
+        present[i] = 0;
+    for (i = 0; i < n; i++) {
+        res = ccn_flatname_from_ccnb(flatname, names[i]->buf, names[i]->length);
+        if (res < 0)
+            continue;
+        res = ccn_btree_cursor_seek(&cursor, ccnr->btree,
+                                    flatname->buf, flatname->length);
+        if (res < 0) {
+            ans = -1;
+            break;
+        }
+        if (res == 1) {
+            present[i] = 1;
+            ans++;
+        }
+    }
+    r_util_charbuf_release(ccnr, flatname);
+    return(ans);
+}
+
 /**
  * Called when a content object is received by sync and needs to be
  * committed to stable storage by the repo.
@@ -427,6 +531,11 @@ r_sync_upcall_store(struct ccnr_handle *ccnr,
     
     ccnb = info->content_ccnb;
     ccnb_size = info->pco->offset[CCN_PCO_E];
+    if (r_verify_content(ccnr, info->h, ccnb, ccnb_size, info->pco, 0) < 0) {
+        ccnr_debug_ccnb(ccnr, __LINE__, "co_verify_failed", NULL,
+                        ccnb, ccnb_size);
+        return(CCN_UPCALL_RESULT_ERR);
+    }
     
     content = process_incoming_content(ccnr, r_io_fdholder_from_fd(ccnr, ccn_get_connection_fd(info->h)),
                                        (void *)ccnb, ccnb_size);
@@ -42,6 +42,9 @@ r_sync_notify_after(struct ccnr_handle *ccnr, ccnr_hwm item);
 
 /** Request that a SyncNotifyContent call is made for each content object
  *  matching the interest.
+ *  The names are walked directly from the btree, and are passed in blocks,
+ *  in canonical order, through SyncNotifyContentBlock; only the end of the
+ *  enumeration is signalled through SyncNotifyContent.
  *  returns -1 for error, or an enumeration number which will also be passed
  *      in the SyncNotifyContent
  */
@@ -57,6 +60,17 @@ int
 r_sync_lookup(struct ccnr_handle *ccnr, struct ccn_charbuf *interest,
               struct ccn_charbuf *content_ccnb);
 
+/** Check which of a batch of names are stored locally in the repository.
+ * Each name is a ccnb Name that includes the digest component, and the
+ * batch should be in ascending order, so that the names can be found with
+ * one pass over the index.  present[i] is set to 1 for each names[i] that
+ * is present, and to 0 for each that is not.
+ * returns the number present, or -1 for error.
+ */
+int
+r_sync_lookup_names(struct ccnr_handle *ccnr, struct ccn_charbuf **names,
+                    int n, unsigned char *present);
+
 /**
  * Called when a content object is received by sync and needs to be
  * committed to stable storage by the repo.
@@ -77,5 +91,12 @@ r_sync_local_store(struct ccnr_handle *ccnr, struct ccn_charbuf *content_cb);
 int
 r_sync_notify_content(struct ccnr_handle *ccnr, int e, struct content_entry *content);
 
+/**
+ * Stretch the period of a periodic sync action while the repo is idle.
+ * returns the period to use.
+ */
+int
+r_sync_idle_period(struct ccnr_handle *ccnr, int micros);
+
 
 #endif
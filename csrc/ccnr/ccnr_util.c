@@ -41,6 +41,7 @@
 #include <sys/un.h>
 #include <netinet/in.h>
 
+#include <ccn/arena.h>
 #include <ccn/bloom.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
@@ -54,48 +55,35 @@
 
 #include "ccnr_private.h"
 
+#include "ccnr_msg.h"
 #include "ccnr_util.h"
 
+/**
+ * Obtain a charbuf for short-term use, from the scratch arena.
+ * Anything not released is reclaimed by the main loop.
+ */
 PUBLIC struct ccn_charbuf *
 r_util_charbuf_obtain(struct ccnr_handle *h)
 {
-    struct ccn_charbuf *c = h->scratch_charbuf;
-    if (c == NULL)
-        return(ccn_charbuf_create());
-    h->scratch_charbuf = NULL;
-    c->length = 0;
-    return(c);
+    return(ccn_charbuf_create_in(h->scratch));
 }
 
 PUBLIC void
 r_util_charbuf_release(struct ccnr_handle *h, struct ccn_charbuf *c)
 {
-    c->length = 0;
-    if (h->scratch_charbuf == NULL)
-        h->scratch_charbuf = c;
-    else
-        ccn_charbuf_destroy(&c);
+    ccn_charbuf_release_in(h->scratch, &c);
 }
 
 PUBLIC struct ccn_indexbuf *
 r_util_indexbuf_obtain(struct ccnr_handle *h)
 {
-    struct ccn_indexbuf *c = h->scratch_indexbuf;
-    if (c == NULL)
-        return(ccn_indexbuf_create());
-    h->scratch_indexbuf = NULL;
-    c->n = 0;
-    return(c);
+    return(ccn_indexbuf_create_in(h->scratch));
 }
 
 PUBLIC void
 r_util_indexbuf_release(struct ccnr_handle *h, struct ccn_indexbuf *c)
 {
-    c->n = 0;
-    if (h->scratch_indexbuf == NULL)
-        h->scratch_indexbuf = c;
-    else
-        ccn_indexbuf_destroy(&c);
+    ccn_indexbuf_release_in(h->scratch, &c);
 }
 
 PUBLIC void
@@ -121,16 +109,52 @@ r_util_reseed(struct ccnr_handle *h)
     seed48(h->seed);
 }
 
+/**
+ * Read the clock, and keep the time in h->sec and h->usec.
+ *
+ * The scheduler uses the same cached reading, so this needs doing
+ * before ccn_schedule_run and wherever a fresher time matters.
+ */
 PUBLIC void
-r_util_gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
+r_util_refresh_time(struct ccnr_handle *h)
+{
+    const struct ccn_timeval *now = ccn_clock_refresh(&h->clock);
+    h->sec = now->s;
+    h->usec = now->micros;
+}
+
+/**
+ * Go into or out of idle mode, as the traffic warrants.
+ *
+ * Idle mode lets the scheduler hold timers for up to h->idle_slack,
+ * so that nearby ones share a wakeup.
+ */
+PUBLIC void
+r_util_check_quiet(struct ccnr_handle *h)
+{
+    int quiet;
+    
+    if (h->idle_slack <= 0)
+        return;
+    quiet = (hashtb_n(h->propagating_tab) == 0 &&
+             h->sec - h->busy_sec >= CCNR_QUIET_SECS);
+    if (quiet == h->quiet)
+        return;
+    h->quiet = quiet;
+    ccn_schedule_set_slack(h->sched, quiet ? h->idle_slack : 0);
+    if (CCNSHOULDLOG(h, idle, CCNL_FINE))
+        ccnr_msg(h, "%s idle mode", quiet ? "entering" : "leaving");
+}
+
+/**
+ * Stretch the period of a housekeeping event while ccnr is quiet.
+ */
+PUBLIC int
+r_util_idle_period(struct ccnr_handle *h, int usec)
 {
-    struct ccnr_handle *h = self->data;
-    struct timeval now = {0};
-    gettimeofday(&now, 0);
-    result->s = now.tv_sec;
-    result->micros = now.tv_usec;
-    h->sec = now.tv_sec;
-    h->usec = now.tv_usec;
+    if (h->quiet && usec <= INT_MAX / CCNR_IDLE_STRETCH)
+        return(usec * CCNR_IDLE_STRETCH);
+    return(usec);
 }
 
 PUBLIC int
@@ -25,7 +25,9 @@
 
 #include "ccnr_private.h"
 
-void r_util_gettime(const struct ccn_gettime *self,struct ccn_timeval *result);
+void r_util_refresh_time(struct ccnr_handle *h);
+void r_util_check_quiet(struct ccnr_handle *h);
+int r_util_idle_period(struct ccnr_handle *h, int usec);
 int r_util_timecmp(long secA, unsigned usecA, long secB, unsigned usecB);
 void r_util_reseed(struct ccnr_handle *h);
 void r_util_indexbuf_release(struct ccnr_handle *h,struct ccn_indexbuf *c);
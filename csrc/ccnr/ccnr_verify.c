@@ -0,0 +1,209 @@
+/**
+ * @file ccnr_verify.c
+ *
+ * Part of ccnr - CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Signature checks for incoming content, done by libccn's verifier
+ * threads (see ccn_verifier_create).
+ *
+ * Everything that touches the handle - finding the key, consulting and
+ * filling the cache of objects already verified, storing the content -
+ * stays on the main thread.  Only ccn_verify_signature runs on the
+ * workers, on a copy of the object.  Finished checks are collected
+ * when the verifier's fd, which is polled along with everything else,
+ * is readable, and the objects that pass are stored then; until that
+ * point they are neither in the repository nor served from it.
+ */
+
+#include <stdlib.h>
+
+#include <ccn/ccn.h>
+#include <ccn/ccn_private.h>
+#include <ccn/charbuf.h>
+#include <ccn/signing.h>
+
+#include "ccnr_private.h"
+
+#include "ccnr_verify.h"
+
+#include "ccnr_init.h"
+#include "ccnr_msg.h"
+#include "ccnr_proto.h"
+
+/** Most checks outstanding per thread, before they are done inline */
+#define CCNR_VERIFY_BACKLOG 256
+
+/**
+ * A ContentObject waiting on its signature check.
+ * This is the tag given to ccn_verifier_submit.
+ */
+struct ccnr_verify_job {
+    struct ccn *client;                 /**< the handle that found the key */
+    struct ccn_charbuf *ccnb;           /**< copy of the ContentObject */
+    struct ccn_parsed_ContentObject pco;
+    const struct ccn_pkey *pubkey;
+};
+
+static void
+r_verify_job_destroy(struct ccnr_verify_job **pjob)
+{
+    struct ccnr_verify_job *job = *pjob;
+
+    if (job == NULL)
+        return;
+    ccn_charbuf_destroy(&job->ccnb);
+    free(job);
+    *pjob = NULL;
+}
+
+/**
+ * Start the verification threads.
+ *
+ * CCNR_VERIFY_THREADS says how many; with 0, signatures are checked
+ * by libccn as the content arrives.
+ * @returns the number of threads started.
+ */
+PUBLIC int
+r_verify_init(struct ccnr_handle *h)
+{
+    int n;
+
+    n = r_init_confval(h, "CCNR_VERIFY_THREADS", 0, 64, 2);
+    if (n == 0)
+        return(0);
+    h->verifier = ccn_verifier_create(n);
+    if (h->verifier == NULL) {
+        ccnr_msg(h, "r_verify_init: no verification threads");
+        return(0);
+    }
+    return(ccn_verifier_threads(h->verifier));
+}
+
+/**
+ * Finish the checks in hand, store what passes, and stop the threads.
+ */
+PUBLIC void
+r_verify_final(struct ccnr_handle *h)
+{
+    if (h->verifier == NULL)
+        return;
+    ccn_verifier_stop(h->verifier);
+    r_verify_complete(h);
+    ccn_verifier_destroy(&h->verifier);
+}
+
+/**
+ * Verify an incoming ContentObject, here or on a worker thread.
+ *
+ * Content whose key is not at hand is let through, as libccn would.
+ * @param client - the handle the content arrived on
+ * @param later - nonzero if the caller can do without the content
+ *        being stored on return.
+ * @returns 0 if the content should be stored now, 1 if it will be
+ *          stored once its check passes, or -1 if the check failed.
+ */
+PUBLIC int
+r_verify_content(struct ccnr_handle *h, struct ccn *client,
+                 const unsigned char *ccnb, size_t size,
+                 struct ccn_parsed_ContentObject *pco, int later)
+{
+    struct ccn_verifier *v = h->verifier;
+    struct ccnr_verify_job *job = NULL;
+    const struct ccn_pkey *pubkey = NULL;
+    int res;
+
+    if (v == NULL)
+        return(0);
+    res = ccn_verify_content_prepare(client, ccnb, pco, &pubkey);
+    if (res == 2 && later && ccn_verifier_outstanding(v) <
+                             ccn_verifier_threads(v) * CCNR_VERIFY_BACKLOG) {
+        job = calloc(1, sizeof(*job));
+        if (job != NULL) {
+            job->ccnb = ccn_charbuf_create();
+            if (job->ccnb == NULL ||
+                ccn_charbuf_append(job->ccnb, ccnb, size) < 0)
+                r_verify_job_destroy(&job);
+        }
+        if (job != NULL) {
+            job->client = client;
+            job->pco = *pco;
+            job->pubkey = pubkey;
+            if (ccn_verifier_submit(v, job->ccnb->buf, job->ccnb->length,
+                                    &job->pco, pubkey, job) == 0)
+                return(1);
+            r_verify_job_destroy(&job);
+        }
+    }
+    if (res == 2) {
+        res = (ccn_verify_signature(ccnb, size, pco, pubkey) == 1) ? 0 : -1;
+        if (res == 0)
+            ccn_verify_content_done(client, ccnb, pco, pubkey);
+    }
+    if (res == 1)
+        return(0);
+    if (res < 0) {
+        h->content_verify_failed++;
+        return(-1);
+    }
+    h->content_verified++;
+    return(0);
+}
+
+/**
+ * @returns the fd to poll for finished checks, or -1 if none.
+ */
+PUBLIC int
+r_verify_fd(struct ccnr_handle *h)
+{
+    if (h->verifier == NULL)
+        return(-1);
+    return(ccn_verifier_fd(h->verifier));
+}
+
+/**
+ * Collect the finished checks, and store the content that passed.
+ */
+PUBLIC void
+r_verify_complete(struct ccnr_handle *h)
+{
+    struct ccnr_verify_job *job = NULL;
+    void *tag = NULL;
+    int res;
+
+    if (h->verifier == NULL)
+        return;
+    while (ccn_verifier_reap(h->verifier, &tag, &res)) {
+        job = tag;
+        if (res == 1) {
+            h->content_verified++;
+            ccn_verify_content_done(job->client, job->ccnb->buf,
+                                    &job->pco, job->pubkey);
+            r_proto_content_verified(h, job->client, job->ccnb->buf,
+                                     job->ccnb->length, &job->pco);
+        }
+        else {
+            h->content_verify_failed++;
+            ccnr_debug_ccnb(h, __LINE__, "co_verify_failed", NULL,
+                            job->ccnb->buf, job->ccnb->length);
+        }
+        r_verify_job_destroy(&job);
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * @file ccnr_verify.h
+ *
+ * Part of ccnr - CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CCNR_VERIFY_DEFINED
+#define CCNR_VERIFY_DEFINED
+
+#include "ccnr_private.h"
+
+int r_verify_init(struct ccnr_handle *h);
+void r_verify_final(struct ccnr_handle *h);
+int r_verify_content(struct ccnr_handle *h, struct ccn *client,
+                     const unsigned char *ccnb, size_t size,
+                     struct ccn_parsed_ContentObject *pco, int later);
+int r_verify_fd(struct ccnr_handle *h);
+void r_verify_complete(struct ccnr_handle *h);
+
+#endif
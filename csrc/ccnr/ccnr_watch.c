@@ -0,0 +1,556 @@
+/**
+ * @file ccnr_watch.c
+ *
+ * Part of ccnr - CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Ingest of files as they are written into a watched directory.
+ *
+ * Each file that appears in CCNR_WATCH_DIRECTORY after startup is
+ * published as a new version under CCNR_WATCH_PREFIX/<filename>.
+ * Every time another CCNR_WATCH_BLOCKSIZE bytes have been appended,
+ * they become the next segment; once the file has not grown for
+ * CCNR_WATCH_IDLE seconds, or is removed, what is left becomes the
+ * final segment.  Segments are signed with the repository's key by
+ * the batching signer, and stored as each signature is made.
+ *
+ * Files already there at startup, or already published, are published
+ * again in full as a new version if they change.
+ *
+ * On Linux, inotify says when to look; elsewhere, or if inotify loses
+ * track, the directory is scanned each tick.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#define CCNR_HAVE_INOTIFY 1
+#endif
+
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
+#include <ccn/schedule.h>
+#include <ccn/signer.h>
+#include <ccn/uri.h>
+
+#include "ccnr_private.h"
+
+#include "ccnr_watch.h"
+
+#include "ccnr_dispatch.h"
+#include "ccnr_init.h"
+#include "ccnr_msg.h"
+#include "ccnr_store.h"
+
+/** Microseconds between ticks */
+#define CCNR_WATCH_TICK 1000000
+/** Most segments waiting to be signed before reading is held off */
+#define CCNR_WATCH_BACKLOG 256
+
+struct watch_file {
+    int fd;                     /**< open while being published, else -1 */
+    ino_t ino;                  /**< to notice a file being replaced */
+    off_t offset;               /**< bytes published so far */
+    off_t size;                 /**< size as of the last tick */
+    uintmax_t seq;              /**< next segment number */
+    struct ccn_charbuf *name;   /**< versioned name, while being published */
+    int idle;                   /**< ticks without growth */
+    unsigned scan;              /**< scan that last saw the file */
+};
+
+struct ccnr_watch {
+    const char *dir;            /**< the watched directory */
+    struct ccn_charbuf *prefix; /**< names of files go under this */
+    struct hashtb *files;       /**< watch_file, keyed by file name */
+    struct ccn_charbuf *buf;    /**< for reading blocks */
+    size_t blocksize;
+    int idle;                   /**< ticks before a quiet file is done */
+    int ifd;                    /**< inotify fd, or -1 to scan */
+    int rescan;                 /**< inotify lost events */
+    unsigned scan;              /**< scan generation */
+    struct ccn_scheduled_event *tick;
+};
+
+static void
+r_watch_finalize_file(struct hashtb_enumerator *e)
+{
+    struct watch_file *f = e->data;
+
+    if (f->fd != -1)
+        close(f->fd);
+    ccn_charbuf_destroy(&f->name);
+}
+
+/**
+ * Sign and store one segment of a file.
+ */
+static void
+r_watch_signed(struct ccn_signer *s, struct ccn_charbuf *cob,
+               void *data, intptr_t intdata)
+{
+    struct ccnr_handle *h = data;
+    struct content_entry *content = NULL;
+
+    if (cob == NULL || h->face0 == NULL)
+        return;
+    content = process_incoming_content(h, h->face0, cob->buf, cob->length);
+    if (content == NULL) {
+        ccnr_debug_ccnb(h, __LINE__, "watch_store_failed", NULL,
+                        cob->buf, cob->length);
+        return;
+    }
+    r_store_commit_content(h, content);
+    h->watch_segments++;
+}
+
+static int
+r_watch_submit(struct ccnr_handle *h, struct watch_file *f,
+               const unsigned char *data, size_t size, int final)
+{
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_charbuf *name = NULL;
+    int res;
+
+    name = ccn_charbuf_create();
+    if (name == NULL)
+        return(-1);
+    ccn_charbuf_append_charbuf(name, f->name);
+    ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, f->seq);
+    if (final)
+        sp.sp_flags |= CCN_SP_FINAL_BLOCK;
+    res = ccn_signer_submit(h->direct_signer, name, &sp, data, size,
+                            &r_watch_signed, h, 0);
+    ccn_charbuf_destroy(&name);
+    if (res < 0)
+        return(-1);
+    f->seq++;
+    return(0);
+}
+
+/**
+ * Begin publishing a new version of a file, from its start.
+ */
+static int
+r_watch_begin(struct ccnr_handle *h, struct watch_file *f,
+              const char *fname, size_t fnamelen)
+{
+    struct ccnr_watch *w = h->watch;
+    struct ccn_charbuf *path = NULL;
+    struct stat st;
+
+    if (f->fd != -1)
+        close(f->fd);
+    ccn_charbuf_destroy(&f->name);
+    f->offset = f->size = 0;
+    f->seq = 0;
+    f->idle = 0;
+    path = ccn_charbuf_create();
+    if (path == NULL)
+        return(-1);
+    ccn_charbuf_putf(path, "%s/", w->dir);
+    ccn_charbuf_append(path, fname, fnamelen);
+    f->fd = open(ccn_charbuf_as_string(path), O_RDONLY);
+    ccn_charbuf_destroy(&path);
+    if (f->fd == -1)
+        return(-1);
+    if (fstat(f->fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(f->fd);
+        f->fd = -1;
+        return(-1);
+    }
+    f->ino = st.st_ino;
+    f->name = ccn_charbuf_create();
+    if (f->name == NULL ||
+        ccn_charbuf_append_charbuf(f->name, w->prefix) < 0 ||
+        ccn_name_append(f->name, fname, fnamelen) < 0 ||
+        ccn_create_version(h->direct_client, f->name, CCN_V_NOW, 0, 0) < 0) {
+        close(f->fd);
+        f->fd = -1;
+        ccn_charbuf_destroy(&f->name);
+        return(-1);
+    }
+    h->watch_files++;
+    if (CCNSHOULDLOG(h, watch, CCNL_INFO))
+        ccnr_debug_ccnb(h, __LINE__, "watch_begin", NULL,
+                        f->name->buf, f->name->length);
+    return(0);
+}
+
+/**
+ * Publish what has been appended to a file, in whole blocks, and the
+ * rest too if the file is done.
+ * @returns 0, or 1 if held off by the signing backlog.
+ */
+static int
+r_watch_ingest(struct ccnr_handle *h, struct watch_file *f, int finish)
+{
+    struct ccnr_watch *w = h->watch;
+    struct stat st;
+    off_t avail;
+    ssize_t n;
+    size_t want;
+    int final;
+
+    if (f->fd == -1)
+        return(0);
+    if (fstat(f->fd, &st) == -1)
+        finish = 1;
+    else if (st.st_size < f->offset)
+        finish = 1; /* truncated - end this version where it was */
+    else {
+        if (st.st_size != f->size)
+            f->idle = 0;
+        f->size = st.st_size;
+    }
+    for (;;) {
+        if (!finish &&
+            ccn_signer_pending(h->direct_signer) >= CCNR_WATCH_BACKLOG)
+            return(1);
+        avail = f->size - f->offset;
+        if (avail < (off_t)w->blocksize && !finish)
+            return(0);
+        want = avail < (off_t)w->blocksize ? avail : w->blocksize;
+        n = 0;
+        if (want > 0) {
+            n = pread(f->fd, w->buf->buf, want, f->offset);
+            if (n <= 0) {
+                /* Gone short - end this version with what we have */
+                finish = 1;
+                f->size = f->offset;
+                n = 0;
+            }
+        }
+        final = finish && f->offset + n == f->size;
+        if (r_watch_submit(h, f, w->buf->buf, n, final) < 0) {
+            ccnr_msg(h, "r_watch_ingest: cannot queue segment for signing");
+            final = 1;
+        }
+        f->offset += n;
+        if (final) {
+            close(f->fd);
+            f->fd = -1;
+            ccn_charbuf_destroy(&f->name);
+            return(0);
+        }
+    }
+}
+
+/**
+ * Find or make the entry for a file.
+ */
+static struct watch_file *
+r_watch_file(struct ccnr_watch *w, const char *fname, size_t len, int *isnew)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct watch_file *f = NULL;
+    int res;
+
+    hashtb_start(w->files, e);
+    res = hashtb_seek(e, fname, len, 0);
+    f = e->data;
+    if (res == HT_NEW_ENTRY)
+        f->fd = -1;
+    hashtb_end(e);
+    if (isnew != NULL)
+        *isnew = (res == HT_NEW_ENTRY);
+    return(f);
+}
+
+static void
+r_watch_forget(struct ccnr_watch *w, const char *fname, size_t len)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+
+    hashtb_start(w->files, e);
+    if (hashtb_seek(e, fname, len, 0) >= 0)
+        hashtb_delete(e);
+    hashtb_end(e);
+}
+
+/**
+ * Look over the directory for new, grown, replaced, and removed files.
+ *
+ * @param startup - nonzero to just note what is there already.
+ */
+static void
+r_watch_scan(struct ccnr_handle *h, int startup)
+{
+    struct ccnr_watch *w = h->watch;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *path = NULL;
+    struct watch_file *f = NULL;
+    struct dirent *de = NULL;
+    struct stat st;
+    DIR *dir = NULL;
+    size_t len;
+    int isnew;
+
+    w->scan++;
+    dir = opendir(w->dir);
+    path = ccn_charbuf_create();
+    while (dir != NULL && path != NULL && (de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        path->length = 0;
+        ccn_charbuf_putf(path, "%s/%s", w->dir, de->d_name);
+        if (stat(ccn_charbuf_as_string(path), &st) == -1 || !S_ISREG(st.st_mode))
+            continue;
+        len = strlen(de->d_name);
+        f = r_watch_file(w, de->d_name, len, &isnew);
+        if (f == NULL)
+            continue;
+        f->scan = w->scan;
+        if (startup || (isnew == 0 && f->fd == -1 && f->ino == st.st_ino &&
+                        f->size == st.st_size)) {
+            f->ino = st.st_ino;
+            f->size = st.st_size;
+            continue;
+        }
+        if (f->fd != -1 && f->ino != st.st_ino)
+            r_watch_ingest(h, f, 1);
+        if (f->fd == -1)
+            r_watch_begin(h, f, de->d_name, len);
+        r_watch_ingest(h, f, 0);
+    }
+    if (dir != NULL)
+        closedir(dir);
+    ccn_charbuf_destroy(&path);
+    /* Whatever was not seen is gone */
+    hashtb_start(w->files, e);
+    while (e->data != NULL) {
+        f = e->data;
+        if (f->scan == w->scan)
+            hashtb_next(e);
+        else {
+            r_watch_ingest(h, f, 1);
+            hashtb_delete(e);
+        }
+    }
+    hashtb_end(e);
+}
+
+#if defined(CCNR_HAVE_INOTIFY)
+static void
+r_watch_event(struct ccnr_handle *h, const struct inotify_event *ev)
+{
+    struct ccnr_watch *w = h->watch;
+    struct watch_file *f = NULL;
+    size_t len;
+
+    if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+        w->rescan = 1;
+        return;
+    }
+    if (ev->len == 0 || (ev->mask & IN_ISDIR) != 0 || ev->name[0] == '.')
+        return;
+    len = strlen(ev->name);
+    f = r_watch_file(w, ev->name, len, NULL);
+    if (f == NULL)
+        return;
+    if ((ev->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+        r_watch_ingest(h, f, 1);
+        r_watch_forget(w, ev->name, len);
+        return;
+    }
+    if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        r_watch_ingest(h, f, 1);
+        r_watch_begin(h, f, ev->name, len);
+    }
+    else if (f->fd == -1)
+        r_watch_begin(h, f, ev->name, len);
+    r_watch_ingest(h, f, 0);
+}
+#endif
+
+/**
+ * Read the inotify events and act on them.
+ */
+PUBLIC void
+r_watch_process(struct ccnr_handle *h)
+{
+#if defined(CCNR_HAVE_INOTIFY)
+    struct ccnr_watch *w = h->watch;
+    const struct inotify_event *ev = NULL;
+    union {
+        struct inotify_event ev;
+        char buf[8192];
+    } u;
+    ssize_t n;
+    ssize_t i;
+
+    if (w == NULL || w->ifd == -1)
+        return;
+    while ((n = read(w->ifd, u.buf, sizeof(u.buf))) > 0) {
+        for (i = 0; i + (ssize_t)sizeof(*ev) <= n; i += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)(u.buf + i);
+            r_watch_event(h, ev);
+        }
+    }
+    if (w->rescan) {
+        w->rescan = 0;
+        r_watch_scan(h, 0);
+    }
+#endif
+}
+
+static int
+r_watch_tick(struct ccn_schedule *sched,
+             void *clienth,
+             struct ccn_scheduled_event *ev,
+             int flags)
+{
+    struct ccnr_handle *h = clienth;
+    struct ccnr_watch *w = h->watch;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct watch_file *f = NULL;
+    int held = 0;
+
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0 || w == NULL || w->tick != ev)
+        return(0);
+    if (w->ifd == -1)
+        r_watch_scan(h, 0);
+    hashtb_start(w->files, e);
+    for (f = e->data; f != NULL; f = e->data) {
+        if (f->fd != -1) {
+            f->idle++;
+            held |= r_watch_ingest(h, f, f->idle > w->idle);
+        }
+        hashtb_next(e);
+    }
+    hashtb_end(e);
+    return(held ? CCNR_WATCH_TICK / 100 : CCNR_WATCH_TICK);
+}
+
+/**
+ * Start watching CCNR_WATCH_DIRECTORY, if it is set.
+ * @returns 0 if watching, -1 if not.
+ */
+PUBLIC int
+r_watch_init(struct ccnr_handle *h)
+{
+    struct ccnr_watch *w = NULL;
+    struct hashtb_param param = {0};
+    const char *dir = NULL;
+    const char *uri = NULL;
+
+    dir = getenv("CCNR_WATCH_DIRECTORY");
+    if (dir == NULL || dir[0] == 0)
+        return(-1);
+    if (h->direct_signer == NULL)
+        return(-1);
+    uri = getenv("CCNR_WATCH_PREFIX");
+    if (uri == NULL || uri[0] == 0) {
+        ccnr_msg(h, "CCNR_WATCH_DIRECTORY needs CCNR_WATCH_PREFIX");
+        return(-1);
+    }
+    w = calloc(1, sizeof(*w));
+    if (w == NULL)
+        return(-1);
+    w->dir = dir;
+    w->ifd = -1;
+    w->prefix = ccn_charbuf_create();
+    w->buf = ccn_charbuf_create();
+    param.finalize = &r_watch_finalize_file;
+    w->files = hashtb_create(sizeof(struct watch_file), &param);
+    if (w->prefix == NULL || w->buf == NULL || w->files == NULL)
+        goto Bail;
+    if (ccn_name_from_uri(w->prefix, uri) < 0) {
+        ccnr_msg(h, "CCNR_WATCH_PREFIX: bad name %s", uri);
+        goto Bail;
+    }
+    w->blocksize = r_init_confval(h, "CCNR_WATCH_BLOCKSIZE", 1, 8192, 4096);
+    w->idle = r_init_confval(h, "CCNR_WATCH_IDLE", 1, 3600, 5);
+    if (ccn_charbuf_reserve(w->buf, w->blocksize) == NULL)
+        goto Bail;
+    h->watch = w;
+#if defined(CCNR_HAVE_INOTIFY)
+    w->ifd = inotify_init();
+    if (w->ifd != -1) {
+        fcntl(w->ifd, F_SETFL, O_NONBLOCK);
+        fcntl(w->ifd, F_SETFD, FD_CLOEXEC);
+        if (inotify_add_watch(w->ifd, dir, IN_CREATE | IN_MODIFY |
+                              IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == -1) {
+            ccnr_msg(h, "inotify %s: %s", dir, strerror(errno));
+            close(w->ifd);
+            w->ifd = -1;
+        }
+    }
+#endif
+    /* Files there already are left alone until they change */
+    r_watch_scan(h, 1);
+    w->tick = ccn_schedule_event(h->sched, CCNR_WATCH_TICK, &r_watch_tick, NULL, 0);
+    ccnr_msg(h, "watching %s for files to publish under %s", dir, uri);
+    return(0);
+Bail:
+    h->watch = NULL;
+    hashtb_destroy(&w->files);
+    ccn_charbuf_destroy(&w->prefix);
+    ccn_charbuf_destroy(&w->buf);
+    free(w);
+    return(-1);
+}
+
+/**
+ * Stop watching.
+ *
+ * A version still being published is left without its final segment.
+ */
+PUBLIC void
+r_watch_final(struct ccnr_handle *h)
+{
+    struct ccnr_watch *w = h->watch;
+
+    if (w == NULL)
+        return;
+    if (w->tick != NULL)
+        ccn_schedule_cancel(h->sched, w->tick);
+    w->tick = NULL;
+    if (w->ifd != -1)
+        close(w->ifd);
+    hashtb_destroy(&w->files);
+    ccn_charbuf_destroy(&w->prefix);
+    ccn_charbuf_destroy(&w->buf);
+    free(w);
+    h->watch = NULL;
+}
+
+/**
+ * @returns the fd to poll for directory changes, or -1 if none.
+ */
+PUBLIC int
+r_watch_fd(struct ccnr_handle *h)
+{
+    if (h->watch == NULL)
+        return(-1);
+    return(h->watch->ifd);
+}
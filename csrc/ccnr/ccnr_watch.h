@@ -0,0 +1,33 @@
+/**
+ * @file ccnr_watch.h
+ *
+ * Part of ccnr - CCNx Repository Daemon.
+ *
+ */
+
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CCNR_WATCH_DEFINED
+#define CCNR_WATCH_DEFINED
+
+#include "ccnr_private.h"
+
+int r_watch_init(struct ccnr_handle *h);
+void r_watch_final(struct ccnr_handle *h);
+int r_watch_fd(struct ccnr_handle *h);
+void r_watch_process(struct ccnr_handle *h);
+
+#endif
@@ -12,7 +12,7 @@
 # FOR A PARTICULAR PURPOSE.
 #
 
-LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -L$(SYNCLIBDIR) -lsync -lccn
+LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -L$(SYNCLIBDIR) -lsync -lccn -lpthread
 CCNLIBDIR = ../lib
 SYNCLIBDIR = ../sync
 # Override conf.mk or else we don't pick up all the includes
@@ -23,7 +23,7 @@ PROGRAMS = $(INSTALLED_PROGRAMS)
 DEBRIS = 
 
 BROKEN_PROGRAMS = 
-CSRC = ccnr_dispatch.c ccnr_forwarding.c ccnr_init.c ccnr_internal_client.c ccnr_io.c ccnr_link.c ccnr_main.c ccnr_match.c ccnr_msg.c ccnr_net.c ccnr_proto.c ccnr_sendq.c ccnr_stats.c ccnr_store.c ccnr_sync.c ccnr_util.c
+CSRC = ccnr_bulk.c ccnr_dispatch.c ccnr_forwarding.c ccnr_init.c ccnr_internal_client.c ccnr_io.c ccnr_link.c ccnr_main.c ccnr_match.c ccnr_msg.c ccnr_net.c ccnr_proto.c ccnr_sendq.c ccnr_stats.c ccnr_store.c ccnr_sync.c ccnr_util.c ccnr_verify.c ccnr_watch.c
 HSRC = ccnr_private.h
 SCRIPTSRC = 
  
@@ -33,7 +33,7 @@ all: default $(BROKEN_PROGRAMS)
 
 $(PROGRAMS): $(CCNLIBDIR)/libccn.a 
 
-CCNR_OBJ = ccnr_dispatch.o ccnr_forwarding.o ccnr_init.o ccnr_internal_client.o ccnr_io.o ccnr_link.o ccnr_main.o ccnr_match.o ccnr_msg.o ccnr_net.o ccnr_proto.o ccnr_sendq.o ccnr_stats.o ccnr_store.o ccnr_sync.o ccnr_util.o
+CCNR_OBJ = ccnr_bulk.o ccnr_dispatch.o ccnr_forwarding.o ccnr_init.o ccnr_internal_client.o ccnr_io.o ccnr_link.o ccnr_main.o ccnr_match.o ccnr_msg.o ccnr_net.o ccnr_proto.o ccnr_sendq.o ccnr_stats.o ccnr_store.o ccnr_sync.o ccnr_util.o ccnr_verify.o ccnr_watch.o
 
 ccnr: $(CCNR_OBJ) $(SYNCLIBDIR)/libsync.a
 	$(CC) $(CFLAGS) -o $@ $(CCNR_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
@@ -51,7 +51,13 @@ check test: ccnr $(SCRIPTSRC)
 # Dependencies below here are checked by depend target
 # but must be updated manually.
 ###############################
-ccnr_dispatch.o: ccnr_dispatch.c ../include/ccn/bloom.h \
+ccnr_bulk.o: ccnr_bulk.c ../include/ccn/btree.h ../include/ccn/charbuf.h \
+  ../include/ccn/hashtb.h ../include/ccn/btree_content.h \
+  ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/indexbuf.h \
+  ccnr_private.h ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/schedule.h ../include/ccn/seqwriter.h ccnr_bulk.h \
+  ccnr_init.h ccnr_io.h ccnr_msg.h ccnr_store.h
+ccnr_dispatch.o: ccnr_dispatch.c ../include/ccn/arena.h ../include/ccn/bloom.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
   ../include/ccn/face_mgmt.h ../include/ccn/sockcreate.h \
@@ -60,7 +66,7 @@ ccnr_dispatch.o: ccnr_dispatch.c ../include/ccn/bloom.h \
   ../ccnr/ccnr_private.h ../include/ccn/seqwriter.h ccnr_private.h \
   ccnr_dispatch.h ccnr_forwarding.h ccnr_io.h ccnr_link.h ccnr_match.h \
   ccnr_msg.h ccnr_proto.h ccnr_sendq.h ccnr_stats.h ccnr_store.h \
-  ccnr_sync.h ccnr_util.h
+  ccnr_sync.h ccnr_util.h ccnr_verify.h ccnr_watch.h
 ccnr_forwarding.o: ccnr_forwarding.c ../include/ccn/bloom.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
@@ -69,20 +75,23 @@ ccnr_forwarding.o: ccnr_forwarding.c ../include/ccn/bloom.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ccnr_private.h \
   ../include/ccn/seqwriter.h ccnr_forwarding.h ccnr_io.h ccnr_link.h \
   ccnr_match.h ccnr_msg.h ccnr_stats.h ccnr_util.h
-ccnr_init.o: ccnr_init.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
+ccnr_init.o: ccnr_init.c ../include/ccn/arena.h ../include/ccn/bloom.h ../include/ccn/btree.h \
+  ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
   ../include/ccn/face_mgmt.h ../include/ccn/sockcreate.h \
   ../include/ccn/hashtb.h ../include/ccn/schedule.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ../sync/SyncBase.h \
   ../ccnr/ccnr_private.h ../include/ccn/seqwriter.h ccnr_private.h \
-  ccnr_init.h ccnr_dispatch.h ccnr_forwarding.h ccnr_internal_client.h \
-  ccnr_io.h ccnr_msg.h ccnr_net.h ccnr_proto.h ccnr_sendq.h ccnr_store.h \
-  ccnr_sync.h ccnr_util.h
+  ccnr_init.h ccnr_bulk.h ccnr_dispatch.h ccnr_forwarding.h \
+  ccnr_internal_client.h ccnr_io.h ccnr_msg.h ccnr_net.h ccnr_proto.h \
+  ccnr_sendq.h ccnr_store.h ccnr_sync.h ccnr_util.h ccnr_verify.h \
+  ccnr_watch.h
 ccnr_internal_client.o: ccnr_internal_client.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
-  ../include/ccn/schedule.h ../include/ccn/sockaddrutil.h \
+  ../include/ccn/schedule.h ../include/ccn/signer.h \
+  ../include/ccn/sockaddrutil.h \
   ../include/ccn/uri.h ../include/ccn/keystore.h ccnr_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h \
   ccnr_internal_client.h ccnr_forwarding.h ../include/ccn/hashtb.h \
@@ -94,7 +103,8 @@ ccnr_io.o: ccnr_io.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/hashtb.h ../include/ccn/schedule.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ccnr_private.h \
   ../include/ccn/seqwriter.h ccnr_io.h ccnr_forwarding.h \
-  ccnr_internal_client.h ccnr_link.h ccnr_msg.h ccnr_sendq.h ccnr_stats.h
+  ccnr_internal_client.h ccnr_link.h ccnr_msg.h ccnr_sendq.h ccnr_stats.h \
+  ccnr_store.h ccnr_verify.h ccnr_watch.h
 ccnr_link.o: ccnr_link.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
@@ -104,8 +114,8 @@ ccnr_link.o: ccnr_link.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/seqwriter.h ccnr_link.h ccnr_forwarding.h \
   ccnr_internal_client.h ccnr_io.h ccnr_match.h ccnr_msg.h ccnr_sendq.h \
   ccnr_stats.h ccnr_store.h ccnr_util.h
-ccnr_main.o: ccnr_main.c ccnr_private.h ../include/ccn/ccn_private.h \
-  ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
+ccnr_main.o: ccnr_main.c ccnr_private.h ../include/ccn/ccn.h \
+  ../include/ccn/ccn_private.h ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/charbuf.h ../include/ccn/schedule.h \
   ../include/ccn/seqwriter.h ccnr_init.h ccnr_dispatch.h ccnr_msg.h \
   ccnr_stats.h
@@ -122,18 +132,19 @@ ccnr_msg.o: ccnr_msg.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h \
   ccnr_private.h ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/schedule.h ../include/ccn/seqwriter.h ccnr_msg.h
-ccnr_net.o: ccnr_net.c ccnr_private.h ../include/ccn/ccn_private.h \
-  ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
+ccnr_net.o: ccnr_net.c ccnr_private.h ../include/ccn/ccn.h \
+  ../include/ccn/ccn_private.h ../include/ccn/coding.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/charbuf.h ../include/ccn/schedule.h \
   ../include/ccn/seqwriter.h ccnr_net.h ccnr_io.h ccnr_msg.h
 ccnr_proto.o: ccnr_proto.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccn_private.h ../include/ccn/schedule.h \
+  ../include/ccn/signer.h \
   ../include/ccn/sockaddrutil.h ../include/ccn/uri.h ../sync/SyncBase.h \
   ../ccnr/ccnr_private.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/seqwriter.h ccnr_private.h ccnr_proto.h ccnr_dispatch.h \
   ccnr_forwarding.h ../include/ccn/hashtb.h ccnr_init.h ccnr_io.h \
-  ccnr_msg.h ccnr_sendq.h ccnr_store.h ccnr_sync.h ccnr_util.h
+  ccnr_msg.h ccnr_sendq.h ccnr_store.h ccnr_sync.h ccnr_util.h ccnr_verify.h
 ccnr_sendq.o: ccnr_sendq.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
@@ -142,22 +153,25 @@ ccnr_sendq.o: ccnr_sendq.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ccnr_private.h \
   ../include/ccn/seqwriter.h ccnr_sendq.h ccnr_io.h ccnr_link.h \
   ccnr_msg.h ccnr_store.h
-ccnr_stats.o: ccnr_stats.c ../include/ccn/ccn.h ../include/ccn/coding.h \
-  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+ccnr_stats.o: ccnr_stats.c ../include/ccn/btree.h \
+  ../include/ccn/charbuf.h ../include/ccn/hashtb.h ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/indexbuf.h \
   ../include/ccn/schedule.h ../include/ccn/sockaddrutil.h \
-  ../include/ccn/hashtb.h ../include/ccn/uri.h ccnr_private.h \
+  ../include/ccn/uri.h ccnr_private.h \
   ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
-  ../include/ccn/seqwriter.h ccnr_stats.h ccnr_io.h ccnr_msg.h
+  ../include/ccn/seqwriter.h ../sync/SyncBase.h ccnr_stats.h ccnr_io.h \
+  ccnr_msg.h
 ccnr_store.o: ccnr_store.c ../include/ccn/bloom.h \
   ../include/ccn/btree_content.h ../include/ccn/btree.h \
   ../include/ccn/charbuf.h ../include/ccn/hashtb.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccn_private.h ../include/ccn/face_mgmt.h \
   ../include/ccn/sockcreate.h ../include/ccn/schedule.h \
-  ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ccnr_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ../include/ccn/uring.h \
+  ccnr_private.h \
   ../include/ccn/seqwriter.h ccnr_stats.h ccnr_store.h ccnr_init.h \
   ccnr_link.h ccnr_util.h ccnr_proto.h ccnr_msg.h ccnr_sync.h \
-  ccnr_match.h ccnr_sendq.h ccnr_io.h
+  ccnr_match.h ccnr_sendq.h ccnr_io.h ccnr_bulk.h
 ccnr_sync.o: ccnr_sync.c ../include/ccn/btree.h ../include/ccn/charbuf.h \
   ../include/ccn/hashtb.h ../include/ccn/btree_content.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/indexbuf.h \
@@ -165,11 +179,24 @@ ccnr_sync.o: ccnr_sync.c ../include/ccn/btree.h ../include/ccn/charbuf.h \
   ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/seqwriter.h ccnr_private.h ccnr_dispatch.h ccnr_io.h \
   ccnr_link.h ccnr_msg.h ccnr_proto.h ccnr_store.h ccnr_sync.h \
-  ccnr_util.h
-ccnr_util.o: ccnr_util.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
+  ccnr_util.h ccnr_verify.h
+ccnr_util.o: ccnr_util.c ../include/ccn/arena.h ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
   ../include/ccn/face_mgmt.h ../include/ccn/sockcreate.h \
   ../include/ccn/hashtb.h ../include/ccn/schedule.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h ccnr_private.h \
   ../include/ccn/seqwriter.h ccnr_util.h
+ccnr_verify.o: ccnr_verify.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/signing.h ccnr_private.h ../include/ccn/ccn_private.h \
+  ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
+  ../include/ccn/seqwriter.h ccnr_verify.h ccnr_init.h ccnr_msg.h \
+  ccnr_proto.h
+ccnr_watch.o: ccnr_watch.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/hashtb.h ../include/ccn/schedule.h \
+  ../include/ccn/signer.h ../include/ccn/uri.h ccnr_private.h \
+  ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
+  ../include/ccn/seqwriter.h ccnr_watch.h ccnr_dispatch.h ccnr_init.h \
+  ccnr_msg.h ccnr_store.h
@@ -27,6 +27,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
@@ -87,8 +89,7 @@ struct ccn_decoder {
     int sstate;
     struct ccn_decoder_stack_item *stack;
     struct ccn_charbuf *stringstack;
-    const struct ccn_dict_entry *tagdict;
-    int tagdict_count;
+    struct ccn_dict_index *tagindex;
     ccn_decoder_callback callback;
     void *callbackdata;
     int formatting_flags;
@@ -112,8 +113,12 @@ ccn_decoder_create(int formatting_flags, const struct ccn_dict *dtags)
         return(NULL);
     }
     d->schema = CCN_NO_SCHEMA;
-    d->tagdict = dtags->dict;
-    d->tagdict_count = dtags->count;
+    d->tagindex = ccn_dict_index_create(dtags);
+    if (d->tagindex == NULL) {
+        ccn_charbuf_destroy(&d->stringstack);
+        free(d);
+        return(NULL);
+    }
     d->formatting_flags = formatting_flags;
     d->annotation = NULL;
     return(d);
@@ -171,21 +176,12 @@ ccn_decoder_destroy(struct ccn_decoder **dp)
             ccn_decoder_pop(d);
         }
         ccn_charbuf_destroy(&(d->stringstack));
+        ccn_dict_index_destroy(&(d->tagindex));
         free(d);
         *dp = NULL;
     }
 }
 
-static const char *
-dict_name_from_number(int ndx, const struct ccn_dict_entry *dict, int n)
-{
-    int i;
-    for (i = 0; i < n; i++)
-        if (ndx == dict[i].index)
-            return (dict[i].name);
-    return (NULL);
-}
-
 static const char Base64[] =
   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -338,7 +334,7 @@ ccn_decoder_decode(struct ccn_decoder *d, unsigned char p[], size_t n)
                             d->sstate = 0;
                             tagname = NULL;
                             if (numval <= INT_MAX)
-                                tagname = dict_name_from_number(numval, d->tagdict, d->tagdict_count);
+                                tagname = ccn_dict_index_name(d->tagindex, numval);
                             if (tagname == NULL) {
                                 fprintf(stderr,
                                         "*** Warning: unrecognized DTAG %lu\n",
@@ -635,14 +631,41 @@ process_data(struct ccn_decoder *d, unsigned char *data, size_t n)
     return(res);
 }
 
+/**
+ * Map a regular file, so that big captures need not be copied into memory.
+ * @returns 0 if it was processed, -1 if it must be read instead.
+ */
+static int
+process_mapped_fd(struct ccn_decoder *d, int fd, int *resp)
+{
+    struct stat st;
+    void *map;
+    
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (off_t)(size_t)st.st_size != st.st_size)
+        return(-1);
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        return(-1);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    fprintf(stderr, " <!-- input is %6lu bytes -->\n", (unsigned long)st.st_size);
+    *resp = process_data(d, map, st.st_size);
+    munmap(map, st.st_size);
+    return(0);
+}
+
 static int
 process_fd(struct ccn_decoder *d, int fd)
 {
-    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct ccn_charbuf *c;
     ssize_t len;
     int res = 0;
+    
+    if (process_mapped_fd(d, fd, &res) == 0)
+        return(res);
+    c = ccn_charbuf_create();
     for (;;) {
-        unsigned char *p = ccn_charbuf_reserve(c, 80);
+        unsigned char *p = ccn_charbuf_reserve(c, 65536);
         if (p == NULL) {
             perror("ccn_charbuf_reserve");
             res = 1;
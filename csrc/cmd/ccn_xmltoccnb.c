@@ -57,8 +57,7 @@ struct ccn_encoder {
     int is_hexBinary;
     int is_text;
     int toss_white;
-    const struct ccn_dict_entry *tagdict;
-    int tagdict_count;
+    struct ccn_dict_index *tagindex;
     FILE *outfile;
 };
 
@@ -134,14 +133,16 @@ base64_decode_bytes(struct base64_decoder *d, const void *p, size_t count)
     d->result_size = oi;
 }
 
-static int
-dict_lookup(const char *key, const struct ccn_dict_entry *dict, int n)
+void
+ccn_encoder_destroy(struct ccn_encoder **cbp)
 {
-    int i;
-    for (i = 0; i < n; i++)
-        if (0 == strcmp(key, dict[i].name))
-            return (dict[i].index);
-    return (-1);
+    struct ccn_encoder *c = *cbp;
+    if (c != NULL) {
+        ccn_charbuf_destroy(&c->openudata);
+        ccn_dict_index_destroy(&c->tagindex);
+        free(c);
+        *cbp = NULL;
+    }
 }
 
 struct ccn_encoder *
@@ -154,23 +155,13 @@ ccn_encoder_create(FILE *outfile, const struct ccn_dict *dtags)
         if (c->openudata != NULL)
             ccn_charbuf_reserve(c->openudata, 128);
         c->outfile = outfile;
-        c->tagdict = dtags->dict;
-        c->tagdict_count = dtags->count;
+        c->tagindex = ccn_dict_index_create(dtags);
+        if (c->openudata == NULL || c->tagindex == NULL)
+            ccn_encoder_destroy(&c);
     }
     return(c);
 }
 
-void
-ccn_encoder_destroy(struct ccn_encoder **cbp)
-{
-    struct ccn_encoder *c = *cbp;
-    if (c != NULL) {
-        ccn_charbuf_destroy(&c->openudata);
-        free(c);
-        *cbp = NULL;
-    }
-}
-
 static void
 emit_bytes(struct ccn_encoder *u, const void *p, size_t length)
 {
@@ -302,7 +293,7 @@ emit_name(struct ccn_encoder *u, enum ccn_tt tt, const void *name)
     if (length == 0) return; /* should never happen */
     finish_openudata(u);
     if (tt == CCN_TAG) {
-        dictindex = dict_lookup(name, u->tagdict, u->tagdict_count);
+        dictindex = ccn_dict_index_lookup(u->tagindex, name);
         if (dictindex >= 0) {
             emit_tt(u, dictindex, CCN_DTAG);
             return;
@@ -138,6 +138,8 @@ main(int argc, char **argv)
         face_instance->descr.port = CCN_DEFAULT_UNICAST_PORT;
     face_instance->descr.mcast_ttl = -1;
     face_instance->lifetime = (~0U) >> 1;
+    face_instance->rate = -1;
+    face_instance->burst = -1;
     
     CHKRES(res = ccnb_append_face_instance(newface, face_instance));
     temp->length = 0;
@@ -227,6 +229,10 @@ main(int argc, char **argv)
     forwarding_entry->name_prefix = name_prefix;
     forwarding_entry->faceid = face_instance->faceid;
     forwarding_entry->lifetime = (~0U) >> 1;
+    forwarding_entry->store_quota = -1;
+    forwarding_entry->traffic_class = -1;
+    forwarding_entry->default_freshness = -1;
+    forwarding_entry->max_residency = -1;
     prefixreg = ccn_charbuf_create();
     CHKRES(res = ccnb_append_forwarding_entry(prefixreg, forwarding_entry));
     temp->length = 0;
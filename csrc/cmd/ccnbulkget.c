@@ -0,0 +1,210 @@
+/**
+ * @file ccnbulkget.c
+ * Fetches streams at the given CCNx URIs into files, all at once
+ *
+ * A CCNx command-line utility.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/uri.h>
+#include <ccn/fetch.h>
+
+/**
+ * Provide usage hints for the program and then exit with a non-zero status.
+ */
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-h] [-d flags] [-p pipeline] [-b budget] [-s scope] [-a] "
+            "[-o dir] ccnx:/a/b ...\n"
+            "  Fetches streams at the given ccn URIs in parallel, writing each\n"
+            "  to a file named by the last component of its URI\n"
+            "  -h produces this message\n"
+            "  -d flags specifies the fetch debug flags (as for ccncat)\n"
+            "  -p pipeline specifies the size of the pipeline of each stream.\n"
+            "     Default 32.\n"
+            "  -b budget limits the interests in flight for all of the streams\n"
+            "     together.  Default 0 (no limit beyond the pipelines).\n"
+            "  -s scope specifies the scope for the interests.  Default unlimited.\n"
+            "     scope = 0 (cache), 1 (local), 2 (neighborhood), 3 (unlimited).\n"
+            "  -a allow stale data\n"
+            "  -o dir puts the files in dir rather than the current directory\n",
+            progname);
+    exit(1);
+}
+
+static struct ccn_charbuf *
+make_template(int allow_stale, int scope)
+{
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
+    ccn_charbuf_append_closer(templ); /* </Name> */
+    ccn_charbuf_append_tt(templ, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
+    ccnb_append_number(templ, 1);
+    ccn_charbuf_append_closer(templ); /* </MaxSuffixComponents> */
+    if (allow_stale) {
+        ccn_charbuf_append_tt(templ, CCN_DTAG_AnswerOriginKind, CCN_DTAG);
+        ccnb_append_number(templ, CCN_AOK_DEFAULT | CCN_AOK_STALE);
+        ccn_charbuf_append_closer(templ); /* </AnswerOriginKind> */
+    }
+    if (scope >= 0 && scope <= 2) {
+        ccnb_tagged_putf(templ, CCN_DTAG_Scope, "%d", scope);
+    }
+    ccn_charbuf_append_closer(templ); /* </Interest> */
+    return(templ);
+}
+
+/**
+ * Find the file name for a URI - its last component, as written.
+ * @returns NULL if there is no usable one.
+ */
+static const char *
+file_name(const char *uri)
+{
+    const char *s = strrchr(uri, '/');
+    s = (s == NULL) ? uri : s + 1;
+    if (s[0] == 0 || strcmp(s, ".") == 0 || strcmp(s, "..") == 0)
+        return(NULL);
+    return(s);
+}
+
+/**
+ * Process options, open a file for each CCNx URI, and fetch them all.
+ */
+int
+main(int argc, char **argv)
+{
+    struct ccn *ccn = NULL;
+    struct ccn_fetch *fetch = NULL;
+    struct ccn_charbuf **names = NULL;
+    struct ccn_charbuf *templ = NULL;
+    struct ccn_charbuf *path = NULL;
+    intmax_t *results = NULL;
+    int *fds = NULL;
+    const char *dir = ".";
+    int dflag = 0;
+    int allow_stale = 0;
+    int scope = -1;
+    int pipeline = 32;
+    int budget = 0;
+    int n;
+    int i;
+    int res;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "hab:d:o:p:s:")) != -1) {
+        switch (opt) {
+            case 'a':
+                allow_stale = 1;
+                break;
+            case 'b':
+                budget = atoi(optarg);
+                if (budget < 0)
+                    usage(argv[0]);
+                break;
+            case 'd':
+                dflag = atoi(optarg);
+                break;
+            case 'o':
+                dir = optarg;
+                break;
+            case 'p':
+                pipeline = atoi(optarg);
+                if (pipeline <= 0)
+                    usage(argv[0]);
+                break;
+            case 's':
+                scope = atoi(optarg);
+                if (scope < 0 || scope > 3)
+                    usage(argv[0]);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    n = argc - optind;
+    if (n <= 0)
+        usage(argv[0]);
+    names = calloc(n, sizeof(*names));
+    fds = calloc(n, sizeof(*fds));
+    results = calloc(n, sizeof(*results));
+    path = ccn_charbuf_create();
+    /* Check the args first */
+    for (i = 0; i < n; i++) {
+        const char *arg = argv[optind + i];
+        names[i] = ccn_charbuf_create();
+        res = ccn_name_from_uri(names[i], arg);
+        if (res < 0 || file_name(arg) == NULL) {
+            fprintf(stderr, "%s: bad ccn URI: %s\n", argv[0], arg);
+            exit(1);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        path->length = 0;
+        ccn_charbuf_putf(path, "%s/%s", dir, file_name(argv[optind + i]));
+        fds[i] = open(ccn_charbuf_as_string(path), O_WRONLY | O_CREAT, 0666);
+        if (fds[i] == -1) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0],
+                    ccn_charbuf_as_string(path), strerror(errno));
+            exit(1);
+        }
+    }
+
+    ccn = ccn_create();
+    if (ccn_connect(ccn, NULL) == -1) {
+        perror("Could not connect to ccnd");
+        exit(1);
+    }
+
+    templ = make_template(allow_stale, scope);
+
+    fetch = ccn_fetch_new(ccn);
+    if (dflag) {
+        ccn_fetch_set_debug(fetch, stderr, dflag);
+    }
+    ccn_fetch_set_budget(fetch, budget);
+    res = ccn_fetch_bulk(fetch, n, names, fds, results, templ, pipeline,
+                         CCN_V_HIGHEST);
+    for (i = 0; i < n; i++) {
+        const char *arg = argv[optind + i];
+        if (results[i] == CCN_FETCH_READ_TIMEOUT)
+            fprintf(stderr, "%s: timed out: %s\n", argv[0], arg);
+        else if (results[i] == CCN_FETCH_READ_ZERO)
+            fprintf(stderr, "%s: missing data: %s\n", argv[0], arg);
+        else if (results[i] < 0)
+            fprintf(stderr, "%s: fetch error: %s\n", argv[0], arg);
+        close(fds[i]);
+        ccn_charbuf_destroy(&names[i]);
+    }
+    fetch = ccn_fetch_destroy(fetch);
+    ccn_destroy(&ccn);
+    ccn_charbuf_destroy(&templ);
+    ccn_charbuf_destroy(&path);
+    free(names);
+    free(fds);
+    free(results);
+    exit(res == n ? 0 : 1);
+}
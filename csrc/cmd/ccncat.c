@@ -34,7 +34,7 @@ static void
 usage(const char *progname)
 {
     fprintf(stderr,
-            "%s [-h] [-d flags] [-p pipeline] [-s scope] [-a] ccnx:/a/b ...\n"
+            "%s [-h] [-d flags] [-p pipeline] [-s scope] [-a] [-c] [-m] ccnx:/a/b ...\n"
             "  Reads streams at the given ccn URIs and writes to stdout\n"
             "  -h produces this message\n"
             "  -d flags specifies the fetch debug flags which are the sum of\n"
@@ -44,12 +44,15 @@ usage(const char *progname)
             "    NoteFill = 8,\n"
             "    NoteFinal = 16,\n"
             "    NoteTimeout = 32,\n"
-            "    NoteOpenClose = 64\n"
+            "    NoteOpenClose = 64,\n"
+            "    NoteWindow = 128\n"
             "  -p pipeline specifies the size of the pipeline.  Default 4.\n"
-            "     pipeline >= 0.\n"
+            "     pipeline >= 0.  The congestion window grows to at most this.\n"
             "  -s scope specifies the scope for the interests.  Default unlimited.\n"
             "     scope = 0 (cache), 1 (local), 2 (neighborhood), 3 (unlimited).\n"
-            "  -a allow stale data\n",
+            "  -a allow stale data\n"
+            "  -c grow the congestion window with CUBIC rather than AIMD\n"
+            "  -m fetch by way of the manifest, checking one signature\n",
             progname);
     exit(1);
 }
@@ -92,19 +95,27 @@ main(int argc, char **argv)
     const char *arg = NULL;
     int dflag = 0;
     int allow_stale = 0;
+    int cubic = 0;
+    int manifest = 0;
     int scope = -1;
     int pipeline = 4;
-    unsigned char buf[8192];
+    const unsigned char *data = NULL;
     int i;
     int res;
     int opt;
     int assumeFixed = 0; // variable only for now
     
-    while ((opt = getopt(argc, argv, "had:p:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "hacmd:p:s:")) != -1) {
         switch (opt) {
             case 'a':
                 allow_stale = 1;
                 break;
+            case 'c':
+                cubic = 1;
+                break;
+            case 'm':
+                manifest = 1;
+                break;
             case 'd':
                 dflag = atoi(optarg);
                 break;
@@ -157,9 +168,16 @@ main(int argc, char **argv)
         if (NULL == stream) {
             continue;
         }
-        while ((res = ccn_fetch_read(stream, buf, sizeof(buf))) != 0) {
+        if (cubic)
+            ccn_fetch_set_window_mode(stream, ccn_fetch_window_CUBIC);
+        if (manifest && ccn_fetch_use_manifest(stream, 8000) < 0) {
+            fprintf(stderr, "%s: no manifest: %s\n", argv[0], arg);
+            stream = ccn_fetch_close(stream);
+            continue;
+        }
+        while ((res = ccn_fetch_read_view(stream, &data, INTMAX_MAX)) != 0) {
             if (res > 0) {
-                fwrite(buf, res, 1, stdout);
+                fwrite(data, res, 1, stdout);
             } else if (res == CCN_FETCH_READ_NONE) {
                 fflush(stdout);
                 if (ccn_run(ccn, 1000) < 0) {
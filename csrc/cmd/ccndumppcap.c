@@ -4,6 +4,9 @@
  * by ccndump), and writes them to a pcap file. Uses the splitting
  * code from ccn_splitccnb.
  *
+ * With -r it goes the other way, reading captures and writing out the
+ * ccnb messages they carry, or with -s a per-prefix summary of them.
+ *
  * A CCNx command-line utility.
  *
  * Copyright (C) 2008, 2009 Palo Alto Research Center, Inc.
@@ -25,15 +28,21 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 
 #include <pcap.h>
 #include <ccn/ccn.h>
 #include <ccn/ccnd.h>
+#include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
+#include <ccn/uri.h>
 
 #define LLC_LENGTH 4
 #define IP_OFFSET LLC_LENGTH
@@ -52,6 +61,7 @@
 #define MAX_PACKET 65536
 #define DEFAULT_SRC_PORT 55555
 #define DEFAULT_DEST_PORT CCN_DEFAULT_UNICAST_PORT_NUMBER
+#define DEFAULT_DEPTH 2
 
 static void
 usage(const char *progname)
@@ -60,8 +70,17 @@ usage(const char *progname)
             "%s <infile> [<infile> ...]\n"
             "   Reads ccnb blocks from one or more files, and writes them in pcap format\n"
             "   to stdout.\n"
-            "   ccnb blocks can be generated by any of the other utility programs.\n",
-            progname);
+            "   ccnb blocks can be generated by any of the other utility programs.\n"
+            "%s -r [-s] [-p n] [-j n] <capture> [<capture> ...]\n"
+            "   Reads pcap captures, and writes the Interests and ContentObjects\n"
+            "   they carry (over UDP, TCP or ethernet) to stdout as ccnb, in\n"
+            "   capture time order.  A TCP segment gives only the messages that\n"
+            "   start and end within it.\n"
+            "   -s  write a summary instead: Interest and Data counts and\n"
+            "       Interest-to-Data latency for each name prefix\n"
+            "   -p n  group names by their first n components (default %d)\n"
+            "   -j n  decode with n threads (default one per processor)\n",
+            progname, progname, DEFAULT_DEPTH);
     exit(1);
 }
 
@@ -244,6 +263,744 @@ process_fd(pcap_dumper_t *pcap_out, int fd, int content_only,
     return(res);
 }
 
+/*
+ * Reading captures.
+ *
+ * A capture is mapped and walked record by record, and cut into chunks
+ * of whole records that worker threads decode while the walk goes on.
+ * Each chunk collects the Interests and ContentObjects it finds, in
+ * capture order.  When all are done, the chunks are merged by capture
+ * time, so that the output (or the summary) sees the messages from all
+ * the captures in the order they were seen on the wire.
+ *
+ * Captures are read directly rather than through libpcap, which can
+ * only go through a file from one end to the other.
+ */
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define PCAP_FILE_HDR       24
+#define PCAP_REC_HDR        16
+#define LINKTYPE_NULL       0
+#define LINKTYPE_ETHERNET   1
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LOOP       108
+#define LINKTYPE_LINUX_SLL  113
+#define LINKTYPE_IPV4       228
+#define LINKTYPE_IPV6       229
+#define CCND_ETHERTYPE      0x88B5
+#define CHUNK_BYTES         (4 << 20)
+#define PENDING_USEC        4000000 /* forget Interests unanswered this long */
+
+struct capture {
+    const char *path;
+    const unsigned char *buf;
+    size_t size;
+    int swapped;                /* written with the other byte order */
+    int nsec;                   /* timestamps in nanoseconds */
+    unsigned linktype;
+};
+
+enum msg_kind {
+    MSG_INTEREST = 1,
+    MSG_DATA
+};
+
+struct cap_msg {
+    uint64_t usec;              /* capture time */
+    size_t off;                 /* the ccnb message, within the capture */
+    uint32_t size;
+    uint32_t name;              /* first name component, from off */
+    uint32_t comp;              /* component boundaries, in chunk comps */
+    unsigned short ncomps;
+    unsigned char kind;
+};
+
+struct cap_chunk {
+    struct capture *cap;
+    int seq;                    /* position among all chunks */
+    size_t start;               /* first record */
+    size_t end;                 /* just past the last record */
+    struct cap_msg *msg;
+    size_t n;
+    size_t limit;
+    size_t next;                /* for the merge */
+    struct ccn_indexbuf *comps; /* boundaries, relative to each name */
+    unsigned long packets;
+    unsigned long skipped;      /* packets that carry nothing we know */
+    unsigned long partial;      /* payloads with undecodable bytes */
+};
+
+struct reader {
+    pthread_mutex_t lock;
+    pthread_cond_t more;
+    struct cap_chunk **chunk;
+    int nchunks;
+    int limit;
+    int next;                   /* next chunk to decode */
+    int done;                   /* no more chunks coming */
+    int summary;                /* keep name boundaries too */
+};
+
+static uint32_t
+cap_u32(const struct capture *cap, size_t off)
+{
+    uint32_t v;
+    
+    memcpy(&v, cap->buf + off, sizeof(v));
+    if (cap->swapped)
+        v = ((v >> 24) | ((v >> 8) & 0xff00) |
+             ((v << 8) & 0xff0000) | (v << 24));
+    return(v);
+}
+
+/**
+ * Find the payload of an IPv4 or IPv6 packet that carries UDP or TCP.
+ *
+ * A TCP segment gives only the messages that start and end within it.
+ * @returns 0, or -1 if there is nothing to look at.
+ */
+static int
+ip_payload(const unsigned char *p, size_t n,
+           const unsigned char **pay, size_t *plen)
+{
+    size_t hl;
+    size_t len;
+    unsigned proto;
+    
+    if (n < 1)
+        return(-1);
+    if ((p[0] >> 4) == 4) {
+        if (n < 20)
+            return(-1);
+        hl = (p[0] & 15) * 4;
+        len = (p[2] << 8) | p[3];
+        /* Fragments after the first carry no header to go by */
+        if ((p[6] & 0x3f) != 0 || p[7] != 0)
+            return(-1);
+        proto = p[9];
+    }
+    else if ((p[0] >> 4) == 6) {
+        if (n < 40)
+            return(-1);
+        hl = 40;
+        len = 40 + ((p[4] << 8) | p[5]);
+        proto = p[6];
+    }
+    else
+        return(-1);
+    if (len < n)
+        n = len;
+    if (hl < 20 || hl > n)
+        return(-1);
+    p += hl;
+    n -= hl;
+    if (proto == 17)
+        hl = 8;
+    else if (proto == 6 && n >= 20)
+        hl = (p[12] >> 4) * 4;
+    else
+        return(-1);
+    if (hl < 8 || hl >= n)
+        return(-1);
+    *pay = p + hl;
+    *plen = n - hl;
+    return(0);
+}
+
+/**
+ * Find the part of a captured packet that may hold ccnb.
+ * @returns 0, or -1 if there is nothing to look at.
+ */
+static int
+packet_payload(unsigned linktype, const unsigned char *p, size_t n,
+               const unsigned char **pay, size_t *plen)
+{
+    unsigned type = 0x0800;
+    
+    switch (linktype) {
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            if (n < 4)
+                return(-1);
+            p += 4;
+            n -= 4;
+            break;
+        case LINKTYPE_ETHERNET:
+            if (n < 14)
+                return(-1);
+            type = (p[12] << 8) | p[13];
+            p += 14;
+            n -= 14;
+            if (type == 0x8100 && n >= 4) {
+                type = (p[2] << 8) | p[3];
+                p += 4;
+                n -= 4;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if (n < 16)
+                return(-1);
+            type = (p[14] << 8) | p[15];
+            p += 16;
+            n -= 16;
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            break;
+        default:
+            return(-1);
+    }
+    if (type == CCND_ETHERTYPE) {
+        *pay = p;
+        *plen = n;
+        return(n > 0 ? 0 : -1);
+    }
+    if (type != 0x0800 && type != 0x86DD)
+        return(-1);
+    return(ip_payload(p, n, pay, plen));
+}
+
+static void
+note_message(struct reader *r, struct cap_chunk *c, uint64_t usec,
+             enum msg_kind kind, const unsigned char *msg, size_t size,
+             struct ccn_indexbuf *comps)
+{
+    struct cap_msg *m;
+    size_t i;
+    
+    if (c->n == c->limit) {
+        c->limit = c->limit ? 2 * c->limit : 1024;
+        c->msg = realloc(c->msg, c->limit * sizeof(c->msg[0]));
+        if (c->msg == NULL) {
+            perror("ccndumppcap");
+            exit(1);
+        }
+    }
+    m = &c->msg[c->n++];
+    m->usec = usec;
+    m->off = msg - c->cap->buf;
+    m->size = size;
+    m->name = comps->buf[0];
+    m->comp = c->comps->n;
+    m->ncomps = comps->n - 1;
+    m->kind = kind;
+    if (r->summary)
+        for (i = 0; i < comps->n; i++)
+            ccn_indexbuf_append_element(c->comps, comps->buf[i] - comps->buf[0]);
+}
+
+/**
+ * Note one message, or each one in a CCNProtocolDataUnit.
+ */
+static void
+decode_message(struct reader *r, struct cap_chunk *c, uint64_t usec,
+               const unsigned char *msg, size_t size,
+               struct ccn_indexbuf *comps, int pdu_ok)
+{
+    struct ccn_skeleton_decoder decoder = {0};
+    struct ccn_skeleton_decoder *d = &decoder;
+    struct ccn_parsed_interest pi = {0};
+    struct ccn_parsed_ContentObject pco = {0};
+    ssize_t dres;
+    
+    d->state |= CCN_DSTATE_PAUSE;
+    ccn_skeleton_decode(d, msg, size);
+    if (d->state < 0 || CCN_GET_TT_FROM_DSTATE(d->state) != CCN_DTAG)
+        return;
+    switch (d->numval) {
+        case CCN_DTAG_CCNProtocolDataUnit:
+            if (!pdu_ok)
+                return;
+            size -= d->index;
+            if (size > 0)
+                size--;
+            msg += d->index;
+            memset(d, 0, sizeof(*d));
+            while (d->index < size) {
+                dres = ccn_skeleton_decode(d, msg + d->index, size - d->index);
+                if (d->state != 0)
+                    return;
+                decode_message(r, c, usec, msg + d->index - dres, dres, comps, 0);
+            }
+            return;
+        case CCN_DTAG_Interest:
+            if (ccn_parse_interest(msg, size, &pi, comps) >= 0)
+                note_message(r, c, usec, MSG_INTEREST, msg, size, comps);
+            return;
+        case CCN_DTAG_ContentObject:
+            /* Only the name is wanted, so skip the rest of the parse */
+            if (ccn_parse_ContentObject_name(msg, size, &pco, comps) == 0)
+                note_message(r, c, usec, MSG_DATA, msg, size, comps);
+            return;
+        default:
+            return;
+    }
+}
+
+static void
+decode_chunk(struct reader *r, struct cap_chunk *c)
+{
+    struct ccn_skeleton_decoder decoder;
+    struct ccn_skeleton_decoder *d = &decoder;
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct capture *cap = c->cap;
+    const unsigned char *pay;
+    size_t plen;
+    size_t caplen;
+    size_t p;
+    size_t s;
+    uint64_t usec;
+    
+    c->comps = ccn_indexbuf_create();
+    for (p = c->start; p < c->end; p += PCAP_REC_HDR + caplen) {
+        caplen = cap_u32(cap, p + 8);
+        usec = (uint64_t)cap_u32(cap, p) * 1000000 +
+               (cap->nsec ? cap_u32(cap, p + 4) / 1000 : cap_u32(cap, p + 4));
+        c->packets++;
+        if (packet_payload(cap->linktype, cap->buf + p + PCAP_REC_HDR, caplen,
+                           &pay, &plen) < 0) {
+            c->skipped++;
+            continue;
+        }
+        while (plen > 0) {
+            memset(d, 0, sizeof(*d));
+            s = ccn_skeleton_decode(d, pay, plen);
+            if (d->state != 0 || s == 0) {
+                /* Ethernet pads short frames with zeros */
+                for (s = 0; s < plen && pay[s] == 0; s++)
+                    continue;
+                if (s < plen)
+                    c->partial++;
+                break;
+            }
+            decode_message(r, c, usec, pay, s, comps, 1);
+            pay += s;
+            plen -= s;
+        }
+    }
+    ccn_indexbuf_destroy(&comps);
+}
+
+static void *
+read_worker(void *arg)
+{
+    struct reader *r = arg;
+    struct cap_chunk *c;
+    
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (r->next == r->nchunks && !r->done)
+            pthread_cond_wait(&r->more, &r->lock);
+        if (r->next == r->nchunks)
+            break;
+        c = r->chunk[r->next++];
+        pthread_mutex_unlock(&r->lock);
+        decode_chunk(r, c);
+        pthread_mutex_lock(&r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return(NULL);
+}
+
+static void
+add_chunk(struct reader *r, struct capture *cap, size_t start, size_t end)
+{
+    struct cap_chunk *c = calloc(1, sizeof(*c));
+    
+    if (c == NULL) {
+        perror("ccndumppcap");
+        exit(1);
+    }
+    c->cap = cap;
+    c->start = start;
+    c->end = end;
+    pthread_mutex_lock(&r->lock);
+    if (r->nchunks == r->limit) {
+        r->limit = r->limit ? 2 * r->limit : 64;
+        r->chunk = realloc(r->chunk, r->limit * sizeof(r->chunk[0]));
+        if (r->chunk == NULL) {
+            perror("ccndumppcap");
+            exit(1);
+        }
+    }
+    c->seq = r->nchunks;
+    r->chunk[r->nchunks++] = c;
+    pthread_cond_signal(&r->more);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * Map a capture and hand it to the workers a chunk at a time.
+ * @returns 0, or -1 if it is not a capture we can read.
+ */
+static int
+split_capture(struct reader *r, struct capture *cap)
+{
+    struct stat st;
+    uint32_t magic;
+    size_t caplen;
+    size_t start;
+    size_t p;
+    void *map;
+    int fd;
+    
+    fd = open(cap->path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(cap->path);
+        return(-1);
+    }
+    if (st.st_size < PCAP_FILE_HDR) {
+        fprintf(stderr, "%s: not a pcap capture\n", cap->path);
+        close(fd);
+        return(-1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(cap->path);
+        return(-1);
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    cap->buf = map;
+    cap->size = st.st_size;
+    magic = cap_u32(cap, 0);
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC) {
+        cap->swapped = 1;
+        magic = cap_u32(cap, 0);
+    }
+    if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NSEC) {
+        fprintf(stderr, "%s: not a pcap capture\n", cap->path);
+        return(-1);
+    }
+    cap->nsec = (magic == PCAP_MAGIC_NSEC);
+    cap->linktype = cap_u32(cap, 20) & 0xffff;
+    fprintf(stderr, " <!-- %s is %6lu bytes, link type %u -->\n",
+            cap->path, (unsigned long)cap->size, cap->linktype);
+    for (start = p = PCAP_FILE_HDR; p + PCAP_REC_HDR <= cap->size;) {
+        caplen = cap_u32(cap, p + 8);
+        if (caplen > cap->size - p - PCAP_REC_HDR) {
+            fprintf(stderr, "%s: truncated at %lu\n",
+                    cap->path, (unsigned long)p);
+            break;
+        }
+        p += PCAP_REC_HDR + caplen;
+        if (p - start >= CHUNK_BYTES) {
+            add_chunk(r, cap, start, p);
+            start = p;
+        }
+    }
+    if (p > start)
+        add_chunk(r, cap, start, p);
+    return(0);
+}
+
+/* Order the merge by capture time, then by position in the captures */
+static int
+chunk_before(const struct cap_chunk *a, const struct cap_chunk *b)
+{
+    uint64_t x = a->msg[a->next].usec;
+    uint64_t y = b->msg[b->next].usec;
+    
+    if (x != y)
+        return(x < y);
+    return(a->seq < b->seq);
+}
+
+static void
+heap_down(struct cap_chunk **heap, int n, int i)
+{
+    struct cap_chunk *c = heap[i];
+    int j;
+    
+    for (; (j = 2 * i + 1) < n; i = j) {
+        if (j + 1 < n && chunk_before(heap[j + 1], heap[j]))
+            j++;
+        if (!chunk_before(heap[j], c))
+            break;
+        heap[i] = heap[j];
+    }
+    heap[i] = c;
+}
+
+/* Per-prefix totals for the summary */
+struct prefix_stats {
+    unsigned long interests;
+    unsigned long data;
+    unsigned long answered;     /* Data that followed a pending Interest */
+    uint64_t latency;           /* total usec, over answered */
+    uint64_t max_latency;
+    uintmax_t bytes;            /* of Data */
+};
+
+struct pending_interest {
+    uint64_t usec;
+};
+
+struct summary {
+    int depth;                  /* name components in a prefix */
+    struct hashtb *prefixes;    /* prefix_stats, by prefix components */
+    struct hashtb *pending;     /* pending_interest, by name components */
+    int sweep_at;               /* when to drop stale pending Interests */
+    size_t *hashes;
+    size_t nhashes;
+};
+
+static void
+sweep_pending(struct summary *s, uint64_t now)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct pending_interest *pi;
+    
+    for (hashtb_start(s->pending, e); e->data != NULL;) {
+        pi = e->data;
+        if (now - pi->usec > PENDING_USEC)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+    s->sweep_at = 2 * hashtb_n(s->pending);
+    if (s->sweep_at < 4096)
+        s->sweep_at = 4096;
+}
+
+static void
+summarize(struct summary *s, struct cap_chunk *c, struct cap_msg *m)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct prefix_stats *ps;
+    struct pending_interest *pi = NULL;
+    const unsigned char *key = c->cap->buf + m->off + m->name;
+    const size_t *bounds = c->comps->buf + m->comp;
+    uint64_t lat;
+    int k = m->ncomps < s->depth ? m->ncomps : s->depth;
+    int i;
+    
+    hashtb_start(s->prefixes, e);
+    hashtb_seek(e, key, bounds[k], 0);
+    ps = e->data;
+    hashtb_end(e);
+    if (ps == NULL)
+        return;
+    if (m->kind == MSG_INTEREST) {
+        ps->interests++;
+        hashtb_start(s->pending, e);
+        if (hashtb_seek(e, key, bounds[m->ncomps], 0) >= 0) {
+            pi = e->data;
+            if (pi->usec == 0 || m->usec - pi->usec > PENDING_USEC)
+                pi->usec = m->usec;
+        }
+        hashtb_end(e);
+        if (hashtb_n(s->pending) > s->sweep_at)
+            sweep_pending(s, m->usec);
+        return;
+    }
+    ps->data++;
+    ps->bytes += m->size;
+    if (m->ncomps + 1 > s->nhashes) {
+        s->nhashes = m->ncomps + 1;
+        s->hashes = realloc(s->hashes, s->nhashes * sizeof(s->hashes[0]));
+        if (s->hashes == NULL) {
+            perror("ccndumppcap");
+            exit(1);
+        }
+    }
+    /* The longest pending Interest name that is a prefix of this one */
+    hashtb_hash_prefixes(s->pending, key, bounds, m->ncomps + 1, s->hashes);
+    for (i = m->ncomps; i >= 0 && pi == NULL; i--)
+        pi = hashtb_lookup_hashed(s->pending, key, bounds[i], s->hashes[i]);
+    if (pi == NULL)
+        return;
+    i++;
+    if (m->usec >= pi->usec && m->usec - pi->usec <= PENDING_USEC) {
+        lat = m->usec - pi->usec;
+        ps->answered++;
+        ps->latency += lat;
+        if (lat > ps->max_latency)
+            ps->max_latency = lat;
+    }
+    hashtb_start(s->pending, e);
+    if (hashtb_seek_hashed(e, key, bounds[i], 0, s->hashes[i]) == HT_OLD_ENTRY)
+        hashtb_delete(e);
+    hashtb_end(e);
+}
+
+struct prefix_row {
+    const unsigned char *key;
+    size_t keysize;
+    struct prefix_stats *ps;
+};
+
+static int
+prefix_row_cmp(const void *a, const void *b)
+{
+    const struct prefix_row *x = a;
+    const struct prefix_row *y = b;
+    unsigned long nx = x->ps->interests + x->ps->data;
+    unsigned long ny = y->ps->interests + y->ps->data;
+    
+    if (nx != ny)
+        return(nx < ny ? 1 : -1);
+    if (x->keysize != y->keysize)
+        return(x->keysize < y->keysize ? -1 : 1);
+    return(memcmp(x->key, y->key, x->keysize));
+}
+
+static void
+print_summary(struct summary *s)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *uri = ccn_charbuf_create();
+    struct prefix_row *row;
+    struct prefix_stats *ps;
+    int n = hashtb_n(s->prefixes);
+    int i;
+    
+    row = calloc(n + 1, sizeof(row[0]));
+    if (row == NULL) {
+        perror("ccndumppcap");
+        exit(1);
+    }
+    for (i = 0, hashtb_start(s->prefixes, e); i < n; i++, hashtb_next(e)) {
+        row[i].key = e->key;
+        row[i].keysize = e->keysize;
+        row[i].ps = e->data;
+    }
+    hashtb_end(e);
+    qsort(row, n, sizeof(row[0]), &prefix_row_cmp);
+    printf("# prefix interests data answered mean_ms max_ms data_bytes\n");
+    for (i = 0; i < n; i++) {
+        ps = row[i].ps;
+        ccn_charbuf_reset(name);
+        ccn_charbuf_append_tt(name, CCN_DTAG_Name, CCN_DTAG);
+        ccn_charbuf_append(name, row[i].key, row[i].keysize);
+        ccn_charbuf_append_closer(name);
+        ccn_charbuf_reset(uri);
+        ccn_uri_append(uri, name->buf, name->length, 1);
+        printf("%s %lu %lu %lu %.3f %.3f %ju\n", ccn_charbuf_as_string(uri),
+               ps->interests, ps->data, ps->answered,
+               ps->answered ? ps->latency / 1000.0 / ps->answered : 0.0,
+               ps->max_latency / 1000.0, ps->bytes);
+    }
+    free(row);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&uri);
+}
+
+/**
+ * Read pcap captures, and write out the ccnb messages they carry, or
+ * a summary of them, in capture time order.
+ */
+static int
+read_captures(char **paths, int npaths, int summary, int depth, int nthreads)
+{
+    struct reader rr = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    struct reader *r = &rr;
+    struct summary ss = {0};
+    struct summary *s = &ss;
+    struct capture *caps;
+    struct cap_chunk **heap;
+    struct cap_chunk *c;
+    struct cap_msg *m;
+    pthread_t *threads;
+    unsigned long packets = 0;
+    unsigned long skipped = 0;
+    unsigned long partial = 0;
+    unsigned long msgs = 0;
+    int res = 0;
+    int n;
+    int i;
+    
+    r->summary = summary;
+    caps = calloc(npaths, sizeof(caps[0]));
+    threads = calloc(nthreads, sizeof(threads[0]));
+    if (caps == NULL || threads == NULL) {
+        perror("ccndumppcap");
+        return(1);
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, &read_worker, r) != 0) {
+            perror("ccndumppcap");
+            return(1);
+        }
+    }
+    for (i = 0; i < npaths; i++) {
+        caps[i].path = paths[i];
+        if (split_capture(r, &caps[i]) < 0)
+            res = 1;
+    }
+    pthread_mutex_lock(&r->lock);
+    r->done = 1;
+    pthread_cond_broadcast(&r->more);
+    pthread_mutex_unlock(&r->lock);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    heap = calloc(r->nchunks + 1, sizeof(heap[0]));
+    if (heap == NULL) {
+        perror("ccndumppcap");
+        return(1);
+    }
+    for (n = 0, i = 0; i < r->nchunks; i++) {
+        c = r->chunk[i];
+        packets += c->packets;
+        skipped += c->skipped;
+        partial += c->partial;
+        msgs += c->n;
+        if (c->n > 0)
+            heap[n++] = c;
+    }
+    for (i = n / 2 - 1; i >= 0; i--)
+        heap_down(heap, n, i);
+    if (summary) {
+        s->depth = depth;
+        s->prefixes = hashtb_create(sizeof(struct prefix_stats), NULL);
+        s->pending = hashtb_create(sizeof(struct pending_interest), NULL);
+        s->sweep_at = 4096;
+    }
+    while (n > 0) {
+        c = heap[0];
+        m = &c->msg[c->next++];
+        if (summary)
+            summarize(s, c, m);
+        else if (fwrite(c->cap->buf + m->off, 1, m->size, stdout) != m->size) {
+            perror("ccndumppcap");
+            res = 1;
+            break;
+        }
+        if (c->next == c->n)
+            heap[0] = heap[--n];
+        heap_down(heap, n, 0);
+    }
+    fprintf(stderr, " <!-- %lu packets, %lu messages, %lu skipped, %lu partial -->\n",
+            packets, msgs, skipped, partial);
+    if (summary) {
+        print_summary(s);
+        hashtb_destroy(&s->prefixes);
+        hashtb_destroy(&s->pending);
+        free(s->hashes);
+    }
+    for (i = 0; i < r->nchunks; i++) {
+        c = r->chunk[i];
+        free(c->msg);
+        ccn_indexbuf_destroy(&c->comps);
+        free(c);
+    }
+    for (i = 0; i < npaths; i++)
+        if (caps[i].buf != NULL)
+            munmap((void *)caps[i].buf, caps[i].size);
+    free(r->chunk);
+    free(heap);
+    free(caps);
+    free(threads);
+    return(res);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -252,9 +1009,44 @@ main(int argc, char **argv)
     int fd;
     int i;
     int res = 0;
+    int opt;
+    int reverse = 0;
+    int summary = 0;
+    int depth = DEFAULT_DEPTH;
+    int nthreads = 0;
     
-    if (argc < 2) {
+    while ((opt = getopt(argc, argv, "rsp:j:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                reverse = 1;
+                break;
+            case 's':
+                summary = 1;
+                break;
+            case 'p':
+                depth = atoi(optarg);
+                if (depth < 0)
+                    usage(argv[0]);
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                if (nthreads <= 0)
+                    usage(argv[0]);
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc || (summary && !reverse))
         usage(argv[0]);
+    if (reverse) {
+        if (nthreads == 0)
+            nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (nthreads <= 0)
+            nthreads = 1;
+        return(read_captures(argv + optind, argc - optind,
+                             summary, depth, nthreads));
     }
 
     pcap = pcap_open_dead(DLT_NULL, MAX_PACKET);
@@ -269,7 +1061,7 @@ main(int argc, char **argv)
         usage(argv[0]);
     }
 
-    for (i = 1; argv[i] != 0; i++) {
+    for (i = optind; argv[i] != 0; i++) {
         fprintf(stderr, "<!-- Processing %s -->\n", argv[i]);
 
         fd = open(argv[i], O_RDONLY);
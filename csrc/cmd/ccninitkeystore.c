@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pwd.h>
@@ -34,12 +35,13 @@ static void
 usage(const char *progname)
 {
     fprintf(stderr,
-            "%s [-h] [-f] [-u username] [-l keylength] [-v validity] [directory]\n"
+            "%s [-h] [-f] [-u username] [-t keytype] [-l keylength] [-v validity] [directory]\n"
             "   Initialize a CCNx keystore with given parameters\n", progname);
     fprintf(stderr,
             "   -h  Display this help message.\n"
             "   -f  Force overwriting an existing keystore. Default no overwrite permitted.\n" 
             "   -u username  Username for this keystore.  Default username of effective uid.\n"
+            "   -t keytype  rsa or ec (ECDSA P-256, much cheaper to sign with).  Default rsa.\n"
             "   -l keylength  Length of RSA key to be generated.  Default 1024 bits.\n"
             "   -v validity  Number of days that certificate should be valid.  Default 30.\n"
             "   directory  Directory in which to create .ccnx/.ccnx_keystore. Default $HOME.\n"
@@ -58,10 +60,11 @@ main(int argc, char **argv)
     char *user = NULL;
     char useruid[32];
     struct passwd *pwd = NULL;
+    int keytype = CCN_KEYSTORE_KEY_RSA;
     int keylength = 0;
     int validity = 0;
     
-    while ((opt = getopt(argc, argv, "hfu:p:l:v:")) != -1) {
+    while ((opt = getopt(argc, argv, "hfu:p:t:l:v:")) != -1) {
         switch (opt) {
             case 'f':
                 force = 1;
@@ -69,9 +72,19 @@ main(int argc, char **argv)
             case 'u':
                 user = optarg;
                 break;
+            case 't':
+                if (strcasecmp(optarg, "rsa") == 0)
+                    keytype = CCN_KEYSTORE_KEY_RSA;
+                else if (strcasecmp(optarg, "ec") == 0)
+                    keytype = CCN_KEYSTORE_KEY_EC;
+                else {
+                    fprintf(stderr, "%s: Key type must be rsa or ec.\n", optarg);
+                    exit(1);
+                }
+                break;
             case 'l':
                 keylength = atoi(optarg);
-                if (keylength < 512) {
+                if (keylength < 256) {
                     fprintf(stderr, "%d: Key length too short for signing CCNx objects.\n", keylength);
                     exit(1);
                 }
@@ -119,6 +132,16 @@ main(int argc, char **argv)
         perror(ccn_charbuf_as_string(keystore));
         exit(1);
     }
+    if (keylength != 0) {
+        if (keytype == CCN_KEYSTORE_KEY_RSA && keylength < 512) {
+            fprintf(stderr, "%d: Key length too short for signing CCNx objects.\n", keylength);
+            exit(1);
+        }
+        if (keytype == CCN_KEYSTORE_KEY_EC && keylength != 256) {
+            fprintf(stderr, "%d: EC keys are 256 bits.\n", keylength);
+            exit(1);
+        }
+    }
     if (user == NULL) {
         errno = 0;
         pwd = getpwuid(geteuid());
@@ -133,13 +156,13 @@ main(int argc, char **argv)
             user = useruid;
         }
     }
-    res = ccn_keystore_file_init(ccn_charbuf_as_string(keystore), CCN_KEYSTORE_PASS,
-                                 user, keylength, validity);
+    res = ccn_keystore_file_init_key(ccn_charbuf_as_string(keystore), CCN_KEYSTORE_PASS,
+                                     user, keytype, keylength, validity);
     if (res != 0) {
         if (errno != 0)
             perror(ccn_charbuf_as_string(keystore));
         else
-            fprintf(stderr, "ccn_keystore_file_init: invalid argument\n");
+            fprintf(stderr, "ccn_keystore_file_init_key: invalid argument\n");
         exit(1);
     }
     return(0);
@@ -0,0 +1,259 @@
+/**
+ * @file ccnlinkemu.c
+ * Relays UDP traffic between two ccnds, with added delay and loss.
+ *
+ * A CCNx command-line utility.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * This is meant for the scripted tests, to see how things behave over
+ * a slow or lossy link without needing privileges to shape real ones.
+ * The two ccnds make udp faces to the relay ports instead of to each
+ * other.  What arrives on relay port A (from the ccnd on port A) is
+ * sent on from relay port B to the ccnd on port B, and the other way
+ * around, so each ccnd sees its peer at the address it expects.
+ *
+ * When told to stop, it prints what it carried, so that it doubles as
+ * a meter of the traffic between the two.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ccn/ccn.h>
+#include <ccn/coding.h>
+
+#define MAX_DGRAM 9000
+#define MAX_QUEUED 4096
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-d delay] [-l loss] [-r seed] port_a port_b relay_a relay_b\n"
+            "   Relays udp datagrams between the ccnd on localhost port_a,\n"
+            "   which should send to relay_a, and the one on port_b, which\n"
+            "   should send to relay_b.  On SIGTERM or SIGINT, prints\n"
+            "   datagrams,dropped,bytes,interests,contentobjects\n"
+            "   -d delay - milliseconds to hold each datagram.  Default 0.\n"
+            "   -l loss - percentage of datagrams to drop.  Default 0.\n"
+            "   -r seed - random seed\n",
+            progname);
+    exit(1);
+}
+
+struct queued {
+    struct timeval due;
+    int dir;
+    size_t size;
+    unsigned char buf[MAX_DGRAM];
+};
+
+struct counts {
+    unsigned long datagrams;
+    unsigned long dropped;
+    unsigned long long bytes;
+    unsigned long interests;
+    unsigned long content;
+};
+
+static struct queued spare;     /**< for arrivals when the queue is full */
+static volatile sig_atomic_t stopping = 0;
+
+static void
+handle_stop(int sig)
+{
+    stopping = sig;
+}
+
+/**
+ * Count the Interests and ContentObjects in a datagram.
+ */
+static void
+count_messages(const unsigned char *p, size_t n, struct counts *c)
+{
+    struct ccn_skeleton_decoder sd;
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    size_t i = 0;
+    ssize_t used;
+
+    while (i < n) {
+        d = ccn_buf_decoder_start(&decoder, p + i, n - i);
+        if (ccn_buf_match_dtag(d, CCN_DTAG_Interest))
+            c->interests++;
+        else if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject))
+            c->content++;
+        memset(&sd, 0, sizeof(sd));
+        used = ccn_skeleton_decode(&sd, p + i, n - i);
+        if (sd.state != 0 || used <= 0)
+            break;
+        i += used;
+    }
+}
+
+static int
+bind_relay(unsigned port)
+{
+    struct sockaddr_in sa;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+        return(-1);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == -1) {
+        close(fd);
+        return(-1);
+    }
+    return(fd);
+}
+
+/**
+ * Milliseconds from now until t, or 0 if it is past.
+ */
+static int
+msec_until(const struct timeval *t)
+{
+    struct timeval now;
+    long ms;
+
+    gettimeofday(&now, NULL);
+    ms = (t->tv_sec - now.tv_sec) * 1000 +
+         ((long)t->tv_usec - (long)now.tv_usec + 999) / 1000;
+    return(ms < 0 ? 0 : ms);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct sockaddr_in peer[2];
+    struct pollfd fds[2];
+    struct queued *q = NULL;
+    struct counts c = {0};
+    unsigned head = 0;
+    unsigned nq = 0;
+    unsigned delay = 0;
+    unsigned loss = 0;
+    unsigned seed = getpid();
+    int timeout;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "hd:l:r:")) != -1) {
+        switch (opt) {
+            case 'd':
+                delay = atoi(optarg);
+                break;
+            case 'l':
+                loss = atoi(optarg);
+                if (loss > 100)
+                    usage(progname);
+                break;
+            case 'r':
+                seed = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(progname);
+        }
+    }
+    if (argc - optind != 4)
+        usage(progname);
+    srandom(seed);
+    for (i = 0; i < 2; i++) {
+        memset(&peer[i], 0, sizeof(peer[i]));
+        peer[i].sin_family = AF_INET;
+        peer[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        peer[i].sin_port = htons(atoi(argv[optind + i]));
+        fds[i].fd = bind_relay(atoi(argv[optind + 2 + i]));
+        if (fds[i].fd == -1) {
+            perror(argv[optind + 2 + i]);
+            exit(1);
+        }
+        fds[i].events = POLLIN;
+    }
+    q = calloc(MAX_QUEUED, sizeof(*q));
+    if (q == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    signal(SIGTERM, &handle_stop);
+    signal(SIGINT, &handle_stop);
+    while (!stopping) {
+        timeout = (nq == 0) ? -1 : msec_until(&q[head].due);
+        if (poll(fds, 2, timeout) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(1);
+        }
+        /* What arrives from peer i leaves through the other relay port */
+        for (i = 0; i < 2; i++) {
+            struct queued *e;
+            ssize_t res;
+
+            if ((fds[i].revents & POLLIN) == 0)
+                continue;
+            e = (nq < MAX_QUEUED) ? &q[(head + nq) % MAX_QUEUED] : &spare;
+            res = recv(fds[i].fd, e->buf, sizeof(e->buf), 0);
+            if (res <= 0)
+                continue;
+            if (e == &spare || (loss > 0 &&
+                  (unsigned)(random() % 100) < loss)) {
+                c.dropped++;
+                continue;
+            }
+            e->dir = 1 - i;
+            e->size = res;
+            gettimeofday(&e->due, NULL);
+            e->due.tv_sec += delay / 1000;
+            e->due.tv_usec += (delay % 1000) * 1000;
+            if (e->due.tv_usec >= 1000000) {
+                e->due.tv_sec++;
+                e->due.tv_usec -= 1000000;
+            }
+            nq++;
+        }
+        while (nq > 0 && msec_until(&q[head].due) == 0) {
+            struct queued *e = &q[head];
+
+            sendto(fds[e->dir].fd, e->buf, e->size, 0,
+                   (struct sockaddr *)&peer[e->dir], sizeof(peer[0]));
+            c.datagrams++;
+            c.bytes += e->size;
+            count_messages(e->buf, e->size, &c);
+            head = (head + 1) % MAX_QUEUED;
+            nq--;
+        }
+    }
+    printf("%lu,%lu,%llu,%lu,%lu\n",
+           c.datagrams, c.dropped, c.bytes, c.interests, c.content);
+    free(q);
+    exit(0);
+}
@@ -0,0 +1,202 @@
+/**
+ * @file ccnrandget.c
+ * Fetches randomly chosen segments of a stream, and reports the rate.
+ *
+ * A CCNx command-line utility.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * This is meant for measuring how fast a repository serves content
+ * that is spread over a working set of a given size, so the segments
+ * are chosen uniformly from the first N, and each one is asked for
+ * by its exact name.  Run it through a ccnd with a small content store
+ * (CCND_CAP) so that the repository sees the interests.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/uri.h>
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-n count] [-N segments] [-w window] [-s scope] [-r seed] "
+            "ccnx:/a/b/version\n"
+            "   Fetches randomly chosen segments of the stream with the given\n"
+            "   versioned name, and prints count,failures,seconds,reads/s\n"
+            "   -n count - segments to fetch.  Default 10000.\n"
+            "   -N segments - choose from segments 0 to N-1.  Default 1000.\n"
+            "   -w window - most interests outstanding.  Default 16.\n"
+            "   -s scope - scope of the interests.  Default none.\n"
+            "   -r seed - random seed\n",
+            progname);
+    exit(1);
+}
+
+struct mydata {
+    struct ccn_closure closure;
+    unsigned outstanding;
+    unsigned received;
+    unsigned failed;            /**< timed out, or bad */
+};
+
+static enum ccn_upcall_res
+incoming_content(struct ccn_closure *selfp,
+                 enum ccn_upcall_kind kind,
+                 struct ccn_upcall_info *info)
+{
+    struct mydata *md = selfp->data;
+
+    /* Return from ccn_run, to refill the window */
+    if (kind != CCN_UPCALL_FINAL)
+        ccn_set_run_timeout(info->h, 0);
+    switch (kind) {
+        case CCN_UPCALL_FINAL:
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_INTEREST_TIMED_OUT:
+            md->failed++;
+            md->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+        case CCN_UPCALL_CONTENT:
+            md->received++;
+            md->outstanding--;
+            return(CCN_UPCALL_RESULT_OK);
+        default:
+            md->failed++;
+            md->outstanding--;
+            return(CCN_UPCALL_RESULT_ERR);
+    }
+}
+
+static struct ccn_charbuf *
+make_template(int scope)
+{
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
+    ccn_charbuf_append_closer(templ); /* </Name> */
+    /* The segment, plus the implicit digest */
+    ccnb_tagged_putf(templ, CCN_DTAG_MaxSuffixComponents, "%d", 1);
+    if (scope >= 0)
+        ccnb_tagged_putf(templ, CCN_DTAG_Scope, "%d", scope);
+    ccn_charbuf_append_closer(templ); /* </Interest> */
+    return(templ);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *progname = argv[0];
+    struct ccn *ccn = NULL;
+    struct ccn_charbuf *prefix = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_charbuf *templ = NULL;
+    struct mydata md = {{0}};
+    struct timeval start;
+    struct timeval stop;
+    double elapsed;
+    unsigned count = 10000;
+    unsigned nseg = 1000;
+    unsigned window = 16;
+    unsigned seed = 0;
+    unsigned issued = 0;
+    int scope = -1;
+    int opt;
+    int res;
+
+    while ((opt = getopt(argc, argv, "hn:N:w:s:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 'N':
+                nseg = atoi(optarg);
+                if (nseg < 1)
+                    usage(progname);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                if (window < 1)
+                    usage(progname);
+                break;
+            case 's':
+                scope = atoi(optarg);
+                if (scope < 0 || scope > 2)
+                    usage(progname);
+                break;
+            case 'r':
+                seed = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                usage(progname);
+        }
+    }
+    if (argv[optind] == NULL || argv[optind + 1] != NULL)
+        usage(progname);
+    prefix = ccn_charbuf_create();
+    res = ccn_name_from_uri(prefix, argv[optind]);
+    if (res < 0) {
+        fprintf(stderr, "%s: bad ccn URI: %s\n", progname, argv[optind]);
+        exit(1);
+    }
+    ccn = ccn_create();
+    if (ccn_connect(ccn, NULL) == -1) {
+        perror("Could not connect to ccnd");
+        exit(1);
+    }
+    srandom(seed != 0 ? seed : (unsigned)getpid());
+    templ = make_template(scope);
+    name = ccn_charbuf_create();
+    md.closure.p = &incoming_content;
+    md.closure.data = &md;
+    gettimeofday(&start, NULL);
+    while (md.received + md.failed < count) {
+        while (issued < count && md.outstanding < window) {
+            ccn_charbuf_reset(name);
+            ccn_charbuf_append_charbuf(name, prefix);
+            ccn_name_append_numeric(name, CCN_MARKER_SEQNUM,
+                                    random() % nseg);
+            res = ccn_express_interest(ccn, name, &md.closure, templ);
+            if (res < 0) {
+                fprintf(stderr, "%s: could not express interest\n", progname);
+                exit(1);
+            }
+            issued++;
+            md.outstanding++;
+        }
+        res = ccn_run(ccn, 100);
+        if (res < 0)
+            break;
+    }
+    gettimeofday(&stop, NULL);
+    elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1e6;
+    printf("%u,%u,%.3f,%.1f\n", md.received + md.failed, md.failed,
+           elapsed, elapsed > 0 ? md.received / elapsed : 0.0);
+    ccn_destroy(&ccn);
+    ccn_charbuf_destroy(&prefix);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&templ);
+    exit(md.failed > 0 || res < 0);
+}
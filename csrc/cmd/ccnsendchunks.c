@@ -111,7 +111,8 @@ main(int argc, char **argv)
     struct ccn_charbuf *name = NULL;
     struct ccn_charbuf *temp = NULL;
     struct ccn_charbuf *templ = NULL;
-    struct ccn_charbuf *signed_info = NULL;
+    struct ccn_content_builder *builder = NULL;
+    struct ccn_content_builder *first_builder = NULL;
     struct ccn_charbuf *keylocator = NULL;
     struct ccn_charbuf *finalblockid = NULL;
     struct ccn_keystore *keystore = NULL;
@@ -162,7 +163,6 @@ main(int argc, char **argv)
     name = ccn_charbuf_create();
     temp = ccn_charbuf_create();
     templ = ccn_charbuf_create();
-    signed_info = ccn_charbuf_create();
     keystore = ccn_keystore_create();
     temp->length = 0;
     ccn_charbuf_putf(temp, "%s/.ccnx/.ccnx_keystore", getenv("HOME"));
@@ -209,6 +209,29 @@ main(int argc, char **argv)
         ccn_charbuf_append_closer(keylocator); /* </KeyLocator> */
     }
     
+    /* Put the keylocator in the first block only. */
+    first_builder = ccn_content_builder_create(
+        /*pubkeyid*/ccn_keystore_public_key_digest(keystore),
+        /*publisher_key_id_size*/ccn_keystore_public_key_digest_length(keystore),
+        /*type*/CCN_CONTENT_DATA,
+        /*freshness*/ expire,
+        keylocator,
+        ccn_keystore_digest_algorithm(keystore),
+        ccn_keystore_private_key(keystore));
+    builder = ccn_content_builder_create(
+        ccn_keystore_public_key_digest(keystore),
+        ccn_keystore_public_key_digest_length(keystore),
+        CCN_CONTENT_DATA,
+        expire,
+        NULL,
+        ccn_keystore_digest_algorithm(keystore),
+        ccn_keystore_private_key(keystore));
+    ccn_charbuf_destroy(&keylocator);
+    if (first_builder == NULL || builder == NULL) {
+        fprintf(stderr, "Failed to create content builder\n");
+        exit(1);
+    }
+    
     for (i = 0;; i++) {
         read_res = read_full(0, buf, blocksize);
         if (read_res < 0) {
@@ -216,7 +239,6 @@ main(int argc, char **argv)
             read_res = 0;
             status = 1;
         }
-        signed_info->length = 0;
         if (read_res < blocksize) {
             temp->length = 0;
             ccn_charbuf_putf(temp, "%d", i);
@@ -225,35 +247,19 @@ main(int argc, char **argv)
             ccn_charbuf_append_tt(finalblockid, temp->length, CCN_BLOB);
             ccn_charbuf_append(finalblockid, temp->buf, temp->length);
         }
-        res = ccn_signed_info_create(signed_info,
-                                     /*pubkeyid*/ccn_keystore_public_key_digest(keystore),
-                                     /*publisher_key_id_size*/ccn_keystore_public_key_digest_length(keystore),
-                                     /*datetime*/NULL,
-                                     /*type*/CCN_CONTENT_DATA,
-                                     /*freshness*/ expire,
-                                     finalblockid,
-                                     keylocator);
-        /* Put the keylocator in the first block only. */
-        ccn_charbuf_destroy(&keylocator);
-        if (res < 0) {
-            fprintf(stderr, "Failed to create signed_info (res == %d)\n", res);
-            exit(1);
-        }
         name->length = 0;
         ccn_charbuf_append(name, root->buf, root->length);
         temp->length = 0;
         ccn_charbuf_putf(temp, "%d", i);
         ccn_name_append(name, temp->buf, temp->length);
         temp->length = 0;
-        ccn_charbuf_append(temp, buf, read_res);
-        temp->length = 0;
-        res = ccn_encode_ContentObject(temp,
-                                       name,
-                                       signed_info,
-                                       buf,
-                                       read_res,
-                                       ccn_keystore_digest_algorithm(keystore),
-                                       ccn_keystore_private_key(keystore));
+        res = ccn_content_builder_encode(i == 0 ? first_builder : builder,
+                                         temp,
+                                         name,
+                                         /*datetime*/NULL,
+                                         finalblockid,
+                                         buf,
+                                         read_res);
         if (res != 0) {
             fprintf(stderr, "Failed to encode ContentObject (res == %d)\n", res);
             exit(1);
@@ -291,7 +297,8 @@ main(int argc, char **argv)
     ccn_charbuf_destroy(&root);
     ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&temp);
-    ccn_charbuf_destroy(&signed_info);
+    ccn_content_builder_destroy(&first_builder);
+    ccn_content_builder_destroy(&builder);
     ccn_charbuf_destroy(&finalblockid);
     ccn_keystore_destroy(&keystore);
     ccn_destroy(&ccn);
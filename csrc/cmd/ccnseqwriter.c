@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 #include <ccn/ccn.h>
 #include <ccn/uri.h>
 #include <ccn/seqwriter.h>
@@ -30,7 +31,8 @@ static void
 usage(const char *progname)
 {
         fprintf(stderr,
-                "%s [-h] [-b 0<blocksize<=4096] [-r] ccnx:/some/uri\n"
+                "%s [-h] [-b 0<blocksize<=4096] [-r] [-s scope] [-w window] [-m] [-v]"
+                " ccnx:/some/uri\n"
                 "    Reads stdin, sending data under the given URI"
                 " using ccn versioning and segmentation.\n"
                 "    -h generate this help message.\n"
@@ -38,7 +40,12 @@ usage(const char *progname)
                 "    -r generate start-write interest so a repository will"
                 " store the content.\n"
                 "    -s n set scope of start-write interest.\n"
-                "       n = 1(local), 2(neighborhood), 3(everywhere) Default 1.\n",
+                "       n = 1(local), 2(neighborhood), 3(everywhere) Default 1.\n"
+                "    -w n sign up to n segments ahead of the interests for them.\n"
+                "       Default 0 (sign each segment when it is asked for).\n"
+                "    -m publish a manifest of the segments, the only thing signed"
+                " with a key.\n"
+                "    -v report signatures and puts per second on stderr.\n",
                 progname);
         exit(1);
 }
@@ -71,6 +78,11 @@ main(int argc, char **argv)
     int blocksize = 1024;
     int torepo = 0;
     int scope = 1;
+    int window = 0;
+    int manifest = 0;
+    int verbose = 0;
+    struct timeval t0;
+    struct timeval t1;
     int i;
     int status = 0;
     int res;
@@ -79,13 +91,16 @@ main(int argc, char **argv)
     unsigned char *buf = NULL;
     struct ccn_charbuf *templ;
     
-    while ((res = getopt(argc, argv, "hrb:s:")) != -1) {
+    while ((res = getopt(argc, argv, "hmrvb:s:w:")) != -1) {
         switch (res) {
             case 'b':
                 blocksize = atoi(optarg);
                 if (blocksize <= 0 || blocksize > 4096)
                     usage(progname);
                 break;
+            case 'm':
+                manifest = 1;
+                break;
             case 'r':
                 torepo = 1;
                 break;
@@ -94,6 +109,14 @@ main(int argc, char **argv)
                 if (scope < 1 || scope > 3)
                     usage(progname);
                 break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'w':
+                window = atoi(optarg);
+                if (window < 0)
+                    usage(progname);
+                break;
             default:
             case 'h':
                 usage(progname);
@@ -124,6 +147,12 @@ main(int argc, char **argv)
         exit(1);
     }
     ccn_seqw_set_block_limits(w, blocksize, blocksize);
+    if (window > 0 && ccn_seqw_set_window(w, window) < 0) {
+        fprintf(stderr, "%s: bad window: %d\n", progname, window);
+        exit(1);
+    }
+    if (manifest)
+        ccn_seqw_set_manifest(w, 1);
     if (torepo) {
         struct ccn_charbuf *name_v = ccn_charbuf_create();
         ccn_seqw_get_name(w, name_v);
@@ -138,6 +167,7 @@ main(int argc, char **argv)
             exit(1);
         }
     }
+    gettimeofday(&t0, NULL);
     blockread = 0;
     for (i = 0;; i++) {
         while (blockread < blocksize) {
@@ -171,8 +201,24 @@ cleanup:
             res = ccn_seqw_write(w, buf, blockread);
         }
     }
+    if (verbose) {
+        uintmax_t sigs = 0;
+        uintmax_t puts = 0;
+        int ready = 0;
+        double dt;
+        ccn_seqw_get_counts(w, &sigs, &puts, &ready);
+        gettimeofday(&t1, NULL);
+        dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+        if (dt <= 0)
+            dt = 1e-6;
+        fprintf(stderr, "%s: %ju signatures (%.0f/sec), %ju puts (%.0f/sec),"
+                " %d ready at close, %.3f sec\n", progname,
+                sigs, sigs / dt, puts, puts / dt, ready, dt);
+    }
     ccn_seqw_close(w);
     ccn_run(ccn, 1);
+    while (ccn_output_is_pending(ccn) && ccn_run(ccn, 10) >= 0)
+        continue;
     free(buf);
     buf = NULL;
     ccn_charbuf_destroy(&name);
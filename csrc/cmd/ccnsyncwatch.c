@@ -53,13 +53,17 @@ void
 usage(char *prog)
 {
     fprintf(stderr,
-            "%s [-t topo-uri] [-p prefix-uri] [-r roothash-hex] [-w timeout-secs]\n"
+            "%s [-t topo-uri] [-p prefix-uri] [-r roothash-hex] [-w timeout-secs]"
+            " [-c cache-dir]\n"
             "   topo-uri and prefix-uri must be CCNx URIs.\n"
             "   roothash-hex must be an even number of hex digits "
             "representing a valid starting root hash.\n"
             "   timeout-secs is the time, in seconds that the program "
             "should monitor sync activity.\n"
-            "       or -1 to run until interrupted.\n", prog);
+            "       or -1 to run until interrupted.\n"
+            "   cache-dir is a directory that keeps the sync tree between runs, "
+            "so that\n"
+            "       only names added since the last run are reported.\n", prog);
     exit(1);
 }
 
@@ -100,12 +104,16 @@ main(int argc, char **argv)
     struct ccn_charbuf *roothash = NULL;
     struct ccn_charbuf *topo = ccn_charbuf_create();
     int timeout = 10*1000;
+    char *cachedir = NULL;
     unsigned i, j, n;
  
     ccn_name_init(prefix);
     ccn_name_init(topo);
-    while ((opt = getopt(argc, argv, "hp:r:t:w:")) != -1) {
+    while ((opt = getopt(argc, argv, "c:hp:r:t:w:")) != -1) {
         switch (opt) {
+            case 'c':
+                cachedir = optarg;
+                break;
             case 'p':
                 if (0 > ccn_name_from_uri(prefix, optarg)) usage(argv[0]);
                 break;
@@ -141,7 +149,7 @@ main(int argc, char **argv)
     res = ccn_connect(h, NULL);
     slice = ccns_slice_create();
     ccns_slice_set_topo_prefix(slice, topo, prefix);
-    ccns = ccns_open(h, slice, &sync_cb, roothash, NULL);
+    ccns = ccns_open_cached(h, slice, &sync_cb, roothash, NULL, cachedir);
     ccn_run(h, timeout);
     ccns_close(&ccns, NULL, NULL);
     ccns_slice_destroy(&slice);
@@ -12,13 +12,13 @@
 # FOR A PARTICULAR PURPOSE.
 #
 
-LDLIBS = -L../lib $(MORE_LDLIBS) -lccn
+LDLIBS = -L../lib $(MORE_LDLIBS) -lccn -lpthread
 EXPATLIBS = -lexpat
 CCNLIBDIR = ../lib
 
 INSTALLED_PROGRAMS = \
     ccn_ccnbtoxml ccn_splitccnb ccndumpnames ccnnamelist ccnrm \
-    ccnls ccnslurp ccnbx ccncat ccnbasicconfig \
+    ccnls ccnslurp ccnbx ccncat ccnbulkget ccnbasicconfig \
     ccnsendchunks ccncatchunks ccncatchunks2 \
     ccnpoke ccnpeek ccnhexdumpdata \
     ccnseqwriter ccnsimplecat \
@@ -31,6 +31,8 @@ PROGRAMS = $(INSTALLED_PROGRAMS) \
     ccnbuzz  \
     dataresponsetest \
     ccn_fetch_test \
+    ccnlinkemu \
+    ccnrandget \
     $(PCAP_PROGRAMS)
 
 EXPAT_PROGRAMS = ccn_xmltoccnb
@@ -39,9 +41,9 @@ BROKEN_PROGRAMS =
 DEBRIS =
 SCRIPTSRC = ccn_initkeystore.sh
 CSRC =  ccn_ccnbtoxml.c ccn_splitccnb.c ccn_xmltoccnb.c ccnbasicconfig.c \
-       ccnbuzz.c ccnbx.c ccncat.c ccnsimplecat.c ccncatchunks.c ccncatchunks2.c \
+       ccnbuzz.c ccnbx.c ccncat.c ccnbulkget.c ccnsimplecat.c ccncatchunks.c ccncatchunks2.c \
        ccndumpnames.c ccndumppcap.c ccnfilewatch.c ccnpeek.c ccnhexdumpdata.c \
-       ccninitkeystore.c ccnls.c ccnnamelist.c ccnpoke.c ccnrm.c ccnsendchunks.c \
+       ccninitkeystore.c ccnlinkemu.c ccnls.c ccnnamelist.c ccnpoke.c ccnrandget.c ccnrm.c ccnsendchunks.c \
        ccnseqwriter.c ccnsyncwatch.c ccn_fetch_test.c ccnlibtest.c ccnslurp.c dataresponsetest.c 
 
 default all: $(PROGRAMS)
@@ -100,6 +102,9 @@ ccnbx: ccnbx.o
 ccncat: ccncat.o
 	$(CC) $(CFLAGS) -o $@ ccncat.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
+ccnbulkget: ccnbulkget.o
+	$(CC) $(CFLAGS) -o $@ ccnbulkget.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 ccnsimplecat: ccnsimplecat.o
 	$(CC) $(CFLAGS) -o $@ ccnsimplecat.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
@@ -130,6 +135,12 @@ ccnpoke: ccnpoke.o
 ccnpeek: ccnpeek.o
 	$(CC) $(CFLAGS) -o $@ ccnpeek.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
+ccnlinkemu: ccnlinkemu.o
+	$(CC) $(CFLAGS) -o $@ ccnlinkemu.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
+ccnrandget: ccnrandget.o
+	$(CC) $(CFLAGS) -o $@ ccnrandget.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 ccnhexdumpdata: ccnhexdumpdata.o
 	$(CC) $(CFLAGS) -o $@ ccnhexdumpdata.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
@@ -161,7 +172,7 @@ signbenchtest: signbenchtest.o
 	$(CC) $(CFLAGS) -o $@ signbenchtest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto 
 
 ccndumppcap: ccndumppcap.o
-	$(CC) $(CFLAGS) -o $@ ccndumppcap.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lpcap
+	$(CC) $(CFLAGS) -o $@ ccndumppcap.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lpcap -lpthread
 
 ccnfilewatch: ccnfilewatch.o
 	$(CC) $(CFLAGS) -o $@ ccnfilewatch.o
@@ -196,22 +207,24 @@ ccnbx.o: ccnbx.c ../include/ccn/charbuf.h ../include/ccn/coding.h \
 ccncat.o: ccncat.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h \
   ../include/ccn/fetch.h
+ccnbulkget.o: ccnbulkget.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h \
+  ../include/ccn/fetch.h
 ccnsimplecat.o: ccnsimplecat.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccncatchunks.o: ccncatchunks.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/uri.h
-ccncatchunks2.o: ccncatchunks2.c ../include/ccn/ccn.h \
-  ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/schedule.h \
-  ../include/ccn/uri.h
+ccncatchunks2.o: ccncatchunks2.c ../include/ccn/bulkdata.h \
+  ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccndumpnames.o: ccndumpnames.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccndumppcap.o: ccndumppcap.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
-  ../include/ccn/ccnd.h
+  ../include/ccn/ccnd.h ../include/ccn/hashtb.h ../include/ccn/uri.h
 ccnfilewatch.o: ccnfilewatch.c
 ccnpeek.o: ccnpeek.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
@@ -222,12 +235,17 @@ ccninitkeystore.o: ccninitkeystore.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/keystore.h
 ccnls.o: ccnls.c ../include/ccn/ccn.h ../include/ccn/coding.h \
-  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/traverse.h ../include/ccn/uri.h
 ccnnamelist.o: ccnnamelist.c ../include/ccn/coding.h ../include/ccn/uri.h \
   ../include/ccn/charbuf.h
 ccnpoke.o: ccnpoke.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h \
   ../include/ccn/keystore.h ../include/ccn/signing.h
+ccnlinkemu.o: ccnlinkemu.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h
+ccnrandget.o: ccnrandget.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccnrm.o: ccnrm.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccnsendchunks.o: ccnsendchunks.c ../include/ccn/ccn.h \
@@ -247,9 +265,9 @@ ccn_fetch_test.o: ccn_fetch_test.c ../include/ccn/fetch.h \
 ccnlibtest.o: ccnlibtest.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/uri.h
-ccnslurp.o: ccnslurp.c ../include/ccn/bloom.h ../include/ccn/ccn.h \
+ccnslurp.o: ccnslurp.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/uri.h
+  ../include/ccn/indexbuf.h ../include/ccn/traverse.h ../include/ccn/uri.h
 dataresponsetest.o: dataresponsetest.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h
@@ -25,11 +25,13 @@ ALLTESTS = \
   test_happy_face \
   test_late \
   test_long_example \
+  test_repo_benchmark \
   test_repo_performance \
   test_single_ccnd \
   test_single_ccnd_teardown \
   test_single_done \
   test_sync_basic \
+  test_sync_benchmark \
   test_sync_read \
   test_sync_repo2 \
   test_twohop_ccnd \
@@ -0,0 +1,63 @@
+/**
+ * @file ccn/arena.h
+ *
+ * Reusable charbufs and indexbufs for short-lived temporaries.
+ *
+ * Handling one message typically needs a few scratch buffers, which
+ * would otherwise be created and destroyed each time.  An arena keeps
+ * every buffer it has handed out, along with its storage, so that once
+ * it has seen the peak number in use at once, getting a buffer from it
+ * costs no allocation at all.
+ *
+ * A buffer from ccn_charbuf_create_in or ccn_indexbuf_create_in belongs
+ * to the arena.  Give it back with the matching release call, or let
+ * ccn_arena_reset take back everything at a point where nothing from
+ * the arena is in use.  Never pass it to ccn_charbuf_destroy or
+ * ccn_indexbuf_destroy.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_ARENA_DEFINED
+#define CCN_ARENA_DEFINED
+
+struct ccn_arena;
+struct ccn_charbuf;
+struct ccn_indexbuf;
+
+struct ccn_arena *ccn_arena_create(void);
+void ccn_arena_destroy(struct ccn_arena **ap);
+
+/*
+ * Get an empty charbuf or indexbuf from the arena.
+ * Returns NULL only if a new one was needed and could not be made.
+ */
+struct ccn_charbuf *ccn_charbuf_create_in(struct ccn_arena *a);
+struct ccn_indexbuf *ccn_indexbuf_create_in(struct ccn_arena *a);
+
+/*
+ * Give a buffer back to the arena, and set *cp to NULL.
+ * A buffer that did not come from the arena is simply destroyed.
+ */
+void ccn_charbuf_release_in(struct ccn_arena *a, struct ccn_charbuf **cp);
+void ccn_indexbuf_release_in(struct ccn_arena *a, struct ccn_indexbuf **cp);
+
+/*
+ * Take back every buffer the arena has handed out.
+ */
+void ccn_arena_reset(struct ccn_arena *a);
+
+#endif
@@ -99,4 +99,14 @@ const struct ccn_bloom_wire *
 int ccn_bloom_match_wire(const struct ccn_bloom_wire *f,
                          const void *key, size_t size);
 
+/*
+ * ccn_bloom_match_wire_keys: Test many keys against one filter
+ * The answer for keys[i] (of size sizes[i]) is stored in results[i].
+ * This is cheaper per key than calling ccn_bloom_match_wire repeatedly.
+ * Returns the number of matches.
+ */
+int ccn_bloom_match_wire_keys(const struct ccn_bloom_wire *f, int n,
+                              const void **keys, const size_t *sizes,
+                              unsigned char *results);
+
 #endif
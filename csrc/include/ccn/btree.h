@@ -21,6 +21,7 @@
 #ifndef CCN_BTREE_DEFINED
 #define CCN_BTREE_DEFINED
 
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <ccn/charbuf.h>
@@ -28,6 +29,7 @@
 
 struct ccn_btree_io;
 struct ccn_btree_node;
+struct ccn_indexbuf;
 
 /**
  * Methods for external I/O of btree nodes.
@@ -58,6 +60,17 @@ struct ccn_btree_node;
  * set iodata to NULL, updating openfds as appropriate.  It should not change
  * the other parts of the node.
  *
+ * Commit, if provided, makes everything written so far durable as one
+ * consistent snapshot, together with a mark chosen by the client; until
+ * then, the store may come back after a crash as of the previous commit.
+ * Stores without it make each write durable on its own.
+ *
+ * Refresh, if provided, belongs to a read-only store that another process
+ * is committing to.  It catches up with that process's latest commit,
+ * appending to its second argument the nodeids whose stored contents may
+ * differ from what was there before; it returns 1 if there was a new
+ * commit and 0 if not.
+ *
  * Negative return values indicate errors.
  */
 typedef int (*ccn_btree_io_openfn)
@@ -70,6 +83,10 @@ typedef int (*ccn_btree_io_closefn)
     (struct ccn_btree_io *, struct ccn_btree_node *);
 typedef int (*ccn_btree_io_destroyfn)
     (struct ccn_btree_io **);
+typedef int (*ccn_btree_io_commitfn)
+    (struct ccn_btree_io *, uintmax_t);
+typedef int (*ccn_btree_io_refreshfn)
+    (struct ccn_btree_io *, struct ccn_indexbuf *);
 
 /* This serves as the external name of a btree node. */
 typedef unsigned ccn_btnodeid;
@@ -84,8 +101,11 @@ struct ccn_btree_io {
     ccn_btree_io_writefn btwrite;
     ccn_btree_io_closefn btclose;
     ccn_btree_io_destroyfn btdestroy;
+    ccn_btree_io_commitfn btcommit; /**< NULL if writes are not deferred */
+    ccn_btree_io_refreshfn btrefresh; /**< NULL unless read-only */
     ccn_btnodeid maxnodeid;    /**< Largest assigned nodeid */
     int openfds;               /**< Number of open files */
+    uintmax_t mark;            /**< Client's mark as of the last commit */
     void *data;
 };
 /**
@@ -103,6 +123,9 @@ struct ccn_btree_node {
     unsigned freelow;           /**< Index of first unused byte of free space */
     unsigned corrupt;           /**< Structure is not to be trusted */
     unsigned activity;          /**< Meters use of the node */
+    struct ccn_charbuf *hints;  /**< Key prefixes for searching; private */
+    unsigned cached;            /**< Bytes counted in btree->cachebytes */
+    unsigned pinned;            /**< Bytes counted in btree->pinbytes */
 };
 
 /** Increment to node->activity when node is referenced but not changed */
@@ -130,13 +153,43 @@ struct ccn_btree {
     ccn_btnodeid missedsplit;   /**< should stay zero */
     int errors;                 /**< counter for detected errors */
     int cleanreq;               /**< if nonzero, cleaning might be needed */
+    /* resident node cache */
+    struct ccn_indexbuf *clock; /**< resident nodeids, in CLOCK order */
+    int hand;                   /**< CLOCK hand, an index into clock */
+    struct ccn_indexbuf *opened; /**< nodes opened for io, for the cleaner */
+    uintmax_t cachebytes;       /**< bytes in resident nodes (approximate) */
+    uintmax_t pinbytes;         /**< part of cachebytes in internal nodes */
+    uintmax_t hits;             /**< ccn_btree_getnode found node resident */
+    uintmax_t misses;           /**< ccn_btree_getnode had to read node */
     /* tunables */
     int full;                   /**< split internal nodes bigger than this */
     int full0;                  /**< split leaf nodes bigger than this */
     int nodebytes;              /**< limit size of node */
     int nodepool;               /**< limit resident size */
+    uintmax_t cachelimit;       /**< limit resident bytes, if nonzero */
+};
+
+/**
+ * A position within the leaves of a btree
+ *
+ * A cursor stays on a leaf, so that stepping to a neighboring entry,
+ * or seeking to a key in the same leaf, does not need a descent from
+ * the root.  It holds a node pointer, so it is only good until the
+ * btree is changed or cleaned (see ccn_btree_getnode()).
+ */
+struct ccn_btree_cursor {
+    struct ccn_btree *btree;
+    struct ccn_btree_node *leaf; /**< NULL if off either end */
+    int index;                  /**< entry within leaf */
 };
 
+/**
+ * State for building a btree from sorted keys
+ *
+ * Private to ccn_btree.c
+ */
+struct ccn_btree_builder;
+
 /**
  *  Structure of a node.
  *  
@@ -253,6 +306,9 @@ int ccn_btree_insert_entry(struct ccn_btree_node *node, int i,
                            const unsigned char *key, size_t keysize,
                            void *payload, size_t payload_bytes);
 
+/* Remove the entry at slot i of node */
+int ccn_btree_delete_entry(struct ccn_btree_node *node, int i);
+
 /* Initialize a btree node */
 int ccn_btree_init_node(struct ccn_btree_node *node,
                         int level, unsigned char nodetype, unsigned char extsz);
@@ -283,6 +339,15 @@ struct ccn_btree_node *ccn_btree_getnode(struct ccn_btree *bt,
 struct ccn_btree_node *ccn_btree_rnode(struct ccn_btree *bt,
                                        ccn_btnodeid nodeid);
 
+/* Drop clean, idle nodes from memory until the node cache is within limits */
+int ccn_btree_evict(struct ccn_btree *btree);
+
+/* Write all changed nodes and commit them as one snapshot */
+int ccn_btree_commit(struct ccn_btree *btree, uintmax_t mark);
+
+/* Catch up with the latest commit to a read-only store */
+int ccn_btree_refresh(struct ccn_btree *btree);
+
 /* Clean a node and release io resources, retaining cached node in memory */
 int ccn_btree_close_node(struct ccn_btree *btree, struct ccn_btree_node *node);
 
@@ -307,9 +372,38 @@ int ccn_btree_prev_leaf(struct ccn_btree *btree,
                         struct ccn_btree_node *node,
                         struct ccn_btree_node **ansp);
 
+/* Position a cursor at key, or at the entry that would follow it */
+int ccn_btree_cursor_seek(struct ccn_btree_cursor *c, struct ccn_btree *btree,
+                          const unsigned char *key, size_t size);
+
+/* Step a cursor to the following entry */
+int ccn_btree_cursor_next(struct ccn_btree_cursor *c);
+
+/* Step a cursor to the preceding entry */
+int ccn_btree_cursor_prev(struct ccn_btree_cursor *c);
+
+/* Start building a btree bottom-up from keys supplied in order */
+struct ccn_btree_builder *ccn_btree_builder_create(struct ccn_btree *btree,
+                                                   int fill_percent);
+
+/* Add the next leaf entry; keys must be strictly increasing */
+int ccn_btree_builder_append(struct ccn_btree_builder *b,
+                             const unsigned char *key, size_t keysize,
+                             void *payload, size_t payload_bytes);
+
+/* Write out the partial nodes, install the root, and free the builder */
+int ccn_btree_builder_finish(struct ccn_btree_builder **pb);
+
+/* Free a builder without touching the root */
+void ccn_btree_builder_destroy(struct ccn_btree_builder **pb);
+
 /* Split a node into two */
 int ccn_btree_split(struct ccn_btree *btree, struct ccn_btree_node *node);
 
+/* Merge a node with its right-hand sibling, if they fit in one */
+int ccn_btree_merge(struct ccn_btree *btree, struct ccn_btree_node *node,
+                    int fill_percent);
+
 /* Prepare to update a node */
 int ccn_btree_prepare_for_update(struct ccn_btree *bt,
                                  struct ccn_btree_node *node);
@@ -324,6 +418,12 @@ int ccn_btree_check(struct ccn_btree *btree, FILE *outfp);
 /* For btree node storage in files */
 struct ccn_btree_io *ccn_btree_io_from_directory(const char *path,
                                                  struct ccn_charbuf *msgs);
+/* For btree node storage in pages of a single file */
+struct ccn_btree_io *ccn_btree_io_from_pagefile(const char *path,
+                                                struct ccn_charbuf *msgs);
+/* For reading a page store that another process is writing */
+struct ccn_btree_io *ccn_btree_io_from_pagefile_readonly(const char *path,
+                                                struct ccn_charbuf *msgs);
 
 /* Low-level field access */
 unsigned ccn_btree_fetchval(const unsigned char *p, int size);
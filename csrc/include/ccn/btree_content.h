@@ -62,6 +62,14 @@ int ccn_btree_match_interest(struct ccn_btree_node *node, int ndx,
                              const struct ccn_parsed_interest *pi,
                              struct ccn_charbuf *scratch);
 
+/* Same, with the Interest's Exclude compiled (ce may be NULL) */
+struct ccn_compiled_exclude;
+int ccn_btree_match_interest_excl(struct ccn_btree_node *node, int ndx,
+                                  const unsigned char *interest_msg,
+                                  const struct ccn_parsed_interest *pi,
+                                  const struct ccn_compiled_exclude *ce,
+                                  struct ccn_charbuf *scratch);
+
 /* Insert a ContentObject into a btree node */
 int ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
                              uint_least64_t cobid,
@@ -69,6 +77,14 @@ int ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
                              struct ccn_parsed_ContentObject *pc,
                              struct ccn_charbuf *flatname);
 
+/* Fill in the leaf payload for a ContentObject, as the above would */
+int ccn_btree_init_content_payload(struct ccn_btree_content_payload *e,
+                                   uint_least64_t cobid,
+                                   const unsigned char *content_object,
+                                   struct ccn_parsed_ContentObject *pc,
+                                   const unsigned char *flatname,
+                                   size_t fsize);
+
 /* cobid accessor */
 uint_least64_t ccn_btree_content_cobid(struct ccn_btree_node *node, int ndx);
 int ccn_btree_content_set_cobid(struct ccn_btree_node *node, int ndx,
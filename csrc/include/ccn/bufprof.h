@@ -0,0 +1,80 @@
+/**
+ * @file ccn/bufprof.h
+ *
+ * Allocation profiling for charbufs and indexbufs.
+ *
+ * When the tree is built with CCN_BUF_PROFILE defined (for example, with
+ * PLATCFLAGS += -DCCN_BUF_PROFILE in csrc/conf/local.mk), each call to
+ * ccn_charbuf_create(), ccn_charbuf_create_n() or ccn_indexbuf_create()
+ * is counted against its call site, along with the bytes allocated for
+ * the buffer over its lifetime.  Everything that includes charbuf.h or
+ * indexbuf.h must be built the same way, since the buffer structures
+ * carry the call site.
+ *
+ * Without CCN_BUF_PROFILE, nothing is counted and the table stays empty.
+ * The counters are not protected by any lock.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_BUFPROF_DEFINED
+#define CCN_BUFPROF_DEFINED
+
+#include <stddef.h>
+
+enum ccn_bufprof_kind {
+    CCN_BUFPROF_CHARBUF,
+    CCN_BUFPROF_INDEXBUF
+};
+
+/**
+ * Counters for one call site
+ */
+struct ccn_bufprof_site {
+    const char *file;           /**< __FILE__ of the call */
+    int line;                   /**< __LINE__ of the call */
+    enum ccn_bufprof_kind kind;
+    unsigned long long creates; /**< buffers created here */
+    unsigned long long grows;   /**< times these buffers were enlarged */
+    unsigned long long bytes;   /**< bytes allocated for these buffers */
+};
+
+/**
+ * Find (or make) the counters for a call site.
+ * @returns NULL if there is no room for more sites.
+ */
+struct ccn_bufprof_site *ccn_bufprof_site(const char *file, int line,
+                                          enum ccn_bufprof_kind kind);
+
+/**
+ * Note an allocation of bytes for a buffer created at site s.
+ *
+ * Used by the buffer code; s may be NULL.
+ */
+void ccn_bufprof_alloc(struct ccn_bufprof_site *s, size_t bytes, int grow);
+
+/**
+ * Copy out the busiest sites, most creates first.
+ * @returns the number copied, at most max.
+ */
+int ccn_bufprof_snapshot(struct ccn_bufprof_site *out, int max);
+
+/**
+ * Zero all the counters.
+ */
+void ccn_bufprof_reset(void);
+
+#endif
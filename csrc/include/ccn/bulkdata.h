@@ -0,0 +1,123 @@
+/**
+ * @file ccn/bulkdata.h
+ *
+ * Pipelined reception of a sequence of content objects.
+ *
+ * The items of the sequence are named by the prefix plus one more
+ * component, made from the sequence number by a ccn_seqfunc.  The
+ * interests are kept in flight under a congestion window (see
+ * ccn/window.h), answers that arrive ahead of their turn are held in a
+ * reassembly window, and the client sees the items strictly in order.
+ *
+ * The transfer ends with the item whose FinalBlockID matches its own
+ * last name component.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2008, 2009, 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_BULKDATA_DEFINED
+#define CCN_BULKDATA_DEFINED
+
+#include <stdint.h>
+#include <ccn/ccn.h>
+
+/*
+ * The client provides a ccn_seqfunc * (and perhaps a matching param)
+ * to specify the scheme for naming the content items in the sequence.
+ * Given the sequence number x, it should place in resultbuf the
+ * corresponding blob that that will be used in the final explicit
+ * Component of the Name of item x in the sequence.  This should
+ * act as a mathematical function, returning the same answer for a given x.
+ * (Usually param will be NULL, but is provided in case it is needed.)
+ */
+typedef void ccn_seqfunc(uintmax_t x, void *param,
+                         struct ccn_charbuf *resultbuf);
+
+/*
+ * Ready-to-use sequencing functions
+ * ccn_decimal_seqfunc - decimal ascii, as written by ccnsendchunks
+ * ccn_binary_seqfunc - big-endian binary with a leading zero byte
+ * ccn_segment_seqfunc - the CCN_MARKER_SEQNUM segment numbering
+ */
+extern ccn_seqfunc ccn_decimal_seqfunc;
+extern ccn_seqfunc ccn_binary_seqfunc;
+extern ccn_seqfunc ccn_segment_seqfunc;
+
+#define CCN_BULKDATA_ALLOW_STALE 1  /**< stale content may answer */
+#define CCN_BULKDATA_CUBIC       2  /**< CCN_WINDOW_CUBIC, not AIMD */
+
+struct ccn_bulkdata_params {
+    ccn_seqfunc *seqfunc;       /**< NULL for ccn_segment_seqfunc */
+    void *seqfunc_param;
+    uintmax_t first;            /**< sequence number to start from */
+    int flags;                  /**< CCN_BULKDATA_* */
+    int max_window;             /**< bound on items in flight or held */
+    int timeout_ms;             /**< give up after this long without progress */
+};
+
+struct ccn_bulkdata_stats {
+    intmax_t interests;         /**< interests expressed */
+    intmax_t received;          /**< answers received */
+    intmax_t delivered;         /**< items passed to the client */
+    intmax_t held;              /**< answers that arrived out of order */
+    intmax_t dups;              /**< answers that were not needed */
+    intmax_t timeouts;          /**< items asked for again on the timer */
+    intmax_t holes;             /**< items asked for again early */
+    double cwnd;                /**< current congestion window */
+    intmax_t srtt;              /**< smoothed round trip, microseconds */
+};
+
+struct ccn_bulkdata;
+
+/**
+ * Start receiving the sequence under prefix.
+ *
+ * params may be NULL for the defaults.  client->p is called with
+ * CCN_UPCALL_CONTENT (or CCN_UPCALL_CONTENT_RAW, when verification is
+ * deferred) once for each item, in sequence order.  Items that arrived
+ * out of order are presented without an interest in the info.
+ * Returning anything but CCN_UPCALL_RESULT_OK stops the transfer.
+ * client->p is called with CCN_UPCALL_FINAL by ccn_bulkdata_destroy.
+ *
+ * The work is done from ccn_run; when the transfer ends, ccn_run is
+ * made to return.
+ * @returns NULL for an error.
+ */
+struct ccn_bulkdata *ccn_bulkdata_create(struct ccn *h,
+                                         const struct ccn_charbuf *prefix,
+                                         const struct ccn_bulkdata_params *p,
+                                         struct ccn_closure *client);
+
+/**
+ * @returns 0 while in progress, 1 after the final item was delivered,
+ *          or -1 if the transfer stopped short.
+ */
+int ccn_bulkdata_status(struct ccn_bulkdata *b);
+
+/**
+ * @returns the sequence number of the next item to be delivered.
+ */
+uintmax_t ccn_bulkdata_next(struct ccn_bulkdata *b);
+
+void ccn_bulkdata_get_stats(struct ccn_bulkdata *b,
+                            struct ccn_bulkdata_stats *stats);
+
+/**
+ * Stop the transfer, if it is still going, and free the state.
+ */
+void ccn_bulkdata_destroy(struct ccn_bulkdata **bp);
+
+#endif
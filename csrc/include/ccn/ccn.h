@@ -23,6 +23,7 @@
 #define CCN_CCN_DEFINED
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <ccn/coding.h>
 #include <ccn/charbuf.h>
 #include <ccn/indexbuf.h>
@@ -143,11 +144,34 @@ struct ccn_upcall_info {
     struct ccn_indexbuf *content_comps;
 };
 
+/*
+ * ccn_slice_retain: keep part of a received message past the upcall
+ * The pointers in ccn_upcall_info are only good during the upcall.
+ * To hang on to (say) the ContentObject without copying it, call
+ * ccn_slice_retain(info->h, info->content_ccnb, info->pco->offset[CCN_PCO_E])
+ * from the upcall; the handle then leaves that input buffer alone
+ * until every slice of it has been released.  Bytes that did not come
+ * from the handle's input buffer are copied.
+ * Slices belong to the handle's thread.  Returns NULL for error.
+ */
+struct ccn_slice;
+struct ccn_slice *ccn_slice_retain(struct ccn *h,
+                                   const unsigned char *p, size_t size);
+const unsigned char *ccn_slice_buf(const struct ccn_slice *s);
+size_t ccn_slice_size(const struct ccn_slice *s);
+void ccn_slice_release(struct ccn_slice **sp);
+
 /*
  * ccn_create: create a client handle
  * Creates and initializes a client handle, not yet connected.
  * On error, returns NULL and sets errno.
  * Errors: ENOMEM
+ *
+ * Set CCNX_KEY_CACHE=1 in the environment to keep the public keys that
+ * the handle fetches in ~/.ccnx/keycache (or $CCNX_DIR/keycache), or set
+ * it to a directory name to keep them there, so that later processes
+ * can verify without fetching them again.  CCNX_KEY_CACHE_TTL is how
+ * many seconds a cached key is used for (default one day).
  */ 
 struct ccn *ccn_create(void);
 
@@ -185,6 +209,13 @@ void ccn_destroy(struct ccn **hp);
 /* Control where verification happens */
 int ccn_defer_verification(struct ccn *h, int defer);
 
+/*
+ * ccn_verify_threads: check signatures of incoming content on n threads
+ * Upcalls are still made by the handle, in arrival order.  n of 0 stops
+ * the threads; -1 leaves things as they are.  Returns the old count.
+ */
+int ccn_verify_threads(struct ccn *h, int n);
+
 /***********************************
  * Writing Names
  * Names for interests are constructed in charbufs using 
@@ -306,6 +337,26 @@ int ccn_express_interest(struct ccn *h,
                          struct ccn_closure *action,
                          struct ccn_charbuf *interest_template);
 
+/***********************************
+ * ccn_compile_interest:
+ * For expressing many interests that differ only in their last name
+ * component, such as the segments of a stream.  The name_prefix and
+ * interest_template (which may be NULL) are checked and encoded once,
+ * and may be reused or destroyed after the call.
+ * ccn_express_compiled_interest then behaves as ccn_express_interest
+ * would with the name_prefix extended by the size bytes at comp.
+ * Returns NULL if the name or template is not valid.
+ */
+struct ccn_compiled_interest;
+struct ccn_compiled_interest *
+ccn_compile_interest(struct ccn_charbuf *name_prefix,
+                     struct ccn_charbuf *interest_template);
+int ccn_express_compiled_interest(struct ccn *h,
+                                  struct ccn_compiled_interest *ci,
+                                  const void *comp, size_t size,
+                                  struct ccn_closure *action);
+void ccn_compiled_interest_destroy(struct ccn_compiled_interest **cip);
+
 /*
  * Register to receive interests on a prefix
  */
@@ -330,6 +381,29 @@ int ccn_set_interest_filter_with_flags(struct ccn *h,
  */
 int ccn_put(struct ccn *h, const void *p, size_t length);
 
+/*
+ * ccn_put_from_file: send ccn binary that is also held in a file
+ * Like ccn_put, but the caller vouches that p is a single well-formed
+ * object, and that the same bytes are in fd at offset.  Where it can,
+ * this sends them from the file to ccnd without copying them through
+ * user space; otherwise it falls back to ccn_put.
+ * Returns -1 for error, 0 if sent completely, 1 if queued.
+ */
+int ccn_put_from_file(struct ccn *h, const void *p, size_t length,
+                      int fd, off_t offset);
+
+/*
+ * ccn_batch_begin, ccn_batch_end:
+ * Between these calls ccn_put (and ccn_express_interest) only queues its
+ * output, which is written when the outermost batch ends, or sooner if
+ * a lot has built up.  This saves a write per message for bursts of
+ * small ones.  ccn_run does this for its upcalls and scheduled events.
+ * ccn_batch_end returns -1 for error, 0 if everything has been sent,
+ * 1 if some output is still queued.
+ */
+void ccn_batch_begin(struct ccn *h);
+int ccn_batch_end(struct ccn *h);
+
 /*
  * ccn_output_is_pending:
  * This is for client-managed select or poll.
@@ -352,6 +426,21 @@ int ccn_run(struct ccn *h, int timeout);
  */
 int ccn_set_run_timeout(struct ccn *h, int timeout);
 
+/*
+ * ccn_prepare_poll, ccn_process_ready: for client-managed event loops
+ * These let a handle be run from an existing poll, epoll or libevent
+ * loop instead of ccn_run.  ccn_prepare_poll does any scheduled work
+ * that is due, sets *events to the poll(2) events to wait for on
+ * ccn_get_connection_fd(h), and returns the number of microseconds to
+ * wait at most (0 means do not wait), or -1 for error.
+ * When the fd is ready or the time is up, call ccn_process_ready with
+ * the revents seen (0 for a timeout); it does not block, and returns
+ * a negative value for error.  Then call ccn_prepare_poll again.
+ * Neither may be called from an upcall.
+ */
+int ccn_prepare_poll(struct ccn *h, short *events);
+int ccn_process_ready(struct ccn *h, int revents);
+
 /*
  * ccn_get: Get a single matching ContentObject
  * This is a convenience for getting a single matching ContentObject.
@@ -376,11 +465,58 @@ int ccn_get(struct ccn *h,
 
 #define CCN_GET_NOKEYWAIT 1
 
+/*
+ * ccn_get_many: Get matching ContentObjects for many interests at once
+ * Like ccn_get, but keeps up to concurrency interests outstanding
+ * (0 for no limit), so that the round trips overlap.  Blocks until
+ * every item is answered or timeout_ms has passed.  Each item's res is
+ * set to 0 if it was answered, -1 if not.  If action is not NULL, it is
+ * called with data as each item completes, either way.
+ * Returns the number of items answered, or -1 for an error.
+ */
+struct ccn_get_item {
+    struct ccn_charbuf *name;                   /**< ccnb Name */
+    struct ccn_charbuf *interest_template;      /**< may be NULL */
+    struct ccn_charbuf *resultbuf;              /**< may be NULL */
+    struct ccn_parsed_ContentObject *pcobuf;    /**< may be NULL */
+    struct ccn_indexbuf *compsbuf;              /**< may be NULL */
+    int res;                                    /**< 0 if answered */
+};
+
+typedef void (*ccn_get_action)(struct ccn *h, void *data,
+                               struct ccn_get_item *item);
+
+int ccn_get_many(struct ccn *h,
+                 struct ccn_get_item *items,
+                 int n,
+                 int concurrency,
+                 int timeout_ms,
+                 int flags,
+                 ccn_get_action action,
+                 void *data);
+
 /* Handy if the content object didn't arrive in the usual way. */
 int ccn_verify_content(struct ccn *h,
                        const unsigned char *msg,
                        struct ccn_parsed_ContentObject *pco);
 
+/*
+ * ccn_verify_content_prepare, ccn_verify_content_done:
+ * Verification in two parts, so that the signature check can be done
+ * apart from the handle with ccn_verify_signature.  prepare returns
+ * 0 if the signature is good, -1 if it is bad, 1 if the key is not
+ * at hand, or 2 if the check is still to be done with *pubkey; done
+ * records a check that passed.
+ */
+int ccn_verify_content_prepare(struct ccn *h,
+                               const unsigned char *msg,
+                               struct ccn_parsed_ContentObject *pco,
+                               const struct ccn_pkey **pubkey);
+void ccn_verify_content_done(struct ccn *h,
+                             const unsigned char *msg,
+                             struct ccn_parsed_ContentObject *pco,
+                             const struct ccn_pkey *pubkey);
+
 /***********************************
  * Binary decoding
  * These routines require that the whole binary object be buffered.
@@ -684,6 +820,7 @@ struct ccn_parsed_ContentObject {
     unsigned short offset[CCN_PCO_E+1];
     unsigned char digest[32];	/* Computed only when needed */
     int digest_bytes;
+    int partial;        /* Signature and SignedInfo not yet parsed */
 };
 
 /*
@@ -700,6 +837,27 @@ int ccn_parse_ContentObject(const unsigned char *msg, size_t size,
                             struct ccn_parsed_ContentObject *x,
                             struct ccn_indexbuf *components);
 
+/*
+ * ccn_parse_ContentObject_name:
+ * A cheaper first stage of ccn_parse_ContentObject, for callers that
+ * often decide on the name alone.  Parses the framing, Name, and Content,
+ * but steps over the Signature and SignedInfo; x->partial is set, and
+ * x->type and the offsets within those two elements are not yet valid.
+ * Returns 0, or a negative value for an error.
+ */
+int ccn_parse_ContentObject_name(const unsigned char *msg, size_t size,
+                                 struct ccn_parsed_ContentObject *x,
+                                 struct ccn_indexbuf *components);
+
+/*
+ * ccn_parse_ContentObject_finish:
+ * Completes a parse begun by ccn_parse_ContentObject_name, leaving *x as
+ * ccn_parse_ContentObject would have.  Does nothing if x->partial is clear.
+ * Returns 0, or a negative value for an error.
+ */
+int ccn_parse_ContentObject_finish(const unsigned char *msg, size_t size,
+                                   struct ccn_parsed_ContentObject *x);
+
 void ccn_digest_ContentObject(const unsigned char *msg,
                               struct ccn_parsed_ContentObject *pc);
 
@@ -754,6 +912,13 @@ int ccn_name_comp_get(const unsigned char *data,
 
 int ccn_name_next_sibling(struct ccn_charbuf *c);
 
+/*
+ * ccn_name_shard: pick which of nshards owns a ccnb-encoded Name,
+ * by a hash of its first ncomps Components.  Returns -1 for a bad Name.
+ */
+int ccn_name_shard(const unsigned char *name, size_t size,
+                   int ncomps, int nshards);
+
 /***********************************
  * Reading content objects
  */
@@ -815,6 +980,22 @@ struct ccn_signing_params {
 #define CCN_SP_TEMPL_KEY_LOCATOR    0x0008
 #define CCN_SP_FINAL_BLOCK          0x0010
 #define CCN_SP_OMIT_KEY_LOCATOR     0x0020
+#define CCN_SP_DIGEST_ONLY          0x0040
+#define CCN_SP_HMAC                 0x0080
+
+/*
+ * CCN_SP_DIGEST_ONLY and CCN_SP_HMAC replace the public key signature
+ * with a much cheaper one, for content that stays on this host.
+ * A digest-only object carries just the SHA-256 of its signed portion,
+ * so it is checked for corruption but anyone could have made it.
+ * An HMAC object carries the HMAC-SHA256 of that under the local key,
+ * a secret shared by the producers and consumers on the host (see
+ * ccn_load_local_key), and can be verified only by them.  Neither kind
+ * needs a key locator, so none is added unless one is supplied.
+ *
+ * ccn_set_signing_policy makes one of these the default for the names
+ * under a prefix, for callers that do not ask for either.
+ */
 
 int ccn_sign_content(struct ccn *h,
                      struct ccn_charbuf *resultbuf,
@@ -822,6 +1003,18 @@ int ccn_sign_content(struct ccn *h,
                      const struct ccn_signing_params *params,
                      const void *data, size_t size);
 
+int ccn_sign_content_batch(struct ccn *h,
+                           struct ccn_charbuf **resultbufs, int n,
+                           const struct ccn_charbuf **names,
+                           const struct ccn_signing_params *params,
+                           const void **data, const size_t *sizes);
+
+int ccn_set_signing_policy(struct ccn *h,
+                           const struct ccn_charbuf *prefix,
+                           int sp_flags);
+
+int ccn_load_local_key(struct ccn *h, const char *path);
+
 int ccn_load_private_key(struct ccn *h,
                          const char *keystore_path,
                          const char *keystore_passphrase,
@@ -846,6 +1039,8 @@ int ccn_chk_signing_params(struct ccn *h,
 /* low-level content-object signing */
 
 #define CCN_SIGNING_DEFAULT_DIGEST_ALGORITHM "SHA256"
+#define CCN_SIGNING_DIGEST_ONLY_ALGORITHM "2.16.840.1.101.3.4.2.1"
+#define CCN_SIGNING_HMAC_SHA256_ALGORITHM "1.2.840.113549.2.9"
 
 int ccn_signed_info_create(
     struct ccn_charbuf *c,              /* filled with result */
@@ -865,6 +1060,51 @@ int ccn_encode_ContentObject(struct ccn_charbuf *buf,
                              const char *digest_algorithm,
                              const struct ccn_pkey *private_key);
 
+int ccn_encode_ContentObject_symmetric(struct ccn_charbuf *buf,
+                                       const struct ccn_charbuf *Name,
+                                       const struct ccn_charbuf *SignedInfo,
+                                       const void *data,
+                                       size_t size,
+                                       const void *key,
+                                       size_t keysize);
+
+int ccn_encode_ContentObjects(struct ccn_charbuf **bufs, int n,
+                              const struct ccn_charbuf **Names,
+                              const struct ccn_charbuf **SignedInfos,
+                              const void **data,
+                              const size_t *sizes,
+                              const char *digest_algorithm,
+                              const struct ccn_pkey *private_key);
+
+/*
+ * A ContentObject builder holds the parts of the encoding that stay the
+ * same from one object to the next for a given publisher key, type,
+ * freshness and key locator, so that a producer emitting many similar
+ * objects only encodes what changes.  The result is identical to that of
+ * ccn_signed_info_create followed by ccn_encode_ContentObject.
+ * The private key is not copied, and must outlive the builder.
+ */
+struct ccn_content_builder;
+
+struct ccn_content_builder *ccn_content_builder_create(
+    const void *publisher_key_id,       /* input, (sha256) hash */
+    size_t publisher_key_id_size,       /* input, 32 for sha256 hashes */
+    enum ccn_content_type type,         /* input */
+    int freshness,                      /* input, -1 means omit */
+    const struct ccn_charbuf *key_locator, /* input, optional, ccnb encoded */
+    const char *digest_algorithm,       /* input, NULL for default */
+    const struct ccn_pkey *private_key);
+
+void ccn_content_builder_destroy(struct ccn_content_builder **bp);
+
+int ccn_content_builder_encode(struct ccn_content_builder *b,
+    struct ccn_charbuf *buf,            /* result is appended */
+    const struct ccn_charbuf *Name,     /* input, ccnb encoded */
+    const struct ccn_charbuf *timestamp,/* input ccnb blob, NULL for "now" */
+    const struct ccn_charbuf *finalblockid, /* input, NULL means omit */
+    const void *data,
+    size_t size);
+
 /***********************************
  * Matching
  */
@@ -896,6 +1136,33 @@ int ccn_excluded(const unsigned char *excl,
                  const unsigned char *nextcomp,
                  size_t nextcomp_size);
 
+/*
+ * An Exclude may be compiled once, so that checking many candidates
+ * against it costs a binary search each rather than a full decode.
+ * ccn_compile_exclude returns NULL if the Exclude is malformed;
+ * the uncompiled routines still apply in that case.
+ */
+struct ccn_compiled_exclude;
+struct ccn_compiled_exclude *ccn_compile_exclude(const unsigned char *excl,
+                                                 size_t excl_size);
+void ccn_compiled_exclude_destroy(struct ccn_compiled_exclude **cep);
+int ccn_compiled_excluded(const struct ccn_compiled_exclude *ce,
+                          const unsigned char *nextcomp,
+                          size_t nextcomp_size);
+
+/*
+ * As ccn_content_matches_interest, with the Exclude (if any)
+ * given in compiled form by ce.  ce may be NULL.
+ */
+int ccn_content_matches_interest_excl(const unsigned char *content_object,
+                                      size_t content_object_size,
+                                      int implicit_content_digest,
+                                      struct ccn_parsed_ContentObject *pc,
+                                      const unsigned char *interest_msg,
+                                      size_t interest_msg_size,
+                                      const struct ccn_parsed_interest *pi,
+                                      const struct ccn_compiled_exclude *ce);
+
 /***********************************
  * StatusResponse
  */
@@ -1003,6 +1270,24 @@ int ccn_resolve_version(struct ccn *h,
                         int versioning_flags,
                         int timeout_ms);
 
+/*
+ * ccn_resolve_version_async: like ccn_resolve_version, without blocking
+ * The action is called exactly once, with res = 1 and the extended name
+ * if a version was found, res = 0 and the original name if not, or
+ * res = -1 if the handle went away first.  Only versions later than
+ * after (a version component value, may be NULL) are looked for, and
+ * the first of those ends the search.
+ */
+typedef void (*ccn_resolve_action)(struct ccn *h, void *data, int res,
+                                   const struct ccn_charbuf *name);
+
+int ccn_resolve_version_async(struct ccn *h,
+                              const struct ccn_charbuf *name, /* ccnb */
+                              int versioning_flags,
+                              int timeout_ms,
+                              const unsigned char *after, size_t after_size,
+                              ccn_resolve_action action, void *data);
+
 int ccn_create_version(struct ccn *h,
                        struct ccn_charbuf *name,
                        int versioning_flags,
@@ -29,6 +29,7 @@ struct ccn;
 struct ccn_charbuf;
 struct sockaddr_un;
 struct ccn_schedule;
+struct hashtb;
 
 /*
  * Dispatch a message as if it had arrived on the socket
@@ -41,6 +42,12 @@ void ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size);
  */
 int ccn_process_scheduled_operations(struct ccn *h);
 
+/*
+ * Number of expressed interests that were due at the last
+ * ccn_process_scheduled_operations call
+ */
+int ccn_interests_aged(struct ccn *h);
+
 /*
  * get or set the schedule in a handle.  Events on this schedule will
  * be run from the ccn_run() calls.
@@ -48,6 +55,12 @@ int ccn_process_scheduled_operations(struct ccn *h);
 struct ccn_schedule *ccn_get_schedule(struct ccn *h);
 struct ccn_schedule *ccn_set_schedule(struct ccn *h, struct ccn_schedule *s);
 
+/*
+ * Where the handle keeps its cache of resolved versions, for use by
+ * ccn_resolve_version_async.  The cache is destroyed with the handle.
+ */
+struct hashtb **ccn_version_cache(struct ccn *h);
+
 /*
  * Grab buffered output
  * Caller should destroy returned buffer.
@@ -56,4 +69,45 @@ struct ccn_charbuf *ccn_grab_buffered_output(struct ccn *h);
 
 void ccn_setup_sockaddr_un(const char *, struct sockaddr_un *);
 
+/*
+ * Several ccnd processes may share a host (and its port), each owning
+ * the names whose leading components hash to it; see ccn_name_shard.
+ * CCN_SHARDS gives the count, and each has its own unix-domain socket.
+ * CCN_SHARD_COMPONENTS says how many components are hashed.
+ */
+#define CCN_MAX_SHARDS 64
+#define CCN_MAX_SHARD_COMPONENTS 8
+#define CCN_SHARD_HASH_INIT 2166136261U
+int ccn_local_shards(void);
+int ccn_shard_components(void);
+uint32_t ccn_shard_hash(uint32_t, const unsigned char *, size_t);
+int ccn_shard_pick(uint32_t, int);
+void ccn_setup_sockaddr_un_shard(const char *, int, struct sockaddr_un *);
+
+/*
+ * Use an already-connected stream socket as the connection to ccnd
+ */
+int ccn_connect_fd(struct ccn *h, int fd);
+
+/*
+ * Threads for checking signatures of incoming content, as set up by
+ * ccn_verify_threads.  The message given to ccn_verifier_submit must
+ * stay put until its check is reaped; the fd is readable once a
+ * check has finished.
+ */
+struct ccn_verifier;
+struct ccn_pkey;
+struct ccn_parsed_ContentObject;
+struct ccn_verifier *ccn_verifier_create(int nthreads);
+void ccn_verifier_stop(struct ccn_verifier *v);
+void ccn_verifier_destroy(struct ccn_verifier **pv);
+int ccn_verifier_submit(struct ccn_verifier *v,
+                        const unsigned char *msg, size_t size,
+                        const struct ccn_parsed_ContentObject *pco,
+                        const struct ccn_pkey *pubkey, void *tag);
+int ccn_verifier_reap(struct ccn_verifier *v, void **tagp, int *resp);
+int ccn_verifier_fd(struct ccn_verifier *v);
+int ccn_verifier_threads(struct ccn_verifier *v);
+int ccn_verifier_outstanding(struct ccn_verifier *v);
+
 #endif
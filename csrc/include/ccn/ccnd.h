@@ -38,4 +38,25 @@
  */
 #define CCN_EMPTY_PDU "CCN\202\000"
 #define CCN_EMPTY_PDU_LENGTH 5
+
+/**
+ * A local client asks to switch its connection over to shared-memory
+ * rings (see ccn/shmring.h) by sending, as its first message, a scope 0
+ * Interest in this prefix.  ccnd answers "ok" or "no" in a ContentObject.
+ * With "ok" comes the descriptor of the rings, as SCM_RIGHTS ancillary
+ * data, and ccnd uses the rings for everything after the answer.
+ */
+#define CCN_SHM_URI "ccnx:/%C1.M.S.localhost/%C1.M.SHM"
+#define CCN_SHM_ENVNAME "CCN_SHM"
+
+/**
+ * A trusted local client (e.g. a repository) may add this component
+ * to the request to ask for length framing on what it sends.  Then
+ * each message it puts in its ring is preceded by its size, as a
+ * CCN_SHM_FRAME_BYTES integer in host byte order, and ccnd finds the
+ * messages by that rather than by decoding the ccnb stream.  What ccnd
+ * sends is not framed.  A client gets this with CCN_SHM=framed.
+ */
+#define CCN_SHM_FRAMED "\xC1.M.FRAMED"
+#define CCN_SHM_FRAME_BYTES 4
 #endif
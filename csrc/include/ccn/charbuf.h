@@ -24,13 +24,27 @@
 
 #include <stddef.h>
 #include <time.h>
+#ifdef CCN_BUF_PROFILE
+#include <ccn/bufprof.h>
+#endif
 
 struct ccn_charbuf {
     size_t length;
     size_t limit;
     unsigned char *buf;
+#ifdef CCN_BUF_PROFILE
+    struct ccn_bufprof_site *site;
+#endif
 };
 
+/*
+ * A charbuf keeps up to CCN_CHARBUF_INLINE bytes in the same allocation
+ * as the struct, and only goes to the heap separately when it grows
+ * beyond that.  So c->buf is never NULL for a live charbuf, and must not
+ * be freed or taken over by the caller; copy the bytes out instead.
+ */
+#define CCN_CHARBUF_INLINE 64
+
 /*
  * ccn_charbuf_create:  allocate a new charbuf
  * ccn_charbuf_create_n: allocate a new charbuf with a preallocated but
@@ -41,6 +55,32 @@ struct ccn_charbuf *ccn_charbuf_create(void);
 struct ccn_charbuf *ccn_charbuf_create_n(size_t n);
 void ccn_charbuf_destroy(struct ccn_charbuf **cbp);
 
+/*
+ * ccn_charbuf_init_inline: set up a charbuf that is not on the heap
+ * The first space bytes of storage are the ones that immediately follow
+ * the struct, as in
+ *
+ *     struct { struct ccn_charbuf c; unsigned char space[40]; } tmp;
+ *     ccn_charbuf_init_inline(&tmp.c, sizeof(tmp.space));
+ *
+ * No allocation happens unless the contents outgrow that space.
+ * ccn_charbuf_fini: release whatever such a charbuf has grown into
+ * Use this instead of ccn_charbuf_destroy for an inline charbuf.
+ */
+void ccn_charbuf_init_inline(struct ccn_charbuf *c, size_t space);
+void ccn_charbuf_fini(struct ccn_charbuf *c);
+
+#ifdef CCN_BUF_PROFILE
+/*
+ * In a profiling build, creation is counted against the caller's
+ * file and line (see ccn/bufprof.h).
+ */
+struct ccn_charbuf *ccn_charbuf_create_at(const char *file, int line);
+struct ccn_charbuf *ccn_charbuf_create_n_at(size_t n, const char *file, int line);
+#define ccn_charbuf_create() ccn_charbuf_create_at(__FILE__, __LINE__)
+#define ccn_charbuf_create_n(n) ccn_charbuf_create_n_at(n, __FILE__, __LINE__)
+#endif
+
 /*
  * ccn_charbuf_reserve: reserve some space in the buffer
  * Grows c->buf if needed and returns a pointer to the new region.
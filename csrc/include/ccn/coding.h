@@ -163,7 +163,24 @@ enum ccn_dtag {
     CCN_DTAG_SyncConfigSliceList = 125,
     CCN_DTAG_SyncConfigSliceOp = 126,
     CCN_DTAG_SyncNodeDeltas = 127,
+    CCN_DTAG_SyncNodeIBLT = 128,
+    CCN_DTAG_SyncIBLTCells = 129,
+    CCN_DTAG_SyncNodeBatch = 130,
+    CCN_DTAG_SyncNameSuffix = 131,
+    CCN_DTAG_EgressRate = 132,
+    CCN_DTAG_EgressBurst = 133,
+    CCN_DTAG_StoreQuota = 134,
+    CCN_DTAG_Manifest = 135,
+    CCN_DTAG_TrafficClass = 136,
+    CCN_DTAG_DefaultFreshness = 137,
+    CCN_DTAG_MaxResidency = 138,
     CCN_DTAG_SequenceNumber = 256,
+    CCN_DTAG_LinkFragment = 257,
+    CCN_DTAG_FragmentIndex = 258,
+    CCN_DTAG_FragmentCount = 259,
+    CCN_DTAG_FragmentRequest = 260,
+    CCN_DTAG_LinkAck = 261,
+    CCN_DTAG_AckMask = 262,
     CCN_DTAG_CCNProtocolDataUnit = 17702112
 };
 
@@ -48,4 +48,14 @@ void ccn_digest_init(struct ccn_digest *);
 int ccn_digest_update(struct ccn_digest *, const void *, size_t);
 int ccn_digest_final(struct ccn_digest *, unsigned char *, size_t);
 
+/*
+ * Digest each of n buffers in one call, for callers that hash many
+ * objects back to back.  No digest object is allocated.
+ * The n results are stored one after another, digest_size bytes each.
+ * Returns 0 on success, or -1 if the id or digest_size is not supported.
+ */
+int ccn_digest_buffers(enum ccn_digest_id, int n,
+                       const void **data, const size_t *sizes,
+                       unsigned char *results, size_t digest_size);
+
 #endif
@@ -37,4 +37,15 @@ void ccn_destroy_dict(struct ccn_dict **dp);
 int ccn_extend_dict(const char *dict_file, struct ccn_dict *d,
                     struct ccn_dict **rdp);
 
+/*
+ * Hashed index over a dictionary, for constant time lookups of the
+ * name for a dtag and of the dtag for a name.
+ */
+struct ccn_dict_index;
+
+struct ccn_dict_index *ccn_dict_index_create(const struct ccn_dict *d);
+void ccn_dict_index_destroy(struct ccn_dict_index **xp);
+const char *ccn_dict_index_name(const struct ccn_dict_index *x, int index);
+int ccn_dict_index_lookup(const struct ccn_dict_index *x, const char *name);
+
 #endif
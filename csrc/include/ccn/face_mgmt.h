@@ -33,6 +33,8 @@ struct ccn_face_instance {
     unsigned faceid;
     struct ccn_sockdescr descr;
     int lifetime;
+    int rate;           /**< egress bytes per second, 0 for none, -1 if absent */
+    int burst;          /**< egress burst in bytes, or -1 if absent */
     struct ccn_charbuf *store;
 };
 
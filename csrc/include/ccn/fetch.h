@@ -50,9 +50,15 @@ typedef enum {
 	ccn_fetch_flags_NoteFinal = 16,
 	ccn_fetch_flags_NoteTimeout = 32,
 	ccn_fetch_flags_NoteOpenClose = 64,
+	ccn_fetch_flags_NoteWindow = 128,
 	ccn_fetch_flags_NoteAll = 0xffff
 } ccn_fetch_flags;
 
+typedef enum {
+	ccn_fetch_window_AIMD = 0,
+	ccn_fetch_window_CUBIC = 1
+} ccn_fetch_window_mode;
+
 #define CCN_FETCH_READ_ZERO (-3)
 #define CCN_FETCH_READ_TIMEOUT (-2)
 #define CCN_FETCH_READ_NONE (-1)
@@ -124,6 +130,17 @@ ccn_fetch_open(struct ccn_fetch *f, struct ccn_charbuf *name,
 			   int resolveVersion,
 			   int assumeFixed);
 
+/**
+ * Fetches the segments of the stream by way of its manifest
+ * (see ccn/manifest.h), which is looked for within timeoutMs.
+ * Only the signature of the manifest is checked; each segment is
+ * asked for by its digest, and checked with a hash.
+ * Must be called before anything is read from the stream.
+ * @returns -1 if there is no manifest, otherwise returns 0.
+ */
+int
+ccn_fetch_use_manifest(struct ccn_fetch_stream *fs, int timeoutMs);
+
 /**
  * Closes the stream and reclaims any resources used by the stream.
  * The stream object will be freed, so the client must not access it again.
@@ -163,6 +180,22 @@ ccn_fetch_read(struct ccn_fetch_stream *fs,
 			   void *buf,
 			   intmax_t len);
 
+/**
+ * Reads bytes from a stream without copying them.
+ * Like ccn_fetch_read, except that *pbuf is set to point at the bytes
+ * where they are buffered, rather than having them copied out.
+ * At most len bytes are returned, and no more than the rest of the
+ * segment at the read position, so it may take several calls to read
+ * what ccn_fetch_read would in one.
+ * The bytes remain valid until the next ccn_fetch_read,
+ * ccn_fetch_read_view, ccn_fetch_seek or ccn_fetch_close on the stream.
+ * @returns as for ccn_fetch_read.
+ */
+intmax_t
+ccn_fetch_read_view(struct ccn_fetch_stream *fs,
+					const unsigned char **pbuf,
+					intmax_t len);
+
 /**
  * Resets the timeout indicator, which will cause pending interests to be
  * retried.  The client determines conditions for a timeout to be considered
@@ -184,6 +217,67 @@ int
 ccn_fetch_seek(struct ccn_fetch_stream *fs,
 			   intmax_t pos);
 
+/**
+ * Selects how the congestion window of the stream grows.
+ * Each stream keeps a window that limits the interests in flight.  It
+ * starts out small and grows as segments arrive, up to the number of
+ * buffers; it shrinks when an interest goes unanswered for longer than
+ * the retransmission timeout (which is derived from the measured round
+ * trip times), or when several later segments arrive ahead of one.
+ * ccn_fetch_window_AIMD (the default) grows the window linearly once
+ * past slow start, and halves it on a loss.
+ * ccn_fetch_window_CUBIC grows it as a cubic function of the time since
+ * the last loss, which recovers faster on paths with a large
+ * bandwidth-delay product, and cuts it back less on a loss.
+ */
+void
+ccn_fetch_set_window_mode(struct ccn_fetch_stream *fs,
+						  ccn_fetch_window_mode mode);
+
+/**
+ * Limits the interests in flight for all of the streams together.
+ * When a budget is set, the streams take turns placing one interest
+ * at a time, so that each gets a fair share of it; each stream is still
+ * held to its own congestion window as well.
+ * 0 (the default) means no limit beyond the windows.
+ */
+void
+ccn_fetch_set_budget(struct ccn_fetch *f, int maxInterests);
+
+/**
+ * Writes the data of the stream to the file fd as the segments arrive,
+ * using pwrite at the position of each segment, so that they need not
+ * wait for the ones before them.  The file is extended to its final
+ * size as soon as that is known.  Positions can only be inferred out of
+ * order when the segment size is fixed (see ccn_fetch_open).
+ * Once a sink is set, ccn_fetch_read returns CCN_FETCH_READ_NONE, and
+ * ccn_fetch_avail returns CCN_FETCH_READ_END when the file is complete.
+ * @returns -1 if the stream has already been read from, otherwise 0.
+ */
+int
+ccn_fetch_set_sink(struct ccn_fetch_stream *fs, int fd);
+
+/**
+ * Fetches a list of streams at once, names[i] into the file fds[i].
+ * The streams are opened as by ccn_fetch_open (assuming fixed size
+ * segments), given sinks, and run until each one completes or fails.
+ * Use ccn_fetch_set_budget beforehand to share a limit on the interests
+ * in flight among them.
+ * If results != NULL, results[i] gets the size of stream i if it was
+ * fetched completely, otherwise CCN_FETCH_READ_TIMEOUT,
+ * CCN_FETCH_READ_ZERO, or CCN_FETCH_READ_NONE (could not be opened
+ * or written).
+ * @returns the number of streams fetched completely.
+ */
+int
+ccn_fetch_bulk(struct ccn_fetch *f, int n,
+			   struct ccn_charbuf **names,
+			   const int *fds,
+			   intmax_t *results,
+			   struct ccn_charbuf *interestTemplate,
+			   int maxBufs,
+			   int resolveVersion);
+
 /**
  * @returns the current read position (initially 0)
  */
@@ -25,12 +25,15 @@
 #include <stddef.h>
 
 struct hashtb; /* details are private to the implementation */
+struct ccn_memacct; /* see <ccn/memacct.h> */
 struct hashtb_enumerator; /* more about this below */
 typedef void (*hashtb_finalize_proc)(struct hashtb_enumerator *);
 struct hashtb_param {
     hashtb_finalize_proc finalize; /* default is NULL */
     void *finalize_data;           /* default is NULL */
     int orders;                    /* default is 0 */
+    struct ccn_memacct *memacct;   /* counts the table's memory, or NULL */
+    int shrink;                    /* nonzero to give back slots as it empties */
 }; 
 
 /*
@@ -69,6 +72,40 @@ hashtb_n(struct hashtb *ht);
 void *
 hashtb_lookup(struct hashtb *ht, const void *key, size_t keysize);
 
+/*
+ * hashtb_hash: Hash a key with a secret chosen when the process starts.
+ * This is for hashes kept outside any table; each table uses a key of
+ * its own, so this is not the hash a table would compute.
+ */
+size_t
+hashtb_hash(const unsigned char *key, size_t keysize);
+
+/*
+ * hashtb_table_hash: Compute the hash of a key, as used internally by ht.
+ */
+size_t
+hashtb_table_hash(struct hashtb *ht, const unsigned char *key, size_t keysize);
+
+/*
+ * hashtb_hash_prefixes: Hash a series of prefixes in one pass, for ht.
+ * For 0 <= i < n, hashes[i] is set to the hash of the key
+ * starting at buf + offsets[0] and ending at buf + offsets[i].
+ * The offsets must be non-decreasing, as in a component indexbuf
+ * for a ccnb Name.
+ */
+void
+hashtb_hash_prefixes(struct hashtb *ht,
+                     const unsigned char *buf, const size_t *offsets, int n,
+                     size_t *hashes);
+
+/*
+ * hashtb_lookup_hashed: Like hashtb_lookup, with a precomputed hash.
+ * The hash must be what hashtb_table_hash would compute for that key.
+ */
+void *
+hashtb_lookup_hashed(struct hashtb *ht, const void *key, size_t keysize,
+                     size_t hash);
+
 /* The client owns the memory for an enumerator, normally in a local. */ 
 struct hashtb_enumerator {
     struct hashtb *ht;
@@ -111,6 +148,15 @@ hashtb_seek(struct hashtb_enumerator *hte,
 #define HT_OLD_ENTRY 0
 #define HT_NEW_ENTRY 1
 
+/*
+ * hashtb_seek_hashed: Like hashtb_seek, with a precomputed hash.
+ * The hash must be what hashtb_table_hash would compute for that key.
+ */
+int
+hashtb_seek_hashed(struct hashtb_enumerator *hte,
+                   const void *key, size_t keysize, size_t extsize,
+                   size_t hash);
+
 /*
  * hashtb_delete: Delete an item
  * The item will be unlinked from the table, and will
@@ -125,6 +171,8 @@ void hashtb_delete(struct hashtb_enumerator *);
 
 /*
  * hashtb_rehash: Hint about number of buckets to use
+ * The table is sized so that it can hold n_buckets entries (or the
+ * current number, if larger) without growing.
  * Normally the implementation grows the number of buckets as needed.
  * This optional call might help if the caller knows something about
  * the expected number of elements in advance, or if the size of the
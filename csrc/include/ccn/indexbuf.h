@@ -23,13 +23,27 @@
 #define CCN_INDEXBUF_DEFINED
 
 #include <stddef.h>
+#ifdef CCN_BUF_PROFILE
+#include <ccn/bufprof.h>
+#endif
 
 struct ccn_indexbuf {
     size_t n;
     size_t limit;
     size_t *buf;
+#ifdef CCN_BUF_PROFILE
+    struct ccn_bufprof_site *site;
+#endif
 };
 
+/*
+ * A new indexbuf has room for CCN_INDEXBUF_INLINE elements inside its
+ * own allocation, and only goes to the heap separately when it grows
+ * beyond that.  Code should not hold on to c->buf across calls that
+ * may grow the buffer, nor free it directly.
+ */
+#define CCN_INDEXBUF_INLINE 16
+
 struct ccn_indexbuf *ccn_indexbuf_create(void);
 void ccn_indexbuf_destroy(struct ccn_indexbuf **cbp);
 size_t *ccn_indexbuf_reserve(struct ccn_indexbuf *c, size_t n);
@@ -42,4 +56,25 @@ int ccn_indexbuf_remove_first_match(struct ccn_indexbuf *x, size_t val);
 void ccn_indexbuf_move_to_end(struct ccn_indexbuf *x, size_t val);
 void ccn_indexbuf_move_to_front(struct ccn_indexbuf *x, size_t val);
 
+/*
+ * An indexbuf that lives on the stack (or inside another struct), with
+ * its first elements in the space that immediately follows it:
+ *
+ *     struct { struct ccn_indexbuf x; size_t space[8]; } tmp;
+ *     ccn_indexbuf_init_inline(&tmp.x, 8);
+ *     ...
+ *     ccn_indexbuf_fini(&tmp.x);
+ *
+ * ccn_indexbuf_fini frees any storage it grew into; it must not be
+ * passed to ccn_indexbuf_destroy.
+ */
+void ccn_indexbuf_init_inline(struct ccn_indexbuf *c, size_t space);
+void ccn_indexbuf_fini(struct ccn_indexbuf *c);
+
+#ifdef CCN_BUF_PROFILE
+/* Count creation against the caller (see ccn/bufprof.h) */
+struct ccn_indexbuf *ccn_indexbuf_create_at(const char *file, int line);
+#define ccn_indexbuf_create() ccn_indexbuf_create_at(__FILE__, __LINE__)
+#endif
+
 #endif
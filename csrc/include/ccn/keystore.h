@@ -42,8 +42,19 @@ struct ccn_pkey;
  */
 struct ccn_certificate;
 
+/*
+ * key types for ccn_keystore_file_init_key
+ */
+#define CCN_KEYSTORE_KEY_RSA 0  /**< RSA, 1024 bits by default */
+#define CCN_KEYSTORE_KEY_EC  1  /**< ECDSA on the P-256 curve */
+
 struct ccn_keystore *ccn_keystore_create(void);
 void ccn_keystore_destroy(struct ccn_keystore **p);
+/*
+ * Set CCNX_KEYSTORE_CACHE=1 in the environment to let ccn_keystore_init
+ * keep the unlocked key in a private cache file next to the keystore,
+ * which makes later loads much faster.
+ */
 int ccn_keystore_init(struct ccn_keystore *p, char *name, char *password);
 const struct ccn_pkey *ccn_keystore_private_key(struct ccn_keystore *p);
 const struct ccn_pkey *ccn_keystore_public_key(struct ccn_keystore *p);
@@ -52,4 +63,5 @@ ssize_t ccn_keystore_public_key_digest_length(struct ccn_keystore *p);
 const unsigned char *ccn_keystore_public_key_digest(struct ccn_keystore *p);
 const struct ccn_certificate *ccn_keystore_certificate(struct ccn_keystore *p);
 int ccn_keystore_file_init(char *filename, char *password, char *subject, int keylength, int validity_days);
+int ccn_keystore_file_init_key(char *filename, char *password, char *subject, int keytype, int keylength, int validity_days);
 #endif
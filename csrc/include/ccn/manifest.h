@@ -0,0 +1,73 @@
+/**
+ * @file ccn/manifest.h
+ *
+ * Manifests for segmented content.
+ *
+ * A manifest lists the digests of the segments of a stream, so that
+ * one signature over the manifest stands for all of them.  Each segment
+ * is then asked for by its implicit digest and checked with a hash.
+ * Large streams get a tree of manifest nodes, each listing at most
+ * CCN_MANIFEST_FANOUT digests.  Only the root is signed with a key;
+ * the nodes below it are reached by digest, like the segments.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_MANIFEST_DEFINED
+#define CCN_MANIFEST_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ccn/charbuf.h>
+
+struct ccn;
+
+/** Size of each digest listed, the SHA-256 of a whole ContentObject */
+#define CCN_MANIFEST_DIGEST_BYTES 32
+/** Most digests listed by one manifest node */
+#define CCN_MANIFEST_FANOUT 100
+/** Most levels of nodes under the root */
+#define CCN_MANIFEST_MAX_DEPTH 8
+
+/**
+ * One manifest node.
+ *
+ * The node covers count segments from segment start.  Each of its n
+ * digests is of an item covering block_size of those segments: the
+ * segments themselves when block_size is 1, and otherwise the manifest
+ * nodes of the level below.
+ */
+struct ccn_manifest {
+    uintmax_t start;
+    uintmax_t count;
+    uintmax_t block_size;
+    int n;
+    struct ccn_charbuf *digests;    /**< n digests, end to end */
+};
+
+struct ccn_manifest *ccn_manifest_parse(const unsigned char *, size_t);
+
+void ccn_manifest_destroy(struct ccn_manifest **);
+
+int ccnb_append_manifest(struct ccn_charbuf *, const struct ccn_manifest *);
+
+int ccn_name_append_manifest(struct ccn_charbuf *name,
+                             int level, uintmax_t start);
+
+int ccn_manifest_put(struct ccn *h, struct ccn_charbuf *name,
+                     const unsigned char *digests, uintmax_t count);
+
+#endif
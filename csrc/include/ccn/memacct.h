@@ -0,0 +1,64 @@
+/**
+ * @file ccn/memacct.h
+ *
+ * Counting allocator wrappers, for attributing memory to subsystems.
+ *
+ * Each subsystem that wants its memory counted keeps a struct
+ * ccn_memacct (its tag) and allocates through these wrappers instead
+ * of malloc and friends.  The tag then holds the live bytes and objects
+ * and the most bytes ever live at once.  A block carries its size in a
+ * small header, so it must be freed or reallocated with the same tag
+ * it was allocated with.  With a NULL tag the wrappers are plain
+ * malloc, calloc, realloc and free, with no header.
+ *
+ * Memory that a subsystem does not allocate itself may still be
+ * charged to its tag with ccn_memacct_note or ccn_memacct_set.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_MEMACCT_DEFINED
+#define CCN_MEMACCT_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ccn_memacct {
+    const char *name;           /**< for reports */
+    uintmax_t bytes;            /**< bytes live now */
+    uintmax_t objects;          /**< allocations live now */
+    uintmax_t peak;             /**< most bytes live at once */
+};
+
+void *ccn_memacct_malloc(struct ccn_memacct *a, size_t size);
+void *ccn_memacct_calloc(struct ccn_memacct *a, size_t n, size_t size);
+void *ccn_memacct_realloc(struct ccn_memacct *a, void *p, size_t size);
+void ccn_memacct_free(struct ccn_memacct *a, void *p);
+
+/*
+ * Charge (or with negative values, credit) a tag for memory allocated
+ * by other means.
+ */
+void ccn_memacct_note(struct ccn_memacct *a, intmax_t bytes, intmax_t objects);
+
+/*
+ * Set a tag outright, for memory that is counted by taking a census
+ * rather than at each allocation.  The peak is then only as good as
+ * the sampling.
+ */
+void ccn_memacct_set(struct ccn_memacct *a, uintmax_t bytes, uintmax_t objects);
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file ccn/mux.h
+ *
+ * One ccnd connection shared by ccn handles in several threads.
+ *
+ * A ccn handle is not thread-safe, so a multi-threaded client gives each
+ * thread a handle of its own.  Rather than have each of those connect
+ * to ccnd, they may be attached to a ccn_mux, which holds the one real
+ * connection.  Each attached handle is joined to the mux by a socketpair,
+ * and is otherwise an ordinary handle: its thread expresses interests,
+ * runs ccn_run (or its own event loop), and gets its own upcalls.
+ * The handles do share the cache of verified content, so an object
+ * verified in one thread is not checked again in the others.
+ *
+ * The mux runs in a thread of its own, in ccn_mux_run.  It passes
+ * everything from the attached handles up to ccnd.  Content coming back
+ * is passed only to the handles that have expressed unexpired interests
+ * under a prefix of its name; interests coming from ccnd are passed to
+ * all of them, and each handle's interest filters sort them out.  All of
+ * the mux's own state belongs to its thread, so there are no locks.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_MUX_DEFINED
+#define CCN_MUX_DEFINED
+
+struct ccn;
+struct ccn_mux;
+
+/**
+ * Connect to ccnd, using the unix-domain socket name (NULL for the
+ * default, as for ccn_connect).
+ * @returns the new mux, or NULL for error.
+ */
+struct ccn_mux *ccn_mux_create(const char *name);
+
+/**
+ * Connect an unconnected handle through the mux.
+ *
+ * This may be called from any thread, while ccn_mux_run is running
+ * in another.  The handle belongs to the calling thread as usual,
+ * and should be created and destroyed there.
+ * Disconnecting or destroying the handle detaches it.
+ * @returns the handle's fd, or -1 for error.
+ */
+int ccn_mux_attach(struct ccn_mux *m, struct ccn *h);
+
+/**
+ * Pass messages between ccnd and the attached handles.
+ *
+ * The timeout is in milliseconds, or -1 to run for as long as
+ * the ccnd connection lasts.
+ * @returns 0 when the time is up, or -1 if the ccnd connection was lost.
+ */
+int ccn_mux_run(struct ccn_mux *m, int timeout);
+
+/**
+ * Close the ccnd connection and the ends of the attached handles'
+ * connections that the mux holds.
+ */
+void ccn_mux_destroy(struct ccn_mux **mp);
+
+#endif
@@ -21,6 +21,7 @@
 #define CCN_REG_MGMT_DEFINED
 
 #include <stddef.h>
+#include <stdint.h>
 #include <ccn/charbuf.h>
 
 struct ccn_forwarding_entry {
@@ -31,9 +32,22 @@ struct ccn_forwarding_entry {
     unsigned faceid;
     int flags;
     int lifetime;
+    intmax_t store_quota;   /**< content store bytes for the prefix,
+                                 0 to lift, -1 if absent */
+    int traffic_class;      /**< 0 to CCN_TRAFFIC_CLASSES - 1,
+                                 or -1 if absent */
+    int default_freshness;  /**< seconds for content under the prefix that
+                                 lacks FreshnessSeconds, 0 to lift,
+                                 -1 if absent */
+    int max_residency;      /**< most seconds content under the prefix
+                                 stays in the store, 0 to lift,
+                                 -1 if absent */
     unsigned char store[48];
 };
 
+/** TrafficClass values run from 0 (served first) to this, less 1 */
+#define CCN_TRAFFIC_CLASSES 4
+
 /** Refer to doc/technical/Registration.txt for the meaning of these flags */
 #define CCN_FORW_ACTIVE         1
 #define CCN_FORW_CHILD_INHERIT  2
@@ -43,6 +57,9 @@ struct ccn_forwarding_entry {
 #define CCN_FORW_LOCAL         32
 #define CCN_FORW_TAP           64
 #define CCN_FORW_CAPTURE_OK   128
+#define CCN_FORW_BALANCE      256
+#define CCN_FORW_BEST         512
+#define CCN_FORW_NOCACHE     1024
 #define CCN_FORW_PUBMASK (CCN_FORW_ACTIVE        | \
                           CCN_FORW_CHILD_INHERIT | \
                           CCN_FORW_ADVERTISE     | \
@@ -50,7 +67,10 @@ struct ccn_forwarding_entry {
                           CCN_FORW_CAPTURE       | \
                           CCN_FORW_LOCAL         | \
                           CCN_FORW_TAP           | \
-                          CCN_FORW_CAPTURE_OK    )
+                          CCN_FORW_CAPTURE_OK    | \
+                          CCN_FORW_BALANCE       | \
+                          CCN_FORW_BEST          | \
+                          CCN_FORW_NOCACHE       )
 
 struct ccn_forwarding_entry *
 ccn_forwarding_entry_parse(const unsigned char *p, size_t size);
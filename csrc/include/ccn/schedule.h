@@ -48,6 +48,25 @@ struct ccn_gettime {
     void *data;                /* for private use by gettime */
 };
 
+/*
+ * A cached monotonic clock
+ * ccn_clock_refresh reads the system's monotonic clock (the coarse
+ * variant, where that is at least 1 millisecond fine) into now, and the
+ * gettime member just reports the saved value.  So an event loop that
+ * refreshes once per turn, and hands &clock->gettime to
+ * ccn_schedule_create, reads the clock once per turn no matter how often
+ * the scheduler and the rest of the program look at it.  The time is
+ * not disturbed by steps of the wall clock, but neither is it a date;
+ * use gettimeofday for anything that is displayed or sent elsewhere.
+ */
+struct ccn_clock {
+    struct ccn_gettime gettime; /* reports now */
+    struct ccn_timeval now;     /* as of the latest refresh */
+    int id;                     /* the system clock in use, or -1 */
+};
+void ccn_clock_init(struct ccn_clock *clock);
+const struct ccn_timeval *ccn_clock_refresh(struct ccn_clock *clock);
+
 /*
  * The scheduled action may return a non-positive value
  * if the event should not be scheduled to occur again,
@@ -71,6 +90,10 @@ struct ccn_scheduled_event {
 
 /*
  * Create and destroy
+ * If the environment variable CCN_SCHEDULE is "wheel" at creation time,
+ * a timer wheel is used in place of the default heap.  This makes
+ * scheduling and cancellation constant-time, and a cancelled event is
+ * freed immediately, so it must not be referred to afterwards.
  */
 struct ccn_schedule *ccn_schedule_create(void *clienth,
                                          const struct ccn_gettime *ccnclock);
@@ -83,6 +106,8 @@ const struct ccn_gettime *ccn_schedule_get_gettime(struct ccn_schedule *);
 
 /*
  * ccn_schedule_event: schedule a new event
+ * The macro form passes the spelling of the action along, so that
+ * the lateness statistics (below) can show it.
  */
 struct ccn_scheduled_event *ccn_schedule_event(
     struct ccn_schedule *sched,
@@ -90,6 +115,15 @@ struct ccn_scheduled_event *ccn_schedule_event(
     ccn_scheduled_action action,
     void *evdata,
     intptr_t evint);
+struct ccn_scheduled_event *ccn_schedule_event_named(
+    struct ccn_schedule *sched,
+    int micros,
+    ccn_scheduled_action action,
+    void *evdata,
+    intptr_t evint,
+    const char *name);
+#define ccn_schedule_event(sched, micros, action, evdata, evint) \
+    ccn_schedule_event_named(sched, micros, action, evdata, evint, #action)
 
 /*
  * ccn_schedule_cancel: cancel a scheduled event
@@ -106,4 +140,75 @@ int ccn_schedule_cancel(struct ccn_schedule *, struct ccn_scheduled_event *);
  */
 int ccn_schedule_run(struct ccn_schedule *);
 
+/*
+ * Lateness statistics
+ * Each time an event runs, the schedule notes how late it is (in micros,
+ * as of the schedule's latest reading of the clock), accumulated for each
+ * distinct action.  Bucket 0 of the histogram counts the runs that were
+ * on time; bucket i counts those from 2**(i-1) to 2**i - 1 micros late.
+ */
+#define CCN_SCHEDULE_LAG_BUCKETS 32
+struct ccn_schedule_lag {
+    ccn_scheduled_action action;
+    const char *name;           /* spelling of the action, or NULL */
+    uintmax_t runs;
+    uintmax_t late_sum;         /* micros */
+    unsigned late_max;          /* micros */
+    unsigned hist[CCN_SCHEDULE_LAG_BUCKETS];
+};
+
+/*
+ * ccn_schedule_lag: copy out the lateness statistics
+ * Fills in at most max entries, busiest actions first.
+ * Returns the number filled in.
+ */
+int ccn_schedule_lag(struct ccn_schedule *sched,
+                     struct ccn_schedule_lag *out, int max);
+
+/*
+ * ccn_schedule_lag_percentile: estimate a percentile of the lateness
+ * The result is the upper end of the bucket, but not more than late_max.
+ */
+unsigned ccn_schedule_lag_percentile(const struct ccn_schedule_lag *lag,
+                                     unsigned pct);
+
+/*
+ * Event loop accounting
+ * A client's loop should call ccn_schedule_note_idle(sched, 1) just
+ * before it waits for i/o, and ccn_schedule_note_idle(sched, 0) just
+ * after (a second call is harmless).  The schedule then keeps track of how the time is divided
+ * between waiting, running scheduled events, and everything else.
+ * With a cached clock, time spent in ccn_schedule_run is only seen at
+ * the next refresh, and is charged to events then.
+ */
+struct ccn_schedule_load {
+    uintmax_t total;            /* micros since the schedule was created */
+    uintmax_t idle;             /* micros spent waiting */
+    uintmax_t events;           /* micros spent in ccn_schedule_run */
+    uintmax_t wakeups;          /* waits that have ended */
+    uintmax_t slack_time;       /* micros with timer slack in effect */
+    uintmax_t slack_wakeups;    /* waits ended while it was */
+};
+void ccn_schedule_note_idle(struct ccn_schedule *sched, int idle);
+void ccn_schedule_get_load(struct ccn_schedule *sched,
+                           struct ccn_schedule_load *load);
+
+/*
+ * Timer slack
+ * With slack set, ccn_schedule_run rounds the time until the next event
+ * up to a multiple of the slack (in the schedule's own time), so every
+ * wait ends on a common grid and events that fall due close together
+ * are run by a single wakeup.  Events may then run up to slack micros
+ * late.  This suits a client with nothing pending but housekeeping;
+ * set it back to 0 when there is real work.  The load statistics count
+ * the wakeups, and the time and wakeups spent with slack in effect.
+ */
+void ccn_schedule_set_slack(struct ccn_schedule *sched, int micros);
+
+/*
+ * ccn_schedule_memory: bytes held by the schedule, for memory reports
+ * Sets *nevents (if not NULL) to the number of pending events.
+ */
+size_t ccn_schedule_memory(struct ccn_schedule *sched, int *nevents);
+
 #endif
@@ -22,6 +22,7 @@
 #define CCN_SEQWRITER_DEFINED
 
 #include <stddef.h>
+#include <stdint.h>
 struct ccn_seqwriter;
 struct ccn;
 struct ccn_charbuf;
@@ -33,6 +34,10 @@ int ccn_seqw_get_name(struct ccn_seqwriter *w, struct ccn_charbuf *nv);
 int ccn_seqw_write(struct ccn_seqwriter *w, const void *buf, size_t size);
 int ccn_seqw_batch_end(struct ccn_seqwriter *w);
 int ccn_seqw_set_block_limits(struct ccn_seqwriter *w, int l, int h);
+int ccn_seqw_set_window(struct ccn_seqwriter *w, int window);
+int ccn_seqw_set_manifest(struct ccn_seqwriter *w, int on);
+int ccn_seqw_get_counts(struct ccn_seqwriter *w, uintmax_t *signatures,
+                        uintmax_t *puts, int *ready);
 int ccn_seqw_close(struct ccn_seqwriter *w);
 
 #endif
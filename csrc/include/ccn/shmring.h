@@ -0,0 +1,96 @@
+/**
+ * @file ccn/shmring.h
+ *
+ * Shared-memory rings for a local client connection.
+ *
+ * A pair of byte-stream rings, one in each direction, in shared memory
+ * that both ends have mapped.  ccnd creates it, seals it at its size,
+ * and passes the descriptor to the client over the unix-domain socket;
+ * after that the ccnb stream goes through the rings rather than through
+ * the socket.  The socket stays open, and serves as the doorbell: a
+ * byte is sent on it only when the other end has said that it is about
+ * to wait, for data or for space.
+ *
+ * The memory is a sealed memfd, so this is only available on Linux.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_SHMRING_DEFINED
+#define CCN_SHMRING_DEFINED
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <ccn/charbuf.h>
+
+struct ccn_shmring;
+
+/** Default size of each of the two rings */
+#define CCN_SHMRING_SIZE (1 << 20)
+
+/*
+ * Create and destroy
+ * ccn_shmring_create makes shared memory with rings of at least size
+ * bytes, sealed so that it can be neither shrunk nor grown, and puts a
+ * descriptor for it into *fdp, for the caller to pass to the other end
+ * and then close.  ccn_shmring_attach maps memory made by
+ * ccn_shmring_create, taking the other end's part; it refuses anything
+ * that is not so sealed, and does not close fd.  In either case sock is
+ * the connected socket to use as the doorbell; it is not closed by
+ * ccn_shmring_destroy.  Both return NULL on failure, and always where
+ * sealed memory is not available.
+ */
+struct ccn_shmring *ccn_shmring_create(size_t size, int sock, int *fdp);
+struct ccn_shmring *ccn_shmring_attach(int fd, int sock);
+void ccn_shmring_destroy(struct ccn_shmring **);
+
+/*
+ * Passing the descriptor
+ * ccn_shmring_sendfd sends size bytes from p on a unix-domain socket
+ * with fd attached.  ccn_shmring_recvfd receives into buf, and if a
+ * descriptor came along with the data and *fdp is -1, stores it there.
+ * Both return what sendmsg or recvmsg does.
+ */
+ssize_t ccn_shmring_sendfd(int sock, const void *p, size_t size, int fd);
+ssize_t ccn_shmring_recvfd(int sock, void *buf, size_t size, int *fdp);
+
+/*
+ * Transfer
+ * These never block.  Each returns the number of bytes moved, which is
+ * 0 if the outgoing ring is full or the incoming one is empty; the
+ * other end is rung if it was waiting on what was done.  When a write
+ * comes up short, the other end is asked to ring back once it has made
+ * some room.
+ */
+ssize_t ccn_shmring_write(struct ccn_shmring *, const void *p, size_t size);
+ssize_t ccn_shmring_writev(struct ccn_shmring *,
+                           const struct iovec *iov, int iovcnt);
+ssize_t ccn_shmring_read(struct ccn_shmring *, void *buf, size_t size);
+
+/*
+ * Waiting
+ * Call ccn_shmring_idle just before waiting for the socket to become
+ * readable; it asks for a ring when new data arrives.  If it returns
+ * nonzero there is already data to read, and the caller should not wait.
+ * When the socket is readable, ccn_shmring_drain discards the doorbell
+ * bytes; it returns 0 if the other end has closed the connection,
+ * -1 for an error, or 1 otherwise.
+ */
+int ccn_shmring_idle(struct ccn_shmring *);
+int ccn_shmring_drain(struct ccn_shmring *);
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * @file ccn/signer.h
+ *
+ * Deferred, batched signing of ContentObjects.
+ *
+ * A daemon that answers requests from its packet-processing path can
+ * hand the signing off to a signer instead of doing it in place.  The
+ * requests are queued, and signed from a scheduled event, so the
+ * current round of input is finished first.  Requests that share their
+ * signing parameters are signed together with ccn_sign_content_batch,
+ * which costs one private key operation for the whole batch.  Each
+ * finished object is passed to a completion action, or simply put to
+ * the handle.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_SIGNER_DEFINED
+#define CCN_SIGNER_DEFINED
+
+#include <stdint.h>
+#include <ccn/ccn.h>
+#include <ccn/schedule.h>
+
+struct ccn_signer;
+
+/**
+ * Called when a request has been signed.
+ *
+ * cob holds the signed object, and belongs to the signer; it is NULL
+ * if the signing failed or the signer is being destroyed.  data and
+ * intdata are as given to ccn_signer_submit.
+ */
+typedef void (*ccn_signer_action)(struct ccn_signer *s,
+                                  struct ccn_charbuf *cob,
+                                  void *data, intptr_t intdata);
+
+/**
+ * Create a signer that signs with handle h from events on sched.
+ */
+struct ccn_signer *ccn_signer_create(struct ccn *h,
+                                     struct ccn_schedule *sched);
+
+/**
+ * Queue a request to sign, as ccn_sign_content would.
+ *
+ * The name, params (including any template) and data are copied.
+ * If action is NULL, the signed object is put to the handle.
+ * @returns 0, or -1 for an error.
+ */
+int ccn_signer_submit(struct ccn_signer *s,
+                      const struct ccn_charbuf *name,
+                      const struct ccn_signing_params *params,
+                      const void *data, size_t size,
+                      ccn_signer_action action,
+                      void *actiondata, intptr_t actionint);
+
+/**
+ * @returns the number of requests waiting to be signed.
+ */
+int ccn_signer_pending(struct ccn_signer *s);
+
+/**
+ * Get the number of objects signed, and of private key operations
+ * used to sign them.
+ */
+void ccn_signer_get_counts(struct ccn_signer *s,
+                           uintmax_t *objects, uintmax_t *signatures);
+
+/**
+ * Destroy the signer.
+ *
+ * Requests still queued are not signed; their actions are called with
+ * a NULL cob so that they can release their data.
+ */
+void ccn_signer_destroy(struct ccn_signer **sp);
+
+#endif
@@ -53,8 +53,30 @@ void ccn_sigc_destroy(struct ccn_sigc **);
 int ccn_sigc_update(struct ccn_sigc *ctx, const void *data, size_t size);
 int ccn_sigc_final(struct ccn_sigc *ctx, struct ccn_signature *signature, size_t *size, const struct ccn_pkey *priv_key);
 size_t ccn_sigc_signature_max_size(struct ccn_sigc *ctx, const struct ccn_pkey *priv_key);
+int ccn_merkle_sign(int n, struct ccn_charbuf **parts,
+                    struct ccn_charbuf **witnesses,
+                    const char *digest, const struct ccn_pkey *priv_key,
+                    struct ccn_signature *signature, size_t *size);
 int ccn_verify_signature(const unsigned char *msg, size_t size, const struct ccn_parsed_ContentObject *co,
                          const struct ccn_pkey *verification_pubkey);
+
+/*
+ * Signatures that need no public key: a bare SHA-256 digest, which
+ * only protects against corruption, or an HMAC-SHA256 under a secret
+ * shared by the local producers and consumers.  See CCN_SP_DIGEST_ONLY
+ * and CCN_SP_HMAC in ccn/ccn.h.
+ */
+#define CCN_SIG_PUBKEY 0
+#define CCN_SIG_DIGEST 1
+#define CCN_SIG_HMAC   2
+#define CCN_SYMMETRIC_SIGNATURE_SIZE 32
+int ccn_signature_kind(const unsigned char *msg, const struct ccn_parsed_ContentObject *co);
+int ccn_symmetric_sign(const void *key, size_t keysize,
+                       const unsigned char *data, size_t size,
+                       unsigned char *result);
+int ccn_verify_symmetric_signature(const unsigned char *msg, size_t size,
+                                   const struct ccn_parsed_ContentObject *co,
+                                   const void *key, size_t keysize);
 struct ccn_pkey *ccn_d2i_pubkey(const unsigned char *p, size_t size);
 void ccn_pubkey_free(struct ccn_pkey *i_pubkey); /* use for result of ccn_d2i_pubkey */
 size_t ccn_pubkey_size(const struct ccn_pkey *i_pubkey);
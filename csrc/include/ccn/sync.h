@@ -130,6 +130,26 @@ struct ccns_handle *ccns_open(struct ccn *h,
                                       struct ccn_charbuf *rhash,
                                       struct ccn_charbuf *pname);
 
+/**
+ * Start notification of addition of names to a sync slice, keeping the
+ * sync tree nodes and the last root hash in a cache directory, so that a
+ * restarted client only fetches the nodes that changed.
+ * The cache is written when a comparison completes, and by ccns_close.
+ * @param cachedir is the directory for the cache (which must exist),
+ *  or NULL for no cache.
+ *  If rhash is NULL and the cache holds a root hash for the slice, the
+ *  enumeration starts from that root hash, so only names added since the
+ *  last run are reported.
+ *  See ccns_open for the other parameters.
+ * @returns a pointer to a new sync handle, which will be freed at close.
+ */
+struct ccns_handle *ccns_open_cached(struct ccn *h,
+                                     struct ccns_slice *slice,
+                                     ccns_callback callback,
+                                     struct ccn_charbuf *rhash,
+                                     struct ccn_charbuf *pname,
+                                     const char *cachedir);
+
 /**
  * Stop notification of changes of names in a sync slice and free the handle.
  * @param sh is a pointer (to a pointer) to the sync handle returned
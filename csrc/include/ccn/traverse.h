@@ -0,0 +1,74 @@
+/**
+ * @file ccn/traverse.h
+ *
+ * Traversal of a branch of the ccn name hierarchy.
+ *
+ * The children of a prefix are discovered in order by probing: an
+ * interest for the prefix that excludes everything up to the last
+ * child seen brings back the next one.  Each child found starts the
+ * exploration of its own level at once, and the probes for all the
+ * levels are kept outstanding together, breadth first, up to a bound.
+ *
+ * Optionally, each prefix is first offered to a repository as a name
+ * enumeration request (%C1.E.be), which lists all of its children in
+ * one response when a repository holds the prefix.  If the first one
+ * goes unanswered, there is taken to be no repository.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_TRAVERSE_DEFINED
+#define CCN_TRAVERSE_DEFINED
+
+#include <ccn/ccn.h>
+
+#define CCN_TRAVERSE_ALLOW_STALE 1 /**< stale content may answer */
+#define CCN_TRAVERSE_MUST_VERIFY 2 /**< ask for content to be verified */
+#define CCN_TRAVERSE_ONE_LEVEL   4 /**< do not go below the prefix */
+#define CCN_TRAVERSE_ENUMERATE   8 /**< try repository name enumeration */
+
+struct ccn_traverse_params {
+    int flags;              /**< CCN_TRAVERSE_* */
+    int scope;              /**< Scope for the interests, or -1 */
+    int max_outstanding;    /**< bound on the frontier, 0 for default */
+    int lifetime_ms;        /**< for each interest, 0 for default */
+};
+
+/**
+ * Called for each ContentObject that the traversal turns up.
+ *
+ * kind is the upcall kind it arrived with, so the action can tell
+ * whether it was verified.  level is the number of components in the
+ * prefix of the probe that found it; the component at that index is
+ * the one that was discovered.  Objects deeper than one past level are
+ * not reported, since the traversal goes on to explore below them.
+ */
+typedef void (*ccn_traverse_action)(struct ccn_upcall_info *info,
+                                    enum ccn_upcall_kind kind,
+                                    int level, void *data);
+
+/**
+ * Traverse the names under prefix, calling action for what is found.
+ *
+ * Blocks, running the handle, until there is nothing left to probe.
+ * Must not be called from an upcall.
+ * @returns the number of objects reported, or -1 for an error.
+ */
+long ccn_traverse(struct ccn *h, const struct ccn_charbuf *prefix,
+                  const struct ccn_traverse_params *params,
+                  ccn_traverse_action action, void *data);
+
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file ccn/uring.h
+ *
+ * A thin layer over the Linux io_uring interface.
+ *
+ * Only the pieces that the daemons use are provided: a submission
+ * and completion ring, one group of provided receive buffers, and
+ * preparation of the few operations they need.  Where io_uring is not
+ * available (at compile time or at run time) ccn_uring_create returns
+ * NULL, and callers should fall back to their usual event loop.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_URING_DEFINED
+#define CCN_URING_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+struct ccn_uring;
+
+/**
+ * A completion, as copied out of the ring by ccn_uring_reap.
+ */
+struct ccn_uring_cqe {
+    uint64_t user_data;     /**< as given when the operation was prepared */
+    int res;                /**< result, or -errno */
+    unsigned flags;         /**< CCN_URING_F_* */
+    int bid;                /**< provided buffer id, or -1 if none */
+};
+#define CCN_URING_F_MORE 1  /**< a multishot operation remains armed */
+
+/*
+ * Create and destroy
+ * The ring is sized for at least entries submissions, with the
+ * completion ring a few times that.  nbufs receive buffers of bufsize
+ * bytes each are allocated and registered for use by the multishot
+ * receive operations; nbufs must be a power of 2, or 0 if no receives
+ * will be done.
+ */
+struct ccn_uring *ccn_uring_create(unsigned entries,
+                                   unsigned nbufs, size_t bufsize);
+void ccn_uring_destroy(struct ccn_uring **);
+int ccn_uring_fd(struct ccn_uring *);
+
+/*
+ * Prepare operations
+ * Nothing is passed to the kernel until the next call to
+ * ccn_uring_submit or ccn_uring_wait, unless the submission ring fills.
+ * Each returns 0 on success, -1 if no submission entry could be had.
+ * The msghdr passed to ccn_uring_recvmsg_multishot must stay put for
+ * as long as the operation is armed; its msg_namelen and msg_controllen
+ * give the space left at the start of each buffer.
+ * The buffer passed to ccn_uring_read must stay put until its completion.
+ */
+int ccn_uring_recv_multishot(struct ccn_uring *, int fd, uint64_t user_data);
+int ccn_uring_recvmsg_multishot(struct ccn_uring *, int fd,
+                                struct msghdr *msg, uint64_t user_data);
+int ccn_uring_poll(struct ccn_uring *, int fd, unsigned pollevents,
+                   int multishot, uint64_t user_data);
+int ccn_uring_read(struct ccn_uring *, int fd, void *buf, size_t len,
+                   off_t offset, uint64_t user_data);
+int ccn_uring_cancel(struct ccn_uring *, uint64_t target, uint64_t user_data);
+
+/*
+ * Submit what has been prepared, and wait up to timeout_ms (-1 means
+ * forever, 0 means don't wait) for at least one completion.
+ * @returns the number of completions ready, or -1 with errno set.
+ */
+int ccn_uring_submit(struct ccn_uring *);
+int ccn_uring_wait(struct ccn_uring *, int timeout_ms);
+
+/*
+ * Copy out up to max completions, making room for more.
+ * @returns the number copied.
+ */
+int ccn_uring_reap(struct ccn_uring *, struct ccn_uring_cqe *cqes, int max);
+
+/*
+ * Provided buffers
+ * A completion with bid >= 0 holds the buffer until it is recycled.
+ */
+unsigned char *ccn_uring_buf(struct ccn_uring *, int bid);
+void ccn_uring_buf_recycle(struct ccn_uring *, int bid);
+
+/*
+ * Find the pieces of a buffer filled by a multishot recvmsg.
+ * res is the completion result, and msg is the one used to arm it.
+ * @returns the payload length (which may be less than the datagram,
+ *          if *truncated is set), or -1 if the buffer is malformed.
+ */
+ssize_t ccn_uring_recvmsg_parse(struct ccn_uring *, int bid, int res,
+                                const struct msghdr *msg,
+                                unsigned char **payload,
+                                struct sockaddr **addr, socklen_t *addrlen,
+                                int *truncated);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file ccn/window.h
+ *
+ * Congestion window and retransmission timer for pipelined fetching.
+ *
+ * A receiver that keeps many interests in flight holds them to a
+ * window that starts small, grows as content arrives, and shrinks on a
+ * loss.  The retransmission timeout is derived from the measured round
+ * trip times, in the manner of TCP.  Both ccn_fetch and ccn_bulkdata
+ * use this, so that they behave alike on the same path.
+ *
+ * Times are in microseconds.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_WINDOW_DEFINED
+#define CCN_WINDOW_DEFINED
+
+#include <stdint.h>
+
+/*
+ * How the window grows past slow start, and how far it is cut on a loss.
+ * AIMD grows it linearly and halves it.  CUBIC grows it as a cubic
+ * function of the time since the last loss, which recovers faster on
+ * paths with a large bandwidth-delay product, and cuts it back less.
+ */
+#define CCN_WINDOW_AIMD  0
+#define CCN_WINDOW_CUBIC 1
+
+#define CCN_WINDOW_RTO_INITIAL 1000000
+#define CCN_WINDOW_RTO_MIN 100000
+#define CCN_WINDOW_RTO_MAX 4000000
+
+struct ccn_window {
+    int mode;                   /**< CCN_WINDOW_AIMD or CCN_WINDOW_CUBIC */
+    double cwnd;                /**< congestion window, in interests */
+    double ssthresh;            /**< slow start threshold */
+    double max;                 /**< the window never grows beyond this */
+    double cubic_max;           /**< window before the last decrease */
+    uint64_t last_decrease;     /**< time of the last decrease (0 if none) */
+    intmax_t srtt;              /**< smoothed round trip (0 if no samples) */
+    intmax_t rttvar;            /**< round trip time variation */
+    intmax_t rto;               /**< retransmission timeout */
+};
+
+/**
+ * Set up a window that starts at initial and may grow to max.
+ */
+void ccn_window_init(struct ccn_window *w, int mode,
+                     double initial, double max);
+
+/**
+ * The current time, in microseconds, for use with the calls below.
+ */
+uint64_t ccn_window_now(void);
+
+/**
+ * Grow the window for a newly arrived answer.
+ */
+void ccn_window_open(struct ccn_window *w, uint64_t now);
+
+/**
+ * Shrink the window after a loss.
+ *
+ * A timeout drops the window to 1 and starts slow start over; a loss
+ * inferred from later answers arriving first only cuts it back.  Only
+ * the first inferred loss in a round trip counts.
+ * @returns 1 if the window was changed, 0 if the loss was not counted.
+ */
+int ccn_window_close(struct ccn_window *w, uint64_t now, int timeout);
+
+/**
+ * Update the retransmission timeout from a round trip sample.
+ *
+ * Only use samples from interests that were sent just once, since an
+ * answer to one that was sent again could be for either copy.
+ */
+void ccn_window_note_rtt(struct ccn_window *w, intmax_t rtt);
+
+/**
+ * Double the retransmission timeout, after it expired.
+ */
+void ccn_window_backoff(struct ccn_window *w);
+
+#endif
@@ -29,9 +29,10 @@ CCNLIBOBJ := ccn_client.o ccn_charbuf.o ccn_indexbuf.o ccn_coding.o \
 		ccn_digest.o ccn_interest.o ccn_keystore.o \
                 ccn_signing.o ccn_sockcreate.o \
 		ccn_traverse.o ccn_match.o hashtb.o ccn_merkle_path_asn1.o \
-		ccn_setup_sockaddr_un.o ccn_bulkdata.o ccn_versioning.o \
-		ccn_seqwriter.o ccn_sockaddrutil.o \
-		ccn_btree.o ccn_btree_content.o ccn_btree_store.o
+		ccn_setup_sockaddr_un.o ccn_bulkdata.o ccn_window.o ccn_signer.o ccn_versioning.o \
+		ccn_seqwriter.o ccn_manifest.o ccn_sockaddrutil.o \
+		ccn_btree.o ccn_btree_content.o ccn_btree_store.o ccn_uring.o \
+		ccn_bufprof.o
 
 CCNLIBSRC := $(CCNLIBOBJ:.o=.c)
 
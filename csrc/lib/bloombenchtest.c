@@ -0,0 +1,113 @@
+/**
+ * @file bloombenchtest.c
+ *
+ * A simple test program to benchmark Bloom filter matching.
+ *
+ * Compares ccn_bloom_match_wire, one key at a time, against
+ * ccn_bloom_match_wire_keys, for filters of a few sizes filled to
+ * their design load.  Half of the keys tested are members.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ccn/bloom.h>
+
+#define COUNT (8192 * BATCH)
+#define BATCH 256
+#define KEY_SIZE 12
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start->tv_sec) +
+           ((int)end.tv_usec - (int)start->tv_usec) / 1e6);
+}
+
+static void
+report(const char *what, int members, double dt, int matched)
+{
+    if (dt <= 0)
+        dt = 1e-6;
+    printf("%-6s %5d members: %10.0f keys/sec, %5.1f%% matched\n",
+           what, members, COUNT / dt, 100.0 * matched / COUNT);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const int filter_members[] = {10, 100, 500, 1000};
+    static const unsigned char seed[4] = {1, 2, 3, 4};
+    unsigned char keybytes[2 * BATCH][KEY_SIZE];
+    const void *keys[BATCH];
+    size_t sizes[BATCH];
+    unsigned char results[BATCH];
+    unsigned char check[BATCH];
+    unsigned char *wire = NULL;
+    const struct ccn_bloom_wire *f = NULL;
+    struct ccn_bloom *b = NULL;
+    struct timeval start;
+    int i, j, k, n, size, matched;
+
+    for (i = 0; i < 2 * BATCH; i++)
+        for (j = 0; j < KEY_SIZE; j++)
+            keybytes[i][j] = random();
+    for (k = 0; k < sizeof(filter_members) / sizeof(filter_members[0]); k++) {
+        n = filter_members[k];
+        b = ccn_bloom_create(n, seed);
+        /* The even keys are members, along with some others */
+        for (i = 0; i < n; i++) {
+            if (i < BATCH)
+                ccn_bloom_insert(b, keybytes[2 * i], KEY_SIZE);
+            else
+                ccn_bloom_insert(b, &i, sizeof(i));
+        }
+        size = ccn_bloom_wiresize(b);
+        wire = malloc(size);
+        if (wire == NULL || ccn_bloom_store_wire(b, wire, size) < 0) {
+            fprintf(stderr, "cannot store filter\n");
+            exit(1);
+        }
+        f = ccn_bloom_validate_wire(wire, size);
+        for (j = 0; j < BATCH; j++) {
+            keys[j] = keybytes[j];
+            sizes[j] = KEY_SIZE;
+        }
+        matched = 0;
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i++) {
+            j = i % BATCH;
+            check[j] = ccn_bloom_match_wire(f, keys[j], sizes[j]);
+            matched += check[j];
+        }
+        report("single", n, elapsed(&start), matched);
+        matched = 0;
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i += BATCH)
+            matched += ccn_bloom_match_wire_keys(f, BATCH, keys, sizes,
+                                                 results);
+        report("keys", n, elapsed(&start), matched);
+        if (memcmp(check, results, BATCH) != 0) {
+            fprintf(stderr, "results differ for %d members\n", n);
+            exit(1);
+        }
+        free(wire);
+        ccn_bloom_destroy(&b);
+    }
+    return(0);
+}
@@ -0,0 +1,221 @@
+/**
+ * @file ccn_arena.c
+ * @brief Reusable charbufs and indexbufs for short-lived temporaries.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <ccn/arena.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+
+/**
+ * Buffers that have grown beyond this many bytes are not kept when
+ * they come back, so that one large message does not pin the memory.
+ */
+#define CCN_ARENA_KEEP_BYTES 65536
+
+/**
+ * A set of buffers of one kind.
+ *
+ * The first used entries of item are out on loan; the rest are ready
+ * for reuse.  Loans are usually returned in the reverse order, so the
+ * search on return starts at the most recent.
+ */
+struct ccn_arena_set {
+    void **item;
+    int used;
+    int n;
+    int limit;
+};
+
+struct ccn_arena {
+    struct ccn_arena_set charbufs;
+    struct ccn_arena_set indexbufs;
+};
+
+struct ccn_arena *
+ccn_arena_create(void)
+{
+    return(calloc(1, sizeof(struct ccn_arena)));
+}
+
+void
+ccn_arena_destroy(struct ccn_arena **ap)
+{
+    struct ccn_arena *a = *ap;
+    struct ccn_charbuf *c = NULL;
+    struct ccn_indexbuf *x = NULL;
+    int i;
+
+    if (a == NULL)
+        return;
+    for (i = 0; i < a->charbufs.n; i++) {
+        c = a->charbufs.item[i];
+        ccn_charbuf_destroy(&c);
+    }
+    for (i = 0; i < a->indexbufs.n; i++) {
+        x = a->indexbufs.item[i];
+        ccn_indexbuf_destroy(&x);
+    }
+    free(a->charbufs.item);
+    free(a->indexbufs.item);
+    free(a);
+    *ap = NULL;
+}
+
+/**
+ * Lend out a spare item, if there is one.
+ */
+static void *
+arena_take(struct ccn_arena_set *s)
+{
+    if (s->used == s->n)
+        return(NULL);
+    return(s->item[s->used++]);
+}
+
+/**
+ * Add a newly made item to the set, as out on loan.
+ *
+ * This is only called when there are no spares, so it goes at the end.
+ * @returns 0, or -1 if there was no room.
+ */
+static int
+arena_add(struct ccn_arena_set *s, void *p)
+{
+    void **item = NULL;
+    int limit;
+
+    if (s->n == s->limit) {
+        limit = 2 * s->limit + 8;
+        item = realloc(s->item, limit * sizeof(s->item[0]));
+        if (item == NULL)
+            return(-1);
+        s->item = item;
+        s->limit = limit;
+    }
+    s->item[s->n++] = p;
+    s->used = s->n;
+    return(0);
+}
+
+/**
+ * Take an item back from loan.
+ * @returns the index of the item, or -1 if it is not one of ours.
+ */
+static int
+arena_return(struct ccn_arena_set *s, void *p)
+{
+    int i;
+
+    for (i = s->used - 1; i >= 0; i--) {
+        if (s->item[i] == p) {
+            s->used--;
+            s->item[i] = s->item[s->used];
+            s->item[s->used] = p;
+            return(s->used);
+        }
+    }
+    return(-1);
+}
+
+struct ccn_charbuf *
+ccn_charbuf_create_in(struct ccn_arena *a)
+{
+    struct ccn_charbuf *c = arena_take(&a->charbufs);
+
+    if (c != NULL) {
+        c->length = 0;
+        return(c);
+    }
+    c = ccn_charbuf_create();
+    if (c != NULL && arena_add(&a->charbufs, c) < 0)
+        ccn_charbuf_destroy(&c);
+    return(c);
+}
+
+struct ccn_indexbuf *
+ccn_indexbuf_create_in(struct ccn_arena *a)
+{
+    struct ccn_indexbuf *x = arena_take(&a->indexbufs);
+
+    if (x != NULL) {
+        x->n = 0;
+        return(x);
+    }
+    x = ccn_indexbuf_create();
+    if (x != NULL && arena_add(&a->indexbufs, x) < 0)
+        ccn_indexbuf_destroy(&x);
+    return(x);
+}
+
+void
+ccn_charbuf_release_in(struct ccn_arena *a, struct ccn_charbuf **cp)
+{
+    struct ccn_charbuf *c = *cp;
+    int i;
+
+    if (c == NULL)
+        return;
+    *cp = NULL;
+    i = arena_return(&a->charbufs, c);
+    if (i < 0)
+        ccn_charbuf_destroy(&c);
+    else if (c->limit > CCN_ARENA_KEEP_BYTES) {
+        /* Trade it for a fresh one, without the large buffer */
+        a->charbufs.item[i] = ccn_charbuf_create();
+        ccn_charbuf_destroy(&c);
+        if (a->charbufs.item[i] == NULL)
+            a->charbufs.item[i] = a->charbufs.item[--a->charbufs.n];
+    }
+}
+
+void
+ccn_indexbuf_release_in(struct ccn_arena *a, struct ccn_indexbuf **cp)
+{
+    struct ccn_indexbuf *x = *cp;
+    int i;
+
+    if (x == NULL)
+        return;
+    *cp = NULL;
+    i = arena_return(&a->indexbufs, x);
+    if (i < 0)
+        ccn_indexbuf_destroy(&x);
+    else if (x->limit * sizeof(x->buf[0]) > CCN_ARENA_KEEP_BYTES) {
+        a->indexbufs.item[i] = ccn_indexbuf_create();
+        ccn_indexbuf_destroy(&x);
+        if (a->indexbufs.item[i] == NULL)
+            a->indexbufs.item[i] = a->indexbufs.item[--a->indexbufs.n];
+    }
+}
+
+void
+ccn_arena_reset(struct ccn_arena *a)
+{
+    struct ccn_charbuf *c = NULL;
+    struct ccn_indexbuf *x = NULL;
+
+    while (a->charbufs.used > 0) {
+        c = a->charbufs.item[a->charbufs.used - 1];
+        ccn_charbuf_release_in(a, &c);
+    }
+    while (a->indexbufs.used > 0) {
+        x = a->indexbufs.item[a->indexbufs.used - 1];
+        ccn_indexbuf_release_in(a, &x);
+    }
+}
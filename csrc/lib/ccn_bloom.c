@@ -185,6 +185,86 @@ ccn_bloom_match_wire(const struct ccn_bloom_wire *f, const void *key, size_t siz
     return(1);
 }
 
+/*
+ * Keys hashed side by side by ccn_bloom_match_wire_keys.  Each key's
+ * hash is a serial feedback shift, so one key at a time is bound by
+ * the latency of that chain; several independent chains in step keep
+ * the processor busy, and the loops are simple enough for the compiler
+ * to vectorize.
+ */
+#define CCN_BLOOM_LANES 8
+
+/*
+ * ccn_bloom_match_wire_keys:
+ * Test n keys for membership in one filter, as ccn_bloom_match_wire does.
+ * results[i] is set to 1 or 0 for keys[i], whose size is sizes[i].
+ * Returns the number of keys that matched.
+ */
+int
+ccn_bloom_match_wire_keys(const struct ccn_bloom_wire *f, int n,
+                          const void **keys, const size_t *sizes,
+                          unsigned char *results)
+{
+    const unsigned char *hb[CCN_BLOOM_LANES];
+    size_t hs[CCN_BLOOM_LANES];
+    unsigned s[CCN_BLOOM_LANES];
+    unsigned hit[CCN_BLOOM_LANES];
+    unsigned b, h, m, seed;
+    int i, j, l;
+    int lanes;
+    int matched = 0;
+    size_t k, minsize, maxsize;
+    
+    m = (8*sizeof(f->bloom) - 1) & ((1 << f->lg_bits) - 1);
+    seed = bloom_seed(f);
+    for (i = 0; i < n; i += lanes) {
+        lanes = (n - i < CCN_BLOOM_LANES) ? n - i : CCN_BLOOM_LANES;
+        minsize = maxsize = sizes[i];
+        for (l = 0; l < CCN_BLOOM_LANES; l++) {
+            /* idle lanes just repeat the last key */
+            j = i + (l < lanes ? l : lanes - 1);
+            hb[l] = keys[j];
+            hs[l] = sizes[j];
+            if (hs[l] < minsize)
+                minsize = hs[l];
+            if (hs[l] > maxsize)
+                maxsize = hs[l];
+            s[l] = seed;
+            hit[l] = 1;
+        }
+        /* This is bloom_nexthash, written out so the lanes run in step */
+#define BLOOM_STEP(l, u) \
+        (b = s[l] & ((1 << 13) - 1), \
+         s[l] = ((s[l] >> 13) ^ (b << 18) ^ b) + (u), \
+         s[l] &= 0x7FFFFFFF)
+        for (k = 0; k < minsize; k++)
+            for (l = 0; l < CCN_BLOOM_LANES; l++)
+                BLOOM_STEP(l, hb[l][k] + 1);
+        for (; k < maxsize; k++)
+            for (l = 0; l < CCN_BLOOM_LANES; l++)
+                if (k < hs[l])
+                    BLOOM_STEP(l, hb[l][k] + 1);
+        for (j = 0; j < f->n_hash; j++) {
+            b = 0;
+            for (l = 0; l < CCN_BLOOM_LANES; l++) {
+                BLOOM_STEP(l, 0);
+                h = s[l] & m;
+                hit[l] &= f->bloom[h >> 3] >> (h & 7);
+            }
+            for (l = 0; l < CCN_BLOOM_LANES; l++)
+                b |= hit[l];
+            if ((b & 1) == 0)
+                break;
+        }
+#undef BLOOM_STEP
+        for (l = 0; l < lanes; l++) {
+            results[i + l] = hit[l] & 1;
+            matched += hit[l] & 1;
+        }
+    }
+    return(matched);
+}
+
 int
 ccn_bloom_match(struct ccn_bloom *b, const void *key, size_t size)
 {
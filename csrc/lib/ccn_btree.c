@@ -18,6 +18,7 @@
  */
  
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -25,6 +26,7 @@
 
 #include <ccn/charbuf.h>
 #include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
 
 #include <ccn/btree.h>
 
@@ -311,6 +313,166 @@ ccn_btree_compare(const unsigned char *key,
     return(size > ksiz);
 }
 
+/**
+ * Search hints for a resident node
+ *
+ * The keys of the entries from first on all begin with the same skip
+ * bytes, which are kept after the hints.  The hint for each of these
+ * entries is the next 8 bytes of its key.  The hints are dense and
+ * cheap to compare, and order the same way as the keys, except for ties.
+ *
+ * The hints are kept with the resident node, not stored with it.
+ * ccn_btree_insert_entry() keeps them up to date; anything else that
+ * changes the keys must call ccn_btree_chknode() or
+ * ccn_btree_init_node(), which discard them.
+ */
+struct ccn_btree_hints {
+    uint_least64_t n;           /**< entries in the node */
+    uint_least64_t first;       /**< first entry with a non-empty key */
+    uint_least64_t skip;        /**< length of the common prefix */
+    uint_least64_t h[1];        /**< n hints, then the prefix */
+};
+#define HINTS_SIZE(n, skip) \
+    (offsetof(struct ccn_btree_hints, h) + (n) * sizeof(uint_least64_t) + (skip))
+
+/**
+ * Compute a hint, from the 8 bytes of the key after the common prefix,
+ * as a big-endian number padded with zeros.
+ * If one key's hint is less than another's, so is the key.
+ */
+static uint_least64_t
+key_hint(const unsigned char *key, size_t size)
+{
+    uint_least64_t h = 0;
+    size_t i;
+    
+    for (i = 0; i < 8; i++)
+        h = (h << 8) + (i < size ? key[i] : 0);
+    return(h);
+}
+
+/**
+ * Copy up to len bytes of the key of entry i, starting at offset off
+ * @returns the number of bytes copied.
+ */
+static unsigned
+key_bytes(struct ccn_btree_node *node, int i, unsigned off,
+          unsigned char *dst, unsigned len)
+{
+    struct ccn_btree_entry_trailer *p = NULL;
+    unsigned koff, ksiz, m, n;
+    int piece;
+    
+    p = seek_trailer(node, i);
+    if (p == NULL)
+        return(0);
+    for (n = 0, piece = 0; piece < 2 && n < len; piece++) {
+        koff = piece ? MYFETCH(p, koff1) : MYFETCH(p, koff0);
+        ksiz = piece ? MYFETCH(p, ksiz1) : MYFETCH(p, ksiz0);
+        if (koff > node->buf->length || ksiz > node->buf->length - koff)
+            return(node->corrupt = __LINE__, 0);
+        if (off >= ksiz) {
+            off -= ksiz;
+            continue;
+        }
+        m = ksiz - off;
+        if (m > len - n)
+            m = len - n;
+        memcpy(dst + n, node->buf->buf + koff + off, m);
+        n += m;
+        off = 0;
+    }
+    return(n);
+}
+
+/**
+ * Get the search hints for a node of n entries, computing them if needed
+ * @returns NULL if they are not available.
+ */
+static struct ccn_btree_hints *
+node_hints(struct ccn_btree_node *node, int n)
+{
+    struct ccn_btree_hints *hints = NULL;
+    unsigned char a[64], z[64];
+    unsigned char k[8];
+    unsigned first, skip, m, ma, mz, i;
+    
+    if (node->hints != NULL) {
+        hints = (struct ccn_btree_hints *)node->hints->buf;
+        if (hints->n == n &&
+            node->hints->length == HINTS_SIZE(n, hints->skip))
+            return(hints);
+    }
+    /* Internal nodes have an empty key in entry 0 */
+    first = 0;
+    if (n > 1 && key_bytes(node, 0, 0, k, 1) == 0)
+        first = 1;
+    /* The keys are in order, so the first and last bound the prefix */
+    skip = 0;
+    if (first < n) {
+        do {
+            ma = key_bytes(node, first, skip, a, sizeof(a));
+            mz = key_bytes(node, n - 1, skip, z, sizeof(z));
+            for (m = 0; m < ma && m < mz && a[m] == z[m]; m++)
+                continue;
+            skip += m;
+        } while (m == sizeof(a));
+    }
+    if (node->corrupt)
+        return(NULL);
+    if (node->hints == NULL)
+        node->hints = ccn_charbuf_create();
+    if (node->hints == NULL)
+        return(NULL);
+    node->hints->length = 0;
+    hints = (void *)ccn_charbuf_reserve(node->hints, HINTS_SIZE(n, skip));
+    if (hints == NULL)
+        return(NULL);
+    hints->n = n;
+    hints->first = first;
+    hints->skip = skip;
+    for (i = 0; i < n; i++)
+        hints->h[i] = (i < first) ? 0 :
+                      key_hint(k, key_bytes(node, i, skip, k, sizeof(k)));
+    if (first < n)
+        key_bytes(node, first, 0, (unsigned char *)(hints->h + n), skip);
+    if (node->corrupt)
+        return(NULL);
+    node->hints->length = HINTS_SIZE(n, skip);
+    return(hints);
+}
+
+/**
+ * Update the search hints of a node for a new entry at slot i,
+ * or discard them if they cannot be updated in place.
+ */
+static void
+update_hints(struct ccn_btree_node *node, int i,
+             const unsigned char *key, size_t keysize)
+{
+    struct ccn_btree_hints *hints = NULL;
+    unsigned n, skip;
+    
+    if (node->hints == NULL)
+        return;
+    hints = (struct ccn_btree_hints *)node->hints->buf;
+    n = hints->n;
+    skip = hints->skip;
+    if (node->hints->length != HINTS_SIZE(n, skip) ||
+        i < hints->first || i > n || keysize == 0 || keysize < skip ||
+        memcmp(key, hints->h + n, skip) != 0 ||
+        ccn_charbuf_reserve(node->hints, sizeof(hints->h[0])) == NULL) {
+        ccn_charbuf_destroy(&node->hints);
+        return;
+    }
+    hints = (struct ccn_btree_hints *)node->hints->buf;
+    memmove(hints->h + i + 1, hints->h + i,
+            (n - i) * sizeof(hints->h[0]) + skip);
+    hints->h[i] = key_hint(key + skip, keysize - skip);
+    hints->n = n + 1;
+    node->hints->length = HINTS_SIZE(n + 1, skip);
+}
+
 /**
  * Search the node for the given key
  *
@@ -320,6 +482,8 @@ ccn_btree_compare(const unsigned char *key,
  * where the item would go if it were to be inserted.
  *
  * Uses a binary search, so the keys in the node must be sorted and unique.
+ * The search goes first over the node's search hints, so that only the
+ * entries whose hints tie with the key's need a full comparison.
  *
  * @returns CCN_BT_ENCRES(index, success) indication, or -1 for an error.
  */
@@ -328,12 +492,40 @@ ccn_btree_searchnode(const unsigned char *key,
                      size_t size,
                      struct ccn_btree_node *node)
 {
-    int i, j, mid, res;
+    struct ccn_btree_hints *hints = NULL;
+    uint_least64_t h;
+    int i, j, n, mid, res;
     
     if (node->corrupt)
         return(-1);
     i = 0;
     j = ccn_btree_node_nent(node);
+    hints = (size == 0) ? NULL : node_hints(node, j);
+    if (hints != NULL) {
+        /* Most keys can be placed by the common prefix alone */
+        n = (size < hints->skip) ? size : hints->skip;
+        res = memcmp(key, hints->h + j, n);
+        if (res < 0 || (res == 0 && size < hints->skip))
+            return(CCN_BT_ENCRES(hints->first, 0));
+        if (res > 0)
+            return(CCN_BT_ENCRES(j, 0));
+        /* Narrow the search to the entries whose hints tie with the key's */
+        h = key_hint(key + hints->skip, size - hints->skip);
+        for (i = hints->first, n = j; i < n;) {
+            mid = (i + n) >> 1;
+            if (hints->h[mid] < h)
+                i = mid + 1;
+            else
+                n = mid;
+        }
+        for (n = i; n < j;) {
+            mid = (n + j) >> 1;
+            if (hints->h[mid] <= h)
+                n = mid + 1;
+            else
+                j = mid;
+        }
+    }
     while (i < j) {
         mid = (i + j) >> 1;
         res =  ccn_btree_compare(key, size, node, mid);
@@ -438,16 +630,83 @@ ccn_btree_lookup_internal(struct ccn_btree *btree,
     return(srchres);
 }
 
-/* See if we can reuse a leading portion of the key */
+/** How many neighbors on each side to consider for sharing a key prefix */
+#define CCN_BT_REUSE_SCAN 4
+
+/**
+ * Find the stored bytes that begin the key of entry j, as one contiguous
+ * run of the node's string space.
+ * @returns the length of the run, with its offset in *koffp.
+ */
+static unsigned
+key_run(struct ccn_btree_node *node, int j, unsigned *koffp)
+{
+    struct ccn_btree_entry_trailer *p = NULL;
+    unsigned koff0, ksiz0, koff1, ksiz1;
+    
+    p = seek_trailer(node, j);
+    if (p == NULL)
+        return(0);
+    koff0 = MYFETCH(p, koff0);
+    ksiz0 = MYFETCH(p, ksiz0);
+    koff1 = MYFETCH(p, koff1);
+    ksiz1 = MYFETCH(p, ksiz1);
+    if (ksiz0 == 0) {
+        koff0 = koff1;
+        ksiz0 = ksiz1;
+    }
+    else if (koff0 + ksiz0 == koff1)
+        ksiz0 += ksiz1; /* piece 1 carries on where piece 0 stops */
+    if (koff0 > node->freelow || ksiz0 > node->freelow - koff0)
+        return(0);
+    *koffp = koff0;
+    return(ksiz0);
+}
+
+/**
+ * See if we can reuse a leading portion of the key
+ *
+ * Neighboring keys in a node usually have a long prefix in common,
+ * so we look for the longest one among the entries near slot ndx that
+ * is stored contiguously, and share its bytes as piece 0 of the new key.
+ * Piece 1 then holds just the rest.
+ *
+ * Unless that saves at least half of the key, the whole key is stored,
+ * so that later keys have a long run to share.
+ *
+ * On return, reuse[0] is the offset of the shared bytes and reuse[1]
+ * is their length (0 for none).
+ */
 static void
 scan_reusable(const unsigned char *key, size_t keysize,
              struct ccn_btree_node *node, int ndx, unsigned reuse[2])
 {
-    /* this is an optimization - leave out for now */
-    /* but this is a good place to do this check... */
+    const unsigned char *s = NULL;
+    unsigned koff, ksiz, m;
+    int j, n;
+    
     if (ndx == 0 && keysize > 0 && ccn_btree_node_level(node) != 0) {
         abort();
     }
+    n = ccn_btree_node_nent(node);
+    for (j = ndx - CCN_BT_REUSE_SCAN; j < ndx + CCN_BT_REUSE_SCAN; j++) {
+        if (j < 0 || j >= n)
+            continue;
+        ksiz = key_run(node, j, &koff);
+        if (ksiz > keysize)
+            ksiz = keysize;
+        if (ksiz <= reuse[1])
+            continue;
+        s = node->buf->buf + koff;
+        for (m = 0; m < ksiz && s[m] == key[m]; m++)
+            continue;
+        if (m > reuse[1]) {
+            reuse[0] = koff;
+            reuse[1] = m;
+        }
+    }
+    if (reuse[1] * 2 < keysize)
+        reuse[0] = reuse[1] = 0;
 }
 
 /**
@@ -555,11 +814,54 @@ ccn_btree_insert_entry(struct ccn_btree_node *node, int i,
     }
     /* Finally, copy the (non-shared portion of the) key */
     to = node->buf->buf + node->freelow;
-    memmove(to, key + reuse[0], keysize - reuse[1]);
+    memmove(to, key + reuse[1], keysize - reuse[1]);
     node->freelow += keysize - reuse[1];
+    update_hints(node, i, key, keysize);
     return(n + 1);
 }
 
+/**
+ *  Remove an entry from a node
+ *
+ * The entries before it slide over to fill the gap.  The bytes of its key
+ * are left in the string space, since other keys may share them.
+ * The last remaining entry may not be removed.
+ *
+ * @returns the new entry count, or -1 in case of error.
+ */
+int
+ccn_btree_delete_entry(struct ccn_btree_node *node, int i)
+{
+    struct ccn_btree_entry_trailer *t = NULL;
+    unsigned char *x = NULL;
+    size_t k, org;
+    int j, n;
+    
+    if (node->freelow == 0)
+        ccn_btree_chknode(node);
+    if (node->corrupt)
+        return(-1);
+    n = ccn_btree_node_nent(node);
+    if (i < 0 || i >= n || n < 2)
+        return(-1);
+    k = ccn_btree_node_getentrysize(node);
+    x = ccn_btree_node_getentry(k - sizeof(*t), node, 0);
+    if (x == NULL)
+        return(-1);
+    org = x - node->buf->buf;
+    memmove(x + k, x, i * k);
+    memset(x, 0x33, k);
+    if (node->clean > org)
+        node->clean = org;
+    /* Fix up the entdx in the entries that followed */
+    for (j = i + 1; j < n; j++) {
+        t = (void *)(x + (j + 1) * k - sizeof(*t));
+        MYSTORE(t, entdx, j - 1);
+    }
+    ccn_charbuf_destroy(&node->hints);
+    return(n - 1);
+}
+
 #if 0
 #define MSG(fmt, ...) fprintf(stderr, fmt "\n", __VA_ARGS__)
 #else
@@ -780,6 +1082,189 @@ Bail:
     ccn_btree_note_error(btree, __LINE__);
     return(-1);
 }
+
+/**
+ * Pull the only child of the root up into the root
+ *
+ * This is the reverse of ccn_btree_grow_a_level(); the tree gets one
+ * level shorter, and the child is left empty and unlinked.
+ */
+static int
+ccn_btree_shrink_a_level(struct ccn_btree *btree,
+                         struct ccn_btree_node *root,
+                         struct ccn_btree_node *child)
+{
+    struct ccn_btree_node_header *hdr = NULL;
+    struct ccn_btree_internal_payload *e = NULL;
+    struct ccn_btree_node *gc = NULL;
+    struct ccn_charbuf *t = NULL;
+    int i, n;
+    
+    n = ccn_btree_node_nent(child);
+    if (n < 1)
+        return(-1);
+    if (ccn_btree_node_level(child) > 0) {
+        for (i = 0; i < n; i++) {
+            e = seek_internal(child, i);
+            if (e == NULL)
+                return(-1);
+            gc = ccn_btree_rnode(btree, MYFETCH(e, child));
+            if (gc != NULL)
+                gc->parent = root->nodeid;
+        }
+    }
+    t = root->buf;
+    root->buf = child->buf;
+    child->buf = t;
+    hdr = (struct ccn_btree_node_header *)root->buf->buf;
+    MYSTORE(hdr, nodetype, 'R');
+    root->clean = 0;
+    ccn_charbuf_destroy(&root->hints);
+    ccn_btree_chknode(root); /* Update freelow */
+    child->buf->length = 0;
+    child->clean = 0;
+    child->freelow = 0;
+    child->parent = 0;
+    ccn_charbuf_destroy(&child->hints);
+    return(0);
+}
+
+/**
+ * Merge a node with its right-hand sibling, if the two fit in one
+ *
+ * They fit if the combined entry count and size stay within fill_percent
+ * of the limits at which a node would be split.  The entries of the
+ * sibling are appended to node, and the sibling's entry in the parent
+ * is removed, leaving the sibling empty and unlinked.  A parent other
+ * than the root keeps at least two entries.  If the root is left with
+ * only one child, that child is pulled up into the root.
+ *
+ * node->parent must be set, as it is for nodes reached by a lookup.
+ *
+ * @returns 1 if the nodes were merged, 0 if not, -1 for error.
+ */
+int
+ccn_btree_merge(struct ccn_btree *btree, struct ccn_btree_node *node,
+                int fill_percent)
+{
+    struct ccn_btree_node newnode = {0};
+    struct ccn_btree_node *parent = NULL;
+    struct ccn_btree_node *right = NULL;
+    struct ccn_btree_node *src = NULL;
+    struct ccn_btree_node *chld = NULL;
+    struct ccn_btree_internal_payload *e = NULL;
+    struct ccn_charbuf *key = NULL;
+    void *payload = NULL;
+    int i, j, k, n, m, np, pb, level, limit, res;
+    
+    if (node->parent == 0 || node->corrupt)
+        return(0);
+    parent = ccn_btree_getnode(btree, node->parent, 0);
+    if (parent == NULL)
+        return(-1);
+    np = ccn_btree_node_nent(parent);
+    if (np < 2 || (np == 2 && parent->nodeid != 1))
+        return(0);
+    if (ccn_btree_node_payloadsize(parent) != sizeof(*e))
+        return(-1);
+    /* Find node in the parent */
+    for (i = 0; i < np; i++) {
+        e = seek_internal(parent, i);
+        if (e == NULL)
+            return(-1);
+        if (MYFETCH(e, child) == node->nodeid)
+            break;
+    }
+    if (i >= np - 1)
+        return(0);
+    e = seek_internal(parent, i + 1);
+    if (e == NULL)
+        return(-1);
+    right = ccn_btree_getnode(btree, MYFETCH(e, child), parent->nodeid);
+    if (right == NULL || right->corrupt)
+        return(-1);
+    level = ccn_btree_node_level(node);
+    n = ccn_btree_node_nent(node);
+    m = ccn_btree_node_nent(right);
+    if (level < 0 || level != ccn_btree_node_level(right) || n < 1 || m < 1)
+        return(-1);
+    limit = (level == 0 && btree->full0 > 0) ? btree->full0 : btree->full;
+    if ((n + m) * 100 > limit * fill_percent)
+        return(0);
+    if (btree->nodebytes != 0 && (node->buf->length + right->buf->length) *
+          (uintmax_t)100 > (uintmax_t)btree->nodebytes * fill_percent)
+        return(0);
+    pb = ccn_btree_node_payloadsize(node);
+    if (pb < 0 || pb != ccn_btree_node_payloadsize(right))
+        return(-1);
+    if (ccn_btree_prepare_for_update(btree, node) < 0 ||
+        ccn_btree_prepare_for_update(btree, right) < 0 ||
+        ccn_btree_prepare_for_update(btree, parent) < 0)
+        return(-1);
+    /* Build the merged node on the side, so a failure changes nothing */
+    newnode.nodeid = node->nodeid;
+    newnode.buf = ccn_charbuf_create();
+    key = ccn_charbuf_create();
+    if (newnode.buf == NULL || key == NULL)
+        goto Bail;
+    res = ccn_btree_init_node(&newnode, level, 0, 0);
+    if (res < 0)
+        goto Bail;
+    for (k = 0; k < n + m; k++) {
+        src = (k < n) ? node : right;
+        j = (k < n) ? k : k - n;
+        if (k == n && level > 0)
+            res = ccn_btree_key_fetch(key, parent, i + 1); /* separator */
+        else
+            res = ccn_btree_key_fetch(key, src, j);
+        payload = ccn_btree_node_getentry(pb, src, j);
+        if (res < 0 || payload == NULL)
+            goto Bail;
+        res = ccn_btree_insert_entry(&newnode, k, key->buf, key->length,
+                                     payload, pb);
+        if (res < 0)
+            goto Bail;
+    }
+    res = ccn_btree_delete_entry(parent, i + 1);
+    if (res < 0) {
+        parent->corrupt = __LINE__;
+        goto Bail;
+    }
+    /* Committed - children of right now belong to node */
+    for (j = 0; level > 0 && j < m; j++) {
+        e = seek_internal(right, j);
+        chld = (e == NULL) ? NULL : ccn_btree_rnode(btree, MYFETCH(e, child));
+        if (chld != NULL)
+            chld->parent = node->nodeid;
+    }
+    node->clean = 0;
+    ccn_charbuf_destroy(&node->buf);
+    node->buf = newnode.buf;
+    newnode.buf = NULL;
+    ccn_charbuf_destroy(&newnode.hints);
+    ccn_charbuf_destroy(&node->hints);
+    ccn_btree_chknode(node); /* Update freelow */
+    right->buf->length = 0;
+    right->clean = 0;
+    right->freelow = 0;
+    right->parent = 0;
+    ccn_charbuf_destroy(&right->hints);
+    if (parent->nodeid == 1 && res == 1) {
+        res = ccn_btree_shrink_a_level(btree, parent, node);
+        if (res < 0)
+            goto Bail;
+    }
+    ccn_charbuf_destroy(&key);
+    MSG("Merged node %u into %u", (unsigned)right->nodeid,
+        (unsigned)node->nodeid);
+    return(1);
+Bail:
+    ccn_charbuf_destroy(&newnode.buf);
+    ccn_charbuf_destroy(&newnode.hints);
+    ccn_charbuf_destroy(&key);
+    ccn_btree_note_error(btree, __LINE__);
+    return(-1);
+}
 #undef MSG
 
 /**
@@ -907,9 +1392,721 @@ Bail:
     return(ans);
 }
 
+/**
+ * Move a cursor off the end of its leaf, if need be
+ * @returns 1 if on an entry, 0 if at end, -1 if error.
+ */
+static int
+ccn_btree_cursor_settle(struct ccn_btree_cursor *c)
+{
+    struct ccn_btree_node *leaf = NULL;
+    int n;
+    int res;
+    
+    while (c->leaf != NULL) {
+        n = ccn_btree_node_nent(c->leaf);
+        if (n < 0)
+            break;
+        if (c->index < n)
+            return(1);
+        if (n == 0) {
+            /* Only an empty tree should have an empty leaf */
+            if (c->leaf->parent != 0)
+                break;
+            c->leaf = NULL;
+            return(0);
+        }
+        res = ccn_btree_next_leaf(c->btree, c->leaf, &leaf);
+        if (res < 0)
+            break;
+        c->leaf = leaf;
+        c->index = 0;
+    }
+    if (c->leaf == NULL)
+        return(0);
+    c->leaf = NULL;
+    return(-1);
+}
+
+/**
+ * Position a cursor at the entry for key, or if there is none, at the
+ * entry that would come just after it.
+ *
+ * If the cursor is already on a leaf that spans key, only that leaf is
+ * searched; otherwise this is a lookup from the root.  The cursor
+ * must have been zeroed before its first use.
+ *
+ * @returns 1 if key was found, 0 if not (the cursor's leaf is NULL if
+ *          there are no later entries), or -1 for an error.
+ */
+int
+ccn_btree_cursor_seek(struct ccn_btree_cursor *c, struct ccn_btree *btree,
+                      const unsigned char *key, size_t size)
+{
+    struct ccn_btree_node *leaf = c->leaf;
+    int n;
+    int res;
+    
+    if (c->btree == btree && leaf != NULL && leaf->corrupt == 0 &&
+          (n = ccn_btree_node_nent(leaf)) > 0 &&
+          ccn_btree_compare(key, size, leaf, 0) >= 0 &&
+          ccn_btree_compare(key, size, leaf, n - 1) <= 0)
+        res = ccn_btree_searchnode(key, size, leaf);
+    else
+        res = ccn_btree_lookup(btree, key, size, &leaf);
+    c->btree = btree;
+    c->leaf = NULL;
+    c->index = 0;
+    if (res < 0)
+        return(-1);
+    c->leaf = leaf;
+    c->index = CCN_BT_SRCH_INDEX(res);
+    n = ccn_btree_cursor_settle(c);
+    if (n <= 0)
+        return(n);
+    return(CCN_BT_SRCH_FOUND(res));
+}
+
+/**
+ * Step a cursor to the following entry, moving to the next leaf as needed.
+ * @returns 1 if on an entry, 0 if at end, -1 if error.
+ */
+int
+ccn_btree_cursor_next(struct ccn_btree_cursor *c)
+{
+    if (c->leaf == NULL)
+        return(0);
+    c->index++;
+    return(ccn_btree_cursor_settle(c));
+}
+
+/**
+ * Step a cursor to the preceding entry, moving to the previous leaf as needed.
+ *
+ * Once a cursor has gone off the end, it stays there.
+ * @returns 1 if on an entry, 0 if at beginning, -1 if error.
+ */
+int
+ccn_btree_cursor_prev(struct ccn_btree_cursor *c)
+{
+    struct ccn_btree_node *leaf = NULL;
+    int res;
+    
+    if (c->leaf == NULL)
+        return(0);
+    while (c->index <= 0) {
+        res = ccn_btree_prev_leaf(c->btree, c->leaf, &leaf);
+        if (res <= 0) {
+            c->leaf = NULL;
+            return(res);
+        }
+        c->leaf = leaf;
+        c->index = ccn_btree_node_nent(leaf);
+        if (c->index < 0) {
+            c->leaf = NULL;
+            return(-1);
+        }
+    }
+    c->index--;
+    return(1);
+}
+
+/** Deepest tree the builder will make */
+#define CCN_BT_BUILDER_MAX_LEVELS 30
+
+/** One level of a tree being built */
+struct ccn_btree_builder_level {
+    struct ccn_btree_node node; /**< header and keys of the partial node */
+    struct ccn_charbuf *ents;   /**< entries of the partial node */
+    struct ccn_charbuf *first;  /**< first key in the partial node's subtree */
+    struct ccn_charbuf *carry;  /**< key carried over to the next node */
+    unsigned akoff;             /**< last key stored whole, for sharing */
+    unsigned aksiz;
+    int n;                      /**< entries in the partial node */
+    int emitted;                /**< nodes already written at this level */
+};
+
+struct ccn_btree_builder {
+    struct ccn_btree *btree;
+    int fill;                   /**< target fill, percent */
+    int nlevels;                /**< levels started so far */
+    struct ccn_charbuf *prev;   /**< the last leaf key, to check order */
+    struct ccn_btree_builder_level lev[CCN_BT_BUILDER_MAX_LEVELS];
+};
+
+/**
+ * Start building a btree bottom-up from keys supplied in order
+ *
+ * This is much cheaper than inserting the keys one by one, because
+ * every node is filled and written just once, and nothing but the
+ * partial node at each level needs to stay in memory.  Nodes are
+ * given ids in the order they are filled, so a leaf scan reads them
+ * in the order they were written.
+ *
+ * The btree must be empty, apart from its root, and nothing else
+ * may change it until the builder is finished.
+ *
+ * @param fill_percent - how full to make the nodes, relative to the
+ *        split thresholds (btree->full0, btree->full, btree->nodebytes),
+ *        so that later inserts do not cause an immediate split.
+ * @returns the builder, or NULL for error.
+ */
+struct ccn_btree_builder *
+ccn_btree_builder_create(struct ccn_btree *btree, int fill_percent)
+{
+    struct ccn_btree_builder *b = NULL;
+    struct ccn_btree_node *root = NULL;
+    
+    root = ccn_btree_getnode(btree, 1, 0);
+    if (root == NULL || root->corrupt ||
+        ccn_btree_node_nent(root) != 0 || btree->nextnodeid < 2)
+        return(NULL);
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+        return(NULL);
+    b->btree = btree;
+    b->fill = fill_percent;
+    if (b->fill < 1 || b->fill > 100)
+        b->fill = 100;
+    b->prev = ccn_charbuf_create();
+    if (b->prev == NULL) {
+        free(b);
+        return(NULL);
+    }
+    return(b);
+}
+
+/**
+ * Write out the partial node at a level, and link it into the level above
+ */
+static int
+ccn_btree_builder_emit(struct ccn_btree_builder *b, int level);
+
+/**
+ * Add an entry to the partial node at the given level,
+ * emitting that node first if it is full.
+ *
+ * An internal node always passes its last entry on to the next node,
+ * so that none ends up with a single entry (and so no key), which
+ * ccn_btree_next_leaf() and ccn_btree_prev_leaf() could not handle.
+ */
+static int
+ccn_btree_builder_add(struct ccn_btree_builder *b, int level,
+                      const unsigned char *key, size_t keysize,
+                      void *payload, size_t payload_bytes)
+{
+    struct ccn_btree_internal_payload link;
+    struct ccn_btree_builder_level *lev = NULL;
+    struct ccn_btree_entry_trailer *t = NULL;
+    unsigned char *e = NULL;
+    size_t k, pb, limit, bytes, ksiz, m;
+    unsigned least;
+    int res;
+    
+    if (level >= CCN_BT_BUILDER_MAX_LEVELS || keysize > CCN_BT_MAX_KEY_SIZE)
+        return(-1);
+    pb = (payload_bytes + CCN_BT_SIZE_UNITS - 1)
+         / CCN_BT_SIZE_UNITS
+         * CCN_BT_SIZE_UNITS;
+    k = pb + sizeof(struct ccn_btree_entry_trailer);
+    if (k / CCN_BT_SIZE_UNITS > 255)
+        return(-1);
+    lev = &b->lev[level];
+    if (level == b->nlevels) {
+        lev->node.buf = ccn_charbuf_create();
+        lev->ents = ccn_charbuf_create();
+        lev->first = ccn_charbuf_create();
+        lev->carry = ccn_charbuf_create();
+        b->nlevels++;
+        if (lev->node.buf == NULL || lev->ents == NULL ||
+            lev->first == NULL || lev->carry == NULL)
+            return(-1);
+        res = ccn_btree_init_node(&lev->node, level, 0, 0);
+        if (res < 0)
+            return(-1);
+    }
+    if (lev->n > 0) {
+        least = (level == 0) ? 2 : 3;
+        limit = (level == 0) ? b->btree->full0 : b->btree->full;
+        limit = limit * b->fill / 100;
+        if (limit < least)
+            limit = least;
+        bytes = lev->node.buf->length + lev->ents->length + keysize + k;
+        if (lev->n >= limit ||
+            (lev->n >= least && b->btree->nodebytes > 0 &&
+             bytes > (size_t)b->btree->nodebytes * b->fill / 100)) {
+            if (level == 0) {
+                res = ccn_btree_builder_emit(b, level);
+                if (res < 0)
+                    return(-1);
+            }
+            else {
+                /* Take back the last entry, whose key ends the node */
+                e = lev->ents->buf + lev->ents->length - k;
+                t = (struct ccn_btree_entry_trailer *)(e + pb);
+                memcpy(&link, e, sizeof(link));
+                lev->carry->length = 0;
+                ccn_charbuf_append(lev->carry,
+                                   lev->node.buf->buf + MYFETCH(t, koff0),
+                                   MYFETCH(t, ksiz0));
+                ksiz = MYFETCH(t, ksiz1);
+                ccn_charbuf_append(lev->carry,
+                                   lev->node.buf->buf + MYFETCH(t, koff1),
+                                   ksiz);
+                if (ksiz == 0)
+                    ksiz = MYFETCH(t, ksiz0); /* it was stored whole */
+                lev->node.buf->length -= ksiz;
+                lev->ents->length -= k;
+                lev->n--;
+                res = ccn_btree_builder_emit(b, level);
+                if (res >= 0)
+                    res = ccn_btree_builder_add(b, level,
+                                                lev->carry->buf, lev->carry->length,
+                                                &link, sizeof(link));
+                if (res < 0)
+                    return(-1);
+            }
+        }
+    }
+    if (lev->n == 0) {
+        lev->first->length = 0;
+        ccn_charbuf_append(lev->first, key, keysize);
+        if (level != 0)
+            keysize = 0; /* the first key of an internal node is implied */
+        lev->aksiz = 0;
+    }
+    /* Share a prefix with the last whole key, as scan_reusable() would */
+    for (m = 0; m < lev->aksiz && m < keysize &&
+                lev->node.buf->buf[lev->akoff + m] == key[m]; m++)
+        continue;
+    if (m * 2 < keysize)
+        m = 0;
+    e = ccn_charbuf_reserve(lev->ents, k);
+    if (e == NULL)
+        return(-1);
+    memset(e, 0, k);
+    memcpy(e, payload, payload_bytes);
+    t = (struct ccn_btree_entry_trailer *)(e + pb);
+    if (m != 0) {
+        MYSTORE(t, koff0, lev->akoff);
+        MYSTORE(t, ksiz0, m);
+        MYSTORE(t, koff1, lev->node.buf->length);
+        MYSTORE(t, ksiz1, keysize - m);
+    }
+    else {
+        MYSTORE(t, koff0, lev->node.buf->length);
+        MYSTORE(t, ksiz0, keysize);
+        lev->akoff = lev->node.buf->length;
+        lev->aksiz = keysize;
+    }
+    MYSTORE(t, entdx, lev->n);
+    MYSTORE(t, level, level);
+    MYSTORE(t, entsz, k / CCN_BT_SIZE_UNITS);
+    lev->ents->length += k;
+    res = ccn_charbuf_append(lev->node.buf, key + m, keysize - m);
+    if (res < 0)
+        return(-1);
+    lev->n++;
+    return(0);
+}
+
+/**
+ * Put the entries of a partial node after its keys, at the end of the node
+ */
+static int
+ccn_btree_builder_seal(struct ccn_btree_builder_level *lev)
+{
+    struct ccn_charbuf *buf = lev->node.buf;
+    size_t pad;
+    
+    pad = (CCN_BT_SIZE_UNITS - buf->length % CCN_BT_SIZE_UNITS)
+          % CCN_BT_SIZE_UNITS;
+    if (NULL == ccn_charbuf_reserve(buf, pad + lev->ents->length))
+        return(-1);
+    memset(buf->buf + buf->length, 0, pad);
+    buf->length += pad;
+    ccn_charbuf_append_charbuf(buf, lev->ents);
+    lev->node.freelow = 0;
+    lev->node.clean = 0;
+    return(ccn_btree_chknode(&lev->node));
+}
+
+static int
+ccn_btree_builder_emit(struct ccn_btree_builder *b, int level)
+{
+    struct ccn_btree_internal_payload link = {{CCN_BT_INTERNAL_MAGIC}};
+    struct ccn_btree_builder_level *lev = &b->lev[level];
+    struct ccn_btree *btree = b->btree;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_charbuf *t = NULL;
+    ccn_btnodeid id;
+    int res;
+    
+    if (ccn_btree_builder_seal(lev) < 0)
+        return(-1);
+    id = btree->nextnodeid++;
+    lev->node.nodeid = id;
+    if (btree->io != NULL) {
+        /* Straight to storage; it need not be resident */
+        res = btree->io->btopen(btree->io, &lev->node);
+        if (res < 0)
+            return(-1);
+        res = btree->io->btwrite(btree->io, &lev->node);
+        if (btree->io->btclose(btree->io, &lev->node) < 0)
+            res = -1;
+        lev->node.iodata = NULL;
+        if (res < 0)
+            return(-1);
+    }
+    else {
+        node = ccn_btree_getnode(btree, id, 0);
+        if (node == NULL || ccn_btree_node_nent(node) != 0)
+            return(-1);
+        t = node->buf;
+        node->buf = lev->node.buf;
+        lev->node.buf = t;
+        node->clean = 0;
+        node->freelow = 0;
+        ccn_btree_chknode(node);
+    }
+    lev->emitted++;
+    lev->n = 0;
+    lev->ents->length = 0;
+    res = ccn_btree_init_node(&lev->node, level, 0, 0);
+    if (res < 0)
+        return(-1);
+    MYSTORE(&link, child, id);
+    return(ccn_btree_builder_add(b, level + 1,
+                                 lev->first->buf, lev->first->length,
+                                 &link, sizeof(link)));
+}
+
+/**
+ * Add the next leaf entry
+ *
+ * @returns 0 for success, -1 for error (including a key out of order).
+ */
+int
+ccn_btree_builder_append(struct ccn_btree_builder *b,
+                         const unsigned char *key, size_t keysize,
+                         void *payload, size_t payload_bytes)
+{
+    size_t cmplen;
+    int res;
+    
+    if (b->nlevels > 0 && b->lev[0].n + b->lev[0].emitted > 0) {
+        cmplen = keysize < b->prev->length ? keysize : b->prev->length;
+        res = memcmp(key, b->prev->buf, cmplen);
+        if (res < 0 || (res == 0 && keysize <= b->prev->length))
+            return(-1);
+    }
+    res = ccn_btree_builder_add(b, 0, key, keysize, payload, payload_bytes);
+    if (res < 0)
+        return(-1);
+    b->prev->length = 0;
+    return(ccn_charbuf_append(b->prev, key, keysize));
+}
+
+/**
+ * Finish building
+ *
+ * The partial nodes are written out from the bottom up; the single
+ * node left at the top becomes the new contents of the root, which
+ * is left dirty for the usual cleaning.
+ * The builder is freed in any case; if there is an error, the root
+ * may not have been updated.
+ *
+ * @returns 0 for success, -1 for error.
+ */
+int
+ccn_btree_builder_finish(struct ccn_btree_builder **pb)
+{
+    struct ccn_btree_builder *b = *pb;
+    struct ccn_btree_builder_level *lev = NULL;
+    struct ccn_btree_node_header *hdr = NULL;
+    struct ccn_btree_node *root = NULL;
+    int ans = 0;
+    int i;
+    
+    if (b == NULL)
+        return(-1);
+    *pb = NULL;
+    for (i = 0; i < b->nlevels && ans == 0; i++) {
+        lev = &b->lev[i];
+        if (lev->n == 0)
+            break;
+        if (i < b->nlevels - 1 || lev->emitted > 0) {
+            if (ccn_btree_builder_emit(b, i) < 0)
+                ans = -1;
+            continue;
+        }
+        /* This is the top */
+        root = ccn_btree_getnode(b->btree, 1, 0);
+        if (root == NULL || ccn_btree_builder_seal(lev) < 0 ||
+            ccn_btree_prepare_for_update(b->btree, root) < 0) {
+            ans = -1;
+            break;
+        }
+        hdr = (struct ccn_btree_node_header *)lev->node.buf->buf;
+        MYSTORE(hdr, nodetype, 'R');
+        root->buf->length = 0;
+        ccn_charbuf_append_charbuf(root->buf, lev->node.buf);
+        root->clean = 0;
+        root->freelow = 0;
+        if (ccn_btree_chknode(root) < 0)
+            ans = -1;
+        b->btree->cleanreq++;
+    }
+    ccn_btree_builder_destroy(&b);
+    return(ans);
+}
+
+/**
+ * Abandon a build
+ *
+ * The root is left as it was.  Nodes already written are not
+ * reclaimed, but nothing refers to them.
+ */
+void
+ccn_btree_builder_destroy(struct ccn_btree_builder **pb)
+{
+    struct ccn_btree_builder *b = *pb;
+    struct ccn_btree_builder_level *lev = NULL;
+    int i;
+    
+    if (b == NULL)
+        return;
+    for (i = 0; i < b->nlevels; i++) {
+        lev = &b->lev[i];
+        ccn_charbuf_destroy(&lev->node.buf);
+        ccn_charbuf_destroy(&lev->ents);
+        ccn_charbuf_destroy(&lev->first);
+        ccn_charbuf_destroy(&lev->carry);
+    }
+    ccn_charbuf_destroy(&b->prev);
+    free(b);
+    *pb = NULL;
+}
+
 #define CCN_BTREE_MAGIC 0x53ade78
 #define CCN_BTREE_VERSION 1
 
+/**
+ * Note that a resident node has been opened for io, so that the
+ * cleaner can find it without looking at every resident node.
+ */
+static void
+note_opened(struct ccn_btree *bt, struct ccn_btree_node *node)
+{
+    if (bt->opened == NULL)
+        bt->opened = ccn_indexbuf_create();
+    if (bt->opened != NULL)
+        ccn_indexbuf_append_element(bt->opened, node->nodeid);
+}
+
+/**
+ * Bring the node's share of the cache byte counts up to date
+ *
+ * Nodes grow in many places, so this is done when they come into
+ * memory and whenever the CLOCK hand passes them.
+ */
+static void
+cache_account(struct ccn_btree *bt, struct ccn_btree_node *node)
+{
+    unsigned size = 0;
+    
+    if (node->buf != NULL)
+        size = node->buf->limit;
+    if (node->hints != NULL)
+        size += node->hints->limit;
+    bt->cachebytes -= node->cached;
+    bt->pinbytes -= node->pinned;
+    node->cached = size;
+    node->pinned = (ccn_btree_node_level(node) > 0) ? size : 0;
+    bt->cachebytes += node->cached;
+    bt->pinbytes += node->pinned;
+}
+
+static int
+cache_over(struct ccn_btree *btree)
+{
+    if (btree->nodepool >= 16 && hashtb_n(btree->resident) > btree->nodepool)
+        return(1);
+    return(btree->cachelimit != 0 && btree->cachebytes > btree->cachelimit);
+}
+
+/**
+ * Drop clean, idle nodes from memory until the node cache is within limits
+ *
+ * The limits are btree->nodepool nodes (if at least 16) and
+ * btree->cachelimit bytes (if nonzero).
+ *
+ * The resident nodes are visited in CLOCK order.  A node that has seen
+ * activity since the hand last came by has its activity halved and is
+ * kept; otherwise it is dropped (and closed), provided it is clean.
+ * The root is never dropped, and the other internal nodes are passed
+ * over while they take no more than half of the cache, since every
+ * lookup needs them.  Each visit takes constant time, and one call
+ * makes at most two trips around.
+ *
+ * Node pointers obtained earlier may be invalidated.
+ *
+ * @returns the number of nodes dropped.
+ */
+int
+ccn_btree_evict(struct ccn_btree *btree)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_indexbuf *clock = btree->clock;
+    struct ccn_btree_node *node = NULL;
+    ccn_btnodeid nodeid;
+    size_t visits;
+    int ans = 0;
+    int i;
+    
+    if (clock == NULL)
+        return(0);
+    /* Nodes only grow while open for update, so recount those first */
+    for (i = 0; btree->opened != NULL && i < btree->opened->n; i++) {
+        node = ccn_btree_rnode(btree, btree->opened->buf[i]);
+        if (node != NULL)
+            cache_account(btree, node);
+    }
+    for (visits = 2 * clock->n;
+         visits > 0 && clock->n > 0 && cache_over(btree); visits--) {
+        if (btree->hand >= clock->n)
+            btree->hand = 0;
+        nodeid = clock->buf[btree->hand];
+        node = ccn_btree_rnode(btree, nodeid);
+        if (node == NULL) {
+            clock->buf[btree->hand] = clock->buf[--clock->n];
+            continue;
+        }
+        cache_account(btree, node);
+        if (nodeid == 1 ||
+            (node->pinned != 0 && btree->pinbytes * 2 <= btree->cachebytes) ||
+            node->clean != node->buf->length) {
+            btree->hand++;
+            continue;
+        }
+        if (node->activity > 0) {
+            node->activity /= 2; /* Age the node's activity */
+            btree->hand++;
+            continue;
+        }
+        btree->cachebytes -= node->cached;
+        btree->pinbytes -= node->pinned;
+        hashtb_start(btree->resident, e);
+        if (hashtb_seek(e, &nodeid, sizeof(nodeid), 0) == HT_OLD_ENTRY)
+            hashtb_delete(e);
+        hashtb_end(e);
+        clock->buf[btree->hand] = clock->buf[--clock->n];
+        ans++;
+    }
+    return(ans);
+}
+
+/**
+ * Write all the changed resident nodes, then commit them as one snapshot
+ *
+ * With a store that defers its writes (one that has a btcommit method)
+ * the snapshot is what will be found after a crash, and mark comes back
+ * as io->mark when the store is opened again.  Nodes stay open.
+ *
+ * @returns 0 for success or -1 for error, in which case nothing new
+ *          is committed.
+ */
+int
+ccn_btree_commit(struct ccn_btree *btree, uintmax_t mark)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_btree_io *io = btree->io;
+    struct ccn_btree_node *node = NULL;
+    int res = 0;
+
+    if (io == NULL)
+        return(-1);
+    for (hashtb_start(btree->resident, e); e->data != NULL; hashtb_next(e)) {
+        node = e->data;
+        if (node->corrupt)
+            res = -1;
+        else if (node->clean == node->buf->length)
+            continue;
+        else if (node->iodata == NULL || io->btwrite(io, node) < 0)
+            res = -1;
+        else
+            node->clean = node->buf->length;
+    }
+    hashtb_end(e);
+    if (res < 0) {
+        ccn_btree_note_error(btree, __LINE__);
+        return(-1);
+    }
+    if (io->btcommit != NULL)
+        res = io->btcommit(io, mark);
+    if (res < 0)
+        ccn_btree_note_error(btree, __LINE__);
+    return(res);
+}
+
+/**
+ * Catch up with the latest commit to a read-only store
+ *
+ * This is for a btree whose storage is written by another process
+ * (its io has a btrefresh method).  The resident nodes that the new
+ * commit has changed are dropped, to be read again when next needed,
+ * and the parents recorded in the rest are forgotten, since the shape
+ * of the tree around them may have changed.
+ *
+ * Node pointers obtained earlier are invalidated.
+ *
+ * @returns 1 if there was a new commit, 0 if not, or -1 for error,
+ *          in which case the btree stays as it was.
+ */
+int
+ccn_btree_refresh(struct ccn_btree *btree)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_btree_io *io = btree->io;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_indexbuf *changed = NULL;
+    ccn_btnodeid nodeid;
+    int res;
+    int i;
+    
+    if (io == NULL || io->btrefresh == NULL)
+        return(-1);
+    changed = ccn_indexbuf_create();
+    if (changed == NULL)
+        return(-1);
+    res = io->btrefresh(io, changed);
+    if (res > 0) {
+        for (i = 0; i < changed->n; i++) {
+            nodeid = changed->buf[i];
+            node = ccn_btree_rnode(btree, nodeid);
+            if (node == NULL)
+                continue;
+            btree->cachebytes -= node->cached;
+            btree->pinbytes -= node->pinned;
+            hashtb_start(btree->resident, e);
+            if (hashtb_seek(e, &nodeid, sizeof(nodeid), 0) == HT_OLD_ENTRY)
+                hashtb_delete(e);
+            hashtb_end(e);
+        }
+        for (hashtb_start(btree->resident, e); e->data != NULL; hashtb_next(e)) {
+            node = e->data;
+            node->parent = 0;
+        }
+        hashtb_end(e);
+        btree->nextnodeid = io->maxnodeid + 1;
+    }
+    ccn_indexbuf_destroy(&changed);
+    return(res);
+}
+
 /**
  *  Write out any pending changes, mark the node clean, and release node iodata
  *
@@ -952,6 +2149,7 @@ finalize_node(struct hashtb_enumerator *e)
         abort();
     ccn_btree_close_node(btree, node);
     ccn_charbuf_destroy(&node->buf);
+    ccn_charbuf_destroy(&node->hints);
 }
 
 /**
@@ -1009,6 +2207,8 @@ ccn_btree_destroy(struct ccn_btree **pbt)
     if (bt->magic != CCN_BTREE_MAGIC)
         abort();
     hashtb_destroy(&bt->resident);
+    ccn_indexbuf_destroy(&bt->clock);
+    ccn_indexbuf_destroy(&bt->opened);
     if (bt->errors != 0)
         res = -(bt->errors & 1023);
     if (bt->io != NULL)
@@ -1037,6 +2237,7 @@ ccn_btree_init_node(struct ccn_btree_node *node,
     bytes = sizeof(*hdr) + extsz * CCN_BT_SIZE_UNITS;
     node->clean = 0;
     node->buf->length = 0;
+    ccn_charbuf_destroy(&node->hints);
     hdr = (struct ccn_btree_node_header *)ccn_charbuf_reserve(node->buf, bytes);
     if (hdr == NULL) return(-1);
     MYSTORE(hdr, magic, CCN_BTREE_MAGIC);
@@ -1074,10 +2275,16 @@ ccn_btree_getnode(struct ccn_btree *bt,
     hashtb_start(bt->resident, e);
     res = hashtb_seek(e, &nodeid, sizeof(nodeid), 0);
     node = e->data;
-    if (res == HT_NEW_ENTRY) {
+    if (res == HT_OLD_ENTRY)
+        bt->hits++;
+    else if (res == HT_NEW_ENTRY) {
         node->nodeid = nodeid;
         node->buf = ccn_charbuf_create();
         bt->cleanreq++;
+        if (bt->clock == NULL)
+            bt->clock = ccn_indexbuf_create();
+        if (bt->clock != NULL)
+            ccn_indexbuf_append_element(bt->clock, nodeid);
         if (node->buf == NULL) {
             ccn_btree_note_error(bt, __LINE__);
             node->corrupt = __LINE__;
@@ -1094,6 +2301,8 @@ ccn_btree_getnode(struct ccn_btree *bt,
                     ccn_btree_note_error(bt, __LINE__);
                 else {
                     node->clean = node->buf->length;
+                    if (node->clean != 0)
+                        bt->misses++;
                     if (-1 == ccn_btree_chknode(node))
                         ccn_btree_note_error(bt, __LINE__);
                     node->activity = CCN_BT_ACTIVITY_READ_BUMP;
@@ -1104,8 +2313,11 @@ ccn_btree_getnode(struct ccn_btree *bt,
                             ccn_btree_note_error(bt, __LINE__);
                     }
                 }
+                if (node->iodata != NULL)
+                    note_opened(bt, node);
             }
         }
+        cache_account(bt, node);
     }
     if (node != NULL && node->nodeid != nodeid)
         abort();
@@ -1161,6 +2373,7 @@ ccn_btree_chknode(struct ccn_btree_node *node)
         return(-1);
     saved_corrupt = node->corrupt;
     node->corrupt = 0;
+    ccn_charbuf_destroy(&node->hints);
     if (node->buf == NULL)
         return(node->corrupt = __LINE__, -1);
     if (node->buf->length == 0)
@@ -1244,6 +2457,8 @@ ccn_btree_prepare_for_update(struct ccn_btree *bt, struct ccn_btree_node *node)
             ccn_btree_note_error(bt, __LINE__);
             node->corrupt = __LINE__;
         }
+        else
+            note_opened(bt, node);
     }
     node->activity += CCN_BT_ACTIVITY_UPDATE_BUMP;
     return(res);
@@ -60,27 +60,23 @@ ccn_btree_storeval64(unsigned char *p, int size, uint_least64_t v)
 }
 
 /**
- * Insert a ContentObject into a btree node
+ * Fill in the leaf payload that describes a ContentObject
  *
- * The caller has presumably already done a lookup and found that the
- * object is not there.
+ * This is what ccn_btree_insert_content() puts in the index, made
+ * available separately for building an index in bulk
+ * (see ccn_btree_builder_create()).
  *
- * The caller is responsible for provinding a valid content parse (pc).
- *
- * The flatname buffer should hold the correct full name, including the
- * digest.
+ * The flatname should hold the correct full name, including the digest.
  *
- * @returns the new entry count or, -1 for error.
+ * @returns 0 for success, -1 for error.
  */
 int
-ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
-                         uint_least64_t cobid,
-                         const unsigned char *content_object,
-                         struct ccn_parsed_ContentObject *pc,
-                         struct ccn_charbuf *flatname)
+ccn_btree_init_content_payload(struct ccn_btree_content_payload *e,
+                               uint_least64_t cobid,
+                               const unsigned char *content_object,
+                               struct ccn_parsed_ContentObject *pc,
+                               const unsigned char *flatname, size_t fsize)
 {
-    struct ccn_btree_content_payload payload;
-    struct ccn_btree_content_payload *e = &payload;
     int ncomp;
     int res;
     unsigned size;
@@ -89,7 +85,7 @@ ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
     size_t blob_size = 0;
     
     size = pc->offset[CCN_PCO_E];
-    ncomp = ccn_flatname_ncomps(flatname->buf, flatname->length);
+    ncomp = ccn_flatname_ncomps(flatname, fsize);
     if (ncomp != pc->name_ncomps + 1)
         return(-1);
     memset(e, 'U', sizeof(*e));
@@ -116,10 +112,40 @@ ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
     if (res < 0 || blob_size != sizeof(e->ppkdg))
         return(-1);
     memcpy(e->ppkdg, blob, sizeof(e->ppkdg));
+    return(0);
+}
+
+/**
+ * Insert a ContentObject into a btree node
+ *
+ * The caller has presumably already done a lookup and found that the
+ * object is not there.
+ *
+ * The caller is responsible for provinding a valid content parse (pc).
+ *
+ * The flatname buffer should hold the correct full name, including the
+ * digest.
+ *
+ * @returns the new entry count or, -1 for error.
+ */
+int
+ccn_btree_insert_content(struct ccn_btree_node *node, int ndx,
+                         uint_least64_t cobid,
+                         const unsigned char *content_object,
+                         struct ccn_parsed_ContentObject *pc,
+                         struct ccn_charbuf *flatname)
+{
+    struct ccn_btree_content_payload payload;
+    int res;
+    
+    res = ccn_btree_init_content_payload(&payload, cobid, content_object, pc,
+                                         flatname->buf, flatname->length);
+    if (res < 0)
+        return(-1);
     /* Now actually do the insert */
     res = ccn_btree_insert_entry(node, ndx,
                                  flatname->buf, flatname->length,
-                                 e, sizeof(*e));
+                                 &payload, sizeof(payload));
     return(res);
 }
 
@@ -144,6 +170,27 @@ ccn_btree_match_interest(struct ccn_btree_node *node, int ndx,
                          const unsigned char *interest_msg,
                          const struct ccn_parsed_interest *pi,
                          struct ccn_charbuf *scratch)
+{
+    return(ccn_btree_match_interest_excl(node, ndx, interest_msg, pi,
+                                         NULL, scratch));
+}
+
+/**
+ * Like ccn_btree_match_interest, with the Interest's Exclude (if any)
+ * compiled ahead of time.
+ *
+ * A caller that walks many entries for one interest should compile
+ * the Exclude once with ccn_compile_exclude and pass it as ce.
+ * If ce is NULL, the Exclude is decoded from interest_msg.
+ *
+ * @result 1 for match, 0 for no match, -1 for error.
+ */
+int
+ccn_btree_match_interest_excl(struct ccn_btree_node *node, int ndx,
+                              const unsigned char *interest_msg,
+                              const struct ccn_parsed_interest *pi,
+                              const struct ccn_compiled_exclude *ce,
+                              struct ccn_charbuf *scratch)
 {
     const unsigned char *blob = NULL;
     const unsigned char *nextcomp = NULL;
@@ -204,7 +251,11 @@ ccn_btree_match_interest(struct ccn_btree_node *node, int ndx,
         }
         if (nextcomp == NULL)
             return(0);
-        if (ccn_excluded(interest_msg + pi->offset[CCN_PI_B_Exclude],
+        if (ce != NULL) {
+            if (ccn_compiled_excluded(ce, nextcomp, nextcomp_size))
+                return(0);
+        }
+        else if (ccn_excluded(interest_msg + pi->offset[CCN_PI_B_Exclude],
                          (pi->offset[CCN_PI_E_Exclude] -
                           pi->offset[CCN_PI_B_Exclude]),
                          nextcomp,
@@ -20,6 +20,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +29,7 @@
 
 #include <ccn/btree.h>
 #include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
 
 static int bts_open(struct ccn_btree_io *, struct ccn_btree_node *);
 static int bts_read(struct ccn_btree_io *, struct ccn_btree_node *, unsigned);
@@ -42,79 +44,49 @@ struct bts_data {
 };
 
 /**
- * Create a btree storage layer from a directory.
- * 
- * In this implementation of the storage layer, each btree block is stored
- * as a separate file.
- * The files are named using the decimal representation of the nodeid.
- *
- * If msgs is not NULL, diagnostics may be recorded there.
+ * Create and lock the lock file in the directory.
  *
- * @param path is the name of the directory, which must exist.
- * @returns the new ccn_btree_io handle, or sets errno and returns NULL.
+ * The lock file descriptor is left open in *lfdp, since closing it
+ * would release the lock.
+ * @returns 0 for success, -1 for failure.
  */
-struct ccn_btree_io *
-ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
+static int
+bts_lock(struct ccn_charbuf *dirpath, int *lfdp, struct ccn_charbuf *msgs)
 {
-    DIR *d = NULL;
-    struct bts_data *md = NULL;
-    struct ccn_btree_io *ans = NULL;
-    struct ccn_btree_io *tans = NULL;
     struct ccn_charbuf *temp = NULL;
     char tbuf[21];
-    int fd = -1;
     struct flock flk = {0};
     int pid, res;
-    int maxnodeid = 0;
-    
-    /* Make sure we were handed a directory */
-    d = opendir(path);
-    if (d == NULL)
-        goto Bail; /* errno per opendir */
-    closedir(d);
-    d = NULL;
+    int ans = -1;
     
-    /* Allocate private data area */
-    md = calloc(1, sizeof(*md));
-    if (md == NULL)
-        goto Bail; /* errno per calloc */
-    md->lfd = -1;
-    md->dirpath = ccn_charbuf_create();
-    if (md->dirpath == NULL) goto Bail; /* errno per calloc */
-    res = ccn_charbuf_putf(md->dirpath, "%s", path);
-    if (res < 0) goto Bail; /* errno per calloc or snprintf */
-    tans = calloc(1, sizeof(*tans));
-    if (tans == NULL) goto Bail; /* errno per calloc */
-    
-    /* Try to create a lock file */
     temp = ccn_charbuf_create();
-    if (temp == NULL) goto Bail; /* errno per calloc */    
-    res = ccn_charbuf_append_charbuf(temp, md->dirpath);
+    if (temp == NULL) goto Bail; /* errno per calloc */
+    res = ccn_charbuf_append_charbuf(temp, dirpath);
     if (res < 0) goto Bail; /* errno per calloc */
     res = ccn_charbuf_putf(temp, "/.LCK");
     if (res < 0) goto Bail; /* errno per calloc or snprintf */
     flk.l_type = F_WRLCK;
     flk.l_whence = SEEK_SET;
-    md->lfd = open(ccn_charbuf_as_string(temp),
+    *lfdp = open(ccn_charbuf_as_string(temp),
                (O_RDWR | O_CREAT | O_EXCL),
                0600);
-    if (md->lfd == -1) {
+    if (*lfdp == -1) {
         if (errno == EEXIST) {
             // try to recover by checking if the pid the lock names exists
-            md->lfd = open(ccn_charbuf_as_string(temp), O_RDWR);
-            if (md->lfd == -1) {
+            *lfdp = open(ccn_charbuf_as_string(temp), O_RDWR);
+            if (*lfdp == -1) {
                 if (msgs != NULL)
                     ccn_charbuf_append_string(msgs, "Unable to open pid file for update. ");
                 goto Bail;
             }
             memset(tbuf, 0, sizeof(tbuf));
-            read(md->lfd, tbuf, sizeof(tbuf) - 1);
+            read(*lfdp, tbuf, sizeof(tbuf) - 1);
             pid = strtol(tbuf, NULL, 10);
             if (pid == (int)getpid())
                 goto Bail; /* locked by self; errno still EACCES */
-            if (fcntl(md->lfd, F_SETLK, &flk) == -1) {
+            if (fcntl(*lfdp, F_SETLK, &flk) == -1) {
                 if (errno == EACCES || errno == EAGAIN) { // it's locked
-                    fcntl(md->lfd, F_GETLK, &flk);
+                    fcntl(*lfdp, F_GETLK, &flk);
                     if (msgs != NULL)
                         ccn_charbuf_putf(msgs, "Locked by process id %d. ", flk.l_pid);
                     goto Bail;
@@ -122,8 +94,8 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
             }
             if (msgs != NULL)
                 ccn_charbuf_putf(msgs, "Breaking stale lock by pid %d. ", pid);
-            lseek(md->lfd, 0, SEEK_SET);
-            ftruncate(md->lfd, 0);
+            lseek(*lfdp, 0, SEEK_SET);
+            ftruncate(*lfdp, 0);
         }
         else {
             if (msgs != NULL)
@@ -131,9 +103,9 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
             goto Bail; /* errno per open, probably EACCES */
         }
     }
-    else if (fcntl(md->lfd, F_SETLK, &flk) == -1) {
+    else if (fcntl(*lfdp, F_SETLK, &flk) == -1) {
         if (errno == EACCES || errno == EAGAIN) { // it's locked
-            fcntl(md->lfd, F_GETLK, &flk);
+            fcntl(*lfdp, F_GETLK, &flk);
             if (msgs != NULL)
                 ccn_charbuf_putf(msgs, "Locked by process id %d. ", flk.l_pid);
             goto Bail;
@@ -142,12 +114,66 @@ ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
     /* Locking succeeded - place our pid in the lockfile so humans can see it */
     temp->length = 0;
     ccn_charbuf_putf(temp, "%d", (int)getpid());
-    if (write(md->lfd, temp->buf, temp->length) < 0) {
+    if (write(*lfdp, temp->buf, temp->length) < 0) {
         if (msgs != NULL)
             ccn_charbuf_append_string(msgs, "Unable to write pid file.");
         goto Bail;
     }
-    /* leave the lock file descriptor open, otherwise the lock is released */
+    ans = 0;
+Bail:
+    ccn_charbuf_destroy(&temp);
+    return(ans);
+}
+
+/**
+ * Create a btree storage layer from a directory.
+ * 
+ * In this implementation of the storage layer, each btree block is stored
+ * as a separate file.
+ * The files are named using the decimal representation of the nodeid.
+ *
+ * If msgs is not NULL, diagnostics may be recorded there.
+ *
+ * @param path is the name of the directory, which must exist.
+ * @returns the new ccn_btree_io handle, or sets errno and returns NULL.
+ */
+struct ccn_btree_io *
+ccn_btree_io_from_directory(const char *path, struct ccn_charbuf *msgs)
+{
+    DIR *d = NULL;
+    struct bts_data *md = NULL;
+    struct ccn_btree_io *ans = NULL;
+    struct ccn_btree_io *tans = NULL;
+    struct ccn_charbuf *temp = NULL;
+    char tbuf[21];
+    int fd = -1;
+    int res;
+    int maxnodeid = 0;
+    
+    /* Make sure we were handed a directory */
+    d = opendir(path);
+    if (d == NULL)
+        goto Bail; /* errno per opendir */
+    closedir(d);
+    d = NULL;
+    
+    /* Allocate private data area */
+    md = calloc(1, sizeof(*md));
+    if (md == NULL)
+        goto Bail; /* errno per calloc */
+    md->lfd = -1;
+    md->dirpath = ccn_charbuf_create();
+    if (md->dirpath == NULL) goto Bail; /* errno per calloc */
+    res = ccn_charbuf_putf(md->dirpath, "%s", path);
+    if (res < 0) goto Bail; /* errno per calloc or snprintf */
+    tans = calloc(1, sizeof(*tans));
+    if (tans == NULL) goto Bail; /* errno per calloc */
+    
+    /* Try to create a lock file */
+    temp = ccn_charbuf_create();
+    if (temp == NULL) goto Bail; /* errno per calloc */    
+    res = bts_lock(md->dirpath, &md->lfd, msgs);
+    if (res < 0) goto Bail;
     /* Read maxnodeid */
     temp->length = 0;
     ccn_charbuf_append_charbuf(temp, md->dirpath);
@@ -324,31 +350,42 @@ bts_close(struct ccn_btree_io *io, struct ccn_btree_node *node)
 }
 
 /**
- *  Remove the lock file, trusting that it is ours.
+ *  Remove the lock file in dirpath, trusting that it is ours.
  *  @returns -1 if there were errors (but it cleans up what it can).
  */
 static int
-bts_remove_lockfile(struct ccn_btree_io *io)
+bts_remove_lockfile_path(struct ccn_charbuf *dirpath, int *lfdp)
 {
     size_t sav;
     int res;
     struct flock flk = {0};
-    struct bts_data *md = NULL;
     
-    md = io->data;
-    sav = md->dirpath->length;
-    ccn_charbuf_putf(md->dirpath, "/.LCK");
-    res = unlink(ccn_charbuf_as_string(md->dirpath));
-    md->dirpath->length = sav;
-    if (md->lfd >= 0) {
+    sav = dirpath->length;
+    ccn_charbuf_putf(dirpath, "/.LCK");
+    res = unlink(ccn_charbuf_as_string(dirpath));
+    dirpath->length = sav;
+    if (*lfdp >= 0) {
         flk.l_type = F_UNLCK;
         flk.l_whence = SEEK_SET;
-        fcntl(md->lfd, F_SETLK, &flk);
-        md->lfd = -1;
+        fcntl(*lfdp, F_SETLK, &flk);
+        close(*lfdp);
+        *lfdp = -1;
     }
     return(res);
 }
 
+/**
+ *  Remove the lock file, trusting that it is ours.
+ *  @returns -1 if there were errors (but it cleans up what it can).
+ */
+static int
+bts_remove_lockfile(struct ccn_btree_io *io)
+{
+    struct bts_data *md = io->data;
+    
+    return(bts_remove_lockfile_path(md->dirpath, &md->lfd));
+}
+
 /**
  *  Remove the lock file and free up resources.
  *  @returns -1 if there were errors (but it cleans up what it can).
@@ -373,3 +410,950 @@ bts_destroy(struct ccn_btree_io **pio)
     *pio = NULL;
     return(res);
 }
+
+/*
+ * Single-file page storage
+ *
+ * In this implementation of the storage layer, the nodes are kept in one
+ * file, named pages, that is divided into BTP_PAGESIZE pages.  Each node
+ * occupies a run of pages whose length is a power of 2.  The node map has
+ * a fixed-size record for each nodeid that tells where the node lives and
+ * how long it is.  The first page of the pages file holds a header, so
+ * page number 0 means that there are no pages.
+ *
+ * The pages are copy-on-write.  A node is never written over in a run
+ * that belongs to the last commit; it goes to a new run, and the old one
+ * is reused only after the next two commits.  A commit writes the whole
+ * node map to a run of its own, syncs, and then writes a commit record
+ * that points to that map.  The header has two slots for commit records,
+ * used alternately, so an interrupted commit leaves the one before it
+ * intact; on opening, the valid record with the later generation wins.
+ * So after a crash the store comes back exactly as of the last commit.
+ *
+ * Runs not accounted for in the committed node map are free; the free
+ * lists are rebuilt from the map when the store is opened.
+ *
+ * Other processes may read the store while it is being written, without
+ * taking the lock.  A reader works from the node map of one commit, and
+ * refreshes to a later one from time to time.  The extra commit that a
+ * released run waits out is what lets a reader still on the commit
+ * before the latest one go on reading; a reader that falls further
+ * behind than that notices, since after each read it checks that the
+ * header has not moved on by more than one commit, and fails the read
+ * (with ESTALE) if it has.  A writer that restarts forgets the runs it
+ * was holding back, so readers are best restarted along with it.
+ *
+ * Stores written before commits were introduced (magic CCNBTP01) keep
+ * the node map in a separate file, named nodemap.  They are read from
+ * there, and converted by their first commit.
+ */
+
+#define BTP_PAGESIZE 4096
+#define BTP_NCLASS 24           /**< size classes, 1 to 2**23 pages */
+#define BTP_RECSIZE 16          /**< size of a node map record */
+#define BTP_SLOTSIZE 40         /**< size of a commit record */
+#define BTP_SLOT(i) (512 * ((i) + 1)) /**< offset of commit record slot */
+#define BTP_MAGIC "CCNBTP02"
+#define BTP_MAGIC1 "CCNBTP01"
+
+static int btp_open(struct ccn_btree_io *, struct ccn_btree_node *);
+static int btp_read(struct ccn_btree_io *, struct ccn_btree_node *, unsigned);
+static int btp_write(struct ccn_btree_io *, struct ccn_btree_node *);
+static int btp_close(struct ccn_btree_io *, struct ccn_btree_node *);
+static int btp_destroy(struct ccn_btree_io **);
+static int btp_commit(struct ccn_btree_io *, uintmax_t);
+static int btp_refresh(struct ccn_btree_io *, struct ccn_indexbuf *);
+
+/**
+ * Where a node lives (in-memory form of a node map record)
+ */
+struct btp_extent {
+    uint64_t page;              /**< first page, or 0 if none */
+    unsigned length;            /**< bytes of node data */
+    unsigned char lg;           /**< run is 2**lg pages */
+    unsigned char fresh;        /**< run is not part of the last commit */
+};
+
+struct btp_data {
+    struct ccn_btree_io *io;
+    struct ccn_charbuf *dirpath;
+    int lfd;                    /**< lock file */
+    int pfd;                    /**< pages file */
+    int mfd;                    /**< old-style nodemap file, or -1 */
+    uint64_t npages;            /**< pages file size, in pages */
+    struct btp_extent *map;     /**< indexed by nodeid */
+    unsigned nmap;              /**< allocated size of map */
+    struct ccn_indexbuf *free[BTP_NCLASS]; /**< free runs by size class */
+    struct ccn_indexbuf *pending; /**< page, lg of runs to retire on commit */
+    struct ccn_indexbuf *retired; /**< page, lg of runs to free on commit */
+    struct btp_extent maprun;   /**< where the committed node map is */
+    uint64_t gen;               /**< generation of the last commit */
+    int changed;                /**< node map differs from the committed one */
+    int readonly;               /**< another process writes the store */
+};
+
+static void
+btp_putval(unsigned char *p, int size, uint64_t v)
+{
+    while (size > 0) {
+        p[--size] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+static uint64_t
+btp_getval(const unsigned char *p, int size)
+{
+    uint64_t v = 0;
+    int i;
+    
+    for (i = 0; i < size; i++)
+        v = (v << 8) + p[i];
+    return(v);
+}
+
+/**
+ * Make sure the in-memory node map has a slot for nodeid.
+ */
+static int
+btp_map_reserve(struct btp_data *md, ccn_btnodeid nodeid)
+{
+    struct btp_extent *map = NULL;
+    unsigned n;
+    
+    if (nodeid < md->nmap)
+        return(0);
+    for (n = md->nmap + 16; n <= nodeid; n *= 2)
+        continue;
+    map = realloc(md->map, n * sizeof(map[0]));
+    if (map == NULL)
+        return(-1);
+    memset(map + md->nmap, 0, (n - md->nmap) * sizeof(map[0]));
+    md->map = map;
+    md->nmap = n;
+    return(0);
+}
+
+/**
+ * Put a run of 2**lg pages on the free list.
+ */
+static int
+btp_free_run(struct btp_data *md, uint64_t page, int lg)
+{
+    if (page == 0 || lg < 0 || lg >= BTP_NCLASS)
+        return(-1);
+    if (md->free[lg] == NULL)
+        md->free[lg] = ccn_indexbuf_create();
+    if (md->free[lg] == NULL)
+        return(-1);
+    return(ccn_indexbuf_append_element(md->free[lg], page));
+}
+
+/**
+ * Let go of the run that a node used to occupy.
+ *
+ * If the last commit refers to the run, it is kept through the next two,
+ * for the sake of readers.
+ */
+static int
+btp_release_run(struct btp_data *md, const struct btp_extent *x)
+{
+    if (x->page == 0)
+        return(0);
+    if (x->fresh)
+        return(btp_free_run(md, x->page, x->lg));
+    if (md->pending == NULL)
+        md->pending = ccn_indexbuf_create();
+    if (md->pending == NULL ||
+        ccn_indexbuf_append_element(md->pending, x->page) < 0)
+        return(-1);
+    return(ccn_indexbuf_append_element(md->pending, x->lg));
+}
+
+/**
+ * Get a run of 2**lg pages, from the free lists if possible.
+ * @returns the first page of the run, or 0 for failure.
+ */
+static uint64_t
+btp_alloc_run(struct btp_data *md, int lg)
+{
+    struct ccn_indexbuf *f = NULL;
+    uint64_t page;
+    int j;
+    
+    for (j = lg; j < BTP_NCLASS; j++) {
+        f = md->free[j];
+        if (f != NULL && f->n > 0)
+            break;
+    }
+    if (j == BTP_NCLASS) {
+        page = md->npages;
+        md->npages += ((uint64_t)1 << lg);
+        return(page);
+    }
+    page = f->buf[--(f->n)];
+    /* Split a larger run, keeping the front part */
+    while (j > lg) {
+        j--;
+        btp_free_run(md, page + ((uint64_t)1 << j), j);
+    }
+    return(page);
+}
+
+/**
+ * Give away space between pages lo and hi as free runs.
+ */
+static void
+btp_free_gap(struct btp_data *md, uint64_t lo, uint64_t hi)
+{
+    int lg;
+    
+    while (lo < hi) {
+        for (lg = BTP_NCLASS - 1; lg > 0; lg--)
+            if (((uint64_t)1 << lg) <= hi - lo)
+                break;
+        btp_free_run(md, lo, lg);
+        lo += ((uint64_t)1 << lg);
+    }
+}
+
+static int
+btp_extent_compare(const void *a, const void *b)
+{
+    const struct btp_extent *x = *(const struct btp_extent * const *)a;
+    const struct btp_extent *y = *(const struct btp_extent * const *)b;
+    
+    if (x->page < y->page)
+        return(-1);
+    return(x->page > y->page);
+}
+
+/**
+ * Read the node map of n records, found at offset off of fd, and rebuild
+ * the free lists.
+ */
+static int
+btp_load_map(struct btp_data *md, int fd, off_t off, unsigned n,
+             struct ccn_charbuf *msgs)
+{
+    unsigned char rec[BTP_RECSIZE];
+    struct btp_extent **v = NULL;
+    struct btp_extent *x = NULL;
+    uint64_t page;
+    unsigned i;
+    unsigned nused;
+    ssize_t sres;
+    int ans = -1;
+    
+    if (n > 0 && btp_map_reserve(md, n - 1) < 0)
+        return(-1);
+    for (i = 1; i < n; i++) {
+        sres = pread(fd, rec, sizeof(rec), off + (off_t)i * BTP_RECSIZE);
+        if (sres != sizeof(rec))
+            return(-1);
+        x = &md->map[i];
+        x->page = btp_getval(rec, 8);
+        x->length = btp_getval(rec + 8, 4);
+        x->lg = rec[12];
+        if (x->page != 0 && (x->lg >= BTP_NCLASS ||
+            x->length > ((uint64_t)BTP_PAGESIZE << x->lg))) {
+            if (msgs != NULL)
+                ccn_charbuf_putf(msgs, "Bad nodemap entry for node %u. ", i);
+            errno = EINVAL;
+            return(-1);
+        }
+    }
+    md->io->maxnodeid = (n > 0) ? n - 1 : 0;
+    /* Everything between the runs in use is free */
+    v = calloc(n + 1, sizeof(v[0]));
+    if (v == NULL)
+        return(-1);
+    for (i = 1, nused = 0; i < n; i++)
+        if (md->map[i].page != 0)
+            v[nused++] = &md->map[i];
+    if (md->maprun.page != 0)
+        v[nused++] = &md->maprun;
+    qsort(v, nused, sizeof(v[0]), &btp_extent_compare);
+    for (i = 0, page = 1; i < nused; i++) {
+        if (v[i]->page < page) {
+            if (msgs != NULL)
+                ccn_charbuf_putf(msgs, "Overlapping nodemap entries. ");
+            errno = EINVAL;
+            goto Bail;
+        }
+        btp_free_gap(md, page, v[i]->page);
+        page = v[i]->page + ((uint64_t)1 << v[i]->lg);
+    }
+    /* The tail of the last run need not have been written */
+    if (md->npages < page)
+        md->npages = page;
+    btp_free_gap(md, page, md->npages);
+    ans = 0;
+Bail:
+    free(v);
+    return(ans);
+}
+
+/**
+ * Checksum for a commit record (64-bit FNV-1a)
+ */
+static uint64_t
+btp_slot_sum(const unsigned char *p)
+{
+    uint64_t h = 14695981039346656037ULL;
+    int i;
+    
+    for (i = 0; i < BTP_SLOTSIZE - 8; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return(h);
+}
+
+/**
+ * Pick out the latest good commit record from the header.
+ *
+ * If there is none, the store is empty.
+ */
+static void
+btp_load_commit(struct btp_data *md, const unsigned char *hdr)
+{
+    const unsigned char *p = NULL;
+    const unsigned char *best = NULL;
+    uint64_t gen;
+    int i;
+    
+    for (i = 0; i < 2; i++) {
+        p = hdr + BTP_SLOT(i);
+        if (btp_getval(p + BTP_SLOTSIZE - 8, 8) != btp_slot_sum(p))
+            continue;
+        gen = btp_getval(p, 8);
+        if (best == NULL || gen > md->gen) {
+            best = p;
+            md->gen = gen;
+        }
+    }
+    if (best == NULL)
+        return;
+    md->maprun.page = btp_getval(best + 8, 8);
+    md->maprun.length = btp_getval(best + 16, 4);
+    md->maprun.lg = best[20];
+    md->io->mark = btp_getval(best + 24, 8);
+}
+
+/**
+ * Find the generation of the latest good commit record now on disk.
+ * @returns the generation (0 if there is none), or -1 for an error.
+ */
+static int64_t
+btp_peek_gen(struct btp_data *md)
+{
+    unsigned char slots[BTP_SLOT(1) + BTP_SLOTSIZE];
+    const unsigned char *p = NULL;
+    uint64_t best = 0;
+    uint64_t gen;
+    ssize_t sres;
+    int i;
+    
+    sres = pread(md->pfd, slots, sizeof(slots), 0);
+    if (sres != sizeof(slots))
+        return(-1);
+    for (i = 0; i < 2; i++) {
+        p = slots + BTP_SLOT(i);
+        if (btp_getval(p + BTP_SLOTSIZE - 8, 8) != btp_slot_sum(p))
+            continue;
+        gen = btp_getval(p, 8);
+        if (gen > best)
+            best = gen;
+    }
+    return(best);
+}
+
+/**
+ * Check that what a reader has just read cannot have been overwritten,
+ * that is, the writer has not committed twice since the reader's commit.
+ * @returns 0 if all is well, or -1 with errno set.
+ */
+static int
+btp_check_gen(struct btp_data *md)
+{
+    int64_t gen;
+    
+    gen = btp_peek_gen(md);
+    if (gen < 0) {
+        errno = EIO;
+        return(-1);
+    }
+    if ((uint64_t)gen > md->gen + 1) {
+        errno = ESTALE;
+        return(-1);
+    }
+    return(0);
+}
+
+/**
+ * Open one of the files of a page store, creating it if create is set.
+ */
+static int
+btp_open_file(struct btp_data *md, const char *name, int create)
+{
+    struct ccn_charbuf *temp = NULL;
+    int fd = -1;
+    
+    temp = ccn_charbuf_create();
+    if (temp == NULL)
+        return(-1);
+    ccn_charbuf_append_charbuf(temp, md->dirpath);
+    ccn_charbuf_putf(temp, "/%s", name);
+    if (md->readonly)
+        fd = open(ccn_charbuf_as_string(temp), O_RDONLY);
+    else
+        fd = open(ccn_charbuf_as_string(temp),
+                  create ? (O_RDWR | O_CREAT) : O_RDWR, 0640);
+    ccn_charbuf_destroy(&temp);
+    if (fd != -1)
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return(fd);
+}
+
+/**
+ * Load the node map of the latest commit, for a reader.
+ *
+ * If changed is not NULL, the nodeids whose runs differ from those in
+ * the map being replaced are appended to it.  A node that keeps its run
+ * from one commit to the next cannot have been written in between, but
+ * across more than one commit a run may have been freed and reused, so
+ * then every nodeid is appended.
+ * @returns 1 if a newer commit was loaded, 0 if there was none, or -1
+ *          with errno set, in which case the old map is still in place.
+ */
+static int
+btp_reload(struct btp_data *md, struct ccn_indexbuf *changed,
+           struct ccn_charbuf *msgs)
+{
+    unsigned char hdr[BTP_SLOT(1) + BTP_SLOTSIZE];
+    struct ccn_btree_io *io = md->io;
+    struct btp_extent *old = md->map;
+    struct btp_extent none = {0};
+    struct btp_extent maprun = md->maprun;
+    const struct btp_extent *x = NULL;
+    const struct btp_extent *y = NULL;
+    ccn_btnodeid oldmax = io->maxnodeid;
+    uintmax_t mark = io->mark;
+    uint64_t gen = md->gen;
+    unsigned nold = md->nmap;
+    unsigned n;
+    unsigned i;
+    ssize_t sres;
+    int res;
+    
+    sres = pread(md->pfd, hdr, sizeof(hdr), 0);
+    if (sres != sizeof(hdr)) {
+        if (sres >= 0)
+            errno = EIO;
+        return(-1);
+    }
+    btp_load_commit(md, hdr);
+    if (old != NULL && md->gen == gen)
+        return(0);
+    md->map = NULL;
+    md->nmap = 0;
+    res = btp_load_map(md, md->pfd, (off_t)md->maprun.page * BTP_PAGESIZE,
+                       md->maprun.length / BTP_RECSIZE, msgs);
+    /* Readers never allocate */
+    for (i = 0; i < BTP_NCLASS; i++)
+        ccn_indexbuf_destroy(&md->free[i]);
+    if (res == 0)
+        res = btp_check_gen(md);
+    if (res < 0) {
+        res = errno;
+        free(md->map);
+        md->map = old;
+        md->nmap = nold;
+        md->maprun = maprun;
+        md->gen = gen;
+        io->maxnodeid = oldmax;
+        io->mark = mark;
+        errno = res;
+        return(-1);
+    }
+    n = (io->maxnodeid > oldmax) ? io->maxnodeid : oldmax;
+    for (i = 1; changed != NULL && old != NULL && i <= n; i++) {
+        x = (i < nold) ? &old[i] : &none;
+        y = (i < md->nmap) ? &md->map[i] : &none;
+        if (md->gen != gen + 1 || x->page != y->page ||
+            x->length != y->length || x->lg != y->lg)
+            ccn_indexbuf_append_element(changed, i);
+    }
+    free(old);
+    return(1);
+}
+
+/**
+ * Set up a page store, for writing or (if readonly is set) for reading
+ * what another process has committed.
+ */
+static struct ccn_btree_io *
+btp_create(const char *path, struct ccn_charbuf *msgs, int readonly)
+{
+    DIR *d = NULL;
+    struct btp_data *md = NULL;
+    struct ccn_btree_io *ans = NULL;
+    struct ccn_btree_io *tans = NULL;
+    unsigned char hdr[BTP_PAGESIZE];
+    struct stat statbuf;
+    ssize_t sres;
+    int locked = 0;
+    int res;
+    int i;
+    
+    /* Make sure we were handed a directory */
+    d = opendir(path);
+    if (d == NULL)
+        goto Bail; /* errno per opendir */
+    closedir(d);
+    d = NULL;
+    
+    /* Allocate private data area */
+    md = calloc(1, sizeof(*md));
+    if (md == NULL)
+        goto Bail; /* errno per calloc */
+    md->lfd = md->pfd = md->mfd = -1;
+    md->readonly = readonly;
+    md->dirpath = ccn_charbuf_create();
+    if (md->dirpath == NULL) goto Bail; /* errno per calloc */
+    res = ccn_charbuf_putf(md->dirpath, "%s", path);
+    if (res < 0) goto Bail; /* errno per calloc or snprintf */
+    tans = calloc(1, sizeof(*tans));
+    if (tans == NULL) goto Bail; /* errno per calloc */
+    md->io = tans;
+    
+    if (readonly) {
+        md->pfd = btp_open_file(md, "pages", 0);
+        if (md->pfd == -1) goto Bail; /* errno per open */
+        sres = pread(md->pfd, hdr, sizeof(hdr), 0);
+        if (sres != sizeof(hdr) || btp_getval(hdr + 8, 4) != BTP_PAGESIZE ||
+            memcmp(hdr, BTP_MAGIC, 8) != 0) {
+            if (msgs != NULL)
+                ccn_charbuf_append_string(msgs, "Not a committed page store. ");
+            errno = EINVAL;
+            goto Bail;
+        }
+        /* The writer may commit twice while we load; if so, go again */
+        for (i = 0, res = -1; i < 3 && res < 0; i++)
+            res = btp_reload(md, NULL, msgs);
+        if (res < 0) goto Bail;
+        goto Ready;
+    }
+    res = bts_lock(md->dirpath, &md->lfd, msgs);
+    if (res < 0) goto Bail;
+    locked = 1;
+    md->pfd = btp_open_file(md, "pages", 1);
+    if (md->pfd == -1) goto Bail; /* errno per open */
+    
+    /* Check the header, writing one if the file is new */
+    if (fstat(md->pfd, &statbuf) == -1)
+        goto Bail;
+    memset(hdr, 0, sizeof(hdr));
+    if (statbuf.st_size == 0) {
+        memcpy(hdr, BTP_MAGIC, 8);
+        btp_putval(hdr + 8, 4, BTP_PAGESIZE);
+        sres = pwrite(md->pfd, hdr, sizeof(hdr), 0);
+        if (sres != sizeof(hdr))
+            goto Bail;
+        statbuf.st_size = sizeof(hdr);
+    }
+    else {
+        sres = pread(md->pfd, hdr, sizeof(hdr), 0);
+        if (sres != sizeof(hdr) || btp_getval(hdr + 8, 4) != BTP_PAGESIZE ||
+            (memcmp(hdr, BTP_MAGIC, 8) != 0 &&
+             memcmp(hdr, BTP_MAGIC1, 8) != 0)) {
+            if (msgs != NULL)
+                ccn_charbuf_append_string(msgs, "Bad pages file header. ");
+            errno = EINVAL;
+            goto Bail;
+        }
+    }
+    md->npages = (statbuf.st_size + BTP_PAGESIZE - 1) / BTP_PAGESIZE;
+    if (memcmp(hdr, BTP_MAGIC1, 8) == 0) {
+        md->mfd = btp_open_file(md, "nodemap", 0);
+        if (md->mfd == -1) goto Bail; /* errno per open */
+        if (fstat(md->mfd, &statbuf) == -1)
+            goto Bail;
+        res = btp_load_map(md, md->mfd, 0, statbuf.st_size / BTP_RECSIZE, msgs);
+        md->changed = 1;
+    }
+    else {
+        btp_load_commit(md, hdr);
+        res = btp_load_map(md, md->pfd,
+                           (off_t)md->maprun.page * BTP_PAGESIZE,
+                           md->maprun.length / BTP_RECSIZE, msgs);
+    }
+    if (res < 0) goto Bail;
+    
+Ready:
+    /* Everything looks good. */
+    ans = tans;
+    tans = NULL;
+    res = md->dirpath->length;
+    if (res >= sizeof(ans->clue))
+        res = sizeof(ans->clue) - 1;
+    memcpy(ans->clue, md->dirpath->buf + md->dirpath->length - res, res);
+    ans->btopen = &btp_open;
+    ans->btread = &btp_read;
+    ans->btwrite = &btp_write;
+    ans->btclose = &btp_close;
+    ans->btdestroy = &btp_destroy;
+    if (readonly)
+        ans->btrefresh = &btp_refresh;
+    else
+        ans->btcommit = &btp_commit;
+    ans->openfds = 0;
+    ans->data = md;
+    md = NULL;
+Bail:
+    if (tans != NULL) free(tans);
+    if (md != NULL) {
+        res = errno;
+        if (locked)
+            bts_remove_lockfile_path(md->dirpath, &md->lfd);
+        else if (md->lfd >= 0)
+            close(md->lfd);
+        if (md->pfd != -1) close(md->pfd);
+        if (md->mfd != -1) close(md->mfd);
+        for (i = 0; i < BTP_NCLASS; i++)
+            ccn_indexbuf_destroy(&md->free[i]);
+        ccn_indexbuf_destroy(&md->pending);
+        ccn_indexbuf_destroy(&md->retired);
+        free(md->map);
+        ccn_charbuf_destroy(&md->dirpath);
+        free(md);
+        errno = res;
+    }
+    return(ans);
+}
+
+/**
+ * Create a btree storage layer, keeping the nodes in a single file
+ * within a directory.
+ *
+ * Unlike ccn_btree_io_from_directory, this does not need a file (or a
+ * file descriptor) per node, so the number of open nodes is not limited
+ * by CCN_BT_OPEN_NODES_LIMIT.  The same lock file is used, so the two
+ * kinds of store may not be open on the same directory at once.
+ *
+ * Writes become durable with the next btcommit (or when the store is
+ * destroyed); the mark given with the last commit is in io->mark.
+ *
+ * If msgs is not NULL, diagnostics may be recorded there.
+ *
+ * @param path is the name of the directory, which must exist.
+ * @returns the new ccn_btree_io handle, or sets errno and returns NULL.
+ */
+struct ccn_btree_io *
+ccn_btree_io_from_pagefile(const char *path, struct ccn_charbuf *msgs)
+{
+    return(btp_create(path, msgs, 0));
+}
+
+/**
+ * Open a page store that another process writes, for reading only.
+ *
+ * No lock is taken, and nothing is ever written.  The store is seen as
+ * of the writer's latest commit, and io->mark is the writer's mark;
+ * btrefresh (see ccn_btree_refresh) moves on to a later commit.  Nodes
+ * that have been changed in memory cannot be closed.
+ *
+ * @param path is the name of the directory, which must hold a store
+ *        written since commits were introduced.
+ * @returns the new ccn_btree_io handle, or sets errno and returns NULL.
+ */
+struct ccn_btree_io *
+ccn_btree_io_from_pagefile_readonly(const char *path, struct ccn_charbuf *msgs)
+{
+    return(btp_create(path, msgs, 1));
+}
+
+static int
+btp_open(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct btp_data *md = io->data;
+    
+    if (node->iodata != NULL || io != md->io) abort();
+    if (btp_map_reserve(md, node->nodeid) < 0)
+        return(-1);
+    if (node->nodeid > io->maxnodeid && !md->readonly) {
+        /* The node map grows, so that maxnodeid is remembered */
+        io->maxnodeid = node->nodeid;
+        md->changed = 1;
+    }
+    /* There is no per-node state beyond the map entry */
+    node->iodata = md;
+    return(0);
+}
+
+static int
+btp_read(struct ccn_btree_io *io, struct ccn_btree_node *node, unsigned limit)
+{
+    struct btp_data *md = io->data;
+    struct btp_extent *x = NULL;
+    unsigned char *p = NULL;
+    ssize_t sres;
+    unsigned clean = 0;
+    
+    if (node->iodata != md || node->nodeid >= md->nmap) abort();
+    x = &md->map[node->nodeid];
+    if (x->length < limit)
+        limit = x->length;
+    if (node->clean > 0 && node->clean <= node->buf->length)
+        clean = node->clean;
+    if (clean > limit)
+        clean = limit;
+    node->buf->length = clean;  /* we know clean <= node->buf->length */
+    if (limit == clean)
+        return(0);
+    p = ccn_charbuf_reserve(node->buf, limit - clean);
+    if (p == NULL)
+        return(-1);
+    sres = pread(md->pfd, p, limit - clean,
+                 (off_t)x->page * BTP_PAGESIZE + clean);
+    if (sres < 0)
+        return(-1);
+    if (md->readonly) {
+        /* The writer may have reused the run under us */
+        if (btp_check_gen(md) < 0)
+            return(-1);
+        if (sres != limit - clean) {
+            errno = EIO;
+            return(-1);
+        }
+    }
+    if (sres != limit - clean)
+        abort(); // XXX - really should not happen unless someone else modified file
+    node->buf->length += sres;
+    return(0);
+}
+
+static int
+btp_write(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct btp_data *md = io->data;
+    struct btp_extent *x = NULL;
+    struct btp_extent old;
+    size_t length = node->buf->length;
+    size_t clean = 0;
+    uint64_t npages;
+    ssize_t sres;
+    int lg;
+    
+    if (node->iodata != md || node->nodeid >= md->nmap) abort();
+    if (md->readonly) {
+        if (node->clean == length)
+            return(0);
+        errno = EROFS;
+        return(-1);
+    }
+    x = &md->map[node->nodeid];
+    if (node->clean == length && x->length == length)
+        return(0); /* Nothing has changed */
+    old = *x;
+    npages = (length + BTP_PAGESIZE - 1) / BTP_PAGESIZE;
+    for (lg = 0; ((uint64_t)1 << lg) < npages; lg++)
+        continue;
+    if (lg >= BTP_NCLASS) {
+        errno = EFBIG;
+        return(-1);
+    }
+    if (x->page != 0 && lg <= x->lg && (x->fresh || length == 0)) {
+        /* Fits where it is, and the last commit does not need it */
+        if (node->clean > 0 && node->clean <= length && node->clean <= x->length)
+            clean = node->clean;
+    }
+    else if (length > 0) {
+        x->page = btp_alloc_run(md, lg);
+        x->lg = lg;
+        x->fresh = 1;
+    }
+    if (length > clean) {
+        sres = pwrite(md->pfd, node->buf->buf + clean, length - clean,
+                      (off_t)x->page * BTP_PAGESIZE + clean);
+        if (sres != length - clean) {
+            if (x->page != old.page)
+                btp_free_run(md, x->page, x->lg);
+            *x = old;
+            if (sres >= 0)
+                errno = EIO;
+            return(-1);
+        }
+    }
+    if (x->page == old.page && x->length == length)
+        return(0);
+    x->length = length;
+    md->changed = 1;
+    if (old.page != x->page && btp_release_run(md, &old) < 0)
+        return(-1);
+    return(0);
+}
+
+/**
+ * Make what has been written so far the store's committed state.
+ *
+ * The whole node map goes to a new run, and after a sync, the commit
+ * record in the other header slot is pointed at it and synced in turn.
+ * Only then are the runs given up before the last commit reused; those
+ * given up since wait for the next one, as readers may still be using
+ * them.
+ */
+static int
+btp_commit(struct ccn_btree_io *io, uintmax_t mark)
+{
+    struct btp_data *md = io->data;
+    struct btp_extent run = {0};
+    unsigned char slot[BTP_SLOTSIZE] = {0};
+    unsigned char *buf = NULL;
+    struct ccn_indexbuf *retired = NULL;
+    struct ccn_charbuf *temp = NULL;
+    uint64_t npages;
+    ssize_t sres;
+    unsigned n;
+    unsigned i;
+    int ans = -1;
+    
+    if (md->io != io) abort();
+    if (!md->changed && mark == io->mark)
+        return(0);
+    n = io->maxnodeid + 1;
+    if (btp_map_reserve(md, io->maxnodeid) < 0)
+        return(-1);
+    buf = calloc(n, BTP_RECSIZE);
+    if (buf == NULL)
+        return(-1);
+    for (i = 1; i < n; i++) {
+        btp_putval(buf + i * BTP_RECSIZE, 8, md->map[i].page);
+        btp_putval(buf + i * BTP_RECSIZE + 8, 4, md->map[i].length);
+        buf[i * BTP_RECSIZE + 12] = md->map[i].lg;
+    }
+    run.length = n * BTP_RECSIZE;
+    npages = (run.length + BTP_PAGESIZE - 1) / BTP_PAGESIZE;
+    for (run.lg = 0; ((uint64_t)1 << run.lg) < npages; run.lg++)
+        continue;
+    if (run.lg >= BTP_NCLASS) {
+        errno = EFBIG;
+        goto Bail;
+    }
+    run.page = btp_alloc_run(md, run.lg);
+    sres = pwrite(md->pfd, buf, run.length, (off_t)run.page * BTP_PAGESIZE);
+    if (sres != run.length || fsync(md->pfd) != 0)
+        goto Bail;
+    btp_putval(slot, 8, md->gen + 1);
+    btp_putval(slot + 8, 8, run.page);
+    btp_putval(slot + 16, 4, run.length);
+    slot[20] = run.lg;
+    btp_putval(slot + 24, 8, mark);
+    btp_putval(slot + BTP_SLOTSIZE - 8, 8, btp_slot_sum(slot));
+    sres = pwrite(md->pfd, slot, sizeof(slot), BTP_SLOT((md->gen + 1) & 1));
+    if (sres != sizeof(slot) || fsync(md->pfd) != 0)
+        goto Bail;
+    if (md->mfd != -1) {
+        /* Converting an old store; the map is in the pages file now */
+        sres = pwrite(md->pfd, BTP_MAGIC, 8, 0);
+        if (sres != 8 || fsync(md->pfd) != 0)
+            goto Bail;
+        close(md->mfd);
+        md->mfd = -1;
+        temp = ccn_charbuf_create();
+        if (temp != NULL) {
+            ccn_charbuf_append_charbuf(temp, md->dirpath);
+            ccn_charbuf_putf(temp, "/nodemap");
+            unlink(ccn_charbuf_as_string(temp));
+            ccn_charbuf_destroy(&temp);
+        }
+    }
+    /* Committed */
+    md->gen++;
+    io->mark = mark;
+    md->changed = 0;
+    retired = md->retired;
+    md->retired = md->pending;
+    md->pending = NULL;
+    if (md->maprun.page != 0) {
+        if (md->retired == NULL)
+            md->retired = ccn_indexbuf_create();
+        if (md->retired != NULL &&
+            ccn_indexbuf_append_element(md->retired, md->maprun.page) == 0)
+            ccn_indexbuf_append_element(md->retired, md->maprun.lg);
+    }
+    md->maprun = run;
+    run.page = 0;
+    for (i = 0; retired != NULL && i + 1 < retired->n; i += 2)
+        btp_free_run(md, retired->buf[i], retired->buf[i + 1]);
+    for (i = 1; i < n; i++)
+        md->map[i].fresh = 0;
+    ans = 0;
+Bail:
+    if (run.page != 0)
+        btp_free_run(md, run.page, run.lg);
+    ccn_indexbuf_destroy(&retired);
+    free(buf);
+    return(ans);
+}
+
+/**
+ * Catch up with the writer's latest commit, for a reader.
+ */
+static int
+btp_refresh(struct ccn_btree_io *io, struct ccn_indexbuf *changed)
+{
+    struct btp_data *md = io->data;
+    
+    if (md->io != io || !md->readonly) abort();
+    return(btp_reload(md, changed, NULL));
+}
+
+static int
+btp_close(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    if (node->iodata != io->data)
+        return(-1);
+    node->iodata = NULL;
+    return(0);
+}
+
+/**
+ *  Commit, remove the lock file, close the files, and free up resources.
+ *  A reader has only the files to close and the resources to free.
+ *  @returns -1 if there were errors (but it cleans up what it can).
+ */
+static int
+btp_destroy(struct ccn_btree_io **pio)
+{
+    int res = 0;
+    int i;
+    struct btp_data *md = NULL;
+
+    if (*pio == NULL)
+        return(0);
+    if ((*pio)->btdestroy != &btp_destroy)
+        abort(); /* serious caller bug */
+    md = (*pio)->data;
+    if (md->io != *pio) abort();
+    /* Keep what was written since the last commit */
+    if (!md->readonly && btp_commit(*pio, (*pio)->mark) < 0)
+        res = -1;
+    if (close(md->pfd) == -1)
+        res = -1;
+    if (md->mfd != -1 && close(md->mfd) == -1)
+        res = -1;
+    if (!md->readonly &&
+        bts_remove_lockfile_path(md->dirpath, &md->lfd) < 0)
+        res = -1;
+    for (i = 0; i < BTP_NCLASS; i++)
+        ccn_indexbuf_destroy(&md->free[i]);
+    ccn_indexbuf_destroy(&md->pending);
+    ccn_indexbuf_destroy(&md->retired);
+    free(md->map);
+    ccn_charbuf_destroy(&md->dirpath);
+    free(md);
+    (*pio)->data = NULL;
+    free(*pio);
+    *pio = NULL;
+    return(res);
+}
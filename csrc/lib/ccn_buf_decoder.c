@@ -32,13 +32,114 @@ ccn_buf_decoder_start(struct ccn_buf_decoder *d,
     d->decoder.state |= CCN_DSTATE_PAUSE;
     d->buf = buf;
     d->size = size;
-    ccn_skeleton_decode(&d->decoder, buf, size);
+    ccn_buf_advance(d);
     return(d);
 }
 
+/**
+ * Step over one token without going through the general state machine
+ *
+ * Handles the usual case for ccn_buf_advance: the decoder is paused
+ * between tokens, or just after a BLOB or UDATA token whose data lies
+ * within the buffer, and the next token is a DTAG, BLOB, UDATA, or
+ * CLOSE that is complete in the buffer.  The decoder is left in exactly
+ * the state ccn_skeleton_decode would have produced.  The parsers in this
+ * file call ccn_buf_advance once per token, so this is a hot spot.
+ *
+ * @returns 0 if the token was consumed, or -1 if the general decoder
+ *          must be used instead (in which case nothing has changed).
+ */
+static int
+ccn_buf_advance_fast(struct ccn_buf_decoder *d)
+{
+    const size_t limit = (~(size_t)0U) >> (7 + CCN_TT_BITS);
+    const unsigned char *p = d->buf;
+    size_t n = d->size;
+    size_t i = d->decoder.index;
+    size_t numval = d->decoder.numval;
+    size_t token_index;
+    int state = d->decoder.state;
+    int nest = d->decoder.nest;
+    int tagstate;
+    unsigned char c;
+    int tt;
+    
+    /* The bits above the pause bit hold the tag state, then the token type */
+    if (state < 0 || (state & CCN_DSTATE_PAUSE) == 0)
+        return(-1);
+    tagstate = (state >> 8) & 3;
+    if (tagstate > 1)
+        return(-1);
+    switch (state & 0xFF) {
+        case CCN_DSTATE_INITIAL:
+        case CCN_DSTATE_NEWTOKEN:
+            break;
+        case CCN_DSTATE_BLOB:
+        case CCN_DSTATE_UDATA:
+            if (i > n || numval > n - i)
+                return(-1);
+            i += numval;
+            numval = 0;
+            break;
+        default:
+            return(-1);
+    }
+    if (i >= n)
+        return(-1);
+    token_index = i;
+    if (p[i] == CCN_CLOSE) {
+        if (nest <= 0)
+            return(-1);
+        i++;
+        nest -= 1;
+        tagstate = 0;
+        state = (nest == 0) ? CCN_DSTATE_INITIAL : CCN_DSTATE_NEWTOKEN;
+        tt = CCN_NO_TOKEN;
+    }
+    else {
+        for (numval = 0; (p[i] & CCN_TT_HBIT) == CCN_CLOSE;) {
+            if (numval > limit)
+                return(-1);
+            numval = (numval << 7) + p[i];
+            if (++i == n)
+                return(-1);
+        }
+        c = p[i++];
+        numval = (numval << (7-CCN_TT_BITS)) +
+                 ((c >> CCN_TT_BITS) & CCN_MAX_TINY);
+        tt = c & CCN_TT_MASK;
+        switch (tt) {
+            case CCN_DTAG:
+                nest += 1;
+                d->decoder.element_index = token_index;
+                tagstate = 1;
+                state = CCN_DSTATE_NEWTOKEN;
+                break;
+            case CCN_BLOB:
+                tagstate = 0;
+                state = (numval == 0) ? CCN_DSTATE_NEWTOKEN : CCN_DSTATE_BLOB;
+                break;
+            case CCN_UDATA:
+                tagstate = 0;
+                state = (numval == 0) ? CCN_DSTATE_NEWTOKEN : CCN_DSTATE_UDATA;
+                break;
+            default:
+                return(-1);
+        }
+    }
+    d->decoder.state = state | CCN_DSTATE_PAUSE | (tagstate << 8) | (tt << 16);
+    d->decoder.nest = nest;
+    d->decoder.numval = numval;
+    d->decoder.token_index = token_index;
+    d->decoder.index = i;
+    return(0);
+}
+
 void
 ccn_buf_advance(struct ccn_buf_decoder *d)
 {
+    if (ccn_buf_advance_fast(d) == 0)
+        return;
     ccn_skeleton_decode(&d->decoder,
                         d->buf + d->decoder.index,
                         d->size - d->decoder.index);
@@ -810,6 +911,7 @@ ccn_parse_ContentObject(const unsigned char *msg, size_t size,
     int res;
     x->magic = 20090415;
     x->digest_bytes = 0;
+    x->partial = 0;
     if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject)) {
         ccn_buf_advance(d);
         res = ccn_parse_Signature(d, x);
@@ -835,6 +937,149 @@ ccn_parse_ContentObject(const unsigned char *msg, size_t size,
     return(0);
 }
 
+/**
+ * Step over the element at the current position without looking inside
+ *
+ * The whole element is scanned by the skeleton decoder in one call,
+ * rather than token by token as in ccn_buf_advance_past_element, and
+ * the decoder is left at the token that follows it.
+ */
+static void
+ccn_buf_skip_element(struct ccn_buf_decoder *d)
+{
+    struct ccn_skeleton_decoder sd = {0};
+    size_t start = d->decoder.token_index;
+    ssize_t n;
+    
+    if (!ccn_buf_match_some_dtag(d)) {
+        d->decoder.state = -__LINE__;
+        return;
+    }
+    n = ccn_skeleton_decode(&sd, d->buf + start, d->size - start);
+    if (n <= 0 || sd.state != 0) {
+        d->decoder.state = -__LINE__;
+        return;
+    }
+    d->decoder.index = start + n;
+    d->decoder.nest -= 1;
+    d->decoder.state = CCN_DSTATE_NEWTOKEN | CCN_DSTATE_PAUSE;
+    ccn_buf_advance(d);
+}
+
+/**
+ * Parse just the framing and Name of a ContentObject
+ *
+ * This is the first stage of ccn_parse_ContentObject.  The Signature and
+ * SignedInfo are stepped over; their own offsets are recorded, but not
+ * those of anything inside them, and x->type is not set.  Callers that
+ * may need those call ccn_parse_ContentObject_finish, which picks up
+ * where this left off.  The Content is located as usual.
+ *
+ * This is for callers such as ccnd that often discard an object on the
+ * strength of its name alone, as a duplicate or as unsolicited.
+ * @returns 0, or a negative value for an error.
+ */
+int
+ccn_parse_ContentObject_name(const unsigned char *msg, size_t size,
+                             struct ccn_parsed_ContentObject *x,
+                             struct ccn_indexbuf *components)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, msg, size);
+    int res;
+    x->magic = 20090415;
+    x->digest_bytes = 0;
+    x->partial = 1;
+    if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject)) {
+        ccn_buf_advance(d);
+        x->offset[CCN_PCO_B_Signature] = d->decoder.token_index;
+        if (ccn_buf_match_dtag(d, CCN_DTAG_Signature))
+            ccn_buf_skip_element(d);
+        x->offset[CCN_PCO_E_Signature] = d->decoder.token_index;
+        x->offset[CCN_PCO_B_Name] = d->decoder.token_index;
+        x->offset[CCN_PCO_B_Component0] = d->decoder.index;
+        res = ccn_parse_Name(d, components);
+        if (res < 0)
+            d->decoder.state = -__LINE__;
+        x->name_ncomps = res;
+        x->offset[CCN_PCO_E_ComponentLast] = d->decoder.token_index - 1;
+        x->offset[CCN_PCO_E_Name] = d->decoder.token_index;
+        x->offset[CCN_PCO_B_SignedInfo] = d->decoder.token_index;
+        if (ccn_buf_match_dtag(d, CCN_DTAG_SignedInfo))
+            ccn_buf_skip_element(d);
+        else
+            d->decoder.state = -__LINE__;
+        x->offset[CCN_PCO_E_SignedInfo] = d->decoder.token_index;
+        x->offset[CCN_PCO_B_Content] = d->decoder.token_index;
+        ccn_parse_required_tagged_BLOB(d, CCN_DTAG_Content, 0, -1);
+        x->offset[CCN_PCO_E_Content] = d->decoder.token_index;
+        ccn_buf_check_close(d);
+        x->offset[CCN_PCO_E] = d->decoder.index;
+    }
+    else
+        d->decoder.state = -__LINE__;
+    if (d->decoder.index != size || !CCN_FINAL_DSTATE(d->decoder.state))
+        return (CCN_DSTATE_ERR_CODING);
+    return(0);
+}
+
+/**
+ * Start a decoder partway into a ContentObject
+ *
+ * The decoder sees the whole message, so offsets come out the same as
+ * for a parse from the top, but begins with the token at start, at the
+ * nesting level of the children of the ContentObject.
+ */
+static struct ccn_buf_decoder *
+ccn_buf_decoder_start_in_ContentObject(struct ccn_buf_decoder *d,
+                                       const unsigned char *msg, size_t size,
+                                       size_t start)
+{
+    memset(&d->decoder, 0, sizeof(d->decoder));
+    d->decoder.state = CCN_DSTATE_NEWTOKEN | CCN_DSTATE_PAUSE;
+    d->decoder.index = start;
+    d->decoder.nest = 1;
+    d->buf = msg;
+    d->size = size;
+    ccn_buf_advance(d);
+    return(d);
+}
+
+/**
+ * Complete a parse begun by ccn_parse_ContentObject_name
+ *
+ * Parses the Signature and SignedInfo, filling in the rest of *x just as
+ * ccn_parse_ContentObject would have.  A computed digest is kept.
+ * Calling this again, or after a full parse, does nothing.
+ * @returns 0, or a negative value for an error.
+ */
+int
+ccn_parse_ContentObject_finish(const unsigned char *msg, size_t size,
+                               struct ccn_parsed_ContentObject *x)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    size_t e_signature = x->offset[CCN_PCO_E_Signature];
+    size_t e_signedinfo = x->offset[CCN_PCO_E_SignedInfo];
+    
+    if (!x->partial)
+        return(0);
+    if (size < x->offset[CCN_PCO_E])
+        return(-1);
+    d = ccn_buf_decoder_start_in_ContentObject(&decoder, msg, size,
+                                               x->offset[CCN_PCO_B_Signature]);
+    ccn_parse_Signature(d, x);
+    if (d->decoder.state < 0 || d->decoder.token_index != e_signature)
+        return(CCN_DSTATE_ERR_CODING);
+    d = ccn_buf_decoder_start_in_ContentObject(&decoder, msg, size,
+                                               x->offset[CCN_PCO_B_SignedInfo]);
+    ccn_parse_SignedInfo(d, x);
+    if (d->decoder.state < 0 || d->decoder.token_index != e_signedinfo)
+        return(CCN_DSTATE_ERR_CODING);
+    x->partial = 0;
+    return(0);
+}
+
 int
 ccn_ref_tagged_BLOB(enum ccn_dtag tt,
                     const unsigned char *buf, size_t start, size_t stop,
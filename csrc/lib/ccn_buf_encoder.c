@@ -218,6 +218,350 @@ ccn_encode_ContentObject(struct ccn_charbuf *buf,
     return(res == 0 ? 0 : -1);
 }
 
+/**
+ * Encode a ContentObject with a signature that needs no public key.
+ *
+ * With a NULL key the signature is a bare SHA-256 digest, otherwise
+ * an HMAC-SHA256 under the key; see CCN_SP_DIGEST_ONLY and CCN_SP_HMAC.
+ * Either costs about as much as hashing the object once.
+ * @param buf is the output buffer where encoded object is written.
+ * @param Name, SignedInfo, data and size are as for ccn_encode_ContentObject.
+ * @param key is the shared secret, or NULL for a digest only.
+ * @param keysize is the size of the key, in bytes.
+ * @returns 0 for success or -1 for error.
+ */
+int
+ccn_encode_ContentObject_symmetric(struct ccn_charbuf *buf,
+                                   const struct ccn_charbuf *Name,
+                                   const struct ccn_charbuf *SignedInfo,
+                                   const void *data,
+                                   size_t size,
+                                   const void *key,
+                                   size_t keysize)
+{
+    unsigned char signature[CCN_SYMMETRIC_SIGNATURE_SIZE];
+    struct ccn_charbuf *signed_part = NULL;
+    int sigsize;
+    int res = 0;
+    
+    signed_part = ccn_charbuf_create();
+    if (signed_part == NULL)
+        return(-1);
+    res |= ccn_charbuf_append_charbuf(signed_part, Name);
+    res |= ccn_charbuf_append_charbuf(signed_part, SignedInfo);
+    res |= ccnb_append_tagged_blob(signed_part, CCN_DTAG_Content, data, size);
+    if (res == 0) {
+        sigsize = ccn_symmetric_sign(key, keysize, signed_part->buf,
+                                     signed_part->length, signature);
+        if (sigsize < 0)
+            res = -1;
+    }
+    if (res == 0) {
+        res |= ccn_charbuf_append_tt(buf, CCN_DTAG_ContentObject, CCN_DTAG);
+        res |= ccn_encode_Signature(buf, key == NULL ?
+                                    CCN_SIGNING_DIGEST_ONLY_ALGORITHM :
+                                    CCN_SIGNING_HMAC_SHA256_ALGORITHM,
+                                    NULL, 0,
+                                    (const struct ccn_signature *)signature,
+                                    sigsize);
+        res |= ccn_charbuf_append_charbuf(buf, signed_part);
+        res |= ccn_charbuf_append_closer(buf);
+    }
+    ccn_charbuf_destroy(&signed_part);
+    return(res == 0 ? 0 : -1);
+}
+
+/**
+ * Encode and sign a batch of ContentObjects with a single signature.
+ *
+ * The signature is over the root of a Merkle hash tree of the objects
+ * (see ccn_merkle_sign), and each object carries a Witness with its path
+ * to that root, so it can still be verified by itself.  This costs one
+ * private key operation for the whole batch, rather than one per object.
+ * A batch of one is encoded as by ccn_encode_ContentObject.
+ * @param bufs are the n output buffers where the objects are written.
+ * @param Names, SignedInfos, data and sizes give the n objects, as for
+ *        ccn_encode_ContentObject.
+ * @param digest_algorithm may be NULL for default.
+ * @param private_key is the private key to use for signing.
+ * @returns 0 for success or -1 for error.
+ */
+int
+ccn_encode_ContentObjects(struct ccn_charbuf **bufs, int n,
+                          const struct ccn_charbuf **Names,
+                          const struct ccn_charbuf **SignedInfos,
+                          const void **data,
+                          const size_t *sizes,
+                          const char *digest_algorithm,
+                          const struct ccn_pkey *private_key)
+{
+    struct ccn_charbuf **parts = NULL;
+    struct ccn_charbuf **witnesses = NULL;
+    struct ccn_signature *signature = NULL;
+    size_t signature_size = 0;
+    int res = 0;
+    int i;
+
+    if (n < 1)
+        return(-1);
+    if (n == 1)
+        return(ccn_encode_ContentObject(bufs[0], Names[0], SignedInfos[0],
+                                        data[0], sizes[0],
+                                        digest_algorithm, private_key));
+    parts = calloc(n, sizeof(parts[0]));
+    witnesses = calloc(n, sizeof(witnesses[0]));
+    signature = calloc(1, ccn_pubkey_size(private_key));
+    if (parts == NULL || witnesses == NULL || signature == NULL)
+        res = -1;
+    for (i = 0; i < n && res == 0; i++) {
+        parts[i] = ccn_charbuf_create();
+        witnesses[i] = ccn_charbuf_create();
+        res |= ccn_charbuf_append_charbuf(parts[i], Names[i]);
+        res |= ccn_charbuf_append_charbuf(parts[i], SignedInfos[i]);
+        res |= ccnb_append_tagged_blob(parts[i], CCN_DTAG_Content,
+                                       data[i], sizes[i]);
+    }
+    if (res == 0)
+        res = ccn_merkle_sign(n, parts, witnesses, digest_algorithm,
+                              private_key, signature, &signature_size);
+    for (i = 0; i < n && res == 0; i++) {
+        res |= ccn_charbuf_append_tt(bufs[i], CCN_DTAG_ContentObject, CCN_DTAG);
+        res |= ccn_encode_Signature(bufs[i], digest_algorithm,
+                                    witnesses[i]->buf, witnesses[i]->length,
+                                    signature, signature_size);
+        res |= ccn_charbuf_append_charbuf(bufs[i], parts[i]);
+        res |= ccn_charbuf_append_closer(bufs[i]);
+    }
+    for (i = 0; i < n; i++) {
+        if (parts != NULL)
+            ccn_charbuf_destroy(&parts[i]);
+        if (witnesses != NULL)
+            ccn_charbuf_destroy(&witnesses[i]);
+    }
+    free(parts);
+    free(witnesses);
+    free(signature);
+    return(res == 0 ? 0 : -1);
+}
+
+/**
+ * The invariant pieces of a ContentObject encoding.
+ *
+ * In wire order, an object is co_head, the signature bits, Name,
+ * si_head, the timestamp, si_mid, any FinalBlockID, si_tail, and the
+ * Content.  The signature covers everything from the Name through the
+ * Content, which are contiguous in the result, so the builder writes
+ * those straight into the caller's buffer and signs them in place.
+ */
+struct ccn_content_builder {
+    struct ccn_charbuf *co_head; /**< through the SignatureBits start tag */
+    struct ccn_charbuf *si_head; /**< through the Timestamp start tag */
+    struct ccn_charbuf *si_mid;  /**< Timestamp closer through Freshness */
+    struct ccn_charbuf *si_tail; /**< KeyLocator and SignedInfo closer */
+    char *digest_algorithm;
+    const struct ccn_pkey *private_key;
+};
+
+/**
+ * Create a builder for ContentObjects that share their SignedInfo.
+ *
+ * The arguments are as for ccn_signed_info_create and
+ * ccn_encode_ContentObject.
+ * @returns the new builder, or NULL for error.
+ */
+struct ccn_content_builder *
+ccn_content_builder_create(const void *publisher_key_id,
+                           size_t publisher_key_id_size,
+                           enum ccn_content_type type,
+                           int freshness,
+                           const struct ccn_charbuf *key_locator,
+                           const char *digest_algorithm,
+                           const struct ccn_pkey *private_key)
+{
+    struct ccn_content_builder *b;
+    struct ccn_charbuf *c;
+    const char fakepubkeyid[32] = {0};
+    int res = 0;
+
+    if (publisher_key_id != NULL && publisher_key_id_size != 32)
+        return(NULL);
+    if (private_key == NULL)
+        return(NULL);
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+        return(NULL);
+    b->private_key = private_key;
+    b->co_head = c = ccn_charbuf_create();
+    if (c == NULL)
+        goto Bail;
+    res |= ccn_charbuf_append_tt(c, CCN_DTAG_ContentObject, CCN_DTAG);
+    res |= ccn_charbuf_append_tt(c, CCN_DTAG_Signature, CCN_DTAG);
+    if (digest_algorithm != NULL) {
+        b->digest_algorithm = strdup(digest_algorithm);
+        if (b->digest_algorithm == NULL)
+            goto Bail;
+        res |= ccn_charbuf_append_tt(c, CCN_DTAG_DigestAlgorithm, CCN_DTAG);
+        res |= ccn_charbuf_append_tt(c, strlen(digest_algorithm), CCN_UDATA);
+        res |= ccn_charbuf_append_string(c, digest_algorithm);
+        res |= ccn_charbuf_append_closer(c);
+    }
+    res |= ccn_charbuf_append_tt(c, CCN_DTAG_SignatureBits, CCN_DTAG);
+    b->si_head = c = ccn_charbuf_create();
+    if (c == NULL)
+        goto Bail;
+    if (publisher_key_id == NULL) {
+        publisher_key_id = fakepubkeyid;
+        publisher_key_id_size = sizeof(fakepubkeyid);
+    }
+    res |= ccn_charbuf_append_tt(c, CCN_DTAG_SignedInfo, CCN_DTAG);
+    res |= ccnb_append_tagged_blob(c, CCN_DTAG_PublisherPublicKeyDigest,
+                                   publisher_key_id, publisher_key_id_size);
+    res |= ccn_charbuf_append_tt(c, CCN_DTAG_Timestamp, CCN_DTAG);
+    b->si_mid = c = ccn_charbuf_create();
+    if (c == NULL)
+        goto Bail;
+    res |= ccn_charbuf_append_closer(c);
+    if (type != CCN_CONTENT_DATA) {
+        res |= ccn_charbuf_append_tt(c, CCN_DTAG_Type, CCN_DTAG);
+        res |= ccn_charbuf_append_tt(c, 3, CCN_BLOB);
+        res |= ccn_charbuf_append_value(c, type, 3);
+        res |= ccn_charbuf_append_closer(c);
+    }
+    if (freshness >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_FreshnessSeconds, "%d", freshness);
+    b->si_tail = c = ccn_charbuf_create();
+    if (c == NULL)
+        goto Bail;
+    if (key_locator != NULL)
+        res |= ccn_charbuf_append_charbuf(c, key_locator);
+    res |= ccn_charbuf_append_closer(c);
+    if (res == 0)
+        return(b);
+Bail:
+    ccn_content_builder_destroy(&b);
+    return(NULL);
+}
+
+void
+ccn_content_builder_destroy(struct ccn_content_builder **bp)
+{
+    struct ccn_content_builder *b = *bp;
+
+    if (b == NULL)
+        return;
+    ccn_charbuf_destroy(&b->co_head);
+    ccn_charbuf_destroy(&b->si_head);
+    ccn_charbuf_destroy(&b->si_mid);
+    ccn_charbuf_destroy(&b->si_tail);
+    free(b->digest_algorithm);
+    free(b);
+    *bp = NULL;
+}
+
+/**
+ * Encode and sign one ContentObject using a builder.
+ *
+ * Room for the largest possible signature is left ahead of the Name,
+ * and the object is shifted down afterwards in the (unusual) case
+ * that the signature turns out to be shorter.
+ * @param b is the builder.
+ * @param buf is the output buffer, to which the encoded object is appended.
+ * @param Name is the ccnb-encoded name.
+ * @param timestamp holds the timestamp, as a ccnb-encoded blob, or is NULL
+ *        to use the current time.
+ * @param finalblockid holds the FinalBlockID, as a ccnb-encoded blob, or is
+ *        NULL to omit.
+ * @param data points to the raw data to be encoded.
+ * @param size is the size, in bytes, of the raw data to be encoded.
+ * @returns 0 for success or -1 for error.
+ */
+int
+ccn_content_builder_encode(struct ccn_content_builder *b,
+                           struct ccn_charbuf *buf,
+                           const struct ccn_charbuf *Name,
+                           const struct ccn_charbuf *timestamp,
+                           const struct ccn_charbuf *finalblockid,
+                           const void *data,
+                           size_t size)
+{
+    struct {
+        struct ccn_charbuf c;
+        unsigned char space[16];
+    } tt;
+    struct ccn_sigc *sig_ctx = NULL;
+    unsigned char *sig = NULL;
+    unsigned char *p = NULL;
+    size_t start = buf->length;
+    size_t slot;
+    size_t slot_size;
+    size_t body;
+    size_t sig_max;
+    size_t sig_size = 0;
+    size_t used;
+    int res = 0;
+
+    ccn_charbuf_init_inline(&tt.c, sizeof(tt.space));
+    sig_max = ccn_sigc_signature_max_size(NULL, b->private_key);
+    res |= ccn_charbuf_append_tt(&tt.c, sig_max, CCN_BLOB);
+    res |= ccn_charbuf_append_charbuf(buf, b->co_head);
+    slot = buf->length;
+    slot_size = tt.c.length + sig_max + 2;
+    if (res != 0 || ccn_charbuf_reserve(buf, slot_size) == NULL)
+        goto Bail;
+    buf->length += slot_size;
+    body = buf->length;
+    res |= ccn_charbuf_append_charbuf(buf, Name);
+    res |= ccn_charbuf_append_charbuf(buf, b->si_head);
+    if (timestamp != NULL)
+        res |= ccn_charbuf_append_charbuf(buf, timestamp);
+    else
+        res |= ccnb_append_now_blob(buf, CCN_MARKER_NONE);
+    res |= ccn_charbuf_append_charbuf(buf, b->si_mid);
+    if (finalblockid != NULL) {
+        res |= ccn_charbuf_append_tt(buf, CCN_DTAG_FinalBlockID, CCN_DTAG);
+        res |= ccn_charbuf_append_charbuf(buf, finalblockid);
+        res |= ccn_charbuf_append_closer(buf);
+    }
+    res |= ccn_charbuf_append_charbuf(buf, b->si_tail);
+    res |= ccnb_append_tagged_blob(buf, CCN_DTAG_Content, data, size);
+    if (res != 0)
+        goto Bail;
+    /* Sign into the spare room past the end, then move it into the slot */
+    sig_ctx = ccn_sigc_create();
+    if (sig_ctx == NULL ||
+        ccn_sigc_init(sig_ctx, b->digest_algorithm, b->private_key) != 0 ||
+        ccn_sigc_update(sig_ctx, buf->buf + body, buf->length - body) != 0 ||
+        ccn_charbuf_reserve(buf, sig_max + 1) == NULL)
+        goto Bail;
+    sig = buf->buf + buf->length;
+    if (ccn_sigc_final(sig_ctx, (struct ccn_signature *)sig, &sig_size,
+                       b->private_key) != 0 || sig_size > sig_max)
+        goto Bail;
+    ccn_sigc_destroy(&sig_ctx);
+    tt.c.length = 0;
+    ccn_charbuf_append_tt(&tt.c, sig_size, CCN_BLOB);
+    p = buf->buf + slot;
+    memcpy(p, tt.c.buf, tt.c.length);
+    p += tt.c.length;
+    memcpy(p, sig, sig_size);
+    p += sig_size;
+    *p++ = 0; /* </SignatureBits> */
+    *p++ = 0; /* </Signature> */
+    used = p - (buf->buf + slot);
+    if (used < slot_size) {
+        memmove(p, buf->buf + body, buf->length - body);
+        buf->length -= slot_size - used;
+    }
+    ccn_charbuf_fini(&tt.c);
+    return(ccn_charbuf_append_closer(buf));
+Bail:
+    if (sig_ctx != NULL)
+        ccn_sigc_destroy(&sig_ctx);
+    ccn_charbuf_fini(&tt.c);
+    buf->length = start;
+    return(-1);
+}
+
 /***********************************
  * Append a StatusResponse
  * 
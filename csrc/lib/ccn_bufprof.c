@@ -0,0 +1,118 @@
+/**
+ * @file ccn_bufprof.c
+ * @brief Allocation profiling for charbufs and indexbufs.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/bufprof.h>
+
+/*
+ * The sites are kept in a fixed open-addressed table, so that counting
+ * never allocates.  A site is known by the address of its __FILE__
+ * string together with its line.
+ */
+#define BUFPROF_SITES 1024
+
+static struct ccn_bufprof_site bufprof_sites[BUFPROF_SITES];
+static int bufprof_n;
+
+struct ccn_bufprof_site *
+ccn_bufprof_site(const char *file, int line, enum ccn_bufprof_kind kind)
+{
+    struct ccn_bufprof_site *s;
+    unsigned i;
+
+    i = ((uintptr_t)file >> 3) * 31 + line * 2654435761U;
+    for (;; i++) {
+        s = &bufprof_sites[i % BUFPROF_SITES];
+        if (s->file == file && s->line == line && s->kind == kind)
+            return(s);
+        if (s->file == NULL)
+            break;
+    }
+    /* Keep a few empty slots, so that the search above ends */
+    if (bufprof_n >= BUFPROF_SITES - 8)
+        return(NULL);
+    bufprof_n++;
+    s->file = file;
+    s->line = line;
+    s->kind = kind;
+    return(s);
+}
+
+void
+ccn_bufprof_alloc(struct ccn_bufprof_site *s, size_t bytes, int grow)
+{
+    if (s == NULL)
+        return;
+    if (grow)
+        s->grows++;
+    else
+        s->creates++;
+    s->bytes += bytes;
+}
+
+static int
+bufprof_compare(const void *a, const void *b)
+{
+    const struct ccn_bufprof_site *x = a;
+    const struct ccn_bufprof_site *y = b;
+
+    if (x->creates != y->creates)
+        return(x->creates < y->creates ? 1 : -1);
+    if (x->bytes != y->bytes)
+        return(x->bytes < y->bytes ? 1 : -1);
+    return(0);
+}
+
+int
+ccn_bufprof_snapshot(struct ccn_bufprof_site *out, int max)
+{
+    struct ccn_bufprof_site *all;
+    int i, n;
+
+    if (max <= 0 || bufprof_n == 0)
+        return(0);
+    all = malloc(bufprof_n * sizeof(*all));
+    if (all == NULL)
+        return(0);
+    for (i = 0, n = 0; i < BUFPROF_SITES && n < bufprof_n; i++)
+        if (bufprof_sites[i].file != NULL &&
+            (bufprof_sites[i].creates != 0 || bufprof_sites[i].grows != 0))
+            all[n++] = bufprof_sites[i];
+    qsort(all, n, sizeof(*all), &bufprof_compare);
+    if (n > max)
+        n = max;
+    memcpy(out, all, n * sizeof(*all));
+    free(all);
+    return(n);
+}
+
+void
+ccn_bufprof_reset(void)
+{
+    int i;
+
+    for (i = 0; i < BUFPROF_SITES; i++) {
+        bufprof_sites[i].creates = 0;
+        bufprof_sites[i].grows = 0;
+        bufprof_sites[i].bytes = 0;
+    }
+}
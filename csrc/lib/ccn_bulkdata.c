@@ -1,10 +1,10 @@
 /**
  * @file ccn_bulkdata.c
- * @brief (INCOMPLETE)Support for transport of bulk data.
- * 
+ * @brief Support for transport of bulk data.
+ *
  * Part of the CCNx C Library.
  *
- * Copyright (C) 2008, 2009 Palo Alto Research Center, Inc.
+ * Copyright (C) 2008, 2009, 2012 Palo Alto Research Center, Inc.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License version 2.1
@@ -21,33 +21,22 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
-#include <ccn/bloom.h>
+#include <ccn/bulkdata.h>
 #include <ccn/ccn.h>
+#include <ccn/ccn_private.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+#include <ccn/schedule.h>
+#include <ccn/window.h>
 
-/************ Candidate API stuff - was in ccn/ccn.h for a while ******/
-/***********************************
- * Bulk data
- */
-
-/*
- * The client provides a ccn_seqfunc * (and perhaps a matching param)
- * to specify the scheme for naming the content items in the sequence.
- * Given the sequence number x, it should place in resultbuf the
- * corresponding blob that that will be used in the final explicit
- * Component of the Name of item x in the sequence.  This should
- * act as a mathematical function, returning the same answer for a given x.
- * (Usually param will be NULL, but is provided in case it is needed.)
- */
-typedef void ccn_seqfunc(uintmax_t x, void *param,
-                         struct ccn_charbuf *resultbuf);
-
-/*
- * Ready-to-use sequencing functions
- */
-extern ccn_seqfunc ccn_decimal_seqfunc;
-extern ccn_seqfunc ccn_binary_seqfunc;
-/**********************************************************************/
+#define CCN_BULKDATA_WINDOW 64          /* default max_window */
+#define CCN_BULKDATA_WINDOW_LIMIT 4096
+#define CCN_BULKDATA_INITIAL_WINDOW 2
+#define CCN_BULKDATA_TIMEOUT_MS 15000   /* default timeout_ms */
+#define CCN_BULKDATA_HOLE_THRESHOLD 3
+#define CCN_BULKDATA_CHECK_MIN 10000    /* microseconds between checks */
 
 /*
  * Encode the number in decimal ascii
@@ -71,7 +60,7 @@ ccn_binary_seqfunc(uintmax_t x, void *param, struct ccn_charbuf *resultbuf)
     int n;
     unsigned char *b;
     (void)param; /* unused */
-    for (n = 0, m = 0; x < m; n++)
+    for (n = 0, m = 0; x > m; n++)
         m = (m << 8) | 0xff;
     b = ccn_charbuf_reserve(resultbuf, n + 1);
     resultbuf->length = n + 1;
@@ -79,187 +68,584 @@ ccn_binary_seqfunc(uintmax_t x, void *param, struct ccn_charbuf *resultbuf)
         b[n] = x & 0xff;
 }
 
+/*
+ * Encode the number as a segment number: the CCN_MARKER_SEQNUM byte,
+ * followed by the value in big-endian binary with no leading zeros.
+ */
+void
+ccn_segment_seqfunc(uintmax_t x, void *param, struct ccn_charbuf *resultbuf)
+{
+    uintmax_t m;
+    int n;
+    unsigned char *b;
+    (void)param; /* unused */
+    for (n = 0, m = x; m != 0; n++)
+        m >>= 8;
+    b = ccn_charbuf_reserve(resultbuf, n + 1);
+    resultbuf->length = n + 1;
+    b[0] = CCN_MARKER_SEQNUM;
+    for (; n > 0; n--, x >>= 8)
+        b[n] = x & 0xff;
+}
+
+/**
+ * One expressed interest.
+ *
+ * When an item is asked for again, its old request is orphaned (b set
+ * to NULL) rather than cancelled; the library still holds the closure
+ * and frees it by way of the FINAL upcall.
+ */
+struct bulk_req {
+    struct ccn_closure closure;
+    struct ccn_bulkdata *b;         /**< NULL once orphaned */
+    uintmax_t x;                    /**< sequence number asked for */
+    uint64_t sent;                  /**< when the interest went out */
+    int retries;                    /**< times the item was asked for again */
+    int holes;                      /**< later items that arrived first */
+};
+
+/**
+ * An entry of the reassembly window, for item x at index x % nslots.
+ */
+struct bulk_slot {
+    struct bulk_req *req;           /**< interest in flight, if any */
+    struct ccn_slice *slice;        /**< answer held for delivery */
+    unsigned char *copy;            /**< or a copy, if it could not be kept */
+    size_t size;
+    enum ccn_upcall_kind kind;      /**< how the held answer arrived */
+};
+
 /*
  * Our private record of the state of the bulk data reception
  */
-struct bulkdata {
+struct ccn_bulkdata {
+    struct ccn *h;
     ccn_seqfunc *seqfunc;           /* the sequence number scheme */
     void *seqfunc_param;            /* parameters thereto, if needed */
-    struct pending *first;          /* start of list of pending items */
     struct ccn_closure *client;     /* client-supplied upcall for delivery */
+    struct ccn_compiled_interest *ci; /* the prefix and template, encoded */
+    struct ccn_charbuf *comp;       /* scratch for the seqfunc */
+    struct ccn_window win;
+    struct bulk_slot *slot;         /* the reassembly window */
+    int nslots;
+    int in_flight;
+    int status;                     /* as for ccn_bulkdata_status */
     uintmax_t next_expected;        /* smallest undelivered sequence number */
-    struct ccn_charbuf *name_prefix;
-    int prefix_comps;
-    /* pubid, etc? */
+    uintmax_t next_ask;             /* smallest number not yet asked for */
+    uintmax_t final;                /* last item, UINTMAX_MAX until known */
+    intmax_t timeout;               /* microseconds without progress */
+    uint64_t progress;              /* time of the last delivery */
+    struct ccn_scheduled_event *ev; /* the retransmission timer */
+    struct ccn_bulkdata_stats stats;
 };
 
-struct pending {
-    struct pending *prev;           /* links for doubly-linked list */
-    struct pending *next;
-    struct bulkdata *parent;
-    uintmax_t x;                    /* sequence number for this item */
-    struct ccn_closure closure;     /* our closure for getting matching data */
-    unsigned char *content_ccnb;    /* the content that has arrived */
-    size_t content_size;
-};
+static enum ccn_upcall_res
+incoming_bulkdata(struct ccn_closure *selfp,
+                  enum ccn_upcall_kind kind,
+                  struct ccn_upcall_info *info);
+
+static struct bulk_slot *
+slot_for(struct ccn_bulkdata *b, uintmax_t x)
+{
+    return(&b->slot[x % b->nslots]);
+}
+
+/**
+ * Forget the interest in flight for a slot, if any.
+ */
+static void
+orphan_req(struct ccn_bulkdata *b, struct bulk_slot *s)
+{
+    if (s->req != NULL) {
+        s->req->b = NULL;
+        s->req = NULL;
+        b->in_flight--;
+    }
+}
+
+static void
+drop_held(struct bulk_slot *s)
+{
+    ccn_slice_release(&s->slice);
+    free(s->copy);
+    s->copy = NULL;
+    s->size = 0;
+}
+
+static int
+is_held(struct bulk_slot *s)
+{
+    return(s->slice != NULL || s->copy != NULL);
+}
+
+/**
+ * Express the interest for item x.
+ * @returns 0, or -1 if the interest could not be expressed.
+ */
+static int
+express_bulkdata_interest(struct ccn_bulkdata *b, uintmax_t x, int retries)
+{
+    struct bulk_slot *s = slot_for(b, x);
+    struct bulk_req *req = NULL;
+    int res;
+
+    req = calloc(1, sizeof(*req));
+    if (req == NULL)
+        return(-1);
+    req->closure.p = &incoming_bulkdata;
+    req->closure.data = req;
+    req->b = b;
+    req->x = x;
+    req->retries = retries;
+    req->sent = ccn_window_now();
+    b->comp->length = 0;
+    (*b->seqfunc)(x, b->seqfunc_param, b->comp);
+    res = ccn_express_compiled_interest(b->h, b->ci, b->comp->buf,
+                                        b->comp->length, &req->closure);
+    if (res < 0) {
+        /* The library did not take it, so there will be no FINAL */
+        free(req);
+        return(-1);
+    }
+    orphan_req(b, s);
+    s->req = req;
+    b->in_flight++;
+    b->stats.interests++;
+    return(0);
+}
+
+/**
+ * Ask for the items that fit, in order, up to the congestion window.
+ */
+static void
+fill_window(struct ccn_bulkdata *b)
+{
+    uintmax_t x;
+
+    if (b->status != 0)
+        return;
+    while (b->in_flight < (int)b->win.cwnd &&
+           b->next_ask - b->next_expected < (uintmax_t)b->nslots &&
+           b->next_ask <= b->final) {
+        x = b->next_ask;
+        if (slot_for(b, x)->req == NULL &&
+            express_bulkdata_interest(b, x, 0) < 0)
+            break;
+        b->next_ask++;
+    }
+}
+
+static void
+cancel_timer(struct ccn_bulkdata *b)
+{
+    struct ccn_scheduled_event *ev = b->ev;
+
+    b->ev = NULL;
+    if (ev != NULL)
+        ccn_schedule_cancel(ccn_get_schedule(b->h), ev);
+}
+
+/**
+ * Stop the transfer, leaving the outcome in status.
+ */
+static void
+finish(struct ccn_bulkdata *b, int status)
+{
+    int i;
+
+    if (b->status != 0)
+        return;
+    b->status = status;
+    for (i = 0; i < b->nslots; i++) {
+        orphan_req(b, &b->slot[i]);
+        drop_held(&b->slot[i]);
+    }
+    cancel_timer(b);
+    ccn_set_run_timeout(b->h, 0);
+}
+
+/**
+ * Hand one item to the client, and advance.
+ * @returns 0, or -1 if the client refused it.
+ */
+static int
+deliver(struct ccn_bulkdata *b, enum ccn_upcall_kind kind,
+        struct ccn_upcall_info *info)
+{
+    enum ccn_upcall_res ans;
 
-static enum ccn_upcall_res deliver_content(struct ccn *h, struct bulkdata *b);
-static void express_bulkdata_interest(struct ccn *h, struct pending *b);
-// XXX - missing a way to create a struct bulkdata *
-// XXX - missing code to create new pendings
+    ans = (*b->client->p)(b->client, kind, info);
+    if (ans != CCN_UPCALL_RESULT_OK)
+        return(-1);
+    b->next_expected++;
+    b->stats.delivered++;
+    b->progress = ccn_window_now();
+    return(0);
+}
 
+/**
+ * deliver_held is used to deliver a previously-buffered
+ * ContentObject to the client.
+ */
+static int
+deliver_held(struct ccn_bulkdata *b, struct bulk_slot *s)
+{
+    struct ccn_upcall_info info = {0};
+    struct ccn_parsed_ContentObject obj = {0};
+    const unsigned char *ccnb;
+    int res;
 
-/*static*/ enum ccn_upcall_res
-imcoming_bulkdata(struct ccn_closure *selfp,
+    ccnb = (s->slice != NULL) ? ccn_slice_buf(s->slice) : s->copy;
+    info.h = b->h;
+    info.pco = &obj;
+    info.content_comps = ccn_indexbuf_create();
+    res = ccn_parse_ContentObject(ccnb, s->size, &obj, info.content_comps);
+    if (res >= 0) {
+        info.content_ccnb = ccnb;
+        info.matched_comps = info.content_comps->n - 2;
+        /* There is no matched interest to present */
+        res = deliver(b, s->kind, &info);
+    }
+    ccn_indexbuf_destroy(&info.content_comps);
+    drop_held(s);
+    return(res);
+}
+
+/**
+ * An answer for later items arrived ahead of the earlier ones.
+ *
+ * Some reordering is normal, so an item is asked for again only after
+ * several later ones have overtaken it, and more than a round trip
+ * has passed.
+ */
+static void
+check_holes(struct ccn_bulkdata *b, uintmax_t x, uint64_t sent, uint64_t now)
+{
+    intmax_t slack = b->win.srtt + b->win.srtt / 4;
+    struct bulk_slot *s = NULL;
+    uintmax_t y;
+    int lost = 0;
+
+    for (y = b->next_expected; y < x; y++) {
+        s = slot_for(b, y);
+        if (s->req == NULL || s->req->sent > sent)
+            continue;
+        s->req->holes++;
+        if (s->req->holes >= CCN_BULKDATA_HOLE_THRESHOLD &&
+            (intmax_t)(now - s->req->sent) > slack &&
+            express_bulkdata_interest(b, y, s->req->retries + 1) == 0) {
+            b->stats.holes++;
+            lost++;
+        }
+    }
+    if (lost > 0)
+        ccn_window_close(&b->win, now, 0);
+}
+
+static enum ccn_upcall_res
+incoming_bulkdata(struct ccn_closure *selfp,
                   enum ccn_upcall_kind kind,
                   struct ccn_upcall_info *info)
 {
-    struct bulkdata *b;
-    struct pending *p = selfp->data;
-    enum ccn_upcall_res res = CCN_UPCALL_RESULT_ERR;
+    struct bulk_req *req = selfp->data;
+    struct ccn_bulkdata *b = req->b;
+    struct bulk_slot *s = NULL;
+    uintmax_t x = req->x;
+    uint64_t now;
+    uintmax_t y;
 
-    assert(selfp == &p->closure);
-    b = p->parent;
-    
+    assert(selfp == &req->closure);
+    if (kind == CCN_UPCALL_FINAL) {
+        if (b != NULL)
+            orphan_req(b, slot_for(b, x));
+        free(req);
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    if (b == NULL)
+        return(CCN_UPCALL_RESULT_OK);
     switch (kind) {
-        case CCN_UPCALL_FINAL:
-            p->prev->next = p->next->prev;
-            p->next->prev = p->prev->next;
-            if (b != NULL && p == b->first)
-                b->first = (p == p->next) ? NULL : p->next;
-            if (p->content_ccnb != NULL)
-                free(p->content_ccnb);
-            free(p);
-            return(CCN_UPCALL_RESULT_OK);
-	case CCN_UPCALL_CONTENT:
-    	case CCN_UPCALL_CONTENT_UNVERIFIED:
-	case CCN_UPCALL_CONTENT_BAD:
-            /* XXX - should we be returning bad (signature failed) content */
-            break;
         case CCN_UPCALL_INTEREST_TIMED_OUT:
-            /* XXX - may want to give client a chance to decide */ 
+            /* The timer normally gets there first */
+            now = ccn_window_now();
+            req->sent = now;
+            req->retries++;
+            b->stats.timeouts++;
+            ccn_window_close(&b->win, now, 1);
             return(CCN_UPCALL_RESULT_REEXPRESS);
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+            return(CCN_UPCALL_RESULT_VERIFY);
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+            return(CCN_UPCALL_RESULT_FETCHKEY);
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_RAW:
+            break;
         default:
-            return(CCN_UPCALL_RESULT_ERR);
+            /* Bad content is left for the timer to ask for again */
+            return(CCN_UPCALL_RESULT_OK);
     }
-    /* XXX - check to see if seq comp matches, if not we have a hole to fill */
-    
-    if (p->content_ccnb == NULL) {
-    if (p->x == b->next_expected) {
-        /* Good, we have in-order data to deliver to the caller */
-        res = (*b->client->p)(b->client, kind, info);
-        if (res == CCN_UPCALL_RESULT_OK) {
-            b->next_expected += 1;
-            b->first = (p == p->next) ? NULL : p->next;
-            p->prev->next = p->next->prev;
-            p->next->prev = p->prev->next;
-            p->next = p->prev = p;
-            p->parent = NULL;
+    b->stats.received++;
+    now = ccn_window_now();
+    if (req->retries == 0)
+        ccn_window_note_rtt(&b->win, now - req->sent);
+    ccn_window_open(&b->win, now);
+    s = slot_for(b, x);
+    orphan_req(b, s);
+    if (ccn_is_final_block(info) && x < b->final) {
+        b->final = x;
+        /* Nothing past the end will answer */
+        for (y = x + 1; y < b->next_ask; y++)
+            orphan_req(b, slot_for(b, y));
+    }
+    check_holes(b, x, req->sent, now);
+    if (x == b->next_expected) {
+        if (deliver(b, kind, info) < 0) {
+            finish(b, -1);
+            return(CCN_UPCALL_RESULT_OK);
+        }
+        for (s = slot_for(b, b->next_expected);
+             is_held(s) && b->next_expected <= b->final;
+             s = slot_for(b, b->next_expected)) {
+            if (deliver_held(b, s) < 0) {
+                finish(b, -1);
+                return(CCN_UPCALL_RESULT_OK);
+            }
         }
-        // else ...
     }
-    else if (p->content_ccnb == NULL) {
-        /* Out-of-order data, save it for later */
-        size_t size = info->pco->offset[CCN_PCO_E];
-        selfp->refcount++; /* don't call FINAL just yet */
-        p->content_ccnb = malloc(size);
-        memcpy(p->content_ccnb, info->content_ccnb, size);
-        p->content_size = size;
+    else if (!is_held(s)) {
+        /* Out-of-order data, keep it for later */
+        s->size = info->pco->offset[CCN_PCO_E];
+        s->kind = kind;
+        s->slice = ccn_slice_retain(info->h, info->content_ccnb, s->size);
+        if (s->slice == NULL) {
+            s->copy = malloc(s->size);
+            if (s->copy == NULL) {
+                s->size = 0;
+                return(CCN_UPCALL_RESULT_OK);
+            }
+            memcpy(s->copy, info->content_ccnb, s->size);
+        }
+        b->stats.held++;
     }
+    if (b->next_expected > b->final)
+        finish(b, 1);
+    else
+        fill_window(b);
+    return(CCN_UPCALL_RESULT_OK);
+}
+
+/**
+ * The retransmission timer.
+ *
+ * Asks again for the items that have been out for longer than the
+ * retransmission timeout, and gives up if nothing has been delivered
+ * for too long.
+ */
+static int
+check_bulkdata(struct ccn_schedule *sched,
+               void *clienth,
+               struct ccn_scheduled_event *ev,
+               int flags)
+{
+    struct ccn_bulkdata *b = ev->evdata;
+    struct bulk_slot *s = NULL;
+    uint64_t now;
+    uintmax_t x;
+    int lost = 0;
+    int delay;
+
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0) {
+        b->ev = NULL;
+        return(0);
     }
-    while (b->first != NULL && b->first->x == b->next_expected &&
-           b->first->content_ccnb != NULL) {
-        res = deliver_content(info->h, b);
-        if (res != CCN_UPCALL_RESULT_OK)
-            break;
+    now = ccn_window_now();
+    for (x = b->next_expected; x < b->next_ask && x <= b->final; x++) {
+        s = slot_for(b, x);
+        if (s->req != NULL && (intmax_t)(now - s->req->sent) >= b->win.rto &&
+            express_bulkdata_interest(b, x, s->req->retries + 1) == 0) {
+            b->stats.timeouts++;
+            lost++;
+        }
     }
-    if (b->first == NULL) {
-        // XXX 
-        return(CCN_UPCALL_RESULT_OK);
+    if (lost > 0) {
+        ccn_window_backoff(&b->win);
+        ccn_window_close(&b->win, now, 1);
     }
-    for (p = b->first; p->x >= b->next_expected; p = p->next) {
-        // XXX - this is not really right ...
-        if (p->content_ccnb == NULL)
-            express_bulkdata_interest(info->h, p);
+    if ((intmax_t)(now - b->progress) >= b->timeout) {
+        b->ev = NULL;
+        finish(b, -1);
+        return(0);
     }
-    return(CCN_UPCALL_RESULT_OK);
+    fill_window(b);
+    delay = b->win.rto / 4;
+    if (delay < CCN_BULKDATA_CHECK_MIN)
+        delay = CCN_BULKDATA_CHECK_MIN;
+    return(delay);
 }
 
 static void
-express_bulkdata_interest(struct ccn *h, struct pending *p)
+gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
 {
-    int res;
-    struct bulkdata *b = NULL;
-    int prefix_comps = -1;
-    int addl_comps = -1;
-    struct ccn_charbuf *name = NULL;
-    struct ccn_charbuf *templ = NULL;
-    struct ccn_charbuf *seq = NULL;
-    
-    b = p->parent;
-    if (b == NULL)
-        return;
-    name = ccn_charbuf_create();
-    templ = ccn_charbuf_create();
-    seq = ccn_charbuf_create();
-
-    ccn_charbuf_append(name, b->name_prefix->buf, b->name_prefix->length);
-    
-    seq->length = 0;
-    (*b->seqfunc)(p->x, b->seqfunc_param, seq);
-    ccn_name_append(name, seq->buf, seq->length);
-    prefix_comps = -1;
-    addl_comps = 1;
-    
-    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
+    struct timeval now = {0};
+    gettimeofday(&now, 0);
+    result->s = now.tv_sec;
+    result->micros = now.tv_usec;
+}
 
+static struct ccn_gettime bulkdata_ticker = {
+    "bulk",
+    &gettime,
+    1000000,
+    NULL
+};
+
+/**
+ * The handle's schedule, which is made if there is none yet.
+ * It is destroyed along with the handle.
+ */
+static struct ccn_schedule *
+handle_schedule(struct ccn *h)
+{
+    struct ccn_schedule *sched = ccn_get_schedule(h);
+
+    if (sched == NULL) {
+        sched = ccn_schedule_create(h, &bulkdata_ticker);
+        ccn_set_schedule(h, sched);
+    }
+    return(sched);
+}
+
+static struct ccn_charbuf *
+make_template(int flags)
+{
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
     ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
     ccn_charbuf_append_closer(templ); /* </Name> */
-
-    // XXX - may want to set Min/MaxSuffixComponents
-    
+    ccn_charbuf_append_tt(templ, CCN_DTAG_MaxSuffixComponents, CCN_DTAG);
+    ccnb_append_number(templ, 1);
+    ccn_charbuf_append_closer(templ); /* </MaxSuffixComponents> */
+    if ((flags & CCN_BULKDATA_ALLOW_STALE) != 0) {
+        ccn_charbuf_append_tt(templ, CCN_DTAG_AnswerOriginKind, CCN_DTAG);
+        ccnb_append_number(templ, CCN_AOK_DEFAULT | CCN_AOK_STALE);
+        ccn_charbuf_append_closer(templ); /* </AnswerOriginKind> */
+    }
     ccn_charbuf_append_closer(templ); /* </Interest> */
-    res = ccn_express_interest(h, name, &p->closure, templ);
-    assert(res >= 0); // XXX - handle this better
+    return(templ);
+}
+
+struct ccn_bulkdata *
+ccn_bulkdata_create(struct ccn *h,
+                    const struct ccn_charbuf *prefix,
+                    const struct ccn_bulkdata_params *p,
+                    struct ccn_closure *client)
+{
+    static const struct ccn_bulkdata_params defaults = {0};
+    struct ccn_bulkdata *b = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_charbuf *templ = NULL;
+    struct ccn_schedule *sched = NULL;
+    int window;
+
+    if (h == NULL || prefix == NULL || client == NULL || client->p == NULL)
+        return(NULL);
+    if (p == NULL)
+        p = &defaults;
+    window = p->max_window;
+    if (window <= 0)
+        window = CCN_BULKDATA_WINDOW;
+    if (window > CCN_BULKDATA_WINDOW_LIMIT)
+        window = CCN_BULKDATA_WINDOW_LIMIT;
+    sched = handle_schedule(h);
+    b = calloc(1, sizeof(*b));
+    if (b == NULL || sched == NULL)
+        goto Bail;
+    b->h = h;
+    b->seqfunc = (p->seqfunc != NULL) ? p->seqfunc : &ccn_segment_seqfunc;
+    b->seqfunc_param = p->seqfunc_param;
+    b->client = client;
+    b->next_expected = b->next_ask = p->first;
+    b->final = UINTMAX_MAX;
+    b->timeout = 1000LL * ((p->timeout_ms > 0) ? p->timeout_ms
+                                               : CCN_BULKDATA_TIMEOUT_MS);
+    ccn_window_init(&b->win, ((p->flags & CCN_BULKDATA_CUBIC) != 0) ?
+                    CCN_WINDOW_CUBIC : CCN_WINDOW_AIMD,
+                    CCN_BULKDATA_INITIAL_WINDOW, window);
+    b->nslots = window;
+    b->slot = calloc(window, sizeof(b->slot[0]));
+    b->comp = ccn_charbuf_create();
+    name = ccn_charbuf_create();
+    if (b->slot == NULL || b->comp == NULL || name == NULL ||
+        ccn_charbuf_append_charbuf(name, prefix) < 0)
+        goto Bail;
+    templ = make_template(p->flags);
+    b->ci = ccn_compile_interest(name, templ);
     ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&templ);
-    ccn_charbuf_destroy(&seq);
+    if (b->ci == NULL)
+        goto Bail;
+    b->progress = ccn_window_now();
+    b->ev = ccn_schedule_event(sched, b->win.rto / 4, &check_bulkdata, b, 0);
+    if (b->ev == NULL)
+        goto Bail;
+    fill_window(b);
+    if (b->in_flight == 0)
+        goto Bail;
+    return(b);
+Bail:
+    ccn_charbuf_destroy(&name);
+    if (b != NULL) {
+        b->client = NULL;
+        ccn_bulkdata_destroy(&b);
+    }
+    return(NULL);
 }
 
-/*
- * deliver_content is used to deliver a previously-buffered
- * ContentObject to the client.
- */
-static enum ccn_upcall_res
-deliver_content(struct ccn *h, struct bulkdata *b)
+int
+ccn_bulkdata_status(struct ccn_bulkdata *b)
+{
+    return(b->status);
+}
+
+uintmax_t
+ccn_bulkdata_next(struct ccn_bulkdata *b)
+{
+    return(b->next_expected);
+}
+
+void
+ccn_bulkdata_get_stats(struct ccn_bulkdata *b,
+                       struct ccn_bulkdata_stats *stats)
 {
+    *stats = b->stats;
+    stats->cwnd = b->win.cwnd;
+    stats->srtt = b->win.srtt;
+}
+
+void
+ccn_bulkdata_destroy(struct ccn_bulkdata **bp)
+{
+    struct ccn_bulkdata *b = *bp;
+    struct ccn_closure *client = NULL;
     struct ccn_upcall_info info = {0};
-    struct ccn_parsed_ContentObject obj = {0};
-    struct pending *p = b->first;
-    int res;
-    enum ccn_upcall_res ans;
-    assert(p != NULL && p->x == b->next_expected && p->content_ccnb != NULL);
-    info.pco = &obj;
-    info.content_comps = ccn_indexbuf_create();
-    res = ccn_parse_ContentObject(p->content_ccnb, p->content_size,
-                                  &obj, info.content_comps);
-    assert(res >= 0);
-    info.content_ccnb = p->content_ccnb;
-    info.matched_comps = info.content_comps->n - 2;
-    /* XXX - we have no matched interest to present */
-    ans = (*b->client->p)(b->client, CCN_UPCALL_CONTENT, &info);
-    // XXX - check for refusal
-    info.content_ccnb = NULL;
-    free(p->content_ccnb);
-    p->content_ccnb = NULL;
-    p->content_size = 0;
-    ccn_indexbuf_destroy(&info.content_comps);
-    if (ans == CCN_UPCALL_RESULT_OK) {
-        struct ccn_closure *old = &p->closure;
-        if ((--(old->refcount)) == 0) {
-            info.pco = NULL;
-            (old->p)(old, CCN_UPCALL_FINAL, &info);
+    int i;
+
+    if (b == NULL)
+        return;
+    *bp = NULL;
+    if (b->slot != NULL) {
+        for (i = 0; i < b->nslots; i++) {
+            orphan_req(b, &b->slot[i]);
+            drop_held(&b->slot[i]);
         }
+        free(b->slot);
+    }
+    cancel_timer(b);
+    ccn_compiled_interest_destroy(&b->ci);
+    ccn_charbuf_destroy(&b->comp);
+    client = b->client;
+    if (client != NULL) {
+        info.h = b->h;
+        (client->p)(client, CCN_UPCALL_FINAL, &info);
     }
-    return(ans);
+    free(b);
 }
@@ -24,11 +24,30 @@
 #include <sys/time.h>
 #include <ccn/charbuf.h>
 
+#ifdef CCN_BUF_PROFILE
+#undef ccn_charbuf_create
+#undef ccn_charbuf_create_n
+#endif
+
+/*
+ * A charbuf from ccn_charbuf_create comes with CCN_CHARBUF_INLINE bytes of
+ * storage right after the struct, in the same allocation, so that small
+ * buffers never need a second malloc.  The buffer is using that storage
+ * exactly when c->buf == CHARBUF_INLINE_SPACE(c); for a charbuf set up by
+ * ccn_charbuf_init_inline, the storage is the space that follows it in
+ * the caller's struct.
+ */
+#define CHARBUF_INLINE_SPACE(c) ((unsigned char *)((c) + 1))
+
 struct ccn_charbuf *
 ccn_charbuf_create(void)
 {
     struct ccn_charbuf *c;
-    c = calloc(1, sizeof(*c));
+    c = calloc(1, sizeof(*c) + CCN_CHARBUF_INLINE);
+    if (c != NULL) {
+        c->buf = CHARBUF_INLINE_SPACE(c);
+        c->limit = CCN_CHARBUF_INLINE;
+    }
     return(c);
 }
 
@@ -36,14 +55,17 @@ struct ccn_charbuf *
 ccn_charbuf_create_n(size_t n)
 {
     struct ccn_charbuf *c;
-    c = malloc(sizeof(*c));
+    c = malloc(sizeof(*c) + CCN_CHARBUF_INLINE);
     if (c == NULL) return (NULL);
     c->length = 0;
-    c->limit = n;
-    if (n == 0) {
-        c->buf = NULL;
+    c->limit = CCN_CHARBUF_INLINE;
+    c->buf = CHARBUF_INLINE_SPACE(c);
+#ifdef CCN_BUF_PROFILE
+    c->site = NULL;
+#endif
+    if (n <= CCN_CHARBUF_INLINE)
         return(c);
-    }
+    c->limit = n;
     c->buf = malloc(n);
     if (c->buf == NULL) {
         free(c);
@@ -52,12 +74,58 @@ ccn_charbuf_create_n(size_t n)
     return(c);
 }
 
+void
+ccn_charbuf_init_inline(struct ccn_charbuf *c, size_t space)
+{
+    c->length = 0;
+    c->limit = space;
+    c->buf = CHARBUF_INLINE_SPACE(c);
+#ifdef CCN_BUF_PROFILE
+    c->site = NULL;
+#endif
+}
+
+void
+ccn_charbuf_fini(struct ccn_charbuf *c)
+{
+    if (c->buf != CHARBUF_INLINE_SPACE(c))
+        free(c->buf);
+    c->buf = NULL;
+    c->length = c->limit = 0;
+}
+
+#ifdef CCN_BUF_PROFILE
+struct ccn_charbuf *
+ccn_charbuf_create_at(const char *file, int line)
+{
+    struct ccn_charbuf *c;
+    c = ccn_charbuf_create();
+    if (c != NULL) {
+        c->site = ccn_bufprof_site(file, line, CCN_BUFPROF_CHARBUF);
+        ccn_bufprof_alloc(c->site, 0, 0);
+    }
+    return(c);
+}
+
+struct ccn_charbuf *
+ccn_charbuf_create_n_at(size_t n, const char *file, int line)
+{
+    struct ccn_charbuf *c;
+    c = ccn_charbuf_create_n(n);
+    if (c != NULL) {
+        c->site = ccn_bufprof_site(file, line, CCN_BUFPROF_CHARBUF);
+        ccn_bufprof_alloc(c->site, n > CCN_CHARBUF_INLINE ? n : 0, 0);
+    }
+    return(c);
+}
+#endif
+
 void
 ccn_charbuf_destroy(struct ccn_charbuf **cbp)
 {
     struct ccn_charbuf *c = *cbp;
     if (c != NULL) {
-        if (c->buf != NULL)
+        if (c->buf != CHARBUF_INLINE_SPACE(c))
             free(c->buf);
         free(c);
         *cbp = NULL;
@@ -77,18 +145,25 @@ ccn_charbuf_reserve(struct ccn_charbuf *c, size_t n)
     if (newsz > c->limit) {
         if (2 * c->limit > newsz)
             newsz = 2 * c->limit;
-#ifdef CCN_NOREALLOC
-        buf = malloc(newsz);
-        if (buf == NULL)
-            return(NULL);
-        memcpy(buf, c->buf, c->limit);
-        free(c->buf);
-#else
-        buf = realloc(c->buf, newsz);
+#ifndef CCN_NOREALLOC
+        if (buf != CHARBUF_INLINE_SPACE(c))
+            buf = realloc(c->buf, newsz);
+        else
+#endif
+        {
+            buf = malloc(newsz);
+            if (buf != NULL) {
+                memcpy(buf, c->buf, c->limit);
+                if (c->buf != CHARBUF_INLINE_SPACE(c))
+                    free(c->buf);
+            }
+        }
         if (buf == NULL)
             return(NULL);
-#endif
         memset(buf + c->limit, 0, newsz - c->limit);
+#ifdef CCN_BUF_PROFILE
+        ccn_bufprof_alloc(c->site, newsz, 1);
+#endif
         c->buf = buf;
         c->limit = newsz;
     }
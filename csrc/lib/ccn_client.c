@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -34,6 +35,7 @@
 #include <unistd.h>
 #include <openssl/evp.h>
 
+#include <ccn/arena.h>
 #include <ccn/ccn.h>
 #include <ccn/ccn_private.h>
 #include <ccn/ccnd.h>
@@ -45,8 +47,15 @@
 #include <ccn/schedule.h>
 #include <ccn/signing.h>
 #include <ccn/keystore.h>
+#include <ccn/random.h>
+#include <ccn/shmring.h>
 #include <ccn/uri.h>
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#define CCN_HAVE_SENDFILE 1
+#endif
+
 /* Forward struct declarations */
 struct interests_by_prefix;
 struct expressed_interest;
@@ -65,13 +74,23 @@ struct ccn {
     struct ccn_charbuf *ccndid;
     struct hashtb *interests_by_prefix;
     struct hashtb *interest_filters;
+    struct hashtb *ifilt_trie;  /* edges of the filter trie, see below */
+    struct interest_filter *ifilt_root; /* filter for the empty prefix */
+    unsigned ifilt_nodes;       /* last filter trie node number used */
+    struct ccn_charbuf *ifilt_key; /* scratch for trie edge keys */
     struct ccn_skeleton_decoder decoder;
-    struct ccn_indexbuf *scratch_indexbuf;
+    struct ccn_arena *scratch; /* per-message temporaries */
     struct hashtb *keys;    /* public keys, by pubid */
+    struct hashtb *key_fetches; /* closures of key fetches, by pubid */
+    struct ccn_charbuf *keycache; /* directory of cached keys, or NULL */
+    int keycache_ttl;           /* seconds a cached key is good for */
     struct hashtb *keystores;   /* unlocked private keys */
     struct ccn_charbuf *default_pubid;
+    struct ccn_charbuf *local_key; /* shared secret for CCN_SP_HMAC */
+    struct hashtb *signing_policies; /* sp_flags, by name prefix */
     struct ccn_schedule *schedule;
-    struct timeval now;
+    struct ccn_clock clock;     /* monotonic, read once per ccn_run turn */
+    struct timeval now;         /* as of the latest clock reading */
     int timeout;
     int refresh_us;
     int err;                    /* pos => errno value, neg => other */
@@ -80,6 +99,108 @@ struct ccn {
     int tap;
     int running;
     int defer_verification;     /* Client wants to do its own verification */
+    struct ccn_verifier *verifier; /* threads checking signatures, or NULL */
+    struct ccn_held *held;      /* messages held for signature checks */
+    struct ccn_held **held_tail;
+    struct ccn_held *delivering; /* held message being dispatched */
+    int batching;               /* depth of ccn_batch_begin calls */
+    struct ccn_shmring *shm;    /* rings shared with ccnd, or NULL */
+    int framed;                 /* our output to the rings is length-framed */
+    struct expressed_interest **interest_heap; /* earliest due first */
+    int interest_heap_n;        /* entries in use */
+    int interest_heap_limit;    /* entries allocated */
+    int n_interests;            /* expressed interests, counting dead ones */
+    int dead_interests;         /* retired, awaiting ccn_clean_all_interests */
+    int check_wanted_pub;       /* an interest has started waiting for a key */
+    int keys_seen;              /* hashtb_n(keys) when last checked */
+    int interests_aged;         /* handled by last scheduled operations */
+    struct ccn_inblock *inblock; /* inbuf, once a slice of it is kept */
+    size_t inbuf_done;          /* inbuf bytes already dispatched, if the
+                                   move to a fresh buffer is still owed */
+    size_t inbuf_want;          /* size of the next read from sock */
+    struct hashtb *version_cache; /* see ccn_versioning.c */
+};
+
+/**
+ * Input buffer storage that the client is keeping some of,
+ * shared by the handle (while it is still reading into it) and
+ * by the slices.
+ */
+struct ccn_inblock {
+    int refcount;
+    struct ccn_charbuf *cb;
+};
+
+/**
+ * A piece of a received message that the client has kept
+ */
+struct ccn_slice {
+    struct ccn_inblock *block;
+    const unsigned char *buf;
+    size_t size;
+};
+
+/** Queued output is written out early once a batch builds up this much */
+#define CCN_BATCH_FLUSH_BYTES 32768
+
+/** Least, and starting, size of a read from the socket */
+#define CCN_INBUF_MIN 8800
+/** Most ccn_process_input will read from the socket at once */
+#define CCN_INBUF_MAX (256 * 1024)
+/** Messages ccn_process_input dispatches before letting timers run */
+#define CCN_INPUT_BATCH 256
+
+/**
+ * Data field for entries in the process-wide table of content that has
+ * verified, keyed by the ContentObject digest followed by the digest
+ * of the public key that it verified with.  The entries are kept on a
+ * list with the most recently used at the newer end.
+ */
+struct verified_entry {
+    struct verified_entry *older;
+    struct verified_entry *newer;
+    size_t keysize;
+    unsigned char key[64];      /* a copy of the key, for eviction */
+};
+
+/** Seconds a key in the on-disk key cache is good for, by default */
+#define CCN_KEYCACHE_TTL (24 * 60 * 60)
+
+/** Largest key the on-disk key cache will hold */
+#define CCN_KEYCACHE_MAX 8192
+
+/** Longest wait in ccn_prepare_poll while messages are held */
+#define CCN_HELD_POLL_US 1000
+
+/** How many verified ContentObjects to remember */
+#define CCN_VERIFIED_CACHE_SIZE 2048
+
+/** Size of a freshly made local key, in bytes */
+#define CCN_LOCAL_KEY_SIZE 32
+
+/*
+ * Shared by all of the handles in the process, whatever thread they are
+ * in (see ccn_mux.c), and destroyed along with the last one.  The lock
+ * covers the table, the list, and the count of users.
+ */
+static pthread_mutex_t ccn_verified_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct hashtb *ccn_verified = NULL;
+static struct verified_entry *ccn_verified_oldest = NULL;
+static struct verified_entry *ccn_verified_newest = NULL;
+static int ccn_verified_users = 0;
+
+/**
+ * A copy of an incoming message, held back while the verifier threads
+ * check its signature.  Messages that arrive behind one that is being
+ * checked are held too, so that upcalls are made in arrival order.
+ */
+struct ccn_held {
+    struct ccn_held *next;
+    struct ccn_charbuf *msg;
+    struct ccn_parsed_ContentObject pco;
+    const struct ccn_pkey *pubkey;
+    int checking;               /* a verifier thread has it */
+    int verdict;                /* 1 good, 0 bad, -1 not checked */
 };
 
 struct interests_by_prefix { /* keyed by components of name prefix */
@@ -96,6 +217,8 @@ struct expressed_interest {
     int outstanding;             /* number currently outstanding (0 or 1) */
     int lifetime_us;             /* interest lifetime in microseconds */
     struct ccn_charbuf *wanted_pub; /* waiting for this pub to arrive */
+    struct timeval due;          /* when it next needs looking after */
+    int heapix;                  /* 1 + index in h->interest_heap, or 0 */
     struct expressed_interest *next; /* link to next in list */
 };
 
@@ -129,12 +252,16 @@ struct ccn_reg_closure {
 /* Prototypes */
 
 static void ccn_refresh_interest(struct ccn *, struct expressed_interest *);
+static void ccn_keycache_init(struct ccn *);
+static void ccn_inblock_release(struct ccn_inblock **);
 static void ccn_initiate_prefix_reg(struct ccn *,
                                     const void *, size_t,
                                     struct interest_filter *);
 static void finalize_pkey(struct hashtb_enumerator *e);
 static void finalize_keystore(struct hashtb_enumerator *e);
 static int ccn_pushout(struct ccn *h);
+static void ccn_held_flush(struct ccn *h);
+static int ccn_load_local_key_1(struct ccn *h, const char *path, int create);
 static void update_ifilt_flags(struct ccn *, struct interest_filter *, int);
 static int update_multifilt(struct ccn *,
                             struct interest_filter *,
@@ -153,6 +280,19 @@ tv_earlier(const struct timeval *a, const struct timeval *b)
     return(a->tv_usec < b->tv_usec);
 }
 
+/**
+ * Read the clock into h->now
+ *
+ * The clock is monotonic, so h->now is only good for timing.
+ */
+static void
+ccn_note_time(struct ccn *h)
+{
+    const struct ccn_timeval *now = ccn_clock_refresh(&h->clock);
+    h->now.tv_sec = now->s;
+    h->now.tv_usec = now->micros;
+}
+
 /**
  * Produce message on standard error output describing the last
  * error encountered during a call using the given handle.
@@ -217,22 +357,13 @@ ccn_geterror(struct ccn *h)
 static struct ccn_indexbuf *
 ccn_indexbuf_obtain(struct ccn *h)
 {
-    struct ccn_indexbuf *c = h->scratch_indexbuf;
-    if (c == NULL)
-        return(ccn_indexbuf_create());
-    h->scratch_indexbuf = NULL;
-    c->n = 0;
-    return(c);
+    return(ccn_indexbuf_create_in(h->scratch));
 }
 
 static void
 ccn_indexbuf_release(struct ccn *h, struct ccn_indexbuf *c)
 {
-    c->n = 0;
-    if (h->scratch_indexbuf == NULL)
-        h->scratch_indexbuf = c;
-    else
-        ccn_indexbuf_destroy(&c);
+    ccn_indexbuf_release_in(h->scratch, &c);
 }
 
 /**
@@ -276,11 +407,19 @@ ccn_create(void)
         return(h);
     param.finalize_data = h;
     h->sock = -1;
+    ccn_clock_init(&h->clock);
     h->interestbuf = ccn_charbuf_create();
+    h->scratch = ccn_arena_create();
     param.finalize = &finalize_pkey;
     h->keys = hashtb_create(sizeof(struct ccn_pkey *), &param);
+    h->key_fetches = hashtb_create(sizeof(struct ccn_closure *), NULL);
+    ccn_keycache_init(h);
     param.finalize = &finalize_keystore;
     h->keystores = hashtb_create(sizeof(struct ccn_keystore *), &param);
+    pthread_mutex_lock(&ccn_verified_lock);
+    if (ccn_verified_users++ == 0)
+        ccn_verified = hashtb_create(sizeof(struct verified_entry), NULL);
+    pthread_mutex_unlock(&ccn_verified_lock);
     s = getenv("CCN_DEBUG");
     h->verbose_error = (s != NULL && s[0] != 0);
     s = getenv("CCN_TAP");
@@ -303,6 +442,7 @@ ccn_create(void)
     } else
         h->tap = -1;
     h->defer_verification = 0;
+    h->held_tail = &h->held;
     OpenSSL_add_all_algorithms();
     return(h);
 }
@@ -340,6 +480,150 @@ ccn_defer_verification(struct ccn *h, int defer)
     return(old);
 }
 
+/**
+ * Check the signatures of incoming content on other threads.
+ *
+ * With n threads, content whose signature needs a public key is
+ * held while one of the threads checks it, and the handle carries
+ * on reading in the meantime.  Upcalls are still made from ccn_run
+ * (or ccn_process_ready), in the order that the messages arrived.
+ * Objects already in the cache of verified objects are not held.
+ * While anything is held, ccn_prepare_poll asks to be called again
+ * within CCN_HELD_POLL_US, for the sake of client-managed event loops.
+ *
+ * Setting n to 0 waits for the checks in hand, delivers the held
+ * messages, and stops the threads.
+ *
+ * @param n is the number of threads wanted, or -1 to leave unchanged.
+ * @returns the previous number of threads, or -1 for error.
+ */
+int
+ccn_verify_threads(struct ccn *h, int n)
+{
+    struct ccn_verifier *v = NULL;
+    int old;
+
+    if (h == NULL)
+        return(-1);
+    if (h->running != 0)
+        return(NOTE_ERR(h, EBUSY));
+    old = 0;
+    if (h->verifier != NULL)
+        old = ccn_verifier_threads(h->verifier);
+    if (n < 0 || n == old)
+        return(old);
+    if (n > 0) {
+        v = ccn_verifier_create(n);
+        if (v == NULL)
+            return(NOTE_ERRNO(h));
+    }
+    if (h->verifier != NULL) {
+        ccn_verifier_stop(h->verifier);
+        ccn_held_flush(h);
+        ccn_verifier_destroy(&h->verifier);
+    }
+    h->verifier = v;
+    return(old);
+}
+
+/**
+ * How long to wait for ccnd to answer a request for shared-memory rings
+ */
+#define CCN_SHM_WAIT_MS 1000
+
+/**
+ * Ask ccnd to carry this connection over shared-memory rings.
+ *
+ * This is done only if CCN_SHM is set in the environment, and must
+ * happen before any other traffic on the connection.  We send a scope 0
+ * Interest and wait a little while for the answer; ccnd makes the rings
+ * and passes us their descriptor along with an "ok".  With CCN_SHM=framed
+ * we also ask for length framing on our output (see CCN_SHM_FRAMED).
+ * Any failure before that, including a ccnd that does not know about
+ * the rings and so never answers, just leaves the connection as a
+ * plain socket.
+ * @returns -1 if ccnd has switched to the rings but we cannot follow.
+ */
+static int
+ccn_shm_negotiate(struct ccn *h)
+{
+    struct ccn_skeleton_decoder dd = {0};
+    struct ccn_skeleton_decoder *d = &dd;
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_charbuf *name = NULL;
+    struct ccn_charbuf *interest = NULL;
+    struct ccn_charbuf *reply = NULL;
+    struct timeval start;
+    struct timeval now;
+    struct pollfd fds[1];
+    const unsigned char *val = NULL;
+    size_t size = 0;
+    unsigned char *buf;
+    const char *s;
+    int millisec;
+    int framed;
+    int fd = -1;
+    int ans = 0;
+    ssize_t res;
+
+    s = getenv(CCN_SHM_ENVNAME);
+    if (s == NULL || s[0] == 0 || strcmp(s, "0") == 0)
+        return(0);
+    framed = (strcmp(s, "framed") == 0);
+    name = ccn_charbuf_create();
+    interest = ccn_charbuf_create();
+    reply = ccn_charbuf_create();
+    ccn_name_from_uri(name, CCN_SHM_URI);
+    if (framed)
+        ccn_name_append_str(name, CCN_SHM_FRAMED);
+    ccn_charbuf_append_tt(interest, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append_charbuf(interest, name);
+    ccnb_tagged_putf(interest, CCN_DTAG_Scope, "0");
+    ccn_charbuf_append_closer(interest); /* </Interest> */
+    res = write(h->sock, interest->buf, interest->length);
+    if (res != interest->length)
+        goto Finish;
+    gettimeofday(&start, NULL);
+    fds[0].fd = h->sock;
+    fds[0].events = POLLIN;
+    while (d->state != 0 || d->index == 0) {
+        gettimeofday(&now, NULL);
+        millisec = CCN_SHM_WAIT_MS -
+                   ((now.tv_sec - start.tv_sec) * 1000 +
+                    (now.tv_usec - start.tv_usec) / 1000);
+        if (millisec <= 0 || poll(fds, 1, millisec) <= 0)
+            goto Finish;
+        buf = ccn_charbuf_reserve(reply, 1024);
+        res = ccn_shmring_recvfd(h->sock, buf, reply->limit - reply->length, &fd);
+        if (res <= 0)
+            goto Finish;
+        reply->length += res;
+        ccn_skeleton_decode(d, buf, res);
+        if (d->state < 0)
+            goto Finish;
+    }
+    if (d->index != reply->length ||
+        ccn_parse_ContentObject(reply->buf, reply->length, &pco, NULL) < 0 ||
+        !ccn_content_matches_interest(reply->buf, reply->length, 1, &pco,
+                                      interest->buf, interest->length, NULL) ||
+        ccn_content_get_value(reply->buf, reply->length, &pco, &val, &size) < 0)
+        goto Finish;
+    if (size == 2 && memcmp(val, "ok", 2) == 0) {
+        if (fd != -1)
+            h->shm = ccn_shmring_attach(fd, h->sock);
+        if (h->shm == NULL)
+            ans = NOTE_ERR(h, EPROTO);
+        h->framed = framed;
+    }
+Finish:
+    if (fd != -1)
+        close(fd);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&interest);
+    ccn_charbuf_destroy(&reply);
+    return(ans);
+}
+
 /**
  * Connect to local ccnd.
  * @param h is a ccn library handle
@@ -373,6 +657,32 @@ ccn_connect(struct ccn *h, const char *name)
     res = fcntl(h->sock, F_SETFL, O_NONBLOCK);
     if (res == -1)
         return(NOTE_ERRNO(h));
+    if (ccn_shm_negotiate(h) < 0) {
+        ccn_disconnect(h);
+        return(-1);
+    }
+    return(h->sock);
+}
+
+/**
+ * Use an already-connected stream socket as the connection to ccnd.
+ *
+ * This is for ccn_mux_attach; the fd belongs to the handle afterwards.
+ * @returns the fd, or -1 for error.
+ */
+int
+ccn_connect_fd(struct ccn *h, int fd)
+{
+    int res;
+    if (h == NULL)
+        return(-1);
+    h->err = 0;
+    if (h->sock != -1)
+        return(NOTE_ERR(h, EINVAL));
+    res = fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (res == -1)
+        return(NOTE_ERRNO(h));
+    h->sock = fd;
     return(h->sock);
 }
 
@@ -386,12 +696,32 @@ int
 ccn_disconnect(struct ccn *h)
 {
     int res;
+    struct pollfd fds[1];
+    int i;
     res = ccn_pushout(h);
-    if (res == 1) {
+    if (res == 1 && h->shm != NULL) {
+        /* Give ccnd a little while to make room in the ring */
+        fds[0].fd = h->sock;
+        fds[0].events = POLLIN;
+        for (i = 0; i < 100 && res == 1; i++) {
+            if (poll(fds, 1, 10) > 0 && ccn_shmring_drain(h->shm) <= 0)
+                break;
+            res = ccn_pushout(h);
+        }
+    }
+    else if (res == 1) {
         res = fcntl(h->sock, F_SETFL, 0); /* clear O_NONBLOCK */
         if (res == 0)
             ccn_pushout(h);
     }
+    ccn_shmring_destroy(&h->shm);
+    h->framed = 0;
+    if (h->inblock != NULL) {
+        /* The slices have the storage now */
+        h->inbuf = NULL;
+        h->inbuf_done = 0;
+        ccn_inblock_release(&h->inblock);
+    }
     ccn_charbuf_destroy(&h->inbuf);
     ccn_charbuf_destroy(&h->outbuf);
     res = close(h->sock);
@@ -428,6 +758,132 @@ replace_interest_msg(struct expressed_interest *interest,
     }
 }
 
+/*
+ * The expressed interests that are being timed are kept in a binary
+ * heap ordered by due time, so that ccn_process_scheduled_operations
+ * only needs to look at the ones that are due.  Interests waiting
+ * for a key are not timed, and dead ones are left for the next
+ * ccn_clean_all_interests.
+ */
+
+static void
+ccn_interest_heap_put(struct ccn *h, int i, struct expressed_interest *ie)
+{
+    h->interest_heap[i] = ie;
+    ie->heapix = i + 1;
+}
+
+/**
+ * Move the heap entry at index i to where it belongs.
+ */
+static void
+ccn_interest_heap_sift(struct ccn *h, int i)
+{
+    struct expressed_interest **a = h->interest_heap;
+    struct expressed_interest *ie = a[i];
+    int n = h->interest_heap_n;
+    int c;
+    
+    while (i > 0 && tv_earlier(&ie->due, &a[(i - 1) / 2]->due)) {
+        ccn_interest_heap_put(h, i, a[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    for (c = 2 * i + 1; c < n; i = c, c = 2 * i + 1) {
+        if (c + 1 < n && tv_earlier(&a[c + 1]->due, &a[c]->due))
+            c++;
+        if (!tv_earlier(&a[c]->due, &ie->due))
+            break;
+        ccn_interest_heap_put(h, i, a[c]);
+    }
+    ccn_interest_heap_put(h, i, ie);
+}
+
+static void
+ccn_unschedule_interest(struct ccn *h, struct expressed_interest *ie)
+{
+    struct expressed_interest *last;
+    int i = ie->heapix - 1;
+    
+    if (i < 0)
+        return;
+    ie->heapix = 0;
+    last = h->interest_heap[--h->interest_heap_n];
+    if (last != ie) {
+        ccn_interest_heap_put(h, i, last);
+        ccn_interest_heap_sift(h, i);
+    }
+}
+
+static int
+ccn_schedule_interest(struct ccn *h, struct expressed_interest *ie,
+                      const struct timeval *due)
+{
+    struct expressed_interest **a;
+    int n;
+    
+    if (ie->heapix == 0) {
+        if (h->interest_heap_n == h->interest_heap_limit) {
+            n = 2 * h->interest_heap_limit + 64;
+            a = realloc(h->interest_heap, n * sizeof(a[0]));
+            if (a == NULL)
+                return(NOTE_ERRNO(h));
+            h->interest_heap = a;
+            h->interest_heap_limit = n;
+        }
+        ccn_interest_heap_put(h, h->interest_heap_n++, ie);
+    }
+    ie->due = *due;
+    ccn_interest_heap_sift(h, ie->heapix - 1);
+    return(0);
+}
+
+/**
+ * Drop the handler and message of an interest that is no longer wanted.
+ *
+ * The interest itself is freed by the next ccn_clean_all_interests.
+ */
+static void
+ccn_retire_interest(struct ccn *h, struct expressed_interest *ie)
+{
+    ccn_unschedule_interest(h, ie);
+    if (ie->action == NULL)
+        return;
+    ie->target = 0;
+    ccn_replace_handler(h, &(ie->action), NULL);
+    replace_interest_msg(ie, NULL);
+    h->dead_interests++;
+}
+
+/**
+ * Arrange for an interest to be looked after again, according to its state.
+ *
+ * This should be called whenever something may have changed the target,
+ * lasttime, or wanted_pub of the interest.
+ */
+static void
+ccn_settle_interest(struct ccn *h, struct expressed_interest *ie)
+{
+    struct timeval due;
+    
+    if (ie->action == NULL)
+        ccn_unschedule_interest(h, ie);
+    else if (ie->target > 0) {
+        /* An interest that could not be sent yet comes due right away */
+        due = ie->lasttime;
+        due.tv_sec += ie->lifetime_us / 1000000;
+        due.tv_usec += ie->lifetime_us % 1000000;
+        if (due.tv_usec >= 1000000) {
+            due.tv_sec += 1;
+            due.tv_usec -= 1000000;
+        }
+        ccn_schedule_interest(h, ie, &due);
+    }
+    else if (ie->wanted_pub != NULL)
+        ccn_unschedule_interest(h, ie);
+    else
+        ccn_retire_interest(h, ie);
+}
+
 static struct expressed_interest *
 ccn_destroy_interest(struct ccn *h, struct expressed_interest *i)
 {
@@ -436,6 +892,10 @@ ccn_destroy_interest(struct ccn *h, struct expressed_interest *i)
         ccn_gripe(i);
         return(NULL);
     }
+    ccn_unschedule_interest(h, i);
+    if (i->action == NULL)
+        h->dead_interests--;
+    h->n_interests--;
     ccn_replace_handler(h, &(i->action), NULL);
     replace_interest_msg(i, NULL);
     ccn_charbuf_destroy(&i->wanted_pub);
@@ -487,6 +947,15 @@ ccn_destroy(struct ccn **hp)
         return;
     ccn_schedule_destroy(&h->schedule);
     ccn_disconnect(h);
+    if (h->verifier != NULL)
+        ccn_verifier_stop(h->verifier);
+    while (h->held != NULL) {
+        struct ccn_held *held = h->held;
+        h->held = held->next;
+        ccn_charbuf_destroy(&held->msg);
+        free(held);
+    }
+    ccn_verifier_destroy(&h->verifier);
     if (h->interests_by_prefix != NULL) {
         for (hashtb_start(h->interests_by_prefix, e); e->data != NULL; hashtb_next(e)) {
             struct interests_by_prefix *entry = e->data;
@@ -504,14 +973,31 @@ ccn_destroy(struct ccn **hp)
         hashtb_end(e);
         hashtb_destroy(&(h->interest_filters));
     }
+    hashtb_destroy(&(h->ifilt_trie));
+    ccn_charbuf_destroy(&h->ifilt_key);
+    h->ifilt_root = NULL;
     hashtb_destroy(&(h->keys));
+    hashtb_destroy(&(h->key_fetches));
+    ccn_charbuf_destroy(&h->keycache);
     hashtb_destroy(&(h->keystores));
+    hashtb_destroy(&(h->signing_policies));
+    hashtb_destroy(&(h->version_cache));
+    pthread_mutex_lock(&ccn_verified_lock);
+    if (--ccn_verified_users == 0) {
+        hashtb_destroy(&ccn_verified);
+        ccn_verified_oldest = ccn_verified_newest = NULL;
+    }
+    pthread_mutex_unlock(&ccn_verified_lock);
     ccn_charbuf_destroy(&h->interestbuf);
     ccn_charbuf_destroy(&h->inbuf);
     ccn_charbuf_destroy(&h->outbuf);
-    ccn_indexbuf_destroy(&h->scratch_indexbuf);
+    ccn_arena_destroy(&h->scratch);
     ccn_charbuf_destroy(&h->default_pubid);
+    if (h->local_key != NULL)
+        memset(h->local_key->buf, 0, h->local_key->limit);
+    ccn_charbuf_destroy(&h->local_key);
     ccn_charbuf_destroy(&h->ccndid);
+    free(h->interest_heap);
     if (h->tap != -1)
         close(h->tap);
     free(h);
@@ -562,58 +1048,82 @@ ccn_check_namebuf(struct ccn *h, struct ccn_charbuf *namebuf, int prefix_comps,
     return(ans);
 }
 
-static void
+/**
+ * Append the parts of an interest template that follow the Name,
+ * except for any Nonce, and get the lifetime from it.
+ * @returns -1 if the template does not parse, 1 if the lifetime in it
+ *          was out of range (and so was not used), 0 otherwise.
+ */
+static int
+ccn_append_template_selectors(struct ccn_charbuf *c,
+                              struct ccn_charbuf *interest_template,
+                              int *lifetime_us)
+{
+    struct ccn_parsed_interest pi = { 0 };
+    intmax_t lifetime;
+    size_t start;
+    size_t size;
+    int res;
+    
+    res = ccn_parse_interest(interest_template->buf,
+                             interest_template->length, &pi, NULL);
+    if (res < 0)
+        return(-1);
+    lifetime = ccn_interest_lifetime(interest_template->buf, &pi);
+    start = pi.offset[CCN_PI_E_Name];
+    size = pi.offset[CCN_PI_B_Nonce] - start;
+    ccn_charbuf_append(c, interest_template->buf + start, size);
+    start = pi.offset[CCN_PI_B_OTHER];
+    size = pi.offset[CCN_PI_E_OTHER] - start;
+    if (size != 0)
+        ccn_charbuf_append(c, interest_template->buf + start, size);
+    // XXX - for now, don't try to handle lifetimes over 30 seconds.
+    if (lifetime < 1 || lifetime > (30 << 12))
+        return(1);
+    *lifetime_us = (lifetime * 1000000) >> 12;
+    return(0);
+}
+
+/**
+ * Build the interest message in h->interestbuf.
+ * @returns the lifetime in microseconds, or -1 for error.
+ */
+static int
 ccn_construct_interest(struct ccn *h,
                        struct ccn_charbuf *name_prefix,
-                       struct ccn_charbuf *interest_template,
-                       struct expressed_interest *dest)
+                       struct ccn_charbuf *interest_template)
 {
     struct ccn_charbuf *c = h->interestbuf;
-    size_t start;
-    size_t size;
+    int lifetime_us = CCN_INTEREST_LIFETIME_MICROSEC;
     int res;
     
-    dest->lifetime_us = CCN_INTEREST_LIFETIME_MICROSEC;
     c->length = 0;
     ccn_charbuf_append_tt(c, CCN_DTAG_Interest, CCN_DTAG);
     ccn_charbuf_append(c, name_prefix->buf, name_prefix->length);
-    res = 0;
     if (interest_template != NULL) {
-        struct ccn_parsed_interest pi = { 0 };
-        res = ccn_parse_interest(interest_template->buf,
-                                 interest_template->length, &pi, NULL);
-        if (res >= 0) {
-            intmax_t lifetime = ccn_interest_lifetime(interest_template->buf, &pi);
-            // XXX - for now, don't try to handle lifetimes over 30 seconds.
-            if (lifetime < 1 || lifetime > (30 << 12))
-                NOTE_ERR(h, EINVAL);
-            else
-                dest->lifetime_us = (lifetime * 1000000) >> 12;
-            start = pi.offset[CCN_PI_E_Name];
-            size = pi.offset[CCN_PI_B_Nonce] - start;
-            ccn_charbuf_append(c, interest_template->buf + start, size);
-            start = pi.offset[CCN_PI_B_OTHER];
-            size = pi.offset[CCN_PI_E_OTHER] - start;
-            if (size != 0)
-                ccn_charbuf_append(c, interest_template->buf + start, size);
-        }
-        else
+        res = ccn_append_template_selectors(c, interest_template, &lifetime_us);
+        if (res != 0)
             NOTE_ERR(h, EINVAL);
+        if (res < 0)
+            return(-1);
     }
     ccn_charbuf_append_closer(c);
-    replace_interest_msg(dest, (res >= 0 ? c : NULL));
+    return(lifetime_us);
 }
 
-int
-ccn_express_interest(struct ccn *h,
-                     struct ccn_charbuf *namebuf,
-                     struct ccn_closure *action,
-                     struct ccn_charbuf *interest_template)
+/**
+ * Make an expressed interest from the message in msg, file it under
+ * the name components in key, and send it.
+ */
+static int
+ccn_enroll_interest(struct ccn *h,
+                    const unsigned char *key, size_t keysize,
+                    struct ccn_charbuf *msg, int lifetime_us,
+                    struct ccn_closure *action)
 {
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
     int res;
-    int prefixend;
     struct expressed_interest *interest = NULL;
     struct interests_by_prefix *entry = NULL;
     if (h->interests_by_prefix == NULL) {
@@ -621,15 +1131,8 @@ ccn_express_interest(struct ccn *h,
         if (h->interests_by_prefix == NULL)
             return(NOTE_ERRNO(h));
     }
-    prefixend = ccn_check_namebuf(h, namebuf, -1, 1);
-    if (prefixend < 0)
-        return(prefixend);
-    /*
-     * To make it easy to lookup prefixes of names, we keep only
-     * the prefix name components as the key in the hash table.
-     */
     hashtb_start(h->interests_by_prefix, e);
-    res = hashtb_seek(e, namebuf->buf + 1, prefixend - 1, 0);
+    res = hashtb_seek(e, key, keysize, 0);
     entry = e->data;
     if (entry == NULL) {
         NOTE_ERRNO(h);
@@ -645,7 +1148,8 @@ ccn_express_interest(struct ccn *h,
         return(-1);
     }
     interest->magic = 0x7059e5f4;
-    ccn_construct_interest(h, namebuf, interest_template, interest);
+    interest->lifetime_us = lifetime_us;
+    replace_interest_msg(interest, msg);
     if (interest->interest_msg == NULL) {
         free(interest);
         hashtb_end(e);
@@ -655,47 +1159,367 @@ ccn_express_interest(struct ccn *h,
     interest->target = 1;
     interest->next = entry->list;
     entry->list = interest;
+    h->n_interests++;
     hashtb_end(e);
     /* Actually send the interest out right away */
     ccn_refresh_interest(h, interest);
+    ccn_settle_interest(h, interest);
     return(0);
 }
 
-static void
-finalize_interest_filter(struct hashtb_enumerator *e)
+int
+ccn_express_interest(struct ccn *h,
+                     struct ccn_charbuf *namebuf,
+                     struct ccn_closure *action,
+                     struct ccn_charbuf *interest_template)
 {
-    struct interest_filter *i = e->data;
-    if (i->ccn_reg_closure != NULL) {
-        i->ccn_reg_closure->interest_filter = NULL;
-        i->ccn_reg_closure = NULL;
-    }
+    int prefixend;
+    int lifetime_us;
+    prefixend = ccn_check_namebuf(h, namebuf, -1, 1);
+    if (prefixend < 0)
+        return(prefixend);
+    lifetime_us = ccn_construct_interest(h, namebuf, interest_template);
+    if (lifetime_us < 0)
+        return(-1);
+    /*
+     * To make it easy to lookup prefixes of names, we keep only
+     * the prefix name components as the key in the hash table.
+     */
+    return(ccn_enroll_interest(h, namebuf->buf + 1, prefixend - 1,
+                               h->interestbuf, lifetime_us, action));
 }
 
 /**
- * Register to receive interests on a prefix, with forwarding flags
- *
- * See ccn_set_interest_filter for a description of the basic operation.
- *
- * The additional forw_flags argument offers finer control of which
- * interests are forward to the application.
- * Refer to doc/technical/Registration for details.
- *
- * There may be multiple actions associated with the prefix.  They will be
- * called in an unspecified order.  The flags passed to ccnd will be
- * the inclusive-or of the flags associated with each action.
- *
- * Passing a value of 0 for forw_flags will unregister just this specific action,
- * leaving other actions untouched.
+ * The pieces of an interest message that stay the same for all the
+ * interests expressed from a ccn_compiled_interest.
+ */
+struct ccn_compiled_interest {
+    struct ccn_charbuf *head;   /* <Interest><Name> and the prefix components */
+    struct ccn_charbuf *tail;   /* </Name>, the selectors, and </Interest> */
+    size_t keystart;            /* where the components start in head */
+    int lifetime_us;
+};
+
+/**
+ * Prepare for expressing many interests that differ only in a final
+ * name component.
  *
- * @returns -1 in case of error, non-negative for success.
+ * The name prefix and the template are checked and encoded just once,
+ * so ccn_express_compiled_interest need only copy the encoding and
+ * splice in the final component.
+ * @param name_prefix is the ccnb-encoded Name common to the interests.
+ * @param interest_template is as for ccn_express_interest, or NULL.
+ * @returns the compiled interest, or NULL for error.
  */
-int
+struct ccn_compiled_interest *
+ccn_compile_interest(struct ccn_charbuf *name_prefix,
+                     struct ccn_charbuf *interest_template)
+{
+    struct ccn_compiled_interest *ci;
+    int res;
+    
+    res = ccn_check_namebuf(NULL, name_prefix, -1, 0);
+    if (res < 0 || res + 1 != name_prefix->length)
+        return(NULL);
+    res = 0;
+    ci = calloc(1, sizeof(*ci));
+    if (ci == NULL)
+        return(NULL);
+    ci->head = ccn_charbuf_create();
+    ci->tail = ccn_charbuf_create();
+    ci->lifetime_us = CCN_INTEREST_LIFETIME_MICROSEC;
+    if (ci->head == NULL || ci->tail == NULL)
+        res = -1;
+    else {
+        ccn_charbuf_append_tt(ci->head, CCN_DTAG_Interest, CCN_DTAG);
+        /* The <Name> tag is a single byte */
+        ci->keystart = ci->head->length + 1;
+        ccn_charbuf_append(ci->head, name_prefix->buf, name_prefix->length - 1);
+        ccn_charbuf_append_closer(ci->tail); /* </Name> */
+        if (interest_template != NULL)
+            res = ccn_append_template_selectors(ci->tail, interest_template,
+                                                &ci->lifetime_us);
+        ccn_charbuf_append_closer(ci->tail); /* </Interest> */
+    }
+    if (res < 0)
+        ccn_compiled_interest_destroy(&ci);
+    return(ci);
+}
+
+void
+ccn_compiled_interest_destroy(struct ccn_compiled_interest **cip)
+{
+    struct ccn_compiled_interest *ci = *cip;
+    if (ci == NULL)
+        return;
+    ccn_charbuf_destroy(&ci->head);
+    ccn_charbuf_destroy(&ci->tail);
+    free(ci);
+    *cip = NULL;
+}
+
+/**
+ * Express an interest in the compiled prefix plus one more component.
+ *
+ * This behaves like ccn_express_interest with the name extended by
+ * the given component.
+ * @param comp is the value of the final component.
+ * @param size is its length.
+ * @returns -1 for error, non-negative for success.
+ */
+int
+ccn_express_compiled_interest(struct ccn *h,
+                              struct ccn_compiled_interest *ci,
+                              const void *comp, size_t size,
+                              struct ccn_closure *action)
+{
+    struct ccn_charbuf *c = h->interestbuf;
+    size_t keyend;
+    size_t compstart;
+    
+    c->length = 0;
+    ccn_charbuf_append(c, ci->head->buf, ci->head->length);
+    compstart = c->length;
+    ccn_charbuf_append_tt(c, CCN_DTAG_Component, CCN_DTAG);
+    ccn_charbuf_append_tt(c, size, CCN_BLOB);
+    ccn_charbuf_append(c, comp, size);
+    ccn_charbuf_append_closer(c);
+    /* Leave off what might be a digest, as ccn_check_namebuf does */
+    keyend = c->length;
+    if (keyend == compstart + 36)
+        keyend = compstart;
+    ccn_charbuf_append(c, ci->tail->buf, ci->tail->length);
+    return(ccn_enroll_interest(h, c->buf + ci->keystart, keyend - ci->keystart,
+                               c, ci->lifetime_us, action));
+}
+
+static void
+finalize_interest_filter(struct hashtb_enumerator *e)
+{
+    struct interest_filter *i = e->data;
+    if (i->ccn_reg_closure != NULL) {
+        i->ccn_reg_closure->interest_filter = NULL;
+        i->ccn_reg_closure = NULL;
+    }
+}
+
+/* * * interest filter trie * * */
+
+/**
+ * Edge of the trie that indexes the interest filters by name component
+ *
+ * The edges are all in one hash table, keyed by the number of the node
+ * they leave followed by the ccnb-encoded component, so a descent hashes
+ * each component of the Interest name once.  Node 0 is the root; the
+ * filter for the empty prefix hangs directly off the handle.
+ */
+struct ifilt_edge {
+    unsigned node;                  /**< the node this edge leads to */
+    int refs;                       /**< filters at or below that node */
+    struct interest_filter *filter; /**< filter for that prefix, or NULL */
+};
+
+/**
+ * A filter that matched an Interest, held for the upcall
+ */
+struct ifilt_match {
+    struct ccn_closure *action;
+    int matched_comps;
+};
+#define CCN_IFILT_MATCH_STACK 16
+
+static void
+ifilt_edge_key(struct ccn *h, unsigned node,
+               const unsigned char *comp, size_t size)
+{
+    h->ifilt_key->length = 0;
+    ccn_charbuf_append(h->ifilt_key, &node, sizeof(node));
+    ccn_charbuf_append(h->ifilt_key, comp, size);
+}
+
+/**
+ * Take a filter out of the trie
+ * @param n is the number of leading components to unwind.
+ */
+static void
+ifilt_trie_remove(struct ccn *h, const unsigned char *name,
+                  struct ccn_indexbuf *comps, int n,
+                  struct interest_filter *filter)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ifilt_edge *edge;
+    unsigned node = 0;
+    int i;
+    int res;
+    
+    if (comps->n == 1 && h->ifilt_root == filter)
+        h->ifilt_root = NULL;
+    for (i = 0; i < n; i++) {
+        ifilt_edge_key(h, node, name + comps->buf[i],
+                       comps->buf[i + 1] - comps->buf[i]);
+        hashtb_start(h->ifilt_trie, e);
+        res = hashtb_seek(e, h->ifilt_key->buf, h->ifilt_key->length, 0);
+        edge = e->data;
+        if (res != HT_OLD_ENTRY) {
+            if (edge != NULL)
+                hashtb_delete(e);
+            hashtb_end(e);
+            THIS_CANNOT_HAPPEN(h);
+            return;
+        }
+        node = edge->node;
+        if (edge->filter == filter)
+            edge->filter = NULL;
+        if (--edge->refs == 0)
+            hashtb_delete(e);
+        hashtb_end(e);
+    }
+}
+
+/**
+ * Put a new filter into the trie
+ * @returns 0, or -1 in case of an error.
+ */
+static int
+ifilt_trie_add(struct ccn *h, struct ccn_charbuf *namebuf,
+               struct interest_filter *filter)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_indexbuf *comps;
+    struct ifilt_edge *edge = NULL;
+    unsigned node = 0;
+    int n;
+    int i;
+    int res = 0;
+    
+    comps = ccn_indexbuf_obtain(h);
+    n = ccn_name_split(namebuf, comps);
+    if (n < 0)
+        res = NOTE_ERR(h, EINVAL);
+    else if (n == 0)
+        h->ifilt_root = filter;
+    if (n <= 0)
+        goto Finish;
+    if (h->ifilt_key == NULL)
+        h->ifilt_key = ccn_charbuf_create();
+    if (h->ifilt_trie == NULL && h->ifilt_key != NULL)
+        h->ifilt_trie = hashtb_create(sizeof(struct ifilt_edge), NULL);
+    if (h->ifilt_trie == NULL) {
+        res = NOTE_ERRNO(h);
+        goto Finish;
+    }
+    for (i = 0; i < n; i++) {
+        ifilt_edge_key(h, node, namebuf->buf + comps->buf[i],
+                       comps->buf[i + 1] - comps->buf[i]);
+        hashtb_start(h->ifilt_trie, e);
+        res = hashtb_seek(e, h->ifilt_key->buf, h->ifilt_key->length, 0);
+        edge = e->data;
+        if (res == HT_NEW_ENTRY)
+            edge->node = ++h->ifilt_nodes;
+        if (edge != NULL)
+            edge->refs++;
+        hashtb_end(e);
+        if (res < 0) {
+            ifilt_trie_remove(h, namebuf->buf, comps, i, filter);
+            res = NOTE_ERRNO(h);
+            goto Finish;
+        }
+        node = edge->node;
+    }
+    edge->filter = filter;
+    res = 0;
+Finish:
+    ccn_indexbuf_release(h, comps);
+    return(res);
+}
+
+/**
+ * Take a filter that is going away out of the trie
+ */
+static void
+ifilt_trie_unlink(struct ccn *h, struct ccn_charbuf *namebuf,
+                  struct interest_filter *filter)
+{
+    struct ccn_indexbuf *comps;
+    int n;
+    
+    comps = ccn_indexbuf_obtain(h);
+    n = ccn_name_split(namebuf, comps);
+    if (n >= 0)
+        ifilt_trie_remove(h, namebuf->buf, comps, n, filter);
+    ccn_indexbuf_release(h, comps);
+}
+
+/**
+ * Find the filters for the prefixes of an Interest name
+ *
+ * The descent stops at the first component that no filter goes through.
+ * The actions are held, so that they stay good through the upcalls
+ * even if the filters are changed meanwhile.
+ * @param m must have room for comps->n entries.
+ * @returns the number found, shortest prefix first.
+ */
+static int
+ifilt_trie_match(struct ccn *h, const unsigned char *msg,
+                 struct ccn_indexbuf *comps, struct ifilt_match *m)
+{
+    struct ifilt_edge *edge;
+    unsigned node = 0;
+    int n = 0;
+    int i;
+    
+    if (h->ifilt_root != NULL) {
+        m[n].action = NULL;
+        ccn_replace_handler(h, &m[n].action, h->ifilt_root->action);
+        m[n++].matched_comps = 0;
+    }
+    for (i = 0; h->ifilt_trie != NULL && i + 1 < comps->n; i++) {
+        ifilt_edge_key(h, node, msg + comps->buf[i],
+                       comps->buf[i + 1] - comps->buf[i]);
+        edge = hashtb_lookup(h->ifilt_trie, h->ifilt_key->buf,
+                             h->ifilt_key->length);
+        if (edge == NULL)
+            break;
+        if (edge->filter != NULL && edge->filter->action != NULL) {
+            m[n].action = NULL;
+            ccn_replace_handler(h, &m[n].action, edge->filter->action);
+            m[n++].matched_comps = i + 1;
+        }
+        node = edge->node;
+    }
+    return(n);
+}
+
+/* end of interest filter trie */
+
+/**
+ * Register to receive interests on a prefix, with forwarding flags
+ *
+ * See ccn_set_interest_filter for a description of the basic operation.
+ *
+ * The additional forw_flags argument offers finer control of which
+ * interests are forward to the application.
+ * Refer to doc/technical/Registration for details.
+ *
+ * There may be multiple actions associated with the prefix.  They will be
+ * called in an unspecified order.  The flags passed to ccnd will be
+ * the inclusive-or of the flags associated with each action.
+ *
+ * Passing a value of 0 for forw_flags will unregister just this specific action,
+ * leaving other actions untouched.
+ *
+ * @returns -1 in case of error, non-negative for success.
+ */
+int
 ccn_set_interest_filter_with_flags(struct ccn *h, struct ccn_charbuf *namebuf,
                         struct ccn_closure *action, int forw_flags)
 {
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
     int res;
+    int fresh;
     struct interest_filter *entry;
     
     if (h->interest_filters == NULL) {
@@ -710,8 +1534,18 @@ ccn_set_interest_filter_with_flags(struct ccn *h, struct ccn_charbuf *namebuf,
         return(res);
     hashtb_start(h->interest_filters, e);
     res = hashtb_seek(e, namebuf->buf + 1, namebuf->length - 2, 0);
+    fresh = (res == HT_NEW_ENTRY);
+    if (fresh && action != NULL) {
+        if (ifilt_trie_add(h, namebuf, e->data) < 0) {
+            hashtb_delete(e);
+            res = -1;
+        }
+    }
     if (res >= 0) {
         entry = e->data;
+        /* Unlink first - the old handler's finalize may free namebuf */
+        if (action == NULL && !fresh)
+            ifilt_trie_unlink(h, namebuf, entry);
         if (entry->action != NULL && action != NULL && action != entry->action)
             res = update_multifilt(h, entry, action, forw_flags);
         else {
@@ -781,6 +1615,20 @@ struct multifilt_item {
     int forw_flags;
 };
 
+/**
+ * Array of the filters of a multifilt
+ *
+ * An upcall in progress holds a reference, so a change made while it
+ * is running is made on a fresh copy rather than on the array that is
+ * being walked.  Otherwise changes are made in place.
+ */
+struct multifilt_array {
+    int refcount;
+    int n;                      /**< Number of elements in use */
+    int size;                   /**< Number of elements allocated */
+    struct multifilt_item item[1];
+};
+
 /**
  * Data for the multifilt case
  *
@@ -789,22 +1637,18 @@ struct multifilt_item {
  */
 struct multifilt {
     struct ccn_closure me;
-    int n;                      /**< Number of elements in a */
-    struct multifilt_item *a;   /**< The filters that are to be combined */
+    struct multifilt_array *a;  /**< The filters that are to be combined */
 };
 
 /* Prototypes */
 static enum ccn_upcall_res handle_multifilt(struct ccn_closure *selfp,
                                             enum ccn_upcall_kind kind,
                                             struct ccn_upcall_info *info);
-static int build_multifilt_array(struct ccn *h,
-                                 struct multifilt_item **ap,
-                                 int n,
-                                 struct ccn_closure *action,
-                                 int forw_flags);
-static void destroy_multifilt_array(struct ccn *h,
-                                    struct multifilt_item **ap,
-                                    int n);
+static struct multifilt_array *own_multifilt_array(struct ccn *h,
+                                                   struct multifilt *md,
+                                                   int room);
+static void release_multifilt_array(struct ccn *h,
+                                    struct multifilt_array **ap);
 
 /**
  * Take care of the case of multiple filters registered on one prefix
@@ -818,10 +1662,9 @@ update_multifilt(struct ccn *h,
                  int forw_flags)
 {
     struct multifilt *md = NULL;
-    struct multifilt_item *a = NULL;
+    struct multifilt_array *a = NULL;
     int flags;
     int i;
-    int n = 0;
     
     if (action->p == &handle_multifilt) {
         /* This should never happen. */
@@ -832,122 +1675,140 @@ update_multifilt(struct ccn *h,
         md = f->action->data;
         if (md->me.data != md)
             abort();
-        a = md->a;
     }
     else {
-        /* Make a new multifilt, with 2 slots */
-        a = calloc(2, sizeof(*a));
-        if (a == NULL)
-            return(NOTE_ERRNO(h));
+        /* Not there, but if the flags are 0 we do not need to remember action */
+        if (forw_flags == 0) {
+            action->refcount++;
+            ccn_replace_handler(h, &action, NULL);
+            return(0);
+        }
+        /* Make a new multifilt, holding the existing action */
         md = calloc(1, sizeof(*md));
-        if (md == NULL) {
-            free(a);
+        if (md == NULL)
             return(NOTE_ERRNO(h));
-        }
         md->me.p = &handle_multifilt;
         md->me.data = md;
-        md->n = 2;
-        md->a = a;
-        ccn_replace_handler(h, &(a[0].action), f->action);
-        a[0].forw_flags = f->flags;
-        ccn_replace_handler(h, &(a[1].action), action);
-        a[1].forw_flags = 0; /* Actually set these below */
+        a = own_multifilt_array(h, md, 2);
+        if (a == NULL) {
+            free(md);
+            return(-1);
+        }
+        ccn_replace_handler(h, &(a->item[0].action), f->action);
+        a->item[0].forw_flags = f->flags;
+        a->n = 1;
         ccn_replace_handler(h, &f->action, &md->me);
     }
     /* Search for the action */
-    for (i = 0; i < n; i++) {
-        if (a[i].action == action) {
-            a[i].forw_flags = forw_flags;
-            if (forw_flags == 0) {
-                ccn_replace_handler(h, &(a[i].action), NULL);
-                action = NULL;
-            }
-            goto Finish;
+    for (i = 0; i < md->a->n; i++)
+        if (md->a->item[i].action == action)
+            break;
+    if (i < md->a->n && forw_flags != 0)
+        md->a->item[i].forw_flags = forw_flags;
+    else if (i < md->a->n) {
+        a = own_multifilt_array(h, md, 0);
+        if (a == NULL)
+            return(-1);
+        ccn_replace_handler(h, &(a->item[i].action), NULL);
+        a->n--;
+        memmove(&a->item[i], &a->item[i + 1], (a->n - i) * sizeof(a->item[0]));
+        if (a->n == 0) {
+            /* Nothing left; this drops the filter */
+            ccn_replace_handler(h, &f->action, NULL);
+            return(0);
         }
     }
-    /* Not there, but if the flags are 0 we do not need to remember action */
-    if (forw_flags == 0) {
+    else if (forw_flags == 0) {
         action->refcount++;
         ccn_replace_handler(h, &action, NULL);
-        goto Finish;
     }
-    /* Need to build a new array */
-    n = build_multifilt_array(h, &a, n, action, forw_flags);
-    if (n < 0)
-        return(n);
-    destroy_multifilt_array(h, &md->a, md->n);
-    md->a = a;
-    md->n = n;
-Finish:
+    else {
+        a = own_multifilt_array(h, md, md->a->n + 1);
+        if (a == NULL)
+            return(-1);
+        ccn_replace_handler(h, &(a->item[a->n].action), action);
+        a->item[a->n].forw_flags = forw_flags;
+        a->n++;
+    }
     /* The only thing left to do is to combine the forwarding flags */
-    for (i = 0, flags = 0; i < n; i++)
-        flags |= a[i].forw_flags;
+    a = md->a;
+    for (i = 0, flags = 0; i < a->n; i++)
+        flags |= a->item[i].forw_flags;
     update_ifilt_flags(h, f, flags);
     return(0);
 }
 
 /**
- * Replace *ap with a copy, perhaps with one additional element
+ * Get the array of a multifilt ready to be changed in place
  *
- * The old array is not modified.  Empty slots are not copied.
- *
- * @returns new count, or -1 in case of an error.
+ * If an upcall is holding the current array, it is replaced by a copy.
+ * @param room is the number of elements that need to fit.
+ * @returns the array, or NULL in case of an error.
  */
-static int
-build_multifilt_array(struct ccn *h,
-                      struct multifilt_item **ap,
-                      int n,
-                      struct ccn_closure *action,
-                      int forw_flags)
-{
-    struct multifilt_item *a = NULL; /* old array */
-    struct multifilt_item *c = NULL; /* new array */
-    int i, j, m;
+static struct multifilt_array *
+own_multifilt_array(struct ccn *h, struct multifilt *md, int room)
+{
+    struct multifilt_array *a = md->a; /* old array */
+    struct multifilt_array *c = NULL;  /* new array */
+    int size;
+    int i;
     
-    a = *ap;
-    /* Determine how many slots we will need */
-    for (m = 0, i = 0; i < n; i++) {
-        if (a[i].action != NULL)
-            m++;
-    }
-    if (action != NULL)
-        m++;
-    if (m == 0) {
-        *ap = NULL;
-        return(0);
-    }
-    c = calloc(m, sizeof(*c));
-    if (c == NULL)
-        return(NOTE_ERRNO(h));
-    for (i = 0, j = 0; i < n; i++) {
-        if (a[i].action != NULL) {
-            ccn_replace_handler(h, &(c[j].action), a[i].action);
-            c[j].forw_flags = a[i].forw_flags;
-            j++;
+    if (a != NULL && a->refcount == 1 && room <= a->size)
+        return(a);
+    size = (a == NULL) ? 0 : a->n;
+    if (size < room)
+        size = room;
+    if (a != NULL && size < 2 * a->n)
+        size = 2 * a->n;
+    if (size < 2)
+        size = 2;
+    if (a != NULL && a->refcount == 1) {
+        /* Nobody else is looking, so the references just move */
+        c = realloc(a, sizeof(*c) + (size - 1) * sizeof(c->item[0]));
+        if (c == NULL) {
+            NOTE_ERRNO(h);
+            return(NULL);
         }
+        memset(&c->item[c->n], 0, (size - c->n) * sizeof(c->item[0]));
+        c->size = size;
+        md->a = c;
+        return(c);
+    }
+    c = calloc(1, sizeof(*c) + (size - 1) * sizeof(c->item[0]));
+    if (c == NULL) {
+        NOTE_ERRNO(h);
+        return(NULL);
     }
-    if (j < m) {
-        ccn_replace_handler(h, &(c[j].action), action);
-        c[j].forw_flags = forw_flags;
+    c->refcount = 1;
+    c->size = size;
+    if (a != NULL) {
+        for (i = 0; i < a->n; i++) {
+            ccn_replace_handler(h, &(c->item[i].action), a->item[i].action);
+            c->item[i].forw_flags = a->item[i].forw_flags;
+        }
+        c->n = a->n;
     }
-    *ap = c;
-    return(m);
+    release_multifilt_array(h, &md->a);
+    md->a = c;
+    return(c);
 }
 
 /**
- * Destroy a multifilt_array
+ * Let go of a reference to a multifilt_array
  */
 static void
-destroy_multifilt_array(struct ccn *h, struct multifilt_item **ap, int n)
+release_multifilt_array(struct ccn *h, struct multifilt_array **ap)
 {
-    struct multifilt_item *a;
+    struct multifilt_array *a;
     int i;
     
     a = *ap;
     if (a != NULL) {
-        for (i = 0; i < n; i++)
-            ccn_replace_handler(h, &(a[i].action), NULL);
-        free(a);
+        if (--a->refcount == 0) {
+            for (i = 0; i < a->n; i++)
+                ccn_replace_handler(h, &(a->item[i].action), NULL);
+            free(a);
+        }
         *ap = NULL;
     }
 }
@@ -961,30 +1822,30 @@ handle_multifilt(struct ccn_closure *selfp,
                  struct ccn_upcall_info *info)
 {
     struct multifilt *md;
-    struct multifilt_item *a;
+    struct multifilt_array *a;
     enum ccn_upcall_res ans;
     enum ccn_upcall_res res;
-    int i, n;
+    int i;
     
     md = selfp->data;
     if (kind == CCN_UPCALL_FINAL) {
-        destroy_multifilt_array(info->h, &md->a, md->n);
+        release_multifilt_array(info->h, &md->a);
         free(md);
         return(CCN_UPCALL_RESULT_OK);
     }
     /*
      * Since the upcalls might be changing registrations on the fly,
-     * we need to make a copy of the array (updating the refcounts).
+     * hold on to the array; any change will be made to a copy.
      * Forget md and selfp, since they could go away during upcalls.
      */
     a = md->a;
-    n = build_multifilt_array(info->h, &a, md->n, NULL, 0);
+    a->refcount++;
     ans = CCN_UPCALL_RESULT_OK;
     md = NULL;
     selfp = NULL;
-    for (i = 0; i < n; i++) {
-        if ((a[i].forw_flags & CCN_FORW_ACTIVE) != 0) {
-            res = (a[i].action->p)(a[i].action, kind, info);
+    for (i = 0; i < a->n; i++) {
+        if ((a->item[i].forw_flags & CCN_FORW_ACTIVE) != 0) {
+            res = (a->item[i].action->p)(a->item[i].action, kind, info);
             if (res == CCN_UPCALL_RESULT_INTEREST_CONSUMED) {
                 ans = res;
                 if (kind == CCN_UPCALL_INTEREST)
@@ -992,12 +1853,30 @@ handle_multifilt(struct ccn_closure *selfp,
             }
         }
     }
-    destroy_multifilt_array(info->h, &a, n);
+    release_multifilt_array(info->h, &a);
     return(ans);
 }
 
 /* end of multifilt */
 
+/**
+ * Write to ccnd, through the rings if we have them.
+ * Returns as write(2) does.
+ */
+static ssize_t
+ccn_write_out(struct ccn *h, const void *p, size_t size)
+{
+    ssize_t res;
+    if (h->shm == NULL)
+        return(write(h->sock, p, size));
+    res = ccn_shmring_write(h->shm, p, size);
+    if (res == 0) {
+        errno = EAGAIN;
+        return(-1);
+    }
+    return(res);
+}
+
 static int
 ccn_pushout(struct ccn *h)
 {
@@ -1007,7 +1886,7 @@ ccn_pushout(struct ccn *h)
         if (h->sock < 0)
             return(1);
         size = h->outbuf->length - h->outbufindex;
-        res = write(h->sock, h->outbuf->buf + h->outbufindex, size);
+        res = ccn_write_out(h, h->outbuf->buf + h->outbufindex, size);
         if (res == size) {
             h->outbuf->length = h->outbufindex = 0;
             return(0);
@@ -1024,6 +1903,10 @@ int
 ccn_put(struct ccn *h, const void *p, size_t length)
 {
     struct ccn_skeleton_decoder dd = {0};
+    unsigned char hdr[CCN_SHM_FRAME_BYTES];
+    struct iovec iov[2];
+    size_t hdrlen = 0;
+    uint32_t framelen;
     ssize_t res;
     if (h == NULL)
         return(-1);
@@ -1040,16 +1923,34 @@ ccn_put(struct ccn *h, const void *p, size_t length)
             h->tap = -1;
         }
     }
+    if (h->framed && h->shm != NULL) {
+        framelen = length;
+        memcpy(hdr, &framelen, sizeof(hdr));
+        hdrlen = sizeof(hdr);
+    }
     if (h->outbuf != NULL && h->outbufindex < h->outbuf->length) {
         // XXX - should limit unbounded growth of h->outbuf
+        ccn_charbuf_append(h->outbuf, hdr, hdrlen);
         ccn_charbuf_append(h->outbuf, p, length); // XXX - check res
+        if (h->batching > 0 &&
+            h->outbuf->length - h->outbufindex < CCN_BATCH_FLUSH_BYTES)
+            return(1);
         return (ccn_pushout(h));
     }
-    if (h->sock == -1)
+    if (h->batching > 0)
+        res = 0;
+    else if (h->sock == -1)
         res = 0;
+    else if (hdrlen > 0) {
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = hdrlen;
+        iov[1].iov_base = (void *)p;
+        iov[1].iov_len = length;
+        res = ccn_shmring_writev(h->shm, iov, 2);
+    }
     else
-        res = write(h->sock, p, length);
-    if (res == length)
+        res = ccn_write_out(h, p, length);
+    if (res == hdrlen + length)
         return(0);
     if (res == -1) {
         if (errno != EAGAIN)
@@ -1060,10 +1961,93 @@ ccn_put(struct ccn *h, const void *p, size_t length)
         h->outbuf = ccn_charbuf_create();
         h->outbufindex = 0;
     }
+    if (res < hdrlen) {
+        ccn_charbuf_append(h->outbuf, hdr + res, hdrlen - res);
+        res = 0;
+    }
+    else
+        res -= hdrlen;
     ccn_charbuf_append(h->outbuf, ((const unsigned char *)p)+res, length-res);
     return(1);
 }
 
+/**
+ * Send a message whose bytes are also held in a file.
+ *
+ * When the connection is a plain socket with nothing queued ahead,
+ * the bytes go from the file to the socket within the kernel.  Any
+ * part that does not fit is queued from p, as ccn_put would.
+ * @param p - the message, which must be one well-formed ccnb object
+ * @param fd - an open file holding the same bytes at offset
+ * @returns -1 for error, 0 if sent completely, 1 if queued.
+ */
+int
+ccn_put_from_file(struct ccn *h, const void *p, size_t length,
+                  int fd, off_t offset)
+{
+#if defined(CCN_HAVE_SENDFILE)
+    ssize_t res;
+    if (h == NULL)
+        return(-1);
+    if (p == NULL || length == 0 || fd < 0 || h->sock == -1 ||
+        h->shm != NULL || h->tap != -1 || h->batching > 0 ||
+        ccn_output_is_pending(h))
+        return(ccn_put(h, p, length));
+    res = sendfile(h->sock, fd, &offset, length);
+    if (res == length)
+        return(0);
+    if (res == -1) {
+        if (errno == EINVAL || errno == ENOSYS)
+            return(ccn_put(h, p, length));
+        if (errno != EAGAIN)
+            return(NOTE_ERRNO(h));
+        res = 0;
+    }
+    if (h->outbuf == NULL) {
+        h->outbuf = ccn_charbuf_create();
+        h->outbufindex = 0;
+    }
+    ccn_charbuf_append(h->outbuf, ((const unsigned char *)p) + res, length - res);
+    return(1);
+#else
+    return(ccn_put(h, p, length));
+#endif
+}
+
+/**
+ * Start a batch of output.
+ *
+ * Until the matching ccn_batch_end, ccn_put (and so ccn_express_interest)
+ * only queues what it is given, so that a burst of small messages goes
+ * to ccnd in one write rather than one each.  Batches may nest; the
+ * output goes when the outermost one ends, or sooner if a lot of it has
+ * built up.  ccn_run batches the output of the upcalls and scheduled
+ * work of each pass through its loop.
+ * @param h is the ccn handle.
+ */
+void
+ccn_batch_begin(struct ccn *h)
+{
+    if (h != NULL)
+        h->batching++;
+}
+
+/**
+ * End a batch of output started by ccn_batch_begin.
+ * @param h is the ccn handle.
+ * @returns -1 for error, 0 if all the output has been sent,
+ *          1 if some is still queued (leaving it to ccn_run to finish).
+ */
+int
+ccn_batch_end(struct ccn *h)
+{
+    if (h == NULL || h->batching <= 0)
+        return(-1);
+    if (--h->batching > 0)
+        return(ccn_output_is_pending(h));
+    return(ccn_pushout(h));
+}
+
 int
 ccn_output_is_pending(struct ccn *h)
 {
@@ -1094,7 +2078,7 @@ ccn_refresh_interest(struct ccn *h, struct expressed_interest *interest)
         if (res >= 0) {
             interest->outstanding += 1;
             if (h->now.tv_sec == 0)
-                gettimeofday(&h->now, NULL);
+                ccn_note_time(h);
             interest->lasttime = h->now;
         }
     }
@@ -1150,12 +2134,155 @@ ccn_digest_Content(const unsigned char *content_object,
     ccn_digest_destroy(&d);
 }
 
-static int
-ccn_cache_key(struct ccn *h,
-              const unsigned char *ccnb, size_t size,
-              struct ccn_parsed_ContentObject *pco)
-{
-    int type;
+/*
+ * The on-disk key cache
+ *
+ * Public keys that arrive as content are also written to a directory,
+ * one file per key named by the hex digest of the key (its publisher
+ * id), so that later processes need not fetch them again.  A file is
+ * used only while it is younger than the time to live, and only if its
+ * digest is still the one it is named by, so a damaged or planted file
+ * is no worse than a missing one.  CCNX_KEY_CACHE turns this on: "1"
+ * puts the cache in the keycache subdirectory of the directory of the
+ * default keystore, and anything else (but "0") names the directory.
+ * CCNX_KEY_CACHE_TTL gives the time to live, in seconds.
+ */
+static void
+ccn_keycache_init(struct ccn *h)
+{
+    const char *s;
+    
+    h->keycache_ttl = CCN_KEYCACHE_TTL;
+    s = getenv("CCNX_KEY_CACHE_TTL");
+    if (s != NULL && s[0] != 0 && atoi(s) > 0)
+        h->keycache_ttl = atoi(s);
+    s = getenv("CCNX_KEY_CACHE");
+    if (s == NULL || s[0] == 0 || strcmp(s, "0") == 0)
+        return;
+    h->keycache = ccn_charbuf_create();
+    if (h->keycache == NULL)
+        return;
+    if (strcmp(s, "1") != 0)
+        ccn_charbuf_append_string(h->keycache, s);
+    else {
+        s = getenv("CCNX_DIR");
+        if (s != NULL && s[0] != 0)
+            ccn_charbuf_putf(h->keycache, "%s/keycache", s);
+        else {
+            s = getenv("HOME");
+            ccn_charbuf_putf(h->keycache, "%s/.ccnx/keycache",
+                             s != NULL ? s : "");
+        }
+    }
+}
+
+static void
+ccn_keycache_path(struct ccn *h, const unsigned char *pkeyid,
+                  size_t pkeyid_size, struct ccn_charbuf *c)
+{
+    size_t i;
+    
+    ccn_charbuf_putf(c, "%s/", ccn_charbuf_as_string(h->keycache));
+    for (i = 0; i < pkeyid_size; i++)
+        ccn_charbuf_putf(c, "%02x", pkeyid[i]);
+}
+
+/**
+ * Look for a public key in the on-disk key cache.
+ * @returns the key, or NULL if it is not there or not usable.
+ */
+static struct ccn_pkey *
+ccn_keycache_read(struct ccn *h, const unsigned char *pkeyid,
+                  size_t pkeyid_size)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccn_digest *digest = NULL;
+    struct ccn_pkey *pkey = NULL;
+    unsigned char buf[CCN_KEYCACHE_MAX];
+    unsigned char md[32];
+    struct timeval now;
+    struct stat st;
+    ssize_t n;
+    size_t have = 0;
+    int fd;
+    
+    if (h->keycache == NULL || pkeyid_size != sizeof(md))
+        return(NULL);
+    path = ccn_charbuf_create();
+    ccn_keycache_path(h, pkeyid, pkeyid_size, path);
+    fd = open(ccn_charbuf_as_string(path), O_RDONLY | O_NOFOLLOW);
+    ccn_charbuf_destroy(&path);
+    if (fd == -1)
+        return(NULL);
+    gettimeofday(&now, NULL);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size <= 0 || st.st_size > CCN_KEYCACHE_MAX ||
+        now.tv_sec - st.st_mtime > h->keycache_ttl)
+        goto Finish;
+    while (have < (size_t)st.st_size) {
+        n = read(fd, buf + have, st.st_size - have);
+        if (n <= 0)
+            goto Finish;
+        have += n;
+    }
+    digest = ccn_digest_create(CCN_DIGEST_SHA256);
+    ccn_digest_init(digest);
+    if (ccn_digest_size(digest) != sizeof(md) ||
+        ccn_digest_update(digest, buf, have) < 0 ||
+        ccn_digest_final(digest, md, sizeof(md)) < 0 ||
+        memcmp(md, pkeyid, sizeof(md)) != 0)
+        goto Finish;
+    pkey = ccn_d2i_pubkey(buf, have);
+Finish:
+    ccn_digest_destroy(&digest);
+    close(fd);
+    return(pkey);
+}
+
+/**
+ * Put a public key in the on-disk key cache, if there is one.
+ *
+ * The key is written to a temporary and moved into place, so readers
+ * never see part of one.
+ */
+static void
+ccn_keycache_write(struct ccn *h, const unsigned char *pkeyid,
+                   size_t pkeyid_size,
+                   const unsigned char *data, size_t data_size)
+{
+    struct ccn_charbuf *path = NULL;
+    struct ccn_charbuf *temp = NULL;
+    int fd;
+    int ok;
+    
+    if (h->keycache == NULL || data_size > CCN_KEYCACHE_MAX)
+        return;
+    path = ccn_charbuf_create();
+    temp = ccn_charbuf_create();
+    ccn_keycache_path(h, pkeyid, pkeyid_size, path);
+    ccn_charbuf_putf(temp, "%s.XXXXXX", ccn_charbuf_as_string(path));
+    fd = mkstemp(ccn_charbuf_as_string(temp));
+    if (fd == -1 && errno == ENOENT &&
+        mkdir(ccn_charbuf_as_string(h->keycache), 0700) == 0)
+        fd = mkstemp(ccn_charbuf_as_string(temp));
+    if (fd != -1) {
+        ok = (write(fd, data, data_size) == (ssize_t)data_size);
+        if (close(fd) != 0)
+            ok = 0;
+        if (!ok || rename(ccn_charbuf_as_string(temp),
+                          ccn_charbuf_as_string(path)) != 0)
+            unlink(ccn_charbuf_as_string(temp));
+    }
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&temp);
+}
+
+static int
+ccn_cache_key(struct ccn *h,
+              const unsigned char *ccnb, size_t size,
+              struct ccn_parsed_ContentObject *pco)
+{
+    int type;
     struct ccn_pkey **entry;
     struct hashtb_enumerator ee;
     struct hashtb_enumerator *e = &ee;
@@ -1194,6 +2321,7 @@ ccn_cache_key(struct ccn *h,
             return(NOTE_ERRNO(h));
         }
         *entry = pkey;
+        ccn_keycache_write(h, digest, sizeof(digest), data, data_size);
     }
     hashtb_end(e);
     return (0);
@@ -1227,8 +2355,11 @@ ccn_locate_key(struct ccn *h,
     const unsigned char *pkeyid;
     size_t pkeyid_size;
     struct ccn_pkey **entry;
+    struct ccn_pkey *cached;
     struct ccn_buf_decoder decoder;
     struct ccn_buf_decoder *d;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
 
     if (h->keys == NULL) {
         return (NOTE_ERR(h, EINVAL));
@@ -1245,6 +2376,24 @@ ccn_locate_key(struct ccn *h,
         *pubkey = *entry;
         return (0);
     }
+    /* A process before us may have fetched it */
+    cached = ccn_keycache_read(h, pkeyid, pkeyid_size);
+    if (cached != NULL) {
+        hashtb_start(h->keys, e);
+        res = hashtb_seek(e, pkeyid, pkeyid_size, 0);
+        if (res == HT_NEW_ENTRY) {
+            entry = e->data;
+            *entry = cached;
+            *pubkey = cached;
+            res = 0;
+        }
+        else {
+            ccn_pubkey_free(cached);
+            res = NOTE_ERRNO(h);
+        }
+        hashtb_end(e);
+        return (res);
+    }
     /* Is a key locator present? */
     if (pco->offset[CCN_PCO_B_KeyLocator] == pco->offset[CCN_PCO_E_KeyLocator])
         return (-1);
@@ -1261,8 +2410,6 @@ ccn_locate_key(struct ccn *h,
         struct ccn_digest *digest = NULL;
         unsigned char *key_digest = NULL;
         size_t key_digest_size;
-        struct hashtb_enumerator ee;
-        struct hashtb_enumerator *e = &ee;
 
         res = ccn_ref_tagged_BLOB(CCN_DTAG_Key, msg,
                                   pco->offset[CCN_PCO_B_Key_Certificate_KeyName],
@@ -1331,6 +2478,33 @@ ccn_append_link_name(struct ccn_charbuf *name, const unsigned char *data, size_t
     return(-1);
 }
 
+/**
+ * Forget a finished key fetch, so that the next need for the key may
+ * start another.
+ */
+static void
+ccn_key_fetch_done(struct ccn *h, struct ccn_closure *selfp)
+{
+    struct ccn_charbuf *pkeyid = selfp->data;
+    struct ccn_closure **entry;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    
+    if (pkeyid == NULL)
+        return;
+    if (h != NULL && h->key_fetches != NULL) {
+        hashtb_start(h->key_fetches, e);
+        if (hashtb_seek(e, pkeyid->buf, pkeyid->length, 0) >= 0) {
+            entry = e->data;
+            if (*entry == selfp || *entry == NULL)
+                hashtb_delete(e);
+        }
+        hashtb_end(e);
+    }
+    ccn_charbuf_destroy(&pkeyid);
+    selfp->data = NULL;
+}
+
 /**
  * Called when we get an answer to a KeyLocator fetch issued by
  * ccn_initiate_key_fetch.  This does not really have to do much,
@@ -1355,6 +2529,7 @@ handle_key(struct ccn_closure *selfp,
     
     switch(kind) {
         case CCN_UPCALL_FINAL:
+            ccn_key_fetch_done(h, selfp);
             free(selfp);
             return(CCN_UPCALL_RESULT_OK);
         case CCN_UPCALL_INTEREST_TIMED_OUT:
@@ -1422,7 +2597,8 @@ ccn_initiate_key_fetch(struct ccn *h,
     /* 
      * Create a new interest in the key name, set up a callback that will
      * insert the key into the h->keys hashtb for the calling handle and
-     * cause the trigger_interest to be re-expressed.
+     * cause the trigger_interest to be re-expressed.  Only one fetch per
+     * key is out at a time; the triggers of the rest just wait for it.
      */
     int res;
     int namelen;
@@ -1431,20 +2607,27 @@ ccn_initiate_key_fetch(struct ccn *h,
     const unsigned char *pkeyid = NULL;
     size_t pkeyid_size = 0;
     struct ccn_charbuf *templ = NULL;
+    struct ccn_closure **entry = NULL;
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
     
+    res = ccn_ref_tagged_BLOB(CCN_DTAG_PublisherPublicKeyDigest, msg,
+                              pco->offset[CCN_PCO_B_PublisherPublicKeyDigest],
+                              pco->offset[CCN_PCO_E_PublisherPublicKeyDigest],
+                              &pkeyid, &pkeyid_size);
+    if (res < 0)
+        pkeyid = NULL;
     if (trigger_interest != NULL) {
         /* Arrange a wakeup when the key arrives */
         if (trigger_interest->wanted_pub == NULL)
             trigger_interest->wanted_pub = ccn_charbuf_create();
-        res = ccn_ref_tagged_BLOB(CCN_DTAG_PublisherPublicKeyDigest, msg,
-                                  pco->offset[CCN_PCO_B_PublisherPublicKeyDigest],
-                                  pco->offset[CCN_PCO_E_PublisherPublicKeyDigest],
-                                  &pkeyid, &pkeyid_size);
-        if (trigger_interest->wanted_pub != NULL && res >= 0) {
+        if (trigger_interest->wanted_pub != NULL && pkeyid != NULL) {
             trigger_interest->wanted_pub->length = 0;
             ccn_charbuf_append(trigger_interest->wanted_pub, pkeyid, pkeyid_size);
         }
         trigger_interest->target = 0;
+        /* The key may be here already */
+        h->check_wanted_pub = 1;
     }
 
     namelen = (pco->offset[CCN_PCO_E_KeyName_Name] -
@@ -1455,11 +2638,26 @@ ccn_initiate_key_fetch(struct ccn *h,
      */
     if (namelen == 0)
         return(-1);
+    if (pkeyid != NULL && hashtb_lookup(h->key_fetches, pkeyid, pkeyid_size) != NULL)
+        return(0); /* already on its way */
     key_closure = calloc(1, sizeof(*key_closure));
     if (key_closure == NULL)
         return (NOTE_ERRNO(h));
     key_closure->p = &handle_key;
     key_closure->intdata = CCN_MAX_KEY_LINK_CHAIN; /* to limit how many links we will resolve */
+    if (pkeyid != NULL) {
+        hashtb_start(h->key_fetches, e);
+        if (hashtb_seek(e, pkeyid, pkeyid_size, 0) == HT_NEW_ENTRY) {
+            entry = e->data;
+            *entry = key_closure;
+            key_closure->data = ccn_charbuf_create();
+            if (key_closure->data == NULL)
+                hashtb_delete(e);
+            else
+                ccn_charbuf_append(key_closure->data, pkeyid, pkeyid_size);
+        }
+        hashtb_end(e);
+    }
     
     key_name = ccn_charbuf_create();
     res = ccn_charbuf_append(key_name,
@@ -1479,6 +2677,10 @@ ccn_initiate_key_fetch(struct ccn *h,
     }
     ccn_charbuf_append_closer(templ); /* </Interest> */
     res = ccn_express_interest(h, key_name, key_closure, templ);
+    if (res < 0 && key_closure->refcount == 0) {
+        ccn_key_fetch_done(h, key_closure);
+        free(key_closure);
+    }
     ccn_charbuf_destroy(&key_name);
     ccn_charbuf_destroy(&templ);
     return(res);
@@ -1501,6 +2703,263 @@ ccn_check_pub_arrival(struct ccn *h, struct expressed_interest *interest)
     }
 }
 
+static void
+ccn_verified_unlink(struct verified_entry *v)
+{
+    if (v->older != NULL)
+        v->older->newer = v->newer;
+    else
+        ccn_verified_oldest = v->newer;
+    if (v->newer != NULL)
+        v->newer->older = v->older;
+    else
+        ccn_verified_newest = v->older;
+    v->older = v->newer = NULL;
+}
+
+static void
+ccn_verified_link(struct verified_entry *v)
+{
+    v->older = ccn_verified_newest;
+    v->newer = NULL;
+    if (ccn_verified_newest != NULL)
+        ccn_verified_newest->newer = v;
+    else
+        ccn_verified_oldest = v;
+    ccn_verified_newest = v;
+}
+
+/**
+ * Make the key under which a verified object is remembered: the digest
+ * of the whole object (signature included) followed by the digest of
+ * the key used.  Only keys found by publisher digest in the handle's
+ * key cache are eligible, since for them the publisher digest is known
+ * to be the key's.
+ * @returns 0, or -1 if the object is not eligible.
+ */
+static int
+ccn_verified_key(struct ccn *h,
+                 const unsigned char *msg,
+                 struct ccn_parsed_ContentObject *pco,
+                 const struct ccn_pkey *pubkey,
+                 unsigned char *key, size_t *keysize)
+{
+    struct ccn_pkey **entry;
+    const unsigned char *pkeyid = NULL;
+    size_t pkeyid_size = 0;
+    int res;
+
+    if (ccn_verified == NULL)
+        return(-1);
+    res = ccn_ref_tagged_BLOB(CCN_DTAG_PublisherPublicKeyDigest, msg,
+                              pco->offset[CCN_PCO_B_PublisherPublicKeyDigest],
+                              pco->offset[CCN_PCO_E_PublisherPublicKeyDigest],
+                              &pkeyid, &pkeyid_size);
+    if (res < 0 || pkeyid_size > 64 - sizeof(pco->digest))
+        return(-1);
+    entry = hashtb_lookup(h->keys, pkeyid, pkeyid_size);
+    if (entry == NULL || *entry != pubkey)
+        return(-1);
+    ccn_digest_ContentObject(msg, pco);
+    memcpy(key, pco->digest, sizeof(pco->digest));
+    memcpy(key + sizeof(pco->digest), pkeyid, pkeyid_size);
+    *keysize = sizeof(pco->digest) + pkeyid_size;
+    return(0);
+}
+
+/**
+ * @returns 1 if a ContentObject is among those remembered as having
+ *          verified with pubkey.
+ */
+static int
+ccn_verified_check(struct ccn *h,
+                   const unsigned char *msg,
+                   struct ccn_parsed_ContentObject *pco,
+                   const struct ccn_pkey *pubkey)
+{
+    struct verified_entry *v;
+    unsigned char key[64];
+    size_t keysize;
+    int ans = 0;
+
+    if (ccn_verified_key(h, msg, pco, pubkey, key, &keysize) < 0)
+        return(0);
+    pthread_mutex_lock(&ccn_verified_lock);
+    v = hashtb_lookup(ccn_verified, key, keysize);
+    if (v != NULL) {
+        if (v != ccn_verified_newest) {
+            ccn_verified_unlink(v);
+            ccn_verified_link(v);
+        }
+        ans = 1;
+    }
+    pthread_mutex_unlock(&ccn_verified_lock);
+    return(ans);
+}
+
+/**
+ * Remember that a ContentObject has verified with pubkey, forgetting
+ * the least recently used entry once CCN_VERIFIED_CACHE_SIZE are held.
+ */
+static void
+ccn_verified_note(struct ccn *h,
+                  const unsigned char *msg,
+                  struct ccn_parsed_ContentObject *pco,
+                  const struct ccn_pkey *pubkey)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct verified_entry *v;
+    unsigned char key[64];
+    size_t keysize;
+
+    if (ccn_verified_key(h, msg, pco, pubkey, key, &keysize) < 0)
+        return;
+    pthread_mutex_lock(&ccn_verified_lock);
+    hashtb_start(ccn_verified, e);
+    if (hashtb_n(ccn_verified) >= CCN_VERIFIED_CACHE_SIZE) {
+        v = ccn_verified_oldest;
+        ccn_verified_unlink(v);
+        if (hashtb_seek(e, v->key, v->keysize, 0) >= 0)
+            hashtb_delete(e);
+    }
+    if (hashtb_seek(e, key, keysize, 0) == HT_NEW_ENTRY) {
+        v = e->data;
+        memcpy(v->key, key, keysize);
+        v->keysize = keysize;
+        ccn_verified_link(v);
+    }
+    hashtb_end(e);
+    pthread_mutex_unlock(&ccn_verified_lock);
+}
+
+/**
+ * Verify the signature of a ContentObject, remembering those that pass
+ * so that the same object need not be checked again by this or any
+ * other handle in the process.
+ *
+ * An object that is checked against a different key is verified afresh,
+ * since the key is part of what is remembered.  Only successes are
+ * remembered.  The table is locked for the lookup and for the update,
+ * but not during the check.
+ * @returns as for ccn_verify_signature: 1 if the signature is good.
+ */
+static int
+ccn_verify_signature_cached(struct ccn *h,
+                            const unsigned char *msg, size_t size,
+                            struct ccn_parsed_ContentObject *pco,
+                            const struct ccn_pkey *pubkey)
+{
+    int res;
+
+    if (ccn_verified_check(h, msg, pco, pubkey))
+        return(1);
+    res = ccn_verify_signature(msg, size, pco, pubkey);
+    if (res == 1)
+        ccn_verified_note(h, msg, pco, pubkey);
+    return(res);
+}
+
+/**
+ * Verify an object whose signature needs no public key.
+ *
+ * HMAC signatures are checked with the local key, which is loaded if
+ * need be, but never created here.
+ * @returns 1 if the signature is good, 0 if it is not, or -1 if the
+ *          object has a public key signature.
+ */
+static int
+ccn_verify_local(struct ccn *h,
+                 const unsigned char *msg, size_t size,
+                 struct ccn_parsed_ContentObject *pco)
+{
+    int kind;
+    int res;
+    
+    kind = ccn_signature_kind(msg, pco);
+    if (kind == CCN_SIG_PUBKEY)
+        return(-1);
+    if (kind == CCN_SIG_HMAC && h->local_key == NULL &&
+        ccn_load_local_key_1(h, NULL, 0) < 0)
+        return(0);
+    if (kind == CCN_SIG_HMAC)
+        res = ccn_verify_symmetric_signature(msg, size, pco,
+                                             h->local_key->buf,
+                                             h->local_key->length);
+    else
+        res = ccn_verify_symmetric_signature(msg, size, pco, NULL, 0);
+    return(res == 1);
+}
+
+/**
+ * Hold a message at the end of the queue of held messages.
+ * @returns the entry, or NULL if out of memory.
+ */
+static struct ccn_held *
+ccn_hold_message(struct ccn *h, const unsigned char *msg, size_t size)
+{
+    struct ccn_held *held;
+
+    held = calloc(1, sizeof(*held));
+    if (held == NULL)
+        return(NULL);
+    held->msg = ccn_charbuf_create();
+    if (held->msg == NULL || ccn_charbuf_append(held->msg, msg, size) < 0) {
+        ccn_charbuf_destroy(&held->msg);
+        free(held);
+        return(NULL);
+    }
+    held->verdict = -1;
+    *h->held_tail = held;
+    h->held_tail = &held->next;
+    return(held);
+}
+
+/**
+ * Have a verifier thread check the signature of a ContentObject.
+ *
+ * The message is held until the check is done, unless it is the one
+ * being delivered from the queue, which just stays at the front.
+ * @returns 0 if the check is under way, or -1 if the caller should
+ *          verify the object itself.
+ */
+static int
+ccn_hold_for_check(struct ccn *h,
+                   const unsigned char *msg, size_t size,
+                   struct ccn_parsed_ContentObject *pco,
+                   const struct ccn_pkey *pubkey)
+{
+    struct ccn_held *held = h->delivering;
+
+    if (ccn_verifier_threads(h->verifier) == 0)
+        return(-1);
+    if (ccn_verified_check(h, msg, pco, pubkey))
+        return(-1);
+    if (held == NULL) {
+        held = ccn_hold_message(h, msg, size);
+        if (held == NULL)
+            return(-1);
+    }
+    held->pco = *pco;
+    held->pubkey = pubkey;
+    if (ccn_verifier_submit(h->verifier, held->msg->buf, held->msg->length,
+                            &held->pco, pubkey, held) < 0) {
+        if (held != h->delivering) {
+            /* it is last in the queue, so take it back off */
+            struct ccn_held **pp;
+            for (pp = &h->held; *pp != held; pp = &(*pp)->next)
+                continue;
+            *pp = NULL;
+            h->held_tail = pp;
+            ccn_charbuf_destroy(&held->msg);
+            free(held);
+        }
+        return(-1);
+    }
+    held->checking = 1;
+    return(0);
+}
+
 /**
  * Dispatch a message through the registered upcalls.
  * This is not used by normal ccn clients, but is made available for use when
@@ -1518,6 +2977,11 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
     int res;
     enum ccn_upcall_res ures;
     
+    /* Keep behind anything held for a signature check */
+    if (h->held != NULL && h->delivering == NULL) {
+        if (ccn_hold_message(h, msg, size) != NULL)
+            return;
+    }
     h->running++;
     info.h = h;
     info.pi = &pi;
@@ -1528,26 +2992,35 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
         enum ccn_upcall_kind upcall_kind = CCN_UPCALL_INTEREST;
         info.interest_ccnb = msg;
         if (h->interest_filters != NULL && info.interest_comps->n > 0) {
-            struct ccn_indexbuf *comps = info.interest_comps;
-            size_t keystart = comps->buf[0];
-            unsigned char *key = msg + keystart;
-            struct interest_filter *entry;
-            for (i = comps->n - 1; i >= 0; i--) {
-                entry = hashtb_lookup(h->interest_filters, key, comps->buf[i] - keystart);
-                if (entry != NULL) {
-                    info.matched_comps = i;
-                    ures = (entry->action->p)(entry->action, upcall_kind, &info);
-                    if (ures == CCN_UPCALL_RESULT_INTEREST_CONSUMED)
-                        upcall_kind = CCN_UPCALL_CONSUMED_INTEREST;
-                }
+            struct ifilt_match mbuf[CCN_IFILT_MATCH_STACK];
+            struct ifilt_match *m = mbuf;
+            int nm = 0;
+            if (info.interest_comps->n > CCN_IFILT_MATCH_STACK)
+                m = calloc(info.interest_comps->n, sizeof(*m));
+            if (m != NULL)
+                nm = ifilt_trie_match(h, msg, info.interest_comps, m);
+            /* Longest match first */
+            for (i = nm - 1; i >= 0; i--) {
+                info.matched_comps = m[i].matched_comps;
+                ures = (m[i].action->p)(m[i].action, upcall_kind, &info);
+                if (ures == CCN_UPCALL_RESULT_INTEREST_CONSUMED)
+                    upcall_kind = CCN_UPCALL_CONSUMED_INTEREST;
             }
+            for (i = 0; i < nm; i++)
+                ccn_replace_handler(h, &m[i].action, NULL);
+            if (m != mbuf)
+                free(m);
         }
     }
     else {
         /* This message should be a ContentObject. */
         struct ccn_parsed_ContentObject obj = {0};
+        /* 1 or 0 once the signature is checked, for each match */
+        int verdict = -1;
+        if (h->delivering != NULL)
+            verdict = h->delivering->verdict;
         info.pco = &obj;
-        info.content_comps = ccn_indexbuf_create();
+        info.content_comps = ccn_indexbuf_obtain(h);
         res = ccn_parse_ContentObject(msg, size, &obj, info.content_comps);
         if (res >= 0) {
             info.content_ccnb = msg;
@@ -1580,19 +3053,33 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
                                     int type = ccn_get_content_type(msg, info.pco);
                                     if (type == CCN_CONTENT_KEY)
                                         res = ccn_cache_key(h, msg, size, info.pco);
-                                    res = ccn_locate_key(h, msg, info.pco, &pubkey);
-                                    if (h->defer_verification) {
-                                        if (res == 0)
+                                    res = ccn_verify_local(h, msg, size, info.pco);
+                                    if (res >= 0) {
+                                        /* digest-only or HMAC, no key to find */
+                                        if (h->defer_verification)
                                             upcall_kind = CCN_UPCALL_CONTENT_RAW;
-                                        else
-                                            upcall_kind = CCN_UPCALL_CONTENT_KEYMISSING;
+                                        else if (res != 1)
+                                            upcall_kind = CCN_UPCALL_CONTENT_BAD;
+                                    }
+                                    else {
+                                        res = ccn_locate_key(h, msg, info.pco, &pubkey);
+                                        if (h->defer_verification) {
+                                            if (res == 0)
+                                                upcall_kind = CCN_UPCALL_CONTENT_RAW;
+                                            else
+                                                upcall_kind = CCN_UPCALL_CONTENT_KEYMISSING;
+                                        }
+                                        else if (res == 0) {
+                                            /* we have the pubkey, use it to verify the msg */
+                                            if (verdict < 0 && h->verifier != NULL &&
+                                                ccn_hold_for_check(h, msg, size, info.pco, pubkey) == 0)
+                                                goto Held;
+                                            if (verdict < 0)
+                                                verdict = (ccn_verify_signature_cached(h, msg, size, info.pco, pubkey) == 1);
+                                            upcall_kind = verdict ? CCN_UPCALL_CONTENT : CCN_UPCALL_CONTENT_BAD;
+                                        } else
+                                            upcall_kind = CCN_UPCALL_CONTENT_UNVERIFIED;
                                     }
-                                    else if (res == 0) {
-                                        /* we have the pubkey, use it to verify the msg */
-                                        res = ccn_verify_signature(msg, size, info.pco, pubkey);
-                                        upcall_kind = (res == 1) ? CCN_UPCALL_CONTENT : CCN_UPCALL_CONTENT_BAD;
-                                    } else
-                                        upcall_kind = CCN_UPCALL_CONTENT_UNVERIFIED;
                                     interest->outstanding -= 1;
                                     info.interest_ccnb = interest->interest_msg;
                                     info.matched_comps = i;
@@ -1614,11 +3101,9 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
                                         /* For now, call this a client bug. */
                                         abort();
                                     }
-                                    else {
+                                    else
                                         interest->target = 0;
-                                        replace_interest_msg(interest, NULL);
-                                        ccn_replace_handler(h, &(interest->action), NULL);
-                                    }
+                                    ccn_settle_interest(h, interest);
                                 }
                             }
                         }
@@ -1627,66 +3112,330 @@ ccn_dispatch_message(struct ccn *h, unsigned char *msg, size_t size)
             }
         }
     } // XXX whew, what a lot of right braces!
+Held:
     ccn_indexbuf_release(h, info.interest_comps);
-    ccn_indexbuf_destroy(&info.content_comps);
+    ccn_indexbuf_release(h, info.content_comps);
     h->running--;
 }
 
-static int
-ccn_process_input(struct ccn *h)
+/**
+ * Deliver the held messages whose signature checks are done.
+ *
+ * Delivery stops at the first message that is still being checked,
+ * which may be one that turned out to need checking only now.
+ */
+static void
+ccn_held_deliver(struct ccn *h)
 {
-    ssize_t res;
-    ssize_t msgstart;
-    unsigned char *buf;
-    struct ccn_skeleton_decoder *d = &h->decoder;
-    struct ccn_charbuf *inbuf = h->inbuf;
-    if (inbuf == NULL)
-        h->inbuf = inbuf = ccn_charbuf_create();
-    if (inbuf->length == 0)
-        memset(d, 0, sizeof(*d));
-    buf = ccn_charbuf_reserve(inbuf, 8800);
-    res = read(h->sock, buf, inbuf->limit - inbuf->length);
-    if (res == 0) {
-        ccn_disconnect(h);
-        return(-1);
-    }
-    if (res == -1) {
-        if (errno == EAGAIN)
-            res = 0;
-        else
-            return(NOTE_ERRNO(h));
-    }
-    inbuf->length += res;
-    msgstart = 0;
-    ccn_skeleton_decode(d, buf, res);
-    while (d->state == 0) {
-        ccn_dispatch_message(h, inbuf->buf + msgstart, 
-                              d->index - msgstart);
-        msgstart = d->index;
-        if (msgstart == inbuf->length) {
-            inbuf->length = 0;
-            return(0);
-        }
-        ccn_skeleton_decode(d, inbuf->buf + d->index,
-                            inbuf->length - d->index);
+    struct ccn_held *held;
+    void *tag = NULL;
+    int res;
+
+    while (ccn_verifier_reap(h->verifier, &tag, &res)) {
+        held = tag;
+        held->checking = 0;
+        held->verdict = (res == 1);
+        if (held->verdict)
+            ccn_verified_note(h, held->msg->buf, &held->pco,
+                              held->pubkey);
     }
-    if (msgstart < inbuf->length && msgstart > 0) {
-        /* move partial message to start of buffer */
-        memmove(inbuf->buf, inbuf->buf + msgstart,
-                inbuf->length - msgstart);
-        inbuf->length -= msgstart;
-        d->index -= msgstart;
+    while ((held = h->held) != NULL && !held->checking) {
+        h->delivering = held;
+        ccn_dispatch_message(h, held->msg->buf, held->msg->length);
+        h->delivering = NULL;
+        if (held->checking)
+            break;
+        h->held = held->next;
+        if (h->held == NULL)
+            h->held_tail = &h->held;
+        ccn_charbuf_destroy(&held->msg);
+        free(held);
     }
-    return(0);
 }
 
+/**
+ * Deliver the held messages that are ready, as one batch of output.
+ *
+ * Once the verifier is stopped, that is all of them.
+ */
 static void
-ccn_update_refresh_us(struct ccn *h, struct timeval *tv)
+ccn_held_flush(struct ccn *h)
 {
-    int delta;
-    if (tv->tv_sec < h->now.tv_sec)
+    ccn_batch_begin(h);
+    ccn_held_deliver(h);
+    ccn_batch_end(h);
+}
+
+/**
+ * Dispatch the complete messages in h->inbuf, given that the last res
+ * bytes of it (starting at buf) have just arrived.
+ */
+static void
+ccn_inblock_release(struct ccn_inblock **bp)
+{
+    struct ccn_inblock *b = *bp;
+    if (b == NULL)
         return;
-    if (tv->tv_sec > h->now.tv_sec + CCN_INTEREST_LIFETIME_SEC)
+    *bp = NULL;
+    if (--b->refcount > 0)
+        return;
+    ccn_charbuf_destroy(&b->cb);
+    free(b);
+}
+
+/**
+ * Keep part of a received message beyond the upcall that delivered it.
+ *
+ * When the bytes are in the handle's input buffer, as they are for
+ * upcalls made from ccn_run, no copy is made; the handle reads further
+ * input into a fresh buffer instead.  Otherwise the bytes are copied.
+ * @param h is the ccn handle.
+ * @param p points to the bytes, for example info->content_ccnb.
+ * @param size is their length.
+ * @returns the slice, or NULL for error.
+ */
+struct ccn_slice *
+ccn_slice_retain(struct ccn *h, const unsigned char *p, size_t size)
+{
+    struct ccn_slice *s;
+    struct ccn_charbuf *cb = h->inbuf;
+    
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        goto Bail;
+    if (cb != NULL && p >= cb->buf && p + size <= cb->buf + cb->length) {
+        if (h->inblock == NULL) {
+            h->inblock = calloc(1, sizeof(*h->inblock));
+            if (h->inblock == NULL)
+                goto Bail;
+            h->inblock->refcount = 1;
+            h->inblock->cb = cb;
+        }
+        s->block = h->inblock;
+        s->block->refcount++;
+        s->buf = p;
+    }
+    else {
+        s->block = calloc(1, sizeof(*s->block));
+        if (s->block == NULL)
+            goto Bail;
+        s->block->refcount = 1;
+        s->block->cb = ccn_charbuf_create();
+        if (s->block->cb == NULL ||
+            ccn_charbuf_append(s->block->cb, p, size) < 0) {
+            ccn_inblock_release(&s->block);
+            goto Bail;
+        }
+        s->buf = s->block->cb->buf;
+    }
+    s->size = size;
+    return(s);
+Bail:
+    NOTE_ERRNO(h);
+    free(s);
+    return(NULL);
+}
+
+const unsigned char *
+ccn_slice_buf(const struct ccn_slice *s)
+{
+    return(s->buf);
+}
+
+size_t
+ccn_slice_size(const struct ccn_slice *s)
+{
+    return(s->size);
+}
+
+void
+ccn_slice_release(struct ccn_slice **sp)
+{
+    struct ccn_slice *s = *sp;
+    if (s == NULL)
+        return;
+    ccn_inblock_release(&s->block);
+    free(s);
+    *sp = NULL;
+}
+
+/**
+ * Stop reading into an input buffer that slices have been kept from,
+ * carrying over whatever follows msgstart into a fresh buffer.
+ *
+ * If there is no memory for that, the old buffer is left as it is,
+ * and nothing more is read into it until a later call succeeds.
+ * @returns 0, or -1 for error.
+ */
+static int
+ccn_inbuf_replace(struct ccn *h, size_t msgstart)
+{
+    struct ccn_charbuf *old = h->inbuf;
+    struct ccn_charbuf *c;
+    
+    c = ccn_charbuf_create();
+    if (c == NULL ||
+        ccn_charbuf_append(c, old->buf + msgstart, old->length - msgstart) < 0) {
+        ccn_charbuf_destroy(&c);
+        h->inbuf_done = msgstart;
+        return(NOTE_ERRNO(h));
+    }
+    h->decoder.index -= msgstart;
+    h->inbuf = c;
+    h->inbuf_done = 0;
+    ccn_inblock_release(&h->inblock);
+    return(0);
+}
+
+/**
+ * Make sure the input buffer is ours to read into.
+ * @returns 0, or -1 if an earlier ccn_inbuf_replace still cannot be done.
+ */
+static int
+ccn_inbuf_ready(struct ccn *h)
+{
+    if (h->inblock != NULL && h->inbuf != NULL)
+        return(ccn_inbuf_replace(h, h->inbuf_done));
+    return(0);
+}
+
+/**
+ * Dispatch the complete messages in inbuf, given res new bytes at buf
+ * @returns the number of messages dispatched.
+ */
+static int
+ccn_process_inbuf(struct ccn *h, unsigned char *buf, ssize_t res)
+{
+    ssize_t msgstart;
+    int n = 0;
+    struct ccn_skeleton_decoder *d = &h->decoder;
+    struct ccn_charbuf *inbuf = h->inbuf;
+    inbuf->length += res;
+    msgstart = 0;
+    ccn_skeleton_decode(d, buf, res);
+    while (d->state == 0) {
+        ccn_dispatch_message(h, inbuf->buf + msgstart, 
+                              d->index - msgstart);
+        n++;
+        msgstart = d->index;
+        if (msgstart == inbuf->length) {
+            if (h->inblock != NULL)
+                (void)ccn_inbuf_replace(h, msgstart);
+            else
+                inbuf->length = 0;
+            return(n);
+        }
+        ccn_skeleton_decode(d, inbuf->buf + d->index,
+                            inbuf->length - d->index);
+    }
+    if (h->inblock != NULL)
+        (void)ccn_inbuf_replace(h, msgstart);
+    else if (msgstart < inbuf->length && msgstart > 0) {
+        /* move partial message to start of buffer */
+        memmove(inbuf->buf, inbuf->buf + msgstart,
+                inbuf->length - msgstart);
+        inbuf->length -= msgstart;
+        d->index -= msgstart;
+    }
+    return(n);
+}
+
+/**
+ * Take what has arrived through the rings, after clearing the doorbell.
+ * If ccnd has closed the connection, what it left is taken first.
+ */
+static int
+ccn_process_shm_input(struct ccn *h)
+{
+    ssize_t res;
+    unsigned char *buf;
+    int alive;
+    alive = ccn_shmring_drain(h->shm);
+    if (alive == -1)
+        return(NOTE_ERRNO(h));
+    while (h->shm != NULL) {
+        if (h->inbuf == NULL)
+            h->inbuf = ccn_charbuf_create();
+        if (ccn_inbuf_ready(h) < 0)
+            return(-1);
+        if (h->inbuf->length == 0)
+            memset(&h->decoder, 0, sizeof(h->decoder));
+        buf = ccn_charbuf_reserve(h->inbuf, 8800);
+        res = ccn_shmring_read(h->shm, buf, h->inbuf->limit - h->inbuf->length);
+        if (res == 0)
+            break;
+        ccn_process_inbuf(h, buf, res);
+    }
+    if (alive == 0 && h->sock != -1) {
+        ccn_disconnect(h);
+        return(-1);
+    }
+    return(0);
+}
+
+/**
+ * Read what has arrived on the socket and dispatch it
+ *
+ * Reads are repeated until the socket runs dry, so a burst is taken
+ * in one pass through ccn_run, but after CCN_INPUT_BATCH messages we
+ * return so that the scheduled operations get a turn.  We also return
+ * early if an upcall sets the run timeout to 0.
+ * The size of each read adapts to the traffic, between CCN_INBUF_MIN
+ * and CCN_INBUF_MAX.
+ */
+static int
+ccn_process_input(struct ccn *h)
+{
+    ssize_t res;
+    unsigned char *buf;
+    struct ccn_charbuf *inbuf;
+    size_t want;
+    int timeout = h->timeout;
+    int n = 0;
+    if (h->shm != NULL)
+        return(ccn_process_shm_input(h));
+    if (h->inbuf_want < CCN_INBUF_MIN)
+        h->inbuf_want = CCN_INBUF_MIN;
+    while (n < CCN_INPUT_BATCH && h->sock != -1) {
+        if (h->timeout == 0 && timeout != 0)
+            break;
+        if (ccn_inbuf_ready(h) < 0)
+            return(-1);
+        inbuf = h->inbuf;
+        if (inbuf == NULL)
+            h->inbuf = inbuf = ccn_charbuf_create();
+        if (inbuf->length == 0)
+            memset(&h->decoder, 0, sizeof(h->decoder));
+        want = h->inbuf_want;
+        buf = ccn_charbuf_reserve(inbuf, want);
+        if (buf == NULL)
+            return(NOTE_ERRNO(h));
+        res = read(h->sock, buf, want);
+        if (res == 0) {
+            ccn_disconnect(h);
+            return(-1);
+        }
+        if (res == -1) {
+            if (errno == EAGAIN)
+                break;
+            return(NOTE_ERRNO(h));
+        }
+        if ((size_t)res == want && want < CCN_INBUF_MAX)
+            h->inbuf_want = (want * 2 < CCN_INBUF_MAX) ? want * 2 : CCN_INBUF_MAX;
+        else if ((size_t)res < want / 8 && want > CCN_INBUF_MIN)
+            h->inbuf_want = (want / 2 > CCN_INBUF_MIN) ? want / 2 : CCN_INBUF_MIN;
+        n += ccn_process_inbuf(h, buf, res);
+    }
+    return(0);
+}
+
+static void
+ccn_update_refresh_us(struct ccn *h, struct timeval *tv)
+{
+    int delta;
+    if (tv->tv_sec < h->now.tv_sec)
+        return;
+    if (tv->tv_sec > h->now.tv_sec + h->refresh_us / 1000000)
         return;
     delta = (tv->tv_sec  - h->now.tv_sec)*1000000 +
             (tv->tv_usec - h->now.tv_usec);
@@ -1697,9 +3446,7 @@ ccn_update_refresh_us(struct ccn *h, struct timeval *tv)
 }
 
 static void
-ccn_age_interest(struct ccn *h,
-                 struct expressed_interest *interest,
-                 const unsigned char *key, size_t keysize)
+ccn_age_interest(struct ccn *h, struct expressed_interest *interest)
 {
     struct ccn_parsed_interest pi = {0};
     struct ccn_upcall_info info = {0};
@@ -1811,6 +3558,18 @@ ccn_get_schedule(struct ccn *h)
     return(h->schedule);
 }
 
+/**
+ * Get the handle's cache of resolved versions
+ *
+ * ccn_versioning.c makes and uses the cache; it is kept here so that
+ * it goes away with the handle.
+ */
+struct hashtb **
+ccn_version_cache(struct ccn *h)
+{
+    return(&h->version_cache);
+}
+
 /**
  * Set the event schedule in a ccn handle
  * @param h is the ccn handle
@@ -1829,6 +3588,9 @@ ccn_set_schedule(struct ccn *h, struct ccn_schedule *schedule)
  * Process any scheduled operations that are due.
  * This is not used by normal ccn clients, but is made available for use
  * by ccnd to run its internal client.
+ *
+ * Only the expressed interests that are due are looked at; the count
+ * is available afterwards from ccn_interests_aged().
  * @param h is the ccn handle.
  * @returns the number of microseconds until the next thing needs to happen.
  */
@@ -1839,12 +3601,13 @@ ccn_process_scheduled_operations(struct ccn *h)
     struct hashtb_enumerator *e = &ee;
     struct interests_by_prefix *entry;
     struct expressed_interest *ie;
-    int need_clean = 0;
     h->refresh_us = 5 * CCN_INTEREST_LIFETIME_MICROSEC;
-    gettimeofday(&h->now, NULL);
+    h->interests_aged = 0;
+    ccn_note_time(h);
     if (ccn_output_is_pending(h))
         return(h->refresh_us);
     h->running++;
+    ccn_batch_begin(h);
     if (h->interest_filters != NULL) {
         for (hashtb_start(h->interest_filters, e); e->data != NULL; hashtb_next(e)) {
             struct interest_filter *i = e->data;
@@ -1858,32 +3621,53 @@ ccn_process_scheduled_operations(struct ccn *h)
         hashtb_end(e);
     }
     if (h->interests_by_prefix != NULL) {
-        for (hashtb_start(h->interests_by_prefix, e); e->data != NULL; hashtb_next(e)) {
-            entry = e->data;
-            ccn_check_interests(entry->list);
-            if (entry->list == NULL)
-                need_clean = 1;
-            else {
+        /* Keys are never removed, so a change in count means an arrival */
+        if (h->check_wanted_pub || hashtb_n(h->keys) != h->keys_seen) {
+            h->check_wanted_pub = 0;
+            h->keys_seen = hashtb_n(h->keys);
+            for (hashtb_start(h->interests_by_prefix, e); e->data != NULL; hashtb_next(e)) {
+                entry = e->data;
                 for (ie = entry->list; ie != NULL; ie = ie->next) {
-                    ccn_check_pub_arrival(h, ie);
-                    if (ie->target != 0)
-                        ccn_age_interest(h, ie, e->key, e->keysize);
-                    if (ie->target == 0 && ie->wanted_pub == NULL) {
-                        ccn_replace_handler(h, &(ie->action), NULL);
-                        replace_interest_msg(ie, NULL);
-                        need_clean = 1;
+                    if (ie->wanted_pub != NULL) {
+                        ccn_check_pub_arrival(h, ie);
+                        ccn_settle_interest(h, ie);
                     }
                 }
             }
+            hashtb_end(e);
         }
-        hashtb_end(e);
-        if (need_clean)
+        while (h->interest_heap_n > 0) {
+            ie = h->interest_heap[0];
+            if (tv_earlier(&h->now, &ie->due))
+                break;
+            ccn_unschedule_interest(h, ie);
+            h->interests_aged++;
+            ccn_age_interest(h, ie);
+            ccn_settle_interest(h, ie);
+        }
+        if (h->interest_heap_n > 0)
+            ccn_update_refresh_us(h, &h->interest_heap[0]->due);
+        /* Free the dead ones once they are a fair fraction of the total */
+        if (h->dead_interests > 0 && 8 * h->dead_interests >= h->n_interests)
             ccn_clean_all_interests(h);
     }
+    ccn_batch_end(h);
     h->running--;
     return(h->refresh_us);
 }
 
+/**
+ * Report how many expressed interests the most recent
+ * ccn_process_scheduled_operations() had to look after.
+ * @param h is the ccn handle.
+ * @returns the count.
+ */
+int
+ccn_interests_aged(struct ccn *h)
+{
+    return(h->interests_aged);
+}
+
 /**
  * Modify ccn_run timeout.
  *
@@ -1902,6 +3686,81 @@ ccn_set_run_timeout(struct ccn *h, int timeout)
     return(ans);
 }
 
+/**
+ * Get ready to wait for the ccn connection in a client-managed event loop.
+ *
+ * This runs the scheduled operations that are due, including events on
+ * the schedule set with ccn_set_schedule, and tells what to wait for.
+ * @param h is the ccn handle.
+ * @param events is set to the poll(2) events wanted on the connection fd.
+ * @returns the number of microseconds after which ccn_process_ready
+ *          should be called even if the fd does not become ready,
+ *          0 if it should be called right away, or -1 for error.
+ */
+int
+ccn_prepare_poll(struct ccn *h, short *events)
+{
+    int microsec;
+    int s_microsec = -1;
+    if (h->running != 0)
+        return(NOTE_ERR(h, EBUSY));
+    if (h->sock == -1)
+        return(-1);
+    if (h->schedule != NULL) {
+        ccn_batch_begin(h);
+        s_microsec = ccn_schedule_run(h->schedule);
+        ccn_batch_end(h);
+    }
+    microsec = ccn_process_scheduled_operations(h);
+    if (s_microsec >= 0 && s_microsec < microsec)
+        microsec = s_microsec;
+    *events = POLLIN;
+    /* With the rings, ccnd rings us when there is room for output */
+    if (ccn_output_is_pending(h) && h->shm == NULL)
+        *events |= POLLOUT;
+    /* Data may be waiting in the ring without the fd being ready */
+    if (h->shm != NULL && ccn_shmring_idle(h->shm))
+        microsec = 0;
+    /* Come back soon for messages held for signature checks */
+    if (h->held != NULL && microsec > CCN_HELD_POLL_US)
+        microsec = CCN_HELD_POLL_US;
+    return(microsec);
+}
+
+/**
+ * Handle whatever the connection is ready for, without blocking.
+ *
+ * This is the other half of ccn_prepare_poll.
+ * @param h is the ccn handle.
+ * @param revents is the poll(2) revents seen on the connection fd,
+ *        or 0 if the time given by ccn_prepare_poll ran out.
+ * @returns a negative value for error (e.g. the connection was lost),
+ *          zero for success.
+ */
+int
+ccn_process_ready(struct ccn *h, int revents)
+{
+    int res = 0;
+    if (h->running != 0)
+        return(NOTE_ERR(h, EBUSY));
+    if (h->sock == -1)
+        return(-1);
+    if (ccn_output_is_pending(h))
+        ccn_pushout(h);
+    if ((revents & (POLLIN | POLLERR | POLLHUP)) != 0 || h->shm != NULL) {
+        ccn_batch_begin(h);
+        res = ccn_process_input(h);
+        ccn_batch_end(h);
+    }
+    if (h->held != NULL)
+        ccn_held_flush(h);
+    if (h->err == ENOTCONN)
+        ccn_disconnect(h);
+    if (h->sock == -1)
+        return(-1);
+    return(res);
+}
+
 /**
  * Run the ccn client event loop.
  * This may serve as the main event loop for simple apps by passing 
@@ -1914,9 +3773,8 @@ int
 ccn_run(struct ccn *h, int timeout)
 {
     struct timeval start;
-    struct pollfd fds[1];
+    struct pollfd fds[2];
     int microsec;
-    int s_microsec = -1;
     int millisec;
     int res = -1;
     if (h->running != 0)
@@ -1925,16 +3783,11 @@ ccn_run(struct ccn *h, int timeout)
     memset(&start, 0, sizeof(start));
     h->timeout = timeout;
     for (;;) {
-        if (h->sock == -1) {
+        microsec = ccn_prepare_poll(h, &fds[0].events);
+        if (microsec < 0) {
             res = -1;
             break;
         }
-        if (h->schedule != NULL) {
-            s_microsec = ccn_schedule_run(h->schedule);
-        }
-        microsec = ccn_process_scheduled_operations(h);
-        if (s_microsec >= 0 && s_microsec < microsec)
-            microsec = s_microsec;
         timeout = h->timeout;
         if (start.tv_sec == 0)
             start = h->now;
@@ -1947,25 +3800,23 @@ ccn_run(struct ccn *h, int timeout)
             }
         }
         fds[0].fd = h->sock;
-        fds[0].events = POLLIN;
-        if (ccn_output_is_pending(h))
-            fds[0].events |= POLLOUT;
+        fds[0].revents = 0;
+        /* The verifier's fd, while there are messages held */
+        fds[1].fd = -1;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if (h->held != NULL)
+            fds[1].fd = ccn_verifier_fd(h->verifier);
         millisec = microsec / 1000;
         if (timeout >= 0 && timeout < millisec)
             millisec = timeout;
-        res = poll(fds, 1, millisec);
+        res = poll(fds, 2, millisec);
         if (res < 0 && errno != EINTR) {
             res = NOTE_ERRNO(h);
             break;
         }
-        if (res > 0) {
-            if ((fds[0].revents | POLLOUT) != 0)
-                ccn_pushout(h);
-            if ((fds[0].revents | POLLIN) != 0)
-                ccn_process_input(h);
-        }
-        if (h->err == ENOTCONN)
-            ccn_disconnect(h);
+        if (res > 0 || microsec == 0)
+            ccn_process_ready(h, fds[0].revents);
         if (h->timeout == 0)
             break;
     }
@@ -1986,6 +3837,29 @@ struct simple_get_data {
     int res;
 };
 
+/**
+ * Save the results of a get for the caller
+ */
+static void
+save_get_result(struct ccn_upcall_info *info,
+                struct ccn_charbuf *resultbuf,
+                struct ccn_parsed_ContentObject *pcobuf,
+                struct ccn_indexbuf *compsbuf)
+{
+    if (resultbuf != NULL) {
+        resultbuf->length = 0;
+        ccn_charbuf_append(resultbuf,
+                           info->content_ccnb, info->pco->offset[CCN_PCO_E]);
+    }
+    if (pcobuf != NULL)
+        memcpy(pcobuf, info->pco, sizeof(*pcobuf));
+    if (compsbuf != NULL) {
+        compsbuf->n = 0;
+        ccn_indexbuf_append(compsbuf,
+                            info->content_comps->buf, info->content_comps->n);
+    }
+}
+
 /**
  * Upcall for implementing ccn_get()
  */
@@ -2016,23 +3890,58 @@ handle_simple_incoming_content(
     }
     else if (kind != CCN_UPCALL_CONTENT && kind != CCN_UPCALL_CONTENT_RAW)
         return(CCN_UPCALL_RESULT_ERR);
-    if (md->resultbuf != NULL) {
-        md->resultbuf->length = 0;
-        ccn_charbuf_append(md->resultbuf,
-                           info->content_ccnb, info->pco->offset[CCN_PCO_E]);
-    }
-    if (md->pcobuf != NULL)
-        memcpy(md->pcobuf, info->pco, sizeof(*md->pcobuf));
-    if (md->compsbuf != NULL) {
-        md->compsbuf->n = 0;
-        ccn_indexbuf_append(md->compsbuf,
-                            info->content_comps->buf, info->content_comps->n);
-    }
+    save_get_result(info, md->resultbuf, md->pcobuf, md->compsbuf);
     md->res = 0;
     ccn_set_run_timeout(h, 0);
     return(CCN_UPCALL_RESULT_OK);
 }
 
+/**
+ * Find a handle that a blocking get may run
+ *
+ * If h is NULL or already running, a new connection is made, sharing
+ * the keys of h if there is one.
+ * @returns the handle to use, or NULL for error.
+ */
+static struct ccn *
+get_handle(struct ccn *orig_h, struct hashtb **saved_keys)
+{
+    struct ccn *h = orig_h;
+    int res;
+    
+    *saved_keys = NULL;
+    if (h != NULL && !h->running)
+        return(h);
+    h = ccn_create();
+    if (h == NULL)
+        return(NULL);
+    if (orig_h != NULL) { /* Dad, can I borrow the keys? */
+        *saved_keys = h->keys;
+        h->keys = orig_h->keys;
+    }
+    res = ccn_connect(h, NULL);
+    if (res < 0) {
+        if (*saved_keys != NULL)
+            h->keys = *saved_keys;
+        ccn_destroy(&h);
+        return(NULL);
+    }
+    return(h);
+}
+
+/**
+ * Undo get_handle
+ */
+static void
+put_handle(struct ccn *h, struct ccn *orig_h, struct hashtb *saved_keys)
+{
+    if (h != orig_h) {
+        if (saved_keys != NULL)
+            h->keys = saved_keys;
+        ccn_destroy(&h);
+    }
+}
+
 /**
  * Get a single matching ContentObject
  * This is a convenience for getting a single matching ContentObject.
@@ -2053,64 +3962,246 @@ handle_simple_incoming_content(
  * @returns 0 for success, -1 for an error.
  */
 int
-ccn_get(struct ccn *h,
-        struct ccn_charbuf *name,
-        struct ccn_charbuf *interest_template,
-        int timeout_ms,
-        struct ccn_charbuf *resultbuf,
-        struct ccn_parsed_ContentObject *pcobuf,
-        struct ccn_indexbuf *compsbuf,
-        int flags)
+ccn_get(struct ccn *h,
+        struct ccn_charbuf *name,
+        struct ccn_charbuf *interest_template,
+        int timeout_ms,
+        struct ccn_charbuf *resultbuf,
+        struct ccn_parsed_ContentObject *pcobuf,
+        struct ccn_indexbuf *compsbuf,
+        int flags)
+{
+    struct ccn *orig_h = h;
+    struct hashtb *saved_keys = NULL;
+    int res;
+    struct simple_get_data *md;
+    
+    if ((flags & ~((int)CCN_GET_NOKEYWAIT)) != 0)
+        return(-1);
+    h = get_handle(orig_h, &saved_keys);
+    if (h == NULL)
+        return(-1);
+    md = calloc(1, sizeof(*md));
+    md->resultbuf = resultbuf;
+    md->pcobuf = pcobuf;
+    md->compsbuf = compsbuf;
+    md->flags = flags;
+    md->res = -1;
+    md->closure.p = &handle_simple_incoming_content;
+    md->closure.data = md;
+    md->closure.intdata = 1; /* tell upcall to re-express if needed */
+    md->closure.refcount = 1;
+    res = ccn_express_interest(h, name, &md->closure, interest_template);
+    if (res >= 0)
+        res = ccn_run(h, timeout_ms);
+    if (res >= 0)
+        res = md->res;
+    md->resultbuf = NULL;
+    md->pcobuf = NULL;
+    md->compsbuf = NULL;
+    md->closure.intdata = 0;
+    md->closure.refcount--;
+    if (md->closure.refcount == 0)
+        free(md);
+    put_handle(h, orig_h, saved_keys);
+    return(res);
+}
+
+/**
+ * State shared by the requests of one ccn_get_many()
+ */
+struct get_many_data {
+    struct ccn_get_item *items;
+    struct get_many_req **reqs; /**< by item index, once expressed */
+    int n;                      /**< number of items */
+    int next;                   /**< next item to express */
+    int active;                 /**< expressed and not yet answered */
+    int done;                   /**< answered or failed */
+    int ok;                     /**< answered */
+    int flags;
+    ccn_get_action action;
+    void *data;
+};
+
+/**
+ * One outstanding request of a ccn_get_many()
+ *
+ * Like simple_get_data, this may outlive the call, with gm NULL.
+ */
+struct get_many_req {
+    struct ccn_closure closure;
+    struct get_many_data *gm;
+    int i;                      /**< index of item */
+};
+
+static void
+get_many_complete(struct ccn *h, struct get_many_data *gm, int i, int res)
+{
+    gm->items[i].res = res;
+    gm->done++;
+    if (res == 0)
+        gm->ok++;
+    if (gm->action != NULL)
+        (gm->action)(h, gm->data, &gm->items[i]);
+}
+
+/**
+ * Express as many of the remaining items as the concurrency allows
+ */
+static void
+get_many_fill(struct ccn *h, struct get_many_data *gm, int concurrency);
+
+static enum ccn_upcall_res
+handle_get_many_content(struct ccn_closure *selfp,
+                        enum ccn_upcall_kind kind,
+                        struct ccn_upcall_info *info)
+{
+    struct get_many_req *req = selfp->data;
+    struct get_many_data *gm = req->gm;
+    struct ccn_get_item *item = NULL;
+    
+    if (kind == CCN_UPCALL_FINAL) {
+        free(req);
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    if (gm == NULL)
+        return(CCN_UPCALL_RESULT_OK);
+    if (kind == CCN_UPCALL_INTEREST_TIMED_OUT)
+        return(CCN_UPCALL_RESULT_REEXPRESS);
+    if (kind == CCN_UPCALL_CONTENT_UNVERIFIED) {
+        if ((gm->flags & CCN_GET_NOKEYWAIT) == 0)
+            return(CCN_UPCALL_RESULT_VERIFY);
+    }
+    if (kind == CCN_UPCALL_CONTENT_KEYMISSING) {
+        if ((gm->flags & CCN_GET_NOKEYWAIT) == 0)
+            return(CCN_UPCALL_RESULT_FETCHKEY);
+    }
+    else if (kind != CCN_UPCALL_CONTENT && kind != CCN_UPCALL_CONTENT_RAW)
+        return(CCN_UPCALL_RESULT_ERR);
+    item = &gm->items[req->i];
+    save_get_result(info, item->resultbuf, item->pcobuf, item->compsbuf);
+    req->gm = NULL;
+    gm->active--;
+    get_many_complete(info->h, gm, req->i, 0);
+    get_many_fill(info->h, gm, selfp->intdata);
+    if (gm->done == gm->n)
+        ccn_set_run_timeout(info->h, 0);
+    return(CCN_UPCALL_RESULT_OK);
+}
+
+static void
+get_many_fill(struct ccn *h, struct get_many_data *gm, int concurrency)
+{
+    struct get_many_req *req = NULL;
+    struct ccn_get_item *item = NULL;
+    int i;
+    int res;
+    
+    while (gm->next < gm->n && (concurrency <= 0 || gm->active < concurrency)) {
+        i = gm->next++;
+        item = &gm->items[i];
+        req = calloc(1, sizeof(*req));
+        if (req == NULL) {
+            get_many_complete(h, gm, i, -1);
+            continue;
+        }
+        req->gm = gm;
+        req->i = i;
+        req->closure.p = &handle_get_many_content;
+        req->closure.data = req;
+        req->closure.intdata = concurrency;
+        req->closure.refcount = 1; /* held by ccn_get_many */
+        gm->reqs[i] = req;
+        gm->active++;
+        res = ccn_express_interest(h, item->name, &req->closure,
+                                   item->interest_template);
+        if (res < 0) {
+            req->gm = NULL;
+            gm->active--;
+            get_many_complete(h, gm, i, -1);
+        }
+    }
+}
+
+/**
+ * Get matching ContentObjects for many independent interests
+ *
+ * This is like ccn_get, but keeps several interests outstanding at once,
+ * so that the round trips overlap.  Blocks until every item has been
+ * answered or the timeout is reached.
+ * @param h is the ccn handle, as for ccn_get.
+ * @param items is the array of requests.  For each, name and
+ *        interest_template are as for ccn_get, and the results are
+ *        stored in resultbuf, pcobuf, and compsbuf, any of which may be NULL.
+ *        res is set to 0 if the item was answered, -1 if not.
+ * @param n is the number of items.
+ * @param concurrency limits how many interests are outstanding at once;
+ *        0 means no limit.
+ * @param timeout_ms limits the time spent waiting for all the answers.
+ * @param flags as for ccn_get.
+ * @param action if not NULL, is called from within ccn_run as each item
+ *        completes, with data and the item.  Items still unanswered at
+ *        the timeout are reported just before ccn_get_many returns.
+ * @returns the number of items answered, or -1 for an error.
+ */
+int
+ccn_get_many(struct ccn *h,
+             struct ccn_get_item *items,
+             int n,
+             int concurrency,
+             int timeout_ms,
+             int flags,
+             ccn_get_action action,
+             void *data)
 {
     struct ccn *orig_h = h;
     struct hashtb *saved_keys = NULL;
+    struct get_many_data gm = {0};
+    struct get_many_req *req = NULL;
+    int i;
     int res;
-    struct simple_get_data *md;
     
-    if ((flags & ~((int)CCN_GET_NOKEYWAIT)) != 0)
+    if ((flags & ~((int)CCN_GET_NOKEYWAIT)) != 0 || n < 0)
+        return(-1);
+    for (i = 0; i < n; i++)
+        items[i].res = -1;
+    if (n == 0)
+        return(0);
+    gm.reqs = calloc(n, sizeof(gm.reqs[0]));
+    if (gm.reqs == NULL)
+        return(-1);
+    h = get_handle(orig_h, &saved_keys);
+    if (h == NULL) {
+        free(gm.reqs);
         return(-1);
-    if (h == NULL || h->running) {
-        h = ccn_create();
-        if (h == NULL)
-            return(-1);
-        if (orig_h != NULL) { /* Dad, can I borrow the keys? */
-            saved_keys = h->keys;
-            h->keys = orig_h->keys;
-        }
-        res = ccn_connect(h, NULL);
-        if (res < 0) {
-            ccn_destroy(&h);
-            return(-1);
-        }
     }
-    md = calloc(1, sizeof(*md));
-    md->resultbuf = resultbuf;
-    md->pcobuf = pcobuf;
-    md->compsbuf = compsbuf;
-    md->flags = flags;
-    md->res = -1;
-    md->closure.p = &handle_simple_incoming_content;
-    md->closure.data = md;
-    md->closure.intdata = 1; /* tell upcall to re-express if needed */
-    md->closure.refcount = 1;
-    res = ccn_express_interest(h, name, &md->closure, interest_template);
-    if (res >= 0)
+    gm.items = items;
+    gm.n = n;
+    gm.flags = flags;
+    gm.action = action;
+    gm.data = data;
+    get_many_fill(h, &gm, concurrency);
+    res = 0;
+    if (gm.done < gm.n)
         res = ccn_run(h, timeout_ms);
-    if (res >= 0)
-        res = md->res;
-    md->resultbuf = NULL;
-    md->pcobuf = NULL;
-    md->compsbuf = NULL;
-    md->closure.intdata = 0;
-    md->closure.refcount--;
-    if (md->closure.refcount == 0)
-        free(md);
-    if (h != orig_h) {
-        if (saved_keys != NULL)
-            h->keys = saved_keys;
-        ccn_destroy(&h);
+    /* Cut loose whatever is still outstanding */
+    for (i = 0; i < n; i++) {
+        req = gm.reqs[i];
+        if (req == NULL)
+            continue;
+        if (req->gm != NULL) {
+            req->gm = NULL;
+            get_many_complete(h, &gm, i, -1);
+        }
+        req->closure.refcount--;
+        if (req->closure.refcount == 0)
+            free(req);
     }
-    return(res);
+    for (i = gm.next; i < n; i++)
+        get_many_complete(h, &gm, i, -1);
+    free(gm.reqs);
+    put_handle(h, orig_h, saved_keys);
+    return(res < 0 ? -1 : gm.ok);
 }
 
 /**
@@ -2289,6 +4380,10 @@ ccn_initiate_prefix_reg(struct ccn *h,
     fe->name_prefix = ccn_charbuf_create();
     fe->flags = i->flags & 0xFF;
     fe->lifetime = -1; /* Let ccnd decide */
+    fe->store_quota = -1;
+    fe->traffic_class = -1;
+    fe->default_freshness = -1;
+    fe->max_residency = -1;
     ccn_name_init(fe->name_prefix);
     ccn_name_append_components(fe->name_prefix, prefix, 0, prefix_size);
     reg_request = ccn_charbuf_create();
@@ -2312,7 +4407,8 @@ ccn_initiate_prefix_reg(struct ccn *h,
 
 /**
  * Verify a ContentObject using the public key from either the object
- * itself or our cache of keys.
+ * itself or our cache of keys.  Digest-only and HMAC signatures need
+ * no public key; see CCN_SP_DIGEST_ONLY and CCN_SP_HMAC.
  *
  * This routine does not attempt to fetch the public key if it is not
  * at hand.
@@ -2328,15 +4424,64 @@ ccn_verify_content(struct ccn *h,
     int res;
     unsigned char *buf = (unsigned char *)msg; /* XXX - discard const */
     
+    res = ccn_verify_local(h, msg, pco->offset[CCN_PCO_E], pco);
+    if (res >= 0)
+        return(res == 1 ? 0 : -1);
     res = ccn_locate_key(h, msg, pco, &pubkey);
     if (res == 0) {
         /* we have the pubkey, use it to verify the msg */
-        res = ccn_verify_signature(buf, pco->offset[CCN_PCO_E], pco, pubkey);
+        res = ccn_verify_signature_cached(h, buf, pco->offset[CCN_PCO_E], pco, pubkey);
         res = (res == 1) ? 0 : -1;
     }
     return(res);
 }
 
+/**
+ * Do the part of verifying a ContentObject that needs the handle.
+ *
+ * This leaves the signature check itself, which is the costly part,
+ * to be done by ccn_verify_signature wherever suits the caller - on
+ * another thread, say.  Signatures that need no public key are checked
+ * here, and so are objects found to have been verified already.
+ * @param pubkey is set to the key to check the signature with, if 2
+ *        is returned.  It stays good for the life of the handle.
+ * @returns 0 if the signature is good, -1 if it is bad, 1 if the key
+ *          is not at hand, or 2 if the signature is yet to be checked.
+ */
+int
+ccn_verify_content_prepare(struct ccn *h,
+                           const unsigned char *msg,
+                           struct ccn_parsed_ContentObject *pco,
+                           const struct ccn_pkey **pubkey)
+{
+    struct ccn_pkey *key = NULL;
+    int res;
+
+    res = ccn_verify_local(h, msg, pco->offset[CCN_PCO_E], pco);
+    if (res >= 0)
+        return(res == 1 ? 0 : -1);
+    res = ccn_locate_key(h, msg, pco, &key);
+    if (res != 0)
+        return(1);
+    if (ccn_verified_check(h, msg, pco, key))
+        return(0);
+    *pubkey = key;
+    return(2);
+}
+
+/**
+ * Note that an object left to be checked by ccn_verify_content_prepare
+ * has a good signature, so that it need not be checked again.
+ */
+void
+ccn_verify_content_done(struct ccn *h,
+                        const unsigned char *msg,
+                        struct ccn_parsed_ContentObject *pco,
+                        const struct ccn_pkey *pubkey)
+{
+    ccn_verified_note(h, msg, pco, pubkey);
+}
+
 /**
  * Load a private key from a keystore file.
  *
@@ -2402,6 +4547,206 @@ Cleanup:
     return(res);
 }
 
+/**
+ * Name the local key file, in the directory of the default keystore
+ * unless CCNX_LOCAL_KEY says otherwise.
+ */
+static void
+ccn_local_key_path(struct ccn_charbuf *c)
+{
+    const char *s;
+    
+    s = getenv("CCNX_LOCAL_KEY");
+    if (s != NULL && s[0] != 0) {
+        ccn_charbuf_append_string(c, s);
+        return;
+    }
+    s = getenv("CCNX_DIR");
+    if (s != NULL && s[0] != 0) {
+        ccn_charbuf_putf(c, "%s/.ccnx_local_key", s);
+        return;
+    }
+    s = getenv("HOME");
+    ccn_charbuf_putf(c, "%s/.ccnx/.ccnx_local_key", s != NULL ? s : "");
+}
+
+static int
+ccn_load_local_key_1(struct ccn *h, const char *path, int create)
+{
+    struct ccn_charbuf *temp = NULL;
+    struct ccn_charbuf *key = NULL;
+    unsigned char *p = NULL;
+    ssize_t n;
+    int fd = -1;
+    int res = -1;
+    
+    temp = ccn_charbuf_create();
+    key = ccn_charbuf_create();
+    if (path == NULL) {
+        ccn_local_key_path(temp);
+        path = ccn_charbuf_as_string(temp);
+    }
+    p = ccn_charbuf_reserve(key, CCN_LOCAL_KEY_SIZE);
+    fd = open(path, O_RDONLY);
+    if (fd == -1 && errno == ENOENT && create) {
+        /* Make a fresh one; if another process beats us, use theirs */
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd != -1) {
+            ccn_random_bytes(p, CCN_LOCAL_KEY_SIZE);
+            n = write(fd, p, CCN_LOCAL_KEY_SIZE);
+            close(fd);
+            if (n != CCN_LOCAL_KEY_SIZE) {
+                unlink(path);
+                goto Finish;
+            }
+        }
+        fd = open(path, O_RDONLY);
+    }
+    if (fd == -1) {
+        NOTE_ERRNO(h);
+        goto Finish;
+    }
+    n = read(fd, p, CCN_LOCAL_KEY_SIZE);
+    if (n < CCN_LOCAL_KEY_SIZE / 2) {
+        NOTE_ERR(h, EINVAL);
+        goto Finish;
+    }
+    key->length = n;
+    if (h->local_key != NULL)
+        memset(h->local_key->buf, 0, h->local_key->limit);
+    ccn_charbuf_destroy(&h->local_key);
+    h->local_key = key;
+    key = NULL;
+    res = 0;
+Finish:
+    if (fd != -1)
+        close(fd);
+    if (key != NULL)
+        memset(key->buf, 0, key->limit);
+    ccn_charbuf_destroy(&key);
+    ccn_charbuf_destroy(&temp);
+    return(res);
+}
+
+/**
+ * Load the local key, the secret used to make and check CCN_SP_HMAC
+ * signatures.
+ *
+ * If the file does not exist, it is created holding a fresh random key,
+ * readable only by its owner.  The processes that are to trust each
+ * other's HMAC objects must all be able to read the same file.
+ * @param h is the ccn handle
+ * @param path names the key file, or NULL for the default, which is
+ *        $CCNX_LOCAL_KEY, or .ccnx_local_key alongside the default keystore.
+ * @result is 0 for success, negative for error.
+ */
+int
+ccn_load_local_key(struct ccn *h, const char *path)
+{
+    return(ccn_load_local_key_1(h, path, 1));
+}
+
+/**
+ * Make a cheaper kind of signature the default for a namespace.
+ *
+ * ccn_sign_content and ccn_sign_content_batch apply the policy of the
+ * longest prefix that has one to any name for which the caller did not
+ * ask for CCN_SP_DIGEST_ONLY or CCN_SP_HMAC itself.
+ * @param h is the ccn handle
+ * @param prefix is the ccnb-encoded name prefix
+ * @param sp_flags is CCN_SP_DIGEST_ONLY, CCN_SP_HMAC, or 0 to go back
+ *        to public key signatures.
+ * @result is 0 for success, negative for error.
+ */
+int
+ccn_set_signing_policy(struct ccn *h,
+                       const struct ccn_charbuf *prefix,
+                       int sp_flags)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_indexbuf *comps = NULL;
+    int ncomps;
+    int res = 0;
+    
+    if (sp_flags != 0 && sp_flags != CCN_SP_DIGEST_ONLY && sp_flags != CCN_SP_HMAC)
+        return(NOTE_ERR(h, EINVAL));
+    if (sp_flags == CCN_SP_HMAC && h->local_key == NULL) {
+        res = ccn_load_local_key(h, NULL);
+        if (res < 0)
+            return(res);
+    }
+    comps = ccn_indexbuf_create();
+    ncomps = ccn_name_split(prefix, comps);
+    if (ncomps < 0) {
+        ccn_indexbuf_destroy(&comps);
+        return(NOTE_ERR(h, EINVAL));
+    }
+    if (h->signing_policies == NULL)
+        h->signing_policies = hashtb_create(sizeof(int), NULL);
+    hashtb_start(h->signing_policies, e);
+    res = hashtb_seek(e, prefix->buf + comps->buf[0],
+                      comps->buf[ncomps] - comps->buf[0], 0);
+    if (res >= 0) {
+        if (sp_flags == 0)
+            hashtb_delete(e);
+        else
+            *(int *)e->data = sp_flags;
+        res = 0;
+    }
+    else
+        res = NOTE_ERRNO(h);
+    hashtb_end(e);
+    ccn_indexbuf_destroy(&comps);
+    return(res);
+}
+
+/**
+ * Look up the signing policy for a name.
+ * @returns the sp_flags of the longest prefix with a policy, or 0.
+ */
+static int
+ccn_signing_policy(struct ccn *h, const struct ccn_charbuf *name)
+{
+    struct ccn_indexbuf *comps = NULL;
+    int *flags = NULL;
+    int ans = 0;
+    int i;
+    
+    if (h->signing_policies == NULL || hashtb_n(h->signing_policies) == 0)
+        return(0);
+    comps = ccn_indexbuf_create();
+    i = ccn_name_split(name, comps);
+    for (; i >= 0 && flags == NULL; i--)
+        flags = hashtb_lookup(h->signing_policies, name->buf + comps->buf[0],
+                              comps->buf[i] - comps->buf[0]);
+    if (flags != NULL)
+        ans = *flags;
+    ccn_indexbuf_destroy(&comps);
+    return(ans);
+}
+
+/**
+ * Settle which kind of signature to make, from the params and the
+ * signing policy, and make sure the local key is at hand if needed.
+ * @returns CCN_SP_DIGEST_ONLY, CCN_SP_HMAC, 0 for a public key
+ *          signature, or negative for error.
+ */
+static int
+ccn_choose_signature(struct ccn *h, struct ccn_signing_params *p,
+                     const struct ccn_charbuf *name)
+{
+    int kind;
+    
+    kind = p->sp_flags & (CCN_SP_DIGEST_ONLY | CCN_SP_HMAC);
+    if (kind == 0)
+        kind = ccn_signing_policy(h, name);
+    if (kind == CCN_SP_HMAC && h->local_key == NULL &&
+        ccn_load_local_key(h, NULL) < 0)
+        return(-1);
+    return(kind);
+}
+
 /**
  * Load the handle's default signing key from a keystore.
  *
@@ -2527,9 +4872,14 @@ ccn_chk_signing_params(struct ccn *h,
                               CCN_SP_TEMPL_FRESHNESS      |
                               CCN_SP_TEMPL_KEY_LOCATOR    |
                               CCN_SP_FINAL_BLOCK          |
-                              CCN_SP_OMIT_KEY_LOCATOR
+                              CCN_SP_OMIT_KEY_LOCATOR     |
+                              CCN_SP_DIGEST_ONLY          |
+                              CCN_SP_HMAC
                               )) != 0)
         return(NOTE_ERR(h, EINVAL));
+    conflicting = CCN_SP_DIGEST_ONLY | CCN_SP_HMAC;
+    if ((result->sp_flags & conflicting) == conflicting)
+        return(NOTE_ERR(h, EINVAL));
     conflicting = CCN_SP_TEMPL_FINAL_BLOCK_ID | CCN_SP_FINAL_BLOCK;
     if ((result->sp_flags & conflicting) == conflicting)
         return(NOTE_ERR(h, EINVAL));
@@ -2677,18 +5027,27 @@ ccn_sign_content(struct ccn *h,
     struct ccn_charbuf *timestamp = NULL;
     struct ccn_charbuf *finalblockid = NULL;
     struct ccn_charbuf *keylocator = NULL;
+    int kind;
     int res;
     
     res = ccn_chk_signing_params(h, params, &p,
                                  &timestamp, &finalblockid, &keylocator);
     if (res < 0)
         return(res);
+    kind = ccn_choose_signature(h, &p, name_prefix);
+    if (kind < 0) {
+        ccn_charbuf_destroy(&timestamp);
+        ccn_charbuf_destroy(&keylocator);
+        ccn_charbuf_destroy(&finalblockid);
+        return(kind);
+    }
     hashtb_start(h->keystores, e);
     if (hashtb_seek(e, p.pubid, sizeof(p.pubid), 0) == HT_OLD_ENTRY) {
         struct ccn_keystore **pk = e->data;
         keystore = *pk;
         signed_info = ccn_charbuf_create();
-        if (keylocator == NULL && (p.sp_flags & CCN_SP_OMIT_KEY_LOCATOR) == 0) {
+        if (keylocator == NULL && kind == 0 &&
+            (p.sp_flags & CCN_SP_OMIT_KEY_LOCATOR) == 0) {
             /* Construct a key locator containing the key itself */
             keylocator = ccn_charbuf_create();
             ccn_charbuf_append_tt(keylocator, CCN_DTAG_KeyLocator, CCN_DTAG);
@@ -2726,7 +5085,15 @@ ccn_sign_content(struct ccn *h,
                                          p.freshness,
                                          finalblockid,
                                          keylocator);
-        if (res >= 0)
+        if (res >= 0 && kind != 0)
+            res = ccn_encode_ContentObject_symmetric(resultbuf,
+                                                     name_prefix,
+                                                     signed_info,
+                                                     data,
+                                                     size,
+                                                     kind == CCN_SP_HMAC ? h->local_key->buf : NULL,
+                                                     kind == CCN_SP_HMAC ? h->local_key->length : 0);
+        else if (res >= 0)
             res = ccn_encode_ContentObject(resultbuf,
                                            name_prefix,
                                            signed_info,
@@ -2746,6 +5113,145 @@ ccn_sign_content(struct ccn *h,
     ccn_charbuf_destroy(&signed_info);
     return(res);
 }
+
+/**
+ * Create a batch of signed ContentObjects, with one signature for all.
+ *
+ * This is like calling ccn_sign_content for each of the n objects, but the
+ * private key is used only once; see ccn_encode_ContentObjects.
+ * The params apply to every object.  CCN_SP_FINAL_BLOCK marks the last
+ * name of the batch as the final block, in the SignedInfo of all of them.
+ * Unless the params choose the kind of signature, the names must all
+ * fall under the same signing policy.
+ *
+ * @param h is the ccn handle
+ * @param resultbufs - n result buffers to which the ContentObjects
+ *        will be appended
+ * @param names contains the n ccnb-encoded names
+ * @param params describe the ancillary information needed
+ * @param data points to the n pieces of raw content
+ * @param sizes gives the sizes of the raw content, in bytes
+ * @returns 0 for success, -1 for error
+ */
+int
+ccn_sign_content_batch(struct ccn *h,
+                       struct ccn_charbuf **resultbufs, int n,
+                       const struct ccn_charbuf **names,
+                       const struct ccn_signing_params *params,
+                       const void **data, const size_t *sizes)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_signing_params p = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_charbuf *signed_info = NULL;
+    const struct ccn_charbuf **signed_infos = NULL;
+    struct ccn_keystore *keystore = NULL;
+    struct ccn_charbuf *timestamp = NULL;
+    struct ccn_charbuf *finalblockid = NULL;
+    struct ccn_charbuf *keylocator = NULL;
+    int kind;
+    int res;
+    int i;
+    
+    if (n < 1)
+        return(NOTE_ERR(h, EINVAL));
+    res = ccn_chk_signing_params(h, params, &p,
+                                 &timestamp, &finalblockid, &keylocator);
+    if (res < 0)
+        return(res);
+    kind = ccn_choose_signature(h, &p, names[0]);
+    /* Without an explicit choice, the policy must agree for all names */
+    for (i = 1; i < n && kind >= 0; i++)
+        if ((p.sp_flags & (CCN_SP_DIGEST_ONLY | CCN_SP_HMAC)) == 0 &&
+            ccn_signing_policy(h, names[i]) != kind)
+            kind = NOTE_ERR(h, EINVAL);
+    if (kind < 0) {
+        ccn_charbuf_destroy(&timestamp);
+        ccn_charbuf_destroy(&keylocator);
+        ccn_charbuf_destroy(&finalblockid);
+        return(kind);
+    }
+    hashtb_start(h->keystores, e);
+    if (hashtb_seek(e, p.pubid, sizeof(p.pubid), 0) == HT_OLD_ENTRY) {
+        struct ccn_keystore **pk = e->data;
+        keystore = *pk;
+        signed_info = ccn_charbuf_create();
+        if (keylocator == NULL && kind == 0 &&
+            (p.sp_flags & CCN_SP_OMIT_KEY_LOCATOR) == 0) {
+            /* Construct a key locator containing the key itself */
+            keylocator = ccn_charbuf_create();
+            ccn_charbuf_append_tt(keylocator, CCN_DTAG_KeyLocator, CCN_DTAG);
+            ccn_charbuf_append_tt(keylocator, CCN_DTAG_Key, CCN_DTAG);
+            res = ccn_append_pubkey_blob(keylocator,
+                                         ccn_keystore_public_key(keystore));
+            ccn_charbuf_append_closer(keylocator); /* </Key> */
+            ccn_charbuf_append_closer(keylocator); /* </KeyLocator> */
+        }
+        if (res >= 0 && (p.sp_flags & CCN_SP_FINAL_BLOCK) != 0) {
+            int ncomp;
+            struct ccn_indexbuf *ndx;
+            const unsigned char *comp = NULL;
+            size_t size = 0;
+            
+            ndx = ccn_indexbuf_create();
+            ncomp = ccn_name_split(names[n - 1], ndx);
+            if (ncomp < 0)
+                res = NOTE_ERR(h, EINVAL);
+            else {
+                finalblockid = ccn_charbuf_create();
+                ccn_name_comp_get(names[n - 1]->buf,
+                                  ndx, ncomp - 1, &comp, &size);
+                ccn_charbuf_append_tt(finalblockid, size, CCN_BLOB);
+                ccn_charbuf_append(finalblockid, comp, size);
+            }
+            ccn_indexbuf_destroy(&ndx);
+        }
+        if (res >= 0)
+            res = ccn_signed_info_create(signed_info,
+                                         ccn_keystore_public_key_digest(keystore),
+                                         ccn_keystore_public_key_digest_length(keystore),
+                                         timestamp,
+                                         p.type,
+                                         p.freshness,
+                                         finalblockid,
+                                         keylocator);
+        if (res >= 0 && kind != 0) {
+            /* These cost no more one at a time than in a tree */
+            for (i = 0; i < n && res >= 0; i++)
+                res = ccn_encode_ContentObject_symmetric(resultbufs[i],
+                                                         names[i],
+                                                         signed_info,
+                                                         data[i],
+                                                         sizes[i],
+                                                         kind == CCN_SP_HMAC ? h->local_key->buf : NULL,
+                                                         kind == CCN_SP_HMAC ? h->local_key->length : 0);
+        }
+        else if (res >= 0) {
+            signed_infos = calloc(n, sizeof(signed_infos[0]));
+            for (i = 0; i < n; i++)
+                signed_infos[i] = signed_info;
+            res = ccn_encode_ContentObjects(resultbufs, n,
+                                            names,
+                                            signed_infos,
+                                            data,
+                                            sizes,
+                                            ccn_keystore_digest_algorithm(keystore),
+                                            ccn_keystore_private_key(keystore));
+            free(signed_infos);
+        }
+    }
+    else {
+        res = NOTE_ERR(h, -1);
+        hashtb_delete(e);
+    }
+    hashtb_end(e);
+    ccn_charbuf_destroy(&timestamp);
+    ccn_charbuf_destroy(&keylocator);
+    ccn_charbuf_destroy(&finalblockid);
+    ccn_charbuf_destroy(&signed_info);
+    return(res);
+}
+
 /**
  * Check whether content described by info is final block.
  *
@@ -26,6 +26,89 @@
  */
 #define XML(goop) ((void)0)
 
+/**
+ * Fast path for the skeleton decoder
+ *
+ * Consumes whole tokens of the commonly used kinds - DTAG, EXT, BLOB,
+ * UDATA, and CLOSE - starting at p[i], as long as each one lies
+ * entirely within the input.  Headers are decoded in a tight loop and
+ * BLOB and UDATA payloads are skipped in one step.  Anything else
+ * (partial tokens, attributes, TAG, errors) is left for the general
+ * state machine, which sees exactly the same state it would have
+ * reached by itself.
+ *
+ * @returns the index of the first unconsumed byte; *donep is set
+ *          if the outermost element was closed.
+ */
+static size_t
+skeleton_fast(struct ccn_skeleton_decoder *d,
+              const unsigned char *p, size_t i, size_t n,
+              int *tagstatep, size_t *numvalp, int *donep)
+{
+    const size_t limit = (~(size_t)0U) >> (7 + CCN_TT_BITS);
+    int tagstate = *tagstatep;
+    int nest = d->nest;
+    size_t numval;
+    size_t j;
+    unsigned char c;
+
+    while (i < n) {
+        d->token_index = i + d->index;
+        if (p[i] == CCN_CLOSE) {
+            if (nest <= 0)
+                break;
+            i++;
+            tagstate = 0;
+            nest -= 1;
+            if (nest == 0) {
+                *donep = 1;
+                break;
+            }
+            continue;
+        }
+        numval = 0;
+        for (j = i; j < n && (p[j] & CCN_TT_HBIT) == CCN_CLOSE; j++) {
+            if (numval > limit)
+                goto Out;
+            numval = (numval << 7) + p[j];
+        }
+        if (j == n)
+            break;
+        c = p[j++];
+        numval = (numval << (7-CCN_TT_BITS)) +
+                 ((c >> CCN_TT_BITS) & CCN_MAX_TINY);
+        switch (c & CCN_TT_MASK) {
+            case CCN_DTAG:
+                tagstate = 1;
+                nest += 1;
+                d->element_index = d->token_index;
+                break;
+            case CCN_EXT:
+                tagstate = 0;
+                nest += 1;
+                d->element_index = d->token_index;
+                break;
+            case CCN_BLOB:
+            case CCN_UDATA:
+                if (numval > n - j)
+                    goto Out;
+                tagstate = 0;
+                j += numval;
+                numval = 0;
+                break;
+            default:
+                goto Out;
+        }
+        i = j;
+        *numvalp = numval;
+    }
+Out:
+    *tagstatep = tagstate;
+    d->nest = nest;
+    return(i);
+}
+
+
 /**
  * Decodes ccnb decoded data
  *
@@ -73,6 +156,20 @@ ccn_skeleton_decode(struct ccn_skeleton_decoder *d,
         switch (state) {
             case CCN_DSTATE_INITIAL:
             case CCN_DSTATE_NEWTOKEN: /* start new thing */
+                if (!pause && tagstate < 2) {
+                    int done = 0;
+                    size_t start = i;
+                    i = skeleton_fast(d, p, i, n, &tagstate, &numval, &done);
+                    if (i != start)
+                        state = CCN_DSTATE_NEWTOKEN;
+                    if (done) {
+                        state = CCN_DSTATE_INITIAL;
+                        n = i;
+                        break;
+                    }
+                    if (i == n)
+                        break;
+                }
                 d->token_index = i + d->index;
                 if (tagstate > 1 && tagstate-- == 2) {
                     XML("\""); /* close off the attribute value */
@@ -129,7 +129,24 @@ static const struct ccn_dict_entry ccn_tagdict[] = {
     {CCN_DTAG_SyncConfigSliceList, "SyncConfigSliceList"},
     {CCN_DTAG_SyncConfigSliceOp, "SyncConfigSliceOp"},
     {CCN_DTAG_SyncNodeDeltas, "SyncNodeDeltas"},
+    {CCN_DTAG_SyncNodeIBLT, "SyncNodeIBLT"},
+    {CCN_DTAG_SyncIBLTCells, "SyncIBLTCells"},
+    {CCN_DTAG_SyncNodeBatch, "SyncNodeBatch"},
+    {CCN_DTAG_SyncNameSuffix, "SyncNameSuffix"},
+    {CCN_DTAG_EgressRate, "EgressRate"},
+    {CCN_DTAG_EgressBurst, "EgressBurst"},
+    {CCN_DTAG_StoreQuota, "StoreQuota"},
+    {CCN_DTAG_Manifest, "Manifest"},
+    {CCN_DTAG_TrafficClass, "TrafficClass"},
+    {CCN_DTAG_DefaultFreshness, "DefaultFreshness"},
+    {CCN_DTAG_MaxResidency, "MaxResidency"},
     {CCN_DTAG_SequenceNumber, "SequenceNumber"},
+    {CCN_DTAG_LinkFragment, "LinkFragment"},
+    {CCN_DTAG_FragmentIndex, "FragmentIndex"},
+    {CCN_DTAG_FragmentCount, "FragmentCount"},
+    {CCN_DTAG_FragmentRequest, "FragmentRequest"},
+    {CCN_DTAG_LinkAck, "LinkAck"},
+    {CCN_DTAG_AckMask, "AckMask"},
     {CCN_DTAG_CCNProtocolDataUnit, "CCNProtocolDataUnit"},
     {0, 0}
 };
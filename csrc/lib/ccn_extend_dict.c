@@ -224,3 +224,122 @@ err:
     return (-1);
     
 }
+
+/*
+ * The index is a pair of open-addressed hash tables of entry numbers,
+ * one keyed by dtag value and one by name, each at most half full.
+ */
+struct ccn_dict_index {
+    const struct ccn_dict *d;
+    unsigned mask;
+    int *by_index;
+    int *by_name;
+};
+
+static unsigned
+dict_hash_index(int index)
+{
+    return ((unsigned)index * 2654435761U);
+}
+
+static unsigned
+dict_hash_name(const char *name)
+{
+    unsigned h = 2166136261U;
+    for (; *name != 0; name++)
+        h = (h ^ (unsigned char)*name) * 16777619U;
+    return (h);
+}
+
+/**
+ * Build an index for fast lookups in both directions.
+ *
+ * The dictionary must outlive the index.  Where a dictionary has
+ * repeated entries, the first one wins, as it would in a linear search.
+ * @returns the index, or NULL if out of memory.
+ */
+struct ccn_dict_index *
+ccn_dict_index_create(const struct ccn_dict *d)
+{
+    struct ccn_dict_index *x;
+    unsigned size = 8;
+    unsigned h;
+    int i;
+    
+    while (size < 2U * d->count)
+        size *= 2;
+    x = calloc(1, sizeof(*x));
+    if (x == NULL)
+        return (NULL);
+    x->d = d;
+    x->mask = size - 1;
+    x->by_index = malloc(size * sizeof(x->by_index[0]));
+    x->by_name = malloc(size * sizeof(x->by_name[0]));
+    if (x->by_index == NULL || x->by_name == NULL) {
+        ccn_dict_index_destroy(&x);
+        return (NULL);
+    }
+    memset(x->by_index, -1, size * sizeof(x->by_index[0]));
+    memset(x->by_name, -1, size * sizeof(x->by_name[0]));
+    for (i = 0; i < d->count; i++) {
+        for (h = dict_hash_index(d->dict[i].index) & x->mask;
+             x->by_index[h] != -1; h = (h + 1) & x->mask)
+            if (d->dict[x->by_index[h]].index == d->dict[i].index)
+                break;
+        if (x->by_index[h] == -1)
+            x->by_index[h] = i;
+        for (h = dict_hash_name(d->dict[i].name) & x->mask;
+             x->by_name[h] != -1; h = (h + 1) & x->mask)
+            if (strcmp(d->dict[x->by_name[h]].name, d->dict[i].name) == 0)
+                break;
+        if (x->by_name[h] == -1)
+            x->by_name[h] = i;
+    }
+    return (x);
+}
+
+void
+ccn_dict_index_destroy(struct ccn_dict_index **xp)
+{
+    struct ccn_dict_index *x = *xp;
+    if (x != NULL) {
+        free(x->by_index);
+        free(x->by_name);
+        free(x);
+    }
+    *xp = NULL;
+}
+
+/**
+ * Look up the name for a dtag value.
+ * @returns the name, or NULL if there is none.
+ */
+const char *
+ccn_dict_index_name(const struct ccn_dict_index *x, int index)
+{
+    unsigned h;
+    int e;
+    
+    for (h = dict_hash_index(index) & x->mask;
+         (e = x->by_index[h]) != -1; h = (h + 1) & x->mask)
+        if (x->d->dict[e].index == index)
+            return (x->d->dict[e].name);
+    return (NULL);
+}
+
+/**
+ * Look up the dtag value for a name.
+ * @returns the value, or -1 if there is none.
+ */
+int
+ccn_dict_index_lookup(const struct ccn_dict_index *x, const char *name)
+{
+    unsigned h;
+    int e;
+    
+    for (h = dict_hash_name(name) & x->mask;
+         (e = x->by_name[h]) != -1; h = (h + 1) & x->mask)
+        if (strcmp(x->d->dict[e].name, name) == 0)
+            return (x->d->dict[e].index);
+    return (-1);
+}
@@ -84,6 +84,8 @@ ccn_face_instance_parse(const unsigned char *p, size_t size)
         mcast_off = ccn_parse_tagged_string(d, CCN_DTAG_MulticastInterface, store);
         result->descr.mcast_ttl = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_MulticastTTL);
         result->lifetime = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FreshnessSeconds);
+        result->rate = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_EgressRate);
+        result->burst = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_EgressBurst);
         ccn_buf_check_close(d);
     }
     else
@@ -115,7 +117,7 @@ ccn_face_instance_destroy(struct ccn_face_instance **pfi)
     *pfi = NULL;
 }
 
-//<!ELEMENT FaceInstance  (Action?, PublisherPublicKeyDigest?, FaceID?, IPProto?, Host?, Port?, MulticastInterface?, MulticastTTL?, FreshnessSeconds?)>
+//<!ELEMENT FaceInstance  (Action?, PublisherPublicKeyDigest?, FaceID?, IPProto?, Host?, Port?, MulticastInterface?, MulticastTTL?, FreshnessSeconds?, EgressRate?, EgressBurst?)>
 /**
  * Marshal an internal face instance representation into ccnb form
  */
@@ -152,6 +154,12 @@ ccnb_append_face_instance(struct ccn_charbuf *c,
     if (fi->lifetime >= 0)
         res |= ccnb_tagged_putf(c, CCN_DTAG_FreshnessSeconds, "%d",
                                    fi->lifetime);    
+    if (fi->rate >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_EgressRate, "%d",
+                                   fi->rate);
+    if (fi->burst >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_EgressBurst, "%d",
+                                   fi->burst);
     res |= ccnb_element_end(c);
     return(res);
 }
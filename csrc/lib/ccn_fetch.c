@@ -33,6 +33,8 @@
  */
 
 #include <ccn/fetch.h>
+#include <ccn/manifest.h>
+#include <ccn/window.h>
 
 #include <sys/types.h>
 #include <stdio.h>
@@ -49,16 +51,21 @@
 #define CCN_INTEREST_TIMEOUT_USECS 15000000
 #define MaxSuffixDefault 4
 
+// congestion window and retransmission timer parameters
+#define CCN_FETCH_MAX_BUFS 128
+#define CCN_FETCH_INITIAL_WINDOW 2
+#define CCN_FETCH_HOLE_THRESHOLD 3
+
+// levels of the manifest tree, from the root down to the segments
+#define CCN_FETCH_MF_LEVELS (CCN_MANIFEST_MAX_DEPTH + 2)
+
 typedef intmax_t seg_t;
 
 typedef uint64_t TimeMarker;
 
 static TimeMarker
 GetCurrentTimeUSecs(void) {
-	const TimeMarker M = 1000*1000;
-	struct timeval now = {0};
-    gettimeofday(&now, 0);
-	return now.tv_sec*M+now.tv_usec;
+	return ccn_window_now();
 }
 
 static intmax_t
@@ -76,36 +83,67 @@ struct ccn_fetch {
 	int nStreams;
 	int maxStreams;
 	struct ccn_fetch_stream **streams;
+	int budget;				// max interests in flight for all streams (0 if none)
+	int rover;				// the next stream to take a turn at the budget
 };
 
 struct ccn_fetch_buffer {
-	struct ccn_fetch_buffer *next;
-	seg_t seg;			// the seg for this buffer (< 0 if unassigned)
+	seg_t seg;			// the seg for this buffer (< 0 if the slot is free)
 	intmax_t pos;		// the base byte position for this segment
 	int len;			// the number of valid bytes
 	int max;			// the buffer size
 	unsigned char *buf;	// where the bytes are
+	struct ccn_slice *slice;	// holds the bytes, if not allocated here
 };
 
 struct localClosure {
 	struct ccn_fetch_stream *fs;
 	struct localClosure *next;
 	seg_t reqSeg;
+	TimeMarker startClock;	// when the segment was first asked for
+	TimeMarker sendClock;	// when the interest was last sent
+	int retries;			// times the interest has been sent again
+	int holes;				// later segments that arrived ahead of this one
+};
+
+struct mfLevel {
+	uintmax_t blk;			// segments covered by each item (0 if not known yet)
+	uintmax_t n;			// the number of items
+	unsigned char *digests;	// the digest of each item
+	unsigned char *known;	// nonzero for the items whose digest is known
+};
+
+struct mfRequest {
+	struct ccn_fetch_stream *fs;
+	struct mfRequest *next;
+	int level;				// the node asked for, by level and index
+	uintmax_t index;
 	TimeMarker startClock;
 };
 
+struct fetchManifest {
+	struct ccn_charbuf *name;	// the name of the root
+	uintmax_t count;			// the number of segments
+	int segLevel;				// the level of the segments (0 if not known yet)
+	struct mfLevel levels[CCN_FETCH_MF_LEVELS];	// level 0 is the root
+	struct mfRequest *requests;	// manifest nodes being fetched
+	intmax_t nodesRead;
+	intmax_t badDigests;
+};
+
 struct ccn_fetch_stream {
 	struct ccn_fetch *parent;
 	struct localClosure *requests;	// segment requests in process
 	int reqBusy;			// the number of requests busy
 	int maxBufs;			// max number of buffers allowed
-	int nBufs;				// the number of buffers allocated
-	struct ccn_fetch_buffer *bufList;	// the buffer list
+	int nBufs;				// the number of buffers in use
+	int ringSize;			// slots in the ring (a power of 2, >= 2*maxBufs)
+	struct ccn_fetch_buffer *ring;	// the buffers, slot is seg mod ringSize
 	char *id;
 	struct ccn_charbuf *name;			// interest name (without seq#)
 	struct ccn_charbuf *interest;		// interest template
+	struct ccn_compiled_interest *compiled;	// name and template, encoded
 	int segSize;			// the segment size (-1 if variable, 0 if unknown)
-	int segsAhead;
 	intmax_t fileSize;		// the file size (< 0 if unassigned)
 	intmax_t readPosition;	// the read position (always assigned)
 	intmax_t readStart;		// the read position at segment start
@@ -118,6 +156,16 @@ struct ccn_fetch_stream {
 	intmax_t timeoutsSeen;
 	seg_t segsRead;
 	seg_t segsRequested;
+	struct ccn_window win;	// congestion window and retransmission timer
+	intmax_t retransmits;	// interests sent again after the timeout
+	intmax_t fastRetransmits;	// interests sent again because of holes
+	intmax_t bytesRead;		// bytes of segment data received
+	TimeMarker openClock;	// when the stream was opened
+	seg_t needSeg;			// segments below this are requested or buffered
+	int sinkFd;				// where segments are written (< 0 if read instead)
+	int sinkSized;			// 1 if the sink has been extended, 2 if exact
+	int sinkError;			// errno from writing the sink (0 if none)
+	struct fetchManifest *mf;	// segment digests (NULL if not used)
 };
 
 // forward reference
@@ -125,6 +173,10 @@ static enum ccn_upcall_res
 CallMe(struct ccn_closure *selfp,
 	   enum ccn_upcall_kind kind,
 	   struct ccn_upcall_info *info);
+static enum ccn_upcall_res
+MfCallMe(struct ccn_closure *selfp,
+		 enum ccn_upcall_kind kind,
+		 struct ccn_upcall_info *info);
 
 ///////////////////////////////////////////////////////
 // Internal routines
@@ -157,6 +209,18 @@ sequenced_name(struct ccn_charbuf *basename, seg_t seq) {
     return(name);
 }
 
+static size_t
+seqnum_component(unsigned char *b, size_t n, seg_t seq) {
+	// fills the end of b with the value of the component that
+	// sequenced_name would append, and returns its length
+	size_t i = n;
+	uintmax_t v;
+	for (v = seq; v != 0; v >>= 8)
+		b[--i] = v & 0xff;
+	b[--i] = CCN_MARKER_SEQNUM;
+	return n - i;
+}
+
 static struct ccn_charbuf *
 make_data_template(int maxSuffix) {
 	// creates a template for interests that only have a name
@@ -227,6 +291,7 @@ AddSegRequest(struct ccn_fetch_stream *fs, seg_t seg) {
 	req->fs = fs;
 	req->reqSeg = seg;
 	req->startClock = GetCurrentTimeUSecs();
+	req->sendClock = req->startClock;
 	req->next = fs->requests;
 	fs->requests = req;
 	if (debug != NULL && (flags & ccn_fetch_flags_NoteAddRem)) {
@@ -277,26 +342,25 @@ RemSegRequest(struct ccn_fetch_stream *fs, struct localClosure *req) {
 static struct ccn_fetch_buffer *
 FindBufferForSeg(struct ccn_fetch_stream *fs, seg_t seg) {
 	// finds the buffer object given the seg
-	struct ccn_fetch_buffer *fb = fs->bufList;
-	for (;;) {
-		if (fb == NULL) break;
-		if (fb->seg == seg) break;
-		fb = fb->next;
-	} 
+	// a seg can only be in the one slot, so this is a single probe
+	if (seg < 0) return NULL;
+	struct ccn_fetch_buffer *fb = &fs->ring[seg & (fs->ringSize - 1)];
+	if (fb->seg != seg) return NULL;
 	return fb;
 }
 
 static struct ccn_fetch_buffer *
 FindBufferForPosition(struct ccn_fetch_stream *fs, intmax_t pos) {
-	// finds the buffer object given the seg
-	struct ccn_fetch_buffer *fb = fs->bufList;
-	for (;;) {
-		if (fb == NULL) break;
+	// finds the buffer object given the position
+	// (only used for seeks, so a scan of the ring will do)
+	int i;
+	for (i = 0; i < fs->ringSize; i++) {
+		struct ccn_fetch_buffer *fb = &fs->ring[i];
 		intmax_t fp = fb->pos;
-		if (fp >= 0 && pos >= fp && pos < fp+fb->len) break;
-		fb = fb->next;
-	} 
-	return fb;
+		if (fb->seg >= 0 && fp >= 0 && pos >= fp && pos < fp+fb->len)
+			return fb;
+	}
+	return NULL;
 }
 
 static intmax_t
@@ -320,20 +384,42 @@ InferPosition(struct ccn_fetch_stream *fs, seg_t seg) {
 	return pos;
 }
 
+static void
+FreeBufferBytes(struct ccn_fetch_buffer *fb) {
+	// lets go of the bytes of the buffer
+	if (fb->slice != NULL)
+		ccn_slice_release(&fb->slice);
+	else if (fb->buf != NULL)
+		free(fb->buf);
+	fb->buf = NULL;
+}
+
+static void
+ReleaseBuffer(struct ccn_fetch_stream *fs, struct ccn_fetch_buffer *fb) {
+	// lets go of the buffer, leaving its slot free
+	FreeBufferBytes(fb);
+	memset(fb, 0, sizeof(*fb));
+	fb->seg = -1;
+	fs->nBufs--;
+}
+
 static struct ccn_fetch_buffer *
-NewBufferForSeg(struct ccn_fetch_stream *fs, seg_t seg, size_t len) {
-	// makes a new buffer for the segment
-	struct ccn_fetch_buffer *fb = calloc(1, sizeof(*fb));
-	if (len > 0) fb->buf = calloc(len, sizeof(unsigned char));
+NewBufferForSeg(struct ccn_fetch_stream *fs, seg_t seg, size_t len,
+				struct ccn_slice *slice) {
+	// makes a new buffer for the segment, using the slice if given
+	// the slot may still hold a seg a whole ring away, which must be
+	// well outside the window by now, so it makes way
+	struct ccn_fetch_buffer *fb = &fs->ring[seg & (fs->ringSize - 1)];
+	if (fb->seg >= 0) ReleaseBuffer(fs, fb);
+	if (slice != NULL) {
+		fb->slice = slice;
+		fb->buf = (unsigned char *) ccn_slice_buf(slice);
+	} else if (len > 0) fb->buf = calloc(len, sizeof(unsigned char));
 	fb->seg = seg;
 	intmax_t pos = InferPosition(fs, seg);
 	fb->pos = pos;
 	fb->len = len;
 	fs->nBufs++;
-	fb->next = fs->bufList;
-	fs->bufList = fb;
-	fs->segsAhead++;
-	if (fs->segsAhead >= fs->maxBufs) fs->segsAhead = fs->maxBufs-1;
 	if (fs->segSize <= 0 && pos >= 0) {
 		// segment size is variable or unknown
 		// position for buffer is known, so propagate forwards
@@ -358,58 +444,208 @@ NewBufferForSeg(struct ccn_fetch_stream *fs, seg_t seg, size_t len) {
 static void
 PruneSegments(struct ccn_fetch_stream *fs) {
 	intmax_t start = fs->readStart;
-	struct ccn_fetch_buffer *lag = NULL;
-	struct ccn_fetch_buffer *fb = fs->bufList;
-	while (fb != NULL && fs->nBufs > fs->maxBufs) {
-		struct ccn_fetch_buffer *next = fb->next;
-		if (fs->maxBufs == 0 || (fb->pos >= 0 && start > (fb->pos + fb->len))) {
-			// this buffer is going away
-			// note: keep buffer immediately before readStart if possible
-			if (lag == NULL) {
-				fs->bufList = next;
-			} else {
-				lag->next = next;
+	int i;
+	for (i = 0; i < fs->ringSize && fs->nBufs > fs->maxBufs; i++) {
+		struct ccn_fetch_buffer *fb = &fs->ring[i];
+		if (fb->seg < 0) continue;
+		// note: keep buffer immediately before readStart if possible
+		if (fs->maxBufs == 0 || (fb->pos >= 0 && start > (fb->pos + fb->len)))
+			ReleaseBuffer(fs, fb);
+	}
+}
+
+///////////////////////////////////////////////////////
+// Manifest routines
+///////////////////////////////////////////////////////
+
+static int
+MfAddLevel(struct fetchManifest *mf, int level, uintmax_t blk) {
+	// sets up the items of a level, each covering blk segments
+	// returns -1 if the level does not fit what is known already
+	struct mfLevel *lv = &mf->levels[level];
+	if (level <= 0 || level >= CCN_FETCH_MF_LEVELS || blk == 0) return -1;
+	if (lv->blk != 0) return (lv->blk == blk) ? 0 : -1;
+	if (mf->levels[level-1].blk % blk != 0) return -1;
+	if (blk > 1 && level == CCN_FETCH_MF_LEVELS - 1) return -1;
+	lv->blk = blk;
+	lv->n = (mf->count + blk - 1) / blk;
+	lv->digests = calloc(lv->n, CCN_MANIFEST_DIGEST_BYTES);
+	lv->known = calloc(lv->n, 1);
+	if (lv->n > 0 && (lv->digests == NULL || lv->known == NULL)) {
+		lv->blk = 0;
+		return -1;
+	}
+	if (blk == 1) mf->segLevel = level;
+	return 0;
+}
+
+static int
+MfAddNode(struct fetchManifest *mf, int level, uintmax_t index,
+		  const unsigned char *ccnb, size_t size) {
+	// takes in the digests listed by a manifest node
+	// returns -1 if the node is not the one expected
+	struct mfLevel *lv = &mf->levels[level];
+	struct ccn_manifest *m = ccn_manifest_parse(ccnb, size);
+	uintmax_t start = index * lv->blk;
+	uintmax_t count = mf->count - start;
+	int res = -1;
+	if (count > lv->blk) count = lv->blk;
+	if (m != NULL && m->start == start && m->count == count
+		&& m->block_size < lv->blk
+		&& MfAddLevel(mf, level + 1, m->block_size) == 0
+		&& m->n == (count + m->block_size - 1) / m->block_size) {
+		struct mfLevel *below = &mf->levels[level + 1];
+		uintmax_t first = start / m->block_size;
+		memcpy(below->digests + first * CCN_MANIFEST_DIGEST_BYTES,
+			   m->digests->buf, m->n * CCN_MANIFEST_DIGEST_BYTES);
+		memset(below->known + first, 1, m->n);
+		res = 0;
+	}
+	ccn_manifest_destroy(&m);
+	return res;
+}
+
+static void
+MfNeedNode(struct ccn_fetch_stream *fs, int level, uintmax_t index) {
+	// asks for a manifest node by its digest, unless already asked
+	struct fetchManifest *mf = fs->mf;
+	struct mfRequest *req = mf->requests;
+	for (; req != NULL; req = req->next)
+		if (req->level == level && req->index == index) return;
+	struct mfLevel *lv = &mf->levels[level];
+	struct ccn_charbuf *name = ccn_charbuf_create();
+	ccn_charbuf_append_charbuf(name, fs->name);
+	ccn_name_append_manifest(name, level, index * lv->blk);
+	ccn_name_append(name, lv->digests + index * CCN_MANIFEST_DIGEST_BYTES,
+					CCN_MANIFEST_DIGEST_BYTES);
+	req = calloc(1, sizeof(*req));
+	req->fs = fs;
+	req->level = level;
+	req->index = index;
+	req->startClock = GetCurrentTimeUSecs();
+	struct ccn_closure *action = calloc(1, sizeof(*action));
+	action->data = req;
+	action->p = &MfCallMe;
+	if (ccn_express_interest(fs->parent->h, name, action, NULL) >= 0) {
+		req->next = mf->requests;
+		mf->requests = req;
+	} else {
+		free(req);
+		free(action);
+	}
+	ccn_charbuf_destroy(&name);
+}
+
+static const unsigned char *
+MfNeedDigest(struct ccn_fetch_stream *fs, seg_t seg) {
+	// finds the digest of the segment, walking down from the root
+	// returns NULL if it is not known yet, and asks for the node
+	// of the manifest that would give the next step down
+	struct fetchManifest *mf = fs->mf;
+	int level = 0;
+	uintmax_t index = 0;
+	if (seg < 0 || (uintmax_t) seg >= mf->count) return NULL;
+	for (;;) {
+		struct mfLevel *below = &mf->levels[level + 1];
+		if (below->blk != 0) {
+			uintmax_t i = seg / below->blk;
+			if (below->known[i]) {
+				if (below->blk == 1)
+					return below->digests + i * CCN_MANIFEST_DIGEST_BYTES;
+				level++;
+				index = i;
+				continue;
 			}
-			if (fb->buf != NULL) free(fb->buf);
-			free(fb);
-			fs->nBufs--;
-		} else {
-			// keep this buffer in play
-			lag = fb;
 		}
-		fb = next;
+		if (level > 0) MfNeedNode(fs, level, index);
+		return NULL;
 	}
 }
 
+static int
+MfCheckDigest(struct ccn_upcall_info *info, const unsigned char *digest) {
+	// returns 1 if the content has the expected implicit digest
+	if (digest == NULL || info->pco == NULL) return 0;
+	ccn_digest_ContentObject(info->content_ccnb, info->pco);
+	if (info->pco->digest_bytes != CCN_MANIFEST_DIGEST_BYTES) return 0;
+	return memcmp(info->pco->digest, digest, CCN_MANIFEST_DIGEST_BYTES) == 0;
+}
+
 static void
+MfDestroy(struct fetchManifest **pmf) {
+	// makes orphans of the node requests, and frees the rest
+	struct fetchManifest *mf = *pmf;
+	int i;
+	if (mf == NULL) return;
+	while (mf->requests != NULL) {
+		struct mfRequest *req = mf->requests;
+		mf->requests = req->next;
+		req->fs = NULL;
+	}
+	for (i = 0; i < CCN_FETCH_MF_LEVELS; i++) {
+		free(mf->levels[i].digests);
+		free(mf->levels[i].known);
+	}
+	ccn_charbuf_destroy(&mf->name);
+	free(mf);
+	*pmf = NULL;
+}
+
+static struct localClosure *
 NeedSegment(struct ccn_fetch_stream *fs, seg_t seg) {
 	// requests that a specific segment interest be registered
 	// but ONLY if it the request not already in flight
 	// AND the segment is not already in a buffer
+	// returns the request if one was placed
 	struct ccn_fetch_buffer *fb = FindBufferForSeg(fs, seg);
 	if (fb != NULL)
 		// no point in requesting what we have
-		return;
+		return NULL;
 	if (fs->finalSeg >= 0 && seg > fs->finalSeg)
 		// no point in requesting off the end, either
-		return;
+		return NULL;
 	if (fs->timeoutSeg > 0 && seg >= fs->timeoutSeg)
 		// don't request a timed-out segment
-		return;
+		return NULL;
 	if (fs->zeroLenSeg > 0 && seg >= fs->zeroLenSeg)
 		// don't request a zero-length segment
-		return;
+		return NULL;
+	const unsigned char *digest = NULL;
+	if (fs->mf != NULL) {
+		digest = MfNeedDigest(fs, seg);
+		if (digest == NULL) {
+			// the manifest node that lists it has to come first
+			if (fs->needSeg > seg) fs->needSeg = seg;
+			return NULL;
+		}
+	}
 	struct localClosure *req = AddSegRequest(fs, seg);
 	if (req != NULL) {
 		FILE *debug = fs->parent->debug;
 		ccn_fetch_flags flags = fs->parent->debugFlags;
-		struct ccn_charbuf *temp = sequenced_name(fs->name, seg);
 		struct ccn *h = fs->parent->h;
 		struct ccn_closure *action = calloc(1, sizeof(*action));
 		action->data = req;
 		action->p = &CallMe;
-		int res = ccn_express_interest(h, temp, action, fs->interest);
-		ccn_charbuf_destroy(&temp);
+		int res;
+		if (digest != NULL) {
+			// ask for exactly the segment that the manifest lists
+			struct ccn_charbuf *temp = sequenced_name(fs->name, seg);
+			ccn_name_append(temp, digest, CCN_MANIFEST_DIGEST_BYTES);
+			res = ccn_express_interest(h, temp, action, fs->interest);
+			ccn_charbuf_destroy(&temp);
+		} else if (fs->compiled != NULL && seg >= 0) {
+			// the usual case, just splice in the segment number
+			unsigned char comp[sizeof(seg_t) + 1];
+			size_t n = seqnum_component(comp, sizeof(comp), seg);
+			res = ccn_express_compiled_interest(h, fs->compiled,
+												comp + sizeof(comp) - n, n,
+												action);
+		} else {
+			struct ccn_charbuf *temp = sequenced_name(fs->name, seg);
+			res = ccn_express_interest(h, temp, action, fs->interest);
+			ccn_charbuf_destroy(&temp);
+		}
 		if (res >= 0) {
 			// the ccn connection accepted our request
 			fs->reqBusy++;
@@ -423,7 +659,7 @@ NeedSegment(struct ccn_fetch_stream *fs, seg_t seg) {
 				fprintf(debug, "\n");
 				fflush(debug);
 			}
-			return;
+			return req;
 		}
 		// the request was not placed, so get rid of the evidence
 		// CallMe won't get a chance to free it
@@ -438,22 +674,235 @@ NeedSegment(struct ccn_fetch_stream *fs, seg_t seg) {
 		free(action);
         
 	}
+	return NULL;
 }
 
-static void
-NeedSegments(struct ccn_fetch_stream *fs) {
-	// determines which segments should be requested
-	// based on the current readSeg and maxBufs 
+static int
+NeedNextSegment(struct ccn_fetch_stream *fs) {
+	// requests the lowest segment that is neither buffered nor in flight,
+	// based on the current readSeg, the room in the buffers,
+	// and the congestion window
+	// returns 1 if an interest was placed
 	seg_t loSeg = fs->readSeg;
-	seg_t hiSeg = loSeg+fs->segsAhead;
+	seg_t hiSeg = loSeg+fs->maxBufs-1;
 	seg_t finalSeg = fs->finalSeg;
 	if (finalSeg >= 0 && hiSeg > finalSeg) hiSeg = finalSeg;
 	if (loSeg > hiSeg) hiSeg = loSeg;
-	while (loSeg <= hiSeg) {
-		// try to request needed segments
-		NeedSegment(fs, loSeg);
-		loSeg++;
+	if (fs->needSeg > loSeg) loSeg = fs->needSeg;
+	while (loSeg <= hiSeg && fs->reqBusy < (int) fs->win.cwnd) {
+		seg_t seg = loSeg++;
+		struct localClosure *req = fs->requests;
+		while (req != NULL && req->reqSeg != seg) req = req->next;
+		if (req != NULL || FindBufferForSeg(fs, seg) != NULL)
+			continue;
+		fs->needSeg = loSeg;
+		return (NeedSegment(fs, seg) != NULL);
+	}
+	fs->needSeg = loSeg;
+	return 0;
+}
+
+static void
+FillPipes(struct ccn_fetch *f) {
+	// the streams take turns placing one interest each,
+	// until the shared budget or every window is used up
+	int ns = f->nStreams;
+	int busy = 0;
+	int idle = 0;
+	int i;
+	for (i = 0; i < ns; i++)
+		busy = busy + f->streams[i]->reqBusy;
+	while (ns > 0 && idle < ns && busy < f->budget) {
+		if (f->rover >= ns) f->rover = 0;
+		struct ccn_fetch_stream *fs = f->streams[f->rover];
+		f->rover++;
+		if (NeedNextSegment(fs)) {
+			busy++;
+			idle = 0;
+		} else idle++;
+	}
+}
+
+static void
+NeedSegments(struct ccn_fetch_stream *fs) {
+	// requests the segments that the stream should have in flight
+	struct ccn_fetch *f = fs->parent;
+	if (f->budget > 0)
+		FillPipes(f);
+	else
+		while (NeedNextSegment(fs));
+}
+
+static void
+WriteToSink(struct ccn_fetch_stream *fs, struct ccn_fetch_buffer *fb) {
+	// writes the bytes of the buffer at its position in the sink,
+	// and releases them
+	intmax_t off = 0;
+	while (off < fb->len && fs->sinkError == 0) {
+		ssize_t res = pwrite(fs->sinkFd, fb->buf+off, fb->len-off,
+							 (off_t) (fb->pos+off));
+		if (res > 0) off = off + res;
+		else if (res == 0) fs->sinkError = EIO;
+		else if (errno != EINTR) fs->sinkError = errno;
+	}
+	FreeBufferBytes(fb);
+}
+
+static void
+DrainToSink(struct ccn_fetch_stream *fs) {
+	// writes out every buffer whose position is known, in any order,
+	// then advances the read position over the written prefix
+	struct ccn_fetch_buffer *fb = NULL;
+	if (fs->sinkFd < 0) return;
+	for (;;) {
+		fb = FindBufferForSeg(fs, fs->readSeg);
+		if (fb == NULL) break;
+		if (fb->pos < 0) fb->pos = fs->readStart;
+		if (fb->buf != NULL) WriteToSink(fs, fb);
+		fs->readSeg++;
+		fs->readStart = fb->pos + fb->len;
+		fs->readPosition = fs->readStart;
+	}
+	int i;
+	for (i = 0; i < fs->ringSize; i++) {
+		fb = &fs->ring[i];
+		if (fb->seg >= 0 && fb->buf != NULL && fb->pos >= 0)
+			WriteToSink(fs, fb);
+	}
+	if (fs->sinkSized < 2 && fs->sinkError == 0) {
+		// settle the extent of the file as soon as it is known,
+		// the exact size may only come with the final segment
+		intmax_t size = -1;
+		if (fs->fileSize >= 0) {
+			size = fs->fileSize;
+			fs->sinkSized = 2;
+		} else if (fs->sinkSized == 0 && fs->segSize > 0 && fs->finalSeg >= 0) {
+			size = (fs->finalSeg + 1) * fs->segSize;
+			fs->sinkSized = 1;
+		}
+		if (size >= 0 && ftruncate(fs->sinkFd, (off_t) size) < 0)
+			fs->sinkError = errno;
+	}
+	PruneSegments(fs);
+}
+
+static void
+NoteWindow(struct ccn_fetch_stream *fs, const char *why) {
+	FILE *debug = fs->parent->debug;
+	ccn_fetch_flags flags = fs->parent->debugFlags;
+	if (debug != NULL && (flags & ccn_fetch_flags_NoteWindow)) {
+		fprintf(debug,
+				"-- ccn_fetch window %s, %s, cwnd %.2f, ssthresh %.2f"
+				", srtt %jd, rto %jd\n",
+				why, fs->id, fs->win.cwnd, fs->win.ssthresh,
+				fs->win.srtt, fs->win.rto);
+		fflush(debug);
+	}
+}
+
+static void
+CloseWindow(struct ccn_fetch_stream *fs, TimeMarker now, int timeout) {
+	// shrinks the congestion window after a loss
+	if (ccn_window_close(&fs->win, now, timeout))
+		NoteWindow(fs, (timeout ? "timeout" : "hole"));
+}
+
+static void
+NoteTimeout(struct ccn_fetch_stream *fs, seg_t seg, intmax_t dt) {
+	// the segment has been asked for too long
+	// assume that this interest will never produce
+	FILE *debug = fs->parent->debug;
+	ccn_fetch_flags flags = fs->parent->debugFlags;
+	seg_t timeoutSeg = fs->timeoutSeg;
+	fs->timeoutsSeen++;
+	fs->win.cwnd = 1.0;
+	if (timeoutSeg < 0 || seg < timeoutSeg) {
+		// we can infer a new timeoutSeg
+		fs->timeoutSeg = seg;
+	}
+	if (debug != NULL && (flags & ccn_fetch_flags_NoteTimeout)) {
+		fprintf(debug, 
+				"** ccn_fetch timeout, %s, seg %jd",
+				fs->id, seg);
+		fprintf(debug, 
+				", dt %jd us, timeoutUSecs %jd\n",
+				dt, fs->timeoutUSecs);
+		fflush(debug);
+	}
+}
+
+static int
+ResendSegRequest(struct ccn_fetch_stream *fs, struct localClosure *old) {
+	// sends the interest for a segment again, ahead of the library timeout
+	// the old request is orphaned, and CallMe disposes of it later
+	// returns 0 if the new interest went out
+	seg_t seg = old->reqSeg;
+	TimeMarker first = old->startClock;
+	int retries = old->retries + 1;
+	if (RemSegRequest(fs, old) != NULL)
+		return -1;
+	if (fs->reqBusy > 0) fs->reqBusy--;
+	struct localClosure *req = NeedSegment(fs, seg);
+	if (req == NULL)
+		return -1;
+	req->startClock = first;
+	req->retries = retries;
+	return 0;
+}
+
+static void
+CheckRequests(struct ccn_fetch_stream *fs) {
+	// sends again the interests that have been out for longer than the
+	// retransmission timeout, and gives up on the ones that are hopeless
+	TimeMarker now = GetCurrentTimeUSecs();
+	struct localClosure *req = fs->requests;
+	int lost = 0;
+	while (req != NULL) {
+		struct localClosure *next = req->next;
+		seg_t seg = req->reqSeg;
+		if (fs->timeoutSeg >= 0 && seg >= fs->timeoutSeg) {
+			// blocked anyway
+		} else if (DeltaTime(req->startClock, now) >= fs->timeoutUSecs) {
+			NoteTimeout(fs, seg, DeltaTime(req->startClock, now));
+		} else if (DeltaTime(req->sendClock, now) >= fs->win.rto) {
+			if (ResendSegRequest(fs, req) == 0) {
+				fs->retransmits++;
+				lost++;
+			}
+		}
+		req = next;
+	}
+	if (lost > 0) {
+		// back off the timer, as well as the window
+		ccn_window_backoff(&fs->win);
+		CloseWindow(fs, now, 1);
+	}
+}
+
+static void
+CheckHoles(struct ccn_fetch_stream *fs, struct localClosure *got, TimeMarker now) {
+	// a segment arrived, so the ones asked for earlier that are still
+	// missing may have been lost
+	// some reordering is normal, so wait a bit more than a round trip
+	struct localClosure *req = fs->requests;
+	intmax_t slack = fs->win.srtt + fs->win.srtt / 4;
+	int lost = 0;
+	while (req != NULL) {
+		struct localClosure *next = req->next;
+		if (req != got && req->reqSeg < got->reqSeg
+			&& req->sendClock <= got->sendClock) {
+			req->holes++;
+			if (req->holes >= CCN_FETCH_HOLE_THRESHOLD
+				&& DeltaTime(req->sendClock, now) > slack
+				&& ResendSegRequest(fs, req) == 0) {
+				fs->fastRetransmits++;
+				lost++;
+			}
+		}
+		req = next;
 	}
+	if (lost > 0)
+		CloseWindow(fs, now, 0);
 }
 
 static void
@@ -494,46 +943,60 @@ CallMe(struct ccn_closure *selfp,
 			// this is the cleanup for an expressed interest
 			req = RemSegRequest(fs, req);
 			if (fs->reqBusy > 0) fs->reqBusy--;
+			if (thisSeg < fs->needSeg && FindBufferForSeg(fs, thisSeg) == NULL)
+				// came back empty, so it may need asking for again
+				fs->needSeg = thisSeg;
 			free(selfp);
 			return(CCN_UPCALL_RESULT_OK);
 		case CCN_UPCALL_INTEREST_TIMED_OUT: {
 			if (finalSeg >= 0 && thisSeg > finalSeg)
 				// ignore this timeout quickly
 				return(CCN_UPCALL_RESULT_OK);
-			intmax_t dt = DeltaTime(req->startClock, GetCurrentTimeUSecs());
+			TimeMarker now = GetCurrentTimeUSecs();
+			intmax_t dt = DeltaTime(req->startClock, now);
 			if (dt >= fs->timeoutUSecs) {
 				// timed out, too many retries
-				// assume that this interest will never produce
-				seg_t timeoutSeg = fs->timeoutSeg;
-				fs->timeoutsSeen++;
-				fs->segsAhead = 0;
-				if (timeoutSeg < 0 || thisSeg < timeoutSeg) {
-					// we can infer a new timeoutSeg
-					fs->timeoutSeg = thisSeg;
-				}
-				if (debug != NULL && (flags & ccn_fetch_flags_NoteTimeout)) {
-					fprintf(debug, 
-							"** ccn_fetch timeout, %s, seg %jd",
-							fs->id, thisSeg);
-					fprintf(debug, 
-							", dt %jd us, timeoutUSecs %jd\n",
-							dt, fs->timeoutUSecs);
-					fflush(debug);
-				}
+				NoteTimeout(fs, thisSeg, dt);
 				return(CCN_UPCALL_RESULT_OK);
 			}
+			// the interest lifetime ran out, so it counts as a loss
+			req->sendClock = now;
+			req->retries++;
+			fs->retransmits++;
+			CloseWindow(fs, now, 1);
 			// TBD: may need to reseed bloom filter?  who to ask?
 			return(CCN_UPCALL_RESULT_REEXPRESS);
 		}
 		case CCN_UPCALL_CONTENT_UNVERIFIED:
-			return (CCN_UPCALL_RESULT_VERIFY);
+			if (fs->mf == NULL)
+				return (CCN_UPCALL_RESULT_VERIFY);
+			// the manifest vouches for it instead, by its digest
 		case CCN_UPCALL_CONTENT_KEYMISSING:
-			return (CCN_UPCALL_RESULT_FETCHKEY);
+			if (fs->mf == NULL)
+				return (CCN_UPCALL_RESULT_FETCHKEY);
 		case CCN_UPCALL_CONTENT:
 		case CCN_UPCALL_CONTENT_RAW:
 			if (fs->timeoutSeg >= 0 && fs->timeoutSeg <= thisSeg)
 				// we will ignore this, since we are blocked
 				return(CCN_UPCALL_RESULT_OK);
+			if (fs->mf != NULL && FindBufferForSeg(fs, thisSeg) == NULL) {
+				struct mfLevel *lv = &fs->mf->levels[fs->mf->segLevel];
+				const unsigned char *digest = NULL;
+				if (fs->mf->segLevel > 0 && thisSeg >= 0
+					&& (uintmax_t) thisSeg < lv->n && lv->known[thisSeg])
+					digest = lv->digests + thisSeg * CCN_MANIFEST_DIGEST_BYTES;
+				if (!MfCheckDigest(info, digest)) {
+					// not what the manifest lists, so it is bogus
+					fs->mf->badDigests++;
+					if (debug != NULL && (flags & ccn_fetch_flags_NoteGlitch)) {
+						fprintf(debug, 
+								"** ccn_fetch bad digest, %s, seg %jd\n",
+								fs->id, thisSeg);
+						fflush(debug);
+					}
+					return(CCN_UPCALL_RESULT_OK);
+				}
+			}
 			break;
 		default:
 			// SHOULD NOT HAPPEN
@@ -585,8 +1048,19 @@ CallMe(struct ccn_closure *selfp,
 					fs->segSize = dataLen;
 			}
 			if (thisSeg == finalSeg) fs->finalSegLen = dataLen;
-			struct ccn_fetch_buffer *fb = NewBufferForSeg(fs, thisSeg, dataLen);
-			memcpy(fb->buf, data, dataLen);
+			TimeMarker now = GetCurrentTimeUSecs();
+			if (req->retries == 0)
+				// only unambiguous samples are used
+				ccn_window_note_rtt(&fs->win, DeltaTime(req->sendClock, now));
+			ccn_window_open(&fs->win, now);
+			CheckHoles(fs, req, now);
+			fs->bytesRead += dataLen;
+			// keep the data where it arrived, rather than copying it
+			struct ccn_slice *slice = ccn_slice_retain(info->h, data, dataLen);
+			struct ccn_fetch_buffer *fb = NewBufferForSeg(fs, thisSeg, dataLen,
+														  slice);
+			if (slice == NULL)
+				memcpy(fb->buf, data, dataLen);
 			if (debug != NULL && (flags & ccn_fetch_flags_NoteFill)) {
 				fprintf(debug, 
 						"-- ccn_fetch FillSeg, %s, seg %jd, len %d, nbuf %d",
@@ -614,11 +1088,82 @@ CallMe(struct ccn_closure *selfp,
 			fs->segsRead++;
 		}
 	}
+	DrainToSink(fs);
+	// keep the pipeline full
+	NeedSegments(fs);
 	
 	ccn_set_run_timeout(fs->parent->h, 0);
 	return(CCN_UPCALL_RESULT_OK);
 }
 
+static enum ccn_upcall_res
+MfCallMe(struct ccn_closure *selfp,
+		 enum ccn_upcall_kind kind,
+		 struct ccn_upcall_info *info) {
+	// MfCallMe is the callback for the interest in a manifest node
+	struct mfRequest *req = (struct mfRequest *) selfp->data;
+	struct ccn_fetch_stream *fs = req->fs;
+	if (kind == CCN_UPCALL_FINAL) {
+		if (fs != NULL) {
+			struct mfRequest **pp = &fs->mf->requests;
+			while (*pp != NULL && *pp != req) pp = &(*pp)->next;
+			if (*pp != NULL) *pp = req->next;
+		}
+		free(req);
+		free(selfp);
+		return(CCN_UPCALL_RESULT_OK);
+	}
+	if (fs == NULL)
+		return(CCN_UPCALL_RESULT_OK);
+	struct fetchManifest *mf = fs->mf;
+	struct mfLevel *lv = &mf->levels[req->level];
+	FILE *debug = fs->parent->debug;
+	ccn_fetch_flags flags = fs->parent->debugFlags;
+	switch (kind) {
+		case CCN_UPCALL_INTEREST_TIMED_OUT: {
+			intmax_t dt = DeltaTime(req->startClock, GetCurrentTimeUSecs());
+			if (dt < fs->timeoutUSecs)
+				return(CCN_UPCALL_RESULT_REEXPRESS);
+			// none of the segments it lists can be asked for
+			NoteTimeout(fs, req->index * lv->blk, dt);
+			return(CCN_UPCALL_RESULT_OK);
+		}
+		case CCN_UPCALL_CONTENT:
+		case CCN_UPCALL_CONTENT_RAW:
+		case CCN_UPCALL_CONTENT_UNVERIFIED:
+		case CCN_UPCALL_CONTENT_KEYMISSING:
+			break;
+		default:
+			return(CCN_UPCALL_RESULT_ERR);
+	}
+	const unsigned char *data = NULL;
+	size_t dataLen = 0;
+	if (!MfCheckDigest(info, lv->digests + req->index * CCN_MANIFEST_DIGEST_BYTES)
+		|| ccn_content_get_value(info->content_ccnb, info->pco->offset[CCN_PCO_E],
+								 info->pco, &data, &dataLen) < 0
+		|| MfAddNode(mf, req->level, req->index, data, dataLen) < 0) {
+		mf->badDigests++;
+		if (debug != NULL && (flags & ccn_fetch_flags_NoteGlitch)) {
+			fprintf(debug, 
+					"** ccn_fetch bad manifest node, %s, level %d, start %ju\n",
+					fs->id, req->level, req->index * lv->blk);
+			fflush(debug);
+		}
+		return(CCN_UPCALL_RESULT_OK);
+	}
+	mf->nodesRead++;
+	if (debug != NULL && (flags & ccn_fetch_flags_NoteFill)) {
+		fprintf(debug, 
+				"-- ccn_fetch manifest node, %s, level %d, start %ju",
+				fs->id, req->level, req->index * lv->blk);
+		ShowDelta(debug, req->startClock);
+	}
+	// the segments it lists may be asked for now
+	NeedSegments(fs);
+	ccn_set_run_timeout(fs->parent->h, 0);
+	return(CCN_UPCALL_RESULT_OK);
+}
+
 ///////////////////////////////////////////////////////
 // External routines
 ///////////////////////////////////////////////////////
@@ -702,6 +1247,8 @@ ccn_fetch_poll(struct ccn_fetch *f) {
 		if (fs != NULL) {
 			intmax_t avail = ccn_fetch_avail(fs);
 			if (avail >= 0) count++;
+			CheckRequests(fs);
+			NeedSegments(fs);
 		}
 	}
 	// we should try for more progress
@@ -760,7 +1307,7 @@ ccn_fetch_open(struct ccn_fetch *f,
 	// returns a new ccn_fetch_stream object based on the arguments
 	// returns NULL if not successful
     if (maxBufs <= 0) return NULL;
-	if (maxBufs > 16) maxBufs = 16;
+	if (maxBufs > CCN_FETCH_MAX_BUFS) maxBufs = CCN_FETCH_MAX_BUFS;
 	int res = 0;
 	FILE *debug = f->debug;
 	ccn_fetch_flags flags = f->debugFlags;
@@ -795,11 +1342,19 @@ ccn_fetch_open(struct ccn_fetch *f,
 		}
 	}
 	fs->maxBufs = maxBufs;
-	fs->segsAhead = 0;
+	fs->ringSize = 1;
+	while (fs->ringSize < 2 * maxBufs) fs->ringSize = 2 * fs->ringSize;
+	fs->ring = calloc(fs->ringSize, sizeof(*(fs->ring)));
+	int i;
+	for (i = 0; i < fs->ringSize; i++) fs->ring[i].seg = -1;
+	ccn_window_init(&fs->win, CCN_WINDOW_AIMD,
+					CCN_FETCH_INITIAL_WINDOW, maxBufs);
+	fs->openClock = GetCurrentTimeUSecs();
 	fs->fileSize = -1;
 	fs->finalSeg = -1;
 	fs->timeoutSeg = -1;
 	fs->zeroLenSeg = -1;
+	fs->sinkFd = -1;
 	fs->parent = f;
 	fs->timeoutUSecs = CCN_INTEREST_TIMEOUT_USECS;  // TBD: how to get better timeout?
 	
@@ -810,6 +1365,7 @@ ccn_fetch_open(struct ccn_fetch *f,
 		fs->interest = cb;
 	} else
 		fs->interest = make_data_template(MaxSuffixDefault);
+	fs->compiled = ccn_compile_interest(fs->name, fs->interest);
 	
 	
 	// remember the stream in the parent
@@ -866,6 +1422,8 @@ ccn_fetch_close(struct ccn_fetch_stream *fs) {
 		ccn_charbuf_destroy(&fs->name);
 	if (fs->interest != NULL)
 		ccn_charbuf_destroy(&fs->interest);
+	ccn_compiled_interest_destroy(&fs->compiled);
+	MfDestroy(&fs->mf);
 	struct ccn_fetch *f = fs->parent;
 	if (f != NULL) {
 		int ns = f->nStreams;
@@ -890,14 +1448,110 @@ ccn_fetch_close(struct ccn_fetch_stream *fs) {
 				fs->segsRequested,
 				fs->segsRead,
 				fs->timeoutsSeen);
+		intmax_t dt = DeltaTime(fs->openClock, GetCurrentTimeUSecs());
+		fprintf(debug,
+				"-- ccn_fetch stats, %s, bytes %jd, dt %jd.%06d, %jd bytes/sec"
+				", cwnd %.2f, srtt %jd us, rto %jd us"
+				", resent %jd, fast resent %jd\n",
+				fs->id,
+				fs->bytesRead,
+				dt / 1000000, (int) (dt % 1000000),
+				(dt > 0) ? (intmax_t) (fs->bytesRead * 1.0e6 / dt) : 0,
+				fs->win.cwnd, fs->win.srtt, fs->win.rto,
+				fs->retransmits, fs->fastRetransmits);
 		fflush(debug);
 	}
 	// finally, get rid of the stream object
+	free(fs->ring);
 	freeString(fs->id);
 	free(fs);
 	return NULL;
 }
 
+/**
+ * Fetches the segments of the stream by way of its manifest.
+ * The signature of the root of the manifest is checked once, here, and
+ * then each segment is asked for by its digest and checked with a hash,
+ * whatever its own signature.  The nodes of a large manifest are
+ * fetched as the segments they list are needed.
+ * Must be called before anything is read from the stream.
+ * @returns -1 if there is no manifest to be had within timeoutMs,
+ * otherwise returns 0.
+ */
+extern int
+ccn_fetch_use_manifest(struct ccn_fetch_stream *fs, int timeoutMs) {
+	if (fs->mf != NULL) return 0;
+	if (fs->readPosition != 0 || fs->sinkFd >= 0) return -1;
+	struct ccn *h = fs->parent->h;
+	struct fetchManifest *mf = calloc(1, sizeof(*mf));
+	struct ccn_charbuf *templ = make_data_template(1);
+	struct ccn_charbuf *cob = ccn_charbuf_create();
+	struct ccn_parsed_ContentObject pco = {0};
+	struct ccn_manifest *m = NULL;
+	const unsigned char *data = NULL;
+	size_t dataLen = 0;
+	int res;
+	mf->name = ccn_charbuf_create();
+	ccn_charbuf_append_charbuf(mf->name, fs->name);
+	ccn_name_append_manifest(mf->name, 0, 0);
+	// the one signature that needs checking
+	res = ccn_get(h, mf->name, templ, timeoutMs, cob, &pco, NULL, 0);
+	if (res >= 0)
+		res = ccn_content_get_value(cob->buf, cob->length, &pco,
+									&data, &dataLen);
+	if (res >= 0) {
+		m = ccn_manifest_parse(data, dataLen);
+		res = -1;
+		if (m != NULL && m->start == 0) {
+			// the root covers whole blocks, though the last may be short
+			mf->count = m->count;
+			mf->levels[0].blk = m->block_size * (m->n > 0 ? m->n : 1);
+			mf->levels[0].n = 1;
+			if (MfAddLevel(mf, 1, m->block_size) == 0
+				&& m->n == mf->levels[1].n) {
+				memcpy(mf->levels[1].digests, m->digests->buf,
+					   m->n * CCN_MANIFEST_DIGEST_BYTES);
+				memset(mf->levels[1].known, 1, m->n);
+				res = 0;
+			}
+		}
+	}
+	ccn_manifest_destroy(&m);
+	ccn_charbuf_destroy(&cob);
+	ccn_charbuf_destroy(&templ);
+	if (res < 0) {
+		MfDestroy(&mf);
+		return -1;
+	}
+	// start over, since what is here so far was not checked
+	struct localClosure *req = fs->requests;
+	fs->requests = NULL;
+	while (req != NULL) {
+		req->fs = NULL;
+		req = req->next;
+	}
+	int i;
+	for (i = 0; i < fs->ringSize; i++)
+		if (fs->ring[i].seg >= 0) ReleaseBuffer(fs, &fs->ring[i]);
+	fs->reqBusy = 0;
+	fs->needSeg = 0;
+	fs->timeoutSeg = -1;
+	fs->zeroLenSeg = -1;
+	fs->fileSize = (mf->count == 0) ? 0 : -1;
+	fs->finalSeg = (seg_t) mf->count - 1;
+	fs->finalSegLen = 0;
+	fs->mf = mf;
+	FILE *debug = fs->parent->debug;
+	if (debug != NULL && (fs->parent->debugFlags & ccn_fetch_flags_NoteOpenClose)) {
+		fprintf(debug, 
+				"-- ccn_fetch manifest, %s, segments %ju\n",
+				fs->id, mf->count);
+		fflush(debug);
+	}
+	NeedSegments(fs);
+	return 0;
+}
+
 /**
  * Tests for available bytes in the stream.
  */
@@ -941,6 +1595,66 @@ ccn_fetch_avail(struct ccn_fetch_stream *fs) {
 	return avail;
 }
 
+static intmax_t
+ReadCheck(struct ccn_fetch_stream *fs) {
+	// checks for the conditions that stop a read at the read position
+	// returns 1 if there may be bytes to read
+	seg_t seg = fs->readSeg;
+	if (fs->fileSize >= 0 && fs->readPosition >= fs->fileSize)
+		// file size known, and we are at the limit
+		return CCN_FETCH_READ_END;
+	if (fs->timeoutSeg >= 0 && seg >= fs->timeoutSeg)
+		// if a needed read timed out, then we say so
+		return CCN_FETCH_READ_TIMEOUT;
+	if (fs->zeroLenSeg >= 0 && seg >= fs->zeroLenSeg)
+		// if we got a zero length segment, report it
+		return CCN_FETCH_READ_ZERO;
+	return 1;
+}
+
+static struct ccn_fetch_buffer *
+ReadBuffer(struct ccn_fetch_stream *fs, intmax_t *off) {
+	// finds the buffer holding the byte at the read position,
+	// and sets *off to the offset of that byte in the buffer
+	// returns NULL if the byte has not arrived
+	intmax_t pos = fs->readPosition;
+	seg_t seg = fs->readSeg;
+	struct ccn_fetch_buffer *fb = FindBufferForSeg(fs, seg);
+	if (fb == NULL) return NULL;
+	if (fb->pos < 0)
+		// segments delivered at random might cause this
+		fb->pos = pos;
+	intmax_t lo = fb->pos;
+	intmax_t hi = lo + fb->len;
+	if (pos < lo || pos >= hi) {
+		// this SHOULD NOT HAPPEN!
+		FILE *debug = fs->parent->debug;
+		if (debug != NULL) {
+			fprintf(debug, 
+					"** ccn_fetch read, %s, seg %jd, pos %jd, lo %jd, hi %jd\n",
+					fs->id, seg, pos, (intmax_t) lo, (intmax_t) hi);
+			fflush(debug);
+		}
+		return NULL;
+	}
+	*off = pos - lo;
+	return fb;
+}
+
+static void
+ReadAdvance(struct ccn_fetch_stream *fs, struct ccn_fetch_buffer *fb,
+			intmax_t n) {
+	// moves the read position over n bytes of the buffer
+	intmax_t pos = fs->readPosition + n;
+	fs->readPosition = pos;
+	fs->readStart = fb->pos;
+	if (pos == fb->pos + fb->len) {
+		// finished the bytes in this segment
+		fs->readSeg++;
+		fs->readStart = pos;
+	}
+}
+
 /**
  * Reads bytes from a stream.
  * Reads at most len bytes into buf from the given stream.
@@ -957,64 +1671,26 @@ extern intmax_t
 ccn_fetch_read(struct ccn_fetch_stream *fs,
 			   void *buf,
 			   intmax_t len) {
-	if (len < 0 || buf == NULL) {
+	if (len < 0 || buf == NULL || fs->sinkFd >= 0) {
 		return CCN_FETCH_READ_NONE;
 	}
-	intmax_t off = 0;
-	intmax_t pos = fs->readPosition;
-	if (fs->fileSize >= 0 && pos >= fs->fileSize) {
-		// file size known, and we are at the limit
-		return CCN_FETCH_READ_END;
-	}
-	intmax_t nr = 0;
+	intmax_t nr = ReadCheck(fs);
+	if (nr <= 0)
+		return nr;
+	nr = 0;
 	unsigned char *dst = (unsigned char *) buf;
-	seg_t seg = fs->readSeg;
-	
-	if (fs->timeoutSeg >= 0 && seg >= fs->timeoutSeg)
-		// if a needed read timed out, then we say so
-		return CCN_FETCH_READ_TIMEOUT;
-	if (fs->zeroLenSeg >= 0 && seg >= fs->zeroLenSeg)
-		// if we got a zero length segment, report it
-		return CCN_FETCH_READ_ZERO;
 	while (len > 0) {
-		struct ccn_fetch_buffer *fb = FindBufferForSeg(fs, seg);
+		intmax_t off = 0;
+		struct ccn_fetch_buffer *fb = ReadBuffer(fs, &off);
 		if (fb == NULL) break;
-		unsigned char *src = fb->buf;
-		intmax_t start = fb->pos;
-		intmax_t lo = start;
-		if (lo < 0) {
-			// segments delivered at random might cause this
-			lo = pos;
-			fb->pos = pos;
-		}
-		intmax_t hi = lo + fb->len;
-		if (pos < lo || pos >= hi || seg != fb->seg) {
-			// this SHOULD NOT HAPPEN!
-			FILE *debug = fs->parent->debug;
-			if (debug != NULL) {
-				fprintf(debug, 
-						"** ccn_fetch read, %s, seg %jd, pos %jd, lo %jd, hi %jd\n",
-						fs->id, seg, pos, (intmax_t) lo, (intmax_t) hi);
-				fflush(debug);
-			}
-			break;
-		}
-		intmax_t d = hi - pos;
+		intmax_t d = fb->len - off;
 		if (d > len) d = len;
-		memcpy(dst+off, src+(pos-lo), d);
+		memcpy(dst+nr, fb->buf+off, d);
 		nr = nr + d;
-		pos = pos + d;
-		off = off + d;
 		len = len - d;
-		fs->readPosition = pos;
-		fs->readStart = start;
-		if (pos == hi) {
-			// finished the bytes in this segment
-			seg++;
-			fs->readSeg = seg;
-			fs->readStart = pos;
-		}
+		ReadAdvance(fs, fb, d);
 	}
+	CheckRequests(fs);
 	NeedSegments(fs);
 	PruneSegments(fs);
 	if (nr == 0) {
@@ -1023,13 +1699,54 @@ ccn_fetch_read(struct ccn_fetch_stream *fs,
 	return nr;
 }
 
+/**
+ * Reads bytes from a stream without copying them.
+ * Sets *pbuf to the bytes at the read position, where they are buffered,
+ * and advances the read position past them.
+ * At most len bytes are returned, and no more than the rest of the
+ * current segment.
+ * The bytes remain valid until the next ccn_fetch_read,
+ * ccn_fetch_read_view, ccn_fetch_seek or ccn_fetch_close on the stream.
+ * @returns as for ccn_fetch_read.
+ */
+extern intmax_t
+ccn_fetch_read_view(struct ccn_fetch_stream *fs,
+					const unsigned char **pbuf,
+					intmax_t len) {
+	if (len < 0 || pbuf == NULL || fs->sinkFd >= 0) {
+		return CCN_FETCH_READ_NONE;
+	}
+	*pbuf = NULL;
+	// what an earlier view pointed at may go now
+	PruneSegments(fs);
+	intmax_t nr = ReadCheck(fs);
+	if (nr <= 0)
+		return nr;
+	nr = 0;
+	intmax_t off = 0;
+	struct ccn_fetch_buffer *fb = ReadBuffer(fs, &off);
+	if (fb != NULL && len > 0) {
+		nr = fb->len - off;
+		if (nr > len) nr = len;
+		*pbuf = fb->buf + off;
+		ReadAdvance(fs, fb, nr);
+	}
+	CheckRequests(fs);
+	NeedSegments(fs);
+	if (nr == 0) {
+		return CCN_FETCH_READ_NONE;
+	}
+	return nr;
+}
+
 /**
  * Resets the timeout marker.
  */
 extern void
 ccn_reset_timeout(struct ccn_fetch_stream *fs) {
 	fs->timeoutSeg = -1;
-	fs->segsAhead = 0;
+	fs->needSeg = fs->readSeg;
+	fs->win.cwnd = 1.0;
 }
 
 /**
@@ -1050,7 +1767,7 @@ ccn_fetch_seek(struct ccn_fetch_stream *fs, intmax_t pos) {
 		// (also resets bad segment indicators)
 		fs->timeoutSeg = -1;
 		fs->zeroLenSeg = -1;
-		fs->segsAhead = 0;
+		fs->win.cwnd = 1.0;
 	} else if (pos == fs->readPosition) {
 		// no change
 		return 0;
@@ -1079,12 +1796,99 @@ ccn_fetch_seek(struct ccn_fetch_stream *fs, intmax_t pos) {
 	fs->readPosition = pos;
 	fs->readStart = start;
 	fs->readSeg = seg;
+	fs->needSeg = seg;
 	NeedSegment(fs, seg);
 	PruneSegments(fs);
 	
 	return 0;
 }
 
+/**
+ * Selects how the congestion window of the stream responds to arrivals
+ * and losses.
+ */
+extern void
+ccn_fetch_set_window_mode(struct ccn_fetch_stream *fs,
+						  ccn_fetch_window_mode mode) {
+	fs->win.mode = ((mode == ccn_fetch_window_CUBIC)
+					? CCN_WINDOW_CUBIC : CCN_WINDOW_AIMD);
+}
+
+/**
+ * Limits the interests in flight for all of the streams together.
+ * 0 (the default) leaves each stream limited only by its own window.
+ */
+extern void
+ccn_fetch_set_budget(struct ccn_fetch *f, int maxInterests) {
+	f->budget = (maxInterests > 0) ? maxInterests : 0;
+}
+
+/**
+ * Writes the data of the stream to fd as segments arrive.
+ * @returns -1 if the stream has been read from, otherwise 0.
+ */
+extern int
+ccn_fetch_set_sink(struct ccn_fetch_stream *fs, int fd) {
+	if (fd < 0 || fs->readPosition != 0) return -1;
+	fs->sinkFd = fd;
+	DrainToSink(fs);
+	return 0;
+}
+
+/**
+ * Fetches the named streams into the given files, all at once.
+ * @returns the number of streams fetched completely.
+ */
+extern int
+ccn_fetch_bulk(struct ccn_fetch *f, int n,
+			   struct ccn_charbuf **names,
+			   const int *fds,
+			   intmax_t *results,
+			   struct ccn_charbuf *interestTemplate,
+			   int maxBufs,
+			   int resolveVersion) {
+	struct ccn_fetch_stream **fss = calloc(n, sizeof(*fss));
+	struct ccn_charbuf *id = ccn_charbuf_create();
+	int left = 0;
+	int done = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		if (results != NULL) results[i] = CCN_FETCH_READ_NONE;
+		id->length = 0;
+		ccn_uri_append(id, names[i]->buf, names[i]->length, 0);
+		fss[i] = ccn_fetch_open(f, names[i], ccn_charbuf_as_string(id),
+								interestTemplate, maxBufs, resolveVersion, 1);
+		if (fss[i] == NULL) continue;
+		ccn_fetch_set_sink(fss[i], fds[i]);
+		left++;
+	}
+	ccn_charbuf_destroy(&id);
+	while (left > 0) {
+		if (ccn_run(f->h, 100) < 0) break;
+		ccn_fetch_poll(f);
+		for (i = 0; i < n; i++) {
+			struct ccn_fetch_stream *fs = fss[i];
+			if (fs == NULL) continue;
+			intmax_t res = ccn_fetch_avail(fs);
+			if (fs->sinkError != 0) {
+				res = CCN_FETCH_READ_NONE;
+			} else if (res == CCN_FETCH_READ_END) {
+				res = fs->fileSize;
+				done++;
+			} else if (res != CCN_FETCH_READ_TIMEOUT
+					   && res != CCN_FETCH_READ_ZERO)
+				continue;
+			if (results != NULL) results[i] = res;
+			fss[i] = ccn_fetch_close(fs);
+			left--;
+		}
+	}
+	for (i = 0; i < n; i++)
+		if (fss[i] != NULL) ccn_fetch_close(fss[i]);
+	free(fss);
+	return done;
+}
+
 /**
  * @returns the current read position.
  */
@@ -22,18 +22,77 @@
 #include <string.h>
 #include <ccn/indexbuf.h>
 
+#ifdef CCN_BUF_PROFILE
+#undef ccn_indexbuf_create
+#endif
+
 #define ELEMENT size_t
 
+/**
+ * Storage for the first CCN_INDEXBUF_INLINE elements, just past the struct.
+ */
+#define INDEXBUF_INLINE_SPACE(c) ((ELEMENT *)((c) + 1))
+
 /**
  * Create a new indexbuf.
+ *
+ * The struct and room for CCN_INDEXBUF_INLINE elements come from
+ * a single allocation.
  */
 struct ccn_indexbuf *
 ccn_indexbuf_create(void)
 {
     struct ccn_indexbuf *c;
-    c = calloc(1, sizeof(*c));
+    c = calloc(1, sizeof(*c) + CCN_INDEXBUF_INLINE * sizeof(ELEMENT));
+    if (c != NULL) {
+        c->buf = INDEXBUF_INLINE_SPACE(c);
+        c->limit = CCN_INDEXBUF_INLINE;
+    }
+    return(c);
+}
+
+/**
+ * Set up an indexbuf whose first elements live in caller-provided space.
+ */
+void
+ccn_indexbuf_init_inline(struct ccn_indexbuf *c, size_t space)
+{
+    c->n = 0;
+    c->limit = space;
+    c->buf = INDEXBUF_INLINE_SPACE(c);
+#ifdef CCN_BUF_PROFILE
+    c->site = NULL;
+#endif
+}
+
+/**
+ * Release any storage an inline indexbuf has grown into.
+ */
+void
+ccn_indexbuf_fini(struct ccn_indexbuf *c)
+{
+    if (c->buf != INDEXBUF_INLINE_SPACE(c))
+        free(c->buf);
+    c->buf = NULL;
+    c->n = c->limit = 0;
+}
+
+#ifdef CCN_BUF_PROFILE
+/**
+ * Create a new indexbuf, counting it against the caller.
+ */
+struct ccn_indexbuf *
+ccn_indexbuf_create_at(const char *file, int line)
+{
+    struct ccn_indexbuf *c;
+    c = ccn_indexbuf_create();
+    if (c != NULL) {
+        c->site = ccn_bufprof_site(file, line, CCN_BUFPROF_INDEXBUF);
+        ccn_bufprof_alloc(c->site, 0, 0);
+    }
     return(c);
 }
+#endif
 
 /**
  * Deallocate indexbuf.
@@ -43,7 +102,7 @@ ccn_indexbuf_destroy(struct ccn_indexbuf **cbp)
 {
     struct ccn_indexbuf *c = *cbp;
     if (c != NULL) {
-        if (c->buf != NULL) {
+        if (c->buf != INDEXBUF_INLINE_SPACE(c)) {
             free(c->buf);
         }
         free(c);
@@ -66,18 +125,25 @@ ccn_indexbuf_reserve(struct ccn_indexbuf *c, size_t n)
     if (newlim > oldlim) {
         if (2 * oldlim > newlim)
             newlim = 2 * oldlim;
-#ifdef CCN_NOREALLOC
-        buf = malloc(newlim * sizeof(ELEMENT));
-        if (buf == NULL)
-            return(NULL);
-        memcpy(buf, c->buf, oldlim * sizeof(ELEMENT));
-        free(c->buf);
-#else
-        buf = realloc(c->buf, newlim * sizeof(ELEMENT));
+#ifndef CCN_NOREALLOC
+        if (buf != INDEXBUF_INLINE_SPACE(c))
+            buf = realloc(c->buf, newlim * sizeof(ELEMENT));
+        else
+#endif
+        {
+            buf = malloc(newlim * sizeof(ELEMENT));
+            if (buf != NULL) {
+                memcpy(buf, c->buf, oldlim * sizeof(ELEMENT));
+                if (c->buf != INDEXBUF_INLINE_SPACE(c))
+                    free(c->buf);
+            }
+        }
         if (buf == NULL)
             return(NULL);
-#endif
         memset(buf + oldlim, 0, (newlim - oldlim) * sizeof(ELEMENT));
+#ifdef CCN_BUF_PROFILE
+        ccn_bufprof_alloc(c->site, newlim * sizeof(ELEMENT), 1);
+#endif
         c->buf = buf;
         c->limit = newlim;
     }
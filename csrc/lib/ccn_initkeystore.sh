@@ -14,6 +14,8 @@
 #
 # Create a ccn keystore without relying on java
 : ${RSA_KEYSIZE:=1024}
+# Set CCN_KEYTYPE=ec for an ECDSA P-256 key, which is much cheaper to sign with
+: ${CCN_KEYTYPE:=rsa}
 : ${CCN_USER:=`id -n -u`}
 Fail () {
   echo '*** Failed' "$*"
@@ -21,6 +23,11 @@ Fail () {
 }
 test -d .ccnx && rm -rf .ccnx
 test $RSA_KEYSIZE -ge 512 || Fail \$RSA_KEYSIZE too small to sign CCN content
+case $CCN_KEYTYPE in
+  rsa) NEWKEY="-newkey rsa:$RSA_KEYSIZE -keyout private_key.pem";;
+  ec)  NEWKEY="-key private_key.pem";;
+  *)   Fail \$CCN_KEYTYPE must be rsa or ec;;
+esac
 (umask 077 && mkdir .ccnx) || Fail $0 Unable to create .ccnx directory
 cd .ccnx
 umask 077
@@ -37,10 +44,13 @@ countryName_default		= AU
 countryName_min			= 2
 countryName_max			= 2
 EOF
+if [ $CCN_KEYTYPE = ec ]; then
+  openssl ecparam -name prime256v1 -param_enc named_curve \
+                  -genkey -noout -out private_key.pem   || Fail openssl ecparam
+fi
 openssl req    -config openssl.cnf      \
-               -newkey rsa:$RSA_KEYSIZE \
+               $NEWKEY                  \
                -x509                    \
-               -keyout private_key.pem  \
                -out certout.pem         \
                -subj /CN="$CCN_USER"    \
                -nodes                                   || Fail openssl req
@@ -22,10 +22,17 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
 #include <openssl/evp.h>
+#include <openssl/opensslv.h>
 #include <openssl/x509v3.h>
 #include <openssl/pkcs12.h>
 #include <openssl/sha.h>
@@ -67,6 +74,230 @@ ccn_keystore_destroy(struct ccn_keystore **p)
     }
 }
 
+/*
+ * Unlocking a PKCS#12 keystore runs the password through many rounds of
+ * key derivation, which dominates the startup time of short-lived tools.
+ * If CCNX_KEYSTORE_CACHE is set (and not "0"), the unlocked private key
+ * and certificate are kept in DER form in a file next to the keystore,
+ * with the suffix below.  The cache is only used if it is a regular file
+ * owned by the user and not accessible to anyone else, and if it was
+ * made from the same keystore bytes and password; it is rewritten
+ * otherwise.
+ */
+#define KEYSTORE_CACHE_SUFFIX ".cache"
+#define KEYSTORE_CACHE_MAGIC "CCNxKC01"
+#define KEYSTORE_CACHE_MAX 65536
+#define KEYSTORE_CACHE_HEADER (8 + SHA256_DIGEST_LENGTH + 4 + 4)
+
+static int
+keystore_cache_enabled(void)
+{
+    const char *s = getenv("CCNX_KEYSTORE_CACHE");
+    return (s != NULL && s[0] != 0 && strcmp(s, "0") != 0);
+}
+
+static char *
+keystore_cache_name(const char *filename)
+{
+    size_t len = strlen(filename);
+    char *ans = malloc(len + sizeof(KEYSTORE_CACHE_SUFFIX));
+    if (ans != NULL) {
+        memcpy(ans, filename, len);
+        memcpy(ans + len, KEYSTORE_CACHE_SUFFIX, sizeof(KEYSTORE_CACHE_SUFFIX));
+    }
+    return (ans);
+}
+
+/*
+ * Read a whole (small) file into a malloced buffer.
+ * If fd is not -1 it is used (and closed); otherwise filename is opened.
+ */
+static unsigned char *
+read_small_file(const char *filename, int fd, size_t *sizep)
+{
+    struct stat st;
+    unsigned char *buf = NULL;
+    ssize_t n;
+    size_t have = 0;
+
+    if (fd == -1)
+        fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return (NULL);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size > KEYSTORE_CACHE_MAX)
+        goto Bail;
+    buf = malloc(st.st_size + 1);
+    if (buf == NULL)
+        goto Bail;
+    while (have < (size_t)st.st_size) {
+        n = read(fd, buf + have, st.st_size - have);
+        if (n <= 0)
+            goto Bail;
+        have += n;
+    }
+    close(fd);
+    *sizep = have;
+    return (buf);
+Bail:
+    if (buf != NULL) {
+        OPENSSL_cleanse(buf, have);
+        free(buf);
+    }
+    close(fd);
+    return (NULL);
+}
+
+/*
+ * The cache is tied to the keystore contents and the password.
+ */
+static int
+keystore_cache_tag(const char *filename, const char *password,
+                   unsigned char *tag)
+{
+    SHA256_CTX ctx;
+    unsigned char *ks;
+    size_t size = 0;
+
+    ks = read_small_file(filename, -1, &size);
+    if (ks == NULL)
+        return (-1);
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, ks, size);
+    SHA256_Update(&ctx, password, strlen(password));
+    SHA256_Final(tag, &ctx);
+    free(ks);
+    return (0);
+}
+
+static void
+put_uint32(unsigned char *q, uint32_t v)
+{
+    q[0] = v >> 24;
+    q[1] = v >> 16;
+    q[2] = v >> 8;
+    q[3] = v;
+}
+
+static uint32_t
+get_uint32(const unsigned char *q)
+{
+    return (((uint32_t)q[0] << 24) | (q[1] << 16) | (q[2] << 8) | q[3]);
+}
+
+static int
+keystore_read_cache(struct ccn_keystore *p, const char *filename,
+                    const unsigned char *tag)
+{
+    struct stat st;
+    char *cachename;
+    unsigned char *buf = NULL;
+    const unsigned char *q;
+    size_t size = 0;
+    uint32_t keylen;
+    uint32_t certlen;
+    int fd;
+    int res = -1;
+
+    cachename = keystore_cache_name(filename);
+    if (cachename == NULL)
+        return (-1);
+    fd = open(cachename, O_RDONLY | O_NOFOLLOW);
+    free(cachename);
+    if (fd == -1)
+        return (-1);
+    if (fstat(fd, &st) != 0 || st.st_uid != geteuid() ||
+        (st.st_mode & 077) != 0) {
+        close(fd);
+        return (-1);
+    }
+    buf = read_small_file(NULL, fd, &size);
+    if (buf == NULL || size < KEYSTORE_CACHE_HEADER)
+        goto Finish;
+    if (memcmp(buf, KEYSTORE_CACHE_MAGIC, 8) != 0 ||
+        memcmp(buf + 8, tag, SHA256_DIGEST_LENGTH) != 0)
+        goto Finish;
+    keylen = get_uint32(buf + 8 + SHA256_DIGEST_LENGTH);
+    certlen = get_uint32(buf + 8 + SHA256_DIGEST_LENGTH + 4);
+    if (keylen > size || certlen > size ||
+        KEYSTORE_CACHE_HEADER + keylen + certlen != size)
+        goto Finish;
+    q = buf + KEYSTORE_CACHE_HEADER;
+    p->private_key = d2i_AutoPrivateKey(NULL, &q, keylen);
+    q = buf + KEYSTORE_CACHE_HEADER + keylen;
+    p->certificate = d2i_X509(NULL, &q, certlen);
+    if (p->private_key != NULL && p->certificate != NULL)
+        res = 0;
+    else {
+        if (p->private_key != NULL)
+            EVP_PKEY_free(p->private_key);
+        if (p->certificate != NULL)
+            X509_free(p->certificate);
+        p->private_key = NULL;
+        p->certificate = NULL;
+    }
+Finish:
+    if (buf != NULL) {
+        OPENSSL_cleanse(buf, size);
+        free(buf);
+    }
+    return (res);
+}
+
+static void
+keystore_write_cache(struct ccn_keystore *p, const char *filename,
+                     const unsigned char *tag)
+{
+    char *cachename;
+    char *tempname = NULL;
+    unsigned char *buf = NULL;
+    unsigned char *q;
+    int keylen;
+    int certlen;
+    size_t size = 0;
+    int fd = -1;
+
+    cachename = keystore_cache_name(filename);
+    if (cachename == NULL)
+        return;
+    keylen = i2d_PrivateKey(p->private_key, NULL);
+    certlen = i2d_X509(p->certificate, NULL);
+    if (keylen <= 0 || certlen <= 0)
+        goto Finish;
+    size = KEYSTORE_CACHE_HEADER + keylen + certlen;
+    buf = malloc(size);
+    tempname = malloc(strlen(cachename) + 8);
+    if (buf == NULL || tempname == NULL)
+        goto Finish;
+    memcpy(buf, KEYSTORE_CACHE_MAGIC, 8);
+    memcpy(buf + 8, tag, SHA256_DIGEST_LENGTH);
+    put_uint32(buf + 8 + SHA256_DIGEST_LENGTH, keylen);
+    put_uint32(buf + 8 + SHA256_DIGEST_LENGTH + 4, certlen);
+    q = buf + KEYSTORE_CACHE_HEADER;
+    i2d_PrivateKey(p->private_key, &q);
+    i2d_X509(p->certificate, &q);
+    /* write a private temporary, then move it into place */
+    sprintf(tempname, "%s.XXXXXX", cachename);
+    fd = mkstemp(tempname);
+    if (fd == -1)
+        goto Finish;
+    if (fchmod(fd, S_IRUSR | S_IWUSR) != 0 ||
+        write(fd, buf, size) != (ssize_t)size ||
+        close(fd) != 0 ||
+        rename(tempname, cachename) != 0) {
+        if (fd != -1)
+            close(fd);
+        unlink(tempname);
+    }
+Finish:
+    if (buf != NULL) {
+        OPENSSL_cleanse(buf, size);
+        free(buf);
+    }
+    free(tempname);
+    free(cachename);
+}
+
 int
 ccn_keystore_init(struct ccn_keystore *p, char *filename, char *password)
 {
@@ -75,21 +306,29 @@ ccn_keystore_init(struct ccn_keystore *p, char *filename, char *password)
     ASN1_OBJECT *digest_obj;
     int digest_size;
     int res;
+    int cache;
+    unsigned char tag[SHA256_DIGEST_LENGTH];
 
     OpenSSL_add_all_algorithms();
-    fp = fopen(filename, "rb");
-    if (fp == NULL)
-        return (-1);
+    cache = keystore_cache_enabled() &&
+            keystore_cache_tag(filename, password, tag) == 0;
+    if (cache && keystore_read_cache(p, filename, tag) == 0)
+        cache = 0; /* already current */
+    else {
+        fp = fopen(filename, "rb");
+        if (fp == NULL)
+            return (-1);
 
-    keystore = d2i_PKCS12_fp(fp, NULL);
-    fclose(fp);
-    if (keystore == NULL)
-        return (-1);
+        keystore = d2i_PKCS12_fp(fp, NULL);
+        fclose(fp);
+        if (keystore == NULL)
+            return (-1);
 
-    res = PKCS12_parse(keystore, password, &(p->private_key), &(p->certificate), NULL);
-    PKCS12_free(keystore);
-    if (res == 0) {
-        return (-1);
+        res = PKCS12_parse(keystore, password, &(p->private_key), &(p->certificate), NULL);
+        PKCS12_free(keystore);
+        if (res == 0) {
+            return (-1);
+        }
     }
     p->public_key = X509_get_pubkey(p->certificate);
     /* cache the public key digest to avoid work later */
@@ -118,6 +357,8 @@ ccn_keystore_init(struct ccn_keystore *p, char *filename, char *password)
     }
     
     p->initialized = 1;
+    if (cache)
+        keystore_write_cache(p, filename, tag);
     return (0);
 }
 
@@ -198,7 +439,7 @@ add_cert_extension(X509 *cert, int nid, char *value)
     return(1);
 }
 /**
- * Create a PKCS12 keystore file
+ * Create a PKCS12 keystore file holding an RSA key
  * @param filename  the name of the keystore file to be created.
  * @param password  the import/export password for the keystore.
  * @param subject   the subject (and issuer) name in the certificate.
@@ -212,12 +453,79 @@ int
 ccn_keystore_file_init(char *filename, char *password,
                        char *subject, int keylength, int validity_days)
 {
-	RSA *rsa = RSA_new();
-    BIGNUM *pub_exp = BN_new();
+    return(ccn_keystore_file_init_key(filename, password, subject,
+                                      CCN_KEYSTORE_KEY_RSA, keylength,
+                                      validity_days));
+}
+
+/**
+ * Generate the key pair for a new keystore.
+ * @returns 1 on success, 0 on failure
+ */
+static int
+generate_key(EVP_PKEY *pkey, int keytype, int keylength)
+{
+    RSA *rsa = NULL;
+    BIGNUM *pub_exp = NULL;
+    EC_KEY *ec = NULL;
+    int res = 0;
+    
+    switch (keytype) {
+        case CCN_KEYSTORE_KEY_RSA:
+            rsa = RSA_new();
+            pub_exp = BN_new();
+            if (rsa == NULL || pub_exp == NULL)
+                break;
+            BN_set_word(pub_exp, RSA_F4);
+            res = RSA_generate_key_ex(rsa, keylength, pub_exp, NULL);
+            res &= EVP_PKEY_set1_RSA(pkey, rsa);
+            break;
+        case CCN_KEYSTORE_KEY_EC:
+            ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+            if (ec == NULL)
+                break;
+            /* Name the curve in the certificate rather than spelling it out */
+            EC_KEY_set_asn1_flag(ec, OPENSSL_EC_NAMED_CURVE);
+            res = EC_KEY_generate_key(ec);
+            res &= EVP_PKEY_set1_EC_KEY(pkey, ec);
+            break;
+    }
+    if (rsa != NULL)
+        RSA_free(rsa);
+    if (pub_exp != NULL)
+        BN_free(pub_exp);
+    if (ec != NULL)
+        EC_KEY_free(ec);
+    return(res);
+}
+
+/**
+ * Create a PKCS12 keystore file
+ *
+ * An ECDSA key on the P-256 curve signs many times faster than an RSA
+ * key of comparable strength, and makes much smaller signatures, which
+ * matters to a producer that signs every segment.
+ * @param filename  the name of the keystore file to be created.
+ * @param password  the import/export password for the keystore.
+ * @param subject   the subject (and issuer) name in the certificate.
+ * @param keytype   CCN_KEYSTORE_KEY_RSA or CCN_KEYSTORE_KEY_EC.
+ * @param keylength the number of bits in the key to be generated.
+ *                  A value <= 0 will result in the default being used,
+ *                  1024 for RSA.  An EC key is always 256 bits.
+ * @param validity_days the number of days the certificate in the keystore will
+ *                  be valid.  A value <= 0 will result in the default (30) being used.
+ * @returns 0 on success, -1 on failure
+ */
+int
+ccn_keystore_file_init_key(char *filename, char *password, char *subject,
+                           int keytype, int keylength, int validity_days)
+{
     EVP_PKEY *pkey = EVP_PKEY_new();
     X509 *cert = X509_new();
     X509_NAME *name = NULL;
     PKCS12 *pkcs12 = NULL;
+    const EVP_MD *cert_md = NULL;
+    char *key_usage = NULL;
     unsigned char spkid[SHA256_DIGEST_LENGTH];
     char spkid_hex[1 + 2 * SHA256_DIGEST_LENGTH];
     unsigned long serial = 0;
@@ -229,21 +537,38 @@ ccn_keystore_file_init(char *filename, char *password,
     int ans = -1;
     
     // Check whether initial allocations succeeded.
-    if (rsa == NULL || pub_exp == NULL || pkey == NULL || cert == NULL)
+    if (pkey == NULL || cert == NULL)
         goto Bail;
     
     // Set up default values for keylength and expiration.
-    if (keylength <= 0)
-        keylength = 1024;
+    switch (keytype) {
+        case CCN_KEYSTORE_KEY_RSA:
+            if (keylength <= 0)
+                keylength = 1024;
+            cert_md = EVP_sha1();
+            key_usage = "digitalSignature,nonRepudiation,keyEncipherment,dataEncipherment,keyAgreement";
+            break;
+        case CCN_KEYSTORE_KEY_EC:
+            if (keylength <= 0)
+                keylength = 256;
+            if (keylength != 256)
+                goto Bail;
+#if OPENSSL_VERSION_NUMBER < 0x10000000L
+            cert_md = EVP_ecdsa();
+#else
+            cert_md = EVP_sha256();
+#endif
+            key_usage = "digitalSignature,nonRepudiation,keyAgreement";
+            break;
+        default:
+            goto Bail;
+    }
     if (validity_days <= 0)
         validity_days = 30;
     
     OpenSSL_add_all_algorithms();
     
-    BN_set_word(pub_exp, RSA_F4);
-    res = 1;
-    res &= RSA_generate_key_ex(rsa, keylength, pub_exp, NULL);
-    res &= EVP_PKEY_set1_RSA(pkey, rsa);
+    res = generate_key(pkey, keytype, keylength);
     res &= X509_set_version(cert, 2);       // 2 => X509v3
 	if (res == 0)
         goto Bail;
@@ -271,7 +596,7 @@ ccn_keystore_file_init(char *filename, char *password,
     
     // Add the necessary extensions.
     res &= add_cert_extension(cert, NID_basic_constraints, "critical,CA:FALSE");
-    res &= add_cert_extension(cert, NID_key_usage, "digitalSignature,nonRepudiation,keyEncipherment,dataEncipherment,keyAgreement");
+    res &= add_cert_extension(cert, NID_key_usage, key_usage);
     res &= add_cert_extension(cert, NID_ext_key_usage, "clientAuth");
     
     if (res == 0)
@@ -296,7 +621,7 @@ ccn_keystore_file_init(char *filename, char *password,
         goto Bail;
     
     // The certificate is complete, sign it.
-    res = X509_sign(cert, pkey, EVP_sha1());
+    res = X509_sign(cert, pkey, cert_md);
     if (res == 0)
         goto Bail;
 
@@ -332,14 +657,6 @@ Bail:
         EVP_PKEY_free(pkey);
         pkey = NULL;
     }
-    if (rsa != NULL) {
-        RSA_free(rsa);
-        rsa = NULL;
-    }
-    if (pub_exp != NULL){
-        BN_free(pub_exp);
-        pub_exp = NULL;
-    }
     if (cert != NULL) {
         X509_free(cert);
         cert = NULL;
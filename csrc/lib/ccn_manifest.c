@@ -0,0 +1,265 @@
+/**
+ * @file ccn_manifest.c
+ * @brief Support for manifests of segmented content.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/manifest.h>
+
+static const unsigned char manifest_marker[] = {
+    CCN_MARKER_CONTROL, '.', 'M', 'A', 'N', 'I', 'F', 'E', 'S', 'T'
+};
+
+static int
+parse_tagged_uintmax(struct ccn_buf_decoder *d, enum ccn_dtag dtag,
+                     uintmax_t *result)
+{
+    int res;
+
+    if (!ccn_buf_match_dtag(d, dtag))
+        return(d->decoder.state = -__LINE__);
+    ccn_buf_advance(d);
+    res = ccn_parse_uintmax(d, result);
+    ccn_buf_check_close(d);
+    return(res);
+}
+
+/**
+ * Parse a ccnb-encoded Manifest
+ * @returns the manifest, to be freed with ccn_manifest_destroy, or NULL
+ *          if it is not well formed.
+ */
+struct ccn_manifest *
+ccn_manifest_parse(const unsigned char *p, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&decoder, p, size);
+    struct ccn_manifest *result;
+    const unsigned char *blob;
+    size_t blobsize;
+    int res = 0;
+
+    result = calloc(1, sizeof(*result));
+    if (result == NULL)
+        return(NULL);
+    result->digests = ccn_charbuf_create();
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Manifest)) {
+        ccn_buf_advance(d);
+        res |= parse_tagged_uintmax(d, CCN_DTAG_Start, &result->start);
+        res |= parse_tagged_uintmax(d, CCN_DTAG_Count, &result->count);
+        res |= parse_tagged_uintmax(d, CCN_DTAG_BlockSize, &result->block_size);
+        if (res < 0)
+            d->decoder.state = -__LINE__;
+        while (ccn_buf_match_dtag(d, CCN_DTAG_ContentDigest)) {
+            ccn_buf_advance(d);
+            if (ccn_buf_match_blob(d, &blob, &blobsize) &&
+                blobsize == CCN_MANIFEST_DIGEST_BYTES) {
+                ccn_charbuf_append(result->digests, blob, blobsize);
+                result->n++;
+                ccn_buf_advance(d);
+            }
+            else
+                d->decoder.state = -__LINE__;
+            ccn_buf_check_close(d);
+        }
+        ccn_buf_check_close(d);
+    }
+    else
+        d->decoder.state = -__LINE__;
+    if (d->decoder.index != size || !CCN_FINAL_DSTATE(d->decoder.state))
+        ccn_manifest_destroy(&result);
+    else if (result->block_size == 0 || result->n >
+             (result->count + result->block_size - 1) / result->block_size)
+        ccn_manifest_destroy(&result);
+    return(result);
+}
+
+/**
+ * Destroy the result of a ccn_manifest_parse
+ */
+void
+ccn_manifest_destroy(struct ccn_manifest **pm)
+{
+    if (*pm == NULL)
+        return;
+    ccn_charbuf_destroy(&(*pm)->digests);
+    free(*pm);
+    *pm = NULL;
+}
+
+/**
+ * Append a ccnb-encoded Manifest
+ * @returns 0, or -1 for error
+ */
+int
+ccnb_append_manifest(struct ccn_charbuf *c, const struct ccn_manifest *m)
+{
+    int res;
+    int i;
+
+    if (m->digests->length != (size_t)m->n * CCN_MANIFEST_DIGEST_BYTES)
+        return(-1);
+    res = ccnb_element_begin(c, CCN_DTAG_Manifest);
+    res |= ccnb_tagged_putf(c, CCN_DTAG_Start, "%ju", m->start);
+    res |= ccnb_tagged_putf(c, CCN_DTAG_Count, "%ju", m->count);
+    res |= ccnb_tagged_putf(c, CCN_DTAG_BlockSize, "%ju", m->block_size);
+    for (i = 0; i < m->n; i++)
+        res |= ccnb_append_tagged_blob(c, CCN_DTAG_ContentDigest,
+                m->digests->buf + i * CCN_MANIFEST_DIGEST_BYTES,
+                CCN_MANIFEST_DIGEST_BYTES);
+    res |= ccnb_element_end(c);
+    return(res);
+}
+
+/**
+ * Append the name of a manifest node to the name of a stream
+ *
+ * The root is stream/%C1.MANIFEST.  The node at a level below it
+ * covering segments from start is stream/%C1.MANIFEST/level/start.
+ * Levels count down from the root, so the digests of level 1 nodes
+ * are in the root, those of level 2 nodes in level 1 nodes, and so on;
+ * the nodes of the lowest level list segment digests.
+ * @param name is the ccnb-encoded versioned name of the stream.
+ * @param level is 0 for the root.
+ * @returns 0, or -1 for error
+ */
+int
+ccn_name_append_manifest(struct ccn_charbuf *name, int level, uintmax_t start)
+{
+    int res;
+
+    res = ccn_name_append(name, manifest_marker, sizeof(manifest_marker));
+    if (res >= 0 && level > 0) {
+        res = ccn_name_append_numeric(name, CCN_MARKER_NONE, level);
+        if (res >= 0)
+            res = ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, start);
+    }
+    return(res);
+}
+
+/**
+ * Sign one manifest node and put it, noting its digest
+ */
+static int
+manifest_put_node(struct ccn *h, struct ccn_charbuf *name, int level,
+                  const struct ccn_manifest *m, struct ccn_charbuf *digests)
+{
+    struct ccn_charbuf *nn = ccn_charbuf_create();
+    struct ccn_charbuf *body = ccn_charbuf_create();
+    struct ccn_charbuf *cob = ccn_charbuf_create();
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_parsed_ContentObject pco = {0};
+    int res;
+
+    ccn_charbuf_append_charbuf(nn, name);
+    res = ccn_name_append_manifest(nn, level, m->start);
+    if (res >= 0)
+        res = ccnb_append_manifest(body, m);
+    /* Only the root needs a real signature; the rest are had by digest */
+    if (level > 0)
+        sp.sp_flags |= CCN_SP_DIGEST_ONLY;
+    if (res >= 0)
+        res = ccn_sign_content(h, cob, nn, &sp, body->buf, body->length);
+    if (res >= 0)
+        res = ccn_put(h, cob->buf, cob->length);
+    if (res >= 0 && digests != NULL) {
+        res = ccn_parse_ContentObject(cob->buf, cob->length, &pco, NULL);
+        if (res >= 0) {
+            ccn_digest_ContentObject(cob->buf, &pco);
+            ccn_charbuf_append(digests, pco.digest, sizeof(pco.digest));
+        }
+    }
+    ccn_charbuf_destroy(&nn);
+    ccn_charbuf_destroy(&body);
+    ccn_charbuf_destroy(&cob);
+    return(res < 0 ? -1 : 0);
+}
+
+/**
+ * Publish the manifest of a segmented stream
+ *
+ * The nodes are built from the bottom up, since each lists the digests
+ * of the ones below it, and put as they are made.  Only the root, which
+ * comes last, is signed with the default key.
+ * @param name is the ccnb-encoded versioned name of the stream.
+ * @param digests holds the digests of the count segments, in order.
+ * @returns 0, or -1 for error
+ */
+int
+ccn_manifest_put(struct ccn *h, struct ccn_charbuf *name,
+                 const unsigned char *digests, uintmax_t count)
+{
+    struct ccn_charbuf *below = NULL;
+    struct ccn_charbuf *above = NULL;
+    struct ccn_charbuf *t = NULL;
+    struct ccn_manifest m = {0};
+    uintmax_t block = 1;    /* segments per item of the level below */
+    uintmax_t nitems = count;
+    uintmax_t i;
+    int depth = 0;
+    int level;
+    int res = 0;
+    
+    for (i = count; i > CCN_MANIFEST_FANOUT; depth++)
+        i = (i + CCN_MANIFEST_FANOUT - 1) / CCN_MANIFEST_FANOUT;
+    if (depth > CCN_MANIFEST_MAX_DEPTH)
+        return(-1);
+    below = ccn_charbuf_create();
+    above = ccn_charbuf_create();
+    ccn_charbuf_append(below, digests, count * CCN_MANIFEST_DIGEST_BYTES);
+    m.digests = ccn_charbuf_create();
+    for (level = depth; res == 0; level--) {
+        above->length = 0;
+        m.block_size = block;
+        for (i = 0; res == 0 && (i < nitems || i == 0);
+             i += CCN_MANIFEST_FANOUT) {
+            m.start = i * block;
+            m.n = nitems - i;
+            if (m.n > CCN_MANIFEST_FANOUT)
+                m.n = CCN_MANIFEST_FANOUT;
+            m.count = count - m.start;
+            if (m.count > block * CCN_MANIFEST_FANOUT)
+                m.count = block * CCN_MANIFEST_FANOUT;
+            m.digests->length = 0;
+            ccn_charbuf_append(m.digests,
+                               below->buf + i * CCN_MANIFEST_DIGEST_BYTES,
+                               m.n * CCN_MANIFEST_DIGEST_BYTES);
+            if (level == 0)
+                break;
+            res = manifest_put_node(h, name, level, &m, above);
+        }
+        if (res != 0 || level == 0)
+            break;
+        t = below; below = above; above = t;
+        nitems = (nitems + CCN_MANIFEST_FANOUT - 1) / CCN_MANIFEST_FANOUT;
+        block *= CCN_MANIFEST_FANOUT;
+    }
+    if (res == 0)
+        res = manifest_put_node(h, name, 0, &m, NULL);
+    ccn_charbuf_destroy(&m.digests);
+    ccn_charbuf_destroy(&below);
+    ccn_charbuf_destroy(&above);
+    return(res);
+}
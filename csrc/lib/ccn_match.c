@@ -35,21 +35,18 @@ ccn_digest_ContentObject(const unsigned char *content_object,
                          struct ccn_parsed_ContentObject *pc)
 {
     int res;
-    struct ccn_digest *d = NULL;
+    const void *data = content_object;
+    size_t size;
 
     if (pc->magic < 20080000) abort();
     if (pc->digest_bytes == sizeof(pc->digest))
         return;
     if (pc->digest_bytes != 0) abort();
-    d = ccn_digest_create(CCN_DIGEST_SHA256);
-    ccn_digest_init(d);
-    res = ccn_digest_update(d, content_object, pc->offset[CCN_PCO_E]);
+    size = pc->offset[CCN_PCO_E];
+    res = ccn_digest_buffers(CCN_DIGEST_SHA256, 1, &data, &size,
+                             pc->digest, sizeof(pc->digest));
     if (res < 0) abort();
-    res = ccn_digest_final(d, pc->digest, sizeof(pc->digest));
-    if (res < 0) abort();
-    if (pc->digest_bytes != 0) abort();
     pc->digest_bytes = sizeof(pc->digest);
-    ccn_digest_destroy(&d);
 }
 
 static int
@@ -67,6 +64,10 @@ ccn_pubid_matches(const unsigned char *content_object,
     pubidstart = pi->offset[CCN_PI_B_PublisherIDKeyDigest];
     pubidbytes = pi->offset[CCN_PI_E_PublisherIDKeyDigest] - pubidstart;
     if (pubidbytes > 0) {
+        /* The publisher is in the SignedInfo, which may not be parsed yet */
+        if (ccn_parse_ContentObject_finish(content_object,
+                                           pc->offset[CCN_PCO_E], pc) < 0)
+            return(0);
         d = ccn_buf_decoder_start(&decoder,
                                   content_object +
                                    pc->offset[CCN_PCO_B_PublisherPublicKeyDigest],
@@ -172,6 +173,190 @@ ccn_excluded(const unsigned char *excl,
     return(!excluded);
 }
 
+/**
+ * One stretch of the compiled Exclude, up to and including the
+ * explicit component that ends it.
+ */
+struct ccn_exclude_range {
+    const unsigned char *comp;  /**< the component after the range */
+    size_t comp_size;
+    const struct ccn_bloom_wire *bloom; /**< Bloom for the range, or NULL */
+    int any;                    /**< whole range is excluded */
+};
+
+/**
+ * An Exclude, parsed once so that it may be checked by binary search.
+ *
+ * There are n explicit components, in canonical order, and n + 1 ranges;
+ * the last range is open-ended, and its comp is NULL.
+ */
+struct ccn_compiled_exclude {
+    int n;
+    unsigned char *bytes;       /**< private copy of the Exclude */
+    struct ccn_exclude_range *range;
+};
+
+/* Canonical order - shorter components first, then by bytes */
+static int
+ccn_exclude_compare(const unsigned char *a, size_t a_size,
+                    const unsigned char *b, size_t b_size)
+{
+    if (a_size != b_size)
+        return(a_size < b_size ? -1 : 1);
+    return(memcmp(a, b, a_size));
+}
+
+/* Parse the optional Any or Bloom that applies to a range */
+static void
+ccn_exclude_filter(struct ccn_buf_decoder *d, struct ccn_exclude_range *r)
+{
+    const unsigned char *bloom = NULL;
+    size_t bloom_size = 0;
+    
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Any)) {
+        ccn_buf_advance(d);
+        r->any = 1;
+        ccn_buf_check_close(d);
+    }
+    else if (ccn_buf_match_dtag(d, CCN_DTAG_Bloom)) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_blob(d, &bloom, &bloom_size))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+        if (bloom_size != 0) {
+            r->bloom = ccn_bloom_validate_wire(bloom, bloom_size);
+            /* If not a valid filter, treat like a false positive */
+            if (r->bloom == NULL)
+                r->any = 1;
+        }
+    }
+}
+
+/**
+ * Compile an Exclude element for repeated use by ccn_compiled_excluded.
+ *
+ * The encoding is copied, so the result does not depend on the
+ * lifetime of the message it came from.
+ * @returns the compiled form, or NULL if the Exclude is malformed or
+ *          its components are out of order.  The caller may then fall
+ *          back to ccn_excluded, which will treat it as before.
+ */
+struct ccn_compiled_exclude *
+ccn_compile_exclude(const unsigned char *excl, size_t excl_size)
+{
+    struct ccn_compiled_exclude *ce = NULL;
+    struct ccn_exclude_range *r = NULL;
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = NULL;
+    const unsigned char *comp = NULL;
+    size_t comp_size = 0;
+    int limit = 4;
+    
+    ce = calloc(1, sizeof(*ce));
+    if (ce == NULL)
+        return(NULL);
+    ce->bytes = malloc(excl_size);
+    ce->range = calloc(limit, sizeof(ce->range[0]));
+    if (ce->bytes == NULL || ce->range == NULL)
+        goto Bail;
+    memcpy(ce->bytes, excl, excl_size);
+    d = ccn_buf_decoder_start(&decoder, ce->bytes, excl_size);
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_Exclude))
+        goto Bail;
+    ccn_buf_advance(d);
+    for (;;) {
+        ccn_exclude_filter(d, &ce->range[ce->n]);
+        if (!ccn_buf_match_dtag(d, CCN_DTAG_Component))
+            break;
+        ccn_buf_advance(d);
+        comp = ce->bytes;
+        comp_size = 0;
+        if (ccn_buf_match_blob(d, &comp, &comp_size))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+        if (ce->n > 0) {
+            r = &ce->range[ce->n - 1];
+            if (ccn_exclude_compare(r->comp, r->comp_size,
+                                    comp, comp_size) >= 0)
+                goto Bail;
+        }
+        r = &ce->range[ce->n];
+        r->comp = comp;
+        r->comp_size = comp_size;
+        ce->n++;
+        if (ce->n == limit) {
+            r = realloc(ce->range, 2 * limit * sizeof(ce->range[0]));
+            if (r == NULL)
+                goto Bail;
+            memset(r + limit, 0, limit * sizeof(ce->range[0]));
+            ce->range = r;
+            limit *= 2;
+        }
+    }
+    ccn_buf_check_close(d);
+    if (d->decoder.state < 0 || d->decoder.index != excl_size)
+        goto Bail;
+    return(ce);
+Bail:
+    ccn_compiled_exclude_destroy(&ce);
+    return(NULL);
+}
+
+/**
+ * Release a compiled Exclude.
+ */
+void
+ccn_compiled_exclude_destroy(struct ccn_compiled_exclude **cep)
+{
+    struct ccn_compiled_exclude *ce = *cep;
+    
+    if (ce != NULL) {
+        free(ce->bytes);
+        free(ce->range);
+        free(ce);
+        *cep = NULL;
+    }
+}
+
+/**
+ * Test for a match between a next component and a compiled Exclude
+ *
+ * This gives the same answer as ccn_excluded, in time logarithmic in
+ * the number of explicit components.
+ * @result 1 if nextcomp is excluded, otherwise 0.
+ */
+int
+ccn_compiled_excluded(const struct ccn_compiled_exclude *ce,
+                      const unsigned char *nextcomp,
+                      size_t nextcomp_size)
+{
+    const struct ccn_exclude_range *r = NULL;
+    int lo = 0;
+    int hi = ce->n;
+    int mid;
+    int res;
+    
+    /* Find the first explicit component that is not below nextcomp */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        r = &ce->range[mid];
+        res = ccn_exclude_compare(r->comp, r->comp_size,
+                                  nextcomp, nextcomp_size);
+        if (res == 0)
+            return(1); /* One of the explicit excludes */
+        if (res < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    r = &ce->range[lo];
+    if (r->any)
+        return(1);
+    if (r->bloom != NULL && ccn_bloom_match_wire(r->bloom, nextcomp, nextcomp_size))
+        return(1);
+    return(0);
+}
+
 /**
  * Test for a match between a ContentObject and an Interest
  *
@@ -199,6 +384,31 @@ ccn_content_matches_interest(const unsigned char *content_object,
                              const unsigned char *interest_msg,
                              size_t interest_msg_size,
                              const struct ccn_parsed_interest *pi)
+{
+    return(ccn_content_matches_interest_excl(content_object,
+                                             content_object_size,
+                                             implicit_content_digest, pc,
+                                             interest_msg, interest_msg_size,
+                                             pi, NULL));
+}
+
+/**
+ * Test for a match between a ContentObject and an Interest,
+ * using a compiled form of the Interest's Exclude.
+ *
+ * This is ccn_content_matches_interest, for callers that check one
+ * interest against many candidates.  If ce is NULL, any Exclude is
+ * decoded from interest_msg as usual.
+ */
+int
+ccn_content_matches_interest_excl(const unsigned char *content_object,
+                                  size_t content_object_size,
+                                  int implicit_content_digest,
+                                  struct ccn_parsed_ContentObject *pc,
+                                  const unsigned char *interest_msg,
+                                  size_t interest_msg_size,
+                                  const struct ccn_parsed_interest *pi,
+                                  const struct ccn_compiled_exclude *ce)
 {
     struct ccn_parsed_ContentObject pc_store;
     struct ccn_parsed_interest pi_store;
@@ -300,7 +510,11 @@ ccn_content_matches_interest(const unsigned char *content_object,
             nextcomp = pc->digest;
         }
         else abort(); /* bug - should have returned already */
-        if (ccn_excluded(interest_msg + pi->offset[CCN_PI_B_Exclude],
+        if (ce != NULL) {
+            if (ccn_compiled_excluded(ce, nextcomp, nextcomp_size))
+                return(0);
+        }
+        else if (ccn_excluded(interest_msg + pi->offset[CCN_PI_B_Exclude],
                          (pi->offset[CCN_PI_E_Exclude] -
                           pi->offset[CCN_PI_B_Exclude]),
                          nextcomp,
@@ -0,0 +1,136 @@
+/**
+ * @file ccn_memacct.c
+ * @brief Counting allocator wrappers, for attributing memory to subsystems.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/memacct.h>
+
+/**
+ * The header in front of each counted block.
+ *
+ * The union keeps what follows it aligned as well as malloc would.
+ */
+union ccn_memacct_hdr {
+    size_t size;
+    long double ld;
+    void *p;
+    intmax_t i;
+};
+
+static void
+memacct_add(struct ccn_memacct *a, size_t size)
+{
+    a->bytes += size;
+    a->objects += 1;
+    if (a->bytes > a->peak)
+        a->peak = a->bytes;
+}
+
+void *
+ccn_memacct_malloc(struct ccn_memacct *a, size_t size)
+{
+    union ccn_memacct_hdr *h;
+
+    if (a == NULL)
+        return(malloc(size));
+    if (size > (size_t)-1 - sizeof(*h))
+        return(NULL);
+    h = malloc(sizeof(*h) + size);
+    if (h == NULL)
+        return(NULL);
+    h->size = size;
+    memacct_add(a, size);
+    return(h + 1);
+}
+
+void *
+ccn_memacct_calloc(struct ccn_memacct *a, size_t n, size_t size)
+{
+    void *p;
+
+    if (a == NULL)
+        return(calloc(n, size));
+    if (size != 0 && n > (size_t)-1 / size)
+        return(NULL);
+    p = ccn_memacct_malloc(a, n * size);
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return(p);
+}
+
+void *
+ccn_memacct_realloc(struct ccn_memacct *a, void *p, size_t size)
+{
+    union ccn_memacct_hdr *h;
+    size_t old;
+
+    if (a == NULL)
+        return(realloc(p, size));
+    if (p == NULL)
+        return(ccn_memacct_malloc(a, size));
+    if (size > (size_t)-1 - sizeof(*h))
+        return(NULL);
+    h = ((union ccn_memacct_hdr *)p) - 1;
+    old = h->size;
+    h = realloc(h, sizeof(*h) + size);
+    if (h == NULL)
+        return(NULL);
+    h->size = size;
+    a->bytes -= old;
+    a->objects -= 1;
+    memacct_add(a, size);
+    return(h + 1);
+}
+
+void
+ccn_memacct_free(struct ccn_memacct *a, void *p)
+{
+    union ccn_memacct_hdr *h;
+
+    if (a == NULL || p == NULL) {
+        free(p);
+        return;
+    }
+    h = ((union ccn_memacct_hdr *)p) - 1;
+    a->bytes -= h->size;
+    a->objects -= 1;
+    free(h);
+}
+
+void
+ccn_memacct_note(struct ccn_memacct *a, intmax_t bytes, intmax_t objects)
+{
+    if (a == NULL)
+        return;
+    a->bytes += bytes;
+    a->objects += objects;
+    if (a->bytes > a->peak)
+        a->peak = a->bytes;
+}
+
+void
+ccn_memacct_set(struct ccn_memacct *a, uintmax_t bytes, uintmax_t objects)
+{
+    if (a == NULL)
+        return;
+    a->bytes = bytes;
+    a->objects = objects;
+    if (a->bytes > a->peak)
+        a->peak = a->bytes;
+}
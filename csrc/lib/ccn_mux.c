@@ -0,0 +1,559 @@
+/**
+ * @file ccn_mux.c
+ * @brief One ccnd connection shared by ccn handles in several threads.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <ccn/ccn.h>
+#include <ccn/ccn_private.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
+#include <ccn/mux.h>
+
+/** How often to drop expired entries from the wants table, in seconds */
+#define CCN_MUX_SWEEP_SECONDS 10
+
+/**
+ * One end of the mux: ccnd (port 0), or an attached handle
+ */
+struct ccn_mux_port {
+    int fd;
+    unsigned serial;            /**< tells reuses of a port number apart */
+    unsigned stamp;             /**< last content delivered here */
+    struct ccn_skeleton_decoder decoder;
+    struct ccn_charbuf *inbuf;
+    struct ccn_charbuf *outbuf;
+    size_t outbufindex;
+};
+
+/**
+ * A handle that has expressed interests under some prefix
+ */
+struct ccn_mux_want {
+    int port;
+    unsigned serial;
+    time_t expiry;
+};
+
+/**
+ * Data field for entries in the wants table, which is keyed by
+ * the name components of the interests' prefixes
+ */
+struct ccn_mux_wants {
+    struct ccn_mux_want *w;
+    int n;
+    int limit;
+};
+
+struct ccn_mux {
+    struct ccn_mux_port **ports;    /**< by port number, NULL if free */
+    int n_ports;                    /**< allocated size of ports */
+    int ctl[2];                     /**< pipe carrying newly attached fds */
+    struct hashtb *wants;           /**< who gets what content */
+    struct ccn_indexbuf *comps;
+    struct pollfd *fds;             /**< n_ports + 1 of them */
+    unsigned next_serial;
+    unsigned stamp;
+    time_t now;
+    time_t next_sweep;
+};
+
+static void
+finalize_wants(struct hashtb_enumerator *e)
+{
+    struct ccn_mux_wants *ws = e->data;
+    free(ws->w);
+    ws->w = NULL;
+}
+
+static void
+close_port(struct ccn_mux *m, int i)
+{
+    struct ccn_mux_port *p = m->ports[i];
+    if (p == NULL)
+        return;
+    close(p->fd);
+    ccn_charbuf_destroy(&p->inbuf);
+    ccn_charbuf_destroy(&p->outbuf);
+    free(p);
+    m->ports[i] = NULL;
+}
+
+/**
+ * Add a port for the fd, which the mux then owns.
+ * @returns the port number, or -1 for error.
+ */
+static int
+add_port(struct ccn_mux *m, int fd)
+{
+    struct ccn_mux_port *p;
+    struct ccn_mux_port **a;
+    struct pollfd *fds;
+    int i;
+    int n;
+
+    for (i = 0; i < m->n_ports && m->ports[i] != NULL; i++)
+        continue;
+    if (i == m->n_ports) {
+        n = 2 * m->n_ports + 8;
+        a = realloc(m->ports, n * sizeof(a[0]));
+        if (a == NULL)
+            goto Bail;
+        m->ports = a;
+        fds = realloc(m->fds, (n + 1) * sizeof(fds[0]));
+        if (fds == NULL)
+            goto Bail;
+        m->fds = fds;
+        memset(a + m->n_ports, 0, (n - m->n_ports) * sizeof(a[0]));
+        m->n_ports = n;
+    }
+    p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        goto Bail;
+    p->inbuf = ccn_charbuf_create();
+    p->outbuf = ccn_charbuf_create();
+    if (p->inbuf == NULL || p->outbuf == NULL ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+        ccn_charbuf_destroy(&p->inbuf);
+        ccn_charbuf_destroy(&p->outbuf);
+        free(p);
+        goto Bail;
+    }
+    p->fd = fd;
+    p->serial = ++m->next_serial;
+    m->ports[i] = p;
+    return(i);
+Bail:
+    close(fd);
+    return(-1);
+}
+
+/**
+ * Write what is queued for a port.
+ * @returns -1 if the port is broken, else 0.
+ */
+static int
+flush_port(struct ccn_mux_port *p)
+{
+    ssize_t res;
+    size_t size;
+
+    size = p->outbuf->length - p->outbufindex;
+    if (size == 0)
+        return(0);
+    res = send(p->fd, p->outbuf->buf + p->outbufindex, size, MSG_NOSIGNAL);
+    if (res == -1)
+        return((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+    p->outbufindex += res;
+    if (p->outbufindex == p->outbuf->length)
+        p->outbuf->length = p->outbufindex = 0;
+    return(0);
+}
+
+static void
+send_port(struct ccn_mux *m, int i, const unsigned char *msg, size_t size)
+{
+    struct ccn_mux_port *p = m->ports[i];
+    ssize_t res = 0;
+
+    if (p->outbuf->length == 0) {
+        res = send(p->fd, msg, size, MSG_NOSIGNAL);
+        if (res == -1)
+            res = 0;
+    }
+    if (res < size)
+        ccn_charbuf_append(p->outbuf, msg + res, size - res);
+}
+
+/**
+ * Note that the handle on port i has expressed an interest.
+ */
+static void
+note_want(struct ccn_mux *m, int i, const unsigned char *msg, size_t size)
+{
+    struct ccn_parsed_interest pi = {0};
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_mux_wants *ws;
+    struct ccn_mux_want *w;
+    struct ccn_indexbuf *comps = m->comps;
+    size_t keystart;
+    size_t keyend;
+    int lifetime;
+    int j;
+    int res;
+
+    res = ccn_parse_interest(msg, size, &pi, comps);
+    if (res < 0)
+        return;
+    lifetime = ccn_interest_lifetime_seconds(msg, &pi);
+    keystart = comps->buf[0];
+    keyend = comps->buf[comps->n - 1];
+    /* Leave off what might be a digest, as ccn_express_interest does */
+    if (comps->n > 1 && keyend - comps->buf[comps->n - 2] == 36)
+        keyend = comps->buf[comps->n - 2];
+    hashtb_start(m->wants, e);
+    res = hashtb_seek(e, msg + keystart, keyend - keystart, 0);
+    ws = e->data;
+    if (ws != NULL) {
+        for (j = 0; j < ws->n; j++)
+            if (ws->w[j].port == i)
+                break;
+        if (j == ws->limit) {
+            w = realloc(ws->w, (2 * ws->limit + 2) * sizeof(w[0]));
+            if (w == NULL)
+                j = -1;
+            else {
+                ws->w = w;
+                ws->limit = 2 * ws->limit + 2;
+            }
+        }
+        if (j >= 0) {
+            if (j == ws->n)
+                ws->n++;
+            w = &ws->w[j];
+            w->port = i;
+            w->serial = m->ports[i]->serial;
+            w->expiry = m->now + lifetime + 1;
+        }
+    }
+    hashtb_end(e);
+}
+
+/**
+ * Remove the wants that have expired or whose handles are gone.
+ */
+static void
+prune_wants(struct ccn_mux *m, struct ccn_mux_wants *ws)
+{
+    struct ccn_mux_want *w;
+    int j;
+
+    for (j = 0; j < ws->n;) {
+        w = &ws->w[j];
+        if (w->expiry <= m->now || m->ports[w->port] == NULL ||
+            m->ports[w->port]->serial != w->serial)
+            ws->w[j] = ws->w[--ws->n];
+        else
+            j++;
+    }
+}
+
+static void
+sweep_wants(struct ccn_mux *m)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_mux_wants *ws;
+
+    for (hashtb_start(m->wants, e); e->data != NULL;) {
+        ws = e->data;
+        prune_wants(m, ws);
+        if (ws->n == 0)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+    m->next_sweep = m->now + CCN_MUX_SWEEP_SECONDS;
+}
+
+/**
+ * Pass content from ccnd to each handle that wants it, once.
+ */
+static void
+demux_content(struct ccn_mux *m, const unsigned char *msg, size_t size)
+{
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_indexbuf *comps = m->comps;
+    struct ccn_mux_wants *ws;
+    struct ccn_mux_port *p;
+    size_t keystart;
+    int i;
+    int j;
+
+    if (ccn_parse_ContentObject(msg, size, &pco, comps) < 0)
+        return;
+    m->stamp++;
+    keystart = comps->buf[0];
+    for (i = comps->n - 1; i >= 0; i--) {
+        ws = hashtb_lookup(m->wants, msg + keystart, comps->buf[i] - keystart);
+        if (ws == NULL)
+            continue;
+        prune_wants(m, ws);
+        for (j = 0; j < ws->n; j++) {
+            p = m->ports[ws->w[j].port];
+            if (p->stamp != m->stamp) {
+                p->stamp = m->stamp;
+                send_port(m, ws->w[j].port, msg, size);
+            }
+        }
+    }
+}
+
+/**
+ * Route one complete message that arrived on port i.
+ */
+static void
+route_message(struct ccn_mux *m, int i, const unsigned char *msg, size_t size)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    int j;
+
+    d = ccn_buf_decoder_start(&decoder, msg, size);
+    if (i != 0) {
+        if (ccn_buf_match_dtag(d, CCN_DTAG_Interest))
+            note_want(m, i, msg, size);
+        send_port(m, 0, msg, size);
+    }
+    else if (ccn_buf_match_dtag(d, CCN_DTAG_ContentObject))
+        demux_content(m, msg, size);
+    else {
+        for (j = 1; j < m->n_ports; j++)
+            if (m->ports[j] != NULL)
+                send_port(m, j, msg, size);
+    }
+}
+
+/**
+ * Read what is available on a port, and route the complete messages.
+ * @returns -1 if the port is closed or broken, else 0.
+ */
+static int
+read_port(struct ccn_mux *m, int i)
+{
+    struct ccn_mux_port *p = m->ports[i];
+    struct ccn_skeleton_decoder *d = &p->decoder;
+    struct ccn_charbuf *inbuf = p->inbuf;
+    unsigned char *buf;
+    size_t msgstart;
+    ssize_t res;
+
+    if (inbuf->length == 0)
+        memset(d, 0, sizeof(*d));
+    buf = ccn_charbuf_reserve(inbuf, 8800);
+    res = read(p->fd, buf, inbuf->limit - inbuf->length);
+    if (res == 0)
+        return(-1);
+    if (res == -1)
+        return((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+    inbuf->length += res;
+    msgstart = 0;
+    ccn_skeleton_decode(d, buf, res);
+    while (d->state == 0) {
+        route_message(m, i, inbuf->buf + msgstart, d->index - msgstart);
+        msgstart = d->index;
+        if (msgstart == inbuf->length) {
+            inbuf->length = 0;
+            return(0);
+        }
+        ccn_skeleton_decode(d, inbuf->buf + d->index,
+                            inbuf->length - d->index);
+    }
+    if (d->state < 0)
+        return(-1);
+    if (msgstart > 0) {
+        /* move partial message to start of buffer */
+        memmove(inbuf->buf, inbuf->buf + msgstart,
+                inbuf->length - msgstart);
+        inbuf->length -= msgstart;
+        d->index -= msgstart;
+    }
+    return(0);
+}
+
+/**
+ * Take the fds of newly attached handles from the control pipe.
+ */
+static void
+take_attached(struct ccn_mux *m)
+{
+    int fd;
+
+    while (read(m->ctl[0], &fd, sizeof(fd)) == sizeof(fd))
+        add_port(m, fd);
+}
+
+struct ccn_mux *
+ccn_mux_create(const char *name)
+{
+    struct ccn_mux *m;
+    struct sockaddr_un addr = {0};
+    struct hashtb_param param = {0};
+    int fd;
+
+    m = calloc(1, sizeof(*m));
+    if (m == NULL)
+        return(NULL);
+    m->ctl[0] = m->ctl[1] = -1;
+    param.finalize = &finalize_wants;
+    m->wants = hashtb_create(sizeof(struct ccn_mux_wants), &param);
+    m->comps = ccn_indexbuf_create();
+    if (m->wants == NULL || m->comps == NULL || pipe(m->ctl) == -1 ||
+        fcntl(m->ctl[0], F_SETFL, O_NONBLOCK) == -1)
+        goto Bail;
+    if (name == NULL || name[0] == 0)
+        ccn_setup_sockaddr_un(NULL, &addr);
+    else {
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, name, sizeof(addr.sun_path));
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        goto Bail;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        goto Bail;
+    }
+    if (add_port(m, fd) != 0)
+        goto Bail;
+    return(m);
+Bail:
+    ccn_mux_destroy(&m);
+    return(NULL);
+}
+
+int
+ccn_mux_attach(struct ccn_mux *m, struct ccn *h)
+{
+    int sv[2];
+    int res;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+        return(-1);
+    res = ccn_connect_fd(h, sv[0]);
+    if (res == -1) {
+        close(sv[0]);
+        close(sv[1]);
+        return(-1);
+    }
+    /* Small pipe writes are atomic, so attaching threads do not collide */
+    if (write(m->ctl[1], &sv[1], sizeof(sv[1])) != sizeof(sv[1])) {
+        ccn_disconnect(h);
+        close(sv[1]);
+        return(-1);
+    }
+    return(res);
+}
+
+int
+ccn_mux_run(struct ccn_mux *m, int timeout)
+{
+    struct timeval start;
+    struct timeval now;
+    struct ccn_mux_port *p;
+    int millisec;
+    int elapsed;
+    int nfds;
+    int res;
+    int i;
+
+    gettimeofday(&start, NULL);
+    for (;;) {
+        gettimeofday(&now, NULL);
+        m->now = now.tv_sec;
+        if (m->now >= m->next_sweep)
+            sweep_wants(m);
+        millisec = 1000 * CCN_MUX_SWEEP_SECONDS;
+        if (timeout >= 0) {
+            elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+                      (now.tv_usec - start.tv_usec) / 1000;
+            if (elapsed > timeout)
+                return(0);
+            if (timeout - elapsed < millisec)
+                millisec = timeout - elapsed;
+        }
+        m->fds[0].fd = m->ctl[0];
+        m->fds[0].events = POLLIN;
+        for (i = 0, nfds = 1; i < m->n_ports; i++) {
+            p = m->ports[i];
+            m->fds[i + 1].fd = (p == NULL) ? -1 : p->fd;
+            m->fds[i + 1].events = POLLIN;
+            if (p != NULL && p->outbuf->length > p->outbufindex)
+                m->fds[i + 1].events |= POLLOUT;
+            m->fds[i + 1].revents = 0;
+            if (p != NULL)
+                nfds = i + 2;
+        }
+        res = poll(m->fds, nfds, millisec);
+        if (res == -1 && errno != EINTR)
+            return(-1);
+        if (res <= 0)
+            continue;
+        gettimeofday(&now, NULL);
+        m->now = now.tv_sec;
+        for (i = 0; i + 1 < nfds; i++) {
+            if (m->ports[i] == NULL || m->fds[i + 1].revents == 0)
+                continue;
+            res = 0;
+            if ((m->fds[i + 1].revents & POLLOUT) != 0)
+                res = flush_port(m->ports[i]);
+            if (res == 0 && (m->fds[i + 1].revents & ~POLLOUT) != 0)
+                res = read_port(m, i);
+            if (res == -1) {
+                if (i == 0)
+                    return(-1);
+                close_port(m, i);
+            }
+        }
+        /* Output for the handles is queued as ccnd's input is read */
+        for (i = 0; i < m->n_ports; i++)
+            if (m->ports[i] != NULL && flush_port(m->ports[i]) == -1 && i != 0)
+                close_port(m, i);
+        if ((m->fds[0].revents & POLLIN) != 0)
+            take_attached(m);
+    }
+}
+
+void
+ccn_mux_destroy(struct ccn_mux **mp)
+{
+    struct ccn_mux *m = *mp;
+    int fd;
+    int i;
+
+    if (m == NULL)
+        return;
+    if (m->ctl[0] != -1) {
+        while (read(m->ctl[0], &fd, sizeof(fd)) == sizeof(fd))
+            close(fd);
+        close(m->ctl[0]);
+        close(m->ctl[1]);
+    }
+    for (i = 0; i < m->n_ports; i++)
+        close_port(m, i);
+    free(m->ports);
+    free(m->fds);
+    hashtb_destroy(&m->wants);
+    ccn_indexbuf_destroy(&m->comps);
+    free(m);
+    *mp = NULL;
+}
@@ -19,11 +19,13 @@
  */
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
 #include <ccn/indexbuf.h>
 #include <ccn/random.h>
+#include <ccn/ccn_private.h>
 
 /**
  * Reset charbuf to represent an empty Name in binary format.
@@ -298,3 +300,48 @@ Finish:
     ccn_indexbuf_destroy(&ndx);
     return(res);
 }
+
+/**
+ * Pick the shard that owns a name, out of nshards.
+ *
+ * The choice rests on the first ncomps Components, so that everything
+ * under a prefix of that length falls to the same shard.  A shorter
+ * name is hashed on what it has, and the empty name belongs to shard 0.
+ * @param name points to a ccnb-encoded Name; anything after it is ignored.
+ * @param size bounds the bytes that may be examined.
+ * @param ncomps is how many leading Components to hash, at least 1.
+ * @returns the shard, from 0 to nshards - 1, or -1 for a bad Name.
+ */
+int
+ccn_name_shard(const unsigned char *name, size_t size,
+               int ncomps, int nshards)
+{
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d;
+    const unsigned char *comp = NULL;
+    size_t compsize = 0;
+    uint32_t x = CCN_SHARD_HASH_INIT;
+    int i;
+
+    if (nshards <= 1)
+        return(0);
+    d = ccn_buf_decoder_start(&decoder, name, size);
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_Name))
+        return(-1);
+    ccn_buf_advance(d);
+    for (i = 0; i < ncomps && ccn_buf_match_dtag(d, CCN_DTAG_Component); i++) {
+        ccn_buf_advance(d);
+        compsize = 0;
+        if (ccn_buf_match_blob(d, &comp, &compsize))
+            ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+        if (d->decoder.state < 0)
+            return(-1);
+        x = ccn_shard_hash(x, comp, compsize);
+    }
+    if (d->decoder.state < 0)
+        return(-1);
+    if (i == 0)
+        return(0);
+    return(ccn_shard_pick(x, nshards));
+}
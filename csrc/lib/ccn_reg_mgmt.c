@@ -37,6 +37,7 @@ ccn_forwarding_entry_parse(const unsigned char *p, size_t size)
     size_t sz;
     size_t start;
     size_t end;
+    uintmax_t quota;
     int action_off = -1;
     int ccnd_id_off = -1;
     
@@ -76,6 +77,20 @@ ccn_forwarding_entry_parse(const unsigned char *p, size_t size)
         result->faceid = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FaceID);
         result->flags = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_ForwardingFlags);
         result->lifetime = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_FreshnessSeconds);
+        result->store_quota = -1;
+        if (ccn_buf_match_dtag(d, CCN_DTAG_StoreQuota)) {
+            ccn_buf_advance(d);
+            if (ccn_parse_uintmax(d, &quota) >= 0 && quota <= INTMAX_MAX)
+                result->store_quota = quota;
+            else
+                d->decoder.state = -__LINE__;
+            ccn_buf_check_close(d);
+        }
+        result->traffic_class = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_TrafficClass);
+        if (result->traffic_class >= CCN_TRAFFIC_CLASSES)
+            d->decoder.state = -__LINE__;
+        result->default_freshness = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_DefaultFreshness);
+        result->max_residency = ccn_parse_optional_tagged_nonNegativeInteger(d, CCN_DTAG_MaxResidency);
         ccn_buf_check_close(d);
     }
     else
@@ -131,6 +146,18 @@ ccnb_append_forwarding_entry(struct ccn_charbuf *c,
     if (fe->lifetime >= 0)
         res |= ccnb_tagged_putf(c, CCN_DTAG_FreshnessSeconds, "%d",
                                    fe->lifetime);
+    if (fe->store_quota >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_StoreQuota, "%jd",
+                                   fe->store_quota);
+    if (fe->traffic_class >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_TrafficClass, "%d",
+                                   fe->traffic_class);
+    if (fe->default_freshness >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_DefaultFreshness, "%d",
+                                   fe->default_freshness);
+    if (fe->max_residency >= 0)
+        res |= ccnb_tagged_putf(c, CCN_DTAG_MaxResidency, "%d",
+                                   fe->max_residency);
     res |= ccnb_element_end(c);
     return(res);
 }
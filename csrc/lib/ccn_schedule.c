@@ -21,8 +21,12 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
+#include <sys/time.h>
 #include <ccn/schedule.h>
 
+#undef ccn_schedule_event
+
 /**
  * We use a heap structure (as in heapsort) to
  * keep track of the scheduled events to get O(log n)
@@ -33,6 +37,34 @@ struct ccn_schedule_heap_item {
     struct ccn_scheduled_event *ev;
 };
 
+/**
+ * Alternatively (if CCN_SCHEDULE=wheel is in the environment when the
+ * schedule is created), we use a hierarchical timer wheel, which gives
+ * O(1) insertion and cancellation.  Events due within the same tick
+ * run in the order they were placed in the wheel.
+ */
+#define WHEEL_TICK_SHIFT 8  /* micros per tick is 1 << WHEEL_TICK_SHIFT */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 5
+#define WHEEL_OVERFLOW (WHEEL_LEVELS * WHEEL_SLOTS)
+#define WHEEL_DETACHED (-1)
+
+struct ccn_wheel_link {
+    struct ccn_wheel_link *prev;
+    struct ccn_wheel_link *next;
+};
+
+struct ccn_wheel_item {
+    struct ccn_scheduled_event ev; /* must be first */
+    struct ccn_wheel_link link;
+    int64_t event_time;
+    int where;                  /* index into wslot, or WHEEL_DETACHED */
+};
+
+#define WHEEL_ITEM(l) \
+    ((struct ccn_wheel_item *)((char *)(l) - offsetof(struct ccn_wheel_item, link)))
+
 struct ccn_schedule {
     void *clienth;
     const struct ccn_gettime *clock;
@@ -43,8 +75,50 @@ struct ccn_schedule {
     int now;         /* internal micros corresponding to lasttime  */
     struct ccn_timeval lasttime; /* actual time when we last checked  */
     int time_has_passed; /* to prevent too-frequent time syscalls */
+    /* The rest is used only by the timer wheel */
+    int wheel;       /* nonzero if using the timer wheel */
+    int wheel_n;     /* number of events in the wheel */
+    int64_t wnow;    /* internal micros, as for now, but never rebased */
+    uint64_t wtick;  /* current tick; earlier ticks have been processed */
+    uint64_t wmask[WHEEL_LEVELS]; /* occupied slots at each level */
+    struct ccn_wheel_link wslot[WHEEL_OVERFLOW + 1];
+    struct ccn_wheel_item *wrunning; /* event whose action is running */
+    /* Statistics */
+    struct ccn_schedule_lag *lag; /* LAG_SLOTS entries, hashed by action */
+    int64_t born;    /* wnow at creation */
+    int64_t idle_since; /* wnow when the client began to wait */
+    int idle_on;     /* nonzero while the client is waiting */
+    uintmax_t idle;  /* total micros spent waiting */
+    uintmax_t events; /* total micros spent running events */
+    int64_t run_start; /* wnow when an uncharged run began */
+    int run_pending; /* nonzero if that run is not yet charged */
+    uintmax_t wakeups; /* waits that have ended */
+    int slack;       /* micros of timer slack, 0 for none */
+    int64_t slack_since; /* wnow when the slack was set */
+    uintmax_t slack_time; /* total micros with slack in effect */
+    uintmax_t slack_wakeups; /* waits ended with slack in effect */
 };
 
+/**
+ * The lateness statistics are kept in a small open-addressed table,
+ * since there are only a few distinct actions in practice.  Actions
+ * beyond what fits are not counted.
+ */
+#define LAG_SLOTS 64
+
+static void wheel_init(struct ccn_schedule *sched);
+static void wheel_destroy(struct ccn_schedule *sched);
+static struct ccn_scheduled_event *wheel_event(struct ccn_schedule *sched,
+                                               int micros,
+                                               struct ccn_scheduled_event *ev);
+static int wheel_cancel(struct ccn_schedule *sched,
+                        struct ccn_scheduled_event *ev);
+static int wheel_run(struct ccn_schedule *sched);
+static int ccn_schedule_cancelled_event(struct ccn_schedule *sched,
+                                        void *clienth,
+                                        struct ccn_scheduled_event *ev,
+                                        int flags);
+
 /*
  * update_epoch: reset sched->now to avoid wrapping
  */
@@ -81,7 +155,12 @@ update_time(struct ccn_schedule *sched)
     if (elapsed + sched->now < elapsed)
         update_epoch(sched);
     sched->now += elapsed;
+    sched->wnow += elapsed;
     sched->lasttime = now;
+    if (sched->run_pending && sched->wnow > sched->run_start) {
+        sched->events += sched->wnow - sched->run_start;
+        sched->run_pending = 0;
+    }
 }
 
 struct ccn_schedule *
@@ -90,11 +169,16 @@ ccn_schedule_create(void *clienth, const struct ccn_gettime *ccnclock)
     struct ccn_schedule *sched;
     if (ccnclock == NULL)
         return(NULL);
+    const char *s;
     sched = calloc(1, sizeof(*sched));
     if (sched != NULL) {
         sched->clienth = clienth;
         sched->clock = ccnclock;
+        s = getenv("CCN_SCHEDULE");
+        if (s != NULL && strcmp(s, "wheel") == 0)
+            wheel_init(sched);
         update_time(sched);
+        sched->born = sched->wnow;
     }
     return(sched);
 }
@@ -111,6 +195,8 @@ ccn_schedule_destroy(struct ccn_schedule **schedp)
     if (sched == NULL)
         return;
     *schedp = NULL;
+    if (sched->wheel)
+        wheel_destroy(sched);
     heap = sched->heap;
     if (heap != NULL) {
         n = sched->heap_n;
@@ -122,6 +208,7 @@ ccn_schedule_destroy(struct ccn_schedule **schedp)
         }
         free(heap);
     }
+    free(sched->lag);
     free(sched);
 }
 
@@ -215,6 +302,78 @@ reschedule_event(
     return(ev);
 }
 
+/*
+ * lag_entry: find (or make) the lateness statistics for an action
+ */
+static struct ccn_schedule_lag *
+lag_entry(struct ccn_schedule *sched, ccn_scheduled_action action)
+{
+    struct ccn_schedule_lag *lag;
+    uintptr_t h;
+    int i;
+    if (sched->lag == NULL) {
+        sched->lag = calloc(LAG_SLOTS, sizeof(sched->lag[0]));
+        if (sched->lag == NULL)
+            return(NULL);
+    }
+    h = (uintptr_t)action;
+    h ^= h >> 11;
+    for (i = 0; i < LAG_SLOTS; i++) {
+        lag = &sched->lag[(h + i) % LAG_SLOTS];
+        if (lag->action == action)
+            return(lag);
+        if (lag->action == NULL) {
+            lag->action = action;
+            return(lag);
+        }
+    }
+    return(NULL);
+}
+
+/*
+ * lag_record: note that an action is about to run
+ * micros is the time until it was due, so negative if it is late.
+ */
+static void
+lag_record(struct ccn_schedule *sched, ccn_scheduled_action action,
+           int64_t micros)
+{
+    struct ccn_schedule_lag *lag;
+    unsigned late = 0;
+    int b;
+    if (action == &ccn_schedule_cancelled_event)
+        return;
+    lag = lag_entry(sched, action);
+    if (lag == NULL)
+        return;
+    if (micros < 0)
+        late = (-micros > UINT_MAX) ? UINT_MAX : -micros;
+    for (b = 0; b < CCN_SCHEDULE_LAG_BUCKETS - 1 && (late >> b) != 0; b++)
+        continue;
+    lag->hist[b]++;
+    lag->runs++;
+    lag->late_sum += late;
+    if (late > lag->late_max)
+        lag->late_max = late;
+}
+
+/*
+ * note_events: account for the time spent running events since start
+ * If the clock has not moved (as with a cached clock), the time is
+ * charged when it next does.
+ */
+static void
+note_events(struct ccn_schedule *sched, int64_t start, int ran)
+{
+    if (ran == 0)
+        return;
+    if (!sched->run_pending) {
+        sched->run_start = start;
+        sched->run_pending = 1;
+    }
+    update_time(sched);
+}
+
 /*
  * ccn_schedule_event: schedule a new event
  */
@@ -225,14 +384,42 @@ ccn_schedule_event(
     ccn_scheduled_action action,
     void *evdata,
     intptr_t evint)
+{
+    return(ccn_schedule_event_named(sched, micros, action, evdata, evint,
+                                    NULL));
+}
+
+/*
+ * ccn_schedule_event_named: schedule a new event
+ * The name is used only for reporting statistics, and is not copied.
+ */
+struct ccn_scheduled_event *
+ccn_schedule_event_named(
+    struct ccn_schedule *sched,
+    int micros,
+    ccn_scheduled_action action,
+    void *evdata,
+    intptr_t evint,
+    const char *name)
 {
     struct ccn_scheduled_event *ev;
-    ev = calloc(1, sizeof(*ev));
+    struct ccn_schedule_lag *lag;
+    if (name != NULL) {
+        lag = lag_entry(sched, action);
+        if (lag != NULL && lag->name == NULL)
+            lag->name = (name[0] == '&') ? name + 1 : name;
+    }
+    if (sched->wheel)
+        ev = calloc(1, sizeof(struct ccn_wheel_item));
+    else
+        ev = calloc(1, sizeof(*ev));
     if (ev == NULL) return(NULL);
     ev->action = action;
     ev->evdata = evdata;
     ev->evint = evint;
     update_time(sched);
+    if (sched->wheel)
+        return(wheel_event(sched, micros, ev));
     return(reschedule_event(sched, micros, ev));
 }
 
@@ -256,6 +443,8 @@ ccn_schedule_cancel(struct ccn_schedule *sched, struct ccn_scheduled_event *ev)
     int res;
     if (ev == NULL)
         return(-1);
+    if (sched->wheel && ev != (void *)sched->wrunning)
+        return(wheel_cancel(sched, ev));
     res = (ev->action)(sched, sched->clienth, ev, CCN_SCHEDULE_CANCEL);
     if (res > 0)
         abort(); /* Bug in ev->action - bad return value */
@@ -276,6 +465,7 @@ ccn_schedule_run_next(struct ccn_schedule *sched)
     sched->heap[0].ev = NULL;
     micros = sched->heap[0].event_time - sched->now;
     heap_sift(sched->heap, sched->heap_n--);
+    lag_record(sched, ev->action, micros);
     res = (ev->action)(sched, sched->clienth, ev, 0);
     if (res <= 0) {
         free(ev);
@@ -291,6 +481,26 @@ ccn_schedule_run_next(struct ccn_schedule *sched)
     reschedule_event(sched, micros + res, ev);
 }
 
+/**
+ * Push a wait out to the next multiple of the slack.
+ *
+ * Every wait then ends on the same grid, so events that fall due
+ * within one slack interval of each other are run by one wakeup.
+ */
+static int
+slack_stretch(struct ccn_schedule *sched, int micros)
+{
+    int64_t t;
+
+    if (sched->slack <= 0 || micros <= 0 || micros == INT_MAX)
+        return(micros);
+    t = sched->wnow + micros + sched->slack - 1;
+    t -= t % sched->slack;
+    if (t - sched->wnow > INT_MAX)
+        return(INT_MAX);
+    return(t - sched->wnow);
+}
+
 /*
  * ccn_schedule_run: do any scheduled events
  * This executes any scheduled actions whose time has come.
@@ -300,22 +510,592 @@ ccn_schedule_run_next(struct ccn_schedule *sched)
 int
 ccn_schedule_run(struct ccn_schedule *sched)
 {
+    int64_t start;
+    int ran = 0;
+    if (sched->wheel)
+        return(slack_stretch(sched, wheel_run(sched)));
     update_time(sched);
+    start = sched->wnow;
     while (sched->heap_n > 0 && sched->heap[0].event_time <= sched->now) {
         sched->time_has_passed = 0;
         ccn_schedule_run_next(sched);
         if (sched->time_has_passed)
             update_time(sched);
+        ran++;
     }
+    note_events(sched, start, ran);
     if (sched->heap_n == 0)
         return(-1);
-    return(sched->heap[0].event_time - sched->now);
+    /* The clock may have moved on in note_events; never look idle */
+    if (sched->heap[0].event_time < sched->now)
+        return(0);
+    return(slack_stretch(sched, sched->heap[0].event_time - sched->now));
+}
+
+/*
+ * Timer wheel implementation
+ */
+
+static void
+wheel_list_init(struct ccn_wheel_link *head)
+{
+    head->prev = head->next = head;
+}
+
+static void
+wheel_init(struct ccn_schedule *sched)
+{
+    int i;
+    sched->wheel = 1;
+    for (i = 0; i <= WHEEL_OVERFLOW; i++)
+        wheel_list_init(&sched->wslot[i]);
+}
+
+/*
+ * lowest_bit: index of the least significant 1 bit; m must be nonzero
+ */
+static int
+lowest_bit(uint64_t m)
+{
+    int i = 0;
+    if ((m & 0xFFFFFFFFU) == 0) { i += 32; m >>= 32; }
+    if ((m & 0xFFFF) == 0) { i += 16; m >>= 16; }
+    if ((m & 0xFF) == 0) { i += 8; m >>= 8; }
+    if ((m & 0xF) == 0) { i += 4; m >>= 4; }
+    if ((m & 0x3) == 0) { i += 2; m >>= 2; }
+    if ((m & 0x1) == 0) { i += 1; }
+    return(i);
+}
+
+/*
+ * wheel_unlink: take an item out of whatever list it is on
+ */
+static void
+wheel_unlink(struct ccn_schedule *sched, struct ccn_wheel_item *it)
+{
+    struct ccn_wheel_link *head;
+    it->link.prev->next = it->link.next;
+    it->link.next->prev = it->link.prev;
+    it->link.prev = it->link.next = NULL;
+    if (it->where >= 0 && it->where < WHEEL_OVERFLOW) {
+        head = &sched->wslot[it->where];
+        if (head->next == head)
+            sched->wmask[it->where / WHEEL_SLOTS] &=
+                ~((uint64_t)1 << (it->where % WHEEL_SLOTS));
+    }
+}
+
+/*
+ * wheel_place: put an item into the slot for its event time
+ *
+ * The level is chosen by the most significant tick bit in which the
+ * event time differs from the current tick, so that the slot will
+ * be cascaded down exactly when the current tick reaches its range.
+ */
+static void
+wheel_place(struct ccn_schedule *sched, struct ccn_wheel_item *it)
+{
+    uint64_t c = sched->wtick;
+    uint64_t t = 0;
+    uint64_t x;
+    struct ccn_wheel_link *head;
+    int level = 0;
+    int where;
+
+    if (it->event_time > 0)
+        t = (uint64_t)it->event_time >> WHEEL_TICK_SHIFT;
+    if (t <= c)
+        where = c % WHEEL_SLOTS;
+    else {
+        x = t ^ c;
+        while (level < WHEEL_LEVELS && (x >> ((level + 1) * WHEEL_BITS)) != 0)
+            level++;
+        if (level == WHEEL_LEVELS)
+            where = WHEEL_OVERFLOW;
+        else
+            where = level * WHEEL_SLOTS +
+                    (t >> (level * WHEEL_BITS)) % WHEEL_SLOTS;
+    }
+    head = &sched->wslot[where];
+    it->where = where;
+    it->link.next = head;
+    it->link.prev = head->prev;
+    head->prev->next = &it->link;
+    head->prev = &it->link;
+    if (where < WHEEL_OVERFLOW)
+        sched->wmask[where / WHEEL_SLOTS] |=
+            (uint64_t)1 << (where % WHEEL_SLOTS);
+}
+
+/*
+ * wheel_splice: move the contents of a slot to a private list
+ */
+static void
+wheel_splice(struct ccn_schedule *sched, int where, struct ccn_wheel_link *to)
+{
+    struct ccn_wheel_link *head = &sched->wslot[where];
+    wheel_list_init(to);
+    if (head->next != head) {
+        to->next = head->next;
+        to->prev = head->prev;
+        to->next->prev = to;
+        to->prev->next = to;
+        wheel_list_init(head);
+    }
+    if (where < WHEEL_OVERFLOW)
+        sched->wmask[where / WHEEL_SLOTS] &=
+            ~((uint64_t)1 << (where % WHEEL_SLOTS));
+}
+
+/*
+ * wheel_next_tick: find the earliest tick after the current one
+ * whose slot might hold events, or UINT64_MAX if there are none
+ */
+static uint64_t
+wheel_next_tick(struct ccn_schedule *sched)
+{
+    uint64_t c = sched->wtick;
+    uint64_t m;
+    int shift;
+    int level;
+    int d;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        shift = level * WHEEL_BITS;
+        d = (c >> shift) % WHEEL_SLOTS;
+        if (d == WHEEL_SLOTS - 1)
+            continue;
+        m = sched->wmask[level] & ~(((uint64_t)2 << d) - 1);
+        if (m != 0)
+            return((c >> (shift + WHEEL_BITS) << (shift + WHEEL_BITS)) |
+                   ((uint64_t)lowest_bit(m) << shift));
+    }
+    shift = WHEEL_LEVELS * WHEEL_BITS;
+    if (sched->wslot[WHEEL_OVERFLOW].next != &sched->wslot[WHEEL_OVERFLOW])
+        return(((c >> shift) + 1) << shift);
+    return(UINT64_MAX);
+}
+
+/*
+ * wheel_advance: move the current tick forward to t
+ *
+ * Nothing may be pending in ticks that are skipped.  Slots at the
+ * higher levels whose range now begins are cascaded down.
+ */
+static void
+wheel_advance(struct ccn_schedule *sched, uint64_t t)
+{
+    struct ccn_wheel_link work;
+    int level;
+    int shift;
+
+    if (t <= sched->wtick)
+        return;
+    sched->wtick = t;
+    for (level = WHEEL_LEVELS; level > 0; level--) {
+        shift = level * WHEEL_BITS;
+        if ((t & (((uint64_t)1 << shift) - 1)) != 0)
+            continue;
+        if (level == WHEEL_LEVELS)
+            wheel_splice(sched, WHEEL_OVERFLOW, &work);
+        else
+            wheel_splice(sched, level * WHEEL_SLOTS +
+                         (t >> shift) % WHEEL_SLOTS, &work);
+        while (work.next != &work) {
+            struct ccn_wheel_item *it = WHEEL_ITEM(work.next);
+            it->where = WHEEL_DETACHED;
+            wheel_unlink(sched, it);
+            wheel_place(sched, it);
+        }
+    }
+}
+
+static struct ccn_scheduled_event *
+wheel_event(struct ccn_schedule *sched, int micros,
+            struct ccn_scheduled_event *ev)
+{
+    struct ccn_wheel_item *it = (struct ccn_wheel_item *)ev;
+    it->event_time = sched->wnow + micros;
+    wheel_place(sched, it);
+    sched->wheel_n++;
+    return(ev);
+}
+
+/*
+ * wheel_cancel: cancel an event that is not currently running
+ *
+ * Unlike the heap, the wheel can free the event right away.
+ */
+static int
+wheel_cancel(struct ccn_schedule *sched, struct ccn_scheduled_event *ev)
+{
+    struct ccn_wheel_item *it = (struct ccn_wheel_item *)ev;
+    int res;
+    if (it->link.next == NULL)
+        return(-1); /* already being cancelled */
+    wheel_unlink(sched, it);
+    sched->wheel_n--;
+    res = (ev->action)(sched, sched->clienth, ev, CCN_SCHEDULE_CANCEL);
+    if (res > 0)
+        abort(); /* Bug in ev->action - bad return value */
+    free(it);
+    return(0);
+}
+
+/*
+ * wheel_run_item: run an event that has been taken out of the wheel
+ */
+static void
+wheel_run_item(struct ccn_schedule *sched, struct ccn_wheel_item *it)
+{
+    struct ccn_scheduled_event *ev = &it->ev;
+    int64_t micros = it->event_time - sched->wnow;
+    int res;
+
+    lag_record(sched, ev->action, micros);
+    sched->wrunning = it;
+    res = (ev->action)(sched, sched->clienth, ev, 0);
+    sched->wrunning = NULL;
+    if (res <= 0 || ev->action == &ccn_schedule_cancelled_event) {
+        sched->wheel_n--;
+        free(it);
+        return;
+    }
+    /* As for the heap, keep to the original schedule unless way behind */
+    if (micros < -(int)(sched->clock->micros_per_base))
+        micros = 0;
+    it->event_time = sched->wnow + micros + res;
+    wheel_place(sched, it);
+}
+
+/*
+ * wheel_run_slot: run the due events in the current slot
+ * Returns the number of events that were run.
+ */
+static int
+wheel_run_slot(struct ccn_schedule *sched)
+{
+    struct ccn_wheel_link work;
+    struct ccn_wheel_item *it;
+    int where;
+    int ran;
+    int total = 0;
+
+    do {
+        ran = 0;
+        where = sched->wtick % WHEEL_SLOTS;
+        wheel_splice(sched, where, &work);
+        while (work.next != &work) {
+            it = WHEEL_ITEM(work.next);
+            wheel_unlink(sched, it);
+            if (it->event_time > sched->wnow) {
+                wheel_place(sched, it);
+                continue;
+            }
+            if (sched->time_has_passed > 0)
+                sched->time_has_passed = 0; /* leave a stopped clock alone */
+            wheel_run_item(sched, it);
+            if (sched->time_has_passed)
+                update_time(sched);
+            ran++;
+        }
+        total += ran;
+    } while (ran != 0 && sched->wslot[where].next != &sched->wslot[where]);
+    return(total);
+}
+
+static int
+wheel_run(struct ccn_schedule *sched)
+{
+    struct ccn_wheel_link *head;
+    struct ccn_wheel_link *l;
+    uint64_t target;
+    uint64_t t;
+    int64_t next;
+    int64_t d;
+    int64_t start;
+    int ran = 0;
+
+    update_time(sched);
+    start = sched->wnow;
+    for (;;) {
+        ran += wheel_run_slot(sched);
+        target = sched->wnow > 0 ? (uint64_t)sched->wnow >> WHEEL_TICK_SHIFT : 0;
+        if (sched->wtick >= target)
+            break;
+        t = wheel_next_tick(sched);
+        wheel_advance(sched, t < target ? t : target);
+    }
+    note_events(sched, start, ran);
+    if (sched->wheel_n == 0)
+        return(-1);
+    /* Anything left in the current slot is due later in this tick */
+    head = &sched->wslot[sched->wtick % WHEEL_SLOTS];
+    next = INT64_MAX;
+    for (l = head->next; l != head; l = l->next)
+        if (WHEEL_ITEM(l)->event_time < next)
+            next = WHEEL_ITEM(l)->event_time;
+    if (next == INT64_MAX) {
+        t = wheel_next_tick(sched);
+        if (t == UINT64_MAX || t >= ((uint64_t)INT64_MAX >> WHEEL_TICK_SHIFT))
+            return(INT_MAX);
+        next = (int64_t)(t << WHEEL_TICK_SHIFT);
+    }
+    d = next - sched->wnow;
+    if (d < 0)
+        return(0);
+    if (d > INT_MAX)
+        return(INT_MAX);
+    return(d);
+}
+
+static void
+wheel_destroy(struct ccn_schedule *sched)
+{
+    struct ccn_wheel_link *head;
+    struct ccn_wheel_item *it;
+    int i;
+    for (i = 0; i <= WHEEL_OVERFLOW; i++) {
+        head = &sched->wslot[i];
+        while (head->next != head) {
+            it = WHEEL_ITEM(head->next);
+            wheel_unlink(sched, it);
+            sched->wrunning = it;
+            (it->ev.action)(sched, sched->clienth, &it->ev, CCN_SCHEDULE_CANCEL);
+            sched->wrunning = NULL;
+            free(it);
+        }
+    }
+    sched->wheel_n = 0;
+}
+
+/*
+ * Statistics
+ */
+
+static int
+lag_compare(const void *a, const void *b)
+{
+    const struct ccn_schedule_lag *x = a;
+    const struct ccn_schedule_lag *y = b;
+    if (x->late_sum != y->late_sum)
+        return(x->late_sum < y->late_sum ? 1 : -1);
+    if (x->runs != y->runs)
+        return(x->runs < y->runs ? 1 : -1);
+    return(0);
+}
+
+/**
+ * Copy out the lateness statistics.
+ *
+ * The actions that have been late by the most in total come first.
+ * @returns the number of entries filled in, at most max.
+ */
+int
+ccn_schedule_lag(struct ccn_schedule *sched,
+                 struct ccn_schedule_lag *out, int max)
+{
+    struct ccn_schedule_lag all[LAG_SLOTS];
+    int i;
+    int n = 0;
+    if (sched->lag == NULL || max <= 0)
+        return(0);
+    for (i = 0; i < LAG_SLOTS; i++)
+        if (sched->lag[i].runs != 0)
+            all[n++] = sched->lag[i];
+    qsort(all, n, sizeof(all[0]), &lag_compare);
+    if (n > max)
+        n = max;
+    memcpy(out, all, n * sizeof(all[0]));
+    return(n);
+}
+
+/**
+ * Estimate a percentile of the lateness of an action.
+ *
+ * @returns the upper end of the bucket holding the percentile,
+ *          but not more than the largest lateness seen.
+ */
+unsigned
+ccn_schedule_lag_percentile(const struct ccn_schedule_lag *lag, unsigned pct)
+{
+    uintmax_t n = 0;
+    uintmax_t want;
+    uintmax_t acc = 0;
+    unsigned hi;
+    int i;
+    for (i = 0; i < CCN_SCHEDULE_LAG_BUCKETS; i++)
+        n += lag->hist[i];
+    if (n == 0)
+        return(0);
+    want = (n * pct + 99) / 100;
+    if (want == 0)
+        want = 1;
+    for (i = 0; i < CCN_SCHEDULE_LAG_BUCKETS - 1; i++) {
+        acc += lag->hist[i];
+        if (acc >= want)
+            break;
+    }
+    hi = (i == 0) ? 0 : (1U << i) - 1;
+    return(hi < lag->late_max ? hi : lag->late_max);
+}
+
+/**
+ * Note that the client is about to wait for i/o (idle nonzero),
+ * or has finished waiting (idle zero).
+ */
+void
+ccn_schedule_note_idle(struct ccn_schedule *sched, int idle)
+{
+    if (!idle && !sched->idle_on)
+        return;
+    update_time(sched);
+    if (idle) {
+        sched->idle_since = sched->wnow;
+        sched->idle_on = 1;
+    }
+    else if (sched->idle_on) {
+        if (sched->wnow > sched->idle_since)
+            sched->idle += sched->wnow - sched->idle_since;
+        sched->idle_on = 0;
+        sched->wakeups++;
+        if (sched->slack > 0)
+            sched->slack_wakeups++;
+    }
+}
+
+/**
+ * Allow the times reported by ccn_schedule_run to be late by up to
+ * micros, so that nearby events share a wakeup.  Zero turns it off.
+ */
+void
+ccn_schedule_set_slack(struct ccn_schedule *sched, int micros)
+{
+    if (micros < 0)
+        micros = 0;
+    if (micros == sched->slack)
+        return;
+    update_time(sched);
+    if (sched->slack > 0 && sched->wnow > sched->slack_since)
+        sched->slack_time += sched->wnow - sched->slack_since;
+    sched->slack_since = sched->wnow;
+    sched->slack = micros;
+}
+
+/**
+ * Report how the time since the schedule was created has been spent.
+ */
+void
+ccn_schedule_get_load(struct ccn_schedule *sched,
+                      struct ccn_schedule_load *load)
+{
+    update_time(sched);
+    load->total = (sched->wnow > sched->born) ? sched->wnow - sched->born : 0;
+    load->idle = sched->idle;
+    if (sched->idle_on && sched->wnow > sched->idle_since)
+        load->idle += sched->wnow - sched->idle_since;
+    load->events = sched->events;
+    load->wakeups = sched->wakeups;
+    load->slack_time = sched->slack_time;
+    if (sched->slack > 0 && sched->wnow > sched->slack_since)
+        load->slack_time += sched->wnow - sched->slack_since;
+    load->slack_wakeups = sched->slack_wakeups;
+}
+
+/**
+ * Report the memory held by the schedule.
+ *
+ * This is a census, so it costs nothing while events come and go.
+ * @param nevents if not NULL, gets the number of pending events.
+ * @returns the bytes held for events, the heap, and the statistics.
+ */
+size_t
+ccn_schedule_memory(struct ccn_schedule *sched, int *nevents)
+{
+    size_t n;
+    size_t bytes = sizeof(*sched);
+
+    if (sched->wheel) {
+        n = sched->wheel_n;
+        bytes += n * sizeof(struct ccn_wheel_item);
+    }
+    else {
+        n = sched->heap_n;
+        bytes += n * sizeof(struct ccn_scheduled_event);
+    }
+    bytes += sched->heap_limit * sizeof(sched->heap[0]);
+    if (sched->lag != NULL)
+        bytes += LAG_SLOTS * sizeof(sched->lag[0]);
+    if (nevents != NULL)
+        *nevents = n;
+    return(bytes);
+}
+
+/* The coarse clock is used only if it is at least this fine */
+#define CCN_CLOCK_COARSE_NS 1000000
+
+static void
+ccn_clock_gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
+{
+    const struct ccn_clock *clock = self->data;
+    *result = clock->now;
+}
+
+/**
+ * Set up a cached monotonic clock, and take the first reading.
+ */
+void
+ccn_clock_init(struct ccn_clock *clock)
+{
+    memset(clock, 0, sizeof(*clock));
+    memcpy(clock->gettime.descr, "mono", 5);
+    clock->gettime.gettime = &ccn_clock_gettime;
+    clock->gettime.micros_per_base = 1000000;
+    clock->gettime.data = clock;
+    clock->id = -1;
+#ifdef CLOCK_MONOTONIC
+    {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+            clock->id = CLOCK_MONOTONIC;
+#ifdef CLOCK_MONOTONIC_COARSE
+        if (clock_getres(CLOCK_MONOTONIC_COARSE, &ts) == 0 &&
+            ts.tv_sec == 0 && ts.tv_nsec <= CCN_CLOCK_COARSE_NS)
+            clock->id = CLOCK_MONOTONIC_COARSE;
+#endif
+    }
+#endif
+    ccn_clock_refresh(clock);
+}
+
+/**
+ * Read the clock.
+ *
+ * Falls back to gettimeofday if there is no monotonic clock.
+ * @returns the new reading, which is also saved in clock->now.
+ */
+const struct ccn_timeval *
+ccn_clock_refresh(struct ccn_clock *clock)
+{
+    struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    
+    if (clock->id != -1 && clock_gettime(clock->id, &ts) == 0) {
+        clock->now.s = ts.tv_sec;
+        clock->now.micros = ts.tv_nsec / 1000;
+        return(&clock->now);
+    }
+#endif
+    gettimeofday(&tv, NULL);
+    clock->now.s = tv.tv_sec;
+    clock->now.micros = tv.tv_usec;
+    return(&clock->now);
 }
 
 #ifdef TESTSCHEDULE
 // cc -g -o testschedule -DTESTSCHEDULE=main -I../include ccn_schedule.c
 #include <stdio.h>
-#include <sys/time.h>
 
 static void
 my_gettime(const struct ccn_gettime *self, struct ccn_timeval *result)
@@ -331,9 +1111,23 @@ static struct ccn_gettime gt = {"getTOD", &my_gettime, 1000000, NULL};
 static void
 testtick(struct ccn_schedule *sched)
 {
-    sched->now = sched->heap[0].event_time + 1;
-    printf("%ld: ", (long)sched->heap[0].event_time);
-    ccn_schedule_run_next(sched);
+    struct ccn_wheel_link *l;
+    int64_t t = INT64_MAX;
+    int i;
+    if (!sched->wheel) {
+        sched->now = sched->heap[0].event_time + 1;
+        printf("%ld: ", (long)sched->heap[0].event_time);
+        ccn_schedule_run_next(sched);
+        printf("\n");
+        return;
+    }
+    for (i = 0; i <= WHEEL_OVERFLOW; i++)
+        for (l = sched->wslot[i].next; l != &sched->wslot[i]; l = l->next)
+            if (WHEEL_ITEM(l)->event_time < t)
+                t = WHEEL_ITEM(l)->event_time;
+    sched->wnow = t + 1;
+    printf("%ld: ", (long)t);
+    ccn_schedule_run(sched);
     printf("\n");
 }
 static char dd[] = "ABDEFGHI";
@@ -345,12 +1139,16 @@ static int C(SARGS) { printf("C"); return 0; }
 static int D(SARGS) { if (flags & CCN_SCHEDULE_CANCEL) return(0);
                       printf("D");  return 30000000; }
 static struct ccn_schedule_heap_item tst[7];
-int TESTSCHEDULE()
+
+static void
+letters(int wheel)
 {
     struct ccn_schedule *s = ccn_schedule_create(dd+5, &gt);
     int i;
     struct ccn_scheduled_event *victim = NULL;
     // s->heap = tst; s->heap_limit = 7; // uncomment for easy debugger display
+    if (wheel)
+        wheel_init(s);
     s->time_has_passed = -1; /* don't really ask for time */
     ccn_schedule_event(s, 11111, A, dd+4, 11111);
     ccn_schedule_event(s, 1, A, dd, 1);
@@ -365,6 +1163,105 @@ int TESTSCHEDULE()
         testtick(s);
     }
     ccn_schedule_destroy(&s);
+}
+
+/*
+ * Microbenchmark, modeled on ccnd's pending interests: schedule n
+ * events up to 4 seconds out, cancel half of them (as satisfied
+ * interests would be), and let the rest expire in 1 ms steps.
+ */
+static int bench_fired;
+static int Nop(SARGS) { if ((flags & CCN_SCHEDULE_CANCEL) == 0) bench_fired++;
+                        return(0); }
+
+static double
+bench_elapsed(struct timeval *t0)
+{
+    struct timeval t1;
+    gettimeofday(&t1, NULL);
+    return((t1.tv_sec - t0->tv_sec) * 1e9 + (t1.tv_usec - t0->tv_usec) * 1e3);
+}
+
+static void
+bench(int wheel, int n)
+{
+    struct ccn_schedule *s = ccn_schedule_create(dd, &gt);
+    struct ccn_scheduled_event **evs = calloc(n, sizeof(evs[0]));
+    struct timeval t0;
+    double ins, can, run;
+    int i;
+    int step;
+
+    if (wheel)
+        wheel_init(s);
+    s->time_has_passed = -1;
+    bench_fired = 0;
+    srandom(1);
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i++)
+        evs[i] = ccn_schedule_event(s, random() % 4000000, Nop, NULL, i);
+    ins = bench_elapsed(&t0) / n;
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < n; i += 2)
+        ccn_schedule_cancel(s, evs[i]);
+    can = bench_elapsed(&t0) / ((n + 1) / 2);
+    gettimeofday(&t0, NULL);
+    for (step = 0; step <= 4000; step++) {
+        s->now += 1000;
+        s->wnow += 1000;
+        ccn_schedule_run(s);
+    }
+    run = bench_elapsed(&t0) / (n / 2);
+    printf("%s %8d events: schedule %6.1f ns, cancel %6.1f ns,"
+           " expire %6.1f ns per event, %d fired\n",
+           wheel ? "wheel" : "heap ", n, ins, can, run, bench_fired);
+    ccn_schedule_destroy(&s);
+    free(evs);
+}
+
+/*
+ * With slack, waits should end on the slack grid, and never early.
+ */
+static void
+slack(int wheel)
+{
+    struct ccn_schedule *s = ccn_schedule_create(dd, &gt);
+    int i;
+    int res;
+    int bad = 0;
+
+    if (wheel)
+        wheel_init(s);
+    s->time_has_passed = -1;
+    ccn_schedule_set_slack(s, 250000);
+    for (i = 1; i <= 20; i++)
+        ccn_schedule_event(s, i * 37000, Nop, NULL, i);
+    for (i = 0; i < 20; i++) {
+        res = ccn_schedule_run(s);
+        if (res < 0)
+            break;
+        if ((s->wnow + res) % 250000 != 0)
+            bad++;
+        s->now += res;
+        s->wnow += res;
+    }
+    printf("%s slack: %d wakeups for 20 events, %d off the grid\n",
+           wheel ? "wheel" : "heap ", i, bad);
+    ccn_schedule_destroy(&s);
+}
+
+int TESTSCHEDULE()
+{
+    int n;
+    letters(0);
+    printf("---- wheel ----\n");
+    letters(1);
+    slack(0);
+    slack(1);
+    for (n = 2000; n <= 2000000; n *= 10) {
+        bench(0, n);
+        bench(1, n);
+    }
     return(0);
 }
 #endif
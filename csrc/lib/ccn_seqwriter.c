@@ -21,11 +21,16 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/indexbuf.h>
+#include <ccn/manifest.h>
 #include <ccn/seqwriter.h>
 
 #define MAX_DATA_SIZE 4096
+#define MAX_WINDOW 1024
 
 struct ccn_seqwriter {
     struct ccn_closure cl;
@@ -38,10 +43,48 @@ struct ccn_seqwriter {
     int batching;
     int blockminsize;
     int blockmaxsize;
+    struct ccn_charbuf **ready; /* signed ahead, for seqnum readyseq and up */
+    int window;                 /* how far to sign ahead, 0 to sign lazily */
+    int nready;
+    uintmax_t readyseq;
+    intmax_t wanted;            /* highest seqnum asked for, -1 if none */
+    int nvcomps;                /* components in the versioned name */
+    size_t nvstart;             /* and where they are in nv */
+    size_t nvend;
+    uintmax_t signatures;
+    uintmax_t puts;
+    struct ccn_charbuf *digests; /* of each segment, if making a manifest */
     unsigned char interests_possibly_pending;
     unsigned char closed;
 };
 
+/**
+ * Record the digest of a freshly signed segment for the manifest.
+ *
+ * A segment may be signed more than once before it goes out, so the
+ * last one signed is the one recorded.
+ */
+static int
+seqw_note_digest(struct ccn_seqwriter *w, struct ccn_charbuf *cob)
+{
+    struct ccn_parsed_ContentObject pco = {0};
+    struct ccn_charbuf *d = w->digests;
+    size_t off = w->seqnum * CCN_MANIFEST_DIGEST_BYTES;
+    int res;
+    
+    res = ccn_parse_ContentObject(cob->buf, cob->length, &pco, NULL);
+    if (res < 0)
+        return(res);
+    ccn_digest_ContentObject(cob->buf, &pco);
+    if (d->length < off + CCN_MANIFEST_DIGEST_BYTES &&
+        ccn_charbuf_reserve(d, off + CCN_MANIFEST_DIGEST_BYTES - d->length) == NULL)
+        return(-1);
+    memcpy(d->buf + off, pco.digest, CCN_MANIFEST_DIGEST_BYTES);
+    if (d->length < off + CCN_MANIFEST_DIGEST_BYTES)
+        d->length = off + CCN_MANIFEST_DIGEST_BYTES;
+    return(0);
+}
+
 static struct ccn_charbuf *
 seqw_next_cob(struct ccn_seqwriter *w)
 {
@@ -52,15 +95,131 @@ seqw_next_cob(struct ccn_seqwriter *w)
     
     if (w->closed)
         sp.sp_flags |= CCN_SP_FINAL_BLOCK;
+    if (w->digests != NULL)
+        sp.sp_flags |= CCN_SP_DIGEST_ONLY;
     ccn_charbuf_append(name, w->nv->buf, w->nv->length);
     ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, w->seqnum);
     res = ccn_sign_content(w->h, cob, name, &sp, w->buffer->buf, w->buffer->length);
+    if (res >= 0 && w->digests != NULL)
+        res = seqw_note_digest(w, cob);
     if (res < 0)
         ccn_charbuf_destroy(&cob);
+    else
+        w->signatures++;
     ccn_charbuf_destroy(&name);
     return(cob);
 }
 
+/**
+ * Find the segment an interest asks for, if it names one of ours.
+ * @returns the seqnum, or -1
+ */
+static intmax_t
+seqw_interest_seqnum(struct ccn_seqwriter *w, struct ccn_upcall_info *info)
+{
+    struct ccn_indexbuf *comps = info->interest_comps;
+    const unsigned char *ccnb = info->interest_ccnb;
+    const unsigned char *comp = NULL;
+    size_t size = 0;
+    size_t len = w->nvend - w->nvstart;
+    uintmax_t seq = 0;
+    size_t i;
+    
+    if (comps == NULL || comps->n < w->nvcomps + 2)
+        return(-1);
+    if (comps->buf[w->nvcomps] - comps->buf[0] != len ||
+        memcmp(ccnb + comps->buf[0], w->nv->buf + w->nvstart, len) != 0)
+        return(-1);
+    if (ccn_name_comp_get(ccnb, comps, w->nvcomps, &comp, &size) < 0 ||
+        size < 1 || size > 1 + sizeof(seq) || comp[0] != CCN_MARKER_SEQNUM)
+        return(-1);
+    for (i = 1; i < size; i++)
+        seq = (seq << 8) + comp[i];
+    return(seq);
+}
+
+/**
+ * Put the ready object at index i, and slide the window past the
+ * ones that have gone out.
+ */
+static int
+seqw_put_ready(struct ccn_seqwriter *w, int i)
+{
+    struct ccn_charbuf *cob = w->ready[i];
+    int res;
+    int n;
+    
+    res = ccn_put(w->h, cob->buf, cob->length);
+    if (res < 0)
+        return(res);
+    w->puts++;
+    ccn_charbuf_destroy(&w->ready[i]);
+    for (n = 0; n < w->nready && w->ready[n] == NULL; n++)
+        continue;
+    if (n > 0) {
+        memmove(w->ready, w->ready + n, (w->nready - n) * sizeof(w->ready[0]));
+        w->nready -= n;
+        w->readyseq += n;
+    }
+    return(0);
+}
+
+/**
+ * Sign the buffered data into the window, ahead of any interest for it.
+ *
+ * If it has already been asked for, it goes right out.
+ * @returns 0, or -1 if the window is full or signing failed.
+ */
+static int
+seqw_sign_ahead(struct ccn_seqwriter *w)
+{
+    struct ccn_charbuf *cob = NULL;
+    uintmax_t seq = w->seqnum;
+    
+    if (w->nready >= w->window && !w->closed)
+        return(-1);
+    cob = seqw_next_cob(w);
+    if (cob == NULL)
+        return(-1);
+    if (seq == 0) {
+        w->cob0 = ccn_charbuf_create();
+        ccn_charbuf_append_charbuf(w->cob0, cob);
+    }
+    w->ready[w->nready++] = cob;
+    w->buffer->length = 0;
+    w->seqnum++;
+    if (w->interests_possibly_pending || (intmax_t)seq <= w->wanted ||
+        w->digests != NULL) {
+        if (seqw_put_ready(w, w->nready - 1) == 0)
+            w->interests_possibly_pending = 0;
+    }
+    return(0);
+}
+
+/**
+ * Answer an interest from the window, if any of it matches.
+ */
+static int
+seqw_answer_ready(struct ccn_seqwriter *w, struct ccn_upcall_info *info)
+{
+    int i;
+    
+    for (i = 0; i < w->nready; i++) {
+        struct ccn_charbuf *cob = w->ready[i];
+        if (cob != NULL &&
+            ccn_content_matches_interest(cob->buf, cob->length,
+                                         1, NULL,
+                                         info->interest_ccnb,
+                                         info->pi->offset[CCN_PI_E],
+                                         info->pi)) {
+            if (w->nready >= w->window)
+                ccn_set_run_timeout(info->h, 0); /* room to write again */
+            return(seqw_put_ready(w, i));
+        }
+    }
+    return(-1);
+}
+
 static enum ccn_upcall_res
 seqw_incoming_interest(
                        struct ccn_closure *selfp,
@@ -75,14 +234,29 @@ seqw_incoming_interest(
         abort();
     switch (kind) {
         case CCN_UPCALL_FINAL:
+            while (w->nready > 0)
+                ccn_charbuf_destroy(&w->ready[--w->nready]);
+            free(w->ready);
             ccn_charbuf_destroy(&w->nb);
             ccn_charbuf_destroy(&w->nv);
             ccn_charbuf_destroy(&w->buffer);
             ccn_charbuf_destroy(&w->cob0);
+            ccn_charbuf_destroy(&w->digests);
             free(w);
             break;
         case CCN_UPCALL_INTEREST:
-            if (w->closed || w->buffer->length > w->blockminsize) {
+            if (w->window > 0) {
+                intmax_t seq = seqw_interest_seqnum(w, info);
+                if (seqw_answer_ready(w, info) == 0)
+                    return(CCN_UPCALL_RESULT_INTEREST_CONSUMED);
+                if ((w->closed || w->buffer->length > w->blockminsize) &&
+                    seqw_sign_ahead(w) == 0 && w->nready > 0 &&
+                    seqw_answer_ready(w, info) == 0)
+                    return(CCN_UPCALL_RESULT_INTEREST_CONSUMED);
+                if (seq >= (intmax_t)w->seqnum && seq > w->wanted)
+                    w->wanted = seq;
+            }
+            else if (w->closed || w->buffer->length > w->blockminsize) {
                 cob = seqw_next_cob(w);
                 if (cob == NULL)
                     return(CCN_UPCALL_RESULT_OK);
@@ -144,6 +318,15 @@ ccn_seqw_create(struct ccn *h, struct ccn_charbuf *name)
     nv = ccn_charbuf_create();
     ccn_charbuf_append(nv, name->buf, name->length);
     res = ccn_create_version(h, nv, CCN_V_NOW, 0, 0);
+    if (res >= 0) {
+        struct ccn_indexbuf *nvc = ccn_indexbuf_create();
+        w->nvcomps = res = ccn_name_split(nv, nvc);
+        if (res >= 0) {
+            w->nvstart = nvc->buf[0];
+            w->nvend = nvc->buf[res];
+        }
+        ccn_indexbuf_destroy(&nvc);
+    }
     if (res < 0 || nb == NULL) {
         ccn_charbuf_destroy(&nv);
         ccn_charbuf_destroy(&nb);
@@ -158,6 +341,7 @@ ccn_seqw_create(struct ccn *h, struct ccn_charbuf *name)
     w->buffer = ccn_charbuf_create();
     w->h = h;
     w->seqnum = 0;
+    w->wanted = -1;
     w->interests_possibly_pending = 1;
     w->blockminsize = 0;
     w->blockmaxsize = MAX_DATA_SIZE;
@@ -215,18 +399,33 @@ ccn_seqw_write(struct ccn_seqwriter *w, const void *buf, size_t size)
         return(-1);
     if (w->buffer == NULL || size > w->blockmaxsize)
         return(ccn_seterror(w->h, EINVAL));
+    if (w->window > 0) {
+        /* Sign each block as soon as it fills, so interests find it ready */
+        if (size + w->buffer->length > w->blockmaxsize &&
+            w->buffer->length >= w->blockminsize)
+            seqw_sign_ahead(w);
+        if (size + w->buffer->length > w->blockmaxsize)
+            return(ccn_seterror(w->h, EAGAIN));
+        if (size != 0)
+            ccn_charbuf_append(w->buffer, buf, size);
+        if (w->batching == 0 && (w->closed ||
+                                 w->buffer->length >= w->blockmaxsize))
+            seqw_sign_ahead(w);
+        return(size);
+    }
     ans = size;
     if (size + w->buffer->length > w->blockmaxsize)
         ans = ccn_seterror(w->h, EAGAIN);
     else if (size != 0)
         ccn_charbuf_append(w->buffer, buf, size);
-    if (w->interests_possibly_pending &&
+    if ((w->interests_possibly_pending || w->digests != NULL) &&
         (w->closed || w->buffer->length >= w->blockminsize) &&
         (w->batching == 0 || ans == -1)) {
         cob = seqw_next_cob(w);
         if (cob != NULL) {
             res = ccn_put(w->h, cob->buf, cob->length);
             if (res >= 0) {
+                w->puts++;
                 if (w->seqnum == 0) {
                     w->cob0 = cob;
                     cob = NULL;
@@ -280,6 +479,81 @@ ccn_seqw_set_block_limits(struct ccn_seqwriter *w, int l, int h)
     w->blockmaxsize = h;
     return(0);
 }
+/**
+ * Sign segments ahead of the interests for them.
+ *
+ * Up to window segments are signed as soon as their data is written,
+ * and kept ready so that an interest is answered without any signing.
+ * ccn_seqw_write refuses new data (EAGAIN) while the window is full.
+ * A window of 0 (the default) signs each segment when it is asked for.
+ * The window may only be changed before anything has been written.
+ * @returns 0, or -1 for an error.
+ */
+int
+ccn_seqw_set_window(struct ccn_seqwriter *w, int window)
+{
+    struct ccn_charbuf **ready = NULL;
+    
+    if (w == NULL || w->cl.data != w || w->closed)
+        return(-1);
+    if (window < 0 || window > MAX_WINDOW || w->seqnum != 0 || w->nready != 0)
+        return(-1);
+    if (window > 0) {
+        /* one extra, for the final block */
+        ready = calloc(window + 1, sizeof(ready[0]));
+        if (ready == NULL)
+            return(-1);
+    }
+    free(w->ready);
+    w->ready = ready;
+    w->window = window;
+    return(0);
+}
+
+/**
+ * Publish a manifest of the segments when the stream is closed.
+ *
+ * The segments then get a digest-only signature, and only the root of
+ * the manifest is signed with a key, so that a consumer checks one
+ * signature, and a hash for each segment (see ccn/manifest.h).
+ * Such a consumer asks for nothing until the manifest is out, so the
+ * segments are put as soon as they are signed, without waiting to be
+ * asked; a repository (or the ccnd content store) holds them meanwhile.
+ * This may only be changed before anything has been written.
+ * @returns 0, or -1 for an error.
+ */
+int
+ccn_seqw_set_manifest(struct ccn_seqwriter *w, int on)
+{
+    if (w == NULL || w->cl.data != w || w->closed)
+        return(-1);
+    if (w->seqnum != 0 || w->nready != 0 || w->buffer->length != 0)
+        return(-1);
+    if (!on)
+        ccn_charbuf_destroy(&w->digests);
+    else if (w->digests == NULL)
+        w->digests = ccn_charbuf_create();
+    return(0);
+}
+
+/**
+ * Get the number of segments signed and put so far.
+ */
+int
+ccn_seqw_get_counts(struct ccn_seqwriter *w,
+                    uintmax_t *signatures, uintmax_t *puts, int *ready)
+{
+    if (w == NULL || w->cl.data != w)
+        return(-1);
+    if (signatures != NULL)
+        *signatures = w->signatures;
+    if (puts != NULL)
+        *puts = w->puts;
+    if (ready != NULL)
+        *ready = w->nready;
+    return(0);
+}
+
 /**
  * Assert that an interest has possibly been expressed that matches
  * the seqwriter's data.  This is useful, for example, if the seqwriter
@@ -307,6 +581,13 @@ ccn_seqw_close(struct ccn_seqwriter *w)
     w->interests_possibly_pending = 1;
     w->batching = 0;
     ccn_seqw_write(w, NULL, 0);
+    /* Nobody will be able to ask us for these, so send them along now */
+    while (w->nready > 0 && seqw_put_ready(w, 0) == 0)
+        continue;
+    /* The manifest follows the segments, once they are all out */
+    if (w->digests != NULL && w->nready == 0 && w->buffer->length == 0 &&
+        w->digests->length == w->seqnum * CCN_MANIFEST_DIGEST_BYTES)
+        ccn_manifest_put(w->h, w->nv, w->digests->buf, w->seqnum);
     ccn_set_interest_filter(w->h, w->nb, NULL);
     return(0);
 }
@@ -18,43 +18,270 @@
  * Fifth Floor, Boston, MA 02110-1301 USA.
  */
  
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <ccn/ccn.h>
 #include <ccn/ccnd.h>
 #include <ccn/ccn_private.h>
 
 /**
- * Set up a unix-domain socket address for contacting ccnd.
+ * Get the number of ccnd shards on this host, from CCN_SHARDS.
+ * @returns the count, 1 if ccnd is not sharded.
+ */
+int
+ccn_local_shards(void)
+{
+    const char *s = getenv("CCN_SHARDS");
+    int n;
+
+    if (s == NULL || s[0] == 0)
+        return(1);
+    n = atoi(s);
+    if (n < 1)
+        return(1);
+    if (n > CCN_MAX_SHARDS)
+        return(CCN_MAX_SHARDS);
+    return(n);
+}
+
+/**
+ * Get the number of leading name components that pick the shard,
+ * from CCN_SHARD_COMPONENTS.
  *
- * If the environment variable CCN_LOCAL_SOCKNAME is set and
- * not empty, it supplies the name stem; otherwise the compiled-in
- * default is used.
+ * With the default of 1, everything under a top-level prefix goes to
+ * one shard; more components spread a busy prefix over the shards.
+ * ccnd and its clients must agree on this.
+ * @returns the count, from 1 to CCN_MAX_SHARD_COMPONENTS.
+ */
+int
+ccn_shard_components(void)
+{
+    const char *s = getenv("CCN_SHARD_COMPONENTS");
+    int n;
+
+    if (s == NULL || s[0] == 0)
+        return(1);
+    n = atoi(s);
+    if (n < 1)
+        return(1);
+    if (n > CCN_MAX_SHARD_COMPONENTS)
+        return(CCN_MAX_SHARD_COMPONENTS);
+    return(n);
+}
+
+/**
+ * Mix the value of one Component into the hash that picks a shard.
  *
- * If portstr is NULL or empty, the environment variable CCN_LOCAL_PORT is
- * checked. If the portstr specifies something other than the ccnx registered
- * port number, the socket name is modified accordingly. 
+ * Start from CCN_SHARD_HASH_INIT.  This is the hash behind
+ * ccn_name_shard, kept here so that finding the socket does not need
+ * the ccnb decoder.  The size goes in first, so that the same bytes
+ * split into components differently hash differently.
+ */
+uint32_t
+ccn_shard_hash(uint32_t x, const unsigned char *comp, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < 4; i++)
+        x = (x ^ ((size >> (8 * i)) & 0xFF)) * 16777619U;
+    for (i = 0; i < size; i++)
+        x = (x ^ comp[i]) * 16777619U;
+    return(x);
+}
+
+/**
+ * Pick the shard from the hash of a name's leading components.
+ * @returns the shard, from 0 to nshards - 1.
+ */
+int
+ccn_shard_pick(uint32_t x, int nshards)
+{
+    if (nshards <= 1)
+        return(0);
+    /* The low bits of FNV are weak; mix before taking the remainder */
+    x ^= x >> 16;
+    x *= 0x85ebca6bU;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35U;
+    x ^= x >> 16;
+    return(x % (unsigned)nshards);
+}
+
+static int
+hexval(int c)
+{
+    if (c >= '0' && c <= '9')
+        return(c - '0');
+    if (c >= 'A' && c <= 'F')
+        return(c - 'A' + 10);
+    if (c >= 'a' && c <= 'f')
+        return(c - 'a' + 10);
+    return(-1);
+}
+
+/**
+ * Find the shard that owns a ccnx URI, from its first ncomps components.
+ *
+ * The components are unescaped as ccn_name_from_uri would do it,
+ * including . and .., without building the Name.  As with
+ * ccn_name_shard, the empty name belongs to shard 0.
+ * @returns the shard, or -1 if the URI is malformed.
+ */
+static int
+shard_from_uri(const char *uri, int ncomps, int nshards)
+{
+    unsigned char buf[1024];
+    size_t start[CCN_MAX_SHARD_COMPONENTS + 1];
+    uint32_t x = CCN_SHARD_HASH_INIT;
+    int depth = 0;
+    size_t len;
+    size_t dots;
+    size_t n = 0;
+    size_t i;
+    int hi, lo;
+    int c;
+    int k;
+
+    if (strncmp(uri, "ccnx:", 5) == 0)
+        uri += 5;
+    if (ncomps > CCN_MAX_SHARD_COMPONENTS)
+        ncomps = CCN_MAX_SHARD_COMPONENTS;
+    start[0] = 0;
+    for (;;) {
+        while (uri[0] == '/')
+            uri++;
+        if (uri[0] == 0 || uri[0] == '?' || uri[0] == '#')
+            break;
+        /* Only the leading ncomps are kept, but all of them are counted */
+        n = start[depth < ncomps ? depth : ncomps];
+        len = dots = 0;
+        for (i = 0; uri[i] != 0 && strchr("/?#", uri[i]) == NULL; i++) {
+            c = (unsigned char)uri[i];
+            if (c == '%') {
+                hi = hexval(uri[i + 1]);
+                lo = (hi < 0) ? -1 : hexval(uri[i + 2]);
+                if (lo < 0)
+                    return(-1);
+                c = hi * 16 + lo;
+                i += 2;
+            }
+            len++;
+            if (c == '.')
+                dots++;
+            if (depth < ncomps) {
+                if (n == sizeof(buf))
+                    return(-1);
+                buf[n++] = c;
+            }
+        }
+        uri += i;
+        /* A component of only dots loses three of them; . and .. move */
+        if (dots == len) {
+            if (len == 1)
+                continue;
+            if (len == 2) {
+                if (depth == 0)
+                    return(-1);
+                depth--;
+                continue;
+            }
+            if (depth < ncomps)
+                n -= 3;
+        }
+        if (depth < ncomps)
+            start[depth + 1] = n;
+        depth++;
+    }
+    if (depth == 0)
+        return(0);
+    if (depth > ncomps)
+        depth = ncomps;
+    for (k = 0; k < depth; k++)
+        x = ccn_shard_hash(x, buf + start[k], start[k + 1] - start[k]);
+    return(ccn_shard_pick(x, nshards));
+}
+
+/**
+ * Get the shard to contact, from the environment.
+ *
+ * CCN_SHARD names it outright; otherwise it is the one that owns the
+ * name in CCN_SHARD_PREFIX, or else shard 0.
+ */
+static int
+shard_from_env(int nshards)
+{
+    const char *s;
+    int shard = 0;
+
+    s = getenv("CCN_SHARD");
+    if (s != NULL && s[0] != 0) {
+        shard = atoi(s);
+        return(shard < 0 ? 0 : shard % nshards);
+    }
+    s = getenv("CCN_SHARD_PREFIX");
+    if (s != NULL && s[0] != 0)
+        shard = shard_from_uri(s, ccn_shard_components(), nshards);
+    return(shard < 0 ? 0 : shard);
+}
+
+/**
+ * Set up a unix-domain socket address for contacting a given ccnd shard.
+ *
+ * This is as for ccn_setup_sockaddr_un, except that the shard is
+ * given; if there are no shards (CCN_SHARDS unset), it is ignored.
  * @param portstr - numeric port; use NULL for default.
+ * @param shard - which ccnd, from 0 up to ccn_local_shards() - 1.
  */
 void
-ccn_setup_sockaddr_un(const char *portstr, struct sockaddr_un *result)
+ccn_setup_sockaddr_un_shard(const char *portstr, int shard,
+                            struct sockaddr_un *result)
 {
     struct sockaddr_un *sa = result;
     const char *sockname = getenv("CCN_LOCAL_SOCKNAME");
+    char suffix[16] = "";
     if (sockname == NULL || sockname[0] == 0)
         sockname = CCN_DEFAULT_LOCAL_SOCKNAME; /* /tmp/.ccnd.sock */
+    if (ccn_local_shards() > 1)
+        snprintf(suffix, sizeof(suffix), ".%d", shard);
     memset(sa, 0, sizeof(*sa));
     sa->sun_family = AF_UNIX;
     if (portstr == NULL || portstr[0] == 0)
         portstr = getenv(CCN_LOCAL_PORT_ENVNAME);
     if (portstr != NULL && atoi(portstr) > 0 &&
           atoi(portstr) != atoi(CCN_DEFAULT_UNICAST_PORT))
-        snprintf(sa->sun_path, sizeof(sa->sun_path), "%s.%s",
-                 sockname, portstr);
+        snprintf(sa->sun_path, sizeof(sa->sun_path), "%s.%s%s",
+                 sockname, portstr, suffix);
     else
-        snprintf(sa->sun_path, sizeof(sa->sun_path), "%s",
-                 sockname);
+        snprintf(sa->sun_path, sizeof(sa->sun_path), "%s%s",
+                 sockname, suffix);
+}
+
+/**
+ * Set up a unix-domain socket address for contacting ccnd.
+ *
+ * If the environment variable CCN_LOCAL_SOCKNAME is set and
+ * not empty, it supplies the name stem; otherwise the compiled-in
+ * default is used.
+ *
+ * If portstr is NULL or empty, the environment variable CCN_LOCAL_PORT is
+ * checked. If the portstr specifies something other than the ccnx registered
+ * port number, the socket name is modified accordingly. 
+ *
+ * If CCN_SHARDS says that several ccnd processes share the host, the
+ * shard is chosen by CCN_SHARD or CCN_SHARD_PREFIX, and its number is
+ * appended to the socket name.
+ * @param portstr - numeric port; use NULL for default.
+ */
+void
+ccn_setup_sockaddr_un(const char *portstr, struct sockaddr_un *result)
+{
+    int n = ccn_local_shards();
+
+    ccn_setup_sockaddr_un_shard(portstr, n > 1 ? shard_from_env(n) : 0,
+                                result);
 }
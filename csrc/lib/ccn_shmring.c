@@ -0,0 +1,392 @@
+/**
+ * @file ccn_shmring.c
+ * @brief Shared-memory rings for a local client connection.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for memfd_create */
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <ccn/charbuf.h>
+#include <ccn/shmring.h>
+
+#define CCN_SHMRING_MAGIC 0x63636e72
+#define CCN_SHMRING_VERSION 1
+#define CCN_SHMRING_HDR 4096    /**< the rings' data start this far in */
+#define CCN_SHMRING_MIN 4096
+#define CCN_SHMRING_MAX (1 << 28)
+
+/*
+ * The rings live in a memfd that can be neither shrunk nor grown, so
+ * neither end can make the other take SIGBUS by truncating it.  Where
+ * there are no sealed memfds there are no rings.
+ */
+#if defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+#define CCN_SHMRING_SEALS (F_SEAL_SHRINK | F_SEAL_GROW)
+#endif
+
+/**
+ * Control block for one direction.
+ *
+ * head is advanced only by the producer, and tail only by the consumer;
+ * they are kept on separate cache lines.  Each end sets one of the
+ * want flags when it is about to wait, and the other end clears it
+ * when it rings the doorbell.
+ */
+struct ccn_shmring_ctl {
+    volatile uint32_t head;         /**< bytes ever written */
+    unsigned char pad0[60];
+    volatile uint32_t tail;         /**< bytes ever read */
+    unsigned char pad1[60];
+    volatile uint32_t want_data;    /**< consumer is waiting for data */
+    volatile uint32_t want_space;   /**< producer is waiting for room */
+    unsigned char pad2[56];
+};
+
+/**
+ * The start of the shared file.
+ * ring[0] carries data from the creator, ring[1] towards it.
+ */
+struct ccn_shmring_shared {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                  /**< bytes in each ring, a power of 2 */
+    unsigned char pad[52];
+    struct ccn_shmring_ctl ring[2];
+};
+
+/**
+ * Our end of the rings.
+ */
+struct ccn_shmring {
+    struct ccn_shmring_shared *shared;
+    size_t mapsize;
+    struct ccn_shmring_ctl *tx;
+    struct ccn_shmring_ctl *rx;
+    unsigned char *txdata;
+    unsigned char *rxdata;
+    uint32_t size;
+    int sock;
+};
+
+static struct ccn_shmring *
+shmring_map(int fd, size_t mapsize, int creator, int sock)
+{
+    struct ccn_shmring *r;
+    void *base;
+
+    base = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return(NULL);
+    r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        munmap(base, mapsize);
+        return(NULL);
+    }
+    r->shared = base;
+    r->mapsize = mapsize;
+    r->size = (mapsize - CCN_SHMRING_HDR) / 2;
+    r->tx = &r->shared->ring[creator ? 0 : 1];
+    r->rx = &r->shared->ring[creator ? 1 : 0];
+    r->txdata = (unsigned char *)base + CCN_SHMRING_HDR +
+                (creator ? 0 : r->size);
+    r->rxdata = (unsigned char *)base + CCN_SHMRING_HDR +
+                (creator ? r->size : 0);
+    r->sock = sock;
+    return(r);
+}
+
+/**
+ * Create the shared memory, sealed at its size, and map it.
+ */
+struct ccn_shmring *
+ccn_shmring_create(size_t size, int sock, int *fdp)
+{
+    struct ccn_shmring *r = NULL;
+    struct ccn_shmring_shared *s;
+    uint32_t ringsize;
+    size_t mapsize;
+    int fd = -1;
+
+    *fdp = -1;
+    if (size > CCN_SHMRING_MAX)
+        return(NULL);
+    for (ringsize = CCN_SHMRING_MIN; ringsize < size; ringsize *= 2)
+        continue;
+    mapsize = CCN_SHMRING_HDR + 2 * (size_t)ringsize;
+#ifdef CCN_SHMRING_SEALS
+    fd = memfd_create("ccn-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1)
+        return(NULL);
+    if (ftruncate(fd, mapsize) == 0 &&
+        fcntl(fd, F_ADD_SEALS, CCN_SHMRING_SEALS | F_SEAL_SEAL) == 0)
+        r = shmring_map(fd, mapsize, 1, sock);
+#endif
+    if (r == NULL) {
+        if (fd != -1)
+            close(fd);
+        return(NULL);
+    }
+    s = r->shared;
+    s->size = ringsize;
+    s->version = CCN_SHMRING_VERSION;
+    /* Either end may be waiting before it has ever looked at the ring */
+    s->ring[0].want_data = s->ring[1].want_data = 1;
+    __sync_synchronize();
+    s->magic = CCN_SHMRING_MAGIC;
+    *fdp = fd;
+    return(r);
+}
+
+/**
+ * Map shared memory made by the other end.
+ *
+ * Only memory that is sealed at its size and already carries our
+ * header is accepted, so nothing can pull the pages out from under us.
+ */
+struct ccn_shmring *
+ccn_shmring_attach(int fd, int sock)
+{
+    struct ccn_shmring *r = NULL;
+#ifdef CCN_SHMRING_SEALS
+    struct ccn_shmring_shared hdr;
+    struct stat st;
+    int seals;
+
+    seals = fcntl(fd, F_GET_SEALS);
+    if (seals != -1 &&
+        (seals & CCN_SHMRING_SEALS) == CCN_SHMRING_SEALS &&
+        fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+        hdr.magic == CCN_SHMRING_MAGIC &&
+        hdr.version == CCN_SHMRING_VERSION &&
+        hdr.size >= CCN_SHMRING_MIN && hdr.size <= CCN_SHMRING_MAX &&
+        (hdr.size & (hdr.size - 1)) == 0 &&
+        st.st_size == CCN_SHMRING_HDR + 2 * (off_t)hdr.size)
+        r = shmring_map(fd, st.st_size, 0, sock);
+#endif
+    return(r);
+}
+
+/**
+ * Send a message on a unix-domain socket, passing fd along with it.
+ */
+ssize_t
+ccn_shmring_sendfd(int sock, const void *p, size_t size, int fd)
+{
+    struct msghdr msg = {0};
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr align;
+        unsigned char buf[CMSG_SPACE(sizeof(int))];
+    } u;
+
+    memset(&u, 0, sizeof(u));
+    iov.iov_base = (void *)p;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return(sendmsg(sock, &msg, 0));
+}
+
+/**
+ * Receive from a unix-domain socket, picking up a passed fd if there
+ * is one.  *fdp is left alone if there is not; any others are closed.
+ */
+ssize_t
+ccn_shmring_recvfd(int sock, void *buf, size_t size, int *fdp)
+{
+    struct msghdr msg = {0};
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr align;
+        unsigned char buf[CMSG_SPACE(4 * sizeof(int))];
+    } u;
+    ssize_t res;
+    int fd;
+    int i, n;
+
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+#ifdef MSG_CMSG_CLOEXEC
+    res = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+#else
+    res = recvmsg(sock, &msg, 0);
+#endif
+    if (res < 0)
+        return(res);
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < n; i++) {
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (*fdp == -1)
+                *fdp = fd;
+            else
+                close(fd);
+        }
+    }
+    return(res);
+}
+
+void
+ccn_shmring_destroy(struct ccn_shmring **rp)
+{
+    struct ccn_shmring *r = *rp;
+    if (r != NULL) {
+        munmap(r->shared, r->mapsize);
+        free(r);
+        *rp = NULL;
+    }
+}
+
+static void
+shmring_ring(struct ccn_shmring *r, volatile uint32_t *want)
+{
+    unsigned char b = 0;
+    if (__sync_bool_compare_and_swap(want, 1, 0))
+        (void)send(r->sock, &b, 1, MSG_DONTWAIT);
+}
+
+ssize_t
+ccn_shmring_writev(struct ccn_shmring *r, const struct iovec *iov, int iovcnt)
+{
+    struct ccn_shmring_ctl *c = r->tx;
+    uint32_t mask = r->size - 1;
+    uint32_t head = c->head;
+    size_t total = 0;
+    size_t room;
+    size_t n, m, k;
+    size_t done;
+    int i;
+
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+    room = r->size - (head - c->tail);
+    if (room < total) {
+        c->want_space = 1;
+        __sync_synchronize();
+        room = r->size - (head - c->tail);
+    }
+    __sync_synchronize();
+    done = 0;
+    for (i = 0; i < iovcnt && done < room; i++) {
+        n = iov[i].iov_len;
+        if (n > room - done)
+            n = room - done;
+        for (k = 0; k < n; k += m) {
+            m = r->size - ((head + done + k) & mask);
+            if (m > n - k)
+                m = n - k;
+            memcpy(r->txdata + ((head + done + k) & mask),
+                   (const unsigned char *)iov[i].iov_base + k, m);
+        }
+        done += n;
+    }
+    if (done == 0)
+        return(0);
+    __sync_synchronize();
+    c->head = head + done;
+    __sync_synchronize();
+    shmring_ring(r, &c->want_data);
+    return(done);
+}
+
+ssize_t
+ccn_shmring_write(struct ccn_shmring *r, const void *p, size_t size)
+{
+    struct iovec iov;
+    iov.iov_base = (void *)p;
+    iov.iov_len = size;
+    return(ccn_shmring_writev(r, &iov, 1));
+}
+
+ssize_t
+ccn_shmring_read(struct ccn_shmring *r, void *buf, size_t size)
+{
+    struct ccn_shmring_ctl *c = r->rx;
+    uint32_t mask = r->size - 1;
+    uint32_t tail = c->tail;
+    size_t avail;
+    size_t n, m;
+
+    avail = c->head - tail;
+    __sync_synchronize();
+    if (size > avail)
+        size = avail;
+    for (n = 0; n < size; n += m) {
+        m = r->size - ((tail + n) & mask);
+        if (m > size - n)
+            m = size - n;
+        memcpy((unsigned char *)buf + n, r->rxdata + ((tail + n) & mask), m);
+    }
+    if (size == 0)
+        return(0);
+    __sync_synchronize();
+    c->tail = tail + size;
+    __sync_synchronize();
+    shmring_ring(r, &c->want_space);
+    return(size);
+}
+
+int
+ccn_shmring_idle(struct ccn_shmring *r)
+{
+    r->rx->want_data = 1;
+    __sync_synchronize();
+    return(r->rx->head != r->rx->tail);
+}
+
+int
+ccn_shmring_drain(struct ccn_shmring *r)
+{
+    unsigned char buf[64];
+    ssize_t res;
+
+    for (;;) {
+        res = recv(r->sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (res == 0)
+            return(0);
+        if (res == -1)
+            return((errno == EAGAIN || errno == EINTR) ? 1 : -1);
+    }
+}
@@ -0,0 +1,299 @@
+/**
+ * @file ccn_signer.c
+ * @brief Deferred, batched signing of ContentObjects.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/schedule.h>
+#include <ccn/signer.h>
+
+/** Most objects to sign under one signature */
+#define CCN_SIGNER_BATCH 64
+/** Most batches to sign before letting other work in */
+#define CCN_SIGNER_ROUNDS 4
+
+struct ccn_sign_req {
+    struct ccn_sign_req *next;
+    struct ccn_charbuf *name;
+    struct ccn_charbuf *data;
+    struct ccn_charbuf *result;
+    struct ccn_signing_params sp;   /**< template_ccnb is our copy */
+    ccn_signer_action action;
+    void *actiondata;
+    intptr_t actionint;
+};
+
+struct ccn_signer {
+    struct ccn *h;
+    struct ccn_schedule *sched;
+    struct ccn_scheduled_event *ev;
+    struct ccn_sign_req *head;
+    struct ccn_sign_req **tail;
+    int n;
+    uintmax_t objects;
+    uintmax_t signatures;
+};
+
+static int signer_run(struct ccn_schedule *sched, void *clienth,
+                      struct ccn_scheduled_event *ev, int flags);
+
+struct ccn_signer *
+ccn_signer_create(struct ccn *h, struct ccn_schedule *sched)
+{
+    struct ccn_signer *s;
+
+    if (h == NULL || sched == NULL)
+        return(NULL);
+    s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return(NULL);
+    s->h = h;
+    s->sched = sched;
+    s->tail = &s->head;
+    return(s);
+}
+
+static void
+req_destroy(struct ccn_sign_req **rp)
+{
+    struct ccn_sign_req *r = *rp;
+
+    if (r == NULL)
+        return;
+    ccn_charbuf_destroy(&r->name);
+    ccn_charbuf_destroy(&r->data);
+    ccn_charbuf_destroy(&r->result);
+    ccn_charbuf_destroy(&r->sp.template_ccnb);
+    free(r);
+    *rp = NULL;
+}
+
+int
+ccn_signer_submit(struct ccn_signer *s,
+                  const struct ccn_charbuf *name,
+                  const struct ccn_signing_params *params,
+                  const void *data, size_t size,
+                  ccn_signer_action action,
+                  void *actiondata, intptr_t actionint)
+{
+    struct ccn_signing_params sp = CCN_SIGNING_PARAMS_INIT;
+    struct ccn_sign_req *r;
+    int res = 0;
+
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return(-1);
+    if (params != NULL)
+        sp = *params;
+    r->sp = sp;
+    r->sp.template_ccnb = NULL;
+    r->name = ccn_charbuf_create();
+    r->data = ccn_charbuf_create();
+    if (r->name == NULL || r->data == NULL)
+        res = -1;
+    else {
+        res |= ccn_charbuf_append_charbuf(r->name, name);
+        res |= ccn_charbuf_append(r->data, data, size);
+    }
+    if (res == 0 && sp.template_ccnb != NULL) {
+        r->sp.template_ccnb = ccn_charbuf_create();
+        if (r->sp.template_ccnb == NULL)
+            res = -1;
+        else
+            res |= ccn_charbuf_append_charbuf(r->sp.template_ccnb,
+                                              sp.template_ccnb);
+    }
+    if (res != 0) {
+        req_destroy(&r);
+        return(-1);
+    }
+    r->action = action;
+    r->actiondata = actiondata;
+    r->actionint = actionint;
+    *(s->tail) = r;
+    s->tail = &r->next;
+    s->n++;
+    if (s->ev == NULL)
+        s->ev = ccn_schedule_event(s->sched, 0, signer_run, s, 0);
+    return(0);
+}
+
+/**
+ * Tell whether two requests can share a signature.
+ *
+ * Those that use a template, or mark their own name as the final
+ * block, are signed by themselves.
+ */
+static int
+batchable(const struct ccn_sign_req *a, const struct ccn_sign_req *b)
+{
+    if (a->sp.template_ccnb != NULL || b->sp.template_ccnb != NULL)
+        return(0);
+    if (((a->sp.sp_flags | b->sp.sp_flags) & CCN_SP_FINAL_BLOCK) != 0)
+        return(0);
+    return(a->sp.sp_flags == b->sp.sp_flags &&
+           a->sp.type == b->sp.type &&
+           a->sp.freshness == b->sp.freshness &&
+           memcmp(a->sp.pubid, b->sp.pubid, sizeof(a->sp.pubid)) == 0);
+}
+
+/**
+ * Take the first request off the queue, along with those that can be
+ * signed with it.
+ * @returns the number taken.
+ */
+static int
+take_batch(struct ccn_signer *s, struct ccn_sign_req **batch)
+{
+    struct ccn_sign_req **pp;
+    struct ccn_sign_req *r;
+    int n = 0;
+
+    for (pp = &s->head; *pp != NULL && n < CCN_SIGNER_BATCH;) {
+        r = *pp;
+        if (n == 0 || batchable(batch[0], r)) {
+            *pp = r->next;
+            r->next = NULL;
+            batch[n++] = r;
+        }
+        else
+            pp = &r->next;
+    }
+    s->tail = &s->head;
+    for (r = s->head; r != NULL; r = r->next)
+        s->tail = &r->next;
+    s->n -= n;
+    return(n);
+}
+
+/**
+ * Sign a batch, one signature for all if possible.
+ */
+static void
+sign_batch(struct ccn_signer *s, struct ccn_sign_req **batch, int n)
+{
+    struct ccn_charbuf *results[CCN_SIGNER_BATCH];
+    const struct ccn_charbuf *names[CCN_SIGNER_BATCH];
+    const void *data[CCN_SIGNER_BATCH];
+    size_t sizes[CCN_SIGNER_BATCH];
+    int res = -1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        batch[i]->result = ccn_charbuf_create();
+        results[i] = batch[i]->result;
+        names[i] = batch[i]->name;
+        data[i] = batch[i]->data->buf;
+        sizes[i] = batch[i]->data->length;
+    }
+    if (n > 1) {
+        res = ccn_sign_content_batch(s->h, results, n, names,
+                                     &batch[0]->sp, data, sizes);
+        if (res >= 0)
+            s->signatures++;
+        else {
+            /* Perhaps the names differ in signing policy; try singly */
+            for (i = 0; i < n; i++)
+                results[i]->length = 0;
+        }
+    }
+    if (res < 0) {
+        for (i = 0; i < n; i++) {
+            res = ccn_sign_content(s->h, results[i], names[i],
+                                   &batch[i]->sp, data[i], sizes[i]);
+            if (res < 0)
+                ccn_charbuf_destroy(&batch[i]->result);
+            else
+                s->signatures++;
+        }
+    }
+    for (i = 0; i < n; i++)
+        if (batch[i]->result != NULL)
+            s->objects++;
+}
+
+static int
+signer_run(struct ccn_schedule *sched, void *clienth,
+           struct ccn_scheduled_event *ev, int flags)
+{
+    struct ccn_signer *s = ev->evdata;
+    struct ccn_sign_req *batch[CCN_SIGNER_BATCH];
+    struct ccn_sign_req *r;
+    int rounds;
+    int n;
+    int i;
+
+    if ((flags & CCN_SCHEDULE_CANCEL) != 0)
+        return(0);
+    for (rounds = 0; rounds < CCN_SIGNER_ROUNDS && s->head != NULL; rounds++) {
+        n = take_batch(s, batch);
+        sign_batch(s, batch, n);
+        for (i = 0; i < n; i++) {
+            r = batch[i];
+            if (r->action != NULL)
+                (r->action)(s, r->result, r->actiondata, r->actionint);
+            else if (r->result != NULL)
+                ccn_put(s->h, r->result->buf, r->result->length);
+            req_destroy(&r);
+        }
+    }
+    if (s->head != NULL)
+        return(1);
+    s->ev = NULL;
+    return(0);
+}
+
+int
+ccn_signer_pending(struct ccn_signer *s)
+{
+    return(s->n);
+}
+
+void
+ccn_signer_get_counts(struct ccn_signer *s,
+                      uintmax_t *objects, uintmax_t *signatures)
+{
+    if (objects != NULL)
+        *objects = s->objects;
+    if (signatures != NULL)
+        *signatures = s->signatures;
+}
+
+void
+ccn_signer_destroy(struct ccn_signer **sp)
+{
+    struct ccn_signer *s = *sp;
+    struct ccn_sign_req *r;
+
+    if (s == NULL)
+        return;
+    if (s->ev != NULL)
+        ccn_schedule_cancel(s->sched, s->ev);
+    s->ev = NULL;
+    while (s->head != NULL) {
+        r = s->head;
+        s->head = r->next;
+        if (r->action != NULL)
+            (r->action)(s, NULL, r->actiondata, r->actionint);
+        req_destroy(&r);
+    }
+    free(s);
+    *sp = NULL;
+}
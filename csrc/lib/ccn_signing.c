@@ -21,7 +21,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/opensslv.h>
 #include <openssl/rand.h>
+#include <openssl/sha.h>
 #include <openssl/x509.h>
 #include <ccn/merklepathasn1.h>
 #include <ccn/ccn.h>
@@ -32,7 +35,7 @@ struct ccn_sigc {
     EVP_MD_CTX context;
 };
 
-#ifdef NID_ecdsa_with_SHA256
+#if defined(NID_ecdsa_with_SHA256) && OPENSSL_VERSION_NUMBER < 0x10000000L
 static int init256(EVP_MD_CTX *ctx)
 { return SHA256_Init(ctx->md_data); }
 static int update256(EVP_MD_CTX *ctx,const void *data,size_t count)
@@ -121,7 +124,11 @@ md_from_digest_and_pkey(const char *digest, const struct ccn_pkey *pkey)
         case NID_sha256:    // supported for RSA/EC key types
             if (pkey_type == EVP_PKEY_RSA)
                 return(EVP_sha256());
-#if defined(EVP_PKEY_EC) && defined(NID_ecdsa_with_SHA256)
+#if defined(EVP_PKEY_EC) && OPENSSL_VERSION_NUMBER >= 0x10000000L
+            /* ECDSA over a P-256 key: the key picks the signature method */
+            else if (pkey_type == EVP_PKEY_EC)
+                return(EVP_sha256());
+#elif defined(EVP_PKEY_EC) && defined(NID_ecdsa_with_SHA256)
             else if (pkey_type == EVP_PKEY_EC) {
                 return(&sha256ec_md);
             } /* our own md */
@@ -275,6 +282,130 @@ int ccn_merkle_root_hash(const unsigned char *msg, size_t size,
     return (0);
 }
 
+/*
+ * Append the witness for a leaf of the tree built by ccn_merkle_sign.
+ * This is a DigestInfo with the MHT OID, wrapping the DER-encoded path:
+ * the node number and the sibling hashes, from the top down.
+ */
+static int
+ccn_merkle_witness(const unsigned char *tree, int hash_size, int node,
+                   struct ccn_charbuf *witness)
+{
+    MP_info *merkle_path_info = NULL;
+    X509_SIG *digest_info = NULL;
+    ASN1_OCTET_STRING *hash = NULL;
+    unsigned char *der = NULL;
+    unsigned char *p = NULL;
+    int der_size;
+    int depth = 0;
+    int x;
+    int res = -1;
+
+    for (x = node; x > 1; x = parent_of(x))
+        depth++;
+    merkle_path_info = MP_info_new();
+    if (merkle_path_info == NULL)
+        return(-1);
+    ASN1_INTEGER_set(merkle_path_info->node, node);
+    for (x = depth - 1; x >= 0; x--) {
+        hash = ASN1_OCTET_STRING_new();
+        ASN1_OCTET_STRING_set(hash, tree + sibling_of(node >> x) * hash_size, hash_size);
+        sk_ASN1_OCTET_STRING_push(merkle_path_info->hashes, hash);
+    }
+    der_size = i2d_MP_info(merkle_path_info, NULL);
+    if (der_size <= 0)
+        goto Bail;
+    der = calloc(1, der_size);
+    p = der;
+    i2d_MP_info(merkle_path_info, &p);
+    digest_info = X509_SIG_new();
+    ASN1_OBJECT_free(digest_info->algor->algorithm);
+    /* ...2.2 is an MHT w/ SHA256 */
+    digest_info->algor->algorithm = OBJ_txt2obj("1.2.840.113550.11.1.2.2", 1);
+    digest_info->algor->parameter = ASN1_TYPE_new();
+    ASN1_TYPE_set(digest_info->algor->parameter, V_ASN1_NULL, NULL);
+    ASN1_OCTET_STRING_set(digest_info->digest, der, der_size);
+    der_size = i2d_X509_SIG(digest_info, NULL);
+    if (der_size <= 0)
+        goto Bail;
+    p = ccn_charbuf_reserve(witness, der_size);
+    if (p == NULL || i2d_X509_SIG(digest_info, &p) != der_size)
+        goto Bail;
+    witness->length += der_size;
+    res = 0;
+Bail:
+    X509_SIG_free(digest_info);
+    MP_info_free(merkle_path_info);
+    free(der);
+    return(res);
+}
+
+/**
+ * Sign a batch of objects with one signature, over a Merkle hash tree.
+ *
+ * The leaves of the tree are the SHA-256 digests of the signed portions,
+ * parts[0] through parts[n-1] (each the encoded Name, SignedInfo and
+ * Content of one object), and only the root is signed.  The tree is kept
+ * in heap order, with the leaves at nodes n through 2n-1.
+ * The witness that lets each object be verified on its own is appended
+ * to witnesses[i].
+ * @param signature must have room for ccn_pubkey_size(priv_key) bytes.
+ * @returns 0 for success, -1 for error.
+ */
+int
+ccn_merkle_sign(int n, struct ccn_charbuf **parts,
+                struct ccn_charbuf **witnesses,
+                const char *digest, const struct ccn_pkey *priv_key,
+                struct ccn_signature *signature, size_t *size)
+{
+    const EVP_MD *md = NULL;
+    const EVP_MD *merkle_path_digest = EVP_sha256();
+    EVP_MD_CTX digest_context;
+    EVP_MD_CTX *digest_contextp = &digest_context;
+    int hash_size = EVP_MD_size(merkle_path_digest);
+    unsigned char *tree = NULL;
+    unsigned int sig_size = 0;
+    int node;
+    int i;
+    int res = 1;
+
+    if (n < 1)
+        return(-1);
+    md = md_from_digest_and_pkey(digest, priv_key);
+    if (md == NULL)
+        return(-1);
+    tree = calloc(2 * n, hash_size);
+    if (tree == NULL)
+        return(-1);
+    EVP_MD_CTX_init(digest_contextp);
+    for (i = 0; i < n && res == 1; i++) {
+        res = EVP_DigestInit_ex(digest_contextp, merkle_path_digest, NULL);
+        res &= EVP_DigestUpdate(digest_contextp, parts[i]->buf, parts[i]->length);
+        res &= EVP_DigestFinal_ex(digest_contextp, tree + (n + i) * hash_size, NULL);
+    }
+    /* the children of a node are adjacent, left then right */
+    for (node = n - 1; node >= 1 && res == 1; node--) {
+        res = EVP_DigestInit_ex(digest_contextp, merkle_path_digest, NULL);
+        res &= EVP_DigestUpdate(digest_contextp, tree + 2 * node * hash_size, 2 * hash_size);
+        res &= EVP_DigestFinal_ex(digest_contextp, tree + node * hash_size, NULL);
+    }
+    if (res == 1) {
+        res = EVP_SignInit_ex(digest_contextp, md, NULL);
+        res &= EVP_SignUpdate(digest_contextp, tree + hash_size, hash_size);
+        res &= EVP_SignFinal(digest_contextp, (unsigned char *)signature,
+                             &sig_size, (EVP_PKEY *)priv_key);
+    }
+    EVP_MD_CTX_cleanup(digest_contextp);
+    for (i = 0; i < n && res == 1; i++)
+        if (ccn_merkle_witness(tree, hash_size, n + i, witnesses[i]) < 0)
+            res = 0;
+    free(tree);
+    if (res != 1)
+        return(-1);
+    *size = sig_size;
+    return(0);
+}
+
 int ccn_verify_signature(const unsigned char *msg,
                      size_t size,
                      const struct ccn_parsed_ContentObject *co,
@@ -418,6 +549,107 @@ int ccn_verify_signature(const unsigned char *msg,
     return (res);
 }
 
+/**
+ * Tell what sort of signature a ContentObject carries.
+ * @returns CCN_SIG_DIGEST or CCN_SIG_HMAC for the signatures that need no
+ *          public key, otherwise CCN_SIG_PUBKEY.
+ */
+int
+ccn_signature_kind(const unsigned char *msg,
+                   const struct ccn_parsed_ContentObject *co)
+{
+    const unsigned char *alg = NULL;
+    size_t alg_size = 0;
+    int res;
+    
+    if (co->offset[CCN_PCO_B_DigestAlgorithm] == co->offset[CCN_PCO_E_DigestAlgorithm])
+        return(CCN_SIG_PUBKEY);
+    res = ccn_ref_tagged_string(CCN_DTAG_DigestAlgorithm, msg,
+                                co->offset[CCN_PCO_B_DigestAlgorithm],
+                                co->offset[CCN_PCO_E_DigestAlgorithm],
+                                &alg, &alg_size);
+    if (res < 0)
+        return(CCN_SIG_PUBKEY);
+    if (alg_size == strlen(CCN_SIGNING_DIGEST_ONLY_ALGORITHM) &&
+        memcmp(alg, CCN_SIGNING_DIGEST_ONLY_ALGORITHM, alg_size) == 0)
+        return(CCN_SIG_DIGEST);
+    if (alg_size == strlen(CCN_SIGNING_HMAC_SHA256_ALGORITHM) &&
+        memcmp(alg, CCN_SIGNING_HMAC_SHA256_ALGORITHM, alg_size) == 0)
+        return(CCN_SIG_HMAC);
+    return(CCN_SIG_PUBKEY);
+}
+
+/**
+ * Make a signature that needs no public key.
+ *
+ * With a NULL key, this is the SHA-256 digest of the data; otherwise it
+ * is the HMAC-SHA256 of the data under the key.
+ * @param result must have room for CCN_SYMMETRIC_SIGNATURE_SIZE bytes.
+ * @returns the size of the signature, or -1 for error.
+ */
+int
+ccn_symmetric_sign(const void *key, size_t keysize,
+                   const unsigned char *data, size_t size,
+                   unsigned char *result)
+{
+    unsigned int md_size = 0;
+    
+    if (key == NULL) {
+        SHA256(data, size, result);
+        return(SHA256_DIGEST_LENGTH);
+    }
+    if (keysize == 0 || keysize > 1024)
+        return(-1);
+    if (HMAC(EVP_sha256(), key, (int)keysize, data, size, result, &md_size) == NULL)
+        return(-1);
+    return(md_size);
+}
+
+/**
+ * Verify a digest-only or HMAC signature.
+ *
+ * The key is needed only for CCN_SIG_HMAC.  The comparison takes the
+ * same time wherever the signatures differ.
+ * @returns 1 if the signature is good, 0 if it is not, -1 for error
+ *          (including a signature of some other kind).
+ */
+int
+ccn_verify_symmetric_signature(const unsigned char *msg, size_t size,
+                               const struct ccn_parsed_ContentObject *co,
+                               const void *key, size_t keysize)
+{
+    unsigned char expected[CCN_SYMMETRIC_SIGNATURE_SIZE];
+    const unsigned char *bits = NULL;
+    size_t bits_size = 0;
+    unsigned diff = 0;
+    int kind;
+    int res;
+    int i;
+    
+    kind = ccn_signature_kind(msg, co);
+    if (kind == CCN_SIG_PUBKEY || (kind == CCN_SIG_HMAC && key == NULL))
+        return(-1);
+    if (co->offset[CCN_PCO_B_Witness] != co->offset[CCN_PCO_E_Witness])
+        return(-1);
+    res = ccn_ref_tagged_BLOB(CCN_DTAG_SignatureBits, msg,
+                              co->offset[CCN_PCO_B_SignatureBits],
+                              co->offset[CCN_PCO_E_SignatureBits],
+                              &bits, &bits_size);
+    if (res < 0)
+        return(-1);
+    res = ccn_symmetric_sign(kind == CCN_SIG_HMAC ? key : NULL, keysize,
+                             msg + co->offset[CCN_PCO_B_Name],
+                             co->offset[CCN_PCO_E_Content] - co->offset[CCN_PCO_B_Name],
+                             expected);
+    if (res < 0)
+        return(-1);
+    if (bits_size != (size_t)res)
+        return(0);
+    for (i = 0; i < res; i++)
+        diff |= bits[i] ^ expected[i];
+    return(diff == 0);
+}
+
 struct ccn_pkey *
 ccn_d2i_pubkey(const unsigned char *p, size_t size)
 {
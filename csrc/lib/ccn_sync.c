@@ -80,6 +80,7 @@ struct ccns_handle {
     struct ccn_scheduled_event *ev;
     ccns_callback callback;
     unsigned flags;
+    char *cachedir;         // directory for the node cache (may be NULL)
 };
 
 /*
@@ -548,6 +549,170 @@ static int HeartbeatAction(struct ccn_schedule *sched,
                            int flags);
 
 static int ccns_send_root_advise_interest(struct SyncRootStruct *root);
+void ccns_msg(struct ccnr_handle *h, const char *fmt, ...);
+
+/*
+ * Node cache support
+ *
+ * The cache for a slice is two files in the cache directory, named by the
+ * hex of the slice hash: <hex>.root holds the raw root hash, and
+ * <hex>.nodes holds the encodings of the nodes of that tree, back to back.
+ */
+static struct ccn_charbuf *
+cache_path(struct ccns_handle *ccns, const char *suffix)
+{
+    struct ccn_charbuf *path = ccn_charbuf_create();
+    struct ccn_charbuf *sh = ccns->root->sliceHash;
+    char *hex = SyncHexStr(sh->buf, sh->length);
+    ccn_charbuf_putf(path, "%s/%s.%s", ccns->cachedir, hex, suffix);
+    free(hex);
+    return(path);
+}
+
+static int
+read_file(const char *path, struct ccn_charbuf *dst)
+{
+    FILE *f = fopen(path, "r");
+    unsigned char buf[8192];
+    size_t n;
+    if (f == NULL)
+        return(-1);
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        ccn_charbuf_append(dst, buf, n);
+    fclose(f);
+    return(0);
+}
+
+/*
+ * Enter the cached nodes as remote nodes (and local, as for fetched nodes).
+ * Returns the cached root hash, or NULL if there is none.
+ */
+static struct ccn_charbuf *
+cache_load(struct ccns_handle *ccns)
+{
+    struct SyncRootStruct *root = ccns->root;
+    struct ccn_charbuf *path = cache_path(ccns, "root");
+    struct ccn_charbuf *rhash = ccn_charbuf_create();
+    struct ccn_charbuf *nodes = ccn_charbuf_create();
+    struct ccn_buf_decoder ds;
+    struct ccn_buf_decoder *d;
+    int count = 0;
+    if (read_file(ccn_charbuf_as_string(path), rhash) < 0 || rhash->length == 0)
+        ccn_charbuf_destroy(&rhash);
+    ccn_charbuf_destroy(&path);
+    path = cache_path(ccns, "nodes");
+    if (rhash != NULL && read_file(ccn_charbuf_as_string(path), nodes) == 0) {
+        d = ccn_buf_decoder_start(&ds, nodes->buf, nodes->length);
+        while (ccn_buf_match_dtag(d, CCN_DTAG_SyncNode)) {
+            struct SyncNodeComposite *nc = SyncAllocComposite(root->base);
+            struct SyncHashCacheEntry *ce;
+            if (SyncParseComposite(nc, d) < 0 || nc->hash == NULL) {
+                SyncFreeComposite(nc);
+                break;
+            }
+            ce = SyncHashEnter(root->ch, nc->hash->buf, nc->hash->length,
+                               SyncHashState_remote);
+            if (ce == NULL || ce->ncR != NULL) {
+                SyncFreeComposite(nc);
+                continue;
+            }
+            ce->ncR = nc;
+            SyncNodeIncRC(nc);
+            if (ce->ncL == NULL) {
+                ce->ncL = nc;
+                SyncNodeIncRC(nc);
+            }
+            count++;
+        }
+    }
+    if (root->base->debug >= CCNL_INFO)
+        ccns_msg(root->base->client_handle, "ccns cache, %d nodes loaded", count);
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&nodes);
+    return(rhash);
+}
+
+static int
+cache_write_tree(struct SyncRootStruct *root, struct SyncHashCacheEntry *ce,
+                 FILE *f)
+{
+    struct SyncNodeComposite *nc;
+    int i;
+    if (ce == NULL)
+        return(0);
+    nc = (ce->ncL != NULL) ? ce->ncL : ce->ncR;
+    if (nc == NULL)
+        return(0);
+    if (fwrite(nc->cb->buf, 1, nc->cb->length, f) != nc->cb->length)
+        return(-1);
+    for (i = 0; i < nc->refLen; i++) {
+        struct SyncNodeElem *ep = &nc->refs[i];
+        struct ccn_buf_decoder ds;
+        struct ccn_buf_decoder *d;
+        const unsigned char *xp = NULL;
+        ssize_t xs = 0;
+        if (ep->kind & SyncElemKind_leaf)
+            continue;
+        d = SyncInitDecoderFromOffset(&ds, nc, ep->start, ep->stop);
+        SyncGetHashPtr(d, &xp, &xs);
+        if (cache_write_tree(root, SyncHashLookup(root->ch, xp, xs), f) < 0)
+            return(-1);
+    }
+    return(0);
+}
+
+/*
+ * Write the current root hash, and the nodes of its tree that we have.
+ * Each file is written under a temporary name, then renamed into place.
+ */
+static int
+cache_save(struct ccns_handle *ccns)
+{
+    struct SyncRootStruct *root = ccns->root;
+    struct ccn_charbuf *hash = root->currentHash;
+    struct ccn_charbuf *path;
+    struct ccn_charbuf *temp;
+    FILE *f;
+    int res = 0;
+    if (ccns->cachedir == NULL || hash->length == 0)
+        return(0);
+    path = cache_path(ccns, "nodes");
+    temp = cache_path(ccns, "nodes.tmp");
+    f = fopen(ccn_charbuf_as_string(temp), "w");
+    if (f == NULL)
+        res = -1;
+    else {
+        res = cache_write_tree(root,
+                               SyncHashLookup(root->ch, hash->buf, hash->length),
+                               f);
+        if (fclose(f) != 0)
+            res = -1;
+        if (res == 0)
+            res = rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(path));
+    }
+    ccn_charbuf_destroy(&path);
+    ccn_charbuf_destroy(&temp);
+    if (res == 0) {
+        path = cache_path(ccns, "root");
+        temp = cache_path(ccns, "root.tmp");
+        f = fopen(ccn_charbuf_as_string(temp), "w");
+        if (f == NULL)
+            res = -1;
+        else {
+            if (fwrite(hash->buf, 1, hash->length, f) != hash->length)
+                res = -1;
+            if (fclose(f) != 0)
+                res = -1;
+            if (res == 0)
+                res = rename(ccn_charbuf_as_string(temp), ccn_charbuf_as_string(path));
+        }
+        ccn_charbuf_destroy(&path);
+        ccn_charbuf_destroy(&temp);
+    }
+    if (res < 0 && root->base->debug >= CCNL_WARNING)
+        ccns_msg(root->base->client_handle, "ccns cache, save failed");
+    return(res);
+}
 
 /**
  * Start notification of addition of names to a sync slice.
@@ -572,11 +737,32 @@ ccns_open(struct ccn *h,
           ccns_callback callback,
           struct ccn_charbuf *rhash,
           struct ccn_charbuf *pname)
+{
+    return(ccns_open_cached(h, slice, callback, rhash, pname, NULL));
+}
+
+/**
+ * Start notification of addition of names to a sync slice, keeping the
+ * sync tree nodes and the last root hash in a cache directory.
+ * @param cachedir is the directory for the cache, or NULL for none.
+ *  If rhash is NULL and the cache holds a root hash for the slice, the
+ *  enumeration starts from that root hash.
+ *  See ccns_open for the other parameters.
+ * @returns a pointer to a new sync handle, which will be freed at close.
+ */
+struct ccns_handle *
+ccns_open_cached(struct ccn *h,
+                 struct ccns_slice *slice,
+                 ccns_callback callback,
+                 struct ccn_charbuf *rhash,
+                 struct ccn_charbuf *pname,
+                 const char *cachedir)
 {
     struct ccn_schedule *schedule;
     struct ccn_gettime *timer;
     struct ccns_handle *ccns = calloc(1, sizeof(*ccns));
     struct SyncHashCacheEntry *ceL = NULL;
+    struct ccn_charbuf *chash = NULL;
     if (ccns == NULL)
         return(NULL);
     schedule = ccn_get_schedule(h);
@@ -599,6 +785,13 @@ ccns_open(struct ccn *h,
                              slice->topo, slice->prefix, NULL);
     // TODO: no filters yet
 
+    if (cachedir != NULL) {
+        ccns->cachedir = strdup(cachedir);
+        chash = cache_load(ccns);
+        if (rhash == NULL)
+            rhash = chash;
+    }
+
     // starting at given root hash -- need to sanity check rhash, check node fetch works
     // current behavior on unknown hash is to report failure.
     if (rhash != NULL) {
@@ -610,6 +803,7 @@ ccns_open(struct ccn *h,
             ccns->flags |= CCNS_FLAGS_SC;
         }
     }
+    ccn_charbuf_destroy(&chash);
 
     ccns_send_root_advise_interest(ccns->root);
     ccns->ev = ccn_schedule_event(ccns->base->sched,
@@ -637,6 +831,8 @@ void ccns_close(struct ccns_handle **ccnsp, struct ccn_charbuf *rhash, struct cc
         ccn_charbuf_reset(rhash);
         ccn_charbuf_append_charbuf(rhash, ccns->root->currentHash);
     }
+    cache_save(ccns);
+    free(ccns->cachedir);
     SyncFreeBase(&(*ccnsp)->base);
     free(*ccnsp);
     *ccnsp = NULL;
@@ -2164,6 +2360,7 @@ CompareAction(struct ccn_schedule *sched,
             if (ce->ncL != NULL)
                 SyncNodeDecRC(ce->ncL);
             ce->ncL = ce->ncR;
+            cache_save(ccns);
             // cleanup
             int64_t now = SyncCurrentTime();
             int64_t mh = SyncDeltaTime(data->lastEnter, now);
@@ -2538,6 +2735,7 @@ ccns_hwm_update(struct ccnr_handle *ccnr, ccnr_hwm hwm, ccnr_accession a)
 #include <sync/IndexSorter.c>
 #include <sync/SyncBase.c>
 #include <sync/SyncHashCache.c>
+#include <sync/SyncIBLT.c>
 #include <sync/SyncNode.c>
 #include <sync/SyncRoot.c>
 #include <sync/SyncTreeWorker.c>
@@ -4,7 +4,7 @@
  * 
  * Part of the CCNx C Library.
  *
- * Copyright (C) 2009 Palo Alto Research Center, Inc.
+ * Copyright (C) 2009, 2012 Palo Alto Research Center, Inc.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License version 2.1
@@ -17,352 +17,612 @@
  * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
  * Fifth Floor, Boston, MA 02110-1301 USA.
  */
-#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <ccn/bloom.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
+#include <ccn/traverse.h>
 #include <ccn/uri.h>
 
+/** Default bound on the number of outstanding probes */
+#define CCN_TRAVERSE_WINDOW 1024
+/** Default InterestLifetime for probes */
+#define CCN_TRAVERSE_LIFETIME_MS 1000
+/** Largest enumeration response we are willing to collect */
+#define CCN_TRAVERSE_ENUM_MAX (16 << 20)
 
-/************ Candidate API  ******/
+/** The name enumeration marker, as answered by ccnr */
+static const unsigned char enum_marker[6] = {CCN_MARKER_CONTROL, '.', 'E', '.', 'b', 'e'};
 
 /**
- * Private record of the state of traversal
+ * What is known about the children of one prefix.
+ *
+ * The children are found in order by a chain of probes, each asking
+ * for the leftmost child above low, so the exclusion never needs more
+ * than one fencepost however many children there are.  The chain ends
+ * when a probe goes unanswered.
+ *
+ * A second chain working down from the high end would not help: the
+ * library hands each answer to every pending interest that it matches,
+ * so the two chains would take each other's answers.
  */
-struct ccn_traversal {
-    int magic; /* 68955871 */
-    long *counter;
-    unsigned warn;
-    int flags;
-    int n_excl;
-    struct ccn_charbuf **excl; /* Array of n_excl items */
-    
+struct level {
+    struct ccn_charbuf *prefix; /**< ccnb Name */
+    int ncomps;                 /**< number of components in prefix */
+    struct ccn_charbuf *low;    /**< ccnb Component, or NULL */
+    int refs;
+};
+
+enum probe_kind {
+    PROBE_RANGE,    /**< the unexplored range of a level */
+    PROBE_ENUM      /**< repository name enumeration of a prefix */
 };
 
-#define EXCLUDE_LOW 1
-#define EXCLUDE_HIGH 2
-#define MUST_VERIFY 4
-#define LOCAL_SCOPE 8
-#define ALLOW_STALE 0x10
+/**
+ * One outstanding or queued interest of a traversal.
+ */
+struct probe {
+    struct ccn_closure closure;
+    struct traversal *t;
+    struct probe *next;         /**< in the queue */
+    enum probe_kind kind;
+    int root;                   /**< first probe of the traversal */
+    struct level *lv;
+    struct ccn_charbuf *body;   /**< enumeration response so far */
+    struct ccn_charbuf *segname; /**< enumeration name through version */
+    uintmax_t seg;              /**< enumeration segment wanted next */
+};
+
+/**
+ * Private record of the state of traversal
+ *
+ * Probes refer back to this, so it stays around until the last of
+ * them is gone, even if ccn_traverse has returned.
+ */
+struct traversal {
+    struct ccn_traverse_params p;
+    ccn_traverse_action action; /**< NULL once abandoned */
+    void *data;
+    struct probe *head;         /**< queue of probes not yet expressed */
+    struct probe *tail;
+    int outstanding;            /**< probes expressed and not finished */
+    int refs;
+    int enumerate;              /**< still trying name enumeration */
+    long found;
+};
 
-/* Prototypes */
-static int namecompare(const void *a, const void *b);
-static struct ccn_traversal *get_my_data(struct ccn_closure *selfp);
-static void append_Any_filter(struct ccn_charbuf *c);
-static int express_my_interest(struct ccn *h,
-                               struct ccn_closure *selfp,
-                               struct ccn_charbuf *name);
-static struct ccn_closure *split_my_excludes(struct ccn_closure *selfp);
-static enum ccn_upcall_res incoming_content(struct ccn_closure *selfp,
-                                            enum ccn_upcall_kind kind,
-                                            struct ccn_upcall_info *);
-static struct ccn_charbuf *ccn_charbuf_duplicate(struct ccn_charbuf *);
-static void answer_passive(struct ccn_charbuf *templ, int allow_stale);
-static void local_scope(struct ccn_charbuf *templ);
+static enum ccn_upcall_res probe_handler(struct ccn_closure *selfp,
+                                         enum ccn_upcall_kind kind,
+                                         struct ccn_upcall_info *info);
 
 /**
- * Comparison operator for sorting the excl list with qsort.
- * For convenience, the items in the excl array are
- * charbufs containing ccnb-encoded Names of one component each.
- * (This is not the most efficient representation.)
+ * Make the record for a level.
+ * @param comp if not NULL, is a ccnb Component to add to the prefix.
  */
-static int /* for qsort */
-namecompare(const void *a, const void *b)
+static struct level *
+level_create(const struct ccn_charbuf *prefix, int ncomps,
+             const struct ccn_charbuf *comp)
 {
-    const struct ccn_charbuf *aa = *(const struct ccn_charbuf **)a;
-    const struct ccn_charbuf *bb = *(const struct ccn_charbuf **)b;
-    int ans = ccn_compare_names(aa->buf, aa->length, bb->buf, bb->length);
-    if (ans == 0)
-        abort();
-    return (ans);
+    struct level *lv = calloc(1, sizeof(*lv));
+    
+    if (lv == NULL)
+        return(NULL);
+    lv->prefix = ccn_charbuf_create();
+    if (lv->prefix == NULL) {
+        free(lv);
+        return(NULL);
+    }
+    ccn_charbuf_append(lv->prefix, prefix->buf, prefix->length);
+    lv->ncomps = ncomps;
+    if (comp != NULL) {
+        lv->prefix->length--; /* Strip name closer */
+        ccn_charbuf_append(lv->prefix, comp->buf, comp->length);
+        ccn_charbuf_append_closer(lv->prefix); /* </Name> */
+        lv->ncomps++;
+    }
+    return(lv);
 }
 
-static struct ccn_traversal *get_my_data(struct ccn_closure *selfp)
+static void
+level_release(struct level **lvp)
 {
-    struct ccn_traversal *data = selfp->data;
-    if (data->magic != 68955871) abort();
-    return(data);
+    struct level *lv = *lvp;
+    
+    *lvp = NULL;
+    if (lv == NULL || --lv->refs > 0)
+        return;
+    ccn_charbuf_destroy(&lv->prefix);
+    ccn_charbuf_destroy(&lv->low);
+    free(lv);
 }
 
-/*
- * This upcall gets called for each piece of incoming content that
- * matches one of our interests.  We need to issue a new interest that
- * excludes another component at the current level, and perhaps also
- * and interest to start exploring the next level.  Thus if the matched
- * interest is
- *   /a/b/c exclude {d,e,f,i,j,k}
- * and we get
- *   /a/b/c/g/h
- * we would issue a new interest
- *   /a/b/c exclude {d,e,f,g,i,j,k}
- * to continue exploring the current level, plus a simple interest
- *   /a/b/c/g
- * to start exploring the next level as well.
- *
- * This does end up fetching each piece of content multiple times, once for
- * each level in the name. The repeated requests will be answered from the local
- * content store, though, and so should not generate extra network traffic.
- * There is a lot of unanswerable interest generated, though.  
- *
- * To prevent the interests from becoming too huge, we may need to split them.
- * Thus if the first new interest above were deemed too large, we could instead
- * issue the two interests
- *   /a/b/c exclude {d,e,f,g,*}
- *   /a/b/c exclude {*,g,i,j,k}
- * where * stands for a Bloom filter that excludes anything.  Note the
- * repetition of g to ensure that these two interests cover disjoint portions
- * of the hierarchy. We need to keep track of the endpoint conditions
- * as well as the excluded set in our upcall data.
- * When a split happens, we need a new closure to track it, as we do when
- * we start exploring a new level.
+/**
+ * Make a probe of a level and put it at the end of the queue.
  */
-static enum ccn_upcall_res
-incoming_content(
-    struct ccn_closure *selfp,
-    enum ccn_upcall_kind kind,
-    struct ccn_upcall_info *info)
+static struct probe *
+probe_enqueue(struct traversal *t, enum probe_kind kind, struct level *lv)
 {
-    struct ccn_charbuf *c = NULL;
-    struct ccn_charbuf *comp = NULL;
-    struct ccn_charbuf *uri = NULL;
-    const unsigned char *ccnb = NULL;
-    size_t ccnb_size = 0;
-    struct ccn_indexbuf *comps = NULL;
-    int matched_comps = 0;
-    int res;
-    int i;
-    struct ccn_traversal *data = get_my_data(selfp);
+    struct probe *p = calloc(1, sizeof(*p));
     
-    if (kind == CCN_UPCALL_FINAL) {
-        for (i = 0; i < data->n_excl; i++)
-            ccn_charbuf_destroy(&(data->excl[i]));
-        if (data->excl != NULL)
-            free(data->excl);
-        free(data);
-        free(selfp);
-        return(0);
-    }
-    if (kind == CCN_UPCALL_INTEREST_TIMED_OUT)
-        return(0);
-    if (kind == CCN_UPCALL_CONTENT_BAD)
-        return(0);
-    if (kind == CCN_UPCALL_CONTENT_UNVERIFIED) {
-        if ((data->flags & MUST_VERIFY) != 0)
-            return(CCN_UPCALL_RESULT_VERIFY);
-    }
-    if (kind != CCN_UPCALL_CONTENT && kind != CCN_UPCALL_CONTENT_UNVERIFIED) abort();
+    if (p == NULL)
+        return(NULL);
+    p->closure.p = &probe_handler;
+    p->closure.data = p;
+    p->t = t;
+    t->refs++;
+    p->kind = kind;
+    p->lv = lv;
+    lv->refs++;
+    if (t->tail == NULL)
+        t->head = p;
+    else
+        t->tail->next = p;
+    t->tail = p;
+    return(p);
+}
 
-    ccnb = info->content_ccnb;
-    ccnb_size = info->pco->offset[CCN_PCO_E];
-    comps = info->content_comps;
-    matched_comps = info->pi->prefix_comps;
-    c = ccn_charbuf_create();
-    uri = ccn_charbuf_create();
-        
-    if (matched_comps + 1 > comps->n) {
-        ccn_uri_append(c, ccnb, ccnb_size, 1);
-        fprintf(stderr, "How did this happen?  %s\n", ccn_charbuf_as_string(uri));
-        exit(1);
-    }
+static void
+probe_destroy(struct probe **pp)
+{
+    struct probe *p = *pp;
+    struct traversal *t = NULL;
     
-    data->counter[0]++; /* Tell main that something new came in */
+    if (p == NULL)
+        return;
+    t = p->t;
+    level_release(&p->lv);
+    ccn_charbuf_destroy(&p->body);
+    ccn_charbuf_destroy(&p->segname);
+    free(p);
+    *pp = NULL;
+    if (--t->refs == 0)
+        free(t);
+}
 
-    /* Recover the same prefix as before */
-    ccn_name_init(c);
-    ccn_name_append_components(c, ccnb, comps->buf[0], comps->buf[matched_comps]);
+/**
+ * Start on a newly found prefix, with name enumeration if it is in use.
+ */
+static void
+explore(struct traversal *t, const struct ccn_charbuf *prefix, int ncomps,
+        const struct ccn_charbuf *comp)
+{
+    struct level *lv = level_create(prefix, ncomps, comp);
     
-    comp = ccn_charbuf_create();
-    ccn_name_init(comp);
-    if (matched_comps + 1 == comps->n) {
-        /* Reconstruct the implicit content digest component */
-        ccn_digest_ContentObject(ccnb, info->pco);
-        ccn_name_append(comp, info->pco->digest, info->pco->digest_bytes);
-    }
-    else {
-        ccn_name_append_components(comp, ccnb,
-                                   comps->buf[matched_comps],
-                                   comps->buf[matched_comps + 1]);
-    }
-    data->excl = realloc(data->excl, (data->n_excl + 1) * sizeof(data->excl[0]));
-    data->excl[data->n_excl++] = comp;
-    comp = NULL;
-    qsort(data->excl, data->n_excl, sizeof(data->excl[0]), &namecompare);
-    res = express_my_interest(info->h, selfp, c);
-    if (res == -1) {
-        struct ccn_closure *high = split_my_excludes(selfp);
-        if (high == NULL) abort();
-        express_my_interest(info->h, selfp, c);
-        express_my_interest(info->h, high, c);
-    }
-    /* Explore the next level, if there is one. */
-    if (matched_comps + 2 < comps->n) {
-        struct ccn_traversal *newdat = NULL;
-        struct ccn_closure *cl;
-        newdat = calloc(1, sizeof(*newdat));
-        newdat->magic = 68955871;
-        newdat->warn = 1492;
-        newdat->counter = data->counter;
-        newdat->flags = data->flags & ~(EXCLUDE_LOW | EXCLUDE_HIGH);
-        newdat->n_excl = 0;
-        newdat->excl = NULL;
-        cl = calloc(1, sizeof(*cl));
-        cl->p = &incoming_content;
-        cl->data = newdat;
-        ccn_name_init(c);
-        ccn_name_append_components(c, ccnb,
-                                   comps->buf[0],
-                                   comps->buf[matched_comps + 1]);
-        express_my_interest(info->h, cl, c);
-    }
-    else {
-        res = ccn_uri_append(uri, info->content_ccnb, info->pco->offset[CCN_PCO_E], 1);
-        if (res < 0)
-            fprintf(stderr, "*** Error: ccn_traverse line %d res=%d\n", __LINE__, res);
-        else
-            printf("%s\n", ccn_charbuf_as_string(uri));
-    }
-    ccn_charbuf_destroy(&c);
-    ccn_charbuf_destroy(&uri);
-    return(0);
+    if (lv == NULL)
+        return;
+    lv->refs++;
+    probe_enqueue(t, t->enumerate ? PROBE_ENUM : PROBE_RANGE, lv);
+    level_release(&lv);
 }
 
-/*
- * Construct and send a new interest that uses the exclusion list.
- * Return -1 if not sent because of packet size, 0 for success.
+/**
+ * Compare two ccnb Components in the canonical order.
+ *
+ * Shorter components come first, then the values are compared as bytes.
  */
 static int
-express_my_interest(struct ccn *h,
-                    struct ccn_closure *selfp,
-                    struct ccn_charbuf *name)
+compcompare(const struct ccn_charbuf *a, const struct ccn_charbuf *b)
 {
-    int ans;
-    struct ccn_charbuf *templ = NULL;
-    int i;
-    struct ccn_traversal *data = get_my_data(selfp);
+    const unsigned char *av = NULL;
+    const unsigned char *bv = NULL;
+    size_t as = 0;
+    size_t bs = 0;
+    
+    ccn_ref_tagged_BLOB(CCN_DTAG_Component, a->buf, 0, a->length, &av, &as);
+    ccn_ref_tagged_BLOB(CCN_DTAG_Component, b->buf, 0, b->length, &bv, &bs);
+    if (as != bs)
+        return(as < bs ? -1 : 1);
+    return(memcmp(av, bv, as));
+}
 
-    templ = ccn_charbuf_create();
+/**
+ * Append an Any filter, useful for excluding
+ * everything between two 'fenceposts' in an Exclude construct.
+ */
+static void
+append_Any_filter(struct ccn_charbuf *c)
+{
+    ccn_charbuf_append_tt(c, CCN_DTAG_Any, CCN_DTAG);
+    ccn_charbuf_append_closer(c);
+}
+
+/**
+ * Construct the interest template for a probe.
+ */
+static struct ccn_charbuf *
+probe_templ(struct traversal *t, struct probe *p)
+{
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    struct level *lv = p->lv;
+    unsigned char buf[3];
+    uintmax_t lifetime;
+    int aok;
+    int i;
+    
     ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
     ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
     ccn_charbuf_append_closer(templ); /* </Name> */
-    if (data->n_excl != 0) {
-        ccn_charbuf_append_tt(templ, CCN_DTAG_Exclude, CCN_DTAG);
-        if ((data->flags & EXCLUDE_LOW) != 0)
+    if (p->kind == PROBE_RANGE) {
+        if (lv->low != NULL) {
+            ccn_charbuf_append_tt(templ, CCN_DTAG_Exclude, CCN_DTAG);
             append_Any_filter(templ);
-        for (i = 0; i < data->n_excl; i++) {
-            struct ccn_charbuf *comp = data->excl[i];
-            if (comp->length < 4) abort();
-            ccn_charbuf_append(templ, comp->buf + 1, comp->length - 2);
+            ccn_charbuf_append(templ, lv->low->buf, lv->low->length);
+            ccn_charbuf_append_closer(templ); /* </Exclude> */
         }
-        if ((data->flags & EXCLUDE_HIGH) != 0)
-            append_Any_filter(templ);
-        ccn_charbuf_append_closer(templ); /* </Exclude> */
+        /* Do not generate new content */
+        aok = CCN_AOK_CS;
+        if ((t->p.flags & CCN_TRAVERSE_ALLOW_STALE) != 0)
+            aok |= CCN_AOK_STALE;
+        ccnb_tagged_putf(templ, CCN_DTAG_AnswerOriginKind, "%d", aok);
     }
-    answer_passive(templ, (data->flags & ALLOW_STALE) != 0);
-    if ((data->flags & LOCAL_SCOPE) != 0)
-        local_scope(templ);
+    if (t->p.scope >= 0)
+        ccnb_tagged_putf(templ, CCN_DTAG_Scope, "%d", t->p.scope);
+    /* InterestLifetime is in units of 1/4096 second */
+    lifetime = (uintmax_t)t->p.lifetime_ms * 4096 / 1000;
+    if (lifetime >= (1 << 24))
+        lifetime = (1 << 24) - 1;
+    for (i = sizeof(buf) - 1; i >= 0; i--, lifetime >>= 8)
+        buf[i] = lifetime & 0xff;
+    ccnb_append_tagged_blob(templ, CCN_DTAG_InterestLifetime, buf, sizeof(buf));
     ccn_charbuf_append_closer(templ); /* </Interest> */
-    if (templ->length + name->length > data->warn + 2) {
-        fprintf(stderr, "*** Interest packet is %d bytes\n", (int)templ->length);
-        data->warn = data->warn * 8 / 5;
+    return(templ);
+}
+
+/**
+ * Express the interest for a probe.
+ * @returns 0, or -1 if it could not be sent.
+ */
+static int
+probe_express(struct ccn *h, struct probe *p)
+{
+    struct ccn_charbuf *templ = probe_templ(p->t, p);
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    int res;
+    
+    if (p->kind == PROBE_RANGE)
+        ccn_charbuf_append_charbuf(name, p->lv->prefix);
+    else if (p->segname == NULL) {
+        ccn_charbuf_append_charbuf(name, p->lv->prefix);
+        ccn_name_append(name, enum_marker, sizeof(enum_marker));
     }
-    if (templ->length + name->length > 1450 && data->n_excl > 3)
-        ans = -1;
     else {
-        ccn_express_interest(h, name, selfp, templ);
-        ans = 0;
+        ccn_charbuf_append_charbuf(name, p->segname);
+        ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, p->seg);
     }
+    res = ccn_express_interest(h, name, &p->closure, templ);
+    ccn_charbuf_destroy(&name);
     ccn_charbuf_destroy(&templ);
-    return(ans);
+    return(res < 0 ? -1 : 0);
 }
 
-/*
- * Build a new closure to handle the high half of the excludes, and modify the
- * old closure to handle the low half.
+/**
+ * Express queued probes, up to the bound on the frontier.
+ *
+ * Stops the run once everything is done.
  */
-static struct ccn_closure *
-split_my_excludes(struct ccn_closure *selfp)
+static void
+traversal_fill(struct ccn *h, struct traversal *t)
 {
-    int i;
-    int m;
-    struct ccn_traversal *newdat = NULL;
-    struct ccn_closure *cl;
-    struct ccn_traversal *data = get_my_data(selfp);
+    struct probe *p = NULL;
     
-    if (data->n_excl < 3)
-        return NULL;
-    m = data->n_excl / 2;
-    newdat = calloc(1, sizeof(*newdat));
-    newdat->magic = 68955871;
-    newdat->warn = 1492;
-    newdat->counter = data->counter;
-    newdat->n_excl = data->n_excl - m;
-    newdat->excl = calloc(newdat->n_excl, sizeof(newdat->excl[0]));
-    if (newdat->excl == NULL) {
-        free(newdat);
-        return(NULL);
-    }
-    newdat->excl[0] = ccn_charbuf_duplicate(data->excl[m]);
-    newdat->flags = data->flags | EXCLUDE_LOW;
-    for (i = 1; i < newdat->n_excl; i++) {
-        newdat->excl[i] = data->excl[m + i];
-        data->excl[m + i] = NULL;
+    while (t->head != NULL && t->outstanding < t->p.max_outstanding) {
+        p = t->head;
+        t->head = p->next;
+        if (t->head == NULL)
+            t->tail = NULL;
+        p->next = NULL;
+        if (probe_express(h, p) < 0)
+            probe_destroy(&p);
+        else
+            t->outstanding++;
     }
-    data->n_excl = m + 1;
-    data->flags |= EXCLUDE_HIGH;
-    cl = calloc(1, sizeof(*cl));
-    cl->p = &incoming_content;
-    cl->data = newdat;
-    return(cl);
+    if (t->head == NULL && t->outstanding == 0)
+        ccn_set_run_timeout(h, 0);
 }
 
 /**
- * Append an Any filter, useful for excluding
- * everything between two 'fenceposts' in an Exclude construct.
+ * Enumeration did not work for this prefix, so probe it instead.
+ *
+ * If the very first one fails, there is no repository to ask.
  */
 static void
-append_Any_filter(struct ccn_charbuf *c)
+enum_fallback(struct traversal *t, struct probe *p)
 {
-    ccn_charbuf_append_tt(c, CCN_DTAG_Any, CCN_DTAG);
-    ccn_charbuf_append_closer(c);
+    if (p->root)
+        t->enumerate = 0;
+    probe_enqueue(t, PROBE_RANGE, p->lv);
 }
 
-static struct ccn_charbuf *
-ccn_charbuf_duplicate(struct ccn_charbuf *c)
+/**
+ * Explore the children named in a complete enumeration response.
+ * @returns the number of children, or -1 if the response is unusable.
+ */
+static int
+enum_parse(struct traversal *t, struct probe *p)
 {
-    struct ccn_charbuf *ans = ccn_charbuf_create();
-    ccn_charbuf_append(ans, c->buf, c->length);
-    return(ans);
+    struct ccn_buf_decoder decoder;
+    struct ccn_buf_decoder *d = NULL;
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_charbuf *comp = ccn_charbuf_create();
+    int n = 0;
+    
+    d = ccn_buf_decoder_start(&decoder, p->body->buf, p->body->length);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_Collection)) {
+        ccn_buf_advance(d);
+        while (ccn_buf_match_dtag(d, CCN_DTAG_Link)) {
+            ccn_buf_advance(d);
+            if (ccn_parse_Name(d, comps) < 1)
+                break;
+            ccn_buf_check_close(d); /* </Link> */
+            if (d->decoder.state < 0)
+                break;
+            comp->length = 0;
+            ccn_charbuf_append(comp, p->body->buf + comps->buf[0],
+                               comps->buf[1] - comps->buf[0]);
+            explore(t, p->lv->prefix, p->lv->ncomps, comp);
+            n++;
+        }
+        ccn_buf_check_close(d); /* </Collection> */
+    }
+    else
+        d->decoder.state = -__LINE__;
+    ccn_indexbuf_destroy(&comps);
+    ccn_charbuf_destroy(&comp);
+    if (d->decoder.state < 0 || d->decoder.index != p->body->length)
+        return(-1);
+    return(n);
 }
 
-/*
- * Append AnswerOriginKind element to partially constructed Interest,
- * requesting to not generate new content.
+/**
+ * Collect a segment of an enumeration response.
+ *
+ * The answer is named prefix/%C1.E.be/<repo key>/<version>/<segment>.
+ * A repository that holds only content named by the prefix itself
+ * answers with no children, so that also calls for probing.
+ * @returns 0 if the next segment has been asked for, 1 if the probe
+ *        is finished.
  */
-static void
-answer_passive(struct ccn_charbuf *templ, int allow_stale)
+static int
+enum_content(struct ccn_upcall_info *info, struct probe *p)
 {
-    int aok = CCN_AOK_CS;
-    if (allow_stale)
-        aok |= CCN_AOK_STALE;
-    ccnb_tagged_putf(templ, CCN_DTAG_AnswerOriginKind, "%d", aok);
+    struct traversal *t = p->t;
+    struct ccn_indexbuf *comps = info->content_comps;
+    const unsigned char *value = NULL;
+    size_t size = 0;
+    int k = p->lv->ncomps;
+    int res;
+    
+    if (comps->n < k + 5)
+        goto Fallback;
+    if (p->segname == NULL) {
+        p->segname = ccn_charbuf_create();
+        ccn_name_init(p->segname);
+        ccn_name_append_components(p->segname, info->content_ccnb,
+                                   comps->buf[0], comps->buf[k + 3]);
+        p->body = ccn_charbuf_create();
+    }
+    res = ccn_content_get_value(info->content_ccnb,
+                                info->pco->offset[CCN_PCO_E], info->pco,
+                                &value, &size);
+    if (res < 0 || p->body->length + size > CCN_TRAVERSE_ENUM_MAX)
+        goto Fallback;
+    ccn_charbuf_append(p->body, value, size);
+    if (ccn_is_final_block(info)) {
+        res = enum_parse(t, p);
+        if (res <= 0)
+            goto Fallback;
+        return(1);
+    }
+    p->seg++;
+    if (probe_express(info->h, p) == 0)
+        return(0);
+Fallback:
+    enum_fallback(t, p);
+    return(1);
 }
 
-/*
- * Append Scope=0 to partially constructed Interest, meaning
- * to address only the local ccnd.
+/**
+ * Handle the answer to a range probe.
+ *
+ * If the level for /a/b/c has been explored up to d, the probe is
+ *   /a/b/c exclude {<=d}
+ * and if it brings back
+ *   /a/b/c/g/h
+ * then the probe goes out again as
+ *   /a/b/c exclude {<=g}
+ * and a new level /a/b/c/g is queued, so that it is explored at the
+ * same time.  An answer that is not above d is stale, and is ignored.
+ *
+ * This does end up fetching each piece of content multiple times, once for
+ * each level in the name. The repeated requests will be answered from the local
+ * content store, though, and so should not generate extra network traffic.
+ * @returns 0 if the probe has been expressed again, 1 if it is finished.
  */
+static int
+range_content(struct ccn_upcall_info *info, enum ccn_upcall_kind kind,
+              struct probe *p)
+{
+    struct traversal *t = p->t;
+    struct level *lv = p->lv;
+    struct ccn_indexbuf *comps = info->content_comps;
+    const unsigned char *ccnb = info->content_ccnb;
+    struct ccn_charbuf *comp = NULL;
+    struct ccn_charbuf *marker = NULL;
+    int k = lv->ncomps;
+    int enumeration = 0;
+    
+    if (comps->n < k + 1)
+        return(1);
+    comp = ccn_charbuf_create();
+    if (comps->n == k + 1) {
+        /* Reconstruct the implicit content digest component */
+        ccn_digest_ContentObject(ccnb, info->pco);
+        ccnb_append_tagged_blob(comp, CCN_DTAG_Component,
+                                info->pco->digest, info->pco->digest_bytes);
+    }
+    else {
+        ccn_charbuf_append(comp, ccnb + comps->buf[k],
+                           comps->buf[k + 1] - comps->buf[k]);
+        /* Responses to name enumeration are not part of the namespace */
+        marker = ccn_charbuf_create();
+        ccnb_append_tagged_blob(marker, CCN_DTAG_Component,
+                                enum_marker, sizeof(enum_marker));
+        enumeration = (comp->length == marker->length &&
+                       memcmp(comp->buf, marker->buf, marker->length) == 0);
+        ccn_charbuf_destroy(&marker);
+    }
+    if (lv->low != NULL && compcompare(comp, lv->low) <= 0) {
+        ccn_charbuf_destroy(&comp);
+        return(probe_express(info->h, p) < 0);
+    }
+    if (!enumeration) {
+        if (comps->n > k + 2 && (t->p.flags & CCN_TRAVERSE_ONE_LEVEL) == 0)
+            explore(t, lv->prefix, k, comp);
+        else {
+            t->found++;
+            (t->action)(info, kind, k, t->data);
+        }
+    }
+    ccn_charbuf_destroy(&lv->low);
+    lv->low = comp;
+    comp = NULL;
+    return(probe_express(info->h, p) < 0);
+}
+
+static enum ccn_upcall_res
+probe_handler(struct ccn_closure *selfp,
+              enum ccn_upcall_kind kind,
+              struct ccn_upcall_info *info)
+{
+    struct probe *p = selfp->data;
+    struct traversal *t = p->t;
+    int res;
+    
+    switch (kind) {
+        case CCN_UPCALL_FINAL:
+            probe_destroy(&p);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_INTEREST_TIMED_OUT:
+            if (t->action == NULL)
+                return(CCN_UPCALL_RESULT_OK);
+            /* Nothing left in the range, or no repository */
+            if (p->kind == PROBE_ENUM)
+                enum_fallback(t, p);
+            t->outstanding--;
+            traversal_fill(info->h, t);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+            if ((t->p.flags & CCN_TRAVERSE_MUST_VERIFY) != 0)
+                return(CCN_UPCALL_RESULT_VERIFY);
+            break;
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+            if ((t->p.flags & CCN_TRAVERSE_MUST_VERIFY) != 0)
+                return(CCN_UPCALL_RESULT_FETCHKEY);
+            break;
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_RAW:
+        case CCN_UPCALL_CONTENT_BAD:
+            break;
+        default:
+            return(CCN_UPCALL_RESULT_OK);
+    }
+    if (t->action == NULL)
+        return(CCN_UPCALL_RESULT_OK);
+    if (p->kind == PROBE_ENUM)
+        res = enum_content(info, p);
+    else
+        res = range_content(info, kind, p);
+    if (res != 0)
+        t->outstanding--;
+    /* Send out whatever this answer has added to the queue */
+    traversal_fill(info->h, t);
+    return(CCN_UPCALL_RESULT_OK);
+}
+
+/**
+ * Traverse the names under prefix, calling action for what is found.
+ *
+ * Blocks, running the handle, until there is nothing left to probe.
+ * @param h is the ccn handle; must not be called from an upcall.
+ * @param prefix is the ccnb-encoded Name to start from.
+ * @param params may be NULL for the defaults.
+ * @param action is called for each ContentObject found.
+ * @param data is passed to action.
+ * @returns the number of objects reported, or -1 for an error.
+ */
+long
+ccn_traverse(struct ccn *h, const struct ccn_charbuf *prefix,
+             const struct ccn_traverse_params *params,
+             ccn_traverse_action action, void *data)
+{
+    struct traversal *t = NULL;
+    struct level *lv = NULL;
+    struct probe *p = NULL;
+    long ans = -1;
+    int ncomps;
+    int res = 0;
+    
+    ncomps = ccn_name_split(prefix, NULL);
+    if (h == NULL || action == NULL || ncomps < 0)
+        return(-1);
+    t = calloc(1, sizeof(*t));
+    if (t == NULL)
+        return(-1);
+    t->refs = 1;
+    t->p.scope = -1;
+    if (params != NULL)
+        t->p = *params;
+    if (t->p.max_outstanding <= 0)
+        t->p.max_outstanding = CCN_TRAVERSE_WINDOW;
+    if (t->p.lifetime_ms <= 0)
+        t->p.lifetime_ms = CCN_TRAVERSE_LIFETIME_MS;
+    t->action = action;
+    t->data = data;
+    t->enumerate = ((t->p.flags & CCN_TRAVERSE_ENUMERATE) != 0 &&
+                    (t->p.flags & CCN_TRAVERSE_ONE_LEVEL) == 0);
+    lv = level_create(prefix, ncomps, NULL);
+    if (lv == NULL)
+        goto Finish;
+    lv->refs++;
+    p = probe_enqueue(t, t->enumerate ? PROBE_ENUM : PROBE_RANGE, lv);
+    if (p != NULL)
+        p->root = 1;
+    level_release(&lv);
+    traversal_fill(h, t);
+    while (res >= 0 && (t->head != NULL || t->outstanding > 0))
+        res = ccn_run(h, 1000);
+    if (res >= 0)
+        ans = t->found;
+Finish:
+    /* Anything still outstanding is cut loose */
+    t->action = NULL;
+    while ((p = t->head) != NULL) {
+        t->head = p->next;
+        probe_destroy(&p);
+    }
+    t->tail = NULL;
+    if (--t->refs == 0)
+        free(t);
+    return(ans);
+}
+
 static void
-local_scope(struct ccn_charbuf *templ)
+print_name(struct ccn_upcall_info *info, enum ccn_upcall_kind kind,
+           int level, void *data)
 {
-    ccn_charbuf_append_tt(templ, CCN_DTAG_Scope, CCN_DTAG);
-    ccn_charbuf_append_tt(templ, 1, CCN_UDATA);
-    ccn_charbuf_append(templ, "0", 1);
-    ccn_charbuf_append_closer(templ); /* </Scope> */
+    struct ccn_charbuf *uri = ccn_charbuf_create();
+    int res;
+    
+    res = ccn_uri_append(uri, info->content_ccnb,
+                         info->pco->offset[CCN_PCO_E], 1);
+    if (res < 0)
+        fprintf(stderr, "*** Error: ccn_traverse line %d res=%d\n", __LINE__, res);
+    else
+        printf("%s\n", ccn_charbuf_as_string(uri));
+    ccn_charbuf_destroy(&uri);
 }
 
 /**
@@ -372,37 +632,12 @@ local_scope(struct ccn_charbuf *templ)
 void
 ccn_dump_names(struct ccn *h, struct ccn_charbuf *name_prefix, int local_scope, int allow_stale)
 {
-    long *counter;
-    int i;
-    long n;
-    int res;
-    struct ccn_traversal *data = NULL;
-    struct ccn_closure *cl = NULL;
+    struct ccn_traverse_params params = {0};
     
-    counter = calloc(1, sizeof(*counter));
-    data = calloc(1, sizeof(*data));
-    data->magic = 68955871;
-    data->warn = 1492;
-    data->flags = 0;
-    data->counter = counter;
-    if (local_scope)
-        data->flags |= LOCAL_SCOPE;
+    params.scope = local_scope ? 0 : -1;
     if (allow_stale)
-        data->flags |= ALLOW_STALE;
-    
-    cl = calloc(1, sizeof(*cl));
-    cl->p = &incoming_content;
-    cl->data = data;
-    
-    express_my_interest(h, cl, name_prefix);
-    cl = NULL;
-    data = NULL;
-    for (i = 0;; i++) {
-        n = *counter;
-        res = ccn_run(h, 1000); /* stop if we run dry for 1 sec */
-        fflush(stdout);
-        if (*counter == n || res < 0)
-            break;
-    }
+        params.flags |= CCN_TRAVERSE_ALLOW_STALE;
+    ccn_traverse(h, name_prefix, &params, &print_name, NULL);
+    fflush(stdout);
     exit(0);
 }
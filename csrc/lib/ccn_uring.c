@@ -0,0 +1,606 @@
+/**
+ * @file ccn_uring.c
+ * @brief A thin layer over the Linux io_uring interface.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <ccn/uring.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_FEAT_EXT_ARG)
+#define CCN_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#if defined(CCN_HAVE_URING)
+
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define BGID 0  /**< our only provided buffer group */
+
+/*
+ * The kernel shares the ring indices with us; these give the
+ * ordering that its side of the protocol expects.
+ */
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+struct ccn_uring {
+    int fd;
+    unsigned features;
+    /* submission ring */
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_khead;
+    unsigned *sq_ktail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_tail;               /**< our unpublished tail */
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    /* completion ring */
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_khead;
+    unsigned *cq_ktail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    /* provided buffers */
+    struct io_uring_buf_ring *br;
+    size_t br_size;
+    unsigned nbufs;
+    size_t bufsize;
+    unsigned char *bufs;
+};
+
+static int
+sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+          void *arg, size_t argsz)
+{
+    return(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, arg, argsz));
+}
+
+static int
+sys_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+/**
+ * Map the shared rings once the kernel has told us their layout.
+ */
+static int
+map_rings(struct ccn_uring *r, struct io_uring_params *p)
+{
+    unsigned char *sq;
+    unsigned char *cq;
+    unsigned *array;
+    unsigned i;
+
+    r->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if ((p->features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = 0;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        r->sq_ring = NULL;
+        return(-1);
+    }
+    r->cq_ring = r->sq_ring;
+    if (r->cq_ring_size != 0) {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            r->cq_ring = NULL;
+            return(-1);
+        }
+    }
+    r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        return(-1);
+    }
+    sq = r->sq_ring;
+    r->sq_khead = (unsigned *)(sq + p->sq_off.head);
+    r->sq_ktail = (unsigned *)(sq + p->sq_off.tail);
+    r->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    r->sq_entries = p->sq_entries;
+    r->sq_tail = *r->sq_ktail;
+    /* Each slot of the indirection array always names its own sqe */
+    array = (unsigned *)(sq + p->sq_off.array);
+    for (i = 0; i < p->sq_entries; i++)
+        array[i] = i;
+    cq = r->cq_ring;
+    r->cq_khead = (unsigned *)(cq + p->cq_off.head);
+    r->cq_ktail = (unsigned *)(cq + p->cq_off.tail);
+    r->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return(0);
+}
+
+/**
+ * Allocate the receive buffers and register them as a buffer ring.
+ */
+static int
+setup_bufs(struct ccn_uring *r, unsigned nbufs, size_t bufsize)
+{
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    if (nbufs == 0)
+        return(0);
+    if ((nbufs & (nbufs - 1)) != 0 || nbufs > 32768) {
+        errno = EINVAL;
+        return(-1);
+    }
+    r->br_size = nbufs * sizeof(struct io_uring_buf);
+    r->br = mmap(NULL, r->br_size, PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (r->br == MAP_FAILED) {
+        r->br = NULL;
+        return(-1);
+    }
+    r->bufs = malloc(nbufs * bufsize);
+    if (r->bufs == NULL)
+        return(-1);
+    r->nbufs = nbufs;
+    r->bufsize = bufsize;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)r->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = BGID;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return(-1);
+    for (i = 0; i < nbufs; i++) {
+        r->br->bufs[i].addr = (uintptr_t)(r->bufs + i * bufsize);
+        r->br->bufs[i].len = bufsize;
+        r->br->bufs[i].bid = i;
+    }
+    STORE_RELEASE(&r->br->tail, (unsigned short)nbufs);
+    return(0);
+}
+
+struct ccn_uring *
+ccn_uring_create(unsigned entries, unsigned nbufs, size_t bufsize)
+{
+    struct ccn_uring *r;
+    struct io_uring_params p;
+
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+        return(NULL);
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 8 * entries;
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0) {
+        free(r);
+        return(NULL);
+    }
+    fcntl(r->fd, F_SETFD, FD_CLOEXEC);
+    r->features = p.features;
+    if ((p.features & IORING_FEAT_EXT_ARG) == 0 ||
+        (p.features & IORING_FEAT_NODROP) == 0) {
+        errno = ENOSYS;
+        goto Bail;
+    }
+    if (map_rings(r, &p) < 0)
+        goto Bail;
+    if (setup_bufs(r, nbufs, bufsize) < 0)
+        goto Bail;
+    return(r);
+Bail:
+    ccn_uring_destroy(&r);
+    return(NULL);
+}
+
+void
+ccn_uring_destroy(struct ccn_uring **pr)
+{
+    struct ccn_uring *r = *pr;
+    int save = errno;
+
+    if (r == NULL)
+        return;
+    if (r->fd >= 0)
+        close(r->fd);
+    if (r->br != NULL)
+        munmap(r->br, r->br_size);
+    free(r->bufs);
+    if (r->sqes != NULL)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring != NULL && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring != NULL)
+        munmap(r->sq_ring, r->sq_ring_size);
+    free(r);
+    *pr = NULL;
+    errno = save;
+}
+
+int
+ccn_uring_fd(struct ccn_uring *r)
+{
+    return(r->fd);
+}
+
+/**
+ * Get a cleared submission entry, pushing out what we have if the
+ * ring is full.
+ */
+static struct io_uring_sqe *
+get_sqe(struct ccn_uring *r)
+{
+    struct io_uring_sqe *sqe;
+
+    if (r->sq_tail - LOAD_ACQUIRE(r->sq_khead) >= r->sq_entries) {
+        if (ccn_uring_submit(r) < 0 ||
+            r->sq_tail - LOAD_ACQUIRE(r->sq_khead) >= r->sq_entries)
+            return(NULL);
+    }
+    sqe = &r->sqes[r->sq_tail & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_tail++;
+    return(sqe);
+}
+
+int
+ccn_uring_recv_multishot(struct ccn_uring *r, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+
+    if (sqe == NULL)
+        return(-1);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BGID;
+    sqe->user_data = user_data;
+    return(0);
+}
+
+int
+ccn_uring_recvmsg_multishot(struct ccn_uring *r, int fd,
+                            struct msghdr *msg, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+
+    if (sqe == NULL)
+        return(-1);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BGID;
+    sqe->user_data = user_data;
+    return(0);
+}
+
+int
+ccn_uring_poll(struct ccn_uring *r, int fd, unsigned pollevents,
+               int multishot, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+
+    if (sqe == NULL)
+        return(-1);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    pollevents = (pollevents << 16) | (pollevents >> 16);
+#endif
+    sqe->poll32_events = pollevents;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = user_data;
+    return(0);
+}
+
+int
+ccn_uring_read(struct ccn_uring *r, int fd, void *buf, size_t len,
+               off_t offset, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+
+    if (sqe == NULL)
+        return(-1);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return(0);
+}
+
+int
+ccn_uring_cancel(struct ccn_uring *r, uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = get_sqe(r);
+
+    if (sqe == NULL)
+        return(-1);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+    return(0);
+}
+
+/**
+ * Publish our submissions and enter the kernel.
+ */
+static int
+enter(struct ccn_uring *r, unsigned min_complete, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit;
+    unsigned flags = 0;
+    int res;
+
+    STORE_RELEASE(r->sq_ktail, r->sq_tail);
+    to_submit = r->sq_tail - LOAD_ACQUIRE(r->sq_khead);
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+            arg.ts = (uintptr_t)&ts;
+        }
+        res = sys_enter(r->fd, to_submit, min_complete, flags,
+                        &arg, sizeof(arg));
+    }
+    else if (to_submit == 0)
+        return(0);
+    else
+        res = sys_enter(r->fd, to_submit, 0, 0, NULL, 0);
+    if (res < 0 && (errno == ETIME || errno == EBUSY))
+        res = 0;
+    return(res);
+}
+
+int
+ccn_uring_submit(struct ccn_uring *r)
+{
+    return(enter(r, 0, 0));
+}
+
+int
+ccn_uring_wait(struct ccn_uring *r, int timeout_ms)
+{
+    unsigned ready;
+
+    ready = LOAD_ACQUIRE(r->cq_ktail) - *r->cq_khead;
+    if (ready == 0 && timeout_ms != 0) {
+        if (enter(r, 1, timeout_ms) < 0)
+            return(-1);
+        ready = LOAD_ACQUIRE(r->cq_ktail) - *r->cq_khead;
+    }
+    else {
+        if (enter(r, 0, 0) < 0)
+            return(-1);
+        ready = LOAD_ACQUIRE(r->cq_ktail) - *r->cq_khead;
+    }
+    return(ready);
+}
+
+int
+ccn_uring_reap(struct ccn_uring *r, struct ccn_uring_cqe *out, int max)
+{
+    unsigned head = *r->cq_khead;
+    unsigned tail = LOAD_ACQUIRE(r->cq_ktail);
+    struct io_uring_cqe *cqe;
+    int n;
+
+    for (n = 0; n < max && head != tail; n++, head++) {
+        cqe = &r->cqes[head & r->cq_mask];
+        out[n].user_data = cqe->user_data;
+        out[n].res = cqe->res;
+        out[n].flags = 0;
+        if ((cqe->flags & IORING_CQE_F_MORE) != 0)
+            out[n].flags |= CCN_URING_F_MORE;
+        out[n].bid = -1;
+        if ((cqe->flags & IORING_CQE_F_BUFFER) != 0)
+            out[n].bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    }
+    STORE_RELEASE(r->cq_khead, head);
+    return(n);
+}
+
+unsigned char *
+ccn_uring_buf(struct ccn_uring *r, int bid)
+{
+    if (bid < 0 || (unsigned)bid >= r->nbufs)
+        return(NULL);
+    return(r->bufs + bid * r->bufsize);
+}
+
+void
+ccn_uring_buf_recycle(struct ccn_uring *r, int bid)
+{
+    unsigned short tail;
+    struct io_uring_buf *b;
+
+    if (bid < 0 || (unsigned)bid >= r->nbufs)
+        return;
+    tail = r->br->tail;
+    b = &r->br->bufs[tail & (r->nbufs - 1)];
+    b->addr = (uintptr_t)(r->bufs + bid * r->bufsize);
+    b->len = r->bufsize;
+    b->bid = bid;
+    STORE_RELEASE(&r->br->tail, (unsigned short)(tail + 1));
+}
+
+ssize_t
+ccn_uring_recvmsg_parse(struct ccn_uring *r, int bid, int res,
+                        const struct msghdr *msg,
+                        unsigned char **payload,
+                        struct sockaddr **addr, socklen_t *addrlen,
+                        int *truncated)
+{
+    struct io_uring_recvmsg_out *o;
+    unsigned char *buf = ccn_uring_buf(r, bid);
+    size_t hdr;
+    size_t avail;
+
+    hdr = sizeof(*o) + msg->msg_namelen + msg->msg_controllen;
+    if (buf == NULL || res < 0 || (size_t)res < hdr)
+        return(-1);
+    o = (struct io_uring_recvmsg_out *)buf;
+    *addr = (struct sockaddr *)(buf + sizeof(*o));
+    *addrlen = o->namelen;
+    if (*addrlen > msg->msg_namelen)
+        *addrlen = msg->msg_namelen;
+    *payload = buf + hdr;
+    avail = res - hdr;
+    *truncated = ((o->flags & MSG_TRUNC) != 0 || o->payloadlen > avail);
+    if (o->payloadlen < avail)
+        avail = o->payloadlen;
+    return(avail);
+}
+
+#else
+
+/*
+ * No io_uring here; creation fails and nothing else can be reached.
+ */
+struct ccn_uring *
+ccn_uring_create(unsigned entries, unsigned nbufs, size_t bufsize)
+{
+    errno = ENOSYS;
+    return(NULL);
+}
+
+void
+ccn_uring_destroy(struct ccn_uring **pr)
+{
+    *pr = NULL;
+}
+
+int
+ccn_uring_fd(struct ccn_uring *r)
+{
+    return(-1);
+}
+
+int
+ccn_uring_recv_multishot(struct ccn_uring *r, int fd, uint64_t user_data)
+{
+    return(-1);
+}
+
+int
+ccn_uring_recvmsg_multishot(struct ccn_uring *r, int fd,
+                            struct msghdr *msg, uint64_t user_data)
+{
+    return(-1);
+}
+
+int
+ccn_uring_poll(struct ccn_uring *r, int fd, unsigned pollevents,
+               int multishot, uint64_t user_data)
+{
+    return(-1);
+}
+
+int
+ccn_uring_read(struct ccn_uring *r, int fd, void *buf, size_t len,
+               off_t offset, uint64_t user_data)
+{
+    return(-1);
+}
+
+int
+ccn_uring_cancel(struct ccn_uring *r, uint64_t target, uint64_t user_data)
+{
+    return(-1);
+}
+
+int
+ccn_uring_submit(struct ccn_uring *r)
+{
+    errno = ENOSYS;
+    return(-1);
+}
+
+int
+ccn_uring_wait(struct ccn_uring *r, int timeout_ms)
+{
+    errno = ENOSYS;
+    return(-1);
+}
+
+int
+ccn_uring_reap(struct ccn_uring *r, struct ccn_uring_cqe *cqes, int max)
+{
+    return(0);
+}
+
+unsigned char *
+ccn_uring_buf(struct ccn_uring *r, int bid)
+{
+    return(NULL);
+}
+
+void
+ccn_uring_buf_recycle(struct ccn_uring *r, int bid)
+{
+}
+
+ssize_t
+ccn_uring_recvmsg_parse(struct ccn_uring *r, int bid, int res,
+                        const struct msghdr *msg,
+                        unsigned char **payload,
+                        struct sockaddr **addr, socklen_t *addrlen,
+                        int *truncated)
+{
+    return(-1);
+}
+
+#endif
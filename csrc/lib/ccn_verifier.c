@@ -0,0 +1,319 @@
+/**
+ * @file ccn_verifier.c
+ * @brief Signature checks for a client handle, done by a pool of threads.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Only ccn_verify_signature runs on the workers.  Finding the key, the
+ * cache of objects already verified, and the upcalls all stay with the
+ * handle, which collects the finished checks when the pipe is readable.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <ccn/ccn.h>
+#include <ccn/ccn_private.h>
+#include <ccn/signing.h>
+
+struct ccn_verifier_job {
+    struct ccn_verifier_job *next;
+    const unsigned char *msg;           /**< the caller's copy */
+    size_t size;
+    struct ccn_parsed_ContentObject pco;
+    const struct ccn_pkey *pubkey;
+    void *tag;
+    int res;                            /**< from ccn_verify_signature */
+};
+
+struct ccn_verifier {
+    int nthreads;
+    pthread_t *threads;
+    int outstanding;                    /**< submitted, not yet reaped */
+    int wake[2];                        /**< pipe, written as checks finish */
+    pthread_mutex_t lock;               /**< guards the rest */
+    pthread_cond_t work;
+    struct ccn_verifier_job *todo;      /**< waiting, oldest first */
+    struct ccn_verifier_job **todo_tail;
+    struct ccn_verifier_job *done;      /**< finished, oldest first */
+    struct ccn_verifier_job **done_tail;
+    int stopping;
+};
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/* Older OpenSSL needs to be told how to lock its shared state */
+static pthread_mutex_t *verifier_ssl_locks = NULL;
+
+static void
+verifier_ssl_lock(int mode, int n, const char *file, int line)
+{
+    if ((mode & CRYPTO_LOCK) != 0)
+        pthread_mutex_lock(&verifier_ssl_locks[n]);
+    else
+        pthread_mutex_unlock(&verifier_ssl_locks[n]);
+}
+
+static unsigned long
+verifier_ssl_id(void)
+{
+    return((unsigned long)pthread_self());
+}
+
+static int
+verifier_ssl_init(void)
+{
+    int i;
+
+    if (verifier_ssl_locks != NULL || CRYPTO_get_locking_callback() != NULL)
+        return(0);
+    verifier_ssl_locks = calloc(CRYPTO_num_locks(), sizeof(pthread_mutex_t));
+    if (verifier_ssl_locks == NULL)
+        return(-1);
+    for (i = 0; i < CRYPTO_num_locks(); i++)
+        pthread_mutex_init(&verifier_ssl_locks[i], NULL);
+    CRYPTO_set_id_callback(&verifier_ssl_id);
+    CRYPTO_set_locking_callback(&verifier_ssl_lock);
+    return(0);
+}
+#else
+static int
+verifier_ssl_init(void)
+{
+    return(0);
+}
+#endif
+
+static void *
+verifier_worker(void *arg)
+{
+    struct ccn_verifier *v = arg;
+    struct ccn_verifier_job *job = NULL;
+    int wake;
+
+    for (;;) {
+        pthread_mutex_lock(&v->lock);
+        while (v->todo == NULL && !v->stopping)
+            pthread_cond_wait(&v->work, &v->lock);
+        job = v->todo;
+        if (job == NULL) {
+            pthread_mutex_unlock(&v->lock);
+            return(NULL);
+        }
+        v->todo = job->next;
+        if (v->todo == NULL)
+            v->todo_tail = &v->todo;
+        pthread_mutex_unlock(&v->lock);
+        job->next = NULL;
+        job->res = ccn_verify_signature(job->msg, job->size,
+                                        &job->pco, job->pubkey);
+        pthread_mutex_lock(&v->lock);
+        wake = (v->done == NULL);
+        *v->done_tail = job;
+        v->done_tail = &job->next;
+        pthread_mutex_unlock(&v->lock);
+        if (wake)
+            (void)write(v->wake[1], "", 1);
+    }
+}
+
+/**
+ * Start n threads for checking signatures.
+ * @returns the pool, or NULL if not even one thread could be started.
+ */
+struct ccn_verifier *
+ccn_verifier_create(int n)
+{
+    struct ccn_verifier *v = NULL;
+    sigset_t all;
+    sigset_t old;
+    int i;
+
+    if (n <= 0 || verifier_ssl_init() < 0)
+        return(NULL);
+    v = calloc(1, sizeof(*v));
+    if (v == NULL)
+        return(NULL);
+    v->threads = calloc(n, sizeof(v->threads[0]));
+    if (v->threads == NULL || pipe(v->wake) == -1) {
+        free(v->threads);
+        free(v);
+        return(NULL);
+    }
+    fcntl(v->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(v->wake[1], F_SETFL, O_NONBLOCK);
+    fcntl(v->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(v->wake[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&v->lock, NULL);
+    pthread_cond_init(&v->work, NULL);
+    v->todo_tail = &v->todo;
+    v->done_tail = &v->done;
+    /* Signals are for the application's threads */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 0; i < n; i++)
+        if (pthread_create(&v->threads[i], NULL, &verifier_worker, v) != 0)
+            break;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    v->nthreads = i;
+    if (i == 0)
+        ccn_verifier_destroy(&v);
+    return(v);
+}
+
+/**
+ * Stop the threads once they have done the checks in hand.
+ *
+ * Checks that have not been reaped are lost.
+ */
+void
+ccn_verifier_destroy(struct ccn_verifier **pv)
+{
+    struct ccn_verifier *v = *pv;
+    struct ccn_verifier_job *job;
+
+    if (v == NULL)
+        return;
+    ccn_verifier_stop(v);
+    while ((job = v->done) != NULL) {
+        v->done = job->next;
+        free(job);
+    }
+    close(v->wake[0]);
+    close(v->wake[1]);
+    pthread_cond_destroy(&v->work);
+    pthread_mutex_destroy(&v->lock);
+    free(v->threads);
+    free(v);
+    *pv = NULL;
+}
+
+/**
+ * Wait for the threads to finish the checks in hand, and stop them.
+ *
+ * The results may still be reaped afterwards.
+ */
+void
+ccn_verifier_stop(struct ccn_verifier *v)
+{
+    int i;
+
+    pthread_mutex_lock(&v->lock);
+    v->stopping = 1;
+    pthread_cond_broadcast(&v->work);
+    pthread_mutex_unlock(&v->lock);
+    for (i = 0; i < v->nthreads; i++)
+        pthread_join(v->threads[i], NULL);
+    v->nthreads = 0;
+}
+
+/**
+ * Hand a signature check to the threads.
+ *
+ * msg must stay put until the check has been reaped.
+ * @returns 0, or -1 if the check should be done by the caller.
+ */
+int
+ccn_verifier_submit(struct ccn_verifier *v,
+                    const unsigned char *msg, size_t size,
+                    const struct ccn_parsed_ContentObject *pco,
+                    const struct ccn_pkey *pubkey, void *tag)
+{
+    struct ccn_verifier_job *job;
+
+    if (v->nthreads == 0)
+        return(-1);
+    job = calloc(1, sizeof(*job));
+    if (job == NULL)
+        return(-1);
+    job->msg = msg;
+    job->size = size;
+    job->pco = *pco;
+    job->pubkey = pubkey;
+    job->tag = tag;
+    pthread_mutex_lock(&v->lock);
+    *v->todo_tail = job;
+    v->todo_tail = &job->next;
+    pthread_cond_signal(&v->work);
+    pthread_mutex_unlock(&v->lock);
+    v->outstanding++;
+    return(0);
+}
+
+/**
+ * Take one finished check, if there is one.
+ * @param tagp gets the tag given to ccn_verifier_submit.
+ * @param resp gets what ccn_verify_signature returned.
+ * @returns 1 if a check was reaped, 0 if none has finished.
+ */
+int
+ccn_verifier_reap(struct ccn_verifier *v, void **tagp, int *resp)
+{
+    struct ccn_verifier_job *job;
+    char buf[64];
+
+    pthread_mutex_lock(&v->lock);
+    job = v->done;
+    if (job != NULL) {
+        v->done = job->next;
+        if (v->done == NULL)
+            v->done_tail = &v->done;
+    }
+    else
+        while (read(v->wake[0], buf, sizeof(buf)) > 0)
+            continue;
+    pthread_mutex_unlock(&v->lock);
+    if (job == NULL)
+        return(0);
+    v->outstanding--;
+    *tagp = job->tag;
+    *resp = job->res;
+    free(job);
+    return(1);
+}
+
+/**
+ * @returns the fd that becomes readable as checks finish.
+ */
+int
+ccn_verifier_fd(struct ccn_verifier *v)
+{
+    return(v->wake[0]);
+}
+
+/**
+ * @returns the number of threads running.
+ */
+int
+ccn_verifier_threads(struct ccn_verifier *v)
+{
+    return(v->nthreads);
+}
+
+/**
+ * @returns the number of checks submitted and not yet reaped.
+ */
+int
+ccn_verifier_outstanding(struct ccn_verifier *v)
+{
+    return(v->outstanding);
+}
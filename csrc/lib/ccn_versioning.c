@@ -22,9 +22,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 #include <ccn/bloom.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
 #include <ccn/uri.h>
 #include <ccn/ccn_private.h>
 
@@ -75,8 +77,32 @@ append_future_vcomp(struct ccn_charbuf *templ)
     ccn_charbuf_append_closer(templ); /* </Component> */
 }
 
+/**
+ * Append InterestLifetime to partially constructed Interest.
+ */
+static void
+answer_lifetime(struct ccn_charbuf *templ, int lifetime_ms)
+{
+    unsigned char buf[3];
+    uintmax_t lifetime;
+    int i;
+    
+    /* InterestLifetime is in units of 1/4096 second */
+    lifetime = (uintmax_t)lifetime_ms * 4096 / 1000;
+    if (lifetime >= (1 << 24))
+        lifetime = (1 << 24) - 1;
+    for (i = sizeof(buf) - 1; i >= 0; i--, lifetime >>= 8)
+        buf[i] = lifetime & 0xff;
+    ccnb_append_tagged_blob(templ, CCN_DTAG_InterestLifetime, buf, sizeof(buf));
+}
+
+/**
+ * Make the template for asking for versions later than vcomp.
+ * @param lifetime_ms if positive, is put in as the InterestLifetime.
+ */
 static struct ccn_charbuf *
-resolve_templ(struct ccn_charbuf *templ, unsigned const char *vcomp, int size)
+resolve_templ(struct ccn_charbuf *templ, unsigned const char *vcomp, int size,
+              int lifetime_ms)
 {
     if (templ == NULL)
         templ = ccn_charbuf_create();
@@ -99,6 +125,8 @@ resolve_templ(struct ccn_charbuf *templ, unsigned const char *vcomp, int size)
     ccn_charbuf_append_closer(templ); /* </Exclude> */
     answer_highest(templ);
     answer_passive(templ);
+    if (lifetime_ms > 0)
+        answer_lifetime(templ, lifetime_ms);
     ccn_charbuf_append_closer(templ); /* </Interest> */
     return(templ);
 }
@@ -153,7 +181,7 @@ ccn_resolve_version(struct ccn *h, struct ccn_charbuf *name,
             goto Finish;
         }    
     }
-    templ = resolve_templ(templ, lowtime, sizeof(lowtime));
+    templ = resolve_templ(templ, lowtime, sizeof(lowtime), 0);
     ccn_charbuf_append(prefix, name->buf, name->length); /* our copy */
     cobj->length = 0;
     res = ccn_get(h, prefix, templ, timeout_ms, cobj, pco, ndx, 0);
@@ -171,7 +199,7 @@ ccn_resolve_version(struct ccn *h, struct ccn_charbuf *name,
             myres = 0;
             if ((versioning_flags & CCN_V_EST) == 0)
                 break;
-            templ = resolve_templ(templ, vers, vers_size);
+            templ = resolve_templ(templ, vers, vers_size, 0);
             if (templ == NULL) break;
             cobj->length = 0;
             res = ccn_get(h, prefix, templ, timeout_ms, cobj, pco, ndx,
@@ -188,6 +216,339 @@ Finish:
     return(myres);
 }
 
+/**
+ * How long a resolved version is remembered, in milliseconds.
+ *
+ * This is kept short, because the point is only to spare the network
+ * when many callers ask about the same names at about the same time.
+ */
+#define CCN_RESOLVE_TTL_MS 2000
+
+/**
+ * The version cache is swept of stale entries when it gets this big.
+ */
+#define CCN_RESOLVE_CACHE_MAX 256
+
+/**
+ * A remembered version, keyed by the ccnb Name of the prefix.
+ */
+struct resolved_version {
+    intmax_t expiry;            /**< ms, after which the entry is stale */
+    unsigned char highest;      /**< nothing later was found */
+    unsigned char size;         /**< bytes used in vers */
+    unsigned char vers[16];     /**< value of the version component */
+};
+
+/**
+ * State for one ccn_resolve_version_async.
+ */
+struct resolve_state {
+    struct ccn_closure closure;
+    struct ccn_charbuf *prefix; /**< the name we are resolving */
+    struct ccn_charbuf *templ;
+    struct ccn_charbuf *after;  /**< lower bound, or NULL */
+    int n;                      /**< number of components in prefix */
+    int flags;
+    int timeout_ms;
+    int reported;               /**< action has been called */
+    unsigned char size;         /**< of best version so far, or 0 */
+    unsigned char vers[16];
+    ccn_resolve_action action;
+    void *data;
+};
+
+static intmax_t
+resolve_now_ms(void)
+{
+    struct timeval now;
+    
+    gettimeofday(&now, NULL);
+    return((intmax_t)now.tv_sec * 1000 + now.tv_usec / 1000);
+}
+
+/**
+ * Compare version components.
+ *
+ * The timestamps are big-endian with no leading zeros past the marker,
+ * so a longer one is later.
+ */
+static int
+vers_compare(const unsigned char *a, size_t asize,
+             const unsigned char *b, size_t bsize)
+{
+    if (asize != bsize)
+        return(asize < bsize ? -1 : 1);
+    return(memcmp(a, b, asize));
+}
+
+/**
+ * Look for a usable cached version of prefix.
+ * @returns 1 if cached version is the answer, 0 if it is known that
+ *        there is nothing later than after, -1 if the network must be asked.
+ */
+static int
+resolve_cache_lookup(struct ccn *h, struct ccn_charbuf *prefix, int flags,
+                     struct ccn_charbuf *after,
+                     const unsigned char **vers, size_t *vers_size)
+{
+    struct hashtb *cache = *ccn_version_cache(h);
+    struct resolved_version *rv = NULL;
+    
+    if (cache == NULL)
+        return(-1);
+    rv = hashtb_lookup(cache, prefix->buf, prefix->length);
+    if (rv == NULL || rv->expiry <= resolve_now_ms())
+        return(-1);
+    if (after != NULL &&
+        vers_compare(rv->vers, rv->size, after->buf, after->length) <= 0)
+        return(rv->highest ? 0 : -1);
+    if ((flags & CCN_V_EST) != 0 && !rv->highest && after == NULL)
+        return(-1);
+    *vers = rv->vers;
+    *vers_size = rv->size;
+    return(1);
+}
+
+static void
+resolve_cache_store(struct ccn *h, struct resolve_state *st, int highest)
+{
+    struct hashtb **cachep = ccn_version_cache(h);
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct resolved_version *rv = NULL;
+    intmax_t now = resolve_now_ms();
+    int res;
+    
+    if (*cachep == NULL)
+        *cachep = hashtb_create(sizeof(struct resolved_version), NULL);
+    if (*cachep == NULL)
+        return;
+    if (hashtb_n(*cachep) >= CCN_RESOLVE_CACHE_MAX) {
+        for (hashtb_start(*cachep, e); e->data != NULL;) {
+            rv = e->data;
+            if (rv->expiry <= now)
+                hashtb_delete(e);
+            else
+                hashtb_next(e);
+        }
+        hashtb_end(e);
+        if (hashtb_n(*cachep) >= CCN_RESOLVE_CACHE_MAX &&
+            hashtb_lookup(*cachep, st->prefix->buf, st->prefix->length) == NULL)
+            return;
+    }
+    hashtb_start(*cachep, e);
+    res = hashtb_seek(e, st->prefix->buf, st->prefix->length, 0);
+    rv = e->data;
+    if (res >= 0 && rv != NULL) {
+        /* Never trade a complete answer for a partial one */
+        if (res == HT_NEW_ENTRY || highest || !rv->highest ||
+            rv->expiry <= now) {
+            rv->expiry = now + CCN_RESOLVE_TTL_MS;
+            rv->highest = highest;
+            rv->size = st->size;
+            memcpy(rv->vers, st->vers, st->size);
+        }
+    }
+    hashtb_end(e);
+}
+
+/**
+ * Tell the caller how it came out, just once.
+ */
+static void
+resolve_report(struct ccn *h, struct resolve_state *st, int res)
+{
+    struct ccn_charbuf *name = NULL;
+    
+    if (st->reported)
+        return;
+    st->reported = 1;
+    if (res > 0) {
+        name = ccn_charbuf_create();
+        ccn_charbuf_append(name, st->prefix->buf, st->prefix->length);
+        ccn_name_append(name, st->vers, st->size);
+    }
+    (st->action)(h, st->data, res, name != NULL ? name : st->prefix);
+    ccn_charbuf_destroy(&name);
+}
+
+static void
+resolve_finish(struct ccn *h, struct resolve_state *st, int highest)
+{
+    if (st->size != 0) {
+        resolve_cache_store(h, st, highest);
+        resolve_report(h, st, 1);
+    }
+    else
+        resolve_report(h, st, 0);
+}
+
+static enum ccn_upcall_res
+resolve_handler(struct ccn_closure *selfp,
+                enum ccn_upcall_kind kind,
+                struct ccn_upcall_info *info)
+{
+    struct resolve_state *st = selfp->data;
+    const unsigned char *vers = NULL;
+    size_t vers_size = 0;
+    int res;
+    
+    switch (kind) {
+        case CCN_UPCALL_FINAL:
+            resolve_report(info->h, st, -1);
+            ccn_charbuf_destroy(&st->prefix);
+            ccn_charbuf_destroy(&st->templ);
+            ccn_charbuf_destroy(&st->after);
+            free(st);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_INTEREST_TIMED_OUT:
+            /* Nothing later turned up, so what we have is the highest */
+            resolve_finish(info->h, st, 1);
+            return(CCN_UPCALL_RESULT_OK);
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+        case CCN_UPCALL_CONTENT_RAW:
+            break;
+        default:
+            return(CCN_UPCALL_RESULT_OK);
+    }
+    if (st->reported)
+        return(CCN_UPCALL_RESULT_OK);
+    if (info->pco->type == CCN_CONTENT_NACK) {
+        resolve_finish(info->h, st, 1);
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    res = ccn_name_comp_get(info->content_ccnb, info->content_comps, st->n,
+                            &vers, &vers_size);
+    if (res < 0 || vers_size != 7 || vers[0] != CCN_MARKER_VERSION) {
+        resolve_finish(info->h, st, 1);
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    st->size = vers_size;
+    memcpy(st->vers, vers, vers_size);
+    /* A version past the caller's lower bound is as far as we need to go */
+    if ((st->flags & CCN_V_EST) == 0 || st->after != NULL) {
+        resolve_finish(info->h, st, 0);
+        return(CCN_UPCALL_RESULT_OK);
+    }
+    st->templ = resolve_templ(st->templ, st->vers, st->size, st->timeout_ms);
+    if (st->templ == NULL ||
+        ccn_express_interest(info->h, st->prefix, selfp, st->templ) < 0)
+        resolve_finish(info->h, st, 0);
+    return(CCN_UPCALL_RESULT_OK);
+}
+
+/**
+ * Resolve the version without waiting for the answer.
+ *
+ * This is the asynchronous counterpart of ccn_resolve_version, for
+ * clients that need to resolve many names at once; each call just
+ * expresses an interest, and the answers are delivered from ccn_run.
+ * Versions found are remembered by the handle for a short while, so
+ * a repeated request for the same name may be answered without
+ * asking the network.
+ * @param h is the ccn handle; it must not be NULL.
+ * @param name is a ccnb-encoded Name prefix.  It is copied, not modified.
+ * @param versioning_flags as for ccn_resolve_version.
+ * @param timeout_ms is used as the lifetime of each interest.
+ * @param after if not NULL, is the value of a version component that
+ *        the caller already has.  Only later versions are looked for, and
+ *        the first one found ends the search, even with CCN_V_EST.
+ * @param after_size is the size of after.
+ * @param action is called exactly once, with res 1 and the extended name
+ *        if a version was found, res 0 and the original name if not,
+ *        or res -1 if the handle was destroyed first.  The name is only
+ *        valid during the call.  The call may come before
+ *        ccn_resolve_version_async returns.
+ * @param data is passed to action.
+ * @returns -1 for error (action is not called), 0 otherwise.
+ */
+int
+ccn_resolve_version_async(struct ccn *h, const struct ccn_charbuf *name,
+                          int versioning_flags, int timeout_ms,
+                          const unsigned char *after, size_t after_size,
+                          ccn_resolve_action action, void *data)
+{
+    struct resolve_state *st = NULL;
+    struct ccn_indexbuf *nix = NULL;
+    const unsigned char *vers = NULL;
+    size_t vers_size = 0;
+    unsigned char lowtime[7] = {CCN_MARKER_VERSION, 0, FF, FF, FF, FF, FF};
+    int res;
+    
+    if (h == NULL || action == NULL)
+        return(-1);
+    if ((versioning_flags & ~CCN_V_NESTOK & ~CCN_V_EST) != CCN_V_HIGH ||
+        (after != NULL && (after_size < 3 || after_size > 16))) {
+        ccn_seterror(h, EINVAL);
+        ccn_perror(h, "ccn_resolve_version_async: bad versioning_flags or lower bound");
+        return(-1);
+    }
+    st = calloc(1, sizeof(*st));
+    nix = ccn_indexbuf_create();
+    if (st == NULL || nix == NULL)
+        goto Bail;
+    st->closure.p = &resolve_handler;
+    st->closure.data = st;
+    st->flags = versioning_flags;
+    st->timeout_ms = timeout_ms;
+    st->action = action;
+    st->data = data;
+    st->prefix = ccn_charbuf_create();
+    if (st->prefix == NULL ||
+        ccn_charbuf_append(st->prefix, name->buf, name->length) < 0)
+        goto Bail;
+    st->n = ccn_name_split(st->prefix, nix);
+    if (st->n < 0)
+        goto Bail;
+    if ((versioning_flags & CCN_V_NESTOK) == 0) {
+        res = ccn_name_comp_get(st->prefix->buf, nix, st->n - 1, &vers, &vers_size);
+        if (res >= 0 && vers_size == 7 && vers[0] == CCN_MARKER_VERSION) {
+            resolve_report(h, st, 0);
+            goto Done;
+        }
+    }
+    if (after != NULL) {
+        st->after = ccn_charbuf_create();
+        if (st->after == NULL || ccn_charbuf_append(st->after, after, after_size) < 0)
+            goto Bail;
+    }
+    res = resolve_cache_lookup(h, st->prefix, versioning_flags, st->after,
+                               &vers, &vers_size);
+    if (res >= 0) {
+        st->size = res ? vers_size : 0;
+        if (res)
+            memcpy(st->vers, vers, vers_size);
+        resolve_report(h, st, res);
+        goto Done;
+    }
+    if (after != NULL)
+        st->templ = resolve_templ(NULL, after, after_size, timeout_ms);
+    else
+        st->templ = resolve_templ(NULL, lowtime, sizeof(lowtime), timeout_ms);
+    if (st->templ == NULL ||
+        ccn_express_interest(h, st->prefix, &st->closure, st->templ) < 0)
+        goto Bail;
+    ccn_indexbuf_destroy(&nix);
+    return(0);
+Done:
+    ccn_indexbuf_destroy(&nix);
+    ccn_charbuf_destroy(&st->prefix);
+    ccn_charbuf_destroy(&st->after);
+    free(st);
+    return(0);
+Bail:
+    ccn_indexbuf_destroy(&nix);
+    if (st != NULL) {
+        ccn_charbuf_destroy(&st->prefix);
+        ccn_charbuf_destroy(&st->templ);
+        ccn_charbuf_destroy(&st->after);
+        free(st);
+    }
+    return(-1);
+}
+
 /**
  * Extend a Name with a new version stamp
  * @param h is the the ccn handle.
@@ -0,0 +1,157 @@
+/**
+ * @file ccn_window.c
+ * @brief Congestion window and retransmission timer for pipelined fetching.
+ *
+ * Part of the CCNx C Library.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stddef.h>
+#include <sys/time.h>
+#include <ccn/window.h>
+
+#define CCN_WINDOW_AIMD_BETA 0.5
+#define CCN_WINDOW_CUBIC_BETA 0.7
+#define CCN_WINDOW_CUBIC_C 0.4
+
+void
+ccn_window_init(struct ccn_window *w, int mode, double initial, double max)
+{
+    if (max < 1.0)
+        max = 1.0;
+    if (initial < 1.0)
+        initial = 1.0;
+    if (initial > max)
+        initial = max;
+    w->mode = mode;
+    w->cwnd = initial;
+    w->ssthresh = max;
+    w->max = max;
+    w->cubic_max = 0.0;
+    w->last_decrease = 0;
+    w->srtt = 0;
+    w->rttvar = 0;
+    w->rto = CCN_WINDOW_RTO_INITIAL;
+}
+
+uint64_t
+ccn_window_now(void)
+{
+    struct timeval now = {0};
+
+    gettimeofday(&now, NULL);
+    return((uint64_t)now.tv_sec * 1000000 + now.tv_usec);
+}
+
+/**
+ * Newton's method is plenty for window sizes.
+ */
+static double
+cube_root(double x)
+{
+    double r = (x > 1.0) ? x / 3.0 : 1.0;
+    double n;
+    int i;
+
+    if (x <= 0.0)
+        return(0.0);
+    for (i = 0; i < 40; i++) {
+        n = (2.0 * r + x / (r * r)) / 3.0;
+        if (n >= r - 1e-9 && n <= r + 1e-9)
+            break;
+        r = n;
+    }
+    return(r);
+}
+
+void
+ccn_window_open(struct ccn_window *w, uint64_t now)
+{
+    double cwnd = w->cwnd;
+    double t, k, target;
+
+    if (cwnd < w->ssthresh)
+        cwnd = cwnd + 1.0;  /* slow start */
+    else if (w->mode == CCN_WINDOW_CUBIC && w->last_decrease != 0) {
+        /* Aim for the cubic function of the time since the last decrease */
+        t = (now - w->last_decrease) / 1.0e6;
+        k = cube_root(w->cubic_max * (1.0 - CCN_WINDOW_CUBIC_BETA) /
+                      CCN_WINDOW_CUBIC_C);
+        target = CCN_WINDOW_CUBIC_C * (t - k) * (t - k) * (t - k) +
+                 w->cubic_max;
+        if (target > cwnd)
+            cwnd = cwnd + (target - cwnd) / cwnd;
+        else
+            cwnd = cwnd + 0.01 / cwnd;
+    }
+    else
+        cwnd = cwnd + 1.0 / cwnd;  /* additive increase */
+    if (cwnd > w->max)
+        cwnd = w->max;
+    w->cwnd = cwnd;
+}
+
+int
+ccn_window_close(struct ccn_window *w, uint64_t now, int timeout)
+{
+    double beta;
+
+    if (!timeout && w->last_decrease != 0 &&
+        (intmax_t)(now - w->last_decrease) < w->srtt)
+        return(0);
+    beta = (w->mode == CCN_WINDOW_CUBIC) ? CCN_WINDOW_CUBIC_BETA
+                                         : CCN_WINDOW_AIMD_BETA;
+    w->cubic_max = w->cwnd;
+    w->ssthresh = w->cwnd * beta;
+    if (w->ssthresh < 2.0)
+        w->ssthresh = 2.0;
+    w->cwnd = timeout ? 1.0 : w->ssthresh;
+    if (w->cwnd > w->max)
+        w->cwnd = w->max;
+    w->last_decrease = now;
+    return(1);
+}
+
+void
+ccn_window_note_rtt(struct ccn_window *w, intmax_t rtt)
+{
+    intmax_t err;
+
+    if (rtt < 1)
+        rtt = 1;
+    if (w->srtt == 0) {
+        w->srtt = rtt;
+        w->rttvar = rtt / 2;
+    }
+    else {
+        err = rtt - w->srtt;
+        if (err < 0)
+            err = -err;
+        w->rttvar = (3 * w->rttvar + err) / 4;
+        w->srtt = (7 * w->srtt + rtt) / 8;
+    }
+    w->rto = w->srtt + 4 * w->rttvar;
+    if (w->rto < CCN_WINDOW_RTO_MIN)
+        w->rto = CCN_WINDOW_RTO_MIN;
+    if (w->rto > CCN_WINDOW_RTO_MAX)
+        w->rto = CCN_WINDOW_RTO_MAX;
+}
+
+void
+ccn_window_backoff(struct ccn_window *w)
+{
+    w->rto = 2 * w->rto;
+    if (w->rto > CCN_WINDOW_RTO_MAX)
+        w->rto = CCN_WINDOW_RTO_MAX;
+}
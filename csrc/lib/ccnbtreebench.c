@@ -0,0 +1,712 @@
+/**
+ * @file ccnbtreebench.c
+ *
+ * A test program to benchmark the btree index used by ccnr.
+ *
+ * For each storage layer (none, one file per node, and the page file)
+ * and each kind of key (sequential, in random order, and versioned and
+ * segmented names, as a repository sees them), this builds an index of
+ * content entries by single inserts, then times point lookups, a scan
+ * of the whole index, and matching of Interests the way ccnr does it.
+ * It reports the rate, the bytes of node i/o per operation, and the
+ * memory in use.  The node cache is kept within its limit, as ccnr's
+ * cleaner would keep it.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <ccn/btree.h>
+#include <ccn/btree_content.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/hashtb.h>
+#include <ccn/indexbuf.h>
+#include <ccn/uri.h>
+
+/** Operations between visits of the cleaner */
+#define CLEAN_BATCH 1000
+
+static void
+usage(const char *progname)
+{
+    fprintf(stderr,
+            "%s [-n count] [-s segments] [-f fanout] [-p nodepool] "
+            "[-b backends]\n"
+            "   Benchmarks the btree index with count names of each kind\n"
+            "   -n count - names in each index.  Default 100000.\n"
+            "   -s segments - segments per version of the versioned names.\n"
+            "      Default 16.\n"
+            "   -f fanout - most entries per node.  Default 1999, as ccnr.\n"
+            "   -p nodepool - most resident nodes.  Default 512, as ccnr.\n"
+            "   -b backends - some of memory,directory,pagefile.  Default all.\n"
+            "   Scratch directories named _bt_bench_* are made and removed.\n",
+            progname);
+    exit(1);
+}
+
+static void
+fatal(const char *what)
+{
+    perror(what);
+    exit(1);
+}
+
+/**
+ * Storage layer that counts the node i/o of the one it wraps
+ */
+struct counting_io {
+    struct ccn_btree_io io;
+    struct ccn_btree_io *inner;
+    uintmax_t bytes;
+};
+
+static void
+counting_sync(struct ccn_btree_io *io)
+{
+    struct counting_io *cio = io->data;
+
+    io->maxnodeid = cio->inner->maxnodeid;
+    io->openfds = cio->inner->openfds;
+    io->mark = cio->inner->mark;
+}
+
+static int
+counting_open(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct counting_io *cio = io->data;
+    int res;
+
+    res = cio->inner->btopen(cio->inner, node);
+    counting_sync(io);
+    return(res);
+}
+
+static int
+counting_read(struct ccn_btree_io *io, struct ccn_btree_node *node,
+              unsigned limit)
+{
+    struct counting_io *cio = io->data;
+    int res;
+
+    res = cio->inner->btread(cio->inner, node, limit);
+    if (res >= 0)
+        cio->bytes += node->buf->length;
+    counting_sync(io);
+    return(res);
+}
+
+static int
+counting_write(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct counting_io *cio = io->data;
+    int res;
+
+    res = cio->inner->btwrite(cio->inner, node);
+    if (res >= 0)
+        cio->bytes += node->buf->length;
+    counting_sync(io);
+    return(res);
+}
+
+static int
+counting_close(struct ccn_btree_io *io, struct ccn_btree_node *node)
+{
+    struct counting_io *cio = io->data;
+    int res;
+
+    res = cio->inner->btclose(cio->inner, node);
+    counting_sync(io);
+    return(res);
+}
+
+static int
+counting_commit(struct ccn_btree_io *io, uintmax_t mark)
+{
+    struct counting_io *cio = io->data;
+    int res;
+
+    res = cio->inner->btcommit(cio->inner, mark);
+    counting_sync(io);
+    return(res);
+}
+
+static int
+counting_destroy(struct ccn_btree_io **pio)
+{
+    struct counting_io *cio = (*pio)->data;
+    int res;
+
+    res = cio->inner->btdestroy(&cio->inner);
+    free(cio);
+    *pio = NULL;
+    return(res);
+}
+
+static struct ccn_btree_io *
+counting_io_create(struct ccn_btree_io *inner)
+{
+    struct counting_io *cio;
+
+    cio = calloc(1, sizeof(*cio));
+    if (cio == NULL)
+        return(NULL);
+    cio->inner = inner;
+    memcpy(cio->io.clue, inner->clue, sizeof(cio->io.clue));
+    cio->io.btopen = &counting_open;
+    cio->io.btread = &counting_read;
+    cio->io.btwrite = &counting_write;
+    cio->io.btclose = &counting_close;
+    cio->io.btdestroy = &counting_destroy;
+    if (inner->btcommit != NULL)
+        cio->io.btcommit = &counting_commit;
+    cio->io.data = cio;
+    counting_sync(&cio->io);
+    return(&cio->io);
+}
+
+/**
+ * A set of flatnames, end to end
+ */
+struct keyset {
+    const char *what;
+    struct ccn_charbuf *flat;
+    size_t *off;                /**< n + 1 offsets into flat */
+    int n;
+};
+
+static void
+fill_digest(unsigned char *d, unsigned i)
+{
+    unsigned x = i * 2654435761U + 1;
+    int k;
+
+    for (k = 0; k < 32; k++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        d[k] = x;
+    }
+}
+
+/**
+ * Make the keys: four name components and the digest, as in ccnr
+ *
+ * seq and random are /bench/seq/NNNNNNNNN/%00; random is shuffled.
+ * versioned is /bench/OBJECT/%FDversion/%00segment, where the objects
+ * are in no particular order and their segments are consecutive.
+ */
+static void
+keyset_init(struct keyset *ks, const char *what, int n, int segments)
+{
+    unsigned char comp[32];
+    unsigned char digest[32];
+    size_t *off;
+    size_t t;
+    int i;
+    int j;
+    int obj;
+    int seg;
+
+    ks->what = what;
+    ks->n = n;
+    ks->flat = ccn_charbuf_create();
+    ks->off = calloc(n + 1, sizeof(ks->off[0]));
+    if (ks->flat == NULL || ks->off == NULL)
+        fatal("keyset_init");
+    for (i = 0; i < n; i++) {
+        ks->off[i] = ks->flat->length;
+        ccn_flatname_append_component(ks->flat, (const void *)"bench", 5);
+        if (what[0] != 'v') {
+            ccn_flatname_append_component(ks->flat, (const void *)"seq", 3);
+            snprintf((char *)comp, sizeof(comp), "%09d", i);
+            ccn_flatname_append_component(ks->flat, comp, 9);
+            comp[0] = CCN_MARKER_SEQNUM;
+            ccn_flatname_append_component(ks->flat, comp, 1);
+        }
+        else {
+            obj = i / segments;
+            seg = i % segments;
+            fill_digest(digest, obj);
+            snprintf((char *)comp, sizeof(comp), "%02x%02x%02x%02x",
+                     digest[0], digest[1], digest[2], digest[3]);
+            ccn_flatname_append_component(ks->flat, comp, 8);
+            comp[0] = CCN_MARKER_VERSION;
+            memcpy(comp + 1, digest + 4, 6);
+            ccn_flatname_append_component(ks->flat, comp, 7);
+            comp[0] = CCN_MARKER_SEQNUM;
+            t = 1;
+            if (seg > 255)
+                comp[t++] = seg >> 8;
+            if (seg > 0)
+                comp[t++] = seg;
+            ccn_flatname_append_component(ks->flat, comp, t);
+        }
+        fill_digest(digest, i + 0x10000000);
+        ccn_flatname_append_component(ks->flat, digest, 32);
+    }
+    ks->off[n] = ks->flat->length;
+    if (what[0] == 'r') {
+        /* Shuffle by rebuilding from a permuted order */
+        struct ccn_charbuf *flat = ccn_charbuf_create();
+        int *perm = calloc(n, sizeof(*perm));
+
+        off = calloc(n + 1, sizeof(off[0]));
+        if (flat == NULL || perm == NULL || off == NULL)
+            fatal("keyset_init");
+        for (i = 0; i < n; i++)
+            perm[i] = i;
+        for (i = n - 1; i > 0; i--) {
+            j = random() % (i + 1);
+            t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+        }
+        for (i = 0; i < n; i++) {
+            off[i] = flat->length;
+            ccn_charbuf_append(flat, ks->flat->buf + ks->off[perm[i]],
+                               ks->off[perm[i] + 1] - ks->off[perm[i]]);
+        }
+        off[n] = flat->length;
+        ccn_charbuf_destroy(&ks->flat);
+        free(ks->off);
+        free(perm);
+        ks->flat = flat;
+        ks->off = off;
+    }
+}
+
+static void
+keyset_destroy(struct keyset *ks)
+{
+    ccn_charbuf_destroy(&ks->flat);
+    free(ks->off);
+    ks->off = NULL;
+}
+
+/**
+ * One benchmark run, on one btree
+ */
+struct bench {
+    const char *backend;
+    struct ccn_btree *btree;
+    struct counting_io *cio;    /**< NULL for memory */
+    char dir[32];
+    struct ccn_charbuf *cob;    /**< ContentObject that all entries share */
+    struct ccn_parsed_ContentObject pco;
+    struct ccn_btree_cursor cursor;
+    struct timeval start;
+    uintmax_t startbytes;
+};
+
+/**
+ * Remove a scratch directory, which the storage layers keep flat
+ */
+static void
+remove_dir(const char *path)
+{
+    struct ccn_charbuf *temp = ccn_charbuf_create();
+    struct dirent *de = NULL;
+    DIR *d = NULL;
+
+    d = opendir(path);
+    while (d != NULL && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        temp->length = 0;
+        ccn_charbuf_putf(temp, "%s/%s", path, de->d_name);
+        unlink(ccn_charbuf_as_string(temp));
+    }
+    if (d != NULL)
+        closedir(d);
+    rmdir(path);
+    ccn_charbuf_destroy(&temp);
+}
+
+/**
+ * Make a ContentObject with 4 name components, for the index entries
+ *
+ * Only the name component count, the SignedInfo, and the size go into
+ * an entry, so one object does for all of them.  Nothing checks the
+ * signature, so it is left blank.
+ */
+static void
+bench_init_cob(struct bench *b)
+{
+    static const unsigned char sigbits[128] = {0};
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *cob = ccn_charbuf_create();
+    int res;
+
+    res = ccn_name_from_uri(name, "ccnx:/bench/a/b/c");
+    res |= ccnb_element_begin(cob, CCN_DTAG_ContentObject);
+    res |= ccnb_element_begin(cob, CCN_DTAG_Signature);
+    res |= ccnb_append_tagged_blob(cob, CCN_DTAG_SignatureBits,
+                                   sigbits, sizeof(sigbits));
+    res |= ccnb_element_end(cob);
+    res |= ccn_charbuf_append_charbuf(cob, name);
+    res |= ccn_signed_info_create(cob, NULL, 0, NULL, CCN_CONTENT_DATA,
+                                  -1, NULL, NULL);
+    res |= ccnb_append_tagged_blob(cob, CCN_DTAG_Content, "data", 4);
+    res |= ccnb_element_end(cob);
+    if (res >= 0)
+        res = ccn_parse_ContentObject(cob->buf, cob->length, &b->pco, NULL);
+    if (res < 0)
+        fatal("bench_init_cob");
+    b->cob = cob;
+    ccn_charbuf_destroy(&name);
+}
+
+static void
+bench_init(struct bench *b, const char *backend, int fanout, int nodepool)
+{
+    struct ccn_btree_io *io = NULL;
+    struct ccn_btree_node *node = NULL;
+
+    memset(b, 0, sizeof(*b));
+    b->backend = backend;
+    b->btree = ccn_btree_create();
+    if (b->btree == NULL)
+        fatal("ccn_btree_create");
+    if (strcmp(backend, "memory") != 0) {
+        strcpy(b->dir, "_bt_bench_XXXXXX");
+        if (mkdtemp(b->dir) == NULL)
+            fatal("mkdtemp");
+        if (strcmp(backend, "directory") == 0)
+            io = ccn_btree_io_from_directory(b->dir, NULL);
+        else
+            io = ccn_btree_io_from_pagefile(b->dir, NULL);
+        if (io == NULL)
+            fatal(b->dir);
+        b->btree->io = counting_io_create(io);
+        if (b->btree->io == NULL)
+            fatal("counting_io_create");
+        b->cio = b->btree->io->data;
+        b->btree->nodepool = nodepool;
+    }
+    node = ccn_btree_getnode(b->btree, b->btree->nextnodeid++, 0);
+    if (node == NULL || ccn_btree_init_node(node, 0, 'R', 0) < 0)
+        fatal("root");
+    b->btree->full = b->btree->full0 = fanout;
+    b->btree->nodebytes = 2097152;
+    bench_init_cob(b);
+}
+
+static void
+bench_destroy(struct bench *b)
+{
+    if (ccn_btree_destroy(&b->btree) < 0)
+        fprintf(stderr, "%s: btree errors\n", b->backend);
+    ccn_charbuf_destroy(&b->cob);
+    if (b->dir[0] != 0)
+        remove_dir(b->dir);
+}
+
+/**
+ * Write the changed nodes, close them, and trim the node cache
+ *
+ * This is what ccnr's cleaner does over time.  It invalidates node
+ * pointers, including the one in the cursor.
+ */
+static void
+bench_clean(struct bench *b)
+{
+    struct ccn_btree *btree = b->btree;
+    struct ccn_btree_node *node = NULL;
+    int i;
+
+    memset(&b->cursor, 0, sizeof(b->cursor));
+    if (btree->io == NULL)
+        return;
+    for (i = 0; btree->opened != NULL && i < btree->opened->n; i++) {
+        node = ccn_btree_rnode(btree, btree->opened->buf[i]);
+        if (node != NULL && ccn_btree_close_node(btree, node) < 0)
+            fatal("ccn_btree_close_node");
+    }
+    if (btree->opened != NULL)
+        btree->opened->n = 0;
+    ccn_btree_evict(btree);
+}
+
+static void
+bench_start(struct bench *b)
+{
+    bench_clean(b);
+    b->startbytes = (b->cio == NULL) ? 0 : b->cio->bytes;
+    gettimeofday(&b->start, NULL);
+}
+
+/**
+ * Bytes in the resident nodes
+ */
+static uintmax_t
+resident_bytes(struct ccn_btree *btree)
+{
+    struct hashtb_enumerator ee;
+    struct hashtb_enumerator *e = &ee;
+    struct ccn_btree_node *node = NULL;
+    uintmax_t ans = 0;
+
+    for (hashtb_start(btree->resident, e); e->data != NULL; hashtb_next(e)) {
+        node = e->data;
+        ans += node->buf->limit;
+    }
+    hashtb_end(e);
+    return(ans);
+}
+
+static void
+bench_report(struct bench *b, const struct keyset *ks, const char *op, int n)
+{
+    struct timeval end;
+    struct rusage ru;
+    double dt;
+    uintmax_t bytes;
+
+    gettimeofday(&end, NULL);
+    dt = (end.tv_sec - b->start.tv_sec) +
+         ((int)end.tv_usec - (int)b->start.tv_usec) / 1e6;
+    if (dt <= 0)
+        dt = 1e-6;
+    bytes = (b->cio == NULL) ? 0 : b->cio->bytes - b->startbytes;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%-9s %-9s %-6s %8d ops %10.0f ops/sec %9.1f io bytes/op"
+           " %6d nodes %8ju KB %8ld maxrss\n",
+           b->backend, ks->what, op, n, n / dt, n ? (double)bytes / n : 0.0,
+           hashtb_n(b->btree->resident),
+           resident_bytes(b->btree) / 1024, (long)ru.ru_maxrss);
+}
+
+static void
+bench_insert(struct bench *b, const struct keyset *ks)
+{
+    struct ccn_btree *btree = b->btree;
+    struct ccn_btree_node *leaf = NULL;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_charbuf *flat = ccn_charbuf_create();
+    int limit;
+    int ndx;
+    int res;
+    int i;
+
+    bench_start(b);
+    for (i = 0; i < ks->n; i++) {
+        flat->length = 0;
+        ccn_charbuf_append(flat, ks->flat->buf + ks->off[i],
+                           ks->off[i + 1] - ks->off[i]);
+        res = ccn_btree_lookup(btree, flat->buf, flat->length, &leaf);
+        if (res < 0 || CCN_BT_SRCH_FOUND(res))
+            fatal("insert lookup");
+        ndx = CCN_BT_SRCH_INDEX(res);
+        res = ccn_btree_prepare_for_update(btree, leaf);
+        if (res >= 0)
+            res = ccn_btree_insert_content(leaf, ndx,
+                                           i + 1, b->cob->buf, &b->pco, flat);
+        if (res < 0)
+            fatal("ccn_btree_insert_content");
+        if (ccn_btree_oversize(btree, leaf)) {
+            res = ccn_btree_split(btree, leaf);
+            for (limit = 100; res >= 0 && btree->nextsplit != 0; limit--) {
+                if (limit == 0)
+                    abort();
+                node = ccn_btree_getnode(btree, btree->nextsplit, 0);
+                if (node == NULL)
+                    fatal("split");
+                res = ccn_btree_split(btree, node);
+            }
+            if (res < 0)
+                fatal("ccn_btree_split");
+        }
+        if ((i + 1) % CLEAN_BATCH == 0)
+            bench_clean(b);
+    }
+    bench_report(b, ks, "insert", ks->n);
+    ccn_charbuf_destroy(&flat);
+}
+
+static void
+bench_lookup(struct bench *b, const struct keyset *ks)
+{
+    struct ccn_btree_node *leaf = NULL;
+    int res;
+    int i;
+    int j;
+
+    bench_start(b);
+    for (i = 0; i < ks->n; i++) {
+        j = random() % ks->n;
+        res = ccn_btree_lookup(b->btree, ks->flat->buf + ks->off[j],
+                               ks->off[j + 1] - ks->off[j], &leaf);
+        if (res < 0 || !CCN_BT_SRCH_FOUND(res))
+            fatal("lookup");
+        if ((i + 1) % CLEAN_BATCH == 0)
+            bench_clean(b);
+    }
+    bench_report(b, ks, "lookup", ks->n);
+}
+
+static void
+bench_scan(struct bench *b, const struct keyset *ks)
+{
+    struct ccn_btree_cursor *c = &b->cursor;
+    int res;
+    int n = 0;
+
+    bench_start(b);
+    res = ccn_btree_cursor_seek(c, b->btree, (const unsigned char *)"", 0);
+    while (res >= 0 && c->leaf != NULL) {
+        n++;
+        res = ccn_btree_cursor_next(c);
+    }
+    if (res < 0 || n != ks->n)
+        fatal("scan");
+    bench_report(b, ks, "scan", n);
+}
+
+/**
+ * Find the first match for Interests in the names, as r_store_lookup does
+ *
+ * Each Interest has the first three components of a name chosen at
+ * random, and no selectors.
+ */
+static void
+bench_match(struct bench *b, const struct keyset *ks)
+{
+    struct ccn_btree_cursor *c = &b->cursor;
+    struct ccn_charbuf *interests = ccn_charbuf_create();
+    struct ccn_charbuf *prefix = ccn_charbuf_create();
+    struct ccn_charbuf *scratch = ccn_charbuf_create();
+    struct ccn_parsed_interest *pi = NULL;
+    struct ccn_indexbuf *ioff = ccn_indexbuf_create();
+    const unsigned char *msg;
+    size_t size;
+    int matched = 0;
+    int res;
+    int i;
+    int j;
+
+    pi = calloc(ks->n, sizeof(*pi));
+    if (pi == NULL)
+        fatal("calloc");
+    for (i = 0; i < ks->n; i++) {
+        j = random() % ks->n;
+        ccn_indexbuf_append_element(ioff, interests->length);
+        ccn_charbuf_append_tt(interests, CCN_DTAG_Interest, CCN_DTAG);
+        ccn_name_init(prefix);
+        ccn_name_append_flatname(prefix, ks->flat->buf + ks->off[j],
+                                 ks->off[j + 1] - ks->off[j], 0, 3);
+        ccn_charbuf_append_charbuf(interests, prefix);
+        ccn_charbuf_append_closer(interests);
+    }
+    ccn_indexbuf_append_element(ioff, interests->length);
+    for (i = 0; i < ks->n; i++) {
+        res = ccn_parse_interest(interests->buf + ioff->buf[i],
+                                 ioff->buf[i + 1] - ioff->buf[i], &pi[i], NULL);
+        if (res < 0)
+            fatal("ccn_parse_interest");
+    }
+    bench_start(b);
+    for (i = 0; i < ks->n; i++) {
+        msg = interests->buf + ioff->buf[i];
+        size = ioff->buf[i + 1] - ioff->buf[i];
+        ccn_flatname_from_ccnb(prefix, msg, size);
+        res = ccn_btree_cursor_seek(c, b->btree, prefix->buf, prefix->length);
+        while (res >= 0 && c->leaf != NULL) {
+            res = ccn_btree_compare(prefix->buf, prefix->length,
+                                    c->leaf, c->index);
+            if (res != 0 && res != -9999)
+                break;
+            res = ccn_btree_match_interest(c->leaf, c->index, msg, &pi[i],
+                                           scratch);
+            if (res == 1) {
+                matched++;
+                break;
+            }
+            if (res == 0)
+                res = ccn_btree_cursor_next(c);
+        }
+        if ((i + 1) % CLEAN_BATCH == 0)
+            bench_clean(b);
+    }
+    bench_report(b, ks, "match", ks->n);
+    if (matched != ks->n)
+        fprintf(stderr, "match: only %d of %d matched\n", matched, ks->n);
+    free(pi);
+    ccn_indexbuf_destroy(&ioff);
+    ccn_charbuf_destroy(&interests);
+    ccn_charbuf_destroy(&prefix);
+    ccn_charbuf_destroy(&scratch);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const char *kinds[] = {"seq", "random", "versioned"};
+    static const char *allbackends[] = {"memory", "directory", "pagefile"};
+    const char *backends = "memory,directory,pagefile";
+    struct keyset ks;
+    struct bench b;
+    int count = 100000;
+    int segments = 16;
+    int fanout = 1999;
+    int nodepool = 512;
+    int opt;
+    int i;
+    int k;
+
+    while ((opt = getopt(argc, argv, "hn:s:f:p:b:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atoi(optarg);
+                break;
+            case 's':
+                segments = atoi(optarg);
+                break;
+            case 'f':
+                fanout = atoi(optarg);
+                break;
+            case 'p':
+                nodepool = atoi(optarg);
+                break;
+            case 'b':
+                backends = optarg;
+                break;
+            case 'h':
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (count < 1 || segments < 1 || segments > 65535 || fanout < 4)
+        usage(argv[0]);
+    srandom(1);
+    for (k = 0; k < 3; k++) {
+        keyset_init(&ks, kinds[k], count, segments);
+        for (i = 0; i < 3; i++) {
+            if (strstr(backends, allbackends[i]) == NULL)
+                continue;
+            bench_init(&b, allbackends[i], fanout, nodepool);
+            bench_insert(&b, &ks);
+            bench_lookup(&b, &ks);
+            bench_scan(&b, &ks);
+            bench_match(&b, &ks);
+            bench_destroy(&b);
+        }
+        keyset_destroy(&ks);
+    }
+    return(0);
+}
@@ -138,6 +138,341 @@ test_btree_io(void)
     return(res);
 }
 
+/**
+ * Tests of ccn_btree_io_from_pagefile() and its methods.
+ *
+ * Assumes TEST_DIRECTORY has been set.
+ */
+static int
+test_btree_pagefile_io(void)
+{
+    int res;
+    int i;
+    struct ccn_btree_node nodespace = {0};
+    struct ccn_btree_node *node = &nodespace;
+    struct ccn_btree_node otherspace = {0};
+    struct ccn_btree_node *other = &otherspace;
+    struct ccn_btree_io *io = NULL;
+    struct ccn_btree_io *io2 = NULL;
+
+    io = ccn_btree_io_from_pagefile(getenv("TEST_DIRECTORY"), NULL);
+    CHKPTR(io);
+    /* Only one store may use the directory at a time */
+    errno = 0;
+    io2 = ccn_btree_io_from_directory(getenv("TEST_DIRECTORY"), NULL);
+    FAILIF(io2 != NULL || errno == 0);
+    node->buf = ccn_charbuf_create();
+    CHKPTR(node->buf);
+    other->buf = ccn_charbuf_create();
+    CHKPTR(other->buf);
+    node->nodeid = 7;
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    FAILIF(node->iodata == NULL);
+    FAILIF(io->maxnodeid != 7);
+    ccn_charbuf_putf(node->buf, "smoke");
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    node->clean = 5;
+    ccn_charbuf_putf(node->buf, "r");
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    /* A neighbor, so that growing node 7 has to move it */
+    other->nodeid = 3;
+    res = io->btopen(io, other);
+    CHKSYS(res);
+    ccn_charbuf_putf(other->buf, "neighbor");
+    res = io->btwrite(io, other);
+    CHKSYS(res);
+    for (i = 0; i < 3000; i++)
+        ccn_charbuf_putf(node->buf, "%04d", i);
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    node->buf->length = 6;
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    res = io->btclose(io, node);
+    CHKSYS(res);
+    FAILIF(node->iodata != NULL);
+    res = io->btclose(io, other);
+    CHKSYS(res);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    /* Make sure it all comes back */
+    io = ccn_btree_io_from_pagefile(getenv("TEST_DIRECTORY"), NULL);
+    CHKPTR(io);
+    FAILIF(io->maxnodeid != 7);
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    node->clean = 0;
+    node->buf->length = 0;
+    ccn_charbuf_putf(node->buf, "garbage");
+    res = io->btread(io, node, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("smoker", ccn_charbuf_as_string(node->buf)));
+    res = io->btopen(io, other);
+    CHKSYS(res);
+    other->buf->length = 0;
+    res = io->btread(io, other, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("neighbor", ccn_charbuf_as_string(other->buf)));
+    res = io->btclose(io, node);
+    CHKSYS(res);
+    res = io->btclose(io, other);
+    CHKSYS(res);
+    FAILIF(io->openfds != 0);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    ccn_charbuf_destroy(&node->buf);
+    ccn_charbuf_destroy(&other->buf);
+    return(res);
+}
+
+/**
+ * Helper for test_btree_pagefile_commit()
+ *
+ * Copies the pages file from one store directory to another.
+ */
+static int
+copy_pages(const char *from, const char *to)
+{
+    struct ccn_charbuf *path = ccn_charbuf_create();
+    char buf[4096];
+    ssize_t n;
+    int ifd, ofd;
+
+    ccn_charbuf_putf(path, "%s/pages", from);
+    ifd = open(ccn_charbuf_as_string(path), O_RDONLY);
+    path->length = 0;
+    ccn_charbuf_putf(path, "%s/pages", to);
+    ofd = open(ccn_charbuf_as_string(path), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ccn_charbuf_destroy(&path);
+    if (ifd == -1 || ofd == -1)
+        return(-1);
+    while ((n = read(ifd, buf, sizeof(buf))) > 0)
+        if (write(ofd, buf, n) != n)
+            return(-1);
+    close(ifd);
+    close(ofd);
+    return(n);
+}
+
+/**
+ * Test that a page store comes back as of its last commit.
+ *
+ * Assumes TEST_DIRECTORY has been set.
+ */
+static int
+test_btree_pagefile_commit(void)
+{
+    int res;
+    struct ccn_btree_node nodespace = {0};
+    struct ccn_btree_node *node = &nodespace;
+    struct ccn_btree_node otherspace = {0};
+    struct ccn_btree_node *other = &otherspace;
+    struct ccn_btree_io *io = NULL;
+    struct ccn_charbuf *cow = ccn_charbuf_create();
+    struct ccn_charbuf *crash = ccn_charbuf_create();
+
+    ccn_charbuf_putf(cow, "%s/cow", getenv("TEST_DIRECTORY"));
+    ccn_charbuf_putf(crash, "%s/crash", getenv("TEST_DIRECTORY"));
+    res = mkdir(ccn_charbuf_as_string(cow), 0777);
+    CHKSYS(res);
+    res = mkdir(ccn_charbuf_as_string(crash), 0777);
+    CHKSYS(res);
+    node->buf = ccn_charbuf_create();
+    other->buf = ccn_charbuf_create();
+    io = ccn_btree_io_from_pagefile(ccn_charbuf_as_string(cow), NULL);
+    CHKPTR(io);
+    FAILIF(io->btcommit == NULL || io->mark != 0);
+    node->nodeid = 2;
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    ccn_charbuf_putf(node->buf, "first");
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    res = io->btcommit(io, 42);
+    CHKSYS(res);
+    FAILIF(io->mark != 42);
+    /* Changes after the commit must not disturb it */
+    node->buf->length = 0;
+    ccn_charbuf_putf(node->buf, "second");
+    node->clean = 0;
+    res = io->btwrite(io, node);
+    CHKSYS(res);
+    other->nodeid = 5;
+    res = io->btopen(io, other);
+    CHKSYS(res);
+    ccn_charbuf_putf(other->buf, "new");
+    res = io->btwrite(io, other);
+    CHKSYS(res);
+    /* What is on disk now is what a crash would leave */
+    res = copy_pages(ccn_charbuf_as_string(cow), ccn_charbuf_as_string(crash));
+    CHKSYS(res);
+    io->btclose(io, node);
+    io->btclose(io, other);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    io = ccn_btree_io_from_pagefile(ccn_charbuf_as_string(crash), NULL);
+    CHKPTR(io);
+    FAILIF(io->mark != 42 || io->maxnodeid != 2);
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    node->clean = 0;
+    res = io->btread(io, node, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("first", ccn_charbuf_as_string(node->buf)));
+    io->btclose(io, node);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    /* Destroying the store committed the rest */
+    io = ccn_btree_io_from_pagefile(ccn_charbuf_as_string(cow), NULL);
+    CHKPTR(io);
+    FAILIF(io->mark != 42 || io->maxnodeid != 5);
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    node->clean = 0;
+    res = io->btread(io, node, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("second", ccn_charbuf_as_string(node->buf)));
+    res = io->btopen(io, other);
+    CHKSYS(res);
+    other->clean = 0;
+    res = io->btread(io, other, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("new", ccn_charbuf_as_string(other->buf)));
+    io->btclose(io, node);
+    io->btclose(io, other);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    ccn_charbuf_destroy(&node->buf);
+    ccn_charbuf_destroy(&other->buf);
+    ccn_charbuf_destroy(&cow);
+    ccn_charbuf_destroy(&crash);
+    return(res);
+}
+
+/**
+ * Helper for test_btree_pagefile_readonly()
+ *
+ * Replaces what a node holds, writes it, and commits with the given mark.
+ */
+static int
+write_and_commit(struct ccn_btree_io *io, struct ccn_btree_node *node,
+                 const char *text, uintmax_t mark)
+{
+    int res;
+
+    node->buf->length = 0;
+    node->clean = 0;
+    ccn_charbuf_putf(node->buf, "%s", text);
+    res = io->btwrite(io, node);
+    if (res >= 0 && mark != 0)
+        res = io->btcommit(io, mark);
+    return(res);
+}
+
+/**
+ * Test that a reader of a page store sees the writer's commits,
+ * and only those.
+ *
+ * Assumes TEST_DIRECTORY has been set.
+ */
+static int
+test_btree_pagefile_readonly(void)
+{
+    int res;
+    struct ccn_btree_node nodespace = {0};
+    struct ccn_btree_node *node = &nodespace;
+    struct ccn_btree_node otherspace = {0};
+    struct ccn_btree_node *other = &otherspace;
+    struct ccn_btree_node rnodespace = {0};
+    struct ccn_btree_node *rnode = &rnodespace;
+    struct ccn_btree_io *io = NULL;
+    struct ccn_btree_io *ro = NULL;
+    struct ccn_btree_io *io2 = NULL;
+    struct ccn_indexbuf *changed = ccn_indexbuf_create();
+    struct ccn_charbuf *dir = ccn_charbuf_create();
+
+    ccn_charbuf_putf(dir, "%s/ro", getenv("TEST_DIRECTORY"));
+    res = mkdir(ccn_charbuf_as_string(dir), 0777);
+    CHKSYS(res);
+    node->buf = ccn_charbuf_create();
+    other->buf = ccn_charbuf_create();
+    rnode->buf = ccn_charbuf_create();
+    io = ccn_btree_io_from_pagefile(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(io);
+    node->nodeid = rnode->nodeid = 2;
+    res = io->btopen(io, node);
+    CHKSYS(res);
+    res = write_and_commit(io, node, "first", 7);
+    CHKSYS(res);
+    ro = ccn_btree_io_from_pagefile_readonly(ccn_charbuf_as_string(dir), NULL);
+    CHKPTR(ro);
+    FAILIF(ro->mark != 7 || ro->btcommit != NULL || ro->btrefresh == NULL);
+    res = ro->btopen(ro, rnode);
+    CHKSYS(res);
+    res = ro->btread(ro, rnode, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("first", ccn_charbuf_as_string(rnode->buf)));
+    /* Writes that are not yet committed are out of sight */
+    res = write_and_commit(io, node, "second", 0);
+    CHKSYS(res);
+    other->nodeid = 5;
+    res = io->btopen(io, other);
+    CHKSYS(res);
+    res = write_and_commit(io, other, "new", 8);
+    CHKSYS(res);
+    res = ro->btrefresh(ro, changed);
+    FAILIF(res != 1 || changed->n != 2 || ro->mark != 8 || ro->maxnodeid != 5);
+    res = ro->btrefresh(ro, changed);
+    FAILIF(res != 0 || changed->n != 2);
+    rnode->clean = 0;
+    res = ro->btread(ro, rnode, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("second", ccn_charbuf_as_string(rnode->buf)));
+    /* A reader writes nothing */
+    rnode->clean = rnode->buf->length;
+    ccn_charbuf_putf(rnode->buf, "!");
+    errno = 0;
+    res = ro->btwrite(ro, rnode);
+    FAILIF(res != -1 || errno != EROFS);
+    /* Falling two commits behind makes reads fail until a refresh */
+    res = write_and_commit(io, node, "third", 9);
+    CHKSYS(res);
+    res = write_and_commit(io, node, "fourth", 10);
+    CHKSYS(res);
+    rnode->clean = 0;
+    errno = 0;
+    res = ro->btread(ro, rnode, 500000);
+    FAILIF(res != -1 || errno != ESTALE);
+    changed->n = 0;
+    res = ro->btrefresh(ro, changed);
+    FAILIF(res != 1 || changed->n != 5 || ro->mark != 10);
+    rnode->clean = 0;
+    res = ro->btread(ro, rnode, 500000);
+    CHKSYS(res);
+    FAILIF(0 != strcmp("fourth", ccn_charbuf_as_string(rnode->buf)));
+    rnode->clean = rnode->buf->length;
+    res = ro->btclose(ro, rnode);
+    CHKSYS(res);
+    res = ro->btdestroy(&ro);
+    CHKSYS(res);
+    /* The reader left the writer's lock alone */
+    io2 = ccn_btree_io_from_pagefile(ccn_charbuf_as_string(dir), NULL);
+    FAILIF(io2 != NULL);
+    io->btclose(io, node);
+    io->btclose(io, other);
+    res = io->btdestroy(&io);
+    CHKSYS(res);
+    ccn_charbuf_destroy(&node->buf);
+    ccn_charbuf_destroy(&other->buf);
+    ccn_charbuf_destroy(&rnode->buf);
+    ccn_indexbuf_destroy(&changed);
+    ccn_charbuf_destroy(&dir);
+    return(res);
+}
+
 /**
  * Helper for test_structure_sizes()
  *
@@ -387,6 +722,7 @@ test_btree_searchnode(void)
         FAILIF(res != testvec[i].expect);
     }
     ccn_charbuf_destroy(&node->buf);
+    ccn_charbuf_destroy(&node->hints);
     free(node);
     return(0);
 }
@@ -489,6 +825,313 @@ test_btree_lookup(void)
     return(res);
 }
 
+int
+test_btree_cursor(void)
+{
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_cursor cursor = {0};
+    struct ccn_btree_cursor *c = &cursor;
+    struct ccn_charbuf *prev = NULL;
+    struct ccn_charbuf *key = NULL;
+    struct ccn_btree_node *leaf2 = NULL;
+    struct ccn_btree_node *leaf3 = NULL;
+    int n;
+    int res;
+    
+    btree = example_btree_small();
+    CHKPTR(btree);
+    leaf2 = ccn_btree_rnode(btree, 2);
+    CHKPTR(leaf2);
+    leaf3 = ccn_btree_rnode(btree, 3);
+    CHKPTR(leaf3);
+    prev = ccn_charbuf_create();
+    key = ccn_charbuf_create();
+    /* Walk forward over both leaves */
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"a", 1);
+    FAILIF(res != 0);
+    FAILIF(c->leaf != leaf2 || c->index != 0);
+    for (n = 0; res >= 0 && c->leaf != NULL; n++) {
+        res = ccn_btree_key_fetch(key, c->leaf, c->index);
+        CHKSYS(res);
+        FAILIF(n > 0 && ccn_btree_compare(prev->buf, prev->length,
+                                          c->leaf, c->index) >= 0);
+        ccn_charbuf_reset(prev);
+        ccn_charbuf_append_charbuf(prev, key);
+        res = ccn_btree_cursor_next(c);
+    }
+    CHKSYS(res);
+    FAILIF(n != ccn_btree_node_nent(leaf2) + ccn_btree_node_nent(leaf3));
+    FAILIF(ccn_btree_cursor_next(c) != 0);
+    /* Seeks within a leaf, and across leaves */
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"d", 1);
+    FAILIF(res != 1 || c->leaf != leaf2 || c->index != 0);
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"odd", 3);
+    FAILIF(res != 1 || c->leaf != leaf2 || c->index != 2);
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"tooth", 5);
+    FAILIF(res != 0 || c->leaf != leaf3 || c->index != 2);
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"truth", 5);
+    FAILIF(res != 1 || c->leaf != leaf3 || c->index != 2);
+    /* Step back from the first entry of the second leaf */
+    res = ccn_btree_cursor_seek(c, btree, prev->buf, 0);
+    FAILIF(res != 0 || c->leaf != leaf2 || c->index != 0);
+    res = ccn_btree_cursor_prev(c);
+    FAILIF(res != 0 || c->leaf != NULL);
+    c->leaf = leaf3;
+    c->index = 0;
+    res = ccn_btree_cursor_prev(c);
+    FAILIF(res != 1 || c->leaf != leaf2);
+    FAILIF(c->index != ccn_btree_node_nent(leaf2) - 1);
+    /* Past the end */
+    res = ccn_btree_cursor_seek(c, btree, (const void *)"zzz", 3);
+    FAILIF(res != 0 || c->leaf != NULL);
+    ccn_charbuf_destroy(&prev);
+    ccn_charbuf_destroy(&key);
+    res = ccn_btree_destroy(&btree);
+    FAILIF(btree != NULL);
+    return(res);
+}
+
+int
+test_btree_builder(void)
+{
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_builder *b = NULL;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_btree_node *leaf = NULL;
+    char payload[8] = "Builder!";
+    char key[20];
+    int nleaves = 0;
+    int i, n;
+    int res;
+    
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    node = ccn_btree_getnode(btree, btree->nextnodeid++, 0);
+    CHKPTR(node);
+    res = ccn_btree_init_node(node, 0, 'R', 0);
+    CHKSYS(res);
+    btree->full = btree->full0 = 5;
+    b = ccn_btree_builder_create(btree, 80);
+    CHKPTR(b);
+    /* Even keys only, so there is something to insert later */
+    for (i = 0; i < 2000; i += 2) {
+        n = sprintf(key, "k%05d", i);
+        res = ccn_btree_builder_append(b, (void *)key, n, payload, sizeof(payload));
+        CHKSYS(res);
+    }
+    res = ccn_btree_builder_append(b, (void *)"k00000", 6, payload, sizeof(payload));
+    FAILIF(res != -1);
+    res = ccn_btree_builder_finish(&b);
+    CHKSYS(res);
+    FAILIF(b != NULL);
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    FAILIF(ccn_btree_node_level(ccn_btree_rnode(btree, 1)) < 4);
+    /* Four entries per node, so 250 leaves */
+    res = ccn_btree_lookup(btree, (void *)"", 0, &leaf);
+    CHKSYS(res);
+    for (; leaf != NULL; nleaves++) {
+        FAILIF(ccn_btree_node_nent(leaf) != 4);
+        res = ccn_btree_next_leaf(btree, leaf, &leaf);
+        CHKSYS(res);
+    }
+    FAILIF(nleaves != 250);
+    for (i = 0; i < 2000; i++) {
+        n = sprintf(key, "k%05d", i);
+        res = ccn_btree_lookup(btree, (void *)key, n, &leaf);
+        CHKSYS(res);
+        FAILIF(CCN_BT_SRCH_FOUND(res) != !(i & 1));
+        if (i & 1) {
+            /* The built tree takes ordinary inserts */
+            res = ccn_btree_insert_entry(leaf, CCN_BT_SRCH_INDEX(res),
+                                         (void *)key, n,
+                                         payload, sizeof(payload));
+            CHKSYS(res);
+            if (ccn_btree_oversize(btree, leaf)) {
+                res = ccn_btree_split(btree, leaf);
+                CHKSYS(res);
+                while (btree->nextsplit != 0) {
+                    node = ccn_btree_rnode(btree, btree->nextsplit);
+                    CHKPTR(node);
+                    res = ccn_btree_split(btree, node);
+                    CHKSYS(res);
+                }
+            }
+        }
+    }
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    FAILIF(btree->errors != 0);
+    res = ccn_btree_destroy(&btree);
+    FAILIF(btree != NULL);
+    /* Sparse nodes - every internal node still needs two entries */
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    node = ccn_btree_getnode(btree, btree->nextnodeid++, 0);
+    CHKPTR(node);
+    res = ccn_btree_init_node(node, 0, 'R', 0);
+    CHKSYS(res);
+    btree->full = btree->full0 = 5;
+    b = ccn_btree_builder_create(btree, 40);
+    CHKPTR(b);
+    for (i = 0; i < 1000; i++) {
+        n = sprintf(key, "k%05d", i);
+        res = ccn_btree_builder_append(b, (void *)key, n, payload, sizeof(payload));
+        CHKSYS(res);
+    }
+    res = ccn_btree_builder_finish(&b);
+    CHKSYS(res);
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    FAILIF(btree->errors != 0);
+    res = ccn_btree_lookup(btree, (void *)"", 0, &leaf);
+    CHKSYS(res);
+    for (n = 0; leaf != NULL && n <= 1000;) {
+        n += ccn_btree_node_nent(leaf);
+        res = ccn_btree_next_leaf(btree, leaf, &leaf);
+        CHKSYS(res);
+    }
+    FAILIF(n != 1000);
+    res = ccn_btree_destroy(&btree);
+    FAILIF(btree != NULL);
+    return(res);
+}
+
+/**
+ * Merge the nodes of a sparse btree until no more will go together.
+ */
+int
+test_btree_merge(void)
+{
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_builder *b = NULL;
+    struct ccn_btree_node *node = NULL;
+    struct ccn_btree_node *leaf = NULL;
+    char payload[8] = "Merge me";
+    char key[20];
+    int merges, nleaves, levels;
+    int i, n;
+    int res;
+    
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    node = ccn_btree_getnode(btree, btree->nextnodeid++, 0);
+    CHKPTR(node);
+    res = ccn_btree_init_node(node, 0, 'R', 0);
+    CHKSYS(res);
+    btree->full = btree->full0 = 5;
+    b = ccn_btree_builder_create(btree, 40);
+    CHKPTR(b);
+    for (i = 0; i < 1000; i++) {
+        n = sprintf(key, "k%05d", i);
+        res = ccn_btree_builder_append(b, (void *)key, n, payload, sizeof(payload));
+        CHKSYS(res);
+    }
+    res = ccn_btree_builder_finish(&b);
+    CHKSYS(res);
+    levels = ccn_btree_node_level(ccn_btree_rnode(btree, 1));
+    /* Deleting an entry */
+    res = ccn_btree_lookup(btree, (void *)"k00000", 6, &leaf);
+    CHKSYS(res);
+    FAILIF(ccn_btree_node_nent(leaf) != 2);
+    res = ccn_btree_delete_entry(leaf, 1);
+    FAILIF(res != 1);
+    res = ccn_btree_delete_entry(leaf, 0);
+    FAILIF(res != -1);
+    res = ccn_btree_insert_entry(leaf, 1, (void *)"k00001", 6,
+                                 payload, sizeof(payload));
+    FAILIF(res != 2);
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    /* Now pack the tree twice as tight */
+    btree->full = btree->full0 = 10;
+    do {
+        merges = 0;
+        res = ccn_btree_lookup(btree, (void *)"", 0, &leaf);
+        CHKSYS(res);
+        while (leaf != NULL) {
+            for (node = leaf; node != NULL && node->parent != 0;
+                 node = ccn_btree_rnode(btree, node->parent)) {
+                res = ccn_btree_merge(btree, node, 100);
+                CHKSYS(res);
+                if (res == 1)
+                    break;
+            }
+            merges += res;
+            if (res == 1 && ccn_btree_node_nent(leaf) > 0)
+                continue;
+            if (res == 1)
+                break; /* the root took over the leaf */
+            res = ccn_btree_next_leaf(btree, leaf, &leaf);
+            CHKSYS(res);
+        }
+    } while (merges > 0);
+    res = ccn_btree_check(btree, NULL);
+    CHKSYS(res);
+    FAILIF(btree->errors != 0);
+    FAILIF(ccn_btree_node_level(ccn_btree_rnode(btree, 1)) >= levels);
+    res = ccn_btree_lookup(btree, (void *)"", 0, &leaf);
+    CHKSYS(res);
+    for (nleaves = 0, n = 0; leaf != NULL; nleaves++) {
+        FAILIF(ccn_btree_node_nent(leaf) > 10);
+        n += ccn_btree_node_nent(leaf);
+        res = ccn_btree_next_leaf(btree, leaf, &leaf);
+        CHKSYS(res);
+    }
+    FAILIF(n != 1000);
+    FAILIF(nleaves > 1000 / 5);
+    for (i = 0; i < 1000; i++) {
+        n = sprintf(key, "k%05d", i);
+        res = ccn_btree_lookup(btree, (void *)key, n, &leaf);
+        CHKSYS(res);
+        FAILIF(!CCN_BT_SRCH_FOUND(res));
+    }
+    res = ccn_btree_destroy(&btree);
+    FAILIF(btree != NULL);
+    return(res);
+}
+
+int
+test_btree_evict(void)
+{
+    struct ccn_btree *btree = NULL;
+    struct ccn_btree_node *node = NULL;
+    int i, res;
+    
+    btree = ccn_btree_create();
+    CHKPTR(btree);
+    /* A root, 4 internal nodes, and 40 leaves, all clean */
+    for (i = 1; i <= 45; i++) {
+        node = ccn_btree_getnode(btree, btree->nextnodeid++, 0);
+        CHKPTR(node);
+        res = ccn_btree_init_node(node, i <= 5 ? (i == 1 ? 2 : 1) : 0,
+                                  i == 1 ? 'R' : 0, 0);
+        CHKSYS(res);
+        node->clean = node->buf->length;
+    }
+    /* Node 7 is hot */
+    for (i = 0; i < 100; i++)
+        ccn_btree_getnode(btree, 7, 0);
+    FAILIF(btree->hits != 100);
+    btree->nodepool = 16;
+    res = ccn_btree_evict(btree);
+    FAILIF(res != 45 - 16);
+    FAILIF(hashtb_n(btree->resident) != 16);
+    for (i = 1; i <= 5; i++)
+        FAILIF(ccn_btree_rnode(btree, i) == NULL);
+    FAILIF(ccn_btree_rnode(btree, 7) == NULL);
+    /* Now by bytes */
+    btree->nodepool = 0;
+    btree->cachelimit = btree->cachebytes / 2;
+    res = ccn_btree_evict(btree);
+    FAILIF(res <= 0);
+    FAILIF(btree->cachebytes > btree->cachelimit);
+    FAILIF(ccn_btree_rnode(btree, 1) == NULL);
+    res = ccn_btree_destroy(&btree);
+    FAILIF(btree != NULL);
+    return(res);
+}
+
 int
 test_basic_btree_insert_entry(void)
 {
@@ -552,6 +1195,59 @@ test_basic_btree_insert_entry(void)
     return(res);
 }
 
+int
+test_btree_key_sharing(void)
+{
+    struct ccn_btree_node node = {};
+    struct ccn_charbuf *key = NULL;
+    unsigned char payload[8] = "Sharing!";
+    const char *prefix = "/parc.com/repo/some/rather/long/name/%FD%05%00%01";
+    char k[80];
+    size_t keybytes = 0;
+    int i, n, res;
+    
+    node.buf = ccn_charbuf_create();
+    key = ccn_charbuf_create();
+    CHKPTR(node.buf);
+    CHKPTR(key);
+    res = ccn_btree_init_node(&node, 0, 0, 0);
+    CHKSYS(res);
+    /* Insert segments out of order, as a split or a repo refill might */
+    for (i = 0; i < 100; i++) {
+        n = sprintf(k, "%s/%%00%%%02X", prefix, (i * 37) % 100);
+        res = ccn_btree_searchnode((void *)k, n, &node);
+        CHKSYS(res);
+        FAILIF(CCN_BT_SRCH_FOUND(res));
+        res = ccn_btree_insert_entry(&node, CCN_BT_SRCH_INDEX(res),
+                                     (void *)k, n, payload, sizeof(payload));
+        CHKSYS(res);
+        keybytes += n;
+    }
+    res = ccn_btree_chknode(&node);
+    CHKSYS(res);
+    for (i = 0; i < 100; i++) {
+        n = sprintf(k, "%s/%%00%%%02X", prefix, i);
+        res = ccn_btree_searchnode((void *)k, n, &node);
+        FAILIF(res != CCN_BT_ENCRES(i, 1));
+        res = ccn_btree_key_fetch(key, &node, i);
+        CHKSYS(res);
+        FAILIF(key->length != n || memcmp(key->buf, k, n) != 0);
+    }
+    /* Keys off the common prefix fall before or after them all */
+    res = ccn_btree_searchnode((void *)"/a", 2, &node);
+    FAILIF(res != CCN_BT_ENCRES(0, 0));
+    res = ccn_btree_searchnode((void *)"/z", 2, &node);
+    FAILIF(res != CCN_BT_ENCRES(100, 0));
+    res = ccn_btree_searchnode((void *)prefix, strlen(prefix), &node);
+    FAILIF(res != CCN_BT_ENCRES(0, 0));
+    /* Most of each key should be shared with a neighbor */
+    FAILIF(node.freelow > keybytes / 4);
+    ccn_charbuf_destroy(&node.buf);
+    ccn_charbuf_destroy(&node.hints);
+    ccn_charbuf_destroy(&key);
+    return(0);
+}
+
 int
 test_btree_inserts_from_stdin(void)
 {
@@ -929,6 +1625,12 @@ ccnbtreetest_main(int argc, char **argv)
     CHKSYS(res);
     res = test_btree_lockfile();
     CHKSYS(res);
+    res = test_btree_pagefile_io();
+    CHKSYS(res);
+    res = test_btree_pagefile_commit();
+    CHKSYS(res);
+    res = test_btree_pagefile_readonly();
+    CHKSYS(res);
     res = test_structure_sizes();
     CHKSYS(res);
     res = test_btree_chknode();
@@ -943,8 +1645,18 @@ ccnbtreetest_main(int argc, char **argv)
     CHKSYS(res);
     res = test_btree_lookup();
     CHKSYS(res);
+    res = test_btree_cursor();
+    CHKSYS(res);
+    res = test_btree_builder();
+    CHKSYS(res);
+    res = test_btree_merge();
+    CHKSYS(res);
+    res = test_btree_evict();
+    CHKSYS(res);
     res = test_basic_btree_insert_entry();
     CHKSYS(res);
+    res = test_btree_key_sharing();
+    CHKSYS(res);
     res = test_flatname();
     CHKSYS(res);
     res = test_insert_content();
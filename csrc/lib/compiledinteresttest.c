@@ -0,0 +1,213 @@
+/**
+ * @file compiledinteresttest.c
+ * Check that compiled interests go out as ccn_express_interest would
+ * send them, and that answers to them are delivered.
+ *
+ * A CCNx test program.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <ccn/ccn.h>
+#include <ccn/ccnd.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/uri.h>
+
+#define NCASES 6
+
+static int content_seen[2];
+
+static enum ccn_upcall_res
+count_content(struct ccn_closure *selfp,
+              enum ccn_upcall_kind kind,
+              struct ccn_upcall_info *info)
+{
+    switch (kind) {
+        case CCN_UPCALL_CONTENT:
+        case CCN_UPCALL_CONTENT_UNVERIFIED:
+        case CCN_UPCALL_CONTENT_BAD:
+        case CCN_UPCALL_CONTENT_KEYMISSING:
+        case CCN_UPCALL_CONTENT_RAW:
+            content_seen[selfp->intdata]++;
+            break;
+        default:
+            break;
+    }
+    return(CCN_UPCALL_RESULT_OK);
+}
+
+static void
+fatal(int lineno, const char *msg)
+{
+    fprintf(stderr, "compiledinteresttest:%d: %s (errno %d)\n",
+            lineno, msg, errno);
+    exit(1);
+}
+#define FAIL(msg) fatal(__LINE__, msg)
+
+/**
+ * Read what the handle has sent and split it into messages.
+ * @returns the number of messages found
+ */
+static int
+read_messages(struct ccn *h, int fd, struct ccn_charbuf *buf,
+              size_t *start, int max)
+{
+    struct ccn_skeleton_decoder dd = {0};
+    struct ccn_skeleton_decoder *d = &dd;
+    unsigned char *p;
+    ssize_t res;
+    size_t i;
+    int n;
+
+    buf->length = 0;
+    for (;;) {
+        ccn_run(h, 50);
+        p = ccn_charbuf_reserve(buf, 8800);
+        res = recv(fd, p, buf->limit - buf->length, MSG_DONTWAIT);
+        if (res <= 0)
+            break;
+        buf->length += res;
+    }
+    for (i = 0, n = 0; i < buf->length && n < max; n++) {
+        start[n] = i;
+        memset(d, 0, sizeof(*d));
+        ccn_skeleton_decode(d, buf->buf + i, buf->length - i);
+        if (d->state != 0 || d->index == 0)
+            FAIL("could not parse what was sent");
+        i += d->index;
+    }
+    start[n] = i;
+    return(n);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct ccn *h = NULL;
+    struct ccn_charbuf *prefix = ccn_charbuf_create();
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    struct ccn_charbuf *templ = ccn_charbuf_create();
+    struct ccn_charbuf *sent = ccn_charbuf_create();
+    struct ccn_charbuf *co = ccn_charbuf_create();
+    struct ccn_compiled_interest *ci[2] = {NULL, NULL};
+    struct ccn_closure plain = { .p = &count_content, .intdata = 0 };
+    struct ccn_closure compiled = { .p = &count_content, .intdata = 1 };
+    static const unsigned char lifetime[2] = {0x20, 0x00};
+    static const size_t compsize[NCASES] = {1, 2, 32, 1, 2, 32};
+    unsigned char comp[32];
+    size_t start[2 * NCASES + 1];
+    struct sockaddr_un addr = {0};
+    int lfd;
+    int fd;
+    int i;
+    int n;
+
+    unsetenv(CCN_SHM_ENVNAME);
+    snprintf(addr.sun_path, sizeof(addr.sun_path),
+             "/tmp/.compiledinteresttest.%d", (int)getpid());
+    addr.sun_family = AF_UNIX;
+    unlink(addr.sun_path);
+    lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd == -1)
+        FAIL("socket");
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(lfd, 1) == -1)
+        FAIL("bind");
+    h = ccn_create();
+    if (ccn_connect(h, addr.sun_path) == -1)
+        FAIL("ccn_connect");
+    fd = accept(lfd, NULL, NULL);
+    if (fd == -1)
+        FAIL("accept");
+    unlink(addr.sun_path);
+
+    ccn_name_from_uri(prefix, "ccnx:/test/compiled/interest");
+    ci[0] = ccn_compile_interest(prefix, NULL);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Interest, CCN_DTAG);
+    ccn_charbuf_append_tt(templ, CCN_DTAG_Name, CCN_DTAG);
+    ccn_charbuf_append_closer(templ); /* </Name> */
+    ccnb_tagged_putf(templ, CCN_DTAG_MaxSuffixComponents, "%d", 1);
+    ccnb_tagged_putf(templ, CCN_DTAG_ChildSelector, "%d", 1);
+    ccnb_append_tagged_blob(templ, CCN_DTAG_InterestLifetime,
+                            lifetime, sizeof(lifetime));
+    ccn_charbuf_append_closer(templ); /* </Interest> */
+    ci[1] = ccn_compile_interest(prefix, templ);
+    if (ci[0] == NULL || ci[1] == NULL)
+        FAIL("ccn_compile_interest");
+
+    /* Each case sends the same interest both ways */
+    for (i = 0; i < NCASES; i++) {
+        memset(comp, 'a' + i, compsize[i]);
+        ccn_charbuf_reset(name);
+        ccn_charbuf_append_charbuf(name, prefix);
+        ccn_name_append(name, comp, compsize[i]);
+        if (ccn_express_interest(h, name, &plain, i < 3 ? NULL : templ) < 0)
+            FAIL("ccn_express_interest");
+        if (ccn_express_compiled_interest(h, ci[i < 3 ? 0 : 1],
+                                          comp, compsize[i], &compiled) < 0)
+            FAIL("ccn_express_compiled_interest");
+    }
+    n = read_messages(h, fd, sent, start, 2 * NCASES);
+    if (n != 2 * NCASES)
+        FAIL("wrong number of interests sent");
+    for (i = 0; i < n; i += 2) {
+        if (start[i + 1] - start[i] != start[i + 2] - start[i + 1] ||
+            0 != memcmp(sent->buf + start[i], sent->buf + start[i + 1],
+                        start[i + 1] - start[i])) {
+            fprintf(stderr, "case %d: encodings differ\n", i / 2);
+            FAIL("compiled interest does not match ccn_express_interest");
+        }
+    }
+
+    /* Answer each case; both interests should see the content */
+    for (i = 0; i < NCASES; i++) {
+        memset(comp, 'a' + i, compsize[i]);
+        ccn_charbuf_reset(name);
+        ccn_charbuf_append_charbuf(name, prefix);
+        ccn_name_append(name, comp, compsize[i]);
+        ccn_charbuf_reset(co);
+        if (ccn_sign_content(h, co, name, NULL, "x", 1) < 0)
+            FAIL("ccn_sign_content");
+        if (write(fd, co->buf, co->length) != co->length)
+            FAIL("write");
+    }
+    for (i = 0; i < 20 && content_seen[1] < NCASES; i++)
+        ccn_run(h, 50);
+    if (content_seen[0] != NCASES || content_seen[1] != NCASES) {
+        fprintf(stderr, "content upcalls: %d plain, %d compiled, of %d\n",
+                content_seen[0], content_seen[1], NCASES);
+        FAIL("answers not delivered");
+    }
+
+    ccn_compiled_interest_destroy(&ci[0]);
+    ccn_compiled_interest_destroy(&ci[1]);
+    ccn_destroy(&h);
+    close(fd);
+    close(lfd);
+    ccn_charbuf_destroy(&prefix);
+    ccn_charbuf_destroy(&name);
+    ccn_charbuf_destroy(&templ);
+    ccn_charbuf_destroy(&sent);
+    ccn_charbuf_destroy(&co);
+    return(0);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file digestbenchtest.c
+ *
+ * A simple test program to benchmark digest performance.
+ *
+ * Compares a digest object per buffer (as ccn_digest_ContentObject used
+ * to do) against ccn_digest_buffers, for a few object sizes.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ccn/digest.h>
+
+#define COUNT 20000
+#define BATCH 64
+#define MAX_SIZE 8192
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start->tv_sec) +
+           ((int)end.tv_usec - (int)start->tv_usec) / 1e6);
+}
+
+static void
+report(const char *what, size_t size, double dt)
+{
+    if (dt <= 0)
+        dt = 1e-6;
+    printf("%-8s %5lu bytes: %8.0f digests/sec, %7.1f MB/sec\n",
+           what, (unsigned long)size, COUNT / dt, COUNT * size / dt / 1e6);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const size_t object_sizes[] = {64, 512, 1500, 4096, MAX_SIZE};
+    unsigned char *bufs = NULL;
+    const void *data[BATCH];
+    size_t sizes[BATCH];
+    unsigned char (*results)[32] = NULL;
+    unsigned char check[32];
+    struct timeval start;
+    struct ccn_digest *d;
+    size_t size;
+    int i, j, k, n, res;
+
+    bufs = malloc(BATCH * MAX_SIZE);
+    results = calloc(BATCH, sizeof(*results));
+    if (bufs == NULL || results == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < BATCH * MAX_SIZE; i++)
+        bufs[i] = random();
+    for (k = 0; k < sizeof(object_sizes) / sizeof(object_sizes[0]); k++) {
+        size = object_sizes[k];
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i++) {
+            d = ccn_digest_create(CCN_DIGEST_SHA256);
+            ccn_digest_init(d);
+            res = ccn_digest_update(d, bufs + (i % BATCH) * MAX_SIZE, size);
+            res |= ccn_digest_final(d, check, sizeof(check));
+            ccn_digest_destroy(&d);
+            if (res < 0) {
+                fprintf(stderr, "ccn_digest failed\n");
+                exit(1);
+            }
+        }
+        report("object", size, elapsed(&start));
+        for (j = 0; j < BATCH; j++) {
+            data[j] = bufs + j * MAX_SIZE;
+            sizes[j] = size;
+        }
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i += n) {
+            n = (COUNT - i < BATCH) ? COUNT - i : BATCH;
+            res = ccn_digest_buffers(CCN_DIGEST_SHA256, n, data, sizes,
+                                     results[0], sizeof(results[0]));
+            if (res < 0) {
+                fprintf(stderr, "ccn_digest_buffers failed\n");
+                exit(1);
+            }
+        }
+        report("buffers", size, elapsed(&start));
+        /* The last buffer digested each way should agree */
+        j = (COUNT - 1) % BATCH;
+        if (memcmp(check, results[j], sizeof(check)) != 0) {
+            fprintf(stderr, "digests differ for size %lu\n",
+                    (unsigned long)size);
+            exit(1);
+        }
+    }
+    free(bufs);
+    free(results);
+    return(0);
+}
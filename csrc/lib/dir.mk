@@ -12,12 +12,14 @@
 # FOR A PARTICULAR PURPOSE.
 #
 
-LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn
+LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn -lpthread
 EXPATLIBS = -lexpat
 CCNLIBDIR = ../lib
 
-PROGRAMS = hashtbtest skel_decode_test \
-    encodedecodetest signbenchtest basicparsetest ccnbtreetest
+PROGRAMS = hashtbtest skel_decode_test compiledinteresttest \
+    encodedecodetest signbenchtest digestbenchtest bloombenchtest \
+    parsebenchtest \
+    basicparsetest ccnbtreetest ccnbtreebench
 
 BROKEN_PROGRAMS =
 DEBRIS = ccn_verifysig _bt_*
@@ -32,12 +34,15 @@ CSRC = ccn_bloom.c \
        ccn_seqwriter.c ccn_signing.c \
        ccn_sockcreate.c ccn_sync.c ccn_traverse.c ccn_uri.c \
        ccn_verifysig.c ccn_versioning.c \
-       ccn_header.c \
+       ccn_header.c ccn_manifest.c \
        ccn_fetch.c \
        encodedecodetest.c hashtb.c hashtbtest.c \
-       signbenchtest.c skel_decode_test.c \
-       basicparsetest.c ccnbtreetest.c \
-       ccn_sockaddrutil.c ccn_setup_sockaddr_un.c
+       signbenchtest.c digestbenchtest.c bloombenchtest.c skel_decode_test.c \
+       parsebenchtest.c \
+       basicparsetest.c ccnbtreetest.c ccnbtreebench.c compiledinteresttest.c \
+       ccn_sockaddrutil.c ccn_setup_sockaddr_un.c ccn_uring.c \
+       ccn_shmring.c ccn_bufprof.c ccn_mux.c ccn_arena.c ccn_window.c \
+       ccn_signer.c ccn_memacct.c ccn_verifier.c
 LIBS = libccn.a
 LIB_OBJS = ccn_client.o ccn_charbuf.o ccn_indexbuf.o ccn_coding.o \
        ccn_dtag_table.o ccn_schedule.o ccn_extend_dict.o \
@@ -47,8 +52,10 @@ LIB_OBJS = ccn_client.o ccn_charbuf.o ccn_indexbuf.o ccn_coding.o \
        ccn_sockcreate.o ccn_sync.o ccn_traverse.o \
        ccn_match.o hashtb.o ccn_merkle_path_asn1.o \
        ccn_sockaddrutil.o ccn_setup_sockaddr_un.o \
-       ccn_bulkdata.o ccn_versioning.o ccn_header.o ccn_fetch.o \
-       ccn_btree.o ccn_btree_content.o ccn_btree_store.o
+       ccn_bulkdata.o ccn_versioning.o ccn_header.o ccn_manifest.o ccn_fetch.o \
+       ccn_btree.o ccn_btree_content.o ccn_btree_store.o ccn_uring.o \
+       ccn_shmring.o ccn_bufprof.o ccn_mux.o ccn_arena.o ccn_window.o \
+       ccn_signer.o ccn_memacct.o ccn_verifier.o
 
 default all: dtag_check lib $(PROGRAMS)
 # Don't try to build shared libs right now.
@@ -75,9 +82,12 @@ shlib: $(SHLIBNAME)
 
 lib: libccn.a
 
-test: default keystore_check encodedecodetest ccnbtreetest
+test: default keystore_check encodedecodetest ccnbtreetest hashtbtest compiledinteresttest
 	./encodedecodetest -o /dev/null
+	./hashtbtest -s 100000
+	./hashtbtest -f 20000
 	./ccnbtreetest
+	./compiledinteresttest
 	rm -R _bt_*
 
 dtag_check: _always
@@ -113,6 +123,9 @@ basicparsetest: basicparsetest.o libccn.a
 encodedecodetest: encodedecodetest.o
 	$(CC) $(CFLAGS) -o $@ encodedecodetest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
+compiledinteresttest: compiledinteresttest.o libccn.a
+	$(CC) $(CFLAGS) -o $@ compiledinteresttest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 ccn_digest.o:
 	$(CC) $(CFLAGS) $(OPENSSL_CFLAGS) -c ccn_digest.c
 
@@ -140,6 +153,9 @@ ccn_merkle_path_asn1.o:
 ccn_header.o:
 	$(CC) $(CFLAGS) -c ccn_header.c
 
+ccn_manifest.o:
+	$(CC) $(CFLAGS) -c ccn_manifest.c
+
 ccn_fetch.o:
 	$(CC) $(CFLAGS) -c ccn_fetch.c
 
@@ -155,8 +171,17 @@ signbenchtest.o:
 signbenchtest: signbenchtest.o
 	$(CC) $(CFLAGS) -o $@ signbenchtest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto 
 
+digestbenchtest: digestbenchtest.o
+	$(CC) $(CFLAGS) -o $@ digestbenchtest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
+bloombenchtest: bloombenchtest.o
+	$(CC) $(CFLAGS) -o $@ bloombenchtest.o $(LDLIBS)
+
+parsebenchtest: parsebenchtest.o
+	$(CC) $(CFLAGS) -o $@ parsebenchtest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 ccndumppcap: ccndumppcap.o
-	$(CC) $(CFLAGS) -o $@ ccndumppcap.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lpcap
+	$(CC) $(CFLAGS) -o $@ ccndumppcap.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto -lpcap -lpthread
 
 ccnbtreetest.o:
 	$(CC) $(CFLAGS) -Dccnbtreetest_main=main -c ccnbtreetest.c
@@ -164,6 +189,9 @@ ccnbtreetest.o:
 ccnbtreetest: ccnbtreetest.o libccn.a
 	$(CC) $(CFLAGS) -o $@ ccnbtreetest.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
+ccnbtreebench: ccnbtreebench.o libccn.a
+	$(CC) $(CFLAGS) -o $@ ccnbtreebench.o $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
+
 clean:
 	rm -f *.o libccn.a libccn.1.$(SHEXT) $(PROGRAMS) depend
 	rm -rf *.dSYM $(DEBRIS) *% *~
@@ -174,14 +202,15 @@ clean:
 ###############################
 ccn_bloom.o: ccn_bloom.c ../include/ccn/bloom.h
 ccn_btree.o: ccn_btree.c ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
-  ../include/ccn/btree.h
+  ../include/ccn/indexbuf.h ../include/ccn/btree.h
 ccn_btree_content.o: ccn_btree_content.c ../include/ccn/btree.h \
   ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
   ../include/ccn/btree_content.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/indexbuf.h \
   ../include/ccn/bloom.h ../include/ccn/uri.h
 ccn_btree_store.o: ccn_btree_store.c ../include/ccn/btree.h \
-  ../include/ccn/charbuf.h ../include/ccn/hashtb.h
+  ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
+  ../include/ccn/indexbuf.h
 ccn_buf_decoder.o: ccn_buf_decoder.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h
@@ -189,16 +218,18 @@ ccn_buf_encoder.o: ccn_buf_encoder.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/signing.h \
   ../include/ccn/ccn_private.h
-ccn_bulkdata.o: ccn_bulkdata.c ../include/ccn/bloom.h \
+ccn_bulkdata.o: ccn_bulkdata.c ../include/ccn/bulkdata.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h
+  ../include/ccn/indexbuf.h ../include/ccn/ccn_private.h \
+  ../include/ccn/schedule.h ../include/ccn/window.h
 ccn_charbuf.o: ccn_charbuf.c ../include/ccn/charbuf.h
-ccn_client.o: ccn_client.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+ccn_client.o: ccn_client.c ../include/ccn/arena.h ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/ccn_private.h ../include/ccn/ccnd.h \
   ../include/ccn/digest.h ../include/ccn/hashtb.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
-  ../include/ccn/signing.h ../include/ccn/keystore.h ../include/ccn/uri.h
+  ../include/ccn/signing.h ../include/ccn/keystore.h \
+  ../include/ccn/shmring.h ../include/ccn/uri.h
 ccn_coding.o: ccn_coding.c ../include/ccn/coding.h
 ccn_digest.o: ccn_digest.c ../include/ccn/digest.h
 ccn_extend_dict.o: ccn_extend_dict.c ../include/ccn/charbuf.h \
@@ -223,11 +254,13 @@ ccn_merkle_path_asn1.o: ccn_merkle_path_asn1.c \
   ../include/ccn/merklepathasn1.h
 ccn_name_util.o: ccn_name_util.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/random.h
+  ../include/ccn/indexbuf.h ../include/ccn/random.h \
+  ../include/ccn/ccn_private.h
 ccn_schedule.o: ccn_schedule.c ../include/ccn/schedule.h
 ccn_seqwriter.o: ccn_seqwriter.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/seqwriter.h
+  ../include/ccn/indexbuf.h ../include/ccn/manifest.h \
+  ../include/ccn/seqwriter.h
 ccn_signing.o: ccn_signing.c ../include/ccn/merklepathasn1.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/signing.h \
@@ -236,9 +269,9 @@ ccn_sockcreate.o: ccn_sockcreate.c ../include/ccn/sockcreate.h
 ccn_sync.o: ccn_sync.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/digest.h ../include/ccn/sync.h ../include/ccn/uri.h
-ccn_traverse.o: ccn_traverse.c ../include/ccn/bloom.h \
-  ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/uri.h
+ccn_traverse.o: ccn_traverse.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/traverse.h ../include/ccn/uri.h
 ccn_uri.o: ccn_uri.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
 ccn_verifysig.o: ccn_verifysig.c ../include/ccn/ccn.h \
@@ -252,19 +285,29 @@ ccn_versioning.o: ccn_versioning.c ../include/ccn/bloom.h \
 ccn_header.o: ccn_header.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
   ../include/ccn/header.h
+ccn_manifest.o: ccn_manifest.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/manifest.h
 ccn_fetch.o: ccn_fetch.c ../include/ccn/fetch.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/uri.h
+  ../include/ccn/indexbuf.h ../include/ccn/uri.h \
+  ../include/ccn/manifest.h ../include/ccn/window.h
 encodedecodetest.o: encodedecodetest.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h ../include/ccn/bloom.h ../include/ccn/uri.h \
   ../include/ccn/digest.h ../include/ccn/keystore.h \
   ../include/ccn/signing.h ../include/ccn/random.h
-hashtb.o: hashtb.c ../include/ccn/hashtb.h
+hashtb.o: hashtb.c ../include/ccn/hashtb.h ../include/ccn/memacct.h
 hashtbtest.o: hashtbtest.c ../include/ccn/hashtb.h
 signbenchtest.o: signbenchtest.c ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
-  ../include/ccn/indexbuf.h ../include/ccn/keystore.h
+  ../include/ccn/indexbuf.h ../include/ccn/keystore.h \
+  ../include/ccn/signing.h
+digestbenchtest.o: digestbenchtest.c ../include/ccn/digest.h
+bloombenchtest.o: bloombenchtest.c ../include/ccn/bloom.h
+parsebenchtest.o: parsebenchtest.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h
 skel_decode_test.o: skel_decode_test.c ../include/ccn/charbuf.h \
   ../include/ccn/coding.h
 basicparsetest.o: basicparsetest.c ../include/ccn/ccn.h \
@@ -276,7 +319,32 @@ ccnbtreetest.o: ccnbtreetest.c ../include/ccn/btree.h \
   ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
   ../include/ccn/btree_content.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
+ccnbtreebench.o: ccnbtreebench.c ../include/ccn/btree.h \
+  ../include/ccn/charbuf.h ../include/ccn/hashtb.h \
+  ../include/ccn/btree_content.h ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/indexbuf.h ../include/ccn/uri.h
+compiledinteresttest.o: compiledinteresttest.c ../include/ccn/ccn.h \
+  ../include/ccn/coding.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h ../include/ccn/ccnd.h ../include/ccn/uri.h
 ccn_sockaddrutil.o: ccn_sockaddrutil.c ../include/ccn/charbuf.h \
   ../include/ccn/sockaddrutil.h
-ccn_setup_sockaddr_un.o: ccn_setup_sockaddr_un.c ../include/ccn/ccnd.h \
-  ../include/ccn/ccn_private.h
+ccn_setup_sockaddr_un.o: ccn_setup_sockaddr_un.c ../include/ccn/ccn.h \
+  ../include/ccn/ccnd.h ../include/ccn/ccn_private.h
+ccn_uring.o: ccn_uring.c ../include/ccn/uring.h
+ccn_shmring.o: ccn_shmring.c ../include/ccn/charbuf.h \
+  ../include/ccn/shmring.h
+ccn_bufprof.o: ccn_bufprof.c ../include/ccn/bufprof.h
+ccn_mux.o: ccn_mux.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/ccn_private.h ../include/ccn/hashtb.h \
+  ../include/ccn/mux.h
+ccn_arena.o: ccn_arena.c ../include/ccn/arena.h ../include/ccn/charbuf.h \
+  ../include/ccn/indexbuf.h
+ccn_window.o: ccn_window.c ../include/ccn/window.h
+ccn_signer.o: ccn_signer.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/schedule.h ../include/ccn/signer.h
+ccn_memacct.o: ccn_memacct.c ../include/ccn/memacct.h
+ccn_verifier.o: ccn_verifier.c ../include/ccn/ccn.h ../include/ccn/coding.h \
+  ../include/ccn/charbuf.h ../include/ccn/indexbuf.h \
+  ../include/ccn/ccn_private.h ../include/ccn/signing.h
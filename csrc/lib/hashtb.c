@@ -17,19 +17,41 @@
  * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
  * Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <fcntl.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <ccn/hashtb.h>
+#include <ccn/memacct.h>
+
+/*
+ * The table is open-addressed.  Each slot has a one-byte tag in a
+ * parallel control array, and lookups examine a group of tags at once
+ * (with SSE2 where available, otherwise 8 at a time in a 64-bit word).
+ * The entries themselves are still allocated individually, since
+ * clients hold on to the data pointers.  All live entries are also on
+ * a list in insertion order; enumerators walk that list, so that
+ * resizing the slot array does not disturb an enumeration in progress.
+ *
+ * Growing is incremental.  The new slot array takes all the inserts,
+ * and each seek or delete moves a few slots' worth of entries over
+ * from the old one, so the cost of a resize is spread out evenly.
+ * Until the old array is drained, lookups consult both.
+ */
 
 struct node;
 struct node {
-    struct node* link;
+    struct node *next;      /* enumeration order, kept after delete */
+    struct node *prev;      /* enumeration order, or deferred cleanup */
     size_t hash;
     size_t keysize;
     size_t extsize;
+    int deleted;
     /* user data follows immediately, followed by key */
 };
 #define DATA(ht, p) ((void *)((p) + 1))
@@ -38,42 +60,433 @@ struct node {
 #define CHECKHTE(ht, hte) ((uintptr_t)((hte)->priv[1]) == ~(uintptr_t)(ht))
 #define MARKHTE(ht, hte) ((hte)->priv[1] = (void*)~(uintptr_t)(ht))
 
+/* Empty is 0 so that a fresh control array can come from calloc */
+#define CTRL_EMPTY   0x00
+#define CTRL_DELETED 0x01
+/* A full slot's control byte has the high bit and the top 7 bits of hash */
+#define CTRL_FULL    0x80
+#define TAG(h) ((unsigned char)(CTRL_FULL | ((h) >> (8 * sizeof(size_t) - 7))))
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GROUP 16
+typedef unsigned groupmask;
+static groupmask
+group_match(const unsigned char *g, unsigned char tag)
+{
+    __m128i c = _mm_loadu_si128((const __m128i *)g);
+    return(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8((char)tag))));
+}
+static groupmask
+group_empty(const unsigned char *g)
+{
+    return(group_match(g, CTRL_EMPTY));
+}
+static groupmask
+group_free(const unsigned char *g)
+{
+    return(~_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g)) & 0xFFFF);
+}
+#define LANE_SHIFT 0
+#else
+#define GROUP 8
+typedef uint64_t groupmask;
+#define LSBS 0x0101010101010101ULL
+#define MSBS 0x8080808080808080ULL
+static uint64_t
+group_load(const unsigned char *g)
+{
+    uint64_t w = 0;
+    int i;
+    for (i = GROUP - 1; i >= 0; i--)
+        w = (w << 8) | g[i];
+    return(w);
+}
+/* May report false matches in full slots; callers check the entry */
+static groupmask
+group_match(const unsigned char *g, unsigned char tag)
+{
+    uint64_t x = group_load(g) ^ (LSBS * tag);
+    return((x - LSBS) & ~x & MSBS);
+}
+static groupmask
+group_empty(const unsigned char *g)
+{
+    /* May report false empties, but only if there is a real one */
+    uint64_t w = group_load(g);
+    return((w - LSBS) & ~w & MSBS);
+}
+static groupmask
+group_free(const unsigned char *g)
+{
+    return(~group_load(g) & MSBS);
+}
+#define LANE_SHIFT 3
+#endif
+
+/** Index of the lowest lane in a non-empty mask */
+static unsigned
+group_lane(groupmask m)
+{
+#if defined(__GNUC__)
+    if (sizeof(m) > sizeof(unsigned))
+        return(__builtin_ctzll(m) >> LANE_SHIFT);
+    return(__builtin_ctz(m) >> LANE_SHIFT);
+#else
+    unsigned i;
+    for (i = 0; (m & 1) == 0; i++)
+        m >>= 1;
+    return(i >> LANE_SHIFT);
+#endif
+}
+
+struct slots {
+    unsigned char *ctrl;        /* control byte per slot */
+    struct node **slot;
+    unsigned capacity;          /* Number of slots, a power of 2 */
+    unsigned growth_left;       /* Inserts into empty slots before resize */
+};
+
 struct hashtb {
-    struct node **bucket;
+    struct slots cur;           /* Where new entries go */
+    struct slots old;           /* Being drained, if old.capacity != 0 */
+    unsigned migrated;          /* Slots of old already moved to cur */
+    struct node *head;          /* All entries, in insertion order */
+    struct node *tail;
     size_t item_size;           /* Size of client's per-entry data */
-    unsigned n_buckets;
     int n;                      /* Number of entries */
     int refcount;               /* Number of open enumerators */
     struct node *deferred;      /* deferred cleanup */
     struct hashtb_param param;  /* saved client parameters */
+    uint64_t key[2];            /* this table's hash key */
 };
 
+/* Keep at least 1/8 of the slots empty so that probes terminate */
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+/*
+ * Old slots to migrate per operation.  Since the new array is at least
+ * as big as the old, and at most 7/16 full when it replaces it, this
+ * leaves ample room to finish draining before cur fills up.
+ */
+#define MIGRATE_STEP (4 * GROUP)
+
+/*
+ * Keys are hashed with SipHash-1-3, keyed separately for each table,
+ * so that nobody outside can choose keys that collide.  With a fixed
+ * hash, a peer that picks names or nonces could make every one of them
+ * land on the same probe sequence, and each lookup would then have to
+ * look at all of them.
+ *
+ * The length goes in at the end, so that the state after the whole
+ * words of a key can be shared by all of its prefixes.
+ */
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+} while (0)
+
+/** Absorb the whole words of a key, one compression round each */
+#define SIPWORDS(v0, v1, v2, v3, key, i, size) do { \
+    uint64_t m_; \
+    for (; i + 8 <= size; i += 8) { \
+        memcpy(&m_, key + i, 8); \
+        v3 ^= m_; \
+        SIPROUND(v0, v1, v2, v3); \
+        v0 ^= m_; \
+    } \
+} while (0)
+
+/** Mix in the last (key_size % 8) bytes and the length */
+static size_t
+sip_finish(uint64_t v0, uint64_t v1, uint64_t v2, uint64_t v3,
+           const unsigned char *tail, size_t key_size)
+{
+    uint64_t m = (uint64_t)key_size << 56;
+    size_t i;
+    for (i = 0; i < (key_size & 7); i++)
+        m |= (uint64_t)tail[i] << (8 * i);
+    v3 ^= m;
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return((size_t)(v0 ^ v1 ^ v2 ^ v3));
+}
+
+static size_t
+sip_hash(const uint64_t *k, const unsigned char *key, size_t key_size)
+{
+    uint64_t v0 = k[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k[1] ^ 0x7465646279746573ULL;
+    size_t i = 0;
+    SIPWORDS(v0, v1, v2, v3, key, i, key_size);
+    return(sip_finish(v0, v1, v2, v3, key + i, key_size));
+}
+
+/*
+ * The process-wide key, from which each table's key is drawn.
+ * It is set up once, on first use, by whichever thread gets there first.
+ */
+static uint64_t hash_key[2];
+static uint64_t hash_key_serial;
+static pthread_once_t hash_key_once = PTHREAD_ONCE_INIT;
+
+static void
+hash_key_init(void)
+{
+    int fd;
+    ssize_t res = -1;
+    
+    fd = open("/dev/urandom", O_RDONLY);
+    if (fd != -1) {
+        res = read(fd, hash_key, sizeof(hash_key));
+        close(fd);
+    }
+    if (res != sizeof(hash_key)) {
+        /* better than no entropy */
+        hash_key[0] ^= (uint64_t)getpid() << 32 ^ (uint64_t)time(NULL);
+        hash_key[1] ^= (uint64_t)(uintptr_t)&hash_key ^ (uint64_t)clock();
+    }
+}
+
+/** Give a new table a key of its own */
+static void
+hash_key_draw(uint64_t *k)
+{
+    uint64_t serial;
+
+    pthread_once(&hash_key_once, &hash_key_init);
+    /* Tables may be made in several threads at once */
+    serial = __sync_add_and_fetch(&hash_key_serial, 2) - 1;
+    k[0] = sip_hash(hash_key, (const void *)&serial, 8);
+    serial++;
+    k[1] = sip_hash(hash_key, (const void *)&serial, 8);
+}
+
 size_t
 hashtb_hash(const unsigned char *key, size_t key_size)
 {
-    size_t h;
-    size_t i;
-    for (h = key_size + 23, i = 0; i < key_size; i++)
-        h = ((h << 6) ^ (h >> 27)) + key[i];
-    return(h);
+    pthread_once(&hash_key_once, &hash_key_init);
+    return(sip_hash(hash_key, key, key_size));
+}
+
+size_t
+hashtb_table_hash(struct hashtb *ht, const unsigned char *key, size_t key_size)
+{
+    return(sip_hash(ht->key, key, key_size));
+}
+
+void
+hashtb_hash_prefixes(struct hashtb *ht,
+                     const unsigned char *buf, const size_t *offsets, int n,
+                     size_t *hashes)
+{
+    const unsigned char *key;
+    uint64_t v0 = ht->key[0] ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = ht->key[1] ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = ht->key[0] ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = ht->key[1] ^ 0x7465646279746573ULL;
+    size_t i = 0;
+    size_t size;
+    int k;
+    if (n <= 0)
+        return;
+    key = buf + offsets[0];
+    for (k = 0; k < n; k++) {
+        size = offsets[k] - offsets[0];
+        SIPWORDS(v0, v1, v2, v3, key, i, size);
+        hashes[k] = sip_finish(v0, v1, v2, v3, key + i, size);
+    }
+}
+
+/**
+ * Set up an empty slot array with the given capacity.
+ * @returns 0 for success, -1 for ENOMEM (in which case t is unchanged).
+ */
+static int
+slots_alloc(struct hashtb *ht, struct slots *t, unsigned capacity)
+{
+    struct ccn_memacct *a = ht->param.memacct;
+    unsigned char *ctrl;
+    struct node **slot;
+    ctrl = ccn_memacct_calloc(a, capacity, 1);
+    slot = ccn_memacct_calloc(a, capacity, sizeof(slot[0]));
+    if (ctrl == NULL || slot == NULL) {
+        ccn_memacct_free(a, ctrl);
+        ccn_memacct_free(a, slot);
+        return(-1);
+    }
+    t->ctrl = ctrl;
+    t->slot = slot;
+    t->capacity = capacity;
+    t->growth_left = MAX_LOAD(capacity);
+    return(0);
+}
+
+static void
+slots_free(struct hashtb *ht, struct slots *t)
+{
+    ccn_memacct_free(ht->param.memacct, t->ctrl);
+    ccn_memacct_free(ht->param.memacct, t->slot);
+    memset(t, 0, sizeof(*t));
+}
+
+/**
+ * Put node p into a free slot.
+ * The slot array must have room, as indicated by growth_left.
+ */
+static void
+slots_insert(struct slots *t, struct node *p)
+{
+    unsigned gmask = t->capacity / GROUP - 1;
+    unsigned g = p->hash & gmask;
+    unsigned step;
+    unsigned i;
+    groupmask m;
+    for (step = 1;; step++) {
+        m = group_free(t->ctrl + g * GROUP);
+        if (m != 0)
+            break;
+        g = (g + step) & gmask;
+    }
+    i = g * GROUP + group_lane(m);
+    if (t->ctrl[i] == CTRL_EMPTY)
+        t->growth_left -= 1;
+    t->ctrl[i] = TAG(p->hash);
+    t->slot[i] = p;
+}
+
+/**
+ * Find the entry with the given key, or node p itself if key is NULL.
+ * @returns the slot index, or capacity if not found.
+ */
+static unsigned
+slots_find(struct hashtb *ht, struct slots *t, size_t h,
+           const void *key, size_t keysize, struct node *p)
+{
+    unsigned gmask = t->capacity / GROUP - 1;
+    unsigned g = h & gmask;
+    unsigned char tag = TAG(h);
+    unsigned step;
+    unsigned i;
+    const unsigned char *c;
+    struct node *q;
+    groupmask m;
+    if (t->capacity == 0)
+        return(0);
+    for (step = 1;; step++) {
+        c = t->ctrl + g * GROUP;
+        for (m = group_match(c, tag); m != 0; m &= m - 1) {
+            i = g * GROUP + group_lane(m);
+            q = t->slot[i];
+            if (q == NULL || q->hash != h)
+                continue;
+            if (key == NULL ? q == p :
+                (keysize == q->keysize && 0 == memcmp(key, KEY(ht, q), keysize)))
+                return(i);
+        }
+        if (group_empty(c) != 0)
+            return(t->capacity);
+        g = (g + step) & gmask;
+    }
+}
+
+/** Vacate slot i */
+static void
+slots_remove(struct slots *t, unsigned i)
+{
+    t->slot[i] = NULL;
+    /* If no probe ever went past this group, the slot is simply empty */
+    if (group_empty(t->ctrl + (i & ~(GROUP - 1))) != 0) {
+        t->ctrl[i] = CTRL_EMPTY;
+        t->growth_left += 1;
+    }
+    else
+        t->ctrl[i] = CTRL_DELETED;
+}
+
+/**
+ * Move up to n slots' worth of entries from the old array to the current one.
+ * Pass ~0U to finish the job.
+ */
+static void
+migrate(struct hashtb *ht, unsigned n)
+{
+    struct slots *old = &ht->old;
+    unsigned i;
+    for (i = ht->migrated; i < old->capacity && n > 0; i++, n--) {
+        if ((old->ctrl[i] & CTRL_FULL) != 0) {
+            slots_insert(&ht->cur, old->slot[i]);
+            /* leave a tombstone so probes for the rest still work */
+            old->ctrl[i] = CTRL_DELETED;
+            old->slot[i] = NULL;
+        }
+    }
+    ht->migrated = i;
+    if (i == old->capacity)
+        slots_free(ht, old);
+}
+
+/**
+ * Start moving all the entries into a fresh slot array.
+ * This also clears out any deleted slots.
+ * If the previous resize is still under way, it is finished first.
+ */
+static void
+slots_resize(struct hashtb *ht, unsigned capacity)
+{
+    struct slots fresh;
+    if (slots_alloc(ht, &fresh, capacity) < 0)
+        return; /* ENOMEM */
+    if (ht->old.capacity != 0)
+        migrate(ht, ~0U);
+    ht->old = ht->cur;
+    ht->cur = fresh;
+    ht->migrated = 0;
+}
+
+/**
+ * Locate the entry with the given key (or node p, if key is NULL).
+ * @returns the slot array holding it, or NULL; *ip gets the index.
+ */
+static struct slots *
+locate(struct hashtb *ht, size_t h, const void *key, size_t keysize,
+       struct node *p, unsigned *ip)
+{
+    *ip = slots_find(ht, &ht->cur, h, key, keysize, p);
+    if (*ip != ht->cur.capacity)
+        return(&ht->cur);
+    *ip = slots_find(ht, &ht->old, h, key, keysize, p);
+    if (*ip != ht->old.capacity)
+        return(&ht->old);
+    return(NULL);
 }
 
 struct hashtb *
 hashtb_create(size_t item_size, const struct hashtb_param *param)
 {
     struct hashtb *ht;
-    ht = calloc(1, sizeof(*ht));
+    ht = ccn_memacct_calloc(param != NULL ? param->memacct : NULL,
+                            1, sizeof(*ht));
     if (ht != NULL) {
         ht->item_size = item_size;
         ht->n = 0;
-        ht->n_buckets = 7;
-        ht->bucket = calloc(ht->n_buckets, sizeof(ht->bucket[0]));
-	if (ht->bucket == NULL) {
-		free(ht);
-		return (NULL); /*ENOMEM*/
-	}
         if (param != NULL)
             ht->param = *param;
+        hash_key_draw(ht->key);
+        if (slots_alloc(ht, &ht->cur, GROUP) < 0) {
+            ccn_memacct_free(ht->param.memacct, ht);
+            return(NULL); /*ENOMEM*/
+        }
     }
     return(ht);
 }
@@ -92,12 +505,14 @@ hashtb_destroy(struct hashtb **htp)
     if (*htp != NULL) {
         struct hashtb_enumerator tmp;
         struct hashtb_enumerator *e = hashtb_start(*htp, &tmp);
+        (*htp)->param.shrink = 0;
         while (e->key != NULL)
             hashtb_delete(e);
         hashtb_end(&tmp);
         if ((*htp)->refcount == 0) {
-            free((*htp)->bucket);
-            free(*htp);
+            slots_free(*htp, &(*htp)->cur);
+            slots_free(*htp, &(*htp)->old);
+            ccn_memacct_free((*htp)->param.memacct, *htp);
             *htp = NULL;
         }
         else
@@ -114,30 +529,31 @@ hashtb_n(struct hashtb *ht)
 void *
 hashtb_lookup(struct hashtb *ht, const void *key, size_t keysize)
 {
-    struct node *p;
-    size_t h;
     if (key == NULL)
         return(NULL);
-    h = hashtb_hash(key, keysize);
-    for (p = ht->bucket[h % ht->n_buckets]; p != NULL; p = p->link) {
-        if (p->hash < h)
-            continue;
-        if (p->hash > h)
-            break;
-        if (keysize == p->keysize && 0 == memcmp(key, KEY(ht, p), keysize))
-            return(DATA(ht, p));
-    }
-    return(NULL);
+    return(hashtb_lookup_hashed(ht, key, keysize,
+                                hashtb_table_hash(ht, key, keysize)));
+}
+
+void *
+hashtb_lookup_hashed(struct hashtb *ht, const void *key, size_t keysize,
+                     size_t hash)
+{
+    struct slots *t;
+    unsigned i;
+    if (key == NULL)
+        return(NULL);
+    t = locate(ht, hash, key, keysize, NULL, &i);
+    if (t == NULL)
+        return(NULL);
+    return(DATA(ht, t->slot[i]));
 }
 
 static void
-setpos(struct hashtb_enumerator *hte, struct node **pp)
+setpos(struct hashtb_enumerator *hte, struct node *p)
 {
     struct hashtb *ht = hte->ht;
-    struct node *p = NULL;
-    hte->priv[0] = pp;
-    if (pp != NULL)
-        p = *pp;
+    hte->priv[0] = p;
     if (p == NULL) {
         hte->key = NULL;
         hte->keysize = 0;
@@ -152,13 +568,13 @@ setpos(struct hashtb_enumerator *hte, struct node **pp)
     }
 }
 
-static struct node **
-scan_buckets(struct hashtb *ht, unsigned b)
+/** Skip over entries deleted since the enumerator was positioned */
+static struct node *
+live(struct node *p)
 {
-    for (; b < ht->n_buckets; b++)
-        if (ht->bucket[b] != NULL)
-            return &(ht->bucket[b]);
-    return(NULL);
+    while (p != NULL && p->deleted)
+        p = p->next;
+    return(p);
 }
 
 #define MAX_ENUMERATORS 30
@@ -171,7 +587,7 @@ hashtb_start(struct hashtb *ht, struct hashtb_enumerator *hte)
     ht->refcount++;
     if (ht->refcount > MAX_ENUMERATORS)
         abort(); /* probably somebody is missing a call to hashtb_end() */
-    setpos(hte, scan_buckets(ht, 0));
+    setpos(hte, ht->head);
     return(hte);
 }
 
@@ -186,12 +602,12 @@ hashtb_end(struct hashtb_enumerator *hte)
         /* do deferred deallocation */
         f = ht->param.finalize;
         while (ht->deferred != NULL) {
-            setpos(hte, &(ht->deferred));
+            p = ht->deferred;
+            setpos(hte, p);
             if (f != NULL)
                 (*f)(hte);
-            p = ht->deferred;
-            ht->deferred = p->link;
-            free(p);
+            ht->deferred = p->prev;
+            ccn_memacct_free(ht->param.memacct, p);
         }
     }
     hte->priv[0] = 0;
@@ -202,58 +618,74 @@ hashtb_end(struct hashtb_enumerator *hte)
 void
 hashtb_next(struct hashtb_enumerator *hte)
 {
-    struct node **pp = hte->priv[0];
-    struct node **ppp;
-    if (pp != NULL) {
-        ppp = pp;
-        pp = &((*pp)->link);
-        if (*pp == NULL)
-           pp = scan_buckets(hte->ht, ((*ppp)->hash % hte->ht->n_buckets) + 1);
-    }
-    setpos(hte, pp);
+    struct node *p = hte->priv[0];
+    if (p != NULL)
+        p = live(p->next);
+    setpos(hte, p);
 }
 
 int
 hashtb_seek(struct hashtb_enumerator *hte, const void *key, size_t keysize, size_t extsize)
+{
+    if (key == NULL) {
+        setpos(hte, NULL);
+        return(-1);
+    }
+    return(hashtb_seek_hashed(hte, key, keysize, extsize,
+                              hashtb_table_hash(hte->ht, key, keysize)));
+}
+
+int
+hashtb_seek_hashed(struct hashtb_enumerator *hte,
+                   const void *key, size_t keysize, size_t extsize,
+                   size_t h)
 {
     struct node *p = NULL;
     struct hashtb *ht = hte->ht;
-    struct node **pp;
-    size_t h;
+    struct slots *t;
+    unsigned i;
     if (key == NULL) {
         setpos(hte, NULL);
         return(-1);
     }
-    if (ht->refcount == 1 && ht->n > ht->n_buckets * 3) {
-        ht->refcount--;
-        hashtb_rehash(ht, 2 * ht->n + 1);
-        ht->refcount++;
-    }
-    h = hashtb_hash(key, keysize);
-    pp = &(ht->bucket[h % ht->n_buckets]);
-    for (p = *pp; p != NULL; pp = &(p->link), p = p->link) {
-        if (p->hash < h)
-            continue;
-        if (p->hash > h)
-            break;
-        if (keysize == p->keysize && 0 == memcmp(key, KEY(ht, p), keysize)) {
-            setpos(hte, pp);
-            return(HT_OLD_ENTRY);
-        }
+    if (ht->old.capacity != 0)
+        migrate(ht, MIGRATE_STEP);
+    t = locate(ht, h, key, keysize, NULL, &i);
+    if (t != NULL) {
+        setpos(hte, t->slot[i]);
+        return(HT_OLD_ENTRY);
     }
-    p = calloc(1, sizeof(*p) + ht->item_size + keysize + extsize);
+    p = ccn_memacct_calloc(ht->param.memacct, 1,
+                           sizeof(*p) + ht->item_size + keysize + extsize);
     if (p == NULL) {
         setpos(hte, NULL);
         return(-1);
     }
+    if (ht->cur.growth_left == 0) {
+        /* Grow, unless it is mostly deleted slots that need clearing */
+        if ((unsigned)ht->n >= MAX_LOAD(ht->cur.capacity) / 2)
+            slots_resize(ht, 2 * ht->cur.capacity);
+        else
+            slots_resize(ht, ht->cur.capacity);
+        if (ht->cur.growth_left == 0) {
+            ccn_memacct_free(ht->param.memacct, p);
+            setpos(hte, NULL);
+            return(-1);
+        }
+    }
     memcpy(KEY(ht, p), key, keysize + extsize);
     p->hash = h;
     p->keysize = keysize;
     p->extsize = extsize;
-    p->link = *pp;
-    *pp = p;
-    hte->ht->n += 1;
-    setpos(hte, pp);
+    slots_insert(&ht->cur, p);
+    p->prev = ht->tail;
+    if (ht->tail != NULL)
+        ht->tail->next = p;
+    else
+        ht->head = p;
+    ht->tail = p;
+    ht->n += 1;
+    setpos(hte, p);
     return(HT_NEW_ENTRY);
 }
 
@@ -261,54 +693,64 @@ void
 hashtb_delete(struct hashtb_enumerator *hte)
 {
     struct hashtb *ht = hte->ht;
-    struct node **pp = hte->priv[0];
-    struct node *p = *pp;
-    if ((p != NULL) && CHECKHTE(ht, hte) && KEY(ht, p) == hte->key) {
-        *pp = p->link;
-        if (*pp == NULL)
-           pp = scan_buckets(hte->ht, (p->hash % hte->ht->n_buckets) + 1);
-        hte->ht->n -= 1;
+    struct node *p = hte->priv[0];
+    struct node *next;
+    struct slots *t;
+    unsigned i;
+    if ((p != NULL) && CHECKHTE(ht, hte) && KEY(ht, p) == hte->key &&
+          !p->deleted) {
+        t = locate(ht, p->hash, NULL, 0, p, &i);
+        if (t == NULL)
+            abort(); /* table is corrupt */
+        slots_remove(t, i);
+        if (p->prev != NULL)
+            p->prev->next = p->next;
+        else
+            ht->head = p->next;
+        if (p->next != NULL)
+            p->next->prev = p->prev;
+        else
+            ht->tail = p->prev;
+        next = live(p->next);
+        p->deleted = 1;
+        ht->n -= 1;
+        if (ht->param.shrink && ht->refcount == 1 &&
+              ht->cur.capacity >= 4 * GROUP &&
+              (unsigned)ht->n < ht->cur.capacity / 16) {
+            /* Mostly empty; move what is left into a quarter of the room */
+            slots_resize(ht, ht->cur.capacity / 4);
+            if (ht->old.capacity != 0)
+                migrate(ht, ~0U);
+        }
+        else if (ht->old.capacity != 0)
+            migrate(ht, MIGRATE_STEP);
         if (ht->refcount == 1) {
             hashtb_finalize_proc f = ht->param.finalize;
             if (f != NULL)
                 (*f)(hte);
-            free(p);
+            ccn_memacct_free(ht->param.memacct, p);
         }
         else {
-            p->link = ht->deferred;
+            /* p->next stays put for the sake of other enumerators */
+            p->prev = ht->deferred;
             ht->deferred = p;
         }
-        setpos(hte, pp);
+        setpos(hte, next);
     }
 }
 
 void
 hashtb_rehash(struct hashtb *ht, unsigned n_buckets)
 {
-    struct node **bucket = NULL;
-    struct node **pp;
-    struct node *p;
-    struct node *q;
-    size_t h;
-    unsigned i;
-    unsigned b;
-    if (ht->refcount != 0 || n_buckets < 1 || n_buckets == ht->n_buckets)
+    unsigned capacity = GROUP;
+    if (ht->refcount != 0 || n_buckets < 1)
         return;
-    bucket = calloc(n_buckets, sizeof(bucket[0]));
-    if (bucket == NULL) return; /* ENOMEM */
-    for (i = 0; i < ht->n_buckets; i++) {
-        for (p = ht->bucket[i]; p != NULL; p = q) {
-            q = p->link;
-            h = p->hash;
-            b = h % n_buckets;
-            for (pp = &bucket[b]; *pp != NULL && ((*pp)->hash < h); pp = &((*pp)->link))
-                continue;
-            p->link = *pp;
-            *pp = p;
-        }
-    }
-    free(ht->bucket);
-    ht->bucket = bucket;
-    ht->n_buckets = n_buckets;
+    if (n_buckets < (unsigned)ht->n)
+        n_buckets = ht->n;
+    while (MAX_LOAD(capacity) < n_buckets && capacity < (~0U >> 1) + 1)
+        capacity *= 2;
+    if (capacity != ht->cur.capacity)
+        slots_resize(ht, capacity);
+    if (ht->old.capacity != 0)
+        migrate(ht, ~0U);
 }
-
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 #include <ccn/hashtb.h>
 
 static void
@@ -44,6 +45,234 @@ finally(struct hashtb_enumerator *e)
     fprintf(stderr, "%s deleting %s\n", who, (const char *)e->key);
 }
 
+static double
+usec(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return(now.tv_sec * 1e6 + now.tv_usec);
+}
+
+/**
+ * Insert n keys, timing each one, and report the worst case.
+ * Growing the table should not cause any one insert to take much longer
+ * than the rest.
+ */
+static int
+insert_latency(int n)
+{
+    char key[32];
+    struct hashtb *h = hashtb_create(sizeof(unsigned), NULL);
+    struct hashtb_enumerator eee;
+    struct hashtb_enumerator *e = hashtb_start(h, &eee);
+    double t0, t1, start, worst = 0;
+    int worst_at = 0;
+    int i;
+    int res = 0;
+
+    start = t1 = usec();
+    for (i = 0; i < n; i++) {
+        t0 = t1;
+        snprintf(key, sizeof(key), "/latency/%d", i);
+        if (hashtb_seek(e, key, strlen(key), 0) != HT_NEW_ENTRY)
+            res = 1;
+        ((unsigned *)(e->data))[0] = i;
+        t1 = usec();
+        if (t1 - t0 > worst) {
+            worst = t1 - t0;
+            worst_at = i;
+        }
+    }
+    hashtb_end(e);
+    printf("%d inserts: mean %.3f us, worst %.0f us at %d\n",
+           n, (t1 - start) / n, worst, worst_at);
+    for (i = 0; i < n; i++) {
+        unsigned *v;
+        snprintf(key, sizeof(key), "/latency/%d", i);
+        v = hashtb_lookup(h, key, strlen(key));
+        if (v == NULL || *v != (unsigned)i)
+            res = 1;
+    }
+    if (hashtb_n(h) != n)
+        res = 1;
+    hashtb_destroy(&h);
+    if (res != 0)
+        fprintf(stderr, "insert_latency: lookups failed\n");
+    return(res);
+}
+
+/**
+ * Fill a table that shrinks, then empty it again but for every 97th key,
+ * deleting as we go through it, and check that the rest are still there.
+ */
+static int
+shrink(int n)
+{
+    char key[32];
+    struct hashtb_param param = {0};
+    struct hashtb *h;
+    struct hashtb_enumerator eee;
+    struct hashtb_enumerator *e;
+    int i;
+    int res = 0;
+
+    param.shrink = 1;
+    h = hashtb_create(sizeof(unsigned), &param);
+    e = hashtb_start(h, &eee);
+    for (i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "/shrink/%d", i);
+        hashtb_seek(e, key, strlen(key), 0);
+        ((unsigned *)(e->data))[0] = i;
+    }
+    hashtb_end(e);
+    for (hashtb_start(h, e); e->data != NULL;) {
+        if (((unsigned *)(e->data))[0] % 97 != 0)
+            hashtb_delete(e);
+        else
+            hashtb_next(e);
+    }
+    hashtb_end(e);
+    for (i = 0; i < n; i++) {
+        snprintf(key, sizeof(key), "/shrink/%d", i);
+        if ((hashtb_lookup(h, key, strlen(key)) != NULL) != (i % 97 == 0))
+            res = 1;
+    }
+    if (hashtb_n(h) != (n + 96) / 97)
+        res = 1;
+    printf("%d inserts, %d left after shrinking\n", n, hashtb_n(h));
+    hashtb_destroy(&h);
+    if (res != 0)
+        fprintf(stderr, "shrink: lookups failed\n");
+    return(res);
+}
+
+/*
+ * The fixed hash that hashtb used before it was keyed, for -f.
+ */
+#define OLD_K1 0x87c37b91114253d5ULL
+#define OLD_K2 0x4cf5ad432745937fULL
+#define ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+static uint64_t
+old_hash_word(uint64_t h, uint64_t w)
+{
+    w *= OLD_K1;
+    w = ROTL(w, 31);
+    h ^= w * OLD_K2;
+    h = ROTL(h, 27);
+    return(h * 5 + 0x52dce729);
+}
+
+static uint64_t
+inverse(uint64_t a)
+{
+    uint64_t x = a; /* right to 3 bits for odd a; each step doubles that */
+    int i;
+    for (i = 0; i < 5; i++)
+        x *= 2 - a * x;
+    return(x);
+}
+
+/**
+ * Make a 16-byte key whose second word undoes whatever the first word
+ * did to the old hash, so that all such keys had the same hash.
+ */
+static void
+old_collision(unsigned char *key, uint64_t first)
+{
+    uint64_t h = old_hash_word(23, first);
+    uint64_t w = (h ^ 0x5555555555555555ULL) * inverse(OLD_K2);
+    w = ROTL(w, 33) * inverse(OLD_K1);
+    memcpy(key, &first, 8);
+    memcpy(key + 8, &w, 8);
+}
+
+static double
+insert_all(const unsigned char *keys, int n)
+{
+    struct hashtb *h = hashtb_create(sizeof(unsigned), NULL);
+    struct hashtb_enumerator eee;
+    struct hashtb_enumerator *e = hashtb_start(h, &eee);
+    double t0 = usec();
+    double t1;
+    int i;
+    for (i = 0; i < n; i++)
+        hashtb_seek(e, keys + 16 * i, 16, 0);
+    for (i = 0; i < n; i++)
+        hashtb_lookup(h, keys + 16 * i, 16);
+    t1 = usec();
+    hashtb_end(e);
+    if (hashtb_n(h) != n)
+        t1 = -1;
+    hashtb_destroy(&h);
+    return(t1 - t0);
+}
+
+/**
+ * Insert and look up n keys chosen to collide under the old fixed hash,
+ * and n ordinary keys, and check that the first set is not much slower.
+ */
+static int
+flood(int n)
+{
+    unsigned char *keys = calloc(n, 16);
+    double tflood, tplain;
+    uint64_t w;
+    int i;
+    int res = 0;
+
+    for (i = 0; i < n; i++)
+        old_collision(keys + 16 * i, 0x100000001ULL * i);
+    for (i = 1; i < n; i++) {
+        memcpy(&w, keys + 16 * i + 8, 8);
+        if (old_hash_word(old_hash_word(23, i * 0x100000001ULL), w) !=
+            old_hash_word(old_hash_word(23, 0), *(uint64_t *)(keys + 8)))
+            res = 1;
+    }
+    tflood = insert_all(keys, n);
+    memset(keys, 0, 16 * n);
+    for (i = 0; i < n; i++)
+        snprintf((char *)keys + 16 * i, 16, "/plain/%06x", (unsigned)i);
+    tplain = insert_all(keys, n);
+    free(keys);
+    printf("%d colliding keys: %.0f us, %d plain keys: %.0f us\n",
+           n, tflood, n, tplain);
+    if (res != 0 || tflood < 0 || tplain < 0 || tflood > 10 * tplain + 1000) {
+        fprintf(stderr, "flood: colliding keys were too slow\n");
+        res = 1;
+    }
+    return(res);
+}
+
+/**
+ * Time the hash alone on some common key sizes.
+ */
+static int
+hash_speed(int n)
+{
+    static const int sizes[] = {8, 16, 24, 32, 64, 128};
+    unsigned char key[128];
+    struct hashtb *h = hashtb_create(sizeof(unsigned), NULL);
+    size_t sum = 0;
+    double t0;
+    unsigned k;
+    int i;
+
+    for (i = 0; i < sizeof(key); i++)
+        key[i] = i * 7;
+    for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        t0 = usec();
+        for (i = 0; i < n; i++) {
+            key[0] = i;
+            sum += hashtb_table_hash(h, key, sizes[k]);
+        }
+        printf("%3d bytes: %.1f ns per hash\n",
+               sizes[k], (usec() - t0) * 1000 / n);
+    }
+    hashtb_destroy(&h);
+    return(sum == 0);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -55,6 +284,27 @@ main(int argc, char **argv)
     struct hashtb_enumerator eee2;
     struct hashtb_enumerator *e2 = NULL;
     int nest = 0;
+
+    if (argc == 3 && strcmp(argv[1], "-t") == 0) {
+        hashtb_end(e);
+        hashtb_destroy(&h);
+        return(insert_latency(atoi(argv[2])));
+    }
+    if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        hashtb_end(e);
+        hashtb_destroy(&h);
+        return(shrink(atoi(argv[2])));
+    }
+    if (argc == 3 && strcmp(argv[1], "-f") == 0) {
+        hashtb_end(e);
+        hashtb_destroy(&h);
+        return(flood(atoi(argv[2])));
+    }
+    if (argc == 3 && strcmp(argv[1], "-h") == 0) {
+        hashtb_end(e);
+        hashtb_destroy(&h);
+        return(hash_speed(atoi(argv[2])));
+    }
     while (fgets(buf, sizeof(buf), stdin)) {
         int i = strlen(buf);
         if (i > 0 && buf[i-1] == '\n')
@@ -0,0 +1,178 @@
+/**
+ * @file parsebenchtest.c
+ *
+ * A simple test program to benchmark ccnb message parsing.
+ *
+ * Builds a typical Interest and a typical ContentObject and reports how
+ * many of each ccn_parse_interest and ccn_parse_ContentObject can handle
+ * per second, along with the equivalent byte rate.  The first stage
+ * alone, ccn_parse_ContentObject_name, is timed as well.  The
+ * ContentObject carries a dummy signature, since only the parse is
+ * being timed.
+ *
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This work is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ * This work is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details. You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ccn/ccn.h>
+#include <ccn/charbuf.h>
+#include <ccn/coding.h>
+#include <ccn/indexbuf.h>
+
+#define COUNT 1000000
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return((end.tv_sec - start->tv_sec) +
+           ((int)end.tv_usec - (int)start->tv_usec) / 1e6);
+}
+
+static void
+report(const char *what, size_t size, double dt)
+{
+    if (dt <= 0)
+        dt = 1e-6;
+    printf("%-13s %5lu bytes: %10.0f msgs/sec, %7.1f MB/sec\n",
+           what, (unsigned long)size, COUNT / dt, COUNT * size / dt / 1e6);
+}
+
+static void
+append_name(struct ccn_charbuf *c)
+{
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    ccn_name_init(name);
+    ccn_name_append_str(name, "parc.com");
+    ccn_name_append_str(name, "benchmark");
+    ccn_name_append_str(name, "parse");
+    ccn_name_append_str(name, "%FD%04%F0%1E%D7%A1");
+    ccn_name_append_str(name, "%00%03");
+    ccn_charbuf_append_charbuf(c, name);
+    ccn_charbuf_destroy(&name);
+}
+
+static void
+build_interest(struct ccn_charbuf *c)
+{
+    unsigned char nonce[6] = {1, 2, 3, 4, 5, 6};
+    unsigned char lifetime[2] = {0x40, 0x00};
+    unsigned char bloom[64];
+
+    memset(bloom, 0x5a, sizeof(bloom));
+    ccnb_element_begin(c, CCN_DTAG_Interest);
+    append_name(c);
+    ccnb_tagged_putf(c, CCN_DTAG_MaxSuffixComponents, "%d", 1);
+    ccnb_element_begin(c, CCN_DTAG_Exclude);
+    ccnb_element_begin(c, CCN_DTAG_Any);
+    ccnb_element_end(c);
+    ccnb_append_tagged_blob(c, CCN_DTAG_Component, nonce, 2);
+    ccnb_append_tagged_blob(c, CCN_DTAG_Bloom, bloom, sizeof(bloom));
+    ccnb_element_end(c); /* </Exclude> */
+    ccnb_tagged_putf(c, CCN_DTAG_ChildSelector, "%d", 1);
+    ccnb_tagged_putf(c, CCN_DTAG_AnswerOriginKind, "%d", 3);
+    ccnb_tagged_putf(c, CCN_DTAG_Scope, "%d", 2);
+    ccnb_append_tagged_blob(c, CCN_DTAG_InterestLifetime,
+                            lifetime, sizeof(lifetime));
+    ccnb_append_tagged_blob(c, CCN_DTAG_Nonce, nonce, sizeof(nonce));
+    ccnb_element_end(c); /* </Interest> */
+}
+
+static void
+build_content(struct ccn_charbuf *c, size_t content_size)
+{
+    unsigned char sig[128];
+    unsigned char digest[32];
+    unsigned char *content;
+
+    memset(sig, 0xa5, sizeof(sig));
+    memset(digest, 0x3c, sizeof(digest));
+    content = calloc(1, content_size);
+    ccnb_element_begin(c, CCN_DTAG_ContentObject);
+    ccnb_element_begin(c, CCN_DTAG_Signature);
+    ccnb_append_tagged_blob(c, CCN_DTAG_SignatureBits, sig, sizeof(sig));
+    ccnb_element_end(c); /* </Signature> */
+    append_name(c);
+    ccnb_element_begin(c, CCN_DTAG_SignedInfo);
+    ccnb_append_tagged_blob(c, CCN_DTAG_PublisherPublicKeyDigest,
+                            digest, sizeof(digest));
+    ccnb_element_begin(c, CCN_DTAG_Timestamp);
+    ccnb_append_now_blob(c, CCN_MARKER_NONE);
+    ccnb_element_end(c);
+    ccnb_tagged_putf(c, CCN_DTAG_FreshnessSeconds, "%d", 10);
+    ccnb_append_tagged_blob(c, CCN_DTAG_FinalBlockID, "\0\3", 2);
+    ccnb_element_begin(c, CCN_DTAG_KeyLocator);
+    ccnb_element_begin(c, CCN_DTAG_KeyName);
+    append_name(c);
+    ccnb_element_end(c); /* </KeyName> */
+    ccnb_element_end(c); /* </KeyLocator> */
+    ccnb_element_end(c); /* </SignedInfo> */
+    ccnb_append_tagged_blob(c, CCN_DTAG_Content, content, content_size);
+    ccnb_element_end(c); /* </ContentObject> */
+    free(content);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const size_t content_sizes[] = {0, 1024, 4096};
+    struct ccn_charbuf *c = ccn_charbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_parsed_interest pi = {0};
+    struct ccn_parsed_ContentObject pco = {0};
+    struct timeval start;
+    char what[20];
+    int i, k, res;
+
+    build_interest(c);
+    gettimeofday(&start, NULL);
+    for (i = 0; i < COUNT; i++) {
+        res = ccn_parse_interest(c->buf, c->length, &pi, comps);
+        if (res < 0) {
+            fprintf(stderr, "Interest parse failed: %d\n", res);
+            exit(1);
+        }
+    }
+    report("Interest", c->length, elapsed(&start));
+    for (k = 0; k < sizeof(content_sizes) / sizeof(content_sizes[0]); k++) {
+        c->length = 0;
+        build_content(c, content_sizes[k]);
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i++) {
+            res = ccn_parse_ContentObject(c->buf, c->length, &pco, comps);
+            if (res < 0) {
+                fprintf(stderr, "ContentObject parse failed: %d\n", res);
+                exit(1);
+            }
+        }
+        sprintf(what, "Content %lu", (unsigned long)content_sizes[k]);
+        report(what, c->length, elapsed(&start));
+        gettimeofday(&start, NULL);
+        for (i = 0; i < COUNT; i++) {
+            res = ccn_parse_ContentObject_name(c->buf, c->length, &pco, comps);
+            if (res < 0) {
+                fprintf(stderr, "ContentObject name parse failed: %d\n", res);
+                exit(1);
+            }
+        }
+        sprintf(what, "  name only");
+        report(what, c->length, elapsed(&start));
+    }
+    ccn_charbuf_destroy(&c);
+    ccn_indexbuf_destroy(&comps);
+    return(0);
+}
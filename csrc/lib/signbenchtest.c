@@ -23,12 +23,131 @@
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/keystore.h>
+#include <ccn/signing.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 
 #define FRESHNESS 10 
 #define COUNT 3000
 #define PAYLOAD_SIZE 51
+#define BATCH 64
+
+static void
+make_name(struct ccn_charbuf *path, struct ccn_charbuf *seq, int i)
+{
+    ccn_name_init(path);
+    ccn_name_append_str(path, "rtp");
+    ccn_name_append_str(path, "protocol");
+    ccn_name_append_str(path, "13.2.117.34");
+    ccn_name_append_str(path, "domain");
+    ccn_name_append_str(path, "smetters");
+    ccn_name_append_str(path, "principal");
+    ccn_name_append_str(path, "2021915340");
+    ccn_name_append_str(path, "id");
+    ccn_charbuf_reset(seq);
+    ccn_charbuf_putf(seq, "%u", i);
+    ccn_name_append(path, seq->buf, seq->length);
+    ccn_name_append_str(path, "seq");
+}
+
+static double
+elapsed(struct timeval *start, struct timeval *end, const char *what)
+{
+  int sec = end->tv_sec - start->tv_sec;
+  int usec = (int)end->tv_usec - (int)start->tv_usec;
+  double dt;
+  while (usec < 0) {
+    sec--;
+    usec += 1000000;
+  }
+  dt = sec + usec / 1e6;
+  printf("\n%s complete in %d.%06d secs, %.0f objects/sec\n",
+         what, sec, usec, (dt > 0) ? COUNT / dt : 0);
+  return(dt);
+}
+
+static double
+seconds_since(struct timeval *start)
+{
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  return((end.tv_sec - start->tv_sec) + ((int)end.tv_usec - (int)start->tv_usec) / 1e6);
+}
+
+/*
+ * Sign and verify COUNT objects with a freshly made key of the given
+ * type, and report the rates, so that the algorithms can be compared.
+ */
+static void
+compare_algorithm(const char *label, int keytype, int keylength,
+                  const char *msgbuf)
+{
+  struct ccn_keystore *keystore = NULL;
+  struct ccn_charbuf *temp = ccn_charbuf_create();
+  struct ccn_charbuf *signed_info = ccn_charbuf_create();
+  struct ccn_charbuf *message = ccn_charbuf_create();
+  struct ccn_charbuf *path = ccn_charbuf_create();
+  struct ccn_charbuf *seq = ccn_charbuf_create();
+  struct ccn_parsed_ContentObject pco = {0};
+  struct timeval start;
+  double dts, dtv;
+  int res;
+  int i;
+
+  ccn_charbuf_putf(temp, "%s/signbenchtest-%d.p12",
+                   getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp", (int)getpid());
+  res = ccn_keystore_file_init_key(ccn_charbuf_as_string(temp),
+                                   "Th1s1sn0t8g00dp8ssw0rd.", "signbenchtest",
+                                   keytype, keylength, 1);
+  keystore = ccn_keystore_create();
+  if (res == 0)
+    res = ccn_keystore_init(keystore, ccn_charbuf_as_string(temp),
+                            "Th1s1sn0t8g00dp8ssw0rd.");
+  unlink(ccn_charbuf_as_string(temp));
+  if (res != 0) {
+    printf("%-10s could not make a key\n", label);
+    goto Cleanup;
+  }
+  ccn_signed_info_create(signed_info,
+                         ccn_keystore_public_key_digest(keystore),
+                         ccn_keystore_public_key_digest_length(keystore),
+                         NULL, CCN_CONTENT_DATA, FRESHNESS, NULL, NULL);
+  gettimeofday(&start, NULL);
+  for (i = 0; i < COUNT; i++) {
+    make_name(path, seq, i);
+    ccn_charbuf_reset(message);
+    res = ccn_encode_ContentObject(message, path, signed_info,
+                                   msgbuf, PAYLOAD_SIZE,
+                                   ccn_keystore_digest_algorithm(keystore),
+                                   ccn_keystore_private_key(keystore));
+    if (res != 0) {
+      printf("%-10s failed to sign\n", label);
+      goto Cleanup;
+    }
+  }
+  dts = seconds_since(&start);
+  res = ccn_parse_ContentObject(message->buf, message->length, &pco, NULL);
+  gettimeofday(&start, NULL);
+  for (i = 0; i < COUNT && res >= 0; i++)
+    res = ccn_verify_signature(message->buf, message->length, &pco,
+                               ccn_keystore_public_key(keystore));
+  dtv = seconds_since(&start);
+  if (res != 1) {
+    printf("%-10s signature does not verify\n", label);
+    goto Cleanup;
+  }
+  printf("%-10s %10.0f %10.0f %10d\n", label,
+         (dts > 0) ? COUNT / dts : 0, (dtv > 0) ? COUNT / dtv : 0,
+         (int)ccn_pubkey_size(ccn_keystore_public_key(keystore)));
+Cleanup:
+  ccn_keystore_destroy(&keystore);
+  ccn_charbuf_destroy(&temp);
+  ccn_charbuf_destroy(&signed_info);
+  ccn_charbuf_destroy(&message);
+  ccn_charbuf_destroy(&path);
+  ccn_charbuf_destroy(&seq);
+}
 
 int
 main(int argc, char **argv)
@@ -38,12 +157,20 @@ main(int argc, char **argv)
   int res = 0;
   struct ccn_charbuf *signed_info = ccn_charbuf_create();
   int i;
-  int sec, usec;
+  int j;
+  double dt1, dt2, dt3;
   char msgbuf[PAYLOAD_SIZE];
+  struct ccn_charbuf *messages[BATCH];
+  struct ccn_charbuf *paths[BATCH];
+  const struct ccn_charbuf *signed_infos[BATCH];
+  const void *data[BATCH];
+  size_t sizes[BATCH];
+  struct ccn_parsed_ContentObject pco = {0};
   struct timeval start, end;
   struct ccn_charbuf *message = ccn_charbuf_create();
   struct ccn_charbuf *path = ccn_charbuf_create();
   struct ccn_charbuf *seq = ccn_charbuf_create();
+  struct ccn_content_builder *builder = NULL;
 
   struct ccn_charbuf *temp = ccn_charbuf_create();
   keystore = ccn_keystore_create();
@@ -80,18 +207,7 @@ main(int argc, char **argv)
       printf(".");
       fflush(stdout);
     }
-    ccn_name_init(path);
-    ccn_name_append_str(path, "rtp");
-    ccn_name_append_str(path, "protocol");
-    ccn_name_append_str(path, "13.2.117.34");
-    ccn_name_append_str(path, "domain");
-    ccn_name_append_str(path, "smetters");
-    ccn_name_append_str(path, "principal");
-    ccn_name_append_str(path, "2021915340");
-    ccn_name_append_str(path, "id");
-    ccn_charbuf_putf(seq, "%u", i);
-    ccn_name_append(path, seq->buf, seq->length);
-    ccn_name_append_str(path, "seq");
+    make_name(path, seq, i);
   
     res = ccn_encode_ContentObject(/* out */ message,
 				   path, signed_info, 
@@ -104,14 +220,112 @@ main(int argc, char **argv)
     ccn_charbuf_reset(seq);
   }
   gettimeofday(&end, NULL);
-  sec = end.tv_sec - start.tv_sec;
-  usec = (int)end.tv_usec - (int)start.tv_usec;
-  while (usec < 0) {
-    sec--;
-    usec += 1000000;
+  dt1 = elapsed(&start, &end, "Signing each");
+
+  builder = ccn_content_builder_create(
+      /* pubkeyid */ ccn_keystore_public_key_digest(keystore),
+      /* publisher_key_id_size */ ccn_keystore_public_key_digest_length(keystore),
+      /* type */ CCN_CONTENT_DATA,
+      /* freshness */ FRESHNESS,
+      /* keylocator */ NULL,
+      ccn_keystore_digest_algorithm(keystore),
+      ccn_keystore_private_key(keystore));
+  if (builder == NULL) {
+    printf("Failed to create content builder\n");
+    exit(1);
+  }
+  printf("Generating %d signed ContentObjects with a builder (one . per 100)\n", COUNT);
+  gettimeofday(&start, NULL);
+  for (i=0; i<COUNT; i++) {
+    if (i>0 && (i%100) == 0) {
+      printf(".");
+      fflush(stdout);
+    }
+    make_name(path, seq, i);
+    res = ccn_content_builder_encode(builder, /* out */ message, path,
+                                     NULL, NULL, msgbuf, PAYLOAD_SIZE);
+    if (res != 0) {
+      printf("Failed to encode with builder\n");
+      exit(1);
+    }
+    if (i < COUNT - 1)
+      ccn_charbuf_reset(message);
+    ccn_charbuf_reset(path);
+    ccn_charbuf_reset(seq);
+  }
+  gettimeofday(&end, NULL);
+  dt3 = elapsed(&start, &end, "Signing each with a builder");
+  if (dt3 > 0)
+    printf("Builder is %.2f times as fast\n", dt1 / dt3);
+  res = ccn_parse_ContentObject(message->buf, message->length, &pco, NULL);
+  if (res >= 0)
+    res = ccn_verify_signature(message->buf, message->length, &pco,
+                               ccn_keystore_public_key(keystore));
+  if (res != 1) {
+    printf("Builder signature does not verify\n");
+    exit(1);
+  }
+  ccn_charbuf_reset(message);
+  ccn_content_builder_destroy(&builder);
+
+  for (j = 0; j < BATCH; j++) {
+    messages[j] = ccn_charbuf_create();
+    paths[j] = ccn_charbuf_create();
+    signed_infos[j] = signed_info;
+    data[j] = msgbuf;
+    sizes[j] = PAYLOAD_SIZE;
+  }
+  printf("Generating %d ContentObjects signed %d per Merkle tree (one . per 100)\n",
+         COUNT, BATCH);
+  gettimeofday(&start, NULL);
+
+  for (i=0; i<COUNT; i+=BATCH) {
+    int n = (COUNT - i < BATCH) ? COUNT - i : BATCH;
+    if (i>0 && (i%100) < BATCH) {
+      printf(".");
+      fflush(stdout);
+    }
+    for (j = 0; j < n; j++) {
+      ccn_charbuf_reset(messages[j]);
+      make_name(paths[j], seq, i + j);
+    }
+    res = ccn_encode_ContentObjects(/* out */ messages, n,
+                                    (const struct ccn_charbuf **)paths,
+                                    signed_infos, data, sizes,
+                                    ccn_keystore_digest_algorithm(keystore),
+                                    ccn_keystore_private_key(keystore));
+    if (res != 0) {
+      printf("Failed to encode a batch\n");
+      exit(1);
+    }
+  }
+  gettimeofday(&end, NULL);
+  dt2 = elapsed(&start, &end, "Signing in batches");
+  if (dt2 > 0)
+    printf("Batches are %.1f times as fast\n", dt1 / dt2);
+
+  /* each object of the last batch should verify by itself */
+  for (j = 0; j <= (COUNT - 1) % BATCH; j++) {
+    res = ccn_parse_ContentObject(messages[j]->buf, messages[j]->length, &pco, NULL);
+    if (res >= 0)
+      res = ccn_verify_signature(messages[j]->buf, messages[j]->length, &pco,
+                                 ccn_keystore_public_key(keystore));
+    if (res != 1) {
+      printf("Batch signature %d does not verify\n", j);
+      exit(1);
+    }
+  }
+  printf("Batch signatures verify\n");
+  for (j = 0; j < BATCH; j++) {
+    ccn_charbuf_destroy(&messages[j]);
+    ccn_charbuf_destroy(&paths[j]);
   }
 
-  printf("\nComplete in %d.%06d secs\n", sec, usec);
+  printf("\nComparing algorithms, %d objects each\n", COUNT);
+  printf("%-10s %10s %10s %10s\n", "key", "signs/sec", "verify/sec", "max sig");
+  compare_algorithm("RSA-1024", CCN_KEYSTORE_KEY_RSA, 1024, msgbuf);
+  compare_algorithm("RSA-2048", CCN_KEYSTORE_KEY_RSA, 2048, msgbuf);
+  compare_algorithm("EC P-256", CCN_KEYSTORE_KEY_EC, 256, msgbuf);
 
   return(0);
 }
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
@@ -41,6 +42,7 @@ static const char *tt_name[8] = {
 };
 
 #define SHOW_HEX_STATE 1
+#define BENCHMARK 2
 
 static int
 process_test(unsigned char *data, size_t n, int flags)
@@ -86,6 +88,48 @@ retry:
     return(res);
 }
 
+/**
+ * Measure decoder throughput, in the way ccnd uses it
+ *
+ * Repeatedly splits the input into top-level elements for about
+ * a second, and reports the rate in MB/s.
+ */
+static int
+process_bench(unsigned char *data, size_t n)
+{
+    struct ccn_skeleton_decoder skel_decoder;
+    struct ccn_skeleton_decoder *d = &skel_decoder;
+    struct timeval t0, t1;
+    double elapsed = 0;
+    double total = 0;
+    size_t i;
+    int elements = 0;
+    int pass;
+
+    gettimeofday(&t0, NULL);
+    for (pass = 0; elapsed < 1.0; pass++) {
+        for (i = 0; i < n;) {
+            memset(d, 0, sizeof(*d));
+            i += ccn_skeleton_decode(d, data + i, n - i);
+            if (d->state != 0)
+                break;
+            if (pass == 0)
+                elements++;
+        }
+        if (d->state != 0 && i < n) {
+            fprintf(stderr, "error state %d at index %lu\n",
+                    (int)d->state, (unsigned long)i);
+            return(1);
+        }
+        total += n;
+        gettimeofday(&t1, NULL);
+        elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+    }
+    printf("%d elements, %lu bytes: %.1f MB/s\n", elements,
+           (unsigned long)n, total / elapsed / 1e6);
+    return(0);
+}
+
 static int
 process_fd(int fd, int flags)
 {
@@ -110,7 +154,10 @@ process_fd(int fd, int flags)
         c->length += len;
     }
     fprintf(stderr, " <!-- input is %6lu bytes -->\n", (unsigned long)c->length);
-    res |= process_test(c->buf, c->length, flags);
+    if ((flags & BENCHMARK) != 0)
+        res |= process_bench(c->buf, c->length);
+    else
+        res |= process_test(c->buf, c->length, flags);
     ccn_charbuf_destroy(&c);
     return(res);
 }
@@ -149,6 +196,10 @@ main(int argc, char **argv)
             flags |= CCN_DSTATE_PAUSE | SHOW_HEX_STATE;
             continue;
         }
+        if (0 == strcmp(argv[i], "-b")) {
+            flags = BENCHMARK;
+            continue;
+        }
         fprintf(stderr, "<!-- Processing %s -->\n", argv[i]);
         res |= process_file(argv[i], flags);
     }
@@ -68,6 +68,9 @@
 #define OP_REG  0
 #define OP_UNREG 1
 
+/* Most bytes of ForwardingEntry elements sent in one prefixregs request */
+#define BATCH_BYTES 30000
+
 /*
  * private types
  */
@@ -75,9 +78,20 @@ struct prefix_face_list_item {
     struct ccn_charbuf *prefix;
     struct ccn_face_instance *fi;
     int flags;
+    intmax_t quota;     /**< store quota for the prefix, or -1 */
+    int tclass;         /**< traffic class for the prefix, or -1 */
+    int fresh;          /**< default freshness for the prefix, or -1 */
+    int residency;      /**< most seconds content stays, or -1 */
     struct prefix_face_list_item *next;
 };
 
+/* A face already set up while processing a config file */
+struct known_face {
+    struct ccn_charbuf *key;
+    unsigned faceid;
+    struct known_face *next;
+};
+
 /*
  * global constant (but not staticly initializable) data
  */
@@ -97,11 +111,16 @@ static void
 usage(const char *progname)
 {
     fprintf(stderr,
-            "%s [-d] [-v] (-f configfile | (add|del) uri (udp|tcp) host [port [flags [mcastttl [mcastif]]]])\n"
+            "%s [-d] [-v] (-f configfile | (add|del) uri (udp|tcp) host [port [flags [mcastttl [mcastif]]]] [rate=bytes/sec] [burst=bytes] [quota=bytes] [class=n] [fresh=seconds] [residency=seconds])\n"
             "   -d enter dynamic mode and create FIB entries based on DNS SRV records\n"
             "   -f configfile add or delete FIB entries based on contents of configfile\n"
             "   -v increase logging level\n"
             "	add|del add or delete FIB entry based on parameters\n"
+            "	rate, burst limit what ccnd sends on a new face\n"
+            "	quota limits the content ccnd keeps under the prefix\n"
+            "	class puts the prefix in a traffic class, 0 (most urgent) to 3\n"
+            "	fresh, residency set how long content under the prefix stays\n"
+            "	fresh, and how long it stays in the store at all\n"
             "%s [-v] destroyface faceid\n"
             "   destroy face based on face number\n",
             progname,
@@ -235,6 +254,8 @@ static struct prefix_face_list_item *prefix_face_list_item_create(struct ccn_cha
                                                                   char *port,
                                                                   char *mcastif,
                                                                   int lifetime,
+                                                                  int rate,
+                                                                  int burst,
                                                                   int flags,
                                                                   int create,
                                                                   unsigned faceid)
@@ -259,6 +280,8 @@ static struct prefix_face_list_item *prefix_face_list_item_create(struct ccn_cha
     pfl->fi->descr.ipproto = ipproto;
     pfl->fi->descr.mcast_ttl = mcast_ttl;
     pfl->fi->lifetime = lifetime;
+    pfl->fi->rate = rate;
+    pfl->fi->burst = burst;
     if (faceid > 0)
         pfl->fi->faceid = faceid;
     pfl->flags = flags;
@@ -381,7 +404,11 @@ register_unregister_prefix(struct ccn *h,
                            int operation,
                            struct ccn_charbuf *name_prefix,
                            struct ccn_face_instance *face_instance,
-                           int flags)
+                           int flags,
+                           intmax_t quota,
+                           int tclass,
+                           int fresh,
+                           int residency)
 {
     struct ccn_charbuf *temp = NULL;
     struct ccn_charbuf *resultbuf = NULL;
@@ -404,6 +431,10 @@ register_unregister_prefix(struct ccn *h,
     forwarding_entry->faceid = face_instance->faceid;
     forwarding_entry->flags = flags;
     forwarding_entry->lifetime = (~0U) >> 1;
+    forwarding_entry->store_quota = quota;
+    forwarding_entry->traffic_class = tclass;
+    forwarding_entry->default_freshness = fresh;
+    forwarding_entry->max_residency = residency;
     
     prefixreg = ccn_charbuf_create();
     ON_NULL_CLEANUP(prefixreg);
@@ -450,6 +481,108 @@ Cleanup:
     return (-1);
 }
 
+/**
+ *  @brief Register or unregister a batch of prefixes with one request
+ *  @param h  the ccnd handle
+ *  @param entries  a sequence of ccnb-encoded ForwardingEntry elements
+ *  @result returns 0 if ccnd applied all of them, -1 if it applied none
+ *          or could not be reached
+ */
+static int
+register_prefix_batch(struct ccn *h, struct ccn_charbuf *entries)
+{
+    struct ccn_charbuf *temp = NULL;
+    struct ccn_charbuf *resultbuf = NULL;
+    struct ccn_charbuf *name = NULL;
+    struct ccn_parsed_ContentObject pcobuf = {0};
+    int res;
+    
+    temp = ccn_charbuf_create();
+    ON_NULL_CLEANUP(temp);
+    res = ccn_sign_content(h, temp, no_name, NULL, entries->buf, entries->length);
+    ON_ERROR_CLEANUP(res);
+    resultbuf = ccn_charbuf_create();
+    ON_NULL_CLEANUP(resultbuf);
+    name = ccn_charbuf_create();
+    ON_ERROR_CLEANUP(ccn_name_init(name));
+    ON_ERROR_CLEANUP(ccn_name_append_str(name, "ccnx"));
+    ON_ERROR_CLEANUP(ccn_name_append(name, ccndid, ccndid_size));
+    ON_ERROR_CLEANUP(ccn_name_append_str(name, "prefixregs"));
+    ON_ERROR_CLEANUP(ccn_name_append(name, temp->buf, temp->length));
+    res = ccn_get(h, name, local_scope_template, 4000, resultbuf, &pcobuf, NULL, 0);
+    ON_ERROR_CLEANUP(res);
+    if (pcobuf.type == CCN_CONTENT_NACK)
+        goto Cleanup;
+    
+    ccn_charbuf_destroy(&temp);
+    ccn_charbuf_destroy(&resultbuf);
+    ccn_charbuf_destroy(&name);
+    return (0);
+    
+Cleanup:
+    ccn_charbuf_destroy(&temp);
+    ccn_charbuf_destroy(&resultbuf);
+    ccn_charbuf_destroy(&name);
+    return (-1);
+}
+
+/*
+ * Remove any rate=, burst=, quota=, class=, fresh= and residency= tokens
+ * from the n tokens at tok, closing up the gaps so that the rest keep
+ * their positions.
+ * Returns -1 for an unparseable value.
+ */
+static int
+take_keyword_tokens(char **tok, int n, int *rate, int *burst, intmax_t *quota,
+                    int *tclass, int *fresh, int *residency)
+{
+    int i, j;
+    int *dst;
+    char *val;
+    char *end;
+    long long v;
+    
+    *rate = *burst = *tclass = *fresh = *residency = -1;
+    *quota = -1;
+    for (i = 0, j = 0; i < n; i++) {
+        dst = NULL;
+        if (tok[i] != NULL && strncasecmp(tok[i], "rate=", 5) == 0)
+            dst = rate, val = tok[i] + 5;
+        else if (tok[i] != NULL && strncasecmp(tok[i], "burst=", 6) == 0)
+            dst = burst, val = tok[i] + 6;
+        else if (tok[i] != NULL && strncasecmp(tok[i], "fresh=", 6) == 0)
+            dst = fresh, val = tok[i] + 6;
+        else if (tok[i] != NULL && strncasecmp(tok[i], "residency=", 10) == 0)
+            dst = residency, val = tok[i] + 10;
+        else if (tok[i] != NULL && strncasecmp(tok[i], "quota=", 6) == 0) {
+            v = strtoll(tok[i] + 6, &end, 10);
+            if (end == tok[i] + 6 || *end != 0 || v < 0)
+                return (-1);
+            *quota = v;
+            continue;
+        }
+        else if (tok[i] != NULL && strncasecmp(tok[i], "class=", 6) == 0) {
+            v = strtol(tok[i] + 6, &end, 10);
+            if (end == tok[i] + 6 || *end != 0 || v < 0 ||
+                v >= CCN_TRAFFIC_CLASSES)
+                return (-1);
+            *tclass = v;
+            continue;
+        }
+        if (dst == NULL) {
+            tok[j++] = tok[i];
+            continue;
+        }
+        v = strtol(val, &end, 10);
+        if (end == val || *end != 0 || v < 0 || v > INT_MAX)
+            return (-1);
+        *dst = v;
+    }
+    for (; j < n; j++)
+        tok[j] = NULL;
+    return (0);
+}
+
 static int
 process_command_tokens(struct prefix_face_list_item *pfltail,
                        int lineno,
@@ -460,7 +593,13 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
                        char *port,
                        char *flags,
                        char *mcastttl,
-                       char *mcastif)
+                       char *mcastif,
+                       int rate,
+                       int burst,
+                       intmax_t quota,
+                       int tclass,
+                       int fresh,
+                       int residency)
 {
     int lifetime = 0;
     struct ccn_charbuf *prefix = NULL;
@@ -588,11 +727,16 @@ process_command_tokens(struct prefix_face_list_item *pfltail,
     }
     /* we have successfully parsed a command line */
     pflp = prefix_face_list_item_create(prefix, ipproto, imcastttl, rhostnamebuf,
-                                        rhostportbuf, mcastif, lifetime, iflags,
+                                        rhostportbuf, mcastif, lifetime,
+                                        rate, burst, iflags,
                                         createface, facenumber);
     if (pflp == NULL) {
         ccndc_fatal(__LINE__, "Unable to allocate prefix_face_list_item\n");
     }
+    pflp->quota = quota;
+    pflp->tclass = tclass;
+    pflp->fresh = fresh;
+    pflp->residency = residency;
     pfltail->next = pflp;
     return (0);
 }
@@ -602,14 +746,14 @@ read_configfile(const char *filename, struct prefix_face_list_item *pfltail)
 {
     int configerrors = 0;
     int lineno = 0;
-    char *cmd;
-    char *uri;
-    char *proto;
-    char *host;
-    char *port;
-    char *flags;
-    char *mcastttl;
-    char *mcastif;
+    char *tok[14];
+    int rate;
+    int burst;
+    intmax_t quota;
+    int tclass;
+    int fresh;
+    int residency;
+    int i;
     FILE *cfg;
     char buf[1024];
     const char *seps = " \t\n";
@@ -633,17 +777,20 @@ read_configfile(const char *filename, struct prefix_face_list_item *pfltail)
         if (cp != NULL)
             *cp = '\0';
         
-        cmd = strtok_r(buf, seps, &last);
-        if (cmd == NULL)	/* blank line */
+        tok[0] = strtok_r(buf, seps, &last);
+        if (tok[0] == NULL)	/* blank line */
             continue;
-        uri = strtok_r(NULL, seps, &last);
-        proto = strtok_r(NULL, seps, &last);
-        host = strtok_r(NULL, seps, &last);
-        port = strtok_r(NULL, seps, &last);
-        flags = strtok_r(NULL, seps, &last);
-        mcastttl = strtok_r(NULL, seps, &last);
-        mcastif = strtok_r(NULL, seps, &last);
-        res = process_command_tokens(pfltail, lineno, cmd, uri, proto, host, port, flags, mcastttl, mcastif);
+        for (i = 1; i < 14; i++)
+            tok[i] = strtok_r(NULL, seps, &last);
+        res = take_keyword_tokens(tok, 14, &rate, &burst, &quota, &tclass,
+                                  &fresh, &residency);
+        if (res < 0)
+            ccndc_warn(__LINE__, "command error (line %d), invalid rate, burst, quota, class, fresh or residency\n", lineno);
+        else
+            res = process_command_tokens(pfltail, lineno, tok[0], tok[1],
+                                         tok[2], tok[3], tok[4], tok[5],
+                                         tok[6], tok[7], rate, burst, quota,
+                                         tclass, fresh, residency);
         if (res < 0) {
             configerrors--;
         } else {
@@ -750,6 +897,23 @@ int query_srv(const unsigned char *domain, int domain_size,
     return (0);
 }
 
+static void
+warn_prefix_failure(struct prefix_face_list_item *pfl, int op, unsigned faceid)
+{
+    struct ccn_charbuf *temp;
+    
+    temp = ccn_charbuf_create();
+    ccn_uri_append(temp, pfl->prefix->buf, pfl->prefix->length, 1);
+    ccndc_warn(__LINE__, "Unable to %sregister prefix on face %d for %s %s %s %s %s\n",
+               (op == OP_UNREG) ? "un" : "", faceid,
+               (op == OP_REG) ? "add" : "del",
+               ccn_charbuf_as_string(temp),
+               (pfl->fi->descr.ipproto == IPPROTO_UDP) ? "udp" : "tcp",
+               pfl->fi->descr.address,
+               pfl->fi->descr.port);
+    ccn_charbuf_destroy(&temp);
+}
+
 void
 process_prefix_face_list_item(struct ccn *h,
                               struct prefix_face_list_item *pfl) 
@@ -783,24 +947,186 @@ process_prefix_face_list_item(struct ccn *h,
             ccn_charbuf_destroy(&temp);
             return;
         }
-        res = register_unregister_prefix(h, op, pfl->prefix, nfi, pfl->flags);
-        if (res < 0) {
-            temp = ccn_charbuf_create();
-            ccn_uri_append(temp, pfl->prefix->buf, pfl->prefix->length, 1);
-            ccndc_warn(__LINE__, "Unable to %sregister prefix on face %d for %s %s %s %s %s\n",
-                       (op == OP_UNREG) ? "un" : "", nfi->faceid,
-                       (op == OP_REG) ? "add" : "del",
-                       ccn_charbuf_as_string(temp),
-                       (pfl->fi->descr.ipproto == IPPROTO_UDP) ? "udp" : "tcp",
-                       pfl->fi->descr.address,
-                       pfl->fi->descr.port);
-            ccn_charbuf_destroy(&temp);
-        }
+        res = register_unregister_prefix(h, op, pfl->prefix, nfi, pfl->flags,
+                                         pfl->quota, pfl->tclass,
+                                         pfl->fresh, pfl->residency);
+        if (res < 0)
+            warn_prefix_failure(pfl, op, nfi->faceid);
     }
     ccn_face_instance_destroy(&nfi);
     return;
 }
 
+/*
+ * Find the face for a list item among those already set up, or set it up.
+ * Returns the faceid, or 0 if the face could not be created.
+ */
+static unsigned
+known_face_id(struct ccn *h, struct known_face **known,
+              struct prefix_face_list_item *pfl)
+{
+    struct ccn_face_instance *nfi;
+    struct ccn_charbuf *key;
+    struct known_face *kf;
+    struct ccn_charbuf *temp;
+    unsigned faceid;
+    
+    key = ccn_charbuf_create();
+    ccn_charbuf_putf(key, "%d %s %s %d %s %d %d", pfl->fi->descr.ipproto,
+                     pfl->fi->descr.address, pfl->fi->descr.port,
+                     pfl->fi->descr.mcast_ttl,
+                     pfl->fi->descr.source_address ? pfl->fi->descr.source_address : "",
+                     pfl->fi->rate, pfl->fi->burst);
+    for (kf = *known; kf != NULL; kf = kf->next) {
+        if (kf->key->length == key->length &&
+            memcmp(kf->key->buf, key->buf, key->length) == 0) {
+            ccn_charbuf_destroy(&key);
+            return (kf->faceid);
+        }
+    }
+    nfi = do_face_action(h, pfl->fi);
+    if (nfi == NULL) {
+        temp = ccn_charbuf_create();
+        ccn_uri_append(temp, pfl->prefix->buf, pfl->prefix->length, 1);
+        ccndc_warn(__LINE__, "Unable to create face for %s %s %s %s %s\n",
+                   (pfl->fi->lifetime > 0) ? "add" : "del",
+                   ccn_charbuf_as_string(temp),
+                   (pfl->fi->descr.ipproto == IPPROTO_UDP) ? "udp" : "tcp",
+                   pfl->fi->descr.address,
+                   pfl->fi->descr.port);
+        ccn_charbuf_destroy(&temp);
+        ccn_charbuf_destroy(&key);
+        return (0);
+    }
+    faceid = nfi->faceid;
+    ccn_face_instance_destroy(&nfi);
+    kf = calloc(1, sizeof(*kf));
+    if (kf == NULL) {
+        ccn_charbuf_destroy(&key);
+        return (faceid);
+    }
+    kf->key = key;
+    kf->faceid = faceid;
+    kf->next = *known;
+    *known = kf;
+    return (faceid);
+}
+
+static void
+known_faces_destroy(struct known_face **known)
+{
+    struct known_face *kf;
+    
+    while ((kf = *known) != NULL) {
+        *known = kf->next;
+        ccn_charbuf_destroy(&kf->key);
+        free(kf);
+    }
+}
+
+/*
+ * Send the registrations collected for items first up to (not including)
+ * last.  If ccnd will not take them as a batch (perhaps it is too old
+ * to know prefixregs) fall back to registering them one at a time.
+ */
+static void
+flush_prefix_batch(struct ccn *h, struct ccn_charbuf *entries,
+                   struct prefix_face_list_item *first,
+                   struct prefix_face_list_item *last,
+                   struct ccn_indexbuf *faceids)
+{
+    struct prefix_face_list_item *pfl;
+    struct ccn_face_instance fi = {0};
+    int op;
+    int i;
+    
+    if (entries->length == 0)
+        return;
+    if (register_prefix_batch(h, entries) < 0) {
+        if (verbose > 0)
+            ccndc_warn(__LINE__, "prefixregs failed, registering one at a time\n");
+        fi.ccnd_id = ccndid;
+        fi.ccnd_id_size = ccndid_size;
+        for (pfl = first, i = 0; pfl != last; pfl = pfl->next) {
+            if (0 != strcmp(pfl->fi->action, "newface"))
+                continue;
+            if (i >= faceids->n)
+                break;
+            fi.faceid = faceids->buf[i++];
+            if (fi.faceid == 0)
+                continue;
+            op = (pfl->fi->lifetime > 0) ? OP_REG : OP_UNREG;
+            if (register_unregister_prefix(h, op, pfl->prefix, &fi,
+                                           pfl->flags, pfl->quota,
+                                           pfl->tclass, pfl->fresh,
+                                           pfl->residency) < 0)
+                warn_prefix_failure(pfl, op, fi.faceid);
+        }
+    }
+    entries->length = 0;
+    faceids->n = 0;
+}
+
+/*
+ * Carry out the commands from a config file.
+ *
+ * Each distinct face is set up once, and the prefix registrations go to
+ * ccnd in prefixregs batches, so that a large FIB loads with a few
+ * signed requests rather than one per line.
+ */
+static void
+process_prefix_face_list_batched(struct ccn *h,
+                                 struct prefix_face_list_item *pflhead)
+{
+    struct ccn_charbuf *entries = ccn_charbuf_create();
+    struct ccn_indexbuf *faceids = ccn_indexbuf_create();
+    struct ccn_forwarding_entry fe = {0};
+    struct known_face *known = NULL;
+    struct prefix_face_list_item *first = pflhead;
+    struct prefix_face_list_item *pfl;
+    unsigned faceid;
+    
+    if (entries == NULL || faceids == NULL)
+        ccndc_fatal(__LINE__, "Unable to allocate batch\n");
+    for (pfl = pflhead; pfl != NULL; pfl = pfl->next) {
+        pfl->fi->ccnd_id = ccndid;
+        pfl->fi->ccnd_id_size = ccndid_size;
+        if (0 != strcmp(pfl->fi->action, "newface")) {
+            /* keep the order: registrations so far go first */
+            flush_prefix_batch(h, entries, first, pfl, faceids);
+            known_faces_destroy(&known);
+            process_prefix_face_list_item(h, pfl);
+            first = pfl->next;
+            continue;
+        }
+        faceid = known_face_id(h, &known, pfl);
+        ccn_indexbuf_append_element(faceids, faceid);
+        if (faceid == 0)
+            continue;
+        fe.action = (pfl->fi->lifetime > 0) ? "prefixreg" : "unreg";
+        fe.name_prefix = pfl->prefix;
+        fe.ccnd_id = ccndid;
+        fe.ccnd_id_size = ccndid_size;
+        fe.faceid = faceid;
+        fe.flags = pfl->flags;
+        fe.lifetime = (~0U) >> 1;
+        fe.store_quota = pfl->quota;
+        fe.traffic_class = pfl->tclass;
+        fe.default_freshness = pfl->fresh;
+        fe.max_residency = pfl->residency;
+        if (ccnb_append_forwarding_entry(entries, &fe) < 0)
+            ccndc_fatal(__LINE__, "Unable to encode ForwardingEntry\n");
+        if (entries->length >= BATCH_BYTES) {
+            flush_prefix_batch(h, entries, first, pfl->next, faceids);
+            first = pfl->next;
+        }
+    }
+    flush_prefix_batch(h, entries, first, NULL, faceids);
+    known_faces_destroy(&known);
+    ccn_charbuf_destroy(&entries);
+    ccn_indexbuf_destroy(&faceids);
+}
+
 enum ccn_upcall_res
 incoming_interest(
                   struct ccn_closure *selfp,
@@ -856,7 +1182,7 @@ incoming_interest(
                                  proto,
                                  host,
                                  portstring,
-                                 NULL, NULL, NULL);
+                                 NULL, NULL, NULL, -1, -1, -1, -1, -1, -1);
     if (res < 0)
         return (CCN_UPCALL_RESULT_ERR);
 
@@ -878,6 +1204,14 @@ main(int argc, char **argv)
     struct prefix_face_list_item *pfl;
     int dynamic = 0;
     struct ccn_closure interest_closure = {.p=&incoming_interest};
+    char *tok[14];
+    int rate;
+    int burst;
+    intmax_t quota;
+    int tclass;
+    int fresh;
+    int residency;
+    int i;
     int res;
     int opt;
     
@@ -906,20 +1240,22 @@ main(int argc, char **argv)
         if (configfile != NULL) {
             usage(progname);
         }
-        /* (add|delete) uri type host [port [flags [mcast-ttl [mcast-if]]]] */
+        /* (add|delete) uri type host [port [flags [mcast-ttl [mcast-if]]]] [rate=n] [burst=n] [quota=n] [class=n] [fresh=n] [residency=n] */
         
-        if (argc - optind < 2 || argc - optind > 8)
+        if (argc - optind < 2 || argc - optind > 14)
             usage(progname);
         
+        for (i = 0; i < 14; i++)
+            tok[i] = (optind + i) < argc ? argv[optind + i] : NULL;
+        res = take_keyword_tokens(tok, 14, &rate, &burst, &quota, &tclass,
+                                  &fresh, &residency);
+        if (res < 0)
+            usage(progname);
         res = process_command_tokens(pflhead, 0,
-                                     argv[optind],
-                                     argv[optind+1],
-                                     (optind + 2) < argc ? argv[optind+2] : NULL,
-                                     (optind + 3) < argc ? argv[optind+3] : NULL,
-                                     (optind + 4) < argc ? argv[optind+4] : NULL,
-                                     (optind + 5) < argc ? argv[optind+5] : NULL,
-                                     (optind + 6) < argc ? argv[optind+6] : NULL,
-                                     (optind + 7) < argc ? argv[optind+7] : NULL);
+                                     tok[0], tok[1], tok[2], tok[3],
+                                     tok[4], tok[5], tok[6], tok[7],
+                                     rate, burst, quota, tclass,
+                                     fresh, residency);
         if (res < 0)
             usage(progname);
     }
@@ -937,8 +1273,12 @@ main(int argc, char **argv)
     
     if (pflhead->next) {        
         ccndid_size = get_ccndid(h, ccndid, sizeof(ccndid_storage));
-        for (pfl = pflhead->next; pfl != NULL; pfl = pfl->next) {
-            process_prefix_face_list_item(h, pfl);
+        if (configfile != NULL)
+            process_prefix_face_list_batched(h, pflhead->next);
+        else {
+            for (pfl = pflhead->next; pfl != NULL; pfl = pfl->next) {
+                process_prefix_face_list_item(h, pfl);
+            }
         }
         prefix_face_list_destroy(&pflhead->next);
     }
@@ -24,7 +24,7 @@ LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/..
 # LOCAL_PATH = project_root/csrc/sync
 LOCAL_C_INCLUDES	+= $(LOCAL_PATH)/../../android/external/openssl-armv5/include
 
-SYNCOBJ := IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o 
+SYNCOBJ := IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncIBLT.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o 
 
 SYNCSRC := $(SYNCOBJ:.o=.c)
 
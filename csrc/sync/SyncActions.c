@@ -33,6 +33,7 @@
 #include <ccnr/ccnr_private.h>
 
 #include "SyncActions.h"
+#include "SyncIBLT.h"
 #include "SyncNode.h"
 #include "SyncPrivate.h"
 #include "SyncRoot.h"
@@ -48,7 +49,10 @@ static int nDeltasLimit = 4;            // limit of deltas objects in chain per
 static int cachePurgeTrigger = 60;      // cache entry purge, in seconds
 static int cacheCleanBatch = 16;        // seconds between cleaning batches
 static int cacheCleanDelta = 8;         // cache clean batch size
+static size_t storeBatchBytes = 8000;   // bytes of nodes per stored batch
+static int cacheResidentLimit = 4*1024*1024; // bytes of local nodes kept per root
 static int adviseNeedReset = 1;         // reset value for adviseNeed
+static int adviseBackoffLimit = 8;      // max multiple of RootAdvise lifetime while idle
 static int updateStallDelta = 15;       // seconds used to determine stalled update
 static int updateNeedDelta = 6;         // seconds for adaptive update
 static int shortDelayMicros = 1000;     // short delay for quick reschedule
@@ -63,6 +67,8 @@ static int namesYieldMicros = 20*1000;  // number of micros to use as yield trig
 static char *syncStableSuffix = "SyncStable";
 
 #define SYNC_UPDATE_VERSION (20120307)
+#define CONTENT_CHECK_BATCH 64  // number of names per local presence check
+#define STORE_BATCH_NODES 64    // limit on nodes per stored batch
 
 enum SyncCompareState {
     SyncCompare_init,
@@ -86,10 +92,16 @@ struct SyncCompareData {
     int errsQueued;                 /**< names added during this comparison */
     int namesAdded;                 /**< names added during this comparison */
     int nodeFetchBusy;              /**< number of busy remote node fetches */
+    int nodeFetchPeak;              /**< max number of busy remote node fetches */
     int nodeFetchFailed;            /**< number of failed remote node fetches */
     int contentPos;                 /**< position of next content to fetch */
+    int contentChecked;             /**< names before this were checked locally */
     int contentFetchBusy;           /**< number of busy content fetches */
     int contentFetchFailed;         /**< number of failed content fetches */
+    struct SyncHashCacheEntry **preQ; /**< remote nodes queued for preload */
+    int preHead;                    /**< index of first queued node */
+    int preLen;                     /**< number of queued nodes */
+    int preMax;                     /**< allocated size of preQ */
     struct ccn_scheduled_event *ev; /**< progress event */
     enum SyncCompareState state;    /**< summary state of comparison */
     int64_t lastFetchOK;          /**< time marker for last successul node/content fetch */
@@ -97,6 +109,7 @@ struct SyncCompareData {
     int64_t lastEnter;            /**< time marker for last compare step entry */
     int64_t lastMark;             /**< time marker for stall determination */
     int64_t maxHold;                /**< max time thread was held by compare */
+    int64_t due;                    /**< when the next step should start */
 };
 
 enum SyncUpdateState {
@@ -114,8 +127,8 @@ struct SyncUpdateData {
     struct SyncNodeAccum *nodes;
     struct SyncTreeWorkerHead *tw;
     struct ccn_charbuf *cb;
-    IndexSorter_Base ixBase;
-    IndexSorter_Index ixPos;
+    struct SyncNameAccum *src;          /*< sorted names to add */
+    int srcPos;                         /*< next name in src */
     int nameLenAccum;
     int namesAdded;
     int initLen;
@@ -124,9 +137,11 @@ struct SyncUpdateData {
     int64_t startTime;
     int64_t entryTime;
     int64_t maxHold;
+    int64_t due;                        /*< when the next step should start */
     int preSortCount;
     int postSortCount;
     struct SyncRootDeltas *deltas;
+    struct SyncIBLT *iblt;              /*< IBLT with the new names (may be NULL) */
 };
 
 ///////////////////////////////////////////////////////////////////////////
@@ -151,6 +166,20 @@ CompareAction(struct ccn_schedule *sched,
               struct ccn_scheduled_event *ev,
               int flags);
 
+static int
+expressContentFetch(struct SyncRootStruct *root,
+                    struct ccn_charbuf *name,
+                    struct SyncCompareData *comp);
+
+static void
+checkContentPresent(struct SyncCompareData *comp);
+
+static int
+fetchWindow(struct SyncRootStruct *root);
+
+static void
+fetchWindowNote(struct SyncRootStruct *root, int64_t sent, int timedOut);
+
 ///////////////////////////////////////////////////////////////////////////
 ///// General internal routines
 ///////////////////////////////////////////////////////////////////////////
@@ -370,37 +399,17 @@ compareHash(struct ccn_charbuf *hashX, struct ccn_charbuf *hashY) {
 static struct SyncNameAccum *
 sortNames(struct SyncRootStruct *root, struct SyncNameAccum *src) {
     char *here = "Sync.sortNames";
-    IndexSorter_Index ixLim = src->len;
-    IndexSorter_Base ixBase = IndexSorter_New(ixLim, -1);
-    ixBase->sorter = SyncNameAccumSorter;
-    ixBase->client = src;
-    IndexSorter_Index ix = 0;
-    for (ix = 0; ix < ixLim; ix++) IndexSorter_Add(ixBase, ix);
-    struct SyncNameAccum *dst = SyncAllocNameAccum(ixLim);
-    struct ccn_charbuf *lag = NULL;
-    for (ix = 0; ix < ixLim; ix++) {
-        IndexSorter_Index j = IndexSorter_Rem(ixBase);
-        if (j >= ixLim) {
-            SyncNoteFailed(root, here, "rem failed", __LINE__);
-            break;
-        }
-        struct ccn_charbuf *name = src->ents[j].name;
-        src->ents[j].name = NULL;
-        if (name == NULL) {
-            SyncNoteFailed(root, here, "name == NULL", __LINE__);
-            break;
-        }
-        if (lag == NULL || SyncCmpNames(lag, name) != 0) {
-            // only append the name if it is not a duplicate
-            SyncNameAccumAppend(dst, name, src->ents[j].data); // XXXXXX
-            lag = name;
-        } else {
-            // this name needs to be destroyed
-            ccn_charbuf_destroy(&name);
-        }
-    }    
+    if (SyncNameAccumSort(src) < 0)
+        SyncNoteFailed(root, here, "bad name", __LINE__);
+    // the sorted entries move to dst
+    struct SyncNameAccum *dst = SyncAllocNameAccum(0);
+    struct SyncNameAccumEntry *ents = dst->ents;
+    dst->ents = src->ents;
+    dst->len = src->len;
+    dst->lim = src->lim;
+    src->ents = ents;
     src->len = 0;
-    IndexSorter_Free(&ixBase);
+    src->lim = 4;
     return dst;
 }
 
@@ -475,12 +484,28 @@ formatStats(struct SyncRootStruct *root, struct ccn_charbuf *cb) {
         }
         intmax_t dt = SyncDeltaTime(comp->startTime, now);
         pos += snprintf(s+pos, lim-pos, ", compareBusy %jd", dt);
+        if (comp->nodeFetchBusy > 0)
+            pos += snprintf(s+pos, lim-pos, ", compareFetchBusy %d",
+                            comp->nodeFetchBusy);
+        if (comp->contentFetchBusy > 0)
+            pos += snprintf(s+pos, lim-pos, ", contentFetchBusy %d",
+                            comp->contentFetchBusy);
+    }
+    if (root->priv->fetchWindow > 0) {
+        pos += snprintf(s+pos, lim-pos, ", fetchWindow %d",
+                        root->priv->fetchWindow);
     }
     if (update != NULL) {
         intmax_t dt = SyncDeltaTime(update->startTime, now);
         pos += snprintf(s+pos, lim-pos, ", updateBusy %jd", dt);
     }
     
+    if (root->priv->adviseIdleMicros != 0) {
+        uintmax_t x = root->priv->adviseIdleMicros;
+        pos += snprintf(s+pos, lim-pos, ", adviseIdle %ju.%06u",
+                        x / M, (unsigned) (x % M));
+    }
+    
     if (root->priv->lastHashChange != 0) {
         uintmax_t x = root->priv->lastHashChange;
         pos += snprintf(s+pos, lim-pos, ", lastHashChange %ju.%06u",
@@ -507,28 +532,52 @@ formatStats(struct SyncRootStruct *root, struct ccn_charbuf *cb) {
                         ncL->byteCount + ncL->cb->length);
     }
     
+    if (root->ch != NULL) {
+        struct SyncHashCacheHead *ch = root->ch;
+        pos += snprintf(s+pos, lim-pos, ", cacheEntries %ju", (uintmax_t) ch->len);
+        pos += snprintf(s+pos, lim-pos, ", cacheProbes %ju", ch->probes);
+        pos += snprintf(s+pos, lim-pos, ", cacheMisses %ju", ch->misses);
+        if (ch->evictions)
+            pos += snprintf(s+pos, lim-pos, ", cacheEvictions %ju", ch->evictions);
+        if (ch->resident)
+            pos += snprintf(s+pos, lim-pos, ", cacheResident %ju",
+                            (uintmax_t) ch->resident);
+    }
+    
     StatsLine(comparesDone);
     StatsLine(lastCompareMicros);
+    StatsLine(lastCompareFetchPeak);
     StatsLine(updatesDone);
     StatsLine(lastUpdateMicros);
     StatsLine(nodesCreated);
     StatsLine(nodesShared);
+    StatsLine(nodesStored);
+    StatsLine(nodesStoreShared);
+    StatsLine(nodeStoreBatches);
     StatsLine(rootAdviseSent);
     StatsLine(rootAdviseSeen);
     StatsLine(rootAdviseReceived);
     StatsLine(rootAdviseTimeout);
     StatsLine(rootAdviseFailed);
+    StatsLine(rootAdviseBackoff);
+    StatsLine(activityNoted);
+    StatsLine(rootAdviseIBLTSent);
+    StatsLine(rootAdviseIBLTDecoded);
+    StatsLine(rootAdviseIBLTFailed);
     StatsLine(nodeFetchSent);
     StatsLine(nodeFetchSeen);
     StatsLine(nodeFetchReceived);
     StatsLine(nodeFetchTimeout);
     StatsLine(nodeFetchFailed);
     StatsLine(nodeFetchBytes);
+    StatsLine(nodeFetchRttMicros);
+    StatsLine(nodeFetchBatched);
     StatsLine(contentFetchSent);
     StatsLine(contentFetchReceived);
     StatsLine(contentFetchTimeout);
     StatsLine(contentFetchFailed);
     StatsLine(contentFetchBytes);
+    StatsLine(schedLagMicros);
     
 #ifdef RUSAGE_SELF
     if (ru_ok >= 0) {
@@ -652,6 +701,37 @@ extractDeltas(struct SyncRootStruct *root, struct ccn_upcall_info *info) {
     return count;
 }
 
+// enterBatch enters the remaining nodes of a SyncNodeBatch as remote nodes
+// (cb is scratch space)
+static void
+enterBatch(struct SyncRootStruct *root, struct ccn_buf_decoder *d,
+           struct ccn_charbuf *cb) {
+    while (ccn_buf_match_dtag(d, CCN_DTAG_SyncNode)) {
+        ccn_charbuf_reset(cb);
+        if (SyncNodeExpand(cb, d) < 0) break;
+        struct SyncNodeComposite *nc = SyncAllocComposite(root->base);
+        struct ccn_buf_decoder ds;
+        struct ccn_buf_decoder *nd = ccn_buf_decoder_start(&ds, cb->buf,
+                                                          cb->length);
+        if (SyncParseComposite(nc, nd) < 0 || nc->hash == NULL) {
+            SyncFreeComposite(nc);
+            break;
+        }
+        struct SyncHashCacheEntry *ce = SyncHashEnter(root->ch,
+                                                      nc->hash->buf,
+                                                      nc->hash->length,
+                                                      SyncHashState_remote);
+        if (ce == NULL || ce->ncR != NULL || isCovered(ce)) {
+            // already have it, or don't need it
+            SyncFreeComposite(nc);
+            continue;
+        }
+        ce->ncR = nc;
+        SyncNodeIncRC(nc);
+        root->priv->stats->nodeFetchBatched++;
+    }
+}
+
 // extractNode parses and creates a sync tree node from an upcall info
 // returns NULL if there was any kind of error
 static struct SyncNodeComposite *
@@ -673,7 +753,23 @@ extractNode(struct SyncRootStruct *root, struct ccn_upcall_info *info) {
     struct SyncNodeComposite *nc = SyncAllocComposite(root->base);
     struct ccn_buf_decoder ds;
     struct ccn_buf_decoder *d = ccn_buf_decoder_start(&ds, cp, cs);
-    res |= SyncParseComposite(nc, d);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_SyncNodeBatch)) {
+        // the requested node is first in the batch
+        struct ccn_charbuf *cb = ccn_charbuf_create();
+        ccn_buf_advance(d);
+        uintmax_t vers = SyncParseUnsigned(d, CCN_DTAG_SyncVersion);
+        if (SyncCheckDecodeErr(d) || vers != SYNC_NODE_BATCH_VERSION
+            || SyncNodeExpand(cb, d) < 0)
+            res = -__LINE__;
+        else {
+            struct ccn_buf_decoder nds;
+            struct ccn_buf_decoder *nd = ccn_buf_decoder_start(&nds, cb->buf,
+                                                              cb->length);
+            res |= SyncParseComposite(nc, nd);
+            if (res >= 0) enterBatch(root, d, cb);
+        }
+        ccn_charbuf_destroy(&cb);
+    } else res |= SyncParseComposite(nc, d);
     if (res < 0) {
         // failed, so back out of the allocations
         SyncNoteFailed(root, here, "bad parse", -res);
@@ -683,6 +779,62 @@ extractNode(struct SyncRootStruct *root, struct ccn_upcall_info *info) {
     return nc;
 }
 
+// nodeBatch returns a SyncNodeBatch for a NodeFetch of the node, holding the
+// node and then its local descendants (breadth-first), in the compact
+// encoding, for as long as they fit in nodeBatchBytes
+// returns NULL if no descendant fits (or there are none)
+static struct ccn_charbuf *
+nodeBatch(struct SyncRootStruct *root, struct SyncNodeComposite *nc) {
+    size_t lim = root->base->priv->nodeBatchBytes;
+    struct ccn_charbuf *cb = ccn_charbuf_create();
+    int qMax = 16;
+    int qLen = 0;
+    int qHead = 0;
+    struct SyncNodeComposite **q = NEW_ANY(qMax, struct SyncNodeComposite *);
+    int full = 0;
+    int res = 0;
+    res |= ccnb_element_begin(cb, CCN_DTAG_SyncNodeBatch);
+    res |= SyncAppendTaggedNumber(cb, CCN_DTAG_SyncVersion,
+                                  SYNC_NODE_BATCH_VERSION);
+    res |= SyncNodeAppendCompact(cb, nc);
+    q[qLen++] = nc;
+    while (res >= 0 && !full && qHead < qLen) {
+        struct SyncNodeComposite *each = q[qHead++];
+        int i = 0;
+        for (i = 0; i < each->refLen; i++) {
+            struct SyncNodeElem *ep = &each->refs[i];
+            if (ep->kind & SyncElemKind_leaf) continue;
+            struct ccn_buf_decoder ds;
+            struct ccn_buf_decoder *d = SyncInitDecoderFromOffset(&ds, each,
+                                                                  ep->start,
+                                                                  ep->stop);
+            const unsigned char *xp = NULL;
+            ssize_t xs = 0;
+            SyncGetHashPtr(d, &xp, &xs);
+            struct SyncHashCacheEntry *ce = SyncHashLookup(root->ch, xp, xs);
+            if (SyncCacheEntryFetch(ce) < 0) continue;
+            size_t mark = cb->length;
+            if (SyncNodeAppendCompact(cb, ce->ncL) < 0
+                || cb->length + 1 > lim) {
+                // no room, so the batch is done
+                cb->length = mark;
+                full = 1;
+                break;
+            }
+            if (qLen >= qMax) {
+                qMax = qMax + qMax;
+                q = realloc(q, qMax * sizeof(q[0]));
+            }
+            q[qLen++] = ce->ncL;
+        }
+    }
+    res |= ccnb_element_end(cb);
+    free(q);
+    if (res < 0 || qLen < 2)
+        ccn_charbuf_destroy(&cb);
+    return cb;
+}
+
 // noteHash remembers a remote hash (given by the hash cache entry),
 // promoting it to the front
 // if add == TRUE and there is no remote hash, then add it, else ignore it
@@ -823,6 +975,7 @@ destroyCompareData(struct SyncCompareData *data) {
     ccn_charbuf_destroy(&data->hashR);
     ccn_charbuf_destroy(&data->cbL);
     ccn_charbuf_destroy(&data->cbR);
+    free(data->preQ);
     data->twL = SyncTreeWorkerFree(data->twL);
     data->twR = SyncTreeWorkerFree(data->twR);
     if (data->ev != NULL && root != NULL) {
@@ -883,7 +1036,155 @@ extractBuf(struct ccn_charbuf *cb, struct SyncNodeComposite *nc, struct SyncNode
     struct ccn_buf_decoder *d = SyncInitDecoderFromElem(&ds, nc, ne);
     ccn_charbuf_reset(cb);
     int res = SyncAppendElementInner(cb, d);
-    return res;    
+    return res;
+}
+
+// rootIBLT returns the IBLT for the names in the current local tree.
+// Updates keep the IBLT current, but if the IBLT is missing or describes
+// some other tree (after a restart, for example) it is rebuilt by walking
+// every leaf of the tree.
+// returns NULL if IBLT mode is disabled, or the walk failed
+static struct SyncIBLT *
+rootIBLT(struct SyncRootStruct *root) {
+    char *here = "Sync.rootIBLT";
+    struct SyncRootPrivate *rp = root->priv;
+    struct ccn_charbuf *hash = root->currentHash;
+    int cells = root->base->priv->ibltCells;
+    if (cells <= 0) return NULL;
+    if (rp->iblt != NULL && rp->ibltHash != NULL
+        && SyncCmpHashesRaw(rp->ibltHash->buf, rp->ibltHash->length,
+                            hash->buf, hash->length) == 0)
+        return rp->iblt;
+
+    struct SyncIBLT *iblt = SyncIBLTAlloc(cells);
+    struct SyncHashCacheEntry *ce = rp->ceCurrent;
+    int res = 0;
+    if (hash->length > 0 && ce != NULL) {
+        struct SyncTreeWorkerHead *tw = SyncTreeWorkerCreate(root->ch, ce, 0);
+        struct ccn_charbuf *cb = ccn_charbuf_create();
+        while (res == 0) {
+            struct SyncTreeWorkerEntry *ent = SyncTreeWorkerTop(tw);
+            if (ent == NULL) break;
+            ce = ent->cacheEntry;
+            if (ce == NULL || SyncCacheEntryFetch(ce) < 0 || ce->ncL == NULL) {
+                res = -__LINE__;
+                break;
+            }
+            struct SyncNodeComposite *nc = ce->ncL;
+            if (ent->pos >= nc->refLen) {
+                // done with this node
+                ent = SyncTreeWorkerPop(tw);
+                if (ent == NULL) break;
+                ent->pos++;
+            } else {
+                struct SyncNodeElem *ep = &nc->refs[ent->pos];
+                if (ep->kind & SyncElemKind_leaf) {
+                    if (extractBuf(cb, nc, ep) < 0) {
+                        res = -__LINE__;
+                        break;
+                    }
+                    SyncIBLTInsert(iblt, root->namingPrefix, cb, 1);
+                    ent->pos++;
+                } else if (SyncTreeWorkerPush(tw) == NULL) {
+                    res = -__LINE__;
+                    break;
+                }
+            }
+        }
+        ccn_charbuf_destroy(&cb);
+        SyncTreeWorkerFree(tw);
+    }
+    if (res < 0) {
+        SyncNoteFailed(root, here, "tree walk", -res);
+        SyncIBLTFree(iblt);
+        return NULL;
+    }
+    SyncIBLTFree(rp->iblt);
+    rp->iblt = iblt;
+    ccn_charbuf_destroy(&rp->ibltHash);
+    rp->ibltHash = ccn_charbuf_create();
+    ccn_charbuf_append_charbuf(rp->ibltHash, hash);
+    if (root->base->debug >= CCNL_INFO) {
+        char temp[64];
+        snprintf(temp, sizeof(temp), "rebuilt, %d names", iblt->names);
+        SyncNoteSimple(root, here, temp);
+    }
+    return iblt;
+}
+
+// ibltWorthSending estimates whether the difference between the local tree
+// (ceL) and the remote tree (ceR) is small enough to list from an IBLT.
+// The difference in leaf counts is a lower bound, when the remote tree is
+// known; an IBLT lists about half as many names as it has cells.
+static int
+ibltWorthSending(struct SyncRootStruct *root,
+                 struct SyncHashCacheEntry *ceL,
+                 struct SyncHashCacheEntry *ceR) {
+    int cells = root->base->priv->ibltCells;
+    if (cells <= 0 || ceL == NULL || ceL->ncL == NULL || ceR == NULL)
+        return 0;
+    struct SyncNodeComposite *ncR = ceR->ncR;
+    if (ncR == NULL) ncR = ceR->ncL;
+    if (ncR != NULL) {
+        int diff = (int) ceL->ncL->leafCount - (int) ncR->leafCount;
+        if (diff < 0) diff = -diff;
+        if (diff > cells / 2) return 0;
+    }
+    return 1;
+}
+
+// extractIBLT parses an IBLT from an upcall info, subtracts the IBLT of the
+// local names, and lists the remote names that are missing locally
+// the names (if any) are placed in a name accum stored in root->priv->remoteDeltas
+// returns < 0 if there is no usable IBLT, 0 if the IBLT could not be decoded
+// (so a tree compare is needed), or the number of names peeled on success
+static int
+extractIBLT(struct SyncRootStruct *root, struct ccn_upcall_info *info) {
+    char *here = "Sync.extractIBLT";
+    const unsigned char *cp = NULL;
+    size_t cs = 0;
+    size_t ccnb_size = info->pco->offset[CCN_PCO_E];
+    const unsigned char *ccnb = info->content_ccnb;
+    int res = ccn_content_get_value(ccnb, ccnb_size, info->pco,
+                                    &cp, &cs);
+    if (res < 0 || cs < 2)
+        return -1;
+    struct ccn_buf_decoder ds;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&ds, cp, cs);
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_SyncNodeIBLT))
+        return -1;
+    struct SyncIBLT *iblt = SyncIBLTParse(d);
+    if (iblt == NULL) {
+        SyncNoteFailed(root, here, "bad parse", __LINE__);
+        return -1;
+    }
+    struct SyncIBLT *local = rootIBLT(root);
+    if (local == NULL || SyncIBLTSubtract(iblt, local) < 0) {
+        // can't use it, most likely the cell counts differ
+        SyncNoteFailed(root, here, "no local IBLT", __LINE__);
+        SyncIBLTFree(iblt);
+        return 0;
+    }
+    struct SyncNameAccum *na = SyncAllocNameAccum(4);
+    int peeled = SyncIBLTDecode(iblt, root->namingPrefix, na);
+    SyncIBLTFree(iblt);
+    if (peeled <= 0) {
+        // too many differences, or only long names
+        SyncFreeNameAccumAndNames(na);
+        return 0;
+    }
+    struct SyncNameAccum *acc = root->priv->remoteDeltas;
+    if (acc == NULL && na->len > 0) {
+        root->priv->remoteDeltas = na;
+    } else {
+        // the caller takes the remote hash as covered, so keep any names
+        // still waiting from an earlier reply
+        int i = 0;
+        for (i = 0; i < na->len; i++)
+            SyncNameAccumAppend(acc, na->ents[i].name, 0);
+        SyncFreeNameAccum(na);
+    }
+    return peeled;
 }
 
 static struct SyncHashCacheEntry *
@@ -968,69 +1269,95 @@ addNameFromCompare(struct SyncCompareData *data) {
     return 0;
 }
 
+// preloadPut(data, ce) appends a remote entry to the preload queue
+static void
+preloadPut(struct SyncCompareData *data, struct SyncHashCacheEntry *ce) {
+    if (data->preLen >= data->preMax) {
+        // full, so unwrap into a larger queue
+        int max = data->preMax * 2 + 16;
+        struct SyncHashCacheEntry **q = NEW_ANY(max, struct SyncHashCacheEntry *);
+        int i = 0;
+        for (i = 0; i < data->preLen; i++)
+            q[i] = data->preQ[(data->preHead + i) % data->preMax];
+        free(data->preQ);
+        data->preQ = q;
+        data->preHead = 0;
+        data->preMax = max;
+    }
+    data->preQ[(data->preHead + data->preLen) % data->preMax] = ce;
+    data->preLen++;
+}
+
+// startPreload(data) queues the remote root, and enters the preload state
+static void
+startPreload(struct SyncCompareData *data) {
+    struct SyncRootStruct *root = data->root;
+    struct SyncHashCacheEntry *ceR = SyncHashLookup(root->ch,
+                                                    data->hashR->buf,
+                                                    data->hashR->length);
+    if (ceR != NULL) preloadPut(data, ceR);
+    data->state = SyncCompare_preload;
+}
+
 /*
  * doPreload(data) walks the remote tree, and requests a fetch for every remote
  * node that is not covered locally and has not been fetched,
  * and is not being fetched.  This allows large trees to be fetched in parallel,
  * speeding up the load process.
+ *
+ * The walk is breadth-first, using data->preQ, so the fetches for all of the
+ * missing nodes at one level are in flight together, up to maxFetchBusy.  A
+ * node being fetched leaves the queue; SyncRemoteFetchResponse puts it back
+ * when it arrives, so that its children are visited next.  No visited node is
+ * walked again when a reply arrives.
  */
 static int
 doPreload(struct SyncCompareData *data) {
     struct SyncRootStruct *root = data->root;
-    struct SyncTreeWorkerHead *twR = data->twR;
     int busyLim = root->base->priv->maxFetchBusy;
-    for (;;) {
-        if (data->nodeFetchBusy > busyLim) return 0;
-        if (twR->level <= 0) break;
-        struct SyncTreeWorkerEntry *ent = SyncTreeWorkerTop(twR);
-        struct SyncHashCacheEntry *ceR = ent->cacheEntry;
-        if (ceR == NULL)
-            return -1;
+    while (data->nodeFetchBusy < busyLim) {
+        // restart the failed node fetches (while we can)
+        struct SyncActionData *sad = data->errList;
+        if (sad == NULL) break;
+        struct SyncHashCacheEntry *ceR = SyncHashLookup(root->ch,
+                                                        sad->hash->buf,
+                                                        sad->hash->length);
+        SyncStartNodeFetch(root, ceR, data);
+        destroyActionData(sad);
+    }
+    while (data->preLen > 0) {
+        struct SyncHashCacheEntry *ceR = data->preQ[data->preHead];
+        if (ceR->ncR == NULL && !isCovered(ceR)
+            && (ceR->state & SyncHashState_fetching) == 0
+            && data->nodeFetchBusy >= busyLim)
+            // needs a fetch, but wait for a reply to make room
+            break;
+        data->preHead = (data->preHead + 1) % data->preMax;
+        data->preLen--;
         if (ceR->state & SyncHashState_fetching
             || isCovered(ceR)) {
-            // not a needed node, so pop it
+            // not a needed node (or not yet), so drop it
         } else if (ceR->ncR != NULL) {
-            // visit the children
+            // queue the children
             struct SyncNodeComposite *ncR = ceR->ncR;
-            int lim = ncR->refLen;
-            while (ent->pos < lim) {
-                struct SyncNodeElem *ep = &ncR->refs[ent->pos];
-                if ((ep->kind & SyncElemKind_leaf) == 0)
-                    break;
-                ent->pos++;
-            }
-            if (ent->pos < lim) {
-                struct SyncNodeElem *ep = &ncR->refs[ent->pos];
+            int i = 0;
+            for (i = 0; i < ncR->refLen; i++) {
+                struct SyncNodeElem *ep = &ncR->refs[i];
+                if (ep->kind & SyncElemKind_leaf) continue;
                 struct SyncHashCacheEntry *sub = cacheEntryForElem(data, ncR, ep, 1);
                 if (sub == NULL)
                     return -1;
-                ent = SyncTreeWorkerPush(twR);
-                if (ent == NULL)
-                    return -1;
-                continue;
+                preloadPut(data, sub);
             }
         } else {
-            // init the fetch, then pop
+            // init the fetch, the reply will queue it again
             SyncStartNodeFetch(root, ceR, data);
         }
-        // common exit to pop and iterate
-        ent = SyncTreeWorkerPop(twR);
-        if (ent != NULL) ent->pos++;
-    }
-    while (data->nodeFetchBusy < busyLim) {
-        // restart the failed node fetches (while we can)
-        struct SyncActionData *sad = data->errList;
-        if (sad == NULL) break;
-        struct SyncHashCacheEntry *ceR = SyncHashLookup(root->ch,
-                                                        sad->hash->buf,
-                                                        sad->hash->length);
-        SyncStartNodeFetch(root, ceR, data);
-        destroyActionData(sad);
     }
     
     if (data->nodeFetchBusy > 0) return 0;
     if (data->errList != NULL) return 0;
-    if (twR->level > 0) return 0;
+    if (data->preLen > 0) return 0;
     return 1;
 }
 
@@ -1181,7 +1508,7 @@ doComparison(struct SyncCompareData *data) {
                 } else {
                     // both L and R are nodes, test for L being present
                     struct SyncHashCacheEntry *subL = cacheEntryForElem(data, ncL, neL, 0);
-                    if (subL == NULL || subL->ncL == NULL)
+                    if (subL == NULL || SyncCacheEntryFetch(subL) < 0 || subL->ncL == NULL)
                         return comparisonFailed(data, "bad cache entry for L", __LINE__);
                     // both L and R are nodes, and both are present
                     struct SyncNodeComposite *ncL = subL->ncL;
@@ -1217,7 +1544,7 @@ doComparison(struct SyncCompareData *data) {
                 } else {
                     // R is a leaf, but L is a node
                     struct SyncHashCacheEntry *subL = cacheEntryForElem(data, ncL, neL, 0);
-                    if (subL == NULL || subL->ncL == NULL)
+                    if (subL == NULL || SyncCacheEntryFetch(subL) < 0 || subL->ncL == NULL)
                         return comparisonFailed(data, "bad cache entry for L", __LINE__);
                     enum SyncCompareResult scr = SyncNodeCompareMinMax(subL->ncL, data->cbR);
                     switch (scr) {
@@ -1382,6 +1709,20 @@ purgeOldEntries(struct SyncRootStruct *root) {
     SyncTreeWorkerFree(twL);
 }
 
+// noteSchedLag records how late a compare or update step started,
+// relative to when it was scheduled to start
+static void
+noteSchedLag(struct SyncRootStruct *root, int64_t due, int64_t now) {
+    struct SyncRootStats *stats = root->priv->stats;
+    if (due == 0) return;
+    int64_t lag = SyncDeltaTime(due, now);
+    if (lag < 0) lag = 0;
+    SyncHistNote(&stats->schedLag, lag);
+    // keep a smoothed lag (gain 1/8)
+    int64_t slag = stats->schedLagMicros;
+    stats->schedLagMicros = slag + (lag - slag) / 8;
+}
+
 static int
 CompareAction(struct ccn_schedule *sched,
               void *clienth,
@@ -1397,6 +1738,8 @@ CompareAction(struct ccn_schedule *sched,
     struct SyncRootStruct *root = data->root;
     struct ccnr_handle *ccnr = root->base->client_handle;
     int debug = root->base->debug;
+    noteSchedLag(root, data->due, data->lastEnter);
+    data->due = 0;
     if (data->ev != ev || flags & CCN_SCHEDULE_CANCEL) {
         // orphaned or cancelled
         if (debug >= CCNL_FINE)
@@ -1411,15 +1754,10 @@ CompareAction(struct ccn_schedule *sched,
             // nothing to do, flow into next state
             if (debug >= CCNL_FINE)
                 SyncNoteSimple(root, here, "init");
-            data->state = SyncCompare_preload;
+            startPreload(data);
         case SyncCompare_preload: {
-            // nothing to do (yet), flow into next state
             if (debug >= CCNL_FINE)
                 SyncNoteSimple(root, here, "preload");
-            struct SyncHashCacheEntry *ceR = SyncHashLookup(root->ch,
-                                                            data->hashR->buf,
-                                                            data->hashR->length);
-            SyncTreeWorkerInit(data->twR, ceR, 1);
             int res = doPreload(data);
             if (res < 0) {
                 abortCompare(data, "doPreload failed");
@@ -1435,7 +1773,11 @@ CompareAction(struct ccn_schedule *sched,
                 break;
             }
             // before switch to busy, reset the remote tree walker
-            SyncTreeWorkerInit(data->twR, ceR, 1);
+            SyncTreeWorkerInit(data->twR,
+                               SyncHashLookup(root->ch,
+                                              data->hashR->buf,
+                                              data->hashR->length),
+                               1);
             data->state = SyncCompare_busy;
         }
         case SyncCompare_busy: {
@@ -1449,7 +1791,7 @@ CompareAction(struct ccn_schedule *sched,
             }
             if (data->errList != NULL) {
                 // we had a load started during compare, so retreat a state
-                data->state = SyncCompare_preload;
+                startPreload(data);
                 if (debug >= CCNL_WARNING)
                     SyncNoteSimple(root, here, "retreat one state");
                 break;
@@ -1464,7 +1806,12 @@ CompareAction(struct ccn_schedule *sched,
             if (debug >= CCNL_FINE)
                 SyncNoteSimple(root, here, "waiting");
             struct SyncNameAccum *namesToFetch = root->namesToFetch;
-            int busyLim = root->base->priv->maxFetchBusy;
+            int busyLim = fetchWindow(root);
+            if (namesToFetch != NULL && data->contentChecked == 0
+                && data->contentPos == 0)
+                // fetch in name order, so the repo appends and indexes
+                // the new content in order
+                SyncNameAccumSort(namesToFetch);
             int len = ((namesToFetch != NULL) ? namesToFetch->len : 0);
             if (debug >= CCNL_FINE) {
                 int pos = data->contentPos;
@@ -1473,17 +1820,26 @@ CompareAction(struct ccn_schedule *sched,
             }
             while (data->contentFetchBusy < busyLim
                    && data->contentPos < len) {
-                // initiate the content fetches
+                // initiate the content fetches, skipping the names
+                // that the repo already has
                 int pos = data->contentPos;
+                if (pos >= data->contentChecked)
+                    checkContentPresent(data);
                 struct ccn_charbuf *name = namesToFetch->ents[pos].name;
-                SyncStartContentFetch(root, name, data);
+                if (namesToFetch->ents[pos].data) {
+                    if (debug >= CCNL_INFO)
+                        SyncNoteUri(root, here, "ignored, already present", name);
+                    SyncAddName(root->base, name, 0);
+                } else {
+                    expressContentFetch(root, name, data);
+                }
                 data->contentPos = pos + 1;
             }
             while (data->contentFetchBusy < busyLim) {
                 // restart the failed fetches
                 struct SyncActionData *sad = data->errList;
                 if (sad == NULL) break;
-                SyncStartContentFetch(root, sad->prefix, data);
+                expressContentFetch(root, sad->prefix, data);
                 destroyActionData(sad);
             }
             if (data->contentFetchBusy > 0) {
@@ -1499,8 +1855,10 @@ CompareAction(struct ccn_schedule *sched,
             int64_t now = SyncCurrentTime();
             int64_t mh = SyncDeltaTime(data->lastEnter, now);
             int64_t dt = SyncDeltaTime(data->startTime, now);
+            SyncHistNote(&root->priv->stats->compareStep, mh);
             root->priv->stats->comparesDone++;
             root->priv->stats->lastCompareMicros = dt;
+            root->priv->stats->lastCompareFetchPeak = data->nodeFetchPeak;
             if (mh > data->maxHold) data->maxHold = mh;
             mh = (mh + 500) / 1000;
             dt = (dt + 500) / 1000;
@@ -1527,8 +1885,11 @@ CompareAction(struct ccn_schedule *sched,
         }
         default: break;
     }
-    int64_t mh = SyncDeltaTime(data->lastEnter, SyncCurrentTime());
+    int64_t now = SyncCurrentTime();
+    int64_t mh = SyncDeltaTime(data->lastEnter, now);
     if (mh > data->maxHold) data->maxHold = mh;
+    SyncHistNote(&root->priv->stats->compareStep, mh);
+    if (delay >= 0) data->due = now + delay;
     return delay;
 }
 
@@ -1543,17 +1904,32 @@ kickCompare(struct SyncCompareData *scd, struct SyncActionData *action) {
                                                             scd,
                                                             0);
         scd->ev = ev;
+        scd->due = SyncCurrentTime() + shortDelayMicros;
     }
 }
 
+// kickHeartBeat runs the heartbeat once, soon, apart from the periodic
+// heartbeat (evint == 1 marks the one-shot event)
+// only one kick is pending at a time
 static void
 kickHeartBeat(struct SyncRootStruct *root, int micros) {
-    if (root != NULL)
-        ccn_schedule_event(root->base->sched,
-                           micros,
-                           HeartbeatAction,
-                           root->base,
-                           0);
+    if (root != NULL && root->base->priv->heartbeatKick == 0) {
+        struct ccn_scheduled_event *ev = ccn_schedule_event(root->base->sched,
+                                                            micros,
+                                                            HeartbeatAction,
+                                                            root->base,
+                                                            1);
+        if (ev != NULL) root->base->priv->heartbeatKick = 1;
+    }
+}
+
+// noteActivity records a change for the root (new local names, or a new
+// remote root), so that idle RootAdvise backoff starts over
+static void
+noteActivity(struct SyncRootStruct *root) {
+    struct SyncRootPrivate *rp = root->priv;
+    rp->adviseIdleMicros = 0;
+    rp->stats->activityNoted++;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -1626,8 +2002,14 @@ newNodeCommon(struct SyncRootStruct *root,
     return ce;
 }
 
+// nodeFromNodesLevel builds the next level of the tree over na.
+// Runs of nodes no deeper than level are packed into new nodes, while
+// deeper nodes (kept whole from the previous tree by an update) pass
+// through unchanged, and are packed when the level reaches them.  This
+// keeps kept subtrees from being wrapped again on every update.
 static struct SyncHashCacheEntry *
-nodeFromNodes(struct SyncRootStruct *root, struct SyncNodeAccum *na) {
+nodeFromNodesLevel(struct SyncRootStruct *root, struct SyncNodeAccum *na,
+                   unsigned level) {
     char *here = "Sync.nodeFromNodes";
     struct SyncHashCacheHead *ch = root->ch;
     struct SyncBaseStruct *base = root->base;
@@ -1660,16 +2042,29 @@ nodeFromNodes(struct SyncRootStruct *root, struct SyncNodeAccum *na) {
     while (j < lim) {
         int maxLen = 0;
         int i = j;
+        if (na->ents[j]->treeDepth > level) {
+            // deeper than this level, so pass it through
+            SyncAccumNode(nodes, na->ents[j]);
+            j++;
+            continue;
+        }
         struct SyncNodeComposite *nc = SyncAllocComposite(base);
         int accLen = nc->cb->length;
         // first, loop to find the run length
-        while (i < lim && accLen < accLim) {
+        while (i < lim && accLen < accLim
+               && na->ents[i]->treeDepth <= level) {
             struct SyncNodeComposite *elem = na->ents[i];
             i++;
             int nodeLen = elem->hash->length + 8;
             if (nodeLen > maxLen) maxLen = nodeLen;
             accLen = accLen + nodeLen + (maxLen - nodeLen) * 2;
         }
+        if (i+1 == lim || (i+1 < lim && na->ents[i+1]->treeDepth > level)) {
+            // don't leave a lone node for the next run, since a node with
+            // one reference has the same hash as the reference, and the
+            // level would be skipped
+            if (i < lim && na->ents[i]->treeDepth <= level) i++;
+        }
         
         // append the references in the run
         while (j < i) {
@@ -1681,7 +2076,7 @@ nodeFromNodes(struct SyncRootStruct *root, struct SyncNodeAccum *na) {
         ce = newNodeCommon(root, nodes, nc);
     }
     // go recursive just in case we need the extra levels
-    ce = nodeFromNodes(root, nodes);
+    ce = nodeFromNodesLevel(root, nodes, level + 1);
     nodes = SyncFreeNodeAccum(nodes);
     if (debug >= CCNL_FINE) {
         ccnr_msg(ccnr, "%s, root#%u, %d refs", here, root->rootId, lim);
@@ -1689,6 +2084,11 @@ nodeFromNodes(struct SyncRootStruct *root, struct SyncNodeAccum *na) {
     return ce;
 }
 
+static struct SyncHashCacheEntry *
+nodeFromNodes(struct SyncRootStruct *root, struct SyncNodeAccum *na) {
+    return nodeFromNodesLevel(root, na, 1);
+}
+
 extern int
 SyncStartSliceEnum(struct SyncRootStruct *root) {
     char *here = "Sync.SyncStartSliceEnum";
@@ -1720,18 +2120,11 @@ SyncStartSliceEnum(struct SyncRootStruct *root) {
 ///// Main dispatching routine, the heart beat
 ///////////////////////////////////////////////////////////////////////////
 
+// doHeartbeat does the periodic work for all of the roots
+// returns the delay until the next heartbeat
 static int
-HeartbeatAction(struct ccn_schedule *sched,
-                void *clienth,
-                struct ccn_scheduled_event *ev,
-                int flags) {
+doHeartbeat(struct SyncBaseStruct *base) {
     char *here = "Sync.HeartbeatAction";
-    struct SyncBaseStruct *base = (struct SyncBaseStruct *) ev->evdata;
-    if (base == NULL || base->priv == NULL || (flags & CCN_SCHEDULE_CANCEL)) {
-        // TBD: and why did this happen? (can't report it, though)
-        return -1;
-    }
-    
     struct SyncPrivate *priv = base->priv;
     if (priv->sliceEnum > 0) {
         // we are still busy enumerating the slices, so reschedule
@@ -1774,9 +2167,17 @@ HeartbeatAction(struct ccn_schedule *sched,
             if (addLen == rp->prevAddLen)
                 // no change recently, so 
                 needUpdate = rp->stats->lastUpdateMicros * 2;
-            if (rp->adviseNeed <= 0 && deltaAdvise > lifeMicros)
-                // it's been a while since the last RootAdvise
+            int64_t adviseMicros = rp->adviseIdleMicros;
+            if (adviseMicros < lifeMicros) adviseMicros = lifeMicros;
+            if (rp->adviseNeed <= 0 && deltaAdvise > adviseMicros) {
+                // it's been a while since the last RootAdvise,
+                // and until something changes, wait longer for the next
                 rp->adviseNeed = adviseNeedReset;
+                if (adviseMicros < lifeMicros * adviseBackoffLimit) {
+                    rp->adviseIdleMicros = adviseMicros * 2;
+                    rp->stats->rootAdviseBackoff++;
+                }
+            }
             if (deltaUpdate >= needUpdate) {
                 // TBD: determine if this is a good algorithm for adaptive update  
                 if (addLen > 0) {
@@ -1826,35 +2227,63 @@ HeartbeatAction(struct ccn_schedule *sched,
     }
     int64_t deltaClean = SyncDeltaTime(priv->lastCacheClean, now);
     if (priv->useRepoStore && deltaClean >= cacheCleanDelta*M) {
-        // time to try to clean a batch of cache entries
-        // TBD: reclaim local nodes when not used for a while?
+        // time to try to clean some batches of cache entries
         int cleanRem = cacheCleanBatch;
-        while (cleanRem > 0) {
-            struct SyncHashCacheEntry *ce = priv->storingHead;
-            if (ce == NULL) break;
-            struct SyncHashCacheEntry *ceN = ce->storing;
-            SyncCacheEntryStore(ce);
-            priv->storingHead = ceN;
-            if (ceN == NULL) priv->storingTail = ceN;
-            if (priv->nStoring > 0) priv->nStoring--;
-            root = ce->head->root;
-            ccnr_hwm chw = ce->stablePoint;
-            if (ccnr_hwm_compare(base->client_handle, chw, root->priv->stablePoint) > 0) {
-                // the node that just got stored had a better stablePoint for the node
-                root->priv->stablePoint = chw;
-                root->priv->lastStable = now;
-                if (ccnr_hwm_compare(base->client_handle, chw, priv->stableTarget) > 0)
-                    priv->stableTarget = chw;
-                if (base->debug >= CCNL_INFO) {
-                    char temp[64];
-                    snprintf(temp, sizeof(temp),
-                             "newly stable at %ju",
-                             ccnr_hwm_encode(base->client_handle, chw));
-                    SyncNoteSimple(root, here, temp);
+        while (cleanRem > 0 && priv->storingHead != NULL) {
+            // each batch of queued nodes is stored as one object
+            struct SyncHashCacheEntry *batch[STORE_BATCH_NODES];
+            size_t bytes = 0;
+            int n = 0;
+            int i = 0;
+            while (n < STORE_BATCH_NODES) {
+                struct SyncHashCacheEntry *ce = priv->storingHead;
+                if (ce == NULL) break;
+                struct SyncNodeComposite *ncL = ce->ncL;
+                size_t len = ((ncL != NULL && ncL->cb != NULL) ? ncL->cb->length : 0);
+                if (n > 0 && bytes + len > storeBatchBytes) break;
+                bytes += len;
+                batch[n++] = ce;
+                priv->storingHead = ce->storing;
+                if (ce->storing == NULL) priv->storingTail = NULL;
+                if (priv->nStoring > 0) priv->nStoring--;
+            }
+            int64_t storeStart = SyncCurrentTime();
+            SyncCacheEntryStoreBatch(base, batch, n);
+            SyncHistNote(&batch[0]->head->root->priv->stats->storeTime,
+                         SyncDeltaTime(storeStart, SyncCurrentTime()));
+            for (i = 0; i < n; i++) {
+                struct SyncHashCacheEntry *ce = batch[i];
+                root = ce->head->root;
+                ccnr_hwm chw = ce->stablePoint;
+                if (ccnr_hwm_compare(base->client_handle, chw, root->priv->stablePoint) > 0) {
+                    // the node that just got stored had a better stablePoint for the node
+                    root->priv->stablePoint = chw;
+                    root->priv->lastStable = now;
+                    if (ccnr_hwm_compare(base->client_handle, chw, priv->stableTarget) > 0)
+                        priv->stableTarget = chw;
+                    if (base->debug >= CCNL_INFO) {
+                        char temp[64];
+                        snprintf(temp, sizeof(temp),
+                                 "newly stable at %ju",
+                                 ccnr_hwm_encode(base->client_handle, chw));
+                        SyncNoteSimple(root, here, temp);
+                    }
                 }
             }
             cleanRem--;
         }
+        root = priv->rootHead;
+        while (root != NULL) {
+            // evict cold local nodes, but not while a compare or update
+            // is walking the tree, and never the current root node
+            struct SyncHashCacheEntry *ceL = root->priv->ceCurrent;
+            if (root->compare == NULL && root->update == NULL) {
+                if (ceL != NULL) ceL->busy++;
+                SyncHashCacheTrim(root->ch, cacheResidentLimit);
+                if (ceL != NULL) ceL->busy--;
+            }
+            root = root->next;
+        }
         priv->lastCacheClean = now;
     }
     if (priv->stableEnabled && priv->useRepoStore
@@ -1895,6 +2324,29 @@ HeartbeatAction(struct ccn_schedule *sched,
     return priv->heartbeatMicros;
 }
 
+static int
+HeartbeatAction(struct ccn_schedule *sched,
+                void *clienth,
+                struct ccn_scheduled_event *ev,
+                int flags) {
+    struct SyncBaseStruct *base = (struct SyncBaseStruct *) ev->evdata;
+    if (base == NULL || base->priv == NULL || (flags & CCN_SCHEDULE_CANCEL)) {
+        // TBD: and why did this happen? (can't report it, though)
+        return -1;
+    }
+    if (ev->evint != 0) {
+        // a kick runs once, the periodic heartbeat goes on by itself
+        base->priv->heartbeatKick = 0;
+        doHeartbeat(base);
+        return -1;
+    }
+    int micros = doHeartbeat(base);
+    // with nothing to do and the repo idle, the heartbeat can slow down
+    if (micros == base->priv->heartbeatMicros)
+        micros = r_sync_idle_period(base->client_handle, micros);
+    return micros;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////
 ///// External routines
@@ -2026,6 +2478,8 @@ SyncRemoteFetchResponse(struct ccn_closure *selfp,
                     }
                     if (comp != NULL && comp->contentFetchBusy > 0)
                         comp->contentFetchBusy--;
+                    if (bytes > 0 || kind == CCN_UPCALL_INTEREST_TIMED_OUT)
+                        fetchWindowNote(root, data->startTime, bytes == 0);
                     if (bytes > 0) {
                         // content fetch wins
                         stats->contentFetchReceived++;
@@ -2103,10 +2557,21 @@ SyncRemoteFetchResponse(struct ccn_closure *selfp,
                         comp->nodeFetchBusy--;
                     if (bytes > 0) {
                         // node fetch wins
+                        // keep a smoothed round trip time (gain 1/8)
+                        int64_t rtt = SyncDeltaTime(data->startTime, now);
+                        int64_t srtt = stats->nodeFetchRttMicros;
+                        if (srtt == 0) srtt = rtt;
+                        else srtt = srtt + (rtt - srtt) / 8;
+                        stats->nodeFetchRttMicros = srtt;
+                        SyncHistNote(&stats->nodeFetchRtt, rtt);
                         stats->nodeFetchReceived++;
                         stats->nodeFetchBytes += bytes;
-                        if (comp != NULL)
+                        if (comp != NULL) {
                             comp->lastFetchOK = now;
+                            if (ce != NULL && comp->state == SyncCompare_preload)
+                                // continue the preload walk from this node
+                                preloadPut(comp, ce);
+                        }
                     } else {
                         // node fetch fails
                         if (kind == CCN_UPCALL_INTEREST_TIMED_OUT)
@@ -2208,6 +2673,8 @@ SyncStartNodeFetch(struct SyncRootStruct *root,
         // link the request into the root
         linkActionData(root, data);
         comp->nodeFetchBusy++;
+        if (comp->nodeFetchBusy > comp->nodeFetchPeak)
+            comp->nodeFetchPeak = comp->nodeFetchBusy;
         ce->state |= SyncHashState_fetching;
         res = 1;
     } else {
@@ -2221,6 +2688,119 @@ SyncStartNodeFetch(struct SyncRootStruct *root,
     return res;
 }
 
+// expresses the interest for one name, with no check of the local repo
+static int
+expressContentFetch(struct SyncRootStruct *root,
+                    struct ccn_charbuf *name,
+                    struct SyncCompareData *comp) {
+    static char *here = "Sync.SyncStartContentFetch";
+    struct SyncBaseStruct *base = root->base;
+    int debug = base->debug;
+    struct ccn *ccn = base->ccn;
+    struct ccn_closure *action = NEW_STRUCT(1, ccn_closure);
+    struct SyncActionData *data = newActionData(SRI_Kind_Content);
+    data->prefix = ccn_charbuf_create();
+    ccn_charbuf_append_charbuf(data->prefix, name);
+    data->comp = comp;
+    action->data = data;
+    action->p = &SyncRemoteFetchResponse;
+    data->skipToHash = -1;  // no hash here
+    struct ccn_charbuf *template = SyncGenInterest(NULL,
+                                                   root->priv->syncScope,
+                                                   base->priv->fetchLifetime,
+                                                   0, -1, NULL);
+    int res = ccn_express_interest(ccn, name, action, template);
+    ccn_charbuf_destroy(&template);
+    if (res >= 0) {
+        // link the request into the root
+        root->priv->stats->contentFetchSent++;
+        linkActionData(root, data);
+        res = 1;
+        if (debug >= CCNL_INFO)
+            SyncNoteUri(root, here, "fetching", name);
+        if (comp != NULL)
+            comp->contentFetchBusy++;
+    } else {
+        // return the storage
+        if (debug >= CCNL_SEVERE)
+            SyncNoteUri(root, here, "failed", name);
+        data = destroyActionData(data);
+        free(action);
+        if (comp != NULL)
+            comp->contentFetchFailed++;
+    }
+    return res;
+}
+
+// checks the local repo for the next batch of names to fetch, from
+// comp->contentChecked on, with one call to the repo for the whole batch;
+// the names that are present are marked with data == 1
+static void
+checkContentPresent(struct SyncCompareData *comp) {
+    static char *here = "Sync.checkContentPresent";
+    struct SyncRootStruct *root = comp->root;
+    struct SyncNameAccum *na = root->namesToFetch;
+    struct ccn_charbuf *names[CONTENT_CHECK_BATCH];
+    unsigned char present[CONTENT_CHECK_BATCH];
+    int pos = comp->contentChecked;
+    int n = na->len - pos;
+    int i = 0;
+    if (n > CONTENT_CHECK_BATCH) n = CONTENT_CHECK_BATCH;
+    for (i = 0; i < n; i++)
+        names[i] = na->ents[pos + i].name;
+    if (r_sync_lookup_names(root->base->client_handle, names, n, present) < 0) {
+        // fetch them all; the repo ignores what it already has
+        SyncNoteFailed(root, here, "r_sync_lookup_names", __LINE__);
+        memset(present, 0, sizeof(present));
+    }
+    for (i = 0; i < n; i++)
+        na->ents[pos + i].data = present[i];
+    comp->contentChecked = pos + n;
+}
+
+// the content fetch window of a root starts at maxFetchBusy, and grows by
+// one for each fetch answered until the first timeout, then by one for
+// each window of fetches answered; a timeout halves it, at most once for
+// each window of fetches sent (as for TCP congestion control)
+static int
+fetchWindow(struct SyncRootStruct *root) {
+    struct SyncRootPrivate *rp = root->priv;
+    struct SyncPrivate *priv = root->base->priv;
+    if (rp->fetchWindow <= 0) {
+        rp->fetchWindow = priv->maxFetchBusy;
+        if (rp->fetchWindow > priv->maxFetchWindow)
+            rp->fetchWindow = priv->maxFetchWindow;
+        rp->fetchThresh = priv->maxFetchWindow;
+        rp->fetchGrowth = 0;
+        rp->fetchCut = 0;
+    }
+    return rp->fetchWindow;
+}
+
+static void
+fetchWindowNote(struct SyncRootStruct *root, int64_t sent, int timedOut) {
+    struct SyncRootPrivate *rp = root->priv;
+    int w = fetchWindow(root);
+    if (timedOut) {
+        if (sent < rp->fetchCut)
+            // sent before the last cut, so already accounted for
+            return;
+        w = w / 2;
+        if (w < 1) w = 1;
+        rp->fetchThresh = w;
+        rp->fetchCut = SyncCurrentTime();
+    } else if (w < rp->fetchThresh) {
+        w++;
+    } else if (++rp->fetchGrowth >= w) {
+        w++;
+    }
+    if (w > root->base->priv->maxFetchWindow)
+        w = root->base->priv->maxFetchWindow;
+    if (w != rp->fetchWindow)
+        rp->fetchGrowth = 0;
+    rp->fetchWindow = w;
+}
+
 extern int
 SyncStartContentFetch(struct SyncRootStruct *root,
                       struct ccn_charbuf *name,
@@ -2245,36 +2825,7 @@ SyncStartContentFetch(struct SyncRootStruct *root,
         SyncAddName(root->base, name, 0);
         res = 0;
     } else {
-        struct ccn_closure *action = NEW_STRUCT(1, ccn_closure);
-        struct SyncActionData *data = newActionData(SRI_Kind_Content);
-        data->prefix = ccn_charbuf_create();
-        ccn_charbuf_append_charbuf(data->prefix, name);
-        data->comp = comp;
-        action->data = data;
-        action->p = &SyncRemoteFetchResponse;
-        data->skipToHash = -1;  // no hash here
-        struct ccn_charbuf *template = SyncGenInterest(NULL,
-                                                       root->priv->syncScope,
-                                                       base->priv->fetchLifetime,
-                                                       0, -1, NULL);
-        res = ccn_express_interest(ccn, name, action, template);
-        ccn_charbuf_destroy(&template);
-        if (res >= 0) {
-            // link the request into the root
-            root->priv->stats->contentFetchSent++;
-            linkActionData(root, data);
-            res = 1;
-            if (debug >= CCNL_INFO)
-                SyncNoteUri(root, here, "fetching", name);
-            comp->contentFetchBusy++;
-        } else {
-            // return the storage
-            if (debug >= CCNL_SEVERE)
-                SyncNoteUri(root, here, "failed", name);
-            data = destroyActionData(data);
-            free(action);
-            comp->contentFetchFailed++;
-        }
+        res = expressContentFetch(root, name, comp);
     }
     return res;
 }
@@ -2318,6 +2869,7 @@ SyncAddName(struct SyncBaseStruct *base,
                     root->priv->highWater = ccnr_hwm_update(base->client_handle,
                                                             root->priv->highWater,
                                                             item);
+                noteActivity(root);
                 count++;
                 if (debug >= CCNL_FINE) {
                     char temp[64];
@@ -2827,6 +3379,7 @@ SyncInterestArrived(struct ccn_closure *selfp,
                             // first time seen, so force a RootAdvise from our side
                             // this should allow the remote to answer with deltas (if present)
                             rp->adviseNeed = adviseNeedReset;
+                            noteActivity(root);
                             // kickHeartBeat(root, shortDelayMicros);
                         }
                     } else {
@@ -2883,6 +3436,8 @@ SyncInterestArrived(struct ccn_closure *selfp,
                     // empty hashes are OK, but must be encoded
                     struct SyncRootDeltas *deltas = NULL;
                     struct ccn_charbuf *cbL = ncL->cb;
+                    struct ccn_charbuf *cbIBLT = NULL;
+                    struct ccn_charbuf *cbBatch = NULL;
                     struct ccn_charbuf *name = SyncCopyName(data->prefix);
                     ccn_name_append(name, bufR, lenR);
                     if (data->kind == SRI_Kind_AdviseInt) {
@@ -2896,13 +3451,33 @@ SyncInterestArrived(struct ccn_closure *selfp,
                             ret = CCN_UPCALL_RESULT_INTEREST_CONSUMED;
                             break;
                         }
+                        if (lenR > 0 && ibltWorthSending(root, ceL, ceR)) {
+                            // the remote can list its missing names from
+                            // an IBLT, in place of comparing the trees
+                            struct SyncIBLT *iblt = rootIBLT(root);
+                            if (iblt != NULL) {
+                                cbIBLT = ccn_charbuf_create();
+                                if (SyncIBLTAppend(cbIBLT, iblt) < 0)
+                                    ccn_charbuf_destroy(&cbIBLT);
+                                else {
+                                    cbL = cbIBLT;
+                                    highHere = "Sync.$RootAdvise(IBLT)";
+                                    rp->stats->rootAdviseIBLTSent++;
+                                }
+                            }
+                        }
                     }
-                    
+
                     // the content object is based on the node
                     struct ccn_charbuf *cob = NULL;
                     if (data->kind == SRI_Kind_FetchInt) {
                         // node fetch results need not expire
                         cob = ncL->content;
+                        if (cob == NULL && base->priv->nodeBatchBytes > 0) {
+                            // send the node with its descendants
+                            cbBatch = nodeBatch(root, ncL);
+                            if (cbBatch != NULL) cbL = cbBatch;
+                        }
                     }
                     if (cob == NULL && cbL != NULL) {
                         // don't already have it, so make it
@@ -2949,6 +3524,8 @@ SyncInterestArrived(struct ccn_closure *selfp,
                             ccn_charbuf_destroy(&cob);
                         }
                     }
+                    ccn_charbuf_destroy(&cbIBLT);
+                    ccn_charbuf_destroy(&cbBatch);
                     ccn_charbuf_destroy(&name);
                     break;
                 }
@@ -3159,7 +3736,34 @@ SyncRootAdviseResponse(struct ccn_closure *selfp,
                             SyncNoteSimple2(root, here, highWhy, hex);
                     } else {
                         int nd = extractDeltas(root, info);
-                        if (nd > 0) {
+                        int ni = -1;
+                        if (nd <= 0) ni = extractIBLT(root, info);
+                        if (ni > 0) {
+                            // the missing names (if any) are remembered in the root
+                            root->priv->stats->rootAdviseIBLTDecoded++;
+                            bytes = info->pco->offset[CCN_PCO_E];
+                            snprintf(highWhyTemp, sizeof(highWhyTemp),
+                                     "IBLT (%u)", ni);
+                            highWhy = highWhyTemp;
+                            if (debug >= CCNL_INFO) {
+                                SyncNoteSimple2(root, here, highWhy, hex);
+                            }
+                            // every remote name is now local or queued
+                            // for fetching, so don't compare against it
+                            setCovered(ce);
+                            if (root->priv->remoteDeltas != NULL)
+                                SyncStartCompareAction(root, NULL);
+                        } else if (ni == 0) {
+                            // too different to list, so fall back to a
+                            // compare, which will fetch the remote root
+                            root->priv->stats->rootAdviseIBLTFailed++;
+                            bytes = info->pco->offset[CCN_PCO_E];
+                            highWhy = "IBLT failed";
+                            if (debug >= CCNL_INFO) {
+                                SyncNoteSimple2(root, here, highWhy, hex);
+                            }
+                            SyncStartCompareAction(root, ce->hash);
+                        } else if (nd > 0) {
                             // the deltas have been remembered in the root
                             snprintf(highWhyTemp, sizeof(highWhyTemp),
                                      "deltas (%u)", nd);
@@ -3469,6 +4073,8 @@ AddUpdateName(struct SyncUpdateData *ud, struct ccn_charbuf *name, int isNew) {
             }
             deltas->deltasCount++;
         }
+        if (ud->iblt != NULL)
+            SyncIBLTInsert(ud->iblt, root->namingPrefix, name, 1);
     }
 
     ud->nameLenAccum += nameLen;
@@ -3480,6 +4086,49 @@ AddUpdateName(struct SyncUpdateData *ud, struct ccn_charbuf *name, int isNew) {
     return res;
 }
 
+// reuseSubtree tests the node just pushed by the tree walker, and if no
+// name still to be added can fall inside it, appends the node itself to
+// ud->nodes, so that neither its names nor its hashes are recomputed.
+// Any names accumulated so far must be flushed to a node first, which we
+// only do once they would make a reasonably full node.
+// returns 1 if the node was kept, 0 if it must be walked
+static int
+reuseSubtree(struct SyncTreeWorkerHead *head, struct SyncUpdateData *ud) {
+    struct SyncRootStruct *root = ud->root;
+    struct SyncTreeWorkerEntry *ent = SyncTreeWorkerTop(head);
+    struct SyncHashCacheEntry *ce = ent->cacheEntry;
+    if (head->remote > 0 || ce == NULL || SyncCacheEntryFetch(ce) < 0)
+        return 0;
+    struct SyncNodeComposite *nc = ce->ncL;
+    if (nc == NULL || nc->maxName == NULL)
+        return 0;
+    if (ud->srcPos < ud->src->len) {
+        struct ccn_charbuf *name = ud->src->ents[ud->srcPos].name;
+        if (name != NULL && SyncCmpNames(name, nc->maxName) <= 0)
+            // the next new name may belong in this node
+            return 0;
+        struct SyncTreeWorkerEntry *up = &head->stack[head->level - 2];
+        struct SyncNodeComposite *ncUp = up->cacheEntry->ncL;
+        if (ncUp == NULL || up->pos + 1 >= ncUp->refLen)
+            // the last node of its parent takes the names that follow it,
+            // so that they land among leaf nodes at the same depth
+            return 0;
+    }
+    if (ud->sort->len > 0) {
+        if (ud->nameLenAccum < nodeSplitTrigger/2)
+            // too few names to make a node, so keep merging
+            return 0;
+        if (MakeNodeFromNames(ud, 0) < 0)
+            return 0;
+    }
+    SyncNodeIncRC(nc);
+    SyncAccumNode(ud->nodes, nc);
+    ud->namesAdded += nc->leafCount;
+    ce->lastUsed = ud->entryTime;
+    root->priv->stats->nodesShared++;
+    return 1;
+}
+
 // merge the semi-sorted names and the old sync tree
 // returns -1 for failure, 0 for incomplete, 1 for complete
 static int
@@ -3488,9 +4137,7 @@ SyncTreeMergeNames(struct SyncTreeWorkerHead *head,
     char *here = "Sync.SyncTreeMergeNames";
     struct SyncRootStruct *root = ud->root;
     int debug = root->base->debug;
-    IndexSorter_Base ixBase = ud->ixBase;
-    struct SyncNameAccum *src = (struct SyncNameAccum *) ixBase->client;
-    IndexSorter_Index srcPos = 0;
+    struct SyncNameAccum *src = ud->src;
     struct ccn_charbuf *cb = ud->cb;
     int res = 0;
     int namesLim = ud->namesAdded+namesYieldInc;
@@ -3524,9 +4171,8 @@ SyncTreeMergeNames(struct SyncTreeWorkerHead *head,
                     enum SyncCompareResult cmp = SCR_after;
                     struct ccn_charbuf *name = NULL;
                     
-                    if (ud->ixBase->len > 0) {
-                        srcPos = IndexSorter_Best(ud->ixBase);
-                        name = src->ents[srcPos].name;
+                    if (ud->srcPos < src->len) {
+                        name = src->ents[ud->srcPos].name;
                         if (name != NULL)
                             cmp = SyncNodeCompareLeaf(nc, ep, name);
                     }
@@ -3535,22 +4181,13 @@ SyncTreeMergeNames(struct SyncTreeWorkerHead *head,
                             // add the name from src
                             AddUpdateName(ud, name, 1);
                         case SCR_min:
-                            // advance the src, remove duplicates
+                            // advance the src (it has no duplicates)
                             if (cmp == SCR_min) {
                                 if (debug >= CCNL_FINE) {
                                     SyncNoteUri(root, here, "skip", name);
                                 }
                             }
-                            for (;;) {
-                                IndexSorter_Rem(ud->ixBase);
-                                if (ud->ixBase->len <= 0) break;
-                                srcPos = IndexSorter_Best(ud->ixBase);
-                                struct ccn_charbuf *next = src->ents[srcPos].name;
-                                if (SyncCmpNames(name, next) != 0) break;
-                                if (debug >= CCNL_FINE) {
-                                    SyncNoteUri(root, here, "skip dup", next);
-                                }
-                            }
+                            ud->srcPos++;
                             break;
                         case SCR_after:
                             // add the name from the tree
@@ -3579,24 +4216,23 @@ SyncTreeMergeNames(struct SyncTreeWorkerHead *head,
                     if (ent == NULL) {
                         res = -__LINE__;
                         break;
-                    }                
+                    }
+                    if (reuseSubtree(head, ud)) {
+                        // the whole node was kept, so skip over it
+                        ent = SyncTreeWorkerPop(head);
+                        if (ent == NULL) break;
+                        ent->pos++;
+                    }
                 }
             }
         }
     }
     if (res == 0) {
         // done with the tree, move items from the src
-        while (ud->ixBase->len > 0) {
-            srcPos = IndexSorter_Best(ud->ixBase);
-            struct ccn_charbuf *name = src->ents[srcPos].name;
+        while (ud->srcPos < src->len) {
+            struct ccn_charbuf *name = src->ents[ud->srcPos].name;
             AddUpdateName(ud, name, 1);
-            for (;;) {
-                IndexSorter_Rem(ud->ixBase);
-                if (ud->ixBase->len <= 0) break;
-                srcPos = IndexSorter_Best(ud->ixBase);
-                struct ccn_charbuf *next = src->ents[srcPos].name;
-                if (SyncCmpNames(name, next) != 0) break;
-            }
+            ud->srcPos++;
             if (ud->namesAdded >= namesLim) {
                 int64_t dt = SyncDeltaTime(ud->entryTime, SyncCurrentTime());
                 if (dt >= namesYieldMicros) {
@@ -3619,6 +4255,7 @@ FreeUpdateData(struct SyncUpdateData *ud) {
         ud->sort = SyncFreeNameAccumAndNames(ud->sort);
         ud->nodes = SyncFreeNodeAccum(ud->nodes);
         ud->deltas = FreeDeltas(ud->deltas);
+        ud->iblt = SyncIBLTFree(ud->iblt);
         free(ud);
     }
     return NULL;
@@ -3639,6 +4276,8 @@ UpdateAction(struct ccn_schedule *sched,
     int showEntry = base->priv->syncActionsPrivate & 8;
     // int64_t prevTime = ud->entryTime;
     ud->entryTime = now;
+    noteSchedLag(root, ud->due, now);
+    ud->due = 0;
     
     switch (ud->state) {
         case SyncUpdate_init: {
@@ -3647,34 +4286,14 @@ UpdateAction(struct ccn_schedule *sched,
             if (showEntry && debug >= CCNL_INFO) {
                 SyncNoteSimple(root, here, "SyncUpdate_init");
             }
-            struct SyncNameAccum *src = (struct SyncNameAccum *) ud->ixBase->client;
-            IndexSorter_Index srcLen = src->len;
-            IndexSorter_Index ix = ud->ixPos;
-            IndexSorter_Index ixLim = ix+namesYieldInc;
-            if (srcLen < ixLim) ixLim = srcLen;
-            
-            while (ix < srcLen) {
-                if (ix > ixLim) {
-                    int64_t dt = SyncDeltaTime(ud->entryTime, SyncCurrentTime());
-                    if (dt >= namesYieldMicros) {
-                        // need to yield
-                        if (debug >= CCNL_FINE)
-                            SyncNoteSimple(root, here, "yield");
-                        break;
-                    }
-                    ixLim += namesYieldInc;
-                }
-                if (debug >= CCNL_FINE) {
-                    struct ccn_charbuf *name = src->ents[ix].name;
-                    SyncNoteUri(root, here, "insert", name);
-                }
-                IndexSorter_Add(ud->ixBase, ix);
-                ix++;
+            struct SyncNameAccum *src = ud->src;
+            if (SyncNameAccumSort(src) < 0)
+                SyncNoteFailed(root, here, "bad name", __LINE__);
+            if (debug >= CCNL_FINE) {
+                int ix = 0;
+                for (ix = 0; ix < src->len; ix++)
+                    SyncNoteUri(root, here, "insert", src->ents[ix].name);
             }
-            ud->ixPos = ix;
-            if (ix < srcLen)
-                // not done yet, so take a break
-                return shortDelayMicros;
             
             struct SyncHashCacheEntry *ent = SyncRootTopEntry(root);
             if (ent != NULL && ud->tw == NULL) {
@@ -3687,7 +4306,7 @@ UpdateAction(struct ccn_schedule *sched,
             ud->state = SyncUpdate_inserted;
         }
         case SyncUpdate_inserted: {
-            // all names to be added are now in ud->ixBase
+            // all names to be added are now sorted in ud->src
             // the old sync tree has not been changed
             if (showEntry && debug >= CCNL_INFO) {
                 SyncNoteSimple(root, here, "SyncUpdate_inserted");
@@ -3699,10 +4318,8 @@ UpdateAction(struct ccn_schedule *sched,
             res = MakeNodeFromNames(ud, 0);
             // done, either normally or with error
             // free the resources
-            struct SyncNameAccum *src = (struct SyncNameAccum *) ud->ixBase->client;
             ud->tw = SyncTreeWorkerFree(ud->tw);
-            src = SyncFreeNameAccumAndNames(src);
-            IndexSorter_Free(&ud->ixBase);
+            ud->src = SyncFreeNameAccumAndNames(ud->src);
             ccn_charbuf_destroy(&ud->cb);
             if (res < 0) {
                 // this is bad news!
@@ -3745,6 +4362,16 @@ UpdateAction(struct ccn_schedule *sched,
                         noteHash(root, ce, 1, 0);
                     }
                     ud->ceStop = ce;
+                    if (ud->iblt != NULL) {
+                        // the IBLT now describes the new tree
+                        struct SyncRootPrivate *rp = root->priv;
+                        SyncIBLTFree(rp->iblt);
+                        rp->iblt = ud->iblt;
+                        ud->iblt = NULL;
+                        ccn_charbuf_destroy(&rp->ibltHash);
+                        rp->ibltHash = ccn_charbuf_create();
+                        ccn_charbuf_append_charbuf(rp->ibltHash, hash);
+                    }
                     // now that we have a new current hash, close out the deltas
                     struct SyncRootDeltas *deltas = CloseUpdateCoding(ud);
                     int64_t dt = SyncDeltaTime(ud->startTime, now);
@@ -3841,6 +4468,7 @@ UpdateAction(struct ccn_schedule *sched,
                 }
             }
             root->priv->adviseNeed = adviseNeedReset;
+            noteActivity(root);
             if (count <= initCount) {
                 // we were supposed to add something?
                 if (debug >= CCNL_INFO) {
@@ -3862,8 +4490,11 @@ UpdateAction(struct ccn_schedule *sched,
             return -1;
         }
     }
-    int64_t edt = SyncDeltaTime(ud->entryTime, SyncCurrentTime());
+    now = SyncCurrentTime();
+    int64_t edt = SyncDeltaTime(ud->entryTime, now);
     if (edt > ud->maxHold) ud->maxHold = edt;
+    SyncHistNote(&root->priv->stats->updateStep, edt);
+    ud->due = now + shortDelayMicros;
     return shortDelayMicros;
 }
 
@@ -3883,15 +4514,20 @@ SyncUpdateRoot(struct SyncRootStruct *root) {
     ud->state = SyncUpdate_init;
     ud->startTime = now;
     ud->entryTime = now;
-    ud->ixBase = IndexSorter_New(acc->len, -1);
-    ud->ixBase->sorter = SyncNameAccumSorter;
-    ud->ixBase->client = acc;
-    ud->ixPos = 0;
+    ud->due = now;
+    ud->src = acc;
+    ud->srcPos = 0;
     ud->initLen = root->priv->currentSize;
     ud->ceStart = root->priv->ceCurrent;
     if (root->base->priv->deltasLimit > 0)
         // create and init the deltas object
         ud->deltas = NewDeltas(root);
+    struct SyncRootPrivate *rp = root->priv;
+    if (rp->iblt != NULL && rp->ibltHash != NULL
+        && SyncCmpHashesRaw(rp->ibltHash->buf, rp->ibltHash->length,
+                            hash->buf, hash->length) == 0)
+        // the IBLT is current, so the update can keep it current
+        ud->iblt = SyncIBLTCopy(rp->iblt);
     struct ccn_scheduled_event *ev = ccn_schedule_event(base->sched,
                                                         0,
                                                         UpdateAction,
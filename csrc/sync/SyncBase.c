@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ccn/btree_content.h>
 #include <ccn/uri.h>
 #include <ccnr/ccnr_msg.h>
 #include <ccnr/ccnr_private.h>
@@ -154,6 +155,10 @@ SyncInit(struct SyncBaseStruct *bp) {
             priv->maxFetchBusy = getEnvLimited("CCNS_MAX_FETCH_BUSY",
                                                1, 100, 6);
 
+            // max content fetch window per root
+            priv->maxFetchWindow = getEnvLimited("CCNS_MAX_FETCH_WINDOW",
+                                                 1, 1000, 64);
+
             // max number of compares busy
             priv->maxComparesBusy = getEnvLimited("CCNS_MAX_COMPARES_BUSY",
                                                   1, 100, 4);
@@ -162,6 +167,14 @@ SyncInit(struct SyncBaseStruct *bp) {
             priv->deltasLimit = getEnvLimited("CCNS_DELTAS_LIMIT",
                                               0, 8000, 0);
             
+            // # of cells for RootAdvise IBLT mode (0 disables it)
+            priv->ibltCells = getEnvLimited("CCNS_IBLT_CELLS",
+                                            0, 99, 0);
+            
+            // # of bytes permitted for NodeFetch batches (0 disables them)
+            priv->nodeBatchBytes = getEnvLimited("CCNS_NODE_BATCH_BYTES",
+                                                 0, 8000, 0);
+            
             // # of bytes permitted for RootAdvise delta mode
             priv->syncScope = getEnvLimited("CCNS_SYNC_SCOPE",
                                               0, 2, 2);
@@ -203,12 +216,21 @@ SyncInit(struct SyncBaseStruct *bp) {
                 pos += snprintf(temp+pos, sizeof(temp)-pos,
                                 ",CCNS_MAX_FETCH_BUSY=%d",
                                 priv->maxFetchBusy);
+                pos += snprintf(temp+pos, sizeof(temp)-pos,
+                                ",CCNS_MAX_FETCH_WINDOW=%d",
+                                priv->maxFetchWindow);
                 pos += snprintf(temp+pos, sizeof(temp)-pos,
                                 ",CCNS_MAX_COMPARES_BUSY=%d",
                                 priv->maxComparesBusy);
                 pos += snprintf(temp+pos, sizeof(temp)-pos,
                                 ",CCNS_DELTAS_LIMIT=%d",
                                 priv->deltasLimit);
+                pos += snprintf(temp+pos, sizeof(temp)-pos,
+                                ",CCNS_IBLT_CELLS=%d",
+                                priv->ibltCells);
+                pos += snprintf(temp+pos, sizeof(temp)-pos,
+                                ",CCNS_NODE_BATCH_BYTES=%d",
+                                priv->nodeBatchBytes);
                 pos += snprintf(temp+pos, sizeof(temp)-pos,
                                 ",CCNS_SYNC_SCOPE=%d",
                                 priv->syncScope);
@@ -252,6 +274,58 @@ SyncFreeBase(struct SyncBaseStruct **bp) {
 }
 
 // Enumeration support
+
+// notifyName handles one name from an enumeration
+static int
+notifyName(struct SyncBaseStruct *base,
+           int enumeration,
+           ccnr_accession item,
+           struct ccn_charbuf *name) {
+    char *here = "Sync.SyncNotifyContent";
+    struct SyncPrivate *priv = base->priv;
+    int debug = base->debug;
+    
+    if (debug >= CCNL_FINE) {
+        struct ccn_charbuf *uri = SyncUriForName(name);
+        ccnr_msg(base->client_handle,
+                 "%s, enum %d, %s!",
+                 here, enumeration, ccn_charbuf_as_string(uri));
+        ccn_charbuf_destroy(&uri);
+    }
+    
+    struct ccn_indexbuf *comps = priv->comps;
+    int splitRes = ccn_name_split(name, comps);
+    if (splitRes < 0) {
+        // really hould not happen!  but it does not hurt to log and ignore it
+        if (debug >= CCNL_SEVERE)
+            ccnr_msg(base->client_handle, "%s, invalid name!", here);
+        return 0;
+    }
+    
+    unsigned char *comp0 = NULL;
+    size_t size0 = 0;
+    unsigned char *comp1 = NULL;
+    size_t size1 = 0;
+    ccn_name_comp_get(name->buf, comps, 0, 
+                      (const unsigned char **) &comp0, &size0);
+    ccn_name_comp_get(name->buf, comps, 1,
+                      (const unsigned char **) &comp1, &size1);
+    ccnr_accession mark = item;
+    if (SyncPrefixMatch(priv->localHostPrefix, name, 0)) {
+        // to the local host, don't update the stable target
+        mark = CCNR_NULL_ACCESSION;
+        if (SyncPrefixMatch(priv->sliceCmdPrefix, name, 0))
+            // this is a new slice
+            SyncHandleSlice(base, name);
+    }
+    if (mark != CCNR_NULL_ACCESSION)
+        priv->stableTarget = ccnr_hwm_update(base->client_handle, priv->stableTarget, mark);
+    
+    // add the name to any applicable roots
+    SyncAddName(base, name, item);
+    return 0;
+}
+
 extern int
 SyncNotifyContent(struct SyncBaseStruct *base,
                   int enumeration,
@@ -304,47 +378,88 @@ SyncNotifyContent(struct SyncBaseStruct *base,
             return -1;
         }
         
-        if (debug >= CCNL_FINE) {
-            struct ccn_charbuf *uri = SyncUriForName(name);
-            ccnr_msg(base->client_handle,
-                     "%s, enum %d, %s!",
-                     here, enumeration, ccn_charbuf_as_string(uri));
-            ccn_charbuf_destroy(&uri);
-        }
-        
-        struct ccn_indexbuf *comps = priv->comps;
-        int splitRes = ccn_name_split(name, comps);
-        if (splitRes < 0) {
-            // really hould not happen!  but it does not hurt to log and ignore it
-            if (debug >= CCNL_SEVERE)
-                ccnr_msg(base->client_handle, "%s, invalid name!", here);
-            return 0;
+        return notifyName(base, enumeration, item, name);
+    }
+    return -1;
+}
+
+extern int
+SyncNotifyContentBlock(struct SyncBaseStruct *base,
+                       int enumeration,
+                       const unsigned char *flat,
+                       const size_t *off,
+                       const ccnr_accession *items,
+                       int n) {
+    if (base == NULL || base->client_handle == NULL) return -1;
+    struct ccn_charbuf *name = ccn_charbuf_create();
+    int res = 0;
+    int i = 0;
+    for (i = 0; i < n && res >= 0; i++) {
+        name->length = 0;
+        ccn_name_init(name);
+        if (ccn_name_append_flatname(name, flat + off[i], off[i+1] - off[i],
+                                     0, -1) < 0) {
+            if (base->debug >= CCNL_SEVERE)
+                ccnr_msg(base->client_handle,
+                         "Sync.SyncNotifyContentBlock, invalid flatname!");
+            continue;
         }
-        
-        unsigned char *comp0 = NULL;
-        size_t size0 = 0;
-        unsigned char *comp1 = NULL;
-        size_t size1 = 0;
-        ccn_name_comp_get(name->buf, comps, 0, 
-                          (const unsigned char **) &comp0, &size0);
-        ccn_name_comp_get(name->buf, comps, 1,
-                          (const unsigned char **) &comp1, &size1);
-        ccnr_accession mark = item;
-        if (SyncPrefixMatch(priv->localHostPrefix, name, 0)) {
-            // to the local host, don't update the stable target
-            mark = CCNR_NULL_ACCESSION;
-            if (SyncPrefixMatch(priv->sliceCmdPrefix, name, 0))
-                // this is a new slice
-                SyncHandleSlice(base, name);
+        res = notifyName(base, enumeration, items[i], name);
+    }
+    ccn_charbuf_destroy(&name);
+    return res;
+}
+
+extern void
+SyncAppendStats(struct SyncBaseStruct *base, struct ccn_charbuf *cb, int xml) {
+    if (base == NULL || base->priv == NULL) return;
+    struct SyncRootStruct *root = base->priv->rootHead;
+    if (xml) ccn_charbuf_putf(cb, "<sync>");
+    for (; root != NULL; root = root->next) {
+        struct SyncRootStats *stats = root->priv->stats;
+        struct ccn_charbuf *uri = SyncUriForName(root->namingPrefix);
+        char *hex = SyncHexStr(root->sliceHash->buf, root->sliceHash->length);
+        if (xml) {
+            ccn_charbuf_putf(cb, "<root><id>%u</id><slice>%s</slice>"
+                             "<compares>%ju</compares><updates>%ju</updates>"
+                             "<lag>%ju</lag>",
+                             root->rootId, hex,
+                             (uintmax_t) stats->comparesDone,
+                             (uintmax_t) stats->updatesDone,
+                             (uintmax_t) stats->schedLagMicros);
+            SyncHistAppend(cb, "fetch", &stats->nodeFetchRtt, 1);
+            SyncHistAppend(cb, "compare", &stats->compareStep, 1);
+            SyncHistAppend(cb, "update", &stats->updateStep, 1);
+            SyncHistAppend(cb, "store", &stats->storeTime, 1);
+            SyncHistAppend(cb, "schedlag", &stats->schedLag, 1);
+            ccn_charbuf_putf(cb, "</root>");
+        } else {
+            const struct SyncHist *hists[5];
+            const char *names[5] = {"fetch", "compare", "update", "store",
+                                    "schedLag"};
+            int i = 0;
+            hists[0] = &stats->nodeFetchRtt;
+            hists[1] = &stats->compareStep;
+            hists[2] = &stats->updateStep;
+            hists[3] = &stats->storeTime;
+            hists[4] = &stats->schedLag;
+            ccn_charbuf_putf(cb, "<div><b>Sync root#%u:</b> %s,"
+                             " %ju compares, %ju updates, lag %ju usec",
+                             root->rootId, ccn_charbuf_as_string(uri),
+                             (uintmax_t) stats->comparesDone,
+                             (uintmax_t) stats->updatesDone,
+                             (uintmax_t) stats->schedLagMicros);
+            for (i = 0; i < 5; i++) {
+                if (hists[i]->count == 0) continue;
+                ccn_charbuf_putf(cb, "; ");
+                SyncHistAppend(cb, names[i], hists[i], 0);
+            }
+            ccn_charbuf_putf(cb, "</div>\n");
         }
-        if (mark != CCNR_NULL_ACCESSION)
-            priv->stableTarget = ccnr_hwm_update(base->client_handle, priv->stableTarget, mark);
-        
-        // add the name to any applicable roots
-        SyncAddName(base, name, item);
-        return 0;
+        free(hex);
+        ccn_charbuf_destroy(&uri);
     }
-    return -1;
+    if (xml) ccn_charbuf_putf(cb, "</sync>");
 }
 
 extern void
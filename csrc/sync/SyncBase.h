@@ -96,6 +96,26 @@ SyncNotifyContent(struct SyncBaseStruct *base,
                   ccnr_accession item,
                   struct ccn_charbuf *name);
 
+// Block enumeration support
+// called by Repo with a block of n names, in canonical order,
+// where name i is the flatname flat[off[i]] up to flat[off[i+1]]
+// and items[i] is its accession
+// returns -1 to terminate, 0 to continue
+int
+SyncNotifyContentBlock(struct SyncBaseStruct *base,
+                       int enumeration,
+                       const unsigned char *flat,
+                       const size_t *off,
+                       const ccnr_accession *items,
+                       int n);
+
+// Stats support
+// called by Repo for its status page
+// appends per-root counters, scheduler lag and phase timings to cb,
+// as HTML if xml == 0, else as a <sync> XML element
+void
+SyncAppendStats(struct SyncBaseStruct *base, struct ccn_charbuf *cb, int xml);
+
 // shutdown a sync base
 void
 SyncShutdown(struct SyncBaseStruct *bp);
@@ -21,6 +21,7 @@
 #include "SyncBase.h"
 #include "SyncHashCache.h"
 #include "SyncNode.h"
+#include "SyncPrivate.h"
 #include "SyncRoot.h"
 #include "SyncUtil.h"
 #include <stdlib.h>
@@ -29,16 +30,75 @@
 #include <ccn/ccn.h>
 #include <ccnr/ccnr_msg.h>
 
+static struct SyncNodeStore *
+releaseStore(struct SyncNodeStore *ns) {
+    if (ns != NULL) {
+        ns->refs--;
+        if (ns->refs <= 0) {
+            ccn_charbuf_destroy(&ns->name);
+            free(ns);
+        }
+    }
+    return NULL;
+}
+
 static struct SyncHashCacheEntry *
 localFreeEntry(struct SyncHashCacheEntry *ce) {
     ce->next = NULL;
     if (ce->ncL != NULL) SyncNodeDecRC(ce->ncL);
     if (ce->ncR != NULL) SyncNodeDecRC(ce->ncR);
+    ce->store = releaseStore(ce->store);
     if (ce->hash != NULL) ccn_charbuf_destroy(&ce->hash);
     free(ce);
     return NULL;
 }
 
+static void
+growCache(struct SyncHashCacheHead *head) {
+    // doubles the number of chains, rehashing using the small hash
+    uint32_t oMod = head->mod;
+    uint32_t nMod = oMod * 2;
+    if (nMod <= oMod) return;
+    struct SyncHashCacheEntry **oEnts = head->ents;
+    struct SyncHashCacheEntry **nEnts = NEW_ANY(nMod, struct SyncHashCacheEntry *);
+    if (nEnts == NULL) return;
+    uint32_t hx = 0;
+    for (hx = 0; hx < oMod; hx++) {
+        struct SyncHashCacheEntry *ent = oEnts[hx];
+        while (ent != NULL) {
+            struct SyncHashCacheEntry *next = ent->next;
+            uint32_t nx = ent->small % nMod;
+            ent->next = nEnts[nx];
+            nEnts[nx] = ent;
+            ent = next;
+        }
+    }
+    head->ents = nEnts;
+    head->mod = nMod;
+    free(oEnts);
+}
+
+static size_t
+residentCost(struct SyncNodeComposite *nc) {
+    // approximate bytes held by a decoded node
+    size_t cost = sizeof(struct SyncNodeComposite)
+    + nc->refLim * sizeof(struct SyncNodeElem);
+    if (nc->cb != NULL) cost += nc->cb->length;
+    if (nc->content != NULL) cost += nc->content->length;
+    if (nc->minName != NULL) cost += nc->minName->length;
+    if (nc->maxName != NULL) cost += nc->maxName->length;
+    return cost;
+}
+
+static int
+compareLastUsed(const void *a, const void *b) {
+    const struct SyncHashCacheEntry *ceA = *(struct SyncHashCacheEntry **) a;
+    const struct SyncHashCacheEntry *ceB = *(struct SyncHashCacheEntry **) b;
+    if (ceA->lastUsed < ceB->lastUsed) return -1;
+    if (ceA->lastUsed > ceB->lastUsed) return 1;
+    return 0;
+}
+
 extern struct SyncHashCacheEntry *
 SyncHashLookup(struct SyncHashCacheHead *head,
                     const unsigned char *xp, ssize_t xs) {
@@ -84,8 +144,6 @@ SyncHashEnter(struct SyncHashCacheHead *head,
     if (ent == NULL) {
         uintmax_t index = head->lastIndex + 1;
         head->lastIndex = index;
-        head->probes = head->probes + 1;
-        head->misses = head->misses + 1;
         ent = NEW_STRUCT(1, SyncHashCacheEntry);
         ent->lastUsed = SyncCurrentTime();
         ent->stablePoint = CCNR_NULL_HWM;
@@ -97,6 +155,9 @@ SyncHashEnter(struct SyncHashCacheHead *head,
         ccn_charbuf_append(ent->hash, xp, xs);
         head->ents[hx] = ent;
         head->len++;
+        if (head->len > 2 * (size_t) head->mod)
+            // chains are getting long, so spread them out
+            growCache(head);
     }
     ent->state |= set;
     return ent;
@@ -121,8 +182,10 @@ SyncHashRemoveEntry(struct SyncHashCacheHead *head,
             lag = ent;
             ent = next;
         }
-        if (ent == ce)
+        if (ent == ce) {
             ce = localFreeEntry(ce);
+            if (head->len > 0) head->len--;
+        }
     }
 }
 
@@ -150,6 +213,59 @@ SyncHashCacheCreate(struct SyncRootStruct *root, uint32_t mod) {
     return head;
 }
 
+extern size_t
+SyncHashCacheTrim(struct SyncHashCacheHead *head, size_t budget) {
+    char *here = "Sync.SyncHashCacheTrim";
+    struct SyncRootStruct *root = head->root;
+    size_t resident = 0;
+    size_t nCand = 0;
+    size_t i = 0;
+    uint32_t hx = 0;
+    struct SyncHashCacheEntry **cands = NULL;
+    for (hx = 0; hx < head->mod; hx++) {
+        struct SyncHashCacheEntry *ent = head->ents[hx];
+        while (ent != NULL) {
+            if (ent->ncL != NULL) resident += residentCost(ent->ncL);
+            ent = ent->next;
+        }
+    }
+    if (resident > budget) {
+        // collect the entries whose local nodes can be fetched again
+        cands = NEW_ANY(head->len + 1, struct SyncHashCacheEntry *);
+        for (hx = 0; hx < head->mod; hx++) {
+            struct SyncHashCacheEntry *ent = head->ents[hx];
+            while (ent != NULL) {
+                if (ent->ncL != NULL && ent->busy == 0
+                    && (ent->state & SyncHashState_stored)
+                    && (ent->state & SyncHashState_storing) == 0
+                    && nCand < head->len)
+                    cands[nCand++] = ent;
+                ent = ent->next;
+            }
+        }
+        // coldest first
+        qsort(cands, nCand, sizeof(cands[0]), compareLastUsed);
+        for (i = 0; i < nCand && resident > budget; i++) {
+            struct SyncHashCacheEntry *ent = cands[i];
+            struct SyncNodeComposite *ncL = ent->ncL;
+            size_t cost = residentCost(ncL);
+            ent->ncL = NULL;
+            SyncNodeDecRC(ncL);
+            resident = (cost < resident) ? resident - cost : 0;
+            head->evictions++;
+        }
+        free(cands);
+        if (i > 0 && root->base->debug >= CCNL_FINE) {
+            char temp[64];
+            snprintf(temp, sizeof(temp), "evicted %zu, resident %zu",
+                     i, resident);
+            SyncNoteSimple(root, here, temp);
+        }
+    }
+    head->resident = resident;
+    return resident;
+}
+
 extern struct SyncHashCacheHead *
 SyncHashCacheFree(struct SyncHashCacheHead *head) {
     if (head != NULL) {
@@ -172,36 +288,196 @@ SyncHashCacheFree(struct SyncHashCacheHead *head) {
     return NULL;
 }
 
+static int
+storeEligible(struct SyncHashCacheEntry *ce) {
+    if (ce == NULL || ce->ncL == NULL || ce->ncL->cb == NULL
+        || (ce->state & SyncHashState_stored)
+        || (ce->state & SyncHashState_storing) == 0)
+        return 0;
+    return 1;
+}
+
+// finds a stored batch that holds the node for the hash of ce, for any root
+// (same hash, same node), or NULL if there is none
+static struct SyncNodeStore *
+findStore(struct SyncBaseStruct *base, struct SyncHashCacheEntry *ce) {
+    struct ccn_charbuf *hash = ce->hash;
+    struct SyncRootStruct *root = base->priv->rootHead;
+    while (root != NULL) {
+        struct SyncHashCacheHead *ch = root->ch;
+        if (ch != NULL && ch != ce->head) {
+            struct SyncHashCacheEntry *each = SyncHashLookup(ch, hash->buf,
+                                                             hash->length);
+            if (each != NULL && each->store != NULL
+                && (each->state & SyncHashState_stored))
+                return each->store;
+        }
+        root = root->next;
+    }
+    return NULL;
+}
+
 extern int
-SyncCacheEntryStore(struct SyncHashCacheEntry *ce) {
-    // causes the cache entry to be saved to the repo
+SyncCacheEntryStoreBatch(struct SyncBaseStruct *base,
+                         struct SyncHashCacheEntry **ents, int n) {
+    // causes the cache entries to be saved to the repo, as one object
+    char *here = "Sync.SyncCacheEntryStoreBatch";
+    struct SyncNodeStore *ns = NEW_STRUCT(1, SyncNodeStore);
+    struct ccn_charbuf *cb = ccn_charbuf_create();
+    struct SyncRootStruct *first = NULL;
+    int nodes = 0;
+    int count = 0;
     int res = 0;
-    if (ce == NULL) {
-        // not an entry
-        res = -1;
-    } else if (ce->ncL == NULL || ce->ncL->cb == NULL
-        || (ce->state & SyncHashState_stored)
-        || (ce->state & SyncHashState_storing) == 0 ) {
-        // not eligible
-        res = 0;
-    } else {
-        struct SyncRootStruct *root = ce->head->root;
-        struct SyncBaseStruct *base = root->base;
-        struct ccn_charbuf *name = SyncNameForLocalNode(root, ce->hash);
-        struct ccn_charbuf *content = ce->ncL->cb;
-        
-        // TBD: do we want to omit version and segment?
-        res |= ccn_create_version(base->ccn, name, CCN_V_NOW, 0, 0);
-        res |= ccn_name_append_numeric(name, CCN_MARKER_SEQNUM, 0);
-        
-        res = SyncLocalRepoStore(base, name, content, CCN_SP_FINAL_BLOCK);
-        if (res > 0) {
+    int i = 0;
+    res |= ccnb_element_begin(cb, CCN_DTAG_SyncNodeBatch);
+    res |= SyncAppendTaggedNumber(cb, CCN_DTAG_SyncVersion,
+                                  SYNC_NODE_BATCH_VERSION);
+    for (i = 0; i < n && res >= 0; i++) {
+        struct SyncHashCacheEntry *ce = ents[i];
+        if (!storeEligible(ce)) continue;
+        struct SyncNodeStore *shared = findStore(base, ce);
+        int j = 0;
+        for (j = 0; shared == NULL && j < i; j++) {
+            // another root may have the same node earlier in this batch
+            struct SyncHashCacheEntry *prev = ents[j];
+            if (prev != NULL && prev->store == ns
+                && SyncCmpHashesRaw(prev->hash->buf, prev->hash->length,
+                                    ce->hash->buf, ce->hash->length) == 0)
+                shared = ns;
+        }
+        if (shared != NULL) {
+            // the node is (or will be) stored already, so just refer to it
+            ce->store = shared;
+            shared->refs++;
+            if (shared != ns) {
+                ce->state |= SyncHashState_stored;
+                ce->state = ce->state - SyncHashState_storing;
+                count++;
+            }
+            ce->head->root->priv->stats->nodesStoreShared++;
+            continue;
+        }
+        if (nodes == 0) {
+            // name the batch by its first node, with a version
+            first = ce->head->root;
+            ns->name = SyncCopyName(base->priv->localHostPrefix);
+            res |= ccn_name_append_str(ns->name, "\xC1.S.nb");
+            res |= ccn_name_append(ns->name, ce->hash->buf, ce->hash->length);
+            res |= ccn_create_version(base->ccn, ns->name, CCN_V_NOW, 0, 0);
+        }
+        res |= SyncNodeAppendCompact(cb, ce->ncL);
+        ce->store = ns;
+        ns->refs++;
+        nodes++;
+    }
+    res |= ccnb_element_end(cb);
+    if (nodes > 0 && res >= 0)
+        res = SyncLocalRepoStore(base, ns->name, cb, CCN_SP_FINAL_BLOCK);
+    // hold a reference while the entries are settled
+    ns->refs++;
+    for (i = 0; i < n; i++) {
+        struct SyncHashCacheEntry *ce = ents[i];
+        if (ce == NULL || ce->store != ns) continue;
+        if (res < 0) {
+            // not stored, so the entry stays as it was
+            ce->store = releaseStore(ce->store);
+        } else {
             // clear the bits
             ce->state |= SyncHashState_stored;
             ce->state = ce->state - SyncHashState_storing;
+            ce->head->root->priv->stats->nodesStored++;
+            count++;
         }
-        ccn_charbuf_destroy(&name);
     }
+    if (nodes > 0 && res >= 0)
+        first->priv->stats->nodeStoreBatches++;
+    if (nodes > 0 && res >= 0 && base->debug >= CCNL_FINE) {
+        char temp[64];
+        snprintf(temp, sizeof(temp), "%d nodes, %d bytes",
+                 nodes, (int) cb->length);
+        SyncNoteUriBase(base, here, temp, ns->name);
+    }
+    releaseStore(ns);
+    ccn_charbuf_destroy(&cb);
+    if (res < 0) return res;
+    return count;
+}
+
+extern int
+SyncCacheEntryStore(struct SyncHashCacheEntry *ce) {
+    // causes the cache entry to be saved to the repo
+    if (ce == NULL) return -1;
+    return SyncCacheEntryStoreBatch(ce->head->root->base, &ce, 1);
+}
+
+// fetches the stored batch that holds the node for ce, and enters its nodes
+// as the local nodes of ce and of any other evicted entries that refer to
+// the same batch
+static int
+fetchFromStore(struct SyncHashCacheEntry *ce, char **why) {
+    struct SyncHashCacheHead *head = ce->head;
+    struct SyncRootStruct *root = head->root;
+    struct SyncBaseStruct *base = root->base;
+    struct SyncNodeStore *ns = ce->store;
+    struct ccn_charbuf *content = ccn_charbuf_create();
+    struct ccn_charbuf *cb = ccn_charbuf_create();
+    struct ccn_parsed_ContentObject pcos;
+    const unsigned char *xp = NULL;
+    size_t xs = 0;
+    int res = SyncLocalRepoFetch(base, ns->name, content, &pcos);
+    if (res >= 0) {
+        res = ccn_content_get_value(content->buf, content->length,
+                                    &pcos, &xp, &xs);
+        if (res < 0) *why = "ccn_content_get_value failed";
+    }
+    if (res >= 0) {
+        struct ccn_buf_decoder ds;
+        struct ccn_buf_decoder *d = ccn_buf_decoder_start(&ds, xp, xs);
+        uintmax_t vers = 0;
+        if (ccn_buf_match_dtag(d, CCN_DTAG_SyncNodeBatch)) {
+            ccn_buf_advance(d);
+            vers = SyncParseUnsigned(d, CCN_DTAG_SyncVersion);
+        }
+        if (SyncCheckDecodeErr(d) || vers != SYNC_NODE_BATCH_VERSION) {
+            *why = "bad batch";
+            res = -1;
+        }
+        while (res >= 0 && ccn_buf_match_dtag(d, CCN_DTAG_SyncNode)) {
+            ccn_charbuf_reset(cb);
+            if (SyncNodeExpand(cb, d) < 0) {
+                *why = "bad node";
+                res = -1;
+                break;
+            }
+            struct ccn_buf_decoder nds;
+            struct ccn_buf_decoder *nd = ccn_buf_decoder_start(&nds, cb->buf,
+                                                              cb->length);
+            struct SyncNodeComposite *nc = SyncAllocComposite(base);
+            if (SyncParseComposite(nc, nd) < 0 || nc->hash == NULL) {
+                *why = "bad parse";
+                SyncFreeComposite(nc);
+                res = -1;
+                break;
+            }
+            struct SyncHashCacheEntry *each = SyncHashLookup(head,
+                                                             nc->hash->buf,
+                                                             nc->hash->length);
+            if (each == NULL || each->store != ns || each->ncL != NULL) {
+                // not needed here
+                SyncFreeComposite(nc);
+                continue;
+            }
+            SyncNodeIncRC(nc);
+            each->ncL = nc;
+        }
+    }
+    if (res >= 0 && ce->ncL == NULL) {
+        *why = "not in batch";
+        res = -1;
+    }
+    ccn_charbuf_destroy(&content);
+    ccn_charbuf_destroy(&cb);
+    if (res >= 0) res = 1;
     return res;
 }
 
@@ -219,6 +495,13 @@ SyncCacheEntryFetch(struct SyncHashCacheEntry *ce) {
     } else if ((ce->state & SyncHashState_stored) == 0) {
         // it's never been stored, fail quietly
         res = -1;
+    } else if (ce->store != NULL) {
+        // it was stored in a batch, so get it from there
+        char *why = "no fetch";
+        res = fetchFromStore(ce, &why);
+        if (res < 0)
+            if (ce->head->root->base->debug >= CCNL_ERROR)
+                SyncNoteUri(ce->head->root, here, why, ce->store->name);
     } else {
         // at this point we try to fetch it from the local repo
         // a failure should complain
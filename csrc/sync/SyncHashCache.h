@@ -24,6 +24,7 @@
 #include <ccnr/ccnr_private.h>
 
 struct SyncRootStruct; // defined in SyncRoot
+struct SyncBaseStruct; // defined in SyncBase
 
 enum SyncHashState {
     SyncHashState_local = 1,     /**< a local node exists */
@@ -39,12 +40,23 @@ struct SyncHashCacheHead {
     struct SyncRootStruct *root;        /**< the parent root */
     uintmax_t probes;                   /**< number of cache probes */
     uintmax_t misses;                   /**< number of cache misses */
+    uintmax_t evictions;                /**< number of local nodes evicted */
+    size_t resident;                    /**< bytes of local nodes (last trim) */
     uintmax_t lastIndex;                /**< assigned by order of creation */
     size_t len;                         /**< number of entries */
     uint32_t mod;                       /**< the mod to use */
     struct SyncHashCacheEntry **ents;   /**< the vector of hash chains */
 };
 
+/**
+ * a batch of local nodes stored in the repo as one signed object
+ * shared by the cache entries (of any root) for the nodes in it
+ */
+struct SyncNodeStore {
+    int refs;                           /**< number of cache entries using it */
+    struct ccn_charbuf *name;           /**< name of the stored object */
+};
+
 struct SyncHashCacheEntry {
     struct SyncHashCacheHead *head;     /**< the parent head */
     struct SyncHashCacheEntry *next;    /**< the next entry in the hash chain */
@@ -56,6 +68,7 @@ struct SyncHashCacheEntry {
     struct ccn_charbuf *hash;           /**< hash used to reach this entry */
     struct SyncNodeComposite *ncL;      /**< the local node in memory */
     struct SyncNodeComposite *ncR;      /**< some remote node in memory */
+    struct SyncNodeStore *store;        /**< stored batch with the local node */
     int64_t lastUsed;                 /**< time when entry last used in compare */
     int64_t lastLocalFetch;           /**< time when local entry last fetched */
     int64_t lastRemoteFetch;          /**< time when remote entry last fetched */
@@ -98,6 +111,16 @@ SyncHashClearMarks(struct SyncHashCacheHead *head);
 struct SyncHashCacheHead *
 SyncHashCacheCreate(struct SyncRootStruct *root, uint32_t mod);
 
+/**
+ * evicts the local nodes of the least recently used entries until the
+ * local nodes in memory take no more than budget bytes
+ * only entries that are stored to the repo and not busy are eligible,
+ * and SyncCacheEntryFetch will bring an evicted node back
+ * @returns the bytes of local nodes still in memory
+ */
+size_t
+SyncHashCacheTrim(struct SyncHashCacheHead *head, size_t budget);
+
 /**
  * frees the cache resources
  * caller must ensure no further use of the cache
@@ -111,6 +134,8 @@ SyncHashCacheFree(struct SyncHashCacheHead *head);
  * fetches the cache entry
  * to be eligible, ce != NULL && ce->ncL != NULL
  * && (ce->state & SyncHashState_stored) == 1
+ * the node is read from its stored batch, and any other evicted nodes of
+ * this root from the same batch are brought back as well
  * @returns < 0 for failure, 0 if not eligible, and > 0 for success
  */
 int
@@ -125,4 +150,16 @@ SyncCacheEntryFetch(struct SyncHashCacheEntry *ce);
 int
 SyncCacheEntryStore(struct SyncHashCacheEntry *ce);
 
+/**
+ * stores the local nodes of the eligible entries (as for SyncCacheEntryStore)
+ * to the repo as one signed SyncNodeBatch, so the batch costs one signature
+ * and one repo write
+ * an entry whose node is already stored for some root (by hash) shares that
+ * stored batch instead of adding its node again
+ * @returns < 0 for failure, else the number of entries now stored
+ */
+int
+SyncCacheEntryStoreBatch(struct SyncBaseStruct *base,
+                         struct SyncHashCacheEntry **ents, int n);
+
 #endif
@@ -0,0 +1,282 @@
+/**
+ * @file sync/SyncIBLT.c
+ *
+ * Part of CCNx Sync.
+ */
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "SyncIBLT.h"
+#include "SyncMacros.h"
+#include "SyncUtil.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ccn/ccn.h>
+
+#define W SYNC_IBLT_NAME_BYTES
+#define LONG_NAME 255
+
+// mix64 is the 64-bit finalizer from MurmurHash3
+static uint64_t
+mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// hashBytes is 64-bit FNV-1a
+static uint64_t
+hashBytes(const unsigned char *xp, size_t xs) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (i = 0; i < xs; i++) {
+        h ^= xp[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static uint32_t
+checkForHash(uint64_t h) {
+    return (uint32_t) mix64(h ^ 0x5bd1e9955bd1e995ULL);
+}
+
+// cellForHash returns the cell for hash function i,
+// with one partition of the cells for each function, so that
+// a name never lands twice in one cell
+static int
+cellForHash(const struct SyncIBLT *t, uint64_t h, int i) {
+    int part = t->cells / SYNC_IBLT_HASHES;
+    uint64_t x = mix64(h + (uint64_t) (i + 1) * 0x9e3779b97f4a7c15ULL);
+    return i * part + (int) (x % (uint64_t) part);
+}
+
+// toggle adds one name (given as a cell image) into the table
+static void
+toggle(struct SyncIBLT *t, uint64_t h, const unsigned char *img, int sign) {
+    uint32_t check = checkForHash(h);
+    int i = 0;
+    for (i = 0; i < SYNC_IBLT_HASHES; i++) {
+        int c = cellForHash(t, h, i);
+        unsigned char *bp = t->bytes + (size_t) c * W;
+        int j = 0;
+        t->count[c] += sign;
+        t->check[c] ^= check;
+        for (j = 0; j < W; j++) bp[j] ^= img[j];
+    }
+    t->names += sign;
+}
+
+extern struct SyncIBLT *
+SyncIBLTAlloc(int cells) {
+    cells = cells - cells % SYNC_IBLT_HASHES;
+    if (cells < SYNC_IBLT_HASHES) cells = SYNC_IBLT_HASHES;
+    struct SyncIBLT *t = NEW_STRUCT(1, SyncIBLT);
+    t->cells = cells;
+    t->count = NEW_ANY(cells, int32_t);
+    t->check = NEW_ANY(cells, uint32_t);
+    t->bytes = NEW_ANY((size_t) cells * W, unsigned char);
+    return t;
+}
+
+extern struct SyncIBLT *
+SyncIBLTCopy(const struct SyncIBLT *src) {
+    struct SyncIBLT *t = SyncIBLTAlloc(src->cells);
+    t->names = src->names;
+    memcpy(t->count, src->count, src->cells * sizeof(int32_t));
+    memcpy(t->check, src->check, src->cells * sizeof(uint32_t));
+    memcpy(t->bytes, src->bytes, (size_t) src->cells * W);
+    return t;
+}
+
+extern struct SyncIBLT *
+SyncIBLTFree(struct SyncIBLT *t) {
+    if (t != NULL) {
+        free(t->count);
+        free(t->check);
+        free(t->bytes);
+        free(t);
+    }
+    return NULL;
+}
+
+extern int
+SyncIBLTInsert(struct SyncIBLT *t,
+               const struct ccn_charbuf *prefix,
+               const struct ccn_charbuf *name,
+               int sign) {
+    unsigned char img[W];
+    // the suffix is the components after the prefix, without the closer
+    size_t pl = prefix->length - 1;
+    memset(img, 0, sizeof(img));
+    if (name->length > pl && memcmp(name->buf, prefix->buf, pl) == 0) {
+        const unsigned char *sp = name->buf + pl;
+        size_t sl = name->length - 1 - pl;
+        uint64_t h = hashBytes(sp, sl);
+        if (sl < W) {
+            img[0] = sl;
+            memcpy(img+1, sp, sl);
+            toggle(t, h, img, (sign < 0) ? -1 : 1);
+            return 1;
+        }
+    }
+    // can't be listed, but must still be counted
+    img[0] = LONG_NAME;
+    toggle(t, hashBytes(name->buf, name->length), img, (sign < 0) ? -1 : 1);
+    return 0;
+}
+
+extern int
+SyncIBLTSubtract(struct SyncIBLT *t, const struct SyncIBLT *sub) {
+    if (t->cells != sub->cells) return -1;
+    size_t n = (size_t) t->cells * W;
+    size_t i = 0;
+    for (i = 0; i < t->cells; i++) {
+        t->count[i] -= sub->count[i];
+        t->check[i] ^= sub->check[i];
+    }
+    for (i = 0; i < n; i++) t->bytes[i] ^= sub->bytes[i];
+    t->names -= sub->names;
+    return 0;
+}
+
+// pureCell tests for a cell that holds exactly one name, and if so
+// returns the hash of that name
+static int
+pureCell(const struct SyncIBLT *t, int c, uint64_t *hp) {
+    int n = t->count[c];
+    if (n != 1 && n != -1) return 0;
+    const unsigned char *bp = t->bytes + (size_t) c * W;
+    int sl = bp[0];
+    if (sl >= W) return 0;
+    int j = 0;
+    for (j = sl + 1; j < W; j++)
+        if (bp[j] != 0) return 0;
+    uint64_t h = hashBytes(bp+1, sl);
+    if (checkForHash(h) != t->check[c]) return 0;
+    *hp = h;
+    return 1;
+}
+
+extern int
+SyncIBLTDecode(struct SyncIBLT *t,
+               const struct ccn_charbuf *prefix,
+               struct SyncNameAccum *plus) {
+    int peeled = 0;
+    int progress = 1;
+    while (progress) {
+        int c = 0;
+        progress = 0;
+        for (c = 0; c < t->cells; c++) {
+            uint64_t h = 0;
+            if (!pureCell(t, c, &h)) continue;
+            unsigned char img[W];
+            int sign = t->count[c];
+            memcpy(img, t->bytes + (size_t) c * W, W);
+            if (sign > 0) {
+                // rebuild the full name
+                struct ccn_charbuf *name = ccn_charbuf_create();
+                ccn_charbuf_append(name, prefix->buf, prefix->length - 1);
+                ccn_charbuf_append(name, img+1, img[0]);
+                ccn_charbuf_append_closer(name);
+                SyncNameAccumAppend(plus, name, 0);
+            }
+            toggle(t, h, img, -sign);
+            peeled++;
+            progress = 1;
+        }
+    }
+    // success only if nothing is left
+    int c = 0;
+    for (c = 0; c < t->cells; c++) {
+        if (t->count[c] != 0 || t->check[c] != 0) return -1;
+    }
+    size_t n = (size_t) t->cells * W;
+    size_t i = 0;
+    for (i = 0; i < n; i++)
+        if (t->bytes[i] != 0) return -1;
+    return peeled;
+}
+
+extern int
+SyncIBLTAppend(struct ccn_charbuf *cb, const struct SyncIBLT *t) {
+    int res = 0;
+    size_t n = (size_t) t->cells * (8 + W);
+    unsigned char *buf = NEW_ANY(n, unsigned char);
+    unsigned char *bp = buf;
+    int c = 0;
+    for (c = 0; c < t->cells; c++) {
+        uint32_t count = (uint32_t) t->count[c];
+        uint32_t check = t->check[c];
+        int j = 0;
+        for (j = 3; j >= 0; j--) {
+            bp[j] = count & 255;
+            bp[4+j] = check & 255;
+            count >>= 8;
+            check >>= 8;
+        }
+        memcpy(bp+8, t->bytes + (size_t) c * W, W);
+        bp += 8 + W;
+    }
+    res |= ccnb_element_begin(cb, CCN_DTAG_SyncNodeIBLT);
+    res |= SyncAppendTaggedNumber(cb, CCN_DTAG_SyncVersion, SYNC_IBLT_VERSION);
+    res |= SyncAppendTaggedNumber(cb, CCN_DTAG_SyncLeafCount,
+                                  (t->names < 0) ? 0 : t->names);
+    res |= ccnb_append_tagged_blob(cb, CCN_DTAG_SyncIBLTCells, buf, n);
+    res |= ccnb_element_end(cb);
+    free(buf);
+    return res;
+}
+
+extern struct SyncIBLT *
+SyncIBLTParse(struct ccn_buf_decoder *d) {
+    const unsigned char *bp = NULL;
+    size_t bs = 0;
+    if (!ccn_buf_match_dtag(d, CCN_DTAG_SyncNodeIBLT))
+        return NULL;
+    ccn_buf_advance(d);
+    uintmax_t vers = SyncParseUnsigned(d, CCN_DTAG_SyncVersion);
+    uintmax_t names = SyncParseUnsigned(d, CCN_DTAG_SyncLeafCount);
+    if (ccn_buf_match_dtag(d, CCN_DTAG_SyncIBLTCells)) {
+        ccn_buf_advance(d);
+        if (ccn_buf_match_blob(d, &bp, &bs)) ccn_buf_advance(d);
+        ccn_buf_check_close(d);
+    }
+    ccn_buf_check_close(d);
+    if (SyncCheckDecodeErr(d) || vers != SYNC_IBLT_VERSION || bp == NULL
+        || bs == 0 || bs % (8 + W) != 0
+        || (bs / (8 + W)) % SYNC_IBLT_HASHES != 0)
+        return NULL;
+    struct SyncIBLT *t = SyncIBLTAlloc(bs / (8 + W));
+    int c = 0;
+    for (c = 0; c < t->cells; c++) {
+        uint32_t count = 0;
+        uint32_t check = 0;
+        int j = 0;
+        for (j = 0; j < 4; j++) {
+            count = (count << 8) + bp[j];
+            check = (check << 8) + bp[4+j];
+        }
+        t->count[c] = (int32_t) count;
+        t->check[c] = check;
+        memcpy(t->bytes + (size_t) c * W, bp+8, W);
+        bp += 8 + W;
+    }
+    t->names = names;
+    return t;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file sync/SyncIBLT.h
+ *
+ * Part of CCNx Sync.
+ */
+/*
+ * Copyright (C) 2012 Palo Alto Research Center, Inc.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License version 2.1
+ * as published by the Free Software Foundation.
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have received
+ * a copy of the GNU Lesser General Public License along with this library;
+ * if not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+ * Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef CCN_SyncIBLT
+#define CCN_SyncIBLT
+
+#include <stdint.h>
+#include <ccn/charbuf.h>
+#include <ccn/ccn.h>
+
+struct SyncNameAccum; // defined in SyncUtil
+
+#define SYNC_IBLT_VERSION 20121015
+#define SYNC_IBLT_HASHES 3          /**< cells touched by each name */
+#define SYNC_IBLT_NAME_BYTES 64     /**< name bytes per cell (incl. length) */
+
+/**
+ * An invertible Bloom lookup table over the names of a sync tree.
+ * Each name is reduced to its suffix after the naming prefix of the root,
+ * and XORed into SYNC_IBLT_HASHES cells.  Subtracting the table of another
+ * name set leaves only the difference, which can be listed by peeling
+ * off cells that hold a single name, as long as the difference is small
+ * compared to the number of cells.
+ * Suffixes longer than SYNC_IBLT_NAME_BYTES-1 are counted, but can't be
+ * listed, so a difference that includes one will not decode.
+ */
+struct SyncIBLT {
+    int cells;                  /**< number of cells (multiple of SYNC_IBLT_HASHES) */
+    int names;                  /**< net number of names inserted */
+    int32_t *count;             /**< per cell, net number of names */
+    uint32_t *check;            /**< per cell, XOR of name checksums */
+    unsigned char *bytes;       /**< per cell, XOR of length and name suffix */
+};
+
+/**
+ * allocates an empty table with cells rounded down to a multiple of
+ * SYNC_IBLT_HASHES (and at least SYNC_IBLT_HASHES)
+ */
+struct SyncIBLT *
+SyncIBLTAlloc(int cells);
+
+/**
+ * @returns a new copy of the table
+ */
+struct SyncIBLT *
+SyncIBLTCopy(const struct SyncIBLT *src);
+
+/**
+ * frees the table (no action if NULL)
+ * @returns NULL
+ */
+struct SyncIBLT *
+SyncIBLTFree(struct SyncIBLT *t);
+
+/**
+ * inserts (sign > 0) or deletes (sign < 0) the name, which should have the
+ * given prefix (both are ccnb Names)
+ * @returns 1 if the name can be listed later, 0 if it is too long (or does
+ * not have the prefix)
+ */
+int
+SyncIBLTInsert(struct SyncIBLT *t,
+               const struct ccn_charbuf *prefix,
+               const struct ccn_charbuf *name,
+               int sign);
+
+/**
+ * subtracts sub from t (the tables must have the same number of cells)
+ * @returns < 0 for a size mismatch, else 0
+ */
+int
+SyncIBLTSubtract(struct SyncIBLT *t, const struct SyncIBLT *sub);
+
+/**
+ * peels the table, destroying its contents
+ * the names inserted in t (but not in the subtracted table) are appended
+ * to plus (with the prefix restored); names from the subtracted table
+ * that are not in t are only counted
+ * @returns the number of names peeled, or < 0 if the table could not be
+ * fully peeled (any names already appended to plus remain)
+ */
+int
+SyncIBLTDecode(struct SyncIBLT *t,
+               const struct ccn_charbuf *prefix,
+               struct SyncNameAccum *plus);
+
+/**
+ * appends the encoding of the table (as a SyncNodeIBLT) to cb
+ * @returns < 0 for failure
+ */
+int
+SyncIBLTAppend(struct ccn_charbuf *cb, const struct SyncIBLT *t);
+
+/**
+ * parses a SyncNodeIBLT
+ * @returns NULL if d is not at a SyncNodeIBLT, or the parse failed
+ */
+struct SyncIBLT *
+SyncIBLTParse(struct ccn_buf_decoder *d);
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "SyncNode.h"
 #include "SyncUtil.h"
+#include <ccn/indexbuf.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -435,3 +436,153 @@ SyncParseComposite(struct SyncNodeComposite *nc, struct ccn_buf_decoder *d) {
     return nc->err;
 }
 
+
+////////////////////////////////////////
+// Routines for the compact encoding
+////////////////////////////////////////
+
+// nameComps fills comps with the component offsets of the name at xp
+// (relative to xp, with the offset of the closer last)
+// returns the number of components, or < 0 for a bad name
+static int
+nameComps(const unsigned char *xp, size_t xs, struct ccn_indexbuf *comps) {
+    struct ccn_buf_decoder ds;
+    struct ccn_buf_decoder *d = ccn_buf_decoder_start(&ds, xp, xs);
+    return ccn_parse_Name(d, comps);
+}
+
+extern int
+SyncNodeAppendCompact(struct ccn_charbuf *cb, struct SyncNodeComposite *nc) {
+    struct ccn_charbuf *src = nc->cb;
+    int lim = nc->refLen;
+    if (lim == 0)
+        return ccn_charbuf_append_charbuf(cb, src);
+    struct ccn_indexbuf *prevComps = ccn_indexbuf_create();
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    const unsigned char *prev = NULL;
+    int prevN = -1;
+    int res = 0;
+    int i = 0;
+    // the header, up to the first reference
+    res |= ccn_charbuf_append(cb, src->buf, nc->refs[0].start);
+    for (i = 0; i < lim; i++) {
+        struct SyncNodeElem *ep = &nc->refs[i];
+        const unsigned char *xp = src->buf + ep->start;
+        size_t xs = ep->stop - ep->start;
+        int n = -1;
+        int k = 0;
+        if (ep->kind & SyncElemKind_leaf)
+            n = nameComps(xp, xs, comps);
+        if (n >= 0 && prevN >= 0) {
+            // count the leading components shared with the previous leaf
+            while (k < n && k < prevN && k < 255) {
+                size_t a0 = comps->buf[k];
+                size_t a1 = comps->buf[k+1];
+                size_t b0 = prevComps->buf[k];
+                size_t b1 = prevComps->buf[k+1];
+                if (a1 - a0 != b1 - b0
+                    || memcmp(xp + a0, prev + b0, a1 - a0) != 0)
+                    break;
+                k++;
+            }
+        }
+        if (k > 0) {
+            // the suffix blob is the shared count, then the rest of the
+            // component encodings
+            size_t s0 = comps->buf[k];
+            size_t s1 = comps->buf[n];
+            unsigned char kb = k;
+            res |= ccn_charbuf_append_tt(cb, CCN_DTAG_SyncNameSuffix, CCN_DTAG);
+            res |= ccn_charbuf_append_tt(cb, 1 + s1 - s0, CCN_BLOB);
+            res |= ccn_charbuf_append(cb, &kb, 1);
+            res |= ccn_charbuf_append(cb, xp + s0, s1 - s0);
+            res |= ccn_charbuf_append_closer(cb);
+        } else {
+            res |= ccn_charbuf_append(cb, xp, xs);
+        }
+        if (n >= 0) {
+            // remember this leaf for the next one
+            struct ccn_indexbuf *t = prevComps;
+            prevComps = comps;
+            comps = t;
+            prev = xp;
+            prevN = n;
+        }
+    }
+    // the trailer, after the last reference
+    ssize_t stop = nc->refs[lim-1].stop;
+    res |= ccn_charbuf_append(cb, src->buf + stop, src->length - stop);
+    ccn_indexbuf_destroy(&prevComps);
+    ccn_indexbuf_destroy(&comps);
+    return res;
+}
+
+extern int
+SyncNodeExpand(struct ccn_charbuf *cb, struct ccn_buf_decoder *d) {
+    const unsigned char *buf = d->buf;
+    struct ccn_indexbuf *comps = ccn_indexbuf_create();
+    struct ccn_charbuf *prev = ccn_charbuf_create();
+    int res = -1;
+    while (ccn_buf_match_dtag(d, CCN_DTAG_SyncNode)) {
+        // the while loop is only present to let us break out early on error
+        size_t start = d->decoder.token_index;
+        ccn_buf_advance(d);
+        SyncParseUnsigned(d, CCN_DTAG_SyncVersion);
+        if (SyncCheckDecodeErr(d) || !ccn_buf_match_dtag(d, CCN_DTAG_SyncNodeElements))
+            break;
+        ccn_buf_advance(d);
+        // the header, up to the first reference
+        ccn_charbuf_append(cb, buf + start, d->decoder.token_index - start);
+        for (;;) {
+            size_t xs = d->decoder.token_index;
+            if (ccn_buf_match_dtag(d, CCN_DTAG_Name)) {
+                SyncParseName(d);
+                ccn_charbuf_reset(prev);
+                ccn_charbuf_append(prev, buf + xs, d->decoder.token_index - xs);
+                ccn_charbuf_append_charbuf(cb, prev);
+            } else if (ccn_buf_match_dtag(d, CCN_DTAG_SyncContentHash)) {
+                SyncParseHash(d);
+                ccn_charbuf_append(cb, buf + xs, d->decoder.token_index - xs);
+            } else if (ccn_buf_match_dtag(d, CCN_DTAG_SyncNameSuffix)) {
+                const unsigned char *bp = NULL;
+                size_t bs = 0;
+                ccn_buf_advance(d);
+                if (ccn_buf_match_blob(d, &bp, &bs)) ccn_buf_advance(d);
+                ccn_buf_check_close(d);
+                int n = nameComps(prev->buf, prev->length, comps);
+                if (SyncCheckDecodeErr(d) || bs < 1 || n < bp[0]) {
+                    SyncSetDecodeErr(d, -__LINE__);
+                    break;
+                }
+                // the shared components of the previous leaf, then the rest
+                prev->length = comps->buf[bp[0]];
+                ccn_charbuf_append(prev, bp + 1, bs - 1);
+                ccn_charbuf_append_closer(prev);
+                ccn_charbuf_append_charbuf(cb, prev);
+            } else {
+                ccn_buf_check_close(d);
+                break;
+            }
+            if (SyncCheckDecodeErr(d)) break;
+        }
+        if (SyncCheckDecodeErr(d)) break;
+        ccn_charbuf_append_closer(cb);
+        // the trailer is not compacted
+        size_t tail = d->decoder.token_index;
+        SyncParseHash(d);
+        SyncParseName(d);
+        SyncParseName(d);
+        SyncParseUnsigned(d, CCN_DTAG_SyncNodeKind);
+        SyncParseUnsigned(d, CCN_DTAG_SyncLeafCount);
+        SyncParseUnsigned(d, CCN_DTAG_SyncTreeDepth);
+        SyncParseUnsigned(d, CCN_DTAG_SyncByteCount);
+        ccn_buf_check_close(d);
+        if (SyncCheckDecodeErr(d)) break;
+        ccn_charbuf_append(cb, buf + tail, d->decoder.token_index - tail);
+        res = 0;
+        break;
+    }
+    ccn_indexbuf_destroy(&comps);
+    ccn_charbuf_destroy(&prev);
+    return res;
+}
@@ -244,5 +244,36 @@ SyncWriteComposite(struct SyncNodeComposite *nc, FILE *f);
 int
 SyncParseComposite(struct SyncNodeComposite *nc, struct ccn_buf_decoder *d);
 
+////////////////////////////////////////
+// Routines for the compact encoding
+////////////////////////////////////////
+
+/**
+ * version of the SyncNodeBatch encoding (a SyncVersion, then the nodes in
+ * the compact encoding), used for NodeFetch replies and for the local
+ * nodes stored in the repo
+ */
+#define SYNC_NODE_BATCH_VERSION (20121015)
+
+/**
+ * appends the compact encoding of the node to cb
+ * the compact encoding is the SyncNode encoding, except that a leaf name
+ * that shares leading components with the previous leaf is replaced by a
+ * SyncNameSuffix (the shared count, then the other components)
+ * @returns < 0 for failure
+ */
+int
+SyncNodeAppendCompact(struct ccn_charbuf *cb, struct SyncNodeComposite *nc);
+
+/**
+ * appends the SyncNode encoding of the (possibly compact) node at d to cb,
+ * leaving d after the node
+ * d must be inside some enclosing element, since the end of the node is
+ * found from the start of the next token
+ * @returns < 0 for failure
+ */
+int
+SyncNodeExpand(struct ccn_charbuf *cb, struct ccn_buf_decoder *d);
+
 
 #endif
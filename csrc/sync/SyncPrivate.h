@@ -26,6 +26,7 @@
 #include "SyncUtil.h"
 
 struct SyncHashCacheEntry;              // from SyncHashCache.h
+struct SyncIBLT;                        // from SyncIBLT.h
 
 struct SyncNameAccumList {
     struct SyncNameAccumList *next;
@@ -55,13 +56,17 @@ struct SyncPrivate {
     int fauxErrorTrigger;
     int syncActionsPrivate;
     int heartbeatMicros;        /*< microseconds between action heartbeats */
+    int heartbeatKick;          /*< 1 if a one-shot heartbeat is pending */
     int rootAdviseFresh;        /*< seconds for root advise response freshness */
     int rootAdviseLifetime;     /*< seconds for root advise interest lifetime */
     int fetchLifetime;          /*< seconds for node fetch interest lifetime */
     int maxFetchBusy;           /*< max # of fetches per root busy */
+    int maxFetchWindow;         /*< max # of content fetches per root busy */
     int comparesBusy;           /*< # of roots doing compares */
     int maxComparesBusy;        /*< max # of roots doing compares */
     int deltasLimit;            /*< # of bytes permitted for RootAdvise delta mode */
+    int ibltCells;              /*< # of cells for RootAdvise IBLT mode */
+    int nodeBatchBytes;         /*< # of bytes permitted for NodeFetch batches */
     int syncScope;              /*< default sync scope */
 };
 
@@ -77,8 +82,12 @@ struct SyncRootStats {
     uint64_t lastUpdateMicros;      /*< last elapsed update time (microsecs) */
     uint64_t comparesDone;          /*< number of sync tree compares completed */
     uint64_t lastCompareMicros;     /*< last elapsed compare time (microsecs) */
+    uint64_t lastCompareFetchPeak;  /*< max concurrent node fetches, last compare */
     uint64_t nodesCreated;          /*< number of new nodes created */
     uint64_t nodesShared;           /*< number of nodes shared */
+    uint64_t nodesStored;           /*< number of local nodes stored */
+    uint64_t nodesStoreShared;      /*< number of nodes stored by another root */
+    uint64_t nodeStoreBatches;      /*< number of node batches stored */
     
     uint64_t rootAdviseSent;        /*< number of RootAdvise interests sent */
     uint64_t nodeFetchSent;         /*< number of NodeFetch interests sent */
@@ -93,6 +102,8 @@ struct SyncRootStats {
     
     uint64_t rootAdviseBytes;       /*< number of bytes for RootAdvise responses */
     uint64_t nodeFetchBytes;        /*< number of bytes for NodeFetch responses */
+    uint64_t nodeFetchRttMicros;    /*< smoothed NodeFetch round trip (microsecs) */
+    uint64_t nodeFetchBatched;      /*< number of extra nodes entered from batches */
     uint64_t contentFetchBytes;     /*< number of bytes for content objects */
 
     uint64_t rootAdviseTimeout;     /*< number of RootAdvise response timeouts */
@@ -100,9 +111,21 @@ struct SyncRootStats {
     uint64_t contentFetchTimeout;   /*< number of content object response timeouts */
     
     uint64_t rootAdviseFailed;      /*< number of RootAdvise response failures */
+    uint64_t rootAdviseBackoff;     /*< number of idle RootAdvise interval increases */
+    uint64_t activityNoted;         /*< number of new names or remote roots noted */
+    uint64_t rootAdviseIBLTSent;    /*< number of IBLT RootAdvise responses sent */
+    uint64_t rootAdviseIBLTDecoded; /*< number of IBLT RootAdvise responses decoded */
+    uint64_t rootAdviseIBLTFailed;  /*< number of IBLT RootAdvise responses not decoded */
     uint64_t nodeFetchFailed;       /*< number of NodeFetch response failures */
     uint64_t contentFetchFailed;    /*< number of content object response failures */
     
+    uint64_t schedLagMicros;        /*< smoothed lateness of compare/update steps */
+    struct SyncHist nodeFetchRtt;   /*< NodeFetch round trips */
+    struct SyncHist compareStep;    /*< time held by each compare step */
+    struct SyncHist updateStep;     /*< time held by each update step */
+    struct SyncHist storeTime;      /*< time for each batch of node stores */
+    struct SyncHist schedLag;       /*< lateness of compare/update steps */
+    
 };
 
 struct SyncRootDeltas {
@@ -127,6 +150,8 @@ struct SyncRootPrivate {
     struct SyncRootDeltas *deltasTail;  /*< pointer to youngest update */
     int nDeltas;                        /*< number of deltas in the list */
     struct SyncNameAccum *remoteDeltas; /*< delta names from remote sources */
+    struct SyncIBLT *iblt;              /*< IBLT of the names in the tree */
+    struct ccn_charbuf *ibltHash;       /*< root hash that iblt describes */
     int syncScope;                      /*< scope to be used for sync */
     int sliceBusy;
     ccnr_hwm highWater;             // high water via SyncNotifyContent
@@ -136,9 +161,14 @@ struct SyncRootPrivate {
     int64_t lastStable;
     int64_t lastHashChange;
     int adviseNeed;
+    int64_t adviseIdleMicros;       // RootAdvise interval while idle (0 if active)
     struct SyncHashCacheEntry *lastLocalSent;
     size_t currentSize;
     size_t prevAddLen;
+    int fetchWindow;                /*< content fetches allowed in flight */
+    int fetchThresh;                /*< window above which growth is slow */
+    int fetchGrowth;                /*< fetches answered since window grew */
+    int64_t fetchCut;               /*< when the window was last cut */
 };
 
 #endif
@@ -35,6 +35,7 @@
 #include "SyncPrivate.h"
 #include "SyncActions.h"
 #include "SyncHashCache.h"
+#include "SyncIBLT.h"
 #include "SyncUtil.h"
 #include "SyncRoot.h"
 
@@ -235,6 +236,8 @@ SyncRemRoot(struct SyncRootStruct *root) {
                 if (rp->remoteDeltas != NULL) {
                     SyncFreeNameAccumAndNames(rp->remoteDeltas);
                 }
+                SyncIBLTFree(rp->iblt);
+                ccn_charbuf_destroy(&rp->ibltHash);
                 free(rp);
             }
             free(root);
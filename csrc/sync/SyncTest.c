@@ -153,6 +153,24 @@ r_sync_lookup(struct ccnr_handle *ccnr,
     return(ans);
 }
 
+PUBLIC int
+r_sync_lookup_names(struct ccnr_handle *ccnr,
+                    struct ccn_charbuf **names,
+                    int n,
+                    unsigned char *present)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        present[i] = 0;
+    return(0);
+}
+
+PUBLIC int
+r_sync_idle_period(struct ccnr_handle *ccnr, int micros)
+{
+    return(micros);
+}
+
 /**
  * Called when a content object is received by sync and needs to be
  * committed to stable storage by the repo.
@@ -490,22 +508,17 @@ testReader(struct SyncTestParms *parms) {
         fclose(f);
         struct ccn_charbuf *tmp = ccn_charbuf_create();
         int i = 0;
-        IndexSorter_Base ixBase = NULL;
         int accumNameBytes = 0;
         int accumContentBytes = 0;
+        int dups = 0;
         if (sort > 0) {
-            IndexSorter_Index ixLim = na->len;
-            ixBase = IndexSorter_New(ixLim, -1);
-            ixBase->sorter = SyncNameAccumSorter;
-            ixBase->client = na;
-            IndexSorter_Index ix = 0;
-            for (; ix < ixLim; ix++) IndexSorter_Add(ixBase, ix);
+            dups = SyncNameAccumSort(na);
+            if (dups < 0)
+                return noteErr("bad sort (bad name)!");
         }
         struct ccn_charbuf *lag = NULL;
         for (;i < na->len; i++) {
-            int j = i;
-            if (ixBase != NULL) j = IndexSorter_Rem(ixBase);
-            struct ccn_charbuf *each = na->ents[j].name;
+            struct ccn_charbuf *each = na->ents[i].name;
             if (sort == 1 && lag != NULL) {
                 int cmp = SyncCmpNames(each, lag);
                 if (cmp < 0)
@@ -515,13 +528,12 @@ testReader(struct SyncTestParms *parms) {
             }
             struct ccn_charbuf *repl = each;
             accumNameBytes = accumNameBytes + repl->length;
-            ssize_t size = na->ents[j].data;
+            ssize_t size = na->ents[i].data;
             accumContentBytes = accumContentBytes + size;
             ccn_charbuf_reset(tmp);
             ccn_uri_append(tmp, repl->buf, repl->length, 1);
             if (sort != 2) {
                 fprintf(stdout, "%4d", i);
-                if (sort) fprintf(stdout, ", %4d", j);
                 fprintf(stdout, ", %8zd, ", size);
             }
             fprintf(stdout, "%s\n", ccn_charbuf_as_string(tmp));
@@ -530,10 +542,9 @@ testReader(struct SyncTestParms *parms) {
         }
         int64_t dt = SyncDeltaTime(startTime, SyncCurrentTime());
         dt = (dt + 500)/ 1000;
-        fprintf(stdout, "-- %d names, %d name bytes, %d content bytes, %d.%03d seconds\n",
-                na->len, accumNameBytes, accumContentBytes,
+        fprintf(stdout, "-- %d names, %d duplicates, %d name bytes, %d content bytes, %d.%03d seconds\n",
+                na->len, dups, accumNameBytes, accumContentBytes,
                 (int) (dt / 1000), (int) (dt % 1000));
-        if (ixBase != NULL) IndexSorter_Free(&ixBase);
         ccn_charbuf_destroy(&tmp);
         na = SyncFreeNameAccum(na);
     } else {
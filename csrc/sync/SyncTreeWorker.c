@@ -26,6 +26,14 @@
 #include <string.h>
 #include <strings.h>
 
+static struct SyncNodeComposite *
+workerNode(struct SyncTreeWorkerHead *head, struct SyncHashCacheEntry *ce) {
+    // the node for this walk, bringing back a local node that was evicted
+    if (head->remote > 0) return ce->ncR;
+    if (ce->ncL == NULL) SyncCacheEntryFetch(ce);
+    return ce->ncL;
+}
+
 extern void
 SyncTreeWorkerInit(struct SyncTreeWorkerHead *head,
                    struct SyncHashCacheEntry *ent,
@@ -69,7 +77,7 @@ SyncTreeWorkerGetElem(struct SyncTreeWorkerHead *head) {
     if (ent == NULL) return NULL;
     struct SyncHashCacheEntry *ce = ent->cacheEntry;
     if (ce == NULL) return NULL;
-    struct SyncNodeComposite *nc = ((head->remote > 0) ? ce->ncR : ce->ncL);
+    struct SyncNodeComposite *nc = workerNode(head, ce);
     if (nc == NULL) return NULL;
     int pos = ent->pos;
     if (pos < 0 || pos >= nc->refLen) return NULL;
@@ -84,7 +92,7 @@ SyncTreeWorkerPush(struct SyncTreeWorkerHead *head) {
         return NULL;
     struct SyncTreeWorkerEntry *ent = SyncTreeWorkerTop(head);
     struct SyncHashCacheEntry *ce = ent->cacheEntry;
-    struct SyncNodeComposite *nc = ((head->remote > 0) ? ce->ncR : ce->ncL);
+    struct SyncNodeComposite *nc = workerNode(head, ce);
     struct ccn_buf_decoder cbd;
     struct ccn_buf_decoder *cb = SyncInitDecoderFromOffset(&cbd, nc,
                                                            ref->start,
@@ -174,7 +182,7 @@ SyncTreeLookupName(struct SyncTreeWorkerHead *head,
             return SCR_error;
         }
         struct SyncHashCacheEntry *ce = ent->cacheEntry;
-        struct SyncNodeComposite *nc = ((head->remote > 0) ? ce->ncR : ce->ncL);
+        struct SyncNodeComposite *nc = workerNode(head, ce);
         if (nc == NULL) {
             // report desired node as missing
             return SCR_missing;
@@ -228,9 +236,8 @@ SyncTreeGenerateNames(struct SyncTreeWorkerHead *head,
             return SCR_error;
         }
         struct SyncHashCacheEntry *ce = ent->cacheEntry;
-        struct SyncNodeComposite *nc = ((head->remote > 0) ? ce->ncR : ce->ncL);
+        struct SyncNodeComposite *nc = workerNode(head, ce);
         if (nc == NULL) {
-            // TBD: fetch node if not present
             return SCR_missing;
         }
         int lim = nc->refLen;
@@ -280,8 +287,8 @@ SyncTreeMarkReachable(struct SyncTreeWorkerHead *head, int minLevel) {
         ce->state |= SyncHashState_marked;
         count++;
         struct SyncNodeComposite *nc = ((head->remote > 0) ? ce->ncR : ce->ncL);
-        if (nc == NULL) break;
-        int lim = nc->refLen;
+        // an evicted node is not fetched just to mark below it
+        int lim = (nc == NULL) ? 0 : nc->refLen;
         if (ent->pos >= lim) {
             // done with the current level, go back to the previous level
             ent = SyncTreeWorkerPop(head);
@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <ccnr/ccnr_msg.h>
 #include <ccnr/ccnr_sync.h>
+#include <ccn/btree_content.h>
 #include <ccn/ccn.h>
 #include <ccn/charbuf.h>
 #include <ccn/coding.h>
@@ -80,6 +81,58 @@ SyncDeltaTime(int64_t mt1, int64_t mt2) {
     return mt2-mt1;
 }
 
+extern void
+SyncHistNote(struct SyncHist *h, int64_t micros) {
+    uint64_t x = (micros < 0) ? 0 : micros;
+    int i = 0;
+    while (x >> i != 0 && i < SYNC_HIST_BUCKETS - 1) i++;
+    h->bucket[i]++;
+    h->count++;
+    h->sum += x;
+    if (x > h->max) h->max = x;
+}
+
+extern uint64_t
+SyncHistQuantile(const struct SyncHist *h, int perMille) {
+    if (h->count == 0) return 0;
+    uint64_t want = (h->count * perMille + 999) / 1000;
+    uint64_t seen = 0;
+    int i = 0;
+    if (want == 0) want = 1;
+    for (i = 0; i < SYNC_HIST_BUCKETS - 1; i++) {
+        seen += h->bucket[i];
+        if (seen >= want) break;
+    }
+    if (i == SYNC_HIST_BUCKETS - 1) return h->max;
+    // the upper bound of bucket i, but never more than the max seen
+    uint64_t lim = (((uint64_t) 1) << i) - 1;
+    return (lim < h->max) ? lim : h->max;
+}
+
+extern void
+SyncHistAppend(struct ccn_charbuf *cb, const char *name,
+               const struct SyncHist *h, int xml) {
+    if (h->count == 0) return;
+    uintmax_t mean = h->sum / h->count;
+    uintmax_t p50 = SyncHistQuantile(h, 500);
+    uintmax_t p99 = SyncHistQuantile(h, 990);
+    if (xml == 0) {
+        ccn_charbuf_putf(cb, "%s %ju (mean %ju, p50 %ju, p99 %ju, max %ju)",
+                         name, (uintmax_t) h->count, mean, p50, p99,
+                         (uintmax_t) h->max);
+        return;
+    }
+    ccn_charbuf_putf(cb, "<%s><count>%ju</count><mean>%ju</mean>"
+                     "<p50>%ju</p50><p99>%ju</p99><max>%ju</max><buckets>",
+                     name, (uintmax_t) h->count, mean, p50, p99,
+                     (uintmax_t) h->max);
+    int i = 0;
+    for (i = 0; i < SYNC_HIST_BUCKETS; i++)
+        ccn_charbuf_putf(cb, "%s%ju", (i > 0) ? " " : "",
+                         (uintmax_t) h->bucket[i]);
+    ccn_charbuf_putf(cb, "</buckets></%s>", name);
+}
+
 extern struct ccn_buf_decoder *
 SyncInitDecoderFromCharbufRange(struct ccn_buf_decoder *d,
                                 const struct ccn_charbuf *cb,
@@ -882,6 +935,144 @@ SyncNameAccumSorter(IndexSorter_Base base,
     return 0;
 }
 
+// the sort keys are flatnames, where memcmp order is the canonical order
+struct NameSortKeys {
+    const unsigned char *buf;   // all of the keys
+    size_t *off;                // key i is buf[off[i]] up to buf[off[i+1]]
+};
+
+// keyByte returns the byte of key x at depth (+1), or 0 past the end
+static int
+keyByte(const struct NameSortKeys *k, int x, size_t depth) {
+    size_t pos = k->off[x] + depth;
+    if (pos >= k->off[x+1]) return 0;
+    return k->buf[pos] + 1;
+}
+
+static int
+keyCmp(const struct NameSortKeys *k, int x, int y, size_t depth) {
+    size_t xs = k->off[x+1] - k->off[x];
+    size_t ys = k->off[y+1] - k->off[y];
+    size_t n = ((xs < ys) ? xs : ys);
+    int cmp = 0;
+    if (n > depth)
+        cmp = memcmp(k->buf + k->off[x] + depth, k->buf + k->off[y] + depth,
+                     n - depth);
+    if (cmp != 0) return cmp;
+    if (xs < ys) return -1;
+    if (xs > ys) return 1;
+    return 0;
+}
+
+// radixSort is an MSD radix sort of ix[lo..hi) on the key bytes from depth,
+// where all of the keys are known to agree before depth
+// (tmp must have room for hi-lo entries, and the sort is stable)
+static void
+radixSort(const struct NameSortKeys *k, int *ix, int *tmp,
+          int lo, int hi, size_t depth) {
+    while (hi - lo > 16) {
+        int count[258];
+        int i = 0;
+        int b = 0;
+        memset(count, 0, sizeof(count));
+        for (i = lo; i < hi; i++) count[keyByte(k, ix[i], depth) + 1]++;
+        if (count[1] == 0) {
+            int only = -1;
+            for (b = 1; b < 257 && only < 0; b++)
+                if (count[b+1] == hi - lo) only = b;
+            if (only >= 0) {
+                // one bucket holds every key, so no need to move them
+                depth++;
+                continue;
+            }
+        }
+        for (b = 1; b < 258; b++) count[b] += count[b-1];
+        for (i = lo; i < hi; i++) {
+            int x = ix[i];
+            tmp[count[keyByte(k, x, depth)]++] = x;
+        }
+        memcpy(ix + lo, tmp, (hi - lo) * sizeof(int));
+        // count[b] is now the end of bucket b, bucket 0 (ended keys) is done
+        int start = lo + count[0];
+        for (b = 1; b < 257; b++) {
+            int stop = lo + count[b];
+            if (stop - start > 1)
+                radixSort(k, ix, tmp, start, stop, depth + 1);
+            start = stop;
+        }
+        return;
+    }
+    // small ranges use an insertion sort
+    int i = 0;
+    for (i = lo + 1; i < hi; i++) {
+        int x = ix[i];
+        int j = i;
+        while (j > lo && keyCmp(k, ix[j-1], x, depth) > 0) {
+            ix[j] = ix[j-1];
+            j--;
+        }
+        ix[j] = x;
+    }
+}
+
+extern int
+SyncNameAccumSort(struct SyncNameAccum *na) {
+    int len = na->len;
+    int bad = 0;
+    int i = 0;
+    if (len <= 0) return 0;
+    // flatten all of the names into one buffer
+    struct ccn_charbuf *flat = ccn_charbuf_create();
+    struct NameSortKeys keys;
+    size_t *off = NEW_ANY(len + 1, size_t);
+    for (i = 0; i < len; i++) {
+        struct ccn_charbuf *name = na->ents[i].name;
+        size_t mark = flat->length;
+        off[i] = mark;
+        if (name == NULL
+            || ccn_flatname_append_from_ccnb(flat, name->buf, name->length,
+                                             0, -1) < 0) {
+            // a bad name sorts as the empty name
+            flat->length = mark;
+            bad++;
+        }
+    }
+    off[len] = flat->length;
+    keys.buf = flat->buf;
+    keys.off = off;
+    int *ix = NEW_ANY(len, int);
+    int *tmp = NEW_ANY(len, int);
+    for (i = 0; i < len; i++) ix[i] = i;
+    // names from a repo enumeration usually arrive in order already
+    for (i = 1; i < len; i++)
+        if (keyCmp(&keys, i-1, i, 0) > 0) break;
+    if (i < len) radixSort(&keys, ix, tmp, 0, len, 0);
+    
+    // permute the entries, removing duplicates (the first one is kept)
+    struct SyncNameAccumEntry *ents = NEW_STRUCT(na->lim, SyncNameAccumEntry);
+    int n = 0;
+    for (i = 0; i < len; i++) {
+        int x = ix[i];
+        if (n > 0 && keyCmp(&keys, ix[i-1], x, 0) == 0) {
+            ccn_charbuf_destroy(&na->ents[x].name);
+            continue;
+        }
+        ents[n++] = na->ents[x];
+    }
+    free(na->ents);
+    na->ents = ents;
+    na->len = n;
+    free(ix);
+    free(tmp);
+    free(off);
+    ccn_charbuf_destroy(&flat);
+    if (bad > 0) {
+        SyncNoteErr("SyncNameAccumSort");
+        return -bad;
+    }
+    return len - n;
+}
+
 extern int
 SyncNameAccumAppend(struct SyncNameAccum *na,
                     struct ccn_charbuf *name,
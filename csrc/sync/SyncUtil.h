@@ -48,6 +48,35 @@ SyncCurrentTime(void);
 int64_t
 SyncDeltaTime(int64_t mt1, int64_t mt2);
 
+//// Latency histograms
+
+#define SYNC_HIST_BUCKETS 24
+
+// bucket 0 counts times of 0, bucket i counts times in [2^(i-1), 2^i)
+// microseconds, and the last bucket has no upper bound
+struct SyncHist {
+    uint64_t count;
+    uint64_t sum;       // total of the times noted (microsecs)
+    uint64_t max;       // largest time noted (microsecs)
+    uint64_t bucket[SYNC_HIST_BUCKETS];
+};
+
+// note one time (microsecs, negative times count as 0)
+void
+SyncHistNote(struct SyncHist *h, int64_t micros);
+
+// returns an upper bound on the given quantile (in parts per thousand)
+// of the times noted (microsecs), or 0 if none were noted
+uint64_t
+SyncHistQuantile(const struct SyncHist *h, int perMille);
+
+// appends a summary of h to cb, as text if xml == 0, else as an XML
+// element with the given name, including the bucket counts
+// (no action if nothing was noted)
+void
+SyncHistAppend(struct ccn_charbuf *cb, const char *name,
+               const struct SyncHist *h, int xml);
+
 // Some basic ccn_charbuf utilities
 
 struct ccn_buf_decoder *
@@ -339,6 +368,18 @@ int
 SyncNameAccumSorter(IndexSorter_Base base,
                     IndexSorter_Index x, IndexSorter_Index y);
 
+/**
+ * sorts the names into CCN standard name order, and removes duplicates
+ * (the duplicate names are destroyed, and the first entry is kept)
+ * the sort is a radix sort over the flatname forms of the names, which
+ * are built together in one buffer, so no comparison has to decode a name
+ * (names that are already in order, as from a repo enumeration, skip the sort)
+ * @returns the number of duplicates removed, or < 0 if any name was bad
+ * (bad names sort as the empty name)
+ */
+int
+SyncNameAccumSort(struct SyncNameAccum *na);
+
 /**
  * appends a new name with associated data
  * important: the name is not copied!
@@ -12,7 +12,7 @@
 # FOR A PARTICULAR PURPOSE.
 #
 
-LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn
+LDLIBS = -L$(CCNLIBDIR) $(MORE_LDLIBS) -lccn -lpthread
 CCNLIBDIR = ../lib
 # Override conf.mk or else we don't pick up all the includes
 CPREFLAGS = -I../include -I..
@@ -22,9 +22,9 @@ PROGRAMS = $(INSTALLED_PROGRAMS) SyncTest
 DEBRIS = 
 
 BROKEN_PROGRAMS = 
-CSRC = IndexSorter.c SyncActions.c SyncBase.c SyncHashCache.c SyncNode.c SyncTest.c SyncRoot.c SyncTreeWorker.c SyncUtil.c
-HSRC = IndexSorter.h SyncActions.h SyncBase.h SyncHashCache.h SyncMacros.h SyncPrivate.h SyncNode.h SyncRoot.h SyncTreeWorker.h SyncUtil.h
-LIB_OBJS = IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o
+CSRC = IndexSorter.c SyncActions.c SyncBase.c SyncHashCache.c SyncIBLT.c SyncNode.c SyncTest.c SyncRoot.c SyncTreeWorker.c SyncUtil.c
+HSRC = IndexSorter.h SyncActions.h SyncBase.h SyncHashCache.h SyncIBLT.h SyncMacros.h SyncPrivate.h SyncNode.h SyncRoot.h SyncTreeWorker.h SyncUtil.h
+LIB_OBJS = IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncIBLT.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o
 SCRIPTSRC = 
  
 default: $(PROGRAMS) libsync.a
@@ -38,7 +38,7 @@ lib:	libsync.a
 libsync.a:	$(LIB_OBJS)
 	ar crus $@ $(LIB_OBJS)
 
-SYNC_OBJ = IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o SyncTest.o
+SYNC_OBJ = IndexSorter.o SyncActions.o SyncBase.o SyncHashCache.o SyncIBLT.o SyncNode.o SyncRoot.o SyncTreeWorker.o SyncUtil.o SyncTest.o
 SyncTest: $(SYNC_OBJ)
 	$(CC) $(CFLAGS) -o $@ $(SYNC_OBJ) $(LDLIBS) $(OPENSSL_LIBS) -lcrypto
 
@@ -63,15 +63,16 @@ SyncActions.o: SyncActions.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../include/ccn/ccn_private.h ../include/ccn/reg_mgmt.h \
   ../include/ccn/seqwriter.h ../ccnr/ccnr_sync.h ../ccnr/ccnr_private.h \
   SyncActions.h SyncBase.h SyncRoot.h SyncUtil.h IndexSorter.h SyncNode.h \
-  SyncMacros.h SyncPrivate.h SyncTreeWorker.h SyncHashCache.h
+  SyncMacros.h SyncPrivate.h SyncTreeWorker.h SyncHashCache.h SyncIBLT.h
 SyncBase.o: SyncBase.c SyncMacros.h SyncActions.h \
   ../include/ccn/charbuf.h SyncBase.h ../ccnr/ccnr_private.h \
   ../include/ccn/ccn_private.h ../include/ccn/coding.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/schedule.h \
   ../include/ccn/seqwriter.h SyncRoot.h ../include/ccn/ccn.h \
   ../include/ccn/indexbuf.h SyncUtil.h IndexSorter.h SyncPrivate.h \
-  ../include/ccn/uri.h ../ccnr/ccnr_msg.h ../ccnr/ccnr_private.h \
-  ../ccnr/ccnr_sync.h
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/hashtb.h ../include/ccn/uri.h ../ccnr/ccnr_msg.h \
+  ../ccnr/ccnr_private.h ../ccnr/ccnr_sync.h
 SyncHashCache.o: SyncHashCache.c SyncBase.h ../ccnr/ccnr_private.h \
   ../include/ccn/ccn_private.h ../include/ccn/coding.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/charbuf.h \
@@ -79,6 +80,9 @@ SyncHashCache.o: SyncHashCache.c SyncBase.h ../ccnr/ccnr_private.h \
   SyncNode.h ../include/ccn/ccn.h ../include/ccn/indexbuf.h SyncMacros.h \
   SyncRoot.h SyncUtil.h IndexSorter.h ../ccnr/ccnr_msg.h \
   ../ccnr/ccnr_private.h
+SyncIBLT.o: SyncIBLT.c SyncIBLT.h ../include/ccn/charbuf.h \
+  ../include/ccn/ccn.h ../include/ccn/coding.h SyncMacros.h SyncUtil.h \
+  IndexSorter.h ../include/ccn/indexbuf.h
 SyncNode.o: SyncNode.c SyncNode.h ../include/ccn/ccn.h \
   ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h SyncMacros.h SyncUtil.h IndexSorter.h
@@ -96,7 +100,7 @@ SyncRoot.o: SyncRoot.c ../include/ccn/ccn.h ../include/ccn/coding.h \
   ../ccnr/ccnr_msg.h ../ccnr/ccnr_private.h ../include/ccn/ccn_private.h \
   ../include/ccn/reg_mgmt.h ../include/ccn/seqwriter.h SyncMacros.h \
   SyncPrivate.h SyncBase.h ../ccnr/ccnr_private.h SyncRoot.h SyncUtil.h \
-  IndexSorter.h SyncActions.h SyncHashCache.h
+  IndexSorter.h SyncActions.h SyncHashCache.h SyncIBLT.h
 SyncTreeWorker.o: SyncTreeWorker.c SyncMacros.h SyncNode.h \
   ../include/ccn/ccn.h ../include/ccn/coding.h ../include/ccn/charbuf.h \
   ../include/ccn/indexbuf.h SyncTreeWorker.h SyncHashCache.h \
@@ -110,4 +114,5 @@ SyncUtil.o: SyncUtil.c SyncBase.h ../ccnr/ccnr_private.h \
   SyncRoot.h ../include/ccn/ccn.h ../include/ccn/indexbuf.h SyncUtil.h \
   IndexSorter.h SyncHashCache.h SyncNode.h SyncMacros.h \
   ../ccnr/ccnr_msg.h ../ccnr/ccnr_private.h ../ccnr/ccnr_sync.h \
-  ../include/ccn/uri.h
+  ../include/ccn/btree_content.h ../include/ccn/btree.h \
+  ../include/ccn/hashtb.h ../include/ccn/uri.h
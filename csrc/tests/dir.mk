@@ -18,6 +18,7 @@ DUPDIR = stubs
 TESTS = $(ALLTESTS)
 ALLTESTS = \
   test_alone \
+  test_cache_policy \
   test_ccndid \
   test_ccnls_meta \
   test_coders \
@@ -30,19 +31,23 @@ ALLTESTS = \
   test_answered_interest_suppression \
   test_key_fetch \
   test_late \
+  test_link_frag \
   test_long_consumer \
   test_long_consumer2 \
   test_long_producer \
+  test_negative_cache \
   test_new_provider \
   test_newface \
   test_prefixreg \
   test_selfreg \
   test_short_stuff \
+  test_shm \
   test_single_ccnd \
   test_single_ccnd_teardown \
   test_spur_traffic \
   test_scope2 \
   test_stale \
+  test_strategy \
   test_twohop_ccnd \
   test_twohop_ccnd_teardown \
   test_unreg
@@ -31,16 +31,60 @@ StuffPreload () {
     ccndsmoketest -b `for i in $CCND_PRELOAD; do echo send $i; done` >/dev/null
 }
 
+Shards () {
+    # The shard numbers, one per line
+    i=0
+    while [ $i -lt ${CCN_SHARDS:-1} ]; do
+        echo $i
+        i=$((i + 1))
+    done
+}
+
 # Provide defaults
 : ${CCND_CAP:=50000}
 : ${CCND_DEBUG:=''}
 export CCN_LOCAL_PORT CCND_CAP CCND_DEBUG CCND_AUTOREG CCND_LISTEN_ON CCND_MTU
+export CCN_SHARDS CCN_SHARD_COMPONENTS
 # The following are rarely used, but include them for completeness
 export CCN_LOCAL_SOCKNAME CCND_DATA_PAUSE_MICROSEC CCND_KEYSTORE_DIRECTORY
-export CCND_DEFAULT_TIME_TO_STALE CCND_MAX_TIME_TO_STALE
+export CCND_DEFAULT_TIME_TO_STALE CCND_MAX_TIME_TO_STALE CCND_CACHE_POLICY
+export CCND_CAP_BYTES CCND_OUTQ_BYTES CCND_IO CCND_MRC_RATE
+export CCND_FACE_INTEREST_RATE CCND_PREFIX_INTEREST_RATE CCND_PIT_LIMIT
+export CCND_PIT_BYTES
+export CCND_NEGATIVE_TTL CCND_NEGATIVE_TTL_PREFIXES CCND_PACK_MICROSEC
+export CCND_LINK_MTU CCND_LINK_ARQ CCND_TRACE CCND_TRACE_RECORDS
+export CCND_LOG_RATE CCND_CPUS CCND_COMPRESS_AGE CCND_CLASS_WEIGHTS
+export CCND_IDLE_SLACK CCND_PROFILE CCND_TOPK CCND_MGMT_BUDGET
+export CCND_NOTICE_INTERVAL
 
 # If a ccnd is already running, try to shut it down cleanly.
-ccndsmoketest kill 2>/dev/null
+for i in `Shards`; do
+	CCN_SHARD=$i ccndsmoketest kill 2>/dev/null
+done
+
+# With CCN_SHARDS, there is one ccnd for each shard, and CCND_CPUS
+# says which cpus they run on.  Each keeps the PIT and content store
+# for the names that hash to it.
+if [ ${CCN_SHARDS:-1} -gt 1 ]
+then
+	for i in `Shards`; do
+		if [ "$CCND_LOG" = "" ]
+		then
+			CCN_SHARD=$i ccnd &
+		else
+			: >"$CCND_LOG.$i" || exit 1
+			CCN_SHARD=$i ccnd 2>"$CCND_LOG.$i" &
+		fi
+	done
+	# Each shard gets the preloads and the forwarding, so that the
+	# owner of each name has them.
+	for i in `Shards`; do
+		CCN_SHARD=$i; export CCN_SHARD
+		StuffPreload 2> /dev/null
+		test -f $HOME/.ccnx/ccnd.conf && ccndc -f $HOME/.ccnx/ccnd.conf
+	done
+	exit 0
+fi
 
 # Fork ccnd, with a log file if requested.
 if [ "$CCND_LOG" = "" ]
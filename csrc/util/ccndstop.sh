@@ -17,4 +17,16 @@ D=`dirname "$0"`
 export PATH="$D:$PATH"
 
 # If a ccnd is running, try to shut it down cleanly.
+# With CCN_SHARDS, stop each of them.
+if [ ${CCN_SHARDS:-1} -gt 1 ]
+then
+	export CCN_SHARDS
+	status=1
+	i=0
+	while [ $i -lt $CCN_SHARDS ]; do
+		CCN_SHARD=$i ccndsmoketest kill && status=0
+		i=$((i + 1))
+	done
+	exit $status
+fi
 ccndsmoketest kill
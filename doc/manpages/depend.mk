@@ -10,6 +10,7 @@ ccndsmoketest.1.html: ccndsmoketest.1.txt
 ccndstart.1.html: ccndstart.1.txt
 ccndstatus.1.html: ccndstatus.1.txt
 ccndstop.1.html: ccndstop.1.txt
+ccndtrace.1.html: ccndtrace.1.txt
 ccnexplore.1.html: ccnexplore.1.txt
 ccnls.1.html: ccnls.1.txt
 ccnlsrepo.1.html: ccnlsrepo.1.txt
@@ -19,10 +20,13 @@ ccnputmeta.1.html: ccnputmeta.1.txt
 ccngetmeta.1.html: ccngetmeta.1.txt
 ccnlibtest.1.html: ccnlibtest.1.txt
 ccnnamelist.1.html: ccnnamelist.1.txt
+ccnreplay.1.html: ccnreplay.1.txt
+ccnloadgen.1.html: ccnloadgen.1.txt
 ccnrm.1.html: ccnrm.1.txt
 ccnseqwriter.1.html: ccnseqwriter.1.txt
 ccn_repo.1.html: ccn_repo.1.txt
 ccncat.1.html: ccncat.1.txt
+ccnbulkget.1.html: ccnbulkget.1.txt
 ccnslurp.1.html: ccnslurp.1.txt
 ccnchat.1.html: ccnchat.1.txt
 ccnpeek.1.html: ccnpeek.1.txt
@@ -45,6 +49,7 @@ ccndsmoketest.1.pdf: ccndsmoketest.1.txt
 ccndstart.1.pdf: ccndstart.1.txt
 ccndstatus.1.pdf: ccndstatus.1.txt
 ccndstop.1.pdf: ccndstop.1.txt
+ccndtrace.1.pdf: ccndtrace.1.txt
 ccnexplore.1.pdf: ccnexplore.1.txt
 ccnls.1.pdf: ccnls.1.txt
 ccnlsrepo.1.pdf: ccnlsrepo.1.txt
@@ -54,10 +59,13 @@ ccnputmeta.1.pdf: ccnputmeta.1.txt
 ccngetmeta.1.pdf: ccngetmeta.1.txt
 ccnlibtest.1.pdf: ccnlibtest.1.txt
 ccnnamelist.1.pdf: ccnnamelist.1.txt
+ccnreplay.1.pdf: ccnreplay.1.txt
+ccnloadgen.1.pdf: ccnloadgen.1.txt
 ccnrm.1.pdf: ccnrm.1.txt
 ccnseqwriter.1.pdf: ccnseqwriter.1.txt
 ccn_repo.1.pdf: ccn_repo.1.txt
 ccncat.1.pdf: ccncat.1.txt
+ccnbulkget.1.pdf: ccnbulkget.1.txt
 ccnslurp.1.pdf: ccnslurp.1.txt
 ccnchat.1.pdf: ccnchat.1.txt
 ccnpeek.1.pdf: ccnpeek.1.txt
@@ -80,6 +88,7 @@ ccndsmoketest.1: ccndsmoketest.1.txt
 ccndstart.1: ccndstart.1.txt
 ccndstatus.1: ccndstatus.1.txt
 ccndstop.1: ccndstop.1.txt
+ccndtrace.1: ccndtrace.1.txt
 ccnexplore.1: ccnexplore.1.txt
 ccnls.1: ccnls.1.txt
 ccnlsrepo.1: ccnlsrepo.1.txt
@@ -89,10 +98,13 @@ ccnputmeta.1: ccnputmeta.1.txt
 ccngetmeta.1: ccngetmeta.1.txt
 ccnlibtest.1: ccnlibtest.1.txt
 ccnnamelist.1: ccnnamelist.1.txt
+ccnreplay.1: ccnreplay.1.txt
+ccnloadgen.1: ccnloadgen.1.txt
 ccnrm.1: ccnrm.1.txt
 ccnseqwriter.1: ccnseqwriter.1.txt
 ccn_repo.1: ccn_repo.1.txt
 ccncat.1: ccncat.1.txt
+ccnbulkget.1: ccnbulkget.1.txt
 ccnslurp.1: ccnslurp.1.txt
 ccnchat.1: ccnchat.1.txt
 ccnpeek.1: ccnpeek.1.txt